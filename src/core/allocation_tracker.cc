@@ -4,16 +4,42 @@
 
 #include "core/allocation_tracker.h"
 
+#include <absl/debugging/stacktrace.h>
+#include <absl/strings/str_cat.h>
+
 #include "absl/random/random.h"
 #include "base/logging.h"
+#include "io/file_util.h"
 #include "util/fibers/stacktrace.h"
 
 namespace dfly {
 namespace {
 thread_local AllocationTracker g_tracker;
 thread_local absl::InsecureBitGen g_bitgen;
+
+// Set while the tracker itself allocates or frees, so that it does not track itself.
+thread_local bool g_inside_tracker = false;
+
+class TrackerScope {
+ public:
+  TrackerScope() {
+    g_inside_tracker = true;
+  }
+  ~TrackerScope() {
+    g_inside_tracker = false;
+  }
+};
+
 }  // namespace
 
+AllocationTracker::SiteStats& AllocationTracker::SiteStats::operator+=(const SiteStats& o) {
+  alloc_count += o.alloc_count;
+  alloc_bytes += o.alloc_bytes;
+  inuse_count += o.inuse_count;
+  inuse_bytes += o.inuse_bytes;
+  return *this;
+}
+
 AllocationTracker& AllocationTracker::Get() {
   return g_tracker;
 }
@@ -48,18 +74,84 @@ absl::Span<const AllocationTracker::TrackingInfo> AllocationTracker::GetRanges()
   return absl::MakeConstSpan(tracking_);
 }
 
+void AllocationTracker::SetSampleRate(size_t sample_rate) {
+  {
+    TrackerScope scope;
+    sampled_ptrs_.clear();
+    samples_.clear();
+  }
+  sample_rate_ = sample_rate;
+  bytes_until_sample_ = sample_rate ? NextSampleDistance() : 0;
+}
+
+void AllocationTracker::MergeSamples(Samples* dest) const {
+  TrackerScope scope;  // samples_ must not change while we iterate over it.
+  for (const auto& [stack, stats] : samples_)
+    (*dest)[stack] += stats;
+}
+
+std::string AllocationTracker::FormatHeapProfile(const Samples& samples, size_t sample_rate) {
+  SiteStats total;
+  for (const auto& [stack, stats] : samples)
+    total += stats;
+
+  std::string res = absl::StrCat("heap profile: ", total.inuse_count, ": ", total.inuse_bytes,
+                                 " [", total.alloc_count, ": ", total.alloc_bytes,
+                                 "] @ heap_v2/", sample_rate, "\n");
+  for (const auto& [stack, stats] : samples) {
+    absl::StrAppend(&res, stats.inuse_count, ": ", stats.inuse_bytes, " [", stats.alloc_count,
+                    ": ", stats.alloc_bytes, "] @");
+    for (void* pc : stack)
+      absl::StrAppend(&res, " 0x", absl::Hex(reinterpret_cast<uintptr_t>(pc)));
+    absl::StrAppend(&res, "\n");
+  }
+
+  // pprof needs the mappings to symbolize the addresses.
+  absl::StrAppend(&res, "\nMAPPED_LIBRARIES:\n");
+  if (auto maps = io::ReadFileToString("/proc/self/maps"); maps)
+    absl::StrAppend(&res, *maps);
+  return res;
+}
+
+int64_t AllocationTracker::NextSampleDistance() {
+  double distance = absl::Exponential<double>(g_bitgen, 1.0 / sample_rate_);
+  return std::max<int64_t>(1, static_cast<int64_t>(distance));
+}
+
+void AllocationTracker::Sample(void* ptr, size_t size) {
+  bytes_until_sample_ = NextSampleDistance();
+
+  // Skips the frames of Sample() and ProcessNew().
+  void* frames[kMaxStackDepth];
+  int depth = absl::GetStackTrace(frames, kMaxStackDepth, 2);
+
+  SiteStats& site = samples_[std::vector<void*>(frames, frames + depth)];
+  site.alloc_count++;
+  site.alloc_bytes += size;
+  site.inuse_count++;
+  site.inuse_bytes += size;
+  sampled_ptrs_[ptr] = {&site, size};
+}
+
 void AllocationTracker::ProcessNew(void* ptr, size_t size) {
-  if (tracking_.empty()) {
+  if (g_inside_tracker || ptr == nullptr) {
     return;
   }
 
-  thread_local bool inside_process_new = false;
-  if (inside_process_new) {
+  if (sample_rate_ > 0) {
+    bytes_until_sample_ -= size;
+    if (bytes_until_sample_ <= 0) {
+      TrackerScope scope;
+      Sample(ptr, size);
+    }
+  }
+
+  if (tracking_.empty()) {
     return;
   }
 
   // Prevent endless recursion, in case logging allocates memory
-  inside_process_new = true;
+  TrackerScope scope;
   double random = absl::Uniform(g_bitgen, 0.0, 1.0);
   for (const auto& band : tracking_) {
     if (random >= band.sample_odds || size > band.upper_bound || size < band.lower_bound) {
@@ -69,11 +161,25 @@ void AllocationTracker::ProcessNew(void* ptr, size_t size) {
     LOG(INFO) << "Allocating " << size << " bytes (" << ptr
               << "). Stack: " << util::fb2::GetStacktrace();
   }
-  inside_process_new = false;
 }
 
 void AllocationTracker::ProcessDelete(void* ptr) {
-  // We currently do not handle delete.
+  // Only sampled allocations are tracked until they are freed.
+  if (sampled_ptrs_.empty() || g_inside_tracker) {
+    return;
+  }
+
+  auto it = sampled_ptrs_.find(ptr);
+  if (it == sampled_ptrs_.end()) {
+    return;
+  }
+
+  auto [site, size] = it->second;
+  site->inuse_count--;
+  site->inuse_bytes -= size;
+
+  TrackerScope scope;
+  sampled_ptrs_.erase(it);
 }
 
 }  // namespace dfly
@@ -3,10 +3,14 @@
 //
 #pragma once
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
+#include <absl/container/node_hash_map.h>
 #include <mimalloc.h>
 
 #include <cstddef>
+#include <string>
+#include <vector>
 
 namespace dfly {
 
@@ -14,6 +18,12 @@ namespace dfly {
 // the stack trace of the memory allocation, if matched by size & sampling criteria.
 // Supports up to 4 different bands in parallel.
 //
+// Independently of the bands, it can sample allocations as a heap profiler: an allocation is
+// sampled once every sample_rate bytes on average, with the distance between samples drawn from
+// an exponential distribution so that allocations of all sizes can be sampled. The stacks of the
+// samples are aggregated by call site and can be dumped in the legacy pprof heap format.
+// Frees are observed only on the thread that sampled the allocation.
+//
 // Thread-local. Must be configured in all relevant threads separately.
 //
 // #define INJECT_ALLOCATION_TRACKER before #include exactly once to override new/delete
@@ -40,11 +50,53 @@ class AllocationTracker {
 
   absl::Span<const TrackingInfo> GetRanges() const;
 
+  // Number of frames recorded per sample.
+  static constexpr int kMaxStackDepth = 32;
+
+  struct SiteStats {
+    uint64_t alloc_count = 0;
+    uint64_t alloc_bytes = 0;
+    uint64_t inuse_count = 0;
+    uint64_t inuse_bytes = 0;
+
+    SiteStats& operator+=(const SiteStats& o);
+  };
+
+  // Sampled stats by stack of return addresses.
+  using Samples = absl::node_hash_map<std::vector<void*>, SiteStats>;
+
+  // Starts sampling allocations once every sample_rate bytes on average, 0 stops sampling.
+  // Changing the rate drops the samples taken so far.
+  void SetSampleRate(size_t sample_rate);
+
+  size_t sample_rate() const {
+    return sample_rate_;
+  }
+
+  // Adds the samples of this thread to dest.
+  void MergeSamples(Samples* dest) const;
+
+  // Formats samples taken with sample_rate in the legacy pprof heap profile format, which pprof
+  // unsamples and symbolizes with the binary: pprof <binary> <file>.
+  static std::string FormatHeapProfile(const Samples& samples, size_t sample_rate);
+
   void ProcessNew(void* ptr, size_t size);
   void ProcessDelete(void* ptr);
 
  private:
+  // Returns the number of bytes until the next sample.
+  int64_t NextSampleDistance();
+
+  void Sample(void* ptr, size_t size);
+
   absl::InlinedVector<TrackingInfo, 4> tracking_;
+
+  size_t sample_rate_ = 0;
+  int64_t bytes_until_sample_ = 0;
+  Samples samples_;
+
+  // Live sampled allocations and their sites, the values of samples_ are pointer stable.
+  absl::flat_hash_map<void*, std::pair<SiteStats*, size_t>> sampled_ptrs_;
 };
 
 }  // namespace dfly
@@ -0,0 +1,58 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/allocation_tracker.h"
+
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class AllocationTrackerTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    AllocationTracker::Get().SetSampleRate(0);
+  }
+};
+
+TEST_F(AllocationTrackerTest, Sampling) {
+  auto& tracker = AllocationTracker::Get();
+  tracker.SetSampleRate(1024);
+
+  // The allocator hooks are not injected into tests, so we report the allocations ourselves.
+  vector<unique_ptr<char[]>> blocks;
+  for (unsigned i = 0; i < 1000; ++i) {
+    blocks.emplace_back(new char[512]);
+    tracker.ProcessNew(blocks.back().get(), 512);
+  }
+
+  AllocationTracker::Samples samples;
+  tracker.MergeSamples(&samples);
+  ASSERT_FALSE(samples.empty());
+
+  // All the allocations were made from the same site.
+  EXPECT_EQ(1u, samples.size());
+  const auto stats = samples.begin()->second;
+  EXPECT_GT(stats.alloc_count, 100u);
+  EXPECT_LT(stats.alloc_count, 1000u);
+  EXPECT_EQ(stats.alloc_count * 512, stats.alloc_bytes);
+  EXPECT_EQ(stats.alloc_count, stats.inuse_count);
+
+  for (auto& block : blocks)
+    tracker.ProcessDelete(block.get());
+  samples.clear();
+  tracker.MergeSamples(&samples);
+  EXPECT_EQ(0u, samples.begin()->second.inuse_bytes);
+  EXPECT_EQ(stats.alloc_count, samples.begin()->second.alloc_count);
+
+  string profile = AllocationTracker::FormatHeapProfile(samples, 1024);
+  EXPECT_THAT(profile, testing::StartsWith("heap profile: 0: 0 ["));
+  EXPECT_THAT(profile, testing::HasSubstr("@ heap_v2/1024\n"));
+  EXPECT_THAT(profile, testing::HasSubstr("MAPPED_LIBRARIES:"));
+}
+
+}  // namespace dfly
@@ -34,8 +34,20 @@ inline uint64_t BitIndex(uint64_t low, uint64_t hi, unsigned i, uint64_t mask) {
 constexpr double kDenom = M_LN2 * M_LN2;
 constexpr double kSBFErrorFactor = 0.5;
 
-inline double BPE(double fp_prob) {
-  return -log(fp_prob) / kDenom;
+// The items are not spread evenly among the blocks, so the blocked layout needs more bits
+// per element for the same error rate.
+constexpr double kBlockedBitsFactor = 1.25;
+
+constexpr unsigned kBlockBits = Bloom::kBlockBytes * 8;
+constexpr unsigned kBlockWords = Bloom::kBlockBytes / 8;
+
+inline double BPE(double fp_prob, bool blocked) {
+  double bpe = -log(fp_prob) / kDenom;
+  return blocked ? bpe * kBlockedBitsFactor : bpe;
+}
+
+inline size_t FilterAlignment(bool blocked) {
+  return blocked ? Bloom::kBlockBytes : alignof(std::max_align_t);
 }
 
 }  // namespace
@@ -44,42 +56,46 @@ Bloom::~Bloom() {
   CHECK(bf_ == nullptr);
 }
 
-Bloom::Bloom(Bloom&& o) : hash_cnt_(o.hash_cnt_), bit_log_(o.bit_log_), bf_(o.bf_) {
+Bloom::Bloom(Bloom&& o)
+    : hash_cnt_(o.hash_cnt_), bit_log_(o.bit_log_), blocked_(o.blocked_), bf_(o.bf_) {
   o.bf_ = nullptr;
 }
 
-void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap) {
+void Bloom::Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* heap, bool blocked) {
   CHECK(bf_ == nullptr);
   CHECK(fp_prob > 0 && fp_prob < 1);
 
   if (fp_prob > 0.5)
     fp_prob = 0.5;
-  double bpe = BPE(fp_prob);
 
-  hash_cnt_ = ceil(M_LN2 * bpe);
+  // The number of hashes is derived from the error rate of the classic layout.
+  hash_cnt_ = ceil(M_LN2 * BPE(fp_prob, false));
 
-  uint64_t bits = uint64_t(ceil(entries * bpe));
-  if (bits < 512) {
-    bits = 512;
+  uint64_t bits = uint64_t(ceil(entries * BPE(fp_prob, blocked)));
+  if (bits < kBlockBits) {
+    bits = kBlockBits;
   }
   bits = absl::bit_ceil(bits);  // make it power of 2.
 
   uint64_t length = bits / 8;
-  bf_ = (uint8_t*)heap->allocate(length);
+  bf_ = (uint8_t*)heap->allocate(length, FilterAlignment(blocked));
   memset(bf_, 0, length);
   bit_log_ = absl::countr_zero(bits);
+  blocked_ = blocked;
 }
 
-void Bloom::Init(uint8_t* blob, size_t len, unsigned hash_cnt) {
+void Bloom::Init(uint8_t* blob, size_t len, unsigned hash_cnt, bool blocked) {
   DCHECK_EQ(len * 8, absl::bit_ceil(len * 8));  // must be power of two.
+  DCHECK(!blocked || (len >= kBlockBytes && uintptr_t(blob) % kBlockBytes == 0));
   CHECK(bf_ == nullptr);
   hash_cnt_ = hash_cnt;
   bf_ = blob;
   bit_log_ = absl::countr_zero(len * 8);
+  blocked_ = blocked;
 }
 
 void Bloom::Destroy(PMR_NS::memory_resource* resource) {
-  resource->deallocate(CHECK_NOTNULL(bf_), bitlen() / 8);
+  resource->deallocate(CHECK_NOTNULL(bf_), bitlen() / 8, FilterAlignment(blocked_));
   bf_ = nullptr;
 }
 
@@ -91,6 +107,17 @@ bool Bloom::Exists(std::string_view str) const {
 }
 
 bool Bloom::Exists(const uint64_t fp[2]) const {
+  if (blocked_) {
+    uint64_t mask[kBlockWords];
+    const uint64_t* block = BlockMask(fp, mask);
+
+    // Branchless over the whole cache line, so that the compiler vectorizes it.
+    uint64_t missing = 0;
+    for (unsigned w = 0; w < kBlockWords; ++w)
+      missing |= mask[w] & ~block[w];
+    return missing == 0;
+  }
+
   uint64_t mask = GetMask(bit_log_);
   for (unsigned i = 0; i < hash_cnt_; ++i) {
     uint64_t index = BitIndex(fp[0], fp[1], i, mask);
@@ -107,6 +134,18 @@ bool Bloom::Add(std::string_view str) {
 }
 
 bool Bloom::Add(const uint64_t fp[2]) {
+  if (blocked_) {
+    uint64_t mask[kBlockWords];
+    uint64_t* block = BlockMask(fp, mask);
+
+    uint64_t added = 0;
+    for (unsigned w = 0; w < kBlockWords; ++w) {
+      added |= mask[w] & ~block[w];
+      block[w] |= mask[w];
+    }
+    return added != 0;
+  }
+
   uint64_t mask = GetMask(bit_log_);
 
   unsigned changes = 0;
@@ -118,13 +157,39 @@ bool Bloom::Add(const uint64_t fp[2]) {
   return changes != 0;
 }
 
+void Bloom::Prefetch(const uint64_t fp[2]) const {
+  if (blocked_) {
+    uint64_t block_mask = GetMask(bit_log_ - absl::countr_zero(kBlockBits));
+    __builtin_prefetch(bf_ + (fp[0] & block_mask) * kBlockBytes);
+    return;
+  }
+
+  uint64_t mask = GetMask(bit_log_);
+  for (unsigned i = 0; i < hash_cnt_; ++i)
+    __builtin_prefetch(bf_ + BitIndex(fp[0], fp[1], i, mask) / 8);
+}
+
 size_t Bloom::Capacity(double fp_prob) const {
   if (fp_prob > 0.5)
     fp_prob = 0.5;
-  double bpe = BPE(fp_prob);
+  double bpe = BPE(fp_prob, blocked_);
   return floor(bitlen() / bpe);
 }
 
+// The block is chosen by the low fingerprint, the bits within it by the high one.
+uint64_t* Bloom::BlockMask(const uint64_t fp[2], uint64_t mask[kBlockBytes / 8]) const {
+  uint64_t block_mask = GetMask(bit_log_ - absl::countr_zero(kBlockBits));
+  uint64_t* block = reinterpret_cast<uint64_t*>(bf_) + (fp[0] & block_mask) * kBlockWords;
+
+  uint32_t low = fp[1], hi = (fp[1] >> 32) | 1;
+  fill(mask, mask + kBlockWords, 0);
+  for (unsigned i = 0; i < hash_cnt_; ++i) {
+    uint32_t bit = BitIndex(low, hi, i, kBlockBits - 1);
+    mask[bit / 64] |= 1ULL << (bit % 64);
+  }
+  return block;
+}
+
 inline bool Bloom::IsSet(size_t bit_idx) const {
   uint64_t byte_idx = bit_idx / 8;
   bit_idx %= 8;  // index within the byte
@@ -144,20 +209,25 @@ inline bool Bloom::Set(size_t bit_idx) {
 ///////////////////////////////////////////////////////////////////////////////
 // SBF implementation
 ///////////////////////////////////////////////////////////////////////////////
-SBF::SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr)
-    : filters_(1, mr), grow_factor_(grow_factor), fp_prob_(fp_prob * kSBFErrorFactor) {
-  filters_.front().Init(initial_capacity, fp_prob_, mr);
+SBF::SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr,
+         bool blocked)
+    : filters_(1, mr),
+      grow_factor_(grow_factor),
+      fp_prob_(fp_prob * kSBFErrorFactor),
+      blocked_(blocked) {
+  filters_.front().Init(initial_capacity, fp_prob_, mr, blocked_);
   max_capacity_ = filters_.front().Capacity(fp_prob_);
 }
 
 SBF::SBF(double grow_factor, double fp_prob, size_t max_capacity, size_t prev_size,
-         size_t current_size, PMR_NS::memory_resource* mr)
+         size_t current_size, PMR_NS::memory_resource* mr, bool blocked)
     : filters_(mr),
       grow_factor_(grow_factor),
       fp_prob_(fp_prob),
       prev_size_(prev_size),
       current_size_(current_size),
-      max_capacity_(max_capacity) {
+      max_capacity_(max_capacity),
+      blocked_(blocked) {
 }
 
 SBF::~SBF() {
@@ -173,22 +243,32 @@ SBF& SBF::operator=(SBF&& src) {
   fp_prob_ = src.fp_prob_;
   current_size_ = src.current_size_;
   max_capacity_ = src.max_capacity_;
+  blocked_ = src.blocked_;
 
   return *this;
 }
 
 void SBF::AddFilter(const std::string& blob, unsigned hash_cnt) {
   PMR_NS::memory_resource* mr = filters_.get_allocator().resource();
-  uint8_t* ptr = (uint8_t*)mr->allocate(blob.size(), 1);
+  uint8_t* ptr = (uint8_t*)mr->allocate(blob.size(), FilterAlignment(blocked_));
   memcpy(ptr, blob.data(), blob.size());
-  filters_.emplace_back().Init(ptr, blob.size(), hash_cnt);
+  filters_.emplace_back().Init(ptr, blob.size(), hash_cnt, blocked_);
+}
+
+void SBF::Fingerprint(std::string_view str, uint64_t fp[2]) {
+  XXH128_hash_t hash = Hash(str);
+  fp[0] = hash.low64;
+  fp[1] = hash.high64;
 }
 
 bool SBF::Add(std::string_view str) {
-  DCHECK_LT(current_size_, max_capacity_);
+  uint64_t fp[2];
+  Fingerprint(str, fp);
+  return Add(fp);
+}
 
-  XXH128_hash_t hash = Hash(str);
-  uint64_t fp[2] = {hash.low64, hash.high64};
+bool SBF::Add(const uint64_t fp[2]) {
+  DCHECK_LT(current_size_, max_capacity_);
 
   auto exists = [fp](const Bloom& b) { return b.Exists(fp); };
 
@@ -207,7 +287,7 @@ bool SBF::Add(std::string_view str) {
   if (current_size_ >= max_capacity_) {
     fp_prob_ *= kSBFErrorFactor;
     filters_.emplace_back().Init(max_capacity_ * grow_factor_, fp_prob_,
-                                 filters_.get_allocator().resource());
+                                 filters_.get_allocator().resource(), blocked_);
     current_size_ = 0;
     max_capacity_ = filters_.back().Capacity(fp_prob_);
   }
@@ -216,14 +296,22 @@ bool SBF::Add(std::string_view str) {
 }
 
 bool SBF::Exists(std::string_view str) const {
-  XXH128_hash_t hash = Hash(str);
-  uint64_t fp[2] = {hash.low64, hash.high64};
+  uint64_t fp[2];
+  Fingerprint(str, fp);
+  return Exists(fp);
+}
 
+bool SBF::Exists(const uint64_t fp[2]) const {
   auto exists = [fp](const Bloom& b) { return b.Exists(fp); };
 
   return any_of(filters_.crbegin(), filters_.crend(), exists);
 }
 
+void SBF::Prefetch(const uint64_t fp[2]) const {
+  for (const Bloom& b : filters_)
+    b.Prefetch(fp);
+}
+
 size_t SBF::MallocUsed() const {
   size_t res = filters_.capacity() * sizeof(Bloom);
   for (const auto& b : filters_) {
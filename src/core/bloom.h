@@ -23,14 +23,22 @@ class Bloom {
   // Note, that Destroy() must be called before calling the d'tor
   ~Bloom();
 
+  // Size of a block of the blocked layout, one cache line.
+  static constexpr unsigned kBlockBytes = 64;
+
   // Initializes a new Bloom object
   // entries - entries are silently rounded up to the minimum capacity.
   // fp_prob - False-positive probability of collision. Must be in (0, 1) range.
   // heap
-  void Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* resource);
+  // blocked - if true, all the bits of an item are set within a single block of kBlockBytes,
+  //           so that a lookup costs one cache miss. The filter needs a few more bits per item
+  //           to reach the same fp_prob.
+  void Init(uint64_t entries, double fp_prob, PMR_NS::memory_resource* resource,
+            bool blocked = false);
 
   // Direct initializer. len*8 must be power of 2.
-  void Init(uint8_t* blob, size_t len, unsigned hash_cnt);
+  // For the blocked layout, blob must be aligned to kBlockBytes.
+  void Init(uint8_t* blob, size_t len, unsigned hash_cnt, bool blocked = false);
 
   // Destroys the object, must be called before destructing the object.
   // resource - resource with which the object was initialized.
@@ -49,6 +57,9 @@ class Bloom {
   bool Add(std::string_view str);
   bool Add(const uint64_t fp[2]);
 
+  // Prefetches the memory that an Exists or an Add call with the fingerprints would access.
+  void Prefetch(const uint64_t fp[2]) const;
+
   size_t bitlen() const {
     return 1ULL << bit_log_;
   }
@@ -66,12 +77,20 @@ class Bloom {
     return hash_cnt_;
   }
 
+  bool blocked() const {
+    return blocked_;
+  }
+
  private:
   bool IsSet(size_t index) const;
   bool Set(size_t index);  // return true if bit was set (i.e was 0 before)
 
+  // Returns the block of the item and fills its bit mask within the block.
+  uint64_t* BlockMask(const uint64_t fp[2], uint64_t mask[kBlockBytes / 8]) const;
+
   uint8_t hash_cnt_ = 0;
   uint8_t bit_log_ = 0;    // log of bit length of the filter. bit length is always power of 2.
+  bool blocked_ = false;
   uint8_t* bf_ = nullptr;  // pointer to the blob.
 };
 
@@ -87,12 +106,14 @@ class SBF {
   SBF(const SBF&) = delete;
 
  public:
-  SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr);
+  // blocked - whether the filters use the blocked layout, see Bloom::Init.
+  SBF(uint64_t initial_capacity, double fp_prob, double grow_factor, PMR_NS::memory_resource* mr,
+      bool blocked = false);
 
   // C'tor used for loading persisted filters into SBF.
   // Should be followed by AddFilter.
   SBF(double grow_factor, double fp_prob, size_t max_capacity, size_t prev_size,
-      size_t current_size, PMR_NS::memory_resource* mr);
+      size_t current_size, PMR_NS::memory_resource* mr, bool blocked = false);
   ~SBF();
 
   SBF& operator=(SBF&& src);
@@ -102,6 +123,13 @@ class SBF {
   bool Add(std::string_view str);
   bool Exists(std::string_view str) const;
 
+  // Batch API: the fingerprints of an item are computed once with Fingerprint,
+  // and the batch prefetches the items a few steps ahead of the ones it checks.
+  static void Fingerprint(std::string_view str, uint64_t fp[2]);
+  bool Add(const uint64_t fp[2]);
+  bool Exists(const uint64_t fp[2]) const;
+  void Prefetch(const uint64_t fp[2]) const;
+
   size_t current_size() const {
     return current_size_;
   }
@@ -136,6 +164,10 @@ class SBF {
     return max_capacity_;
   }
 
+  bool blocked() const {
+    return blocked_;
+  }
+
   size_t MallocUsed() const;
 
  private:
@@ -146,6 +178,7 @@ class SBF {
   size_t prev_size_ = 0;
   size_t current_size_ = 0;
   size_t max_capacity_;
+  bool blocked_ = false;
 };
 
 }  // namespace dfly
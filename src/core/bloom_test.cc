@@ -88,6 +88,51 @@ TEST_F(BloomTest, SBF) {
   EXPECT_LE(collisions, kNumElems * 0.008);
 }
 
+TEST_F(BloomTest, Blocked) {
+  Bloom blocked;
+  blocked.Init(1000, 0.001, PMR_NS::get_default_resource(), true);
+  EXPECT_TRUE(blocked.blocked());
+  EXPECT_EQ(0, uintptr_t(blocked.data().data()) % Bloom::kBlockBytes);
+
+  size_t max_capacity = blocked.Capacity(0.001);
+  unsigned collisions = 0;
+  for (unsigned i = 0; i < max_capacity; ++i) {
+    if (!blocked.Add(absl::StrCat("item", i))) {
+      ++collisions;
+    }
+  }
+
+  // A few more collisions than the classic layout, as the bits share a block.
+  EXPECT_LE(collisions, 3u) << max_capacity;
+  for (unsigned i = 0; i < max_capacity; ++i) {
+    ASSERT_TRUE(blocked.Exists(absl::StrCat("item", i)));
+  }
+
+  unsigned false_positives = 0;
+  for (unsigned i = 0; i < 10000; ++i) {
+    false_positives += blocked.Exists(absl::StrCat("other", i));
+  }
+  EXPECT_LE(false_positives, 30u);
+  blocked.Destroy(PMR_NS::get_default_resource());
+}
+
+TEST_F(BloomTest, BlockedSBF) {
+  SBF sbf(10, 0.001, 2, PMR_NS::get_default_resource(), true);
+
+  constexpr unsigned kNumElems = 100000;
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    uint64_t fp[2];
+    SBF::Fingerprint(absl::StrCat("item", i), fp);
+    sbf.Prefetch(fp);
+    sbf.Add(fp);
+  }
+  EXPECT_GT(sbf.num_filters(), 1u);
+
+  for (unsigned i = 0; i < kNumElems; ++i) {
+    ASSERT_TRUE(sbf.Exists(absl::StrCat("item", i)));
+  }
+}
+
 static void BM_BloomExist(benchmark::State& state) {
   constexpr size_t kCapacity = 1U << 22;
   Bloom bloom;
@@ -107,4 +152,36 @@ static void BM_BloomExist(benchmark::State& state) {
 }
 BENCHMARK(BM_BloomExist);
 
+static void BM_BlockedBloomExist(benchmark::State& state) {
+  constexpr size_t kCapacity = 1U << 22;
+  Bloom bloom;
+  bloom.Init(kCapacity, 0.001, PMR_NS::get_default_resource(), true);
+  for (size_t i = 0; i < kCapacity * 0.8; ++i) {
+    bloom.Add(absl::StrCat("val", i));
+  }
+  unsigned i = 0;
+  char buf[32];
+  memset(buf, 'x', sizeof(buf));
+  string_view sv{buf, sizeof(buf)};
+  while (state.KeepRunning()) {
+    absl::numbers_internal::FastIntToBuffer(i++, buf);
+    bloom.Exists(sv);
+  }
+  bloom.Destroy(PMR_NS::get_default_resource());
+}
+BENCHMARK(BM_BlockedBloomExist);
+
+static void BM_SBFAdd(benchmark::State& state) {
+  SBF sbf(1 << 16, 0.001, 2, PMR_NS::get_default_resource());
+  unsigned i = 0;
+  char buf[32];
+  memset(buf, 'x', sizeof(buf));
+  string_view sv{buf, sizeof(buf)};
+  while (state.KeepRunning()) {
+    absl::numbers_internal::FastIntToBuffer(i++, buf);
+    sbf.Add(sv);
+  }
+}
+BENCHMARK(BM_SBFAdd);
+
 }  // namespace dfly
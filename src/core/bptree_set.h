@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
 #include <functional>
 #include <optional>
 
@@ -48,6 +50,11 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
 
   bool Delete(KeyT item);
 
+  // Builds the tree bottom-up from n items that are sorted according to Policy::KeyCompareTo
+  // and have no duplicates. The tree must be empty. Runs in O(n) compared to O(n log n)
+  // for inserting the items one by one.
+  void FromSorted(const KeyT* items, uint32_t n);
+
   std::optional<uint32_t> GetRank(KeyT item) const;
 
   size_t Height() const {
@@ -102,6 +109,13 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
   /// @param path
   void Delete(BPTreePath path);
 
+  // Replaces item with new_item that has the same position in the order, for example a copy of
+  // item at another address. Returns false if item was not found.
+  bool Replace(KeyT item, KeyT new_item);
+
+  // Reallocates the nodes for which should_move returns true. Returns true if any node moved.
+  bool ReallocNodes(const std::function<bool(const void*)>& should_move);
+
  private:
   BPTreeNode* CreateNode(bool leaf);
 
@@ -115,6 +129,15 @@ template <typename T, typename Policy = BPTreePolicy<T>> class BPTree {
 
   void IncreaseSubtreeCounts(const BPTreePath& path, unsigned depth, int32_t delta);
 
+  // Returns the new address of node after reallocating its subtree.
+  BPTreeNode* ReallocSubtree(BPTreeNode* node, const std::function<bool(const void*)>& should_move,
+                             bool* moved);
+
+  // Builds a subtree of the given height from n sorted items. capacity[h] is the maximal number
+  // of items a subtree of height h + 1 can hold.
+  BPTreeNode* BuildSubtree(const KeyT* items, uint32_t n, unsigned height,
+                           const uint64_t* capacity);
+
   // Charts the path towards key. Returns true if key is found.
   // In that case path->Last().first->Key(path->Last().second) == key.
   // Fills the tree path not including the key itself. In case key was not found,
@@ -219,6 +242,67 @@ template <typename T, typename Policy> bool BPTree<T, Policy>::Delete(KeyT item)
   return true;
 }
 
+template <typename T, typename Policy>
+void BPTree<T, Policy>::FromSorted(const KeyT* items, uint32_t n) {
+  assert(root_ == nullptr);
+  if (n == 0)
+    return;
+
+  using Layout = detail::BPNodeLayout<T>;
+
+  // Find the lowest height that can hold all the items.
+  constexpr unsigned kMaxHeight = 16;
+  uint64_t capacity[kMaxHeight];
+  unsigned height = 1;
+  capacity[0] = Layout::kMaxLeafKeys;
+  while (capacity[height - 1] < n) {
+    assert(height < kMaxHeight);
+    capacity[height] = (Layout::kMaxInnerKeys + 1) * capacity[height - 1] + Layout::kMaxInnerKeys;
+    ++height;
+  }
+
+  root_ = BuildSubtree(items, n, height, capacity);
+  count_ = n;
+  height_ = height;
+}
+
+template <typename T, typename Policy>
+detail::BPTreeNode<T>* BPTree<T, Policy>::BuildSubtree(const KeyT* items, uint32_t n,
+                                                       unsigned height, const uint64_t* capacity) {
+  if (height == 1) {
+    assert(n <= detail::BPNodeLayout<T>::kMaxLeafKeys);
+    BPTreeNode* leaf = CreateNode(true);
+    for (unsigned i = 0; i < n; ++i)
+      leaf->SetKey(i, items[i]);
+    leaf->num_items_ = n;
+    return leaf;
+  }
+
+  // Use the least number of children that can hold the items and spread the items evenly
+  // between them. Every child gets at least half of its capacity, which is above the minimum
+  // fill of a node. The separators between the children are stored in this node.
+  uint64_t child_cap = capacity[height - 2];
+  unsigned num_children = std::max<uint64_t>(2, (n + 1 + child_cap) / (child_cap + 1));
+  assert(num_children <= detail::BPNodeLayout<T>::kMaxInnerKeys + 1u);
+
+  uint32_t child_items = n - (num_children - 1);
+  uint32_t base = child_items / num_children, rem = child_items % num_children;
+
+  BPTreeNode* node = CreateNode(false);
+  for (unsigned i = 0; i < num_children; ++i) {
+    uint32_t len = base + (i < rem);
+    node->SetChild(i, BuildSubtree(items, len, height - 1, capacity));
+    items += len;
+    if (i + 1 < num_children) {
+      node->SetKey(i, *items);
+      ++items;
+    }
+  }
+  node->num_items_ = num_children - 1;
+  node->SetTreeCount(n);
+  return node;
+}
+
 template <typename T, typename Policy>
 std::optional<uint32_t> BPTree<T, Policy>::GetRank(KeyT item) const {
   if (!root_)
@@ -560,6 +644,48 @@ template <typename T, typename Policy> void BPTree<T, Policy>::Delete(BPTreePath
   }
 }
 
+template <typename T, typename Policy>
+bool BPTree<T, Policy>::Replace(KeyT item, KeyT new_item) {
+  if (!root_)
+    return false;
+
+  BPTreePath path;
+  if (!Locate(item, &path))
+    return false;
+
+  auto [node, pos] = path.Last();
+  node->SetKey(pos, new_item);
+  return true;
+}
+
+template <typename T, typename Policy>
+bool BPTree<T, Policy>::ReallocNodes(const std::function<bool(const void*)>& should_move) {
+  bool moved = false;
+  if (root_)
+    root_ = ReallocSubtree(root_, should_move, &moved);
+  return moved;
+}
+
+template <typename T, typename Policy>
+auto BPTree<T, Policy>::ReallocSubtree(BPTreeNode* node,
+                                       const std::function<bool(const void*)>& should_move,
+                                       bool* moved) -> BPTreeNode* {
+  if (!node->IsLeaf()) {
+    for (unsigned i = 0; i <= node->NumItems(); ++i)
+      node->SetChild(i, ReallocSubtree(node->Child(i), should_move, moved));
+  }
+
+  if (!should_move(node))
+    return node;
+
+  // Nodes are trivially copyable blocks of kBPNodeSize bytes.
+  void* ptr = mr_->allocate(detail::kBPNodeSize, 8);
+  memcpy(ptr, node, detail::kBPNodeSize);
+  mr_->deallocate(node, detail::kBPNodeSize, 8);
+  *moved = true;
+  return reinterpret_cast<BPTreeNode*>(ptr);
+}
+
 template <typename T, typename Policy> void BPTree<T, Policy>::DestroyNode(BPTreeNode* node) {
   void* ptr = node;
   mr_->deallocate(ptr, detail::kBPNodeSize, 8);
@@ -175,6 +175,34 @@ TEST_F(BPTreeSetTest, BPtreeInsert) {
   ASSERT_EQ(mi_alloc_.used(), 0u);
 }
 
+TEST_F(BPTreeSetTest, FromSorted) {
+  for (unsigned len : {1u, 31u, 32u, 500u, 20000u}) {
+    vector<uint64_t> items(len);
+    for (unsigned i = 0; i < len; ++i) {
+      items[i] = i * 2;
+    }
+    bptree_.FromSorted(items.data(), len);
+    ASSERT_EQ(len, bptree_.Size());
+    ASSERT_TRUE(Validate()) << len;
+
+    for (unsigned i = 0; i < len; ++i) {
+      ASSERT_EQ(i, bptree_.GetRank(i * 2));
+      ASSERT_EQ(i * 2, bptree_.FromRank(i).Terminal());
+    }
+
+    // The tree stays balanced after further updates.
+    for (unsigned i = 0; i < len; ++i) {
+      ASSERT_TRUE(bptree_.Insert(i * 2 + 1));
+      ASSERT_TRUE(bptree_.Delete(i * 2));
+    }
+    ASSERT_TRUE(Validate()) << len;
+    ASSERT_EQ(len, bptree_.Size());
+
+    bptree_.Clear();
+    ASSERT_EQ(mi_alloc_.used(), 0u);
+  }
+}
+
 TEST_F(BPTreeSetTest, Delete) {
   for (unsigned i = 31; i > 10; --i) {
     bptree_.Insert(i);
@@ -430,6 +458,49 @@ static void BM_FindRandomBPTree(benchmark::State& state) {
 }
 BENCHMARK(BM_FindRandomBPTree)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
 
+static void BM_FromRankBPTree(benchmark::State& state) {
+  unsigned iters = state.range(0);
+  std::vector<ZsetPolicy::KeyT> vals = GenerateRandomPairs(iters);
+  SDSTree bptree;
+  for (unsigned i = 0; i < iters; ++i) {
+    bptree.Insert(vals[i]);
+  }
+
+  mt19937 dre(20);
+  while (state.KeepRunningBatch(10)) {
+    for (unsigned j = 0; j < 10; ++j) {
+      benchmark::DoNotOptimize(bptree.FromRank(dre() % iters));
+    }
+  }
+  for (const auto v : vals) {
+    sdsfree(v.s);
+  }
+}
+BENCHMARK(BM_FromRankBPTree)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
+
+static void BM_GetRankBPTree(benchmark::State& state) {
+  unsigned iters = state.range(0);
+  std::vector<ZsetPolicy::KeyT> vals = GenerateRandomPairs(iters);
+  SDSTree bptree;
+  for (unsigned i = 0; i < iters; ++i) {
+    bptree.Insert(vals[i]);
+  }
+
+  unsigned i = 0;
+  while (state.KeepRunningBatch(10)) {
+    for (unsigned j = 0; j < 10; ++j) {
+      benchmark::DoNotOptimize(bptree.GetRank(vals[i]));
+      ++i;
+      if (vals.size() == i)
+        i = 0;
+    }
+  }
+  for (const auto v : vals) {
+    sdsfree(v.s);
+  }
+}
+BENCHMARK(BM_GetRankBPTree)->Arg(1024)->Arg(1 << 16)->Arg(1 << 20);
+
 static void BM_FindRandomZSL(benchmark::State& state) {
   zskiplist* zsl = zslCreate();
   unsigned iters = state.range(0);
@@ -0,0 +1,351 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/chunked_list.h"
+
+#include <absl/strings/str_cat.h>
+
+#include <cstring>
+
+extern "C" {
+#include "redis/quicklist.h"
+}
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+struct ChunkedList::Chunk {
+  uint16_t begin;  // [begin, end) is the occupied part of data
+  uint16_t end;
+  uint32_t count;  // number of entries
+  uint8_t data[kChunkSize - 8];
+};
+
+namespace {
+
+constexpr uint16_t kDataSize = ChunkedList::kChunkSize - 8;
+constexpr uint16_t kExternalTag = 0xFFFF;
+constexpr size_t kTagLen = sizeof(uint16_t);
+constexpr size_t kExternalLen = sizeof(char*) + sizeof(uint32_t);  // pointer and length
+
+static_assert(ChunkedList::kMaxInlineLen < kExternalTag);
+static_assert(ChunkedList::kMaxInlineLen + 2 * kTagLen <= kDataSize);
+
+uint16_t LoadTag(const uint8_t* ptr) {
+  uint16_t tag;
+  memcpy(&tag, ptr, kTagLen);
+  return tag;
+}
+
+size_t PayloadLen(uint16_t tag) {
+  return tag == kExternalTag ? kExternalLen : tag;
+}
+
+string_view DecodePayload(const uint8_t* payload, uint16_t tag) {
+  if (tag != kExternalTag)
+    return {reinterpret_cast<const char*>(payload), tag};
+
+  char* ptr;
+  uint32_t len;
+  memcpy(&ptr, payload, sizeof(ptr));
+  memcpy(&len, payload + sizeof(ptr), sizeof(len));
+  return {ptr, len};
+}
+
+// Writes the entry for value at dest, external is the separate copy for long values.
+void WriteEntry(uint8_t* dest, string_view value, char* external) {
+  uint16_t tag = external ? kExternalTag : value.size();
+  memcpy(dest, &tag, kTagLen);
+  dest += kTagLen;
+
+  if (external) {
+    uint32_t len = value.size();
+    memcpy(dest, &external, sizeof(external));
+    memcpy(dest + sizeof(external), &len, sizeof(len));
+    dest += kExternalLen;
+  } else {
+    memcpy(dest, value.data(), value.size());
+    dest += value.size();
+  }
+
+  memcpy(dest, &tag, kTagLen);
+}
+
+}  // namespace
+
+ChunkedList::ChunkedList(PMR_NS::memory_resource* mr) : mr_(mr), ring_(mr) {
+}
+
+ChunkedList::~ChunkedList() {
+  Clear();
+  if (spare_)
+    mr_->deallocate(spare_, kChunkSize, alignof(Chunk));
+}
+
+void ChunkedList::PushFront(string_view value) {
+  bool external = value.size() > kMaxInlineLen;
+  size_t entry_len = 2 * kTagLen + (external ? kExternalLen : value.size());
+
+  Chunk* chunk = num_chunks_ ? ChunkAt(0) : nullptr;
+  if (!chunk || chunk->begin < entry_len) {
+    if (num_chunks_ == ring_.size())
+      GrowRing();
+
+    chunk = AllocateChunk(true);
+    head_ = (head_ + ring_.size() - 1) & (ring_.size() - 1);
+    ChunkAt(0) = chunk;
+    ++num_chunks_;
+  }
+
+  char* ext_ptr = nullptr;
+  if (external) {
+    ext_ptr = static_cast<char*>(mr_->allocate(value.size(), 1));
+    memcpy(ext_ptr, value.data(), value.size());
+    external_bytes_ += value.size();
+  }
+
+  chunk->begin -= entry_len;
+  WriteEntry(chunk->data + chunk->begin, value, ext_ptr);
+  ++chunk->count;
+  ++size_;
+}
+
+void ChunkedList::PushBack(string_view value) {
+  bool external = value.size() > kMaxInlineLen;
+  size_t entry_len = 2 * kTagLen + (external ? kExternalLen : value.size());
+
+  Chunk* chunk = num_chunks_ ? ChunkAt(num_chunks_ - 1) : nullptr;
+  if (!chunk || kDataSize - chunk->end < entry_len) {
+    if (num_chunks_ == ring_.size())
+      GrowRing();
+
+    chunk = AllocateChunk(false);
+    ChunkAt(num_chunks_) = chunk;
+    ++num_chunks_;
+  }
+
+  char* ext_ptr = nullptr;
+  if (external) {
+    ext_ptr = static_cast<char*>(mr_->allocate(value.size(), 1));
+    memcpy(ext_ptr, value.data(), value.size());
+    external_bytes_ += value.size();
+  }
+
+  WriteEntry(chunk->data + chunk->end, value, ext_ptr);
+  chunk->end += entry_len;
+  ++chunk->count;
+  ++size_;
+}
+
+string ChunkedList::PopFront() {
+  DCHECK_GT(size_, 0u);
+  Chunk* chunk = ChunkAt(0);
+  string res = PopEntry(chunk, true);
+  if (chunk->count == 0)
+    DropFrontChunk();
+  return res;
+}
+
+string ChunkedList::PopBack() {
+  DCHECK_GT(size_, 0u);
+  Chunk* chunk = ChunkAt(num_chunks_ - 1);
+  string res = PopEntry(chunk, false);
+  if (chunk->count == 0)
+    DropBackChunk();
+  return res;
+}
+
+string_view ChunkedList::Front() const {
+  DCHECK_GT(size_, 0u);
+  const Chunk* chunk = ChunkAt(0);
+  const uint8_t* ptr = chunk->data + chunk->begin;
+  return DecodePayload(ptr + kTagLen, LoadTag(ptr));
+}
+
+string_view ChunkedList::Back() const {
+  DCHECK_GT(size_, 0u);
+  const Chunk* chunk = ChunkAt(num_chunks_ - 1);
+  const uint8_t* ptr = chunk->data + chunk->end - kTagLen;
+  uint16_t tag = LoadTag(ptr);
+  return DecodePayload(ptr - PayloadLen(tag), tag);
+}
+
+string_view ChunkedList::At(size_t index) const {
+  DCHECK_LT(index, size_);
+  string_view res;
+  Iterate(index, index + 1, [&](string_view value) {
+    res = value;
+    return false;
+  });
+  return res;
+}
+
+void ChunkedList::Iterate(size_t start, size_t end,
+                          absl::FunctionRef<bool(string_view)> cb) const {
+  end = std::min(end, size_);
+  if (start >= end)
+    return;
+
+  // Skip whole chunks by their counts.
+  size_t pos = 0;
+  while (start >= ChunkAt(pos)->count) {
+    start -= ChunkAt(pos)->count;
+    end -= ChunkAt(pos)->count;
+    ++pos;
+  }
+
+  size_t index = 0;
+  for (; pos < num_chunks_; ++pos) {
+    const Chunk* chunk = ChunkAt(pos);
+    for (size_t offs = chunk->begin; offs < chunk->end; ++index) {
+      uint16_t tag = LoadTag(chunk->data + offs);
+      size_t payload_len = PayloadLen(tag);
+      if (index >= start) {
+        if (index >= end || !cb(DecodePayload(chunk->data + offs + kTagLen, tag)))
+          return;
+      }
+      offs += payload_len + 2 * kTagLen;
+    }
+  }
+}
+
+void ChunkedList::ReverseIterate(absl::FunctionRef<bool(string_view)> cb) const {
+  for (size_t pos = num_chunks_; pos > 0; --pos) {
+    const Chunk* chunk = ChunkAt(pos - 1);
+    for (size_t offs = chunk->end; offs > chunk->begin;) {
+      uint16_t tag = LoadTag(chunk->data + offs - kTagLen);
+      size_t payload_len = PayloadLen(tag);
+      if (!cb(DecodePayload(chunk->data + offs - kTagLen - payload_len, tag)))
+        return;
+      offs -= payload_len + 2 * kTagLen;
+    }
+  }
+}
+
+size_t ChunkedList::MallocUsed() const {
+  size_t chunks = num_chunks_ + (spare_ ? 1 : 0);
+  return chunks * kChunkSize + ring_.capacity() * sizeof(Chunk*) + external_bytes_;
+}
+
+void ChunkedList::Clear() {
+  if (external_bytes_ > 0) {
+    for (size_t pos = 0; pos < num_chunks_; ++pos) {
+      const Chunk* chunk = ChunkAt(pos);
+      for (size_t offs = chunk->begin; offs < chunk->end;) {
+        uint16_t tag = LoadTag(chunk->data + offs);
+        if (tag == kExternalTag) {
+          string_view value = DecodePayload(chunk->data + offs + kTagLen, tag);
+          mr_->deallocate(const_cast<char*>(value.data()), value.size(), 1);
+        }
+        offs += PayloadLen(tag) + 2 * kTagLen;
+      }
+    }
+    external_bytes_ = 0;
+  }
+
+  for (size_t pos = 0; pos < num_chunks_; ++pos) {
+    ReleaseChunk(ChunkAt(pos));
+    ChunkAt(pos) = nullptr;
+  }
+  head_ = num_chunks_ = size_ = 0;
+}
+
+void ChunkedList::ToQuicklist(quicklist* ql) const {
+  Iterate(0, size_, [ql](string_view value) {
+    quicklistPushTail(ql, const_cast<char*>(value.data()), value.size());
+    return true;
+  });
+}
+
+void ChunkedList::AppendQuicklist(quicklist* ql) {
+  quicklistIter* qiter = quicklistGetIterator(ql, AL_START_HEAD);
+  quicklistEntry entry;
+  while (quicklistNext(qiter, &entry)) {
+    if (entry.value) {
+      PushBack(string_view{reinterpret_cast<char*>(entry.value), entry.sz});
+    } else {
+      PushBack(absl::StrCat(entry.longval));
+    }
+  }
+  quicklistReleaseIterator(qiter);
+}
+
+auto ChunkedList::AllocateChunk(bool for_front) -> Chunk* {
+  Chunk* chunk = spare_;
+  spare_ = nullptr;
+  if (!chunk) {
+    void* ptr = mr_->allocate(kChunkSize, alignof(Chunk));
+    chunk = new (ptr) Chunk;
+  }
+
+  // Chunks that grow towards the head are filled from their end.
+  chunk->begin = chunk->end = for_front ? kDataSize : 0;
+  chunk->count = 0;
+  return chunk;
+}
+
+void ChunkedList::ReleaseChunk(Chunk* chunk) {
+  if (spare_ == nullptr) {
+    spare_ = chunk;
+  } else {
+    mr_->deallocate(chunk, kChunkSize, alignof(Chunk));
+  }
+}
+
+auto ChunkedList::ChunkAt(size_t pos) const -> Chunk*& {
+  DCHECK_LT(pos, ring_.size());
+  return ring_[(head_ + pos) & (ring_.size() - 1)];
+}
+
+void ChunkedList::GrowRing() {
+  size_t new_size = ring_.empty() ? 4 : ring_.size() * 2;
+  decltype(ring_) next(new_size, nullptr, ring_.get_allocator());
+  for (size_t pos = 0; pos < num_chunks_; ++pos)
+    next[pos] = ChunkAt(pos);
+  ring_.swap(next);
+  head_ = 0;
+}
+
+string ChunkedList::PopEntry(Chunk* chunk, bool front) {
+  const uint8_t* payload;
+  uint16_t tag;
+  if (front) {
+    tag = LoadTag(chunk->data + chunk->begin);
+    payload = chunk->data + chunk->begin + kTagLen;
+    chunk->begin += PayloadLen(tag) + 2 * kTagLen;
+  } else {
+    tag = LoadTag(chunk->data + chunk->end - kTagLen);
+    payload = chunk->data + chunk->end - kTagLen - PayloadLen(tag);
+    chunk->end -= PayloadLen(tag) + 2 * kTagLen;
+  }
+  --chunk->count;
+  --size_;
+
+  // The entry bytes stay intact until the next push.
+  string_view value = DecodePayload(payload, tag);
+  string res{value};
+  if (tag == kExternalTag) {
+    mr_->deallocate(const_cast<char*>(value.data()), value.size(), 1);
+    external_bytes_ -= value.size();
+  }
+  return res;
+}
+
+void ChunkedList::DropFrontChunk() {
+  ReleaseChunk(ChunkAt(0));
+  ChunkAt(0) = nullptr;
+  head_ = (head_ + 1) & (ring_.size() - 1);
+  --num_chunks_;
+}
+
+void ChunkedList::DropBackChunk() {
+  ReleaseChunk(ChunkAt(num_chunks_ - 1));
+  ChunkAt(num_chunks_ - 1) = nullptr;
+  --num_chunks_;
+}
+
+}  // namespace dfly
@@ -0,0 +1,108 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+typedef struct quicklist quicklist;
+
+namespace dfly {
+
+// A list of strings, optimized for queue-like access (LPUSH/RPOP, RPUSH/LPOP).
+//
+// Elements are packed into fixed size chunks that are kept in a ring buffer, and pushing or
+// popping at either end is O(1) and never moves other elements. This is unlike quicklist,
+// whose listpack nodes shift their whole contents when pushing to the head and are reallocated
+// on every push. A single spare chunk is cached to avoid allocation churn when the queue
+// drains and refills a chunk at a time.
+//
+// Every entry is framed by a 2 byte tag on both sides, so chunks can be traversed in both
+// directions. Elements longer than kMaxInlineLen are allocated separately and the entry holds
+// a pointer to them.
+//
+// Only operations at the ends and reads by index are supported. Lists that need inserts or
+// removals in the middle stay in quicklist, ToQuicklist/AppendQuicklist convert between the two.
+class ChunkedList {
+ public:
+  static constexpr size_t kChunkSize = 4096;
+  static constexpr size_t kMaxInlineLen = 1024;
+
+  explicit ChunkedList(PMR_NS::memory_resource* mr = PMR_NS::get_default_resource());
+  ~ChunkedList();
+
+  ChunkedList(const ChunkedList&) = delete;
+  ChunkedList& operator=(const ChunkedList&) = delete;
+
+  void PushFront(std::string_view value);
+  void PushBack(std::string_view value);
+
+  // The list must not be empty.
+  std::string PopFront();
+  std::string PopBack();
+
+  // The list must not be empty.
+  std::string_view Front() const;
+  std::string_view Back() const;
+
+  // Returns the element at index, which must be less than Size().
+  // Runs in O(number of chunks) as the chunks keep their element counts.
+  std::string_view At(size_t index) const;
+
+  // Calls cb for every element with index in [start, end). Stops if cb returns false.
+  void Iterate(size_t start, size_t end, absl::FunctionRef<bool(std::string_view)> cb) const;
+
+  // Calls cb for every element from the back to the front. Stops if cb returns false.
+  void ReverseIterate(absl::FunctionRef<bool(std::string_view)> cb) const;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  size_t MallocUsed() const;
+
+  void Clear();
+
+  // Appends all the elements to ql.
+  void ToQuicklist(quicklist* ql) const;
+
+  // Appends all the elements of ql to the list.
+  void AppendQuicklist(quicklist* ql);
+
+ private:
+  struct Chunk;
+
+  Chunk* AllocateChunk(bool for_front);
+  void ReleaseChunk(Chunk* chunk);
+
+  Chunk*& ChunkAt(size_t pos) const;
+  void GrowRing();
+
+  std::string PopEntry(Chunk* chunk, bool front);
+  void DropFrontChunk();
+  void DropBackChunk();
+
+  PMR_NS::memory_resource* mr_;
+
+  // Ring buffer of chunks, its size is a power of 2.
+  mutable std::vector<Chunk*, PMR_NS::polymorphic_allocator<Chunk*>> ring_;
+  size_t head_ = 0;        // position of the first chunk in ring_
+  size_t num_chunks_ = 0;  // number of used positions in ring_
+
+  size_t size_ = 0;             // number of elements
+  size_t external_bytes_ = 0;   // bytes allocated for elements that do not fit into chunks
+  Chunk* spare_ = nullptr;      // released chunk kept for reuse
+};
+
+}  // namespace dfly
@@ -0,0 +1,190 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/chunked_list.h"
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+#include <mimalloc.h>
+
+#include <deque>
+#include <random>
+
+extern "C" {
+#include "redis/quicklist.h"
+#include "redis/zmalloc.h"
+}
+
+#include "base/gtest.h"
+#include "base/init.h"
+#include "base/logging.h"
+#include "core/mi_memory_resource.h"
+
+using namespace std;
+
+namespace dfly {
+
+class ChunkedListTest : public ::testing::Test {
+ protected:
+  ChunkedListTest() : mr_(mi_heap_get_backing()), list_(&mr_) {
+  }
+
+  static void SetUpTestSuite() {
+    // configure redis lib zmalloc which requires mimalloc heap to work.
+    auto* tlh = mi_heap_get_backing();
+    init_zmalloc_threadlocal(tlh);
+  }
+
+  MiMemoryResource mr_;
+  ChunkedList list_;
+};
+
+TEST_F(ChunkedListTest, Basic) {
+  EXPECT_TRUE(list_.Empty());
+
+  list_.PushBack("b");
+  list_.PushFront("a");
+  list_.PushBack("c");
+  EXPECT_EQ(3, list_.Size());
+  EXPECT_EQ("a", list_.Front());
+  EXPECT_EQ("c", list_.Back());
+  EXPECT_EQ("b", list_.At(1));
+
+  EXPECT_EQ("c", list_.PopBack());
+  EXPECT_EQ("a", list_.PopFront());
+  EXPECT_EQ("b", list_.PopFront());
+  EXPECT_TRUE(list_.Empty());
+
+  // An empty list keeps only a spare chunk.
+  EXPECT_LE(list_.MallocUsed(), ChunkedList::kChunkSize + 64);
+}
+
+TEST_F(ChunkedListTest, LargeValues) {
+  string large(ChunkedList::kMaxInlineLen + 1, 'x');
+  list_.PushBack("small");
+  list_.PushBack(large);
+  list_.PushFront(large + "y");
+  EXPECT_GT(list_.MallocUsed(), large.size() * 2);
+
+  EXPECT_EQ(large + "y", list_.Front());
+  EXPECT_EQ(large, list_.Back());
+  EXPECT_EQ(large, list_.PopBack());
+
+  list_.Clear();
+  EXPECT_TRUE(list_.Empty());
+  EXPECT_GE(mr_.used(), ChunkedList::kChunkSize);  // the spare chunk and the ring
+  EXPECT_LT(mr_.used(), ChunkedList::kChunkSize + 128);
+}
+
+TEST_F(ChunkedListTest, Random) {
+  deque<string> expected;
+  mt19937 gen(10);
+
+  for (unsigned i = 0; i < 100000; ++i) {
+    unsigned op = gen() % 8;
+    if (op < 4 || expected.empty()) {
+      size_t len = gen() % 16 == 0 ? gen() % 2000 : gen() % 32;
+      string val = absl::StrCat(i, string(len, 'a' + i % 26));
+      if (op % 2) {
+        list_.PushFront(val);
+        expected.push_front(val);
+      } else {
+        list_.PushBack(val);
+        expected.push_back(val);
+      }
+    } else if (op < 6) {
+      ASSERT_EQ(expected.front(), list_.PopFront()) << i;
+      expected.pop_front();
+    } else if (op < 7) {
+      ASSERT_EQ(expected.back(), list_.PopBack()) << i;
+      expected.pop_back();
+    } else {
+      size_t index = gen() % expected.size();
+      ASSERT_EQ(expected[index], list_.At(index)) << i;
+    }
+    ASSERT_EQ(expected.size(), list_.Size());
+  }
+
+  size_t start = expected.size() / 3, index = start;
+  list_.Iterate(start, start + 1000, [&](string_view val) {
+    EXPECT_EQ(expected[index++], val);
+    return true;
+  });
+  EXPECT_EQ(min(start + 1000, expected.size()), index);
+
+  index = expected.size();
+  list_.ReverseIterate([&](string_view val) {
+    EXPECT_EQ(expected[--index], val);
+    return true;
+  });
+  EXPECT_EQ(0u, index);
+}
+
+TEST_F(ChunkedListTest, Quicklist) {
+  quicklist* ql = quicklistCreate();
+  for (unsigned i = 0; i < 1000; ++i) {
+    string val = i % 2 ? absl::StrCat(i) : absl::StrCat("val", i);
+    quicklistPushTail(ql, val.data(), val.size());
+  }
+
+  list_.AppendQuicklist(ql);
+  ASSERT_EQ(1000, list_.Size());
+  EXPECT_EQ("val0", list_.Front());
+  EXPECT_EQ("999", list_.Back());
+
+  quicklist* ql2 = quicklistCreate();
+  list_.ToQuicklist(ql2);
+  ASSERT_EQ(1000, quicklistCount(ql2));
+
+  quicklistEntry entry;
+  quicklistIter* qiter = quicklistGetIteratorAtIdx(ql2, AL_START_HEAD, 501);
+  ASSERT_TRUE(quicklistNext(qiter, &entry));
+  EXPECT_EQ(501, entry.longval);
+  quicklistReleaseIterator(qiter);
+
+  quicklistRelease(ql);
+  quicklistRelease(ql2);
+}
+
+// Queue workload: push to the head and pop from the tail while keeping the length constant.
+static void BM_QueueChunkedList(benchmark::State& state) {
+  MiMemoryResource mr(mi_heap_get_backing());
+  ChunkedList list(&mr);
+  string val(state.range(0), 'a');
+  for (unsigned i = 0; i < 10000; ++i)
+    list.PushFront(val);
+
+  while (state.KeepRunning()) {
+    list.PushFront(val);
+    benchmark::DoNotOptimize(list.PopBack());
+  }
+}
+BENCHMARK(BM_QueueChunkedList)->Arg(16)->Arg(128)->Arg(1024);
+
+static void BM_QueueQuicklist(benchmark::State& state) {
+  quicklist* ql = quicklistNew(-2, 0);
+  string val(state.range(0), 'a');
+  for (unsigned i = 0; i < 10000; ++i)
+    quicklistPush(ql, val.data(), val.size(), QUICKLIST_HEAD);
+
+  unsigned char* data;
+  size_t sz;
+  long long lv;
+  while (state.KeepRunning()) {
+    quicklistPush(ql, val.data(), val.size(), QUICKLIST_HEAD);
+    quicklistPop(ql, QUICKLIST_TAIL, &data, &sz, &lv);
+    zfree(data);
+  }
+  quicklistRelease(ql);
+}
+BENCHMARK(BM_QueueQuicklist)->Arg(16)->Arg(128)->Arg(1024);
+
+void RegisterChunkedListBench() {
+  auto* tlh = mi_heap_get_backing();
+  init_zmalloc_threadlocal(tlh);
+};
+
+REGISTER_MODULE_INITIALIZER(ChunkedList, RegisterChunkedListBench());
+
+}  // namespace dfly
@@ -6,6 +6,8 @@
 
 // #define XXH_INLINE_ALL
 #include <xxhash.h>
+#include <zdict.h>
+#include <zstd.h>
 
 extern "C" {
 #include "redis/intset.h"
@@ -17,6 +19,8 @@ extern "C" {
 #include "redis/zmalloc.h"  // for non-string objects.
 #include "redis/zset.h"
 }
+#include <absl/container/node_hash_map.h>
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
 
@@ -26,10 +30,18 @@ extern "C" {
 #include "base/logging.h"
 #include "base/pod_array.h"
 #include "core/bloom.h"
+#include "core/chunked_list.h"
+#include "core/count_min_sketch.h"
 #include "core/detail/bitpacking.h"
+#include "core/packed_int_set.h"
+#include "core/packed_string_set.h"
 #include "core/sorted_map.h"
+#include "core/sparse_bitmap.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
+#include "core/tdigest.h"
+#include "core/time_series.h"
+#include "core/top_k.h"
 
 ABSL_RETIRED_FLAG(bool, use_set2, true, "If true use DenseSet for an optimized set data structure");
 
@@ -56,7 +68,12 @@ inline void FreeObjSet(unsigned encoding, void* ptr, MemoryResource* mr) {
       CompactObj::DeleteMR<StringSet>(ptr);
       break;
     }
-
+    case kEncodingPackedSet:
+      CompactObj::DeleteMR<PackedStringSet>(ptr);
+      break;
+    case kEncodingPackedIntSet:
+      CompactObj::DeleteMR<PackedIntSet>(ptr);
+      break;
     case kEncodingIntSet:
       zfree((void*)ptr);
       break;
@@ -71,6 +88,10 @@ size_t MallocUsedSet(unsigned encoding, void* ptr) {
       StringSet* ss = (StringSet*)ptr;
       return ss->ObjMallocUsed() + ss->SetMallocUsed() + zmalloc_usable_size(ptr);
     }
+    case kEncodingPackedSet:
+      return ((PackedStringSet*)ptr)->MallocUsed() + zmalloc_usable_size(ptr);
+    case kEncodingPackedIntSet:
+      return ((PackedIntSet*)ptr)->MallocUsed() + zmalloc_usable_size(ptr);
     case kEncodingIntSet:
       return intsetBlobLen((intset*)ptr);
   }
@@ -136,39 +157,150 @@ inline void FreeObjZset(unsigned encoding, void* ptr) {
   }
 }
 
-// Iterates over allocations of internal hash data structures and re-allocates
-// them if their pages are underutilized.
+// Moves a contiguous blob allocated with zmalloc, like a listpack or an intset, if its page is
+// underutilized. Returns the new address of the blob.
+void* DefragBlob(void* ptr, size_t len, float ratio, bool* moved) {
+  if (!zmalloc_page_is_underutilized(ptr, ratio))
+    return ptr;
+
+  void* replacement = zmalloc(len);
+  memcpy(replacement, ptr, len);
+  zfree(ptr);
+  *moved = true;
+  return replacement;
+}
+
+// Iterates over allocations of the internal data structures of a container and re-allocates
+// them if their pages are underutilized. Containers backed by DenseSet are visited a few buckets
+// at a time, starting from *cursor, which is set to 0 once the whole container was visited.
 // Returns pointer to new object ptr and whether any re-allocations happened.
-pair<void*, bool> DefragHash(MemoryResource* mr, unsigned encoding, void* ptr, float ratio) {
-  switch (encoding) {
-    // Listpack is stored as a single contiguous array
-    case kEncodingListPack: {
-      uint8_t* lp = (uint8_t*)ptr;
-      if (!zmalloc_page_is_underutilized(lp, ratio))
-        return {lp, false};
+pair<void*, bool> DefragContainer(unsigned type, unsigned encoding, void* ptr, float ratio,
+                                  uint32_t* cursor) {
+  bool moved = false;
+  uint32_t next = 0;
 
-      size_t lp_bytes = lpBytes(lp);
-      uint8_t* replacement = lpNew(lpBytes(lp));
-      memcpy(replacement, lp, lp_bytes);
-      lpFree(lp);
+  switch (type) {
+    case OBJ_HASH:
+      if (encoding == kEncodingListPack)
+        ptr = DefragBlob(ptr, lpBytes((uint8_t*)ptr), ratio, &moved);
+      else if (encoding == kEncodingStrMap2)
+        next = ((StringMap*)ptr)->Defrag(*cursor, ratio, &moved);
+      break;
+    case OBJ_SET:
+      if (encoding == kEncodingIntSet)
+        ptr = DefragBlob(ptr, intsetBlobLen((intset*)ptr), ratio, &moved);
+      else if (encoding == kEncodingStrMap2)
+        next = ((StringSet*)ptr)->Defrag(*cursor, ratio, &moved);
+      else if (encoding == kEncodingPackedSet)
+        moved = ((PackedStringSet*)ptr)->DefragIfNeeded(ratio);
+      else if (encoding == kEncodingPackedIntSet)
+        moved = ((PackedIntSet*)ptr)->DefragIfNeeded(ratio);
+      break;
+    case OBJ_ZSET:
+      if (encoding == OBJ_ENCODING_LISTPACK)
+        ptr = DefragBlob(ptr, lpBytes((uint8_t*)ptr), ratio, &moved);
+      else if (encoding == OBJ_ENCODING_SKIPLIST)
+        next = ((detail::SortedMap*)ptr)->Defrag(*cursor, ratio, &moved);
+      break;
+  }
 
-      return {replacement, true};
-    };
+  *cursor = next;
+  return {ptr, moved};
+}
 
-    // StringMap supports re-allocation of it's internal nodes
-    case kEncodingStrMap2: {
-      bool realloced = false;
+bool CanCopyContainer(unsigned type, unsigned encoding, const void* ptr) {
+  switch (type) {
+    case OBJ_LIST:
+      return true;
+    case OBJ_SET:
+      return encoding == kEncodingIntSet ||
+             (encoding == kEncodingStrMap2 && !((const StringSet*)ptr)->ExpirationUsed());
+    case OBJ_HASH:
+      return encoding == kEncodingListPack ||
+             (encoding == kEncodingStrMap2 && !((const StringMap*)ptr)->ExpirationUsed());
+    case OBJ_ZSET:
+      return encoding == OBJ_ENCODING_LISTPACK;
+  }
+  return false;
+}
 
-      StringMap* sm = (StringMap*)ptr;
-      for (auto it = sm->begin(); it != sm->end(); ++it)
-        realloced |= it.ReallocIfNeeded(ratio);
+void* CopyBlob(const void* ptr, size_t len) {
+  void* res = zmalloc(len);
+  memcpy(res, ptr, len);
+  return res;
+}
 
-      return {sm, realloced};
-    }
+// Copies a container into the heap of this thread. Blobs and quicklist nodes are copied as they
+// are, DenseSet based containers are rebuilt, which only reads them as long as nothing expires.
+void* CopyContainer(unsigned type, unsigned encoding, void* ptr) {
+  DCHECK(CanCopyContainer(type, encoding, ptr));
 
+  switch (type) {
+    case OBJ_LIST: {
+      if (encoding != kEncodingChunkedList)
+        return quicklistDup((quicklist*)ptr);
+
+      const ChunkedList* src = (const ChunkedList*)ptr;
+      ChunkedList* res = CompactObj::AllocateMR<ChunkedList>();
+      src->Iterate(0, src->Size(), [res](string_view value) {
+        res->PushBack(value);
+        return true;
+      });
+      return res;
+    }
+    case OBJ_SET: {
+      if (encoding == kEncodingIntSet)
+        return CopyBlob(ptr, intsetBlobLen((intset*)ptr));
+
+      StringSet* src = (StringSet*)ptr;
+      StringSet* res = CompactObj::AllocateMR<StringSet>();
+      res->Reserve(src->UpperBoundSize());
+      for (sds s : *src)
+        res->Add(string_view{s, sdslen(s)});
+      return res;
+    }
+    case OBJ_HASH: {
+      if (encoding == kEncodingListPack)
+        return CopyBlob(ptr, lpBytes((uint8_t*)ptr));
+
+      StringMap* src = (StringMap*)ptr;
+      StringMap* res = CompactObj::AllocateMR<StringMap>();
+      res->Reserve(src->UpperBoundSize());
+      for (const auto& kv : *src)
+        res->AddOrUpdate(string_view{kv.first, sdslen(kv.first)},
+                         string_view{kv.second, sdslen(kv.second)});
+      return res;
+    }
     default:
-      ABSL_UNREACHABLE();
+      return CopyBlob(ptr, lpBytes((uint8_t*)ptr));
+  }
+}
+
+bool JsonNeedsDefrag(const JsonType& j, float ratio) {
+  auto underutilized = [ratio](const void* ptr) {
+    return zmalloc_page_is_underutilized(const_cast<void*>(ptr), ratio) != 0;
   };
+
+  if (j.is_object()) {
+    auto range = j.object_range();
+    if (range.begin() != range.end() && underutilized(&*range.begin()))
+      return true;
+    for (const auto& kv : range) {
+      if (underutilized(kv.key().data()) || JsonNeedsDefrag(kv.value(), ratio))
+        return true;
+    }
+  } else if (j.is_array()) {
+    auto range = j.array_range();
+    if (range.begin() != range.end() && underutilized(&*range.begin()))
+      return true;
+    for (const auto& value : range) {
+      if (JsonNeedsDefrag(value, ratio))
+        return true;
+    }
+  } else if (j.is_string()) {
+    return underutilized(j.as_string_view().data());
+  }
+  return false;
 }
 
 inline void FreeObjStream(void* ptr) {
@@ -199,11 +331,122 @@ static_assert(ascii_len(15) == 17);
 static_assert(ascii_len(16) == 18);
 static_assert(ascii_len(17) == 19);
 
+// Prefixes of the keys with PREFIX_TAG, reference counted by the keys.
+class KeyPrefixDict {
+ public:
+  static constexpr size_t kMaxPrefixes = 1 << 16;
+
+  // Returns the id of prefix and references it, or nullopt if the dictionary is full.
+  optional<uint16_t> Acquire(string_view prefix) {
+    if (auto it = ids_.find(prefix); it != ids_.end()) {
+      entries_[it->second].refs++;
+      return it->second;
+    }
+
+    uint16_t id;
+    if (!free_ids_.empty()) {
+      id = free_ids_.back();
+      free_ids_.pop_back();
+    } else if (entries_.size() < kMaxPrefixes) {
+      id = entries_.size();
+      entries_.emplace_back();
+    } else {
+      return nullopt;
+    }
+
+    auto it = ids_.emplace(prefix, id).first;
+    entries_[id] = Entry{&it->first, 1};
+    bytes_ += prefix.size();
+    return id;
+  }
+
+  void Release(uint16_t id) {
+    Entry& entry = entries_[id];
+    DCHECK_GT(entry.refs, 0u);
+    if (--entry.refs > 0)
+      return;
+
+    bytes_ -= entry.prefix->size();
+    ids_.erase(ids_.find(*entry.prefix));
+    entry.prefix = nullptr;
+    free_ids_.push_back(id);
+  }
+
+  string_view Get(uint16_t id) const {
+    DCHECK(entries_[id].prefix);
+    return *entries_[id].prefix;
+  }
+
+  size_t bytes() const {
+    return bytes_;
+  }
+
+ private:
+  struct Entry {
+    const string* prefix = nullptr;  // the key of ids_, nodes are stable.
+    uint32_t refs = 0;
+  };
+
+  absl::node_hash_map<string, uint16_t> ids_;
+  vector<Entry> entries_;
+  vector<uint16_t> free_ids_;
+  size_t bytes_ = 0;
+};
+
+constexpr int kZstdLevel = 1;
+constexpr size_t kZstdDictSize = 8 << 10;
+constexpr size_t kZstdDictSamplesSize = 256 << 10;  // the first strings to train a dictionary.
+constexpr size_t kMaxCompressedSize = 1 << 20;     // larger strings are too slow to decompress.
+
+struct StrCompression {
+  // Trains the dictionary once enough strings were added.
+  void AddSample(string_view str) {
+    if (trained)
+      return;
+    str = str.substr(0, 16 << 10);
+    samples.append(str);
+    sample_sizes.push_back(str.size());
+    if (samples.size() >= kZstdDictSamplesSize)
+      Train();
+  }
+
+  void Train() {
+    trained = true;
+    string dict(kZstdDictSize, '\0');
+    size_t res = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(),
+                                       sample_sizes.data(), sample_sizes.size());
+    if (ZDICT_isError(res)) {
+      LOG(WARNING) << "Could not train a string compression dictionary: "
+                   << ZDICT_getErrorName(res);
+    } else {
+      cdict = ZSTD_createCDict(dict.data(), res, kZstdLevel);
+      ddict = ZSTD_createDDict(dict.data(), res);
+    }
+    samples = string{};
+    sample_sizes = vector<size_t>{};
+  }
+
+  size_t min_size = 0;
+  ZSTD_CCtx* cctx = nullptr;
+  ZSTD_CDict* cdict = nullptr;
+  ZSTD_DDict* ddict = nullptr;  // never freed, it's referenced by the compressed strings.
+  bool trained = false;
+  string samples;
+  vector<size_t> sample_sizes;
+
+  size_t bytes = 0;
+  size_t raw_bytes = 0;
+};
+
 struct TL {
   MemoryResource* local_mr = PMR_NS::get_default_resource();
   size_t small_str_bytes;
   base::PODArray<uint8_t> tmp_buf;
   string tmp_str;
+  bool key_prefixes = false;
+  KeyPrefixDict key_prefix_dict;
+  StrCompression str_compression;
+  ZSTD_DCtx* dctx = nullptr;  // decompresses strings of any thread.
 };
 
 thread_local TL tl;
@@ -214,6 +457,20 @@ constexpr bool kUseSmallStrings = true;
 /// file and implement with SIMD instructions.
 constexpr bool kUseAsciiEncoding = true;
 
+// Shorter prefixes are not worth a dictionary lookup.
+constexpr size_t kMinKeyPrefixLen = 4;
+constexpr size_t kMaxKeyPrefixLen = 256;
+
+// Returns the length of the shortest prefix ending with ':' after which the rest of key fits
+// into max_suffix_len, or 0 if there is none. Shorter prefixes are shared by more keys.
+size_t KeyPrefixLen(string_view key, size_t max_suffix_len) {
+  size_t min_len = key.size() > max_suffix_len ? key.size() - max_suffix_len : 0;
+  size_t pos = key.find(':', max(min_len, kMinKeyPrefixLen) - 1);
+  if (pos == string_view::npos || pos >= kMaxKeyPrefixLen)
+    return 0;
+  return pos + 1;
+}
+
 }  // namespace
 
 static_assert(sizeof(CompactObj) == 18);
@@ -229,6 +486,8 @@ size_t RobjWrapper::MallocUsed() const {
       CHECK_EQ(OBJ_ENCODING_RAW, encoding_);
       return InnerObjMallocUsed();
     case OBJ_LIST:
+      if (encoding_ == kEncodingChunkedList)
+        return ((ChunkedList*)inner_obj_)->MallocUsed() + zmalloc_usable_size(inner_obj_);
       DCHECK_EQ(encoding_, OBJ_ENCODING_QUICKLIST);
       return QlMAllocSize((quicklist*)inner_obj_);
     case OBJ_SET:
@@ -253,6 +512,8 @@ size_t RobjWrapper::Size() const {
       DCHECK_EQ(OBJ_ENCODING_RAW, encoding_);
       return sz_;
     case OBJ_LIST:
+      if (encoding_ == kEncodingChunkedList)
+        return ((ChunkedList*)inner_obj_)->Size();
       return quicklistCount((quicklist*)inner_obj_);
     case OBJ_ZSET: {
       switch (encoding_) {
@@ -276,6 +537,10 @@ size_t RobjWrapper::Size() const {
           StringSet* ss = (StringSet*)inner_obj_;
           return ss->UpperBoundSize();
         }
+        case kEncodingPackedSet:
+          return ((PackedStringSet*)inner_obj_)->Size();
+        case kEncodingPackedIntSet:
+          return ((PackedIntSet*)inner_obj_)->Size();
         default:
           LOG(FATAL) << "Unexpected encoding " << encoding_;
       };
@@ -308,6 +573,10 @@ void RobjWrapper::Free(MemoryResource* mr) {
       mr->deallocate(inner_obj_, 0, 8);  // we do not keep the allocated size.
       break;
     case OBJ_LIST:
+      if (encoding_ == kEncodingChunkedList) {
+        CompactObj::DeleteMR<ChunkedList>(inner_obj_);
+        break;
+      }
       CHECK_EQ(encoding_, OBJ_ENCODING_QUICKLIST);
       quicklistRelease((quicklist*)inner_obj_);
       break;
@@ -382,18 +651,48 @@ void RobjWrapper::SetString(string_view s, MemoryResource* mr) {
   }
 }
 
+void RobjWrapper::SetRange(size_t start, string_view s, MemoryResource* mr) {
+  DCHECK_EQ(OBJ_STRING, type_);
+  DCHECK_EQ(OBJ_ENCODING_RAW, encoding_);
+
+  size_t end = start + s.size();
+  if (end > sz_) {
+    size_t cur_cap = InnerObjMallocUsed();
+    if (end > cur_cap) {
+      MakeInnerRoom(cur_cap, end, mr);
+    }
+    if (start > sz_) {
+      memset(reinterpret_cast<char*>(inner_obj_) + sz_, 0, start - sz_);
+    }
+    sz_ = end;
+  }
+
+  if (!s.empty())
+    memcpy(reinterpret_cast<char*>(inner_obj_) + start, s.data(), s.size());
+}
+
 bool RobjWrapper::DefragIfNeeded(float ratio) {
+  uint32_t cursor = 0;
+  bool realloced = false;
+  do {
+    realloced |= DefragIfNeeded(ratio, &cursor);
+  } while (cursor);
+  return realloced;
+}
+
+bool RobjWrapper::DefragIfNeeded(float ratio, uint32_t* cursor) {
   if (type() == OBJ_STRING) {
+    *cursor = 0;
     if (zmalloc_page_is_underutilized(inner_obj(), ratio)) {
       ReallocateString(tl.local_mr);
       return true;
     }
-  } else if (type() == OBJ_HASH) {
-    auto [new_ptr, realloced] = DefragHash(tl.local_mr, encoding_, inner_obj_, ratio);
-    inner_obj_ = new_ptr;
-    return realloced;
+    return false;
   }
-  return false;
+
+  auto [new_ptr, realloced] = DefragContainer(type_, encoding_, inner_obj_, ratio, cursor);
+  inner_obj_ = new_ptr;
+  return realloced;
 }
 
 int RobjWrapper::ZsetAdd(double score, sds ele, int in_flags, int* out_flags, double* newscore) {
@@ -525,6 +824,10 @@ using namespace std;
 auto CompactObj::GetStats() -> Stats {
   Stats res;
   res.small_string_bytes = tl.small_str_bytes;
+  res.small_string_table_full = SmallString::TableFullThreadLocal();
+  res.key_prefix_bytes = tl.key_prefix_dict.bytes();
+  res.compressed_string_bytes = tl.str_compression.bytes;
+  res.compressed_string_raw_bytes = tl.str_compression.raw_bytes;
 
   return res;
 }
@@ -534,6 +837,14 @@ void CompactObj::InitThreadLocal(MemoryResource* mr) {
   tl.tmp_buf = base::PODArray<uint8_t>{mr};
 }
 
+void CompactObj::EnableKeyPrefixes(bool enable) {
+  tl.key_prefixes = enable;
+}
+
+void CompactObj::EnableStringCompression(size_t min_size) {
+  tl.str_compression.min_size = min_size;
+}
+
 CompactObj::~CompactObj() {
   if (HasAllocated()) {
     Free();
@@ -563,6 +874,12 @@ size_t CompactObj::Size() const {
       case SMALL_TAG:
         raw_size = u_.small_str.size();
         break;
+      case PREFIX_TAG:
+        raw_size = KeyPrefix().size() + u_.prefixed_key.suffix_len;
+        break;
+      case COMPRESSED_TAG:
+        raw_size = u_.compressed_str.raw_size;
+        break;
       case INT_TAG: {
         absl::AlphaNum an(u_.ival);
         raw_size = an.size();
@@ -574,6 +891,9 @@ size_t CompactObj::Size() const {
       case ROBJ_TAG:
         raw_size = u_.r_obj.Size();
         break;
+      case SPARSE_BITMAP_TAG:
+        raw_size = u_.sparse_bitmap->Size();
+        break;
       default:
         LOG(DFATAL) << "Should not reach " << int(taglen_);
     }
@@ -604,6 +924,10 @@ uint64_t CompactObj::HashCode() const {
   switch (taglen_) {
     case SMALL_TAG:
       return u_.small_str.HashCode();
+    case PREFIX_TAG:
+    case COMPRESSED_TAG:
+      GetString(&tl.tmp_str);
+      return XXH3_64bits_withSeed(tl.tmp_str.data(), tl.tmp_str.size(), kHashSeed);
     case ROBJ_TAG:
       return u_.r_obj.HashCode();
     case INT_TAG: {
@@ -622,7 +946,8 @@ uint64_t CompactObj::HashCode(string_view str) {
 }
 
 unsigned CompactObj::ObjType() const {
-  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == EXTERNAL_TAG)
+  if (IsInline() || taglen_ == INT_TAG || taglen_ == SMALL_TAG || taglen_ == EXTERNAL_TAG ||
+      taglen_ == SPARSE_BITMAP_TAG || taglen_ == PREFIX_TAG || taglen_ == COMPRESSED_TAG)
     return OBJ_STRING;
 
   if (taglen_ == ROBJ_TAG)
@@ -636,6 +961,22 @@ unsigned CompactObj::ObjType() const {
     return OBJ_SBF;
   }
 
+  if (taglen_ == CMS_TAG) {
+    return OBJ_CMS;
+  }
+
+  if (taglen_ == TS_TAG) {
+    return OBJ_TS;
+  }
+
+  if (taglen_ == TOPK_TAG) {
+    return OBJ_TOPK;
+  }
+
+  if (taglen_ == TDIGEST_TAG) {
+    return OBJ_TDIGEST;
+  }
+
   LOG(FATAL) << "TBD " << int(taglen_);
   return 0;
 }
@@ -655,6 +996,10 @@ string_view CompactObj::ObjTypeToString(unsigned type) {
     OBJECT_TYPE_CASE(OBJ_STREAM);
     OBJECT_TYPE_CASE(OBJ_JSON);
     OBJECT_TYPE_CASE(OBJ_SBF);
+    OBJECT_TYPE_CASE(OBJ_CMS);
+    OBJECT_TYPE_CASE(OBJ_TS);
+    OBJECT_TYPE_CASE(OBJ_TOPK);
+    OBJECT_TYPE_CASE(OBJ_TDIGEST);
     default:
       DCHECK(false) << "Unknown object type " << type;
       return "OTHER";
@@ -703,6 +1048,17 @@ auto CompactObj::GetJson() const -> JsonType* {
   return nullptr;
 }
 
+absl::Span<uint8_t> CompactObj::GetJsonFlat() const {
+  DCHECK_EQ(taglen_, JSON_TAG);
+  DCHECK_EQ(u_.json_obj.encoding, kEncodingJsonFlat);
+  return {u_.json_obj.flat_ptr, u_.json_obj.json_len};
+}
+
+unsigned CompactObj::GetJsonEncoding() const {
+  DCHECK_EQ(taglen_, JSON_TAG);
+  return u_.json_obj.encoding;
+}
+
 void CompactObj::SetJson(JsonType&& j) {
   if (taglen_ == JSON_TAG && u_.json_obj.encoding == kEncodingJsonCons) {
     // already json
@@ -723,12 +1079,13 @@ void CompactObj::SetJson(const uint8_t* buf, size_t len) {
   u_.json_obj.json_len = len;
 }
 
-void CompactObj::SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor) {
+void CompactObj::SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor,
+                        bool blocked) {
   if (taglen_ == SBF_TAG) {  // already json
-    *u_.sbf = SBF(initial_capacity, fp_prob, grow_factor, tl.local_mr);
+    *u_.sbf = SBF(initial_capacity, fp_prob, grow_factor, tl.local_mr, blocked);
   } else {
     SetMeta(SBF_TAG);
-    u_.sbf = AllocateMR<SBF>(initial_capacity, fp_prob, grow_factor, tl.local_mr);
+    u_.sbf = AllocateMR<SBF>(initial_capacity, fp_prob, grow_factor, tl.local_mr, blocked);
   }
 }
 
@@ -737,7 +1094,36 @@ SBF* CompactObj::GetSBF() const {
   return u_.sbf;
 }
 
+CountMinSketch* CompactObj::GetCMS() const {
+  DCHECK_EQ(CMS_TAG, taglen_);
+  return u_.cms;
+}
+
+TimeSeries* CompactObj::GetTimeSeries() const {
+  DCHECK_EQ(TS_TAG, taglen_);
+  return u_.time_series;
+}
+
+TopK* CompactObj::GetTopK() const {
+  DCHECK_EQ(TOPK_TAG, taglen_);
+  return u_.topk;
+}
+
+TDigest* CompactObj::GetTDigest() const {
+  DCHECK_EQ(TDIGEST_TAG, taglen_);
+  return u_.tdigest;
+}
+
+SparseBitmap* CompactObj::GetSparseBitmap() const {
+  DCHECK_EQ(SPARSE_BITMAP_TAG, taglen_);
+  return u_.sparse_bitmap;
+}
+
 void CompactObj::SetString(std::string_view str) {
+  SetStringImpl(str, true);
+}
+
+void CompactObj::SetStringImpl(std::string_view str, bool compress) {
   uint8_t mask = mask_ & ~kEncMask;
   CHECK(!IsExternal());
   // Trying auto-detection heuristics first.
@@ -763,6 +1149,12 @@ void CompactObj::SetString(std::string_view str) {
 
   DCHECK_GT(str.size(), kInlineLen);
 
+  if (size_t min_size = tl.str_compression.min_size;
+      compress && min_size > 0 && str.size() >= min_size && str.size() <= kMaxCompressedSize) {
+    if (SetCompressed(str, mask))
+      return;
+  }
+
   string_view encoded = str;
   bool is_ascii = kUseAsciiEncoding && detail::validate_ascii_fast(str.data(), str.size());
 
@@ -784,7 +1176,7 @@ void CompactObj::SetString(std::string_view str) {
 
     if (encoded.size() <= kInlineLen) {
       SetMeta(encoded.size(), mask);
-      detail::ascii_pack(str.data(), str.size(), reinterpret_cast<uint8_t*>(u_.inline_str));
+      memcpy(u_.inline_str, encoded.data(), encoded.size());
 
       return;
     }
@@ -809,6 +1201,97 @@ void CompactObj::SetString(std::string_view str) {
   u_.r_obj.SetString(encoded, tl.local_mr);
 }
 
+bool CompactObj::SetStringRange(size_t start, string_view str) {
+  DCHECK_EQ(OBJ_STRING, ObjType());
+  if (IsExternal())
+    return false;
+
+  if (taglen_ != ROBJ_TAG || (mask_ & kEncMask)) {
+    string tmp;
+    GetString(&tmp);
+    SetMeta(ROBJ_TAG, mask_ & ~kEncMask);
+    u_.r_obj.SetString(tmp, tl.local_mr);
+  }
+
+  u_.r_obj.SetRange(start, str, tl.local_mr);
+  return true;
+}
+
+void CompactObj::SetKey(string_view key) {
+  // Keys of up to 18 chars are inline thanks to ascii packing.
+  constexpr size_t kMaxSuffixLen = sizeof(u_.prefixed_key.suffix);
+  if (tl.key_prefixes && key.size() > kInlineLen + 2) {
+    if (size_t len = KeyPrefixLen(key, kMaxSuffixLen); len > 0) {
+      // Acquire before SetMeta releases the prefix that this object may be holding.
+      if (auto id = tl.key_prefix_dict.Acquire(key.substr(0, len)); id) {
+        SetMeta(PREFIX_TAG, mask_ & ~kEncMask);
+        u_.prefixed_key.prefix_id = *id;
+        u_.prefixed_key.suffix_len = key.size() - len;
+        memcpy(u_.prefixed_key.suffix, key.data() + len, key.size() - len);
+        return;
+      }
+    }
+  }
+
+  // Keys are compared and hashed on every lookup, decompressing them would slow down all of them.
+  SetStringImpl(key, false);
+}
+
+bool CompactObj::SetCompressed(string_view str, uint8_t mask) {
+  StrCompression& sc = tl.str_compression;
+  sc.AddSample(str);
+  if (sc.cctx == nullptr)
+    sc.cctx = ZSTD_createCCtx();
+
+  constexpr size_t kHeaderSize = sizeof(ZSTD_DDict*);
+  size_t bound = ZSTD_compressBound(str.size());
+  tl.tmp_buf.resize(kHeaderSize + bound);
+  uint8_t* frame = tl.tmp_buf.data() + kHeaderSize;
+  size_t res = sc.cdict ? ZSTD_compress_usingCDict(sc.cctx, frame, bound, str.data(), str.size(),
+                                                   sc.cdict)
+                        : ZSTD_compressCCtx(sc.cctx, frame, bound, str.data(), str.size(),
+                                            kZstdLevel);
+
+  // Not worth decompressing on every read if it saves less than 1/8.
+  size_t blob_size = kHeaderSize + res;
+  if (ZSTD_isError(res) || blob_size > str.size() - str.size() / 8)
+    return false;
+
+  memcpy(tl.tmp_buf.data(), &sc.ddict, kHeaderSize);
+  uint8_t* blob = static_cast<uint8_t*>(tl.local_mr->allocate(blob_size, kAlignSize));
+  memcpy(blob, tl.tmp_buf.data(), blob_size);
+
+  SetMeta(COMPRESSED_TAG, mask);
+  u_.compressed_str.blob = blob;
+  u_.compressed_str.blob_size = blob_size;
+  u_.compressed_str.raw_size = str.size();
+  sc.bytes += blob_size;
+  sc.raw_bytes += str.size();
+  return true;
+}
+
+void CompactObj::Decompress(char* dest) const {
+  DCHECK_EQ(taglen_, COMPRESSED_TAG);
+  const CompressedStr& cs = u_.compressed_str;
+  const ZSTD_DDict* ddict;
+  memcpy(&ddict, cs.blob, sizeof(ddict));
+  const uint8_t* frame = cs.blob + sizeof(ddict);
+  size_t frame_size = cs.blob_size - sizeof(ddict);
+
+  if (tl.dctx == nullptr)
+    tl.dctx = ZSTD_createDCtx();
+  size_t res = ddict ? ZSTD_decompress_usingDDict(tl.dctx, dest, cs.raw_size, frame, frame_size,
+                                                  ddict)
+                     : ZSTD_decompressDCtx(tl.dctx, dest, cs.raw_size, frame, frame_size);
+  CHECK_EQ(res, cs.raw_size) << "Corrupted compressed string: "
+                             << (ZSTD_isError(res) ? ZSTD_getErrorName(res) : "bad size");
+}
+
+string_view CompactObj::KeyPrefix() const {
+  DCHECK_EQ(taglen_, PREFIX_TAG);
+  return tl.key_prefix_dict.Get(u_.prefixed_key.prefix_id);
+}
+
 string_view CompactObj::GetSlice(string* scratch) const {
   CHECK(!IsExternal());
   uint8_t is_encoded = mask_ & kEncMask;
@@ -836,6 +1319,24 @@ string_view CompactObj::GetSlice(string* scratch) const {
     return *scratch;
   }
 
+  if (taglen_ == SPARSE_BITMAP_TAG) {
+    scratch->resize(u_.sparse_bitmap->Size());
+    u_.sparse_bitmap->Materialize(scratch->data());
+    return *scratch;
+  }
+
+  if (taglen_ == PREFIX_TAG) {
+    scratch->assign(KeyPrefix());
+    scratch->append(u_.prefixed_key.suffix, u_.prefixed_key.suffix_len);
+    return *scratch;
+  }
+
+  if (taglen_ == COMPRESSED_TAG) {
+    scratch->resize(u_.compressed_str.raw_size);
+    Decompress(scratch->data());
+    return *scratch;
+  }
+
   if (is_encoded) {
     if (taglen_ == ROBJ_TAG) {
       CHECK_EQ(OBJ_STRING, u_.r_obj.type());
@@ -881,15 +1382,35 @@ string_view CompactObj::GetSlice(string* scratch) const {
 }
 
 bool CompactObj::DefragIfNeeded(float ratio) {
+  uint32_t cursor = 0;
+  bool realloced = false;
+  do {
+    realloced |= DefragIfNeeded(ratio, &cursor);
+  } while (cursor);
+  return realloced;
+}
+
+bool CompactObj::DefragIfNeeded(float ratio, uint32_t* cursor) {
+  if (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() != nullptr)
+    return u_.r_obj.DefragIfNeeded(ratio, cursor);
+  if (taglen_ == JSON_TAG)
+    return DefragJson(ratio, cursor);
+
+  *cursor = 0;
   switch (taglen_) {
-    case ROBJ_TAG:
-      // currently only these objet types are supported for this operation
-      if (u_.r_obj.inner_obj() != nullptr) {
-        return u_.r_obj.DefragIfNeeded(ratio);
-      }
-      return false;
     case SMALL_TAG:
       return u_.small_str.DefragIfNeeded(ratio);
+    case COMPRESSED_TAG: {
+      uint8_t* ptr = u_.compressed_str.blob;
+      if (!zmalloc_page_is_underutilized(ptr, ratio))
+        return false;
+
+      size_t len = u_.compressed_str.blob_size;
+      u_.compressed_str.blob = (uint8_t*)tl.local_mr->allocate(len, kAlignSize);
+      memcpy(u_.compressed_str.blob, ptr, len);
+      tl.local_mr->deallocate(ptr, len, kAlignSize);
+      return true;
+    }
     case INT_TAG:
       // this is not relevant in this case
       return false;
@@ -901,12 +1422,91 @@ bool CompactObj::DefragIfNeeded(float ratio) {
   }
 }
 
+bool CompactObj::CanCopyAcrossThreads() const {
+  return taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() != nullptr &&
+         CanCopyContainer(u_.r_obj.type(), u_.r_obj.encoding(), u_.r_obj.inner_obj());
+}
+
+void CompactObj::CopyAcrossThreads(const CompactObj& src) {
+  DCHECK(src.CanCopyAcrossThreads());
+
+  const detail::RobjWrapper& robj = src.u_.r_obj;
+  InitRobj(robj.type(), robj.encoding(),
+           CopyContainer(robj.type(), robj.encoding(), robj.inner_obj()));
+}
+
+bool CompactObj::DefragJson(float ratio, uint32_t* cursor) {
+  constexpr uint32_t kMembersPerStep = 64;
+
+  uint32_t start = *cursor;
+  *cursor = 0;
+  if (u_.json_obj.encoding == kEncodingJsonFlat) {
+    uint8_t* ptr = u_.json_obj.flat_ptr;
+    if (!zmalloc_page_is_underutilized(ptr, ratio))
+      return false;
+
+    size_t len = u_.json_obj.json_len;
+    u_.json_obj.flat_ptr = (uint8_t*)tl.local_mr->allocate(len, kAlignSize);
+    memcpy(u_.json_obj.flat_ptr, ptr, len);
+    tl.local_mr->deallocate(ptr, len, kAlignSize);
+    return true;
+  }
+
+  bool realloced = false;
+  JsonType* json = u_.json_obj.json_ptr;
+
+  // jsoncons does not expose its allocations, so if any node of a tree sits on an
+  // underutilized page the whole tree is copied.
+  auto defrag_tree = [&](JsonType* tree) {
+    if (JsonNeedsDefrag(*tree, ratio)) {
+      JsonType copy(*tree, PMR_NS::polymorphic_allocator<char>{tl.local_mr});
+      tree->swap(copy);
+      realloced = true;
+    }
+  };
+
+  // Large objects and arrays are visited in steps of kMembersPerStep members, copying the
+  // trees of the members. Their member storage and keys stay in place, as moving them would
+  // cost a copy of the whole tree again.
+  size_t members = (json->is_object() || json->is_array()) ? json->size() : 0;
+  if (members > kMembersPerStep) {
+    size_t end = min<size_t>(members, start + kMembersPerStep);
+    if (json->is_object()) {
+      auto it = std::next(json->object_range().begin(), start);
+      for (size_t i = start; i < end; ++i, ++it)
+        defrag_tree(&it->value());
+    } else {
+      auto it = std::next(json->array_range().begin(), start);
+      for (size_t i = start; i < end; ++i, ++it)
+        defrag_tree(&*it);
+    }
+
+    if (end < members) {
+      *cursor = end;
+      return realloced;
+    }
+  } else {
+    defrag_tree(json);
+  }
+
+  if (zmalloc_page_is_underutilized(json, ratio)) {
+    u_.json_obj.json_ptr = AllocateMR<JsonType>(std::move(*json));
+    DeleteMR<JsonType>(json);
+    realloced = true;
+  }
+  return realloced;
+}
+
 bool CompactObj::HasAllocated() const {
   if (IsRef() || taglen_ == INT_TAG || IsInline() || taglen_ == EXTERNAL_TAG ||
       (taglen_ == ROBJ_TAG && u_.r_obj.inner_obj() == nullptr))
     return false;
 
-  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG || taglen_ == SBF_TAG);
+  // PREFIX_TAG owns a reference to its prefix.
+  DCHECK(taglen_ == ROBJ_TAG || taglen_ == SMALL_TAG || taglen_ == JSON_TAG || taglen_ == SBF_TAG ||
+         taglen_ == SPARSE_BITMAP_TAG || taglen_ == PREFIX_TAG || taglen_ == COMPRESSED_TAG ||
+         taglen_ == CMS_TAG || taglen_ == TS_TAG || taglen_ == TOPK_TAG ||
+         taglen_ == TDIGEST_TAG);
   return true;
 }
 
@@ -941,6 +1541,23 @@ void CompactObj::GetString(char* dest) const {
     return;
   }
 
+  if (taglen_ == SPARSE_BITMAP_TAG) {
+    u_.sparse_bitmap->Materialize(dest);
+    return;
+  }
+
+  if (taglen_ == PREFIX_TAG) {
+    string_view prefix = KeyPrefix();
+    memcpy(dest, prefix.data(), prefix.size());
+    memcpy(dest + prefix.size(), u_.prefixed_key.suffix, u_.prefixed_key.suffix_len);
+    return;
+  }
+
+  if (taglen_ == COMPRESSED_TAG) {
+    Decompress(dest);
+    return;
+  }
+
   if (is_encoded) {
     if (taglen_ == ROBJ_TAG) {
       CHECK_EQ(OBJ_STRING, u_.r_obj.type());
@@ -986,18 +1603,21 @@ void CompactObj::GetString(char* dest) const {
   LOG(FATAL) << "Bad tag " << int(taglen_);
 }
 
-void CompactObj::SetExternal(size_t offset, size_t sz) {
+void CompactObj::SetExternal(size_t offset, size_t sz, size_t compressed_sz) {
+  DCHECK_LT(compressed_sz, 1u << 24);
   SetMeta(EXTERNAL_TAG, mask_ & ~kEncMask);
 
   u_.ext_ptr.page_index = offset / 4096;
   u_.ext_ptr.page_offset = offset % 4096;
   u_.ext_ptr.size = sz;
+  u_.ext_ptr.compressed_size = compressed_sz;
 }
 
 std::pair<size_t, size_t> CompactObj::GetExternalSlice() const {
   DCHECK_EQ(EXTERNAL_TAG, taglen_);
   size_t offset = size_t(u_.ext_ptr.page_index) * 4096 + u_.ext_ptr.page_offset;
-  return pair<size_t, size_t>(offset, size_t(u_.ext_ptr.size));
+  size_t len = u_.ext_ptr.compressed_size ? u_.ext_ptr.compressed_size : u_.ext_ptr.size;
+  return pair<size_t, size_t>(offset, len);
 }
 
 void CompactObj::Reset() {
@@ -1026,6 +1646,22 @@ void CompactObj::Free() {
     }
   } else if (taglen_ == SBF_TAG) {
     DeleteMR<SBF>(u_.sbf);
+  } else if (taglen_ == CMS_TAG) {
+    DeleteMR<CountMinSketch>(u_.cms);
+  } else if (taglen_ == TS_TAG) {
+    DeleteMR<TimeSeries>(u_.time_series);
+  } else if (taglen_ == TOPK_TAG) {
+    DeleteMR<TopK>(u_.topk);
+  } else if (taglen_ == TDIGEST_TAG) {
+    DeleteMR<TDigest>(u_.tdigest);
+  } else if (taglen_ == SPARSE_BITMAP_TAG) {
+    DeleteMR<SparseBitmap>(u_.sparse_bitmap);
+  } else if (taglen_ == PREFIX_TAG) {
+    tl.key_prefix_dict.Release(u_.prefixed_key.prefix_id);
+  } else if (taglen_ == COMPRESSED_TAG) {
+    tl.str_compression.bytes -= u_.compressed_str.blob_size;
+    tl.str_compression.raw_bytes -= u_.compressed_str.raw_size;
+    tl.local_mr->deallocate(u_.compressed_str.blob, u_.compressed_str.blob_size, kAlignSize);
   } else {
     LOG(FATAL) << "Unsupported tag " << int(taglen_);
   }
@@ -1043,6 +1679,8 @@ size_t CompactObj::MallocUsed() const {
 
   if (taglen_ == JSON_TAG) {
     DCHECK(u_.json_obj.json_ptr != nullptr);
+    if (u_.json_obj.encoding == kEncodingJsonFlat)
+      return u_.json_obj.json_len;
     return zmalloc_size(u_.json_obj.json_ptr);
   }
 
@@ -1053,6 +1691,34 @@ size_t CompactObj::MallocUsed() const {
   if (taglen_ == SBF_TAG) {
     return u_.sbf->MallocUsed();
   }
+
+  if (taglen_ == CMS_TAG) {
+    return u_.cms->MallocUsed();
+  }
+
+  if (taglen_ == TS_TAG) {
+    return u_.time_series->MallocUsed();
+  }
+
+  if (taglen_ == TOPK_TAG) {
+    return u_.topk->MallocUsed();
+  }
+
+  if (taglen_ == TDIGEST_TAG) {
+    return u_.tdigest->MallocUsed();
+  }
+
+  if (taglen_ == SPARSE_BITMAP_TAG) {
+    return u_.sparse_bitmap->MallocUsed();
+  }
+
+  if (taglen_ == PREFIX_TAG) {
+    return 0;  // the prefix is shared, see Stats::key_prefix_bytes.
+  }
+
+  if (taglen_ == COMPRESSED_TAG) {
+    return u_.compressed_str.blob_size;
+  }
   LOG(DFATAL) << "should not reach";
   return 0;
 }
@@ -1060,6 +1726,16 @@ size_t CompactObj::MallocUsed() const {
 bool CompactObj::operator==(const CompactObj& o) const {
   DCHECK(taglen_ != JSON_TAG && o.taglen_ != JSON_TAG) << "cannot use JSON type to check equal";
 
+  // Whether a string is stored with a prefix or compressed depends on the state of the thread,
+  // e.g. a key is stored without a prefix if the dictionary was full.
+  auto depends_on_thread = [](uint8_t tag) { return tag == PREFIX_TAG || tag == COMPRESSED_TAG; };
+  if (taglen_ != o.taglen_ && (depends_on_thread(taglen_) || depends_on_thread(o.taglen_))) {
+    const CompactObj& varying = depends_on_thread(taglen_) ? *this : o;
+    const CompactObj& other = depends_on_thread(taglen_) ? o : *this;
+    string tmp;
+    return other == varying.GetSlice(&tmp);
+  }
+
   uint8_t m1 = mask_ & kEncMask;
   uint8_t m2 = o.mask_ & kEncMask;
   if (m1 != m2)
@@ -1077,6 +1753,17 @@ bool CompactObj::operator==(const CompactObj& o) const {
   if (taglen_ == SMALL_TAG)
     return u_.small_str.Equal(o.u_.small_str);
 
+  // Equal keys have equal prefixes, because the prefix is chosen by the key.
+  if (taglen_ == PREFIX_TAG) {
+    const PrefixedKey& k1 = u_.prefixed_key;
+    const PrefixedKey& k2 = o.u_.prefixed_key;
+    return k1.prefix_id == k2.prefix_id && k1.suffix_len == k2.suffix_len &&
+           memcmp(k1.suffix, k2.suffix, k1.suffix_len) == 0;
+  }
+
+  if (taglen_ == SPARSE_BITMAP_TAG || taglen_ == COMPRESSED_TAG)
+    return ToString() == o.ToString();
+
   DCHECK(IsInline() && o.IsInline());
 
   return memcmp(u_.inline_str, o.u_.inline_str, taglen_) == 0;
@@ -1093,6 +1780,16 @@ bool CompactObj::EqualNonInline(std::string_view sv) const {
       return u_.r_obj.Equal(sv);
     case SMALL_TAG:
       return u_.small_str.Equal(sv);
+    case COMPRESSED_TAG:
+      return sv.size() == u_.compressed_str.raw_size && GetSlice(&tl.tmp_str) == sv;
+    case PREFIX_TAG: {
+      string_view prefix = KeyPrefix();
+      size_t suffix_len = u_.prefixed_key.suffix_len;
+      return sv.size() == prefix.size() + suffix_len && absl::StartsWith(sv, prefix) &&
+             memcmp(sv.data() + prefix.size(), u_.prefixed_key.suffix, suffix_len) == 0;
+    }
+    case SPARSE_BITMAP_TAG:
+      return GetSlice(&tl.tmp_str) == sv;
     default:
       break;
   }
@@ -1106,10 +1803,11 @@ bool CompactObj::CmpEncoded(string_view sv) const {
     if (encode_len != taglen_)
       return false;
 
-    char buf[kInlineLen * 2];
-    detail::ascii_unpack(to_byte(u_.inline_str), sv.size(), buf);
+    // Compares without unpacking, non ascii sv could otherwise match after dropping its 8th bits.
+    if (!detail::validate_ascii_fast(sv.data(), sv.size()))
+      return false;
 
-    return sv == string_view(buf, sv.size());
+    return detail::compare_packed(to_byte(u_.inline_str), sv.data(), sv.size());
   }
 
   if (taglen_ == ROBJ_TAG) {
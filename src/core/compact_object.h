@@ -5,6 +5,7 @@
 #pragma once
 
 #include <absl/base/internal/endian.h>
+#include <absl/types/span.h>
 
 #include <optional>
 #include <type_traits>
@@ -19,10 +20,18 @@ constexpr unsigned kEncodingIntSet = 0;
 constexpr unsigned kEncodingStrMap = 1;   // for set/map encodings of strings
 constexpr unsigned kEncodingStrMap2 = 2;  // for set/map encodings of strings using DenseSet
 constexpr unsigned kEncodingListPack = 3;
+constexpr unsigned kEncodingPackedSet = 4;  // for sets of short strings using PackedStringSet
+constexpr unsigned kEncodingPackedIntSet = 5;  // for sets of integers using PackedIntSet
+constexpr unsigned kEncodingChunkedList = 6;   // for lists using ChunkedList
 constexpr unsigned kEncodingJsonCons = 0;
 constexpr unsigned kEncodingJsonFlat = 1;
 
 class SBF;
+class SparseBitmap;
+class CountMinSketch;
+class TimeSeries;
+class TopK;
+class TDigest;
 
 namespace detail {
 
@@ -42,6 +51,11 @@ class RobjWrapper {
   void Free(MemoryResource* mr);
 
   void SetString(std::string_view s, MemoryResource* mr);
+
+  // Overwrites the string at start with s in place, growing it with geometric capacity and
+  // zero padding if needed. Requires a raw string.
+  void SetRange(size_t start, std::string_view s, MemoryResource* mr);
+
   void Init(unsigned type, unsigned encoding, void* inner);
 
   unsigned type() const {
@@ -66,6 +80,10 @@ class RobjWrapper {
   // Returns true if re-allocated.
   bool DefragIfNeeded(float ratio);
 
+  // Same, but large containers are processed in steps. *cursor is 0 for the first step and is
+  // set to the position to resume from, or to 0 once the whole object was visited.
+  bool DefragIfNeeded(float ratio, uint32_t* cursor);
+
   // as defined in zset.h
   int ZsetAdd(double score, char* ele, int in_flags, int* out_flags, double* newscore);
 
@@ -107,6 +125,13 @@ class CompactObj {
     EXTERNAL_TAG = 20,
     JSON_TAG = 21,
     SBF_TAG = 22,
+    SPARSE_BITMAP_TAG = 23,
+    PREFIX_TAG = 24,  // a key prefix shared via a thread local dictionary and an inline suffix.
+    COMPRESSED_TAG = 25,  // a zstd compressed string
+    CMS_TAG = 26,
+    TS_TAG = 27,
+    TOPK_TAG = 28,
+    TDIGEST_TAG = 29,
   };
 
   enum MaskBit {
@@ -241,8 +266,22 @@ class CompactObj {
     return mask_ & IO_PENDING;
   }
 
+  // Re-allocates the value, including the internals of containers, from underutilized pages.
+  // Returns true if anything was re-allocated.
   bool DefragIfNeeded(float ratio);
 
+  // Same, but large containers are processed in steps. *cursor is 0 for the first step and is
+  // set to the position to resume from, or to 0 once the whole value was visited.
+  bool DefragIfNeeded(float ratio, uint32_t* cursor);
+
+  // Whether CopyAcrossThreads supports the value: lists, and sets, hashes and sorted sets in
+  // the encodings that can be copied without modifying the source.
+  bool CanCopyAcrossThreads() const;
+
+  // Sets this object to a copy of src, which may be allocated by another thread, in the heap of
+  // this thread. src is only read, its owner must not modify or free it meanwhile.
+  void CopyAcrossThreads(const CompactObj& src);
+
   void SetIoPending(bool b) {
     if (b) {
       mask_ |= IO_PENDING;
@@ -297,6 +336,26 @@ class CompactObj {
   void SetString(std::string_view str);
   void GetString(std::string* res) const;
 
+  // Overwrites the string at start with str, extending it with zeros if needed. The string is
+  // converted to the raw encoding, where it is modified in place with spare capacity, so that
+  // repeated appends to a large string are amortized O(1) instead of copying the whole string.
+  // Returns false for external strings, which must be rewritten with SetString.
+  bool SetStringRange(size_t start, std::string_view str);
+
+  // Like SetString, but once key prefixes are enabled on this thread, a key that does not fit
+  // inline but whose tail after a ':' delimited prefix does is stored as the id of the prefix in
+  // a thread local dictionary and the inline tail. The object must not be used by other threads.
+  void SetKey(std::string_view key);
+
+  // Enables prefix compression of the keys set with SetKey on this thread.
+  static void EnableKeyPrefixes(bool enable);
+
+  // Values of at least min_size bytes set with SetString on this thread are compressed with zstd
+  // if that saves memory, 0 disables compression. The first strings train a dictionary for the
+  // rest. Compressed strings are decompressed on every read. Keys set with SetKey are never
+  // compressed.
+  static void EnableStringCompression(size_t min_size);
+
   // Will set this to hold OBJ_JSON, after that it is safe to call GetJson
   // NOTE: in order to avid copy which can be expensive in this case,
   // you need to move an object that created with the function JsonFromString
@@ -307,14 +366,68 @@ class CompactObj {
   // pre condition - the type here is OBJ_JSON and was set with SetJson
   JsonType* GetJson() const;
 
+  // pre condition - the type here is OBJ_JSON and was set with SetJson(buf, len).
+  // Returns the flexbuffer, scalars can be mutated in place as long as they keep their width.
+  absl::Span<uint8_t> GetJsonFlat() const;
+
+  // kEncodingJsonCons or kEncodingJsonFlat, pre condition - the type here is OBJ_JSON
+  unsigned GetJsonEncoding() const;
+
   void SetSBF(SBF* sbf) {
     SetMeta(SBF_TAG);
     u_.sbf = sbf;
   }
 
-  void SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor);
+  void SetSBF(uint64_t initial_capacity, double fp_prob, double grow_factor,
+              bool blocked = false);
   SBF* GetSBF() const;
 
+  // Takes ownership over sketch, which must be allocated with AllocateMR.
+  void SetCMS(CountMinSketch* cms) {
+    SetMeta(CMS_TAG);
+    u_.cms = cms;
+  }
+
+  CountMinSketch* GetCMS() const;
+
+  // Takes ownership over ts, which must be allocated with AllocateMR.
+  void SetTimeSeries(TimeSeries* ts) {
+    SetMeta(TS_TAG);
+    u_.time_series = ts;
+  }
+
+  TimeSeries* GetTimeSeries() const;
+
+  // Takes ownership over topk, which must be allocated with AllocateMR.
+  void SetTopK(TopK* topk) {
+    SetMeta(TOPK_TAG);
+    u_.topk = topk;
+  }
+
+  TopK* GetTopK() const;
+
+  // Takes ownership over td, which must be allocated with AllocateMR.
+  void SetTDigest(TDigest* td) {
+    SetMeta(TDIGEST_TAG);
+    u_.tdigest = td;
+  }
+
+  TDigest* GetTDigest() const;
+
+  // For STR object that holds a bitmap with only a few bits set.
+  // Takes ownership over bitmap, which must be allocated with AllocateMR.
+  // The string accessors materialize the bitmap as a regular string.
+  void SetSparseBitmap(SparseBitmap* bitmap) {
+    SetMeta(SPARSE_BITMAP_TAG, mask_ & ~kEncMask);
+    u_.sparse_bitmap = bitmap;
+  }
+
+  bool IsSparseBitmap() const {
+    return taglen_ == SPARSE_BITMAP_TAG;
+  }
+
+  SparseBitmap* GetSparseBitmap() const;
+
   // dest must have at least Size() bytes available
   void GetString(char* dest) const;
 
@@ -322,9 +435,16 @@ class CompactObj {
     return taglen_ == EXTERNAL_TAG;
   }
 
-  void SetExternal(size_t offset, size_t sz);
+  // sz is the size of the value. If it is stored compressed, compressed_sz is its length on disk.
+  void SetExternal(size_t offset, size_t sz, size_t compressed_sz = 0);
+
+  // Returns the location of the value on disk, that is its compressed length if it is compressed.
   std::pair<size_t, size_t> GetExternalSlice() const;
 
+  bool IsExternalCompressed() const {
+    return taglen_ == EXTERNAL_TAG && u_.ext_ptr.compressed_size != 0;
+  }
+
   // In case this object a single blob, returns number of bytes allocated on heap
   // for that blob. Otherwise returns 0.
   size_t MallocUsed() const;
@@ -342,6 +462,10 @@ class CompactObj {
 
   struct Stats {
     size_t small_string_bytes = 0;
+    size_t small_string_table_full = 0;  // strings moved to the heap since no segment id was left.
+    size_t key_prefix_bytes = 0;  // of the prefixes shared by keys with PREFIX_TAG.
+    size_t compressed_string_bytes = 0;
+    size_t compressed_string_raw_bytes = 0;  // size of the compressed strings when decompressed.
   };
 
   static Stats GetStats();
@@ -383,8 +507,23 @@ class CompactObj {
 
   bool HasAllocated() const;
 
+  // Requires: taglen_ == JSON_TAG. Large objects and arrays are processed in steps, see
+  // DefragIfNeeded.
+  bool DefragJson(float ratio, uint32_t* cursor);
+
   bool CmpEncoded(std::string_view sv) const;
 
+  // Requires: taglen_ == PREFIX_TAG.
+  std::string_view KeyPrefix() const;
+
+  void SetStringImpl(std::string_view str, bool compress);
+
+  // Returns false if str is not worth compressing.
+  bool SetCompressed(std::string_view str, uint8_t mask);
+
+  // Requires: taglen_ == COMPRESSED_TAG. dest must have room for Size() bytes.
+  void Decompress(char* dest) const;
+
   void SetMeta(uint8_t taglen, uint8_t mask = 0) {
     if (HasAllocated()) {
       Free();
@@ -397,13 +536,26 @@ class CompactObj {
 
   struct ExternalPtr {
     uint32_t type : 8;
-    uint32_t reserved : 24;
+    uint32_t compressed_size : 24;  // 0 if the value is stored as is
     uint32_t page_index;
     uint16_t page_offset;  // 0 for multi-page blobs. != 0 for small blobs.
     uint16_t reserved2;
     uint32_t size;
   } __attribute__((packed));
 
+  struct PrefixedKey {
+    uint16_t prefix_id;
+    uint8_t suffix_len;
+    char suffix[kInlineLen - 3];
+  } __attribute__((packed));
+
+  // The blob starts with the pointer to the zstd dictionary, or nullptr, followed by the frame.
+  struct CompressedStr {
+    uint8_t* blob;
+    uint32_t blob_size;
+    uint32_t raw_size;
+  } __attribute__((packed));
+
   struct JsonWrapper {
     union {
       JsonType* json_ptr;
@@ -426,8 +578,15 @@ class CompactObj {
     // using 'packed' to reduce alignement of U to 1.
     JsonWrapper json_obj __attribute__((packed));
     SBF* sbf __attribute__((packed));
+    CountMinSketch* cms __attribute__((packed));
+    TimeSeries* time_series __attribute__((packed));
+    TopK* topk __attribute__((packed));
+    TDigest* tdigest __attribute__((packed));
+    SparseBitmap* sparse_bitmap __attribute__((packed));
     int64_t ival __attribute__((packed));
     ExternalPtr ext_ptr;
+    PrefixedKey prefixed_key;
+    CompressedStr compressed_str;
 
     U() : r_obj() {
     }
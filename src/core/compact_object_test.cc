@@ -7,6 +7,9 @@
 #include <mimalloc.h>
 #include <xxhash.h>
 
+#include <random>
+#include <thread>
+
 #include <jsoncons/json.hpp>
 #include <jsoncons_ext/jsonpath/jsonpath.hpp>
 
@@ -14,7 +17,10 @@
 #include "base/logging.h"
 #include "core/detail/bitpacking.h"
 #include "core/flat_set.h"
+#include "core/flatbuffers.h"
+#include "core/json/path.h"
 #include "core/mi_memory_resource.h"
+#include "core/segment_allocator.h"
 
 extern "C" {
 #include "redis/intset.h"
@@ -257,6 +263,43 @@ TEST_F(CompactObjectTest, NonInline) {
   EXPECT_EQ(s.size(), obj.Size());
 }
 
+TEST_F(CompactObjectTest, SmallStringOtherThread) {
+  string s(22, 'a');
+  CompactObj obj{s};
+  ASSERT_EQ(obj.Size(), s.size());
+
+  // Small strings are translated through a global table, so other threads can read them.
+  std::thread reader([&] {
+    string tmp;
+    EXPECT_EQ(s, obj.GetSlice(&tmp));
+  });
+  reader.join();
+}
+
+TEST_F(CompactObjectTest, SmallStringSegmentIds) {
+  uint32_t used = SegmentAllocator::used_segments();
+
+  // Spans a few mimalloc segments.
+  vector<CompactObj> objs(500'000);
+  for (size_t i = 0; i < objs.size(); ++i)
+    objs[i].SetString(absl::StrCat("small string number ", i));
+  EXPECT_GT(SegmentAllocator::used_segments(), used);
+
+  // The ids of the emptied segments are released.
+  objs.clear();
+  EXPECT_EQ(used, SegmentAllocator::used_segments());
+
+  // Strings fall back to the heap once the table is full.
+  CompactObj::Stats stats = CompactObj::GetStats();
+  SegmentAllocator::SetMaxSegments(SegmentAllocator::used_segments());
+  string s(22, 'a');
+  CompactObj obj{s};
+  EXPECT_EQ(s, obj);
+  EXPECT_EQ(stats.small_string_table_full + 1, CompactObj::GetStats().small_string_table_full);
+  EXPECT_EQ(stats.small_string_bytes, CompactObj::GetStats().small_string_bytes);
+  SegmentAllocator::SetMaxSegments(SegmentAllocator::kMaxSegments);
+}
+
 TEST_F(CompactObjectTest, InlineAsciiEncoded) {
   string s = "key:0000000000000";
   uint64_t expected_val = XXH3_64bits_withSeed(s.data(), s.size(), kSeed);
@@ -265,6 +308,90 @@ TEST_F(CompactObjectTest, InlineAsciiEncoded) {
   EXPECT_EQ(s.size(), obj.Size());
 }
 
+TEST_F(CompactObjectTest, KeyPrefix) {
+  CompactObj::EnableKeyPrefixes(true);
+  string key1 = "tenant:12345:user:987:session";
+  string key2 = "tenant:12345:user:988:session";
+
+  CompactObj obj1, obj2;
+  obj1.SetKey(key1);
+  obj2.SetKey(key2);
+  EXPECT_EQ(0u, obj1.MallocUsed());
+  EXPECT_EQ(key1, obj1);
+  EXPECT_FALSE(obj1 == key2);
+  EXPECT_EQ(key2, obj2.GetSlice(&tmp_));
+  EXPECT_EQ(key1.size(), obj1.Size());
+  EXPECT_EQ(XXH3_64bits_withSeed(key1.data(), key1.size(), kSeed), obj1.HashCode());
+  EXPECT_FALSE(obj1 == obj2);
+  EXPECT_EQ(OBJ_STRING, obj1.ObjType());
+
+  // Both share "tenant:12345:user:".
+  EXPECT_EQ(18u, CompactObj::GetStats().key_prefix_bytes);
+
+  // Equal to the same key stored without a prefix.
+  CompactObj plain{key1};
+  EXPECT_TRUE(obj1 == plain);
+  EXPECT_TRUE(plain == obj1);
+
+  // Keys without a suitable prefix are stored as usual.
+  obj2.SetKey(string(30, 'a'));
+  EXPECT_GT(obj2.MallocUsed(), 0u);
+  EXPECT_EQ(string(30, 'a'), obj2);
+
+  CompactObj moved = std::move(obj1);
+  EXPECT_EQ(key1, moved);
+  EXPECT_EQ(18u, CompactObj::GetStats().key_prefix_bytes);
+  moved.Reset();
+  EXPECT_EQ(0u, CompactObj::GetStats().key_prefix_bytes);
+  CompactObj::EnableKeyPrefixes(false);
+}
+
+TEST_F(CompactObjectTest, CompressedString) {
+  CompactObj::EnableStringCompression(64);
+  string val = absl::StrCat("{\"name\": \"", string(200, 'x'), "\", \"id\": 12345}");
+
+  cobj_.SetString(val);
+  EXPECT_EQ(val, cobj_);
+  EXPECT_EQ(val, cobj_.ToString());
+  EXPECT_EQ(val.size(), cobj_.Size());
+  EXPECT_EQ(OBJ_STRING, cobj_.ObjType());
+  EXPECT_EQ(XXH3_64bits_withSeed(val.data(), val.size(), kSeed), cobj_.HashCode());
+  EXPECT_LT(cobj_.MallocUsed(), val.size() / 2);
+  EXPECT_FALSE(cobj_ == string(val.size(), 'x'));
+
+  CompactObj::Stats stats = CompactObj::GetStats();
+  EXPECT_EQ(val.size(), stats.compressed_string_raw_bytes);
+  EXPECT_EQ(cobj_.MallocUsed(), stats.compressed_string_bytes);
+
+  // Equal to the same string stored uncompressed.
+  CompactObj::EnableStringCompression(0);
+  CompactObj plain{val};
+  EXPECT_TRUE(cobj_ == plain);
+  EXPECT_TRUE(plain == cobj_);
+
+  // Strings that don't compress well are stored as usual.
+  CompactObj::EnableStringCompression(64);
+  string random(100, '\0');
+  mt19937 gen(0);
+  for (char& c : random)
+    c = gen();
+  plain.SetString(random);
+  EXPECT_EQ(random, plain.ToString());
+  EXPECT_EQ(val.size(), CompactObj::GetStats().compressed_string_raw_bytes);
+
+  // Keys are never compressed.
+  CompactObj key;
+  key.SetKey(val);
+  EXPECT_EQ(val, key);
+  EXPECT_GE(key.MallocUsed(), detail::binpacked_len(val.size()));
+  EXPECT_EQ(val.size(), CompactObj::GetStats().compressed_string_raw_bytes);
+
+  cobj_.Reset();
+  EXPECT_EQ(0u, CompactObj::GetStats().compressed_string_bytes);
+  EXPECT_EQ(0u, CompactObj::GetStats().compressed_string_raw_bytes);
+  CompactObj::EnableStringCompression(0);
+}
+
 TEST_F(CompactObjectTest, Int) {
   cobj_.SetString("0");
   EXPECT_EQ(0, cobj_.TryGetInt());
@@ -320,6 +447,34 @@ TEST_F(CompactObjectTest, AsciiUtil) {
   ASSERT_EQ(data3, act_str);
 }
 
+TEST_F(CompactObjectTest, AsciiSimd) {
+  // Covers the tails of both the 16 and 32 char SIMD loops.
+  for (size_t len = 16; len < 160; ++len) {
+    string data(len, 0);
+    for (size_t i = 0; i < len; ++i)
+      data[i] = 'a' + (i * 7 + len) % 26;
+
+    vector<uint8_t> expected(detail::binpacked_len(len)), actual(expected.size());
+    detail::ascii_pack(data.data(), len, expected.data());
+    detail::ascii_pack_simd2(data.data(), len, actual.data());
+    ASSERT_EQ(expected, actual) << len;
+
+    string unpacked(len, 'y');
+    detail::ascii_unpack_simd(actual.data(), len, unpacked.data());
+    ASSERT_EQ(data, unpacked) << len;
+    ASSERT_TRUE(detail::compare_packed(actual.data(), data.data(), len)) << len;
+
+    for (size_t pos : {size_t(0), len / 2, len - 1}) {
+      string other = data;
+      other[pos] = 'A';
+      ASSERT_FALSE(detail::compare_packed(actual.data(), other.data(), len)) << len << " " << pos;
+    }
+
+    data[len / 3] = char(0x80);
+    ASSERT_FALSE(detail::validate_ascii_fast(data.data(), len)) << len;
+  }
+}
+
 TEST_F(CompactObjectTest, IntSet) {
   intset* is = intsetNew();
   cobj_.InitRobj(OBJ_SET, kEncodingIntSet, is);
@@ -518,6 +673,51 @@ TEST_F(CompactObjectTest, JsonTypeWithPathTest) {
   }
 }
 
+TEST_F(CompactObjectTest, JsonFlat) {
+  auto json = JsonFromString(R"({"a":1,"b":[true,2.5]})", CompactObj::memory_resource());
+  ASSERT_TRUE(json);
+
+  flexbuffers::Builder fbb;
+  json::FromJsonType(*json, &fbb);
+  fbb.Finish();
+  const auto& buf = fbb.GetBuffer();
+  cobj_.SetJson(buf.data(), buf.size());
+
+  ASSERT_EQ(OBJ_JSON, cobj_.ObjType());
+  EXPECT_EQ(kEncodingJsonFlat, cobj_.GetJsonEncoding());
+  EXPECT_EQ(buf.size(), cobj_.MallocUsed());
+
+  // Scalars of the same width are mutated in place.
+  auto flat = cobj_.GetJsonFlat();
+  auto root = flexbuffers::GetRoot(flat.data(), flat.size()).AsMap();
+  EXPECT_TRUE(root["a"].MutateInt(7));
+  EXPECT_TRUE(root["b"].AsVector()[0].MutateBool(false));
+  EXPECT_EQ(R"({"a":7,"b":[false,2.5]})",
+            json::FromFlat(flexbuffers::GetRoot(flat.data(), flat.size())).to_string());
+}
+
+TEST_F(CompactObjectTest, DefragJsonSteps) {
+  string json_str = "[";
+  for (unsigned i = 0; i < 200; ++i)
+    absl::StrAppend(&json_str, i ? "," : "", "\"", string(32, 'a' + i % 26), "\"");
+  json_str += "]";
+
+  std::optional<JsonType> json = JsonFromString(json_str, CompactObj::memory_resource());
+  ASSERT_TRUE(json);
+  cobj_.SetJson(std::move(*json));
+
+  // Large arrays are visited 64 members per step.
+  uint32_t cursor = 0;
+  vector<uint32_t> cursors;
+  do {
+    cobj_.DefragIfNeeded(0.8, &cursor);
+    cursors.push_back(cursor);
+  } while (cursor);
+  EXPECT_EQ(cursors, (vector<uint32_t>{64, 128, 192, 0}));
+  EXPECT_EQ(cobj_.GetJson()->size(), 200u);
+  EXPECT_EQ(cobj_.GetJson()->at(199).as_string(), string(32, 'a' + 199 % 26));
+}
+
 // Test listpack defragmentation.
 // StringMap has built-in defragmantation that is tested in its own test suite.
 TEST_F(CompactObjectTest, DefragHash) {
@@ -701,4 +901,48 @@ static void BM_UnpackSimd(benchmark::State& state) {
 }
 BENCHMARK(BM_UnpackSimd);
 
+static void BM_ComparePacked(benchmark::State& state) {
+  string val(1024, 'a');
+  uint8_t buf[1024];
+
+  detail::ascii_pack(val.data(), val.size(), buf);
+
+  while (state.KeepRunning()) {
+    benchmark::DoNotOptimize(detail::compare_packed(buf, val.data(), val.size()));
+  }
+}
+BENCHMARK(BM_ComparePacked);
+
+static void BM_SetGetAsciiString(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+
+  // Long enough to be ascii packed, but not to be allocated as a small string.
+  string val(state.range(0), 'a');
+  string res;
+  CompactObj obj;
+  while (state.KeepRunning()) {
+    obj.SetString(val);
+    obj.GetString(&res);
+  }
+  obj.Reset();
+}
+BENCHMARK(BM_SetGetAsciiString)->Arg(24)->Arg(128)->Arg(1024);
+
+static void BM_SetGetIntString(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  CompactObj::InitThreadLocal(PMR_NS::get_default_resource());
+
+  string res;
+  char buf[32];
+  CompactObj obj;
+  int64_t next = 1000000;
+  while (state.KeepRunning()) {
+    char* end = absl::numbers_internal::FastIntToBuffer(next++, buf);
+    obj.SetString(string_view{buf, size_t(end - buf)});
+    obj.GetString(&res);
+  }
+}
+BENCHMARK(BM_SetGetIntString);
+
 }  // namespace dfly
@@ -0,0 +1,97 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/count_min_sketch.h"
+
+#include <xxhash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+inline uint32_t SaturatedAdd(uint32_t counter, uint64_t incr) {
+  return min<uint64_t>(counter + incr, UINT32_MAX);
+}
+
+}  // namespace
+
+CountMinSketch::CountMinSketch(uint32_t width, uint32_t depth, PMR_NS::memory_resource* mr)
+    : width_(width), depth_(depth), mr_(mr) {
+  DCHECK(width > 0 && depth > 0 && depth <= kMaxDepth);
+  counters_ = static_cast<uint32_t*>(mr_->allocate(DataSize(), alignof(uint32_t)));
+  Reset();
+}
+
+CountMinSketch::CountMinSketch(uint32_t width, uint32_t depth, uint64_t count,
+                               string_view counters, PMR_NS::memory_resource* mr)
+    : width_(width), depth_(depth), count_(count), mr_(mr) {
+  DCHECK_EQ(counters.size(), DataSize());
+  counters_ = static_cast<uint32_t*>(mr_->allocate(DataSize(), alignof(uint32_t)));
+  memcpy(counters_, counters.data(), DataSize());
+}
+
+CountMinSketch::~CountMinSketch() {
+  mr_->deallocate(counters_, DataSize(), alignof(uint32_t));
+}
+
+void CountMinSketch::DimsFromProb(double error, double prob, uint32_t* width, uint32_t* depth) {
+  *width = ceil(2 / error);
+  *depth = ceil(log10(prob) / log10(0.5));
+}
+
+void CountMinSketch::Indices(string_view item, uint32_t* indices) const {
+  XXH128_hash_t hash = XXH3_128bits_withSeed(item.data(), item.size(), 0xc6a4a7935bd1e995ULL);
+  for (uint32_t i = 0; i < depth_; ++i)
+    indices[i] = i * width_ + (hash.low64 + hash.high64 * i) % width_;
+}
+
+uint32_t CountMinSketch::IncrBy(string_view item, uint32_t incr) {
+  uint32_t indices[kMaxDepth];
+  Indices(item, indices);
+
+  uint32_t res = UINT32_MAX;
+  for (uint32_t i = 0; i < depth_; ++i) {
+    uint32_t& counter = counters_[indices[i]];
+    counter = SaturatedAdd(counter, incr);
+    res = min(res, counter);
+  }
+  count_ += incr;
+  return res;
+}
+
+uint32_t CountMinSketch::Query(string_view item) const {
+  uint32_t indices[kMaxDepth];
+  Indices(item, indices);
+
+  uint32_t res = UINT32_MAX;
+  for (uint32_t i = 0; i < depth_; ++i)
+    res = min(res, counters_[indices[i]]);
+  return res;
+}
+
+void CountMinSketch::Merge(const CountMinSketch& src, uint32_t weight) {
+  DCHECK(src.width_ == width_ && src.depth_ == depth_);
+
+  // A flat loop over all the rows, so that the compiler vectorizes it.
+  size_t len = size_t(width_) * depth_;
+  const uint32_t* src_counters = src.counters_;
+  for (size_t i = 0; i < len; ++i)
+    counters_[i] = SaturatedAdd(counters_[i], uint64_t(src_counters[i]) * weight);
+  count_ += src.count_ * weight;
+}
+
+void CountMinSketch::Reset() {
+  memset(counters_, 0, DataSize());
+  count_ = 0;
+}
+
+}  // namespace dfly
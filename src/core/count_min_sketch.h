@@ -0,0 +1,83 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Count-Min sketch, https://en.wikipedia.org/wiki/Count%E2%80%93min_sketch
+// Keeps depth rows of width 32-bit counters in a single allocation. Each row is indexed by
+// a different combination of two fingerprints of the item, similarly to the Bloom filter.
+// Counters saturate at UINT32_MAX instead of wrapping around.
+class CountMinSketch {
+  CountMinSketch(const CountMinSketch&) = delete;
+  CountMinSketch& operator=(const CountMinSketch&) = delete;
+
+ public:
+  // Limits the number of rows, so that the row indices of an item fit on the stack.
+  static constexpr uint32_t kMaxDepth = 64;
+
+  CountMinSketch(uint32_t width, uint32_t depth, PMR_NS::memory_resource* mr);
+
+  // C'tor used for loading persisted sketches, counters is a blob returned by data().
+  CountMinSketch(uint32_t width, uint32_t depth, uint64_t count, std::string_view counters,
+                 PMR_NS::memory_resource* mr);
+  ~CountMinSketch();
+
+  // Derives the dimensions from the allowed error, as a fraction of the total count,
+  // and the probability to exceed it, the same way RedisBloom does.
+  static void DimsFromProb(double error, double prob, uint32_t* width, uint32_t* depth);
+
+  // Increases the counters of the item and returns its estimated count.
+  uint32_t IncrBy(std::string_view item, uint32_t incr);
+
+  uint32_t Query(std::string_view item) const;
+
+  // Adds the counters of src multiplied by weight. src must have the same dimensions.
+  void Merge(const CountMinSketch& src, uint32_t weight);
+
+  // Zeroes all the counters.
+  void Reset();
+
+  uint32_t width() const {
+    return width_;
+  }
+
+  uint32_t depth() const {
+    return depth_;
+  }
+
+  // Sum of all the increments.
+  uint64_t count() const {
+    return count_;
+  }
+
+  std::string_view data() const {
+    return {reinterpret_cast<const char*>(counters_), DataSize()};
+  }
+
+  size_t MallocUsed() const {
+    return DataSize() + sizeof(CountMinSketch);
+  }
+
+ private:
+  size_t DataSize() const {
+    return size_t(width_) * depth_ * sizeof(uint32_t);
+  }
+
+  // Fills the index of the item in each row.
+  void Indices(std::string_view item, uint32_t* indices) const;
+
+  uint32_t width_, depth_;
+  uint64_t count_ = 0;
+  uint32_t* counters_;
+  PMR_NS::memory_resource* mr_;
+};
+
+}  // namespace dfly
@@ -0,0 +1,73 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/count_min_sketch.h"
+
+#include <absl/strings/str_cat.h>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class CountMinSketchTest : public ::testing::Test {
+ protected:
+  PMR_NS::memory_resource* mr_ = PMR_NS::get_default_resource();
+};
+
+TEST_F(CountMinSketchTest, Basic) {
+  CountMinSketch cms(1000, 5, mr_);
+  EXPECT_EQ(0, cms.Query("a"));
+  EXPECT_EQ(3, cms.IncrBy("a", 3));
+  EXPECT_EQ(5, cms.IncrBy("a", 2));
+  EXPECT_EQ(1, cms.IncrBy("b", 1));
+  EXPECT_EQ(5, cms.Query("a"));
+  EXPECT_EQ(6, cms.count());
+
+  // Counters saturate.
+  cms.IncrBy("c", UINT32_MAX);
+  EXPECT_EQ(UINT32_MAX, cms.IncrBy("c", 10));
+
+  cms.Reset();
+  EXPECT_EQ(0, cms.Query("a"));
+  EXPECT_EQ(0, cms.count());
+}
+
+TEST_F(CountMinSketchTest, ErrorBound) {
+  uint32_t width, depth;
+  CountMinSketch::DimsFromProb(0.001, 0.01, &width, &depth);
+  EXPECT_EQ(2000, width);
+  EXPECT_EQ(7, depth);
+
+  CountMinSketch cms(width, depth, mr_);
+  constexpr unsigned kNumItems = 10000;
+  for (unsigned i = 0; i < kNumItems; ++i)
+    cms.IncrBy(absl::StrCat("item", i), i % 10 + 1);
+
+  // Estimates never undercount and overcount by at most error * count with probability 1 - prob.
+  unsigned violations = 0;
+  for (unsigned i = 0; i < kNumItems; ++i) {
+    uint32_t estimate = cms.Query(absl::StrCat("item", i));
+    ASSERT_GE(estimate, i % 10 + 1);
+    violations += estimate > i % 10 + 1 + 0.001 * cms.count();
+  }
+  EXPECT_LE(violations, kNumItems * 0.01);
+}
+
+TEST_F(CountMinSketchTest, Merge) {
+  CountMinSketch a(100, 4, mr_), b(100, 4, mr_);
+  a.IncrBy("x", 2);
+  b.IncrBy("x", 3);
+  b.IncrBy("y", 1);
+
+  CountMinSketch dest(100, 4, a.count(), a.data(), mr_);
+  EXPECT_EQ(2, dest.Query("x"));
+  dest.Merge(b, 2);
+  EXPECT_EQ(8, dest.Query("x"));
+  EXPECT_EQ(2, dest.Query("y"));
+  EXPECT_EQ(10, dest.count());
+}
+
+}  // namespace dfly
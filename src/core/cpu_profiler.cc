@@ -0,0 +1,155 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/cpu_profiler.h"
+
+#include <absl/debugging/stacktrace.h>
+#include <absl/strings/str_cat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <mutex>
+
+#include "base/logging.h"
+#include "io/file_util.h"
+
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+thread_local CpuProfiler g_profiler;
+
+void AppendWord(uintptr_t word, string* dest) {
+  dest->append(reinterpret_cast<const char*>(&word), sizeof(word));
+}
+
+}  // namespace
+
+CpuProfiler& CpuProfiler::Get() {
+  return g_profiler;
+}
+
+void CpuProfiler::SignalHandler(int sig, siginfo_t* info, void* ucontext) {
+  int saved_errno = errno;
+  g_profiler.RecordSample(ucontext);
+  errno = saved_errno;
+}
+
+void CpuProfiler::RecordSample(void* ucontext) {
+  if (!active_.load(memory_order_relaxed))
+    return;
+
+  if (num_samples_ >= kMaxSamples) {
+    dropped_++;
+    return;
+  }
+
+  // Unwinds from the interrupted code rather than from the signal handler.
+  Sample& sample = samples_[num_samples_];
+  sample.depth =
+      absl::GetStackTraceWithContext(sample.frames, kMaxStackDepth, 1, ucontext, nullptr);
+  num_samples_++;
+}
+
+bool CpuProfiler::Start(uint32_t frequency_hz) {
+#ifdef __linux__
+  if (active_.load(memory_order_relaxed) || frequency_hz == 0)
+    return false;
+
+  static once_flag install_handler;
+  call_once(install_handler, [] {
+    struct sigaction sa = {};
+    sa.sa_sigaction = &CpuProfiler::SignalHandler;
+    sa.sa_flags = SA_RESTART | SA_SIGINFO;
+    sigemptyset(&sa.sa_mask);
+    CHECK_EQ(0, sigaction(SIGPROF, &sa, nullptr));
+  });
+
+  if (!samples_)
+    samples_.reset(new Sample[kMaxSamples]);
+  num_samples_ = 0;
+  dropped_ = 0;
+
+  // The timer runs on the CPU time of this thread and signals only this thread.
+  struct sigevent sev = {};
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev.sigev_notify_thread_id = gettid();
+
+  timer_t timer;
+  if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &timer) != 0) {
+    LOG(WARNING) << "Could not create the profiling timer: " << errno;
+    return false;
+  }
+
+  active_.store(true, memory_order_relaxed);
+  atomic_signal_fence(memory_order_seq_cst);
+
+  uint64_t period_ns = 1000'000'000ULL / frequency_hz;
+  struct itimerspec spec = {};
+  spec.it_interval.tv_sec = period_ns / 1000'000'000;
+  spec.it_interval.tv_nsec = period_ns % 1000'000'000;
+  spec.it_value = spec.it_interval;
+  CHECK_EQ(0, timer_settime(timer, 0, &spec, nullptr));
+
+  static_assert(sizeof(timer_t) == sizeof(timer_));
+  timer_ = timer;
+  return true;
+#else
+  return false;
+#endif
+}
+
+void CpuProfiler::Stop() {
+#ifdef __linux__
+  if (!active_.load(memory_order_relaxed))
+    return;
+
+  timer_delete(reinterpret_cast<timer_t>(timer_));
+  timer_ = nullptr;
+
+  // A signal that is pending already is ignored by the handler.
+  active_.store(false, memory_order_relaxed);
+  atomic_signal_fence(memory_order_seq_cst);
+#endif
+}
+
+void CpuProfiler::MergeSamples(Samples* dest) const {
+  DCHECK(!active_.load(memory_order_relaxed));
+  for (size_t i = 0; i < num_samples_; ++i) {
+    const Sample& sample = samples_[i];
+    (*dest)[vector<void*>(sample.frames, sample.frames + sample.depth)]++;
+  }
+}
+
+string CpuProfiler::FormatProfile(const Samples& samples, uint32_t frequency_hz) {
+  string res;
+
+  // Header: header words, version, sampling period in microseconds and padding.
+  for (uintptr_t word : {0ul, 3ul, 0ul, uintptr_t(1000'000 / frequency_hz), 0ul})
+    AppendWord(word, &res);
+
+  for (const auto& [stack, count] : samples) {
+    AppendWord(count, &res);
+    AppendWord(stack.size(), &res);
+    for (void* pc : stack)
+      AppendWord(reinterpret_cast<uintptr_t>(pc), &res);
+  }
+
+  // Trailer, followed by the mappings that pprof needs to symbolize the addresses.
+  for (uintptr_t word : {0ul, 1ul, 0ul})
+    AppendWord(word, &res);
+  if (auto maps = io::ReadFileToString("/proc/self/maps"); maps)
+    absl::StrAppend(&res, *maps);
+  return res;
+}
+
+}  // namespace dfly
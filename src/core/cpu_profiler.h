@@ -0,0 +1,71 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+#pragma once
+
+#include <absl/container/node_hash_map.h>
+
+#include <signal.h>
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace dfly {
+
+// Sampling CPU profiler, similar to the one of gperftools. A timer on the CPU time of the thread
+// delivers SIGPROF every period and the signal handler records the stack of the interrupted code
+// into a buffer allocated in advance, so the handler never allocates or locks. The samples are
+// aggregated by stack and can be dumped in the legacy pprof CPU profile format.
+//
+// Thread-local. Must be started and stopped in all relevant threads separately.
+// Linux only, Start() fails on other platforms.
+class CpuProfiler {
+ public:
+  // Number of frames recorded per sample.
+  static constexpr int kMaxStackDepth = 32;
+
+  // Samples kept per thread until the profiler is stopped, later ones are dropped.
+  static constexpr size_t kMaxSamples = 1 << 13;
+
+  // Number of samples by stack of return addresses.
+  using Samples = absl::node_hash_map<std::vector<void*>, uint64_t>;
+
+  // Returns a thread-local reference.
+  static CpuProfiler& Get();
+
+  // Starts sampling the thread frequency_hz times per second of its CPU time. Drops the samples
+  // taken so far. Returns false if the profiler is running already or the timer failed.
+  bool Start(uint32_t frequency_hz);
+  void Stop();
+
+  // Adds the samples of this thread to dest. Must be called after Stop().
+  void MergeSamples(Samples* dest) const;
+
+  uint64_t dropped() const {
+    return dropped_;
+  }
+
+  // Formats samples in the legacy pprof CPU profile format, which pprof symbolizes with the
+  // binary: pprof <binary> <file>.
+  static std::string FormatProfile(const Samples& samples, uint32_t frequency_hz);
+
+ private:
+  struct Sample {
+    int depth;
+    void* frames[kMaxStackDepth];
+  };
+
+  static void SignalHandler(int sig, siginfo_t* info, void* ucontext);
+  void RecordSample(void* ucontext);
+
+  std::unique_ptr<Sample[]> samples_;
+  size_t num_samples_ = 0;
+  uint64_t dropped_ = 0;
+  void* timer_ = nullptr;  // timer_t of the thread.
+  std::atomic_bool active_{false};
+};
+
+}  // namespace dfly
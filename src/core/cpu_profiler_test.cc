@@ -0,0 +1,99 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/cpu_profiler.h"
+
+#include <gmock/gmock.h>
+
+#include <chrono>
+#include <cstring>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class CpuProfilerTest : public ::testing::Test {
+ protected:
+  void TearDown() override {
+    CpuProfiler::Get().Stop();
+  }
+
+  // Burns cpu time of this thread, which drives the profiling timer.
+  static uint64_t Spin(chrono::milliseconds duration) {
+    uint64_t res = 0;
+    auto end = chrono::steady_clock::now() + duration;
+    while (chrono::steady_clock::now() < end) {
+      for (unsigned i = 0; i < 1000; ++i)
+        res = res * 31 + i;
+    }
+    return res;
+  }
+
+  static uintptr_t ReadWord(const string& profile, size_t index) {
+    uintptr_t word;
+    memcpy(&word, profile.data() + index * sizeof(word), sizeof(word));
+    return word;
+  }
+};
+
+#ifdef __linux__
+TEST_F(CpuProfilerTest, Sample) {
+  CpuProfiler& profiler = CpuProfiler::Get();
+  EXPECT_FALSE(profiler.Start(0));
+
+  ASSERT_TRUE(profiler.Start(1000));
+  EXPECT_FALSE(profiler.Start(1000));  // running already
+  benchmark::DoNotOptimize(Spin(200ms));
+  profiler.Stop();
+
+  CpuProfiler::Samples samples;
+  profiler.MergeSamples(&samples);
+  ASSERT_FALSE(samples.empty());
+
+  uint64_t total = 0;
+  for (const auto& [stack, count] : samples) {
+    EXPECT_GT(stack.size(), 0u);
+    EXPECT_LE(stack.size(), size_t(CpuProfiler::kMaxStackDepth));
+    total += count;
+  }
+  EXPECT_LE(total, CpuProfiler::kMaxSamples);
+  EXPECT_EQ(profiler.dropped(), 0u);
+
+  // Restarting drops the previous samples.
+  ASSERT_TRUE(profiler.Start(1000));
+  profiler.Stop();
+  samples.clear();
+  profiler.MergeSamples(&samples);
+  EXPECT_LE(samples.size(), 1u);
+}
+#endif
+
+TEST_F(CpuProfilerTest, FormatProfile) {
+  int a, b;
+  CpuProfiler::Samples samples;
+  samples[vector<void*>{&a, &b}] = 3;
+
+  string profile = CpuProfiler::FormatProfile(samples, 100);
+  ASSERT_GE(profile.size(), 12 * sizeof(uintptr_t));
+
+  // Header with the sampling period in microseconds.
+  EXPECT_EQ(ReadWord(profile, 0), 0u);
+  EXPECT_EQ(ReadWord(profile, 1), 3u);
+  EXPECT_EQ(ReadWord(profile, 3), 10000u);
+
+  // The sample: its count, depth and frames.
+  EXPECT_EQ(ReadWord(profile, 5), 3u);
+  EXPECT_EQ(ReadWord(profile, 6), 2u);
+  EXPECT_EQ(ReadWord(profile, 7), uintptr_t(&a));
+  EXPECT_EQ(ReadWord(profile, 8), uintptr_t(&b));
+
+  // Trailer, followed by the mappings of the process.
+  EXPECT_EQ(ReadWord(profile, 9), 0u);
+  EXPECT_EQ(ReadWord(profile, 10), 1u);
+  EXPECT_EQ(ReadWord(profile, 11), 0u);
+}
+
+}  // namespace dfly
@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include <chrono>
 #include <vector>
 
 #include "absl/random/random.h"
@@ -15,8 +16,24 @@ namespace dfly {
 // TODO: We could name it DACHE: Dynamic and Adaptive caCHE.
 // After all, we added additional improvements we added as part of the dragonfly project,
 // that probably justify a right to choose our own name for this data structure.
-struct BasicDashPolicy {
-  enum { kSlotNum = 12, kBucketNum = 64, kStashBucketNum = 2 };
+// Bucket geometry of a table: slots per bucket and regular and stash buckets per segment.
+// Wider buckets amortize the bucket metadata over more entries but lengthen every probe, larger
+// segments make splits rarer but costlier. Buckets hold at most 16 slots, as their fingerprints
+// are compared with a single SIMD instruction. Policies inherit one of the presets below,
+// see dash_bench --type=geometry for their memory per item and throughput.
+template <unsigned SLOT_NUM, unsigned BUCKET_NUM, unsigned STASH_BUCKET_NUM> struct DashGeometry {
+  enum { kSlotNum = SLOT_NUM, kBucketNum = BUCKET_NUM, kStashBucketNum = STASH_BUCKET_NUM };
+};
+
+namespace dash_geometry {
+
+using Default = DashGeometry<14, 56, 4>;  // the geometry of the prime and expire tables.
+using Sparse = DashGeometry<12, 64, 2>;   // shorter probes, for tiny keys and high churn.
+using Dense = DashGeometry<16, 52, 4>;    // less metadata per entry, for large stable tables.
+
+}  // namespace dash_geometry
+
+struct BasicDashPolicy : public dash_geometry::Sparse {
   static constexpr bool kUseVersion = false;
 
   template <typename U> static void DestroyValue(const U&) {
@@ -149,6 +166,19 @@ class DashTable : public detail::DashTableBase {
   template <typename U> const_iterator Find(U&& key) const;
   template <typename U> iterator Find(U&& key);
 
+  // Same as Find(key) but with key_hash == DoHash(key) computed by the caller. Allows looking up
+  // the same key in several tables sharing the hash function without hashing it again.
+  template <typename U> iterator Find(U&& key, uint64_t key_hash) {
+    return FindFirst(key_hash, EqPred(key));
+  }
+
+  // Prefetches the buckets that Find(key) would probe. Allows multi-key lookups to issue all
+  // their memory loads before resolving the keys one by one.
+  template <typename U> void Prefetch(const U& key) const {
+    uint64_t key_hash = DoHash(key);
+    segment_[SegmentId(key_hash)]->Prefetch(key_hash);
+  }
+
   // Find first entry with given key hash that evaulates to true on pred.
   // Pred accepts either (const key&) or (const key&, const value&)
   template <typename Pred> iterator FindFirst(uint64_t key_hash, Pred&& pred);
@@ -253,6 +283,11 @@ class DashTable : public detail::DashTableBase {
     return const_bucket_iterator{this, segment_id, uint8_t(bucket_id)};
   }
 
+  // Returns the bucket of it, seeking to its first occupied slot.
+  bucket_iterator GetBucketIterator(iterator it) {
+    return bucket_iterator{this, it.segment_id(), uint8_t(it.bucket_id())};
+  }
+
   iterator GetIterator(unsigned segment_id, unsigned bucket_id, unsigned slot_id) {
     return iterator{this, segment_id, uint8_t(bucket_id), uint8_t(slot_id)};
   }
@@ -276,6 +311,15 @@ class DashTable : public detail::DashTableBase {
 
   template <typename Cb> void CVCUponBump(uint64_t ver_threshold, const_iterator it, Cb&& cb);
 
+  // Splits segments filled above max_fill of their capacity ahead of the inserts that would
+  // split them. Visits up to max_visits distinct segments in directory order starting from
+  // *cursor, which is updated for the next call. Before a segment is split, cb is called with
+  // its non-empty buckets whose version is below ver_threshold, as in CVCUponInsert.
+  // Returns the number of segments split.
+  template <typename EvictionPolicy, typename Cb>
+  unsigned SplitFilledSegments(double max_fill, unsigned max_visits, uint64_t ver_threshold,
+                               size_t* cursor, EvictionPolicy& ev, Cb&& cb);
+
   void Clear();
 
   // Returns true if an element was deleted i.e the rightmost slot was busy.
@@ -296,6 +340,15 @@ class DashTable : public detail::DashTableBase {
     return stash_unloaded_;
   }
 
+  // Number of segment splits and the time they took, including directory growth.
+  uint64_t splits() const {
+    return splits_;
+  }
+
+  uint64_t split_time_ns() const {
+    return split_time_ns_;
+  }
+
  private:
   enum class InsertMode {
     kInsertIfNotFound,
@@ -308,6 +361,10 @@ class DashTable : public detail::DashTableBase {
   void IncreaseDepth(unsigned new_depth);
   void Split(uint32_t seg_id);
 
+  // Splits the segment at seg_id, doubling the directory if needed. Returns the id of the
+  // segment in the new directory.
+  uint32_t GrowSegment(uint32_t seg_id);
+
   // Segment directory contains multiple segment pointers, some of them pointing to
   // the same object. IterateDistinct goes over all distinct segments in the table.
   template <typename Cb> void IterateDistinct(Cb&& cb);
@@ -321,6 +378,8 @@ class DashTable : public detail::DashTableBase {
 
   uint64_t garbage_collected_ = 0;
   uint64_t stash_unloaded_ = 0;
+  uint64_t splits_ = 0;
+  uint64_t split_time_ns_ = 0;
 };  // DashTable
 
 template <typename _Key, typename _Value, typename Policy>
@@ -841,19 +900,70 @@ auto DashTable<_Key, _Value, Policy>::InsertInternal(U&& key, V&& value, Evictio
       throw std::bad_alloc{};
     }
 
-    // Split the segment.
-    if (target->local_depth() == global_depth_) {
-      IncreaseDepth(global_depth_ + 1);
+    ev.RecordSplit(target);
+    GrowSegment(target_seg_id);
+    target_seg_id = SegmentId(key_hash);
+  }
 
-      target_seg_id = SegmentId(key_hash);
-      assert(target_seg_id < segment_.size() && segment_[target_seg_id] == target);
+  return std::make_pair(iterator{}, false);
+}
+
+template <typename _Key, typename _Value, typename Policy>
+template <typename EvictionPolicy, typename Cb>
+unsigned DashTable<_Key, _Value, Policy>::SplitFilledSegments(double max_fill, unsigned max_visits,
+                                                             uint64_t ver_threshold,
+                                                             size_t* cursor, EvictionPolicy& ev,
+                                                             Cb&& cb) {
+  const size_t max_size = SegmentType::capacity() * max_fill;
+  unsigned num_splits = 0;
+
+  uint32_t sid = *cursor < segment_.size() ? *cursor : 0;
+  for (unsigned i = 0; i < max_visits; ++i) {
+    SegmentType* target = segment_[sid];
+    sid &= ~((1u << (global_depth_ - target->local_depth())) - 1);  // start of its chunk.
+
+    if (target->SlowSize() > max_size) {
+      if (!ev.CanGrow(*this))
+        break;
+
+      if constexpr (SegmentType::kUseVersion) {
+        for (uint8_t bid = 0; bid < SegmentType::kTotalBuckets; ++bid) {
+          if (target->GetVersion(bid) < ver_threshold && !target->GetBucket(bid).IsEmpty()) {
+            cb(bucket_iterator{this, sid, bid});
+          }
+        }
+      }
+
+      ev.RecordSplit(target);
+      sid = GrowSegment(sid);
+      ++num_splits;
+      continue;  // the source segment may still be above max_fill.
     }
 
-    ev.RecordSplit(target);
-    Split(target_seg_id);
+    sid = NextSeg(sid);
+    if (sid >= segment_.size())
+      sid = 0;
   }
 
-  return std::make_pair(iterator{}, false);
+  *cursor = sid;
+  return num_splits;
+}
+
+template <typename _Key, typename _Value, typename Policy>
+uint32_t DashTable<_Key, _Value, Policy>::GrowSegment(uint32_t seg_id) {
+  auto start = std::chrono::steady_clock::now();
+
+  if (segment_[seg_id]->local_depth() == global_depth_) {
+    IncreaseDepth(global_depth_ + 1);
+    seg_id <<= 1;  // IncreaseDepth replicates every pointer into two adjacent ones.
+  }
+  Split(seg_id);
+
+  ++splits_;
+  split_time_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start)
+                        .count();
+  return seg_id;
 }
 
 template <typename _Key, typename _Value, typename Policy>
@@ -6,6 +6,7 @@
 
 #include <absl/base/internal/cycleclock.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/strings/str_cat.h>
 
 #include "base/hash.h"
 #include "base/histogram.h"
@@ -21,8 +22,12 @@ extern "C" {
 using namespace std;
 
 ABSL_FLAG(uint32_t, n, 100000, "num items");
-ABSL_FLAG(string, type, "dash", "");
+ABSL_FLAG(string, type, "dash",
+          "dash, dict, flat or geometry. geometry compares the dash table presets of "
+          "dash_geometry by memory per item and throughput");
 ABSL_FLAG(bool, sds, false, "If true, uses sds as primary key");
+ABSL_FLAG(bool, find, false,
+          "If true, also measures lookup throughput of existing and missing keys (dash only)");
 
 namespace dfly {
 
@@ -85,6 +90,14 @@ struct SdsDashPolicy {
   }
 };
 
+template <typename Geometry> struct UInt64GeometryPolicy : public UInt64Policy {
+  enum {
+    kSlotNum = Geometry::kSlotNum,
+    kBucketNum = Geometry::kBucketNum,
+    kStashBucketNum = Geometry::kStashBucketNum
+  };
+};
+
 using Dash64 = DashTable<uint64_t, uint64_t, UInt64Policy>;
 using DashSds = DashTable<sds, uint64_t, SdsDashPolicy>;
 
@@ -154,6 +167,49 @@ void BenchDashSds(uint64_t num) {
   }
 }
 
+// Returns the number of found items. Half of the lookups are misses to exercise the stash path.
+uint64_t BenchDashFind(uint64_t num) {
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < num * 2; ++i) {
+    found += !udt.Find(i).is_done();
+  }
+  return found;
+}
+
+uint64_t BenchDashSdsFind(uint64_t num) {
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < num * 2; ++i) {
+    string key = absl::StrCat("xxxxxxxxxxxxxxxxxxxxxxx", i);
+    found += !sds_dt.Find(string_view{key}).is_done();
+  }
+  return found;
+}
+
+template <typename Geometry> void BenchGeometry(string_view name, uint64_t num) {
+  DashTable<uint64_t, uint64_t, UInt64GeometryPolicy<Geometry>> dt;
+
+  uint64_t start = absl::GetCurrentTimeNanos();
+  for (uint64_t i = 0; i < num; ++i) {
+    dt.Insert(i, 0);
+  }
+  uint64_t insert_ns = std::max<uint64_t>(absl::GetCurrentTimeNanos() - start, 1);
+
+  start = absl::GetCurrentTimeNanos();
+  uint64_t found = 0;
+  for (uint64_t i = 0; i < num * 2; ++i) {
+    found += !dt.Find(i).is_done();
+  }
+  uint64_t find_ns = std::max<uint64_t>(absl::GetCurrentTimeNanos() - start, 1);
+  CHECK_EQ(found, num);
+
+  CONSOLE_INFO << name << " (" << int(Geometry::kSlotNum) << " slots, "
+               << int(Geometry::kBucketNum) << "+" << int(Geometry::kStashBucketNum)
+               << " buckets): " << double(dt.mem_usage()) / num << " table bytes/item, load factor "
+               << dt.load_factor() << ", " << uint64_t(num * 1e9 / insert_ns) << " inserts/sec, "
+               << uint64_t(num * 2 * 1e9 / find_ns) << " lookups/sec, " << dt.splits()
+               << " splits in " << dt.split_time_ns() / 1000 << "us";
+}
+
 static uint64_t callbackHash(const void* key) {
   return XXH64(&key, sizeof(key), 0);
 }
@@ -219,6 +275,11 @@ int main(int argc, char* argv[]) {
     }
   } else if (table_type == "flat") {
     BenchFlat(num);
+  } else if (table_type == "geometry") {
+    BenchGeometry<dash_geometry::Default>("default", num);
+    BenchGeometry<dash_geometry::Sparse>("sparse", num);
+    BenchGeometry<dash_geometry::Dense>("dense", num);
+    return 0;
   } else {
     LOG(FATAL) << "Unknown type " << table_type;
   }
@@ -227,5 +288,13 @@ int main(int argc, char* argv[]) {
   uint64_t delta = (absl::GetCurrentTimeNanos() - start) / 1000000;
   CONSOLE_INFO << "Took " << delta << " ms";
 
+  if (GetFlag(FLAGS_find) && table_type == "dash") {
+    start = absl::GetCurrentTimeNanos();
+    uint64_t found = is_sds ? BenchDashSdsFind(num) : BenchDashFind(num);
+    uint64_t took_ns = absl::GetCurrentTimeNanos() - start;
+    CONSOLE_INFO << "Lookups: " << num * 2 << ", found: " << found << ", "
+                 << uint64_t(num * 2 * 1e9 / std::max<uint64_t>(took_ns, 1)) << " lookups/sec";
+  }
+
   return 0;
 }
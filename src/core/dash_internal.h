@@ -148,6 +148,18 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
     return mask & GetProbe(probe);
   }
 
+  // Probes this bucket for owned entries and `next` for probing entries with a single
+  // vector comparison (when AVX2 is available).
+  // Returns the mask for this bucket in the low 16 bits and the mask of `next` in the high bits.
+  uint32_t FindWithNeighbour(uint8_t fp_hash, const BucketBase& next) const;
+
+  // Returns a mask of busy stash fingerprints equal to fp. `is_probe` selects fingerprints
+  // that point to the stash entries of the neighbour bucket.
+  uint32_t FindStash(uint8_t fp_hash, bool is_probe) const {
+    unsigned om = is_probe ? stash_probe_mask_ : ~stash_probe_mask_;
+    return CompareStashFP(fp_hash) & stash_busy_ & om & ((1u << kStashFpLen) - 1);
+  }
+
   uint8_t Fp(unsigned i) const {
     assert(i < finger_arr_.size());
     return finger_arr_[i];
@@ -208,6 +220,7 @@ template <unsigned NUM_SLOTS, unsigned NUM_STASH_FPS> class BucketBase {
 
  protected:
   uint32_t CompareFP(uint8_t fp) const;
+  uint32_t CompareStashFP(uint8_t fp) const;
   bool ShiftRight();
 
   // Returns true if stash_pos was stored, false overwise
@@ -328,7 +341,12 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
       this->SetHash(slot, meta_hash, probe);
     }
 
-    template <typename Pred> SlotId FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const;
+    template <typename Pred> SlotId FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const {
+      return FindByMask(this->Find(fp_hash, probe), std::forward<Pred>(pred));
+    }
+
+    // Checks the slots set in mask against pred, returns the first matching one.
+    template <typename Pred> SlotId FindByMask(uint32_t mask, Pred&& pred) const;
 
     bool ShiftRight();
 
@@ -503,6 +521,13 @@ template <typename _Key, typename _Value, typename Policy = DefaultSegmentPolicy
   // Find item with given key hash and truthy predicate
   template <typename Pred> Iterator FindIt(Hash_t key_hash, Pred&& pred) const;
 
+  // Prefetches the home and the neighbour buckets of key_hash.
+  void Prefetch(Hash_t key_hash) const {
+    uint8_t bidx = BucketIndex(key_hash);
+    __builtin_prefetch(&bucket_[bidx]);
+    __builtin_prefetch(&bucket_[NextBid(bidx)]);
+  }
+
   // Returns valid iterator if succeeded or invalid if not (it's full).
   // Requires: key should be not present in the segment.
   // if spread is true, tries to spread the load between neighbour and home buckets,
@@ -953,6 +978,46 @@ uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::CompareFP(uint8_t fp) const {
 }
 #endif
 
+template <unsigned NUM_SLOTS, unsigned NUM_OVR>
+uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::FindWithNeighbour(uint8_t fp,
+                                                           const BucketBase& next) const {
+#if defined(__AVX2__)
+  // Both fingerprint arrays are compared in one 256-bit register: this bucket in the low lane,
+  // next in the high lane. movemask gives us the 16+16 bit result directly.
+  const __m256i key_data = _mm256_set1_epi8(fp);
+  __m128i lo = mm_loadu_si128(reinterpret_cast<const __m128i*>(finger_arr_.data()));
+  __m128i hi = mm_loadu_si128(reinterpret_cast<const __m128i*>(next.finger_arr_.data()));
+  __m256i seg_data = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+  uint32_t mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(seg_data, key_data));
+#else
+  uint32_t mask = CompareFP(fp) | (next.CompareFP(fp) << 16);
+#endif
+  uint32_t valid = (GetBusy() & GetProbe(false)) | ((next.GetBusy() & next.GetProbe(true)) << 16);
+  return mask & valid;
+}
+
+// Compares all stash fingerprints at once using SWAR on a 32-bit word.
+// Returns kStashFpLen bits mask, bit i is set if stash_arr_[i] == fp.
+template <unsigned NUM_SLOTS, unsigned NUM_OVR>
+uint32_t BucketBase<NUM_SLOTS, NUM_OVR>::CompareStashFP(uint8_t fp) const {
+  if constexpr (kStashFpLen == 4) {
+    uint32_t x = absl::little_endian::Load32(stash_arr_.data()) ^ (0x01010101u * fp);
+
+    // The msb of each byte in zeros is set iff the byte in x is zero. Unlike the classic
+    // haszero() trick this does not produce false positives due to borrows.
+    uint32_t zeros = ~(((x & 0x7F7F7F7Fu) + 0x7F7F7F7Fu) | x | 0x7F7F7F7Fu);
+
+    // Gather bits 7, 15, 23, 31 into bits 21-24 and shift them down.
+    return (((zeros >> 7) * 0x00204081u) >> 21) & 0xF;
+  } else {
+    uint32_t mask = 0;
+    for (unsigned i = 0; i < kStashFpLen; ++i) {
+      mask |= unsigned(stash_arr_[i] == fp) << i;
+    }
+    return mask;
+  }
+}
+
 // Bucket slot array goes from left to right: [x, x, ...]
 // Shift right vacates the first slot on the left by shifting all the elements right and
 // possibly deleting the last one on the right.
@@ -972,19 +1037,16 @@ template <unsigned NUM_SLOTS, unsigned NUM_OVR>
 template <typename F>
 auto BucketBase<NUM_SLOTS, NUM_OVR>::IterateStash(uint8_t fp, bool is_probe, F&& func) const
     -> ::std::pair<unsigned, SlotId> {
-  unsigned om = is_probe ? stash_probe_mask_ : ~stash_probe_mask_;
-  unsigned ob = stash_busy_;
-
-  for (unsigned i = 0; i < kStashFpLen; ++i) {
-    if ((ob & 1) && (stash_arr_[i] == fp) && (om & 1)) {
-      unsigned pos = (stash_pos_ >> (i * 2)) & 3;
-      auto sid = func(i, pos);
-      if (sid != BucketBase::kNanSlot) {
-        return std::pair<unsigned, SlotId>(pos, sid);
-      }
+  uint32_t mask = FindStash(fp, is_probe);
+
+  while (mask) {
+    unsigned i = __builtin_ctz(mask);
+    unsigned pos = (stash_pos_ >> (i * 2)) & 3;
+    auto sid = func(i, pos);
+    if (sid != BucketBase::kNanSlot) {
+      return std::pair<unsigned, SlotId>(pos, sid);
     }
-    ob >>= 1;
-    om >>= 1;
+    mask &= mask - 1;
   }
   return std::pair<unsigned, SlotId>(0, BucketBase::kNanSlot);
 }
@@ -1022,28 +1084,25 @@ ___] |___ |__] |  | |___ | \|  |
 
 template <typename Key, typename Value, typename Policy>
 template <typename Pred>
-auto Segment<Key, Value, Policy>::Bucket::FindByFp(uint8_t fp_hash, bool probe, Pred&& pred) const
+auto Segment<Key, Value, Policy>::Bucket::FindByMask(uint32_t mask, Pred&& pred) const
     -> SlotId {
-  unsigned mask = this->Find(fp_hash, probe);
-  if (!mask)
-    return kNanSlot;
+  // Visit only the matching slots.
+  while (mask) {
+    unsigned i = __builtin_ctz(mask);
 
-  unsigned delta = __builtin_ctz(mask);
-  mask >>= delta;
-  for (unsigned i = delta; i < kSlotNum; ++i) {
     // Filterable just by key
     if constexpr (std::is_invocable_v<Pred, const Key_t&>) {
-      if ((mask & 1) && pred(key[i]))
+      if (pred(key[i]))
         return i;
     }
 
     // Filterable by key and value
     if constexpr (std::is_invocable_v<Pred, const Key_t&, const Value_t&>) {
-      if ((mask & 1) && pred(key[i], value[i]))
+      if (pred(key[i], value[i]))
         return i;
     }
 
-    mask >>= 1;
+    mask &= mask - 1;
   };
 
   return kNanSlot;
@@ -1119,22 +1178,24 @@ template <typename Key, typename Value, typename Policy>
 template <typename Pred>
 auto Segment<Key, Value, Policy>::FindIt(Hash_t key_hash, Pred&& pred) const -> Iterator {
   uint8_t bidx = BucketIndex(key_hash);
+  uint8_t nid = NextBid(bidx);
   const Bucket& target = bucket_[bidx];
+  const Bucket& probe = bucket_[nid];
 
   // It helps a bit (10% on my home machine) and more importantly, it does not hurt
   // since we are going to access this memory in a bit.
   __builtin_prefetch(&target);
+  __builtin_prefetch(&probe);
 
+  // Fingerprints of the home and the neighbour buckets are compared together.
   uint8_t fp_hash = key_hash & kFpMask;
-  SlotId sid = target.FindByFp(fp_hash, false, pred);
+  uint32_t fp_mask = target.FindWithNeighbour(fp_hash, probe);
+  SlotId sid = target.FindByMask(fp_mask & 0xFFFF, pred);
   if (sid != BucketType::kNanSlot) {
     return Iterator{bidx, sid};
   }
 
-  uint8_t nid = NextBid(bidx);
-  const Bucket& probe = bucket_[nid];
-
-  sid = probe.FindByFp(fp_hash, true, pred);
+  sid = probe.FindByMask(fp_mask >> 16, pred);
 
 #ifdef ENABLE_DASH_STATS
   stats.neighbour_probes++;
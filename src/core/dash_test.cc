@@ -82,6 +82,32 @@ struct UInt64Policy : public BasicDashPolicy {
   }
 };
 
+template <typename Geometry> struct UInt64GeometryPolicy : public UInt64Policy {
+  enum {
+    kSlotNum = Geometry::kSlotNum,
+    kBucketNum = Geometry::kBucketNum,
+    kStashBucketNum = Geometry::kStashBucketNum
+  };
+};
+
+template <typename Geometry> void CheckGeometry() {
+  constexpr size_t kNumItems = 20000;
+  DashTable<uint64_t, uint64_t, UInt64GeometryPolicy<Geometry>> dt;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    ASSERT_TRUE(dt.Insert(i, i).second);
+  }
+  for (size_t i = 0; i < kNumItems; i += 2) {
+    ASSERT_EQ(1, dt.Erase(i));
+  }
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto it = dt.Find(i);
+    ASSERT_EQ(i % 2 == 0, it.is_done()) << i;
+    if (!it.is_done())
+      ASSERT_EQ(i, it->second);
+  }
+  EXPECT_EQ(kNumItems / 2, dt.size());
+}
+
 struct RelaxedBumpPolicy {
   bool CanBump(uint64_t key) const {
     return true;
@@ -199,6 +225,26 @@ TEST_F(DashTest, SlotBitmap) {
   EXPECT_EQ(2, slot.GetProbe(true));
 }
 
+TEST_F(DashTest, BucketProbe) {
+  detail::BucketBase<12, 4> home, next;
+  home.SetHash(3, 42, false);
+  home.SetHash(4, 17, false);
+  next.SetHash(5, 42, true);
+  next.SetHash(6, 42, false);  // owned by next, should not be reported as a neighbour match.
+
+  uint32_t mask = home.FindWithNeighbour(42, next);
+  EXPECT_EQ(1u << 3, mask & 0xFFFF);
+  EXPECT_EQ(1u << 5, mask >> 16);
+  EXPECT_EQ(0, home.FindWithNeighbour(99, next));
+
+  home.SetStashPtr(1, 42, &next);
+  home.SetStashPtr(0, 7, &next);
+  home.SetStashPtr(0, 42, &next);
+  EXPECT_EQ(0b101, home.FindStash(42, false));
+  EXPECT_EQ(0b010, home.FindStash(7, false));
+  EXPECT_EQ(0, home.FindStash(42, true));
+}
+
 TEST_F(DashTest, Basic) {
   Segment::Key_t key = 0;
   Segment::Value_t val = 0;
@@ -524,6 +570,8 @@ TEST_F(DashTest, Insert) {
 
     ASSERT_EQ(it->second, i);
     ASSERT_LE(dt_.load_factor(), 1) << i;
+    auto hash_it = dt_.Find(i, dt_.DoHash(i));
+    ASSERT_TRUE(!hash_it.is_done() && hash_it->second == i) << i;
   }
 
   for (size_t i = kNumItems; i < kNumItems * 10; ++i) {
@@ -543,6 +591,36 @@ TEST_F(DashTest, Insert) {
   ASSERT_TRUE(dt_.Find(some_val).is_done());
 }
 
+TEST_F(DashTest, SplitFilledSegments) {
+  constexpr size_t kNumItems = 20000;
+  for (size_t i = 0; i < kNumItems; ++i) {
+    dt_.Insert(i, i);
+  }
+  uint64_t splits = dt_.splits();
+  EXPECT_GT(splits, 0u);
+
+  Dash64::DefaultEvictionPolicy ev;
+  size_t cursor = 0;
+  unsigned presplits = 0;
+  for (unsigned i = 0; i < 100; ++i) {
+    presplits += dt_.SplitFilledSegments(0.5, 16, 0, &cursor, ev, [](auto) {});
+  }
+  EXPECT_GT(presplits, 0u);
+  EXPECT_EQ(splits + presplits, dt_.splits());
+  EXPECT_LE(dt_.load_factor(), 0.5);
+
+  for (size_t i = 0; i < kNumItems; ++i) {
+    auto it = dt_.Find(i);
+    ASSERT_TRUE(!it.is_done() && it->second == i) << i;
+  }
+}
+
+TEST_F(DashTest, Geometries) {
+  CheckGeometry<dash_geometry::Default>();
+  CheckGeometry<dash_geometry::Sparse>();
+  CheckGeometry<dash_geometry::Dense>();
+}
+
 TEST_F(DashTest, Traverse) {
   constexpr auto kNumItems = 50;
   for (size_t i = 0; i < kNumItems; ++i) {
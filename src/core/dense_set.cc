@@ -14,10 +14,6 @@
 
 #include "glog/logging.h"
 
-extern "C" {
-#include "redis/zmalloc.h"
-}
-
 namespace dfly {
 using namespace std;
 
@@ -25,6 +21,15 @@ constexpr size_t kMinSizeShift = 2;
 constexpr size_t kMinSize = 1 << kMinSizeShift;
 constexpr bool kAllowDisplacements = true;
 
+// Tables with fewer buckets are rehashed at once when they grow.
+constexpr size_t kMinIncrementalRehash = 1024;
+
+// Buckets migrated per insertion during an incremental rehash. A table of N buckets takes
+// N/2 insertions to grow again, so the migration always finishes before that.
+constexpr uint32_t kRehashStepBuckets = 4;
+
+thread_local size_t tl_pending_rehash_buckets = 0;
+
 DenseSet::IteratorBase::IteratorBase(const DenseSet* owner, bool is_end)
     : owner_(const_cast<DenseSet*>(owner)), curr_entry_(nullptr) {
   curr_list_ = is_end ? owner_->entries_.end() : owner_->entries_.begin();
@@ -82,13 +87,15 @@ DenseSet::~DenseSet() {
   CHECK(entries_.empty());
 }
 
-size_t DenseSet::PushFront(DenseSet::ChainVectorIterator it, void* data, bool has_ttl) {
+size_t DenseSet::PushFront(DenseSet::ChainVectorIterator it, void* data, bool has_ttl,
+                           uint8_t fp) {
   // if this is an empty list assign the value to the empty placeholder pointer
   if (it->IsEmpty()) {
     it->SetObject(data);
+    it->SetFingerprint(fp);
   } else {
     // otherwise make a new link and connect it to the front of the list
-    it->SetLink(NewLink(data, *it));
+    it->SetLink(NewLink(data, fp, *it));
   }
 
   if (has_ttl) {
@@ -104,6 +111,7 @@ void DenseSet::PushFront(DenseSet::ChainVectorIterator it, DenseSet::DensePtr pt
 
   if (it->IsEmpty()) {
     it->SetObject(ptr.GetObject());
+    it->SetFingerprint(ptr.Fingerprint());
     if (ptr.HasTtl()) {
       it->SetTtl(true);
       expiration_used_ = true;
@@ -120,7 +128,7 @@ void DenseSet::PushFront(DenseSet::ChainVectorIterator it, DenseSet::DensePtr pt
     DCHECK(ptr.IsObject());
 
     // allocate a new link if needed and copy the pointer to the new link
-    it->SetLink(NewLink(ptr.Raw(), *it));
+    it->SetLink(NewLink(ptr.Raw(), ptr.Fingerprint(), *it));
     if (ptr.HasTtl()) {
       it->SetTtl(true);
       expiration_used_ = true;
@@ -167,12 +175,19 @@ void* DenseSet::PopDataFront(DenseSet::ChainVectorIterator it) {
 }
 
 void DenseSet::ClearInternal() {
-  for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+  ClearStep(0, entries_.size());
+}
+
+uint32_t DenseSet::ClearStep(uint32_t start, uint32_t count) {
+  auto end = entries_.begin() + min<size_t>(entries_.size(), size_t(start) + count);
+  for (auto it = entries_.begin() + start; it < end; ++it) {
+    size_t bid = it - entries_.begin();
+    unsigned log = bid < rehash_cursor_ ? capacity_log_ - 1 : capacity_log_;
     while (!it->IsEmpty()) {
       bool has_ttl = it->HasTtl();
       bool is_displ = it->IsDisplaced();
       void* obj = PopDataFront(it);
-      int32_t delta = int32_t(BucketId(obj, 0)) - int32_t(it - entries_.begin());
+      int32_t delta = int32_t(BucketId(Hash(obj, 0), log)) - int32_t(bid);
       if (is_displ) {
         DCHECK(delta < 2 || delta > -2);
       } else {
@@ -182,15 +197,21 @@ void DenseSet::ClearInternal() {
     }
   }
 
+  if (end != entries_.end())
+    return end - entries_.begin();
+
   entries_.clear();
   num_used_buckets_ = 0;
   num_links_ = 0;
   size_ = 0;
   expiration_used_ = false;
+  tl_pending_rehash_buckets -= rehash_cursor_;
+  rehash_cursor_ = 0;
+  return 0;
 }
 
-bool DenseSet::Equal(DensePtr dptr, const void* ptr, uint32_t cookie) const {
-  if (dptr.IsEmpty()) {
+bool DenseSet::Equal(DensePtr dptr, const void* ptr, uint32_t cookie, uint8_t fp) const {
+  if (dptr.IsEmpty() || dptr.Fingerprint() != fp) {
     return false;
   }
 
@@ -223,14 +244,14 @@ bool DenseSet::NoItemBelongsBucket(uint32_t bid) const {
   return true;
 }
 
-auto DenseSet::FindEmptyAround(uint32_t bid) -> ChainVectorIterator {
+auto DenseSet::FindEmptyAround(uint32_t bid, bool displace) -> ChainVectorIterator {
   ExpireIfNeeded(nullptr, &entries_[bid]);
 
   if (entries_[bid].IsEmpty()) {
     return entries_.begin() + bid;
   }
 
-  if (!kAllowDisplacements) {
+  if (!kAllowDisplacements || !displace) {
     return entries_.end();
   }
 
@@ -256,6 +277,8 @@ void DenseSet::Reserve(size_t sz) {
 
   sz = absl::bit_ceil(sz);
   if (sz > entries_.size()) {
+    // Resizing rehashes all the buckets anyway, so the previous growth is finished first.
+    RehashStep(UINT32_MAX);
     size_t prev_size = entries_.size();
     entries_.resize(sz);
     capacity_log_ = absl::bit_width(sz) - 1;
@@ -266,73 +289,90 @@ void DenseSet::Reserve(size_t sz) {
 void DenseSet::Grow(size_t prev_size) {
   // perform rehashing of items in the set
   for (long i = prev_size - 1; i >= 0; --i) {
-    DensePtr* curr = &entries_[i];
-    DensePtr* prev = nullptr;
-
-    while (true) {
-      if (ExpireIfNeeded(prev, curr)) {
-        // if curr has disappeared due to expiry and prev was converted from Link to a
-        // regular DensePtr
-        if (prev && !prev->IsLink())
-          break;
-      }
+    RehashBucket(i);
+  }
+}
 
-      if (curr->IsEmpty())
-        break;
-      void* ptr = curr->GetObject();
+void DenseSet::RehashStep(uint32_t num_buckets) {
+  for (; rehash_cursor_ > 0 && num_buckets > 0; --num_buckets) {
+    RehashBucket(--rehash_cursor_);
+    --tl_pending_rehash_buckets;
+  }
 
-      DCHECK(ptr != nullptr && ObjectAllocSize(ptr));
+  // Bucket 1 can move objects to bucket 0, so they are always migrated together.
+  if (rehash_cursor_ == 1) {
+    RehashBucket(--rehash_cursor_);
+    --tl_pending_rehash_buckets;
+  }
+}
 
-      uint32_t bid = BucketId(ptr, 0);
+void DenseSet::RehashBucket(uint32_t i) {
+  DensePtr* curr = &entries_[i];
+  DensePtr* prev = nullptr;
 
-      // if the item does not move from the current chain, ensure
-      // it is not marked as displaced and move to the next item in the chain
-      if (bid == i) {
-        curr->ClearDisplaced();
-        prev = curr;
-        curr = curr->Next();
-        if (curr == nullptr)
-          break;
-      } else {
-        // if the entry is in the wrong chain remove it and
-        // add it to the correct chain. This will also correct
-        // displaced entries
-        auto dest = entries_.begin() + bid;
-        DensePtr dptr = *curr;
+  while (true) {
+    if (ExpireIfNeeded(prev, curr)) {
+      // if curr has disappeared due to expiry and prev was converted from Link to a
+      // regular DensePtr
+      if (prev && !prev->IsLink())
+        break;
+    }
 
-        if (curr->IsObject()) {
-          curr->Reset();  // reset the original placeholder (.next or root)
+    if (curr->IsEmpty())
+      break;
+    void* ptr = curr->GetObject();
 
-          if (prev) {
-            DCHECK(prev->IsLink());
+    DCHECK(ptr != nullptr && ObjectAllocSize(ptr));
 
-            DenseLinkKey* plink = prev->AsLink();
-            DCHECK(&plink->next == curr);
+    uint32_t bid = BucketId(ptr, 0);
 
-            // we want to make *prev a DensePtr instead of DenseLink and we
-            // want to deallocate the link.
-            DensePtr tmp = DensePtr::From(plink);
-            DCHECK(ObjectAllocSize(tmp.GetObject()));
+    // if the item does not move from the current chain, ensure
+    // it is not marked as displaced and move to the next item in the chain
+    if (bid == i) {
+      curr->ClearDisplaced();
+      prev = curr;
+      curr = curr->Next();
+      if (curr == nullptr)
+        break;
+    } else {
+      // if the entry is in the wrong chain remove it and
+      // add it to the correct chain. This will also correct
+      // displaced entries
+      auto dest = entries_.begin() + bid;
+      DensePtr dptr = *curr;
 
-            FreeLink(plink);
-            *prev = tmp;
-          }
+      if (curr->IsObject()) {
+        curr->Reset();  // reset the original placeholder (.next or root)
 
-          DVLOG(2) << " Pushing to " << bid << " " << dptr.GetObject();
-          DCHECK_EQ(BucketId(dptr.GetObject(), 0), bid);
-          PushFront(dest, dptr);
+        if (prev) {
+          DCHECK(prev->IsLink());
 
-          dest->ClearDisplaced();
+          DenseLinkKey* plink = prev->AsLink();
+          DCHECK(&plink->next == curr);
 
-          break;
-        }  // if IsObject
+          // we want to make *prev a DensePtr instead of DenseLink and we
+          // want to deallocate the link.
+          DensePtr tmp = DensePtr::From(plink);
+          DCHECK(ObjectAllocSize(tmp.GetObject()));
 
-        *curr = *dptr.Next();
-        DCHECK(!curr->IsEmpty());
+          FreeLink(plink);
+          *prev = tmp;
+        }
 
+        DVLOG(2) << " Pushing to " << bid << " " << dptr.GetObject();
+        DCHECK_EQ(BucketId(dptr.GetObject(), 0), bid);
         PushFront(dest, dptr);
+
         dest->ClearDisplaced();
-      }
+
+        break;
+      }  // if IsObject
+
+      *curr = *dptr.Next();
+      DCHECK(!curr->IsEmpty());
+
+      PushFront(dest, dptr);
+      dest->ClearDisplaced();
     }
   }
 }
@@ -345,7 +385,7 @@ auto DenseSet::AddOrFindDense(void* ptr, bool has_ttl) -> DensePtr* {
     entries_.resize(kMinSize);
     uint32_t bucket_id = BucketId(hc);
     auto e = entries_.begin() + bucket_id;
-    obj_malloc_used_ += PushFront(e, ptr, has_ttl);
+    obj_malloc_used_ += PushFront(e, ptr, has_ttl, HashFingerprint(hc));
     ++size_;
     ++num_used_buckets_;
 
@@ -353,8 +393,7 @@ auto DenseSet::AddOrFindDense(void* ptr, bool has_ttl) -> DensePtr* {
   }
 
   // if the value is already in the set exit early
-  uint32_t bucket_id = BucketId(hc);
-  DensePtr* dptr = Find(ptr, bucket_id, 0).second;
+  DensePtr* dptr = Find(ptr, hc, 0).second;
   if (dptr != nullptr) {
     return dptr;
   }
@@ -363,6 +402,27 @@ auto DenseSet::AddOrFindDense(void* ptr, bool has_ttl) -> DensePtr* {
   return nullptr;
 }
 
+uint32_t DenseSet::PrepareInsert(uint64_t hashcode, bool* old_layout) {
+  *old_layout = false;
+  if (rehash_cursor_ == 0)
+    return BucketId(hashcode);
+
+  RehashStep(kRehashStepBuckets);
+
+  // The object could be displaced to a neighbour of its old bucket, so the cursor must not
+  // separate them.
+  uint32_t old_bid = BucketId(hashcode, capacity_log_ - 1);
+  while (rehash_cursor_ > 0 && old_bid <= rehash_cursor_ && old_bid + 1 >= rehash_cursor_) {
+    RehashStep(1);
+  }
+
+  if (rehash_cursor_ > 0 && old_bid + 1 < rehash_cursor_) {
+    *old_layout = true;
+    return old_bid;
+  }
+  return BucketId(hashcode);
+}
+
 // Assumes that the object does not exist in the set.
 void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
   if (entries_.empty()) {
@@ -370,16 +430,18 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
     entries_.resize(kMinSize);
   }
 
-  uint32_t bucket_id = BucketId(hashcode);
+  bool old_layout;
+  uint32_t bucket_id = PrepareInsert(hashcode, &old_layout);
 
   DCHECK_LT(bucket_id, entries_.size());
 
   // Try insert into flat surface first. Also handle the grow case
   // if utilization is too high.
   for (unsigned j = 0; j < 2; ++j) {
-    ChainVectorIterator list = FindEmptyAround(bucket_id);
+    // During rehashing objects are displaced only within the old layout.
+    ChainVectorIterator list = FindEmptyAround(bucket_id, rehash_cursor_ == 0 || old_layout);
     if (list != entries_.end()) {
-      obj_malloc_used_ += PushFront(list, obj, has_ttl);
+      obj_malloc_used_ += PushFront(list, obj, has_ttl, HashFingerprint(hashcode));
       if (std::distance(entries_.begin(), list) != bucket_id) {
         list->SetDisplaced(std::distance(entries_.begin() + bucket_id, list));
       }
@@ -392,12 +454,19 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
       break;
     }
 
+    RehashStep(UINT32_MAX);  // finish the previous growth if it is still in progress
+
     size_t prev_size = entries_.size();
     entries_.resize(prev_size * 2);
     ++capacity_log_;
 
-    Grow(prev_size);
-    bucket_id = BucketId(hashcode);
+    if (prev_size < kMinIncrementalRehash) {
+      Grow(prev_size);
+    } else {
+      rehash_cursor_ = prev_size;
+      tl_pending_rehash_buckets += prev_size;
+    }
+    bucket_id = PrepareInsert(hashcode, &old_layout);
   }
 
   DCHECK(!entries_[bucket_id].IsEmpty());
@@ -413,6 +482,7 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
    */
 
   DensePtr to_insert(obj);
+  to_insert.SetFingerprint(HashFingerprint(hashcode));
   if (has_ttl) {
     to_insert.SetTtl(true);
     expiration_used_ = true;
@@ -426,7 +496,15 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
     bucket_id -= unlinked.GetDisplacedDirection();
   }
 
-  DCHECK_EQ(BucketId(to_insert.GetObject(), 0), bucket_id);
+  // The walk can end at the home of an old layout object that was already migrated, it must
+  // move to the current layout then, buckets past the rehash cursor are never visited again.
+  if (old_layout && bucket_id >= rehash_cursor_) {
+    old_layout = false;
+    bucket_id = BucketId(to_insert.GetObject(), 0);
+  }
+
+  DCHECK_EQ(BucketId(Hash(to_insert.GetObject(), 0), old_layout ? capacity_log_ - 1 : capacity_log_),
+            bucket_id);
   ChainVectorIterator list = entries_.begin() + bucket_id;
   PushFront(list, to_insert);
   obj_malloc_used_ += ObjectAllocSize(obj);
@@ -435,14 +513,31 @@ void DenseSet::AddUnique(void* obj, bool has_ttl, uint64_t hashcode) {
   ++size_;
 }
 
-auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
+auto DenseSet::Find2(const void* ptr, uint64_t hashcode, uint32_t cookie)
+    -> tuple<size_t, DensePtr*, DensePtr*> {
+  uint8_t fp = HashFingerprint(hashcode);
+  if (rehash_cursor_ > 0) {
+    // Look in the old layout if any of the buckets the object could occupy there was not
+    // migrated yet.
+    uint32_t old_bid = BucketId(hashcode, capacity_log_ - 1);
+    if (old_bid <= rehash_cursor_) {
+      auto res = FindInBucket(ptr, old_bid, fp, cookie);
+      if (get<2>(res) || old_bid + 1 < rehash_cursor_)
+        return res;
+    }
+  }
+
+  return FindInBucket(ptr, BucketId(hashcode), fp, cookie);
+}
+
+auto DenseSet::FindInBucket(const void* ptr, uint32_t bid, uint8_t fp, uint32_t cookie)
     -> tuple<size_t, DensePtr*, DensePtr*> {
   DCHECK_LT(bid, entries_.size());
 
   DensePtr* curr = &entries_[bid];
   ExpireIfNeeded(nullptr, curr);
 
-  if (Equal(*curr, ptr, cookie)) {
+  if (Equal(*curr, ptr, cookie, fp)) {
     return {bid, nullptr, curr};
   }
 
@@ -451,7 +546,7 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
     curr = &entries_[bid - 1];
     ExpireIfNeeded(nullptr, curr);
 
-    if (Equal(*curr, ptr, cookie)) {
+    if (Equal(*curr, ptr, cookie, fp)) {
       return {bid - 1, nullptr, curr};
     }
   }
@@ -460,7 +555,7 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
     curr = &entries_[bid + 1];
     ExpireIfNeeded(nullptr, curr);
 
-    if (Equal(*curr, ptr, cookie)) {
+    if (Equal(*curr, ptr, cookie, fp)) {
       return {bid + 1, nullptr, curr};
     }
   }
@@ -471,7 +566,7 @@ auto DenseSet::Find2(const void* ptr, uint32_t bid, uint32_t cookie)
   while (curr != nullptr) {
     ExpireIfNeeded(prev, curr);
 
-    if (Equal(*curr, ptr, cookie)) {
+    if (Equal(*curr, ptr, cookie, fp)) {
       return {bid, prev, curr};
     }
     prev = curr;
@@ -584,6 +679,10 @@ uint32_t DenseSet::Scan(uint32_t cursor, const ItemCb& cb) const {
     return 0;
   }
 
+  const_cast<DenseSet*>(this)->RehashStep(kRehashStepBuckets);
+  if (rehash_cursor_ > 0)
+    return ScanRehashing(cursor, cb);
+
   uint32_t entries_idx = cursor >> (32 - capacity_log_);
 
   auto& entries = const_cast<DenseSet*>(this)->entries_;
@@ -599,24 +698,8 @@ uint32_t DenseSet::Scan(uint32_t cursor, const ItemCb& cb) const {
     return 0;
   }
 
-  DensePtr* curr = &entries[entries_idx];
-
   // Check home bucket
-  if (!curr->IsEmpty() && !curr->IsDisplaced()) {
-    // scanning add all entries in a given chain
-    while (true) {
-      cb(curr->GetObject());
-      if (!curr->IsLink())
-        break;
-
-      DensePtr* mcurr = const_cast<DensePtr*>(curr);
-
-      if (ExpireIfNeeded(mcurr, &mcurr->AsLink()->next) && !mcurr->IsLink()) {
-        break;
-      }
-      curr = &curr->AsLink()->next;
-    }
-  }
+  ScanChain(entries_idx, cb);
 
   // Check if the bucket on the left belongs to the home bucket.
   if (entries_idx > 0) {
@@ -647,18 +730,142 @@ uint32_t DenseSet::Scan(uint32_t cursor, const ItemCb& cb) const {
   return entries_idx << (32 - capacity_log_);
 }
 
-auto DenseSet::NewLink(void* data, DensePtr next) -> DenseLinkKey* {
-  LinkAllocator la(mr());
-  DenseLinkKey* lk = la.allocate(1);
-  la.construct(lk);
+void DenseSet::ScanChain(uint32_t bid, const ItemCb& cb) const {
+  DensePtr* curr = &const_cast<DenseSet*>(this)->entries_[bid];
+  ExpireIfNeeded(nullptr, curr);
+  if (curr->IsEmpty() || curr->IsDisplaced())
+    return;
+
+  // scanning add all entries in a given chain
+  while (true) {
+    cb(curr->GetObject());
+    if (!curr->IsLink())
+      break;
+
+    if (ExpireIfNeeded(curr, &curr->AsLink()->next) && !curr->IsLink()) {
+      break;
+    }
+    curr = &curr->AsLink()->next;
+  }
+}
+
+/* Buckets below rehash_cursor_ still hold the objects of the old layout, including the ones
+ * displaced to their neighbours, and the objects of old bucket i move to the buckets 2i and 2i+1.
+ * The current layout has no displaced objects, but an old object displaced to bucket
+ * rehash_cursor_ - 1 can belong to bucket rehash_cursor_ that was already migrated.
+ * The cursor at the granularity of the old layout is also valid for the current one, so the scan
+ * continues seamlessly once the rehash finishes.
+ */
+uint32_t DenseSet::ScanRehashing(uint32_t cursor, const ItemCb& cb) const {
+  auto& entries = const_cast<DenseSet*>(this)->entries_;
+  const unsigned old_log = capacity_log_ - 1;
+  const uint32_t old_size = entries_.size() / 2;
+
+  bool found = false;
+  auto report = [&](const void* obj) {
+    found = true;
+    cb(obj);
+  };
+
+  for (uint32_t bid = cursor >> (32 - old_log); bid < old_size; ++bid) {
+    if (bid < rehash_cursor_) {
+      ScanChain(bid, report);
+      if (bid + 1 < entries_.size()) {
+        DensePtr* right_bucket = &entries[bid + 1];
+        ExpireIfNeeded(nullptr, right_bucket);
+        if (right_bucket->IsDisplaced() && right_bucket->GetDisplacedDirection() == 1)
+          report(right_bucket->GetObject());
+      }
+    }
+
+    if (bid > 0 && bid - 1 < rehash_cursor_) {
+      DensePtr* left_bucket = &entries[bid - 1];
+      ExpireIfNeeded(nullptr, left_bucket);
+      if (left_bucket->IsDisplaced() && left_bucket->GetDisplacedDirection() == -1)
+        report(left_bucket->GetObject());
+    }
+
+    for (uint32_t new_bid = bid * 2; new_bid < bid * 2 + 2; ++new_bid) {
+      if (new_bid >= rehash_cursor_)
+        ScanChain(new_bid, report);
+    }
+
+    if (found)
+      return bid + 1 < old_size ? (bid + 1) << (32 - old_log) : 0;
+  }
+  return 0;
+}
+
+uint32_t DenseSet::DefragBuckets(uint32_t cursor, uint32_t num_buckets, float ratio,
+                                 const std::function<void*(void*, bool)>& realloc_obj,
+                                 bool* moved) {
+  uint32_t end = min<size_t>(entries_.size(), size_t(cursor) + num_buckets);
+  for (uint32_t bid = cursor; bid < end; ++bid) {
+    for (DensePtr* curr = &entries_[bid]; !curr->IsEmpty();) {
+      DensePtr* obj_ptr = curr;
+      if (curr->IsLink()) {
+        DenseLinkKey* link = curr->AsLink();
+        if (LinkSlab::IsUnderutilized(link, ratio)) {
+          void* mem = LinkSlab::ForResource(mr())->Allocate();
+          DenseLinkKey* new_link = new (mem) DenseLinkKey(*link);
+          LinkSlab::Free(link);
+          curr->SetObject(new_link);  // Keeps the tags of the pointer.
+          link = new_link;
+          *moved = true;
+        }
+        obj_ptr = link;
+      }
+
+      void* obj = obj_ptr->GetObject();
+      size_t obj_size = ObjectAllocSize(obj);
+      if (void* new_obj = realloc_obj(obj, curr->HasTtl()); new_obj != obj) {
+        obj_ptr->SetObject(new_obj);
+        obj_malloc_used_ += ObjectAllocSize(new_obj) - obj_size;
+      }
+
+      if (!curr->IsLink())
+        break;
+      curr = &curr->AsLink()->next;
+    }
+  }
+
+  return end < entries_.size() ? end : 0;
+}
+
+auto DenseSet::NewLink(void* data, uint8_t fp, DensePtr next) -> DenseLinkKey* {
+  static_assert(sizeof(DenseLinkKey) == LinkSlab::kBlockSize);
+  DenseLinkKey* lk = new (LinkSlab::ForResource(mr())->Allocate()) DenseLinkKey;
 
   lk->next = next;
   lk->SetObject(data);
+  lk->SetFingerprint(fp);
   ++num_links_;
 
   return lk;
 }
 
+uint32_t DenseSet::ExpireStep(uint32_t start, uint32_t count, uint32_t* min_expire) {
+  size_t end = min<size_t>(entries_.size(), size_t(start) + count);
+  for (size_t bid = start; bid < end; ++bid) {
+    DensePtr* curr = &entries_[bid];
+    ExpireIfNeeded(nullptr, curr);
+
+    // Walks the chain like IteratorBase::Advance does.
+    while (!curr->IsEmpty()) {
+      if (curr->HasTtl())
+        *min_expire = min(*min_expire, ObjExpireTime(curr->GetObject()));
+      if (!curr->IsLink())
+        break;
+
+      DenseLinkKey* plink = curr->AsLink();
+      if (!ExpireIfNeeded(curr, &plink->next) || curr->IsLink())
+        curr = &plink->next;
+    }
+  }
+
+  return end < entries_.size() ? end : 0;
+}
+
 bool DenseSet::ExpireIfNeededInternal(DensePtr* prev, DensePtr* node) const {
   DCHECK(node != nullptr);
   DCHECK(node->HasTtl());
@@ -678,6 +885,12 @@ bool DenseSet::ExpireIfNeededInternal(DensePtr* prev, DensePtr* node) const {
   return deleted;
 }
 
+auto DenseSet::GetStats() -> Stats {
+  Stats res;
+  res.pending_rehash_buckets = tl_pending_rehash_buckets;
+  return res;
+}
+
 void DenseSet::CollectExpired() {
   // Simply iterating over all items will remove expired
   auto it = IteratorBase(this, false);
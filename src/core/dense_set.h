@@ -11,6 +11,7 @@
 #include <vector>
 
 #include "base/pmr/memory_resource.h"
+#include "core/link_slab.h"
 
 namespace dfly {
 
@@ -47,6 +48,8 @@ class DenseSet {
   static constexpr size_t kDisplaceBit = 1ULL << 53;
   static constexpr size_t kDisplaceDirectionBit = 1ULL << 54;
   static constexpr size_t kTtlBit = 1ULL << 55;
+  static constexpr unsigned kFingerprintShift = 56;
+  static constexpr size_t kFingerprintMask = 255ULL << kFingerprintShift;
   static constexpr size_t kTagMask = 4095ULL << 52;  // we reserve 12 high bits.
 
   class DensePtr {
@@ -120,6 +123,18 @@ class DenseSet {
       ptr_ = nullptr;
     }
 
+    // 8 bits of the object hash, used to reject most mismatches during lookups without
+    // dereferencing the object. They are kept next to the object pointer itself,
+    // so for links they are read from the link.
+    uint8_t Fingerprint() const {
+      return (IsObject() ? uptr() : AsLink()->uptr()) >> kFingerprintShift;
+    }
+
+    // Can be called only for objects.
+    void SetFingerprint(uint8_t fp) {
+      ptr_ = (void*)((uptr() & ~kFingerprintMask) | (uint64_t(fp) << kFingerprintShift));
+    }
+
     void* GetObject() const {
       if (IsObject()) {
         return Raw();
@@ -169,7 +184,6 @@ class DenseSet {
   static_assert(sizeof(DenseLinkKey) == 2 * sizeof(uintptr_t));
 
  protected:
-  using LinkAllocator = PMR_NS::polymorphic_allocator<DenseLinkKey>;
   using DensePtrAllocator = PMR_NS::polymorphic_allocator<DensePtr>;
   using ChainVectorIterator = std::vector<DensePtr, DensePtrAllocator>::iterator;
   using ChainVectorConstIterator = std::vector<DensePtr, DensePtrAllocator>::const_iterator;
@@ -242,6 +256,16 @@ class DenseSet {
   using ItemCb = std::function<void(const void*)>;
 
   uint32_t Scan(uint32_t cursor, const ItemCb& cb) const;
+
+  // Frees the objects of count buckets starting at start and returns the bucket to continue
+  // from, or 0 once the set is empty. Allows freeing huge sets incrementally, the set must not
+  // be used otherwise until it returns 0.
+  uint32_t ClearStep(uint32_t start, uint32_t count);
+
+  // Deletes the expired objects of count buckets starting at start and returns the bucket to
+  // continue from, or 0 after the last bucket. Lowers *min_expire to the earliest expiry time of
+  // the remaining objects with ttl in these buckets.
+  uint32_t ExpireStep(uint32_t start, uint32_t count, uint32_t* min_expire);
   void Reserve(size_t sz);
 
   // set an abstract time that allows expiry.
@@ -257,6 +281,20 @@ class DenseSet {
     return expiration_used_;
   }
 
+  // Buckets visited by a single defragmentation step of the derived sets.
+  static constexpr uint32_t kDefragStepBuckets = 256;
+
+  // Number of buckets that still need to be migrated after the last growth.
+  size_t PendingRehashBuckets() const {
+    return rehash_cursor_;
+  }
+
+  struct Stats {
+    size_t pending_rehash_buckets = 0;  // of all the sets of this thread
+  };
+
+  static Stats GetStats();
+
  protected:
   // Virtual functions to be implemented for generic data
   virtual uint64_t Hash(const void* obj, uint32_t cookie) const = 0;
@@ -268,7 +306,7 @@ class DenseSet {
   void CollectExpired();
 
   bool EraseInternal(void* obj, uint32_t cookie) {
-    auto [prev, found] = Find(obj, BucketId(obj, cookie), cookie);
+    auto [prev, found] = Find(obj, Hash(obj, cookie), cookie);
     if (found) {
       Delete(prev, found);
       return true;
@@ -282,7 +320,7 @@ class DenseSet {
     if (Empty())
       return IteratorBase{};
 
-    auto [bid, _, curr] = Find2(ptr, BucketId(ptr, cookie), cookie);
+    auto [bid, _, curr] = Find2(ptr, Hash(ptr, cookie), cookie);
     if (curr) {
       return IteratorBase(this, entries_.begin() + bid, curr);
     }
@@ -318,35 +356,73 @@ class DenseSet {
   // Assumes that the object does not exist in the set.
   void AddUnique(void* obj, bool has_ttl, uint64_t hashcode);
 
+  // Moves the links in buckets [cursor, cursor + num_buckets) that are on pages utilized below
+  // ratio, and calls realloc_obj for each of their objects. realloc_obj returns the address of
+  // the object, which changes if the object was moved. Returns the bucket to continue from
+  // or 0 once all the buckets were visited, and sets *moved if any link was moved.
+  uint32_t DefragBuckets(uint32_t cursor, uint32_t num_buckets, float ratio,
+                         const std::function<void*(void* obj, bool has_ttl)>& realloc_obj,
+                         bool* moved);
+
  private:
   DenseSet(const DenseSet&) = delete;
   DenseSet& operator=(DenseSet&) = delete;
 
-  bool Equal(DensePtr dptr, const void* ptr, uint32_t cookie) const;
+  bool Equal(DensePtr dptr, const void* ptr, uint32_t cookie, uint8_t fp) const;
+
+  static uint8_t HashFingerprint(uint64_t hash) {
+    return hash & 0xFF;  // BucketId uses the high bits
+  }
 
   MemoryResource* mr() {
     return entries_.get_allocator().resource();
   }
 
   uint32_t BucketId(uint64_t hash) const {
-    assert(capacity_log_ > 0);
-    return hash >> (64 - capacity_log_);
+    return BucketId(hash, capacity_log_);
+  }
+
+  static uint32_t BucketId(uint64_t hash, unsigned capacity_log) {
+    assert(capacity_log > 0);
+    return hash >> (64 - capacity_log);
   }
 
   uint32_t BucketId(const void* ptr, uint32_t cookie) const {
     return BucketId(Hash(ptr, cookie));
   }
 
-  // return a ChainVectorIterator (a.k.a iterator) or end if there is an empty chain found
-  ChainVectorIterator FindEmptyAround(uint32_t bid);
+  // return a ChainVectorIterator (a.k.a iterator) or end if there is an empty chain found.
+  // Neighbour buckets are checked only if displace is true.
+  ChainVectorIterator FindEmptyAround(uint32_t bid, bool displace);
 
   // Return if bucket has no item which is not displaced and right/left bucket has no displaced item
   // belong to given bid
   bool NoItemBelongsBucket(uint32_t bid) const;
+
+  // Rehashes all the buckets below prev_size after the table was resized.
   void Grow(size_t prev_size);
 
+  // Moves the objects of bucket bid to their buckets in the current table.
+  // Objects only move to higher buckets, except for buckets 0 and 1.
+  void RehashBucket(uint32_t bid);
+
+  // Migrates up to num_buckets buckets below rehash_cursor_ to the current table.
+  void RehashStep(uint32_t num_buckets);
+
+  // Reports the objects that are not displaced in the chain of bucket bid.
+  void ScanChain(uint32_t bid, const ItemCb& cb) const;
+
+  // Scan over the layout before the growth while the table is rehashed, every bucket of it
+  // covers the two buckets of the current layout that its objects move to.
+  uint32_t ScanRehashing(uint32_t cursor, const ItemCb& cb) const;
+
+  // Returns the bucket to insert an object with the given hash to. During rehashing it first
+  // advances the migration and makes sure the object has a single home, which is either
+  // in the old layout (then old_layout is set) or in the current one.
+  uint32_t PrepareInsert(uint64_t hashcode, bool* old_layout);
+
   // ============ Pseudo Linked List Functions for interacting with Chains ==================
-  size_t PushFront(ChainVectorIterator, void* obj, bool has_ttl);
+  size_t PushFront(ChainVectorIterator, void* obj, bool has_ttl, uint8_t fp);
   void PushFront(ChainVectorIterator, DensePtr);
 
   void* PopDataFront(ChainVectorIterator);
@@ -359,19 +435,24 @@ class DenseSet {
   // ============ Pseudo Linked List in DenseSet end ==================
 
   // returns (prev, item) pair. If item is root, then prev is null.
-  std::pair<DensePtr*, DensePtr*> Find(const void* ptr, uint32_t bid, uint32_t cookie) {
-    auto [_, p, c] = Find2(ptr, bid, cookie);
+  std::pair<DensePtr*, DensePtr*> Find(const void* ptr, uint64_t hashcode, uint32_t cookie) {
+    auto [_, p, c] = Find2(ptr, hashcode, cookie);
     return {p, c};
   }
 
   // returns bid and (prev, item) pair. If item is root, then prev is null.
-  std::tuple<size_t, DensePtr*, DensePtr*> Find2(const void* ptr, uint32_t bid, uint32_t cookie);
+  std::tuple<size_t, DensePtr*, DensePtr*> Find2(const void* ptr, uint64_t hashcode,
+                                                 uint32_t cookie);
+
+  // Looks for the object in bucket bid, its chain and the neighbour buckets.
+  std::tuple<size_t, DensePtr*, DensePtr*> FindInBucket(const void* ptr, uint32_t bid,
+                                                        uint8_t fp, uint32_t cookie);
 
-  DenseLinkKey* NewLink(void* data, DensePtr next);
+  DenseLinkKey* NewLink(void* data, uint8_t fp, DensePtr next);
 
   inline void FreeLink(DenseLinkKey* plink) {
     // deallocate the link if it is no longer a link as it is now in an empty list
-    mr()->deallocate(plink, sizeof(DenseLinkKey), alignof(DenseLinkKey));
+    LinkSlab::Free(plink);
     --num_links_;
   }
 
@@ -397,6 +478,12 @@ class DenseSet {
   mutable uint32_t num_used_buckets_ = 0;  // number of buckets used in entries_ array.
   unsigned capacity_log_ = 0;
 
+  // Large tables are grown incrementally: after entries_ doubles, buckets below rehash_cursor_
+  // still follow the layout of the previous, twice smaller, table and are migrated from the top
+  // down by the following insertions. Buckets at or above the cursor follow the current layout
+  // and contain no displaced objects until the migration is finished.
+  uint32_t rehash_cursor_ = 0;
+
   uint32_t time_now_ = 0;
 
   mutable bool expiration_used_ = false;
@@ -406,8 +493,7 @@ inline void* DenseSet::FindInternal(const void* obj, uint64_t hashcode, uint32_t
   if (entries_.empty())
     return nullptr;
 
-  uint32_t bid = BucketId(hashcode);
-  DensePtr* ptr = const_cast<DenseSet*>(this)->Find(obj, bid, cookie).second;
+  DensePtr* ptr = const_cast<DenseSet*>(this)->Find(obj, hashcode, cookie).second;
   return ptr ? ptr->GetObject() : nullptr;
 }
 
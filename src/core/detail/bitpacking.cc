@@ -98,6 +98,95 @@ static inline pair<const char*, uint8_t*> simd_variant2_pack(const char* ascii,
   return make_pair(ascii, bin);
 }
 
+// Packs 16 ascii chars into the lower 14 bytes of the result, the upper 2 bytes are zero.
+static inline __m128i simd_pack16(__m128i val) {
+  const __m128i control = _mm_set_epi8(-1, -1, 14, 13, 12, 11, 10, 9, 8, 6, 5, 4, 3, 2, 1, 0);
+  __m128i rpart, lpart;
+
+#if defined(__aarch64__)
+  rpart = _mm_and_si128(val, _mm_set1_epi64x(0x007F007F007F007F));
+  lpart = _mm_and_si128(val, _mm_set1_epi64x(0x7F007F007F007F00));
+  val = _mm_or_si128(_mm_srli_epi64(lpart, 1), rpart);
+
+  rpart = _mm_and_si128(val, _mm_set1_epi64x(0x00003FFF00003FFF));
+  lpart = _mm_and_si128(val, _mm_set1_epi64x(0x3FFF00003FFF0000));
+  val = _mm_or_si128(_mm_srli_epi64(lpart, 2), rpart);
+#else
+  val = _mm_maddubs_epi16(_mm_set1_epi16(0x8001), val);
+  val = _mm_madd_epi16(_mm_set1_epi32(0x40000001), val);
+#endif
+
+  rpart = _mm_and_si128(val, _mm_set1_epi64x(0x000000000FFFFFFF));
+  lpart = _mm_and_si128(val, _mm_set1_epi64x(0x0FFFFFFF00000000));
+  val = _mm_or_si128(_mm_srli_epi64(lpart, 4), rpart);
+
+  return _mm_shuffle_epi8(val, control);
+}
+
+#endif
+
+#ifdef __AVX2__
+// Same as simd_variant2_pack with 32 chars per iteration. Every 128 bit lane packs 16 chars
+// into 14 bytes, written with two overlapping stores, so ascii must have 16 more chars after
+// end to absorb the 2 extra bytes.
+static inline pair<const char*, uint8_t*> avx2_pack(const char* ascii, const char* end,
+                                                    uint8_t* bin) {
+  const __m256i control =
+      _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, -1, -1,  //
+                       0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, -1, -1);
+  __m256i val, rpart, lpart;
+
+  while (ascii + 32 <= end) {
+    val = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ascii));
+    val = _mm256_maddubs_epi16(_mm256_set1_epi16(0x8001), val);
+    val = _mm256_madd_epi16(_mm256_set1_epi32(0x40000001), val);
+
+    rpart = _mm256_and_si256(val, _mm256_set1_epi64x(0x000000000FFFFFFF));
+    lpart = _mm256_and_si256(val, _mm256_set1_epi64x(0x0FFFFFFF00000000));
+    val = _mm256_or_si256(_mm256_srli_epi64(lpart, 4), rpart);
+
+    val = _mm256_shuffle_epi8(val, control);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bin), _mm256_castsi256_si128(val));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(bin + 14), _mm256_extracti128_si256(val, 1));
+    bin += 28;
+    ascii += 32;
+  }
+  return make_pair(ascii, bin);
+}
+
+// Unpacks 28 bytes into 32 chars per iteration, reads 2 bytes past the last 28 byte block.
+static inline pair<const uint8_t*, char*> avx2_unpack(const uint8_t* bin, char* ascii,
+                                                      const char* end) {
+  // shifts the second 7-byte blob of every lane to the left.
+  const __m256i control =
+      _mm256_setr_epi8(0, 1, 2, 3, 4, 5, 6, -1, 7, 8, 9, 10, 11, 12, 13, 14,  //
+                       0, 1, 2, 3, 4, 5, 6, -1, 7, 8, 9, 10, 11, 12, 13, 14);
+  __m256i val, rpart, lpart;
+
+  while (ascii + 32 <= end) {
+    __m128i lo = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bin));
+    __m128i hi = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bin + 14));
+    val = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+    val = _mm256_shuffle_epi8(val, control);
+
+    rpart = _mm256_and_si256(val, _mm256_set1_epi64x(0x000000000FFFFFFF));
+    lpart = _mm256_and_si256(val, _mm256_set1_epi64x(0x00FFFFFFF0000000));
+    val = _mm256_or_si256(_mm256_slli_epi64(lpart, 4), rpart);
+
+    rpart = _mm256_and_si256(val, _mm256_set1_epi64x(0x00003FFF00003FFF));
+    lpart = _mm256_and_si256(val, _mm256_set1_epi64x(0xFFFFC000FFFFC000));
+    val = _mm256_or_si256(_mm256_slli_epi64(lpart, 2), rpart);
+
+    rpart = _mm256_and_si256(val, _mm256_set1_epi64x(0x007F007F007F007F));
+    lpart = _mm256_and_si256(val, _mm256_set1_epi64x(0x7F807F807F807F80));
+    val = _mm256_or_si256(_mm256_slli_epi64(lpart, 1), rpart);
+
+    _mm256_storeu_si256(reinterpret_cast<__m256i*>(ascii), val);
+    ascii += 32;
+    bin += 28;
+  }
+  return make_pair(bin, ascii);
+}
 #endif
 
 // Daniel Lemire's function validate_ascii_fast() - under Apache/MIT license.
@@ -142,9 +231,20 @@ bool validate_ascii_fast(const char* src, size_t len) {
 #else
 bool validate_ascii_fast(const char* src, size_t len) {
   size_t i = 0;
+#ifdef __AVX2__
+  if (len >= 32) {
+    __m256i has_error = _mm256_setzero_si256();
+    for (; i <= len - 32; i += 32) {
+      has_error =
+          _mm256_or_si256(has_error, _mm256_loadu_si256((const __m256i*)(src + i)));
+    }
+    if (_mm256_movemask_epi8(has_error))
+      return false;
+  }
+#endif
   __m128i has_error = _mm_setzero_si128();
-  if (len >= 16) {
-    for (; i <= len - 16; i += 16) {
+  if (len - i >= 16) {
+    for (; i + 16 <= len; i += 16) {
       __m128i current_bytes = mm_loadu_si128((const __m128i*)(src + i));
       has_error = _mm_or_si128(has_error, current_bytes);
     }
@@ -225,6 +325,14 @@ void ascii_pack_simd2(const char* ascii, size_t len, uint8_t* bin) {
   // I leave out 16 bytes in addition to 16 that we load in the loop
   // because we store into bin full 16 bytes instead of 14. To prevent data
   // overwrite we finish loop one iteration earlier.
+#ifdef __AVX2__
+  if (len >= 48) {
+    const char* start = ascii;
+    tie(ascii, bin) = avx2_pack(ascii, ascii + len - 16, bin);
+    len -= ascii - start;
+  }
+#endif
+
   const char* end = ascii + len - 32;
 
   // on arm var
@@ -270,6 +378,15 @@ void ascii_unpack(const uint8_t* bin, size_t ascii_len, char* ascii) {
 }
 
 void ascii_unpack_simd(const uint8_t* bin, size_t ascii_len, char* ascii) {
+#ifdef __AVX2__
+  if (ascii_len >= 48) {
+    // Stops 16 chars early, so the overlapping loads stay within the packed blob.
+    char* start = ascii;
+    tie(bin, ascii) = avx2_unpack(bin, ascii, ascii + ascii_len - 16);
+    ascii_len -= ascii - start;
+  }
+#endif
+
 #ifdef __SSSE3__
 
   __m128i val, rpart, lpart;
@@ -315,6 +432,21 @@ bool compare_packed(const uint8_t* packed, const char* ascii, size_t ascii_len)
   bool res = true;
   const char* end = ascii + ascii_len;
 
+#ifdef __SSE3__
+  // Packs 16 chars at a time and compares them with the next 14 bytes. Leaves out 16 chars, so
+  // that the 16 byte loads of packed stay within its length.
+  while (ascii + 32 <= end) {
+    __m128i val = simd_pack16(mm_loadu_si128(reinterpret_cast<const __m128i*>(ascii)));
+    __m128i bin = mm_loadu_si128(reinterpret_cast<const __m128i*>(packed));
+    unsigned eq = _mm_movemask_epi8(_mm_cmpeq_epi8(val, bin));
+    if ((eq & 0x3FFF) != 0x3FFF)
+      return false;
+
+    ascii += 16;
+    packed += 14;
+  }
+#endif
+
   while (ascii + 8 <= end) {
     for (i = 0; i < 7; ++i) {
       uint8_t conv = (ascii[0] >> i) | (ascii[1] << (7 - i));
@@ -338,6 +470,70 @@ bool compare_packed(const uint8_t* packed, const char* ascii, size_t ascii_len)
   return true;
 }
 
+void bit_pack(const uint32_t* src, size_t len, unsigned width, uint8_t* bin) {
+  DCHECK_LE(width, 32u);
+  uint64_t acc = 0;
+  unsigned bits = 0;
+
+  for (size_t i = 0; i < len; ++i) {
+    acc |= uint64_t(src[i]) << bits;
+    bits += width;
+    while (bits >= 8) {
+      *bin++ = acc;
+      acc >>= 8;
+      bits -= 8;
+    }
+  }
+
+  if (bits)
+    *bin = acc;
+}
+
+void bit_unpack(const uint8_t* bin, size_t len, unsigned width, uint32_t* dest) {
+  DCHECK_LE(width, 32u);
+  const uint64_t mask = (1ULL << width) - 1;
+  uint64_t acc = 0;
+  unsigned bits = 0;
+
+  for (size_t i = 0; i < len; ++i) {
+    while (bits < width) {
+      acc |= uint64_t(*bin++) << bits;
+      bits += 8;
+    }
+    dest[i] = acc & mask;
+    acc >>= width;
+    bits -= width;
+  }
+}
+
+size_t lower_bound_u32(const uint32_t* sorted, size_t len, uint32_t val) {
+  size_t res = 0, i = 0;
+
+#if defined(__SSE2__) || defined(__aarch64__)
+  // SSE2 has only signed comparisons, flipping the sign bit preserves the unsigned order.
+  const __m128i flip = _mm_set1_epi32(INT32_MIN);
+  const __m128i target = _mm_xor_si128(_mm_set1_epi32(val), flip);
+  __m128i acc = _mm_setzero_si128();
+
+  for (; i + 4 <= len; i += 4) {
+    __m128i vals = mm_loadu_si128(reinterpret_cast<const __m128i*>(sorted + i));
+    vals = _mm_xor_si128(vals, flip);
+
+    // Matching lanes are -1.
+    acc = _mm_sub_epi32(acc, _mm_cmplt_epi32(vals, target));
+  }
+
+  uint32_t lanes[4];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), acc);
+  res = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#endif
+
+  for (; i < len; ++i)
+    res += sorted[i] < val;
+
+  return res;
+}
+
 #if defined(__GNUC__) && !defined(__clang__)
 #pragma GCC pop_options
 #endif
@@ -38,5 +38,19 @@ inline constexpr size_t binpacked_len(size_t ascii_len) {
   return (ascii_len * 7 + 7) / 8; /* rounded up */
 }
 
+// packs len integers of width bits each (width <= 32) into bitpacked_len(len, width) bytes.
+void bit_pack(const uint32_t* src, size_t len, unsigned width, uint8_t* bin);
+
+// unpacks len integers of width bits each that were packed with bit_pack.
+void bit_unpack(const uint8_t* bin, size_t len, unsigned width, uint32_t* dest);
+
+inline constexpr size_t bitpacked_len(size_t len, unsigned width) {
+  return (len * width + 7) / 8; /* rounded up */
+}
+
+// returns the number of elements of the sorted array that are smaller than val,
+// i.e. the position of std::lower_bound. Branchless, uses SIMD where available.
+size_t lower_bound_u32(const uint32_t* sorted, size_t len, uint32_t val);
+
 }  // namespace detail
 }  // namespace dfly
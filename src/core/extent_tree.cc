@@ -16,6 +16,7 @@ void ExtentTree::Add(size_t start, size_t len) {
   DCHECK_EQ(len_extents_.size(), extents_.size());
 
   size_t end = start + len;
+  total_len_ += len;
 
   if (extents_.empty()) {
     extents_.emplace(start, end);
@@ -36,7 +37,7 @@ void ExtentTree::Add(size_t start, size_t len) {
       merged = true;
       len_extents_.erase(pair{prev->second - prev->first, prev->first});
 
-      if (end == it->first) {  // [first, end = it->first, it->second)
+      if (it != extents_.end() && end == it->first) {  // [first, end = it->first, it->second)
         prev->second = it->second;
         len_extents_.erase(pair{it->second - it->first, it->first});
         extents_.erase(it);
@@ -48,7 +49,7 @@ void ExtentTree::Add(size_t start, size_t len) {
   }
 
   if (!merged) {
-    if (end == it->first) {  // [start, end), [it->first, it->second]
+    if (it != extents_.end() && end == it->first) {  // [start, end), [it->first, it->second]
       len_extents_.erase(pair{it->second - it->first, it->first});
       end = it->second;
       extents_.erase(it);
@@ -114,6 +115,7 @@ optional<pair<size_t, size_t>> ExtentTree::GetRange(size_t len, size_t align) {
   }
 
   DCHECK_EQ(range_end - aligned_start, len);
+  total_len_ -= len;
 
   return pair{aligned_start, range_end};
 }
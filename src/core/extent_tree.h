@@ -22,9 +22,20 @@ class ExtentTree {
   // start is aligned by align.
   std::optional<std::pair<size_t, size_t>> GetRange(size_t len, size_t align);
 
+  // Total length of the extents.
+  size_t total_len() const {
+    return total_len_;
+  }
+
+  // Length of the longest extent, 0 if the tree is empty.
+  size_t max_len() const {
+    return len_extents_.empty() ? 0 : len_extents_.rbegin()->first;
+  }
+
  private:
   absl::btree_map<size_t, size_t> extents_;                 // start -> end.
   absl::btree_set<std::pair<size_t, size_t>> len_extents_;  // (length, start)
+  size_t total_len_ = 0;
 };
 
 }  // namespace dfly
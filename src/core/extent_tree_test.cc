@@ -55,4 +55,21 @@ TEST_F(ExtentTreeTest, Basic) {
   EXPECT_THAT(*op, testing::Pair(60, 92));
 }
 
+TEST_F(ExtentTreeTest, Lengths) {
+  EXPECT_EQ(0u, tree_.max_len());
+
+  tree_.Add(0, 64);
+  tree_.Add(128, 256);
+  EXPECT_EQ(320u, tree_.total_len());
+  EXPECT_EQ(256u, tree_.max_len());
+
+  auto op = tree_.GetRange(32, 32);  // best fit, from the shorter extent.
+  EXPECT_THAT(*op, testing::Pair(0, 32));
+  EXPECT_EQ(288u, tree_.total_len());
+
+  tree_.Add(64, 64);  // coalesces with both neighbours.
+  EXPECT_EQ(352u, tree_.total_len());
+  EXPECT_EQ(352u, tree_.max_len());
+}
+
 }  // namespace dfly
@@ -0,0 +1,156 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/huge_page_resource.h"
+
+#include <sys/mman.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr size_t kBlockAlign = 64;
+
+uintptr_t ChunkOf(const void* ptr) {
+  return uintptr_t(ptr) & ~(HugePageResource::kChunkSize - 1);
+}
+
+}  // namespace
+
+HugePageResource::HugePageResource(PMR_NS::memory_resource* upstream, Mode mode)
+    : upstream_(upstream), mode_(mode) {
+}
+
+HugePageResource::~HugePageResource() {
+  for (auto [chunk, blocks] : chunks_)
+    munmap(reinterpret_cast<void*>(chunk), kChunkSize);
+}
+
+void HugePageResource::AddBlockSize(size_t size) {
+  DCHECK_LE(size, kChunkSize);
+  if (!FindPool(size))
+    pools_.push_back(Pool{.block_size = size});
+}
+
+auto HugePageResource::FindPool(size_t size) -> Pool* {
+  for (auto& pool : pools_) {
+    if (pool.block_size == size)
+      return &pool;
+  }
+  return nullptr;
+}
+
+uint8_t* HugePageResource::MapChunk() {
+  void* ptr = MAP_FAILED;
+  if (mode_ == Mode::EXPLICIT) {
+    // Huge page mappings are aligned to the huge page size.
+    ptr = mmap(nullptr, kChunkSize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (ptr == MAP_FAILED) {
+      LOG_FIRST_N(WARNING, 1) << "Could not map huge pages, falling back to transparent huge "
+                                 "pages: "
+                              << strerror(errno);
+      mode_ = Mode::TRANSPARENT;
+    }
+  }
+
+  if (ptr == MAP_FAILED) {
+    // Over-allocate to align the chunk, the kernel backs only aligned ranges with huge pages.
+    void* raw = mmap(nullptr, kChunkSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                     -1, 0);
+    if (raw == MAP_FAILED) {
+      LOG_FIRST_N(WARNING, 1) << "Could not map arena chunk: " << strerror(errno);
+      return nullptr;
+    }
+
+    uintptr_t start = uintptr_t(raw);
+    uintptr_t aligned = (start + kChunkSize - 1) & ~(kChunkSize - 1);
+    if (aligned > start)
+      munmap(raw, aligned - start);
+    if (uintptr_t tail = start + kChunkSize * 2 - (aligned + kChunkSize); tail > 0)
+      munmap(reinterpret_cast<void*>(aligned + kChunkSize), tail);
+
+    ptr = reinterpret_cast<void*>(aligned);
+    if (madvise(ptr, kChunkSize, MADV_HUGEPAGE) != 0)
+      LOG_FIRST_N(WARNING, 1) << "madvise(MADV_HUGEPAGE) failed: " << strerror(errno);
+  }
+
+  chunks_.emplace(uintptr_t(ptr), 0);
+  return reinterpret_cast<uint8_t*>(ptr);
+}
+
+void* HugePageResource::do_allocate(size_t size, size_t align) {
+  Pool* pool = FindPool(size);
+  if (!pool || align > kBlockAlign)
+    return upstream_->allocate(size, align);
+
+  void* res = nullptr;
+  size_t stride = (size + kBlockAlign - 1) & ~(kBlockAlign - 1);
+  if (!pool->free_blocks.empty()) {
+    res = pool->free_blocks.back();
+    pool->free_blocks.pop_back();
+  } else {
+    if (size_t(pool->end - pool->next) < size) {
+      uint8_t* chunk = MapChunk();
+      if (!chunk)
+        return upstream_->allocate(size, align);
+      pool->next = chunk;
+      pool->end = chunk + kChunkSize;
+      pool->chunk = uintptr_t(chunk);
+    }
+    res = pool->next;
+    pool->next += min<size_t>(stride, pool->end - pool->next);
+  }
+
+  chunks_[ChunkOf(res)]++;
+  used_ += size;
+  return res;
+}
+
+void HugePageResource::do_deallocate(void* ptr, size_t size, size_t align) {
+  Pool* pool = FindPool(size);
+  auto it = pool ? chunks_.find(ChunkOf(ptr)) : chunks_.end();
+  if (it == chunks_.end())
+    return upstream_->deallocate(ptr, size, align);
+
+  DCHECK_GE(used_, size);
+  DCHECK_GT(it->second, 0u);
+  used_ -= size;
+  it->second--;
+  pool->free_blocks.push_back(ptr);
+}
+
+size_t HugePageResource::Trim() {
+  size_t released = 0;
+  for (auto& pool : pools_) {
+    auto is_empty = [this](void* block) { return chunks_.at(ChunkOf(block)) == 0; };
+    auto& blocks = pool.free_blocks;
+    blocks.erase(remove_if(blocks.begin(), blocks.end(), is_empty), blocks.end());
+
+    if (pool.chunk && chunks_.at(pool.chunk) == 0) {
+      pool.next = pool.end = nullptr;
+      pool.chunk = 0;
+    }
+  }
+
+  for (auto it = chunks_.begin(); it != chunks_.end();) {
+    if (it->second == 0) {
+      munmap(reinterpret_cast<void*>(it->first), kChunkSize);
+      released += kChunkSize;
+      chunks_.erase(it++);
+    } else {
+      ++it;
+    }
+  }
+  return released;
+}
+
+}  // namespace dfly
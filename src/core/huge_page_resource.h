@@ -0,0 +1,82 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Memory resource that serves allocations of a few registered block sizes, like the segments of
+// dash tables, from 2MB chunks mapped with huge pages, and forwards everything else upstream.
+// Blocks of the same size are packed densely into the chunks, so they don't fragment the
+// general heap and a lookup touches few TLB entries. Freed blocks are kept on a free list per
+// size and are reused, chunks without live blocks are returned to the OS by Trim().
+// If huge pages can not be mapped, allocations fall back to the upstream resource.
+// Not thread safe, meant to be used by a single shard thread.
+class HugePageResource : public PMR_NS::memory_resource {
+ public:
+  static constexpr size_t kChunkSize = 2ULL << 20;
+
+  enum class Mode {
+    TRANSPARENT,  // madvise(MADV_HUGEPAGE), depends on transparent huge pages being enabled.
+    EXPLICIT,     // MAP_HUGETLB, requires reserved huge pages, falls back to TRANSPARENT.
+  };
+
+  HugePageResource(PMR_NS::memory_resource* upstream, Mode mode);
+  ~HugePageResource();
+
+  // Serves allocations of exactly this size from the arena from now on.
+  // Must be called before such allocations are made.
+  void AddBlockSize(size_t size);
+
+  // Bytes of the live blocks.
+  size_t used() const {
+    return used_;
+  }
+
+  // Bytes of the mapped chunks.
+  size_t reserved() const {
+    return chunks_.size() * kChunkSize;
+  }
+
+  // Unmaps the chunks whose blocks are all free. Returns the number of released bytes.
+  // Takes time linear in the number of free blocks.
+  size_t Trim();
+
+ private:
+  struct Pool {
+    size_t block_size;
+    std::vector<void*> free_blocks;
+    uint8_t* next = nullptr;  // unused space of the last chunk.
+    uint8_t* end = nullptr;
+    uintptr_t chunk = 0;  // the last chunk
+  };
+
+  void* do_allocate(std::size_t size, std::size_t align) final;
+
+  void do_deallocate(void* ptr, std::size_t size, std::size_t align) final;
+
+  bool do_is_equal(const PMR_NS::memory_resource& o) const noexcept final {
+    return this == &o;
+  }
+
+  Pool* FindPool(size_t size);
+
+  // Returns nullptr if no memory could be mapped.
+  uint8_t* MapChunk();
+
+  PMR_NS::memory_resource* upstream_;
+  Mode mode_;
+  std::vector<Pool> pools_;
+  // Addresses of the chunks, aligned to kChunkSize, and the number of their allocated blocks.
+  absl::flat_hash_map<uintptr_t, uint32_t> chunks_;
+  size_t used_ = 0;
+};
+
+}  // namespace dfly
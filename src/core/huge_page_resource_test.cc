@@ -0,0 +1,98 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/huge_page_resource.h"
+
+#include <vector>
+
+#include "base/gtest.h"
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+class HugePageResourceTest : public ::testing::Test {
+ protected:
+  HugePageResourceTest()
+      : res_(PMR_NS::get_default_resource(), HugePageResource::Mode::TRANSPARENT) {
+  }
+
+  HugePageResource res_;
+};
+
+TEST_F(HugePageResourceTest, Basic) {
+  constexpr size_t kBlock = 1000;
+  res_.AddBlockSize(kBlock);
+
+  // Other sizes go upstream.
+  void* other = res_.allocate(kBlock + 1, 8);
+  EXPECT_EQ(0u, res_.used());
+  EXPECT_EQ(0u, res_.reserved());
+  res_.deallocate(other, kBlock + 1, 8);
+
+  // Blocks are 64 byte aligned and fill the chunk before the next one is mapped.
+  constexpr size_t kPerChunk = HugePageResource::kChunkSize / 1024;
+  vector<void*> blocks;
+  for (size_t i = 0; i < kPerChunk; ++i) {
+    blocks.push_back(res_.allocate(kBlock, 8));
+    ASSERT_EQ(0u, uintptr_t(blocks.back()) % 64);
+  }
+  EXPECT_EQ(kPerChunk * kBlock, res_.used());
+  EXPECT_EQ(HugePageResource::kChunkSize, res_.reserved());
+
+  blocks.push_back(res_.allocate(kBlock, 8));
+  EXPECT_EQ(2 * HugePageResource::kChunkSize, res_.reserved());
+
+  // Freed blocks are reused.
+  void* freed = blocks[10];
+  res_.deallocate(freed, kBlock, 8);
+  EXPECT_EQ(kPerChunk * kBlock, res_.used());
+  EXPECT_EQ(freed, res_.allocate(kBlock, 8));
+
+  for (void* block : blocks)
+    res_.deallocate(block, kBlock, 8);
+  EXPECT_EQ(0u, res_.used());
+  EXPECT_EQ(2 * HugePageResource::kChunkSize, res_.reserved());
+}
+
+TEST_F(HugePageResourceTest, Trim) {
+  constexpr size_t kBlock = 1000;
+  constexpr size_t kPerChunk = HugePageResource::kChunkSize / 1024;
+  res_.AddBlockSize(kBlock);
+
+  vector<void*> blocks;
+  for (size_t i = 0; i < 2 * kPerChunk + 1; ++i)
+    blocks.push_back(res_.allocate(kBlock, 8));
+  EXPECT_EQ(3 * HugePageResource::kChunkSize, res_.reserved());
+
+  // Only the first chunk becomes empty, the others keep a live block each.
+  for (size_t i = 0; i < kPerChunk; ++i)
+    res_.deallocate(blocks[i], kBlock, 8);
+  for (size_t i = kPerChunk + 1; i < 2 * kPerChunk; ++i)
+    res_.deallocate(blocks[i], kBlock, 8);
+
+  EXPECT_EQ(HugePageResource::kChunkSize, res_.Trim());
+  EXPECT_EQ(2 * HugePageResource::kChunkSize, res_.reserved());
+  EXPECT_EQ(0u, res_.Trim());
+
+  // The free blocks of the released chunk are not handed out anymore.
+  void* block = res_.allocate(kBlock, 8);
+  EXPECT_EQ(uintptr_t(blocks[kPerChunk]) / HugePageResource::kChunkSize,
+            uintptr_t(block) / HugePageResource::kChunkSize);
+  res_.deallocate(block, kBlock, 8);
+
+  res_.deallocate(blocks[kPerChunk], kBlock, 8);
+  res_.deallocate(blocks[2 * kPerChunk], kBlock, 8);
+  EXPECT_EQ(0u, res_.used());
+  EXPECT_EQ(2 * HugePageResource::kChunkSize, res_.Trim());
+  EXPECT_EQ(0u, res_.reserved());
+
+  // The bump chunk was released as well, so a new one is mapped.
+  blocks = {res_.allocate(kBlock, 8)};
+  EXPECT_EQ(HugePageResource::kChunkSize, res_.reserved());
+  res_.deallocate(blocks[0], kBlock, 8);
+}
+
+}  // namespace dfly
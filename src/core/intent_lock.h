@@ -32,6 +32,13 @@ class IntentLock {
     return (m == SHARED) ? true : cnt_[SHARED] == 0;
   }
 
+  // Same as Check, but for a holder that already recorded its intent using `m` mode, i.e.
+  // returns true if there are no conflicting intents besides the holder's one.
+  bool CheckHeld(Mode m) const {
+    assert(cnt_[m] > 0);
+    return (m == SHARED) ? cnt_[EXCLUSIVE] == 0 : cnt_[EXCLUSIVE] == 1 && cnt_[SHARED] == 0;
+  }
+
   // Returns true if this lock would block transactions from running unless they are at the head
   // of the transaction queue (first ones)
   bool IsContended() const {
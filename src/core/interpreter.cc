@@ -216,6 +216,54 @@ void RunSafe(lua_State* lua, string_view buf, const char* name) {
   }
 }
 
+// Returns the buffer space needed for the redis() argument at idx,
+// or nullopt if it's neither a string nor a number.
+optional<size_t> ArgBufferLen(lua_State* lua, int idx) {
+  char tmpbuf[64];
+  switch (lua_type(lua, idx)) {
+    case LUA_TNUMBER:
+      if (lua_isinteger(lua, idx)) {
+        return absl::AlphaNum{lua_tointeger(lua, idx)}.size();
+      } else {
+        int fmt_len = absl::SNPrintF(tmpbuf, sizeof(tmpbuf), "%.17g", lua_tonumber(lua, idx));
+        CHECK_GT(fmt_len, 0);
+        return fmt_len;
+      }
+    case LUA_TSTRING:
+      return lua_rawlen(lua, idx) + 1;
+  }
+  return nullopt;
+}
+
+// Writes the redis() argument at idx into [cur, end] and returns its length.
+size_t WriteArg(lua_State* lua, int idx, char* cur, char* end) {
+  size_t len = 0;
+  switch (lua_type(lua, idx)) {
+    case LUA_TNUMBER:
+      if (lua_isinteger(lua, idx)) {
+        char* next = absl::numbers_internal::FastIntToBuffer(lua_tointeger(lua, idx), cur);
+        len = next - cur;
+      } else if (lua_isnumber(lua, idx)) {
+        // we pass `end - cur + 1` because we do not want to skip the last character
+        // if it's the last argument.
+        int fmt_len = absl::SNPrintF(cur, end - cur + 1, "%.17g", lua_tonumber(lua, idx));
+        CHECK_GT(fmt_len, 0);
+        len = fmt_len;
+      }
+      break;
+    case LUA_TSTRING:
+      len = lua_rawlen(lua, idx);
+      memcpy(cur, lua_tostring(lua, idx), len + 1);  // + 1 for null terminator
+  };
+  return len;
+}
+
+// lua_Writer that appends the dumped chunk to a std::string.
+int AppendToString(lua_State* lua, const void* p, size_t sz, void* ud) {
+  static_cast<string*>(ud)->append(static_cast<const char*>(p), sz);
+  return 0;
+}
+
 void Require(lua_State* lua, const char* name, lua_CFunction openf) {
   luaL_requiref(lua, name, openf, 1);
   lua_pop(lua, 1); /* remove lib */
@@ -471,30 +519,40 @@ int RedisLogCommand(lua_State* lua) {
 }
 
 // See https://www.lua.org/manual/5.3/manual.html#lua_Alloc
+// ud is the mimalloc heap of the interpreter.
 void* mimalloc_glue(void* ud, void* ptr, size_t osize, size_t nsize) {
-  (void)ud;
+  mi_heap_t* heap = static_cast<mi_heap_t*>(ud);
   if (nsize == 0) {
     InterpreterManager::tl_stats().used_bytes -= mi_usable_size(ptr);
     mi_free_size(ptr, osize);
     return nullptr;
   } else if (ptr == nullptr) {
-    ptr = mi_malloc(nsize);
+    ptr = mi_heap_malloc(heap, nsize);
     InterpreterManager::tl_stats().used_bytes += mi_usable_size(ptr);
     return ptr;
   } else {
     InterpreterManager::tl_stats().used_bytes -= mi_usable_size(ptr);
-    ptr = mi_realloc(ptr, nsize);
+    ptr = mi_heap_realloc(heap, ptr, nsize);
     InterpreterManager::tl_stats().used_bytes += mi_usable_size(ptr);
     return ptr;
   }
 }
 
+// Amount of memory an interpreter can allocate between two steps of RunGCStep.
+constexpr size_t kGcStepBytes = 64 << 10;
+
 }  // namespace
 
 Interpreter::Interpreter() {
   InterpreterManager::tl_stats().interpreter_cnt++;
 
-  lua_ = lua_newstate(mimalloc_glue, nullptr);
+  heap_ = mi_heap_new();
+  lua_ = lua_newstate(mimalloc_glue, heap_);
+#ifdef DFLY_USE_LUAJIT
+  // LuaJIT supports custom allocators only in GC64 mode
+  if (lua_ == nullptr)
+    lua_ = luaL_newstate();
+#endif
   InitLua(lua_);
   void** ptr = static_cast<void**>(lua_getextraspace(lua_));
   *ptr = this;
@@ -540,6 +598,11 @@ Interpreter::Interpreter() {
   lua_pushcfunction(lua_, RedisAPCallCommand);
   lua_settable(lua_, -3);
 
+  /* redis.pcall_batch */
+  lua_pushstring(lua_, "pcall_batch");
+  lua_pushcfunction(lua_, RedisPCallBatchCommand);
+  lua_settable(lua_, -3);
+
   lua_pushstring(lua_, "sha1hex");
   lua_pushcfunction(lua_, RedisSha1Command);
   lua_settable(lua_, -3);
@@ -573,6 +636,25 @@ Interpreter::~Interpreter() {
   InterpreterManager::tl_stats().interpreter_cnt--;
 
   lua_close(lua_);
+
+  // All blocks were freed by lua_close, delete moves the remaining ones to the default heap
+  // if there are any.
+  mi_heap_delete(heap_);
+}
+
+size_t Interpreter::UsedMemory() const {
+  return size_t(lua_gc(lua_, LUA_GCCOUNT, 0)) * 1024 + lua_gc(lua_, LUA_GCCOUNTB, 0);
+}
+
+void Interpreter::RunGCStep() {
+  size_t used = UsedMemory();
+  if (used < gc_step_mark_ + kGcStepBytes)
+    return;
+
+  // Lua paces the work done by a step by the given amount of allocated kilobytes.
+  lua_gc(lua_, LUA_GCSTEP, int((used - gc_step_mark_) / 1024));
+  gc_step_mark_ = UsedMemory();
+  InterpreterManager::tl_stats().gc_steps++;
 }
 
 void Interpreter::FuncSha1(string_view body, char* fp) {
@@ -582,7 +664,8 @@ void Interpreter::FuncSha1(string_view body, char* fp) {
   ToHex(digest, fp);
 }
 
-auto Interpreter::AddFunction(string_view sha, string_view body, string* result) -> AddResult {
+auto Interpreter::AddFunction(string_view sha, string_view body, string* result,
+                              string* bytecode) -> AddResult {
   char funcname[43];
   funcname[0] = 'f';
   funcname[1] = '_';
@@ -593,12 +676,32 @@ auto Interpreter::AddFunction(string_view sha, string_view body, string* result)
   int type = lua_getglobal(lua_, funcname);
   lua_pop(lua_, 1);
 
-  if (type == LUA_TNIL && !AddInternal(funcname, body, result))
+  if (type == LUA_TNIL && !AddInternal(funcname, body, result, bytecode))
     return COMPILE_ERR;
 
   return type == LUA_TNIL ? ADD_OK : ALREADY_EXISTS;
 }
 
+auto Interpreter::AddCompiledFunction(string_view sha, string_view bytecode, string* error)
+    -> AddResult {
+  if (Exists(sha))
+    return ALREADY_EXISTS;
+
+  int res = luaL_loadbufferx(lua_, bytecode.data(), bytecode.size(), "@user_script", "b");
+  if (res == 0) {
+    res = lua_pcall(lua_, 0, 0, 0);  // run func definition code
+  }
+
+  if (res) {
+    error->assign(lua_tostring(lua_, -1));
+    lua_pop(lua_, 1);  // Remove the error.
+    return COMPILE_ERR;
+  }
+
+  DCHECK(Exists(sha));
+  return ADD_OK;
+}
+
 bool Interpreter::Exists(string_view sha) const {
   DCHECK(lua_);
 
@@ -737,11 +840,17 @@ bool Interpreter::IsResultSafe() const {
   return res;
 }
 
-bool Interpreter::AddInternal(const char* f_id, string_view body, string* error) {
+bool Interpreter::AddInternal(const char* f_id, string_view body, string* error,
+                              string* bytecode) {
   string script = absl::StrCat("function ", f_id, "() \n");
   absl::StrAppend(&script, body, "\nend");
 
   int res = luaL_loadbuffer(lua_, script.data(), script.size(), "@user_script");
+  if (res == 0 && bytecode) {
+    // Keep debug info so that errors still report line numbers.
+    bytecode->clear();
+    lua_dump(lua_, AppendToString, bytecode, 0);
+  }
   if (res == 0) {
     res = lua_pcall(lua_, 0, 0, 0);  // run func definition code
   }
@@ -921,27 +1030,14 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
   }
 
   size_t blob_len = 0;
-  char tmpbuf[64];
 
   // Determine size required for backing storage for all args.
   // Skip command name (idx=1), as its stored in a separate buffer.
   for (int idx = 2; idx <= argc; idx++) {
-    switch (lua_type(lua_, idx)) {
-      case LUA_TNUMBER:
-        if (lua_isinteger(lua_, idx)) {
-          blob_len += absl::AlphaNum{lua_tointeger(lua_, idx)}.size();
-        } else {
-          int fmt_len = absl::SNPrintF(tmpbuf, sizeof(tmpbuf), "%.17g", lua_tonumber(lua_, idx));
-          CHECK_GT(fmt_len, 0);
-          blob_len += fmt_len;
-        }
-        continue;
-      case LUA_TSTRING:
-        blob_len += lua_rawlen(lua_, idx) + 1;
-        continue;
-      default:
-        RETURN_ERROR("Lua redis() command arguments must be strings or integers");
-    }
+    optional<size_t> len = ArgBufferLen(lua_, idx);
+    if (!len)
+      RETURN_ERROR("Lua redis() command arguments must be strings or integers");
+    blob_len += *len;
   }
 
   char name_buffer[32];  // backing storage for cmd name
@@ -960,25 +1056,7 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
   char* cur = buffer_.data();
   char* end = cur + blob_len;
   for (int idx = 2; idx <= argc; idx++) {
-    size_t len = 0;
-    switch (lua_type(lua_, idx)) {
-      case LUA_TNUMBER:
-        if (lua_isinteger(lua_, idx)) {
-          char* next = absl::numbers_internal::FastIntToBuffer(lua_tointeger(lua_, idx), cur);
-          len = next - cur;
-        } else if (lua_isnumber(lua_, idx)) {
-          // we pass `end - cur + 1` because we do not want to skip the last character
-          // if it's the last argument.
-          int fmt_len = absl::SNPrintF(cur, end - cur + 1, "%.17g", lua_tonumber(lua_, idx));
-          CHECK_GT(fmt_len, 0);
-          len = fmt_len;
-        }
-        break;
-      case LUA_TSTRING:
-        len = lua_rawlen(lua_, idx);
-        memcpy(cur, lua_tostring(lua_, idx), len + 1);  // + 1 for null terminator
-    };
-
+    size_t len = WriteArg(lua_, idx, cur, end);
     args[idx - 1] = {cur, len};
     cur += len;
   }
@@ -997,7 +1075,8 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
     explorer = &*translator;
   }
 
-  redis_func_(CallArgs{MutSliceSpan{args}, &buffer_, explorer, async, raise_error, &raise_error});
+  redis_func_(
+      CallArgs{MutSliceSpan{args}, &buffer_, explorer, async, raise_error, &raise_error, {}});
   cmd_depth_--;
 
   // Shrink reusable buffer if it's too big.
@@ -1021,6 +1100,92 @@ int Interpreter::RedisGenericCommand(bool raise_error, bool async, ObjectExplore
   return 1;
 }
 
+int Interpreter::RedisBatch() {
+  if (cmd_depth_) {
+    PushError(lua_, "redis.pcall_batch() can not be called recursively");
+    return 1;
+  }
+
+  if (!redis_func_) {
+    PushError(lua_, "internal error - redis function not defined");
+    return 1;
+  }
+
+  int num_cmds = lua_gettop(lua_);
+  if (num_cmds == 0) {
+    PushError(lua_, "Please specify at least one command for redis.pcall_batch()");
+    return 1;
+  }
+
+  // Flatten all commands, including their names, into a single argument list.
+  size_t blob_len = 0, num_args = 0;
+  for (int i = 1; i <= num_cmds; i++) {
+    if (!lua_istable(lua_, i) || lua_rawlen(lua_, i) == 0) {
+      PushError(lua_, "Lua redis.pcall_batch() arguments must be non-empty tables");
+      return 1;
+    }
+
+    unsigned len = lua_rawlen(lua_, i);
+    for (unsigned j = 1; j <= len; j++) {
+      lua_rawgeti(lua_, i, j);
+      optional<size_t> arg_len = ArgBufferLen(lua_, -1);
+      lua_pop(lua_, 1);
+      if (!arg_len) {
+        PushError(lua_, "Lua redis() command arguments must be strings or integers");
+        return 1;
+      }
+      blob_len += *arg_len;
+    }
+    num_args += len;
+  }
+
+  absl::FixedArray<absl::Span<char>, 16> args(num_args);
+  absl::FixedArray<unsigned, 8> cmd_lens(num_cmds);
+  buffer_.resize(blob_len + 4, '\0');
+
+  char* cur = buffer_.data();
+  char* end = cur + blob_len;
+  size_t arg_idx = 0;
+  for (int i = 1; i <= num_cmds; i++) {
+    cmd_lens[i - 1] = lua_rawlen(lua_, i);
+    for (unsigned j = 1; j <= cmd_lens[i - 1]; j++) {
+      lua_rawgeti(lua_, i, j);
+      size_t len = WriteArg(lua_, -1, cur, end);
+      lua_pop(lua_, 1);
+      args[arg_idx++] = {cur, len};
+      cur += len;
+    }
+  }
+  lua_pop(lua_, num_cmds);
+
+  cmd_depth_++;
+  RedisTranslator translator(lua_);
+  bool abort = false;
+  redis_func_(CallArgs{MutSliceSpan{args}, &buffer_, &translator, true, false, &abort,
+                       absl::MakeSpan(cmd_lens)});
+  cmd_depth_--;
+
+  if (buffer_.capacity() > 128) {
+    buffer_.clear();
+    buffer_.shrink_to_fit();
+  }
+
+  // Errors of previously queued async commands can't be handled by the script.
+  if (abort) {
+    DCHECK(translator.HasError());
+    return RaiseError(lua_);
+  }
+
+  // One reply per command was pushed, collect them into a table.
+  DCHECK_EQ(lua_gettop(lua_), num_cmds);
+  lua_createtable(lua_, num_cmds, 0);
+  lua_insert(lua_, 1);
+  for (int i = num_cmds; i >= 1; i--) {
+    lua_rawseti(lua_, 1, i);
+  }
+  return 1;
+}
+
 int Interpreter::RedisCallCommand(lua_State* lua) {
   void** ptr = static_cast<void**>(lua_getextraspace(lua));
   return reinterpret_cast<Interpreter*>(*ptr)->RedisGenericCommand(true, false);
@@ -1041,10 +1206,16 @@ int Interpreter::RedisAPCallCommand(lua_State* lua) {
   return reinterpret_cast<Interpreter*>(*ptr)->RedisGenericCommand(false, true);
 }
 
+int Interpreter::RedisPCallBatchCommand(lua_State* lua) {
+  void** ptr = static_cast<void**>(lua_getextraspace(lua));
+  return reinterpret_cast<Interpreter*>(*ptr)->RedisBatch();
+}
+
 InterpreterManager::Stats& InterpreterManager::Stats::operator+=(const Stats& other) {
   this->used_bytes += other.used_bytes;
   this->interpreter_cnt += other.interpreter_cnt;
   this->blocked_cnt += other.blocked_cnt;
+  this->gc_steps += other.gc_steps;
 
   return *this;
 }
@@ -1071,6 +1242,8 @@ Interpreter* InterpreterManager::Get() {
 
 void InterpreterManager::Return(Interpreter* ir) {
   if (ir >= storage_.data() && ir < storage_.data() + storage_.size()) {
+    // Collect garbage between scripts, so most of the collection work does not land inside them.
+    ir->RunGCStep();
     available_.push_back(ir);
     waker_.notify();
   } else if (return_untracked_ > 0) {
@@ -12,6 +12,7 @@
 #include "util/fibers/synchronization.h"
 
 typedef struct lua_State lua_State;
+typedef struct mi_heap_s mi_heap_t;
 
 namespace dfly {
 
@@ -57,6 +58,11 @@ class Interpreter {
     // The function can request an abort due to an error, even if error_abort is false.
     // It happens when async cmds are flushed and result in an uncatched error.
     bool* requested_abort;
+
+    // Set by redis.pcall_batch: args holds several commands, including their names, with
+    // the given number of args each. One reply per command is expected. async allows to
+    // squash them.
+    absl::Span<const unsigned> batch_lens;
   };
 
   using RedisFunc = std::function<void(CallArgs)>;
@@ -83,7 +89,15 @@ class Interpreter {
   };
 
   // Add function with sha and body to interpreter.
-  AddResult AddFunction(std::string_view sha, std::string_view body, std::string* error);
+  // If bytecode is not null, it's set to the compiled chunk that can be passed to
+  // AddCompiledFunction of other interpreters to skip compilation.
+  AddResult AddFunction(std::string_view sha, std::string_view body, std::string* error,
+                        std::string* bytecode = nullptr);
+
+  // Add function with sha from a chunk produced by AddFunction. Must not be used with untrusted
+  // input, because lua does not verify binary chunks.
+  AddResult AddCompiledFunction(std::string_view sha, std::string_view bytecode,
+                                std::string* error);
 
   bool Exists(std::string_view sha) const;
 
@@ -110,6 +124,14 @@ class Interpreter {
 
   void ResetStack();
 
+  // Memory allocated by the lua state.
+  size_t UsedMemory() const;
+
+  // Performs an incremental garbage collection step if enough memory was allocated since the
+  // last one. Called between script runs. Lua still collects automatically as a backstop,
+  // but stepping here keeps its debt low.
+  void RunGCStep();
+
   // fp must point to buffer with at least 41 chars.
   // fp[40] will be set to '\0'.
   static void FuncSha1(std::string_view body, char* fp);
@@ -126,15 +148,22 @@ class Interpreter {
  private:
   // Returns true if function was successfully added,
   // otherwise returns false and sets the error.
-  bool AddInternal(const char* f_id, std::string_view body, std::string* error);
+  bool AddInternal(const char* f_id, std::string_view body, std::string* error,
+                   std::string* bytecode);
   bool IsTableSafe() const;
 
+  // Runs commands passed to redis.pcall_batch and pushes a table with their replies.
+  int RedisBatch();
+
   static int RedisCallCommand(lua_State* lua);
   static int RedisPCallCommand(lua_State* lua);
   static int RedisACallCommand(lua_State* lua);
   static int RedisAPCallCommand(lua_State* lua);
+  static int RedisPCallBatchCommand(lua_State* lua);
 
   lua_State* lua_;
+  mi_heap_t* heap_;  // lua allocations of this interpreter
+  size_t gc_step_mark_ = 0;
   unsigned cmd_depth_ = 0;
   RedisFunc redis_func_;
   std::string buffer_;
@@ -150,6 +179,7 @@ class InterpreterManager {
     uint64_t used_bytes = 0;
     uint64_t interpreter_cnt = 0;
     uint64_t blocked_cnt = 0;
+    uint64_t gc_steps = 0;
   };
 
  public:
@@ -0,0 +1,64 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+// LuaJIT implements the Lua 5.1 API that Redis scripts are written against. This header provides
+// the newer functions used by the interpreter on top of it.
+
+#pragma once
+
+extern "C" {
+#include <lauxlib.h>
+#include <lua.h>
+#include <lualib.h>
+
+#define lua_rawlen(L, i) lua_objlen(L, (i))
+
+// Since 5.3 the getters return the type of the pushed value.
+#undef lua_getglobal
+static inline int lua_getglobal(lua_State* L, const char* name) {
+  lua_getfield(L, LUA_GLOBALSINDEX, name);
+  return lua_type(L, -1);
+}
+
+#define lua_rawgeti(L, idx, n) (lua_rawgeti(L, (idx), (n)), lua_type(L, -1))
+
+static inline void lua_len(lua_State* L, int idx) {
+  lua_pushinteger(L, (lua_Integer)lua_objlen(L, idx));
+}
+
+// All numbers are doubles, integral ones are replied as integers like by Redis.
+static inline int lua_isinteger(lua_State* L, int idx) {
+  if (lua_type(L, idx) != LUA_TNUMBER)
+    return 0;
+  lua_Number n = lua_tonumber(L, idx);
+  return n >= -9007199254740992.0 && n <= 9007199254740992.0 && n == (lua_Number)(lua_Integer)n;
+}
+
+static inline void luaL_requiref(lua_State* L, const char* modname, lua_CFunction openf, int glb) {
+  lua_pushcfunction(L, openf);
+  lua_pushstring(L, modname);
+  lua_call(L, 1, 1);
+  if (glb && *modname) {
+    lua_pushvalue(L, -1);
+    lua_setglobal(L, modname);
+  }
+}
+
+// There is no extra space, keep a pointer sized userdata in the registry instead.
+static inline void* lua_getextraspace(lua_State* L) {
+  static const char kExtraSpaceKey = 0;
+  lua_pushlightuserdata(L, (void*)&kExtraSpaceKey);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  void* space = lua_touserdata(L, -1);
+  lua_pop(L, 1);
+  if (space == NULL) {
+    lua_pushlightuserdata(L, (void*)&kExtraSpaceKey);
+    space = lua_newuserdata(L, sizeof(void*));
+    lua_rawset(L, LUA_REGISTRYINDEX);
+  }
+  return space;
+}
+
+// Dumps always keep debug information
+#define lua_dump(L, writer, data, strip) lua_dump(L, writer, data)
+}
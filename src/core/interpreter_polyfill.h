@@ -10,6 +10,16 @@ extern "C" {
 #include <lua.h>
 #include <lualib.h>
 
+#ifdef DFLY_USE_LUAJIT
+
+#include "core/interpreter_luajit.h"
+
+// Table functions removed after Lua 5.1 are still present.
+static void register_polyfills(lua_State* lua) {
+}
+
+#else
+
 // TODO: Fix checktab
 #define aux_getn(L, n, w) (luaL_len(L, n))
 
@@ -88,4 +98,6 @@ static void register_polyfills(lua_State* lua) {
 
   lua_remove(lua, -1);
 }
+
+#endif
 }
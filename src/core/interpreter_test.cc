@@ -9,6 +9,10 @@ extern "C" {
 #include <lua.h>
 }
 
+#ifdef DFLY_USE_LUAJIT
+#include "core/interpreter_luajit.h"
+#endif
+
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_replace.h>
 #include <gmock/gmock.h>
@@ -138,8 +142,8 @@ TEST_F(InterpreterTest, Basic) {
     end)",
             "code1");
 
-  int type = lua_getglobal(lua(), "foo");
-  ASSERT_EQ(LUA_TFUNCTION, type);
+  lua_getglobal(lua(), "foo");
+  ASSERT_EQ(LUA_TFUNCTION, lua_type(lua(), -1));
   lua_pushnumber(lua(), 42);
   lua_pcall(lua(), 1, 2, 0);
   int val1 = lua_tointeger(lua(), -1);
@@ -236,6 +240,49 @@ TEST_F(InterpreterTest, Add) {
   EXPECT_TRUE(intptr_.Exists(sha1));
 }
 
+TEST_F(InterpreterTest, AddCompiled) {
+  const char* s1 = "return 40 + 2";
+  char sha_buf[64];
+  Interpreter::FuncSha1(s1, sha_buf);
+  string_view sha{sha_buf, std::strlen(sha_buf)};
+
+  string err, bytecode;
+  Interpreter compiler;
+  ASSERT_EQ(Interpreter::ADD_OK, compiler.AddFunction(sha, s1, &err, &bytecode));
+  EXPECT_FALSE(bytecode.empty());
+
+  EXPECT_EQ(Interpreter::ADD_OK, intptr_.AddCompiledFunction(sha, bytecode, &err));
+  EXPECT_EQ(0, lua_gettop(lua()));
+  EXPECT_EQ(Interpreter::ALREADY_EXISTS, intptr_.AddCompiledFunction(sha, bytecode, &err));
+
+  ASSERT_EQ(Interpreter::RUN_OK, intptr_.RunFunction(sha, &err));
+  ser_.res.clear();
+  intptr_.SerializeResult(&ser_);
+  EXPECT_EQ("i(42) ", ser_.res);
+  intptr_.ResetStack();
+
+  // Only binary chunks are accepted.
+  string other_sha(40, '0');
+  EXPECT_EQ(Interpreter::COMPILE_ERR, intptr_.AddCompiledFunction(other_sha, "return 1", &err));
+  EXPECT_EQ(0, lua_gettop(lua()));
+}
+
+TEST_F(InterpreterTest, GCStep) {
+  size_t initial = intptr_.UsedMemory();
+  EXPECT_GT(initial, 0u);
+  EXPECT_LE(initial, InterpreterManager::tl_stats().used_bytes);
+
+  // Produce garbage that is not referenced after the script ends.
+  ASSERT_TRUE(Execute("local t = {} for i = 1, 20000 do t[i] = tostring(i) end return 0"));
+  size_t used = intptr_.UsedMemory();
+  ASSERT_GT(used, initial);
+
+  // Several steps might be required to finish a cycle.
+  for (unsigned i = 0; i < 100 && intptr_.UsedMemory() >= used; ++i)
+    intptr_.RunGCStep();
+  EXPECT_LT(intptr_.UsedMemory(), used);
+}
+
 // Test cases taken from scripting.tcl
 TEST_F(InterpreterTest, Execute) {
   ASSERT_TRUE(Execute("return 42"));
@@ -340,12 +387,19 @@ TEST_F(InterpreterTest, ArgKeys) {
   EXPECT_EQ("i(123456)", ser_.res);
 }
 
+// LuaJIT has no integer subtype, integral numbers are replied as integers like by Redis.
+#ifdef DFLY_USE_LUAJIT
+constexpr string_view kIntegralDouble = "i(1)";
+#else
+constexpr string_view kIntegralDouble = "d(1)";
+#endif
+
 TEST_F(InterpreterTest, Modules) {
   // cjson module
   EXPECT_TRUE(Execute("return cjson.encode({1, 2, 3})"));
   EXPECT_EQ("str([1,2,3])", ser_.res);
   EXPECT_TRUE(Execute("return cjson.decode('{\"a\": 1}')['a']"));
-  EXPECT_EQ("d(1)", ser_.res);
+  EXPECT_EQ(kIntegralDouble, ser_.res);
 
   // cmsgpack module
   EXPECT_TRUE(Execute("return cmsgpack.pack('ok', true)"));
@@ -514,4 +568,22 @@ end
   EXPECT_EQ("i(1)", ser_.res);
 }
 
+TEST_F(InterpreterTest, PCallBatch) {
+  vector<unsigned> lens;
+  auto cb = [&lens](Interpreter::CallArgs ca) {
+    lens.assign(ca.batch_lens.begin(), ca.batch_lens.end());
+    for (unsigned len : ca.batch_lens)
+      ca.translator->OnInt(len);
+  };
+  intptr_.SetRedisFunc(cb);
+
+  ASSERT_TRUE(Execute("return redis.pcall_batch({'incr', 'a'}, {'incrby', 'b', 5}, {'ping'})"))
+      << error_;
+  EXPECT_THAT(lens, testing::ElementsAre(2, 3, 1));
+  EXPECT_EQ("[i(2) i(3) i(1)]", ser_.res);
+
+  EXPECT_TRUE(Execute("return redis.pcall_batch({'incr', 'a'}, 'b')"));
+  EXPECT_THAT(ser_.res, testing::HasSubstr("must be non-empty tables"));
+}
+
 }  // namespace dfly
@@ -11,19 +11,27 @@ using namespace std;
 
 namespace dfly {
 
-optional<JsonType> JsonFromString(string_view input, PMR_NS::memory_resource* mr) {
-  error_code ec;
-  auto JsonErrorHandler = [](json_errc ec, const ser_context&) {
-    VLOG(1) << "Error while decode JSON: " << make_error_code(ec).message();
-    return false;
-  };
+namespace {
 
-  json_decoder<JsonType> decoder(std::pmr::polymorphic_allocator<char>{mr});
-  json_parser parser(basic_json_decode_options<char>{}, JsonErrorHandler);
+bool JsonErrorHandler(json_errc ec, const ser_context&) {
+  VLOG(1) << "Error while decode JSON: " << make_error_code(ec).message();
+  return false;
+}
+
+}  // namespace
 
+void ParseJson(string_view input, json_visitor* visitor) {
+  static thread_local json_parser parser(basic_json_decode_options<char>{}, JsonErrorHandler);
+  parser.reinitialize();
+
+  error_code ec;
   parser.update(input);
-  parser.finish_parse(decoder, ec);
+  parser.finish_parse(*visitor, ec);
+}
 
+optional<JsonType> JsonFromString(string_view input, PMR_NS::memory_resource* mr) {
+  json_decoder<JsonType> decoder(std::pmr::polymorphic_allocator<char>{mr});
+  ParseJson(input, &decoder);
   if (decoder.is_valid()) {
     return decoder.get_result();
   }
@@ -19,6 +19,10 @@ using JsonType = jsoncons::pmr::json;
 // Build a json object from string. If the string is not legal json, will return nullopt
 std::optional<JsonType> JsonFromString(std::string_view input, PMR_NS::memory_resource* mr);
 
+// Parses input and passes its events to visitor, which tracks whether a complete value was read.
+// The parser and its buffers are re-used by all calls on the same thread.
+void ParseJson(std::string_view input, jsoncons::json_visitor* visitor);
+
 inline auto MakeJsonPathExpr(std::string_view path, std::error_code& ec)
     -> jsoncons::jsonpath::jsonpath_expression<JsonType> {
   return jsoncons::jsonpath::make_expression<JsonType, std::allocator<char>>(
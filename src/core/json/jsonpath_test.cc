@@ -2,12 +2,14 @@
 // See LICENSE for licensing terms.
 //
 
+#include <absl/strings/str_cat.h>
 #include <gmock/gmock.h>
 
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "core/json/driver.h"
 #include "core/json/lexer_impl.h"
+#include "core/json/path.h"
 
 namespace flexbuffers {
 bool operator==(const Reference left, const Reference right) {
@@ -182,6 +184,22 @@ TEST_F(ScannerTest, FlatToJson) {
   EXPECT_EQ(res, JsonType::parse(actual));
 }
 
+TEST_F(ScannerTest, FlatFromString) {
+  const char* json = R"({"foo": "bar", "num": [1, -2, 1.5, 18446744073709551615],
+                         "obj": {"t": true, "n": null}, "arr": [[], {}]})";
+  flexbuffers::Builder fbb;
+  ASSERT_TRUE(FlatFromString(json, &fbb));
+  fbb.Finish();
+
+  JsonType expected = ::dfly::JsonFromString(json, pmr::get_default_resource()).value();
+  EXPECT_EQ(FromFlat(flexbuffers::GetRoot(fbb.GetBuffer())), expected);
+
+  flexbuffers::Builder invalid;
+  EXPECT_FALSE(FlatFromString(R"({"foo": )", &invalid));
+  flexbuffers::Builder duplicates;
+  EXPECT_FALSE(FlatFromString(R"({"foo": 1, "foo": 2})", &duplicates));
+}
+
 TYPED_TEST(JsonPathTest, Parser) {
   EXPECT_NE(0, this->Parse("foo"));
   EXPECT_NE(0, this->Parse("$foo"));
@@ -533,4 +551,38 @@ TYPED_TEST(JsonPathTest, SubRange) {
   arr.clear();
 }
 
+TEST(EvaluatePathsTest, SameAsEvaluatePath) {
+  JsonType json = ValidJson<JsonType>(R"(
+    {"user": {"name": "a", "tags": ["x", "y"], "profile": {"age": 5, "name": "b"}},
+     "arr": [{"name": "c"}, 7], "num": 3})");
+  // Paths with shared prefixes, descents, wildcards, mismatches, functions and duplicates.
+  vector<string> texts = {"$", "$.user.name", "$.user.profile.name", "$..name", "$.user.tags[*]",
+                          "$.num.x", "$.arr[*].name", "$.user.missing.x", "$.user.*",
+                          "$.user.name", "max($..age)"};
+
+  vector<Path> paths;
+  vector<const Path*> path_ptrs;
+  for (const auto& text : texts) {
+    auto path = ParsePath(text);
+    ASSERT_TRUE(path) << text;
+    paths.push_back(std::move(*path));
+  }
+  for (const auto& path : paths)
+    path_ptrs.push_back(&path);
+
+  vector<vector<string>> multi(paths.size());
+  EvaluatePaths(path_ptrs, json, [&](size_t i, optional<string_view> key, const JsonType& val) {
+    multi[i].push_back(absl::StrCat(key.value_or("-"), "=", val.to_string()));
+  });
+
+  for (size_t i = 0; i < paths.size(); ++i) {
+    vector<string> single;
+    EvaluatePath(paths[i], json, [&](optional<string_view> key, const JsonType& val) {
+      single.push_back(absl::StrCat(key.value_or("-"), "=", val.to_string()));
+    });
+    EXPECT_EQ(single, multi[i]) << texts[i];
+  }
+  EXPECT_THAT(multi[2], ElementsAre(R"(name="b")"));
+}
+
 }  // namespace dfly::json
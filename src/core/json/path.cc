@@ -32,6 +32,138 @@ class JsonPathDriver : public json::Driver {
   }
 };
 
+// Evaluates the paths of ids, which all reach node with their first depth segments. The common
+// identifier segments are looked up once for all the paths.
+void EvaluateFrom(absl::Span<const Path* const> paths, absl::Span<const size_t> ids, size_t depth,
+                  optional<string_view> key, const JsonType& node, MultiPathCallback callback) {
+  vector<pair<string_view, vector<size_t>>> children;
+  for (size_t id : ids) {
+    const Path& path = *paths[id];
+    if (depth == path.size()) {
+      callback(id, key, node);
+      continue;
+    }
+
+    const PathSegment& segment = path[depth];
+    if (segment.type() != SegmentType::IDENTIFIER) {
+      absl::Span<const PathSegment> tail(path.data() + depth, path.size() - depth);
+      Dfs::Traverse(tail, node, [&](auto k, const JsonType& val) { callback(id, k, val); });
+      continue;
+    }
+
+    if (!node.is_object())
+      continue;
+
+    auto it = find_if(children.begin(), children.end(),
+                      [&](const auto& child) { return child.first == segment.identifier(); });
+    if (it == children.end())
+      children.emplace_back(segment.identifier(), vector<size_t>{id});
+    else
+      it->second.push_back(id);
+  }
+
+  for (const auto& [identifier, child_ids] : children) {
+    auto it = node.find(identifier);
+    if (it == node.object_range().end())
+      continue;
+
+    // Like Dfs, only objects and arrays are descended into.
+    const JsonType& child = it->value();
+    vector<size_t> next_ids;
+    for (size_t id : child_ids) {
+      if (depth + 1 == paths[id]->size())
+        callback(id, identifier, child);
+      else if (child.is_object() || child.is_array())
+        next_ids.push_back(id);
+    }
+    if (!next_ids.empty())
+      EvaluateFrom(paths, next_ids, depth + 1, identifier, child, callback);
+  }
+}
+
+// Builds a flat json value directly from parser events.
+class FlatBuildVisitor : public jsoncons::default_json_visitor {
+ public:
+  explicit FlatBuildVisitor(flexbuffers::Builder* fbb) : fbb_{fbb} {
+  }
+
+  // Whether a complete value was built
+  bool IsValid() const {
+    return complete_;
+  }
+
+ private:
+  using SemTag = jsoncons::semantic_tag;
+  using SerCtx = jsoncons::ser_context;
+
+  bool visit_begin_object(SemTag, const SerCtx&, error_code&) override {
+    starts_.push_back(fbb_->StartMap());
+    return true;
+  }
+
+  bool visit_end_object(const SerCtx&, error_code&) override {
+    fbb_->EndMap(starts_.back());
+    starts_.pop_back();
+    return EndValue();
+  }
+
+  bool visit_begin_array(SemTag, const SerCtx&, error_code&) override {
+    starts_.push_back(fbb_->StartVector());
+    return true;
+  }
+
+  bool visit_end_array(const SerCtx&, error_code&) override {
+    fbb_->EndVector(starts_.back(), false, false);
+    starts_.pop_back();
+    return EndValue();
+  }
+
+  bool visit_key(const string_view_type& name, const SerCtx&, error_code&) override {
+    fbb_->Key(name.data(), name.size());
+    return true;
+  }
+
+  bool visit_null(SemTag, const SerCtx&, error_code&) override {
+    fbb_->Null();
+    return EndValue();
+  }
+
+  bool visit_bool(bool value, SemTag, const SerCtx&, error_code&) override {
+    fbb_->Bool(value);
+    return EndValue();
+  }
+
+  // Numbers that don't fit are strings tagged as big numbers, same as in JsonType
+  bool visit_string(const string_view_type& value, SemTag, const SerCtx&, error_code&) override {
+    fbb_->String(value.data(), value.size());
+    return EndValue();
+  }
+
+  bool visit_int64(int64_t value, SemTag, const SerCtx&, error_code&) override {
+    fbb_->Int(value);
+    return EndValue();
+  }
+
+  bool visit_uint64(uint64_t value, SemTag, const SerCtx&, error_code&) override {
+    fbb_->UInt(value);
+    return EndValue();
+  }
+
+  bool visit_double(double value, SemTag, const SerCtx&, error_code&) override {
+    fbb_->Double(value);
+    return EndValue();
+  }
+
+  bool EndValue() {
+    complete_ = starts_.empty();
+    return true;
+  }
+
+  flexbuffers::Builder* fbb_;
+  vector<size_t> starts_;
+  bool complete_ = false;
+};
+
 }  // namespace
 
 const char* SegmentName(SegmentType type) {
@@ -130,6 +262,21 @@ void EvaluatePath(const Path& path, const JsonType& json, PathCallback callback)
   callback(nullopt, val);
 }
 
+void EvaluatePaths(absl::Span<const Path* const> paths, const JsonType& json,
+                   MultiPathCallback callback) {
+  vector<size_t> ids;
+  for (size_t i = 0; i < paths.size(); ++i) {
+    const Path& path = *paths[i];
+    if (!path.empty() && path.front().type() == SegmentType::FUNCTION) {
+      EvaluatePath(path, json, [&](auto k, const JsonType& val) { callback(i, k, val); });
+    } else {
+      ids.push_back(i);
+    }
+  }
+
+  EvaluateFrom(paths, ids, 0, nullopt, json, callback);
+}
+
 nonstd::expected<json::Path, string> ParsePath(string_view path) {
   if (path.size() > 8192)
     return nonstd::make_unexpected("Path too long");
@@ -217,6 +364,10 @@ JsonType FromFlat(FlatJson src) {
     return JsonType(src.AsInt64());
   }
 
+  if (src.IsUInt()) {
+    return JsonType(src.AsUInt64());
+  }
+
   if (src.IsFloat()) {
     return JsonType(src.AsDouble());
   }
@@ -254,6 +405,10 @@ void FromJsonType(const JsonType& src, flexbuffers::Builder* fbb) {
     return fbb->Int(src.as<int64_t>());
   }
 
+  if (src.is_uint64()) {
+    return fbb->UInt(src.as<uint64_t>());
+  }
+
   if (src.is_double()) {
     return fbb->Double(src.as_double());
   }
@@ -284,6 +439,12 @@ void FromJsonType(const JsonType& src, flexbuffers::Builder* fbb) {
   fbb->EndVector(start, false, false);
 }
 
+bool FlatFromString(string_view input, flexbuffers::Builder* fbb) {
+  FlatBuildVisitor visitor{fbb};
+  ParseJson(input, &visitor);
+  return visitor.IsValid() && !fbb->HasDuplicateKeys();
+}
+
 unsigned MutatePath(const Path& path, MutateCallback callback, FlatJson json,
                     flexbuffers::Builder* fbb) {
   JsonType mut_json = FromFlat(json);
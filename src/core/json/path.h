@@ -5,6 +5,7 @@
 #pragma once
 
 #include <absl/functional/function_ref.h>
+#include <absl/types/span.h>
 
 #include <string>
 #include <variant>
@@ -125,6 +126,10 @@ using Path = std::vector<PathSegment>;
 using PathCallback = absl::FunctionRef<void(std::optional<std::string_view>, const JsonType&)>;
 using PathFlatCallback = absl::FunctionRef<void(std::optional<std::string_view>, FlatJson)>;
 
+// Same as PathCallback but also passes the index of the matched path.
+using MultiPathCallback =
+    absl::FunctionRef<void(size_t, std::optional<std::string_view>, const JsonType&)>;
+
 // Returns true if the entry should be deleted, false otherwise.
 using MutateCallback = absl::FunctionRef<bool(std::optional<std::string_view>, JsonType*)>;
 
@@ -133,6 +138,11 @@ void EvaluatePath(const Path& path, const JsonType& json, PathCallback callback)
 // Same as above but for flatbuffers.
 void EvaluatePath(const Path& path, FlatJson json, PathFlatCallback callback);
 
+// Evaluates all the paths in a single pass, the identifiers of common path prefixes are looked
+// up once. Matches of each path are passed in the same order as by EvaluatePath.
+void EvaluatePaths(absl::Span<const Path* const> paths, const JsonType& json,
+                   MultiPathCallback callback);
+
 // returns number of matches found with the given path.
 unsigned MutatePath(const Path& path, MutateCallback callback, JsonType* json);
 unsigned MutatePath(const Path& path, MutateCallback callback, FlatJson json,
@@ -149,4 +159,9 @@ JsonType FromFlat(FlatJson src);
 // Does not call flexbuffers::Builder::Finish.
 void FromJsonType(const JsonType& src, flexbuffers::Builder* fbb);
 
+// Parses json text directly into a buffer using flexbuffers::Builder, without building JsonType.
+// Returns false if the text is not legal json or has duplicate keys, that are resolved only by
+// JsonType. The builder should be discarded then. Does not call flexbuffers::Builder::Finish.
+bool FlatFromString(std::string_view input, flexbuffers::Builder* fbb);
+
 }  // namespace dfly::json
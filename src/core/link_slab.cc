@@ -0,0 +1,181 @@
+// Copyright 2026, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/link_slab.h"
+
+#include <absl/container/flat_hash_map.h>
+
+#include <memory>
+
+#include "glog/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+struct LinkSlab::Chunk {
+  LinkSlab* owner;
+  Chunk* prev;
+  Chunk* next;
+  void* free_list;
+  uint32_t used;
+  uint32_t bump;  // Blocks after bump were never allocated and are not on the free list.
+};
+
+namespace {
+
+constexpr size_t kHeaderSize =
+    (sizeof(LinkSlab::Chunk) + LinkSlab::kBlockSize - 1) / LinkSlab::kBlockSize *
+    LinkSlab::kBlockSize;
+constexpr uint32_t kBlocksPerChunk = (LinkSlab::kChunkSize - kHeaderSize) / LinkSlab::kBlockSize;
+
+LinkSlab::Chunk* ChunkOf(const void* ptr) {
+  return reinterpret_cast<LinkSlab::Chunk*>(reinterpret_cast<uintptr_t>(ptr) &
+                                            ~uintptr_t(LinkSlab::kChunkSize - 1));
+}
+
+char* BlockAt(LinkSlab::Chunk* chunk, uint32_t index) {
+  return reinterpret_cast<char*>(chunk) + kHeaderSize + index * LinkSlab::kBlockSize;
+}
+
+thread_local absl::flat_hash_map<PMR_NS::memory_resource*, unique_ptr<LinkSlab>> tl_slabs;
+thread_local LinkSlab* tl_last_slab = nullptr;
+thread_local PMR_NS::memory_resource* tl_last_mr = nullptr;
+
+// Its address identifies the thread.
+thread_local char tl_thread_tag;
+
+}  // namespace
+
+LinkSlab::LinkSlab(MemoryResource* mr) : mr_(mr), thread_(&tl_thread_tag) {
+}
+
+LinkSlab* LinkSlab::ForResource(MemoryResource* mr) {
+  if (mr == tl_last_mr)
+    return tl_last_slab;
+
+  auto& slab = tl_slabs[mr];
+  if (!slab)
+    slab = make_unique<LinkSlab>(mr);
+
+  tl_last_mr = mr;
+  tl_last_slab = slab.get();
+  return tl_last_slab;
+}
+
+void LinkSlab::DestroyThreadLocal(MemoryResource* mr) {
+  if (mr == tl_last_mr) {
+    tl_last_mr = nullptr;
+    tl_last_slab = nullptr;
+  }
+  tl_slabs.erase(mr);
+}
+
+void* LinkSlab::Allocate() {
+  if (remote_frees_.load(memory_order_relaxed))
+    DrainRemoteFrees();
+
+  Chunk* chunk = head_ ? head_ : NewChunk();
+
+  void* res;
+  if (chunk->free_list) {
+    res = chunk->free_list;
+    chunk->free_list = *reinterpret_cast<void**>(res);
+  } else {
+    DCHECK_LT(chunk->bump, kBlocksPerChunk);
+    res = BlockAt(chunk, chunk->bump++);
+  }
+
+  if (++chunk->used == kBlocksPerChunk)
+    UnlinkChunk(chunk);
+  ++num_blocks_;
+  return res;
+}
+
+void LinkSlab::Free(void* ptr) {
+  Chunk* chunk = ChunkOf(ptr);
+  LinkSlab* owner = chunk->owner;
+  if (owner->thread_ == &tl_thread_tag)
+    owner->FreeInChunk(chunk, ptr);
+  else
+    owner->PushRemoteFree(ptr);
+}
+
+bool LinkSlab::IsUnderutilized(const void* ptr, float ratio) {
+  Chunk* chunk = ChunkOf(ptr);
+  const Chunk* target = chunk->owner->head_;
+  return chunk->used < ratio * kBlocksPerChunk && target != nullptr && target != chunk &&
+         target->used >= chunk->used;
+}
+
+auto LinkSlab::NewChunk() -> Chunk* {
+  static_assert(kBlocksPerChunk > 1);
+
+  Chunk* chunk = static_cast<Chunk*>(mr_->allocate(kChunkSize, kChunkSize));
+  DCHECK_EQ(ChunkOf(chunk), chunk);
+
+  *chunk = Chunk{this, nullptr, nullptr, nullptr, 0, 0};
+  LinkChunk(chunk);
+  ++num_chunks_;
+  return chunk;
+}
+
+void LinkSlab::FreeInChunk(Chunk* chunk, void* ptr) {
+  DCHECK_GT(chunk->used, 0u);
+  --num_blocks_;
+
+  if (chunk->used-- == kBlocksPerChunk)
+    LinkChunk(chunk);
+
+  if (chunk->used == 0) {
+    UnlinkChunk(chunk);
+    mr_->deallocate(chunk, kChunkSize, kChunkSize);
+    --num_chunks_;
+    return;
+  }
+
+  *reinterpret_cast<void**>(ptr) = chunk->free_list;
+  chunk->free_list = ptr;
+}
+
+void LinkSlab::PushRemoteFree(void* ptr) {
+  void* head = remote_frees_.load(memory_order_relaxed);
+  do {
+    *reinterpret_cast<void**>(ptr) = head;
+  } while (!remote_frees_.compare_exchange_weak(head, ptr, memory_order_release,
+                                                memory_order_relaxed));
+}
+
+void LinkSlab::DrainRemoteFrees() {
+  void* ptr = remote_frees_.exchange(nullptr, memory_order_acquire);
+  while (ptr) {
+    void* next = *reinterpret_cast<void**>(ptr);
+    FreeInChunk(ChunkOf(ptr), ptr);
+    ptr = next;
+  }
+}
+
+void LinkSlab::LinkChunk(Chunk* chunk) {
+  chunk->prev = tail_;
+  chunk->next = nullptr;
+  if (tail_)
+    tail_->next = chunk;
+  else
+    head_ = chunk;
+  tail_ = chunk;
+}
+
+void LinkSlab::UnlinkChunk(Chunk* chunk) {
+  if (chunk->prev)
+    chunk->prev->next = chunk->next;
+  else
+    head_ = chunk->next;
+
+  if (chunk->next)
+    chunk->next->prev = chunk->prev;
+  else
+    tail_ = chunk->prev;
+}
+
+}  // namespace dfly
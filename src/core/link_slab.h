@@ -0,0 +1,81 @@
+// Copyright 2026, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Thread-local pool of the 16 byte link nodes of DenseSet. Links are carved out of chunks that
+// are allocated from the memory resource with their own size as alignment, so the chunk of a
+// link is found by masking its address. This saves the per-allocation overhead of the allocator
+// and keeps the links of a set close together. Chunks are returned to the memory resource as
+// soon as they become empty. Blocks freed by other threads are queued to their slab and returned
+// to their chunks by the owning thread.
+class LinkSlab {
+ public:
+  using MemoryResource = PMR_NS::memory_resource;
+  struct Chunk;
+
+  static constexpr size_t kBlockSize = 16;
+  static constexpr size_t kChunkSize = 4096;
+
+  explicit LinkSlab(MemoryResource* mr);
+
+  LinkSlab(const LinkSlab&) = delete;
+  LinkSlab& operator=(const LinkSlab&) = delete;
+
+  // Returns the slab of the calling thread that allocates from mr.
+  static LinkSlab* ForResource(MemoryResource* mr);
+
+  // Destroys the slab of the calling thread that allocates from mr. Must be called before mr is
+  // destroyed, so that a new resource at the same address does not get a stale slab.
+  static void DestroyThreadLocal(MemoryResource* mr);
+
+  void* Allocate();
+
+  // Returns the block to the slab it was allocated from. Can be called from any thread.
+  static void Free(void* ptr);
+
+  // Returns true if the chunk of ptr is used below ratio and moving the block to a new
+  // allocation would help to empty it. Must be called by the thread that owns ptr.
+  static bool IsUnderutilized(const void* ptr, float ratio);
+
+  size_t num_chunks() const {
+    return num_chunks_;
+  }
+
+  size_t num_blocks() const {
+    return num_blocks_;
+  }
+
+ private:
+  Chunk* NewChunk();
+  void FreeInChunk(Chunk* chunk, void* ptr);
+  void PushRemoteFree(void* ptr);
+  void DrainRemoteFrees();
+  void LinkChunk(Chunk* chunk);
+  void UnlinkChunk(Chunk* chunk);
+
+  MemoryResource* mr_;
+  const void* thread_;  // identifies the owning thread.
+
+  // Blocks freed by other threads, linked through their first word.
+  std::atomic<void*> remote_frees_{nullptr};
+
+  // Chunks with free blocks. Allocations are served from the head so that the chunks that got
+  // free blocks lately are filled last and have a chance to become empty.
+  Chunk* head_ = nullptr;
+  Chunk* tail_ = nullptr;
+
+  size_t num_chunks_ = 0;
+  size_t num_blocks_ = 0;
+};
+
+}  // namespace dfly
@@ -0,0 +1,249 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/packed_int_set.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "core/detail/bitpacking.h"
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+// Cursors preserve the order of the members and map the smallest one to 0.
+uint64_t ToCursor(int64_t val) {
+  return uint64_t(val) ^ (1ULL << 63);
+}
+
+int64_t FromCursor(uint64_t cursor) {
+  return int64_t(cursor ^ (1ULL << 63));
+}
+
+}  // namespace
+
+PackedIntSet::PackedIntSet(PMR_NS::memory_resource* mr) : blocks_(mr) {
+}
+
+PackedIntSet::~PackedIntSet() {
+  for (const Block& block : blocks_)
+    FreeBlock(block);
+}
+
+size_t PackedIntSet::DataSize(const Block& block) {
+  return detail::bitpacked_len(block.count - 1, block.width);
+}
+
+size_t PackedIntSet::FindBlock(int64_t val) const {
+  auto it = upper_bound(blocks_.begin(), blocks_.end(), val,
+                        [](int64_t val, const Block& block) { return val < block.first; });
+  return it == blocks_.begin() ? 0 : it - blocks_.begin() - 1;
+}
+
+size_t PackedIntSet::Decode(const Block& block, int64_t* dest) const {
+  uint32_t offsets[kBlockSize];
+  detail::bit_unpack(block.data, block.count - 1, block.width, offsets);
+
+  dest[0] = block.first;
+  for (size_t i = 1; i < block.count; ++i)
+    dest[i] = int64_t(uint64_t(block.first) + offsets[i - 1]);
+  return block.count;
+}
+
+auto PackedIntSet::MakeBlock(const int64_t* vals, size_t len) -> Block {
+  DCHECK(len > 0 && len <= kBlockSize);
+
+  uint32_t offsets[kBlockSize];
+  for (size_t i = 1; i < len; ++i) {
+    uint64_t offset = uint64_t(vals[i]) - uint64_t(vals[0]);
+    DCHECK_LE(offset, UINT32_MAX);
+    offsets[i - 1] = offset;
+  }
+
+  // The members are sorted, so the last offset is the widest.
+  Block block{.first = vals[0], .data = nullptr, .count = uint8_t(len), .width = 0};
+  if (len > 1)
+    block.width = absl::bit_width(offsets[len - 2]);
+
+  if (size_t size = DataSize(block); size > 0) {
+    block.data = static_cast<uint8_t*>(blocks_.get_allocator().resource()->allocate(size, 1));
+    detail::bit_pack(offsets, len - 1, block.width, block.data);
+    data_bytes_ += size;
+  }
+  return block;
+}
+
+void PackedIntSet::FreeBlock(const Block& block) {
+  if (block.data) {
+    size_t size = DataSize(block);
+    blocks_.get_allocator().resource()->deallocate(block.data, size, 1);
+    data_bytes_ -= size;
+  }
+}
+
+void PackedIntSet::Store(size_t pos, const int64_t* vals, size_t n) {
+  FreeBlock(blocks_[pos]);
+  if (n == 0) {
+    blocks_.erase(blocks_.begin() + pos);
+    return;
+  }
+
+  // Split in halves, so that both blocks have room for the following insertions.
+  size_t half = n > kBlockSize ? n / 2 : n;
+  bool replaced = false;
+  for (size_t start = 0; start < n;) {
+    size_t limit = start < half ? half : n;
+    size_t end = start + 1;
+    while (end < limit && uint64_t(vals[end]) - uint64_t(vals[start]) <= UINT32_MAX)
+      ++end;
+
+    Block block = MakeBlock(vals + start, end - start);
+    if (replaced)
+      blocks_.insert(blocks_.begin() + pos, block);
+    else
+      blocks_[pos] = block;
+
+    replaced = true;
+    ++pos;
+    start = end;
+  }
+}
+
+bool PackedIntSet::Add(int64_t val) {
+  if (blocks_.empty()) {
+    blocks_.push_back(MakeBlock(&val, 1));
+    size_ = 1;
+    return true;
+  }
+
+  size_t pos = FindBlock(val);
+  int64_t vals[kBlockSize + 1];
+  size_t n = Decode(blocks_[pos], vals);
+
+  int64_t* it = lower_bound(vals, vals + n, val);
+  if (it != vals + n && *it == val)
+    return false;
+
+  memmove(it + 1, it, (vals + n - it) * sizeof(int64_t));
+  *it = val;
+  Store(pos, vals, n + 1);
+  ++size_;
+
+  return true;
+}
+
+bool PackedIntSet::Erase(int64_t val) {
+  if (blocks_.empty())
+    return false;
+
+  size_t pos = FindBlock(val);
+  int64_t vals[kBlockSize * 2];
+  size_t n = Decode(blocks_[pos], vals);
+
+  int64_t* it = lower_bound(vals, vals + n, val);
+  if (it == vals + n || *it != val)
+    return false;
+
+  memmove(it, it + 1, (vals + n - it - 1) * sizeof(int64_t));
+  --n;
+  --size_;
+
+  // Merge sparse neighbours, so that the per block overhead stays small.
+  if (n < kBlockSize / 4 && pos + 1 < blocks_.size() &&
+      n + blocks_[pos + 1].count <= kBlockSize / 2) {
+    n += Decode(blocks_[pos + 1], vals + n);
+    Store(pos + 1, nullptr, 0);
+  }
+  Store(pos, vals, n);
+
+  if (blocks_.size() * 4 < blocks_.capacity())
+    blocks_.shrink_to_fit();
+
+  return true;
+}
+
+bool PackedIntSet::Contains(int64_t val) const {
+  if (blocks_.empty())
+    return false;
+
+  const Block& block = blocks_[FindBlock(val)];
+  if (val == block.first)
+    return true;
+
+  uint64_t offset = uint64_t(val) - uint64_t(block.first);
+  if (val < block.first || offset > UINT32_MAX)
+    return false;
+
+  uint32_t offsets[kBlockSize];
+  size_t len = block.count - 1;
+  detail::bit_unpack(block.data, len, block.width, offsets);
+  size_t i = detail::lower_bound_u32(offsets, len, offset);
+  return i < len && offsets[i] == offset;
+}
+
+bool PackedIntSet::Iterate(absl::FunctionRef<bool(int64_t)> cb) const {
+  int64_t vals[kBlockSize + 1];
+  for (const Block& block : blocks_) {
+    size_t n = Decode(block, vals);
+    for (size_t i = 0; i < n; ++i) {
+      if (!cb(vals[i]))
+        return false;
+    }
+  }
+  return true;
+}
+
+uint64_t PackedIntSet::Scan(uint64_t cursor, absl::FunctionRef<void(int64_t)> cb) const {
+  if (blocks_.empty())
+    return 0;
+
+  int64_t start = FromCursor(cursor);
+  size_t pos = FindBlock(start);
+  int64_t vals[kBlockSize + 1];
+  size_t n = Decode(blocks_[pos], vals);
+  for (size_t i = 0; i < n; ++i) {
+    if (vals[i] >= start)
+      cb(vals[i]);
+  }
+
+  // The first member of the next block is never the smallest one, so the cursor is not 0.
+  return pos + 1 < blocks_.size() ? ToCursor(blocks_[pos + 1].first) : 0;
+}
+
+size_t PackedIntSet::MallocUsed() const {
+  return blocks_.capacity() * sizeof(Block) + data_bytes_;
+}
+
+bool PackedIntSet::DefragIfNeeded(float ratio) {
+  bool moved = false;
+  if (!blocks_.empty() && zmalloc_page_is_underutilized(blocks_.data(), ratio)) {
+    Blocks(blocks_, blocks_.get_allocator()).swap(blocks_);
+    moved = true;
+  }
+
+  auto* mr = blocks_.get_allocator().resource();
+  for (Block& block : blocks_) {
+    if (block.data && zmalloc_page_is_underutilized(block.data, ratio)) {
+      size_t size = DataSize(block);
+      uint8_t* data = static_cast<uint8_t*>(mr->allocate(size, 1));
+      memcpy(data, block.data, size);
+      mr->deallocate(block.data, size, 1);
+      block.data = data;
+      moved = true;
+    }
+  }
+  return moved;
+}
+
+}  // namespace dfly
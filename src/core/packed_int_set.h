@@ -0,0 +1,99 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Compact sorted set of integers for sets that outgrow an intset.
+//
+// Unlike an intset, which stores all the members with the width of the widest one and thus
+// is rewritten completely on every insertion, the members are split into sorted blocks of up
+// to kBlockSize members. A block stores its smallest member and the offsets of the others
+// from it, bit-packed with the width of its largest offset. Members that are close to each
+// other, like ids, take a few bytes each, and an update unpacks and repacks a single block.
+// Blocks are found by a binary search over their first members, and a member within a block
+// by a branchless SIMD scan over the unpacked offsets.
+class PackedIntSet {
+  PackedIntSet(const PackedIntSet&) = delete;
+  PackedIntSet& operator=(const PackedIntSet&) = delete;
+
+ public:
+  static constexpr size_t kBlockSize = 128;
+
+  explicit PackedIntSet(PMR_NS::memory_resource* mr);
+  ~PackedIntSet();
+
+  // Returns true if val was added, false if it already exists.
+  bool Add(int64_t val);
+
+  // Returns true if val was removed.
+  bool Erase(int64_t val);
+
+  bool Contains(int64_t val) const;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  // Calls cb for every member in ascending order until it returns false.
+  // Returns false if the iteration was stopped by cb.
+  bool Iterate(absl::FunctionRef<bool(int64_t)> cb) const;
+
+  // Calls cb with the members of the block with the members at or after cursor, 0 for the first
+  // call. Returns the cursor to continue from or 0 when all the members were visited.
+  // Cursors are derived from the members, so members that stay in the set for the whole scan
+  // are visited exactly once regardless of the updates.
+  uint64_t Scan(uint64_t cursor, absl::FunctionRef<void(int64_t)> cb) const;
+
+  size_t MallocUsed() const;
+
+  // Moves the blocks if they are on pages utilized below ratio.
+  // Returns true if anything was reallocated.
+  bool DefragIfNeeded(float ratio);
+
+ private:
+  struct Block {
+    int64_t first;
+    uint8_t* data;  // offsets of the rest of the members from first, width bits each.
+    uint8_t count;
+    uint8_t width;
+  };
+
+  using Blocks = std::vector<Block, PMR_NS::polymorphic_allocator<Block>>;
+
+  // Returns the index of the block that val belongs to.
+  size_t FindBlock(int64_t val) const;
+
+  // Unpacks the members of the block into dest, which must have room for kBlockSize + 1.
+  // Returns the number of members.
+  size_t Decode(const Block& block, int64_t* dest) const;
+
+  Block MakeBlock(const int64_t* vals, size_t len);
+
+  void FreeBlock(const Block& block);
+
+  // Replaces the block at pos with blocks holding the n sorted vals. Full blocks are split in
+  // halves and the offsets of a block must fit into 32 bits.
+  void Store(size_t pos, const int64_t* vals, size_t n);
+
+  static size_t DataSize(const Block& block);
+
+  Blocks blocks_;
+  size_t size_ = 0;
+  size_t data_bytes_ = 0;
+};
+
+}  // namespace dfly
@@ -0,0 +1,134 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/packed_int_set.h"
+
+#include <gmock/gmock.h>
+
+#include <random>
+#include <set>
+
+#include "base/gtest.h"
+#include "core/detail/bitpacking.h"
+
+namespace dfly {
+
+using namespace std;
+
+class PackedIntSetTest : public ::testing::Test {
+ protected:
+  PackedIntSetTest() : set_(PMR_NS::get_default_resource()) {
+  }
+
+  vector<int64_t> Members() const {
+    vector<int64_t> res;
+    set_.Iterate([&res](int64_t member) {
+      res.push_back(member);
+      return true;
+    });
+    return res;
+  }
+
+  PackedIntSet set_;
+};
+
+TEST_F(PackedIntSetTest, BitPacking) {
+  vector<uint32_t> src = {0, 1, 5, 17, 100, 1000, 65535};
+  for (unsigned width : {16u, 17u, 32u}) {
+    vector<uint8_t> bin(detail::bitpacked_len(src.size(), width));
+    vector<uint32_t> dest(src.size());
+    detail::bit_pack(src.data(), src.size(), width, bin.data());
+    detail::bit_unpack(bin.data(), src.size(), width, dest.data());
+    EXPECT_EQ(src, dest) << width;
+  }
+
+  for (uint32_t val : {0u, 1u, 2u, 17u, 64000u, 65536u, UINT32_MAX})
+    EXPECT_EQ(lower_bound(src.begin(), src.end(), val) - src.begin(),
+              detail::lower_bound_u32(src.data(), src.size(), val))
+        << val;
+}
+
+TEST_F(PackedIntSetTest, Basic) {
+  EXPECT_TRUE(set_.Empty());
+  EXPECT_FALSE(set_.Contains(0));
+  EXPECT_FALSE(set_.Erase(0));
+
+  EXPECT_TRUE(set_.Add(5));
+  EXPECT_TRUE(set_.Add(-3));
+  EXPECT_TRUE(set_.Add(INT64_MAX));
+  EXPECT_TRUE(set_.Add(INT64_MIN));
+  EXPECT_FALSE(set_.Add(5));
+  EXPECT_EQ(4, set_.Size());
+  EXPECT_TRUE(set_.Contains(INT64_MIN));
+  EXPECT_TRUE(set_.Contains(INT64_MAX));
+  EXPECT_FALSE(set_.Contains(4));
+  EXPECT_THAT(Members(), testing::ElementsAre(INT64_MIN, -3, 5, INT64_MAX));
+
+  EXPECT_TRUE(set_.Erase(-3));
+  EXPECT_FALSE(set_.Contains(-3));
+  EXPECT_THAT(Members(), testing::ElementsAre(INT64_MIN, 5, INT64_MAX));
+}
+
+TEST_F(PackedIntSetTest, Random) {
+  set<int64_t> expected;
+  mt19937_64 gen(0);
+
+  for (unsigned i = 0; i < 100000; ++i) {
+    // Mostly dense ids with a few outliers.
+    int64_t member = gen() % 16 == 0 ? int64_t(gen()) : int64_t(gen() % 20000);
+    if (gen() % 3 == 0) {
+      ASSERT_EQ(expected.erase(member) > 0, set_.Erase(member)) << i;
+    } else {
+      ASSERT_EQ(expected.insert(member).second, set_.Add(member)) << i;
+    }
+    ASSERT_EQ(expected.size(), set_.Size());
+  }
+
+  for (int64_t member : expected)
+    ASSERT_TRUE(set_.Contains(member));
+  EXPECT_EQ(vector<int64_t>(expected.begin(), expected.end()), Members());
+
+  // Erasing most of the members merges the blocks.
+  size_t used = set_.MallocUsed();
+  while (expected.size() > 100) {
+    ASSERT_TRUE(set_.Erase(*expected.begin()));
+    expected.erase(expected.begin());
+  }
+  EXPECT_LT(set_.MallocUsed(), used / 2);
+  EXPECT_EQ(vector<int64_t>(expected.begin(), expected.end()), Members());
+}
+
+TEST_F(PackedIntSetTest, Dense) {
+  for (int64_t i = 0; i < 10000; ++i)
+    set_.Add(1000000 + i * 3);
+
+  // Offsets within a block take a couple of bytes.
+  EXPECT_LT(set_.MallocUsed(), 10000 * 3);
+}
+
+TEST_F(PackedIntSetTest, Scan) {
+  for (int64_t i = 0; i < 1000; ++i)
+    set_.Add(i);
+
+  // Members that stay in the set are visited exactly once, even if the blocks change.
+  vector<int64_t> visited;
+  uint64_t cursor = 0;
+  unsigned steps = 0;
+  do {
+    cursor = set_.Scan(cursor, [&](int64_t member) { visited.push_back(member); });
+    if (++steps == 3) {
+      for (int64_t i = 0; i < 1000; i += 2)
+        set_.Erase(i);
+      for (int64_t i = 1000; i < 2000; ++i)
+        set_.Add(-i);
+    }
+  } while (cursor);
+
+  set<int64_t> unique(visited.begin(), visited.end());
+  EXPECT_EQ(unique.size(), visited.size());
+  for (int64_t i = 1; i < 1000; i += 2)
+    EXPECT_TRUE(unique.contains(i)) << i;
+}
+
+}  // namespace dfly
@@ -0,0 +1,189 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/packed_string_set.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+#include "core/compact_object.h"
+
+extern "C" {
+#include "redis/zmalloc.h"
+}
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr size_t kMinIndexSize = 8;
+
+}  // namespace
+
+PackedStringSet::PackedStringSet(PMR_NS::memory_resource* mr) : arena_(mr), index_(mr) {
+}
+
+string_view PackedStringSet::MemberAt(uint32_t offset) const {
+  size_t len = arena_[offset] & ~kDeletedBit;
+  return {reinterpret_cast<const char*>(arena_.data()) + offset + 1, len};
+}
+
+size_t PackedStringSet::FindSlot(string_view member, uint64_t hash) const {
+  if (index_.empty())
+    return 0;
+
+  // The index always has empty slots, so the probing terminates.
+  size_t mask = index_.size() - 1;
+  for (size_t pos = hash & mask;; pos = (pos + 1) & mask) {
+    uint32_t slot = index_[pos];
+    if (slot == kEmptySlot)
+      return index_.size();
+    if (slot != kDeletedSlot && MemberAt(slot - 1) == member)
+      return pos;
+  }
+}
+
+void PackedStringSet::InsertSlot(uint32_t offset, uint64_t hash) {
+  size_t mask = index_.size() - 1;
+  size_t pos = hash & mask;
+  while (index_[pos] != kEmptySlot && index_[pos] != kDeletedSlot)
+    pos = (pos + 1) & mask;
+
+  used_slots_ += index_[pos] == kEmptySlot;
+  index_[pos] = offset + 1;
+}
+
+void PackedStringSet::RebuildIndex() {
+  size_t capacity = kMinIndexSize;
+  while (capacity < (size_ + 1) * 2)
+    capacity *= 2;
+
+  // assign() would keep the capacity of a larger index.
+  Index(capacity, kEmptySlot, index_.get_allocator()).swap(index_);
+  used_slots_ = 0;
+
+  for (size_t offset = 0; offset < arena_.size();) {
+    uint8_t header = arena_[offset];
+    if ((header & kDeletedBit) == 0)
+      InsertSlot(offset, CompactObj::HashCode(MemberAt(offset)));
+    offset += (header & ~kDeletedBit) + 1;
+  }
+}
+
+void PackedStringSet::Compact() {
+  size_t dest = 0;
+  for (size_t src = 0; src < arena_.size();) {
+    uint8_t header = arena_[src];
+    size_t record_len = (header & ~kDeletedBit) + 1;
+    if ((header & kDeletedBit) == 0) {
+      if (dest != src)
+        memmove(arena_.data() + dest, arena_.data() + src, record_len);
+      dest += record_len;
+    }
+    src += record_len;
+  }
+
+  arena_.resize(dest);
+  arena_.shrink_to_fit();
+  deleted_bytes_ = 0;
+  if (++epoch_ == 0)  // 0 would make cursors indistinguishable from a new scan.
+    epoch_ = 1;
+
+  RebuildIndex();
+}
+
+bool PackedStringSet::Add(string_view member) {
+  DCHECK_LE(member.size(), kMaxMemberLen);
+
+  uint64_t hash = CompactObj::HashCode(member);
+  if (FindSlot(member, hash) != index_.size())
+    return false;
+
+  if ((used_slots_ + 1) * 4 > index_.size() * 3)
+    RebuildIndex();
+
+  // Grow the arena by a quarter instead of doubling it to keep the slack small.
+  size_t need = arena_.size() + member.size() + 1;
+  DCHECK_LT(need, UINT32_MAX);
+  if (need > arena_.capacity())
+    arena_.reserve(max(need, arena_.capacity() + arena_.capacity() / 4 + 16));
+
+  uint32_t offset = arena_.size();
+  arena_.push_back(member.size());
+  arena_.insert(arena_.end(), member.begin(), member.end());
+  InsertSlot(offset, hash);
+  ++size_;
+
+  return true;
+}
+
+bool PackedStringSet::Erase(string_view member) {
+  size_t pos = FindSlot(member, CompactObj::HashCode(member));
+  if (pos == index_.size())
+    return false;
+
+  arena_[index_[pos] - 1] |= kDeletedBit;
+  index_[pos] = kDeletedSlot;
+  deleted_bytes_ += member.size() + 1;
+  --size_;
+
+  if (deleted_bytes_ * 2 > arena_.size())
+    Compact();
+
+  return true;
+}
+
+bool PackedStringSet::Contains(string_view member) const {
+  return FindSlot(member, CompactObj::HashCode(member)) != index_.size();
+}
+
+bool PackedStringSet::Iterate(absl::FunctionRef<bool(string_view)> cb) const {
+  for (size_t offset = 0; offset < arena_.size();) {
+    uint8_t header = arena_[offset];
+    if ((header & kDeletedBit) == 0 && !cb(MemberAt(offset)))
+      return false;
+    offset += (header & ~kDeletedBit) + 1;
+  }
+  return true;
+}
+
+uint64_t PackedStringSet::Scan(uint64_t cursor, absl::FunctionRef<void(string_view)> cb) const {
+  // Offsets stay valid while the epoch does not change, the arena is only appended to.
+  size_t offset = (cursor >> 32) == epoch_ ? uint32_t(cursor) : 0;
+
+  while (offset < arena_.size()) {
+    uint8_t header = arena_[offset];
+    size_t next = offset + (header & ~kDeletedBit) + 1;
+    if ((header & kDeletedBit) == 0) {
+      cb(MemberAt(offset));
+      return next < arena_.size() ? (uint64_t(epoch_) << 32) | next : 0;
+    }
+    offset = next;
+  }
+
+  return 0;
+}
+
+bool PackedStringSet::DefragIfNeeded(float ratio) {
+  // Offsets do not change, so running scans stay valid.
+  bool moved = false;
+  if (!arena_.empty() && zmalloc_page_is_underutilized(arena_.data(), ratio)) {
+    Arena(arena_, arena_.get_allocator()).swap(arena_);
+    moved = true;
+  }
+  if (!index_.empty() && zmalloc_page_is_underutilized(index_.data(), ratio)) {
+    Index(index_, index_.get_allocator()).swap(index_);
+    moved = true;
+  }
+  return moved;
+}
+
+size_t PackedStringSet::MallocUsed() const {
+  return arena_.capacity() + index_.capacity() * sizeof(uint32_t);
+}
+
+}  // namespace dfly
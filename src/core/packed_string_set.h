@@ -0,0 +1,100 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Compact set of short strings for sets that are too large for an intset but small enough
+// to not justify the per-member overhead of StringSet.
+//
+// Members are stored back to back in a single arena, each prefixed by a one byte header
+// holding its length and a deleted bit. An open-addressing index with linear probing maps
+// member hashes to arena offsets, so besides its bytes a member costs the header and
+// 4 byte index slots at a load factor of at most 3/4. Erased members are only marked as
+// deleted and the arena is compacted once most of it is occupied by them.
+// Members have no expiry.
+class PackedStringSet {
+  PackedStringSet(const PackedStringSet&) = delete;
+  PackedStringSet& operator=(const PackedStringSet&) = delete;
+
+ public:
+  // The length shares the header byte with the deleted bit.
+  static constexpr size_t kMaxMemberLen = 127;
+
+  explicit PackedStringSet(PMR_NS::memory_resource* mr);
+
+  // Returns true if member was added, false if it already exists.
+  // member must not be longer than kMaxMemberLen.
+  bool Add(std::string_view member);
+
+  // Returns true if member was removed.
+  bool Erase(std::string_view member);
+
+  bool Contains(std::string_view member) const;
+
+  size_t Size() const {
+    return size_;
+  }
+
+  bool Empty() const {
+    return size_ == 0;
+  }
+
+  // Calls cb for every member in insertion order until it returns false.
+  // Returns false if the iteration was stopped by cb.
+  bool Iterate(absl::FunctionRef<bool(std::string_view)> cb) const;
+
+  // Calls cb with the first member at or after cursor, 0 for the first call.
+  // Returns the cursor to continue from or 0 when all the members were visited.
+  // Cursors are never below 2^32 so a cursor of another encoding or a cursor that got stale
+  // by compaction restarts the scan. Members that stay in the set for the whole scan are
+  // visited at least once.
+  uint64_t Scan(uint64_t cursor, absl::FunctionRef<void(std::string_view)> cb) const;
+
+  size_t MallocUsed() const;
+
+  // Moves the arena and the index if they are on pages utilized below ratio.
+  // Returns true if anything was reallocated.
+  bool DefragIfNeeded(float ratio);
+
+ private:
+  using Arena = std::vector<uint8_t, PMR_NS::polymorphic_allocator<uint8_t>>;
+  using Index = std::vector<uint32_t, PMR_NS::polymorphic_allocator<uint32_t>>;
+
+  static constexpr uint32_t kEmptySlot = 0;
+  static constexpr uint32_t kDeletedSlot = UINT32_MAX;
+  static constexpr uint8_t kDeletedBit = 0x80;
+
+  // Returns the position of the slot pointing to member or index_.size() if it is missing.
+  size_t FindSlot(std::string_view member, uint64_t hash) const;
+
+  // Stores offset in the first free slot of the probe sequence of hash.
+  void InsertSlot(uint32_t offset, uint64_t hash);
+
+  std::string_view MemberAt(uint32_t offset) const;
+
+  // Rebuilds the index for size_ + 1 members, dropping the deleted slots.
+  void RebuildIndex();
+
+  // Moves the live members to the front of the arena.
+  void Compact();
+
+  Arena arena_;
+  Index index_;  // arena offset + 1 per occupied slot, the size is a power of 2.
+  uint32_t size_ = 0;
+  uint32_t used_slots_ = 0;  // occupied and deleted slots.
+  uint32_t deleted_bytes_ = 0;
+  uint32_t epoch_ = 1;  // changes whenever members move in the arena.
+};
+
+}  // namespace dfly
@@ -0,0 +1,114 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/packed_string_set.h"
+
+#include <absl/container/flat_hash_set.h>
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+
+#include <random>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+using testing::UnorderedElementsAreArray;
+
+class PackedStringSetTest : public ::testing::Test {
+ protected:
+  PackedStringSetTest() : set_(PMR_NS::get_default_resource()) {
+  }
+
+  vector<string> Members() const {
+    vector<string> res;
+    set_.Iterate([&res](string_view member) {
+      res.emplace_back(member);
+      return true;
+    });
+    return res;
+  }
+
+  PackedStringSet set_;
+};
+
+TEST_F(PackedStringSetTest, Basic) {
+  EXPECT_TRUE(set_.Empty());
+  EXPECT_FALSE(set_.Contains("a"));
+  EXPECT_FALSE(set_.Erase("a"));
+
+  EXPECT_TRUE(set_.Add("a"));
+  EXPECT_TRUE(set_.Add(""));
+  EXPECT_TRUE(set_.Add(string(PackedStringSet::kMaxMemberLen, 'x')));
+  EXPECT_FALSE(set_.Add("a"));
+  EXPECT_EQ(3, set_.Size());
+  EXPECT_TRUE(set_.Contains(""));
+  EXPECT_TRUE(set_.Contains(string(PackedStringSet::kMaxMemberLen, 'x')));
+  EXPECT_FALSE(set_.Contains("b"));
+
+  EXPECT_TRUE(set_.Erase("a"));
+  EXPECT_FALSE(set_.Contains("a"));
+  EXPECT_THAT(Members(), testing::ElementsAre("", string(PackedStringSet::kMaxMemberLen, 'x')));
+  EXPECT_TRUE(set_.Add("a"));
+  EXPECT_EQ(3, set_.Size());
+}
+
+TEST_F(PackedStringSetTest, Random) {
+  absl::flat_hash_set<string> expected;
+  mt19937 gen(0);
+
+  for (unsigned i = 0; i < 100000; ++i) {
+    string member = absl::StrCat(gen() % 3000, string(gen() % 40, 'a'));
+    if (gen() % 3 == 0) {
+      ASSERT_EQ(expected.erase(member) > 0, set_.Erase(member)) << i;
+    } else {
+      ASSERT_EQ(expected.insert(member).second, set_.Add(member)) << i;
+    }
+    ASSERT_EQ(expected.size(), set_.Size());
+  }
+
+  for (const auto& member : expected)
+    ASSERT_TRUE(set_.Contains(member));
+  EXPECT_THAT(Members(), UnorderedElementsAreArray(expected.begin(), expected.end()));
+
+  // Erasing most of the members compacts the arena.
+  size_t used = set_.MallocUsed();
+  size_t left = expected.size() / 10;
+  for (auto it = expected.begin(); expected.size() > left;) {
+    ASSERT_TRUE(set_.Erase(*it));
+    expected.erase(it++);
+  }
+  EXPECT_LT(set_.MallocUsed(), used / 2);
+  EXPECT_THAT(Members(), UnorderedElementsAreArray(expected.begin(), expected.end()));
+}
+
+TEST_F(PackedStringSetTest, Scan) {
+  for (unsigned i = 0; i < 100; ++i)
+    set_.Add(absl::StrCat(i));
+
+  // Members that stay in the set are visited even if the arena is compacted during the scan.
+  absl::flat_hash_set<string> visited;
+  uint64_t cursor = 0;
+  unsigned steps = 0;
+  do {
+    cursor = set_.Scan(cursor, [&](string_view member) { visited.emplace(member); });
+    if (cursor)
+      EXPECT_GE(cursor, 1ULL << 32);
+    if (++steps == 50) {
+      for (unsigned i = 0; i < 60; ++i)
+        set_.Erase(absl::StrCat(i));
+    }
+  } while (cursor);
+
+  for (unsigned i = 60; i < 100; ++i)
+    EXPECT_TRUE(visited.contains(absl::StrCat(i))) << i;
+
+  // Cursors of a different encoding restart the scan.
+  visited.clear();
+  set_.Scan(123, [&](string_view member) { visited.emplace(member); });
+  EXPECT_TRUE(visited.contains("60"));
+}
+
+}  // namespace dfly
@@ -42,6 +42,25 @@ void* AllocateScored(string_view field, double value) {
 
 }  // namespace
 
+uint32_t ScoreMap::Defrag(uint32_t cursor, float ratio,
+                          absl::FunctionRef<void(void*, void*)> on_move, bool* moved) {
+  auto realloc_obj = [&](void* obj, bool) -> void* {
+    sds s = (sds)obj;
+    if (!zmalloc_page_is_underutilized(s, ratio))
+      return obj;
+
+    size_t len = sdslen(s);
+    sds new_s = AllocSdsWithSpace(len, sizeof(double));
+    memcpy(new_s, s, len + 1 + sizeof(double));
+    on_move(s, new_s);
+    sdsfree(s);
+    *moved = true;
+    return new_s;
+  };
+
+  return DefragBuckets(cursor, kDefragStepBuckets, ratio, realloc_obj, moved);
+}
+
 ScoreMap::~ScoreMap() {
   Clear();
 }
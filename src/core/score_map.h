@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <absl/functional/function_ref.h>
+
 #include <optional>
 #include <string_view>
 
@@ -109,6 +111,13 @@ class ScoreMap : public DenseSet {
     ClearInternal();
   }
 
+  // Moves the members and links of kDefragStepBuckets buckets starting at cursor that are on
+  // pages utilized below ratio. on_move is called with the old and the new address of every
+  // moved member before the old one is freed. Returns the cursor to continue from or 0 when
+  // done, and sets *moved if anything was reallocated.
+  uint32_t Defrag(uint32_t cursor, float ratio, absl::FunctionRef<void(void*, void*)> on_move,
+                  bool* moved);
+
   iterator begin() {
     return iterator{this, false};
   }
@@ -4,6 +4,8 @@
 
 #include "core/score_map.h"
 
+#include <absl/strings/str_cat.h>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "core/mi_memory_resource.h"
@@ -84,4 +86,21 @@ TEST_F(ScoreMapTest, EmptyFind) {
   EXPECT_EQ(nullopt, sm_->Find("bar"));
 }
 
+static void BM_AddScoreMap(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  unsigned count = state.range(0);
+  vector<string> keys(count);
+  for (unsigned i = 0; i < count; ++i) {
+    keys[i] = absl::StrCat("member:", 100000 + i);
+  }
+
+  while (state.KeepRunning()) {
+    ScoreMap sm;
+    for (unsigned i = 0; i < count; ++i)
+      sm.AddOrUpdate(keys[i], i);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_AddScoreMap)->Arg(1000)->Arg(100000);
+
 }  // namespace dfly
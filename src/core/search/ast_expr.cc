@@ -19,6 +19,9 @@ namespace dfly::search {
 AstTermNode::AstTermNode(string term) : term{term} {
 }
 
+AstPrefixNode::AstPrefixNode(string prefix) : prefix{std::move(prefix)} {
+}
+
 AstRangeNode::AstRangeNode(double lo, bool lo_excl, double hi, bool hi_excl)
     : lo{lo_excl ? nextafter(lo, hi) : lo}, hi{hi_excl ? nextafter(hi, lo) : hi} {
 }
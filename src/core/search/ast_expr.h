@@ -29,6 +29,13 @@ struct AstTermNode {
   std::string term;
 };
 
+// Matches terms starting with a prefix in text fields
+struct AstPrefixNode {
+  AstPrefixNode(std::string prefix);
+
+  std::string prefix;
+};
+
 // Matches numeric range
 struct AstRangeNode {
   AstRangeNode(double lo, bool lo_excl, double hi, bool hi_excl);
@@ -91,14 +98,14 @@ struct AstKnnNode {
 };
 
 struct AstSortNode {
-  std::unique_ptr<AstNode> filter;
+  std::shared_ptr<const AstNode> filter;  // Shared with cached parsed queries
   std::string field;
   bool descending = false;
 };
 
 using NodeVariants =
-    std::variant<std::monostate, AstStarNode, AstTermNode, AstRangeNode, AstNegateNode,
-                 AstLogicalNode, AstFieldNode, AstTagsNode, AstKnnNode, AstSortNode>;
+    std::variant<std::monostate, AstStarNode, AstTermNode, AstPrefixNode, AstRangeNode,
+                 AstNegateNode, AstLogicalNode, AstFieldNode, AstTagsNode, AstKnnNode, AstSortNode>;
 
 struct AstNode : public NodeVariants {
   using variant::variant;
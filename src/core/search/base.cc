@@ -16,6 +16,14 @@ std::string& QueryParams::operator[](std::string_view k) {
   return params[k];
 }
 
+IndexMemoryStats& IndexMemoryStats::operator+=(const IndexMemoryStats& o) {
+  postings_bytes += o.postings_bytes;
+  dictionary_bytes += o.dictionary_bytes;
+  vector_bytes += o.vector_bytes;
+  sort_bytes += o.sort_bytes;
+  return *this;
+}
+
 WrappedStrPtr::WrappedStrPtr(const PMR_NS::string& s)
     : ptr{std::make_unique<char[]>(s.size() + 1)} {
   std::strcpy(ptr.get(), s.c_str());
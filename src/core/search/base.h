@@ -23,6 +23,8 @@ using DocId = uint32_t;
 
 enum class VectorSimilarity { L2, COSINE };
 
+enum class VectorQuantization { NONE, INT8 };
+
 using OwnedFtVector = std::pair<std::unique_ptr<float[]>, size_t /* dimension (size) */>;
 
 // Query params represent named parameters for queries supplied via PARAMS.
@@ -34,6 +36,14 @@ struct QueryParams {
     return params.size();
   }
 
+  auto begin() const {
+    return params.begin();
+  }
+
+  auto end() const {
+    return params.end();
+  }
+
  private:
   absl::flat_hash_map<std::string, std::string> params;
 };
@@ -76,6 +86,20 @@ struct DocumentAccessor {
   virtual VectorInfo GetVector(std::string_view active_field) const = 0;
 };
 
+// Memory used by an index, split by the kind of data
+struct IndexMemoryStats {
+  size_t postings_bytes = 0;    // Document id lists
+  size_t dictionary_bytes = 0;  // Terms, tags and numeric values pointing to the documents
+  size_t vector_bytes = 0;      // Vectors and vector graphs
+  size_t sort_bytes = 0;        // Values of sort indices
+
+  IndexMemoryStats& operator+=(const IndexMemoryStats& o);
+
+  size_t Total() const {
+    return postings_bytes + dictionary_bytes + vector_bytes + sort_bytes;
+  }
+};
+
 // Base class for type-specific indices.
 //
 // Queries should be done directly on subclasses with their distinc
@@ -84,6 +108,9 @@ struct BaseIndex {
   virtual ~BaseIndex() = default;
   virtual void Add(DocId id, DocumentAccessor* doc, std::string_view field) = 0;
   virtual void Remove(DocId id, DocumentAccessor* doc, std::string_view field) = 0;
+
+  // Estimate of the memory allocated by the index
+  virtual IndexMemoryStats GetMemoryStats() const = 0;
 };
 
 // Base class for type-specific sorting indices.
@@ -27,6 +27,47 @@ template <typename C> bool BlockList<C>::Remove(DocId t) {
   return false;
 }
 
+template <typename C> size_t BlockList<C>::MallocUsed() const {
+  size_t used = blocks_.capacity() * sizeof(C);
+  for (const C& block : blocks_)
+    used += block.MallocUsed();
+  return used;
+}
+
+template <typename C> size_t BlockList<C>::Compact() {
+  size_t used_before = MallocUsed();
+
+  // Merged blocks are kept at most half full, so that the next insertions don't split them
+  // again right away.
+  const size_t merged_size = block_size_ / 2;
+
+  bool mergeable = false;
+  size_t unused = (blocks_.capacity() - blocks_.size()) * sizeof(C);
+  for (size_t i = 0; i < blocks_.size(); i++) {
+    mergeable |= i > 0 && blocks_[i - 1].Size() + blocks_[i].Size() <= merged_size;
+    unused += blocks_[i].UnusedBytes();
+  }
+  if (!mergeable && unused * 2 < used_before)
+    return 0;
+
+  // Merge every block into the last kept one while they fit into a single block
+  size_t last = 0;
+  for (size_t i = 1; i < blocks_.size(); i++) {
+    if (blocks_[last].Size() + blocks_[i].Size() <= merged_size)
+      blocks_[last].Merge(std::move(blocks_[i]));
+    else if (++last != i)
+      blocks_[last] = std::move(blocks_[i]);
+  }
+  if (!blocks_.empty())
+    blocks_.erase(blocks_.begin() + last + 1, blocks_.end());
+
+  for (C& block : blocks_)
+    block.ShrinkToFit();
+  blocks_.shrink_to_fit();
+
+  return used_before - MallocUsed();
+}
+
 template <typename C> typename BlockList<C>::BlockIt BlockList<C>::FindBlock(DocId t) {
   DCHECK(blocks_.empty() || blocks_.back().Size() > 0u);
 
@@ -89,6 +130,39 @@ typename BlockList<C>::BlockListIterator& BlockList<C>::BlockListIterator::opera
   return *this;
 }
 
+template <typename C> void BlockList<C>::BlockListIterator::SeekGE(DocId t) {
+  if (it == it_end || **block_it >= t)
+    return;
+
+  // Move to the last block starting not after t, it's the only one that can contain it
+  auto next = std::upper_bound(it + 1, it_end, t,
+                               [](DocId t, const C& block) { return *block.begin() > t; });
+  if (next - 1 != it) {
+    it = next - 1;
+    block_it = it->begin();
+    block_end = it->end();
+  }
+
+  if constexpr (std::is_same_v<C, SortedVector>) {
+    block_it = std::lower_bound(*block_it, *block_end, t);
+  } else {
+    while (*block_it != *block_end && **block_it < t)
+      ++*block_it;
+  }
+
+  // All elements of the block are less than t, so the next block starts after it
+  if (block_it == block_end) {
+    ++it;
+    if (it != it_end) {
+      block_it = it->begin();
+      block_end = it->end();
+    } else {
+      block_it = std::nullopt;
+      block_end = std::nullopt;
+    }
+  }
+}
+
 template class BlockList<CompressedSortedSet>;
 template class BlockList<SortedVector>;
 
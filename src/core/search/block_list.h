@@ -41,6 +41,16 @@ template <typename Container /* underlying container */> class BlockList {
     return size_;
   }
 
+  // Bytes allocated for the blocks and their elements
+  size_t MallocUsed() const;
+
+  // Merge neighbouring blocks that fit into a single one and release unused capacity.
+  // Removals merge only the block they touch, so lists with removals spread over them keep
+  // many small blocks. Lists without mergeable blocks and with less than half of their capacity
+  // unused are left as they are, as growing vectors keep up to that much spare capacity and
+  // shrinking it would only be undone by the next insertions. Returns the number of freed bytes.
+  size_t Compact();
+
   struct BlockListIterator {
     // To make it work with std container contructors
     using iterator_category = std::forward_iterator_tag;
@@ -55,6 +65,10 @@ template <typename Container /* underlying container */> class BlockList {
 
     BlockListIterator& operator++();
 
+    // Advance to the first element not less than t. Blocks that end before t are skipped by
+    // their first elements without being traversed.
+    void SeekGE(DocId t);
+
     friend class BlockList;
 
     bool operator==(const BlockListIterator& other) const {
@@ -113,6 +127,18 @@ struct SortedVector {
     return entries_.size();
   }
 
+  size_t MallocUsed() const {
+    return entries_.capacity() * sizeof(DocId);
+  }
+
+  size_t UnusedBytes() const {
+    return (entries_.capacity() - entries_.size()) * sizeof(DocId);
+  }
+
+  void ShrinkToFit() {
+    entries_.shrink_to_fit();
+  }
+
   using iterator = typename PMR_NS::vector<DocId>::const_iterator;
 
   iterator begin() const {
@@ -103,6 +103,69 @@ TYPED_TEST(BlockListTest, RandomNumbers) {
   }
 }
 
+TYPED_TEST(BlockListTest, SeekGE) {
+  auto list = this->Make();
+  for (DocId i = 0; i < 1000; i++)
+    list.Insert(i * 3);
+
+  for (DocId start : {0u, 100u, 2000u}) {
+    for (DocId t : {0u, 1u, 3u, 150u, 151u, 1500u, 2997u, 2998u}) {
+      auto it = list.begin();
+      while (it != list.end() && *it < start)
+        ++it;
+
+      it.SeekGE(t);
+      if (t > 2997) {
+        EXPECT_TRUE(it == list.end());
+        continue;
+      }
+      ASSERT_TRUE(it != list.end());
+      EXPECT_EQ(*it, max((t + 2) / 3, (start + 2) / 3) * 3) << start << " " << t;
+    }
+  }
+
+  // Iteration continues normally after seeking
+  auto it = list.begin();
+  it.SeekGE(1000);
+  EXPECT_EQ(*it, 1002u);
+  EXPECT_EQ(*++it, 1005u);
+  EXPECT_EQ(vector<DocId>(it, list.end()).size(), 665u);
+}
+
+TYPED_TEST(BlockListTest, Compact) {
+  auto list = this->Make();
+  for (DocId i = 0; i < 1000; i++)
+    list.Insert(i);
+
+  // Leave small blocks by removing most of the elements
+  for (DocId i = 0; i < 1000; i++) {
+    if (i % 7 != 0)
+      list.Remove(i);
+  }
+
+  size_t used = list.MallocUsed();
+  EXPECT_GT(list.Compact(), 0u);
+  EXPECT_LT(list.MallocUsed(), used);
+  EXPECT_EQ(list.Compact(), 0u);  // Nothing left to compact
+
+  // A few insertions don't leave enough unused capacity to compact again
+  list.Insert(1);
+  EXPECT_EQ(list.Compact(), 0u);
+  list.Remove(1);
+
+  vector<DocId> out(list.begin(), list.end());
+  ASSERT_EQ(out.size(), 143u);
+  for (size_t i = 0; i < out.size(); i++)
+    ASSERT_EQ(out[i], i * 7);
+
+  // Blocks are still split and merged after compaction
+  for (DocId i = 0; i < 1000; i++)
+    list.Insert(i);
+  for (DocId i = 0; i < 1000; i += 2)
+    list.Remove(i);
+  EXPECT_EQ(vector<DocId>(list.begin(), list.end()).size(), 500u);
+}
+
 static void BM_Erase90PctTail(benchmark::State& state) {
   BlockList<CompressedSortedSet> bl{PMR_NS::get_default_resource()};
 
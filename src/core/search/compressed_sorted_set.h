@@ -63,6 +63,18 @@ class CompressedSortedSet {
   size_t Size() const;
   size_t ByteSize() const;
 
+  size_t MallocUsed() const {
+    return diffs_.capacity();
+  }
+
+  size_t UnusedBytes() const {
+    return diffs_.capacity() - diffs_.size();
+  }
+
+  void ShrinkToFit() {
+    diffs_.shrink_to_fit();
+  }
+
   // Add all values from other
   void Merge(CompressedSortedSet&& other);
 
@@ -6,6 +6,7 @@
 
 #include <absl/container/flat_hash_set.h>
 #include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
 #include <absl/strings/numbers.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/str_split.h>
@@ -21,8 +22,10 @@
 
 #include <algorithm>
 #include <cctype>
+#include <cmath>
 
 #include "base/logging.h"
+#include "core/search/vector_utils.h"
 
 namespace dfly::search {
 
@@ -63,40 +66,134 @@ absl::flat_hash_set<string> NormalizeTags(string_view taglist, bool case_sensiti
   return tags;
 }
 
+// Bytes allocated outside of the string object itself
+size_t StringMallocUsed(const PMR_NS::string& str) {
+  return str.capacity() > PMR_NS::string{}.capacity() ? str.capacity() + 1 : 0;
+}
+
+// NaN has no place in the order of the values, so it is skipped like any other non numeric value.
+bool ParseNumber(string_view str, double* num) {
+  return absl::SimpleAtod(str, num) && !std::isnan(*num);
+}
+
 };  // namespace
 
-NumericIndex::NumericIndex(PMR_NS::memory_resource* mr) : entries_{mr} {
+NumericIndex::NumericIndex(PMR_NS::memory_resource* mr) : blocks_{mr} {
 }
 
 void NumericIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
   for (auto str : doc->GetStrings(field)) {
     double num;
-    if (absl::SimpleAtod(str, &num))
-      entries_.emplace(num, id);
+    if (ParseNumber(str, &num))
+      Insert({num, id});
   }
 }
 
 void NumericIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
   for (auto str : doc->GetStrings(field)) {
     double num;
-    if (absl::SimpleAtod(str, &num))
-      entries_.erase({num, id});
+    if (ParseNumber(str, &num))
+      Erase({num, id});
   }
 }
 
-vector<DocId> NumericIndex::Range(double l, double r) const {
-  auto it_l = entries_.lower_bound({l, 0});
-  auto it_r = entries_.lower_bound({r, numeric_limits<DocId>::max()});
+IndexMemoryStats NumericIndex::GetMemoryStats() const {
+  IndexMemoryStats stats;
+  stats.dictionary_bytes = blocks_.capacity() * sizeof(Block);
+  for (const Block& block : blocks_) {
+    stats.dictionary_bytes += block.values.capacity() * sizeof(double);
+    stats.postings_bytes += block.ids.capacity() * sizeof(DocId);
+  }
+  return stats;
+}
 
+vector<DocId> NumericIndex::Range(double l, double r) const {
   vector<DocId> out;
-  for (auto it = it_l; it != it_r; ++it)
-    out.push_back(it->second);
+  for (auto block = FindBlock({l, 0}); block != blocks_.end(); ++block) {
+    auto value_it = block->values.begin() + block->LowerBound({l, 0});
+    auto value_end = upper_bound(value_it, block->values.end(), r);
+    auto id_it = block->ids.begin() + (value_it - block->values.begin());
+    out.insert(out.end(), id_it, id_it + (value_end - value_it));
+
+    if (value_end != block->values.end())
+      break;
+  }
 
   sort(out.begin(), out.end());
   out.erase(unique(out.begin(), out.end()), out.end());
   return out;
 }
 
+size_t NumericIndex::Block::LowerBound(const Entry& e) const {
+  size_t lo = 0, hi = Size();
+  while (lo < hi) {
+    size_t mid = (lo + hi) / 2;
+    if (At(mid) < e)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+NumericIndex::ConstBlockIt NumericIndex::FindBlock(const Entry& e) const {
+  return partition_point(blocks_.begin(), blocks_.end(),
+                         [&e](const Block& block) { return block.At(block.Size() - 1) < e; });
+}
+
+void NumericIndex::Insert(const Entry& e) {
+  if (blocks_.empty())
+    blocks_.emplace_back(blocks_.get_allocator().resource());
+
+  // Entries greater than all others are appended to the last block
+  BlockIt block = prev(blocks_.end());
+  if (block->Size() > 0 && block->At(block->Size() - 1) >= e)
+    block = blocks_.begin() + (FindBlock(e) - blocks_.cbegin());
+
+  size_t pos = block->LowerBound(e);
+  if (pos < block->Size() && block->At(pos) == e)
+    return;
+
+  block->values.insert(block->values.begin() + pos, e.first);
+  block->ids.insert(block->ids.begin() + pos, e.second);
+
+  // Split into two halves
+  if (block->Size() > kBlockSize * 2) {
+    Block tail{blocks_.get_allocator().resource()};
+    tail.values.assign(block->values.begin() + kBlockSize, block->values.end());
+    tail.ids.assign(block->ids.begin() + kBlockSize, block->ids.end());
+    block->values.resize(kBlockSize);
+    block->ids.resize(kBlockSize);
+    blocks_.insert(block + 1, std::move(tail));
+  }
+}
+
+void NumericIndex::Erase(const Entry& e) {
+  BlockIt block = blocks_.begin() + (FindBlock(e) - blocks_.cbegin());
+  if (block == blocks_.end())
+    return;
+
+  size_t pos = block->LowerBound(e);
+  if (pos == block->Size() || block->At(pos) != e)
+    return;
+
+  block->values.erase(block->values.begin() + pos);
+  block->ids.erase(block->ids.begin() + pos);
+
+  if (block->Size() == 0) {
+    blocks_.erase(block);
+    return;
+  }
+
+  // Merge with the next block if both fit into one
+  if (auto next = block + 1; block->Size() < kBlockSize / 2 && next != blocks_.end() &&
+                             block->Size() + next->Size() <= kBlockSize * 2) {
+    block->values.insert(block->values.end(), next->values.begin(), next->values.end());
+    block->ids.insert(block->ids.end(), next->ids.begin(), next->ids.end());
+    blocks_.erase(next);
+  }
+}
+
 template <typename C>
 BaseStringIndex<C>::BaseStringIndex(PMR_NS::memory_resource* mr, bool case_sensitive)
     : case_sensitive_{case_sensitive}, entries_{mr} {
@@ -116,6 +213,22 @@ const typename BaseStringIndex<C>::Container* BaseStringIndex<C>::Matching(strin
   return (it != entries_.end()) ? &it->second : nullptr;
 }
 
+template <typename C>
+vector<const typename BaseStringIndex<C>::Container*> BaseStringIndex<C>::MatchingPrefix(
+    string_view prefix) const {
+  string tmp;
+  if (!case_sensitive_) {
+    tmp = ToLower(prefix);
+    prefix = tmp;
+  }
+
+  vector<const Container*> out;
+  for (auto it = entries_.lower_bound(prefix);
+       it != entries_.end() && absl::StartsWith(it->first, prefix); ++it)
+    out.push_back(&it->second);
+  return out;
+}
+
 template <typename C>
 typename BaseStringIndex<C>::Container* BaseStringIndex<C>::GetOrCreate(string_view word) {
   auto* mr = entries_.get_allocator().resource();
@@ -149,6 +262,30 @@ void BaseStringIndex<C>::Remove(DocId id, DocumentAccessor* doc, string_view fie
   }
 }
 
+template <typename C> IndexMemoryStats BaseStringIndex<C>::GetMemoryStats() const {
+  // Node overhead of the btree is not accounted
+  IndexMemoryStats stats;
+  stats.dictionary_bytes = entries_.size() * sizeof(typename decltype(entries_)::value_type);
+  for (const auto& [term, container] : entries_) {
+    stats.dictionary_bytes += StringMallocUsed(term);
+    stats.postings_bytes += container.MallocUsed();
+  }
+  return stats;
+}
+
+template <typename C> size_t BaseStringIndex<C>::Compact(size_t max_terms) {
+  size_t freed = 0;
+  auto it = entries_.lower_bound(string_view{compact_cursor_});
+  for (; it != entries_.end() && max_terms > 0; ++it, --max_terms)
+    freed += it->second.Compact();
+
+  if (it != entries_.end())
+    compact_cursor_.assign(it->first.data(), it->first.size());
+  else
+    compact_cursor_.clear();
+  return freed;
+}
+
 template struct BaseStringIndex<CompressedSortedSet>;
 template struct BaseStringIndex<SortedVector>;
 
@@ -169,48 +306,146 @@ std::pair<size_t /*dim*/, VectorSimilarity> BaseVectorIndex::Info() const {
 
 FlatVectorIndex::FlatVectorIndex(const SchemaField::VectorParams& params,
                                  PMR_NS::memory_resource* mr)
-    : BaseVectorIndex{params.dim, params.sim}, entries_{mr} {
+    : BaseVectorIndex{params.dim, params.sim},
+      quantized_{params.quantization == VectorQuantization::INT8},
+      entries_{mr},
+      codes_{mr},
+      scales_{mr},
+      norms_{mr} {
   DCHECK(!params.use_hnsw);
-  entries_.reserve(params.capacity * params.dim);
+  if (quantized_) {
+    codes_.reserve(params.capacity * params.dim);
+    scales_.reserve(params.capacity);
+  } else {
+    entries_.reserve(params.capacity * params.dim);
+  }
+  if (sim_ == VectorSimilarity::COSINE)
+    norms_.reserve(params.capacity);
 }
 
 void FlatVectorIndex::Add(DocId id, DocumentAccessor* doc, string_view field) {
-  DCHECK_LE(id * dim_, entries_.size());
-  if (id * dim_ == entries_.size())
-    entries_.resize((id + 1) * dim_);
+  DCHECK_LE(id, NumSlots());
+  if (id == NumSlots()) {
+    if (quantized_) {
+      codes_.resize((id + 1) * dim_);
+      scales_.resize(id + 1);
+    } else {
+      entries_.resize((id + 1) * dim_);
+    }
+    if (sim_ == VectorSimilarity::COSINE)
+      norms_.resize(id + 1);
+  }
 
   // TODO: Let get vector write to buf itself
   auto [ptr, size] = doc->GetVector(field);
+  if (size != dim_)
+    return;
 
-  if (size == dim_)
+  if (quantized_)
+    scales_[id] = QuantizeVector(ptr.get(), dim_, &codes_[id * dim_]);
+  else
     memcpy(&entries_[id * dim_], ptr.get(), dim_ * sizeof(float));
+
+  if (sim_ == VectorSimilarity::COSINE) {
+    norms_[id] =
+        quantized_ ? VectorNorm(&codes_[id * dim_], dim_) : VectorNorm(&entries_[id * dim_], dim_);
+  }
 }
 
 void FlatVectorIndex::Remove(DocId id, DocumentAccessor* doc, string_view field) {
   // noop
 }
 
-const float* FlatVectorIndex::Get(DocId doc) const {
-  return &entries_[doc * dim_];
+IndexMemoryStats FlatVectorIndex::GetMemoryStats() const {
+  IndexMemoryStats stats;
+  stats.vector_bytes = entries_.capacity() * sizeof(float) + codes_.capacity() * sizeof(int8_t) +
+                       (scales_.capacity() + norms_.capacity()) * sizeof(float);
+  return stats;
 }
 
+float FlatVectorIndex::Distance(const float* target, float target_norm, DocId doc) const {
+  if (sim_ == VectorSimilarity::COSINE) {
+    if (quantized_)
+      return CosineDistanceByNorms(target, target_norm, &codes_[doc * dim_], norms_[doc], dim_);
+    return CosineDistanceByNorms(target, target_norm, &entries_[doc * dim_], norms_[doc], dim_);
+  }
+
+  if (quantized_)
+    return QuantizedVectorDistance(target, &codes_[doc * dim_], scales_[doc], dim_, sim_);
+  return VectorDistance(target, &entries_[doc * dim_], dim_, sim_);
+}
+
+size_t FlatVectorIndex::NumSlots() const {
+  return quantized_ ? scales_.size() : entries_.size() / dim_;
+}
+
+// hnswlib space over int8 quantized vectors, every point is stored as its scale followed by
+// the codes. Cuts the memory of the stored points by almost 4x.
+class Int8Space : public hnswlib::SpaceInterface<float> {
+ public:
+  Int8Space(size_t dim, VectorSimilarity sim) : param_{dim, sim} {
+  }
+
+  size_t get_data_size() override {
+    return sizeof(float) + param_.dim;
+  }
+
+  hnswlib::DISTFUNC<float> get_dist_func() override {
+    return &Distance;
+  }
+
+  void* get_dist_func_param() override {
+    return &param_;
+  }
+
+  // Writes the point for v to dest, which must hold get_data_size() bytes
+  void Quantize(const float* v, char* dest) const {
+    float scale = QuantizeVector(v, param_.dim, reinterpret_cast<int8_t*>(dest + sizeof(float)));
+    memcpy(dest, &scale, sizeof(float));
+  }
+
+ private:
+  struct Param {
+    size_t dim;
+    VectorSimilarity sim;
+  };
+
+  static float Distance(const void* u, const void* v, const void* param_ptr) {
+    const auto* param = static_cast<const Param*>(param_ptr);
+    const char* u_data = static_cast<const char*>(u);
+    const char* v_data = static_cast<const char*>(v);
+
+    // Points are not aligned within hnswlib storage
+    float u_scale, v_scale;
+    memcpy(&u_scale, u_data, sizeof(float));
+    memcpy(&v_scale, v_data, sizeof(float));
+
+    return QuantizedVectorDistance(reinterpret_cast<const int8_t*>(u_data + sizeof(float)),
+                                   u_scale,
+                                   reinterpret_cast<const int8_t*>(v_data + sizeof(float)),
+                                   v_scale, param->dim, param->sim);
+  }
+
+  Param param_;
+};
+
 struct HnswlibAdapter {
   // Default setting of hnswlib/hnswalg
   constexpr static size_t kDefaultEfRuntime = 10;
 
   HnswlibAdapter(const SchemaField::VectorParams& params)
-      : space_{MakeSpace(params.dim, params.sim)}, world_{GetSpacePtr(),
-                                                          params.capacity,
-                                                          params.hnsw_m,
-                                                          params.hnsw_ef_construction,
-                                                          100 /* seed*/,
-                                                          true} {
+      : space_{MakeSpace(params)}, world_{GetSpacePtr(),
+                                          params.capacity,
+                                          params.hnsw_m,
+                                          params.hnsw_ef_construction,
+                                          100 /* seed*/,
+                                          true} {
   }
 
   void Add(float* data, DocId id) {
     if (world_.cur_element_count + 1 >= world_.max_elements_)
       world_.resizeIndex(world_.cur_element_count * 2);
-    world_.addPoint(data, id);
+    world_.addPoint(ToPoint(data).data, id);
   }
 
   void Remove(DocId id) {
@@ -219,40 +454,101 @@ struct HnswlibAdapter {
 
   vector<pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef) {
     world_.setEf(ef.value_or(kDefaultEfRuntime));
-    return QueueToVec(world_.searchKnn(target, k));
+    return QueueToVec(world_.searchKnn(ToPoint(target).data, k));
+  }
+
+  // Memory allocated by hnswlib, it doesn't use the memory resource
+  size_t MallocUsed() const {
+    // Every slot has level 0 links with the point, a pointer to upper links and its level
+    size_t used =
+        world_.max_elements_ * (world_.size_data_per_element_ + sizeof(void*) + sizeof(int));
+    for (size_t i = 0; i < world_.cur_element_count; i++)
+      used += world_.element_levels_[i] * world_.size_links_per_element_;
+    return used + world_.label_lookup_.size() *
+                      (sizeof(hnswlib::labeltype) + sizeof(hnswlib::tableint) + sizeof(void*));
   }
 
+  // allowed is sorted. Filtered search skips points that are not allowed, so reaching ef
+  // allowed points takes about ef * M / selectivity distance computations. A brute force scan
+  // over the allowed points is cheaper for selective filters.
   vector<pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef,
                                  const vector<DocId>& allowed) {
-    struct BinsearchFilter : hnswlib::BaseFilterFunctor {
+    struct BitsetFilter : hnswlib::BaseFilterFunctor {
       virtual bool operator()(hnswlib::labeltype id) {
-        return binary_search(allowed->begin(), allowed->end(), id);
+        return id < allowed->size() && (*allowed)[id];
       }
 
-      BinsearchFilter(const vector<DocId>* allowed) : allowed{allowed} {
+      BitsetFilter(const vector<bool>* allowed) : allowed{allowed} {
       }
-      const vector<DocId>* allowed;
+      const vector<bool>* allowed;
     };
 
-    world_.setEf(ef.value_or(kDefaultEfRuntime));
-    BinsearchFilter filter{&allowed};
-    return QueueToVec(world_.searchKnn(target, k, &filter));
+    Point point = ToPoint(target);
+    size_t ef_value = max(ef.value_or(kDefaultEfRuntime), k);
+    if (allowed.size() * allowed.size() <= ef_value * world_.M_ * world_.cur_element_count)
+      return BruteForceKnn(point.data, k, allowed);
+
+    vector<bool> bitset(allowed.empty() ? 0 : allowed.back() + 1);
+    for (DocId id : allowed)
+      bitset[id] = true;
+
+    world_.setEf(ef_value);
+    BitsetFilter filter{&bitset};
+    return QueueToVec(world_.searchKnn(point.data, k, &filter));
   }
 
  private:
-  using SpaceUnion = std::variant<hnswlib::L2Space, hnswlib::InnerProductSpace>;
-
-  static SpaceUnion MakeSpace(size_t dim, VectorSimilarity sim) {
-    if (sim == VectorSimilarity::L2)
-      return hnswlib::L2Space{dim};
+  using SpaceUnion = std::variant<hnswlib::L2Space, hnswlib::InnerProductSpace, Int8Space>;
+
+  // Vector in the format of the space, quantized vectors are kept in buf.
+  struct Point {
+    const void* data;
+    std::unique_ptr<char[]> buf;
+  };
+
+  static SpaceUnion MakeSpace(const SchemaField::VectorParams& params) {
+    if (params.quantization == VectorQuantization::INT8)
+      return SpaceUnion{std::in_place_type<Int8Space>, params.dim, params.sim};
+    if (params.sim == VectorSimilarity::L2)
+      return hnswlib::L2Space{params.dim};
     else
-      return hnswlib::InnerProductSpace{dim};
+      return hnswlib::InnerProductSpace{params.dim};
+  }
+
+  Point ToPoint(const float* vec) {
+    auto* int8_space = get_if<Int8Space>(&space_);
+    if (!int8_space)
+      return {vec, nullptr};
+
+    auto buf = make_unique<char[]>(int8_space->get_data_size());
+    int8_space->Quantize(vec, buf.get());
+    return {buf.get(), std::move(buf)};
   }
 
   hnswlib::SpaceInterface<float>* GetSpacePtr() {
     return visit([](auto& space) -> hnswlib::SpaceInterface<float>* { return &space; }, space_);
   }
 
+  // Exact k nearest allowed points.
+  vector<pair<float, DocId>> BruteForceKnn(const void* target, size_t k,
+                                           const vector<DocId>& allowed) {
+    vector<pair<float, DocId>> out;
+    out.reserve(allowed.size());
+    for (DocId id : allowed) {
+      auto it = world_.label_lookup_.find(id);
+      if (it == world_.label_lookup_.end() || world_.isMarkedDeleted(it->second))
+        continue;
+
+      const char* data = world_.getDataByInternalId(it->second);
+      out.emplace_back(world_.fstdistfunc_(target, data, world_.dist_func_param_), id);
+    }
+
+    size_t prefix_size = min(k, out.size());
+    partial_sort(out.begin(), out.begin() + prefix_size, out.end());
+    out.resize(prefix_size);
+    return out;
+  }
+
   template <typename Q> static vector<pair<float, DocId>> QueueToVec(Q queue) {
     vector<pair<float, DocId>> out(queue.size());
     size_t idx = out.size();
@@ -296,4 +592,10 @@ void HnswVectorIndex::Remove(DocId id, DocumentAccessor* doc, string_view field)
   adapter_->Remove(id);
 }
 
+IndexMemoryStats HnswVectorIndex::GetMemoryStats() const {
+  IndexMemoryStats stats;
+  stats.vector_bytes = adapter_->MallocUsed();
+  return stats;
+}
+
 }  // namespace dfly::search
@@ -2,7 +2,7 @@
 // See LICENSE for licensing terms.
 //
 
-#include <absl/container/btree_set.h>
+#include <absl/container/btree_map.h>
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/flat_hash_set.h>
 
@@ -23,17 +23,53 @@ namespace dfly::search {
 
 // Index for integer fields.
 // Range bounds are queried in logarithmic time, iteration is constant.
+//
+// Entries are kept sorted by (value, id) in a list of blocks with sizes in the range
+// [kBlockSize / 2, kBlockSize * 2]. Blocks store values and ids in separate arrays, so an entry
+// takes 12 bytes without any per entry node overhead.
 struct NumericIndex : public BaseIndex {
   explicit NumericIndex(PMR_NS::memory_resource* mr);
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  IndexMemoryStats GetMemoryStats() const override;
 
   std::vector<DocId> Range(double l, double r) const;
 
  private:
   using Entry = std::pair<double, DocId>;
-  absl::btree_set<Entry, std::less<Entry>, PMR_NS::polymorphic_allocator<Entry>> entries_;
+
+  static constexpr size_t kBlockSize = 512;
+
+  struct Block {
+    explicit Block(PMR_NS::memory_resource* mr) : values{mr}, ids{mr} {
+    }
+
+    size_t Size() const {
+      return ids.size();
+    }
+
+    Entry At(size_t pos) const {
+      return {values[pos], ids[pos]};
+    }
+
+    // Position of the first entry not less than e
+    size_t LowerBound(const Entry& e) const;
+
+    PMR_NS::vector<double> values;
+    PMR_NS::vector<DocId> ids;
+  };
+
+  using BlockIt = PMR_NS::vector<Block>::iterator;
+  using ConstBlockIt = PMR_NS::vector<Block>::const_iterator;
+
+  // First block with its last entry not less than e, end() if there is none.
+  ConstBlockIt FindBlock(const Entry& e) const;
+
+  void Insert(const Entry& e);
+  void Erase(const Entry& e);
+
+  PMR_NS::vector<Block> blocks_;
 };
 
 // Base index for string based indices.
@@ -44,6 +80,16 @@ template <typename C> struct BaseStringIndex : public BaseIndex {
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  IndexMemoryStats GetMemoryStats() const override;
+
+  // Compact the posting lists of up to max_terms terms, continuing from where the previous call
+  // stopped and starting over after the last term. Returns the number of freed bytes.
+  size_t Compact(size_t max_terms);
+
+  // Whether Compact stopped in the middle of the terms
+  bool CompactionInProgress() const {
+    return !compact_cursor_.empty();
+  }
 
   // Used by Add & Remove to tokenize text value
   virtual absl::flat_hash_set<std::string> Tokenize(std::string_view value) const = 0;
@@ -51,38 +97,23 @@ template <typename C> struct BaseStringIndex : public BaseIndex {
   // Pointer is valid as long as index is not mutated. Nullptr if not found
   const Container* Matching(std::string_view str) const;
 
+  // Containers of all words starting with prefix, same validity as for Matching
+  std::vector<const Container*> MatchingPrefix(std::string_view prefix) const;
+
  protected:
   Container* GetOrCreate(std::string_view word);
 
-  struct PmrEqual {
-    using is_transparent = void;
-    bool operator()(const PMR_NS::string& lhs, const PMR_NS::string& rhs) const {
-      return lhs == rhs;
-    }
-    bool operator()(const PMR_NS::string& lhs, const std::string_view& rhs) const {
-      return lhs == rhs;
-    }
-  };
-
-  struct PmrHash {
-    using is_transparent = void;
-    size_t operator()(const std::string_view& sv) const {
-      return absl::Hash<std::string_view>()(sv);
-    }
-    size_t operator()(const PMR_NS::string& pmrs) const {
-      return operator()(std::string_view{pmrs.data(), pmrs.size()});
-    }
-  };
-
   bool case_sensitive_ = false;
+  std::string compact_cursor_;  // First term to compact in the next call to Compact()
 
-  absl::flat_hash_map<PMR_NS::string, Container, PmrHash, PmrEqual,
-                      PMR_NS::polymorphic_allocator<std::pair<PMR_NS::string, Container>>>
+  // Sorted by word for prefix lookups
+  absl::btree_map<PMR_NS::string, Container, std::less<>,
+                  PMR_NS::polymorphic_allocator<std::pair<const PMR_NS::string, Container>>>
       entries_;
 };
 
 // Index for text fields.
-// Hashmap based lookup per word.
+// Sorted map based lookup per word.
 struct TextIndex : public BaseStringIndex<CompressedSortedSet> {
   TextIndex(PMR_NS::memory_resource* mr) : BaseStringIndex(mr, false) {
   }
@@ -90,8 +121,8 @@ struct TextIndex : public BaseStringIndex<CompressedSortedSet> {
   absl::flat_hash_set<std::string> Tokenize(std::string_view value) const override;
 };
 
-// Index for text fields.
-// Hashmap based lookup per word.
+// Index for tag fields.
+// Sorted map based lookup per tag.
 struct TagIndex : public BaseStringIndex<SortedVector> {
   TagIndex(PMR_NS::memory_resource* mr, SchemaField::TagParams params)
       : BaseStringIndex(mr, params.case_sensitive), separator_{params.separator} {
@@ -120,11 +151,23 @@ struct FlatVectorIndex : public BaseVectorIndex {
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  IndexMemoryStats GetMemoryStats() const override;
 
-  const float* Get(DocId doc) const;
+  // Distance from target to the vector of doc. target_norm is the norm of target, used by
+  // COSINE to compute only the dot product with the stored norm of the vector.
+  float Distance(const float* target, float target_norm, DocId doc) const;
 
  private:
-  PMR_NS::vector<float> entries_;
+  size_t NumSlots() const;  // Number of document ids with allocated vectors
+
+  bool quantized_;
+  PMR_NS::vector<float> entries_;  // dim_ floats per document if not quantized
+
+  // dim_ int8 codes and a scale per document if quantized
+  PMR_NS::vector<int8_t> codes_;
+  PMR_NS::vector<float> scales_;
+
+  PMR_NS::vector<float> norms_;  // norm of every vector (or its codes) if COSINE is used
 };
 
 struct HnswlibAdapter;
@@ -135,6 +178,7 @@ struct HnswVectorIndex : public BaseVectorIndex {
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  IndexMemoryStats GetMemoryStats() const override;
 
   std::vector<std::pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef) const;
   std::vector<std::pair<float, DocId>> Knn(float* target, size_t k, std::optional<size_t> ef,
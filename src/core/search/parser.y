@@ -66,7 +66,7 @@ using namespace std;
 
 // Needed 0 at the end to satisfy bison 3.5.1
 %token YYEOF 0
-%token <std::string> TERM "term" PARAM "param" FIELD "field"
+%token <std::string> TERM "term" PARAM "param" FIELD "field" PREFIX "prefix"
 
 %precedence TERM
 %left OR_OP
@@ -128,11 +128,13 @@ search_unary_expr:
   LPAREN search_expr RPAREN           { $$ = std::move($2); }
   | NOT_OP search_unary_expr          { $$ = AstNegateNode(std::move($2)); }
   | TERM                              { $$ = AstTermNode(std::move($1)); }
+  | PREFIX                            { $$ = AstPrefixNode(std::move($1)); }
   | UINT32                            { $$ = AstTermNode(to_string($1)); }
   | FIELD COLON field_cond            { $$ = AstFieldNode(std::move($1), std::move($3)); }
 
 field_cond:
   TERM                                                  { $$ = AstTermNode(std::move($1)); }
+  | PREFIX                                              { $$ = AstPrefixNode(std::move($1)); }
   | UINT32                                              { $$ = AstTermNode(to_string($1)); }
   | NOT_OP field_cond                                   { $$ = AstNegateNode(std::move($2)); }
   | LPAREN field_cond_expr RPAREN                       { $$ = std::move($2); }
@@ -167,6 +169,7 @@ field_unary_expr:
   LPAREN field_cond_expr RPAREN                  { $$ = std::move($2); }
   | NOT_OP field_unary_expr                      { $$ = AstNegateNode(std::move($2)); };
   | TERM                                         { $$ = AstTermNode(std::move($1)); }
+  | PREFIX                                       { $$ = AstPrefixNode(std::move($1)); }
   | UINT32                                       { $$ = AstTermNode(to_string($1)); }
 
 tag_list:
@@ -113,11 +113,50 @@ struct IndexResult {
       value_;
 };
 
+// Intersections seek in the larger set if it's this many times larger than the other one
+constexpr size_t kSeekRatio = 16;
+
+// Advance it to the first element not less than t. Gallops with growing steps, so that
+// skipping n elements takes O(log n) comparisons.
+void SeekGE(vector<DocId>::const_iterator* it, vector<DocId>::const_iterator end, DocId t) {
+  auto lo = *it;
+  if (lo == end || *lo >= t)
+    return;
+
+  size_t step = 1;
+  while (step < size_t(end - lo) && lo[step] < t) {
+    lo += step;
+    step *= 2;
+  }
+  *it = lower_bound(lo + 1, lo + min(step, size_t(end - lo)), t);
+}
+
+template <typename It, typename End> void SeekGE(It* it, End end, DocId t) {
+  if (*it != end)
+    it->SeekGE(t);
+}
+
+// Intersect small with a much larger set by seeking in it for every element of small
+// instead of traversing it fully.
+template <typename S, typename L> void IntersectBySeek(const S& small, const L& large,
+                                                       vector<DocId>* out) {
+  auto it = large.begin();
+  auto end = large.end();
+  for (DocId t : small) {
+    SeekGE(&it, end, t);
+    if (it == end)
+      break;
+    if (*it == t)
+      out->push_back(t);
+  }
+}
+
 struct ProfileBuilder {
   string GetNodeInfo(const AstNode& node) {
     Overloaded node_info{
         [](monostate) -> string { return ""s; },
         [](const AstTermNode& n) { return absl::StrCat("Term{", n.term, "}"); },
+        [](const AstPrefixNode& n) { return absl::StrCat("Prefix{", n.prefix, "}"); },
         [](const AstRangeNode& n) { return absl::StrCat("Range{", n.lo, "<>", n.hi, "}"); },
         [](const AstLogicalNode& n) {
           auto op = n.op == AstLogicalNode::AND ? "and" : "or";
@@ -215,7 +254,14 @@ struct BasicSearch {
     if (op == LogicOp::AND) {
       tmp_vec_.reserve(min(matched.Size(), current.Size()));
       auto cb = [this](auto* s1, auto* s2) {
-        set_intersection(s1->begin(), s1->end(), s2->begin(), s2->end(), back_inserter(tmp_vec_));
+        // Sets of very different sizes are intersected by seeking in the larger one
+        if (s1->size() * kSeekRatio < s2->size())
+          IntersectBySeek(*s1, *s2, &tmp_vec_);
+        else if (s2->size() * kSeekRatio < s1->size())
+          IntersectBySeek(*s2, *s1, &tmp_vec_);
+        else
+          set_intersection(s1->begin(), s1->end(), s2->begin(), s2->end(),
+                           back_inserter(tmp_vec_));
       };
       visit(cb, matched.Borrowed(), current.Borrowed());
     } else {
@@ -269,6 +315,27 @@ struct BasicSearch {
     return UnifyResults(GetSubResults(selected_indices, mapping), LogicOp::OR);
   }
 
+  // "pre*": unify results of all words with the prefix in the field's text index or in all text
+  // indices if no field is set
+  IndexResult Search(const AstPrefixNode& node, string_view active_field) {
+    vector<TextIndex*> selected_indices;
+    if (!active_field.empty()) {
+      auto* index = GetIndex<TextIndex>(active_field);
+      if (!index)
+        return IndexResult{};
+      selected_indices.push_back(index);
+    } else {
+      selected_indices = indices_->GetAllTextIndices();
+    }
+
+    vector<IndexResult> sub_results;
+    for (TextIndex* index : selected_indices) {
+      for (const auto* container : index->MatchingPrefix(node.prefix))
+        sub_results.emplace_back(container);
+    }
+    return UnifyResults(std::move(sub_results), LogicOp::OR);
+  }
+
   // [range]: access field's numeric index
   IndexResult Search(const AstRangeNode& node, string_view active_field) {
     DCHECK(!active_field.empty());
@@ -336,10 +403,11 @@ struct BasicSearch {
 
   void SearchKnnFlat(FlatVectorIndex* vec_index, const AstKnnNode& knn, IndexResult&& sub_results) {
     knn_distances_.reserve(sub_results.Size());
+    const float* target = knn.vec.first.get();
+    float target_norm = VectorNorm(target, knn.vec.second);
     auto cb = [&](auto* set) {
-      auto [dim, sim] = vec_index->Info();
       for (DocId matched_doc : *set) {
-        float dist = VectorDistance(knn.vec.first.get(), vec_index->Get(matched_doc), dim, sim);
+        float dist = vec_index->Distance(target, target_norm, matched_doc);
         knn_distances_.emplace_back(dist, matched_doc);
       }
     };
@@ -572,29 +640,67 @@ vector<pair<string, SortableValue>> FieldIndices::ExtractStoredValues(DocId doc)
   return out;
 }
 
+absl::flat_hash_map<string, IndexMemoryStats> FieldIndices::GetMemoryStats() const {
+  absl::flat_hash_map<string, IndexMemoryStats> out;
+  for (const auto& [ident, index] : indices_)
+    out[ident] += index->GetMemoryStats();
+  for (const auto& [ident, index] : sort_indices_)
+    out[ident] += index->GetMemoryStats();
+  return out;
+}
+
+size_t FieldIndices::Compact(size_t max_terms) {
+  size_t freed = 0;
+  for (auto& [ident, index] : indices_) {
+    if (auto* text_index = dynamic_cast<TextIndex*>(index.get()); text_index)
+      freed += text_index->Compact(max_terms);
+    else if (auto* tag_index = dynamic_cast<TagIndex*>(index.get()); tag_index)
+      freed += tag_index->Compact(max_terms);
+  }
+  return freed;
+}
+
+bool FieldIndices::CompactionInProgress() const {
+  for (const auto& [ident, index] : indices_) {
+    if (auto* text_index = dynamic_cast<const TextIndex*>(index.get()); text_index)
+      if (text_index->CompactionInProgress())
+        return true;
+    if (auto* tag_index = dynamic_cast<const TagIndex*>(index.get()); tag_index)
+      if (tag_index->CompactionInProgress())
+        return true;
+  }
+  return false;
+}
+
 SearchAlgorithm::SearchAlgorithm() = default;
 SearchAlgorithm::~SearchAlgorithm() = default;
 
 bool SearchAlgorithm::Init(string_view query, const QueryParams* params, const SortOption* sort) {
-  try {
-    query_ = make_unique<AstExpr>(ParseQuery(query, params));
-  } catch (const Parser::syntax_error& se) {
-    LOG(INFO) << "Failed to parse query \"" << query << "\":" << se.what();
-    return false;
-  } catch (...) {
-    LOG(INFO) << "Unexpected query parser error";
-    return false;
-  }
+  return Init(Parse(query, params), sort);
+}
 
-  if (holds_alternative<monostate>(*query_))
+bool SearchAlgorithm::Init(shared_ptr<const AstNode> query, const SortOption* sort) {
+  if (!query || holds_alternative<monostate>(*query))
     return false;
 
+  query_ = std::move(query);
   if (sort != nullptr)
-    query_ = make_unique<AstNode>(AstSortNode{std::move(query_), sort->field, sort->descending});
+    query_ = make_shared<AstNode>(AstSortNode{std::move(query_), sort->field, sort->descending});
 
   return true;
 }
 
+shared_ptr<const AstNode> SearchAlgorithm::Parse(string_view query, const QueryParams* params) {
+  try {
+    return make_shared<AstExpr>(ParseQuery(query, params));
+  } catch (const Parser::syntax_error& se) {
+    LOG(INFO) << "Failed to parse query \"" << query << "\":" << se.what();
+  } catch (...) {
+    LOG(INFO) << "Unexpected query parser error";
+  }
+  return nullptr;
+}
+
 SearchResult SearchAlgorithm::Search(const FieldIndices* index, size_t limit) const {
   auto bs = BasicSearch{index, limit};
   if (profiling_enabled_)
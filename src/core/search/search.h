@@ -34,6 +34,7 @@ struct SchemaField {
     size_t capacity = 1000;                       // initial capacity
     size_t hnsw_ef_construction = 200;
     size_t hnsw_m = 16;
+    VectorQuantization quantization = VectorQuantization::NONE;  // storage of vectors
   };
 
   struct TagParams {
@@ -80,6 +81,15 @@ class FieldIndices {
   // Extract values stored in sort indices
   std::vector<std::pair<std::string, SortableValue>> ExtractStoredValues(DocId doc) const;
 
+  // Memory used by the indices of every field, including its sort index
+  absl::flat_hash_map<std::string, IndexMemoryStats> GetMemoryStats() const;
+
+  // Compact posting lists of up to max_terms terms per text and tag index, returns freed bytes
+  size_t Compact(size_t max_terms);
+
+  // Whether a text or tag index has terms left to compact in the current pass
+  bool CompactionInProgress() const;
+
  private:
   void CreateIndices(PMR_NS::memory_resource* mr);
   void CreateSortIndices(PMR_NS::memory_resource* mr);
@@ -137,6 +147,13 @@ class SearchAlgorithm {
   // Init with query and return true if successful.
   bool Init(std::string_view query, const QueryParams* params, const SortOption* sort = nullptr);
 
+  // Init with an already parsed query, return true if it's valid.
+  bool Init(std::shared_ptr<const AstNode> query, const SortOption* sort = nullptr);
+
+  // Parse query with params substituted. Returns nullptr on syntax errors. The parsed query is
+  // immutable and can be re-used by multiple algorithms.
+  static std::shared_ptr<const AstNode> Parse(std::string_view query, const QueryParams* params);
+
   SearchResult Search(const FieldIndices* index,
                       size_t limit = std::numeric_limits<size_t>::max()) const;
 
@@ -147,7 +164,7 @@ class SearchAlgorithm {
 
  private:
   bool profiling_enabled_ = false;
-  std::unique_ptr<AstNode> query_;
+  std::shared_ptr<const AstNode> query_;
 };
 
 }  // namespace dfly::search
@@ -5,6 +5,7 @@
 #include "core/search/search.h"
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/btree_set.h>
 #include <absl/container/flat_hash_map.h>
 #include <absl/strings/escaping.h>
 #include <absl/strings/numbers.h>
@@ -19,6 +20,7 @@
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "core/search/base.h"
+#include "core/search/indices.h"
 #include "core/search/query_driver.h"
 #include "core/search/vector_utils.h"
 
@@ -163,6 +165,15 @@ TEST_F(SearchTest, MatchTerm) {
   EXPECT_TRUE(Check()) << GetError();
 }
 
+TEST_F(SearchTest, MatchPrefix) {
+  PrepareQuery("fo*");
+
+  ExpectAll("foo", "Fo bar", "more foolish bar", "for");
+  ExpectNone("f", "ofo", "bar", "ufoo");
+
+  EXPECT_TRUE(Check()) << GetError();
+}
+
 TEST_F(SearchTest, MatchNotTerm) {
   PrepareQuery("-foo");
 
@@ -272,6 +283,16 @@ TEST_F(SearchTest, MatchField) {
   EXPECT_TRUE(Check()) << GetError();
 }
 
+TEST_F(SearchTest, MatchFieldPrefix) {
+  PrepareSchema({{"f1", SchemaField::TEXT}, {"f2", SchemaField::TEXT}});
+  PrepareQuery("@f1:hel* wor*");
+
+  ExpectAll(Map{{"f1", "hello"}, {"f2", "world"}}, Map{{"f1", "help"}, {"f2", "work"}});
+  ExpectNone(Map{{"f1", "world"}, {"f2", "hello"}}, Map{{"f1", "he"}, {"f2", "word"}});
+
+  EXPECT_TRUE(Check()) << GetError();
+}
+
 TEST_F(SearchTest, MatchRange) {
   PrepareSchema({{"f1", SchemaField::NUMERIC}, {"f2", SchemaField::NUMERIC}});
   PrepareQuery("@f1:[1 10] @f2:[50 100]");
@@ -308,6 +329,136 @@ TEST_F(SearchTest, MatchDoubleRange) {
   }
 }
 
+TEST_F(SearchTest, NumericIndexBlocks) {
+  NumericIndex index{PMR_NS::get_default_resource()};
+  absl::btree_set<pair<double, DocId>> expected;
+  mt19937 gen(0);
+
+  // Enough entries for a few splits and merges of blocks
+  for (unsigned i = 0; i < 50000; i++) {
+    double value = gen() % 2000;
+    DocId id = gen() % 1000;
+    MockedDocument doc{Map{{"field", absl::StrCat(value)}}};
+    if (gen() % 3 == 0) {
+      index.Remove(id, &doc, "field");
+      expected.erase({value, id});
+    } else {
+      index.Add(id, &doc, "field");
+      expected.insert({value, id});
+    }
+
+    if (i % 500 == 0) {
+      double l = gen() % 2000, r = l + gen() % 100;
+      absl::btree_set<DocId> ids;
+      for (auto it = expected.lower_bound({l, 0}); it != expected.end() && it->first <= r; ++it)
+        ids.insert(it->second);
+      ASSERT_THAT(index.Range(l, r), testing::ElementsAreArray(ids.begin(), ids.end())) << i;
+    }
+  }
+}
+
+TEST_F(SearchTest, SkewedIntersection) {
+  auto schema = MakeSimpleSchema({{"tag", SchemaField::TAG}, {"num", SchemaField::NUMERIC}});
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  for (size_t i = 0; i < 5000; i++) {
+    string tags = i % 500 == 0 ? "all,rare" : "all";
+    MockedDocument doc{Map{{"tag", tags}, {"num", absl::StrCat(i)}}};
+    indices.Add(i, &doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  algo.Init("@tag:{all} @tag:{rare}", &params);
+  EXPECT_THAT(algo.Search(&indices).ids,
+              testing::ElementsAre(0, 500, 1000, 1500, 2000, 2500, 3000, 3500, 4000, 4500));
+
+  algo.Init("@tag:{all} @num:[1200 1700] @tag:{rare}", &params);
+  EXPECT_THAT(algo.Search(&indices).ids, testing::ElementsAre(1500));
+}
+
+TEST_F(SearchTest, MemoryStatsAndCompaction) {
+  auto schema = MakeSimpleSchema({{"tag", SchemaField::TAG}, {"num", SchemaField::NUMERIC}});
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  vector<MockedDocument> docs;
+  for (size_t i = 0; i < 5000; i++)
+    docs.emplace_back(Map{{"tag", absl::StrCat("all,tag-", i % 10)}, {"num", absl::StrCat(i)}});
+  for (size_t i = 0; i < docs.size(); i++)
+    indices.Add(i, &docs[i]);
+
+  auto stats = indices.GetMemoryStats();
+  ASSERT_EQ(stats.size(), 2u);
+  EXPECT_GE(stats["tag"].postings_bytes, 2 * 5000 * sizeof(DocId));
+  EXPECT_GT(stats["tag"].dictionary_bytes, 0u);
+  EXPECT_GE(stats["num"].postings_bytes, 5000 * sizeof(DocId));
+  EXPECT_GE(stats["num"].dictionary_bytes, 5000 * sizeof(double));
+  EXPECT_EQ(stats["num"].vector_bytes + stats["num"].sort_bytes, 0u);
+
+  for (size_t i = 0; i < docs.size(); i++) {
+    if (i % 5 != 0)
+      indices.Remove(i, &docs[i]);
+  }
+
+  size_t postings = indices.GetMemoryStats()["tag"].postings_bytes;
+  size_t freed = indices.Compact(100);
+  EXPECT_GT(freed, 0u);
+  EXPECT_EQ(indices.GetMemoryStats()["tag"].postings_bytes, postings - freed);
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+  algo.Init("@tag:{all}", &params);
+  EXPECT_EQ(algo.Search(&indices).ids.size(), 1000u);
+  algo.Init("@tag:{tag-5}", &params);
+  EXPECT_EQ(algo.Search(&indices).ids.size(), 500u);
+}
+
+TEST_F(SearchTest, SortTopK) {
+  auto schema = MakeSimpleSchema({{"tag", SchemaField::TAG}, {"num", SchemaField::NUMERIC}});
+  schema.fields["num"].flags = SchemaField::SORTABLE;
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  // Values are a permutation of ids, every tenth document is rare
+  auto value_of = [](size_t id) -> size_t { return id * 7919 % 1000; };
+  for (size_t i = 0; i < 1000; i++) {
+    string tags = i % 10 == 0 ? "all,rare" : "all";
+    MockedDocument doc{Map{{"tag", tags}, {"num", absl::StrCat(value_of(i))}}};
+    indices.Add(i, &doc);
+  }
+
+  auto sorted_values = [&](string_view query, bool desc, size_t limit) {
+    SearchAlgorithm algo{};
+    QueryParams params;
+    SortOption sort{"num", desc};
+    algo.Init(query, &params, &sort);
+
+    vector<size_t> values;
+    for (DocId id : algo.Search(&indices, limit).ids)
+      values.push_back(value_of(id));
+    return values;
+  };
+
+  // Ordered walk, almost all documents match
+  EXPECT_THAT(sorted_values("*", false, 3), testing::ElementsAre(0u, 1u, 2u));
+  EXPECT_THAT(sorted_values("*", true, 3), testing::ElementsAre(999u, 998u, 997u));
+
+  // Bounded heap over few matches
+  EXPECT_THAT(sorted_values("@tag:{rare}", false, 3), testing::ElementsAre(0u, 10u, 20u));
+
+  // Linear selection for large limits
+  auto values = sorted_values("@tag:{all}", true, 500);
+  ASSERT_EQ(values.size(), 500u);
+  EXPECT_TRUE(is_sorted(values.rbegin(), values.rend()));
+  EXPECT_EQ(values.front(), 999u);
+  EXPECT_EQ(values.back(), 500u);
+
+  // Removed documents are not returned by the ordered walk
+  MockedDocument doc{Map{{"tag", "all,rare"}, {"num", "0"}}};
+  indices.Remove(0, &doc);
+  EXPECT_THAT(sorted_values("*", false, 2), testing::ElementsAre(1u, 2u));
+}
+
 TEST_F(SearchTest, MatchStar) {
   PrepareQuery("*");
   ExpectAll("one", "two", "three", "and", "all", "documents");
@@ -580,6 +731,95 @@ TEST_P(KnnTest, AutoResize) {
   EXPECT_EQ(indices.GetAllDocs().size(), 100);
 }
 
+TEST_P(KnnTest, Filtered) {
+  // Enough points for both selective and wide filters
+  auto schema = MakeSimpleSchema({{"even", SchemaField::TAG},
+                                  {"rare", SchemaField::TAG},
+                                  {"pos", SchemaField::VECTOR}});
+  schema.fields["pos"].special_params = SchemaField::VectorParams{GetParam(), 1};
+  FieldIndices indices{schema, PMR_NS::get_default_resource()};
+
+  for (size_t i = 0; i < 3000; i++) {
+    Map values{{{"even", i % 2 == 0 ? "YES" : "NO"},
+                {"rare", i % 100 == 0 ? "YES" : "NO"},
+                {"pos", ToBytes({float(i)})}}};
+    MockedDocument doc{values};
+    indices.Add(i, &doc);
+  }
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  {
+    params["vec"] = ToBytes({1501.0});
+    algo.Init("@even:{yes} =>[KNN 4 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(&indices).ids, testing::UnorderedElementsAre(1498, 1500, 1502, 1504));
+  }
+
+  {
+    params["vec"] = ToBytes({1440.0});
+    algo.Init("@rare:{yes} =>[KNN 3 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(&indices).ids, testing::ElementsAre(1400, 1500, 1300));
+  }
+}
+
+TEST_P(KnnTest, QuantizedInt8) {
+  auto build = [this](const vector<pair<float, float>>& coords, VectorSimilarity sim) {
+    auto schema = MakeSimpleSchema({{"pos", SchemaField::VECTOR}});
+    SchemaField::VectorParams vparams{GetParam(), 2, sim};
+    vparams.quantization = VectorQuantization::INT8;
+    schema.fields["pos"].special_params = vparams;
+
+    auto indices = make_unique<FieldIndices>(schema, PMR_NS::get_default_resource());
+    for (size_t i = 0; i < coords.size(); i++) {
+      MockedDocument doc{Map{{"pos", ToBytes({coords[i].first, coords[i].second})}}};
+      indices->Add(i, &doc);
+    }
+    return indices;
+  };
+
+  SearchAlgorithm algo{};
+  QueryParams params;
+
+  {
+    auto indices = build({{0, 0}, {1, 0}, {1, 1}, {0, 1}, {0.5, 0.5}}, VectorSimilarity::L2);
+    params["vec"] = ToBytes({0.7, 0.15});
+    algo.Init("* => [KNN 10 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(indices.get()).ids, testing::ElementsAre(1, 4, 0, 2, 3));
+  }
+
+  {
+    auto indices = build({{1, 0}, {0, -1}, {-1, 0}, {0, 1}}, VectorSimilarity::COSINE);
+    params["vec"] = ToBytes({-0.1, -10});
+    algo.Init("* => [KNN 1 @pos $vec]", &params);
+    EXPECT_THAT(algo.Search(indices.get()).ids, testing::ElementsAre(1));
+  }
+}
+
+TEST(VectorUtilsTest, QuantizeVector) {
+  const float kVec[] = {0.5, -1.0, 0.25, 0.0};
+  int8_t codes[4];
+  float scale = QuantizeVector(kVec, 4, codes);
+
+  EXPECT_FLOAT_EQ(scale, 1.0 / 127);
+  EXPECT_THAT(codes, testing::ElementsAre(64, -127, 32, 0));
+
+  const float kTarget[] = {1.0, 1.0, 1.0, 1.0};
+  EXPECT_NEAR(QuantizedVectorDistance(kTarget, codes, scale, 4, VectorSimilarity::L2),
+              VectorDistance(kTarget, kVec, 4, VectorSimilarity::L2), 0.01);
+  EXPECT_NEAR(QuantizedVectorDistance(kTarget, codes, scale, 4, VectorSimilarity::COSINE),
+              VectorDistance(kTarget, kVec, 4, VectorSimilarity::COSINE), 0.01);
+  EXPECT_NEAR(QuantizedVectorDistance(codes, scale, codes, scale, 4, VectorSimilarity::L2), 0,
+              1e-6);
+
+  // Distances by precomputed norms match the plain ones
+  EXPECT_NEAR(CosineDistanceByNorms(kTarget, VectorNorm(kTarget, 4), kVec, VectorNorm(kVec, 4), 4),
+              VectorDistance(kTarget, kVec, 4, VectorSimilarity::COSINE), 1e-6);
+  EXPECT_NEAR(
+      CosineDistanceByNorms(kTarget, VectorNorm(kTarget, 4), codes, VectorNorm(codes, 4), 4),
+      QuantizedVectorDistance(kTarget, codes, scale, 4, VectorSimilarity::COSINE), 1e-6);
+}
+
 INSTANTIATE_TEST_SUITE_P(KnnFlat, KnnTest, testing::Values(false));
 INSTANTIATE_TEST_SUITE_P(KnnHnsw, KnnTest, testing::Values(true));
 
@@ -619,6 +859,22 @@ static void BM_VectorSearch(benchmark::State& state) {
 
 BENCHMARK(BM_VectorSearch)->Args({120, 10'000});
 
+static void BM_VectorDistance(benchmark::State& state) {
+  unsigned ndims = state.range(0);
+  auto sim = state.range(1) ? VectorSimilarity::COSINE : VectorSimilarity::L2;
+
+  vector<float> u(ndims), v(ndims);
+  for (size_t i = 0; i < ndims; i++) {
+    u[i] = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+    v[i] = static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+  }
+
+  for (auto _ : state)
+    benchmark::DoNotOptimize(VectorDistance(u.data(), v.data(), ndims, sim));
+}
+
+BENCHMARK(BM_VectorDistance)->ArgsProduct({{32, 128, 768, 1536}, {0, 1}});
+
 }  // namespace search
 
 }  // namespace dfly
@@ -7,16 +7,24 @@
 #include <absl/container/flat_hash_set.h>
 #include <absl/strings/ascii.h>
 #include <absl/strings/numbers.h>
+#include <absl/numeric/bits.h>
 #include <absl/strings/str_split.h>
 
 #include <algorithm>
+#include <cmath>
 #include <type_traits>
 
 namespace dfly::search {
 
 using namespace std;
 
-namespace {}  // namespace
+namespace {
+
+// Bounded heap selection is cheap while the limit is a small part of the results, otherwise
+// linear selection followed by sorting only the selected ids is faster
+constexpr size_t kHeapSelectRatio = 16;
+
+}  // namespace
 
 template <typename T>
 SimpleValueSortIndex<T>::SimpleValueSortIndex(PMR_NS::memory_resource* mr) : values_{mr} {
@@ -37,9 +45,17 @@ std::vector<ResultScore> SimpleValueSortIndex<T>::Sort(std::vector<DocId>* ids,
   auto cb = [this, desc](const auto& lhs, const auto& rhs) {
     return desc ? (values_[lhs] > values_[rhs]) : (values_[lhs] < values_[rhs]);
   };
-  std::partial_sort(ids->begin(), ids->begin() + std::min(ids->size(), limit), ids->end(), cb);
 
-  vector<ResultScore> out(min(ids->size(), limit));
+  limit = std::min(ids->size(), limit);
+  if (limit * kHeapSelectRatio <= ids->size()) {
+    std::partial_sort(ids->begin(), ids->begin() + limit, ids->end(), cb);
+  } else {
+    std::nth_element(ids->begin(), ids->begin() + limit, ids->end(), cb);
+    std::sort(ids->begin(), ids->begin() + limit, cb);
+  }
+  ids->resize(limit);
+
+  vector<ResultScore> out(limit);
   for (size_t i = 0; i < out.size(); i++)
     out[i] = values_[(*ids)[i]];
   return out;
@@ -59,6 +75,16 @@ void SimpleValueSortIndex<T>::Remove(DocId id, DocumentAccessor* doc, std::strin
   values_[id] = T{};
 }
 
+template <typename T> IndexMemoryStats SimpleValueSortIndex<T>::GetMemoryStats() const {
+  IndexMemoryStats stats;
+  stats.sort_bytes = values_.capacity() * sizeof(T);
+  if constexpr (std::is_same_v<T, PMR_NS::string>) {
+    for (const auto& str : values_)
+      stats.sort_bytes += str.capacity() > T{}.capacity() ? str.capacity() + 1 : 0;
+  }
+  return stats;
+}
+
 template <typename T> PMR_NS::memory_resource* SimpleValueSortIndex<T>::GetMemRes() const {
   return values_.get_allocator().resource();
 }
@@ -71,12 +97,72 @@ double NumericSortIndex::Get(DocId id, DocumentAccessor* doc, std::string_view f
   if (str.empty())
     return 0;
 
+  // NaN breaks the order of the entries, it is sorted like any other non numeric value.
   double v;
-  if (!absl::SimpleAtod(str.front(), &v))
+  if (!absl::SimpleAtod(str.front(), &v) || std::isnan(v))
     return 0;
   return v;
 }
 
+NumericSortIndex::NumericSortIndex(PMR_NS::memory_resource* mr)
+    : SimpleValueSortIndex{mr}, ordered_{mr} {
+}
+
+std::vector<ResultScore> NumericSortIndex::Sort(std::vector<DocId>* ids, size_t limit,
+                                                bool desc) const {
+  // The ordered walk visits about limit * (entries / matches) entries with a lookup for each,
+  // prefer it when this is cheaper than a pass over all matches
+  limit = std::min(ids->size(), limit);
+  size_t expected_steps = limit * ordered_.size() / std::max<size_t>(ids->size(), 1);
+  if (expected_steps * absl::bit_width(ids->size()) < ids->size())
+    return ScanOrdered(ids, limit, desc);
+
+  return SimpleValueSortIndex::Sort(ids, limit, desc);
+}
+
+void NumericSortIndex::Add(DocId id, DocumentAccessor* doc, std::string_view field) {
+  SimpleValueSortIndex::Add(id, doc, field);
+  ordered_.emplace(Value(id), id);
+}
+
+void NumericSortIndex::Remove(DocId id, DocumentAccessor* doc, std::string_view field) {
+  ordered_.erase({Value(id), id});
+  SimpleValueSortIndex::Remove(id, doc, field);
+}
+
+IndexMemoryStats NumericSortIndex::GetMemoryStats() const {
+  IndexMemoryStats stats = SimpleValueSortIndex::GetMemoryStats();
+  stats.sort_bytes += ordered_.size() * sizeof(Entry);
+  return stats;
+}
+
+std::vector<ResultScore> NumericSortIndex::ScanOrdered(std::vector<DocId>* ids, size_t limit,
+                                                       bool desc) const {
+  DCHECK(is_sorted(ids->begin(), ids->end()));
+
+  vector<DocId> top;
+  vector<ResultScore> out;
+  top.reserve(limit);
+  out.reserve(limit);
+
+  auto scan = [&](auto it, auto end) {
+    for (; it != end && top.size() < limit; ++it) {
+      if (binary_search(ids->begin(), ids->end(), it->second)) {
+        top.push_back(it->second);
+        out.emplace_back(it->first);
+      }
+    }
+  };
+
+  if (desc)
+    scan(ordered_.rbegin(), ordered_.rend());
+  else
+    scan(ordered_.begin(), ordered_.end());
+
+  *ids = std::move(top);
+  return out;
+}
+
 PMR_NS::string StringSortIndex::Get(DocId id, DocumentAccessor* doc, std::string_view field) {
   auto str = doc->GetStrings(field);
   if (str.empty())
@@ -26,20 +26,42 @@ template <typename T> struct SimpleValueSortIndex : BaseSortIndex {
 
   void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
   void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  IndexMemoryStats GetMemoryStats() const override;
 
  protected:
   virtual T Get(DocId id, DocumentAccessor* doc, std::string_view field) = 0;
 
   PMR_NS::memory_resource* GetMemRes() const;
 
+  const T& Value(DocId id) const {
+    DCHECK_LT(id, values_.size());
+    return values_[id];
+  }
+
  private:
   PMR_NS::vector<T> values_;
 };
 
+// Besides values by id, keeps all entries ordered by value. Sorting a large part of all documents
+// with a small limit then walks the entries in order and stops after limit matches.
 struct NumericSortIndex : public SimpleValueSortIndex<double> {
-  NumericSortIndex(PMR_NS::memory_resource* mr) : SimpleValueSortIndex{mr} {};
+  explicit NumericSortIndex(PMR_NS::memory_resource* mr);
+
+  std::vector<ResultScore> Sort(std::vector<DocId>* ids, size_t limit, bool desc) const override;
+
+  void Add(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  void Remove(DocId id, DocumentAccessor* doc, std::string_view field) override;
+  IndexMemoryStats GetMemoryStats() const override;
 
   double Get(DocId id, DocumentAccessor* doc, std::string_view field) override;
+
+ private:
+  using Entry = std::pair<double, DocId>;
+
+  // Walk entries in order and pick the first limit ones that are contained in sorted ids
+  std::vector<ResultScore> ScanOrdered(std::vector<DocId>* ids, size_t limit, bool desc) const;
+
+  absl::btree_set<Entry, std::less<Entry>, PMR_NS::polymorphic_allocator<Entry>> ordered_;
 };
 
 // TODO: Map tags to integers for fast sort
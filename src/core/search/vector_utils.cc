@@ -4,6 +4,7 @@
 
 #include "core/search/vector_utils.h"
 
+#include <algorithm>
 #include <cmath>
 #include <memory>
 
@@ -15,9 +16,19 @@ using namespace std;
 
 namespace {
 
+// Distance kernels are plain loops left to the autovectorizer. x86 builds target a baseline
+// instruction set, so the kernels are also cloned for AVX2 and AVX-512 and the loader picks
+// the best clone for the cpu at startup. The clones are dispatched with ifunc resolvers, which
+// only glibc supports, so musl builds use the baseline. NEON is part of the aarch64 baseline.
+#if defined(__x86_64__) && defined(__linux__) && defined(__GLIBC__)
+#define VECTOR_KERNEL \
+  __attribute__((optimize("fast-math"), target_clones("avx512f", "avx2", "default")))
+#else
+#define VECTOR_KERNEL __attribute__((optimize("fast-math")))
+#endif
+
 // Euclidean vector distance: sqrt( sum: (u[i] - v[i])^2  )
-__attribute__((optimize("fast-math"))) float L2Distance(const float* u, const float* v,
-                                                        size_t dims) {
+VECTOR_KERNEL float L2Distance(const float* u, const float* v, size_t dims) {
   float sum = 0;
   for (size_t i = 0; i < dims; i++)
     sum += (u[i] - v[i]) * (u[i] - v[i]);
@@ -25,8 +36,7 @@ __attribute__((optimize("fast-math"))) float L2Distance(const float* u, const fl
 }
 
 // TODO: Normalize vectors ahead if cosine distance is used
-__attribute__((optimize("fast-math"))) float CosineDistance(const float* u, const float* v,
-                                                            size_t dims) {
+VECTOR_KERNEL float CosineDistance(const float* u, const float* v, size_t dims) {
   float sum_uv = 0, sum_uu = 0, sum_vv = 0;
   for (size_t i = 0; i < dims; i++) {
     sum_uv += u[i] * v[i];
@@ -39,6 +49,68 @@ __attribute__((optimize("fast-math"))) float CosineDistance(const float* u, cons
   return 0.0f;
 }
 
+// Euclidean distance to a quantized vector, components of v are codes[i] * scale.
+VECTOR_KERNEL float L2Distance(const float* u, const int8_t* codes, float scale, size_t dims) {
+  float sum = 0;
+  for (size_t i = 0; i < dims; i++) {
+    float diff = u[i] - codes[i] * scale;
+    sum += diff * diff;
+  }
+  return sqrt(sum);
+}
+
+// The scale does not change the angle, so only the codes are used.
+VECTOR_KERNEL float CosineDistance(const float* u, const int8_t* codes, size_t dims) {
+  float sum_uv = 0, sum_uu = 0, sum_vv = 0;
+  for (size_t i = 0; i < dims; i++) {
+    sum_uv += u[i] * codes[i];
+    sum_uu += u[i] * u[i];
+    sum_vv += codes[i] * codes[i];
+  }
+
+  if (float denom = sum_uu * sum_vv; denom != 0.0f)
+    return 1 - sum_uv / sqrt(denom);
+  return 0.0f;
+}
+
+VECTOR_KERNEL float L2Distance(const int8_t* u, float u_scale, const int8_t* v, float v_scale,
+                              size_t dims) {
+  float sum = 0;
+  for (size_t i = 0; i < dims; i++) {
+    float diff = u[i] * u_scale - v[i] * v_scale;
+    sum += diff * diff;
+  }
+  return sqrt(sum);
+}
+
+// Products of codes fit into int32 for any practical dimension (127^2 * dims).
+VECTOR_KERNEL float CosineDistance(const int8_t* u, const int8_t* v, size_t dims) {
+  int32_t sum_uv = 0, sum_uu = 0, sum_vv = 0;
+  for (size_t i = 0; i < dims; i++) {
+    sum_uv += int32_t(u[i]) * v[i];
+    sum_uu += int32_t(u[i]) * u[i];
+    sum_vv += int32_t(v[i]) * v[i];
+  }
+
+  if (float denom = float(sum_uu) * float(sum_vv); denom != 0.0f)
+    return 1 - sum_uv / sqrt(denom);
+  return 0.0f;
+}
+
+VECTOR_KERNEL float DotProduct(const float* u, const float* v, size_t dims) {
+  float sum = 0;
+  for (size_t i = 0; i < dims; i++)
+    sum += u[i] * v[i];
+  return sum;
+}
+
+VECTOR_KERNEL float DotProduct(const float* u, const int8_t* codes, size_t dims) {
+  float sum = 0;
+  for (size_t i = 0; i < dims; i++)
+    sum += u[i] * codes[i];
+  return sum;
+}
+
 }  // namespace
 
 OwnedFtVector BytesToFtVector(string_view value) {
@@ -63,4 +135,63 @@ float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilari
   return 0.0f;
 }
 
+VECTOR_KERNEL float QuantizeVector(const float* v, size_t dims, int8_t* codes) {
+  float max_abs = 0;
+  for (size_t i = 0; i < dims; i++)
+    max_abs = max(max_abs, abs(v[i]));
+
+  float scale = max_abs / 127;
+  float inv_scale = scale != 0.0f ? 1 / scale : 0.0f;
+  for (size_t i = 0; i < dims; i++)
+    codes[i] = static_cast<int8_t>(round(v[i] * inv_scale));
+  return scale;
+}
+
+float QuantizedVectorDistance(const float* u, const int8_t* codes, float scale, size_t dims,
+                              VectorSimilarity sim) {
+  switch (sim) {
+    case VectorSimilarity::L2:
+      return L2Distance(u, codes, scale, dims);
+    case VectorSimilarity::COSINE:
+      return CosineDistance(u, codes, dims);
+  };
+  return 0.0f;
+}
+
+float QuantizedVectorDistance(const int8_t* u, float u_scale, const int8_t* v, float v_scale,
+                              size_t dims, VectorSimilarity sim) {
+  switch (sim) {
+    case VectorSimilarity::L2:
+      return L2Distance(u, u_scale, v, v_scale, dims);
+    case VectorSimilarity::COSINE:
+      return CosineDistance(u, v, dims);
+  };
+  return 0.0f;
+}
+
+float VectorNorm(const float* v, size_t dims) {
+  return sqrt(DotProduct(v, v, dims));
+}
+
+float VectorNorm(const int8_t* codes, size_t dims) {
+  int32_t sum = 0;
+  for (size_t i = 0; i < dims; i++)
+    sum += int32_t(codes[i]) * codes[i];
+  return sqrt(float(sum));
+}
+
+float CosineDistanceByNorms(const float* u, float u_norm, const float* v, float v_norm,
+                            size_t dims) {
+  if (float denom = u_norm * v_norm; denom != 0.0f)
+    return 1 - DotProduct(u, v, dims) / denom;
+  return 0.0f;
+}
+
+float CosineDistanceByNorms(const float* u, float u_norm, const int8_t* codes, float codes_norm,
+                            size_t dims) {
+  if (float denom = u_norm * codes_norm; denom != 0.0f)
+    return 1 - DotProduct(u, codes, dims) / denom;
+  return 0.0f;
+}
+
 }  // namespace dfly::search
@@ -12,4 +12,27 @@ OwnedFtVector BytesToFtVector(std::string_view value);
 
 float VectorDistance(const float* u, const float* v, size_t dims, VectorSimilarity sim);
 
+// Int8 scalar quantization: every component is stored as an int8 code with a single scale per
+// vector, so that v[i] ~ codes[i] * scale. Writes dims codes and returns the scale.
+float QuantizeVector(const float* v, size_t dims, int8_t* codes);
+
+// Distance between the full precision vector u and a quantized vector.
+float QuantizedVectorDistance(const float* u, const int8_t* codes, float scale, size_t dims,
+                              VectorSimilarity sim);
+
+// Distance between two quantized vectors.
+float QuantizedVectorDistance(const int8_t* u, float u_scale, const int8_t* v, float v_scale,
+                              size_t dims, VectorSimilarity sim);
+
+// Euclidean norm of a vector or of the codes of a quantized vector.
+float VectorNorm(const float* v, size_t dims);
+float VectorNorm(const int8_t* codes, size_t dims);
+
+// Cosine distance with norms computed ahead, so only the dot product is left.
+// Scales of quantized vectors cancel out, the codes and their norm are used directly.
+float CosineDistanceByNorms(const float* u, float u_norm, const float* v, float v_norm,
+                            size_t dims);
+float CosineDistanceByNorms(const float* u, float u_norm, const int8_t* codes, float codes_norm,
+                            size_t dims);
+
 }  // namespace dfly::search
@@ -5,6 +5,8 @@
 
 #include <mimalloc/types.h>
 
+#include <mutex>
+
 #include "base/logging.h"
 
 constexpr size_t kSegmentShift = MI_SEGMENT_SHIFT;
@@ -18,16 +20,70 @@ SegmentAllocator::SegmentAllocator(mi_heap_t* heap) : heap_(heap) {
   static_assert((~kSegmentAlignMask) == (MI_SEGMENT_SIZE - 1));
 }
 
-void SegmentAllocator::ValidateMapSize() {
-  if (address_table_.size() > (1u << kSegmentIdBits)) {
-    // This can happen if we restrict dragonfly to small number of threads on high-memory machine,
-    // for example.
-    LOG(WARNING) << "address_table_ map is growing too large: " << address_table_.size();
+std::atomic<uint8_t*> SegmentAllocator::address_table_[kMaxSegments];
+std::atomic_uint32_t SegmentAllocator::used_segments_{0};
+std::atomic_uint32_t SegmentAllocator::max_segments_{kMaxSegments};
+
+namespace {
+
+// Segment ids that were never used or were released by their allocator. Taken only when a thread
+// sees a new segment or empties one, which is rare compared to the allocations.
+struct FreeIds {
+  std::mutex mu;
+  uint32_t next = 0;  // ids above are unused.
+  std::vector<uint16_t> released;
+};
+
+FreeIds free_ids;
+
+}  // namespace
+
+// Returns kMaxSegments if the table is full.
+uint16_t SegmentAllocator::AddSegment(uint64_t seg_ptr) {
+  uint16_t id;
+  {
+    std::lock_guard lk(free_ids.mu);
+    if (used_segments_.load(std::memory_order_relaxed) >=
+        max_segments_.load(std::memory_order_relaxed)) {
+      // CanAllocate() is checked before, but other threads may have taken the last ids since.
+      LOG_FIRST_N(WARNING, 1) << "address_table_ is full: " << used_segments_.load();
+      return kMaxSegments;
+    }
+
+    if (free_ids.released.empty()) {
+      DCHECK_LT(free_ids.next, kMaxSegments);
+      id = free_ids.next++;
+    } else {
+      id = free_ids.released.back();
+      free_ids.released.pop_back();
+    }
+    used_segments_.fetch_add(1, std::memory_order_relaxed);
   }
+
+  address_table_[id].store(reinterpret_cast<uint8_t*>(seg_ptr), std::memory_order_release);
+  rev_indx_.emplace(seg_ptr, id);
+  if (live_.size() <= id)
+    live_.resize(id + 1, 0);
+  return id;
+}
+
+void SegmentAllocator::ReleaseSegment(uint16_t seg_id) {
+  // No pointers into the segment are left, so nobody translates seg_id until it is reused.
+  uint8_t* seg_ptr = address_table_[seg_id].load(std::memory_order_relaxed);
+  rev_indx_.erase(reinterpret_cast<uint64_t>(seg_ptr));
+
+  std::lock_guard lk(free_ids.mu);
+  free_ids.released.push_back(seg_id);
+  used_segments_.fetch_sub(1, std::memory_order_relaxed);
 }
 
 bool SegmentAllocator::CanAllocate() {
-  return address_table_.size() < (1u << kSegmentIdBits);
+  return used_segments_.load(std::memory_order_relaxed) <
+         max_segments_.load(std::memory_order_relaxed);
+}
+
+void SegmentAllocator::SetMaxSegments(uint32_t max) {
+  max_segments_.store(std::min(max, kMaxSegments), std::memory_order_relaxed);
 }
 
 }  // namespace dfly
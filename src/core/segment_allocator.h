@@ -6,11 +6,21 @@
 #include <absl/container/flat_hash_map.h>
 #include <mimalloc.h>
 
+#include <atomic>
+#include <vector>
+
+#include "base/logging.h"
+
 /***
  * This class is tightly coupled with mimalloc segment allocation logic and is designed to provide
  * a compact pointer representation (4bytes ptr) over 64bit address space that gives you
  * 32GB of allocations with option to extend it to 32*256GB if needed.
  *
+ * The translation table is global and shared by the allocators of all threads, so that
+ * pointers can be translated from any thread. A segment address is published before the first
+ * pointer into it is handed out, hence readers do not need locks. Once all the pointers into a
+ * segment are freed, its id is returned to a global free list and reused for another segment,
+ * so the 13-bit ids are bounded by the segments in use rather than by all the segments ever seen.
  */
 
 namespace dfly {
@@ -32,20 +42,36 @@ class SegmentAllocator {
   using Ptr = uint32_t;
 
   SegmentAllocator(mi_heap_t* heap);
-  bool CanAllocate();
+  static bool CanAllocate();
 
-  uint8_t* Translate(Ptr p) const {
-    return address_table_[p & kSegmentIdMask] + Offset(p);
+  // Can be called from any thread.
+  static uint8_t* Translate(Ptr p) {
+    return address_table_[p & kSegmentIdMask].load(std::memory_order_acquire) + Offset(p);
   }
 
   std::pair<Ptr, uint8_t*> Allocate(uint32_t size);
 
+  // Must be called by the thread that allocated ptr.
   void Free(Ptr ptr) {
     void* p = Translate(ptr);
     used_ -= mi_usable_size(p);
     mi_free(p);
+
+    uint16_t seg_id = ptr & kSegmentIdMask;
+    DCHECK_LT(seg_id, live_.size());
+    DCHECK_GT(live_[seg_id], 0u);
+    if (--live_[seg_id] == 0)
+      ReleaseSegment(seg_id);
+  }
+
+  // Number of segment ids in use by all threads.
+  static uint32_t used_segments() {
+    return used_segments_.load(std::memory_order_relaxed);
   }
 
+  // Limits the segment ids that can be in use, for tests. Capped by the 13-bit id space.
+  static void SetMaxSegments(uint32_t max);
+
   mi_heap_t* heap() {
     return heap_;
   }
@@ -59,10 +85,20 @@ class SegmentAllocator {
     return (p >> kSegmentIdBits) * 8;
   }
 
-  void ValidateMapSize();
+  uint16_t AddSegment(uint64_t seg_ptr);
+  void ReleaseSegment(uint16_t seg_id);
+
+ public:
+  static constexpr uint32_t kMaxSegments = 1u << kSegmentIdBits;
+
+ private:
+  static std::atomic<uint8_t*> address_table_[kMaxSegments];
+  static std::atomic_uint32_t used_segments_;
+  static std::atomic_uint32_t max_segments_;
 
-  std::vector<uint8_t*> address_table_;
+  // Segments of this heap, mimalloc segments are owned by a single thread.
   absl::flat_hash_map<uint64_t, uint16_t> rev_indx_;
+  std::vector<uint32_t> live_;  // live allocations indexed by segment id.
   mi_heap_t* heap_;
   size_t used_ = 0;
 };
@@ -76,15 +112,21 @@ inline auto SegmentAllocator::Allocate(uint32_t size) -> std::pair<Ptr, uint8_t*
   uint64_t seg_ptr = iptr & kSegmentAlignMask;
 
   // could be speed up using last used seg_ptr.
-  auto [it, inserted] = rev_indx_.emplace(seg_ptr, address_table_.size());
-  if (inserted) {
-    ValidateMapSize();
-    address_table_.push_back((uint8_t*)seg_ptr);
+  uint16_t seg_id;
+  if (auto it = rev_indx_.find(seg_ptr); it != rev_indx_.end()) {
+    seg_id = it->second;
+  } else {
+    seg_id = AddSegment(seg_ptr);
+    if (seg_id == kMaxSegments) {
+      mi_free(ptr);
+      throw std::bad_alloc{};
+    }
   }
 
   uint32_t seg_offset = (iptr - seg_ptr) / 8;
-  Ptr res = (seg_offset << kSegmentIdBits) | it->second;
+  Ptr res = (seg_offset << kSegmentIdBits) | seg_id;
   used_ += mi_good_size(size);
+  ++live_[seg_id];
 
   return std::make_pair(res, (uint8_t*)ptr);
 }
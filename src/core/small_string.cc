@@ -29,6 +29,7 @@ class XXH3_Deleter {
 struct TL {
   unique_ptr<XXH3_state_t, XXH3_Deleter> xxh_state;
   unique_ptr<SegmentAllocator> seg_alloc;
+  size_t table_full = 0;
 };
 
 thread_local TL tl;
@@ -46,13 +47,22 @@ void SmallString::InitThreadLocal(void* heap) {
 }
 
 bool SmallString::CanAllocate(size_t size) {
-  return size <= kMaxSize && tl.seg_alloc->CanAllocate();
+  if (size > kMaxSize)
+    return false;
+  if (SegmentAllocator::CanAllocate())
+    return true;
+  ++tl.table_full;
+  return false;
 }
 
 size_t SmallString::UsedThreadLocal() {
   return tl.seg_alloc ? tl.seg_alloc->used() : 0;
 }
 
+size_t SmallString::TableFullThreadLocal() {
+  return tl.table_full;
+}
+
 static_assert(sizeof(SmallString) == 16);
 
 // we should use only for sizes greater than kPrefLen
@@ -68,7 +78,7 @@ size_t SmallString::Assign(std::string_view s) {
     realptr = rp;
     size_ = s.size();
   } else if (s.size() <= size_) {
-    realptr = tl.seg_alloc->Translate(small_ptr_);
+    realptr = SegmentAllocator::Translate(small_ptr_);
 
     if (s.size() < size_) {
       size_t capacity = mi_usable_size(realptr);
@@ -101,7 +111,7 @@ void SmallString::Free() {
 uint16_t SmallString::MallocUsed() const {
   if (size_ <= kPrefLen)
     return 0;
-  auto* realptr = tl.seg_alloc->Translate(small_ptr_);
+  auto* realptr = SegmentAllocator::Translate(small_ptr_);
 
   return mi_malloc_usable_size(realptr);
 }
@@ -118,7 +128,7 @@ bool SmallString::Equal(std::string_view o) const {
   if (memcmp(prefix_, o.data(), kPrefLen) != 0)
     return false;
 
-  uint8_t* realp = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* realp = SegmentAllocator::Translate(small_ptr_);
 
   return memcmp(realp, o.data() + kPrefLen, size_ - kPrefLen) == 0;
 }
@@ -156,7 +166,7 @@ void SmallString::Get(std::string* dest) const {
   if (size_) {
     DCHECK_GT(size_, kPrefLen);
     memcpy(dest->data(), prefix_, kPrefLen);
-    uint8_t* ptr = tl.seg_alloc->Translate(small_ptr_);
+    uint8_t* ptr = SegmentAllocator::Translate(small_ptr_);
     memcpy(dest->data() + kPrefLen, ptr, size_ - kPrefLen);
   }
 }
@@ -169,7 +179,7 @@ unsigned SmallString::GetV(string_view dest[2]) const {
   }
 
   dest[0] = string_view{prefix_, kPrefLen};
-  uint8_t* ptr = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* ptr = SegmentAllocator::Translate(small_ptr_);
   dest[1] = string_view{reinterpret_cast<char*>(ptr), size_ - kPrefLen};
   return 2;
 }
@@ -180,7 +190,7 @@ bool SmallString::DefragIfNeeded(float ratio) {
     return false;
   }
 
-  uint8_t* cur_real_ptr = tl.seg_alloc->Translate(small_ptr_);
+  uint8_t* cur_real_ptr = SegmentAllocator::Translate(small_ptr_);
   if (!mi_heap_page_is_underutilized(tl.seg_alloc->heap(), cur_real_ptr, ratio))
     return false;
 
@@ -14,6 +14,8 @@ namespace dfly {
 // for in-memory workloads, especially for keys.
 // Please note that this class does not have automatic constructors and destructors, therefore
 // it requires explicit management.
+// Strings are allocated and freed by the thread that owns them, but they can be read from any
+// thread, since the pointer translation table is global.
 class SmallString {
   static constexpr unsigned kPrefLen = 10;
   static constexpr unsigned kMaxSize = (1 << 8) - 1;
@@ -21,6 +23,9 @@ class SmallString {
  public:
   static void InitThreadLocal(void* heap);
   static size_t UsedThreadLocal();
+
+  // Number of strings this thread could not allocate since the translation table was full.
+  static size_t TableFullThreadLocal();
   static bool CanAllocate(size_t size);
 
   void Reset() {
@@ -4,6 +4,7 @@
 
 #include "core/sorted_map.h"
 
+#include <algorithm>
 #include <cmath>
 
 extern "C" {
@@ -304,6 +305,26 @@ bool SortedMap::Insert(double score, sds ele) {
   return true;
 }
 
+size_t SortedMap::InsertBulk(absl::Span<const pair<double, string_view>> members) {
+  DCHECK_EQ(0u, Size());
+
+  vector<ScoreSds> objs;
+  objs.reserve(members.size());
+  for (const auto& [score, member] : members) {
+    auto [obj, added] = score_map->AddOrSkip(member, score);
+    if (added)
+      objs.push_back(obj);
+    else
+      SetObjScore(obj, score);  // not in the tree yet, so it's safe to update in place.
+  }
+
+  ScoreSdsPolicy::KeyCompareTo cmp;
+  std::sort(objs.begin(), objs.end(), [&](ScoreSds a, ScoreSds b) { return cmp(a, b) < 0; });
+  score_tree->FromSorted(objs.data(), objs.size());
+
+  return objs.size();
+}
+
 optional<unsigned> SortedMap::GetRank(sds ele, bool reverse) const {
   ScoreSds obj = score_map->FindObj(ele);
   if (obj == nullptr)
@@ -332,10 +353,8 @@ SortedMap::ScoredArray SortedMap::GetRange(const zrangespec& range, unsigned off
     }
     DCHECK_LE(GetObjScore(path.Terminal()), range.max);
 
-    while (offset--) {
-      if (!path.Prev())
-        return arr;
-    }
+    if (!SkipItems(offset, true, &path))
+      return arr;
 
     while (limit--) {
       ScoreSds ele = path.Terminal();
@@ -353,10 +372,8 @@ SortedMap::ScoredArray SortedMap::GetRange(const zrangespec& range, unsigned off
     if (path.Empty())
       return arr;
 
-    while (offset--) {
-      if (!path.Next())
-        return arr;
-    }
+    if (!SkipItems(offset, false, &path))
+      return arr;
 
     auto path2 = path;
     size_t num_elems = 0;
@@ -403,10 +420,8 @@ SortedMap::ScoredArray SortedMap::GetLexRange(const zlexrangespec& range, unsign
       if (range.maxex && sdscmp((sds)path.Terminal(), range.max) == 0) {
         ++offset;
       }
-      while (offset--) {
-        if (!path.Prev())
-          return {};
-      }
+      if (!SkipItems(offset, true, &path))
+        return {};
     } else {
       path = score_tree->FromRank(score_tree->Size() - offset - 1);
     }
@@ -433,10 +448,8 @@ SortedMap::ScoredArray SortedMap::GetLexRange(const zlexrangespec& range, unsign
       if (range.minex && sdscmp((sds)path.Terminal(), range.min) == 0) {
         ++offset;
       }
-      while (offset--) {
-        if (!path.Next())
-          return {};
-      }
+      if (!SkipItems(offset, false, &path))
+        return {};
     } else {
       path = score_tree->FromRank(offset);
     }
@@ -457,6 +470,35 @@ SortedMap::ScoredArray SortedMap::GetLexRange(const zlexrangespec& range, unsign
   return arr;
 }
 
+bool SortedMap::SkipItems(unsigned offset, bool reverse, detail::BPTreePath<ScoreSds>* path) const {
+  if (offset == 0)
+    return true;
+
+  // Short hops are cheaper to walk than to descend from the root.
+  constexpr unsigned kMaxWalk = 8;
+  if (offset <= kMaxWalk) {
+    while (offset--) {
+      if (!(reverse ? path->Prev() : path->Next()))
+        return false;
+    }
+    return true;
+  }
+
+  uint32_t rank = path->Rank();
+  if (reverse) {
+    if (offset > rank)
+      return false;
+    rank -= offset;
+  } else {
+    if (uint64_t(rank) + offset >= score_tree->Size())
+      return false;
+    rank += offset;
+  }
+
+  *path = score_tree->FromRank(rank);
+  return true;
+}
+
 uint8_t* SortedMap::ToListPack() const {
   uint8_t* lp = lpNew(0);
 
@@ -478,6 +520,23 @@ bool SortedMap::Delete(sds ele) {
   return true;
 }
 
+uint32_t SortedMap::Defrag(uint32_t cursor, float ratio, bool* moved) {
+  // The tree references the members, so it is updated before the old copies are freed.
+  auto on_move = [this](void* old_obj, void* new_obj) {
+    bool replaced = score_tree->Replace(old_obj, new_obj);
+    DCHECK(replaced);
+  };
+  cursor = score_map->Defrag(cursor, ratio, on_move, moved);
+
+  if (cursor == 0) {
+    auto should_move = [ratio](const void* node) {
+      return zmalloc_page_is_underutilized(const_cast<void*>(node), ratio) != 0;
+    };
+    *moved |= score_tree->ReallocNodes(should_move);
+  }
+  return cursor;
+}
+
 size_t SortedMap::MallocSize() const {
   // TODO: add malloc used to BPTree.
   return score_map->SetMallocUsed() + score_map->ObjMallocUsed() + score_tree->NodeCount() * 256;
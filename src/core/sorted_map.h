@@ -5,6 +5,7 @@
 #pragma once
 
 #include <absl/functional/function_ref.h>
+#include <absl/types/span.h>
 
 #include <memory>
 #include <optional>
@@ -52,6 +53,11 @@ class SortedMap {
   bool Reserve(size_t sz);
   int Add(double score, sds ele, int in_flags, int* out_flags, double* newscore);
   bool Insert(double score, sds member);
+
+  // Adds members to an empty map. The score tree is built bottom-up once all the members are
+  // added, which is much faster than inserting them one by one. If a member appears several
+  // times, the last score wins. Returns the number of added members.
+  size_t InsertBulk(absl::Span<const std::pair<double, std::string_view>> members);
   bool Delete(sds ele);
 
   size_t Size() const {
@@ -60,6 +66,12 @@ class SortedMap {
 
   size_t MallocSize() const;
 
+  // Moves the members and the internal allocations on pages utilized below ratio, a few
+  // buckets of the members per call. The tree nodes are moved once all the members were
+  // visited. Returns the cursor to continue from or 0 when done, and sets *moved if anything
+  // was reallocated.
+  uint32_t Defrag(uint32_t cursor, float ratio, bool* moved);
+
   size_t DeleteRangeByRank(unsigned start, unsigned end);
   size_t DeleteRangeByScore(const zrangespec& range);
   size_t DeleteRangeByLex(const zlexrangespec& range);
@@ -87,6 +99,11 @@ class SortedMap {
  private:
   using ScoreTree = BPTree<ScoreSds, ScoreSdsPolicy>;
 
+  // Moves path by offset items forward, or backward if reverse is true. Uses the subtree
+  // counts of the tree, so it runs in O(log n) regardless of the offset.
+  // Returns false if there is no such item.
+  bool SkipItems(unsigned offset, bool reverse, detail::BPTreePath<ScoreSds>* path) const;
+
   ScoreMap* score_map = nullptr;
   ScoreTree* score_tree = nullptr;  // just a stub for now.
 };
@@ -4,6 +4,7 @@
 
 #include "core/sorted_map.h"
 
+#include <absl/strings/str_cat.h>
 #include <gmock/gmock.h>
 #include <mimalloc.h>
 
@@ -12,6 +13,7 @@
 #include "core/mi_memory_resource.h"
 
 extern "C" {
+#include "redis/listpack.h"
 #include "redis/zmalloc.h"
 }
 
@@ -105,6 +107,42 @@ TEST_F(SortedMapTest, InsertPop) {
                                       Pair(StrEq("a97"), 1000)));
 }
 
+TEST_F(SortedMapTest, Defrag) {
+  auto member = [](unsigned i) { return absl::StrCat("m", i, string(100, 'a')); };
+  for (unsigned i = 0; i < 10000; ++i) {
+    string m = member(i);
+    ASSERT_TRUE(sm_.Insert(i, sdsnewlen(m.data(), m.size())));
+  }
+
+  for (unsigned i = 0; i < 10000; ++i) {
+    if (i % 10 == 0)
+      continue;
+    sds s = sdsnew(member(i).c_str());
+    ASSERT_TRUE(sm_.Delete(s));
+    sdsfree(s);
+  }
+  mi_heap_collect(mi_heap_get_backing(), true);
+
+  bool moved = false;
+  uint32_t cursor = 0;
+  unsigned steps = 0;
+  do {
+    cursor = sm_.Defrag(cursor, 0.9, &moved);
+    ++steps;
+  } while (cursor);
+  EXPECT_TRUE(moved);
+  EXPECT_GT(steps, 1u);
+
+  // The tree follows the moved members.
+  ASSERT_EQ(1000u, sm_.Size());
+  for (unsigned i = 0; i < 1000; ++i) {
+    sds s = sdsnew(member(i * 10).c_str());
+    EXPECT_EQ(i * 10, sm_.GetScore(s));
+    EXPECT_EQ(i, sm_.GetRank(s, false));
+    sdsfree(s);
+  }
+}
+
 TEST_F(SortedMapTest, LexRanges) {
   for (unsigned i = 0; i < 100; ++i) {
     sds s = sdsempty();
@@ -205,6 +243,73 @@ TEST_F(SortedMapTest, ScoreRanges) {
   ASSERT_EQ(0, array.size());
 }
 
+TEST_F(SortedMapTest, DeepOffsets) {
+  constexpr unsigned kSize = 5000;
+  for (unsigned i = 0; i < kSize; ++i) {
+    ASSERT_TRUE(sm_.Insert(i, sdsfromlonglong(i)));
+  }
+
+  zrangespec range;
+  range.min = 10;
+  range.max = 4000;
+  range.minex = range.maxex = 0;
+
+  for (unsigned offset : {0u, 3u, 100u, 3990u, 3991u, 4990u}) {
+    auto array = sm_.GetRange(range, offset, 2, false);
+    if (10 + offset <= 4000) {
+      ASSERT_FALSE(array.empty()) << offset;
+      EXPECT_EQ(10 + offset, array[0].second);
+    } else {
+      EXPECT_TRUE(array.empty()) << offset;
+    }
+
+    array = sm_.GetRange(range, offset, 2, true);
+    if (offset <= 4000 - 10) {
+      ASSERT_FALSE(array.empty()) << offset;
+      EXPECT_EQ(4000 - offset, array[0].second);
+    } else {
+      EXPECT_TRUE(array.empty()) << offset;
+    }
+  }
+
+  range.maxex = 1;
+  auto array = sm_.GetRange(range, 1000, 1, true);
+  ASSERT_EQ(1, array.size());
+  EXPECT_EQ(2999, array[0].second);
+}
+
+TEST_F(SortedMapTest, InsertBulk) {
+  vector<string> names;
+  for (unsigned i = 0; i < 1000; ++i) {
+    names.push_back(absl::StrCat("m", i));
+  }
+
+  vector<pair<double, string_view>> members;
+  for (unsigned i = 0; i < 1000; ++i) {
+    members.emplace_back(1000 - i, names[i]);
+  }
+  members.emplace_back(-1, names[500]);  // the last score wins.
+
+  EXPECT_EQ(1000, sm_.InsertBulk(members));
+  EXPECT_EQ(1000, sm_.Size());
+
+  sds ele = sdsnew("m500");
+  EXPECT_EQ(-1, sm_.GetScore(ele));
+  EXPECT_EQ(0, sm_.GetRank(ele, false));
+  sdsfree(ele);
+
+  ele = sdsnew("m0");
+  EXPECT_EQ(999, sm_.GetRank(ele, false));
+  sdsfree(ele);
+
+  zrangespec range;
+  range.min = 1;
+  range.max = 3;
+  range.minex = range.maxex = 0;
+  auto array = sm_.GetRange(range, 0, 10, false);
+  EXPECT_THAT(array, ElementsAre(Pair("m999", 1), Pair("m998", 2), Pair("m997", 3)));
+}
+
 TEST_F(SortedMapTest, DeleteRange) {
   for (unsigned i = 0; i <= 100; ++i) {
     sds s = sdsempty();
@@ -265,4 +370,49 @@ TEST_F(SortedMapTest, MemoryUsage) {
   zslFree(zsl);
 }
 
+// Compares the insertion into the sorted map with the listpack encoding of small sorted sets.
+static void BM_AddSortedMap(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  unsigned count = state.range(0);
+  vector<sds> members(count);
+  for (unsigned i = 0; i < count; ++i) {
+    members[i] = sdsnew(absl::StrCat("member:", 100000 + i).c_str());
+  }
+
+  MiMemoryResource mr(mi_heap_get_backing());
+  int out_flags;
+  double new_score;
+  while (state.KeepRunning()) {
+    SortedMap sm(&mr);
+    for (unsigned i = 0; i < count; ++i)
+      sm.Add((i * 7919) % count, members[i], 0, &out_flags, &new_score);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+
+  for (sds member : members)
+    sdsfree(member);
+}
+BENCHMARK(BM_AddSortedMap)->Arg(32)->Arg(128)->Arg(1024);
+
+static void BM_AddListpack(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  unsigned count = state.range(0);
+  vector<sds> members(count);
+  for (unsigned i = 0; i < count; ++i) {
+    members[i] = sdsnew(absl::StrCat("member:", 100000 + i).c_str());
+  }
+
+  while (state.KeepRunning()) {
+    uint8_t* lp = lpNew(0);
+    for (unsigned i = 0; i < count; ++i)
+      lp = zzlInsert(lp, members[i], (i * 7919) % count);
+    lpFree(lp);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+
+  for (sds member : members)
+    sdsfree(member);
+}
+BENCHMARK(BM_AddListpack)->Arg(32)->Arg(128)->Arg(1024);
+
 }  // namespace dfly
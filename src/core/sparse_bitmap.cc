@@ -0,0 +1,141 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/sparse_bitmap.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr uint16_t High(uint64_t offset) {
+  return offset >> 16;
+}
+
+constexpr uint16_t Low(uint64_t offset) {
+  return offset & 0xFFFF;
+}
+
+constexpr uint64_t Join(uint16_t high, uint16_t low) {
+  return (uint64_t(high) << 16) | low;
+}
+
+}  // namespace
+
+SparseBitmap::SparseBitmap(PMR_NS::memory_resource* mr) : mr_(mr), containers_(mr) {
+}
+
+auto SparseBitmap::LowerBound(uint16_t high) const -> ContainerVec::const_iterator {
+  return lower_bound(containers_.begin(), containers_.end(), high,
+                     [](const Container& c, uint16_t h) { return c.high < h; });
+}
+
+bool SparseBitmap::Get(uint64_t offset) const {
+  auto it = LowerBound(High(offset));
+  if (it == containers_.end() || it->high != High(offset))
+    return false;
+  return binary_search(it->lows.begin(), it->lows.end(), Low(offset));
+}
+
+bool SparseBitmap::Set(uint64_t offset, bool value) {
+  DCHECK_LT(offset, kMaxBits);
+  size_ = max<uint64_t>(size_, offset / 8 + 1);
+
+  auto cit = containers_.begin() + (LowerBound(High(offset)) - containers_.cbegin());
+  bool found = cit != containers_.end() && cit->high == High(offset);
+  if (!found) {
+    if (!value)
+      return false;
+    cit = containers_.insert(cit, Container{High(offset), LowVec(mr_)});
+  }
+
+  LowVec& lows = cit->lows;
+  auto it = lower_bound(lows.begin(), lows.end(), Low(offset));
+  bool prev = it != lows.end() && *it == Low(offset);
+  if (prev == value)
+    return prev;
+
+  if (value) {
+    lows.insert(it, Low(offset));
+    ++count_;
+  } else {
+    lows.erase(it);
+    --count_;
+    if (lows.empty())
+      containers_.erase(cit);
+  }
+  return prev;
+}
+
+uint64_t SparseBitmap::CountRange(uint64_t start, uint64_t end) const {
+  end = min(end, size_ * 8);
+  if (start >= end)
+    return 0;
+
+  uint64_t count = 0;
+  for (auto cit = LowerBound(High(start)); cit != containers_.end() && cit->high <= High(end - 1);
+       ++cit) {
+    auto first = cit->lows.begin(), last = cit->lows.end();
+    if (cit->high == High(start))
+      first = lower_bound(first, last, Low(start));
+    if (cit->high == High(end - 1))
+      last = upper_bound(first, last, Low(end - 1));
+    count += last - first;
+  }
+  return count;
+}
+
+int64_t SparseBitmap::FindFirst(bool value, uint64_t start, uint64_t end) const {
+  end = min(end, size_ * 8);
+  if (start >= end)
+    return -1;
+
+  // The set bits are visited in order, a clear bit is found as soon as they leave a gap.
+  uint64_t candidate = start;
+  for (auto cit = LowerBound(High(start)); cit != containers_.end(); ++cit) {
+    auto it = cit->lows.begin();
+    if (cit->high == High(start))
+      it = lower_bound(it, cit->lows.end(), Low(start));
+
+    for (; it != cit->lows.end(); ++it) {
+      uint64_t offset = Join(cit->high, *it);
+      if (offset >= end)
+        return value || candidate >= end ? -1 : int64_t(candidate);
+      if (value)
+        return offset;
+      if (offset != candidate)
+        return candidate;
+      ++candidate;
+    }
+  }
+
+  return value || candidate >= end ? -1 : int64_t(candidate);
+}
+
+void SparseBitmap::ForEachSet(absl::FunctionRef<void(uint64_t)> cb) const {
+  for (const auto& c : containers_) {
+    for (uint16_t low : c.lows)
+      cb(Join(c.high, low));
+  }
+}
+
+void SparseBitmap::Materialize(char* dest) const {
+  memset(dest, 0, size_);
+  ForEachSet([dest](uint64_t offset) { dest[offset / 8] |= 1 << (7 - offset % 8); });
+}
+
+size_t SparseBitmap::MallocUsed() const {
+  size_t res = sizeof(SparseBitmap) + containers_.capacity() * sizeof(Container);
+  for (const auto& c : containers_)
+    res += c.lows.capacity() * sizeof(uint16_t);
+  return res;
+}
+
+}  // namespace dfly
@@ -0,0 +1,83 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstdint>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Compressed representation of a string that is used as a bitmap with only a few bits set.
+//
+// Bit offsets follow the order of SETBIT, i.e. offset 0 is the most significant bit of
+// the first byte. Similarly to roaring bitmaps with array containers, the offsets of the set bits
+// are grouped by their high 16 bits and every group keeps a sorted array of the low 16 bits,
+// so each set bit takes 2 bytes regardless of how far apart the bits are.
+// The bitmap also keeps the length of the string it represents, which may end with zero bytes.
+class SparseBitmap {
+  SparseBitmap(const SparseBitmap&) = delete;
+  SparseBitmap& operator=(const SparseBitmap&) = delete;
+
+ public:
+  // Redis limits bitmaps to 2^32 bits.
+  static constexpr uint64_t kMaxBits = 1ULL << 32;
+
+  explicit SparseBitmap(PMR_NS::memory_resource* mr);
+
+  bool Get(uint64_t offset) const;
+
+  // Sets the bit at offset to value and returns its previous value.
+  // Extends the string length to cover offset.
+  bool Set(uint64_t offset, bool value);
+
+  // Length of the represented string in bytes.
+  size_t Size() const {
+    return size_;
+  }
+
+  // Number of set bits.
+  uint64_t Count() const {
+    return count_;
+  }
+
+  // Number of set bits with offsets in [start, end).
+  uint64_t CountRange(uint64_t start, uint64_t end) const;
+
+  // Returns the offset of the first bit with offset in [start, end) that equals value or
+  // -1 if there is none.
+  int64_t FindFirst(bool value, uint64_t start, uint64_t end) const;
+
+  // Calls cb with the offsets of all the set bits in increasing order.
+  void ForEachSet(absl::FunctionRef<void(uint64_t)> cb) const;
+
+  // Writes the represented string to dest, which must have Size() bytes.
+  void Materialize(char* dest) const;
+
+  size_t MallocUsed() const;
+
+ private:
+  using LowVec = std::vector<uint16_t, PMR_NS::polymorphic_allocator<uint16_t>>;
+
+  struct Container {
+    uint16_t high;
+    LowVec lows;  // sorted
+  };
+
+  using ContainerVec = std::vector<Container, PMR_NS::polymorphic_allocator<Container>>;
+
+  // Returns the first container with high >= the given one.
+  ContainerVec::const_iterator LowerBound(uint16_t high) const;
+
+  PMR_NS::memory_resource* mr_;
+  ContainerVec containers_;  // sorted by high
+  uint64_t size_ = 0;
+  uint64_t count_ = 0;
+};
+
+}  // namespace dfly
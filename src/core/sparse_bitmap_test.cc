@@ -0,0 +1,110 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/sparse_bitmap.h"
+
+#include <gmock/gmock.h>
+
+#include <random>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class SparseBitmapTest : public ::testing::Test {
+ protected:
+  SparseBitmapTest() : bitmap_(PMR_NS::get_default_resource()) {
+  }
+
+  // Sets the bit in the dense reference.
+  bool SetRef(uint64_t offset, bool value) {
+    if (ref_.size() <= offset / 8)
+      ref_.resize(offset / 8 + 1, 0);
+    uint8_t mask = 1 << (7 - offset % 8);
+    bool prev = ref_[offset / 8] & mask;
+    ref_[offset / 8] = value ? ref_[offset / 8] | mask : ref_[offset / 8] & ~mask;
+    return prev;
+  }
+
+  bool GetRef(uint64_t offset) const {
+    return offset / 8 < ref_.size() && (ref_[offset / 8] & (1 << (7 - offset % 8)));
+  }
+
+  string Materialize() const {
+    string res(bitmap_.Size(), 'x');
+    bitmap_.Materialize(res.data());
+    return res;
+  }
+
+  SparseBitmap bitmap_;
+  string ref_;
+};
+
+TEST_F(SparseBitmapTest, Basic) {
+  EXPECT_EQ(0, bitmap_.Size());
+  EXPECT_FALSE(bitmap_.Set(100000, true));
+  EXPECT_TRUE(bitmap_.Set(100000, true));
+  EXPECT_EQ(12501, bitmap_.Size());
+  EXPECT_EQ(1, bitmap_.Count());
+  EXPECT_TRUE(bitmap_.Get(100000));
+  EXPECT_FALSE(bitmap_.Get(99999));
+
+  // Clearing a bit past the end still extends the string, like in Redis.
+  EXPECT_FALSE(bitmap_.Set(200000, false));
+  EXPECT_EQ(25001, bitmap_.Size());
+  EXPECT_EQ(1, bitmap_.Count());
+
+  EXPECT_EQ(100000, bitmap_.FindFirst(true, 0, UINT64_MAX));
+  EXPECT_EQ(-1, bitmap_.FindFirst(true, 100001, UINT64_MAX));
+  EXPECT_EQ(0, bitmap_.FindFirst(false, 0, UINT64_MAX));
+  EXPECT_EQ(100001, bitmap_.FindFirst(false, 100000, UINT64_MAX));
+
+  EXPECT_TRUE(bitmap_.Set(100000, false));
+  EXPECT_EQ(0, bitmap_.Count());
+  EXPECT_EQ(string(25001, '\0'), Materialize());
+}
+
+TEST_F(SparseBitmapTest, Random) {
+  mt19937_64 gen(0);
+  for (unsigned i = 0; i < 5000; ++i) {
+    uint64_t offset = gen() % (i % 2 ? 1000 : 10000000);
+    bool value = gen() % 4 != 0;
+    ASSERT_EQ(SetRef(offset, value), bitmap_.Set(offset, value)) << offset;
+  }
+  ASSERT_EQ(ref_.size(), bitmap_.Size());
+  EXPECT_EQ(ref_, Materialize());
+
+  uint64_t num_bits = ref_.size() * 8;
+  for (unsigned i = 0; i < 200; ++i) {
+    uint64_t start = gen() % num_bits;
+    uint64_t end = start + gen() % (i % 2 ? 2000 : num_bits);
+
+    uint64_t count = 0;
+    int64_t first[2] = {-1, -1};
+    for (uint64_t j = start; j < min(end, num_bits); ++j) {
+      bool bit = GetRef(j);
+      count += bit;
+      if (first[bit] < 0)
+        first[bit] = j;
+    }
+    EXPECT_EQ(count, bitmap_.CountRange(start, end));
+    EXPECT_EQ(first[0], bitmap_.FindFirst(false, start, end));
+    EXPECT_EQ(first[1], bitmap_.FindFirst(true, start, end));
+    EXPECT_EQ(GetRef(start), bitmap_.Get(start));
+  }
+}
+
+TEST_F(SparseBitmapTest, Dense) {
+  for (unsigned i = 0; i < 100000; ++i)
+    bitmap_.Set(i, true);
+  EXPECT_EQ(-1, bitmap_.FindFirst(false, 0, UINT64_MAX));
+  EXPECT_EQ(100000 - 16, bitmap_.CountRange(8, 100000 - 8));
+
+  bitmap_.Set(70000, false);
+  EXPECT_EQ(70000, bitmap_.FindFirst(false, 0, UINT64_MAX));
+}
+
+}  // namespace dfly
@@ -10,6 +10,9 @@
 #else
 #include <emmintrin.h>
 #include <tmmintrin.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #endif
 
 namespace dfly {
@@ -188,6 +188,16 @@ void StringMap::RandomPairs(unsigned int count, std::vector<sds>& keys, std::vec
   }
 }
 
+uint32_t StringMap::Defrag(uint32_t cursor, float ratio, bool* moved) {
+  auto realloc_obj = [&](void* obj, bool) -> void* {
+    auto [new_obj, realloced] = ReallocIfNeeded(obj, ratio);
+    *moved |= realloced;
+    return new_obj;
+  };
+
+  return DefragBuckets(cursor, kDefragStepBuckets, ratio, realloc_obj, moved);
+}
+
 pair<sds, bool> StringMap::ReallocIfNeeded(void* obj, float ratio) {
   sds key = (sds)obj;
   size_t key_len = sdslen(key);
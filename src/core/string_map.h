@@ -148,6 +148,11 @@ class StringMap : public DenseSet {
   void RandomPairs(unsigned int count, std::vector<sds>& keys, std::vector<sds>& vals,
                    bool with_value);
 
+  // Moves the fields, values and links of kDefragStepBuckets buckets starting at cursor that
+  // are on pages utilized below ratio. Returns the cursor to continue from or 0 when done,
+  // and sets *moved if anything was reallocated.
+  uint32_t Defrag(uint32_t cursor, float ratio, bool* moved);
+
  private:
   // Reallocate key and/or value if their pages are underutilized.
   // Returns new pointer (stays same if key utilization is enough) and if reallocation happened.
@@ -18,6 +18,7 @@
 #include <unordered_set>
 #include <vector>
 
+#include "base/gtest.h"
 #include "core/compact_object.h"
 #include "core/mi_memory_resource.h"
 #include "glog/logging.h"
@@ -173,4 +174,22 @@ TEST_F(StringMapTest, ReallocIfNeeded) {
     EXPECT_EQ(sm_->Find(build_str(i * 10))->second, build_str(i * 10 + 1));
 }
 
+static void BM_AddStringMap(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  unsigned count = state.range(0);
+  vector<string> fields(count);
+  for (unsigned i = 0; i < count; ++i) {
+    fields[i] = StrCat("field:", 100000 + i);
+  }
+  string value(16, 'x');
+
+  while (state.KeepRunning()) {
+    StringMap sm;
+    for (const auto& field : fields)
+      sm.AddOrUpdate(field, value);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_AddStringMap)->Arg(1000)->Arg(100000);
+
 }  // namespace dfly
@@ -34,6 +34,28 @@ sds AllocImmutableWithTtl(uint32_t len, uint32_t at) {
 
 }  // namespace
 
+uint32_t StringSet::Defrag(uint32_t cursor, float ratio, bool* moved) {
+  auto realloc_obj = [&](void* obj, bool has_ttl) -> void* {
+    sds s = (sds)obj;
+    if (!zmalloc_page_is_underutilized(s, ratio))
+      return obj;
+
+    size_t len = sdslen(s);
+    sds new_s;
+    if (has_ttl) {
+      new_s = AllocSdsWithSpace(len, sizeof(uint32_t));
+      memcpy(new_s, s, len + 1 + sizeof(uint32_t));
+    } else {
+      new_s = sdsnewlen(s, len);
+    }
+    sdsfree(s);
+    *moved = true;
+    return new_s;
+  };
+
+  return DefragBuckets(cursor, kDefragStepBuckets, ratio, realloc_obj, moved);
+}
+
 StringSet::~StringSet() {
   Clear();
 }
@@ -99,6 +99,11 @@ class StringSet : public DenseSet {
 
   uint32_t Scan(uint32_t, const std::function<void(sds)>&) const;
 
+  // Moves the members and links of kDefragStepBuckets buckets starting at cursor that are on
+  // pages utilized below ratio. Returns the cursor to continue from or 0 when done, and sets
+  // *moved if anything was reallocated.
+  uint32_t Defrag(uint32_t cursor, float ratio, bool* moved);
+
   iterator Find(std::string_view member) {
     return iterator{FindIt(&member, 1)};
   }
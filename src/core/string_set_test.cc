@@ -15,9 +15,11 @@
 #include <random>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_set>
 #include <vector>
 
+#include "base/gtest.h"
 #include "core/compact_object.h"
 #include "core/mi_memory_resource.h"
 #include "glog/logging.h"
@@ -73,6 +75,7 @@ class StringSetTest : public ::testing::Test {
 
   void TearDown() override {
     delete ss_;
+    LinkSlab::DestroyThreadLocal(&alloc_);
 
     // ensure there are no memory leaks after every test
     EXPECT_TRUE(alloc_.all_freed());
@@ -162,6 +165,81 @@ TEST_F(StringSetTest, Resizing) {
   }
 }
 
+TEST_F(StringSetTest, RandomAddErase) {
+  // Exercises chains, displaced entries and their unlinking, lookups must keep matching
+  // the fingerprints of the entries after they move.
+  mt19937 rand(0);
+  unordered_set<string> expected;
+  for (unsigned i = 0; i < 20000; ++i) {
+    string str = StrCat(rand() % 5000);
+    switch (rand() % 3) {
+      case 0:
+        ASSERT_EQ(expected.insert(str).second, ss_->Add(str)) << str;
+        break;
+      case 1:
+        ASSERT_EQ(expected.erase(str) > 0, ss_->Erase(str)) << str;
+        break;
+      default:
+        ASSERT_EQ(expected.count(str) > 0, ss_->Contains(str)) << str;
+    }
+  }
+  EXPECT_EQ(expected.size(), ss_->UpperBoundSize());
+  for (const auto& str : expected)
+    EXPECT_TRUE(ss_->Contains(str)) << str;
+}
+
+TEST_F(StringSetTest, IncrementalRehash) {
+  vector<string> strs;
+  while (ss_->PendingRehashBuckets() == 0) {
+    strs.push_back(StrCat("key", strs.size()));
+    ASSERT_TRUE(ss_->Add(strs.back()));
+  }
+  EXPECT_LE(ss_->PendingRehashBuckets(), ss_->BucketCount() / 2 - 4);
+  EXPECT_EQ(ss_->PendingRehashBuckets(), DenseSet::GetStats().pending_rehash_buckets);
+
+  // Lookups, additions and removals see both layouts until the migration finishes.
+  mt19937 rand(0);
+  for (unsigned i = 0; ss_->PendingRehashBuckets() > 0; ++i) {
+    ASSERT_TRUE(ss_->Contains(strs[rand() % strs.size()]));
+    ASSERT_FALSE(ss_->Contains(StrCat("missing", i)));
+    strs.push_back(StrCat("key", strs.size()));
+    ASSERT_TRUE(ss_->Add(strs.back()));
+    if (i % 8 == 0) {
+      size_t index = rand() % strs.size();
+      ASSERT_TRUE(ss_->Erase(strs[index]));
+      strs.erase(strs.begin() + index);
+    }
+  }
+
+  EXPECT_EQ(0, DenseSet::GetStats().pending_rehash_buckets);
+  EXPECT_EQ(strs.size(), ss_->UpperBoundSize());
+  for (const auto& str : strs)
+    EXPECT_TRUE(ss_->Contains(str)) << str;
+}
+
+TEST_F(StringSetTest, ScanDuringRehash) {
+  vector<string> strs;
+  while (ss_->PendingRehashBuckets() == 0) {
+    strs.push_back(StrCat("key", strs.size()));
+    ASSERT_TRUE(ss_->Add(strs.back()));
+  }
+
+  // Every key that exists during the whole scan is reported, while additions keep migrating
+  // buckets under the cursor.
+  unordered_set<string> seen;
+  uint32_t cursor = 0;
+  unsigned i = 0;
+  do {
+    cursor = ss_->Scan(cursor, [&](const sds ptr) { seen.emplace(ptr, sdslen(ptr)); });
+    ASSERT_TRUE(ss_->Add(StrCat("added", i++)));
+  } while (cursor != 0);
+
+  for (const auto& str : strs)
+    EXPECT_TRUE(seen.count(str)) << str;
+  for (const auto& str : strs)
+    EXPECT_TRUE(ss_->Contains(str)) << str;
+}
+
 TEST_F(StringSetTest, SimpleScan) {
   unordered_set<string_view> info = {"foo", "bar"};
   unordered_set<string_view> seen;
@@ -418,6 +496,30 @@ TEST_F(StringSetTest, Ttl) {
   }
 }
 
+TEST_F(StringSetTest, ExpireStep) {
+  for (unsigned i = 0; i < 1000; ++i) {
+    EXPECT_TRUE(ss_->Add(StrCat("short", i), 1));
+    EXPECT_TRUE(ss_->Add(StrCat("long", i), 10));
+    EXPECT_TRUE(ss_->Add(StrCat("persistent", i)));
+  }
+
+  ss_->set_time(5);
+  uint32_t min_expire = UINT32_MAX;
+  uint32_t cursor = 0;
+  unsigned steps = 0;
+  do {
+    cursor = ss_->ExpireStep(cursor, 64, &min_expire);
+    ++steps;
+  } while (cursor);
+
+  EXPECT_GT(steps, 1u);
+  EXPECT_EQ(10u, min_expire);
+  EXPECT_EQ(2000u, ss_->UpperBoundSize());
+  EXPECT_FALSE(ss_->Contains("short7"));
+  EXPECT_TRUE(ss_->Contains("long7"));
+  EXPECT_TRUE(ss_->Contains("persistent7"));
+}
+
 TEST_F(StringSetTest, Grow) {
   mt19937 generator(0);
 
@@ -455,4 +557,124 @@ TEST_F(StringSetTest, IterateEmpty) {
   }
 }
 
+TEST_F(StringSetTest, LinkSlab) {
+  LinkSlab* slab = LinkSlab::ForResource(&alloc_);
+  EXPECT_EQ(slab, LinkSlab::ForResource(&alloc_));
+
+  vector<void*> blocks;
+  for (unsigned i = 0; i < 1000; ++i) {
+    blocks.push_back(slab->Allocate());
+    memset(blocks.back(), 0xAB, LinkSlab::kBlockSize);
+  }
+  EXPECT_EQ(1000, slab->num_blocks());
+  size_t num_chunks = slab->num_chunks();
+  EXPECT_LE(num_chunks * LinkSlab::kChunkSize, 1000 * LinkSlab::kBlockSize * 11 / 10);
+
+  // Leave a single block in the first chunk, it should be worth moving.
+  for (unsigned i = 1; i < LinkSlab::kChunkSize / LinkSlab::kBlockSize; ++i) {
+    LinkSlab::Free(blocks[i]);
+    blocks[i] = nullptr;
+  }
+  EXPECT_TRUE(LinkSlab::IsUnderutilized(blocks[0], 0.5));
+  EXPECT_FALSE(LinkSlab::IsUnderutilized(blocks[500], 0.5));
+
+  // Freed blocks are reused before new chunks are allocated.
+  blocks.push_back(slab->Allocate());
+  EXPECT_EQ(num_chunks, slab->num_chunks());
+
+  for (void* block : blocks) {
+    if (block)
+      LinkSlab::Free(block);
+  }
+  EXPECT_EQ(0, slab->num_blocks());
+  EXPECT_EQ(0, slab->num_chunks());
+}
+
+TEST_F(StringSetTest, LinkSlabOtherThread) {
+  LinkSlab* slab = LinkSlab::ForResource(&alloc_);
+  vector<void*> blocks;
+  for (unsigned i = 0; i < 1000; ++i)
+    blocks.push_back(slab->Allocate());
+
+  // Blocks freed by another thread are queued until the owner allocates again.
+  std::thread other([&] {
+    for (void* block : blocks)
+      LinkSlab::Free(block);
+  });
+  other.join();
+  EXPECT_EQ(1000, slab->num_blocks());
+
+  void* block = slab->Allocate();
+  EXPECT_EQ(1, slab->num_blocks());
+  EXPECT_EQ(1, slab->num_chunks());
+  LinkSlab::Free(block);
+  EXPECT_EQ(0, slab->num_chunks());
+
+  // A new slab is created for the resource once the old one is destroyed.
+  LinkSlab::DestroyThreadLocal(&alloc_);
+  slab = LinkSlab::ForResource(&alloc_);
+  EXPECT_EQ(0, slab->num_blocks());
+}
+
+TEST_F(StringSetTest, DefragLinks) {
+  vector<string> strs;
+  for (unsigned i = 0; i < 10000; ++i) {
+    strs.push_back(StrCat("member:", i));
+    ss_->Add(strs.back());
+  }
+
+  // Erase most of the members so that their links are scattered across sparse chunks.
+  for (unsigned i = 0; i < strs.size(); ++i) {
+    if (i % 16)
+      ss_->Erase(strs[i]);
+  }
+
+  LinkSlab* slab = LinkSlab::ForResource(&alloc_);
+  size_t num_chunks = slab->num_chunks();
+
+  bool moved = false;
+  uint32_t cursor = 0;
+  do {
+    cursor = ss_->Defrag(cursor, 0.8, &moved);
+  } while (cursor);
+
+  EXPECT_LE(slab->num_chunks(), num_chunks);
+  for (unsigned i = 0; i < strs.size(); i += 16)
+    EXPECT_TRUE(ss_->Contains(strs[i]));
+}
+
+static void BM_AddStringSet(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  unsigned count = state.range(0);
+  vector<string> strs(count);
+  for (unsigned i = 0; i < count; ++i) {
+    strs[i] = StrCat("member:", 100000 + i);
+  }
+
+  while (state.KeepRunning()) {
+    StringSet ss;
+    for (const auto& str : strs)
+      ss.Add(str);
+  }
+  state.SetItemsProcessed(state.iterations() * count);
+}
+BENCHMARK(BM_AddStringSet)->Arg(1000)->Arg(100000);
+
+static void BM_FindStringSet(benchmark::State& state) {
+  init_zmalloc_threadlocal(mi_heap_get_backing());
+  unsigned count = state.range(0);
+  StringSet ss;
+  for (unsigned i = 0; i < count; ++i) {
+    ss.Add(StrCat("member:", 100000 + i));
+  }
+
+  unsigned next = 0;
+  char buf[32] = "member:";
+  while (state.KeepRunning()) {
+    char* end = absl::numbers_internal::FastIntToBuffer(100000 + next++ % (count * 2), buf + 7);
+    benchmark::DoNotOptimize(ss.Contains(string_view{buf, size_t(end - buf)}));
+  }
+}
+BENCHMARK(BM_FindStringSet)->Arg(1000)->Arg(100000);
+
 }  // namespace dfly
@@ -45,7 +45,12 @@ void TaskQueue::TaskLoop() {
 
   auto cb = [&] {
     if (queue_.try_dequeue(func)) {
-      push_ec_.notify();
+      // Producers wait only when the queue is full, which is rare, so the notification is skipped
+      // unless one of them registered. The fence pairs with the one in Add(): either the producer
+      // sees the freed slot when it retries or we see the producer.
+      atomic_thread_fence(memory_order_seq_cst);
+      if (blocked_producers_.load(memory_order_relaxed) > 0)
+        push_ec_.notify();
       return true;
     }
 
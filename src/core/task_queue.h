@@ -43,6 +43,10 @@ class TaskQueue {
       return false;
     }
 
+    // The consumer notifies push_ec_ only while there are blocked producers, so the counter must be
+    // increased before retrying to add, see TaskLoop().
+    blocked_producers_.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
     bool result = false;
     while (true) {
       auto key = push_ec_.prepareWait();
@@ -53,6 +57,7 @@ class TaskQueue {
       result = true;
       push_ec_.wait(key.epoch());
     }
+    blocked_producers_.fetch_sub(1, std::memory_order_relaxed);
     return result;
   }
 
@@ -97,6 +102,7 @@ class TaskQueue {
   FuncQ queue_;
 
   util::fb2::EventCount push_ec_, pull_ec_;
+  std::atomic_uint32_t blocked_producers_{0};  // producers that found the queue full.
   std::atomic_bool is_closed_{false};
   unsigned num_consumers_;
   std::unique_ptr<util::fb2::Fiber[]> consumer_fiber_;
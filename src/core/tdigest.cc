@@ -0,0 +1,231 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/tdigest.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr double kNaN = numeric_limits<double>::quiet_NaN();
+
+// Value at weight pos on the line between the points a and b.
+double InterpolateValue(pair<double, double> a, pair<double, double> b, double pos) {
+  if (b.first == a.first)
+    return b.second;
+  return a.second + (pos - a.first) / (b.first - a.first) * (b.second - a.second);
+}
+
+// Weight at value val on the line between the points a and b.
+double InterpolateWeight(pair<double, double> a, pair<double, double> b, double val) {
+  if (b.second == a.second)
+    return b.first;
+  return a.first + (val - a.second) / (b.second - a.second) * (b.first - a.first);
+}
+
+}  // namespace
+
+TDigest::TDigest(double compression, PMR_NS::memory_resource* mr)
+    : compression_(compression), capacity_(Capacity(compression)), mr_(mr) {
+  DCHECK_GT(compression, 0);
+  means_ = static_cast<double*>(mr_->allocate(DataSize(), alignof(double)));
+  weights_ = means_ + capacity_;
+}
+
+TDigest::TDigest(double compression, const State& state, PMR_NS::memory_resource* mr)
+    : TDigest(compression, mr) {
+  size_t nodes = state.merged_nodes + state.unmerged_nodes;
+  DCHECK_LE(nodes, capacity_);
+  DCHECK_EQ(state.means.size(), nodes * sizeof(double));
+  DCHECK_EQ(state.weights.size(), nodes * sizeof(double));
+
+  memcpy(means_, state.means.data(), state.means.size());
+  memcpy(weights_, state.weights.data(), state.weights.size());
+  merged_ = state.merged_nodes;
+  unmerged_ = state.unmerged_nodes;
+  for (size_t i = 0; i < nodes; ++i)
+    (i < merged_ ? merged_weight_ : unmerged_weight_) += weights_[i];
+  // An empty digest is saved with NaN extremes.
+  if (nodes > 0) {
+    min_ = state.min;
+    max_ = state.max;
+  }
+  total_compressions_ = state.total_compressions;
+}
+
+TDigest::~TDigest() {
+  mr_->deallocate(means_, DataSize(), alignof(double));
+}
+
+void TDigest::Add(double value, double weight) {
+  if (merged_ + unmerged_ == capacity_)
+    Compress();
+
+  size_t pos = merged_ + unmerged_;
+  means_[pos] = value;
+  weights_[pos] = weight;
+  ++unmerged_;
+  unmerged_weight_ += weight;
+  min_ = std::min(min_, value);
+  max_ = std::max(max_, value);
+}
+
+void TDigest::Merge(const TDigest& src) {
+  for (size_t i = 0; i < src.merged_ + src.unmerged_; ++i)
+    Add(src.means_[i], src.weights_[i]);
+
+  // The centroids of src do not carry its extremes.
+  if (src.merged_weight_ + src.unmerged_weight_ > 0) {
+    min_ = std::min(min_, src.min_);
+    max_ = std::max(max_, src.max_);
+  }
+}
+
+void TDigest::Reset() {
+  merged_ = unmerged_ = 0;
+  merged_weight_ = unmerged_weight_ = 0;
+  min_ = numeric_limits<double>::max();
+  max_ = numeric_limits<double>::lowest();
+  total_compressions_ = 0;
+}
+
+void TDigest::Compress() {
+  if (unmerged_ == 0)
+    return;
+
+  // The centroids are sorted already, so only the buffer is sorted before merging them.
+  size_t nodes = merged_ + unmerged_;
+  vector<pair<double, double>> sorted(nodes);
+  for (size_t i = 0; i < nodes; ++i)
+    sorted[i] = {means_[i], weights_[i]};
+
+  auto by_mean = [](const auto& l, const auto& r) { return l.first < r.first; };
+  sort(sorted.begin() + merged_, sorted.end(), by_mean);
+  inplace_merge(sorted.begin(), sorted.begin() + merged_, sorted.end(), by_mean);
+
+  // A centroid grows while its weight stays within a bound proportional to q * (1 - q) at both
+  // of its ends, so the centroids near the extremes stay small.
+  double total = merged_weight_ + unmerged_weight_;
+  double normalizer = compression_ / (2 * M_PI * total * log(total));
+  double weight_so_far = 0;
+  size_t cur = 0;
+  means_[0] = sorted[0].first;
+  weights_[0] = sorted[0].second;
+  for (size_t i = 1; i < nodes; ++i) {
+    auto [mean, weight] = sorted[i];
+    double proposed = weights_[cur] + weight;
+    double z = proposed * normalizer;
+    double q0 = weight_so_far / total;
+    double q2 = (weight_so_far + proposed) / total;
+
+    if (z <= q0 * (1 - q0) && z <= q2 * (1 - q2)) {
+      weights_[cur] = proposed;
+      means_[cur] += (mean - means_[cur]) * weight / proposed;
+    } else {
+      weight_so_far += weights_[cur];
+      ++cur;
+      means_[cur] = mean;
+      weights_[cur] = weight;
+    }
+  }
+
+  merged_ = cur + 1;
+  unmerged_ = 0;
+  merged_weight_ = total;
+  unmerged_weight_ = 0;
+  ++total_compressions_;
+  DCHECK_LT(merged_, capacity_);
+}
+
+vector<pair<double, double>> TDigest::Points() const {
+  vector<pair<double, double>> points;
+  points.reserve(2 * merged_ + 2);
+  points.emplace_back(0, min_);
+
+  double cum = 0;
+  for (size_t i = 0; i < merged_; ++i) {
+    if (weights_[i] == 1) {
+      points.emplace_back(cum, means_[i]);
+      points.emplace_back(cum + 1, means_[i]);
+    } else {
+      points.emplace_back(cum + weights_[i] / 2, means_[i]);
+    }
+    cum += weights_[i];
+  }
+
+  points.emplace_back(cum, max_);
+  return points;
+}
+
+double TDigest::Quantile(double q) {
+  DCHECK(q >= 0 && q <= 1);
+  Compress();
+  if (merged_ == 0)
+    return kNaN;
+
+  double index = q * merged_weight_;
+  auto points = Points();
+  auto next = upper_bound(points.begin(), points.end(), index,
+                          [](double pos, const auto& point) { return pos < point.first; });
+  if (next == points.end())
+    return max_;
+  if (next == points.begin())
+    return min_;
+  return InterpolateValue(*(next - 1), *next, index);
+}
+
+double TDigest::Cdf(double value) {
+  Compress();
+  if (merged_ == 0)
+    return kNaN;
+  if (value < min_)
+    return 0;
+  if (value > max_)
+    return 1;
+
+  // Where several points have the value, it is the middle of the weight range they span.
+  auto points = Points();
+  auto first = lower_bound(points.begin(), points.end(), value,
+                           [](const auto& point, double val) { return point.second < val; });
+  auto last = upper_bound(points.begin(), points.end(), value,
+                          [](double val, const auto& point) { return val < point.second; });
+  DCHECK(first != points.end() && last != points.begin());
+
+  double low = first->second == value ? first->first
+                                       : InterpolateWeight(*(first - 1), *first, value);
+  double high = (last - 1)->second == value ? (last - 1)->first
+                                            : InterpolateWeight(*(last - 1), *last, value);
+  return (low + high) / 2 / merged_weight_;
+}
+
+double TDigest::TrimmedMean(double low, double high) {
+  DCHECK(low >= 0 && low < high && high <= 1);
+  Compress();
+  if (merged_ == 0)
+    return kNaN;
+
+  // Each centroid contributes its mean with the part of its weight within the range.
+  double low_pos = low * merged_weight_, high_pos = high * merged_weight_;
+  double sum = 0, weight = 0;
+  double cum = 0;
+  for (size_t i = 0; i < merged_ && cum < high_pos; ++i) {
+    double overlap = std::min(cum + weights_[i], high_pos) - std::max(cum, low_pos);
+    if (overlap > 0) {
+      sum += means_[i] * overlap;
+      weight += overlap;
+    }
+    cum += weights_[i];
+  }
+  return weight > 0 ? sum / weight : kNaN;
+}
+
+}  // namespace dfly
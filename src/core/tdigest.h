@@ -0,0 +1,156 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Merging t-digest, https://arxiv.org/abs/1902.04023
+// Estimates the quantiles of a stream of values with centroids, weighted means of neighbouring
+// values, the same way RedisBloom does. Added values are buffered after the centroids, and once
+// the buffer is full they are sorted and merged with them. The centroids near the extremes are
+// kept small, so the estimates of extreme quantiles are the most accurate. The means and weights
+// are kept in two flat arrays of a single allocation.
+class TDigest {
+  TDigest(const TDigest&) = delete;
+  TDigest& operator=(const TDigest&) = delete;
+
+ public:
+  static constexpr double kDefaultCompression = 100;
+  static constexpr double kMaxCompression = 100000;
+
+  // The persisted state, without the buffer sizes, which are derived from the compression.
+  struct State {
+    double min, max;
+    size_t merged_nodes, unmerged_nodes;
+    uint64_t total_compressions;
+    std::string_view means, weights;  // blobs returned by means_data() and weights_data().
+  };
+
+  TDigest(double compression, PMR_NS::memory_resource* mr);
+
+  // C'tor used for loading persisted digests.
+  TDigest(double compression, const State& state, PMR_NS::memory_resource* mr);
+  ~TDigest();
+
+  // Number of centroids and buffered values that a digest of the compression holds.
+  static size_t Capacity(double compression) {
+    return 6 * compression + 10;
+  }
+
+  void Add(double value, double weight = 1);
+
+  // Adds the centroids and the buffered values of src.
+  void Merge(const TDigest& src);
+
+  void Reset();
+
+  // Queries merge the buffered values first, so they are not const.
+  // They return NaN for an empty digest.
+
+  // Estimated value at the quantile, which must be in [0, 1].
+  double Quantile(double q);
+
+  // Estimated fraction of the values that are smaller than value, plus half of the fraction of
+  // the values that are equal to it.
+  double Cdf(double value);
+
+  // Estimated mean of the values between the quantiles low and high, with low < high.
+  double TrimmedMean(double low, double high);
+
+  bool empty() const {
+    return merged_ + unmerged_ == 0;
+  }
+
+  double min() const {
+    return empty() ? std::numeric_limits<double>::quiet_NaN() : min_;
+  }
+
+  double max() const {
+    return empty() ? std::numeric_limits<double>::quiet_NaN() : max_;
+  }
+
+  double compression() const {
+    return compression_;
+  }
+
+  size_t capacity() const {
+    return capacity_;
+  }
+
+  size_t merged_nodes() const {
+    return merged_;
+  }
+
+  size_t unmerged_nodes() const {
+    return unmerged_;
+  }
+
+  double merged_weight() const {
+    return merged_weight_;
+  }
+
+  double unmerged_weight() const {
+    return unmerged_weight_;
+  }
+
+  // The number of added values.
+  double total_weight() const {
+    return merged_weight_ + unmerged_weight_;
+  }
+
+  uint64_t total_compressions() const {
+    return total_compressions_;
+  }
+
+  std::string_view means_data() const {
+    return {reinterpret_cast<const char*>(means_), (merged_ + unmerged_) * sizeof(double)};
+  }
+
+  std::string_view weights_data() const {
+    return {reinterpret_cast<const char*>(weights_), (merged_ + unmerged_) * sizeof(double)};
+  }
+
+  State GetState() const {
+    return {min(), max(), merged_, unmerged_, total_compressions_, means_data(), weights_data()};
+  }
+
+  size_t MallocUsed() const {
+    return DataSize() + sizeof(TDigest);
+  }
+
+ private:
+  size_t DataSize() const {
+    return 2 * capacity_ * sizeof(double);
+  }
+
+  // Sorts the buffered values and merges them with the centroids.
+  void Compress();
+
+  // The piecewise linear function from the cumulative weight to the value, as a list of
+  // {weight, value} points. It goes from {0, min} to {total weight, max} through the middle of
+  // each centroid, or through both ends of a centroid that holds a single value.
+  std::vector<std::pair<double, double>> Points() const;
+
+  double compression_;
+  size_t capacity_;
+  double* means_;
+  double* weights_;
+  size_t merged_ = 0, unmerged_ = 0;
+  double merged_weight_ = 0, unmerged_weight_ = 0;
+  double min_ = std::numeric_limits<double>::max();
+  double max_ = std::numeric_limits<double>::lowest();
+  uint64_t total_compressions_ = 0;
+  PMR_NS::memory_resource* mr_;
+};
+
+}  // namespace dfly
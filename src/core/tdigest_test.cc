@@ -0,0 +1,98 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/tdigest.h"
+
+#include <cmath>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class TDigestTest : public ::testing::Test {
+ protected:
+  PMR_NS::memory_resource* mr_ = PMR_NS::get_default_resource();
+};
+
+TEST_F(TDigestTest, Basic) {
+  TDigest td(TDigest::kDefaultCompression, mr_);
+  EXPECT_TRUE(isnan(td.Quantile(0.5)));
+  EXPECT_TRUE(isnan(td.Cdf(1)));
+  EXPECT_TRUE(isnan(td.min()));
+
+  td.Add(5);
+  EXPECT_EQ(5, td.Quantile(0));
+  EXPECT_EQ(5, td.Quantile(1));
+  EXPECT_EQ(0.5, td.Cdf(5));
+  EXPECT_EQ(0, td.Cdf(4));
+  EXPECT_EQ(1, td.Cdf(6));
+
+  for (double v : {1, 2, 3, 4})
+    td.Add(v);
+  EXPECT_EQ(1, td.min());
+  EXPECT_EQ(5, td.max());
+  EXPECT_EQ(1, td.Quantile(0));
+  EXPECT_EQ(3, td.Quantile(0.5));
+  EXPECT_EQ(5, td.Quantile(1));
+  EXPECT_DOUBLE_EQ(0.5, td.Cdf(3));
+  EXPECT_DOUBLE_EQ(3, td.TrimmedMean(0, 1));
+  EXPECT_DOUBLE_EQ(3, td.TrimmedMean(0.2, 0.8));
+  EXPECT_DOUBLE_EQ(4.5, td.TrimmedMean(0.6, 1));
+  EXPECT_EQ(2, td.total_compressions());
+
+  td.Reset();
+  EXPECT_TRUE(td.empty());
+  EXPECT_TRUE(isnan(td.max()));
+}
+
+TEST_F(TDigestTest, Accuracy) {
+  constexpr int kNum = 100000;
+  TDigest td(TDigest::kDefaultCompression, mr_);
+  for (int i = 0; i < kNum; ++i)
+    td.Add(i * 7919 % kNum);
+
+  EXPECT_GT(td.total_compressions(), 1u);
+  EXPECT_LE(td.merged_nodes() + td.unmerged_nodes(), td.capacity());
+  for (double q : {0.001, 0.01, 0.1, 0.5, 0.9, 0.99, 0.999}) {
+    EXPECT_NEAR(q * kNum, td.Quantile(q), kNum * 0.005) << q;
+    EXPECT_NEAR(q, td.Cdf(q * kNum), 0.005) << q;
+  }
+  EXPECT_EQ(0, td.Quantile(0));
+  EXPECT_EQ(kNum - 1, td.Quantile(1));
+  EXPECT_NEAR(kNum / 2, td.TrimmedMean(0.1, 0.9), kNum * 0.005);
+}
+
+TEST_F(TDigestTest, Merge) {
+  TDigest low(50, mr_), high(50, mr_);
+  for (int i = 0; i < 1000; ++i) {
+    low.Add(i);
+    high.Add(1000 + i);
+  }
+
+  TDigest td(TDigest::kDefaultCompression, mr_);
+  td.Merge(low);
+  td.Merge(high);
+  EXPECT_EQ(0, td.min());
+  EXPECT_EQ(1999, td.max());
+  EXPECT_EQ(2000, td.total_weight());
+  EXPECT_NEAR(1000, td.Quantile(0.5), 20);
+  EXPECT_NEAR(0.25, td.Cdf(500), 0.01);
+}
+
+TEST_F(TDigestTest, Load) {
+  TDigest td(20, mr_);
+  for (int i = 0; i < 1000; ++i)
+    td.Add(i % 100);
+
+  TDigest loaded(td.compression(), td.GetState(), mr_);
+  EXPECT_EQ(td.merged_weight(), loaded.merged_weight());
+  EXPECT_EQ(td.unmerged_weight(), loaded.unmerged_weight());
+  EXPECT_EQ(td.total_compressions(), loaded.total_compressions());
+  for (double q : {0.0, 0.1, 0.5, 0.9, 1.0})
+    EXPECT_EQ(td.Quantile(q), loaded.Quantile(q)) << q;
+}
+
+}  // namespace dfly
@@ -0,0 +1,395 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/time_series.h"
+
+#include <absl/numeric/bits.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+uint64_t ToBits(double val) {
+  uint64_t res;
+  memcpy(&res, &val, sizeof(res));
+  return res;
+}
+
+double FromBits(uint64_t bits) {
+  double res;
+  memcpy(&res, &bits, sizeof(res));
+  return res;
+}
+
+uint64_t ZigZag(int64_t val) {
+  return (uint64_t(val) << 1) ^ uint64_t(val >> 63);
+}
+
+int64_t UnZigZag(uint64_t val) {
+  return int64_t(val >> 1) ^ -int64_t(val & 1);
+}
+
+// Delta of delta buckets: the control prefix of the bucket and the width of its value.
+// The prefix of bucket i is i ones followed by a zero, the last bucket has no zero.
+constexpr unsigned kDodWidths[] = {0, 7, 9, 12, 64};
+constexpr unsigned kNumDodBuckets = size(kDodWidths);
+
+int64_t BucketStart(int64_t ts, int64_t bucket_ms) {
+  return ts - ts % bucket_ms;
+}
+
+struct Accumulator {
+  int64_t start = 0;
+  uint32_t count = 0;
+  double sum = 0, min = 0, max = 0;
+
+  void Add(uint32_t cnt, double s, double mn, double mx) {
+    if (count == 0) {
+      min = mn;
+      max = mx;
+    } else {
+      min = std::min(min, mn);
+      max = std::max(max, mx);
+    }
+    count += cnt;
+    sum += s;
+  }
+
+  double Result(TsAggregation agg) const {
+    switch (agg) {
+      case TsAggregation::AVG:
+        return sum / count;
+      case TsAggregation::MIN:
+        return min;
+      case TsAggregation::MAX:
+        return max;
+      case TsAggregation::SUM:
+        return sum;
+      case TsAggregation::COUNT:
+        return count;
+    }
+    return 0;
+  }
+};
+
+}  // namespace
+
+class TimeSeries::BitReader {
+ public:
+  explicit BitReader(const Chunk& chunk) : chunk_(chunk) {
+  }
+
+  // Reads len bits, most significant first. Returns false when reading past the end.
+  bool Read(unsigned len, uint64_t* res) {
+    if (pos_ + len > chunk_.bit_len)
+      return false;
+
+    uint64_t val = 0;
+    while (len > 0) {
+      unsigned off = pos_ % 8;
+      unsigned take = min(8 - off, len);
+      uint8_t byte = chunk_.data[pos_ / 8];
+      uint64_t bits = (byte >> (8 - off - take)) & ((1u << take) - 1);
+      val = (val << take) | bits;
+      pos_ += take;
+      len -= take;
+    }
+    *res = val;
+    return true;
+  }
+
+  // Counts the leading ones, up to max.
+  bool ReadPrefix(unsigned max, unsigned* res) {
+    unsigned ones = 0;
+    uint64_t bit = 1;
+    while (ones < max) {
+      if (!Read(1, &bit))
+        return false;
+      if (bit == 0)
+        break;
+      ++ones;
+    }
+    *res = ones;
+    return true;
+  }
+
+ private:
+  const Chunk& chunk_;
+  uint64_t pos_ = 0;
+};
+
+TimeSeries::TimeSeries(PMR_NS::memory_resource* mr, uint32_t chunk_bytes)
+    : chunks_(mr), chunk_bytes_(chunk_bytes) {
+}
+
+void TimeSeries::WriteBits(Chunk* chunk, uint64_t bits, unsigned len) {
+  while (len > 0) {
+    unsigned off = chunk->bit_len % 8;
+    if (off == 0)
+      chunk->data.push_back(0);
+
+    unsigned take = min(8 - off, len);
+    uint8_t part = (bits >> (len - take)) & ((1u << take) - 1);
+    chunk->data.back() |= part << (8 - off - take);
+    chunk->bit_len += take;
+    len -= take;
+  }
+}
+
+void TimeSeries::AddStats(Chunk* chunk, double val) {
+  if (chunk->count == 0) {
+    chunk->min = chunk->max = val;
+  } else {
+    chunk->min = min(chunk->min, val);
+    chunk->max = max(chunk->max, val);
+  }
+  chunk->sum += val;
+  ++chunk->count;
+}
+
+void TimeSeries::Append(Chunk* chunk, int64_t ts, double val) {
+  if (chunk->count == 0) {
+    WriteBits(chunk, ts, 64);
+    WriteBits(chunk, ToBits(val), 64);
+    chunk->first_ts = ts;
+  } else {
+    int64_t delta = ts - chunk->last_ts;
+    uint64_t dod = ZigZag(delta - chunk->last_delta);
+    chunk->last_delta = delta;
+
+    unsigned bucket = 0;
+    if (dod != 0) {
+      bucket = 1;
+      while (kDodWidths[bucket] < 64 && (dod >> kDodWidths[bucket]) != 0)
+        ++bucket;
+    }
+
+    bool last_bucket = bucket + 1 == kNumDodBuckets;
+    WriteBits(chunk, last_bucket ? (1u << bucket) - 1 : ((1u << bucket) - 1) << 1,
+              last_bucket ? bucket : bucket + 1);
+    WriteBits(chunk, dod, kDodWidths[bucket]);
+
+    uint64_t x = ToBits(val) ^ ToBits(chunk->last_val);
+    if (x == 0) {
+      WriteBits(chunk, 0, 1);
+    } else {
+      unsigned lead = min(absl::countl_zero(x), 31);
+      unsigned trail = absl::countr_zero(x);
+      if (chunk->lead != UINT8_MAX && lead >= chunk->lead && trail >= chunk->trail) {
+        // Fits the window of the previous value.
+        WriteBits(chunk, 0b10, 2);
+        WriteBits(chunk, x >> chunk->trail, 64 - chunk->lead - chunk->trail);
+      } else {
+        unsigned meaningful = 64 - lead - trail;
+        WriteBits(chunk, 0b11, 2);
+        WriteBits(chunk, lead, 5);
+        WriteBits(chunk, meaningful - 1, 6);
+        WriteBits(chunk, x >> trail, meaningful);
+        chunk->lead = lead;
+        chunk->trail = trail;
+      }
+    }
+  }
+
+  chunk->last_ts = ts;
+  chunk->last_val = val;
+  AddStats(chunk, val);
+}
+
+bool TimeSeries::Add(int64_t ts, double val) {
+  if (!chunks_.empty() && ts <= chunks_.back().last_ts)
+    return false;
+
+  if (chunks_.empty() || chunks_.back().data.size() >= chunk_bytes_) {
+    if (!chunks_.empty())
+      chunks_.back().data.shrink_to_fit();  // the chunk is complete.
+    chunks_.emplace_back(chunks_.get_allocator().resource());
+  }
+
+  Append(&chunks_.back(), ts, val);
+  ++size_;
+  return true;
+}
+
+auto TimeSeries::Last() const -> optional<Sample> {
+  if (chunks_.empty())
+    return nullopt;
+  return Sample{chunks_.back().last_ts, chunks_.back().last_val};
+}
+
+int64_t TimeSeries::first_ts() const {
+  return chunks_.empty() ? 0 : chunks_.front().first_ts;
+}
+
+bool TimeSeries::Decode(const Chunk& chunk, absl::FunctionRef<bool(Sample)> cb) {
+  BitReader reader(chunk);
+  uint64_t bits;
+  if (!reader.Read(64, &bits))
+    return false;
+  int64_t ts = bits;
+  if (!reader.Read(64, &bits))
+    return false;
+  uint64_t val = bits;
+
+  int64_t delta = 0;
+  unsigned lead = 0, trail = 0;
+  bool has_window = false;
+  for (uint32_t i = 0;; ++i) {
+    if (!cb(Sample{ts, FromBits(val)}))
+      return true;
+    if (i + 1 == chunk.count)
+      return true;
+
+    unsigned bucket;
+    if (!reader.ReadPrefix(kNumDodBuckets - 1, &bucket) ||
+        !reader.Read(kDodWidths[bucket], &bits))
+      return false;
+    delta += UnZigZag(bits);
+    ts += delta;
+
+    unsigned ctrl;
+    if (!reader.ReadPrefix(2, &ctrl))
+      return false;
+    if (ctrl == 0)
+      continue;
+
+    if (ctrl == 2) {
+      uint64_t meaningful;
+      if (!reader.Read(5, &bits) || !reader.Read(6, &meaningful))
+        return false;
+      lead = bits;
+      if (lead + meaningful + 1 > 64)
+        return false;
+      trail = 64 - lead - meaningful - 1;
+      has_window = true;
+    } else if (!has_window) {
+      return false;
+    }
+
+    if (!reader.Read(64 - lead - trail, &bits))
+      return false;
+    val ^= bits << trail;
+  }
+}
+
+void TimeSeries::Range(int64_t from, int64_t to, absl::FunctionRef<void(Sample)> cb) const {
+  for (const Chunk& chunk : chunks_) {
+    if (chunk.last_ts < from)
+      continue;
+    if (chunk.first_ts > to)
+      break;
+
+    Decode(chunk, [&](Sample s) {
+      if (s.ts > to)
+        return false;
+      if (s.ts >= from)
+        cb(s);
+      return true;
+    });
+  }
+}
+
+void TimeSeries::Aggregate(int64_t from, int64_t to, TsAggregation agg, int64_t bucket_ms,
+                           absl::FunctionRef<void(Sample)> cb) const {
+  DCHECK_GT(bucket_ms, 0);
+
+  Accumulator acc;
+  auto add = [&](int64_t start, uint32_t count, double sum, double min, double max) {
+    if (acc.count > 0 && acc.start != start) {
+      cb(Sample{acc.start, acc.Result(agg)});
+      acc = Accumulator{};
+    }
+    acc.start = start;
+    acc.Add(count, sum, min, max);
+  };
+
+  for (const Chunk& chunk : chunks_) {
+    if (chunk.last_ts < from)
+      continue;
+    if (chunk.first_ts > to)
+      break;
+
+    int64_t start = BucketStart(chunk.first_ts, bucket_ms);
+    if (chunk.first_ts >= from && chunk.last_ts <= to &&
+        start == BucketStart(chunk.last_ts, bucket_ms)) {
+      add(start, chunk.count, chunk.sum, chunk.min, chunk.max);
+      continue;
+    }
+
+    Decode(chunk, [&](Sample s) {
+      if (s.ts > to)
+        return false;
+      if (s.ts >= from)
+        add(BucketStart(s.ts, bucket_ms), 1, s.val, s.val, s.val);
+      return true;
+    });
+  }
+
+  if (acc.count > 0)
+    cb(Sample{acc.start, acc.Result(agg)});
+}
+
+auto TimeSeries::GetChunk(size_t idx) const -> ChunkBlob {
+  const Chunk& chunk = chunks_[idx];
+  return ChunkBlob{chunk.count, chunk.bit_len,
+                   {reinterpret_cast<const char*>(chunk.data.data()), chunk.data.size()}};
+}
+
+bool TimeSeries::LoadChunk(const ChunkBlob& blob) {
+  if (blob.count == 0 || blob.bit_len > blob.data.size() * 8 ||
+      blob.data.size() != (blob.bit_len + 7) / 8)
+    return false;
+
+  Chunk& chunk = chunks_.emplace_back(chunks_.get_allocator().resource());
+  chunk.data.assign(blob.data.begin(), blob.data.end());
+  chunk.bit_len = blob.bit_len;
+  chunk.count = blob.count;
+
+  // Replays the samples to restore the stats and the encoder state.
+  Chunk decoded(PMR_NS::get_default_resource());
+  int64_t prev_ts = chunks_.size() > 1 ? chunks_[chunks_.size() - 2].last_ts : INT64_MIN;
+  bool ordered = true;
+  bool valid = Decode(chunk, [&](Sample s) {
+    if (s.ts <= prev_ts) {
+      ordered = false;
+      return false;
+    }
+    prev_ts = s.ts;
+    Append(&decoded, s.ts, s.val);
+    return true;
+  });
+
+  if (!valid || !ordered || decoded.count != chunk.count || decoded.bit_len != chunk.bit_len) {
+    chunks_.pop_back();
+    return false;
+  }
+
+  chunk.first_ts = decoded.first_ts;
+  chunk.last_ts = decoded.last_ts;
+  chunk.last_delta = decoded.last_delta;
+  chunk.last_val = decoded.last_val;
+  chunk.lead = decoded.lead;
+  chunk.trail = decoded.trail;
+  chunk.sum = decoded.sum;
+  chunk.min = decoded.min;
+  chunk.max = decoded.max;
+  size_ += chunk.count;
+  return true;
+}
+
+size_t TimeSeries::MallocUsed() const {
+  size_t res = chunks_.capacity() * sizeof(Chunk);
+  for (const Chunk& chunk : chunks_)
+    res += chunk.data.capacity();
+  return res;
+}
+
+}  // namespace dfly
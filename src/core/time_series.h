@@ -0,0 +1,115 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+enum class TsAggregation : uint8_t { AVG, MIN, MAX, SUM, COUNT };
+
+// Series of (timestamp, value) samples with increasing timestamps.
+//
+// Samples are compressed into chunks of about chunk_bytes bytes, following the Gorilla paper,
+// https://www.vldb.org/pvldb/vol8/p1816-teller.pdf: timestamps are encoded as the delta of their
+// deltas and values as the XOR with the previous value, so regular series take a few bits
+// per sample. Every chunk also keeps the count, sum, min and max of its values, which answer
+// the aggregations of the chunks that fall within a single bucket without decoding them.
+class TimeSeries {
+  TimeSeries(const TimeSeries&) = delete;
+  TimeSeries& operator=(const TimeSeries&) = delete;
+
+ public:
+  static constexpr uint32_t kDefaultChunkBytes = 4096;
+
+  struct Sample {
+    int64_t ts;
+    double val;
+  };
+
+  // A compressed chunk as written to snapshots.
+  struct ChunkBlob {
+    uint32_t count;
+    uint64_t bit_len;
+    std::string_view data;
+  };
+
+  explicit TimeSeries(PMR_NS::memory_resource* mr, uint32_t chunk_bytes = kDefaultChunkBytes);
+
+  // Appends a sample, returns false if ts is not greater than the timestamp of the last sample.
+  bool Add(int64_t ts, double val);
+
+  std::optional<Sample> Last() const;
+
+  // Calls cb for the samples with timestamps in [from, to].
+  void Range(int64_t from, int64_t to, absl::FunctionRef<void(Sample)> cb) const;
+
+  // Calls cb with the aggregation of the samples in [from, to] for every non empty bucket
+  // of bucket_ms, aligned to 0. The timestamp of a bucket is its start.
+  void Aggregate(int64_t from, int64_t to, TsAggregation agg, int64_t bucket_ms,
+                 absl::FunctionRef<void(Sample)> cb) const;
+
+  size_t size() const {
+    return size_;
+  }
+
+  int64_t first_ts() const;
+
+  uint32_t chunk_bytes() const {
+    return chunk_bytes_;
+  }
+
+  size_t num_chunks() const {
+    return chunks_.size();
+  }
+
+  ChunkBlob GetChunk(size_t idx) const;
+
+  // Appends a chunk returned by GetChunk, returns false if it is malformed or does not follow
+  // the last sample.
+  bool LoadChunk(const ChunkBlob& blob);
+
+  size_t MallocUsed() const;
+
+ private:
+  struct Chunk {
+    explicit Chunk(PMR_NS::memory_resource* mr) : data(mr) {
+    }
+
+    // Encoder state, so that samples can be appended.
+    int64_t first_ts = 0, last_ts = 0, last_delta = 0;
+    double last_val = 0;
+    uint8_t lead = UINT8_MAX, trail = 0;  // meaningful bits window of the last XOR.
+
+    uint32_t count = 0;
+    double sum = 0, min = 0, max = 0;
+
+    uint64_t bit_len = 0;
+    std::vector<uint8_t, PMR_NS::polymorphic_allocator<uint8_t>> data;
+  };
+
+  class BitReader;
+
+  static void Append(Chunk* chunk, int64_t ts, double val);
+  static void AddStats(Chunk* chunk, double val);
+  static void WriteBits(Chunk* chunk, uint64_t bits, unsigned len);
+
+  // Decodes all the samples of the chunk, stops early if cb returns false.
+  // Returns false if the chunk is malformed.
+  static bool Decode(const Chunk& chunk, absl::FunctionRef<bool(Sample)> cb);
+
+  std::vector<Chunk, PMR_NS::polymorphic_allocator<Chunk>> chunks_;
+  size_t size_ = 0;
+  uint32_t chunk_bytes_;
+};
+
+}  // namespace dfly
@@ -0,0 +1,144 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/time_series.h"
+
+#include <cmath>
+#include <random>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+using Sample = TimeSeries::Sample;
+
+class TimeSeriesTest : public ::testing::Test {
+ protected:
+  // Fills ts with irregular samples, returns them.
+  vector<Sample> Fill(TimeSeries* ts, unsigned num);
+
+  vector<Sample> All(const TimeSeries& ts) {
+    vector<Sample> res;
+    ts.Range(INT64_MIN, INT64_MAX, [&](Sample s) { res.push_back(s); });
+    return res;
+  }
+
+  PMR_NS::memory_resource* mr_ = PMR_NS::get_default_resource();
+};
+
+vector<Sample> TimeSeriesTest::Fill(TimeSeries* ts, unsigned num) {
+  mt19937 rng(1);
+  vector<Sample> res;
+  int64_t t = 1000;
+  for (unsigned i = 0; i < num; ++i) {
+    t += (i % 7 == 0) ? rng() % 100000 : 1000;
+    double val = (i % 3 == 0) ? double(rng() % 100) : sin(i) * 1e6;
+    if (i % 11 == 0 && !res.empty())
+      val = res.back().val;
+    EXPECT_TRUE(ts->Add(t, val));
+    res.push_back({t, val});
+  }
+  return res;
+}
+
+static bool operator==(const Sample& a, const Sample& b) {
+  return a.ts == b.ts && a.val == b.val;
+}
+
+TEST_F(TimeSeriesTest, Basic) {
+  TimeSeries ts(mr_);
+  EXPECT_FALSE(ts.Last());
+  EXPECT_TRUE(ts.Add(10, 1.5));
+  EXPECT_TRUE(ts.Add(20, -3));
+  EXPECT_FALSE(ts.Add(20, 1));
+  EXPECT_FALSE(ts.Add(5, 1));
+
+  EXPECT_EQ(2, ts.size());
+  EXPECT_EQ(10, ts.first_ts());
+  EXPECT_EQ(20, ts.Last()->ts);
+  EXPECT_EQ(-3, ts.Last()->val);
+
+  vector<Sample> res;
+  ts.Range(15, 100, [&](Sample s) { res.push_back(s); });
+  ASSERT_EQ(1, res.size());
+  EXPECT_EQ(20, res[0].ts);
+}
+
+TEST_F(TimeSeriesTest, RoundTrip) {
+  TimeSeries ts(mr_, 256);
+  vector<Sample> samples = Fill(&ts, 10000);
+  EXPECT_GT(ts.num_chunks(), 1);
+  EXPECT_EQ(samples, All(ts));
+}
+
+TEST_F(TimeSeriesTest, Compression) {
+  TimeSeries ts(mr_);
+  for (unsigned i = 0; i < 10000; ++i)
+    ts.Add(i * 1000, 20.0 + i % 10);
+
+  // A regular series takes about a byte per sample, compared to 16 bytes uncompressed.
+  EXPECT_LT(ts.MallocUsed(), 2 * ts.size());
+}
+
+TEST_F(TimeSeriesTest, Aggregate) {
+  TimeSeries ts(mr_, 256);
+  vector<Sample> samples = Fill(&ts, 10000);
+
+  const int64_t from = samples[100].ts, to = samples[9000].ts, bucket = 60000;
+  vector<Sample> expected;
+  for (const Sample& s : samples) {
+    if (s.ts < from || s.ts > to)
+      continue;
+    int64_t start = s.ts - s.ts % bucket;
+    if (expected.empty() || expected.back().ts != start)
+      expected.push_back({start, 0});
+    expected.back().val += s.val;
+  }
+
+  vector<Sample> res;
+  ts.Aggregate(from, to, TsAggregation::SUM, bucket, [&](Sample s) { res.push_back(s); });
+  ASSERT_EQ(expected.size(), res.size());
+  for (size_t i = 0; i < res.size(); ++i) {
+    EXPECT_EQ(expected[i].ts, res[i].ts);
+    EXPECT_NEAR(expected[i].val, res[i].val, 1e-3 * max(1.0, fabs(expected[i].val)));
+  }
+
+  // A single bucket is answered from the chunk stats.
+  res.clear();
+  ts.Aggregate(0, INT64_MAX, TsAggregation::COUNT, INT64_MAX, [&](Sample s) { res.push_back(s); });
+  ASSERT_EQ(1, res.size());
+  EXPECT_EQ(samples.size(), res[0].val);
+}
+
+TEST_F(TimeSeriesTest, LoadChunk) {
+  TimeSeries ts(mr_, 256);
+  vector<Sample> samples = Fill(&ts, 5000);
+
+  TimeSeries loaded(mr_, 256);
+  for (size_t i = 0; i < ts.num_chunks(); ++i)
+    ASSERT_TRUE(loaded.LoadChunk(ts.GetChunk(i)));
+  EXPECT_EQ(samples, All(loaded));
+
+  // The loaded series can be appended to.
+  EXPECT_TRUE(loaded.Add(samples.back().ts + 1, 7));
+  EXPECT_EQ(7, loaded.Last()->val);
+
+  // Chunks must follow the last sample.
+  EXPECT_FALSE(loaded.LoadChunk(ts.GetChunk(0)));
+
+  // The samples must fill the chunk exactly.
+  TimeSeries other(mr_);
+  TimeSeries::ChunkBlob blob = ts.GetChunk(0);
+  ++blob.count;
+  EXPECT_FALSE(other.LoadChunk(blob));
+  blob.count -= 2;
+  EXPECT_FALSE(other.LoadChunk(blob));
+  blob.count = 0;
+  EXPECT_FALSE(other.LoadChunk(blob));
+  EXPECT_EQ(0, other.size());
+}
+
+}  // namespace dfly
@@ -0,0 +1,183 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/top_k.h"
+
+#include <absl/random/random.h>
+#include <xxhash.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+thread_local absl::InsecureBitGen tl_bitgen;
+
+inline uint32_t SaturatedAdd(uint32_t counter, uint32_t incr) {
+  return min<uint64_t>(uint64_t(counter) + incr, UINT32_MAX);
+}
+
+}  // namespace
+
+TopK::TopK(uint32_t k, uint32_t width, uint32_t depth, double decay, PMR_NS::memory_resource* mr)
+    : width_(width), depth_(depth), decay_(decay), heap_(mr), mr_(mr) {
+  DCHECK(k > 0 && width > 0 && depth > 0 && depth <= kMaxDepth);
+  buckets_ = static_cast<Bucket*>(mr_->allocate(DataSize(), alignof(Bucket)));
+  memset(buckets_, 0, DataSize());
+
+  heap_.reserve(k);
+  for (uint32_t i = 0; i < k; ++i)
+    heap_.push_back(HeapItem{0, 0, PMR_NS::string{mr}});
+}
+
+TopK::TopK(uint32_t k, uint32_t width, uint32_t depth, double decay, string_view buckets,
+           PMR_NS::memory_resource* mr)
+    : TopK(k, width, depth, decay, mr) {
+  DCHECK_EQ(buckets.size(), DataSize());
+  memcpy(buckets_, buckets.data(), DataSize());
+}
+
+TopK::~TopK() {
+  mr_->deallocate(buckets_, DataSize(), alignof(Bucket));
+}
+
+uint32_t TopK::Indices(string_view item, uint32_t* indices) const {
+  XXH128_hash_t hash = XXH3_128bits_withSeed(item.data(), item.size(), 0x9ae16a3b2f90404fULL);
+  for (uint32_t i = 0; i < depth_; ++i)
+    indices[i] = i * width_ + (hash.low64 + hash.high64 * i) % width_;
+  return hash.high64 >> 32;
+}
+
+size_t TopK::FindInHeap(uint32_t fp, string_view item) const {
+  for (size_t i = 0; i < heap_.size(); ++i) {
+    if (heap_[i].count > 0 && heap_[i].fp == fp && heap_[i].item == item)
+      return i;
+  }
+  return heap_.size();
+}
+
+void TopK::SiftDown(size_t pos) {
+  size_t n = heap_.size();
+  while (true) {
+    size_t smallest = pos, left = 2 * pos + 1, right = left + 1;
+    if (left < n && heap_[left].count < heap_[smallest].count)
+      smallest = left;
+    if (right < n && heap_[right].count < heap_[smallest].count)
+      smallest = right;
+    if (smallest == pos)
+      return;
+
+    swap(heap_[pos], heap_[smallest]);
+    pos = smallest;
+  }
+}
+
+optional<string> TopK::IncrBy(string_view item, uint32_t incr) {
+  uint32_t indices[kMaxDepth];
+  uint32_t fp = Indices(item, indices);
+
+  uint32_t max_count = 0;
+  for (uint32_t i = 0; i < depth_; ++i) {
+    Bucket& bucket = buckets_[indices[i]];
+    if (bucket.count == 0) {
+      bucket = {fp, incr};
+    } else if (bucket.fp == fp) {
+      bucket.count = SaturatedAdd(bucket.count, incr);
+    } else {
+      // Every occurrence decays the bucket of the other item, until it is taken over.
+      double chance = pow(decay_, bucket.count);
+      for (uint32_t left = incr; left > 0 && chance > 0; --left) {
+        if (absl::Uniform(tl_bitgen, 0.0, 1.0) >= chance)
+          continue;
+        if (--bucket.count == 0) {
+          bucket = {fp, left};
+          break;
+        }
+        chance = pow(decay_, bucket.count);
+      }
+    }
+
+    if (bucket.fp == fp)
+      max_count = max(max_count, bucket.count);
+  }
+
+  if (max_count == 0)
+    return nullopt;
+
+  if (size_t pos = FindInHeap(fp, item); pos < heap_.size()) {
+    heap_[pos].count = max(heap_[pos].count, max_count);
+    SiftDown(pos);
+    return nullopt;
+  }
+
+  if (max_count < heap_[0].count)
+    return nullopt;
+
+  optional<string> expelled;
+  if (heap_[0].count > 0)
+    expelled.emplace(heap_[0].item);
+
+  heap_[0].fp = fp;
+  heap_[0].count = max_count;
+  heap_[0].item.assign(item);
+  SiftDown(0);
+  return expelled;
+}
+
+bool TopK::Query(string_view item) const {
+  uint32_t indices[kMaxDepth];
+  uint32_t fp = Indices(item, indices);
+  return FindInHeap(fp, item) < heap_.size();
+}
+
+uint32_t TopK::Count(string_view item) const {
+  uint32_t indices[kMaxDepth];
+  uint32_t fp = Indices(item, indices);
+
+  uint32_t res = 0;
+  for (uint32_t i = 0; i < depth_; ++i) {
+    const Bucket& bucket = buckets_[indices[i]];
+    if (bucket.fp == fp)
+      res = max(res, bucket.count);
+  }
+  return res;
+}
+
+vector<pair<string_view, uint32_t>> TopK::List() const {
+  vector<pair<string_view, uint32_t>> res;
+  for (const HeapItem& hi : heap_) {
+    if (hi.count > 0)
+      res.emplace_back(hi.item, hi.count);
+  }
+
+  sort(res.begin(), res.end(), [](const auto& l, const auto& r) { return l.second > r.second; });
+  return res;
+}
+
+void TopK::LoadItem(string_view item, uint32_t count) {
+  // Empty slots have the lowest count, so they are at the top until the heap is full.
+  DCHECK(count > 0 && heap_[0].count == 0);
+
+  uint32_t indices[kMaxDepth];
+  heap_[0].fp = Indices(item, indices);
+  heap_[0].count = count;
+  heap_[0].item.assign(item);
+  SiftDown(0);
+}
+
+size_t TopK::MallocUsed() const {
+  size_t res = sizeof(TopK) + DataSize() + heap_.capacity() * sizeof(HeapItem);
+  for (const HeapItem& hi : heap_)
+    res += hi.item.capacity();
+  return res;
+}
+
+}  // namespace dfly
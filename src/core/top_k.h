@@ -0,0 +1,108 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "base/pmr/memory_resource.h"
+
+namespace dfly {
+
+// Top-K heavy hitters by HeavyKeeper, https://www.usenix.org/conference/atc18/presentation/gong
+// Keeps depth rows of width buckets in a single allocation, each bucket with the fingerprint of
+// an item and its count, and a min-heap of the k items with the largest counts, the same way
+// RedisBloom does. A bucket owned by another item decays with probability decay^count on every
+// increment, and the item takes it over once its count drops to zero.
+class TopK {
+  TopK(const TopK&) = delete;
+  TopK& operator=(const TopK&) = delete;
+
+ public:
+  // Limits the number of rows, so that the row indices of an item fit on the stack.
+  static constexpr uint32_t kMaxDepth = 64;
+
+  struct Bucket {
+    uint32_t fp;
+    uint32_t count;
+  };
+
+  TopK(uint32_t k, uint32_t width, uint32_t depth, double decay, PMR_NS::memory_resource* mr);
+
+  // C'tor used for loading persisted sketches, buckets is a blob returned by buckets_data().
+  // The heap is filled afterwards with LoadItem.
+  TopK(uint32_t k, uint32_t width, uint32_t depth, double decay, std::string_view buckets,
+       PMR_NS::memory_resource* mr);
+  ~TopK();
+
+  // Adds incr occurrences of the item. Returns the item it expelled from the top-k, if any.
+  std::optional<std::string> IncrBy(std::string_view item, uint32_t incr);
+
+  // Whether the item is among the top-k.
+  bool Query(std::string_view item) const;
+
+  // Estimated count of the item.
+  uint32_t Count(std::string_view item) const;
+
+  // The top-k items with their counts, sorted by descending count.
+  std::vector<std::pair<std::string_view, uint32_t>> List() const;
+
+  // Puts an item of a persisted sketch back into the heap.
+  void LoadItem(std::string_view item, uint32_t count);
+
+  uint32_t k() const {
+    return heap_.size();
+  }
+
+  uint32_t width() const {
+    return width_;
+  }
+
+  uint32_t depth() const {
+    return depth_;
+  }
+
+  double decay() const {
+    return decay_;
+  }
+
+  std::string_view buckets_data() const {
+    return {reinterpret_cast<const char*>(buckets_), DataSize()};
+  }
+
+  size_t MallocUsed() const;
+
+ private:
+  struct HeapItem {
+    uint32_t fp;
+    uint32_t count;  // 0 for an empty slot.
+    PMR_NS::string item;
+  };
+
+  size_t DataSize() const {
+    return size_t(width_) * depth_ * sizeof(Bucket);
+  }
+
+  // Returns the fingerprint of the item and fills its bucket index in each row.
+  uint32_t Indices(std::string_view item, uint32_t* indices) const;
+
+  // Returns the index of the item in the heap or heap_.size() if it is not there.
+  size_t FindInHeap(uint32_t fp, std::string_view item) const;
+
+  // Restores the heap order below the item at pos, whose count increased.
+  void SiftDown(size_t pos);
+
+  uint32_t width_, depth_;
+  double decay_;
+  Bucket* buckets_;
+  PMR_NS::vector<HeapItem> heap_;  // min-heap by count, heap_[0] is the next to be expelled.
+  PMR_NS::memory_resource* mr_;
+};
+
+}  // namespace dfly
@@ -0,0 +1,77 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "core/top_k.h"
+
+#include <absl/strings/str_cat.h>
+#include <gmock/gmock.h>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+
+class TopKTest : public ::testing::Test {
+ protected:
+  PMR_NS::memory_resource* mr_ = PMR_NS::get_default_resource();
+};
+
+TEST_F(TopKTest, Basic) {
+  TopK topk(2, 100, 4, 0.9, mr_);
+  EXPECT_FALSE(topk.Query("a"));
+  EXPECT_EQ(nullopt, topk.IncrBy("a", 3));
+  EXPECT_EQ(nullopt, topk.IncrBy("b", 2));
+  EXPECT_TRUE(topk.Query("a"));
+  EXPECT_EQ(3, topk.Count("a"));
+
+  // c takes the place of b, the item with the lowest count.
+  EXPECT_EQ("b", topk.IncrBy("c", 5));
+  EXPECT_FALSE(topk.Query("b"));
+  EXPECT_EQ(2, topk.Count("b"));
+
+  using P = pair<string_view, uint32_t>;
+  EXPECT_EQ((vector<P>{{"c", 5}, {"a", 3}}), topk.List());
+
+  // An item with a count below the minimum of the heap does not enter it.
+  EXPECT_EQ(nullopt, topk.IncrBy("d", 1));
+  EXPECT_FALSE(topk.Query("d"));
+}
+
+TEST_F(TopKTest, HeavyHitters) {
+  TopK topk(10, 1000, 5, 0.9, mr_);
+
+  // 10 heavy items among a long tail of items that occur once.
+  for (unsigned round = 0; round < 100; ++round) {
+    for (unsigned i = 0; i < 10; ++i)
+      topk.IncrBy(absl::StrCat("heavy", i), 1);
+    for (unsigned i = 0; i < 20; ++i)
+      topk.IncrBy(absl::StrCat("tail", round, ":", i), 1);
+  }
+
+  auto list = topk.List();
+  ASSERT_EQ(10, list.size());
+  for (const auto& [item, count] : list) {
+    EXPECT_THAT(string(item), ::testing::StartsWith("heavy"));
+    EXPECT_LE(count, 100);
+    EXPECT_GE(count, 90);
+  }
+}
+
+TEST_F(TopKTest, Load) {
+  TopK src(3, 50, 3, 0.9, mr_);
+  src.IncrBy("x", 10);
+  src.IncrBy("y", 4);
+
+  TopK dest(src.k(), src.width(), src.depth(), src.decay(), src.buckets_data(), mr_);
+  for (const auto& [item, count] : src.List())
+    dest.LoadItem(item, count);
+
+  EXPECT_EQ(src.List(), dest.List());
+  EXPECT_EQ(10, dest.Count("x"));
+  EXPECT_EQ(nullopt, dest.IncrBy("z", 1));
+  EXPECT_TRUE(dest.Query("z"));
+}
+
+}  // namespace dfly
@@ -6,6 +6,7 @@
 
 #include <cstdint>
 #include <limits>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
@@ -19,9 +20,14 @@ enum class KeyOp : int8_t { READ, WRITE, READ_WRITE };
 
 using GlobType = std::pair<std::string, KeyOp>;
 
+class KeyMatcher;
+
 struct AclKeys {
   std::vector<GlobType> key_globs;
   bool all_keys = false;
+
+  // key_globs compiled by the user registry, shared by the connections of the user.
+  std::shared_ptr<const KeyMatcher> matcher;
 };
 
 struct UserCredentials {
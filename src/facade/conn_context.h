@@ -102,6 +102,10 @@ class ConnectionContext {
   // How many async subscription sources are active: monitor and/or pubsub - at most 2.
   uint8_t subscriptions;
 
+  // Time the command amid an async dispatch entered the dispatch queue, as reported by
+  // ProactorBase::GetMonotonicTimeNs().
+  uint64_t dispatch_ts = 0;
+
   // TODO fix inherit actual values from default
   std::string authed_username{"default"};
   std::vector<uint64_t> acl_commands;
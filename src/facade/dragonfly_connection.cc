@@ -59,6 +59,10 @@ ABSL_FLAG(bool, no_tls_on_admin_port, false, "Allow non-tls connections on admin
 ABSL_FLAG(uint64_t, pipeline_squash, 10,
           "Number of queued pipelined commands above which squashing is enabled, 0 means disabled");
 
+ABSL_FLAG(bool, pipeline_squash_adaptive, false,
+          "If true, each connection adapts its squashing threshold (starting at pipeline_squash) "
+          "based on the measured execution time of squashed and regular dispatches");
+
 // When changing this constant, also update `test_large_cmd` test in connection_test.py.
 ABSL_FLAG(uint32_t, max_multi_bulk_len, 1u << 16,
           "Maximum multi-bulk (array) length that is "
@@ -67,6 +71,10 @@ ABSL_FLAG(uint32_t, max_multi_bulk_len, 1u << 16,
 ABSL_FLAG(size_t, max_client_iobuf_len, 1u << 16,
           "Maximum io buffer length that is used to read client requests.");
 
+ABSL_FLAG(bool, release_idle_iobuf, false,
+          "If true, connections that wait for a new request after a short one shrink their io "
+          "buffer back to the minimal size instead of keeping its peak capacity.");
+
 ABSL_FLAG(bool, migrate_connections, true,
           "When enabled, Dragonfly will try to migrate connections to the target thread on which "
           "they operate. Currently this is only supported for Lua script invocations, and can "
@@ -252,9 +260,14 @@ thread_local uint32_t free_req_release_weight = 0;
 const char* kPhaseName[Connection::NUM_PHASES] = {"SETUP", "READ", "PROCESS", "SHUTTING_DOWN",
                                                   "PRECLOSE"};
 
+uint64_t UpdateAverage(uint64_t avg, uint64_t sample) {
+  return avg == 0 ? sample : (avg * 7 + sample) / 8;
+}
+
 }  // namespace
 
 thread_local vector<Connection::PipelineMessagePtr> Connection::pipeline_req_pool_;
+thread_local vector<void*> Connection::pub_msg_pool_;
 thread_local Connection::QueueBackpressure Connection::tl_queue_backpressure_;
 
 void Connection::QueueBackpressure::EnsureBelowLimit() {
@@ -295,7 +308,8 @@ Connection::MCPipelineMessage::MCPipelineMessage(MemcacheParser::Command cmd_in,
   // but there are no other uses like this so far.
 
   // Compute total size and create backing
-  backing_size = cmd.key.size() + value.size();
+  string_view opaque = cmd.meta_flags.opaque;
+  backing_size = cmd.key.size() + value.size() + opaque.size();
   for (const auto& ext_key : cmd.keys_ext)
     backing_size += ext_key.size();
 
@@ -321,6 +335,11 @@ Connection::MCPipelineMessage::MCPipelineMessage(MemcacheParser::Command cmd_in,
     key = {backing.get() + offset, key.size()};
     offset += key.size();
   }
+
+  if (!opaque.empty()) {
+    memcpy(backing.get() + offset, opaque.data(), opaque.size());
+    cmd.meta_flags.opaque = {backing.get() + offset, opaque.size()};
+  }
 }
 
 void Connection::MessageDeleter::operator()(PipelineMessage* msg) const {
@@ -329,8 +348,14 @@ void Connection::MessageDeleter::operator()(PipelineMessage* msg) const {
 }
 
 void Connection::MessageDeleter::operator()(PubMessage* msg) const {
+  // Subscribers receive messages in bursts, so a small pool covers most of them.
+  constexpr size_t kMaxPooledPubMessages = 256;
+
   msg->~PubMessage();
-  mi_free(msg);
+  if (pub_msg_pool_.size() < kMaxPooledPubMessages)
+    pub_msg_pool_.push_back(msg);
+  else
+    mi_free(msg);
 }
 
 void Connection::PipelineMessage::Reset(size_t nargs, size_t capacity) {
@@ -425,14 +450,25 @@ void Connection::DispatchOperations::operator()(const AclUpdateMessage& msg) {
 
 void Connection::DispatchOperations::operator()(const PubMessage& pub_msg) {
   RedisReplyBuilder* rbuilder = (RedisReplyBuilder*)builder;
+
   unsigned i = 0;
   array<string_view, 4> arr;
-  if (pub_msg.pattern.empty()) {
+  if (pub_msg.sharded) {
+    arr[i++] = "smessage";
+  } else if (pub_msg.pattern.empty()) {
     arr[i++] = "message";
   } else {
     arr[i++] = "pmessage";
     arr[i++] = pub_msg.pattern;
   }
+
+  // Channel and message were serialized once by the publisher for all the subscribers.
+  if (!pub_msg.serialized.empty()) {
+    rbuilder->SendSerializedTail(absl::Span<string_view>{arr.data(), i}, i + 2, pub_msg.serialized,
+                                 RedisReplyBuilder::CollectionType::PUSH);
+    return;
+  }
+
   arr[i++] = pub_msg.channel;
   arr[i++] = pub_msg.message;
   rbuilder->SendStringArr(absl::Span<string_view>{arr.data(), i},
@@ -471,8 +507,7 @@ void Connection::DispatchOperations::operator()(const InvalidationMessage& msg)
   if (msg.invalidate_due_to_flush) {
     rbuilder->SendNull();
   } else {
-    std::string_view keys[] = {msg.key};
-    rbuilder->SendStringArr(keys);
+    rbuilder->SendStringArr(absl::Span<const std::string>{msg.keys});
   }
 }
 
@@ -486,7 +521,8 @@ Connection::Connection(Protocol protocol, util::HttpListenerBase* http_listener,
       skip_next_squashing_(false),
       migration_enabled_(false),
       migration_in_process_(false),
-      is_http_(false) {
+      is_http_(false),
+      is_tls_(false) {
   static atomic_uint32_t next_id{1};
 
   protocol_ = protocol;
@@ -570,6 +606,7 @@ void Connection::OnPostMigrateThread() {
 
   stats_ = &tl_facade_stats->conn_stats;
   ++stats_->num_conns;
+  stats_->num_tls_conns += is_tls_;
   stats_->read_buf_capacity += io_buf_.Capacity();
   if (cc_->replica_conn) {
     ++stats_->num_replicas;
@@ -645,6 +682,7 @@ void Connection::HandleRequests() {
         return;
       }
       peer = socket_.get();
+      is_tls_ = true;
       VLOG(1) << "TLS handshake succeeded";
     }
   }
@@ -744,6 +782,9 @@ std::pair<std::string, std::string> Connection::GetClientInfoBeforeAfterTid() co
   if (dispatch_q_.size()) {
     absl::StrAppend(&after, " pipeline=", dispatch_q_.size());
   }
+  if (squash_ctrl_.adaptive) {
+    absl::StrAppend(&after, " squash=", squash_ctrl_.threshold);
+  }
   absl::StrAppend(&after, " age=", now - creation_time_, " idle=", now - last_interaction_);
   string_view phase_name = PHASE_NAMES[phase_];
 
@@ -847,6 +888,7 @@ io::Result<bool> Connection::CheckForHttpProto(FiberSocketBase* peer) {
 
 void Connection::ConnectionFlow(FiberSocketBase* peer) {
   ++stats_->num_conns;
+  stats_->num_tls_conns += is_tls_;
   ++stats_->conn_received_cnt;
   stats_->read_buf_capacity += io_buf_.Capacity();
 
@@ -1002,7 +1044,7 @@ Connection::ParserStatus Connection::ParseRedis(SinkReplyBuilder* orig_builder)
     service_->DispatchCommand(absl::MakeSpan(cmd_vec), cc_.get());
   };
   auto dispatch_async = [this, &parse_args, tlh = mi_heap_get_backing()]() -> MessageHandle {
-    return {FromArgs(std::move(parse_args), tlh)};
+    return {FromArgs(parse_args, tlh)};
   };
 
   do {
@@ -1153,10 +1195,16 @@ auto Connection::IoLoop(util::FiberSocketBase* peer, SinkReplyBuilder* orig_buil
   ParserStatus parse_status = OK;
 
   size_t max_iobfuf_len = absl::GetFlag(FLAGS_max_client_iobuf_len);
+  bool release_idle_iobuf = absl::GetFlag(FLAGS_release_idle_iobuf);
+  size_t last_recv_sz = 0;
 
   do {
     HandleMigrateRequest();
 
+    if (release_idle_iobuf && ShouldReleaseIoBuf(io_buf_, last_recv_sz)) {
+      UpdateIoBufCapacity(io_buf_, stats_, [&]() { io_buf_ = io::IoBuf{kMinReadSize}; });
+    }
+
     io::MutableBytes append_buf = io_buf_.AppendBuffer();
     DCHECK(!append_buf.empty());
 
@@ -1172,6 +1220,8 @@ auto Connection::IoLoop(util::FiberSocketBase* peer, SinkReplyBuilder* orig_buil
     }
 
     io_buf_.CommitWrite(*recv_sz);
+    last_recv_sz = *recv_sz;
+    recent_read_bytes_ += *recv_sz;
     stats_->io_read_bytes += *recv_sz;
     ++stats_->io_read_cnt;
 
@@ -1260,6 +1310,38 @@ bool Connection::ShouldEndDispatchFiber(const MessageHandle& msg) {
   return false;
 }
 
+bool Connection::ShouldReleaseIoBuf(const io::IoBuf& buf, size_t last_recv_sz) {
+  // Most connections are idle most of the time. If everything was consumed and the last read
+  // was short, the connection is likely to block for a while, so don't keep a grown buffer
+  // for it. Connections with a steady stream of large requests keep their capacity.
+  return buf.InputLen() == 0 && buf.Capacity() > kMinReadSize && last_recv_sz < kMinReadSize;
+}
+
+void Connection::SquashController::Init(size_t base_threshold, bool is_adaptive) {
+  threshold = base = base_threshold;
+  adaptive = is_adaptive && base_threshold > 0;
+}
+
+void Connection::SquashController::RecordSingle(uint64_t duration_ns) {
+  single_cmd_ns = UpdateAverage(single_cmd_ns, duration_ns);
+}
+
+void Connection::SquashController::RecordSquashed(uint64_t duration_ns, size_t cmd_cnt) {
+  if (cmd_cnt == 0)
+    return;
+  squashed_cmd_ns = UpdateAverage(squashed_cmd_ns, duration_ns / cmd_cnt);
+  if (single_cmd_ns == 0)  // Nothing to compare with yet.
+    return;
+
+  // Squashing is cheaper per command - start doing it earlier. Otherwise it only adds
+  // latency, so require deeper queues before squashing again.
+  if (squashed_cmd_ns < single_cmd_ns) {
+    threshold = std::max<size_t>(threshold / 2, 1);
+  } else {
+    threshold = std::min<size_t>(threshold * 2, base * kMaxFactor);
+  }
+}
+
 void Connection::SquashPipeline(facade::SinkReplyBuilder* builder) {
   DCHECK_EQ(dispatch_q_.size(), pending_pipeline_cmd_cnt_);
 
@@ -1276,7 +1358,10 @@ void Connection::SquashPipeline(facade::SinkReplyBuilder* builder) {
   stats_->squashed_commands += squash_cmds.size();
   cc_->async_dispatch = true;
 
+  uint64_t start_ns = squash_ctrl_.adaptive ? ProactorBase::GetMonotonicTimeNs() : 0;
   size_t dispatched = service_->DispatchManyCommands(absl::MakeSpan(squash_cmds), cc_.get());
+  if (squash_ctrl_.adaptive)
+    squash_ctrl_.RecordSquashed(ProactorBase::GetMonotonicTimeNs() - start_ns, dispatched);
 
   if (pending_pipeline_cmd_cnt_ == squash_cmds.size()) {  // Flush if no new commands appeared
     builder->FlushBatch();
@@ -1349,7 +1434,8 @@ void Connection::ExecutionFiber(util::FiberSocketBase* peer) {
   SinkReplyBuilder* builder = cc_->reply_builder();
   DispatchOperations dispatch_op{builder, this};
 
-  size_t squashing_threshold = absl::GetFlag(FLAGS_pipeline_squash);
+  squash_ctrl_.Init(absl::GetFlag(FLAGS_pipeline_squash),
+                    absl::GetFlag(FLAGS_pipeline_squash_adaptive));
 
   uint64_t prev_epoch = fb2::FiberSwitchEpoch();
   fb2::NoOpLock noop_lk;
@@ -1387,8 +1473,8 @@ void Connection::ExecutionFiber(util::FiberSocketBase* peer) {
     // we can try to squash them
     // It is only enabled if the threshold is reached and the whole dispatch queue
     // consists only of commands (no pubsub or monitor messages)
-    bool squashing_enabled = squashing_threshold > 0;
-    bool threshold_reached = pending_pipeline_cmd_cnt_ > squashing_threshold;
+    bool squashing_enabled = squash_ctrl_.threshold > 0;
+    bool threshold_reached = pending_pipeline_cmd_cnt_ > squash_ctrl_.threshold;
     bool are_all_plain_cmds = pending_pipeline_cmd_cnt_ == dispatch_q_.size();
     if (squashing_enabled && threshold_reached && are_all_plain_cmds && !skip_next_squashing_) {
       SquashPipeline(builder);
@@ -1410,9 +1496,17 @@ void Connection::ExecutionFiber(util::FiberSocketBase* peer) {
         return;  // don't set conn closing flag
       }
 
+      bool measure = squash_ctrl_.adaptive && holds_alternative<PipelineMessagePtr>(msg.handle);
+      uint64_t start_ns = measure ? ProactorBase::GetMonotonicTimeNs() : 0;
+
       cc_->async_dispatch = true;
+      cc_->dispatch_ts = msg.dispatch_ts;
       std::visit(dispatch_op, msg.handle);
+      cc_->dispatch_ts = 0;
       cc_->async_dispatch = false;
+
+      if (measure)
+        squash_ctrl_.RecordSingle(ProactorBase::GetMonotonicTimeNs() - start_ns);
       RecycleMessage(std::move(msg));
     }
 
@@ -1432,7 +1526,7 @@ void Connection::ExecutionFiber(util::FiberSocketBase* peer) {
   queue_backpressure_->pipeline_cnd.notify_all();
 }
 
-Connection::PipelineMessagePtr Connection::FromArgs(RespVec args, mi_heap_t* heap) {
+Connection::PipelineMessagePtr Connection::FromArgs(const RespVec& args, mi_heap_t* heap) {
   DCHECK(!args.empty());
   size_t backed_sz = 0;
   for (const auto& arg : args) {
@@ -1448,7 +1542,9 @@ Connection::PipelineMessagePtr Connection::FromArgs(RespVec args, mi_heap_t* hea
   PipelineMessagePtr ptr;
   if (ptr = GetFromPipelinePool(); ptr) {
     ptr->Reset(args.size(), backed_sz);
+    stats_->request_pool_hits++;
   } else {
+    stats_->request_pool_misses++;
     void* heap_ptr = mi_heap_malloc_small(heap, sizeof(PipelineMessage));
     // We must construct in place here, since there is a slice that uses memory locations
     ptr.reset(new (heap_ptr) PipelineMessage(args.size(), backed_sz));
@@ -1523,6 +1619,9 @@ Connection::WeakRef Connection::Borrow() {
 
 void Connection::ShutdownThreadLocal() {
   pipeline_req_pool_.clear();
+  for (void* ptr : pub_msg_pool_)
+    mi_free(ptr);
+  pub_msg_pool_.clear();
 }
 
 bool Connection::IsCurrentlyDispatching() const {
@@ -1533,7 +1632,15 @@ bool Connection::IsCurrentlyDispatching() const {
 }
 
 void Connection::SendPubMessageAsync(PubMessage msg) {
-  void* ptr = mi_malloc(sizeof(PubMessage));
+  void* ptr = nullptr;
+  if (pub_msg_pool_.empty()) {
+    ptr = mi_malloc(sizeof(PubMessage));
+    stats_->request_pool_misses++;
+  } else {
+    ptr = pub_msg_pool_.back();
+    pub_msg_pool_.pop_back();
+    stats_->request_pool_hits++;
+  }
   SendAsync({PubMessagePtr{new (ptr) PubMessage{std::move(msg)}, MessageDeleter{}}});
 }
 
@@ -1562,6 +1669,15 @@ void Connection::SendCheckpoint(fb2::BlockingCounter bc, bool ignore_paused, boo
 }
 
 void Connection::SendInvalidationMessageAsync(InvalidationMessage msg) {
+  // Merge into the last queued invalidation if it was not dispatched yet.
+  if (!msg.invalidate_due_to_flush && !dispatch_q_.empty()) {
+    auto* last = get_if<InvalidationMessage>(&dispatch_q_.back().handle);
+    if (last && !last->invalidate_due_to_flush) {
+      last->keys.insert(last->keys.end(), make_move_iterator(msg.keys.begin()),
+                        make_move_iterator(msg.keys.end()));
+      return;
+    }
+  }
   SendAsync({std::move(msg)});
 }
 
@@ -1727,6 +1843,7 @@ void Connection::DecreaseStatsOnClose() {
     --stats_->num_replicas;
   }
   --stats_->num_conns;
+  stats_->num_tls_conns -= is_tls_;
 }
 
 void Connection::BreakOnce(uint32_t ev_mask) {
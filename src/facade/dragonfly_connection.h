@@ -74,6 +74,8 @@ class Connection : public util::Connection {
     std::string pattern{};              // non-empty for pattern subscriber
     std::shared_ptr<char[]> buf;        // stores channel name and message
     std::string_view channel, message;  // channel and message parts from buf
+    std::string_view serialized{};      // channel and message as RESP bulk strings, if set
+    bool sharded = false;               // published with SPUBLISH to a shard channel
   };
 
   // Pipeline message, accumulated Redis command to be executed.
@@ -123,8 +125,10 @@ class Connection : public util::Connection {
     util::fb2::BlockingCounter bc;  // Decremented counter when processed
   };
 
+  // Invalidation push for client tracking. Invalidations that are queued back to back are merged,
+  // so a burst of updates reaches the client as a single push with multiple keys.
   struct InvalidationMessage {
-    std::string key;
+    std::vector<std::string> keys;
     bool invalidate_due_to_flush = false;
   };
 
@@ -289,6 +293,11 @@ class Connection : public util::Connection {
   // Connections will migrate at most once, and only when the flag --migrate_connections is true.
   void RequestAsyncMigration(util::fb2::ProactorBase* dest);
 
+  // Returns the number of bytes read since the previous call. Used to find busy connections.
+  uint64_t TakeRecentReadBytes() {
+    return std::exchange(recent_read_bytes_, 0);
+  }
+
   // Starts traffic logging in the calling thread. Must be a proactor thread.
   // Each thread creates its own log file combining requests from all the connections in
   // that thread. A noop if the thread is already logging.
@@ -302,6 +311,34 @@ class Connection : public util::Connection {
 
   bool IsHttp() const;
 
+  // Whether the io buffer should shrink to its minimal size before waiting for the next
+  // request, see --release_idle_iobuf.
+  static bool ShouldReleaseIoBuf(const io::IoBuf& buf, size_t last_recv_sz);
+
+  // Adjusts the squashing threshold of a connection based on the observed per-command
+  // execution time of regular and squashed dispatches, see --pipeline_squash_adaptive.
+  // Connections whose commands run faster when squashed start squashing earlier, while
+  // connections that do not benefit from it back off up to kMaxFactor * base threshold.
+  struct SquashController {
+    static constexpr unsigned kMaxFactor = 8;
+
+    void Init(size_t base_threshold, bool is_adaptive);
+
+    // Records execution time of a single pipelined command dispatched without squashing.
+    void RecordSingle(uint64_t duration_ns);
+
+    // Records execution time of a squashed batch of cmd_cnt commands and adapts the threshold.
+    void RecordSquashed(uint64_t duration_ns, size_t cmd_cnt);
+
+    size_t threshold = 0;
+    size_t base = 0;
+    bool adaptive = false;
+
+    // Exponentially weighted moving averages of per-command dispatch time.
+    uint64_t single_cmd_ns = 0;
+    uint64_t squashed_cmd_ns = 0;
+  };
+
  protected:
   void OnShutdown() override;
   void OnPreMigrateThread() override;
@@ -368,7 +405,7 @@ class Connection : public util::Connection {
   void RecycleMessage(MessageHandle msg);
 
   // Create new pipeline request, re-use from pool when possible.
-  PipelineMessagePtr FromArgs(RespVec args, mi_heap_t* heap);
+  PipelineMessagePtr FromArgs(const RespVec& args, mi_heap_t* heap);
 
   ParserStatus ParseRedis(SinkReplyBuilder* orig_builder);
   ParserStatus ParseMemcache();
@@ -420,6 +457,7 @@ class Connection : public util::Connection {
   ServiceInterface* service_;
 
   time_t creation_time_, last_interaction_;
+  uint64_t recent_read_bytes_ = 0;
   Phase phase_ = SETUP;
   std::string name_;
 
@@ -448,6 +486,9 @@ class Connection : public util::Connection {
   // Aggregated while handling pipelines, gradually released while handling regular commands.
   static thread_local std::vector<PipelineMessagePtr> pipeline_req_pool_;
 
+  // Memory blocks of destroyed pubsub messages per-thread, reused for the following ones.
+  static thread_local std::vector<void*> pub_msg_pool_;
+
   // Per-thread queue backpressure structs.
   static thread_local QueueBackpressure tl_queue_backpressure_;
 
@@ -455,10 +496,13 @@ class Connection : public util::Connection {
   bool tracking_enabled_ : 1;
   bool skip_next_squashing_ : 1;  // Forcefully skip next squashing
 
+  SquashController squash_ctrl_;
+
   // Connection migration vars, see RequestAsyncMigration() above.
   bool migration_enabled_ : 1;
   bool migration_in_process_ : 1;
   bool is_http_ : 1;
+  bool is_tls_ : 1;
 };
 
 }  // namespace facade
@@ -0,0 +1,74 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/dragonfly_connection.h"
+
+#include <gmock/gmock.h>
+
+using namespace testing;
+using namespace std;
+
+namespace facade {
+
+class SquashControllerTest : public testing::Test {
+ protected:
+  Connection::SquashController ctrl_;
+};
+
+TEST_F(SquashControllerTest, Disabled) {
+  ctrl_.Init(10, false);
+  EXPECT_FALSE(ctrl_.adaptive);
+  EXPECT_EQ(10u, ctrl_.threshold);
+
+  // Squashing disabled by --pipeline_squash=0 can not be enabled by adapting.
+  ctrl_.Init(0, true);
+  EXPECT_FALSE(ctrl_.adaptive);
+  EXPECT_EQ(0u, ctrl_.threshold);
+}
+
+TEST_F(SquashControllerTest, Adapt) {
+  ctrl_.Init(10, true);
+  ASSERT_TRUE(ctrl_.adaptive);
+
+  // Without measured single dispatches there is nothing to compare with.
+  ctrl_.RecordSquashed(1000, 10);
+  EXPECT_EQ(10u, ctrl_.threshold);
+
+  // Squashed commands are cheaper, squash earlier, but never for every command.
+  ctrl_.RecordSingle(1000);
+  ctrl_.RecordSquashed(1000, 10);
+  EXPECT_EQ(5u, ctrl_.threshold);
+  for (unsigned i = 0; i < 10; ++i)
+    ctrl_.RecordSquashed(1000, 10);
+  EXPECT_EQ(1u, ctrl_.threshold);
+
+  // Squashed commands became more expensive, back off up to kMaxFactor times the base.
+  ctrl_.RecordSingle(10);
+  for (unsigned i = 0; i < 30; ++i)
+    ctrl_.RecordSquashed(100'000, 1);
+  EXPECT_EQ(10u * Connection::SquashController::kMaxFactor, ctrl_.threshold);
+
+  // Empty batches are ignored.
+  ctrl_.RecordSquashed(0, 0);
+  EXPECT_EQ(10u * Connection::SquashController::kMaxFactor, ctrl_.threshold);
+}
+
+TEST(ConnectionTest, ShouldReleaseIoBuf) {
+  io::IoBuf buf{1 << 16};
+  EXPECT_TRUE(Connection::ShouldReleaseIoBuf(buf, 10));
+
+  // A large read is likely to be followed by more data.
+  EXPECT_FALSE(Connection::ShouldReleaseIoBuf(buf, 8192));
+
+  // Unparsed input must be kept.
+  buf.WriteAndCommit("PING", 4);
+  EXPECT_FALSE(Connection::ShouldReleaseIoBuf(buf, 10));
+  buf.ConsumeInput(4);
+  EXPECT_TRUE(Connection::ShouldReleaseIoBuf(buf, 10));
+
+  // A minimal buffer has nothing to release.
+  EXPECT_FALSE(Connection::ShouldReleaseIoBuf(io::IoBuf{16}, 10));
+}
+
+}  // namespace facade
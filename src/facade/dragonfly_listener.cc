@@ -5,6 +5,7 @@
 #include "facade/dragonfly_listener.h"
 
 #include <openssl/err.h>
+#include <sys/resource.h>
 
 #include <memory>
 
@@ -29,6 +30,14 @@ ABSL_FLAG(bool, conn_use_incoming_cpu, false,
           "If true uses incoming cpu of a socket in order to distribute"
           " incoming connections");
 
+ABSL_FLAG(bool, conn_load_balance, false,
+          "If true, new connections are placed on the least loaded connection thread and busy "
+          "connections are migrated away from threads that stay overloaded. Migrations require "
+          "--migrate_connections");
+ABSL_FLAG(uint32_t, conn_rebalance_threshold, 30,
+          "Difference in load percent between the busiest and the least busy connection threads "
+          "that triggers a connection migration when it persists for several seconds");
+
 ABSL_FLAG(string, tls_cert_file, "", "cert file for tls connections");
 ABSL_FLAG(string, tls_key_file, "", "key file for tls connections");
 ABSL_FLAG(string, tls_ca_cert_file, "", "ca signed certificate to validate tls connections");
@@ -183,6 +192,26 @@ void OverriddenSSLFree(void* addr, const char* file, int line) {
   mi_free(addr);
 }
 
+constexpr auto kBalancePeriod = std::chrono::seconds(1);
+
+// Number of consecutive periods the imbalance must persist before a connection is migrated.
+constexpr unsigned kImbalancedPeriods = 3;
+
+// Threads whose load is this close to the minimum are considered equal for new connections,
+// so that a burst of connections between two samples doesn't land on the same thread.
+constexpr uint32_t kLoadSlack = 10;
+
+uint64_t ThreadCpuUsec() {
+#ifdef __linux__
+  struct rusage ru;
+  getrusage(RUSAGE_THREAD, &ru);
+  return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1000000ULL + ru.ru_utime.tv_usec +
+         ru.ru_stime.tv_usec;
+#else
+  return 0;
+#endif
+}
+
 }  // namespace
 
 Listener::Listener(Protocol protocol, ServiceInterface* si, Role role)
@@ -288,6 +317,110 @@ uint64_t Listener::RefusedConnectionMaxClientsCount() {
 
 void Listener::PreAcceptLoop(util::ProactorBase* pb) {
   per_thread_.resize(pool()->size());
+
+  // Only the main listener balances, otherwise the listeners would migrate the same
+  // connections concurrently.
+  if (IsMainInterface() && GetFlag(FLAGS_conn_load_balance)) {
+    balance_fb_ = fb2::Fiber("conn_balance", [this] { BalanceLoop(); });
+  }
+}
+
+pair<uint32_t, uint32_t> Listener::ConnectionThreads() const {
+  uint32_t size = pool()->size();
+  uint32_t total = GetFlag(FLAGS_conn_io_threads);
+  uint32_t start = GetFlag(FLAGS_conn_io_thread_start) % size;
+
+  if (total == 0 || total + start > size) {
+    total = size - start;
+  }
+  return {start, total};
+}
+
+uint32_t Listener::ThreadLoad(uint64_t cpu_usec, uint64_t elapsed_usec, uint64_t queued) {
+  // Deep dispatch queues mean the thread falls behind even if it's not saturated yet,
+  // they add a point per 16 queued commands, up to 25.
+  uint64_t cpu_pct = cpu_usec * 100 / max<uint64_t>(elapsed_usec, 1);
+  return min<uint64_t>(cpu_pct, 100) + min<uint64_t>(queued / 16, 25);
+}
+
+uint32_t Listener::LeastLoadedThread(const vector<PerThread>& threads, uint32_t start,
+                                     uint32_t total) {
+  uint32_t min_load = UINT32_MAX;
+  for (uint32_t i = start; i < start + total; ++i)
+    min_load = min(min_load, threads[i].load);
+
+  uint32_t res = start;
+  int32_t min_conns = INT32_MAX;
+  for (uint32_t i = start; i < start + total; ++i) {
+    if (threads[i].load <= min_load + kLoadSlack && threads[i].num_connections < min_conns) {
+      min_conns = threads[i].num_connections;
+      res = i;
+    }
+  }
+  return res;
+}
+
+void Listener::BalanceLoop() {
+  unsigned size = pool()->size();
+  vector<uint64_t> prev_cpu(size), cpu(size), queued(size);
+  uint64_t prev_ts = ProactorBase::GetMonotonicTimeNs();
+  unsigned imbalanced = 0;
+
+  pool()->AwaitBrief([&](unsigned index, ProactorBase*) { prev_cpu[index] = ThreadCpuUsec(); });
+
+  while (!balance_done_.WaitFor(kBalancePeriod)) {
+    pool()->AwaitBrief([&](unsigned index, ProactorBase*) {
+      cpu[index] = ThreadCpuUsec();
+      queued[index] = tl_facade_stats->conn_stats.dispatch_queue_entries;
+    });
+
+    uint64_t now = ProactorBase::GetMonotonicTimeNs();
+    uint64_t elapsed_usec = max<uint64_t>((now - prev_ts) / 1000, 1);
+    prev_ts = now;
+
+    auto [start, total] = ConnectionThreads();
+    uint32_t hot = start, cold = start;
+    {
+      absl::base_internal::SpinLockHolder lock{&mutex_};
+      for (unsigned i = 0; i < size; ++i)
+        per_thread_[i].load = ThreadLoad(cpu[i] - prev_cpu[i], elapsed_usec, queued[i]);
+      for (uint32_t i = start; i < start + total; ++i) {
+        if (per_thread_[i].load > per_thread_[hot].load)
+          hot = i;
+        if (per_thread_[i].load < per_thread_[cold].load)
+          cold = i;
+      }
+      if (per_thread_[hot].load > per_thread_[cold].load + GetFlag(FLAGS_conn_rebalance_threshold))
+        ++imbalanced;
+      else
+        imbalanced = 0;
+    }
+    prev_cpu.swap(cpu);
+
+    if (imbalanced < kImbalancedPeriods)
+      continue;
+    imbalanced = 0;
+
+    // Move the connection that read the most since the last rebalancing of that thread.
+    ProactorBase* dest = pool()->at(cold);
+    pool()->at(hot)->Await([this, dest] {
+      Connection* busiest = nullptr;
+      uint64_t max_bytes = 0;
+      TraverseConnectionsOnThread([&](unsigned, util::Connection* conn) {
+        auto* fconn = static_cast<Connection*>(conn);
+        if (uint64_t bytes = fconn->TakeRecentReadBytes(); bytes > max_bytes) {
+          max_bytes = bytes;
+          busiest = fconn;
+        }
+      });
+
+      if (busiest) {
+        VLOG(1) << "Migrating connection " << busiest->GetClientId() << " to thread "
+                << dest->GetPoolIndex();
+        busiest->RequestAsyncMigration(dest);
+      }
+    });
+  }
 }
 
 bool Listener::IsPrivilegedInterface() const {
@@ -299,6 +432,10 @@ bool Listener::IsMainInterface() const {
 }
 
 void Listener::PreShutdown() {
+  balance_done_.Notify();
+  if (balance_fb_.IsJoinable())
+    balance_fb_.Join();
+
   // Iterate on all connections and allow them to finish their commands for
   // a short period.
   // Executed commands can be visible in snapshots or replicas, but if we close the client
@@ -418,14 +555,14 @@ ProactorBase* Listener::PickConnectionProactor(util::FiberSocketBase* sock) {
   }
 
   if (res_id == kuint32max) {
-    uint32_t total = GetFlag(FLAGS_conn_io_threads);
-    uint32_t start = GetFlag(FLAGS_conn_io_thread_start) % pp->size();
+    auto [start, total] = ConnectionThreads();
 
-    if (total == 0 || total + start > pp->size()) {
-      total = pp->size() - start;
+    if (balance_fb_.IsJoinable()) {
+      absl::base_internal::SpinLockHolder lock{&mutex_};
+      res_id = LeastLoadedThread(per_thread_, start, total);
+    } else {
+      res_id = start + (next_id_.fetch_add(1, std::memory_order_relaxed) % total);
     }
-
-    res_id = start + (next_id_.fetch_add(1, std::memory_order_relaxed) % total);
   }
 
   return pp->at(res_id);
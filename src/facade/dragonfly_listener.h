@@ -14,7 +14,9 @@
 
 #include "facade/facade_types.h"
 #include "util/fiber_socket_base.h"
+#include "util/fibers/fibers.h"
 #include "util/fibers/proactor_base.h"
+#include "util/fibers/synchronization.h"
 #include "util/http/http_handler.h"
 #include "util/listener_interface.h"
 
@@ -50,6 +52,21 @@ class Listener : public util::ListenerInterface {
   bool IsPrivilegedInterface() const;
   bool IsMainInterface() const;
 
+  struct PerThread {
+    int32_t num_connections{0};
+    unsigned napi_id = 0;
+    uint32_t load = 0;  // cpu utilization percent with a penalty for queued pipeline commands.
+  };
+
+  // Returns the load of a thread that used cpu_usec of cpu time during elapsed_usec and has
+  // queued commands waiting in the dispatch queues of its connections.
+  static uint32_t ThreadLoad(uint64_t cpu_usec, uint64_t elapsed_usec, uint64_t queued);
+
+  // Returns the index of the thread in [start, start + total) with the lowest load. Among the
+  // threads whose load is close to the lowest, the one with the fewest connections wins.
+  static uint32_t LeastLoadedThread(const std::vector<PerThread>& threads, uint32_t start,
+                                    uint32_t total);
+
  private:
   util::Connection* NewConnection(ProactorBase* proactor) final;
   ProactorBase* PickConnectionProactor(util::FiberSocketBase* sock) final;
@@ -62,14 +79,17 @@ class Listener : public util::ListenerInterface {
   void PreShutdown() final;
   void PostShutdown() final;
 
+  // Returns the first thread and the number of threads that handle connections.
+  std::pair<uint32_t, uint32_t> ConnectionThreads() const;
+
+  // Samples the load of the threads periodically and migrates busy connections away from
+  // threads that stay overloaded compared to the others.
+  void BalanceLoop();
+
   std::unique_ptr<util::HttpListenerBase> http_base_;
 
   ServiceInterface* service_;
 
-  struct PerThread {
-    int32_t num_connections{0};
-    unsigned napi_id = 0;
-  };
   std::vector<PerThread> per_thread_;
 
   std::atomic_uint32_t next_id_{0};
@@ -81,6 +101,9 @@ class Listener : public util::ListenerInterface {
   int32_t min_cnt_{0};
   absl::base_internal::SpinLock mutex_;
 
+  util::fb2::Fiber balance_fb_;
+  util::fb2::Done balance_done_;
+
   Protocol protocol_;
   SSL_CTX* ctx_ = nullptr;
 };
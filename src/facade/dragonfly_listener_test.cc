@@ -0,0 +1,52 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/dragonfly_listener.h"
+
+#include <gmock/gmock.h>
+
+using namespace testing;
+using namespace std;
+
+namespace facade {
+
+class ListenerTest : public testing::Test {
+ protected:
+  using PerThread = Listener::PerThread;
+
+  static PerThread Thread(int32_t num_connections, uint32_t load) {
+    return PerThread{.num_connections = num_connections, .load = load};
+  }
+};
+
+TEST_F(ListenerTest, ThreadLoad) {
+  EXPECT_EQ(0u, Listener::ThreadLoad(0, 1000, 0));
+  EXPECT_EQ(50u, Listener::ThreadLoad(500, 1000, 0));
+
+  // Cpu time is capped at 100 percent, queued commands add at most 25 points.
+  EXPECT_EQ(100u, Listener::ThreadLoad(1500, 1000, 0));
+  EXPECT_EQ(52u, Listener::ThreadLoad(500, 1000, 32));
+  EXPECT_EQ(125u, Listener::ThreadLoad(1000, 1000, 10000));
+
+  EXPECT_EQ(100u, Listener::ThreadLoad(1, 0, 0));
+}
+
+TEST_F(ListenerTest, LeastLoadedThread) {
+  vector<PerThread> threads = {Thread(1, 90), Thread(5, 25), Thread(2, 60), Thread(9, 10)};
+  EXPECT_EQ(3u, Listener::LeastLoadedThread(threads, 0, 4));
+
+  // Only the threads in the range handle connections.
+  EXPECT_EQ(1u, Listener::LeastLoadedThread(threads, 0, 3));
+  EXPECT_EQ(2u, Listener::LeastLoadedThread(threads, 2, 1));
+
+  // Threads with similar loads are picked by their number of connections.
+  threads[1].load = 15;
+  EXPECT_EQ(1u, Listener::LeastLoadedThread(threads, 0, 4));
+  threads[3].num_connections = 5;
+  EXPECT_EQ(1u, Listener::LeastLoadedThread(threads, 0, 4));
+  threads[3].num_connections = 4;
+  EXPECT_EQ(3u, Listener::LeastLoadedThread(threads, 0, 4));
+}
+
+}  // namespace facade
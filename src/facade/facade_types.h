@@ -112,8 +112,14 @@ struct ConnectionStats {
   uint32_t num_conns = 0;
   uint32_t num_replicas = 0;
   uint32_t num_blocked_clients = 0;
+  uint32_t num_tls_conns = 0;  // connections encrypted by OpenSSL in userspace.
   uint64_t num_migrations = 0;
   uint64_t squashed_commands = 0;
+
+  // Allocations of the per request objects served from the per thread pools, and those that were
+  // not.
+  uint64_t request_pool_hits = 0;
+  uint64_t request_pool_misses = 0;
   ConnectionStats& operator+=(const ConnectionStats& o);
 };
 
@@ -116,10 +116,150 @@ MP::Result ParseValueless(TokensView tokens, MP::Command* res) {
   return MP::OK;
 }
 
+// Maps the M<mode> flag of ms and ma to the corresponding standard command.
+bool ParseMetaMode(char kind, string_view mode, MP::CmdType* type) {
+  if (mode.size() != 1)
+    return false;
+
+  char m = absl::ascii_toupper(mode[0]);
+  if (kind == 's') {
+    switch (m) {
+      case 'E':
+        *type = MP::ADD;
+        break;
+      case 'A':
+        *type = MP::APPEND;
+        break;
+      case 'P':
+        *type = MP::PREPEND;
+        break;
+      case 'R':
+        *type = MP::REPLACE;
+        break;
+      case 'S':
+        *type = MP::SET;
+        break;
+      default:
+        return false;
+    }
+    return true;
+  }
+
+  if (kind == 'a' && (m == 'I' || m == '+' || m == 'D' || m == '-')) {
+    *type = (m == 'I' || m == '+') ? MP::INCR : MP::DECR;
+    return true;
+  }
+  return false;
+}
+
+// <cmd> <key> [<datalen>] <flag>*, the first char of a flag token is the flag itself and the rest
+// is its argument.
+MP::Result ParseMeta(char kind, TokensView tokens, MP::Command* res) {
+  res->meta = true;
+  if (kind == 'n') {
+    res->type = MP::NOOP;
+    return tokens.empty() ? MP::OK : MP::PARSE_ERROR;
+  }
+
+  if (tokens.empty() || tokens[0].size() > 250)  // key length limit
+    return MP::PARSE_ERROR;
+
+  res->key = tokens[0];
+  res->expire_ts = 0;
+  res->flags = 0;
+  res->bytes_len = 0;
+
+  size_t flags_pos = 1;
+  switch (kind) {
+    case 'g':
+      res->type = MP::GET;
+      break;
+    case 'd':
+      res->type = MP::DELETE;
+      break;
+    case 'a':
+      res->type = MP::INCR;
+      res->delta = 1;
+      break;
+    case 's':
+      res->type = MP::SET;
+      if (tokens.size() < 2 || !absl::SimpleAtoi(tokens[1], &res->bytes_len))
+        return MP::BAD_INT;
+      flags_pos = 2;
+      break;
+    default:
+      return MP::UNKNOWN_CMD;
+  }
+
+  MP::MetaFlags& mf = res->meta_flags;
+  for (string_view token : tokens.subspan(flags_pos)) {
+    string_view arg = token.substr(1);
+    bool valid = true;
+    switch (token[0]) {
+      case 'O':
+        mf.opaque = arg;
+        break;
+      case 'q':
+        mf.quiet = true;
+        break;
+      case 'k':
+        mf.return_key = true;
+        break;
+      case 'v':
+        valid = kind == 'g' || kind == 'a';
+        mf.return_value = true;
+        break;
+      case 't':
+        valid = kind == 'g';
+        mf.return_ttl = true;
+        break;
+      case 'c':
+        valid = kind == 'g';
+        mf.return_cas = true;
+        break;
+      case 'f':
+        valid = kind == 'g';
+        mf.return_flags = true;
+        break;
+      case 's':
+        valid = kind == 'g';
+        mf.return_size = true;
+        break;
+      case 'F':
+        valid = kind == 's';
+        if (valid && !absl::SimpleAtoi(arg, &res->flags))
+          return MP::BAD_INT;
+        break;
+      case 'T':
+        valid = kind == 's';
+        if (valid && !absl::SimpleAtoi(arg, &res->expire_ts))
+          return MP::BAD_INT;
+        break;
+      case 'D':
+        valid = kind == 'a';
+        if (valid && !absl::SimpleAtoi(arg, &res->delta))
+          return MP::BAD_DELTA;
+        break;
+      case 'M':
+        valid = ParseMetaMode(kind, arg, &res->type);
+        break;
+      default:  // base64 keys, cas comparisons, vivification and the rest are not supported.
+        valid = false;
+    }
+
+    if (!valid)
+      return MP::PARSE_ERROR;
+  }
+
+  return MP::OK;
+}
+
 }  // namespace
 
 auto MP::Parse(string_view str, uint32_t* consumed, Command* cmd) -> Result {
   cmd->no_reply = false;  // re-initialize
+  cmd->meta = false;
+  cmd->meta_flags = {};
   auto pos = str.find("\r\n");
   *consumed = 0;
   if (pos == string_view::npos) {
@@ -143,6 +283,11 @@ auto MP::Parse(string_view str, uint32_t* consumed, Command* cmd) -> Result {
   if (num_tokens == 0)
     return PARSE_ERROR;
 
+  if (tokens[0].size() == 2 && tokens[0][0] == 'm') {
+    TokensView tokens_view{tokens.begin() + 1, num_tokens - 1};
+    return ParseMeta(tokens[0][1], tokens_view, cmd);
+  }
+
   cmd->type = From(tokens[0]);
   if (cmd->type == INVALID) {
     return UNKNOWN_CMD;
@@ -33,6 +33,7 @@ class MemcacheParser {
 
     QUIT = 20,
     VERSION = 21,
+    NOOP = 22,  // mn, meta no-op.
 
     // The rest of write commands.
     DELETE = 31,
@@ -41,7 +42,22 @@ class MemcacheParser {
     FLUSHALL = 34,
   };
 
+  // Flags of the meta commands that shape their responses, see
+  // https://github.com/memcached/memcached/wiki/MetaCommands
+  struct MetaFlags {
+    std::string_view opaque;    // O<token>, echoed back in the response.
+    bool return_value = false;  // v
+    bool return_ttl = false;    // t
+    bool return_cas = false;    // c
+    bool return_flags = false;  // f
+    bool return_size = false;   // s
+    bool return_key = false;    // k
+    bool quiet = false;         // q, omits the HD, NF and EN responses.
+  };
+
   // According to https://github.com/memcached/memcached/wiki/Commands#standard-protocol
+  // Meta commands are parsed into the standard commands they correspond to with meta set:
+  // mg into GET, ms into one of the store commands, md into DELETE and ma into INCR or DECR.
   struct Command {
     CmdType type = INVALID;
     std::string_view key;
@@ -56,6 +72,9 @@ class MemcacheParser {
     uint32_t bytes_len = 0;
     uint32_t flags = 0;
     bool no_reply = false;
+
+    bool meta = false;
+    MetaFlags meta_flags;
   };
 
   enum Result {
@@ -78,6 +78,51 @@ TEST_F(MCParserTest, Stats) {
   EXPECT_EQ(MemcacheParser::PARSE_ERROR, st);
 }
 
+TEST_F(MCParserTest, Meta) {
+  MemcacheParser::Result st = parser_.Parse("mg key v t f Oop q\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::GET, cmd_.type);
+  EXPECT_TRUE(cmd_.meta);
+  EXPECT_EQ("key", cmd_.key);
+  EXPECT_TRUE(cmd_.meta_flags.return_value);
+  EXPECT_TRUE(cmd_.meta_flags.return_ttl);
+  EXPECT_TRUE(cmd_.meta_flags.return_flags);
+  EXPECT_FALSE(cmd_.meta_flags.return_cas);
+  EXPECT_TRUE(cmd_.meta_flags.quiet);
+  EXPECT_EQ("op", cmd_.meta_flags.opaque);
+  EXPECT_FALSE(cmd_.no_reply);
+
+  st = parser_.Parse("ms key 5 T10 F3 MP\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::PREPEND, cmd_.type);
+  EXPECT_EQ(5, cmd_.bytes_len);
+  EXPECT_EQ(10, cmd_.expire_ts);
+  EXPECT_EQ(3, cmd_.flags);
+  EXPECT_TRUE(cmd_.meta_flags.opaque.empty());
+
+  st = parser_.Parse("ma key D7 M-\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::DECR, cmd_.type);
+  EXPECT_EQ(7, cmd_.delta);
+
+  st = parser_.Parse("md key\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::DELETE, cmd_.type);
+
+  st = parser_.Parse("mn\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_EQ(MemcacheParser::NOOP, cmd_.type);
+
+  st = parser_.Parse("set a 1 20 3\r\n", &consumed_, &cmd_);
+  EXPECT_EQ(MemcacheParser::OK, st);
+  EXPECT_FALSE(cmd_.meta);
+
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("mg key T10\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::PARSE_ERROR, parser_.Parse("ms key 3 MX\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::BAD_INT, parser_.Parse("ms key\r\n", &consumed_, &cmd_));
+  EXPECT_EQ(MemcacheParser::UNKNOWN_CMD, parser_.Parse("mx key\r\n", &consumed_, &cmd_));
+}
+
 TEST_F(MCParserTest, NoreplyBasic) {
   MemcacheParser::Result st = parser_.Parse("set mykey 1 2 3 noreply\r\n", &consumed_, &cmd_);
 
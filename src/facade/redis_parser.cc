@@ -7,11 +7,84 @@
 
 #include "base/logging.h"
 #include "core/heap_size.h"
+#include "facade/facade_types.h"
 
 namespace facade {
 
 using namespace std;
 
+namespace {
+
+// Parses a non-negative decimal number terminated by CRLF in a single pass, which is the
+// common case for array and bulk headers. Returns the number of consumed bytes including CRLF,
+// or 0 if the input should be handled by the generic path.
+inline size_t ParseShortNum(const uint8_t* s, const uint8_t* end, int64_t* res) {
+  constexpr ptrdiff_t kMaxDigits = 18;  // Fits into int64_t.
+
+  const uint8_t* p = s;
+  uint64_t val = 0;
+  while (p < end && p - s < kMaxDigits) {
+    unsigned digit = unsigned(*p) - '0';
+    if (digit > 9)
+      break;
+    val = val * 10 + digit;
+    ++p;
+  }
+
+  if (p == s || end - p < 2 || p[0] != '\r' || p[1] != '\n')
+    return 0;
+
+  *res = val;
+  return p - s + 2;
+}
+
+// The stash holds partially received requests until they complete. Its vectors are recycled
+// across the parsers of the thread instead of being allocated for every such request.
+constexpr size_t kMaxPooledVecs = 64;
+constexpr size_t kMaxPooledBlobSize = 16 << 10;
+constexpr size_t kMaxPooledVecLen = 1024;
+
+thread_local vector<unique_ptr<RespVec>> tl_vec_pool;
+thread_local vector<vector<uint8_t>> tl_blob_pool;
+
+void CountPoolAccess(bool hit) {
+  if (tl_facade_stats)
+    ++(hit ? tl_facade_stats->conn_stats.request_pool_hits
+           : tl_facade_stats->conn_stats.request_pool_misses);
+}
+
+unique_ptr<RespVec> AllocVec() {
+  CountPoolAccess(!tl_vec_pool.empty());
+  if (tl_vec_pool.empty())
+    return make_unique<RespVec>();
+
+  unique_ptr<RespVec> res = std::move(tl_vec_pool.back());
+  tl_vec_pool.pop_back();
+  return res;
+}
+
+vector<uint8_t> AllocBlob(size_t size) {
+  CountPoolAccess(!tl_blob_pool.empty());
+  vector<uint8_t> res;
+  if (!tl_blob_pool.empty()) {
+    res = std::move(tl_blob_pool.back());
+    tl_blob_pool.pop_back();
+  }
+  res.resize(size);
+  return res;
+}
+
+template <typename T> void Recycle(vector<T>* src, vector<T>* pool) {
+  for (auto& item : *src) {
+    if (pool->size() >= kMaxPooledVecs)
+      break;
+    pool->push_back(std::move(item));
+  }
+  src->clear();
+}
+
+}  // namespace
+
 auto RedisParser::Parse(Buffer str, uint32_t* consumed, RespExpr::Vec* res) -> Result {
   *consumed = 0;
   res->clear();
@@ -82,8 +155,12 @@ auto RedisParser::Parse(Buffer str, uint32_t* consumed, RespExpr::Vec* res) -> R
 }
 
 void RedisParser::InitStart(uint8_t prefix_b, RespExpr::Vec* res) {
-  buf_stash_.clear();
-  stash_.clear();
+  erase_if(buf_stash_, [](const Blob& blob) { return blob.capacity() > kMaxPooledBlobSize; });
+  Recycle(&buf_stash_, &tl_blob_pool);
+  erase_if(stash_, [](const auto& vec) { return vec->capacity() > kMaxPooledVecLen; });
+  for (auto& vec : stash_)
+    vec->clear();
+  Recycle(&stash_, &tl_vec_pool);
   cached_expr_ = res;
   parse_stack_.clear();
   last_stashed_level_ = 0;
@@ -119,7 +196,8 @@ void RedisParser::StashState(RespExpr::Vec* res) {
   }
 
   if (cached_expr_ == res) {
-    stash_.emplace_back(new RespExpr::Vec(*res));
+    stash_.push_back(AllocVec());
+    *stash_.back() = *res;
     cached_expr_ = stash_.back().get();
   }
 
@@ -134,7 +212,7 @@ void RedisParser::StashState(RespExpr::Vec* res) {
         if (ebuf.empty() && last_stashed_index_ + 1 == cur.size())
           break;
         if (!ebuf.empty() && !e.has_support) {
-          Blob blob(ebuf.size());
+          Blob blob = AllocBlob(ebuf.size());
           memcpy(blob.data(), ebuf.data(), ebuf.size());
           ebuf = Buffer{blob.data(), blob.size()};
           buf_stash_.push_back(std::move(blob));
@@ -211,6 +289,11 @@ auto RedisParser::ParseNum(Buffer str, int64_t* res) -> Result {
   }
   DCHECK(str[0] == '$' || str[0] == '*' || str[0] == '%' || str[0] == '~');
 
+  if (size_t len = ParseShortNum(str.data() + 1, str.end(), res); len) {
+    last_consumed_ = len + 1;
+    return OK;
+  }
+
   char* s = reinterpret_cast<char*>(str.data() + 1);
   char* pos = reinterpret_cast<char*>(memchr(s, '\n', str.size() - 1));
   if (!pos) {
@@ -274,7 +357,7 @@ auto RedisParser::ConsumeArrayLen(Buffer str) -> Result {
     DCHECK(!server_mode_);
 
     cached_expr_->emplace_back(RespExpr::ARRAY);
-    stash_.emplace_back(new RespExpr::Vec());
+    stash_.push_back(AllocVec());
     RespExpr::Vec* arr = stash_.back().get();
     arr->reserve(len);
     cached_expr_->back().u = arr;
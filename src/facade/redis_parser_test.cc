@@ -133,6 +133,19 @@ TEST_F(RedisParserTest, Multi3) {
   EXPECT_THAT(args_, ElementsAre("SET", "key:000002273458", "VXK"));
 }
 
+TEST_F(RedisParserTest, StashReuse) {
+  // Requests split across reads are stashed, and the stash is recycled by the next ones.
+  for (unsigned i = 0; i < 3; ++i) {
+    string key = absl::StrCat("key:", i, string(i * 10, 'x'));
+    string first = absl::StrCat("*3\r\n$3\r\nSET\r\n$", key.size(), "\r\n", key.substr(0, 5));
+    ASSERT_EQ(RedisParser::INPUT_PENDING, Parse(first));
+    string second = absl::StrCat(key.substr(5), "\r\n$1\r\n", i, "\r\n");
+    string rest = absl::StrCat(first.substr(consumed_), second);
+    ASSERT_EQ(RedisParser::OK, Parse(rest));
+    EXPECT_THAT(args_, ElementsAre("SET", key, absl::StrCat(i)));
+  }
+}
+
 TEST_F(RedisParserTest, ClientMode) {
   parser_.SetClientMode();
 
@@ -209,4 +222,43 @@ TEST_F(RedisParserTest, NestedArray) {
   ASSERT_THAT(args_[1].GetVec(), ElementsAre("car"));
 }
 
+TEST_F(RedisParserTest, Headers) {
+  ASSERT_EQ(RedisParser::OK, Parse("*2\r\n$0\r\n\r\n$012\r\nabcdefghijkl\r\n"));
+  EXPECT_THAT(args_, ElementsAre("", "abcdefghijkl"));
+
+  ASSERT_EQ(RedisParser::BAD_ARRAYLEN, Parse("*1\r\n$1a\r\nx\r\n"));
+  parser_ = RedisParser{};
+  ASSERT_EQ(RedisParser::BAD_ARRAYLEN, Parse("*99999999999999999999\r\n"));
+  parser_ = RedisParser{};
+
+  // The header is split between two reads.
+  ASSERT_EQ(RedisParser::INPUT_PENDING, Parse("*1\r\n$10\r"));
+  ASSERT_EQ(4, consumed_);
+  ASSERT_EQ(RedisParser::OK, Parse("$10\r\n0123456789\r\n"));
+  EXPECT_THAT(args_, ElementsAre("0123456789"));
+}
+
+static void BM_ParsePipelinedSet(benchmark::State& state) {
+  constexpr unsigned kNumCmds = 256;
+  string input;
+  for (unsigned i = 0; i < kNumCmds; ++i) {
+    string key = absl::StrCat("key:", 100000 + i);
+    absl::StrAppend(&input, "*3\r\n$3\r\nSET\r\n$", key.size(), "\r\n", key, "\r\n$16\r\n",
+                    string(16, 'x'), "\r\n");
+  }
+
+  RedisParser parser;
+  RespVec args;
+  uint32_t consumed;
+  while (state.KeepRunning()) {
+    RedisParser::Buffer buf{reinterpret_cast<uint8_t*>(input.data()), input.size()};
+    while (!buf.empty()) {
+      CHECK_EQ(RedisParser::OK, parser.Parse(buf, &consumed, &args));
+      buf.remove_prefix(consumed);
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * kNumCmds);
+}
+BENCHMARK(BM_ParsePipelinedSet);
+
 }  // namespace facade
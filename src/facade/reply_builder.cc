@@ -10,11 +10,17 @@
 #include <double-conversion/double-to-string.h>
 
 #include "absl/strings/escaping.h"
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/heap_size.h"
 #include "facade/error.h"
+#include "facade/reply_offload.h"
 #include "util/fibers/proactor_base.h"
 
+ABSL_FLAG(uint32_t, reply_batch_limit, 8192,
+          "Maximum number of bytes of pipelined replies that are coalesced before they are "
+          "written to the socket");
+
 using namespace std;
 using absl::StrAppend;
 using namespace double_conversion;
@@ -28,6 +34,16 @@ inline iovec constexpr IoVec(std::string_view s) {
   return r;
 }
 
+// Batch buffers that grew beyond this size are moved to a per thread pool after they were
+// flushed, so that connections which pipelined once don't keep a large buffer while idle, and
+// the next pipeline on the thread doesn't have to grow a buffer again.
+constexpr size_t kRetainedBatchCapacity = 1024;
+
+// Bounds the memory kept by the pool to kMaxPooledBatches * reply_batch_limit per thread.
+constexpr size_t kMaxPooledBatches = 32;
+
+thread_local vector<string> tl_batch_pool;
+
 constexpr char kCRLF[] = "\r\n";
 constexpr char kErrPref[] = "-ERR ";
 constexpr char kSimplePref[] = "+";
@@ -53,6 +69,7 @@ SinkReplyBuilder::MGetResponse::~MGetResponse() {
 
 SinkReplyBuilder::SinkReplyBuilder(::io::Sink* sink)
     : sink_(sink),
+      batch_limit_(absl::GetFlag(FLAGS_reply_batch_limit)),
       should_batch_(false),
       should_aggregate_(false),
       has_replied_(true),
@@ -71,15 +88,21 @@ void SinkReplyBuilder::ResetThreadLocalStats() {
 void SinkReplyBuilder::Send(const iovec* v, uint32_t len) {
   has_replied_ = true;
   DCHECK(sink_);
-  constexpr size_t kMaxBatchSize = 1024;
 
   size_t bsize = 0;
   for (unsigned i = 0; i < len; ++i) {
     bsize += v[i].iov_len;
   }
 
-  // Allow batching with up to kMaxBatchSize of data.
-  if ((should_batch_ || should_aggregate_) && (batch_.size() + bsize < kMaxBatchSize)) {
+  // Allow batching with up to batch_limit_ of data. Beyond that the batch and the new reply
+  // are written together with a single vectored write.
+  if ((should_batch_ || should_aggregate_) && (batch_.size() + bsize < batch_limit_)) {
+    if (batch_.size() + bsize > batch_.capacity() && batch_.capacity() <= kRetainedBatchCapacity &&
+        !tl_batch_pool.empty()) {
+      tl_batch_pool.back().append(batch_);
+      batch_.swap(tl_batch_pool.back());
+      tl_batch_pool.pop_back();
+    }
     batch_.reserve(batch_.size() + bsize);
     for (unsigned i = 0; i < len; ++i) {
       std::string_view src((char*)v[i].iov_base, v[i].iov_len);
@@ -185,14 +208,34 @@ void SinkReplyBuilder::FlushBatch() {
   if (batch_.empty())
     return;
 
+  tl_facade_stats->reply_stats.io_write_cnt++;
+  tl_facade_stats->reply_stats.io_write_bytes += batch_.size();
   error_code ec = sink_->Write(io::Buffer(batch_));
-  batch_.clear();
+  ReleaseBatch();
   if (ec) {
     DVLOG(1) << "Error flushing to stream: " << ec.message();
     ec_ = ec;
   }
 }
 
+void SinkReplyBuilder::ReleaseBatch() {
+  batch_.clear();
+  if (batch_.capacity() <= kRetainedBatchCapacity)
+    return;
+
+  if (tl_batch_pool.size() < kMaxPooledBatches)
+    tl_batch_pool.emplace_back().swap(batch_);
+  else
+    string{}.swap(batch_);
+}
+
+size_t SinkReplyBuilder::GetThreadLocalBatchPoolBytes() {
+  size_t res = 0;
+  for (const auto& buf : tl_batch_pool)
+    res += buf.capacity();
+  return res;
+}
+
 size_t SinkReplyBuilder::UsedMemory() const {
   return dfly::HeapSize(batch_);
 }
@@ -210,32 +253,90 @@ void MCReplyBuilder::SendSimpleString(std::string_view str) {
 }
 
 void MCReplyBuilder::SendStored() {
+  if (meta_cmd_)
+    return SendMetaStatus("HD");
   SendSimpleString("STORED");
 }
 
 void MCReplyBuilder::SendLong(long val) {
   char buf[32];
   char* next = absl::numbers_internal::FastIntToBuffer(val, buf);
-  SendSimpleString(string_view(buf, next - buf));
+  string_view str(buf, next - buf);
+
+  if (meta_cmd_ && meta_cmd_->meta_flags.return_value) {
+    string header = absl::StrCat("VA ", str.size());
+    AppendMetaFlags(nullptr, &header);
+    absl::StrAppend(&header, kCRLF);
+    iovec v[] = {IoVec(header), IoVec(str), IoVec(kCRLF)};
+    return Send(v, ABSL_ARRAYSIZE(v));
+  }
+
+  if (meta_cmd_)
+    return SendMetaStatus("HD");
+  SendSimpleString(str);
 }
 
 void MCReplyBuilder::SendMGetResponse(MGetResponse resp) {
   string header;
-  for (unsigned i = 0; i < resp.resp_arr.size(); ++i) {
-    if (resp.resp_arr[i]) {
-      const auto& src = *resp.resp_arr[i];
-      absl::StrAppend(&header, "VALUE ", src.key, " ", src.mc_flag, " ", src.value.size());
-      if (src.mc_ver) {
-        absl::StrAppend(&header, " ", src.mc_ver);
+  if (meta_cmd_) {
+    for (const auto& src : resp.resp_arr) {
+      if (!src) {
+        SendMetaStatus("EN");
+        continue;
       }
 
-      absl::StrAppend(&header, "\r\n");
-      iovec v[] = {IoVec(header), IoVec(src.value), IoVec(kCRLF)};
-      Send(v, ABSL_ARRAYSIZE(v));
-      header.clear();
+      bool with_value = meta_cmd_->meta_flags.return_value;
+      header = with_value ? absl::StrCat("VA ", src->value.size()) : "HD";
+      AppendMetaFlags(&*src, &header);
+      absl::StrAppend(&header, kCRLF);
+
+      // The value is sent directly from the storage of the response.
+      iovec v[] = {IoVec(header), IoVec(src->value), IoVec(kCRLF)};
+      Send(v, with_value ? ABSL_ARRAYSIZE(v) : 1);
+    }
+    return;
+  }
+
+  // The headers of all the items are formatted into a single buffer and the values are referenced
+  // directly, so that the reply is written with a writev per kBatchItems items. Each header
+  // starts with the CRLF that terminates the previous value.
+  size_t headers_len = 0;
+  for (const auto& src : resp.resp_arr) {
+    if (src)
+      headers_len += src->key.size() + 64;  // CRLF, "VALUE ", 3 numbers and separators.
+  }
+  header.reserve(headers_len);  // iovecs point into the buffer, so it must not reallocate.
+
+  constexpr size_t kBatchItems = 32;
+  iovec vec_batch[kBatchItems * 2 + 1];
+  unsigned vec_indx = 0;
+  string_view crlf;
+
+  for (const auto& src : resp.resp_arr) {
+    if (!src)
+      continue;
+
+    size_t start = header.size();
+    absl::StrAppend(&header, crlf, "VALUE ", src->key, " ", src->mc_flag, " ", src->value.size());
+    if (src->mc_ver) {
+      absl::StrAppend(&header, " ", src->mc_ver);
+    }
+    absl::StrAppend(&header, kCRLF);
+    crlf = kCRLF;
+
+    vec_batch[vec_indx++] = IoVec(string_view{header}.substr(start));
+    vec_batch[vec_indx++] = IoVec(src->value);
+    if (vec_indx == kBatchItems * 2) {
+      Send(vec_batch, vec_indx);
+      if (ec_)
+        return;
+      vec_indx = 0;
     }
   }
-  SendSimpleString("END");
+
+  constexpr string_view kEnd = "\r\nEND\r\n";
+  vec_batch[vec_indx++] = IoVec(crlf.empty() ? kEnd.substr(2) : kEnd);
+  Send(vec_batch, vec_indx);
 }
 
 void MCReplyBuilder::SendError(string_view str, std::string_view type) {
@@ -256,13 +357,51 @@ void MCReplyBuilder::SendClientError(string_view str) {
 }
 
 void MCReplyBuilder::SendSetSkipped() {
+  if (meta_cmd_)
+    return SendMetaStatus("NS");
   SendSimpleString("NOT_STORED");
 }
 
 void MCReplyBuilder::SendNotFound() {
+  if (meta_cmd_)
+    return SendMetaStatus("NF");
   SendSimpleString("NOT_FOUND");
 }
 
+void MCReplyBuilder::SendDeleted() {
+  if (meta_cmd_)
+    return SendMetaStatus("HD");
+  SendSimpleString("DELETED");
+}
+
+void MCReplyBuilder::SendMetaStatus(string_view status) {
+  if (meta_cmd_->meta_flags.quiet && (status == "HD" || status == "NF" || status == "EN"))
+    return;
+
+  string line{status};
+  AppendMetaFlags(nullptr, &line);
+  SendSimpleString(line);
+}
+
+void MCReplyBuilder::AppendMetaFlags(const GetResp* resp, string* dest) const {
+  const auto& mf = meta_cmd_->meta_flags;
+  if (resp) {
+    if (mf.return_flags)
+      absl::StrAppend(dest, " f", resp->mc_flag);
+    if (mf.return_size)
+      absl::StrAppend(dest, " s", resp->value.size());
+    if (mf.return_cas)
+      absl::StrAppend(dest, " c", resp->mc_ver);
+    if (mf.return_ttl)
+      absl::StrAppend(dest, " t", resp->mc_ttl);
+  }
+
+  if (mf.return_key)
+    absl::StrAppend(dest, " k", meta_cmd_->key);
+  if (!mf.opaque.empty())
+    absl::StrAppend(dest, " O", mf.opaque);
+}
+
 char* RedisReplyBuilder::FormatDouble(double val, char* dest, unsigned dest_len) {
   StringBuilder sb(dest, dest_len);
   CHECK(dfly_conv.ToShortest(val, &sb));
@@ -519,6 +658,14 @@ void RedisReplyBuilder::SendStringArr(StrSpan arr, CollectionType type) {
   auto cb = [&](size_t i) {
     return visit([i](auto& span) { return facade::ToSV(span[i]); }, arr.span);
   };
+
+  if (ReplyOffload::ShouldOffload(arr.Size())) {
+    string serialized;
+    ReplyOffload::Run([&] { serialized = SerializeStringArr(arr.Size(), cb, type); });
+    SendRaw(serialized);
+    return;
+  }
+
   SendStringArrInternal(arr.Size(), std::move(cb), type);
 }
 
@@ -530,6 +677,71 @@ constexpr static string_view START_SYMBOLS[] = {"*", "~", "%", ">"};
 static_assert(START_SYMBOLS[RedisReplyBuilder::MAP] == "%" &&
               START_SYMBOLS[RedisReplyBuilder::SET] == "~");
 
+void RedisReplyBuilder::SendSerializedTail(StrSpan head, unsigned len, string_view serialized,
+                                           CollectionType type) {
+  DCHECK(type == ARRAY || type == PUSH);
+  string header = absl::StrCat(is_resp3_ ? START_SYMBOLS[type] : "*", len, kCRLF);
+  for (string_view str : head)
+    absl::StrAppend(&header, "$", str.size(), kCRLF, str, kCRLF);
+
+  iovec v[2] = {IoVec(header), IoVec(serialized)};
+  Send(v, 2);
+}
+
+void RedisReplyBuilder::SendBulkStrArr(unsigned len, BulkStrChunks chunks, CollectionType type) {
+  // Bounds the size of a single write to about 256KB.
+  constexpr size_t kChunksPerWrite = 16;
+
+  unsigned header_len = len;
+  string_view type_char = "*";
+  if (is_resp3_) {
+    type_char = START_SYMBOLS[type];
+    if (type == MAP)
+      header_len /= 2;  // Each key value pair counts as one.
+  }
+
+  string header = absl::StrCat(type_char, header_len, kCRLF);
+  iovec v[kChunksPerWrite + 1];
+  v[0] = IoVec(header);
+  size_t pos = 0;
+  do {
+    unsigned vlen = pos == 0 ? 1 : 0;  // the header goes with the first chunks.
+    size_t end = min(chunks.size(), pos + kChunksPerWrite);
+    for (size_t i = pos; i < end; ++i)
+      v[vlen++] = IoVec(chunks[i]);
+    Send(v, vlen);
+
+    for (; pos < end; ++pos)
+      string{}.swap(chunks[pos]);
+  } while (pos < chunks.size());
+}
+
+void RedisReplyBuilder::AppendBulkString(string_view str, BulkStrChunks* chunks) {
+  if (chunks->empty() || chunks->back().size() >= kBulkChunkSize) {
+    chunks->emplace_back();
+    chunks->back().reserve(kBulkChunkSize + 32);
+  }
+
+  char buf[absl::numbers_internal::kFastToBufferSize + 1];
+  buf[0] = '$';
+  char* next = absl::numbers_internal::FastIntToBuffer(str.size(), buf + 1);
+  chunks->back().append(buf, next - buf).append(kCRLF).append(str).append(kCRLF);
+}
+
+void RedisReplyBuilder::ForEachBulkString(const BulkStrChunks& chunks,
+                                          absl::FunctionRef<void(string_view)> cb) {
+  for (string_view body : chunks) {
+    while (!body.empty()) {
+      DCHECK_EQ(body[0], '$');
+      size_t pos = body.find('\r');
+      size_t len = 0;
+      CHECK(absl::SimpleAtoi(body.substr(1, pos - 1), &len));
+      cb(body.substr(pos + 2, len));
+      body.remove_prefix(pos + 2 + len + 2);
+    }
+  }
+}
+
 void RedisReplyBuilder::StartCollection(unsigned len, CollectionType type) {
   if (!is_resp3_) {  // Flatten for Resp2
     if (type == MAP)
@@ -633,6 +845,31 @@ void RedisReplyBuilder::SendStringArrInternal(
   Send(vec.data(), vec_indx + 1);
 }
 
+string RedisReplyBuilder::SerializeStringArr(size_t size,
+                                             absl::FunctionRef<std::string_view(unsigned)> producer,
+                                             CollectionType type) const {
+  size_t header_len = size;
+  string_view type_char = "*";
+  if (is_resp3_) {
+    type_char = START_SYMBOLS[type];
+    if (type == MAP)
+      header_len /= 2;  // Each key value pair counts as one.
+  }
+
+  size_t total = 16;
+  for (unsigned i = 0; i < size; ++i)
+    total += producer(i).size() + 16;
+
+  string res;
+  res.reserve(total);
+  StrAppend(&res, type_char, header_len, kCRLF);
+  for (unsigned i = 0; i < size; ++i) {
+    string_view src = producer(i);
+    StrAppend(&res, "$", src.size(), kCRLF, src, kCRLF);
+  }
+  return res;
+}
+
 void ReqSerializer::SendCommand(std::string_view str) {
   VLOG(2) << "SendCommand: " << str;
 
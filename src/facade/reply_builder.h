@@ -9,6 +9,7 @@
 #include <string_view>
 
 #include "facade/facade_types.h"
+#include "facade/memcache_parser.h"
 #include "facade/op_status.h"
 #include "io/io.h"
 
@@ -34,6 +35,7 @@ class SinkReplyBuilder {
 
     uint64_t mc_ver = 0;  // 0 means we do not output it (i.e has not been requested).
     uint32_t mc_flag = 0;
+    int32_t mc_ttl = -1;  // remaining seconds if requested, -1 if the key does not expire.
 
     GetResp() = default;
     GetResp(std::string_view val) : value(val) {
@@ -147,6 +149,9 @@ class SinkReplyBuilder {
 
   static void ResetThreadLocalStats();
 
+  // Capacity of the flushed batch buffers kept for reuse by the connections of this thread.
+  static size_t GetThreadLocalBatchPoolBytes();
+
  protected:
   void SendRaw(std::string_view str);  // Sends raw without any formatting.
   void SendRawVec(absl::Span<const std::string_view> msg_vec);
@@ -156,9 +161,13 @@ class SinkReplyBuilder {
   void StartAggregate();
   void StopAggregate();
 
+  // Clears the batch after it was flushed, moving its memory to the pool if it grew large.
+  void ReleaseBatch();
+
   std::string batch_;
   ::io::Sink* sink_;
   std::error_code ec_;
+  uint32_t batch_limit_;  // replies are coalesced into batch_ up to this size.
 
   bool should_batch_ : 1;
 
@@ -187,6 +196,7 @@ class MCReplyBuilder : public SinkReplyBuilder {
 
   void SendClientError(std::string_view str);
   void SendNotFound();
+  void SendDeleted();
   void SendSimpleString(std::string_view str) final;
   void SendProtocolError(std::string_view str) final;
 
@@ -195,6 +205,21 @@ class MCReplyBuilder : public SinkReplyBuilder {
   }
 
   bool NoReply() const;
+
+  // Formats the replies as the responses of the meta command until reset with nullptr.
+  // The command must outlive the replies.
+  void SetMetaCmd(const MemcacheParser::Command* cmd) {
+    meta_cmd_ = cmd;
+  }
+
+ private:
+  // Sends a meta status line, like HD or NF, with the requested return flags.
+  void SendMetaStatus(std::string_view status);
+
+  // Appends the return flags requested by the meta command, resp is set for retrievals.
+  void AppendMetaFlags(const GetResp* resp, std::string* dest) const;
+
+  const MemcacheParser::Command* meta_cmd_ = nullptr;
 };
 
 class RedisReplyBuilder : public SinkReplyBuilder {
@@ -236,6 +261,31 @@ class RedisReplyBuilder : public SinkReplyBuilder {
   virtual void SendScoredArray(const std::vector<std::pair<std::string, double>>& arr,
                                bool with_scores);
 
+  // Bulk strings serialized with AppendBulkString. Chunks end on string boundaries and hold
+  // about kBulkChunkSize bytes, so that huge collections are neither serialized into nor
+  // written from a single buffer.
+  using BulkStrChunks = std::vector<std::string>;
+  static constexpr size_t kBulkChunkSize = 16384;
+
+  // Sends a collection of len strings that were serialized into chunks with AppendBulkString.
+  // Lets shards serialize large collections straight from the containers instead of copying
+  // every member into a vector of strings first. For MAP len counts keys and values. The chunks
+  // are written a few at a time and released once written.
+  virtual void SendBulkStrArr(unsigned len, BulkStrChunks chunks, CollectionType type = ARRAY);
+
+  // Appends str to the last of the chunks, serialized as a bulk string. Starts a new chunk once
+  // the last one is full.
+  static void AppendBulkString(std::string_view str, BulkStrChunks* chunks);
+
+  // Calls cb with each of the strings serialized in chunks with AppendBulkString.
+  static void ForEachBulkString(const BulkStrChunks& chunks,
+                                absl::FunctionRef<void(std::string_view)> cb);
+
+  // Sends a collection of len elements that starts with the strings in head and continues with
+  // the remaining elements already encoded in RESP in serialized.
+  void SendSerializedTail(StrSpan head, unsigned len, std::string_view serialized,
+                          CollectionType type = ARRAY);
+
   void StartArray(unsigned len);  // StartCollection(len, ARRAY)
 
   virtual void StartCollection(unsigned len, CollectionType type);
@@ -246,6 +296,12 @@ class RedisReplyBuilder : public SinkReplyBuilder {
   void SendStringArrInternal(size_t size, absl::FunctionRef<std::string_view(unsigned)> producer,
                              CollectionType type);
 
+  // Serializes the same reply as SendStringArrInternal into a single buffer, does not access
+  // the sink, so it can run on another thread.
+  std::string SerializeStringArr(size_t size,
+                                 absl::FunctionRef<std::string_view(unsigned)> producer,
+                                 CollectionType type) const;
+
   bool is_resp3_ = false;
 };
 
@@ -717,6 +717,38 @@ TEST_F(RedisReplyBuilderTest, BatchMode) {
                           absl::StrCat(kBulkStringStart, "0"), std::string_view{}));
 }
 
+TEST_F(RedisReplyBuilderTest, BatchModeCoalescing) {
+  // Small replies of a deep pipeline are coalesced into a single write.
+  builder_->SetBatchMode(true);
+  for (unsigned i = 0; i < 500; ++i)
+    builder_->SendLong(i);
+  ASSERT_EQ(SinkSize(), 0);
+
+  builder_->FlushBatch();
+  EXPECT_EQ(GetReplyStats().io_write_cnt, 1);
+  EXPECT_EQ(GetReplyStats().io_write_bytes, SinkSize());
+  builder_->SetBatchMode(false);
+}
+
+TEST_F(RedisReplyBuilderTest, BatchBufferPool) {
+  // Large batch buffers are pooled after the flush and reused by the next batch of the thread.
+  size_t pooled = SinkReplyBuilder::GetThreadLocalBatchPoolBytes();
+  builder_->SetBatchMode(true);
+  for (unsigned i = 0; i < 500; ++i)
+    builder_->SendLong(i);
+  builder_->FlushBatch();
+  EXPECT_GT(SinkReplyBuilder::GetThreadLocalBatchPoolBytes(), pooled);
+
+  pooled = SinkReplyBuilder::GetThreadLocalBatchPoolBytes();
+  for (unsigned i = 0; i < 10; ++i)
+    builder_->SendLong(i);
+  EXPECT_LT(SinkReplyBuilder::GetThreadLocalBatchPoolBytes(), pooled);
+
+  builder_->FlushBatch();
+  EXPECT_EQ(SinkReplyBuilder::GetThreadLocalBatchPoolBytes(), pooled);
+  builder_->SetBatchMode(false);
+}
+
 TEST_F(RedisReplyBuilderTest, Resp3Double) {
   builder_->SetResp3(true);
   builder_->SendDouble(5.5);
@@ -763,6 +795,65 @@ TEST_F(RedisReplyBuilderTest, SendStringArrayAsSet) {
       << "SendStringArrayAsSet Resp3 Failed.";
 }
 
+TEST_F(RedisReplyBuilderTest, SendSerializedTail) {
+  const std::vector<std::string> head{"pmessage", "ch*"};
+  const std::string_view tail = "$3\r\nch1\r\n$5\r\nhello\r\n";
+
+  builder_->SetResp3(false);
+  builder_->SendSerializedTail(head, 4, tail, builder_->PUSH);
+  ASSERT_TRUE(NoErrors());
+  ASSERT_EQ(TakePayload(), "*4\r\n$8\r\npmessage\r\n$3\r\nch*\r\n$3\r\nch1\r\n$5\r\nhello\r\n");
+
+  builder_->SetResp3(true);
+  builder_->SendSerializedTail(head, 4, tail, builder_->PUSH);
+  ASSERT_TRUE(NoErrors());
+  ASSERT_EQ(TakePayload(), ">4\r\n$8\r\npmessage\r\n$3\r\nch*\r\n$3\r\nch1\r\n$5\r\nhello\r\n");
+}
+
+TEST_F(RedisReplyBuilderTest, SendBulkStrArr) {
+  RedisReplyBuilder::BulkStrChunks chunks;
+  for (std::string_view str : {"k1", "value", ""})
+    RedisReplyBuilder::AppendBulkString(str, &chunks);
+  RedisReplyBuilder::AppendBulkString("v2", &chunks);
+  ASSERT_THAT(chunks, ElementsAre("$2\r\nk1\r\n$5\r\nvalue\r\n$0\r\n\r\n$2\r\nv2\r\n"));
+  const std::string body = chunks[0];
+
+  std::vector<std::string> parsed;
+  RedisReplyBuilder::ForEachBulkString(chunks,
+                                       [&](std::string_view str) { parsed.emplace_back(str); });
+  EXPECT_THAT(parsed, ElementsAre("k1", "value", "", "v2"));
+
+  builder_->SetResp3(false);
+  builder_->SendBulkStrArr(4, chunks, builder_->MAP);
+  ASSERT_TRUE(NoErrors());
+  ASSERT_EQ(TakePayload(), "*4\r\n" + body);
+
+  builder_->SetResp3(true);
+  builder_->SendBulkStrArr(4, chunks, builder_->MAP);
+  ASSERT_TRUE(NoErrors());
+  ASSERT_EQ(TakePayload(), "%2\r\n" + body);
+
+  builder_->SendBulkStrArr(0, {}, builder_->SET);
+  ASSERT_EQ(TakePayload(), "~0\r\n");
+  builder_->SetResp3(false);
+
+  // Large collections are split into chunks on string boundaries and written in parts.
+  chunks.clear();
+  std::string expected = "*5000\r\n";
+  const std::string member(100, 'x');
+  for (unsigned i = 0; i < 5000; ++i) {
+    RedisReplyBuilder::AppendBulkString(member, &chunks);
+    absl::StrAppend(&expected, "$100\r\n", member, "\r\n");
+  }
+  EXPECT_GT(chunks.size(), 16u);
+  for (const auto& chunk : chunks)
+    EXPECT_LE(chunk.size(), RedisReplyBuilder::kBulkChunkSize + 108);
+
+  builder_->SendBulkStrArr(5000, std::move(chunks));
+  ASSERT_TRUE(NoErrors());
+  ASSERT_EQ(TakePayload(), expected);
+}
+
 TEST_F(RedisReplyBuilderTest, SendScoredArray) {
   const std::vector<std::pair<std::string, double>> scored_array{
       {"e1", 1.1}, {"e2", 2.2}, {"e3", 3.3}};
@@ -881,6 +972,7 @@ TEST_F(RedisReplyBuilderTest, BasicCapture) {
       [kTestSws](RRB* r) { r->SendStringArr(kTestSws); },
       [kTestSws](RRB* r) { r->SendStringArr(kTestSws, RRB::SET); },
       [kTestSws](RRB* r) { r->SendStringArr(kTestSws, RRB::MAP); },
+      [](RRB* r) { r->SendBulkStrArr(2, {"$2\r\na1\r\n", "$2\r\na2\r\n"}, RRB::SET); },
       [kTestSws](RRB* r) {
         r->StartArray(3);
         r->SendLong(1L);
@@ -969,4 +1061,21 @@ static void BM_FormatDouble(benchmark::State& state) {
 }
 BENCHMARK(BM_FormatDouble);
 
+static void BM_SendStringArr(benchmark::State& state) {
+  vector<string> strs(state.range(0));
+  for (size_t i = 0; i < strs.size(); ++i) {
+    strs[i] = absl::StrCat("member:", 100000 + i);
+  }
+  vector<string_view> arr(strs.begin(), strs.end());
+
+  io::StringSink sink;
+  RedisReplyBuilder builder(&sink);
+  while (state.KeepRunning()) {
+    builder.SendStringArr(arr);
+    sink.Clear();
+  }
+  state.SetItemsProcessed(state.iterations() * arr.size());
+}
+BENCHMARK(BM_SendStringArr)->Arg(16)->Arg(1024);
+
 }  // namespace facade
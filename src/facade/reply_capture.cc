@@ -56,6 +56,13 @@ void CapturingReplyBuilder::SendStringArr(StrSpan arr, CollectionType type) {
   Capture(StrArrPayload{false, type, {arr.begin(), arr.end()}});
 }
 
+void CapturingReplyBuilder::SendBulkStrArr(unsigned len, BulkStrChunks chunks,
+                                           CollectionType type) {
+  SKIP_LESS(ReplyMode::FULL);
+  DCHECK_EQ(current_.index(), 0u);
+  Capture(SerializedArr{len, type, std::move(chunks)});
+}
+
 void CapturingReplyBuilder::SendNull() {
   SKIP_LESS(ReplyMode::FULL);
   Capture(nullptr_t{});
@@ -179,6 +186,10 @@ struct CaptureVisitor {
       rb->SendStringArr(sa.arr, sa.type);
   }
 
+  void operator()(CapturingReplyBuilder::SerializedArr sa) {
+    rb->SendBulkStrArr(sa.len, std::move(sa.chunks), sa.type);
+  }
+
   void operator()(const unique_ptr<CapturingReplyBuilder::CollectionPayload>& cp) {
     if (!cp) {
       rb->SendNullArray();
@@ -35,6 +35,7 @@ class CapturingReplyBuilder : public RedisReplyBuilder {
   void SendEmptyArray() override;
   void SendSimpleStrArr(StrSpan arr) override;
   void SendStringArr(StrSpan arr, CollectionType type = ARRAY) override;
+  void SendBulkStrArr(unsigned len, BulkStrChunks chunks, CollectionType type = ARRAY) override;
 
   void SendNull() override;
   void SendLong(long val) override;
@@ -57,6 +58,12 @@ class CapturingReplyBuilder : public RedisReplyBuilder {
     std::vector<std::string> arr;
   };
 
+  struct SerializedArr {  // SendBulkStrArr
+    unsigned len;
+    CollectionType type;
+    BulkStrChunks chunks;
+  };
+
   struct CollectionPayload;
 
   struct ScoredArray {
@@ -73,7 +80,8 @@ class CapturingReplyBuilder : public RedisReplyBuilder {
 
   using Payload =
       std::variant<std::monostate, Null, Error, OpStatus, long, double, SimpleString, BulkString,
-                   StrArrPayload, std::unique_ptr<CollectionPayload>, MGetResponse, ScoredArray>;
+                   StrArrPayload, SerializedArr, std::unique_ptr<CollectionPayload>, MGetResponse,
+                   ScoredArray>;
 
   // Non owned Error based on SendError arguments (msg, type)
   using ErrorRef = std::pair<std::string_view, std::string_view>;
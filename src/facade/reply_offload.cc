@@ -0,0 +1,106 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "facade/reply_offload.h"
+
+#include <absl/flags/flag.h>
+
+#include <atomic>
+#include <memory>
+
+#include "base/logging.h"
+#include "base/mpmc_bounded_queue.h"
+#include "util/fibers/fibers.h"
+#include "util/fibers/synchronization.h"
+#include "util/proactor_pool.h"
+
+ABSL_FLAG(uint32_t, reply_offload_min_len, 0,
+          "If positive, the serialization of array replies with at least this number of elements "
+          "can be taken over by idle threads. 0 disables offloading");
+
+namespace facade {
+
+using namespace std;
+using namespace util;
+
+namespace {
+
+struct Job {
+  explicit Job(absl::FunctionRef<void()> f) : fn(f) {
+  }
+
+  // Returns true if the caller is the one to run the job.
+  bool TryClaim() {
+    return !claimed.exchange(true, memory_order_acq_rel);
+  }
+
+  absl::FunctionRef<void()> fn;
+  atomic_bool claimed{false};
+  fb2::Done done;
+};
+
+using JobQueue = base::mpmc_bounded_queue<shared_ptr<Job>>;
+
+JobQueue* job_queue = nullptr;
+size_t min_len = 0;
+
+thread_local uint32_t tl_idle_task = 0;
+
+uint32_t RunOffloadedJob() {
+  constexpr uint32_t kRunAtLowPriority = 0u;
+
+  shared_ptr<Job> job;
+  if (!job_queue->try_dequeue(job))
+    return kRunAtLowPriority;
+
+  // The owner could have given up on waiting and run the job itself.
+  if (job->TryClaim()) {
+    job->fn();
+    job->done.Notify();
+  }
+  return ProactorBase::kOnIdleMaxLevel;
+}
+
+}  // namespace
+
+void ReplyOffload::Init(ProactorPool* pp) {
+  min_len = absl::GetFlag(FLAGS_reply_offload_min_len);
+  if (min_len == 0)
+    return;
+
+  job_queue = new JobQueue(1024);
+  pp->AwaitBrief(
+      [](unsigned, ProactorBase* pb) { tl_idle_task = pb->AddOnIdleTask(RunOffloadedJob); });
+}
+
+void ReplyOffload::Shutdown(ProactorPool* pp) {
+  if (!job_queue)
+    return;
+
+  pp->AwaitBrief([](unsigned, ProactorBase* pb) { pb->RemoveOnIdleTask(tl_idle_task); });
+  delete job_queue;
+  job_queue = nullptr;
+  min_len = 0;
+}
+
+bool ReplyOffload::ShouldOffload(size_t len) {
+  return min_len > 0 && len >= min_len;
+}
+
+void ReplyOffload::Run(absl::FunctionRef<void()> fn) {
+  auto job = make_shared<Job>(fn);
+  if (!job_queue || !job_queue->try_enqueue(job)) {
+    fn();
+    return;
+  }
+
+  ThisFiber::Yield();
+
+  if (job->TryClaim())
+    fn();
+  else
+    job->done.Wait();
+}
+
+}  // namespace facade
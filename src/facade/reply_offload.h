@@ -0,0 +1,38 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/functional/function_ref.h>
+
+#include <cstddef>
+
+namespace util {
+class ProactorPool;
+}  // namespace util
+
+namespace facade {
+
+// Offloads the serialization of large replies from busy proactor threads to idle ones.
+// Jobs are posted into a queue shared by all the threads and every thread takes them from an idle
+// task, so only threads that have nothing else to do pick them up. The posting fiber yields once
+// to let the other fibers of its thread run and then either waits for the thread that took its
+// job or, if nobody did, runs the job itself. The data referenced by a job stays pinned, because
+// its owner waits until the job finishes. The socket writes stay on the owning thread.
+class ReplyOffload {
+ public:
+  // Registers the idle tasks on all the threads of the pool, controlled by --reply_offload_min_len.
+  static void Init(util::ProactorPool* pp);
+
+  static void Shutdown(util::ProactorPool* pp);
+
+  // Returns true if serializing a reply of len elements should be offloaded.
+  static bool ShouldOffload(size_t len);
+
+  // Runs fn on an idle thread or in the calling fiber, returns once fn finished. fn must not
+  // preempt and must be safe to run on another thread.
+  static void Run(absl::FunctionRef<void()> fn);
+};
+
+}  // namespace facade
@@ -49,6 +49,16 @@ int convertSparseToDenseHll(struct HllBufferPtr in_hll, struct HllBufferPtr out_
 int pfadd_sparse(sds* hll_ptr, unsigned char* value, size_t size, int* promoted);
 int pfadd_dense(struct HllBufferPtr hll_ptr, unsigned char* value, size_t size);
 
+/* Same as calling pfadd_sparse() / pfadd_dense() for each of the `count` values, of at most
+ * HLL_ADD_BATCH, but hashes them together which is significantly faster. Return 1 if any
+ * register changed, 0 if none did or a negative number on error. pfadd_sparse_multi() keeps
+ * adding to the dense HLL once `*promoted` is set, and expects it to be 0 initially. */
+#define HLL_ADD_BATCH 32
+int pfadd_sparse_multi(sds* hll_ptr, unsigned char* const* values, const size_t* sizes,
+                       size_t count, int* promoted);
+int pfadd_dense_multi(struct HllBufferPtr hll_ptr, unsigned char* const* values,
+                      const size_t* sizes, size_t count);
+
 /* Returns the estimated count of elements for `hll_ptr`.
  * If `hll_ptr` is not a valid dense-encoded HLL, a negative number is returned. */
 int64_t pfcountSingle(struct HllBufferPtr hll_ptr);
@@ -63,4 +73,26 @@ int64_t pfcountMulti(struct HllBufferPtr* hlls, size_t hlls_count);
  * `out_hll` *can* be one of the elements in `in_hlls`. */
 int pfmerge(struct HllBufferPtr* in_hlls, size_t in_hlls_count, struct HllBufferPtr out_hll);
 
+/* Raw HLLs keep one byte per register. They are never stored, but are cheaper to merge many HLLs
+ * into before counting or writing the result. */
+size_t getRawHllSize();
+
+/* Writes into `raw_hll` an empty raw HLL. Returns 0 upon success, or a negative number when
+ * `raw_hll.size` is different from getRawHllSize(). */
+int createRawHll(struct HllBufferPtr raw_hll);
+
+/* Merges the dense-encoded HLL `in_hll` into `raw_hll`.
+ * Returns 0 upon success, or a negative number if `in_hll` is not a valid dense HLL. */
+int mergeDenseIntoRawHll(struct HllBufferPtr in_hll, struct HllBufferPtr raw_hll);
+
+/* Merges the raw HLL `in_hll` into the raw HLL `raw_hll`. */
+void mergeRawHlls(struct HllBufferPtr in_hll, struct HllBufferPtr raw_hll);
+
+/* Returns the estimated count of elements for `raw_hll`. */
+int64_t pfcountRaw(struct HllBufferPtr raw_hll);
+
+/* Writes the registers of `raw_hll` into the dense-encoded HLL `out_hll`.
+ * Returns 0 upon success, otherwise a negative number. */
+int rawToDenseHll(struct HllBufferPtr raw_hll, struct HllBufferPtr out_hll);
+
 #endif
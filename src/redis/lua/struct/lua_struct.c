@@ -391,6 +391,10 @@ static const struct luaL_Reg thislib[] = {
 
 LUALIB_API int luaopen_struct (lua_State *L);
 
+#if LUA_VERSION_NUM < 502
+#define luaL_newlib(L, l) (lua_newtable(L), luaL_setfuncs(L, l, 0))
+#endif
+
 LUALIB_API int luaopen_struct (lua_State *L) {
   luaL_newlib(L, thislib);
   lua_setglobal(L, "struct");
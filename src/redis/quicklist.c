@@ -129,6 +129,72 @@ static void quicklistBookmarksClear(quicklist *ql) {
         (iter)->zi = NULL;                                                     \
     } while (0)
 
+/* Long lists get a positional index of their nodes, so that access by index does not walk
+ * thousands of nodes. The index is an array of the nodes with the number of entries before
+ * each of them, searched with binary search. It is built by the second lookup by position
+ * without changes in between, so lists that are changed after every lookup do not pay for
+ * building it, and it is dropped by any change. */
+#define QL_INDEX_MIN_NODES 32
+
+typedef struct quicklistIndexEntry {
+    quicklistNode *node;
+    unsigned long long accum; /* entries before the node */
+} quicklistIndexEntry;
+
+struct quicklistIndex {
+    unsigned long len;
+    quicklistIndexEntry entries[];
+};
+
+static inline void quicklistIndexDrop(quicklist *quicklist) {
+    quicklist->index_pending = 0;
+    if (unlikely(quicklist->index != NULL)) {
+        zfree(quicklist->index);
+        quicklist->index = NULL;
+    }
+}
+
+/* Returns the node with the entry at 'head_index' counted from the head and sets 'accum' to
+ * the number of entries before the node, or returns NULL if the list is not indexed. */
+static quicklistNode *quicklistIndexSeek(quicklist *quicklist,
+                                         unsigned long long head_index,
+                                         unsigned long long *accum) {
+    if (quicklist->len < QL_INDEX_MIN_NODES)
+        return NULL;
+
+    if (!quicklist->index) {
+        if (!quicklist->index_pending) {
+            quicklist->index_pending = 1;
+            return NULL;
+        }
+
+        struct quicklistIndex *index =
+            zmalloc(sizeof(*index) + quicklist->len * sizeof(quicklistIndexEntry));
+        unsigned long long total = 0;
+        index->len = 0;
+        for (quicklistNode *n = quicklist->head; n; n = n->next) {
+            index->entries[index->len].node = n;
+            index->entries[index->len].accum = total;
+            index->len++;
+            total += n->count;
+        }
+        quicklist->index = index;
+    }
+
+    /* The last node that starts at or before head_index. */
+    const struct quicklistIndex *index = quicklist->index;
+    unsigned long lo = 0, hi = index->len;
+    while (hi - lo > 1) {
+        unsigned long mid = lo + (hi - lo) / 2;
+        if (index->entries[mid].accum <= head_index)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    *accum = index->entries[lo].accum;
+    return index->entries[lo].node;
+}
+
 /* Create a new quicklist.
  * Free with quicklistRelease(). */
 quicklist *quicklistCreate(void) {
@@ -141,6 +207,8 @@ quicklist *quicklistCreate(void) {
     quicklist->compress = 0;
     quicklist->fill = -2;
     quicklist->bookmark_count = 0;
+    quicklist->index = NULL;
+    quicklist->index_pending = 0;
     return quicklist;
 }
 
@@ -211,6 +279,7 @@ void quicklistRelease(quicklist *quicklist) {
         current = next;
     }
     quicklistBookmarksClear(quicklist);
+    quicklistIndexDrop(quicklist);
     zfree(quicklist);
 }
 
@@ -435,6 +504,7 @@ REDIS_STATIC void __quicklistInsertNode(quicklist *quicklist,
 
     /* Update len first, so in __quicklistCompress we know exactly len */
     quicklist->len++;
+    quicklistIndexDrop(quicklist);
 
     if (old_node)
         quicklistCompress(quicklist, old_node);
@@ -544,6 +614,7 @@ static void __quicklistInsertPlainNode(quicklist *quicklist, quicklistNode *old_
                                        const void *value, size_t sz, int after) {
     __quicklistInsertNode(quicklist, old_node, __quicklistCreatePlainNode(value, sz), after);
     quicklist->count++;
+    quicklistIndexDrop(quicklist);
 }
 
 /* Add new entry to head node of quicklist.
@@ -570,6 +641,7 @@ int quicklistPushHead(quicklist *quicklist, void *value, size_t sz) {
         _quicklistInsertNodeBefore(quicklist, quicklist->head, node);
     }
     quicklist->count++;
+    quicklistIndexDrop(quicklist);
     quicklist->head->count++;
     return (orig_head != quicklist->head);
 }
@@ -597,6 +669,7 @@ int quicklistPushTail(quicklist *quicklist, void *value, size_t sz) {
         _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
     }
     quicklist->count++;
+    quicklistIndexDrop(quicklist);
     quicklist->tail->count++;
     return (orig_tail != quicklist->tail);
 }
@@ -613,6 +686,7 @@ void quicklistAppendListpack(quicklist *quicklist, unsigned char *zl) {
 
     _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
     quicklist->count += node->count;
+    quicklistIndexDrop(quicklist);
 }
 
 /* Create new node consisting of a pre-formed plain node.
@@ -629,6 +703,7 @@ void quicklistAppendPlainNode(quicklist *quicklist, unsigned char *data, size_t
 
     _quicklistInsertNodeAfter(quicklist, quicklist->tail, node);
     quicklist->count += node->count;
+    quicklistIndexDrop(quicklist);
 }
 
 #define quicklistDeleteIfEmpty(ql, n)                                          \
@@ -666,6 +741,7 @@ REDIS_STATIC void __quicklistDelNode(quicklist *quicklist,
     /* Update len first, so in __quicklistCompress we know exactly len */
     quicklist->len--;
     quicklist->count -= node->count;
+    quicklistIndexDrop(quicklist);
 
     /* If we deleted a node within our compress depth, we
      * now have compressed nodes needing to be decompressed. */
@@ -700,6 +776,7 @@ REDIS_STATIC int quicklistDelIndex(quicklist *quicklist, quicklistNode *node,
         quicklistNodeUpdateSz(node);
     }
     quicklist->count--;
+    quicklistIndexDrop(quicklist);
     /* If we deleted the node, the original node is no longer valid */
     return gone ? 1 : 0;
 }
@@ -963,6 +1040,7 @@ REDIS_STATIC void _quicklistInsert(quicklistIter *iter, quicklistEntry *entry,
         __quicklistInsertNode(quicklist, NULL, new_node, after);
         new_node->count++;
         quicklist->count++;
+        quicklistIndexDrop(quicklist);
         return;
     }
 
@@ -1001,6 +1079,7 @@ REDIS_STATIC void _quicklistInsert(quicklistIter *iter, quicklistEntry *entry,
             __quicklistInsertNode(quicklist, node, entry_node, after);
             __quicklistInsertNode(quicklist, entry_node, new_node, after);
             quicklist->count++;
+            quicklistIndexDrop(quicklist);
         }
         return;
     }
@@ -1067,6 +1146,7 @@ REDIS_STATIC void _quicklistInsert(quicklistIter *iter, quicklistEntry *entry,
     }
 
     quicklist->count++;
+    quicklistIndexDrop(quicklist);
 
     /* In any case, we reset iterator to forbid use of iterator after insert.
      * Notice: iter->current has been compressed in _quicklistInsert(). */
@@ -1162,6 +1242,7 @@ int quicklistDelRange(quicklist *quicklist, const long start,
             quicklistNodeUpdateSz(node);
             node->count -= del;
             quicklist->count -= del;
+            quicklistIndexDrop(quicklist);
             quicklistDeleteIfEmpty(quicklist, node);
             if (node)
                 quicklistRecompressOnly(node);
@@ -1222,31 +1303,37 @@ quicklistIter *quicklistGetIteratorAtIdx(quicklist *quicklist,
     if (index >= quicklist->count)
         return NULL;
 
-    /* Seek in the other direction if that way is shorter. */
-    int seek_forward = forward;
-    unsigned long long seek_index = index;
-    if (index > (quicklist->count - 1) / 2) {
-        seek_forward = !forward;
-        seek_index = quicklist->count - 1 - index;
-    }
-
-    n = seek_forward ? quicklist->head : quicklist->tail;
-    while (likely(n)) {
-        if ((accum + n->count) > seek_index) {
-            break;
+    n = quicklistIndexSeek(quicklist, forward ? index : quicklist->count - 1 - index, &accum);
+    if (n) {
+        /* The index counts from the head. */
+        if (!forward) accum = quicklist->count - n->count - accum;
     } else {
-            D("Skipping over (%p) %u at accum %lld", (void *)n, n->count,
-              accum);
-            accum += n->count;
-            n = seek_forward ? n->next : n->prev;
+        /* Seek in the other direction if that way is shorter. */
+        int seek_forward = forward;
+        unsigned long long seek_index = index;
+        if (index > (quicklist->count - 1) / 2) {
+            seek_forward = !forward;
+            seek_index = quicklist->count - 1 - index;
         }
-    }
 
-    if (!n)
-        return NULL;
+        n = seek_forward ? quicklist->head : quicklist->tail;
+        while (likely(n)) {
+            if ((accum + n->count) > seek_index) {
+                break;
+            } else {
+                D("Skipping over (%p) %u at accum %lld", (void *)n, n->count,
+                  accum);
+                accum += n->count;
+                n = seek_forward ? n->next : n->prev;
+            }
+        }
+
+        if (!n)
+            return NULL;
 
-    /* Fix accum so it looks like we seeked in the other direction. */
-    if (seek_forward != forward) accum = quicklist->count - n->count - accum;
+        /* Fix accum so it looks like we seeked in the other direction. */
+        if (seek_forward != forward) accum = quicklist->count - n->count - accum;
+    }
 
     D("Found node: %p at accum %llu, idx %llu, sub+ %llu, sub- %llu", (void *)n,
       accum, index, index - accum, (-index) - 1 + accum);
@@ -1433,6 +1520,7 @@ quicklistIter *quicklistGetIteratorEntryAtIdx(quicklist *quicklist, const long l
 }
 
 static void quicklistRotatePlain(quicklist *quicklist) {
+    quicklistIndexDrop(quicklist);
     quicklistNode *new_head = quicklist->tail;
     quicklistNode *new_tail = quicklist->tail->prev;
     quicklist->head->prev = new_head;
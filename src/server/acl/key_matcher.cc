@@ -0,0 +1,77 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/acl/key_matcher.h"
+
+#include <algorithm>
+
+// we need this because of stringmatchlen
+extern "C" {
+#include "redis/util.h"
+}
+
+namespace dfly::acl {
+
+namespace {
+
+constexpr uint8_t kReadBit = 1;
+constexpr uint8_t kWriteBit = 2;
+
+uint8_t ToMask(KeyOp op) {
+  switch (op) {
+    case KeyOp::READ:
+      return kReadBit;
+    case KeyOp::WRITE:
+      return kWriteBit;
+    case KeyOp::READ_WRITE:
+      return kReadBit | kWriteBit;
+  }
+  return 0;
+}
+
+bool IsLiteral(std::string_view str) {
+  return str.find_first_of("*?[\\") == std::string_view::npos;
+}
+
+}  // namespace
+
+KeyMatcher::KeyMatcher(const std::vector<GlobType>& globs) {
+  for (const auto& [pattern, op] : globs) {
+    std::string_view sv = pattern;
+    if (IsLiteral(sv)) {
+      literals_[std::string(sv)] |= ToMask(op);
+    } else if (sv.back() == '*' && IsLiteral(sv.substr(0, sv.size() - 1))) {
+      prefixes_[std::string(sv.substr(0, sv.size() - 1))] |= ToMask(op);
+      prefix_lens_.push_back(sv.size() - 1);
+    } else {
+      globs_.emplace_back(pattern, ToMask(op));
+    }
+  }
+
+  std::sort(prefix_lens_.begin(), prefix_lens_.end());
+  prefix_lens_.erase(std::unique(prefix_lens_.begin(), prefix_lens_.end()), prefix_lens_.end());
+}
+
+bool KeyMatcher::Matches(std::string_view key, KeyOp op) const {
+  const OpMask mask = ToMask(op);
+
+  if (auto it = literals_.find(key); it != literals_.end() && (it->second & mask))
+    return true;
+
+  for (size_t len : prefix_lens_) {
+    if (len > key.size())
+      break;
+    if (auto it = prefixes_.find(key.substr(0, len)); it != prefixes_.end() && (it->second & mask))
+      return true;
+  }
+
+  for (const auto& [pattern, op_mask] : globs_) {
+    if ((op_mask & mask) &&
+        stringmatchlen(pattern.data(), pattern.size(), key.data(), key.size(), 0))
+      return true;
+  }
+  return false;
+}
+
+}  // namespace dfly::acl
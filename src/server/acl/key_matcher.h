@@ -0,0 +1,39 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "facade/acl_commands_def.h"
+
+namespace dfly::acl {
+
+// The key globs of a user, compiled once when they change.
+//
+// Literal patterns and literal prefixes followed by a single '*', which is what most
+// deployments use, are matched with hash lookups: one for the key itself and one per distinct
+// prefix length. Only the remaining patterns are matched one by one with stringmatchlen.
+class KeyMatcher {
+ public:
+  explicit KeyMatcher(const std::vector<GlobType>& globs);
+
+  // Whether a glob that allows op matches the key. For READ_WRITE any of the two is enough.
+  bool Matches(std::string_view key, KeyOp op) const;
+
+ private:
+  // Bit mask of KeyOp::READ and KeyOp::WRITE.
+  using OpMask = uint8_t;
+
+  absl::flat_hash_map<std::string, OpMask> literals_;
+  absl::flat_hash_map<std::string, OpMask> prefixes_;
+  std::vector<size_t> prefix_lens_;  // sorted, distinct lengths of prefixes_.
+  std::vector<std::pair<std::string, OpMask>> globs_;
+};
+
+}  // namespace dfly::acl
@@ -0,0 +1,44 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/acl/key_matcher.h"
+
+#include "base/gtest.h"
+
+namespace dfly::acl {
+
+TEST(KeyMatcherTest, Patterns) {
+  KeyMatcher matcher({{"foo", KeyOp::READ_WRITE},
+                      {"user:*", KeyOp::READ_WRITE},
+                      {"u*", KeyOp::READ},
+                      {"cache:*:data", KeyOp::READ_WRITE},
+                      {"q?", KeyOp::WRITE}});
+
+  EXPECT_TRUE(matcher.Matches("foo", KeyOp::READ));
+  EXPECT_FALSE(matcher.Matches("foobar", KeyOp::READ));
+  EXPECT_FALSE(matcher.Matches("fo", KeyOp::READ));
+
+  EXPECT_TRUE(matcher.Matches("user:", KeyOp::WRITE));
+  EXPECT_TRUE(matcher.Matches("user:1", KeyOp::WRITE));
+  EXPECT_TRUE(matcher.Matches("u", KeyOp::READ));
+  EXPECT_TRUE(matcher.Matches("usr", KeyOp::READ));
+  EXPECT_FALSE(matcher.Matches("usr", KeyOp::WRITE));
+
+  EXPECT_TRUE(matcher.Matches("cache:a:data", KeyOp::READ));
+  EXPECT_FALSE(matcher.Matches("cache:a:meta", KeyOp::READ));
+  EXPECT_TRUE(matcher.Matches("qa", KeyOp::WRITE));
+  EXPECT_FALSE(matcher.Matches("qa", KeyOp::READ));
+  EXPECT_FALSE(matcher.Matches("bar", KeyOp::READ_WRITE));
+}
+
+TEST(KeyMatcherTest, Escapes) {
+  // Patterns with escapes are not literals.
+  KeyMatcher matcher({{"a\\*", KeyOp::READ_WRITE}, {"*", KeyOp::READ}});
+  EXPECT_TRUE(matcher.Matches("a*", KeyOp::WRITE));
+  EXPECT_FALSE(matcher.Matches("ab", KeyOp::WRITE));
+  EXPECT_TRUE(matcher.Matches("", KeyOp::READ));
+  EXPECT_TRUE(matcher.Matches("anything", KeyOp::READ));
+}
+
+}  // namespace dfly::acl
@@ -7,6 +7,7 @@
 #include "base/logging.h"
 #include "facade/dragonfly_connection.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/acl/key_matcher.h"
 #include "server/command_registry.h"
 #include "server/server_state.h"
 #include "server/transaction.h"
@@ -61,6 +62,11 @@ namespace dfly::acl {
   const bool is_write_command = id.IsWriteOnly();
 
   auto iterate_globs = [&](auto target) {
+    if (keys.matcher) {
+      KeyOp op = is_read_command ? (is_write_command ? KeyOp::READ_WRITE : KeyOp::READ)
+                                 : KeyOp::WRITE;
+      return keys.matcher->Matches(target, op);
+    }
     for (auto& [elem, op] : keys.key_globs) {
       if (match(elem, target)) {
         if (is_read_command && (op == KeyOp::READ || op == KeyOp::READ_WRITE)) {
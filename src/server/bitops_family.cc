@@ -5,6 +5,7 @@
 #include "server/bitops_family.h"
 
 #include <bitset>
+#include <cstring>
 
 #include "absl/strings/match.h"
 #include "base/expected.hpp"
@@ -20,6 +21,7 @@
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
 #include "src/core/overloaded.h"
+#include "src/core/sparse_bitmap.h"
 #include "util/varz.h"
 
 namespace dfly {
@@ -37,6 +39,23 @@ const char* NOT_OP_NAME = "NOT";
 
 using BitsStrVec = std::vector<std::string>;
 
+// SETBIT creates a sparse bitmap instead of a dense string when the string would be at least
+// this long. The bitmap is converted to a dense string once it takes more than
+// 1/kSparseBitmapRatio of the dense size.
+constexpr size_t kMinSparseBitmapLen = 4096;
+constexpr size_t kSparseBitmapRatio = 2;
+
+// The value of a string key, read without copying when possible. Sparse bitmaps are kept in
+// their compressed form.
+struct BitmapValue {
+  std::string_view str;
+  const SparseBitmap* sparse = nullptr;
+
+  size_t Size() const {
+    return sparse ? sparse->Size() : str.size();
+  }
+};
+
 // The following is the list of the functions that would handle the
 // commands that handle the bit operations
 void BitPos(CmdArgList args, ConnectionContext* cntx);
@@ -47,18 +66,20 @@ void BitOp(CmdArgList args, ConnectionContext* cntx);
 void GetBit(CmdArgList args, ConnectionContext* cntx);
 void SetBit(CmdArgList args, ConnectionContext* cntx);
 
-OpResult<std::string> ReadValue(const DbContext& context, std::string_view key, EngineShard* shard);
+OpResult<BitmapValue> ReadValue(const DbContext& context, std::string_view key,
+                                EngineShard* shard, std::string* scratch);
 OpResult<bool> ReadValueBitsetAt(const OpArgs& op_args, std::string_view key, uint32_t offset);
 OpResult<std::size_t> CountBitsForValue(const OpArgs& op_args, std::string_view key, int64_t start,
                                         int64_t end, bool bit_value);
 OpResult<int64_t> FindFirstBitWithValue(const OpArgs& op_args, std::string_view key, bool value,
                                         int64_t start, int64_t end, bool as_bit);
 std::string GetString(const PrimeValue& pv);
+bool GetBitValue(std::string_view entry, uint32_t offset);
 bool SetBitValue(uint32_t offset, bool bit_value, std::string* entry);
 std::size_t CountBitSetByByteIndices(std::string_view at, std::size_t start, std::size_t end);
-std::size_t CountBitSet(std::string_view str, int64_t start, int64_t end, bool bits);
+std::size_t CountBitSet(const BitmapValue& value, int64_t start, int64_t end, bool bits);
 std::size_t CountBitSetByBitIndices(std::string_view at, std::size_t start, std::size_t end);
-std::string RunBitOperationOnValues(std::string_view op, const BitsStrVec& values);
+std::string RunBitOperationOnValues(std::string_view op, BitsStrVec values);
 
 // ------------------------------------------------------------------------- //
 
@@ -79,62 +100,94 @@ bool ToUpperAndGetAsBit(CmdArgList args, size_t i, bool* as_bit) {
   }
 }
 
-// This function can be used for any case where we allowing out of bound
-// access where the default in this case would be 0 -such as bitop
-uint8_t GetByteAt(std::string_view s, std::size_t at) {
-  return at >= s.size() ? 0 : s[at];
-}
+// Helper functors to support operations so we would not need to check which operation to run
+// in the loop (unlike
+// https://github.com/redis/redis/blob/c2b0c13d5c0fab49131f6f5e844f80bfa43f6219/src/bitops.c#L607)
+struct AndOp {
+  template <typename T> T operator()(T left, T right) const {
+    return left & right;
+  }
+};
 
-// For XOR, OR, AND operations on a collection of bytes
-template <typename BitOp, typename SkipOp>
-std::string BitOpString(BitOp operation_f, SkipOp skip_f, const BitsStrVec& values,
-                        std::string new_value) {
-  // at this point, values are not empty
-  std::size_t max_size = new_value.size();
-
-  if (values.size() > 1) {
-    for (std::size_t i = 0; i < max_size; i++) {
-      std::uint8_t new_entry = operation_f(GetByteAt(values[0], i), GetByteAt(values[1], i));
-      for (std::size_t j = 2; j < values.size(); ++j) {
-        new_entry = operation_f(new_entry, GetByteAt(values[j], i));
-        if (skip_f(new_entry)) {
-          break;
-        }
-      }
-      new_value[i] = new_entry;
-    }
-    return new_value;
-  } else {
-    return values[0];
+struct OrOp {
+  template <typename T> T operator()(T left, T right) const {
+    return left | right;
   }
-}
+};
 
-// Helper functions to support operations
-// so we would not need to check which
-// operations to run in the look (unlike
-// https://github.com/redis/redis/blob/c2b0c13d5c0fab49131f6f5e844f80bfa43f6219/src/bitops.c#L607)
-constexpr bool SkipAnd(uint8_t byte) {
-  return byte == 0x0;
-}
+struct XorOp {
+  template <typename T> T operator()(T left, T right) const {
+    return left ^ right;
+  }
+};
 
-constexpr bool SkipOr(uint8_t byte) {
-  return byte == 0xff;
-}
+// Runs dest = dest op src. The shorter of the two is treated as if it was padded with zeros
+// and the result has the length of the longer one. The main loop works on whole words, which
+// the compiler vectorizes.
+template <typename BitOp> void BitOpInPlace(BitOp operation_f, std::string_view src,
+                                            std::string* dest) {
+  const size_t common = std::min(src.size(), dest->size());
+  if (src.size() > dest->size())
+    dest->resize(src.size(), 0);
 
-constexpr bool SkipXor(uint8_t) {
-  return false;
-}
+  uint8_t* dp = reinterpret_cast<uint8_t*>(dest->data());
+  const uint8_t* sp = reinterpret_cast<const uint8_t*>(src.data());
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= common; i += sizeof(uint64_t)) {
+    uint64_t left, right;
+    memcpy(&left, dp + i, sizeof(left));
+    memcpy(&right, sp + i, sizeof(right));
+    left = operation_f(left, right);
+    memcpy(dp + i, &left, sizeof(left));
+  }
+  for (; i < common; ++i) {
+    dp[i] = operation_f(dp[i], sp[i]);
+  }
 
-constexpr uint8_t AndOp(uint8_t left, uint8_t right) {
-  return left & right;
+  // The bytes only one of the operands has.
+  for (; i < src.size(); ++i) {
+    dp[i] = operation_f(uint8_t{0}, sp[i]);
+  }
+  for (; i < dest->size(); ++i) {
+    dp[i] = operation_f(dp[i], uint8_t{0});
+  }
 }
 
-constexpr uint8_t OrOp(uint8_t left, uint8_t right) {
-  return left | right;
+void RunBitOperation(std::string_view op, std::string_view src, std::string* dest) {
+  if (op == OR_OP_NAME) {
+    BitOpInPlace(OrOp{}, src, dest);
+  } else if (op == XOR_OP_NAME) {
+    BitOpInPlace(XorOp{}, src, dest);
+  } else if (op == AND_OP_NAME) {
+    BitOpInPlace(AndOp{}, src, dest);
+  } else {
+    LOG(FATAL) << "Operation not supported '" << op << "'";
+  }
 }
 
-constexpr uint8_t XorOp(uint8_t left, uint8_t right) {
-  return left ^ right;
+// Same as above for a sparse bitmap operand, only its set bits are visited.
+void RunBitOperation(std::string_view op, const SparseBitmap& src, std::string* dest) {
+  const size_t dest_bits = dest->size() * OFFSET_FACTOR;
+  if (src.Size() > dest->size())
+    dest->resize(src.Size(), 0);
+
+  if (op == AND_OP_NAME) {
+    std::string res(dest->size(), 0);
+    src.ForEachSet([&](uint64_t offset) {
+      if (offset < dest_bits && GetBitValue(*dest, offset))
+        SetBitValue(offset, true, &res);
+    });
+    dest->swap(res);
+    return;
+  }
+
+  if (op != OR_OP_NAME && op != XOR_OP_NAME) {
+    LOG(FATAL) << "Operation not supported '" << op << "'";
+  }
+  bool is_or = op == OR_OP_NAME;
+  src.ForEachSet([&](uint64_t offset) {
+    SetBitValue(offset, is_or || !GetBitValue(*dest, offset), dest);
+  });
 }
 
 std::string BitOpNotString(std::string from) {
@@ -178,9 +231,22 @@ std::size_t CountBitSetByByteIndices(std::string_view at, std::size_t start, std
     return 0;
   }
   end = std::min(end, at.size());  // don't overflow
-  std::uint32_t count =
-      std::accumulate(std::next(at.begin(), start), std::next(at.begin(), end), 0,
-                      [](auto counter, uint8_t ch) { return counter + absl::popcount(ch); });
+  if (start >= end) {
+    return 0;
+  }
+
+  // Count whole words, absl::popcount compiles to a single instruction for them.
+  const char* ptr = at.data() + start;
+  std::size_t len = end - start;
+  std::size_t count = 0;
+  for (; len >= sizeof(uint64_t); ptr += sizeof(uint64_t), len -= sizeof(uint64_t)) {
+    uint64_t word;
+    memcpy(&word, ptr, sizeof(word));
+    count += absl::popcount(word);
+  }
+  for (; len > 0; ++ptr, --len) {
+    count += absl::popcount(static_cast<uint8_t>(*ptr));
+  }
   return count;
 }
 
@@ -219,8 +285,8 @@ int64_t NormalizedOffset(int64_t size, int64_t offset) {
 // The parameters for start, end and bits are defaulted to the start of the string,
 // end of the string and bits are false.
 // Note that when bits is false, it means that we are looking on byte boundaries.
-std::size_t CountBitSet(std::string_view str, int64_t start, int64_t end, bool bits) {
-  const int64_t size = bits ? str.size() * OFFSET_FACTOR : str.size();
+std::size_t CountBitSet(const BitmapValue& value, int64_t start, int64_t end, bool bits) {
+  const int64_t size = bits ? value.Size() * OFFSET_FACTOR : value.Size();
 
   if (start > 0 && end > 0 && end < start) {
     return 0;  // for illegal range with positive we just return 0
@@ -242,18 +308,22 @@ std::size_t CountBitSet(std::string_view str, int64_t start, int64_t end, bool b
     end = size;  // don't overflow
   }
   ++end;
-  return bits ? CountBitSetByBitIndices(str, start, end)
-              : CountBitSetByByteIndices(str, start, end);
+  if (value.sparse) {
+    return bits ? value.sparse->CountRange(start, end)
+                : value.sparse->CountRange(start * OFFSET_FACTOR, end * OFFSET_FACTOR);
+  }
+  return bits ? CountBitSetByBitIndices(value.str, start, end)
+              : CountBitSetByByteIndices(value.str, start, end);
 }
 
 // return true if bit is on
-bool GetBitValue(const std::string& entry, uint32_t offset) {
+bool GetBitValue(std::string_view entry, uint32_t offset) {
   const auto byte_val{GetByteValue(entry, offset)};
   const auto index{GetNormalizedBitIndex(offset)};
   return CheckBitStatus(byte_val, index);
 }
 
-bool GetBitValueSafe(const std::string& entry, uint32_t offset) {
+bool GetBitValueSafe(std::string_view entry, uint32_t offset) {
   return ((entry.size() * OFFSET_FACTOR) > offset) ? GetBitValue(entry, offset) : false;
 }
 
@@ -304,6 +374,16 @@ class ElementAccess {
 
   void Commit(std::string_view new_value) const;
 
+  // Returns the sparse bitmap that the entry holds, or nullptr if it is a regular string.
+  SparseBitmap* GetSparseBitmap() const;
+
+  // Initializes a new entry with an empty sparse bitmap.
+  SparseBitmap* CreateSparseBitmap() const;
+
+  // Commits the changes done through GetSparseBitmap(). Converts the bitmap into a dense
+  // string once it is no longer more compact.
+  void CommitSparseBitmap() const;
+
   // return nullopt when key exists but it's not encoded as string
   // return true if key exists and false if it doesn't
   std::optional<bool> Exists(EngineShard* shard);
@@ -348,6 +428,28 @@ void ElementAccess::Commit(std::string_view new_value) const {
   }
 }
 
+SparseBitmap* ElementAccess::GetSparseBitmap() const {
+  CHECK_NOTNULL(shard_);
+  const PrimeValue& pv = element_iter_->second;
+  return pv.IsSparseBitmap() ? pv.GetSparseBitmap() : nullptr;
+}
+
+SparseBitmap* ElementAccess::CreateSparseBitmap() const {
+  CHECK(added_);
+  element_iter_->second.SetSparseBitmap(CompactObj::AllocateMR<SparseBitmap>());
+  return element_iter_->second.GetSparseBitmap();
+}
+
+void ElementAccess::CommitSparseBitmap() const {
+  CHECK_NOTNULL(shard_);
+  PrimeValue& pv = element_iter_->second;
+  const SparseBitmap* bitmap = pv.GetSparseBitmap();
+  if (bitmap->MallocUsed() * kSparseBitmapRatio > bitmap->Size()) {
+    pv.SetString(GetString(pv));
+  }
+  post_updater_.Run();
+}
+
 // =============================================
 // Set a new value to a given bit
 
@@ -365,7 +467,19 @@ OpResult<bool> BitNewValue(const OpArgs& args, std::string_view key, uint32_t of
     return find_res;
   }
 
-  if (element_access.IsNewEntry()) {
+  // Setting a bit far into a new string creates a sparse bitmap instead of allocating
+  // the whole string.
+  SparseBitmap* bitmap = nullptr;
+  if (!element_access.IsNewEntry()) {
+    bitmap = element_access.GetSparseBitmap();
+  } else if (GetByteIndex(offset) + 1 >= kMinSparseBitmapLen) {
+    bitmap = element_access.CreateSparseBitmap();
+  }
+
+  if (bitmap) {
+    old_value = bitmap->Set(offset, bit_value);
+    element_access.CommitSparseBitmap();
+  } else if (element_access.IsNewEntry()) {
     std::string new_entry(GetByteIndex(offset) + 1, 0);
     old_value = SetBitValue(offset, bit_value, &new_entry);
     element_access.Commit(new_entry);
@@ -386,42 +500,24 @@ OpResult<bool> BitNewValue(const OpArgs& args, std::string_view key, uint32_t of
 
 // ---------------------------------------------------------
 
-std::string RunBitOperationOnValues(std::string_view op, const BitsStrVec& values) {
+std::string RunBitOperationOnValues(std::string_view op, BitsStrVec values) {
   // This function accept an operation (either OR, XOR, NOT or OR), and run bit operation
   // on all the values we got from the database. Note that in case that one of the values
   // is shorter than the other it would return a 0 and the operation would continue
   // until we ran the longest value. The function will return the resulting new value
-  std::size_t max_len = 0;
-  std::size_t max_len_index = 0;
-
-  const auto BitOperation = [&]() {
-    if (op == OR_OP_NAME) {
-      std::string default_str{values[max_len_index]};
-      return BitOpString(OrOp, SkipOr, std::move(values), std::move(default_str));
-    } else if (op == XOR_OP_NAME) {
-      return BitOpString(XorOp, SkipXor, std::move(values), std::string(max_len, 0));
-    } else if (op == AND_OP_NAME) {
-      return BitOpString(AndOp, SkipAnd, std::move(values), std::string(max_len, 0));
-    } else if (op == NOT_OP_NAME) {
-      return BitOpNotString(values[0]);
-    } else {
-      LOG(FATAL) << "Operation not supported '" << op << "'";
-      return std::string{};  // otherwise we will have warning of not returning value
-    }
-  };
-
   if (values.empty()) {  // this is ok in case we don't have the src keys
     return std::string{};
   }
-  // The new result is the max length input
-  max_len = values[0].size();
+
+  if (op == NOT_OP_NAME) {
+    return BitOpNotString(std::move(values[0]));
+  }
+
+  std::string result = std::move(values[0]);
   for (std::size_t i = 1; i < values.size(); ++i) {
-    if (values[i].size() > max_len) {
-      max_len = values[i].size();
-      max_len_index = i;
-    }
+    RunBitOperation(op, values[i], &result);
   }
-  return BitOperation();
+  return result;
 }
 
 OpResult<std::string> CombineResultOp(ShardStringResults result, std::string_view op) {
@@ -429,8 +525,7 @@ OpResult<std::string> CombineResultOp(ShardStringResults result, std::string_vie
   BitsStrVec values;
   for (auto&& res : result) {
     if (res) {
-      auto v = res.value();
-      values.emplace_back(std::move(v));
+      values.emplace_back(std::move(res.value()));
     } else {
       if (res.status() != OpStatus::KEY_NOTFOUND) {
         // something went wrong, just bale out
@@ -440,7 +535,7 @@ OpResult<std::string> CombineResultOp(ShardStringResults result, std::string_vie
   }
 
   // and combine them to single result
-  return RunBitOperationOnValues(op, values);
+  return RunBitOperationOnValues(op, std::move(values));
 }
 
 // For bitop not - we cannot accumulate
@@ -464,13 +559,21 @@ OpResult<std::string> RunBitOpOnShard(std::string_view op, const OpArgs& op_args
     return RunBitOpNot(op_args, *start);
   }
   EngineShard* es = op_args.shard;
-  BitsStrVec values;
+  std::optional<std::string> result;
+  std::string tmp;
 
-  // collect all the value for this shard
+  // Fold the values of this shard into the result as we go, so only the first one is copied.
   for (; start != end; ++start) {
     auto find_res = es->db_slice().FindReadOnly(op_args.db_cntx, *start, OBJ_STRING);
     if (find_res) {
-      values.emplace_back(GetString(find_res.value()->second));
+      const PrimeValue& pv = find_res.value()->second;
+      if (result && pv.IsSparseBitmap()) {
+        RunBitOperation(op, *pv.GetSparseBitmap(), &*result);
+      } else if (result) {
+        RunBitOperation(op, pv.GetSlice(&tmp), &*result);
+      } else {
+        result = GetString(pv);
+      }
     } else {
       if (find_res.status() == OpStatus::KEY_NOTFOUND) {
         continue;  // this is allowed, just return empty string per Redis
@@ -479,9 +582,7 @@ OpResult<std::string> RunBitOpOnShard(std::string_view op, const OpArgs& op_args
       }
     }
   }
-  // Run the operation on all the values that we found
-  std::string op_result = RunBitOperationOnValues(op, values);
-  return op_result;
+  return result ? std::move(*result) : std::string{};
 }
 
 template <typename T> void HandleOpValueResult(const OpResult<T>& result, ConnectionContext* cntx) {
@@ -1234,36 +1335,45 @@ std::string GetString(const PrimeValue& pv) {
 }
 
 OpResult<bool> ReadValueBitsetAt(const OpArgs& op_args, std::string_view key, uint32_t offset) {
-  OpResult<std::string> result = ReadValue(op_args.db_cntx, key, op_args.shard);
+  std::string scratch;
+  OpResult<BitmapValue> result = ReadValue(op_args.db_cntx, key, op_args.shard, &scratch);
   if (result) {
-    return GetBitValueSafe(result.value(), offset);
+    if (result->sparse) {
+      return result->sparse->Get(offset);
+    }
+    return GetBitValueSafe(result->str, offset);
   } else {
     return result.status();
   }
 }
 
-OpResult<std::string> ReadValue(const DbContext& context, std::string_view key,
-                                EngineShard* shard) {
+// Scratch holds the value if it has to be decoded.
+OpResult<BitmapValue> ReadValue(const DbContext& context, std::string_view key,
+                                EngineShard* shard, std::string* scratch) {
   auto it_res = shard->db_slice().FindReadOnly(context, key, OBJ_STRING);
   if (!it_res.ok()) {
     return it_res.status();
   }
 
   const PrimeValue& pv = it_res.value()->second;
+  if (pv.IsSparseBitmap()) {
+    return BitmapValue{{}, pv.GetSparseBitmap()};
+  }
 
-  return GetString(pv);
+  return BitmapValue{pv.GetSlice(scratch)};
 }
 
 OpResult<std::size_t> CountBitsForValue(const OpArgs& op_args, std::string_view key, int64_t start,
                                         int64_t end, bool bit_value) {
-  OpResult<std::string> result = ReadValue(op_args.db_cntx, key, op_args.shard);
+  std::string scratch;
+  OpResult<BitmapValue> result = ReadValue(op_args.db_cntx, key, op_args.shard, &scratch);
 
   if (result) {  // if this is not found, just return 0 - per Redis
-    if (result.value().empty()) {
+    if (result->Size() == 0) {
       return 0;
     }
     if (end == std::numeric_limits<int64_t>::max()) {
-      end = result.value().size();
+      end = result->Size();
     }
     return CountBitSet(result.value(), start, end, bit_value);
   } else {
@@ -1301,12 +1411,26 @@ int64_t FindFirstBitWithValueAsBit(std::string_view value_str, bool bit_value, i
 
 int64_t FindFirstBitWithValueAsByte(std::string_view value_str, bool bit_value, int64_t start,
                                     int64_t end) {
+  const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
+  const uint64_t kNotFoundWord = bit_value ? 0 : std::numeric_limits<uint64_t>::max();
   for (int64_t i = start; i <= end; ++i) {
     if (static_cast<size_t>(i) >= value_str.size()) {
       break;
     }
+
+    // Skip whole words that can not contain the bit.
+    uint64_t word;
+    while (i + 8 <= end + 1 && static_cast<size_t>(i) + 8 <= value_str.size()) {
+      memcpy(&word, value_str.data() + i, sizeof(word));
+      if (word != kNotFoundWord)
+        break;
+      i += 8;
+    }
+    if (i > end || static_cast<size_t>(i) >= value_str.size()) {
+      break;
+    }
+
     const uint8_t current_byte = value_str[i];
-    const uint8_t kNotFoundByte = bit_value ? 0 : std::numeric_limits<uint8_t>::max();
     if (current_byte == kNotFoundByte) {
       continue;
     }
@@ -1319,14 +1443,15 @@ int64_t FindFirstBitWithValueAsByte(std::string_view value_str, bool bit_value,
 
 OpResult<int64_t> FindFirstBitWithValue(const OpArgs& op_args, std::string_view key, bool bit_value,
                                         int64_t start, int64_t end, bool as_bit) {
-  OpResult<std::string> value = ReadValue(op_args.db_cntx, key, op_args.shard);
+  std::string scratch;
+  OpResult<BitmapValue> value = ReadValue(op_args.db_cntx, key, op_args.shard, &scratch);
 
-  std::string_view value_str;
+  BitmapValue bitmap;
   if (value) {  // non-existent keys are treated as empty strings, per Redis
-    value_str = value.value();
+    bitmap = value.value();
   }
 
-  int64_t size = value_str.size();
+  int64_t size = bitmap.Size();
   if (as_bit) {
     size *= OFFSET_FACTOR;
   }
@@ -1338,16 +1463,20 @@ OpResult<int64_t> FindFirstBitWithValue(const OpArgs& op_args, std::string_view
   }
 
   int64_t position;
-  if (as_bit) {
-    position = FindFirstBitWithValueAsBit(value_str, bit_value, normalized_start, normalized_end);
+  if (bitmap.sparse) {
+    int64_t factor = as_bit ? 1 : OFFSET_FACTOR;
+    position = bitmap.sparse->FindFirst(bit_value, normalized_start * factor,
+                                        (normalized_end + 1) * factor);
+  } else if (as_bit) {
+    position = FindFirstBitWithValueAsBit(bitmap.str, bit_value, normalized_start, normalized_end);
   } else {
-    position = FindFirstBitWithValueAsByte(value_str, bit_value, normalized_start, normalized_end);
+    position = FindFirstBitWithValueAsByte(bitmap.str, bit_value, normalized_start, normalized_end);
   }
 
-  if (position == -1 && !bit_value && static_cast<size_t>(start) < value_str.size() &&
+  if (position == -1 && !bit_value && static_cast<size_t>(start) < bitmap.Size() &&
       end == std::numeric_limits<int64_t>::max()) {
     // Returning bit-size of the value, compatible with Redis (but is a weird API).
-    return value_str.size() * OFFSET_FACTOR;
+    return bitmap.Size() * OFFSET_FACTOR;
   } else {
     return position;
   }
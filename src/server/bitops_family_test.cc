@@ -11,6 +11,7 @@
 #include <string>
 #include <string_view>
 
+#include "absl/numeric/bits.h"
 #include "absl/strings/str_cat.h"
 #include "base/gtest.h"
 #include "base/logging.h"
@@ -532,6 +533,101 @@ TEST_F(BitOpsFamilyTest, BitPos) {
   EXPECT_EQ(-1, CheckedInt({"bitpos", "d", "0"}));
 }
 
+// Values that span many words and have unaligned tails, so both the word loops and the byte
+// loops of the kernels run.
+TEST_F(BitOpsFamilyTest, BitOpsLargeValues) {
+  const size_t kLens[] = {1000, 1003, 37, 1021};
+  vector<string> keys, values;
+  for (size_t i = 0; i < 4; ++i) {
+    string value(kLens[i], '\0');
+    for (size_t j = 0; j < value.size(); ++j)
+      value[j] = char((j * 31 + i * 17) ^ (j >> 3));
+    keys.push_back(StrCat("large", i));
+    values.push_back(value);
+    Run({"set", keys.back(), value});
+  }
+
+  string expected_and(1021, '\0'), expected_or(1021, '\0'), expected_xor(1021, '\0');
+  for (size_t j = 0; j < expected_and.size(); ++j) {
+    uint8_t a = 0xff, o = 0, x = 0;
+    for (const auto& value : values) {
+      uint8_t b = j < value.size() ? uint8_t(value[j]) : 0;
+      a &= b;
+      o |= b;
+      x ^= b;
+    }
+    expected_and[j] = char(a);
+    expected_or[j] = char(o);
+    expected_xor[j] = char(x);
+  }
+
+  EXPECT_EQ(1021, CheckedInt({"bitop", "and", "dest", keys[0], keys[1], keys[2], keys[3]}));
+  EXPECT_EQ(Run({"get", "dest"}), expected_and);
+  EXPECT_EQ(1021, CheckedInt({"bitop", "or", "dest", keys[0], keys[1], keys[2], keys[3]}));
+  EXPECT_EQ(Run({"get", "dest"}), expected_or);
+  EXPECT_EQ(1021, CheckedInt({"bitop", "xor", "dest", keys[0], keys[1], keys[2], keys[3]}));
+  EXPECT_EQ(Run({"get", "dest"}), expected_xor);
+
+  size_t bits = 0;
+  for (char c : values[1].substr(3, 995))
+    bits += absl::popcount(uint8_t(c));
+  EXPECT_EQ(bits, CheckedInt({"bitcount", keys[1], "3", "997"}));
+
+  string sparse(1003, '\0');
+  sparse[1001] = 0x10;
+  Run({"set", "sparse", sparse});
+  EXPECT_EQ(1001 * 8 + 3, CheckedInt({"bitpos", "sparse", "1"}));
+  EXPECT_EQ(-1, CheckedInt({"bitpos", "sparse", "1", "0", "1000"}));
+  EXPECT_EQ(40, CheckedInt({"bitpos", "sparse", "0", "5"}));
+}
+
+TEST_F(BitOpsFamilyTest, SparseBitmap) {
+  // Setting a high offset on a new key keeps the bitmap compressed.
+  EXPECT_EQ(0, CheckedInt({"setbit", "sparse", "8000000", "1"}));
+  EXPECT_EQ(1, CheckedInt({"setbit", "sparse", "8000000", "1"}));
+  EXPECT_EQ(0, CheckedInt({"setbit", "sparse", "16", "1"}));
+  EXPECT_LT(CheckedInt({"memory", "usage", "sparse"}), 1000);
+
+  EXPECT_EQ(1000001, CheckedInt({"strlen", "sparse"}));
+  EXPECT_EQ(1, CheckedInt({"getbit", "sparse", "16"}));
+  EXPECT_EQ(0, CheckedInt({"getbit", "sparse", "17"}));
+  EXPECT_EQ(2, CheckedInt({"bitcount", "sparse"}));
+  EXPECT_EQ(1, CheckedInt({"bitcount", "sparse", "3", "-1"}));
+  EXPECT_EQ(1, CheckedInt({"bitcount", "sparse", "17", "8000000", "BIT"}));
+  EXPECT_EQ(16, CheckedInt({"bitpos", "sparse", "1"}));
+  EXPECT_EQ(8000000, CheckedInt({"bitpos", "sparse", "1", "3"}));
+  EXPECT_EQ(17, CheckedInt({"bitpos", "sparse", "0", "16", "-1", "BIT"}));
+
+  string expected(1000001, '\0');
+  expected[2] = '\x80';
+  expected[1000000] = '\x80';
+  EXPECT_EQ(Run({"get", "sparse"}), expected);
+  EXPECT_EQ(Run({"getrange", "sparse", "0", "3"}), expected.substr(0, 4));
+
+  // BITOP reads the compressed operand directly.
+  Run({"set", "dense", "\x0f\xff\xff"});
+  EXPECT_EQ(1000001, CheckedInt({"bitop", "or", "dest", "dense", "sparse"}));
+  string expected_or = expected;
+  expected_or.replace(0, 3, "\x0f\xff\xff");
+  EXPECT_EQ(Run({"get", "dest"}), expected_or);
+  EXPECT_EQ(1000001, CheckedInt({"bitop", "and", "dest", "dense", "sparse"}));
+  EXPECT_EQ(Run({"get", "dest"}), string(2, '\0') + '\x80' + string(999998, '\0'));
+  EXPECT_EQ(1000001, CheckedInt({"bitop", "xor", "dest", "dense", "sparse"}));
+  string expected_xor = expected_or;
+  expected_xor[2] = '\x7f';
+  EXPECT_EQ(Run({"get", "dest"}), expected_xor);
+
+  // Once the bitmap is dense enough it is converted into a regular string.
+  EXPECT_EQ(0, CheckedInt({"setbit", "small", "40000", "1"}));
+  EXPECT_LT(CheckedInt({"memory", "usage", "small"}), 1000);
+  for (unsigned i = 0; i < 2000; ++i) {
+    Run({"setbit", "small", absl::StrCat(i * 8 + 1), "1"});
+  }
+  EXPECT_GT(CheckedInt({"memory", "usage", "small"}), 5000);
+  EXPECT_EQ(2001, CheckedInt({"bitcount", "small"}));
+  EXPECT_EQ(1, CheckedInt({"getbit", "small", "40000"}));
+}
+
 TEST_F(BitOpsFamilyTest, BitFieldParsing) {
   const auto syntax_error = ErrArg("ERR syntax error");
   // Parsing Errors
@@ -19,12 +19,14 @@ using namespace std;
 struct WatchItem {
   Transaction* trans;
   KeyReadyChecker key_ready_checker;
+  bool consumes_key;
 
   Transaction* get() const {
     return trans;
   }
 
-  WatchItem(Transaction* t, KeyReadyChecker krc) : trans(t), key_ready_checker(std::move(krc)) {
+  WatchItem(Transaction* t, KeyReadyChecker krc, bool consumes)
+      : trans(t), key_ready_checker(std::move(krc)), consumes_key(consumes) {
   }
 };
 
@@ -197,7 +199,8 @@ void BlockingController::NotifyPending() {
   awakened_indices_.clear();
 }
 
-void BlockingController::AddWatched(Keys watch_keys, KeyReadyChecker krc, Transaction* trans) {
+void BlockingController::AddWatched(Keys watch_keys, KeyReadyChecker krc, Transaction* trans,
+                                    bool consumes_key) {
   auto [dbit, added] = watched_dbs_.emplace(trans->GetDbIndex(), nullptr);
   if (added) {
     dbit->second.reset(new DbWatchTable);
@@ -220,7 +223,7 @@ void BlockingController::AddWatched(Keys watch_keys, KeyReadyChecker krc, Transa
         continue;
     }
     DVLOG(2) << "Emplace " << trans->DebugId() << " to watch " << key;
-    res->second->items.emplace_back(trans, krc);
+    res->second->items.emplace_back(trans, krc, consumes_key);
   }
 }
 
@@ -241,6 +244,9 @@ void BlockingController::AwakeWatched(DbIndex db_index, string_view db_key) {
 }
 
 // Marks the queue as active and notifies the first transaction in the queue.
+// Transactions that do not consume the key leave it as is for the ones after them, so they are
+// notified and removed from the queue without activating it. This way a single write wakes up
+// all the readers of a key in one pass instead of one hop per reader.
 void BlockingController::NotifyWatchQueue(std::string_view key, WatchQueue* wq,
                                           const DbContext& context) {
   DCHECK_EQ(wq->state, WatchQueue::SUSPENDED);
@@ -257,11 +263,16 @@ void BlockingController::NotifyWatchQueue(std::string_view key, WatchQueue* wq,
     if (wi.key_ready_checker(owner_, context, head, key)) {
       DVLOG(2) << "WQ-Pop " << head->DebugId() << " from key " << key;
       if (head->NotifySuspended(owner_->committed_txid(), sid, key)) {
+        awakened_transactions_.insert(head);
+        if (!wi.consumes_key) {
+          queue.pop_front();
+          continue;
+        }
+
         wq->state = WatchQueue::ACTIVE;
         // We deliberately keep the notified transaction in the queue to know which queue
         // must handled when this transaction finished.
         wq->notify_txid = owner_->committed_txid();
-        awakened_transactions_.insert(head);
         break;
       }
     } else {
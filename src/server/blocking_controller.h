@@ -40,7 +40,9 @@ class BlockingController {
   // TODO: consider moving all watched functions to
   // EngineShard with separate per db map.
   //! AddWatched adds a transaction to the blocking queue.
-  void AddWatched(Keys watch_keys, KeyReadyChecker krc, Transaction* me);
+  //! Transactions that do not consume the key are notified together with the ones queued after
+  //! them, the others are notified one at a time.
+  void AddWatched(Keys watch_keys, KeyReadyChecker krc, Transaction* me, bool consumes_key = true);
 
   // Called from operations that create keys like lpush, rename etc.
   void AwakeWatched(DbIndex db_index, std::string_view db_key);
@@ -4,6 +4,7 @@
 
 #include "server/bloom_family.h"
 
+#include "base/flags.h"
 #include "core/bloom.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/error.h"
@@ -12,6 +13,10 @@
 #include "server/engine_shard_set.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(bool, bf_blocked_layout, false,
+          "If true, new bloom filters keep all the bits of an item within one cache line. "
+          "Lookups cost a single cache miss, at the expense of slightly larger filters.");
+
 namespace dfly {
 
 using namespace facade;
@@ -34,6 +39,29 @@ struct SbfParams {
 using AddResult = absl::InlinedVector<OpResult<bool>, 4>;
 using ExistsResult = absl::InlinedVector<bool, 4>;
 
+// How many items ahead the batched commands prefetch the filter memory.
+constexpr size_t kPrefetchDistance = 8;
+
+// Calls cb with the fingerprints of every item, prefetching the filter memory of the items
+// a few positions ahead.
+template <typename Cb> void ForEachPrefetched(const SBF* sbf, CmdArgList items, Cb&& cb) {
+  array<array<uint64_t, 2>, kPrefetchDistance> fps;
+  size_t ahead = min(items.size(), kPrefetchDistance);
+  for (size_t i = 0; i < ahead; ++i) {
+    SBF::Fingerprint(ToSV(items[i]), fps[i].data());
+    sbf->Prefetch(fps[i].data());
+  }
+
+  for (size_t i = 0; i < items.size(); ++i) {
+    auto& fp = fps[i % kPrefetchDistance];
+    cb(i, fp.data());
+    if (i + kPrefetchDistance < items.size()) {
+      SBF::Fingerprint(ToSV(items[i + kPrefetchDistance]), fp.data());
+      sbf->Prefetch(fp.data());
+    }
+  }
+}
+
 OpStatus OpReserve(const SbfParams& params, const OpArgs& op_args, string_view key) {
   auto& db_slice = op_args.shard->db_slice();
   OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
@@ -43,7 +71,8 @@ OpStatus OpReserve(const SbfParams& params, const OpArgs& op_args, string_view k
     return OpStatus::KEY_EXISTS;
 
   PrimeValue& pv = op_res->it->second;
-  pv.SetSBF(params.init_capacity, params.error, params.grow_factor);
+  pv.SetSBF(params.init_capacity, params.error, params.grow_factor,
+            absl::GetFlag(FLAGS_bf_blocked_layout));
 
   return OpStatus::OK;
 }
@@ -58,7 +87,7 @@ OpResult<AddResult> OpAdd(const OpArgs& op_args, string_view key, CmdArgList ite
   PrimeValue& pv = op_res->it->second;
 
   if (op_res->is_new) {
-    pv.SetSBF(0, kDefaultFpProb, kDefaultGrowFactor);
+    pv.SetSBF(0, kDefaultFpProb, kDefaultGrowFactor, absl::GetFlag(FLAGS_bf_blocked_layout));
   } else {
     if (op_res->it->second.ObjType() != OBJ_SBF)
       return OpStatus::WRONG_TYPE;
@@ -66,9 +95,7 @@ OpResult<AddResult> OpAdd(const OpArgs& op_args, string_view key, CmdArgList ite
 
   SBF* sbf = pv.GetSBF();
   AddResult result(items.size());
-  for (size_t i = 0; i < items.size(); ++i) {
-    result[i] = sbf->Add(ToSV(items[i]));
-  }
+  ForEachPrefetched(sbf, items, [&](size_t i, const uint64_t* fp) { result[i] = sbf->Add(fp); });
   return result;
 }
 
@@ -81,10 +108,7 @@ OpResult<ExistsResult> OpExists(const OpArgs& op_args, string_view key, CmdArgLi
 
   const SBF* sbf = it->second.GetSBF();
   ExistsResult result(items.size());
-
-  for (size_t i = 0; i < items.size(); ++i) {
-    result[i] = sbf->Exists(ToSV(items[i]));
-  }
+  ForEachPrefetched(sbf, items, [&](size_t i, const uint64_t* fp) { result[i] = sbf->Exists(fp); });
 
   return result;
 }
@@ -11,6 +11,7 @@ extern "C" {
 }
 
 #include <absl/container/fixed_array.h>
+#include <absl/strings/numbers.h>
 
 #include "base/logging.h"
 #include "server/engine_shard_set.h"
@@ -25,29 +26,61 @@ bool Matches(string_view pattern, string_view channel) {
   return stringmatchlen(pattern.data(), pattern.size(), channel.data(), channel.size(), 0) == 1;
 }
 
-// Build functor for sending messages to connection
-auto BuildSender(string_view channel, facade::ArgRange messages) {
-  absl::FixedArray<string_view, 1> views(messages.Size());
-  size_t messages_size = accumulate(messages.begin(), messages.end(), 0,
-                                    [](int sum, string_view str) { return sum + str.size(); });
-  auto buf = shared_ptr<char[]>{new char[channel.size() + messages_size]};
-  {
-    memcpy(buf.get(), channel.data(), channel.size());
-    char* ptr = buf.get() + channel.size();
+// Part of the pattern before the first character that has a special meaning for globs.
+string_view LiteralPrefix(string_view pattern) {
+  return pattern.substr(0, pattern.find_first_of("*?[\\"));
+}
+
+// Upper bound of the RESP bulk string header and trailer: "$" + length + 2 CRLFs.
+constexpr size_t kBulkOverhead = 1 + 20 + 4;
+
+// Writes str as a RESP bulk string to dest and returns the view of str inside it.
+string_view WriteBulkString(string_view str, char** dest) {
+  char* ptr = *dest;
+  *ptr++ = '$';
+  ptr = absl::numbers_internal::FastIntToBuffer(str.size(), ptr);
+  memcpy(ptr, "\r\n", 2);
+  ptr += 2;
+
+  string_view res{ptr, str.size()};
+  memcpy(ptr, str.data(), str.size());
+  ptr += str.size();
+  memcpy(ptr, "\r\n", 2);
+  *dest = ptr + 2;
+  return res;
+}
+
+// Build functor for sending messages to connection.
+// Channel and messages are serialized once into a buffer that is shared by all the subscribers,
+// so delivering a message to a connection only adds the push header in front of it.
+auto BuildSender(string_view channel, facade::ArgRange messages, bool sharded) {
+  struct Entry {
+    string_view channel, message, serialized;
+  };
+
+  absl::FixedArray<Entry, 1> entries(messages.Size());
+  size_t buf_size = 0;
+  for (string_view message : messages)
+    buf_size += channel.size() + message.size() + 2 * kBulkOverhead;
 
+  auto buf = shared_ptr<char[]>{new char[buf_size]};
+  {
+    char* ptr = buf.get();
     size_t i = 0;
     for (string_view message : messages) {
-      memcpy(ptr, message.data(), message.size());
-      views[i++] = {ptr, message.size()};
-      ptr += message.size();
+      char* start = ptr;
+      entries[i].channel = WriteBulkString(channel, &ptr);
+      entries[i].message = WriteBulkString(message, &ptr);
+      entries[i++].serialized = {start, size_t(ptr - start)};
     }
   }
 
-  return [channel, buf = std::move(buf), views = std::move(views)](facade::Connection* conn,
-                                                                   string pattern) {
-    string_view channel_view{buf.get(), channel.size()};
-    for (std::string_view message_view : views)
-      conn->SendPubMessageAsync({std::move(pattern), buf, channel_view, message_view});
+  return [buf = std::move(buf), entries = std::move(entries), sharded](facade::Connection* conn,
+                                                                      const string& pattern) {
+    for (const Entry& entry : entries) {
+      conn->SendPubMessageAsync(
+          {pattern, buf, entry.channel, entry.message, entry.serialized, sharded});
+    }
   };
 }
 
@@ -101,12 +134,66 @@ void ChannelStore::ChannelMap::DeleteAll() {
     delete ptr.Get();
 }
 
-ChannelStore::ChannelStore() : channels_{new ChannelMap{}}, patterns_{new ChannelMap{}} {
+void ChannelStore::PatternIndex::Add(string_view pattern) {
+  string_view prefix = LiteralPrefix(pattern);
+  auto [it, added] = by_prefix_.try_emplace(prefix);
+  if (added)
+    ++prefix_lens_[prefix.size()];
+  it->second.emplace(pattern);
+}
+
+void ChannelStore::PatternIndex::Remove(string_view pattern) {
+  string_view prefix = LiteralPrefix(pattern);
+  auto it = by_prefix_.find(prefix);
+  if (it == by_prefix_.end())
+    return;
+
+  it->second.erase(pattern);
+  if (it->second.empty()) {
+    by_prefix_.erase(it);
+    if (auto lit = prefix_lens_.find(prefix.size()); --lit->second == 0)
+      prefix_lens_.erase(lit);
+  }
+}
+
+void ChannelStore::PatternIndex::Match(string_view channel,
+                                       absl::FunctionRef<void(string_view)> cb) const {
+  for (auto [len, _] : prefix_lens_) {
+    if (len > channel.size())
+      break;
+
+    auto it = by_prefix_.find(channel.substr(0, len));
+    if (it == by_prefix_.end())
+      continue;
+
+    for (string_view pattern : it->second) {
+      if (Matches(pattern, channel))
+        cb(pattern);
+    }
+  }
+}
+
+ChannelStore::ChannelStore()
+    : channels_{new ChannelMap{}},
+      patterns_{new ChannelMap{}},
+      shard_channels_{new ChannelMap{}} {
   control_block.most_recent = this;
 }
 
-ChannelStore::ChannelStore(ChannelMap* channels, ChannelMap* patterns)
-    : channels_{channels}, patterns_{patterns} {
+ChannelStore::ChannelStore(ChannelMap* channels, ChannelMap* patterns, ChannelMap* shard_channels)
+    : channels_{channels}, patterns_{patterns}, shard_channels_{shard_channels} {
+}
+
+ChannelStore::ChannelMap* ChannelStore::GetMap(Kind kind) const {
+  switch (kind) {
+    case CHANNEL:
+      return channels_;
+    case PATTERN:
+      return patterns_;
+    case SHARD_CHANNEL:
+      return shard_channels_;
+  }
+  return nullptr;
 }
 
 void ChannelStore::Destroy() {
@@ -114,7 +201,7 @@ void ChannelStore::Destroy() {
   control_block.update_mu.unlock();
 
   auto* store = control_block.most_recent.load(memory_order_relaxed);
-  for (auto* chan_map : {store->channels_, store->patterns_}) {
+  for (auto* chan_map : {store->channels_, store->patterns_, store->shard_channels_}) {
     chan_map->DeleteAll();
     delete chan_map;
   }
@@ -123,8 +210,9 @@ void ChannelStore::Destroy() {
 
 ChannelStore::ControlBlock ChannelStore::control_block;
 
-unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange messages) const {
-  vector<Subscriber> subscribers = FetchSubscribers(channel);
+unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange messages,
+                                    bool sharded) const {
+  vector<Subscriber> subscribers = FetchSubscribers(channel, sharded);
   if (subscribers.empty())
     return 0;
 
@@ -142,31 +230,49 @@ unsigned ChannelStore::SendMessages(std::string_view channel, facade::ArgRange m
   }
 
   auto subscribers_ptr = make_shared<decltype(subscribers)>(std::move(subscribers));
-  auto cb = [subscribers_ptr, send = BuildSender(channel, messages)](unsigned idx, auto*) {
-    auto it = lower_bound(subscribers_ptr->begin(), subscribers_ptr->end(), idx,
-                          ChannelStore::Subscriber::ByThreadId);
-    while (it != subscribers_ptr->end() && it->Thread() == idx) {
-      if (auto* ptr = it->Get(); ptr)
-        send(ptr, it->pattern);
-      it++;
-    }
-  };
-  shard_set->pool()->DispatchBrief(std::move(cb));
+  auto sender = BuildSender(channel, messages, sharded);
+  auto send_ptr = make_shared<decltype(sender)>(std::move(sender));
+
+  // Hop only to the threads that have subscribers, each one handles its range of subscribers.
+  for (size_t start = 0; start < subscribers_ptr->size();) {
+    unsigned thread = (*subscribers_ptr)[start].Thread();
+    size_t end = start + 1;
+    while (end < subscribers_ptr->size() && (*subscribers_ptr)[end].Thread() == thread)
+      ++end;
+
+    auto cb = [subscribers_ptr, send_ptr, start, end] {
+      for (size_t i = start; i < end; ++i) {
+        const Subscriber& sub = (*subscribers_ptr)[i];
+        if (auto* ptr = sub.Get(); ptr)
+          (*send_ptr)(ptr, sub.pattern);
+      }
+    };
+    shard_set->pool()->at(thread)->DispatchBrief(std::move(cb));
+    start = end;
+  }
 
   return subscribers_ptr->size();
 }
 
-vector<ChannelStore::Subscriber> ChannelStore::FetchSubscribers(string_view channel) const {
+vector<ChannelStore::Subscriber> ChannelStore::FetchSubscribers(string_view channel,
+                                                                bool sharded) const {
   vector<Subscriber> res;
 
-  if (auto it = channels_->find(channel); it != channels_->end())
+  ChannelMap* channels = sharded ? shard_channels_ : channels_;
+  if (auto it = channels->find(channel); it != channels->end())
     Fill(*it->second, string{}, &res);
 
-  for (const auto& [pat, subs] : *patterns_) {
-    if (Matches(pat, channel))
-      Fill(*subs, pat, &res);
+  if (sharded) {
+    sort(res.begin(), res.end(), Subscriber::ByThread);
+    return res;
   }
 
+  patterns_->pattern_index.Match(channel, [&](string_view pattern) {
+    auto it = patterns_->find(pattern);
+    DCHECK(it != patterns_->end());
+    Fill(*it->second, it->first, &res);
+  });
+
   sort(res.begin(), res.end(), Subscriber::ByThread);
   return res;
 }
@@ -182,9 +288,9 @@ void ChannelStore::Fill(const SubscribeMap& src, const string& pattern, vector<S
   }
 }
 
-std::vector<string> ChannelStore::ListChannels(const string_view pattern) const {
+std::vector<string> ChannelStore::ListChannels(const string_view pattern, bool sharded) const {
   vector<string> res;
-  for (const auto& [channel, _] : *channels_) {
+  for (const auto& [channel, _] : *(sharded ? shard_channels_ : channels_)) {
     if (pattern.empty() || Matches(pattern, channel))
       res.push_back(channel);
   }
@@ -195,9 +301,9 @@ size_t ChannelStore::PatternCount() const {
   return patterns_->size();
 }
 
-ChannelStoreUpdater::ChannelStoreUpdater(bool pattern, bool to_add, ConnectionContext* cntx,
-                                         uint32_t thread_id)
-    : pattern_{pattern}, to_add_{to_add}, cntx_{cntx}, thread_id_{thread_id} {
+ChannelStoreUpdater::ChannelStoreUpdater(ChannelStore::Kind kind, bool to_add,
+                                         ConnectionContext* cntx, uint32_t thread_id)
+    : kind_{kind}, to_add_{to_add}, cntx_{cntx}, thread_id_{thread_id} {
 }
 
 void ChannelStoreUpdater::Record(string_view key) {
@@ -205,7 +311,7 @@ void ChannelStoreUpdater::Record(string_view key) {
 }
 
 pair<ChannelStore::ChannelMap*, bool> ChannelStoreUpdater::GetTargetMap(ChannelStore* store) {
-  auto* target = pattern_ ? store->patterns_ : store->channels_;
+  auto* target = store->GetMap(kind_);
 
   for (auto key : ops_) {
     auto it = target->find(key);
@@ -226,6 +332,8 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
   // New key, add new slot.
   if (to_add_ && it == target->end()) {
     target->emplace(key, new SubscribeMap{{cntx_, thread_id_}});
+    if (kind_ == ChannelStore::PATTERN)
+      target->pattern_index.Add(key);
     return;
   }
 
@@ -234,6 +342,8 @@ void ChannelStoreUpdater::Modify(ChannelMap* target, string_view key) {
     DCHECK(it->second->begin()->first == cntx_);
     freelist_.push_back(it->second.Get());
     target->erase(it);
+    if (kind_ == ChannelStore::PATTERN)
+      target->pattern_index.Remove(key);
     return;
   }
 
@@ -265,9 +375,9 @@ void ChannelStoreUpdater::Apply() {
   // Prepare replacement.
   auto* replacement = store;
   if (copied) {
-    auto* new_chans = pattern_ ? store->channels_ : target;
-    auto* new_patterns = pattern_ ? target : store->patterns_;
-    replacement = new ChannelStore{new_chans, new_patterns};
+    ChannelMap* maps[] = {store->channels_, store->patterns_, store->shard_channels_};
+    maps[kind_] = target;
+    replacement = new ChannelStore{maps[0], maps[1], maps[2]};
   }
 
   // Update control block and unlock it.
@@ -286,7 +396,7 @@ void ChannelStoreUpdater::Apply() {
 
   // Delete previous map and channel store.
   if (copied) {
-    delete (pattern_ ? store->patterns_ : store->channels_);
+    delete store->GetMap(kind_);
     delete store;
   }
 
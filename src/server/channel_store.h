@@ -3,7 +3,10 @@
 //
 #pragma once
 
+#include <absl/container/btree_map.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
+#include <absl/functional/function_ref.h>
 
 #include <string_view>
 
@@ -40,6 +43,10 @@ class ChannelStore {
   friend class ChannelStoreUpdater;
 
  public:
+  // Subscriptions of every kind are kept in a separate map. Sharded channels (SSUBSCRIBE) form
+  // their own namespace and receive only the messages published with SPUBLISH.
+  enum Kind : uint8_t { CHANNEL, PATTERN, SHARD_CHANNEL };
+
   struct Subscriber : public facade::Connection::WeakRef {
     Subscriber(WeakRef ref, const std::string& pattern)
         : facade::Connection::WeakRef(std::move(ref)), pattern(pattern) {
@@ -55,12 +62,15 @@ class ChannelStore {
   ChannelStore();
 
   // Send messages to channel, block on connection backpressure
-  unsigned SendMessages(std::string_view channel, facade::ArgRange messages) const;
+  unsigned SendMessages(std::string_view channel, facade::ArgRange messages,
+                        bool sharded = false) const;
 
   // Fetch all subscribers for channel, including matching patterns.
-  std::vector<Subscriber> FetchSubscribers(std::string_view channel) const;
+  // Sharded channels have no pattern subscribers.
+  std::vector<Subscriber> FetchSubscribers(std::string_view channel, bool sharded = false) const;
 
-  std::vector<std::string> ListChannels(const std::string_view pattern) const;
+  std::vector<std::string> ListChannels(const std::string_view pattern,
+                                        bool sharded = false) const;
   size_t PatternCount() const;
 
   // Destroy current instance and delete it.
@@ -91,6 +101,22 @@ class ChannelStore {
     std::atomic<SubscribeMap*> ptr;
   };
 
+  // Index of patterns by their literal prefix, i.e. the part before the first glob special
+  // character. A channel can match only the patterns whose prefix is also its prefix, so
+  // matching a channel checks only those instead of all the patterns.
+  class PatternIndex {
+   public:
+    void Add(std::string_view pattern);
+    void Remove(std::string_view pattern);
+
+    // Calls cb for every indexed pattern that matches channel.
+    void Match(std::string_view channel, absl::FunctionRef<void(std::string_view)> cb) const;
+
+   private:
+    absl::flat_hash_map<std::string, absl::flat_hash_set<std::string>> by_prefix_;
+    absl::btree_map<size_t, unsigned> prefix_lens_;  // prefix length -> number of prefixes
+  };
+
   // SubscriberMaps for channels/patterns.
   struct ChannelMap : absl::flat_hash_map<std::string, UpdatablePointer> {
     void Add(std::string_view key, ConnectionContext* me, uint32_t thread_id);
@@ -98,6 +124,8 @@ class ChannelStore {
 
     // Delete all stored SubscribeMap pointers.
     void DeleteAll();
+
+    PatternIndex pattern_index;  // maintained only for the map of patterns
   };
 
   // Centralized controller to prevent overlaping updates.
@@ -109,13 +137,16 @@ class ChannelStore {
  private:
   static ControlBlock control_block;
 
-  ChannelStore(ChannelMap* channels, ChannelMap* patterns);
+  ChannelStore(ChannelMap* channels, ChannelMap* patterns, ChannelMap* shard_channels);
+
+  ChannelMap* GetMap(Kind kind) const;
 
   static void Fill(const SubscribeMap& src, const std::string& pattern,
                    std::vector<Subscriber>* out);
 
   ChannelMap* channels_;
   ChannelMap* patterns_;
+  ChannelMap* shard_channels_;
 };
 
 // Performs RCU (read-copy-update) updates to the channel store.
@@ -123,7 +154,8 @@ class ChannelStore {
 // Queues operations and performs them with Apply().
 class ChannelStoreUpdater {
  public:
-  ChannelStoreUpdater(bool pattern, bool to_add, ConnectionContext* cntx, uint32_t thread_id);
+  ChannelStoreUpdater(ChannelStore::Kind kind, bool to_add, ConnectionContext* cntx,
+                      uint32_t thread_id);
 
   void Record(std::string_view key);
   void Apply();
@@ -139,7 +171,7 @@ class ChannelStoreUpdater {
   void Modify(ChannelMap* target, std::string_view key);
 
  private:
-  bool pattern_;
+  ChannelStore::Kind kind_;
   bool to_add_;
   ConnectionContext* cntx_;
   uint32_t thread_id_;
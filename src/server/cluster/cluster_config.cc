@@ -91,8 +91,13 @@ shared_ptr<ClusterConfig> ClusterConfig::CreateFromConfig(string_view my_id,
   shared_ptr<ClusterConfig> result(new ClusterConfig());
 
   result->config_ = config;
+  result->slot_shards_.fill(kNoShard);
+
+  for (size_t i = 0; i < result->config_.size(); ++i) {
+    const ClusterShardInfo& shard = result->config_[i];
+    for (const auto& range : shard.slot_ranges)
+      fill(&result->slot_shards_[range.start], &result->slot_shards_[range.end] + 1, i);
 
-  for (const auto& shard : result->config_) {
     bool owned_by_me = shard.master.id == my_id ||
                        any_of(shard.replicas.begin(), shard.replicas.end(),
                               [&](const ClusterNodeInfo& node) { return node.id == my_id; });
@@ -315,16 +320,9 @@ bool ClusterConfig::IsMySlot(std::string_view key) const {
 ClusterNodeInfo ClusterConfig::GetMasterNodeForSlot(SlotId id) const {
   CHECK_LE(id, cluster::kMaxSlotNum) << "Requesting a non-existing slot id " << id;
 
-  for (const auto& shard : config_) {
-    for (const auto& range : shard.slot_ranges) {
-      if (id >= range.start && id <= range.end) {
-        return shard.master;
-      }
-    }
-  }
-
-  DCHECK(false) << "Can't find master node for slot " << id;
-  return {};
+  uint16_t shard = slot_shards_[id];
+  DCHECK_NE(shard, kNoShard) << "Can't find master node for slot " << id;
+  return shard == kNoShard ? ClusterNodeInfo{} : config_[shard].master;
 }
 
 ClusterShardInfos ClusterConfig::GetConfig() const {
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <array>
 #include <memory>
 #include <string_view>
 #include <vector>
@@ -52,15 +53,15 @@ class ClusterConfig {
   }
 
  private:
-  struct SlotEntry {
-    const ClusterShardInfo* shard = nullptr;
-    bool owned_by_me = false;
-  };
+  static constexpr uint16_t kNoShard = UINT16_MAX;
 
   ClusterConfig() = default;
 
   ClusterShardInfos config_;
 
+  // Index into config_ of the shard serving each slot, kNoShard if none.
+  std::array<uint16_t, kMaxSlotNum + 1> slot_shards_;
+
   SlotSet my_slots_;
   std::vector<MigrationInfo> my_outgoing_migrations_;
   std::vector<MigrationInfo> my_incoming_migrations_;
@@ -4,8 +4,10 @@
 
 #include "server/cluster/cluster_family.h"
 
+#include <algorithm>
 #include <memory>
 #include <mutex>
+#include <numeric>
 #include <string>
 
 #include "absl/cleanup/cleanup.h"
@@ -123,6 +125,9 @@ void ClusterFamily::ClusterHelp(ConnectionContext* cntx) {
       "   <id> <ip:port> <flags> <master> <pings> <pongs> <epoch> <link> <slot> ...",
       "INFO",
       "  Return information about the cluster",
+      "SLOT-STATS SLOTSRANGE <start> <end> | ORDERBY <metric> [LIMIT <limit>] [ASC|DESC]",
+      "   Return statistics of the owned slots in the range or of the top slots by the metric:",
+      "   KEY-COUNT, MEMORY-BYTES, TOTAL-READS, TOTAL-WRITES or OPS-PER-SEC.",
       "HELP",
       "    Prints this help.",
   };
@@ -358,6 +363,122 @@ void ClusterFamily::KeySlot(CmdArgList args, ConnectionContext* cntx) {
   return cntx->SendLong(id);
 }
 
+namespace {
+
+enum class SlotMetric { KEY_COUNT, MEMORY_BYTES, TOTAL_READS, TOTAL_WRITES, OPS_PER_SEC };
+
+uint64_t GetSlotMetric(const SlotStats& stats, SlotMetric metric) {
+  switch (metric) {
+    case SlotMetric::KEY_COUNT:
+      return stats.key_count;
+    case SlotMetric::MEMORY_BYTES:
+      return stats.memory_bytes;
+    case SlotMetric::TOTAL_READS:
+      return stats.total_reads;
+    case SlotMetric::TOTAL_WRITES:
+      return stats.total_writes;
+    case SlotMetric::OPS_PER_SEC:
+      return stats.ops_per_sec;
+  }
+  return 0;
+}
+
+}  // namespace
+
+void ClusterFamily::ClusterSlotStats(CmdArgList args, ConnectionContext* cntx) {
+  // Slot statistics are tracked only in the real cluster mode.
+  if (!IsClusterEnabled())
+    return cntx->SendError("SLOT-STATS is not supported in emulated cluster mode");
+  if (tl_cluster_config == nullptr)
+    return cntx->SendError(kClusterNotConfigured);
+
+  CmdArgParser parser(args.subspan(1));
+  SlotId start = 0, end = kMaxSlotNum;
+  optional<SlotMetric> order_by;
+  size_t limit = 16;
+  bool desc = true;
+
+  if (parser.Check("SLOTSRANGE").IgnoreCase().ExpectTail(2)) {
+    tie(start, end) = parser.Next<SlotId, SlotId>();
+  } else {
+    parser.ToUpper().ExpectTag("ORDERBY");
+    order_by = parser.ToUpper().Switch(
+        "KEY-COUNT", SlotMetric::KEY_COUNT, "MEMORY-BYTES", SlotMetric::MEMORY_BYTES,
+        "TOTAL-READS", SlotMetric::TOTAL_READS, "TOTAL-WRITES", SlotMetric::TOTAL_WRITES,
+        "OPS-PER-SEC", SlotMetric::OPS_PER_SEC);
+    while (parser.HasNext() && !parser.HasError()) {
+      if (parser.Check("LIMIT").IgnoreCase().ExpectTail(1)) {
+        limit = parser.Next<size_t>();
+      } else if (parser.Check("ASC").IgnoreCase()) {
+        desc = false;
+      } else if (parser.Check("DESC").IgnoreCase()) {
+        desc = true;
+      } else {
+        return cntx->SendError(kSyntaxErr);
+      }
+    }
+  }
+
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+  if (parser.HasNext())
+    return cntx->SendError(kSyntaxErr);
+  if (start > end || end > kMaxSlotNum)
+    return cntx->SendError("Invalid slot range");
+  if (limit == 0 || limit > kMaxSlotNum + 1)
+    return cntx->SendError("Limit must be in the range of 1 to 16384");
+
+  vector<SlotId> slots;
+  for (SlotId sid = start; sid <= end; ++sid) {
+    if (tl_cluster_config->IsMySlot(sid))
+      slots.push_back(sid);
+  }
+
+  vector<SlotStats> stats(slots.size());
+  fb2::Mutex mu;
+  shard_set->pool()->AwaitFiberOnAll([&](auto*) {
+    EngineShard* shard = EngineShard::tlocal();
+    if (shard == nullptr)
+      return;
+
+    lock_guard lk(mu);
+    for (size_t i = 0; i < slots.size(); ++i)
+      stats[i] += shard->db_slice().GetSlotStats(slots[i]);
+  });
+
+  vector<size_t> order(slots.size());
+  iota(order.begin(), order.end(), 0);
+  if (order_by) {
+    limit = min(limit, order.size());
+    auto by_metric = [&](size_t a, size_t b) {
+      uint64_t ma = GetSlotMetric(stats[a], *order_by), mb = GetSlotMetric(stats[b], *order_by);
+      if (ma != mb)
+        return desc ? ma > mb : ma < mb;
+      return slots[a] < slots[b];
+    };
+    partial_sort(order.begin(), order.begin() + limit, order.end(), by_metric);
+    order.resize(limit);
+  }
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(order.size());
+  for (size_t i : order) {
+    rb->StartArray(2);
+    rb->SendLong(slots[i]);
+    rb->StartCollection(5, RedisReplyBuilder::MAP);
+    rb->SendBulkString("key-count");
+    rb->SendLong(stats[i].key_count);
+    rb->SendBulkString("memory-bytes");
+    rb->SendLong(stats[i].memory_bytes);
+    rb->SendBulkString("total-reads");
+    rb->SendLong(stats[i].total_reads);
+    rb->SendBulkString("total-writes");
+    rb->SendLong(stats[i].total_writes);
+    rb->SendBulkString("ops-per-sec");
+    rb->SendLong(stats[i].ops_per_sec);
+  }
+}
+
 void ClusterFamily::Cluster(CmdArgList args, ConnectionContext* cntx) {
   // In emulated cluster mode, all slots are mapped to the same host, and number of cluster
   // instances is thus 1.
@@ -381,6 +502,8 @@ void ClusterFamily::Cluster(CmdArgList args, ConnectionContext* cntx) {
     return ClusterInfo(cntx);
   } else if (sub_cmd == "KEYSLOT") {
     return KeySlot(args, cntx);
+  } else if (sub_cmd == "SLOT-STATS") {
+    return ClusterSlotStats(args, cntx);
   } else {
     return cntx->SendError(facade::UnknownSubCmd(sub_cmd, "CLUSTER"), facade::kSyntaxErrType);
   }
@@ -544,9 +667,11 @@ void ClusterFamily::DflyClusterConfig(CmdArgList args, ConnectionContext* cntx)
     return moved ? OpStatus::KEY_MOVED : OpStatus::OK;
   };
 
-  auto cb = [this, &tracker, &new_config, blocking_filter](util::ProactorBase*) {
+  // The previous config is released here rather than by the last data thread to drop it.
+  vector<shared_ptr<ClusterConfig>> prev_configs(shard_set->pool()->size());
+  auto cb = [this, &tracker, &new_config, &prev_configs, blocking_filter](util::ProactorBase* pb) {
     server_family_->CancelBlockingOnThread(blocking_filter);
-    tl_cluster_config = new_config;
+    prev_configs[pb->GetPoolIndex()] = std::exchange(tl_cluster_config, new_config);
     tracker.TrackOnThread();
   };
 
@@ -679,21 +804,31 @@ void ClusterFamily::DflySlotMigrationStatus(CmdArgList args, ConnectionContext*
 
   auto append_answer = [rb, &reply](string_view direction, string_view node_id, string_view filter,
                                     MigrationState state, size_t keys_number, string_view error) {
-    if (filter.empty() || filter == node_id) {
-      error = error.empty() ? "0" : error;
-      reply.push_back(absl::StrCat(direction, " ", node_id, " ", StateToStr(state),
-                                   " keys:", keys_number, " errors:", error));
-    }
+    if (!filter.empty() && filter != node_id)
+      return false;
+
+    error = error.empty() ? "0" : error;
+    reply.push_back(absl::StrCat(direction, " ", node_id, " ", StateToStr(state),
+                                 " keys:", keys_number, " errors:", error));
+    return true;
   };
 
   for (const auto& m : incoming_migrations_jobs_) {
     // TODO add error status
-    append_answer("in", m->GetSourceID(), node_id, m->GetState(), m->GetKeyCount(),
-                  m->GetErrorStr());
+    if (append_answer("in", m->GetSourceID(), node_id, m->GetState(), m->GetKeyCount(),
+                      m->GetErrorStr())) {
+      IncomingSlotMigration::Progress progress = m->GetProgress();
+      absl::StrAppend(&reply.back(), " applied:", progress.applied,
+                      " throughput:", progress.throughput);
+    }
   }
   for (const auto& m : outgoing_migration_jobs_) {
-    append_answer("out", m->GetMigrationInfo().node_id, node_id, m->GetState(), m->GetKeyCount(),
-                  m->GetErrorStr());
+    if (append_answer("out", m->GetMigrationInfo().node_id, node_id, m->GetState(),
+                      m->GetKeyCount(), m->GetErrorStr())) {
+      OutgoingMigration::Progress progress = m->GetProgress();
+      absl::StrAppend(&reply.back(), " bytes:", progress.bytes,
+                      " throughput:", progress.throughput, " eta_sec:", progress.eta_sec);
+    }
   }
 
   if (reply.empty()) {
@@ -907,8 +1042,11 @@ void ClusterFamily::ApplyMigrationSlotRangeToConfig(std::string_view node_id,
 
   // we don't need to use DispatchTracker here because for IncomingMingration we don't have
   // connectionas that should be tracked and for Outgoing migration we do it under Pause
-  server_family_->service().proactor_pool().AwaitFiberOnAll(
-      [&new_config](util::ProactorBase*) { tl_cluster_config = new_config; });
+  vector<shared_ptr<ClusterConfig>> prev_configs(shard_set->pool()->size());
+  server_family_->service().proactor_pool().AwaitBrief(
+      [&new_config, &prev_configs](unsigned index, util::ProactorBase*) {
+        prev_configs[index] = std::exchange(tl_cluster_config, new_config);
+      });
   DCHECK(tl_cluster_config != nullptr);
 }
 
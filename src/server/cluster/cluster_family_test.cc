@@ -648,6 +648,30 @@ TEST_F(ClusterFamilyTest, FlushSlots) {
                                                   _, "total_writes", _, "memory_bytes", _)))));
 }
 
+TEST_F(ClusterFamilyTest, FlushSlotsWithSlotIndex) {
+  absl::FlagSaver saver;
+  SetTestFlag("cluster_slot_index", "true");
+  ResetService();
+
+  EXPECT_EQ(Run({"debug", "populate", "3000", "key", "4", "slots", "0", "2"}), "OK");
+  auto slot_size = [&](string_view slot) {
+    auto resp = RunPrivileged({"dflycluster", "getslotinfo", "slots", slot});
+    return *resp.GetVec()[2].GetInt();
+  };
+  int64_t kept = slot_size("2");
+  ASSERT_GT(kept, 0);
+  ASSERT_GT(slot_size("0"), 0);
+
+  EXPECT_EQ(RunPrivileged({"dflycluster", "flushslots", "0", "1"}), "OK");
+  ExpectConditionWithinTimeout([&]() { return CheckedInt({"dbsize"}) == kept; });
+  EXPECT_EQ(slot_size("0"), 0);
+  EXPECT_EQ(slot_size("1"), 0);
+  EXPECT_EQ(slot_size("2"), kept);
+
+  EXPECT_EQ(RunPrivileged({"dflycluster", "flushslots", "2", "2"}), "OK");
+  ExpectConditionWithinTimeout([&]() { return CheckedInt({"dbsize"}) == 0; });
+}
+
 TEST_F(ClusterFamilyTest, FlushSlotsAndImmediatelySetValue) {
   for (int count : {1, 10, 100, 1000, 10000, 100000}) {
     ConfigSingleNodeCluster(GetMyId());
@@ -675,6 +699,56 @@ TEST_F(ClusterFamilyTest, FlushSlotsAndImmediatelySetValue) {
   }
 }
 
+TEST_F(ClusterFamilyTest, ClusterSlotStats) {
+  ConfigSingleNodeCluster(GetMyId());
+
+  // Slots of "a" and "b" are 15495 and 3300.
+  Run({"MSET", "{a}1", "1", "{a}2", "2"});
+  Run({"SET", "{b}", "value"});
+  Run({"GET", "{b}"});
+
+  auto stats = [](int64_t slot, int64_t keys, int64_t reads, int64_t writes) {
+    return RespArray(ElementsAre(IntArg(slot), RespArray(ElementsAre("key-count", IntArg(keys),
+                                                                     "memory-bytes", _,
+                                                                     "total-reads", IntArg(reads),
+                                                                     "total-writes", IntArg(writes),
+                                                                     "ops-per-sec", _))));
+  };
+
+  EXPECT_THAT(Run({"CLUSTER", "SLOT-STATS", "ORDERBY", "KEY-COUNT", "LIMIT", "2"}),
+              RespArray(ElementsAre(stats(15495, 2, 0, 2), stats(3300, 1, 1, 1))));
+  EXPECT_THAT(Run({"CLUSTER", "SLOT-STATS", "ORDERBY", "total-reads", "LIMIT", "1"}),
+              stats(3300, 1, 1, 1));
+  EXPECT_THAT(Run({"CLUSTER", "SLOT-STATS", "SLOTSRANGE", "3299", "3300"}),
+              RespArray(ElementsAre(stats(3299, 0, 0, 0), stats(3300, 1, 1, 1))));
+
+  EXPECT_THAT(Run({"CLUSTER", "SLOT-STATS", "SLOTSRANGE", "2", "1"}), ErrArg("Invalid slot range"));
+  EXPECT_THAT(Run({"CLUSTER", "SLOT-STATS", "ORDERBY", "cpu"}), ErrArg("syntax error"));
+}
+
+TEST_F(ClusterFamilyTest, OutgoingMigrationProgress) {
+  string config_template = R"json(
+    [
+      {
+        "slot_ranges": [ { "start": 0, "end": 16383 } ],
+        "master": { "id": "$0", "ip": "127.0.0.1", "port": 7000 },
+        "replicas": [],
+        "migrations": [{ "slot_ranges": [ { "start": 0, "end": 100 } ],
+                         "node_id": "target", "ip": "127.0.0.1", "port": 1 }]
+      }
+    ])json";
+  EXPECT_EQ(RunPrivileged({"dflycluster", "config", absl::Substitute(config_template, GetMyId())}),
+            "OK");
+
+  // The target is not reachable, so nothing was sent and the ETA is unknown.
+  auto resp = RunPrivileged({"dflycluster", "slot-migration-status", "target"});
+  EXPECT_THAT(resp.GetString(), StartsWith("out target "));
+  EXPECT_THAT(resp.GetString(), HasSubstr(" bytes:0 throughput:0 eta_sec:-1"));
+
+  ConfigSingleNodeCluster(GetMyId());
+  EXPECT_EQ(RunPrivileged({"dflycluster", "slot-migration-status"}), "NO_STATE");
+}
+
 TEST_F(ClusterFamilyTest, ClusterCrossSlot) {
   ConfigSingleNodeCluster(GetMyId());
 
@@ -691,6 +765,105 @@ TEST_F(ClusterFamilyTest, ClusterCrossSlot) {
   EXPECT_THAT(Run({"MGET", "key{tag}", "key2{tag}"}), RespArray(ElementsAre("value", "value2")));
 }
 
+TEST_F(ClusterFamilyTest, ShardedPubSub) {
+  string config_template = R"json(
+      [
+        {
+          "slot_ranges": [
+            {
+              "start": 0,
+              "end": 8000
+            }
+          ],
+          "master": {
+            "id": "$0",
+            "ip": "10.0.0.1",
+            "port": 7000
+          },
+          "replicas": []
+        },
+        {
+          "slot_ranges": [
+            {
+              "start": 8001,
+              "end": 16383
+            }
+          ],
+          "master": {
+            "id": "other",
+            "ip": "10.0.0.2",
+            "port": 7000
+          },
+          "replicas": []
+        }
+      ])json";
+
+  EXPECT_EQ(RunPrivileged({"dflycluster", "config", absl::Substitute(config_template, GetMyId())}),
+            "OK");
+
+  // Slot of {b} is 3300, owned by this node. Slot of {a} is 15495, owned by the other node.
+  EXPECT_THAT(Run({"spublish", "ch{b}", "foo"}), IntArg(0));
+  EXPECT_THAT(Run({"spublish", "ch{a}", "foo"}), ErrArg("MOVED 15495 10.0.0.2:7000"));
+  EXPECT_THAT(Run({"ssubscribe", "ch{a}"}), ErrArg("MOVED 15495 10.0.0.2:7000"));
+  EXPECT_THAT(Run({"ssubscribe", "ch{b}", "ch{a}"}), ErrArg("CROSSSLOT"));
+  EXPECT_THAT(Run({"sunsubscribe", "ch{b}", "ch{a}"}), ErrArg("CROSSSLOT"));
+
+  single_response_ = false;
+  pp_->at(1)->Await([&] { return Run({"ssubscribe", "ch{b}", "other{b}"}); });
+  auto resp = pp_->at(0)->Await([&] { return Run({"spublish", "ch{b}", "bar"}); });
+  EXPECT_THAT(resp, IntArg(1));
+  resp = pp_->at(0)->Await([&] { return Run({"pubsub", "shardnumsub", "other{b}"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("other{b}", IntArg(1)));
+}
+
+TEST_F(ClusterFamilyTest, ClusterCrossSlotProxy) {
+  absl::FlagSaver fs;
+  SetTestFlag("cluster_proxy_multikey", "true");
+  ConfigSingleNodeCluster(GetMyId());
+
+  EXPECT_EQ(Run({"MSET", "key", "value", "key2", "value2", "key{tag}", "value3"}), "OK");
+  EXPECT_THAT(Run({"MGET", "key2", "missing", "key", "key{tag}"}),
+              RespArray(ElementsAre("value2", ArgType(RespExpr::NIL), "value", "value3")));
+  EXPECT_THAT(Run({"DEL", "key", "key2", "missing"}), IntArg(2));
+  EXPECT_THAT(Run({"MGET", "key", "key2"}),
+              RespArray(ElementsAre(ArgType(RespExpr::NIL), ArgType(RespExpr::NIL))));
+
+  // Commands in transactions are not split.
+  Run({"MULTI"});
+  EXPECT_THAT(Run({"MGET", "key", "key2"}), ErrArg("CROSSSLOT"));
+}
+
+TEST_F(ClusterFamilyTest, SortPatternsCrossSlot) {
+  ConfigSingleNodeCluster(GetMyId());
+
+  Run({"rpush", "{l}list", "a", "b"});
+  Run({"mset", "{l}w_a", "2", "{l}w_b", "1"});
+  EXPECT_THAT(Run({"sort", "{l}list", "by", "{l}w_*"}).GetVec(), ElementsAre("b", "a"));
+  EXPECT_THAT(Run({"sort", "{l}list", "by", "nosort", "get", "{l}w_*"}).GetVec(),
+              ElementsAre("2", "1"));
+
+  // Patterns that select keys in other slots are rejected.
+  EXPECT_THAT(Run({"sort", "{l}list", "by", "w_*"}), ErrArg("CROSSSLOT"));
+  EXPECT_THAT(Run({"sort", "{l}list", "get", "w_*"}), ErrArg("CROSSSLOT"));
+}
+
+TEST_F(ClusterFamilyTest, ClusterCrossSlotProxyAcl) {
+  absl::FlagSaver fs;
+  SetTestFlag("cluster_proxy_multikey", "true");
+  ConfigSingleNodeCluster(GetMyId());
+  TestInitAclFam();
+
+  EXPECT_EQ(Run({"MSET", "key", "value", "other", "value2"}), "OK");
+  EXPECT_EQ(Run({"ACL", "SETUSER", "kostas", "ON", ">pass", "+@all", "~key*"}), "OK");
+  EXPECT_EQ(Run({"AUTH", "kostas", "pass"}), "OK");
+
+  // The caller's key permissions apply to all the split sub commands.
+  EXPECT_THAT(Run({"MGET", "key", "other"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"DEL", "key", "other"}), ErrArg("NOPERM"));
+  EXPECT_THAT(Run({"MGET", "key", "key2"}),
+              RespArray(ElementsAre("value", ArgType(RespExpr::NIL))));
+}
+
 class ClusterFamilyEmulatedTest : public ClusterFamilyTest {
  public:
   ClusterFamilyEmulatedTest() {
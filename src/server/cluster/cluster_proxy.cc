@@ -0,0 +1,370 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/cluster/cluster_proxy.h"
+
+#include <absl/cleanup/cleanup.h>
+#include <absl/container/flat_hash_map.h>
+#include <absl/flags/flag.h>
+#include <absl/strings/str_cat.h>
+
+#include "base/logging.h"
+#include "facade/reply_capture.h"
+#include "facade/service_interface.h"
+#include "server/acl/validator.h"
+#include "server/cluster/cluster_defs.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/protocol_client.h"
+
+ABSL_FLAG(bool, cluster_proxy_multikey, false,
+          "If true, MGET, MSET and DEL over keys of several slots or of slots owned by other "
+          "nodes are split by slots and forwarded to the owning nodes instead of failing with "
+          "CROSSSLOT or MOVED. Meant for clients that are not cluster aware.");
+
+using namespace std;
+using namespace facade;
+
+namespace dfly::cluster {
+
+namespace {
+
+constexpr auto kConnectTimeout = 2000ms;
+constexpr uint32_t kReadTimeoutMs = 5000;
+constexpr size_t kMaxIdleClientsPerNode = 8;
+
+class ProxyClient : public ProtocolClient {
+ public:
+  ProxyClient(string host, uint16_t port) : ProtocolClient(std::move(host), port) {
+  }
+
+  error_code Connect() {
+    if (auto ec = ResolveHostDns(); ec)
+      return ec;
+    return ConnectAndAuth(kConnectTimeout, &cntx_);
+  }
+
+  // Sends already serialized commands.
+  error_code Send(string_view data) {
+    TouchIoTime();
+    return Sock()->Write(io::Buffer(data));
+  }
+
+  // Reads count pipelined replies and calls cb with each of them. Fails if a node does not
+  // reply within kReadTimeoutMs. num_read is set to the number of replies passed to cb.
+  error_code Read(size_t count, absl::FunctionRef<void(const RespExpr&)> cb, size_t* num_read) {
+    auto prev_timeout = Sock()->timeout();
+    Sock()->set_timeout(kReadTimeoutMs);
+    absl::Cleanup restore = [&] { Sock()->set_timeout(prev_timeout); };
+
+    for (*num_read = 0; *num_read < count; ++*num_read) {
+      auto res = ReadRespReply(&buf_, false);
+      if (!res)
+        return res.error();
+      if (LastResponseArgs().empty())
+        return make_error_code(errc::bad_message);
+
+      cb(LastResponseArgs().front());
+      buf_.ConsumeInput(res->left_in_buffer);
+    }
+    return {};
+  }
+
+  // Whether the connection was taken from the pool. The node might have closed it meanwhile.
+  bool pooled = false;
+
+ private:
+  base::IoBuf buf_{1024};
+};
+
+using ClientPtr = unique_ptr<ProxyClient>;
+
+// Idle connections by "ip:port". Never destroyed, closing sockets requires a running proactor.
+thread_local absl::flat_hash_map<string, vector<ClientPtr>>* idle_clients = nullptr;
+
+io::Result<ClientPtr> AcquireClient(const string& addr, const ClusterNodeInfo& node) {
+  if (idle_clients == nullptr)
+    idle_clients = new absl::flat_hash_map<string, vector<ClientPtr>>();
+
+  if (auto it = idle_clients->find(addr); it != idle_clients->end() && !it->second.empty()) {
+    ClientPtr client = std::move(it->second.back());
+    it->second.pop_back();
+    client->pooled = true;
+    return client;
+  }
+
+  auto client = make_unique<ProxyClient>(node.ip, node.port);
+  if (auto ec = client->Connect(); ec)
+    return nonstd::make_unexpected(ec);
+  return client;
+}
+
+// The idle connections of a node are dropped once one of them turns out to be closed, it is
+// likely that the node closed all of them, e.g. because it restarted.
+void DropIdleClients(const string& addr) {
+  if (idle_clients)
+    idle_clients->erase(addr);
+}
+
+// Whether the error of a pooled connection means that the node closed it while idle, rather
+// than that it is slow to reply.
+bool IsStaleConnection(error_code ec) {
+  return ec != errc::timed_out && ec != errc::operation_canceled;
+}
+
+// Connects to the node of addr and sends the pipeline. A pooled connection that fails to send
+// was closed by the node while idle, so the pipeline is sent again over a new connection.
+io::Result<ClientPtr> SendPipeline(const string& addr, const ClusterNodeInfo& node,
+                                   string_view pipeline) {
+  auto client = AcquireClient(addr, node);
+  if (!client)
+    return client;
+
+  error_code ec = (*client)->Send(pipeline);
+  if (ec && (*client)->pooled) {
+    DropIdleClients(addr);
+    client = make_unique<ProxyClient>(node.ip, node.port);
+    ec = (*client)->Connect();
+    if (!ec)
+      ec = (*client)->Send(pipeline);
+  }
+  if (ec)
+    return nonstd::make_unexpected(ec);
+  return client;
+}
+
+void ReleaseClient(const string& addr, ClientPtr client) {
+  client->pooled = false;
+  auto& idle = (*idle_clients)[addr];
+  if (idle.size() < kMaxIdleClientsPerNode)
+    idle.push_back(std::move(client));
+}
+
+void AppendCommand(string_view cmd, CmdArgList args, unsigned step,
+                   const vector<unsigned>& key_pos, string* dest) {
+  absl::StrAppend(dest, "*", 1 + key_pos.size() * step, "\r\n$", cmd.size(), "\r\n", cmd, "\r\n");
+  for (unsigned pos : key_pos) {
+    for (unsigned i = pos; i < pos + step; ++i) {
+      string_view arg = ArgS(args, i);
+      absl::StrAppend(dest, "$", arg.size(), "\r\n", arg, "\r\n");
+    }
+  }
+}
+
+// Merges the replies of the per slot sub commands into the reply of the original command.
+class ReplyMerger {
+ public:
+  ReplyMerger(string_view cmd, size_t num_args) : cmd_(cmd) {
+    if (cmd_ == "MGET")
+      values_.resize(num_args);
+  }
+
+  void AddRemote(const vector<unsigned>& key_pos, const RespExpr& reply) {
+    if (reply.type == RespExpr::ERROR)
+      return SetError(reply.GetView());
+
+    if (cmd_ == "DEL") {
+      if (auto res = reply.GetInt(); res)
+        deleted_ += *res;
+      else
+        SetError("unexpected reply from cluster node");
+    } else if (cmd_ == "MGET") {
+      if (reply.type != RespExpr::ARRAY || reply.GetVec().size() != key_pos.size())
+        return SetError("unexpected reply from cluster node");
+      for (size_t i = 0; i < key_pos.size(); ++i) {
+        const RespExpr& value = reply.GetVec()[i];
+        if (value.type == RespExpr::STRING)
+          values_[key_pos[i]] = value.GetString();
+      }
+    }
+  }
+
+  void AddLocal(const vector<unsigned>& key_pos, CapturingReplyBuilder::Payload&& reply) {
+    if (auto err = CapturingReplyBuilder::GetError(reply); err)
+      return SetError(err->first);
+    if (auto* status = get_if<OpStatus>(&reply); status && *status != OpStatus::OK)
+      return SetError(StatusToMsg(*status));
+
+    if (auto* deleted = get_if<long>(&reply); deleted) {
+      deleted_ += *deleted;
+    } else if (auto* resp = get_if<SinkReplyBuilder::MGetResponse>(&reply); resp) {
+      DCHECK_EQ(resp->resp_arr.size(), key_pos.size());
+      for (size_t i = 0; i < min(key_pos.size(), resp->resp_arr.size()); ++i) {
+        if (resp->resp_arr[i])
+          values_[key_pos[i]] = string(resp->resp_arr[i]->value);
+      }
+    }
+  }
+
+  void SetError(string_view msg) {
+    if (!error_)  // Report the first error.
+      error_ = msg.empty() || msg[0] == '-' ? string(msg) : absl::StrCat("-", msg);
+  }
+
+  void Reply(ConnectionContext* cntx) {
+    auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+    if (error_)
+      return rb->SendError(*error_);
+
+    if (cmd_ == "DEL")
+      return rb->SendLong(deleted_);
+    if (cmd_ == "MSET")
+      return rb->SendOk();
+
+    rb->StartArray(values_.size());
+    for (const auto& value : values_) {
+      if (value)
+        rb->SendBulkString(*value);
+      else
+        rb->SendNull();
+    }
+  }
+
+ private:
+  string_view cmd_;
+  vector<optional<string>> values_;  // MGET values by argument position.
+  long deleted_ = 0;
+  optional<string> error_;
+};
+
+}  // namespace
+
+bool MultiKeyProxy::IsSupported(const CommandId* cid, const ConnectionContext& cntx) {
+  if (!absl::GetFlag(FLAGS_cluster_proxy_multikey) || cntx.is_replicating)
+    return false;
+
+  // Transactions and scripts must stay on this node.
+  if (cntx.conn_state.exec_info.IsCollecting() || cntx.conn_state.exec_info.IsRunning() ||
+      cntx.conn_state.script_info)
+    return false;
+
+  string_view name = cid->name();
+  return name == "MGET" || name == "MSET" || name == "DEL";
+}
+
+bool MultiKeyProxy::Dispatch(const ClusterConfig& config, const CommandId* cid, CmdArgList args,
+                             ConnectionContext* cntx, ServiceInterface* service) {
+  string_view cmd = cid->name();
+  unsigned step = cmd == "MSET" ? 2 : 1;
+
+  // Keys grouped by slot in the order of their first appearance.
+  struct SlotBatch {
+    SlotId slot;
+    vector<unsigned> key_pos;  // positions of the keys in args.
+  };
+
+  vector<SlotBatch> batches;
+  absl::flat_hash_map<SlotId, unsigned> batch_by_slot;
+  for (unsigned i = 0; i + step <= args.size(); i += step) {
+    SlotId slot = KeySlot(ArgS(args, i));
+    auto [it, inserted] = batch_by_slot.emplace(slot, batches.size());
+    if (inserted)
+      batches.push_back({slot, {}});
+    batches[it->second].key_pos.push_back(i);
+  }
+
+  if (batches.size() <= 1 && (batches.empty() || config.IsMySlot(batches[0].slot)))
+    return false;
+
+  // The other nodes run the sub commands with the credentials of this node (masteruser and
+  // masterauth), so they can't apply the ACL of the caller. It is applied here to all the keys,
+  // before any of them is sent.
+  const ConnectionContext* owner =
+      cntx->conn_state.squashing_info ? cntx->conn_state.squashing_info->owner : cntx;
+  if (!acl::IsUserAllowedToInvokeCommand(*owner, *cid, args)) {
+    auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+    rb->SendError(absl::StrCat("-NOPERM ", owner->authed_username, " has no ACL permissions"));
+    return true;
+  }
+
+  // Sub commands of other nodes are pipelined over one connection per node. The config is not
+  // used after this point because it can change once we yield.
+  struct NodeRequest {
+    ClusterNodeInfo node;
+    vector<unsigned> batches;
+    string pipeline;
+    ClientPtr client;
+  };
+
+  absl::flat_hash_map<string, NodeRequest> requests;
+  vector<unsigned> local_batches;
+  for (unsigned i = 0; i < batches.size(); ++i) {
+    if (config.IsMySlot(batches[i].slot)) {
+      local_batches.push_back(i);
+      continue;
+    }
+
+    ClusterNodeInfo node = config.GetMasterNodeForSlot(batches[i].slot);
+    NodeRequest& req = requests[absl::StrCat(node.ip, ":", node.port)];
+    req.node = std::move(node);
+    req.batches.push_back(i);
+    AppendCommand(cmd, args, step, batches[i].key_pos, &req.pipeline);
+  }
+
+  ReplyMerger merger{cmd, args.size()};
+
+  // Send everything first, so that the other nodes work while we run the local sub commands.
+  for (auto& [addr, req] : requests) {
+    auto client = SendPipeline(addr, req.node, req.pipeline);
+    if (!client) {
+      merger.SetError(absl::StrCat("could not send to ", addr, ": ", client.error().message()));
+      continue;
+    }
+    req.client = std::move(*client);
+  }
+
+  for (unsigned i : local_batches) {
+    vector<string> storage{string(cmd)};
+    for (unsigned pos : batches[i].key_pos) {
+      for (unsigned j = pos; j < pos + step; ++j)
+        storage.emplace_back(ArgS(args, j));
+    }
+    CmdArgVec sub_args;
+    for (string& arg : storage)
+      sub_args.emplace_back(arg.data(), arg.size());
+
+    // A single owned slot is dispatched as usual.
+    CapturingReplyBuilder crb;
+    SinkReplyBuilder* orig = cntx->Inject(&crb);
+    service->DispatchCommand(absl::MakeSpan(sub_args), cntx);
+    cntx->Inject(orig);
+    merger.AddLocal(batches[i].key_pos, crb.Take());
+  }
+
+  for (auto& [addr, req] : requests) {
+    if (!req.client)
+      continue;
+
+    size_t num_read = 0;
+    auto add_reply = [&](const RespExpr& reply) {
+      merger.AddRemote(batches[req.batches[num_read]].key_pos, reply);
+    };
+    error_code ec = req.client->Read(req.batches.size(), add_reply, &num_read);
+
+    // A pooled connection that fails before the first reply was closed by the node while idle,
+    // so none of the sub commands ran. They are sent again over a new connection.
+    if (ec && num_read == 0 && req.client->pooled && IsStaleConnection(ec)) {
+      DropIdleClients(addr);
+      auto client = SendPipeline(addr, req.node, req.pipeline);
+      if (!client) {
+        merger.SetError(absl::StrCat("could not send to ", addr, ": ", client.error().message()));
+        continue;
+      }
+      req.client = std::move(*client);
+      ec = req.client->Read(req.batches.size(), add_reply, &num_read);
+    }
+
+    // A connection with unread replies can not be reused.
+    if (ec) {
+      merger.SetError(absl::StrCat("could not read from ", addr, ": ", ec.message()));
+      continue;
+    }
+    ReleaseClient(addr, std::move(req.client));
+  }
+
+  merger.Reply(cntx);
+  return true;
+}
+
+}  // namespace dfly::cluster
@@ -0,0 +1,38 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "facade/facade_types.h"
+#include "server/cluster/cluster_config.h"
+
+namespace facade {
+class ServiceInterface;
+}  // namespace facade
+
+namespace dfly {
+class CommandId;
+class ConnectionContext;
+}  // namespace dfly
+
+namespace dfly::cluster {
+
+// Serves MGET, MSET and DEL over keys of several slots or of slots owned by other nodes for
+// clients that are not cluster aware, instead of replying with CROSSSLOT or MOVED.
+// The command is split into a sub command per slot. Sub commands of slots owned by other nodes
+// are pipelined over pooled thread local connections to their masters while the local ones run
+// on this node, and the replies are merged. Like with a proxy, the sub commands of different
+// slots are not atomic with respect to each other.
+class MultiKeyProxy {
+ public:
+  // Whether the command can be split by slots when issued by this connection.
+  static bool IsSupported(const CommandId* cid, const ConnectionContext& cntx);
+
+  // Returns false if all the keys belong to a single slot owned by this node and the command
+  // should run as usual, otherwise runs the sub commands and replies to the client.
+  static bool Dispatch(const ClusterConfig& config, const CommandId* cid, facade::CmdArgList args,
+                       ConnectionContext* cntx, facade::ServiceInterface* service);
+};
+
+}  // namespace dfly::cluster
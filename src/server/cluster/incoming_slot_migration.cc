@@ -6,6 +6,7 @@
 
 #include "absl/cleanup/cleanup.h"
 #include "absl/strings/str_cat.h"
+#include "base/flags.h"
 #include "base/logging.h"
 #include "cluster_utility.h"
 #include "server/error.h"
@@ -13,6 +14,10 @@
 #include "server/journal/tx_executor.h"
 #include "server/main_service.h"
 
+ABSL_FLAG(uint32_t, slot_migration_apply_batch, 64,
+          "Maximal number of received entries a migration flow applies in one squashed hop. "
+          "1 applies them one by one.");
+
 ABSL_DECLARE_FLAG(int, slot_migration_connection_timeout_ms);
 
 namespace dfly::cluster {
@@ -45,6 +50,13 @@ class ClusterShardMigration {
     JournalReader reader{source, 0};
     TransactionReader tx_reader;
 
+    // The flows of the source shards run in parallel. Each one applies the RESTORE commands of
+    // the snapshot together while more of the stream is already buffered, like replica flows do.
+    // The batch is flushed before any other entry, so a FIN is handled after all the data.
+    const size_t max_batch = absl::GetFlag(FLAGS_slot_migration_apply_batch);
+    vector<journal::ParsedEntry::CmdData> batch;
+    DbIndex batch_dbid = 0;
+
     while (!cntx->IsCancelled()) {
       auto tx_data = tx_reader.NextTxData(&reader, cntx);
       if (!tx_data) {
@@ -53,6 +65,19 @@ class ClusterShardMigration {
         break;
       }
 
+      bool batchable = max_batch > 1 && tx_data->opcode == journal::Op::COMMAND &&
+                       !tx_data->IsGlobalCmd() && tx_data->shard_cnt <= 1;
+      if (!batch.empty() && (!batchable || tx_data->dbid != batch_dbid))
+        ExecuteBatch(batch_dbid, &batch, cntx);
+
+      if (batchable) {
+        batch_dbid = tx_data->dbid;
+        batch.push_back(std::move(tx_data->command));
+        if (batch.size() >= max_batch || !reader.HasBufferedInput())
+          ExecuteBatch(batch_dbid, &batch, cntx);
+        continue;
+      }
+
       while (tx_data->opcode == journal::Op::FIN) {
         VLOG(2) << "Attempt to finalize flow " << source_shard_id_;
         bc->Dec();  // we can Join the flow now
@@ -70,6 +95,7 @@ class ClusterShardMigration {
       }
     }
 
+    ExecuteBatch(batch_dbid, &batch, cntx);
     bc->Dec();  // we should provide ability to join the flow
   }
 
@@ -87,6 +113,17 @@ class ClusterShardMigration {
   }
 
  private:
+  void ExecuteBatch(DbIndex dbid, vector<journal::ParsedEntry::CmdData>* batch, Context* cntx) {
+    if (batch->empty())
+      return;
+
+    if (!cntx->IsCancelled()) {
+      executor_.Execute(dbid, absl::MakeSpan(*batch));
+      in_migration_->ReportApplied(batch->size());
+    }
+    batch->clear();
+  }
+
   void ExecuteTxWithNoShardSync(TransactionData&& tx_data, Context* cntx) {
     if (cntx->IsCancelled()) {
       return;
@@ -95,6 +132,7 @@ class ClusterShardMigration {
     if (!tx_data.IsGlobalCmd()) {
       VLOG(3) << "Execute cmd without sync between shards. txid: " << tx_data.txid;
       executor_.Execute(tx_data.dbid, tx_data.command);
+      in_migration_->ReportApplied(1);
     } else {
       // TODO check which global commands should be supported
       std::string error =
@@ -120,6 +158,7 @@ IncomingSlotMigration::IncomingSlotMigration(string source_id, Service* se, Slot
       service_(*se),
       slots_(std::move(slots)),
       state_(MigrationState::C_CONNECTING),
+      start_(chrono::steady_clock::now()),
       bc_(shards_num) {
   shard_flows_.resize(shards_num);
   for (unsigned i = 0; i < shards_num; ++i) {
@@ -163,6 +202,15 @@ void IncomingSlotMigration::StartFlow(uint32_t shard, util::FiberSocketBase* sou
   VLOG(1) << "Incoming slot migration flow for shard: " << shard << " finished";
 }
 
+IncomingSlotMigration::Progress IncomingSlotMigration::GetProgress() const {
+  Progress res;
+  res.applied = applied_.load(memory_order_relaxed);
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start_).count();
+  if (elapsed > 0)
+    res.throughput = res.applied / elapsed;
+  return res;
+}
+
 size_t IncomingSlotMigration::GetKeyCount() const {
   if (state_.load() == MigrationState::C_FINISHED) {
     return keys_number_;
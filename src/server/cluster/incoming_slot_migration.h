@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <chrono>
+
 #include "helio/io/io.h"
 #include "helio/util/fiber_socket_base.h"
 #include "server/cluster/cluster_defs.h"
@@ -59,6 +61,18 @@ class IncomingSlotMigration {
 
   size_t GetKeyCount() const;
 
+  struct Progress {
+    size_t applied = 0;     // journal entries applied by all the flows
+    size_t throughput = 0;  // entries per second
+  };
+
+  // Can be called from any thread
+  Progress GetProgress() const;
+
+  void ReportApplied(size_t entries) {
+    applied_.fetch_add(entries, std::memory_order_relaxed);
+  }
+
  private:
   std::string source_id_;
   Service& service_;
@@ -73,6 +87,9 @@ class IncomingSlotMigration {
   // because new request can add or remove keys and we get incorrect statistic
   size_t keys_number_ = 0;
 
+  std::atomic_size_t applied_ = 0;
+  std::chrono::steady_clock::time_point start_;
+
   util::fb2::BlockingCounter bc_;
 };
 
@@ -19,6 +19,9 @@
 #include "server/server_family.h"
 
 ABSL_FLAG(int, slot_migration_connection_timeout_ms, 2000, "Timeout for network operations");
+ABSL_FLAG(uint64_t, slot_migration_throughput_limit, 0,
+          "Maximum bytes per second of snapshot data sent by one outgoing slot migration, "
+          "split evenly between its shard flows. 0 means no limit.");
 
 using namespace std;
 using namespace facade;
@@ -31,6 +34,8 @@ class OutgoingMigration::SliceSlotMigration : private ProtocolClient {
   SliceSlotMigration(DbSlice* slice, ServerContext server_context, SlotSet slots,
                      journal::Journal* journal)
       : ProtocolClient(server_context), streamer_(slice, std::move(slots), journal, &cntx_) {
+    if (uint64_t limit = absl::GetFlag(FLAGS_slot_migration_throughput_limit); limit > 0)
+      streamer_.set_rate_limit(std::max<uint64_t>(limit / shard_set->size(), 1));
   }
 
   void Sync(const std::string& node_id, uint32_t shard_id) {
@@ -73,6 +78,10 @@ class OutgoingMigration::SliceSlotMigration : private ProtocolClient {
     return cntx_.GetError();
   }
 
+  RestoreStreamer::Progress GetProgress() const {
+    return streamer_.GetProgress();
+  }
+
  private:
   RestoreStreamer streamer_;
 };
@@ -89,6 +98,7 @@ OutgoingMigration::~OutgoingMigration() {
   main_sync_fb_.JoinIfNeeded();
 
   // Destroy each flow in its dedicated thread, because we could be the last owner of the db tables
+  lock_guard lk(flows_mu_);
   shard_set->pool()->AwaitFiberOnAll([this](util::ProactorBase* pb) {
     if (const auto* shard = EngineShard::tlocal(); shard) {
       slot_migrations_[shard->shard_id()].reset();
@@ -193,13 +203,17 @@ void OutgoingMigration::SyncFb() {
       continue;
     }
 
-    shard_set->pool()->AwaitFiberOnAll([this](util::ProactorBase* pb) {
-      if (auto* shard = EngineShard::tlocal(); shard) {
-        server_family_->journal()->StartInThread();
-        slot_migrations_[shard->shard_id()] = std::make_unique<SliceSlotMigration>(
-            &shard->db_slice(), server(), migration_info_.slot_ranges, server_family_->journal());
-      }
-    });
+    {
+      lock_guard lk(flows_mu_);
+      sync_start_ = chrono::steady_clock::now();
+      shard_set->pool()->AwaitFiberOnAll([this](util::ProactorBase* pb) {
+        if (auto* shard = EngineShard::tlocal(); shard) {
+          server_family_->journal()->StartInThread();
+          slot_migrations_[shard->shard_id()] = std::make_unique<SliceSlotMigration>(
+              &shard->db_slice(), server(), migration_info_.slot_ranges, server_family_->journal());
+        }
+      });
+    }
 
     if (!ChangeState(MigrationState::C_SYNC)) {
       break;
@@ -336,6 +350,32 @@ bool OutgoingMigration::CheckFlowsForErrors() {
   return false;
 }
 
+OutgoingMigration::Progress OutgoingMigration::GetProgress() const {
+  Progress res;
+  lock_guard lk(flows_mu_);
+
+  size_t visited = 0, total = 0;
+  for (const auto& flow : slot_migrations_) {
+    if (!flow)
+      return res;
+    RestoreStreamer::Progress progress = flow->GetProgress();
+    res.bytes += progress.bytes;
+    visited += progress.buckets_visited;
+    total += progress.buckets_total;
+  }
+
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - sync_start_).count();
+  if (elapsed > 0)
+    res.throughput = res.bytes / elapsed;
+
+  // Buckets are traversed at a steady pace, so the ETA is extrapolated from the visited ones.
+  if (GetState() == MigrationState::C_FINISHED || (total > 0 && visited >= total))
+    res.eta_sec = 0;
+  else if (visited > 0)
+    res.eta_sec = elapsed * (total - visited) / visited;
+  return res;
+}
+
 size_t OutgoingMigration::GetKeyCount() const {
   if (state_ == MigrationState::C_FINISHED) {
     return keys_number_;
@@ -3,6 +3,8 @@
 //
 #pragma once
 
+#include <chrono>
+
 #include "io/io.h"
 #include "server/cluster/cluster_defs.h"
 #include "server/protocol_client.h"
@@ -55,6 +57,15 @@ class OutgoingMigration : private ProtocolClient {
 
   size_t GetKeyCount() const;
 
+  struct Progress {
+    size_t bytes = 0;       // of snapshot data sent by the current attempt
+    size_t throughput = 0;  // bytes per second
+    long eta_sec = -1;      // time until the snapshot is sent, -1 if unknown
+  };
+
+  // Progress of the snapshot transfer, can be called from any thread
+  Progress GetProgress() const;
+
   static constexpr long kInvalidAttempt = -1;
   static constexpr std::string_view kUnknownMigration = "UNKNOWN_MIGRATION";
 
@@ -87,6 +98,10 @@ class OutgoingMigration : private ProtocolClient {
   mutable util::fb2::Mutex state_mu_;
   MigrationState state_ ABSL_GUARDED_BY(state_mu_) = MigrationState::C_NO_STATE;
 
+  // Guards replacing the flows, so that their progress can be read from other threads
+  mutable util::fb2::Mutex flows_mu_;
+  std::chrono::steady_clock::time_point sync_start_;
+
   // when migration is finished we need to store number of migrated keys
   // because new request can add or remove keys and we get incorrect statistic
   size_t keys_number_ = 0;
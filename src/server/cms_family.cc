@@ -0,0 +1,308 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/cms_family.h"
+
+#include "core/count_min_sketch.h"
+#include "facade/cmd_arg_parser.h"
+#include "facade/error.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/engine_shard_set.h"
+#include "server/transaction.h"
+
+namespace dfly {
+
+using namespace facade;
+using namespace std;
+
+namespace {
+
+using ItemIncrs = vector<pair<string_view, uint32_t>>;
+using Counts = absl::InlinedVector<uint32_t, 4>;
+
+// A copy of a source sketch of CMS.MERGE, pos is its position among the sources.
+struct MergeSource {
+  size_t pos;
+  unique_ptr<CountMinSketch> cms;
+};
+
+void SendStatus(OpStatus status, ConnectionContext* cntx) {
+  switch (status) {
+    case OpStatus::KEY_EXISTS:
+      return cntx->SendError("CMS: key already exists");
+    case OpStatus::KEY_NOTFOUND:
+      return cntx->SendError("CMS: key does not exist");
+    case OpStatus::INVALID_VALUE:
+      return cntx->SendError("CMS: width/depth is not equal");
+    default:
+      return cntx->SendError(status);
+  }
+}
+
+void SendCounts(const Counts& counts, ConnectionContext* cntx) {
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(counts.size());
+  for (uint32_t count : counts)
+    rb->SendLong(count);
+}
+
+OpStatus OpInit(const OpArgs& op_args, string_view key, uint32_t width, uint32_t depth) {
+  auto& db_slice = op_args.shard->db_slice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+  if (!op_res->is_new)
+    return OpStatus::KEY_EXISTS;
+
+  op_res->it->second.SetCMS(
+      CompactObj::AllocateMR<CountMinSketch>(width, depth, CompactObj::memory_resource()));
+  return OpStatus::OK;
+}
+
+OpResult<Counts> OpIncrBy(const OpArgs& op_args, string_view key, const ItemIncrs& incrs) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto op_res = db_slice.FindMutable(op_args.db_cntx, key, OBJ_CMS);
+  if (!op_res)
+    return op_res.status();
+
+  CountMinSketch* cms = op_res->it->second.GetCMS();
+  Counts result(incrs.size());
+  for (size_t i = 0; i < incrs.size(); ++i)
+    result[i] = cms->IncrBy(incrs[i].first, incrs[i].second);
+  return result;
+}
+
+OpResult<Counts> OpQuery(const OpArgs& op_args, string_view key, CmdArgList items) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto op_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_CMS);
+  if (!op_res)
+    return op_res.status();
+
+  const CountMinSketch* cms = (*op_res)->second.GetCMS();
+  Counts result(items.size());
+  for (size_t i = 0; i < items.size(); ++i)
+    result[i] = cms->Query(ToSV(items[i]));
+  return result;
+}
+
+// Copies the source sketches hosted by the shard. The first argument is the destination
+// and the sources start after {destkey, numkeys}.
+OpResult<vector<MergeSource>> OpCopySources(Transaction* t, EngineShard* shard) {
+  auto& db_slice = shard->db_slice();
+  vector<MergeSource> result;
+  ShardArgs keys = t->GetShardArgs(shard->shard_id());
+  for (auto it = keys.begin(); it != keys.end(); ++it) {
+    if (it.index() == 0)
+      continue;
+
+    auto op_res = db_slice.FindReadOnly(t->GetDbContext(), *it, OBJ_CMS);
+    if (!op_res)
+      return op_res.status();
+
+    const CountMinSketch* cms = (*op_res)->second.GetCMS();
+    result.push_back(
+        {it.index() - 2, make_unique<CountMinSketch>(cms->width(), cms->depth(), cms->count(),
+                                                     cms->data(), PMR_NS::get_default_resource())});
+  }
+  return result;
+}
+
+OpStatus OpStoreMerge(const OpArgs& op_args, string_view key, const vector<MergeSource>& sources,
+                      const vector<uint32_t>& weights) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto op_res = db_slice.FindMutable(op_args.db_cntx, key, OBJ_CMS);
+  if (!op_res)
+    return op_res.status();
+
+  CountMinSketch* dest = op_res->it->second.GetCMS();
+  for (const MergeSource& src : sources) {
+    if (src.cms->width() != dest->width() || src.cms->depth() != dest->depth())
+      return OpStatus::INVALID_VALUE;
+  }
+
+  dest->Reset();
+  for (const MergeSource& src : sources)
+    dest->Merge(*src.cms, weights[src.pos]);
+  return OpStatus::OK;
+}
+
+void Init(string_view key, uint32_t width, uint32_t depth, ConnectionContext* cntx) {
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpInit(t->GetOpArgs(shard), key, width, depth);
+  };
+
+  OpStatus res = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (res == OpStatus::OK)
+    return cntx->SendOk();
+  SendStatus(res, cntx);
+}
+
+}  // namespace
+
+void CmsFamily::InitByDim(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  auto [width, depth] = parser.Next<uint32_t, uint32_t>();
+
+  if (parser.Error())
+    return cntx->SendError("CMS: invalid width/depth");
+  if (width == 0)
+    return cntx->SendError("CMS: invalid width");
+  if (depth == 0 || depth > CountMinSketch::kMaxDepth)
+    return cntx->SendError("CMS: invalid depth");
+
+  Init(key, width, depth, cntx);
+}
+
+void CmsFamily::InitByProb(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  auto [error, prob] = parser.Next<double, double>();
+
+  if (parser.Error())
+    return cntx->SendError("CMS: invalid overestimation value");
+  if (error <= 0 || error >= 1)
+    return cntx->SendError("CMS: invalid overestimation value");
+  if (prob <= 0 || prob >= 1)
+    return cntx->SendError("CMS: invalid prob value");
+
+  uint32_t width, depth;
+  CountMinSketch::DimsFromProb(error, prob, &width, &depth);
+  if (depth > CountMinSketch::kMaxDepth)
+    return cntx->SendError("CMS: invalid prob value");
+
+  Init(key, width, depth, cntx);
+}
+
+void CmsFamily::IncrBy(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  args.remove_prefix(1);
+  if (args.size() % 2 != 0)
+    return cntx->SendError(WrongNumArgsError("cms.incrby"));
+
+  ItemIncrs incrs(args.size() / 2);
+  for (size_t i = 0; i < incrs.size(); ++i) {
+    incrs[i].first = ArgS(args, 2 * i);
+    if (!absl::SimpleAtoi(ArgS(args, 2 * i + 1), &incrs[i].second))
+      return cntx->SendError("CMS: Cannot parse number");
+  }
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpIncrBy(t->GetOpArgs(shard), key, incrs);
+  };
+
+  OpResult<Counts> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  SendCounts(*res, cntx);
+}
+
+void CmsFamily::Query(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  args.remove_prefix(1);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpQuery(t->GetOpArgs(shard), key, args);
+  };
+
+  OpResult<Counts> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  SendCounts(*res, cntx);
+}
+
+// CMS.MERGE destination numKeys source [source ...] [WEIGHTS weight [weight ...]]
+void CmsFamily::Merge(CmdArgList args, ConnectionContext* cntx) {
+  string_view dest_key = ArgS(args, 0);
+  uint32_t num_keys = 0;
+  if (!absl::SimpleAtoi(ArgS(args, 1), &num_keys) || num_keys == 0)
+    return cntx->SendError("CMS: invalid numkeys");
+
+  // DetermineKeys verified that numKeys sources follow.
+  CmdArgParser parser(args.subspan(2 + num_keys));
+  vector<uint32_t> weights(num_keys, 1);
+  if (parser.Check("WEIGHTS").IgnoreCase().ExpectTail(num_keys)) {
+    for (uint32_t& weight : weights)
+      weight = parser.Next<uint32_t>();
+  }
+  bool trailing = parser.HasNext();
+  if (parser.Error() || trailing)
+    return cntx->SendError(kSyntaxErr);
+
+  Transaction* trans = cntx->transaction;
+  vector<OpResult<vector<MergeSource>>> copies(shard_set->size());
+  auto copy_cb = [&](Transaction* t, EngineShard* shard) {
+    copies[shard->shard_id()] = OpCopySources(t, shard);
+    return OpStatus::OK;
+  };
+  trans->Execute(std::move(copy_cb), false);
+
+  vector<MergeSource> sources;
+  for (auto& copy : copies) {
+    if (!copy) {
+      trans->Conclude();
+      return SendStatus(copy.status(), cntx);
+    }
+    move(copy->begin(), copy->end(), back_inserter(sources));
+  }
+
+  ShardId dest_shard = Shard(dest_key, shard_set->size());
+  OpStatus status = OpStatus::OK;
+  auto store_cb = [&](Transaction* t, EngineShard* shard) {
+    if (shard->shard_id() == dest_shard)
+      status = OpStoreMerge(t->GetOpArgs(shard), dest_key, sources, weights);
+    return OpStatus::OK;
+  };
+  trans->Execute(std::move(store_cb), true);
+
+  if (status != OpStatus::OK)
+    return SendStatus(status, cntx);
+  cntx->SendOk();
+}
+
+void CmsFamily::Info(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<array<uint64_t, 3>> {
+    auto op_res = shard->db_slice().FindReadOnly(t->GetDbContext(), key, OBJ_CMS);
+    if (!op_res)
+      return op_res.status();
+    const CountMinSketch* cms = (*op_res)->second.GetCMS();
+    return array<uint64_t, 3>{cms->width(), cms->depth(), cms->count()};
+  };
+
+  auto res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  const string_view kNames[] = {"width", "depth", "count"};
+  rb->StartArray(6);
+  for (size_t i = 0; i < 3; ++i) {
+    rb->SendBulkString(kNames[i]);
+    rb->SendLong((*res)[i]);
+  }
+}
+
+using CI = CommandId;
+
+#define HFUNC(x) SetHandler(&CmsFamily::x)
+
+void CmsFamily::Register(CommandRegistry* registry) {
+  registry->StartFamily();
+
+  *registry
+      << CI{"CMS.INITBYDIM", CO::WRITE | CO::DENYOOM | CO::FAST, 4, 1, 1, acl::BLOOM}.HFUNC(
+             InitByDim)
+      << CI{"CMS.INITBYPROB", CO::WRITE | CO::DENYOOM | CO::FAST, 4, 1, 1, acl::BLOOM}.HFUNC(
+             InitByProb)
+      << CI{"CMS.INCRBY", CO::WRITE | CO::DENYOOM | CO::FAST, -4, 1, 1, acl::BLOOM}.HFUNC(IncrBy)
+      << CI{"CMS.QUERY", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Query)
+      << CI{"CMS.MERGE", CO::WRITE | CO::VARIADIC_KEYS | CO::DENYOOM, -4, 3, 3, acl::BLOOM}.HFUNC(
+             Merge)
+      << CI{"CMS.INFO", CO::READONLY | CO::FAST, 2, 1, 1, acl::BLOOM}.HFUNC(Info);
+};
+
+}  // namespace dfly
@@ -0,0 +1,28 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "server/common.h"
+
+namespace dfly {
+
+class CommandRegistry;
+class ConnectionContext;
+
+// Count-Min sketch commands, compatible with the CMS commands of RedisBloom.
+class CmsFamily {
+ public:
+  static void Register(CommandRegistry* registry);
+
+ private:
+  static void InitByDim(CmdArgList args, ConnectionContext* cntx);
+  static void InitByProb(CmdArgList args, ConnectionContext* cntx);
+  static void IncrBy(CmdArgList args, ConnectionContext* cntx);
+  static void Query(CmdArgList args, ConnectionContext* cntx);
+  static void Merge(CmdArgList args, ConnectionContext* cntx);
+  static void Info(CmdArgList args, ConnectionContext* cntx);
+};
+
+}  // namespace dfly
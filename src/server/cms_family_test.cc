@@ -0,0 +1,80 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/cms_family.h"
+
+#include "facade/facade_test.h"
+#include "server/test_utils.h"
+
+namespace dfly {
+
+using testing::ElementsAre;
+
+class CmsFamilyTest : public BaseFamilyTest {
+ protected:
+};
+
+TEST_F(CmsFamilyTest, Basic) {
+  EXPECT_EQ(Run({"cms.initbydim", "c1", "1000", "5"}), "OK");
+  EXPECT_THAT(Run({"cms.initbydim", "c1", "1000", "5"}), ErrArg("key already exists"));
+  EXPECT_EQ(Run({"type", "c1"}), "CMSk-TYPE");
+
+  auto resp = Run({"cms.incrby", "c1", "a", "3", "b", "1"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(3), IntArg(1))));
+  resp = Run({"cms.incrby", "c1", "a", "2"});
+  EXPECT_THAT(resp, IntArg(5));
+  resp = Run({"cms.query", "c1", "a", "b", "c"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(5), IntArg(1), IntArg(0))));
+
+  resp = Run({"cms.info", "c1"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("width", IntArg(1000), "depth", IntArg(5), "count",
+                                          IntArg(6))));
+
+  EXPECT_EQ(Run({"cms.initbyprob", "c2", "0.001", "0.01"}), "OK");
+  resp = Run({"cms.info", "c2"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("width", IntArg(2000), "depth", IntArg(7), "count",
+                                          IntArg(0))));
+}
+
+TEST_F(CmsFamilyTest, Errors) {
+  EXPECT_THAT(Run({"cms.initbydim", "c1", "0", "5"}), ErrArg("invalid width"));
+  EXPECT_THAT(Run({"cms.initbyprob", "c1", "2", "0.01"}), ErrArg("invalid overestimation"));
+  EXPECT_THAT(Run({"cms.incrby", "c1", "a", "1"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"cms.query", "c1", "a"}), ErrArg("key does not exist"));
+
+  Run({"cms.initbydim", "c1", "100", "4"});
+  EXPECT_THAT(Run({"cms.incrby", "c1", "a", "x"}), ErrArg("Cannot parse number"));
+  EXPECT_THAT(Run({"cms.incrby", "c1", "a", "1", "b"}), ErrArg("wrong number of arguments"));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"cms.query", "str", "a"}), ErrArg("WRONGTYPE"));
+}
+
+TEST_F(CmsFamilyTest, Merge) {
+  Run({"cms.initbydim", "dest", "100", "4"});
+  Run({"cms.initbydim", "a", "100", "4"});
+  Run({"cms.initbydim", "b", "100", "4"});
+  Run({"cms.initbydim", "small", "10", "4"});
+  Run({"cms.incrby", "a", "x", "2"});
+  Run({"cms.incrby", "b", "x", "3", "y", "1"});
+
+  EXPECT_EQ(Run({"cms.merge", "dest", "2", "a", "b"}), "OK");
+  auto resp = Run({"cms.query", "dest", "x", "y"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(5), IntArg(1))));
+
+  // The destination is overwritten, even when it is one of the sources.
+  EXPECT_EQ(Run({"cms.merge", "dest", "2", "dest", "b", "WEIGHTS", "1", "2"}), "OK");
+  resp = Run({"cms.query", "dest", "x", "y"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(11), IntArg(3))));
+  resp = Run({"cms.info", "dest"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("width", IntArg(100), "depth", IntArg(4), "count",
+                                          IntArg(14))));
+
+  EXPECT_THAT(Run({"cms.merge", "dest", "2", "a", "small"}), ErrArg("width/depth"));
+  EXPECT_THAT(Run({"cms.merge", "dest", "1", "missing"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"cms.merge", "nodest", "1", "b"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"cms.merge", "dest", "1", "b", "WEIGHTS"}), ErrArg("syntax error"));
+}
+
+}  // namespace dfly
@@ -0,0 +1,63 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/command_trace.h"
+
+#include "base/logging.h"
+
+namespace dfly {
+
+using namespace std;
+
+const char* CommandTrace::StageName(Stage stage) {
+  switch (stage) {
+    case QUEUED:
+      return "queued";
+    case DISPATCHED:
+      return "dispatched";
+    case SCHEDULED:
+      return "scheduled";
+    case ARMED:
+      return "armed";
+    case EXEC_START:
+      return "exec_start";
+    case EXEC_END:
+      return "exec_end";
+    case REPLIED:
+      return "replied";
+    case NUM_STAGES:
+      break;
+  }
+  return "unknown";
+}
+
+void CommandTrace::RecordFirst(Stage stage, uint64_t ns) {
+  uint64_t cur = ts[stage].load(memory_order_relaxed);
+  while ((cur == 0 || ns < cur) &&
+         !ts[stage].compare_exchange_weak(cur, ns, memory_order_relaxed)) {
+  }
+}
+
+void CommandTrace::RecordLast(Stage stage, uint64_t ns) {
+  uint64_t cur = ts[stage].load(memory_order_relaxed);
+  while (ns > cur && !ts[stage].compare_exchange_weak(cur, ns, memory_order_relaxed)) {
+  }
+}
+
+void TraceLog::Add(string_view command, uint32_t client_id, uint64_t unix_ts_nsec,
+                   const CommandTrace& trace) {
+  DCHECK_GT(entries_.capacity(), 0u);
+
+  TraceEntry entry{string(command), client_id, unix_ts_nsec, {}};
+  for (unsigned i = 0; i < CommandTrace::NUM_STAGES; ++i)
+    entry.ts[i] = trace.ts[i].load(memory_order_relaxed);
+  entries_.push_back(std::move(entry));
+}
+
+void TraceLog::SetOptions(uint32_t sample_rate, size_t max_len) {
+  entries_.set_capacity(max_len);
+  sample_rate_ = max_len > 0 ? sample_rate : 0;
+}
+
+}  // namespace dfly
@@ -0,0 +1,77 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <boost/circular_buffer.hpp>
+#include <string>
+#include <string_view>
+
+namespace dfly {
+
+// Timestamps of the stages a sampled command passed through, as reported by
+// ProactorBase::GetMonotonicTimeNs(), 0 for the stages it skipped.
+// Stages reached by several shards are written concurrently from the shard threads.
+struct CommandTrace {
+  enum Stage : uint8_t {
+    QUEUED,      // entered the dispatch queue of a pipelining connection.
+    DISPATCHED,  // started to execute, right after parsing unless it was queued.
+    SCHEDULED,   // its transaction was scheduled on all of its shards.
+    ARMED,       // the first hop was armed on the shards.
+    EXEC_START,  // the first shard started to run a callback.
+    EXEC_END,    // the last shard finished to run a callback.
+    REPLIED,     // finished and passed its reply to the reply builder.
+    NUM_STAGES
+  };
+
+  static const char* StageName(Stage stage);
+
+  void Record(Stage stage, uint64_t ns) {
+    ts[stage].store(ns, std::memory_order_relaxed);
+  }
+
+  // Keeps the earliest or the latest time of the stage.
+  void RecordFirst(Stage stage, uint64_t ns);
+  void RecordLast(Stage stage, uint64_t ns);
+
+  std::array<std::atomic_uint64_t, NUM_STAGES> ts{};
+};
+
+struct TraceEntry {
+  std::string command;
+  uint32_t client_id;
+  uint64_t unix_ts_nsec;  // wall time of the DISPATCHED stage.
+  std::array<uint64_t, CommandTrace::NUM_STAGES> ts;
+};
+
+// Per thread ring buffer of the latest sampled commands.
+class TraceLog {
+ public:
+  // Returns true if the next command should be sampled.
+  bool ShouldSample() {
+    return sample_rate_ > 0 && ++counter_ % sample_rate_ == 0;
+  }
+
+  void Add(std::string_view command, uint32_t client_id, uint64_t unix_ts_nsec,
+           const CommandTrace& trace);
+
+  void SetOptions(uint32_t sample_rate, size_t max_len);
+
+  void Reset() {
+    entries_.clear();
+  }
+
+  const boost::circular_buffer<TraceEntry>& Entries() const {
+    return entries_;
+  }
+
+ private:
+  uint32_t sample_rate_ = 0;
+  uint32_t counter_ = 0;
+  boost::circular_buffer<TraceEntry> entries_;
+};
+
+}  // namespace dfly
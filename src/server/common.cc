@@ -151,6 +151,14 @@ const char* ObjTypeName(int type) {
       return "rejson-rl";
     case OBJ_SBF:
       return "MBbloom--";
+    case OBJ_CMS:
+      return "CMSk-TYPE";
+    case OBJ_TS:
+      return "TSDB-TYPE";
+    case OBJ_TOPK:
+      return "TopK-TYPE";
+    case OBJ_TDIGEST:
+      return "TDIS-TYPE";
 
     default:
       LOG(ERROR) << "Unsupported type " << type;
@@ -258,7 +266,7 @@ bool ParseDouble(string_view src, double* value) {
 #define ADD(x) (x) += o.x
 
 TieredStats& TieredStats::operator+=(const TieredStats& o) {
-  static_assert(sizeof(TieredStats) == 112);
+  static_assert(sizeof(TieredStats) == 184);
 
   ADD(total_stashes);
   ADD(total_fetches);
@@ -267,9 +275,19 @@ TieredStats& TieredStats::operator+=(const TieredStats& o) {
   ADD(total_defrags);
   ADD(total_heap_buf_allocs);
   ADD(total_registered_buf_allocs);
+  ADD(total_stash_overflows);
+  ADD(total_compressed_raw_bytes);
+  ADD(total_compressed_stored_bytes);
+
+  ADD(total_disk_reads);
+  ADD(total_disk_read_usec);
+  ADD(total_disk_writes);
+  ADD(total_disk_write_usec);
 
   ADD(allocated_bytes);
   ADD(capacity_bytes);
+  ADD(file_free_bytes);
+  ADD(file_fragmented_bytes);
 
   ADD(pending_read_cnt);
   ADD(pending_stash_cnt);
@@ -277,14 +295,16 @@ TieredStats& TieredStats::operator+=(const TieredStats& o) {
   ADD(small_bins_cnt);
   ADD(small_bins_entries_cnt);
   ADD(small_bins_filling_bytes);
+  ADD(small_bins_fragmented_bytes);
 
   return *this;
 }
 
 SearchStats& SearchStats::operator+=(const SearchStats& o) {
-  static_assert(sizeof(SearchStats) == 24);
+  static_assert(sizeof(SearchStats) == 32);
   ADD(used_memory);
   ADD(num_entries);
+  ADD(compacted_bytes);
 
   DCHECK(num_indices == 0 || num_indices == o.num_indices);
   num_indices = std::max(num_indices, o.num_indices);
@@ -299,6 +319,12 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
   for (unsigned i = 0; i < args.size(); i += 2) {
     ToUpper(&args[i]);
     string_view opt = ArgS(args, i);
+    if (opt == "PARALLEL") {
+      scan_opts.parallel = true;
+      --i;  // has no value.
+      continue;
+    }
+
     if (i + 1 == args.size()) {
       return facade::OpStatus::SYNTAX_ERR;
     }
@@ -315,6 +341,7 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
       scan_opts.pattern = ArgS(args, i + 1);
       if (scan_opts.pattern == "*")
         scan_opts.pattern = string_view{};
+      scan_opts.prefix = scan_opts.pattern.substr(0, scan_opts.pattern.find_first_of("*?[\\"));
     } else if (opt == "TYPE") {
       ToLower(&args[i + 1]);
       scan_opts.type_filter = ArgS(args, i + 1);
@@ -332,6 +359,11 @@ OpResult<ScanOpts> ScanOpts::TryFrom(CmdArgList args) {
 bool ScanOpts::Matches(std::string_view val_name) const {
   if (pattern.empty())
     return true;
+
+  if (!absl::StartsWith(val_name, prefix))
+    return false;
+  if (prefix.size() + 1 == pattern.size() && pattern.back() == '*')
+    return true;
   return stringmatchlen(pattern.data(), pattern.size(), val_name.data(), val_name.size(), 0) == 1;
 }
 
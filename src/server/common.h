@@ -72,8 +72,20 @@ struct TieredStats {
   // How many times the system did not perform Stash call (disjoint with total_stashes).
   uint64_t total_stash_overflows = 0;
 
+  // Sizes of the values that were stashed compressed, before and after compression.
+  uint64_t total_compressed_raw_bytes = 0;
+  uint64_t total_compressed_stored_bytes = 0;
+
+  // Completed disk reads and writes, and their total latency from submission to completion.
+  uint64_t total_disk_reads = 0;
+  uint64_t total_disk_read_usec = 0;
+  uint64_t total_disk_writes = 0;
+  uint64_t total_disk_write_usec = 0;
+
   size_t allocated_bytes = 0;
   size_t capacity_bytes = 0;
+  size_t file_free_bytes = 0;        // not used by segments or large values
+  size_t file_fragmented_bytes = 0;  // free bytes outside the largest free range
 
   uint32_t pending_read_cnt = 0;
   uint32_t pending_stash_cnt = 0;
@@ -81,6 +93,7 @@ struct TieredStats {
   uint64_t small_bins_cnt = 0;
   uint64_t small_bins_entries_cnt = 0;
   size_t small_bins_filling_bytes = 0;
+  size_t small_bins_fragmented_bytes = 0;  // bytes of stashed bins not used by live values
 
   TieredStats& operator+=(const TieredStats&);
 };
@@ -89,6 +102,7 @@ struct SearchStats {
   size_t used_memory = 0;
   size_t num_indices = 0;
   size_t num_entries = 0;
+  size_t compacted_bytes = 0;  // freed by compaction of posting lists
 
   SearchStats& operator+=(const SearchStats&);
 };
@@ -297,6 +311,8 @@ struct ScanOpts {
   size_t limit = 10;
   std::string_view type_filter;
   unsigned bucket_id = UINT_MAX;
+  bool parallel = false;  // SCAN traverses all shards at once, with its own cursor format.
+  std::string_view prefix;  // literal prefix of the pattern, to reject keys without globbing.
 
   bool Matches(std::string_view val_name) const;
   static OpResult<ScanOpts> TryFrom(CmdArgList args);
@@ -133,8 +133,8 @@ void ConnectionContext::ChangeMonitor(bool start) {
   EnableMonitoring(start);
 }
 
-vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add, bool to_reply,
-                                     ConnectionContext* conn) {
+vector<unsigned> ChangeSubscriptions(ChannelStore::Kind kind, CmdArgList args, bool to_add,
+                                     bool to_reply, ConnectionContext* conn) {
   vector<unsigned> result(to_reply ? args.size() : 0, 0);
 
   auto& conn_state = conn->conn_state;
@@ -149,12 +149,14 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
   }
 
   auto& sinfo = *conn->conn_state.subscribe_info.get();
-  auto& local_store = pattern ? sinfo.patterns : sinfo.channels;
+  auto& local_store = kind == ChannelStore::PATTERN         ? sinfo.patterns
+                      : kind == ChannelStore::SHARD_CHANNEL ? sinfo.shard_channels
+                                                            : sinfo.channels;
 
   int32_t tid = util::ProactorBase::me()->GetPoolIndex();
   DCHECK_GE(tid, 0);
 
-  ChannelStoreUpdater csu{pattern, to_add, conn, uint32_t(tid)};
+  ChannelStoreUpdater csu{kind, to_add, conn, uint32_t(tid)};
 
   // Gather all the channels we need to subscribe to / remove.
   size_t i = 0;
@@ -164,8 +166,10 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
     else if (!to_add && local_store.erase(channel) > 0)
       csu.Record(channel);
 
-    if (to_reply)
-      result[i++] = sinfo.SubscriptionCount();
+    if (to_reply) {
+      result[i++] = kind == ChannelStore::SHARD_CHANNEL ? sinfo.shard_channels.size()
+                                                        : sinfo.SubscriptionCount();
+    }
   }
 
   csu.Apply();
@@ -182,7 +186,8 @@ vector<unsigned> ChangeSubscriptions(bool pattern, CmdArgList args, bool to_add,
 }
 
 void ConnectionContext::ChangeSubscription(bool to_add, bool to_reply, CmdArgList args) {
-  vector<unsigned> result = ChangeSubscriptions(false, args, to_add, to_reply, this);
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::CHANNEL, args, to_add, to_reply, this);
 
   if (to_reply) {
     for (size_t i = 0; i < result.size(); ++i) {
@@ -197,7 +202,8 @@ void ConnectionContext::ChangeSubscription(bool to_add, bool to_reply, CmdArgLis
 }
 
 void ConnectionContext::ChangePSubscription(bool to_add, bool to_reply, CmdArgList args) {
-  vector<unsigned> result = ChangeSubscriptions(true, args, to_add, to_reply, this);
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::PATTERN, args, to_add, to_reply, this);
 
   if (to_reply) {
     const char* action[2] = {"punsubscribe", "psubscribe"};
@@ -211,6 +217,22 @@ void ConnectionContext::ChangePSubscription(bool to_add, bool to_reply, CmdArgLi
   }
 }
 
+void ConnectionContext::ChangeSSubscription(bool to_add, bool to_reply, CmdArgList args) {
+  vector<unsigned> result =
+      ChangeSubscriptions(ChannelStore::SHARD_CHANNEL, args, to_add, to_reply, this);
+
+  if (to_reply) {
+    const char* action[2] = {"sunsubscribe", "ssubscribe"};
+    if (result.size() == 0) {
+      return SendSubscriptionChangedResponse(action[to_add], std::nullopt, 0);
+    }
+
+    for (size_t i = 0; i < result.size(); ++i) {
+      SendSubscriptionChangedResponse(action[to_add], ArgS(args, i), result[i]);
+    }
+  }
+}
+
 void ConnectionContext::UnsubscribeAll(bool to_reply) {
   if (to_reply && (!conn_state.subscribe_info || conn_state.subscribe_info->channels.empty())) {
     return SendSubscriptionChangedResponse("unsubscribe", std::nullopt, 0);
@@ -232,6 +254,34 @@ void ConnectionContext::PUnsubscribeAll(bool to_reply) {
   ChangePSubscription(false, to_reply, CmdArgList{arg_vec});
 }
 
+void ConnectionContext::SUnsubscribeAll(bool to_reply) {
+  if (to_reply &&
+      (!conn_state.subscribe_info || conn_state.subscribe_info->shard_channels.empty())) {
+    return SendSubscriptionChangedResponse("sunsubscribe", std::nullopt, 0);
+  }
+
+  StringVec channels(conn_state.subscribe_info->shard_channels.begin(),
+                     conn_state.subscribe_info->shard_channels.end());
+  CmdArgVec arg_vec(channels.begin(), channels.end());
+  ChangeSSubscription(false, to_reply, CmdArgList{arg_vec});
+}
+
+void ConnectionContext::SetTrackingPrefixes(vector<string> prefixes) {
+  auto& tracking = conn_state.tracking_info_;
+  if (tracking.prefixes_.empty() && prefixes.empty())
+    return;
+
+  auto conn_ref = conn()->Borrow();
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    DbSlice& db_slice = shard->db_slice();
+    for (const auto& prefix : tracking.prefixes_)
+      db_slice.UntrackPrefix(conn_ref, prefix);
+    for (const auto& prefix : prefixes)
+      db_slice.TrackPrefix(conn_ref, prefix);
+  });
+  tracking.prefixes_ = std::move(prefixes);
+}
+
 void ConnectionContext::SendSubscriptionChangedResponse(string_view action,
                                                         std::optional<string_view> topic,
                                                         unsigned count) {
@@ -246,7 +296,7 @@ void ConnectionContext::SendSubscriptionChangedResponse(string_view action,
 }
 
 size_t ConnectionState::ExecInfo::UsedMemory() const {
-  return dfly::HeapSize(body) + dfly::HeapSize(watched_keys);
+  return dfly::HeapSize(body) + dfly::HeapSize(watched_keys) + dfly::HeapSize(watched_versions);
 }
 
 size_t ConnectionState::ScriptInfo::UsedMemory() const {
@@ -254,7 +304,7 @@ size_t ConnectionState::ScriptInfo::UsedMemory() const {
 }
 
 size_t ConnectionState::SubscribeInfo::UsedMemory() const {
-  return dfly::HeapSize(channels) + dfly::HeapSize(patterns);
+  return dfly::HeapSize(channels) + dfly::HeapSize(patterns) + dfly::HeapSize(shard_channels);
 }
 
 size_t ConnectionState::UsedMemory() const {
@@ -298,12 +348,12 @@ void ConnectionState::ExecInfo::Clear() {
 
 void ConnectionState::ExecInfo::ClearWatched() {
   watched_keys.clear();
+  watched_versions.clear();
   watched_dirty.store(false, memory_order_relaxed);
-  watched_existed = 0;
 }
 
 bool ConnectionState::ClientTracking::ShouldTrackKeys() const {
-  if (!IsTrackingOn()) {
+  if (!IsTrackingOn() || IsBroadcast()) {
     return false;
   }
 
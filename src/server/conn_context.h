@@ -88,8 +88,8 @@ struct ConnectionState {
     bool is_write = false;
 
     std::vector<std::pair<DbIndex, std::string>> watched_keys;  // List of keys registered by WATCH
+    std::vector<uint64_t> watched_versions;  // Per watched key, see DbSlice::WatchKey
     std::atomic_bool watched_dirty = false;  // Set if a watched key was changed before EXEC
-    uint32_t watched_existed = 0;            // Number of times watch was called on an existing key
 
     // If the transaction contains EVAL calls, preborrow an interpreter that will be used for all of
     // them. This has to be done to avoid potentially blocking when borrowing interpreters amid
@@ -107,14 +107,20 @@ struct ConnectionState {
     size_t async_cmds_heap_mem = 0;     // bytes used by async_cmds
     size_t async_cmds_heap_limit = 0;   // max bytes allowed for async_cmds
     std::vector<StoredCmd> async_cmds;  // aggregated by acall
+
+    // Counters for ServerState::ScriptStats.
+    uint32_t num_commands = 0;
+    uint32_t num_hops = 0;
+    uint32_t num_squashed = 0;
   };
 
   // PUB-SUB messaging related data.
   struct SubscribeInfo {
     bool IsEmpty() const {
-      return channels.empty() && patterns.empty();
+      return channels.empty() && patterns.empty() && shard_channels.empty();
     }
 
+    // Shard channels are not included, like in Redis they are counted separately.
     unsigned SubscriptionCount() const {
       return channels.size() + patterns.size();
     }
@@ -124,6 +130,7 @@ struct ConnectionState {
     // TODO: to provide unique_strings across service. This will allow us to use string_view here.
     absl::flat_hash_set<std::string> channels;
     absl::flat_hash_set<std::string> patterns;
+    absl::flat_hash_set<std::string> shard_channels;
   };
 
   struct ReplicationInfo {
@@ -144,6 +151,7 @@ struct ConnectionState {
 
   enum MCGetMask {
     FETCH_CAS_VER = 1,
+    FETCH_TTL = 2,
   };
 
   size_t UsedMemory() const;
@@ -237,11 +245,25 @@ struct ConnectionState {
       return option_ == option;
     }
 
+    // BCAST mode: the client is notified about changes of all keys that start with one of
+    // the prefixes, the keys it reads are not tracked. Prefixes are registered in all shards
+    // by ConnectionContext::SetTrackingPrefixes.
+    bool IsBroadcast() const {
+      return !prefixes_.empty();
+    }
+
+    const std::vector<std::string>& prefixes() const {
+      return prefixes_;
+    }
+
    private:
+    friend class ConnectionContext;
+
     // a flag indicating whether the client has turned on client tracking.
     bool tracking_enabled_ = false;
     bool noloop_ = false;
     Options option_ = NONE;
+    std::vector<std::string> prefixes_;  // BCAST prefixes, the empty prefix matches all keys.
     // sequence number
     size_t seq_num_ = 0;
     size_t caching_seq_num_ = 0;
@@ -285,6 +307,17 @@ class ConnectionContext : public facade::ConnectionContext {
   Transaction* transaction = nullptr;
   const CommandId* cid = nullptr;
 
+  // The last command resolved by Service::DispatchCommand and the name it was sent with.
+  // Pipelines usually repeat the same command, which then skips the registry lookup.
+  struct ResolvedCmd {
+    std::string name;
+    const CommandId* cid = nullptr;
+  };
+  ResolvedCmd last_resolved;
+
+  // Consecutive single shard commands on shards of another NUMA node, see DispatchCommand.
+  uint32_t numa_remote_cmds = 0;
+
   ConnectionState conn_state;
 
   DbIndex db_index() const {
@@ -293,8 +326,14 @@ class ConnectionContext : public facade::ConnectionContext {
 
   void ChangeSubscription(bool to_add, bool to_reply, CmdArgList args);
   void ChangePSubscription(bool to_add, bool to_reply, CmdArgList args);
+  void ChangeSSubscription(bool to_add, bool to_reply, CmdArgList args);
   void UnsubscribeAll(bool to_reply);
   void PUnsubscribeAll(bool to_reply);
+  void SUnsubscribeAll(bool to_reply);
+
+  // Replaces the BCAST tracking prefixes of this connection in all shards.
+  // An empty list turns off BCAST mode.
+  void SetTrackingPrefixes(std::vector<std::string> prefixes);
   void ChangeMonitor(bool start);  // either start or stop monitor on a given connection
 
   size_t UsedMemory() const override;
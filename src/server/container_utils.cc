@@ -5,6 +5,9 @@
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/chunked_list.h"
+#include "core/packed_int_set.h"
+#include "core/packed_string_set.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
@@ -134,6 +137,20 @@ OpResult<ShardFFResult> FindFirstNonEmpty(Transaction* trans, int req_obj_type)
   return ShardFFResult{std::get<PrimeKey>(res).AsRef(), std::get<ShardId>(res)};
 }
 
+// Returns the entry after p or nullptr at the end of lp. Decodes only the entries that are neither
+// short strings nor small integers.
+uint8_t* LpNextEntry(uint8_t* lp, uint8_t* p) {
+  constexpr uint8_t kLpEof = 0xFF;
+
+  if ((p[0] & 0xC0) == 0x80)  // 6 bit string: header, string, 1 byte backlen.
+    p += 2 + (p[0] & 0x3F);
+  else if ((p[0] & 0x80) == 0)  // 7 bit unsigned integer: header, 1 byte backlen.
+    p += 2;
+  else
+    return lpNext(lp, p);
+  return p[0] == kLpEof ? nullptr : p;
+}
+
 }  // namespace
 
 using namespace std;
@@ -150,6 +167,17 @@ quicklistEntry QLEntry() {
 }
 
 bool IterateList(const PrimeValue& pv, const IterateFunc& func, long start, long end) {
+  if (pv.Encoding() == kEncodingChunkedList) {
+    const ChunkedList* cl = static_cast<const ChunkedList*>(pv.RObjPtr());
+    size_t stop = end < 0 ? cl->Size() : end + 1;
+    bool success = true;
+    cl->Iterate(start, stop, [&](string_view value) {
+      success = func(ContainerEntry{value.data(), value.size()});
+      return success;
+    });
+    return success;
+  }
+
   quicklist* ql = static_cast<quicklist*>(pv.RObjPtr());
   long llen = quicklistCount(ql);
   if (end < 0 || end >= llen)
@@ -181,6 +209,14 @@ bool IterateSet(const PrimeValue& pv, const IterateFunc& func) {
     while (success && intsetGet(is, ii++, &ival)) {
       success = func(ContainerEntry{ival});
     }
+  } else if (pv.Encoding() == kEncodingPackedSet) {
+    success = static_cast<PackedStringSet*>(pv.RObjPtr())->Iterate([&func](string_view member) {
+      return func(ContainerEntry{member.data(), member.size()});
+    });
+  } else if (pv.Encoding() == kEncodingPackedIntSet) {
+    success = static_cast<PackedIntSet*>(pv.RObjPtr())->Iterate([&func](int64_t member) {
+      return func(ContainerEntry{member});
+    });
   } else {
     for (sds ptr : *static_cast<StringSet*>(pv.RObjPtr())) {
       if (!func(ContainerEntry{ptr, sdslen(ptr)})) {
@@ -250,6 +286,59 @@ bool IterateSortedSet(const detail::RobjWrapper* robj_wrapper, const IterateSort
   return false;
 }
 
+StringSet* PackedSetToStrSet(const PackedStringSet& ps) {
+  StringSet* ss = CompactObj::AllocateMR<StringSet>();
+  ss->Reserve(ps.Size());
+  ps.Iterate([ss](string_view member) {
+    CHECK(ss->Add(member));
+    return true;
+  });
+  return ss;
+}
+
+PackedStringSet* IntSetToPackedSet(const intset* is) {
+  PackedStringSet* ps = CompactObj::AllocateMR<PackedStringSet>();
+  char buf[32];
+  int64_t intele;
+  for (uint32_t ii = 0; intsetGet(const_cast<intset*>(is), ii, &intele); ++ii) {
+    char* next = absl::numbers_internal::FastIntToBuffer(intele, buf);
+    CHECK(ps->Add(string_view{buf, size_t(next - buf)}));
+  }
+  return ps;
+}
+
+PackedIntSet* IntSetToPackedIntSet(const intset* is) {
+  PackedIntSet* pis = CompactObj::AllocateMR<PackedIntSet>();
+  int64_t intele;
+  for (uint32_t ii = 0; intsetGet(const_cast<intset*>(is), ii, &intele); ++ii) {
+    CHECK(pis->Add(intele));
+  }
+  return pis;
+}
+
+PackedStringSet* PackedIntSetToPackedSet(const PackedIntSet& pis) {
+  PackedStringSet* ps = CompactObj::AllocateMR<PackedStringSet>();
+  char buf[32];
+  pis.Iterate([ps, &buf](int64_t member) {
+    char* next = absl::numbers_internal::FastIntToBuffer(member, buf);
+    CHECK(ps->Add(string_view{buf, size_t(next - buf)}));
+    return true;
+  });
+  return ps;
+}
+
+StringSet* PackedIntSetToStrSet(const PackedIntSet& pis) {
+  StringSet* ss = CompactObj::AllocateMR<StringSet>();
+  ss->Reserve(pis.Size());
+  char buf[32];
+  pis.Iterate([ss, &buf](int64_t member) {
+    char* next = absl::numbers_internal::FastIntToBuffer(member, buf);
+    CHECK(ss->Add(string_view{buf, size_t(next - buf)}));
+    return true;
+  });
+  return ss;
+}
+
 StringMap* GetStringMap(const PrimeValue& pv, const DbContext& db_context) {
   DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
   StringMap* res = static_cast<StringMap*>(pv.RObjPtr());
@@ -258,11 +347,28 @@ StringMap* GetStringMap(const PrimeValue& pv, const DbContext& db_context) {
   return res;
 }
 
-optional<string_view> LpFind(uint8_t* lp, string_view key, uint8_t int_buf[]) {
-  uint8_t* fptr = lpFirst(lp);
-  DCHECK(fptr);
+uint8_t* LpFindField(uint8_t* lp, string_view field) {
+  uint8_t* p = lpFirst(lp);
+  long long ival;
+  if (!p || field.size() >= 64 || string2ll(field.data(), field.size(), &ival))
+    return p ? lpFind(lp, p, (unsigned char*)field.data(), field.size(), 1) : nullptr;
+
+  // Other fields are stored as 6 bit strings, whose header byte holds the length. Comparing the
+  // header first rejects most fields without decoding them.
+  const uint8_t header = 0x80 | field.size();
+  do {
+    if (p[0] == header && memcmp(p + 1, field.data(), field.size()) == 0)
+      return p;
+    p = LpNextEntry(lp, p);  // the value
+    DCHECK(p);
+    p = LpNextEntry(lp, p);
+  } while (p);
+
+  return nullptr;
+}
 
-  fptr = lpFind(lp, fptr, (unsigned char*)key.data(), key.size(), 1);
+optional<string_view> LpFind(uint8_t* lp, string_view key, uint8_t int_buf[]) {
+  uint8_t* fptr = LpFindField(lp, key);
   if (!fptr)
     return std::nullopt;
   uint8_t* vptr = lpNext(lp, fptr);
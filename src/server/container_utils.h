@@ -14,9 +14,14 @@ extern "C" {
 
 #include <functional>
 
+typedef struct intset intset;
+
 namespace dfly {
 
+class PackedIntSet;
+class PackedStringSet;
 class StringMap;
+class StringSet;
 
 namespace container_utils {
 
@@ -72,12 +77,31 @@ bool IterateSortedSet(const detail::RobjWrapper* robj_wrapper, const IterateSort
                       int32_t start = 0, int32_t end = -1, bool reverse = false,
                       bool use_score = false);
 
+// Converts the members of a packed set into a new StringSet.
+StringSet* PackedSetToStrSet(const PackedStringSet& ps);
+
+// Converts the members of an intset into a new PackedStringSet.
+PackedStringSet* IntSetToPackedSet(const intset* is);
+
+// Converts the members of an intset into a new PackedIntSet.
+PackedIntSet* IntSetToPackedIntSet(const intset* is);
+
+// Converts the members of a packed int set into a new PackedStringSet.
+PackedStringSet* PackedIntSetToPackedSet(const PackedIntSet& pis);
+
+// Converts the members of a packed int set into a new StringSet.
+StringSet* PackedIntSetToStrSet(const PackedIntSet& pis);
+
 // Get StringMap pointer from primetable value. Sets expire time from db_context
 StringMap* GetStringMap(const PrimeValue& pv, const DbContext& db_context);
 
 // Get string_view from listpack poiner. Intbuf to store integer values as strings.
 std::string_view LpGetView(uint8_t* lp_it, uint8_t int_buf[]);
 
+// Returns the entry of field among the fields of a listpack of field and value pairs, or nullptr.
+// Same as lpFind with a skip of 1, but faster for short fields that are not integers.
+uint8_t* LpFindField(uint8_t* lp, std::string_view field);
+
 // Find value by key and return stringview to it, otherwise nullopt.
 std::optional<std::string_view> LpFind(uint8_t* lp, std::string_view key, uint8_t int_buf[]);
 
@@ -5,9 +5,14 @@
 #include "server/db_slice.h"
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/dense_set.h"
+#include "core/string_map.h"
+#include "core/string_set.h"
 #include "generic_family.h"
 #include "server/channel_store.h"
 #include "server/cluster/cluster_defs.h"
@@ -19,6 +24,30 @@
 #include "strings/human_readable.h"
 #include "util/fibers/stacktrace.h"
 
+namespace dfly {
+
+// Fraction of the capacity of a hash table segment.
+struct SegmentFillFlag {
+  double value = 0;
+};
+
+bool AbslParseFlag(std::string_view in, SegmentFillFlag* flag, std::string* err) {
+  double val;
+  if (absl::SimpleAtod(in, &val) && val >= 0 && val <= 1) {
+    flag->value = val;
+    return true;
+  }
+
+  *err = "Must be a fraction between 0 and 1";
+  return false;
+}
+
+std::string AbslUnparseFlag(const SegmentFillFlag& flag) {
+  return absl::StrCat(flag.value);
+}
+
+}  // namespace dfly
+
 ABSL_FLAG(bool, enable_heartbeat_eviction, true,
           "Enable eviction during heartbeat when memory is under pressure.");
 
@@ -34,9 +63,36 @@ ABSL_FLAG(double, table_growth_margin, 0.4,
           "Prevents table from growing if number of free slots x average object size x this ratio "
           "is larger than memory budget.");
 
+ABSL_FLAG(dfly::SegmentFillFlag, table_presplit_fill, dfly::SegmentFillFlag{},
+          "If positive, the heartbeat splits hash table segments filled above this fraction of "
+          "their capacity ahead of the inserts that would split them. Keeps segment splits and "
+          "directory doublings off the command path during bulk loads. Not applied in cache mode.");
+
+ABSL_FLAG(std::string, cache_eviction_policy, "lru",
+          "Which keys are evicted in cache mode when a hash table segment is full. "
+          "lru: the least recently used by their position in the buckets. "
+          "lfu: the least frequently used by a decaying frequency estimate, keeps hot keys "
+          "under scans and one-time accesses. "
+          "ttl: the soonest to expire, falls back to lru for keys without expiry.");
+
 ABSL_FLAG(std::string, notify_keyspace_events, "",
           "notify-keyspace-events. Only Ex is supported for now");
 
+ABSL_FLAG(std::string, keyspace_events_sink, "pubsub",
+          "Where keyspace events are delivered. pubsub: published on the __keyevent@<db>__ "
+          "channels. log: kept in a bounded log of every shard that is read with KEYEVENTS.");
+
+ABSL_FLAG(uint32_t, keyspace_events_log_len, 1 << 16,
+          "Number of keyspace events kept by every shard for the log sink. Older events are "
+          "overwritten and reported as lost to the readers that did not read them in time.");
+
+ABSL_FLAG(std::string, keyspace_events_prefix, "",
+          "If set, keyspace events are recorded only for the keys that start with this prefix.");
+
+ABSL_FLAG(uint32_t, lazyfree_threshold, 64,
+          "UNLINK frees lists, sets, hashes and sorted sets with more elements than this "
+          "in the background. 0 disables the lazy freeing");
+
 namespace dfly {
 
 using namespace std;
@@ -47,6 +103,34 @@ using Payload = journal::Entry::Payload;
 
 namespace {
 
+// Freeing these values may take a while, see --lazyfree_threshold.
+bool IsLazyFreeable(const PrimeValue& pv) {
+  uint32_t threshold = GetFlag(FLAGS_lazyfree_threshold);
+  if (threshold == 0 || pv.IsExternal())
+    return false;
+
+  switch (pv.ObjType()) {
+    case OBJ_LIST:
+    case OBJ_SET:
+    case OBJ_HASH:
+    case OBJ_ZSET:
+      return pv.Size() > threshold;
+    default:
+      return false;
+  }
+}
+
+// Returns the members of the sets and hashes that support member expiry.
+DenseSet* MembersOf(const PrimeValue& pv) {
+  if (pv.Encoding() != kEncodingStrMap2)
+    return nullptr;
+  if (pv.ObjType() == OBJ_SET)
+    return static_cast<StringSet*>(pv.RObjPtr());
+  if (pv.ObjType() == OBJ_HASH)
+    return static_cast<StringMap*>(pv.RObjPtr());
+  return nullptr;
+}
+
 constexpr auto kPrimeSegmentSize = PrimeTable::kSegBytes;
 constexpr auto kExpireSegmentSize = ExpireTable::kSegBytes;
 
@@ -68,8 +152,14 @@ void AccountObjectMemory(string_view key, unsigned type, int64_t size, DbTable*
   if (cluster::IsClusterEnabled()) {
     db->slots_stats[cluster::KeySlot(key)].memory_bytes += size;
   }
+
+  if (db->memory_profile)
+    db->memory_profile->Account(key, type, size);
 }
 
+// Counters per row of the LFU frequency sketch of each shard, 256KB in total.
+constexpr size_t kFrequencySketchWidth = 1 << 16;
+
 class PrimeEvictionPolicy {
  public:
   static constexpr bool can_evict = true;  // we implement eviction functionality.
@@ -96,6 +186,9 @@ class PrimeEvictionPolicy {
   unsigned GarbageCollect(const PrimeTable::HotspotBuckets& eb, PrimeTable* me);
   unsigned Evict(const PrimeTable::HotspotBuckets& eb, PrimeTable* me);
 
+  // Evicts the item chosen by a non LRU eviction policy, returns 0 if there is none.
+  unsigned EvictByScore(const PrimeTable::HotspotBuckets& eb);
+
   ssize_t mem_budget() const {
     return mem_budget_;
   }
@@ -182,10 +275,65 @@ unsigned PrimeEvictionPolicy::GarbageCollect(const PrimeTable::HotspotBuckets& e
   return res;
 }
 
+unsigned PrimeEvictionPolicy::EvictByScore(const PrimeTable::HotspotBuckets& eb) {
+  DbTable* table = db_slice_->GetDBTable(cntx_.db_index);
+  const FrequencySketch* sketch = db_slice_->frequency_sketch();
+  bool by_ttl = db_slice_->eviction_policy() == DbSlice::EvictionPolicy::TTL;
+
+  // The item with the lowest score among all the buckets the new key can go to is evicted.
+  PrimeTable::bucket_iterator victim;
+  uint64_t victim_score = 0;
+  bool found = false;
+  string scratch;
+  for (unsigned i = 0; i < eb.num_buckets; ++i) {
+    for (auto it = eb.at(i); !it.is_done(); ++it) {
+      if (it->first.IsSticky())
+        continue;
+
+      uint64_t score;
+      if (by_ttl) {
+        if (!it->second.HasExpire())
+          continue;
+        score = db_slice_->ExpireTime(table->expire.Find(it->first));
+      } else {
+        score = sketch ? sketch->Estimate(it->first.GetSlice(&scratch)) : 0;
+      }
+
+      // do not evict locked keys
+      if ((!found || score < victim_score) &&
+          !table->trans_locks.Find(LockTag(it->first.GetSlice(&scratch))).has_value()) {
+        victim = it;
+        victim_score = score;
+        found = true;
+      }
+    }
+  }
+
+  if (!found)
+    return 0;
+
+  string_view key = victim->first.GetSlice(&scratch);
+
+  // log the evicted keys to journal.
+  if (auto journal = db_slice_->shard_owner()->journal(); journal) {
+    RecordExpiry(cntx_.db_index, key);
+  }
+
+  db_slice_->PerformDeletion(DbSlice::Iterator(victim, StringOrView::FromView(key)), table);
+  ++evicted_;
+  return 1;
+}
+
 unsigned PrimeEvictionPolicy::Evict(const PrimeTable::HotspotBuckets& eb, PrimeTable* me) {
   if (!can_evict_)
     return 0;
 
+  // Without a candidate, TTL falls back to evicting by the bucket position.
+  if (db_slice_->eviction_policy() != DbSlice::EvictionPolicy::LRU) {
+    if (unsigned res = EvictByScore(eb); res > 0)
+      return res;
+  }
+
   constexpr size_t kNumStashBuckets = ABSL_ARRAYSIZE(eb.probes.by_type.stash_buckets);
 
   // choose "randomly" a stash bucket to evict an item.
@@ -226,7 +374,7 @@ unsigned PrimeEvictionPolicy::Evict(const PrimeTable::HotspotBuckets& eb, PrimeT
 
 DbStats& DbStats::operator+=(const DbStats& o) {
   constexpr size_t kDbSz = sizeof(DbStats) - sizeof(DbTableStats);
-  static_assert(kDbSz == 32);
+  static_assert(kDbSz == 48);
 
   DbTableStats::operator+=(o);
 
@@ -234,16 +382,19 @@ DbStats& DbStats::operator+=(const DbStats& o) {
   ADD(expire_count);
   ADD(bucket_count);
   ADD(table_mem_usage);
+  ADD(table_splits);
+  ADD(table_split_usec);
 
   return *this;
 }
 
 SliceEvents& SliceEvents::operator+=(const SliceEvents& o) {
-  static_assert(sizeof(SliceEvents) == 112, "You should update this function with new fields");
+  static_assert(sizeof(SliceEvents) == 120, "You should update this function with new fields");
 
   ADD(evicted_keys);
   ADD(hard_evictions);
   ADD(expired_keys);
+  ADD(expired_fields);
   ADD(garbage_collected);
   ADD(stash_unloaded);
   ADD(bumpups);
@@ -265,7 +416,8 @@ DbSlice::DbSlice(uint32_t index, bool caching_mode, EngineShard* owner)
     : shard_id_(index),
       caching_mode_(caching_mode),
       owner_(owner),
-      client_tracking_map_(owner->memory_resource()) {
+      client_tracking_map_(owner->memory_resource()),
+      prefix_tracking_map_(owner->memory_resource()) {
   db_arr_.emplace_back();
   CreateDb(0);
   expire_base_[0] = expire_base_[1] = 0;
@@ -277,6 +429,28 @@ DbSlice::DbSlice(uint32_t index, bool caching_mode, EngineShard* owner)
     exit(0);
   }
   expired_keys_events_recording_ = !keyspace_events.empty();
+  keyspace_events_prefix_ = GetFlag(FLAGS_keyspace_events_prefix);
+
+  std::string events_sink = GetFlag(FLAGS_keyspace_events_sink);
+  if (events_sink == "log") {
+    key_event_log_ = make_unique<KeyEventLog>(max(GetFlag(FLAGS_keyspace_events_log_len), 1u));
+  } else if (events_sink != "pubsub") {
+    LOG(ERROR) << "Unsupported keyspace events sink " << events_sink;
+    exit(0);
+  }
+
+  std::string eviction_policy = GetFlag(FLAGS_cache_eviction_policy);
+  if (eviction_policy == "lfu") {
+    eviction_policy_ = EvictionPolicy::LFU;
+  } else if (eviction_policy == "ttl") {
+    eviction_policy_ = EvictionPolicy::TTL;
+  } else if (eviction_policy != "lru") {
+    LOG(ERROR) << "Unknown cache_eviction_policy " << eviction_policy;
+    exit(1);
+  }
+
+  if (caching_mode_ && eviction_policy_ == EvictionPolicy::LFU)
+    freq_sketch_ = make_unique<FrequencySketch>(kFrequencySketchWidth);
 }
 
 DbSlice::~DbSlice() {
@@ -305,8 +479,17 @@ auto DbSlice::GetStats() const -> Stats {
     stats.bucket_count = db_wrap.prime.bucket_count();
     stats.expire_count = db_wrap.expire.size();
     stats.table_mem_usage = (db_wrap.prime.mem_usage() + db_wrap.expire.mem_usage());
-  }
-  s.small_string_bytes = CompactObj::GetStats().small_string_bytes;
+    stats.table_splits = db_wrap.prime.splits() + db_wrap.expire.splits();
+    stats.table_split_usec =
+        (db_wrap.prime.split_time_ns() + db_wrap.expire.split_time_ns()) / 1000;
+  }
+  CompactObj::Stats co_stats = CompactObj::GetStats();
+  s.small_string_bytes = co_stats.small_string_bytes;
+  s.small_string_table_full = co_stats.small_string_table_full;
+  s.key_prefix_bytes = co_stats.key_prefix_bytes;
+  s.compressed_string_bytes = co_stats.compressed_string_bytes;
+  s.compressed_string_raw_bytes = co_stats.compressed_string_raw_bytes;
+  s.pending_rehash_buckets = DenseSet::GetStats().pending_rehash_buckets;
 
   return s;
 }
@@ -316,6 +499,31 @@ SlotStats DbSlice::GetSlotStats(cluster::SlotId sid) const {
   return db_arr_[0]->slots_stats[sid];
 }
 
+void DbSlice::UpdateSlotRates(uint64_t now_ms) {
+  if (!db_arr_[0] || db_arr_[0]->slots_stats.empty() || now_ms < slot_rates_updated_ms_ + 1000)
+    return;
+
+  auto& slots_stats = db_arr_[0]->slots_stats;
+  uint64_t elapsed_ms = now_ms - slot_rates_updated_ms_;
+  bool first_update = slot_ops_prev_.empty();
+  slot_ops_prev_.resize(slots_stats.size(), 0);
+  slot_rates_updated_ms_ = now_ms;
+  if (first_update)
+    elapsed_ms = 1000;
+
+  for (size_t sid = 0; sid < slots_stats.size(); ++sid) {
+    SlotStats& stats = slots_stats[sid];
+    uint64_t ops = stats.total_reads + stats.total_writes;
+    // The counters start over when the table is flushed.
+    uint64_t delta = ops >= slot_ops_prev_[sid] ? ops - slot_ops_prev_[sid] : ops;
+    slot_ops_prev_[sid] = ops;
+
+    // Exponential moving average that mostly reflects the last 4 seconds.
+    uint64_t rate = delta * 1000 / elapsed_ms;
+    stats.ops_per_sec = (stats.ops_per_sec * 3 + rate) / 4;
+  }
+}
+
 void DbSlice::Reserve(DbIndex db_ind, size_t key_size) {
   ActivateDb(db_ind);
 
@@ -434,7 +642,8 @@ OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std:
 
   DbSlice::PrimeItAndExp res;
   auto& db = *db_arr_[cntx.db_index];
-  res.it = db.prime.Find(key);
+  uint64_t key_hash = db.prime.DoHash(key);
+  res.it = db.prime.Find(key, key_hash);
 
   absl::Cleanup update_stats_on_miss = [&]() {
     switch (stats_mode) {
@@ -447,6 +656,10 @@ OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std:
     }
   };
 
+  // A miss is final, which is why tiering offloads only values and keeps every key in memory.
+  // With keys on disk, each miss would have to suspend for a disk read, but FindInternal runs
+  // inside shard callbacks that may not preempt, and Exists, expiry, eviction and SCAN cursors
+  // all assume that the prime table holds the whole keyspace.
   if (!IsValid(res.it)) {
     return OpStatus::KEY_NOTFOUND;
   }
@@ -457,7 +670,7 @@ OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std:
 
   FiberAtomicGuard fg;
   if (res.it->second.HasExpire()) {  // check expiry state
-    res = ExpireIfNeeded(cntx, res.it);
+    res = ExpireIfNeeded(cntx, res.it, key_hash);
     if (!IsValid(res.it)) {
       return OpStatus::KEY_NOTFOUND;
     }
@@ -479,7 +692,14 @@ OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std:
     fetched_items_.insert(res.it->first.AsRef());
   }
 
+  // Mark as recently accessed for tiered storage offloading, see TieredStorage::RunOffloading.
+  // Offloaded values are marked once their read completes.
+  if (!res.it->second.IsExternal())
+    res.it->second.SetTouched(true);
+
   db.top_keys.Touch(key);
+  if (freq_sketch_)
+    freq_sketch_->Touch(key);
 
   std::move(update_stats_on_miss).Cancel();
   switch (stats_mode) {
@@ -496,20 +716,65 @@ OpResult<DbSlice::PrimeItAndExp> DbSlice::FindInternal(const Context& cntx, std:
   return res;
 }
 
+void DbSlice::RefreshHotValues(uint64_t now_ms) {
+  // Bounds the work per heartbeat. The hottest keys stay far ahead of the rest in TopKeys even
+  // when only a part of their reads is replayed.
+  constexpr uint64_t kMaxTouches = 256;
+
+  hot_values_.DrainReads([&](DbIndex dbid, string_view key, uint64_t reads) {
+    events_.hits += reads;
+    DbTable* table = GetDBTable(dbid);
+    if (!table)
+      return;
+
+    for (uint64_t i = 0; i < min(reads, kMaxTouches); ++i)
+      table->top_keys.Touch(key);
+    if (cluster::IsClusterEnabled())
+      table->slots_stats[cluster::KeySlot(key)].total_reads += reads;
+  });
+
+  if (!caching_mode_)
+    hot_values_.Refresh(this, now_ms);
+}
+
+void DbSlice::PrefetchKeys(DbIndex db_ind, const ShardArgs& args, unsigned step) const {
+  // Small batches are not worth hashing twice.
+  constexpr size_t kMinBatch = 8;
+  if (args.Size() < kMinBatch * step || !IsDbValid(db_ind))
+    return;
+
+  const PrimeTable& prime = db_arr_[db_ind]->prime;
+  unsigned index = 0;
+  for (string_view key : args) {
+    if (index++ % step == 0)
+      prime.Prefetch(key);
+  }
+}
+
 OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFind(const Context& cntx, string_view key) {
   return AddOrFindInternal(cntx, key);
 }
 
+OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrSkip(const Context& cntx, string_view key) {
+  return AddOrFindInternal(cntx, key, false);
+}
+
 OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cntx,
-                                                              string_view key) {
+                                                              string_view key,
+                                                              bool update_existing) {
   DCHECK(IsDbValid(cntx.db_index));
 
   DbTable& db = *db_arr_[cntx.db_index];
-  auto res = FindInternal(cntx, key, std::nullopt, UpdateStatsMode::kMutableStats);
+  auto res = FindInternal(cntx, key, std::nullopt,
+                          update_existing ? UpdateStatsMode::kMutableStats
+                                          : UpdateStatsMode::kReadStats);
 
   if (res.ok()) {
     Iterator it(res->it, StringOrView::FromView(key));
     ExpIterator exp_it(res->exp_it, StringOrView::FromView(key));
+    if (!update_existing)
+      return DbSlice::AddOrFindResult{.it = it, .exp_it = exp_it, .is_new = false};
+
     PreUpdate(cntx.db_index, it, key);
     // PreUpdate() might have caused a deletion of `it`
     if (res->it.IsOccupied()) {
@@ -560,7 +825,8 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
 
   // Fast-path if change_cb_ is empty so we Find or Add using
   // the insert operation: twice more efficient.
-  CompactObj co_key{key};
+  CompactObj co_key;
+  co_key.SetKey(key);
   PrimeIterator it;
 
   // I try/catch just for sake of having a convenient place to set a breakpoint.
@@ -586,9 +852,12 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
 
   db.stats.inline_keys += it->first.IsInline();
   AccountObjectMemory(key, it->first.ObjType(), it->first.MallocUsed(), &db);  // Account for key
+  if (freq_sketch_)
+    freq_sketch_->Touch(key);
 
   DCHECK_EQ(it->second.MallocUsed(), 0UL);  // Make sure accounting is no-op
   it.SetVersion(NextVersion());
+  CountKeyChange(db, key);
 
   events_.garbage_collected = db.prime.garbage_collected();
   events_.stash_unloaded = db.prime.stash_unloaded();
@@ -599,6 +868,8 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrFindInternal(const Context& cnt
   if (cluster::IsClusterEnabled()) {
     cluster::SlotId sid = cluster::KeySlot(key);
     db.slots_stats[sid].key_count += 1;
+    if (db.HasSlotIndex())
+      db.slot_keys[sid].emplace(key);
   }
 
   return DbSlice::AddOrFindResult{
@@ -618,7 +889,15 @@ void DbSlice::ActivateDb(DbIndex db_ind) {
   CreateDb(db_ind);
 }
 
-bool DbSlice::Del(DbIndex db_ind, Iterator it) {
+bool DbSlice::Del(DbIndex db_ind, Iterator it, bool lazy) {
+  return DelInternal(db_ind, it, lazy, nullptr);
+}
+
+void DbSlice::Detach(DbIndex db_ind, Iterator it, PrimeValue* dest) {
+  CHECK(DelInternal(db_ind, it, false, dest));
+}
+
+bool DbSlice::DelInternal(DbIndex db_ind, Iterator it, bool lazy, PrimeValue* detached) {
   if (!IsValid(it)) {
     return false;
   }
@@ -632,7 +911,7 @@ bool DbSlice::Del(DbIndex db_ind, Iterator it) {
     doc_del_cb_(key, DbContext{db_ind, GetCurrentTimeMs()}, it->second);
   }
   fetched_items_.erase(it->first.AsRef());
-  PerformDeletion(it, db.get());
+  PerformDeletion(it, db.get(), lazy, detached);
 
   return true;
 }
@@ -682,17 +961,34 @@ void DbSlice::FlushSlotsFb(const cluster::SlotSet& slot_ids) {
 
   ServerState& etl = *ServerState::tlocal();
   PrimeTable* pt = &db_arr_[0]->prime;
-  PrimeTable::Cursor cursor;
-  uint64_t i = 0;
-  do {
-    PrimeTable::Cursor next = pt->Traverse(cursor, del_entry_cb);
-    ++i;
-    cursor = next;
-    if (i % 100 == 0) {
-      ThisFiber::Yield();
+  if (db_arr_[0]->HasSlotIndex()) {
+    // Only the keys of the flushed slots are visited, one slot at a time.
+    vector<string> keys;
+    cluster::SlotId sid = 0;
+    uint64_t i = 0;
+    while (etl.gstate() != GlobalState::SHUTTING_DOWN &&
+           db_arr_[0]->NextSlotKeys(slot_ids, &sid, &keys)) {
+      pt = &db_arr_[0]->prime;
+      for (const string& key : keys) {
+        if (auto it = pt->Find(key); IsValid(it))
+          del_entry_cb(it);
+        if (++i % 100 == 0)
+          ThisFiber::Yield();
+      }
     }
+  } else {
+    PrimeTable::Cursor cursor;
+    uint64_t i = 0;
+    do {
+      PrimeTable::Cursor next = pt->Traverse(cursor, del_entry_cb);
+      ++i;
+      cursor = next;
+      if (i % 100 == 0) {
+        ThisFiber::Yield();
+      }
 
-  } while (cursor && etl.gstate() != GlobalState::SHUTTING_DOWN);
+    } while (cursor && etl.gstate() != GlobalState::SHUTTING_DOWN);
+  }
 
   UnregisterOnChange(next_version);
 
@@ -722,6 +1018,7 @@ void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
     auto& db = db_arr_[index];
     CHECK(db);
     InvalidateDbWatches(index);
+    hot_values_.InvalidateDb(index);
     flush_db_arr[index] = std::move(db);
 
     CreateDb(index);
@@ -732,6 +1029,30 @@ void DbSlice::FlushDbIndexes(const std::vector<DbIndex>& indexes) {
   auto cb = [this, async_cleanup, indexes, flush_db_arr = std::move(flush_db_arr)]() mutable {
     if (async_cleanup)
       ClearEntriesOnFlush(indexes, flush_db_arr, true);
+
+    // Frees the entries a few buckets at a time, so that the shard keeps serving meanwhile.
+    auto clear_table = [](auto* table, auto&& cb) {
+      uint64_t i = 0;
+      typename std::remove_pointer_t<decltype(table)>::Cursor cursor;
+      do {
+        cursor = table->Traverse(cursor, [&](auto it) {
+          cb(it);
+          table->Erase(it);
+        });
+        if (++i % 100 == 0)
+          ThisFiber::Yield();
+      } while (cursor);
+    };
+
+    for (auto& db : flush_db_arr) {
+      if (!db)
+        continue;
+      clear_table(&db->prime, [this](PrimeIterator it) {
+        if (IsLazyFreeable(it->second))
+          shard_owner()->FreeLazily(std::move(it->second));
+      });
+      clear_table(&db->expire, [](ExpireIterator) {});
+    }
     flush_db_arr.clear();
     ServerState::tlocal()->DecommitMemory(ServerState::kDataHeap | ServerState::kBackingHeap |
                                           ServerState::kGlibcmalloc);
@@ -764,12 +1085,22 @@ void DbSlice::FlushDb(DbIndex db_ind) {
 void DbSlice::AddExpire(DbIndex db_ind, Iterator main_it, uint64_t at) {
   uint64_t delta = at - expire_base_[0];  // TODO: employ multigen expire updates.
   CHECK(db_arr_[db_ind]->expire.Insert(main_it->first.AsRef(), ExpirePeriod(delta)).second);
+  db_arr_[db_ind]->UpdateExpireIndex(main_it.key(), 0, at);
   main_it->second.SetExpire(true);
 }
 
+void DbSlice::SetExpireTime(DbIndex db_ind, ExpIterator exp_it, uint64_t at) {
+  db_arr_[db_ind]->UpdateExpireIndex(exp_it.key(), ExpireTime(exp_it), at);
+  exp_it->second = FromAbsoluteTime(at);
+}
+
 bool DbSlice::RemoveExpire(DbIndex db_ind, Iterator main_it) {
   if (main_it->second.HasExpire()) {
-    CHECK_EQ(1u, db_arr_[db_ind]->expire.Erase(main_it->first));
+    auto& db = *db_arr_[db_ind];
+    auto exp_it = db.expire.Find(main_it->first);
+    CHECK(IsValid(exp_it));
+    db.UpdateExpireIndex(main_it.key(), ExpireTime(exp_it), 0);
+    db.expire.Erase(exp_it);
     main_it->second.SetExpire(false);
     return true;
   }
@@ -861,7 +1192,7 @@ OpResult<int64_t> DbSlice::UpdateExpire(const Context& cntx, Iterator prime_it,
       return OpStatus::SKIPPED;
     }
 
-    expire_it->second = FromAbsoluteTime(abs_msec);
+    SetExpireTime(cntx.db_index, expire_it, abs_msec);
     return abs_msec;
   } else {
     if (params.expire_options & ExpireFlags::EXPIRE_XX) {
@@ -895,10 +1226,11 @@ OpResult<DbSlice::AddOrFindResult> DbSlice::AddOrUpdateInternal(const Context& c
     it->second.SetExpire(true);
     uint64_t delta = expire_at_ms - expire_base_[0];
     if (IsValid(res.exp_it) && force_update) {
-      res.exp_it->second = ExpirePeriod(delta);
+      SetExpireTime(cntx.db_index, res.exp_it, expire_at_ms);
     } else {
       auto exp_it = db.expire.InsertNew(it->first.AsRef(), ExpirePeriod(delta));
       res.exp_it = ExpIterator(exp_it, StringOrView::FromView(key));
+      db.UpdateExpireIndex(key, 0, expire_at_ms);
     }
   }
 
@@ -976,11 +1308,19 @@ bool DbSlice::CheckLock(IntentLock::Mode mode, DbIndex dbid, uint64_t fp) const
   return true;
 }
 
+bool DbSlice::CheckHeldLock(IntentLock::Mode mode, DbIndex dbid, uint64_t fp) const {
+  const auto& lt = db_arr_[dbid]->trans_locks;
+  auto lock = lt.Find(fp);
+  DCHECK(lock);
+  return lock && lock->CheckHeld(mode);
+}
+
 void DbSlice::PreUpdate(DbIndex db_ind, Iterator it, std::string_view key) {
   FiberAtomicGuard fg;
 
   DVLOG(2) << "Running callbacks in dbid " << db_ind;
   CallChangeCallbacks(db_ind, ChangeReq{it.GetInnerIt()});
+  hot_values_.Invalidate(db_ind, key);
 
   // If the value has a pending stash, cancel it before any modification are applied.
   // Note: we don't delete offloaded values before updates, because a read-modify operation (like
@@ -990,6 +1330,7 @@ void DbSlice::PreUpdate(DbIndex db_ind, Iterator it, std::string_view key) {
   }
 
   it.GetInnerIt().SetVersion(NextVersion());
+  CountKeyChange(*db_arr_[db_ind], key);
 }
 
 void DbSlice::PostUpdate(DbIndex db_ind, Iterator it, std::string_view key, size_t orig_size) {
@@ -1024,6 +1365,11 @@ DbSlice::ItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, Iterator it) cons
 }
 
 DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterator it) const {
+  return ExpireIfNeeded(cntx, it, it->first.HashCode());
+}
+
+DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterator it,
+                                               uint64_t key_hash) const {
   if (!it->second.HasExpire()) {
     LOG(ERROR) << "Invalid call to ExpireIfNeeded";
     return {it, ExpireIterator{}};
@@ -1031,7 +1377,7 @@ DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterato
 
   auto& db = db_arr_[cntx.db_index];
 
-  auto expire_it = db->expire.Find(it->first);
+  auto expire_it = db->expire.Find(it->first, key_hash);
 
   // TODO: Accept Iterator instead of PrimeIterator, as this might save an allocation below.
   string scratch;
@@ -1056,7 +1402,7 @@ DbSlice::PrimeItAndExp DbSlice::ExpireIfNeeded(const Context& cntx, PrimeIterato
     RecordExpiry(cntx.db_index, key);
   }
 
-  if (expired_keys_events_recording_)
+  if (ShouldRecordKeyEvent(key))
     db->expired_keys_events_.emplace_back(key);
 
   auto obj_type = it->second.ObjType();
@@ -1155,49 +1501,207 @@ auto DbSlice::DeleteExpiredStep(const Context& cntx, unsigned count) -> DeleteEx
     result.traversed++;
     time_t ttl = ExpireTime(it) - cntx.time_now_ms;
     if (ttl <= 0) {
-      auto prime_it = db.prime.Find(it->first);
+      uint64_t key_hash = db.prime.DoHash(it->first);
+      auto prime_it = db.prime.Find(it->first, key_hash);
       CHECK(!prime_it.is_done());
-      ExpireIfNeeded(cntx, prime_it);
+      ExpireIfNeeded(cntx, prime_it, key_hash);
       ++result.deleted;
     } else {
       result.survivor_ttl_sum += ttl;
     }
   };
 
-  unsigned i = 0;
-  for (; i < count / 3; ++i) {
-    db.expire_cursor = db.expire.Traverse(db.expire_cursor, cb);
-  }
-
-  // continue traversing only if we had strong deletion rate based on the first sample.
-  if (result.deleted * 4 > result.traversed) {
-    for (; i < count; ++i) {
+  if (db.expire_index) {
+    DeleteIndexedExpired(cntx, &result);
+  } else {
+    unsigned i = 0;
+    for (; i < count / 3; ++i) {
       db.expire_cursor = db.expire.Traverse(db.expire_cursor, cb);
     }
+
+    // continue traversing only if we had strong deletion rate based on the first sample.
+    if (result.deleted * 4 > result.traversed) {
+      for (; i < count; ++i) {
+        db.expire_cursor = db.expire.Traverse(db.expire_cursor, cb);
+      }
+    }
   }
 
   // Send and clear accumulated expired key events
   if (auto& events = db_arr_[cntx.db_index]->expired_keys_events_; !events.empty()) {
-    ChannelStore* store = ServerState::tlocal()->channel_store();
-    store->SendMessages(absl::StrCat("__keyevent@", cntx.db_index, "__:expired"), events);
+    if (key_event_log_) {
+      for (string& key : events)
+        key_event_log_->Add(cntx.db_index, std::move(key));
+    } else {
+      ChannelStore* store = ServerState::tlocal()->channel_store();
+      store->SendMessages(absl::StrCat("__keyevent@", cntx.db_index, "__:expired"), events);
+    }
     events.clear();
   }
 
   return result;
 }
 
+void DbSlice::DeleteIndexedExpired(const Context& cntx, DeleteExpiredStats* result) {
+  // Bounds the latency of a heartbeat, the rest is deleted by the following ones.
+  constexpr size_t kMaxDeletionsPerStep = 1024;
+
+  if (owner_->IsReplica() || !expire_allowed_)
+    return;
+
+  auto& db = *db_arr_[cntx.db_index];
+  vector<string> keys;
+  db.expire_index->PopDue(cntx.time_now_ms, kMaxDeletionsPerStep, &keys);
+
+  for (const string& key : keys) {
+    uint64_t key_hash = db.prime.DoHash(key);
+    auto prime_it = db.prime.Find(key, key_hash);
+    if (!IsValid(prime_it) || !prime_it->second.HasExpire())
+      continue;
+
+    result->traversed++;
+    // Locked keys are retried by the following steps.
+    time_t at = ExpireTime(db.expire.Find(key, key_hash));
+    if (time_t(cntx.time_now_ms) < at || !CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key)) {
+      db.expire_index->Add(key, at);
+      continue;
+    }
+
+    ExpireIfNeeded(cntx, prime_it, key_hash);
+    ++result->deleted;
+  }
+}
+
+void DbSlice::TrackFieldExpiry(DbIndex db_ind, string_view key, uint32_t at_sec) {
+  db_arr_[db_ind]->field_expire_index.Add(key, at_sec);
+}
+
+void DbSlice::TrackFieldExpiry(DbIndex db_ind, string_view key, const PrimeValue& pv) {
+  if (const DenseSet* members = MembersOf(pv); members && members->ExpirationUsed())
+    TrackFieldExpiry(db_ind, key);
+}
+
+size_t DbSlice::DeleteExpiredFieldsStep(const Context& cntx, uint32_t budget) {
+  // Every visited key costs as much as this many buckets.
+  constexpr uint32_t kKeyCost = 16;
+
+  if (owner_->IsReplica() || !expire_allowed_)
+    return 0;
+
+  auto& index = db_arr_[cntx.db_index]->field_expire_index;
+  uint32_t now_sec = MemberTimeSeconds(cntx.time_now_ms);
+  size_t deleted = 0;
+
+  while (budget > kKeyCost) {
+    auto next = index.NextDue(now_sec);
+    if (!next)
+      break;
+
+    string key{*next};
+    budget -= kKeyCost;
+
+    // Locked keys are retried by the following steps.
+    if (!CheckLock(IntentLock::EXCLUSIVE, cntx.db_index, key)) {
+      index.Reschedule(key, now_sec + 1);
+      continue;
+    }
+
+    DenseSet* members = nullptr;
+    if (auto it = db_arr_[cntx.db_index]->prime.Find(key); IsValid(it))
+      members = MembersOf(it->second);
+
+    // The key was deleted or replaced since it was tracked.
+    if (!members || !members->ExpirationUsed()) {
+      index.Remove(key);
+      continue;
+    }
+
+    auto res = FindMutable(cntx, key);
+    if (!IsValid(res.it)) {  // the key itself expired.
+      index.Remove(key);
+      continue;
+    }
+
+    FieldExpireIndex::State* state = index.Find(key);
+    if (state->cursor == 0) {
+      state->pass_min = UINT32_MAX;
+      state->pass_buckets = members->BucketCount();
+    }
+
+    size_t size = members->UpperBoundSize();
+    uint32_t start = state->cursor;
+    members->set_time(now_sec);
+    state->cursor = members->ExpireStep(start, budget, &state->pass_min);
+
+    size_t end = state->cursor ? state->cursor : max<size_t>(start, members->BucketCount());
+    budget -= min<size_t>(budget, end - start);
+    deleted += size - members->UpperBoundSize();
+
+    if (members->UpperBoundSize() == 0) {
+      res.post_updater.Run();
+      if (auto journal = owner_->journal(); journal) {
+        RecordExpiry(cntx.db_index, key);
+      }
+      Del(cntx.db_index, res.it);
+      index.Remove(key);
+    } else if (state->cursor) {
+      // Continues the pass after the keys that are due earlier.
+      index.Reschedule(key, now_sec);
+    } else if (state->pass_buckets != members->BucketCount()) {
+      // The set grew during the pass, so the pass could miss some of the members.
+      index.Reschedule(key, now_sec);
+    } else if (state->pass_min == UINT32_MAX) {
+      index.Remove(key);
+    } else {
+      index.Reschedule(key, state->pass_min);
+    }
+  }
+
+  events_.expired_fields += deleted;
+  return deleted;
+}
+
 int32_t DbSlice::GetNextSegmentForEviction(int32_t segment_id, DbIndex db_ind) const {
   // wraps around if we reached the end
   return db_arr_[db_ind]->prime.NextSeg((size_t)segment_id) %
          db_arr_[db_ind]->prime.GetSegmentCount();
 }
 
-void DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes) {
+unsigned DbSlice::PresplitStep(DbIndex db_ind) {
+  // Bounds the latency of a heartbeat, every visited segment is a scan of its buckets.
+  constexpr unsigned kMaxVisitsPerStep = 128;
+
+  double max_fill = GetFlag(FLAGS_table_presplit_fill).value;
+  if (max_fill <= 0 || caching_mode_)
+    return 0;
+
+  bool apply_memory_limit =
+      !owner_->IsReplica() && !(ServerState::tlocal()->gstate() == GlobalState::LOADING);
+  PrimeEvictionPolicy evp{DbContext{db_ind, GetCurrentTimeMs()},
+                          false,
+                          ssize_t(memory_budget_),
+                          ssize_t(soft_budget_limit_),
+                          this,
+                          apply_memory_limit};
+
+  // Serializes the buckets that are about to move, as is done for inserts.
+  FiberAtomicGuard fg;
+  uint64_t ver_threshold = change_cb_.empty() ? 0 : change_cb_.back().first;
+  auto split_cb = [&](PrimeTable::bucket_iterator bit) { CallChangeCallbacks(db_ind, bit); };
+
+  auto& db = *db_arr_[db_ind];
+  unsigned splits = db.prime.SplitFilledSegments(max_fill, kMaxVisitsPerStep, ver_threshold,
+                                                 &db.presplit_cursor, evp, split_cb);
+  memory_budget_ = evp.mem_budget();
+  return splits;
+}
+
+size_t DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes,
+                                        size_t max_evictions) {
   DCHECK(!owner_->IsReplica());
   if ((!caching_mode_) || !expire_allowed_ || !GetFlag(FLAGS_enable_heartbeat_eviction))
-    return;
+    return 0;
 
-  auto max_eviction_per_hb = GetFlag(FLAGS_max_eviction_per_heartbeat);
   auto max_segment_to_consider = GetFlag(FLAGS_max_segment_to_consider);
 
   auto time_start = absl::GetCurrentTimeNanos();
@@ -1215,6 +1719,11 @@ void DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes
   bool record_keys = owner_->journal() != nullptr || expired_keys_events_recording_;
   vector<string> keys_to_journal;
 
+  // With tiering, values are demoted to disk instead of being deleted, the keys stay in memory.
+  TieredStorage* tiered_storage = owner_->tiered_storage();
+  size_t demotion_budget = tiered_storage ? tiered_storage->DemotionBudget() : 0;
+  vector<string> keys_to_demote;
+
   {
     FiberAtomicGuard guard;
     for (int32_t slot_id = num_slots - 1; slot_id >= 0; --slot_id) {
@@ -1241,6 +1750,18 @@ void DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes
           if (lt.Find(LockTag(key)).has_value())
             continue;
 
+          const PrimeValue& pv = evict_it->second;
+          if (pv.HasIoPending())  // already being demoted
+            continue;
+
+          // Stashing may block, so it is done after the loop. The memory of demoted values is
+          // freed only once their stash completes, so they don't count towards the goals.
+          if (keys_to_demote.size() < demotion_budget && !pv.IsExternal() &&
+              tiered_storage->ShouldStash(pv)) {
+            keys_to_demote.emplace_back(key);
+            continue;
+          }
+
           if (record_keys)
             keys_to_journal.emplace_back(key);
 
@@ -1249,7 +1770,7 @@ void DbSlice::FreeMemWithEvictionStep(DbIndex db_ind, size_t increase_goal_bytes
 
           used_memory_after = owner_->UsedMemory();
           // returns when whichever condition is met first
-          if ((evicted == max_eviction_per_hb) ||
+          if ((evicted == max_evictions) ||
               (used_memory_before - used_memory_after >= increase_goal_bytes))
             goto finish;
         }
@@ -1264,23 +1785,30 @@ finish:
     if (auto journal = owner_->journal(); journal)
       RecordExpiry(db_ind, key);
 
-    if (expired_keys_events_recording_)
+    if (ShouldRecordKeyEvent(key))
       db_table->expired_keys_events_.emplace_back(key);
   }
 
+  for (string_view key : keys_to_demote) {
+    auto it = db_table->prime.Find(key);
+    if (IsValid(it) && !it->second.IsExternal() && !it->second.HasIoPending())
+      tiered_storage->Stash(db_ind, key, &it->second);
+  }
+
   auto time_finish = absl::GetCurrentTimeNanos();
   events_.evicted_keys += evicted;
   DVLOG(2) << "Memory usage before eviction: " << used_memory_before;
   DVLOG(2) << "Memory usage after eviction: " << used_memory_after;
-  DVLOG(2) << "Number of keys evicted / max eviction per hb: " << evicted << "/"
-           << max_eviction_per_hb;
+  DVLOG(2) << "Number of keys evicted / max evictions: " << evicted << "/" << max_evictions;
+  DVLOG(2) << "Number of keys demoted: " << keys_to_demote.size();
   DVLOG(2) << "Eviction time (us): " << (time_finish - time_start) / 1000;
+  return evicted;
 }
 
 void DbSlice::CreateDb(DbIndex db_ind) {
   auto& db = db_arr_[db_ind];
   if (!db) {
-    db.reset(new DbTable{owner_->memory_resource(), db_ind});
+    db.reset(new DbTable{owner_->table_memory_resource(), db_ind});
   }
 }
 
@@ -1371,11 +1899,46 @@ size_t DbSlice::EvictObjects(size_t memory_to_free, Iterator it, DbTable* table)
   return freed_memory_fun();
 };
 
+size_t DbSlice::KeyChangeSlot(string_view key) {
+  return CompactObj::HashCode(key) % DbTable::kKeyChangeSlots;
+}
+
+void DbSlice::CountKeyChange(DbTable& db, string_view key) {
+  if (db.key_changes)
+    ++db.key_changes[KeyChangeSlot(key)];
+}
+
 void DbSlice::RegisterWatchedKey(DbIndex db_indx, std::string_view key,
                                  ConnectionState::ExecInfo* exec_info) {
   db_arr_[db_indx]->watched_keys[key].push_back(exec_info);
 }
 
+uint64_t DbSlice::WatchKey(const Context& cntx, string_view key,
+                           ConnectionState::ExecInfo* exec_info) {
+  if (auto res = FindReadOnly(cntx, key); IsValid(res.it)) {
+    DbTable& db = *db_arr_[cntx.db_index];
+    if (!db.key_changes)
+      db.key_changes.reset(new uint32_t[DbTable::kKeyChangeSlots]());
+    return uint64_t(db.key_changes[KeyChangeSlot(key)]) + 1;
+  }
+
+  RegisterWatchedKey(cntx.db_index, key, exec_info);
+  return 0;
+}
+
+bool DbSlice::IsWatchedKeyUnchanged(const Context& cntx, string_view key,
+                                    uint64_t version) const {
+  auto res = FindReadOnly(cntx, key);
+  if (version == 0)  // registered, its creation dirtied exec_info.
+    return !IsValid(res.it);
+
+  // Deleted keys, including expired ones, are changed. Keys that were deleted and created again
+  // counted their creation. A flushed table has no counters.
+  const DbTable& db = *db_arr_[cntx.db_index];
+  return IsValid(res.it) && db.key_changes &&
+         uint64_t(db.key_changes[KeyChangeSlot(key)]) + 1 == version;
+}
+
 void DbSlice::UnregisterConnectionWatches(const ConnectionState::ExecInfo* exec_info) {
   for (const auto& [db_indx, key] : exec_info->watched_keys) {
     auto& watched_keys = db_arr_[db_indx]->watched_keys;
@@ -1444,15 +2007,50 @@ void DbSlice::ResetEvents() {
   events_ = {};
 }
 
-void DbSlice::SendInvalidationTrackingMessage(std::string_view key) {
-  if (client_tracking_map_.empty())
+void DbSlice::TrackPrefix(const facade::Connection::WeakRef& conn_ref, std::string_view prefix) {
+  auto [it, inserted] = prefix_tracking_map_.try_emplace(prefix);
+  if (inserted)
+    ++tracking_prefix_lens_[prefix.size()];
+  it->second.insert(conn_ref);
+}
+
+void DbSlice::UntrackPrefix(const facade::Connection::WeakRef& conn_ref, std::string_view prefix) {
+  auto it = prefix_tracking_map_.find(prefix);
+  if (it == prefix_tracking_map_.end())
     return;
 
-  auto it = client_tracking_map_.find(key);
-  if (it == client_tracking_map_.end()) {
+  it->second.erase(conn_ref);
+  if (!it->second.empty())
     return;
+
+  prefix_tracking_map_.erase(it);
+  auto len_it = tracking_prefix_lens_.find(prefix.size());
+  DCHECK(len_it != tracking_prefix_lens_.end());
+  if (--len_it->second == 0)
+    tracking_prefix_lens_.erase(len_it);
+}
+
+void DbSlice::SendInvalidationTrackingMessage(std::string_view key) {
+  if (client_tracking_map_.empty() && prefix_tracking_map_.empty())
+    return;
+
+  absl::flat_hash_set<facade::Connection::WeakRef, Hash> client_set;
+  if (auto it = client_tracking_map_.find(key); it != client_tracking_map_.end()) {
+    client_set.insert(it->second.begin(), it->second.end());
+    // remove this key from the tracking table as the key no longer exists
+    client_tracking_map_.erase(it);
+  }
+
+  for (const auto& [len, _] : tracking_prefix_lens_) {
+    if (len > key.size())
+      break;
+    if (auto it = prefix_tracking_map_.find(key.substr(0, len)); it != prefix_tracking_map_.end())
+      client_set.insert(it->second.begin(), it->second.end());
   }
-  auto& client_set = it->second;
+
+  if (client_set.empty())
+    return;
+
   // Notify all the clients. We copy key because we dispatch briefly below and
   // we need to preserve its lifetime
   // TODO this key is further copied within DispatchFiber. Fix this.
@@ -1465,21 +2063,21 @@ void DbSlice::SendInvalidationTrackingMessage(std::string_view key) {
       auto* conn = client.Get();
       auto* cntx = static_cast<ConnectionContext*>(conn->cntx());
       if (cntx && cntx->conn_state.tracking_info_.IsTrackingOn()) {
-        conn->SendInvalidationMessageAsync({key});
+        conn->SendInvalidationMessageAsync({{key}});
       }
     }
   };
   shard_set->pool()->DispatchBrief(std::move(cb));
-  // remove this key from the tracking table as the key no longer exists
-  client_tracking_map_.erase(key);
 }
 
 void DbSlice::PerformDeletion(PrimeIterator del_it, DbTable* table) {
   return PerformDeletion(Iterator::FromPrime(del_it), table);
 }
 
-void DbSlice::PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* table) {
+void DbSlice::PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* table, bool lazy,
+                              PrimeValue* detached) {
   if (!exp_it.is_done()) {
+    table->UpdateExpireIndex(del_it.key(), ExpireTime(exp_it), 0);
     table->expire.Erase(exp_it.GetInnerIt());
   }
 
@@ -1511,20 +2109,28 @@ void DbSlice::PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* tabl
   if (cluster::IsClusterEnabled()) {
     cluster::SlotId sid = cluster::KeySlot(del_it.key());
     table->slots_stats[sid].key_count -= 1;
+    if (table->HasSlotIndex())
+      table->slot_keys[sid].erase(del_it.key());
   }
 
+  if (detached)
+    *detached = std::move(del_it->second);
+  else if (lazy && IsLazyFreeable(pv))
+    shard_owner()->FreeLazily(std::move(del_it->second));
+
+  hot_values_.Invalidate(table->index, del_it.key());
   table->prime.Erase(del_it.GetInnerIt());
   SendInvalidationTrackingMessage(del_it.key());
 }
 
-void DbSlice::PerformDeletion(Iterator del_it, DbTable* table) {
+void DbSlice::PerformDeletion(Iterator del_it, DbTable* table, bool lazy, PrimeValue* detached) {
   ExpIterator exp_it;
   if (del_it->second.HasExpire()) {
     exp_it = ExpIterator::FromPrime(table->expire.Find(del_it->first));
     DCHECK(!exp_it.is_done());
   }
 
-  PerformDeletion(del_it, exp_it, table);
+  PerformDeletion(del_it, exp_it, table, lazy, detached);
 }
 
 void DbSlice::OnCbFinish() {
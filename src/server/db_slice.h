@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <absl/container/btree_map.h>
+#include <absl/strings/match.h>
+
 #include "core/mi_memory_resource.h"
 #include "core/string_or_view.h"
 #include "facade/dragonfly_connection.h"
@@ -11,6 +14,9 @@
 #include "server/cluster/slot_set.h"
 #include "server/common.h"
 #include "server/conn_context.h"
+#include "server/frequency_sketch.h"
+#include "server/hot_values.h"
+#include "server/key_event_log.h"
 #include "server/table.h"
 #include "util/fibers/fibers.h"
 
@@ -31,6 +37,10 @@ struct DbStats : public DbTableStats {
   // Memory used by dictionaries.
   size_t table_mem_usage = 0;
 
+  // Number of segment splits of the dictionaries and the time they took.
+  size_t table_splits = 0;
+  size_t table_split_usec = 0;
+
   using DbTableStats::operator+=;
   using DbTableStats::operator=;
 
@@ -44,6 +54,7 @@ struct SliceEvents {
   // evictions that were performed when we have a negative memory budget.
   size_t hard_evictions = 0;
   size_t expired_keys = 0;
+  size_t expired_fields = 0;  // members of sets and hashes deleted by the active expiry.
   size_t garbage_checked = 0;
   size_t garbage_collected = 0;
   size_t stash_unloaded = 0;
@@ -179,6 +190,11 @@ class DbSlice {
     std::vector<DbStats> db_stats;
     SliceEvents events;
     size_t small_string_bytes = 0;
+    size_t small_string_table_full = 0;
+    size_t key_prefix_bytes = 0;
+    size_t compressed_string_bytes = 0;
+    size_t compressed_string_raw_bytes = 0;
+    size_t pending_rehash_buckets = 0;  // of the growing sets, hashes and sorted sets
   };
 
   using Context = DbContext;
@@ -231,6 +247,9 @@ class DbSlice {
   // Returns slot statistics for db 0.
   SlotStats GetSlotStats(cluster::SlotId sid) const;
 
+  // Updates SlotStats::ops_per_sec of db 0, at most once a second.
+  void UpdateSlotRates(uint64_t now_ms);
+
   void UpdateExpireBase(uint64_t now, unsigned generation) {
     expire_base_[generation & 1] = now;
   }
@@ -250,6 +269,22 @@ class DbSlice {
     return bytes_per_object_;
   }
 
+  // Chooses the keys that are evicted in cache mode when a segment is full.
+  enum class EvictionPolicy : uint8_t {
+    LRU,  // by the bucket position, items are shifted to the end as others are accessed.
+    LFU,  // the least frequently accessed by frequency_sketch().
+    TTL,  // the soonest to expire, like LRU for keys without expiry.
+  };
+
+  EvictionPolicy eviction_policy() const {
+    return eviction_policy_;
+  }
+
+  // Recent access frequencies of keys, only tracked by the LFU eviction policy in cache mode.
+  const FrequencySketch* frequency_sketch() const {
+    return freq_sketch_.get();
+  }
+
   // returns absolute time of the expiration.
   time_t ExpireTime(const ExpConstIterator& it) const {
     return ExpireTime(it.GetInnerIt());
@@ -286,6 +321,11 @@ class DbSlice {
   OpResult<ConstIterator> FindReadOnly(const Context& cntx, std::string_view key,
                                        unsigned req_obj_type) const;
 
+  // Prefetches PrimeTable buckets of every `step`-th argument in args, so that the following
+  // lookups of a multi-key command do not take a cache miss per key. step=2 is used for
+  // key-value argument lists.
+  void PrefetchKeys(DbIndex db_ind, const ShardArgs& args, unsigned step = 1) const;
+
   struct AddOrFindResult {
     Iterator it;
     ExpIterator exp_it;
@@ -297,6 +337,10 @@ class DbSlice {
 
   OpResult<AddOrFindResult> AddOrFind(const Context& cntx, std::string_view key);
 
+  // Same as AddOrFind, but an existing entry is only looked up: the update callbacks do not run
+  // for it, and it must not be modified.
+  OpResult<AddOrFindResult> AddOrSkip(const Context& cntx, std::string_view key);
+
   // Same as AddOrSkip, but overwrites in case entry exists.
   OpResult<AddOrFindResult> AddOrUpdate(const Context& cntx, std::string_view key, PrimeValue obj,
                                         uint64_t expire_at_ms);
@@ -315,6 +359,9 @@ class DbSlice {
   // Adds expiry information.
   void AddExpire(DbIndex db_ind, Iterator main_it, uint64_t at);
 
+  // Changes the expiry time of an entry that already has expiry to at.
+  void SetExpireTime(DbIndex db_ind, ExpIterator exp_it, uint64_t at);
+
   // Removes the corresponing expiry information if exists.
   // Returns true if expiry existed (and removed).
   bool RemoveExpire(DbIndex db_ind, Iterator main_it);
@@ -329,7 +376,12 @@ class DbSlice {
   // Creates a database with index `db_ind`. If such database exists does nothing.
   void ActivateDb(DbIndex db_ind);
 
-  bool Del(DbIndex db_ind, Iterator it);
+  // With lazy, a large value is freed in the background by the shard, see --lazyfree_threshold.
+  bool Del(DbIndex db_ind, Iterator it, bool lazy = false);
+
+  // Deletes the entry like Del, but moves its value to *dest instead of freeing it.
+  // The value is still allocated in the heap of this shard and must be freed here.
+  void Detach(DbIndex db_ind, Iterator it, PrimeValue* dest);
 
   constexpr static DbIndex kDbAll = 0xFFFF;
 
@@ -358,6 +410,9 @@ class DbSlice {
     return CheckLock(mode, dbid, LockTag(key).Fingerprint());
   }
 
+  // Returns true if the key is locked under m only by the caller, which has already acquired it.
+  bool CheckHeldLock(IntentLock::Mode mode, DbIndex dbid, uint64_t fp) const;
+
   size_t db_array_size() const {
     return db_arr_.size();
   }
@@ -422,9 +477,29 @@ class DbSlice {
     size_t survivor_ttl_sum = 0;  // total sum of ttl of survivors (traversed - deleted).
   };
 
-  // Deletes some amount of possible expired items.
+  // Deletes some amount of possible expired items. With the expiry index of the table it deletes
+  // the keys that are due, otherwise it samples count buckets of the expire table.
   DeleteExpiredStats DeleteExpiredStep(const Context& cntx, unsigned count);
-  void FreeMemWithEvictionStep(DbIndex db_indx, size_t increase_goal_bytes);
+  // Schedules the set or hash under key for the active expiry of its members at at_sec, in
+  // member time seconds, or right away with 0 if the expiry of its members is not known.
+  void TrackFieldExpiry(DbIndex db_ind, std::string_view key, uint32_t at_sec = 0);
+
+  // Tracks key if pv is a set or hash with expiring members.
+  void TrackFieldExpiry(DbIndex db_ind, std::string_view key, const PrimeValue& pv);
+
+  // Deletes the expired members of the tracked sets and hashes that are due, visiting up to
+  // about budget buckets of their tables. Empty keys are deleted. Returns the deleted members.
+  size_t DeleteExpiredFieldsStep(const Context& cntx, uint32_t budget);
+
+  // Evicts up to max_evictions items or until increase_goal_bytes were freed.
+  // With tiered storage, values that can be stashed are demoted to disk instead of being deleted.
+  // Returns the number of evicted items.
+  size_t FreeMemWithEvictionStep(DbIndex db_indx, size_t increase_goal_bytes,
+                                 size_t max_evictions);
+
+  // Splits some of the prime table segments filled above --table_presplit_fill, so that bursts
+  // of inserts do not pay for the splits. Returns the number of segments split.
+  unsigned PresplitStep(DbIndex db_ind);
   void ScheduleForOffloadStep(DbIndex db_indx, size_t increase_goal_bytes);
 
   int32_t GetNextSegmentForEviction(int32_t segment_id, DbIndex db_ind) const;
@@ -437,6 +512,16 @@ class DbSlice {
     caching_mode_ = 1;
   }
 
+  // The log of the keyspace events, null unless the log sink is configured.
+  const KeyEventLog* key_event_log() const {
+    return key_event_log_.get();
+  }
+
+  // Counts the reads served by the copies of the hottest values since the last call, and
+  // refreshes the copies that are served by all threads. Not used in caching mode, because
+  // reads of the copies do not bump the keys.
+  void RefreshHotValues(uint64_t now_ms);
+
   // Test hook to inspect last locked keys.
   const auto& TEST_GetLastLockedFps() const {
     return uniq_fps_;
@@ -445,6 +530,16 @@ class DbSlice {
   void RegisterWatchedKey(DbIndex db_indx, std::string_view key,
                           ConnectionState::ExecInfo* exec_info);
 
+  // Watches key for EXEC. Returns a non zero version that changes with every write of the key and
+  // is compared by EXEC instead of tracking the changes. A missing key has no version, so
+  // exec_info is registered to be dirtied upon its creation and 0 is returned.
+  uint64_t WatchKey(const Context& cntx, std::string_view key,
+                    ConnectionState::ExecInfo* exec_info);
+
+  // Returns whether key was not changed since WatchKey returned version. Writes of the keys that
+  // share its change counter are reported as changes too.
+  bool IsWatchedKeyUnchanged(const Context& cntx, std::string_view key, uint64_t version) const;
+
   // Unregisted all watched key entries for connection.
   void UnregisterConnectionWatches(const ConnectionState::ExecInfo* exec_info);
 
@@ -465,8 +560,13 @@ class DbSlice {
     client_tracking_map_[key].insert(conn_ref);
   }
 
+  // BCAST tracking: the client is notified about changes of all keys that start with prefix.
+  void TrackPrefix(const facade::Connection::WeakRef& conn_ref, std::string_view prefix);
+  void UntrackPrefix(const facade::Connection::WeakRef& conn_ref, std::string_view prefix);
+
   // Delete a key referred by its iterator.
-  void PerformDeletion(Iterator del_it, DbTable* table);
+  void PerformDeletion(Iterator del_it, DbTable* table, bool lazy = false,
+                       PrimeValue* detached = nullptr);
   void PerformDeletion(PrimeIterator del_it, DbTable* table);
 
   void LockChangeCb() const {
@@ -499,7 +599,13 @@ class DbSlice {
   void ClearEntriesOnFlush(absl::Span<const DbIndex> indices, const DbTableArray& db_arr,
                            bool async);
 
-  void PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* table);
+  void PerformDeletion(Iterator del_it, ExpIterator exp_it, DbTable* table, bool lazy = false,
+                       PrimeValue* detached = nullptr);
+
+  bool DelInternal(DbIndex db_ind, Iterator it, bool lazy, PrimeValue* detached);
+
+  // Deletes the keys of the expiry index that are due, see DeleteExpiredStep.
+  void DeleteIndexedExpired(const Context& cntx, DeleteExpiredStats* result);
 
   // Send invalidation message to the clients that are tracking the change to a key.
   void SendInvalidationTrackingMessage(std::string_view key);
@@ -519,7 +625,11 @@ class DbSlice {
 
   PrimeItAndExp ExpireIfNeeded(const Context& cntx, PrimeIterator it) const;
 
-  OpResult<AddOrFindResult> AddOrFindInternal(const Context& cntx, std::string_view key);
+  // key_hash is the hash of it->first, shared by the prime and expire tables.
+  PrimeItAndExp ExpireIfNeeded(const Context& cntx, PrimeIterator it, uint64_t key_hash) const;
+
+  OpResult<AddOrFindResult> AddOrFindInternal(const Context& cntx, std::string_view key,
+                                              bool update_existing = true);
 
   OpResult<PrimeItAndExp> FindInternal(const Context& cntx, std::string_view key,
                                        std::optional<unsigned> req_obj_type,
@@ -527,6 +637,9 @@ class DbSlice {
   OpResult<ItAndUpdater> FindMutableInternal(const Context& cntx, std::string_view key,
                                              std::optional<unsigned> req_obj_type);
 
+  static size_t KeyChangeSlot(std::string_view key);
+  void CountKeyChange(DbTable& db, std::string_view key);
+
   uint64_t NextVersion() {
     return version_++;
   }
@@ -569,8 +682,25 @@ class DbSlice {
   // Registered by shard indices on when first document index is created.
   DocDeletionCallback doc_del_cb_;
 
+  bool ShouldRecordKeyEvent(std::string_view key) const {
+    return expired_keys_events_recording_ && absl::StartsWith(key, keyspace_events_prefix_);
+  }
+
   // Record whenever a key expired to DbTable::expired_keys_events_ for keyspace notifications
   bool expired_keys_events_recording_ = true;
+  std::string keyspace_events_prefix_;
+
+  // Receives the keyspace events instead of the pub/sub channels if the log sink is configured.
+  std::unique_ptr<KeyEventLog> key_event_log_;
+
+  EvictionPolicy eviction_policy_ = EvictionPolicy::LRU;
+  std::unique_ptr<FrequencySketch> freq_sketch_;
+
+  HotValues hot_values_;
+
+  // Total reads and writes of every slot at the last UpdateSlotRates.
+  std::vector<uint64_t> slot_ops_prev_;
+  uint64_t slot_rates_updated_ms_ = 0;
 
   struct Hash {
     size_t operator()(const facade::Connection::WeakRef& c) const {
@@ -593,10 +723,17 @@ class DbSlice {
 
   using AllocatorType = PMR_NS::polymorphic_allocator<std::pair<std::string, ConnectionHashSet>>;
 
-  absl::flat_hash_map<std::string, ConnectionHashSet,
-                      absl::container_internal::hash_default_hash<std::string>,
-                      absl::container_internal::hash_default_eq<std::string>, AllocatorType>
-      client_tracking_map_;
+  using TrackingMap =
+      absl::flat_hash_map<std::string, ConnectionHashSet,
+                          absl::container_internal::hash_default_hash<std::string>,
+                          absl::container_internal::hash_default_eq<std::string>, AllocatorType>;
+
+  TrackingMap client_tracking_map_;
+
+  // BCAST clients by prefix. Keys are matched by looking up each of their prefixes that
+  // has a length from tracking_prefix_lens_ (length -> number of prefixes).
+  TrackingMap prefix_tracking_map_;
+  absl::btree_map<size_t, unsigned> tracking_prefix_lens_;
 };
 
 inline bool IsValid(const DbSlice::Iterator& it) {
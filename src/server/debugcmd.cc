@@ -9,7 +9,9 @@ extern "C" {
 
 #include <absl/cleanup/cleanup.h>
 #include <absl/random/random.h>
+#include <absl/strings/ascii.h>
 #include <absl/strings/str_cat.h>
+#include <absl/strings/str_format.h>
 #include <zstd.h>
 
 #include <filesystem>
@@ -17,6 +19,7 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/string_map.h"
+#include "facade/cmd_arg_parser.h"
 #include "server/blocking_controller.h"
 #include "server/container_utils.h"
 #include "server/engine_shard_set.h"
@@ -127,9 +130,13 @@ tuple<const CommandId*, absl::InlinedVector<string, 5>> GeneratePopulateCommand(
   return {cid, args};
 }
 
-void DoPopulateBatch(string_view type, string_view prefix, size_t val_size, bool random_value,
-                     int32_t elements, const PopulateBatch& batch, ServerFamily* sf,
-                     ConnectionContext* cntx) {
+// Uniform in [min, max], or min if max is not larger.
+uint32_t PickInRange(uint32_t min, uint32_t max, absl::InsecureBitGen* gen) {
+  return max > min ? absl::Uniform<uint32_t>(absl::IntervalClosed, *gen, min, max) : min;
+}
+
+void DoPopulateBatch(const DebugCmd::PopulateOptions& options, const PopulateBatch& batch,
+                     ServerFamily* sf, ConnectionContext* cntx) {
   boost::intrusive_ptr<Transaction> local_tx =
       new Transaction{sf->service().mutable_registry()->Find("EXEC")};
   local_tx->StartMultiNonAtomic();
@@ -138,18 +145,9 @@ void DoPopulateBatch(string_view type, string_view prefix, size_t val_size, bool
   absl::InlinedVector<MutableSlice, 5> args_view;
   facade::CapturingReplyBuilder crb;
   ConnectionContext local_cntx{cntx, stub_tx.get(), &crb};
+  const CommandId* expire_cid = sf->service().mutable_registry()->Find("EXPIRE");
 
-  absl::InsecureBitGen gen;
-  for (unsigned i = 0; i < batch.sz; ++i) {
-    string key = absl::StrCat(prefix, ":", batch.index[i]);
-
-    auto [cid, args] = GeneratePopulateCommand(type, std::move(key), val_size, random_value,
-                                               elements, *sf->service().mutable_registry(), &gen);
-    if (!cid) {
-      LOG_EVERY_N(WARNING, 10'000) << "Unable to find command, was it renamed?";
-      break;
-    }
-
+  auto invoke = [&](const CommandId* cid, absl::Span<string> args) {
     args_view.clear();
     for (auto& arg : args) {
       args_view.push_back(absl::MakeSpan(arg));
@@ -162,6 +160,28 @@ void DoPopulateBatch(string_view type, string_view prefix, size_t val_size, bool
     stub_tx->InitByArgs(local_cntx.conn_state.db_index, args_span);
 
     sf->service().InvokeCmd(cid, args_span, &local_cntx);
+  };
+
+  absl::InsecureBitGen gen;
+  for (unsigned i = 0; i < batch.sz; ++i) {
+    string key = absl::StrCat(options.prefix, ":", batch.index[i]);
+    uint32_t val_size = PickInRange(options.val_size, options.max_val_size, &gen);
+    uint32_t elements = PickInRange(options.elements, options.max_elements, &gen);
+
+    auto [cid, args] =
+        GeneratePopulateCommand(options.type, key, val_size, options.populate_random_values,
+                                elements, *sf->service().mutable_registry(), &gen);
+    if (!cid) {
+      LOG_EVERY_N(WARNING, 10'000) << "Unable to find command, was it renamed?";
+      break;
+    }
+    invoke(cid, absl::MakeSpan(args));
+
+    if (options.expire_fraction > 0 && absl::Bernoulli(gen, options.expire_fraction)) {
+      uint32_t ttl = PickInRange(1, options.expire_sec, &gen);
+      string expire_args[] = {std::move(key), absl::StrCat(ttl)};
+      invoke(expire_cid, absl::MakeSpan(expire_args));
+    }
   }
 
   local_cntx.Inject(nullptr);
@@ -392,17 +412,25 @@ void DebugCmd::Run(CmdArgList args) {
         "    If SLOTS is specified then create keys only in given slots range.",
         "    TYPE specifies data type (must be STRING/LIST/SET/HSET/ZSET/JSON), default STRING.",
         "    ELEMENTS specifies how many sub elements if relevant (like entries in a list / set).",
+        "    MAXSIZE / MAXELEMENTS choose the size / elements of every key uniformly between",
+        "    <size> / ELEMENTS and the given maximum.",
+        "    EXPIRE <fraction> <seconds> sets a ttl of up to <seconds> on that fraction of keys.",
         "OBJHIST",
         "    Prints histogram of object sizes.",
         "STACKTRACE",
         "    Prints the stacktraces of all current fibers to the logs.",
         "SHARDS",
-        "    Prints memory usage and key stats per shard, as well as min/max indicators.",
+        "    Prints memory usage, key and cpu stats per shard, as well as min/max indicators.",
+        "    With --shard_cpu_stats also lists the commands that took most of the cpu time.",
         "TX",
         "    Performs transaction analysis per shard.",
         "TRAFFIC <path> | [STOP]"
         "    Starts traffic logging to the specified path. If path is not specified,"
         "    traffic logging is stopped.",
+        "TRACE [JSON] [<count>] | RESET",
+        "    Shows the latest <count> commands sampled with --trace_sample_rate, newest first,",
+        "    with the usec offsets of the stages they passed through. JSON exports them as",
+        "    OpenTelemetry spans with an event per stage. RESET clears the traces.",
         "HELP",
         "    Prints this help.",
     };
@@ -462,6 +490,10 @@ void DebugCmd::Run(CmdArgList args) {
     return LogTraffic(args.subspan(1));
   }
 
+  if (subcmd == "TRACE") {
+    return Trace(args.subspan(1));
+  }
+
   string reply = UnknownSubCmd(subcmd, "DEBUG");
   return cntx_->SendError(reply, kSyntaxErrType);
 }
@@ -616,6 +648,30 @@ optional<DebugCmd::PopulateOptions> DebugCmd::ParsePopulateArgs(CmdArgList args)
         cntx_->SendError(kSyntaxErr);
         return nullopt;
       }
+    } else if (str == "MAXELEMENTS" || str == "MAXSIZE") {
+      if (args.size() < index + 2) {
+        cntx_->SendError(kSyntaxErr);
+        return nullopt;
+      }
+      uint32_t* dest = str == "MAXSIZE" ? &options.max_val_size : &options.max_elements;
+      if (!absl::SimpleAtoi(ArgS(args, ++index), dest)) {
+        cntx_->SendError(kUintErr);
+        return nullopt;
+      }
+    } else if (str == "EXPIRE") {
+      if (args.size() < index + 3) {
+        cntx_->SendError(kSyntaxErr);
+        return nullopt;
+      }
+      if (!absl::SimpleAtod(ArgS(args, ++index), &options.expire_fraction) ||
+          options.expire_fraction < 0 || options.expire_fraction > 1) {
+        cntx_->SendError("fraction must be between 0 and 1");
+        return nullopt;
+      }
+      if (!absl::SimpleAtoi(ArgS(args, ++index), &options.expire_sec) || options.expire_sec == 0) {
+        cntx_->SendError(kUintErr);
+        return nullopt;
+      }
     } else if (str == "SLOTS") {
       if (args.size() < index + 3) {
         cntx_->SendError(kSyntaxErr);
@@ -731,8 +787,7 @@ void DebugCmd::PopulateRangeFiber(uint64_t from, uint64_t num_of_keys,
 
     if (shard_batch.sz == 32) {
       ess.Add(sid, [this, index, options, shard_batch] {
-        DoPopulateBatch(options.type, options.prefix, options.val_size,
-                        options.populate_random_values, options.elements, shard_batch, &sf_, cntx_);
+        DoPopulateBatch(options, shard_batch, &sf_, cntx_);
         if (index % 50 == 0) {
           ThisFiber::Yield();
         }
@@ -744,8 +799,7 @@ void DebugCmd::PopulateRangeFiber(uint64_t from, uint64_t num_of_keys,
   }
 
   ess.AwaitRunningOnShardQueue([&](EngineShard* shard) {
-    DoPopulateBatch(options.type, options.prefix, options.val_size, options.populate_random_values,
-                    options.elements, ps[shard->shard_id()], &sf_, cntx_);
+    DoPopulateBatch(options, ps[shard->shard_id()], &sf_, cntx_);
     // Debug populate does not use transaction framework therefore we call OnCbFinish manually
     // after running the callback
     // Note that running debug populate while running flushall/db can cause dcheck fail because the
@@ -792,6 +846,87 @@ void DebugCmd::LogTraffic(CmdArgList args) {
   cntx_->SendOk();
 }
 
+void DebugCmd::Trace(CmdArgList args) {
+  CmdArgParser parser(args);
+  if (parser.Check("RESET").IgnoreCase()) {
+    shard_set->pool()->AwaitBrief(
+        [](unsigned, auto*) { ServerState::tlocal()->GetTraceLog().Reset(); });
+    return cntx_->SendOk();
+  }
+
+  bool json = static_cast<bool>(parser.Check("JSON").IgnoreCase());
+  size_t count = parser.HasNext() ? parser.Next<size_t>() : 10;
+  if (auto err = parser.Error(); err || parser.HasNext())
+    return cntx_->SendError(err ? err->MakeReply() : facade::ErrorReply{kSyntaxErr});
+
+  fb2::Mutex mu;
+  vector<TraceEntry> entries;
+  shard_set->pool()->AwaitFiberOnAll([&](auto*) {
+    const auto& log = ServerState::tlocal()->GetTraceLog().Entries();
+    lock_guard lk(mu);
+    entries.insert(entries.end(), log.begin(), log.end());
+  });
+
+  sort(entries.begin(), entries.end(),
+       [](const auto& l, const auto& r) { return l.unix_ts_nsec > r.unix_ts_nsec; });
+  entries.resize(min(entries.size(), count));
+
+  // Wall time of a stage, derived from the wall time of the DISPATCHED stage.
+  auto unix_ns = [](const TraceEntry& entry, unsigned stage) {
+    return entry.unix_ts_nsec + entry.ts[stage] - entry.ts[CommandTrace::DISPATCHED];
+  };
+  auto first_stage = [](const TraceEntry& entry) {
+    return entry.ts[CommandTrace::QUEUED] ? CommandTrace::QUEUED : CommandTrace::DISPATCHED;
+  };
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  if (json) {
+    string res = R"({"resourceSpans":[{"resource":{"attributes":[{"key":"service.name",)"
+                 R"("value":{"stringValue":"dragonfly"}}]},"scopeSpans":[{"spans":[)";
+    for (size_t i = 0; i < entries.size(); ++i) {
+      const TraceEntry& entry = entries[i];
+      StrAppend(&res, i ? "," : "", R"({"name":")", entry.command, R"(","startTimeUnixNano":")",
+                unix_ns(entry, first_stage(entry)), R"(","endTimeUnixNano":")",
+                unix_ns(entry, CommandTrace::REPLIED),
+                R"(","attributes":[{"key":"client.id","value":{"intValue":")", entry.client_id,
+                R"("}}],"events":[)");
+      bool first_event = true;
+      for (unsigned stage = 0; stage < CommandTrace::NUM_STAGES; ++stage) {
+        if (entry.ts[stage] == 0)
+          continue;
+        StrAppend(&res, first_event ? "" : ",", R"({"name":")",
+                  CommandTrace::StageName(CommandTrace::Stage(stage)), R"(","timeUnixNano":")",
+                  unix_ns(entry, stage), R"("})");
+        first_event = false;
+      }
+      res.append("]}");
+    }
+    res.append("]}]}]}");
+    return rb->SendBulkString(res);
+  }
+
+  rb->StartArray(entries.size());
+  for (const TraceEntry& entry : entries) {
+    uint64_t start = entry.ts[first_stage(entry)];
+    unsigned num_stages = 0;
+    for (uint64_t ts : entry.ts)
+      num_stages += ts != 0;
+
+    rb->StartArray(5);
+    rb->SendBulkString(entry.command);
+    rb->SendLong(entry.client_id);
+    rb->SendLong(unix_ns(entry, first_stage(entry)) / 1000);
+    rb->SendLong((entry.ts[CommandTrace::REPLIED] - start) / 1000);
+    rb->StartArray(num_stages * 2);
+    for (unsigned stage = 0; stage < CommandTrace::NUM_STAGES; ++stage) {
+      if (entry.ts[stage] == 0)
+        continue;
+      rb->SendBulkString(CommandTrace::StageName(CommandTrace::Stage(stage)));
+      rb->SendLong((entry.ts[stage] - start) / 1000);
+    }
+  }
+}
+
 void DebugCmd::Inspect(string_view key, CmdArgList args) {
   EngineShardSet& ess = *shard_set;
   ShardId sid = Shard(key, ess.size());
@@ -933,8 +1068,14 @@ void DebugCmd::Shards() {
     size_t key_count = 0;
     size_t expire_count = 0;
     size_t key_reads = 0;
+    size_t thread_cpu_usec = 0;
+    size_t cb_cpu_usec = 0;  // with --shard_cpu_stats.
+
+    // Commands that took most of the callback cpu time, with --shard_cpu_stats.
+    vector<pair<string, EngineShard::CmdCpuStats>> top_cpu;
   };
 
+  constexpr size_t kTopCpuCommands = 5;
   vector<ShardInfo> infos(shard_set->size());
   shard_set->RunBriefInParallel([&](EngineShard* shard) {
     auto slice_stats = shard->db_slice().GetStats();
@@ -946,6 +1087,20 @@ void DebugCmd::Shards() {
       stats.expire_count += db_stats.expire_count;
     }
     stats.key_reads = slice_stats.events.hits + slice_stats.events.misses;
+
+    timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    stats.thread_cpu_usec = ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    for (const auto& [name, cpu_stats] : shard->cmd_cpu_stats()) {
+      stats.cb_cpu_usec += cpu_stats.cpu_ns / 1000;
+      stats.top_cpu.emplace_back(name, cpu_stats);
+    }
+    auto by_cpu = [](const auto& l, const auto& r) { return l.second.cpu_ns > r.second.cpu_ns; };
+    size_t top_len = min(stats.top_cpu.size(), kTopCpuCommands);
+    partial_sort(stats.top_cpu.begin(), stats.top_cpu.begin() + top_len, stats.top_cpu.end(),
+                 by_cpu);
+    stats.top_cpu.resize(top_len);
   });
 
 #define ADD_STAT(i, stat) absl::StrAppend(&out, "shard", i, "_", #stat, ": ", infos[i].stat, "\n");
@@ -969,12 +1124,24 @@ void DebugCmd::Shards() {
     ADD_STAT(i, key_count);
     ADD_STAT(i, expire_count);
     ADD_STAT(i, key_reads);
+    ADD_STAT(i, thread_cpu_usec);
+    ADD_STAT(i, cb_cpu_usec);
+
+    // top-like breakdown, share is of the callback cpu time of the shard.
+    for (const auto& [name, cpu_stats] : infos[i].top_cpu) {
+      double share = infos[i].cb_cpu_usec ? cpu_stats.cpu_ns / 10.0 / infos[i].cb_cpu_usec : 0;
+      absl::StrAppend(&out, "shard", i, "_cpu_", absl::AsciiStrToLower(name),
+                      ": calls=", cpu_stats.calls, ",cpu_usec=", cpu_stats.cpu_ns / 1000,
+                      ",wall_usec=", cpu_stats.wall_ns / 1000,
+                      ",share=", absl::StrFormat("%.1f", share), "%\n");
+    }
   }
 
   MAXMIN_STAT(used_memory);
   MAXMIN_STAT(key_count);
   MAXMIN_STAT(expire_count);
   MAXMIN_STAT(key_reads);
+  MAXMIN_STAT(cb_cpu_usec);
 
 #undef ADD_STAT
 #undef MAXMIN_STAT
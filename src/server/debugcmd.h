@@ -13,7 +13,7 @@ class EngineShardSet;
 class ServerFamily;
 
 class DebugCmd {
- private:
+ public:
   struct PopulateOptions {
     uint64_t total_count = 0;
     std::string_view prefix{"key"};
@@ -22,10 +22,18 @@ class DebugCmd {
     std::string_view type{"STRING"};
     uint32_t elements = 1;
 
+    // If set, the value size and the number of elements of every key are chosen uniformly
+    // between the minimum above and these.
+    uint32_t max_val_size = 0;
+    uint32_t max_elements = 0;
+
+    // Fraction of the keys that get a ttl, chosen uniformly between 1 and expire_sec seconds.
+    double expire_fraction = 0;
+    uint32_t expire_sec = 0;
+
     std::optional<cluster::SlotRange> slot_range;
   };
 
- public:
   DebugCmd(ServerFamily* owner, ConnectionContext* cntx);
 
   void Run(CmdArgList args);
@@ -51,6 +59,7 @@ class DebugCmd {
   void Stacktrace();
   void Shards();
   void LogTraffic(CmdArgList);
+  void Trace(CmdArgList args);
 
   ServerFamily& sf_;
   ConnectionContext* cntx_;
@@ -225,11 +225,8 @@ RdbSaver::SnapshotStats SaveStagesController::GetCurrentSnapshotProgress() const
 
   if (use_dfs_format_) {
     shard_set->RunBriefInParallel([&](EngineShard* es) { fetch(es->shard_id()); });
-    RdbSaver::SnapshotStats init{0, 0};
-    return std::accumulate(
-        results.begin(), results.end(), init, [](auto init, auto pr) -> RdbSaver::SnapshotStats {
-          return {init.current_keys + pr.current_keys, init.total_keys + pr.total_keys};
-        });
+    return std::accumulate(results.begin(), results.end(), RdbSaver::SnapshotStats{},
+                           [](auto init, const auto& pr) { return init += pr; });
   }
   fetch(0);
   return results[0];
@@ -270,6 +267,10 @@ void SaveStagesController::SaveDfsSingle(EngineShard* shard) {
 
   SaveMode mode = shard == nullptr ? SaveMode::SUMMARY : SaveMode::SINGLE_SHARD;
   auto glob_data = shard == nullptr ? RdbSaver::GetGlobalData(service_) : RdbSaver::GlobalData{};
+  if (mode == SaveMode::SUMMARY) {
+    glob_data.repl_id = repl_id_;
+    glob_data.repl_lsns = repl_lsns_;
+  }
 
   if (auto err = snapshot->Start(mode, filename, glob_data); err) {
     shared_err_ = err;
@@ -34,6 +34,10 @@ struct SaveStagesInputs {
   Service* service_;
   util::fb2::FiberQueueThreadPool* fq_threadpool_;
   std::shared_ptr<SnapshotStorage> snapshot_storage_;
+
+  // Replication state of a stopped replica, saved in the summary file.
+  std::string repl_id_;
+  std::vector<uint64_t> repl_lsns_;
 };
 
 class RdbSnapshot {
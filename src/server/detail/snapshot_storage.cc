@@ -9,16 +9,24 @@
 #ifdef WITH_AWS
 #include <aws/core/auth/AWSCredentialsProvider.h>
 #include <aws/s3/S3Client.h>
+#include <aws/s3/model/AbortMultipartUploadRequest.h>
+#include <aws/s3/model/CompleteMultipartUploadRequest.h>
+#include <aws/s3/model/CreateMultipartUploadRequest.h>
 #include <aws/s3/model/ListObjectsV2Request.h>
 #include <aws/s3/model/PutObjectRequest.h>
+#include <aws/s3/model/UploadPartRequest.h>
 
 #include "util/aws/aws.h"
 #include "util/aws/credentials_provider_chain.h"
 #include "util/aws/s3_endpoint_provider.h"
 #include "util/aws/s3_read_file.h"
-#include "util/aws/s3_write_file.h"
 #endif
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 #include <regex>
 
 #include "base/logging.h"
@@ -177,9 +185,230 @@ io::Result<std::vector<std::string>, GenericError> FileSnapshotStorage::LoadPath
   return paths;
 }
 
+// Large enough to keep the number of madvise calls negligible.
+constexpr size_t kMappedReleaseChunk = 64ULL << 20;
+
+io::Result<std::unique_ptr<MappedFileSource>> MappedFileSource::Open(const std::string& path) {
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return nonstd::make_unexpected(std::error_code(errno, std::system_category()));
+
+  struct stat st;
+  void* data = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0)
+    data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  std::error_code ec;
+  if (data == MAP_FAILED)
+    ec = std::error_code(st.st_size == 0 ? EINVAL : errno, std::system_category());
+  close(fd);  // the mapping keeps the file open.
+
+  if (ec)
+    return nonstd::make_unexpected(ec);
+
+  madvise(data, st.st_size, MADV_SEQUENTIAL);
+  madvise(data, std::min<size_t>(st.st_size, kMappedReleaseChunk), MADV_WILLNEED);
+
+  return std::unique_ptr<MappedFileSource>(new MappedFileSource((char*)data, st.st_size));
+}
+
+MappedFileSource::~MappedFileSource() {
+  munmap(data_ + released_, size_ - released_);
+}
+
+io::Result<size_t> MappedFileSource::ReadSome(const iovec* v, uint32_t len) {
+  size_t read_total = 0;
+  for (; offs_ < size_ && len > 0; ++v, --len) {
+    size_t read_sz = std::min(size_ - offs_, v->iov_len);
+    memcpy(v->iov_base, data_ + offs_, read_sz);
+    read_total += read_sz;
+    offs_ += read_sz;
+  }
+
+  while (offs_ - released_ >= kMappedReleaseChunk) {
+    munmap(data_ + released_, kMappedReleaseChunk);
+    released_ += kMappedReleaseChunk;
+  }
+
+  return read_total;
+}
+
 #ifdef WITH_AWS
+namespace {
+
+// S3 rejects smaller parts, except for the last one.
+constexpr size_t kMinS3PartSize = 5ULL << 20;
+
+// Writes a file with a multipart upload whose parts are uploaded by their own fibers, so that
+// serialization continues while up to `concurrency` parts are in flight.
+class S3ParallelWriteFile : public io::WriteFile {
+ public:
+  static io::Result<S3ParallelWriteFile*, GenericError> Open(
+      const std::string& bucket, const std::string& key,
+      std::shared_ptr<Aws::S3::S3Client> client, size_t part_size, unsigned concurrency);
+
+  ~S3ParallelWriteFile() override;
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) override;
+  std::error_code Close() override;
+
+ private:
+  S3ParallelWriteFile(const std::string& bucket, const std::string& key, std::string upload_id,
+                      std::shared_ptr<Aws::S3::S3Client> client, size_t part_size,
+                      unsigned concurrency);
+
+  // Starts the upload of the buffered data as the next part, once fewer than concurrency_
+  // uploads are in flight.
+  void UploadBuffer();
+
+  void UploadPart(unsigned part_number, std::string data);
+
+  std::string bucket_, key_, upload_id_;
+  std::shared_ptr<Aws::S3::S3Client> client_;
+  size_t part_size_;
+  unsigned concurrency_;
+
+  std::string buf_;
+  std::vector<std::string> etags_;  // indexed by part number - 1
+  std::vector<fb2::Fiber> uploads_;
+  unsigned in_flight_ = 0;
+  fb2::EventCount upload_done_;
+  std::error_code ec_;  // first failed upload
+};
+
+io::Result<S3ParallelWriteFile*, GenericError> S3ParallelWriteFile::Open(
+    const std::string& bucket, const std::string& key, std::shared_ptr<Aws::S3::S3Client> client,
+    size_t part_size, unsigned concurrency) {
+  Aws::S3::Model::CreateMultipartUploadRequest request;
+  request.SetBucket(bucket);
+  request.SetKey(key);
+  Aws::S3::Model::CreateMultipartUploadOutcome outcome = client->CreateMultipartUpload(request);
+  if (!outcome.IsSuccess()) {
+    return nonstd::make_unexpected(
+        GenericError{std::make_error_code(std::errc::io_error),
+                     "Failed to create multipart upload: " + outcome.GetError().GetMessage()});
+  }
+
+  return new S3ParallelWriteFile(bucket, key, outcome.GetResult().GetUploadId(), std::move(client),
+                                 part_size, concurrency);
+}
+
+S3ParallelWriteFile::S3ParallelWriteFile(const std::string& bucket, const std::string& key,
+                                         std::string upload_id,
+                                         std::shared_ptr<Aws::S3::S3Client> client,
+                                         size_t part_size, unsigned concurrency)
+    : io::WriteFile(key),
+      bucket_(bucket),
+      key_(key),
+      upload_id_(std::move(upload_id)),
+      client_(std::move(client)),
+      part_size_(std::max(part_size, kMinS3PartSize)),
+      concurrency_(std::max(concurrency, 1u)) {
+}
+
+S3ParallelWriteFile::~S3ParallelWriteFile() {
+  for (auto& fb : uploads_)
+    fb.JoinIfNeeded();
+}
+
+io::Result<size_t> S3ParallelWriteFile::WriteSome(const iovec* v, uint32_t len) {
+  size_t written = 0;
+  for (uint32_t i = 0; i < len; i++) {
+    buf_.append(static_cast<const char*>(v[i].iov_base), v[i].iov_len);
+    written += v[i].iov_len;
+  }
+
+  if (buf_.size() >= part_size_)
+    UploadBuffer();
+
+  if (ec_)
+    return nonstd::make_unexpected(ec_);
+  return written;
+}
+
+void S3ParallelWriteFile::UploadBuffer() {
+  upload_done_.await([this] { return in_flight_ < concurrency_; });
+
+  unsigned part_number = etags_.size() + 1;
+  etags_.emplace_back();
+  in_flight_++;
+  uploads_.emplace_back("s3_upload_part", &S3ParallelWriteFile::UploadPart, this, part_number,
+                        std::move(buf_));
+  buf_.clear();
+}
+
+void S3ParallelWriteFile::UploadPart(unsigned part_number, std::string data) {
+  auto body = Aws::MakeShared<Aws::StringStream>("S3ParallelWriteFile");
+  body->write(data.data(), data.size());
+  data = {};
+
+  Aws::S3::Model::UploadPartRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetUploadId(upload_id_);
+  request.SetPartNumber(part_number);
+  request.SetBody(body);
+
+  Aws::S3::Model::UploadPartOutcome outcome = client_->UploadPart(request);
+  if (outcome.IsSuccess()) {
+    etags_[part_number - 1] = outcome.GetResult().GetETag();
+  } else {
+    LOG(ERROR) << "Failed to upload part " << part_number << " of " << key_ << ": "
+               << outcome.GetError().GetMessage();
+    if (!ec_)
+      ec_ = std::make_error_code(std::errc::io_error);
+  }
+
+  in_flight_--;
+  upload_done_.notify();
+}
+
+std::error_code S3ParallelWriteFile::Close() {
+  if (!buf_.empty() || etags_.empty())  // an upload needs at least one part
+    UploadBuffer();
+
+  for (auto& fb : uploads_)
+    fb.Join();
+  uploads_.clear();
+
+  if (ec_) {
+    Aws::S3::Model::AbortMultipartUploadRequest request;
+    request.SetBucket(bucket_);
+    request.SetKey(key_);
+    request.SetUploadId(upload_id_);
+    client_->AbortMultipartUpload(request);
+    return ec_;
+  }
+
+  Aws::S3::Model::CompletedMultipartUpload completed;
+  for (size_t i = 0; i < etags_.size(); i++) {
+    Aws::S3::Model::CompletedPart part;
+    part.SetETag(etags_[i]);
+    part.SetPartNumber(i + 1);
+    completed.AddParts(std::move(part));
+  }
+
+  Aws::S3::Model::CompleteMultipartUploadRequest request;
+  request.SetBucket(bucket_);
+  request.SetKey(key_);
+  request.SetUploadId(upload_id_);
+  request.SetMultipartUpload(std::move(completed));
+  Aws::S3::Model::CompleteMultipartUploadOutcome outcome =
+      client_->CompleteMultipartUpload(request);
+  if (!outcome.IsSuccess()) {
+    LOG(ERROR) << "Failed to complete upload of " << key_ << ": "
+               << outcome.GetError().GetMessage();
+    return std::make_error_code(std::errc::io_error);
+  }
+  return {};
+}
+
+}  // namespace
+
 AwsS3SnapshotStorage::AwsS3SnapshotStorage(const std::string& endpoint, bool https,
-                                           bool ec2_metadata, bool sign_payload) {
+                                           bool ec2_metadata, bool sign_payload,
+                                           size_t upload_part_size, unsigned upload_concurrency)
+    : upload_part_size_(upload_part_size), upload_concurrency_(upload_concurrency) {
   shard_set->pool()->GetNextProactor()->Await([&] {
     if (!ec2_metadata) {
       setenv("AWS_EC2_METADATA_DISABLED", "true", 0);
@@ -210,13 +439,13 @@ io::Result<std::pair<io::Sink*, uint8_t>, GenericError> AwsS3SnapshotStorage::Op
       return nonstd::make_unexpected(GenericError("Invalid S3 path"));
     }
     auto [bucket, key] = *bucket_path;
-    io::Result<aws::S3WriteFile> file = aws::S3WriteFile::Open(bucket, key, s3_);
+    auto file =
+        S3ParallelWriteFile::Open(bucket, key, s3_, upload_part_size_, upload_concurrency_);
     if (!file) {
-      return nonstd::make_unexpected(GenericError(file.error(), "Failed to open write file"));
+      return nonstd::make_unexpected(file.error());
     }
 
-    aws::S3WriteFile* f = new aws::S3WriteFile(std::move(*file));
-    return std::pair<io::Sink*, uint8_t>(f, FileType::CLOUD);
+    return std::pair<io::Sink*, uint8_t>(*file, FileType::CLOUD);
   });
 }
 
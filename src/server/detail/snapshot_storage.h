@@ -75,8 +75,10 @@ class FileSnapshotStorage : public SnapshotStorage {
 #ifdef WITH_AWS
 class AwsS3SnapshotStorage : public SnapshotStorage {
  public:
+  // Files are written with multipart uploads of parts of upload_part_size bytes, of which up to
+  // upload_concurrency are uploaded in parallel.
   AwsS3SnapshotStorage(const std::string& endpoint, bool https, bool ec2_metadata,
-                       bool sign_payload);
+                       bool sign_payload, size_t upload_part_size, unsigned upload_concurrency);
 
   io::Result<std::pair<io::Sink*, uint8_t>, GenericError> OpenWriteFile(
       const std::string& path) override;
@@ -103,6 +105,8 @@ class AwsS3SnapshotStorage : public SnapshotStorage {
                                                               std::string_view prefix);
 
   std::shared_ptr<Aws::S3::S3Client> s3_;
+  size_t upload_part_size_;
+  unsigned upload_concurrency_;
 };
 
 // Returns bucket_name, obj_path for an s3 path.
@@ -128,6 +132,32 @@ class LinuxWriteWrapper : public io::Sink {
 };
 #endif
 
+// Reads a local snapshot file through a read-only memory mapping, which saves a read call and
+// a pass through the file thread pool per block when the file is still in the page cache, as
+// after a restart. Page faults block the thread, so it does not suit cold files on slow disks.
+// The pages are unmapped as they are consumed.
+class MappedFileSource : public io::Source {
+ public:
+  ~MappedFileSource();
+
+  static io::Result<std::unique_ptr<MappedFileSource>> Open(const std::string& path);
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+  size_t Size() const {
+    return size_;
+  }
+
+ private:
+  MappedFileSource(char* data, size_t size) : data_(data), size_(size) {
+  }
+
+  char* data_;
+  size_t size_;
+  size_t offs_ = 0;
+  size_t released_ = 0;  // prefix of the mapping that was already released.
+};
+
 struct FilenameSubstitutions {
   std::string_view ts;
   std::string_view year;
@@ -15,8 +15,15 @@ namespace detail {
 using PrimeKey = CompactObj;
 using PrimeValue = CompactObj;
 
-struct PrimeTablePolicy {
-  enum { kSlotNum = 14, kBucketNum = 56, kStashBucketNum = 4 };
+// Chosen at build time with -DDF_TABLE_GEOMETRY, as every table type is instantiated by the
+// whole server.
+#ifdef DFLY_TABLE_GEOMETRY
+using TableGeometry = dash_geometry::DFLY_TABLE_GEOMETRY;
+#else
+using TableGeometry = dash_geometry::Default;
+#endif
+
+struct PrimeTablePolicy : public TableGeometry {
 
   static constexpr bool kUseVersion = true;
 
@@ -45,8 +52,7 @@ struct PrimeTablePolicy {
   }
 };
 
-struct ExpireTablePolicy {
-  enum { kSlotNum = 14, kBucketNum = 56, kStashBucketNum = 4 };
+struct ExpireTablePolicy : public TableGeometry {
   static constexpr bool kUseVersion = false;
 
   static uint64_t HashFn(const PrimeKey& s) {
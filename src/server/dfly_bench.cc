@@ -3,10 +3,13 @@
 //
 
 #include <absl/random/random.h>
+#include <absl/strings/ascii.h>
+#include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
 #include <absl/strings/str_split.h>
 
+#include <fstream>
 #include <queue>
 
 #include "absl/time/clock.h"
@@ -20,6 +23,14 @@
 #include "util/fibers/pool.h"
 #include "util/fibers/uring_socket.h"
 
+#ifdef DFLY_USE_SSL
+#include "util/tls/tls_socket.h"
+#endif
+
+extern "C" {
+#include "redis/crc16.h"
+}
+
 // A load-test for DragonflyDB that fixes coordinated omission problem.
 
 using std::string;
@@ -40,6 +51,35 @@ ABSL_FLAG(uint64_t, key_stddev, 0,
           " a default value of (max-min)/6");
 ABSL_FLAG(string, ratio, "1:10", "Set:Get ratio");
 ABSL_FLAG(string, command, "", "custom command with __key__ placeholder for keys");
+ABSL_FLAG(string, workload, "",
+          "File with a mix of commands, one per line as '<weight> [<min>[-<max>]] <command>'. "
+          "Commands may use __key__ and __data__ placeholders, the optional range sets the "
+          "size of __data__ values, for example '20 16-1024 set __key__ __data__'. "
+          "Overrides ratio and command. In the memcache protocol __data__ expands to the "
+          "length and the data block, so it must be the last argument, for example "
+          "'20 set __key__ 0 0 __data__'.");
+ABSL_FLAG(uint32_t, pipeline, 1,
+          "Number of commands sent together in a single write. The qps schedule is kept, "
+          "the commands of a batch are sent at the time of its first command");
+ABSL_FLAG(bool, open_loop, true,
+          "Measure latency from the time a request was scheduled to be sent, so that requests "
+          "delayed by slow ones account for the wait. Otherwise from the actual send time");
+ABSL_FLAG(uint32_t, report_interval, 1, "Interval in seconds for latency reports, 0 to disable");
+ABSL_FLAG(string, hdr_file, "",
+          "If set, writes the overall latency distribution in the HdrHistogram percentile "
+          "format to this file");
+ABSL_FLAG(string, summary_file, "",
+          "If set, writes the throughput and the latency percentiles of the run in usec as a "
+          "JSON object to this file");
+ABSL_FLAG(string, protocol, "RESP", "RESP or MC for the memcache text and meta protocol");
+ABSL_FLAG(bool, cluster, false,
+          "Discover the cluster nodes with CLUSTER SLOTS on the server, connect to all the "
+          "masters and route the commands by the slot of their first key");
+
+ABSL_DECLARE_FLAG(bool, tls);
+ABSL_DECLARE_FLAG(string, tls_cert_file);
+ABSL_DECLARE_FLAG(string, tls_key_file);
+ABSL_DECLARE_FLAG(string, tls_ca_cert_file);
 
 using namespace std;
 using namespace util;
@@ -49,6 +89,12 @@ using facade::RespVec;
 using tcp = ::boost::asio::ip::tcp;
 
 constexpr string_view kKeyPlaceholder = "__key__"sv;
+constexpr string_view kDataPlaceholder = "__data__"sv;
+constexpr uint16_t kNumSlots = 16384;
+
+enum class Protocol { RESP, MEMCACHE };
+
+Protocol protocol = Protocol::RESP;
 
 thread_local absl::InsecureBitGen bit_gen;
 
@@ -66,84 +112,233 @@ class KeyGenerator {
   enum DistType { UNIFORM, NORMAL, ZIPFIAN } dist_type_;
 };
 
+// Command with placeholders, picked by the generator with the probability of its weight.
+struct CommandTemplate {
+  enum Placeholder { KEY, DATA };
+
+  // Parses the command and its placeholders.
+  CommandTemplate(uint32_t weight, string_view cmd, uint32_t min_size, uint32_t max_size);
+
+  uint32_t weight;
+  uint32_t min_size, max_size;  // of the __data__ values.
+  vector<string> parts;         // literals, parts[i] precedes holders[i].
+  vector<Placeholder> holders;
+};
+
 class CommandGenerator {
  public:
   CommandGenerator(KeyGenerator* keygen);
 
   string operator()();
 
+  // The first key of the last generated command, empty if it has no keys.
+  string_view first_key() const {
+    return first_key_;
+  }
+
  private:
   KeyGenerator* keygen_;
-  uint32_t ratio_set_ = 0, ratio_get_ = 0;
-  string command_;
+  vector<CommandTemplate> templates_;
+  uint32_t total_weight_ = 0;
   string cmd_;
-  std::vector<size_t> key_indices_;
+  string first_key_;
   string value_;
 };
 
-CommandGenerator::CommandGenerator(KeyGenerator* keygen) : keygen_(keygen) {
-  command_ = GetFlag(FLAGS_command);
-  value_ = string(GetFlag(FLAGS_d), 'a');
+CommandTemplate::CommandTemplate(uint32_t weight, string_view cmd, uint32_t min_size,
+                                 uint32_t max_size)
+    : weight(weight), min_size(min_size), max_size(max_size) {
+  size_t last_pos = 0;
+  while (true) {
+    size_t key_pos = cmd.find(kKeyPlaceholder, last_pos);
+    size_t data_pos = cmd.find(kDataPlaceholder, last_pos);
+    size_t pos = min(key_pos, data_pos);
+    if (pos == string_view::npos)
+      break;
 
-  if (command_.empty()) {
-    pair<string, string> ratio_str = absl::StrSplit(GetFlag(FLAGS_ratio), ':');
-    CHECK(absl::SimpleAtoi(ratio_str.first, &ratio_set_));
-    CHECK(absl::SimpleAtoi(ratio_str.second, &ratio_get_));
-  } else {
-    for (size_t pos = 0; (pos = command_.find(kKeyPlaceholder, pos)) != string::npos;
-         pos += kKeyPlaceholder.size()) {
-      key_indices_.push_back(pos);
+    parts.emplace_back(cmd.substr(last_pos, pos - last_pos));
+    if (pos == key_pos) {
+      holders.push_back(KEY);
+      last_pos = pos + kKeyPlaceholder.size();
+    } else {
+      holders.push_back(DATA);
+      last_pos = pos + kDataPlaceholder.size();
+    }
+  }
+  parts.push_back(absl::StrCat(cmd.substr(last_pos), "\r\n"));
+}
+
+// Reads the workload file, see the description of the workload flag.
+static vector<CommandTemplate> ReadWorkload(const string& path) {
+  ifstream input(path);
+  CHECK(input) << "Could not open " << path;
+
+  const uint32_t default_size = GetFlag(FLAGS_d);
+  vector<CommandTemplate> res;
+  string line;
+  while (getline(input, line)) {
+    string_view cmd = absl::StripAsciiWhitespace(line);
+    if (cmd.empty() || cmd[0] == '#')
+      continue;
+
+    pair<string_view, string_view> weight_str =
+        absl::StrSplit(cmd, absl::MaxSplits(absl::ByAnyChar(" \t"), 1), absl::SkipEmpty());
+    uint32_t weight = 0;
+    CHECK(absl::SimpleAtoi(weight_str.first, &weight)) << "Bad weight in: " << line;
+    cmd = absl::StripLeadingAsciiWhitespace(weight_str.second);
+
+    uint32_t min_size = default_size, max_size = default_size;
+    if (!cmd.empty() && absl::ascii_isdigit(cmd[0])) {
+      pair<string_view, string_view> size_str =
+          absl::StrSplit(cmd, absl::MaxSplits(absl::ByAnyChar(" \t"), 1), absl::SkipEmpty());
+      pair<string_view, string_view> range = absl::StrSplit(size_str.first, '-');
+      CHECK(absl::SimpleAtoi(range.first, &min_size)) << "Bad size in: " << line;
+      max_size = min_size;
+      if (!range.second.empty())
+        CHECK(absl::SimpleAtoi(range.second, &max_size)) << "Bad size in: " << line;
+      CHECK_LE(min_size, max_size) << line;
+      cmd = absl::StripLeadingAsciiWhitespace(size_str.second);
     }
+    CHECK(!cmd.empty()) << "Missing command in: " << line;
+    if (weight > 0)
+      res.emplace_back(weight, cmd, min_size, max_size);
+  }
+  CHECK(!res.empty()) << "No commands in " << path;
+  return res;
+}
+
+CommandGenerator::CommandGenerator(KeyGenerator* keygen) : keygen_(keygen) {
+  const uint32_t size = GetFlag(FLAGS_d);
+  string workload = GetFlag(FLAGS_workload);
+  string command = GetFlag(FLAGS_command);
+
+  if (!workload.empty()) {
+    templates_ = ReadWorkload(workload);
+  } else if (!command.empty()) {
+    templates_.emplace_back(1, command, size, size);
+  } else {
+    uint32_t ratio_set = 0, ratio_get = 0;
+    pair<string, string> ratio_str = absl::StrSplit(GetFlag(FLAGS_ratio), ':');
+    CHECK(absl::SimpleAtoi(ratio_str.first, &ratio_set));
+    CHECK(absl::SimpleAtoi(ratio_str.second, &ratio_get));
+    string_view set_cmd =
+        protocol == Protocol::MEMCACHE ? "set __key__ 0 0 __data__" : "set __key__ __data__";
+    if (ratio_set > 0)
+      templates_.emplace_back(ratio_set, set_cmd, size, size);
+    if (ratio_get > 0)
+      templates_.emplace_back(ratio_get, "get __key__", size, size);
+  }
+
+  uint32_t max_size = 0;
+  for (const auto& tmpl : templates_) {
+    total_weight_ += tmpl.weight;
+    max_size = max(max_size, tmpl.max_size);
   }
+  CHECK_GT(total_weight_, 0u);
+  value_ = string(max_size, 'a');
 }
 
 string CommandGenerator::operator()() {
-  cmd_.clear();
-  string key;
-  if (command_.empty()) {
-    key = (*keygen_)();
+  uint32_t pick = absl::Uniform(bit_gen, 0U, total_weight_);
+  const CommandTemplate* tmpl = &templates_.front();
+  for (const auto& t : templates_) {
+    if (pick < t.weight) {
+      tmpl = &t;
+      break;
+    }
+    pick -= t.weight;
+  }
 
-    if (absl::Uniform(bit_gen, 0U, ratio_get_ + ratio_set_) < ratio_set_) {
-      absl::StrAppend(&cmd_, "set ", key, " ", value_, "\r\n");
+  cmd_.clear();
+  first_key_.clear();
+  for (size_t i = 0; i < tmpl->holders.size(); ++i) {
+    cmd_.append(tmpl->parts[i]);
+    if (tmpl->holders[i] == CommandTemplate::KEY) {
+      string key = (*keygen_)();
+      if (first_key_.empty())
+        first_key_ = key;
+      cmd_.append(key);
     } else {
-      absl::StrAppend(&cmd_, "get ", key, "\r\n");
-    }
-  } else {
-    size_t last_pos = 0;
-    for (size_t pos : key_indices_) {
-      key = (*keygen_)();
-      absl::StrAppend(&cmd_, command_.substr(last_pos, pos - last_pos), key);
-      last_pos = pos + kKeyPlaceholder.size();
+      uint32_t len = tmpl->min_size;
+      if (tmpl->max_size > tmpl->min_size)
+        len = absl::Uniform(absl::IntervalClosed, bit_gen, tmpl->min_size, tmpl->max_size);
+
+      // Memcache storage commands pass the length of the data block right before it.
+      if (protocol == Protocol::MEMCACHE)
+        absl::StrAppend(&cmd_, len, "\r\n");
+      cmd_.append(value_, 0, len);
     }
-    absl::StrAppend(&cmd_, command_.substr(last_pos), "\r\n");
   }
+  cmd_.append(tmpl->parts.back());
   return cmd_;
 }
 
-// Per connection driver.
+// Latencies of a thread, overall and since the last report.
+struct LatencyHist {
+  void Add(uint64_t usec) {
+    total.Add(usec);
+    interval.Add(usec);
+  }
+
+  base::Histogram total;
+  base::Histogram interval;
+};
+
+// Nodes to connect to and, in the cluster mode, the node that owns each slot.
+struct Topology {
+  vector<tcp::endpoint> nodes;
+  vector<uint16_t> slot_owner;  // index into nodes, empty if not in the cluster mode.
+};
+
+Topology topology;
+
+#ifdef DFLY_USE_SSL
+SSL_CTX* ssl_ctx = nullptr;
+#endif
+
+// Per connection driver, holds a connection to every node of the topology.
 class Driver {
  public:
-  explicit Driver(ProactorBase* p = nullptr) {
-    if (p)
-      socket_.reset(p->CreateSocket());
+  explicit Driver(ProactorBase* p = nullptr) : p_(p) {
   }
 
   Driver(const Driver&) = delete;
   Driver(Driver&&) = default;
   Driver& operator=(Driver&&) = default;
 
-  void Connect(unsigned index, const tcp::endpoint& ep);
-  void Run(uint32_t num_reqs, uint64_t cycle_ns, base::Histogram* dest);
+  void Connect(unsigned index);
+  void Run(uint32_t num_reqs, uint64_t cycle_ns, LatencyHist* dest);
 
- private:
-  void ReceiveFb(base::Histogram* dest);
+  uint64_t num_moved() const {
+    return num_moved_;
+  }
 
+ private:
   struct Req {
     uint64_t start;
   };
 
-  unique_ptr<FiberSocketBase> socket_;
-  queue<Req> reqs_;
+  // Connection to a node with the requests awaiting their replies, in order.
+  struct Conn {
+    unique_ptr<FiberSocketBase> socket;
+    queue<Req> reqs;
+    string batch;  // commands to write with the next batch.
+  };
+
+  void ReceiveFb(Conn* conn, LatencyHist* dest);
+
+  // Records the latency of the oldest request of conn.
+  void OnReply(Conn* conn, LatencyHist* dest);
+
+  // Updates the owner of the slot from "MOVED <slot> <host>:<port>".
+  void OnMoved(string_view msg);
+
+  Conn* PickConn(string_view key);
+
+  ProactorBase* p_;
+  vector<unique_ptr<Conn>> conns_;  // one per topology node.
+  vector<uint16_t> slot_owner_;
+  uint64_t num_moved_ = 0;
 };
 
 // Per thread client.
@@ -158,10 +353,12 @@ class TLocalClient {
 
   TLocalClient(const TLocalClient&) = delete;
 
-  void Connect(tcp::endpoint ep);
+  void Connect();
   void Run(uint64_t cycle_ns);
 
-  base::Histogram hist;
+  uint64_t NumMoved() const;
+
+  LatencyHist hist;
 
  private:
   ProactorBase* p_;
@@ -209,14 +406,80 @@ string KeyGenerator::operator()() {
   return absl::StrCat(prefix_, key_suffix);
 }
 
-void Driver::Connect(unsigned index, const tcp::endpoint& ep) {
+// Returns the slot of the key, hashing only its {hashtag} if it has one.
+static uint16_t KeySlot(string_view key) {
+  size_t start = key.find('{');
+  if (start != string_view::npos) {
+    size_t end = key.find('}', start + 1);
+    if (end != string_view::npos && end != start + 1)
+      key = key.substr(start + 1, end - start - 1);
+  }
+  return crc16(key.data(), key.size()) & (kNumSlots - 1);
+}
+
+static FiberSocketBase* CreateSocket(ProactorBase* p) {
+#ifdef DFLY_USE_SSL
+  if (ssl_ctx) {
+    auto* tls_sock = new tls::TlsSocket(p->CreateSocket());
+    tls_sock->InitSSL(ssl_ctx);
+    return tls_sock;
+  }
+#endif
+  return p->CreateSocket();
+}
+
+void Driver::Connect(unsigned index) {
   VLOG(2) << "Connecting " << index;
-  error_code ec = socket_->Connect(ep);
-  CHECK(!ec) << "Could not connect to " << ep << " " << ec;
+  slot_owner_ = topology.slot_owner;
+  for (const tcp::endpoint& ep : topology.nodes) {
+    auto conn = make_unique<Conn>();
+    conn->socket.reset(CreateSocket(p_));
+    error_code ec = conn->socket->Connect(ep);
+    CHECK(!ec) << "Could not connect to " << ep << " " << ec;
+    conns_.push_back(std::move(conn));
+  }
 }
 
-void Driver::Run(uint32_t num_reqs, uint64_t cycle_ns, base::Histogram* dest) {
-  auto receive_fb = MakeFiber([this, dest] { ReceiveFb(dest); });
+auto Driver::PickConn(string_view key) -> Conn* {
+  if (slot_owner_.empty() || key.empty())
+    return conns_.front().get();
+  return conns_[slot_owner_[KeySlot(key)]].get();
+}
+
+void Driver::OnMoved(string_view msg) {
+  ++num_moved_;
+  vector<string_view> parts = absl::StrSplit(msg, ' ', absl::SkipEmpty());
+  uint32_t slot = 0;
+  if (parts.size() < 3 || !absl::SimpleAtoi(parts[1], &slot) || slot >= kNumSlots ||
+      slot_owner_.empty()) {
+    LOG_FIRST_N(WARNING, 10) << "Unexpected redirection: " << msg;
+    return;
+  }
+
+  size_t colon = parts[2].rfind(':');
+  uint16_t port = 0;
+  error_code ec;
+  auto address = ::boost::asio::ip::make_address(string(parts[2].substr(0, colon)), ec);
+  if (colon == string_view::npos || ec || !absl::SimpleAtoi(parts[2].substr(colon + 1), &port)) {
+    LOG_FIRST_N(WARNING, 10) << "Unexpected redirection: " << msg;
+    return;
+  }
+
+  // The commands are not retried, but the following ones go to the new owner. Nodes that were
+  // not discovered at the start are not connected to.
+  tcp::endpoint ep{address, port};
+  auto it = find(topology.nodes.begin(), topology.nodes.end(), ep);
+  if (it == topology.nodes.end()) {
+    LOG_FIRST_N(WARNING, 10) << "Redirected to an unknown node " << ep;
+    return;
+  }
+  slot_owner_[slot] = it - topology.nodes.begin();
+}
+
+void Driver::Run(uint32_t num_reqs, uint64_t cycle_ns, LatencyHist* dest) {
+  vector<fb2::Fiber> receive_fbs;
+  for (auto& conn : conns_)
+    receive_fbs.push_back(MakeFiber([this, conn = conn.get(), dest] { ReceiveFb(conn, dest); }));
 
   int64_t next_invocation = absl::GetCurrentTimeNanos();
 
@@ -225,9 +488,13 @@ void Driver::Run(uint32_t num_reqs, uint64_t cycle_ns, base::Histogram* dest) {
   const uint32_t key_minimum = GetFlag(FLAGS_key_minimum);
   const uint32_t key_maximum = GetFlag(FLAGS_key_maximum);
 
+  const uint32_t pipeline = max(GetFlag(FLAGS_pipeline), 1u);
+  const bool open_loop = GetFlag(FLAGS_open_loop);
+
   KeyGenerator key_gen(key_minimum, key_maximum);
   CommandGenerator cmd_gen(&key_gen);
-  for (unsigned i = 0; i < num_reqs; ++i) {
+  bool closed = false;
+  for (unsigned i = 0; i < num_reqs && !closed; i += pipeline) {
     int64_t now = absl::GetCurrentTimeNanos();
 
     int64_t sleep_ns = next_invocation - now;
@@ -237,22 +504,37 @@ void Driver::Run(uint32_t num_reqs, uint64_t cycle_ns, base::Histogram* dest) {
     } else {
       VLOG(5) << "Behind QPS schedule";
     }
-    next_invocation += cycle_ns;
-
-    string cmd = cmd_gen();
 
+    // In the open loop mode the latency includes the time the request was late for its slot,
+    // otherwise a stalled server delays the following requests and hides their wait.
     Req req;
-    req.start = absl::GetCurrentTimeNanos();
-    reqs_.push(req);
+    req.start = open_loop ? next_invocation : absl::GetCurrentTimeNanos();
+
+    unsigned batch_size = min(pipeline, num_reqs - i);
+    next_invocation += cycle_ns * batch_size;
+
+    for (unsigned j = 0; j < batch_size; ++j) {
+      string cmd = cmd_gen();
+      Conn* conn = PickConn(cmd_gen.first_key());
+      conn->batch.append(cmd);
+      conn->reqs.push(req);
+    }
     // TODO: add type (get/set)
 
-    error_code ec = socket_->Write(io::Buffer(cmd));
-    if (ec && FiberSocketBase::IsConnClosed(ec)) {
-      // TODO: report failure
-      VLOG(1) << "Connection closed";
-      break;
+    for (auto& conn : conns_) {
+      if (conn->batch.empty())
+        continue;
+
+      error_code ec = conn->socket->Write(io::Buffer(conn->batch));
+      conn->batch.clear();
+      if (ec && FiberSocketBase::IsConnClosed(ec)) {
+        // TODO: report failure
+        VLOG(1) << "Connection closed";
+        closed = true;
+        break;
+      }
+      CHECK(!ec) << ec.message();
     }
-    CHECK(!ec) << ec.message();
   }
 
   const absl::Time finish = absl::Now();
@@ -260,30 +542,85 @@ void Driver::Run(uint32_t num_reqs, uint64_t cycle_ns, base::Histogram* dest) {
           << ". Waiting for server processing";
 
   // TODO: to change to a condvar or something.
-  while (!reqs_.empty()) {
-    ThisFiber::SleepFor(1ms);
+  for (auto& conn : conns_) {
+    while (!closed && !conn->reqs.empty()) {
+      ThisFiber::SleepFor(1ms);
+    }
   }
 
-  socket_->Shutdown(SHUT_RDWR);  // breaks the receive fiber.
-  receive_fb.Join();
-  std::ignore = socket_->Close();
+  for (size_t i = 0; i < conns_.size(); ++i) {
+    conns_[i]->socket->Shutdown(SHUT_RDWR);  // breaks the receive fiber.
+    receive_fbs[i].Join();
+    std::ignore = conns_[i]->socket->Close();
+  }
 }
 
-void Driver::ReceiveFb(base::Histogram* dest) {
+void Driver::OnReply(Conn* conn, LatencyHist* dest) {
+  uint64_t now = absl::GetCurrentTimeNanos();
+  uint64_t usec = (now - conn->reqs.front().start) / 1000;
+  dest->Add(usec);
+  conn->reqs.pop();
+}
+
+// Returns the length of the first memcache reply in buf, or 0 if it's incomplete.
+static size_t MCReplyLen(string_view buf) {
+  size_t pos = 0;
+  while (true) {
+    size_t eol = buf.find("\r\n", pos);
+    if (eol == string_view::npos)
+      return 0;
+
+    string_view line = buf.substr(pos, eol - pos);
+    pos = eol + 2;
+
+    // Retrievals return "VALUE <key> <flags> <bytes> [<cas>]" per hit, followed by END.
+    // Meta gets return "VA <bytes> <flags>*" with a single value.
+    bool is_value = absl::StartsWith(line, "VALUE ");
+    if (is_value || absl::StartsWith(line, "VA ")) {
+      vector<string_view> parts = absl::StrSplit(line, ' ', absl::SkipEmpty());
+      size_t index = is_value ? 3 : 1;
+      uint32_t bytes = 0;
+      CHECK(parts.size() > index && absl::SimpleAtoi(parts[index], &bytes)) << line;
+      if (buf.size() < pos + bytes + 2)
+        return 0;
+      pos += bytes + 2;
+      if (is_value)
+        continue;
+      return pos;
+    }
+
+    // Any other line completes the reply, including END after the values.
+    return pos;
+  }
+}
+
+void Driver::ReceiveFb(Conn* conn, LatencyHist* dest) {
   facade::RedisParser parser{1 << 16, false};
   io::IoBuf io_buf{512};
   unsigned num_resp = 0;
   while (true) {
     auto buf = io_buf.AppendBuffer();
-    VLOG(2) << "Socket read: " << reqs_.size() << " " << num_resp;
+    VLOG(2) << "Socket read: " << conn->reqs.size() << " " << num_resp;
 
-    ::io::Result<size_t> recv_sz = socket_->Recv(buf);
+    ::io::Result<size_t> recv_sz = conn->socket->Recv(buf);
     if (!recv_sz && FiberSocketBase::IsConnClosed(recv_sz.error())) {
       break;
     }
     CHECK(recv_sz) << recv_sz.error().message();
     io_buf.CommitWrite(*recv_sz);
 
+    if (protocol == Protocol::MEMCACHE) {
+      // Replies are parsed only once they are complete, so the buffer must fit the largest one.
+      while (size_t len = MCReplyLen(io::View(io_buf.InputBuffer()))) {
+        OnReply(conn, dest);
+        io_buf.ConsumeInput(len);
+        ++num_resp;
+      }
+      if (io_buf.AppendLen() < 64u)
+        io_buf.EnsureCapacity(io_buf.Capacity() * 2);
+      continue;
+    }
+
     uint32_t consumed = 0;
     RedisParser::Result result = RedisParser::OK;
     RespVec parse_args;
@@ -291,10 +628,11 @@ void Driver::ReceiveFb(base::Histogram* dest) {
     do {
       result = parser.Parse(io_buf.InputBuffer(), &consumed, &parse_args);
       if (result == RedisParser::OK && !parse_args.empty()) {
-        uint64_t now = absl::GetCurrentTimeNanos();
-        uint64_t usec = (now - reqs_.front().start) / 1000;
-        dest->Add(usec);
-        reqs_.pop();
+        if (parse_args.size() == 1 && parse_args[0].type == facade::RespExpr::ERROR &&
+            absl::StartsWith(parse_args[0].GetView(), "MOVED ")) {
+          OnMoved(parse_args[0].GetView());
+        }
+        OnReply(conn, dest);
         parse_args.clear();
         ++num_resp;
       }
@@ -304,14 +642,14 @@ void Driver::ReceiveFb(base::Histogram* dest) {
   VLOG(1) << "ReceiveFb done";
 }
 
-void TLocalClient::Connect(tcp::endpoint ep) {
+void TLocalClient::Connect() {
   VLOG(2) << "Connecting client...";
   vector<fb2::Fiber> fbs(drivers_.size());
 
   for (size_t i = 0; i < fbs.size(); ++i) {
     fbs[i] = MakeFiber([&, i] {
       ThisFiber::SetName(absl::StrCat("connect/", i));
-      drivers_[i].Connect(i, ep);
+      drivers_[i].Connect(i);
     });
   }
 
@@ -332,6 +670,128 @@ void TLocalClient::Run(uint64_t cycle_ns) {
     fb.Join();
 }
 
+uint64_t TLocalClient::NumMoved() const {
+  uint64_t res = 0;
+  for (const auto& driver : drivers_)
+    res += driver.num_moved();
+  return res;
+}
+
+#ifdef DFLY_USE_SSL
+static SSL_CTX* CreateSslCntx() {
+  SSL_CTX* ctx = SSL_CTX_new(TLS_client_method());
+  CHECK(ctx);
+
+  const string& key_file = GetFlag(FLAGS_tls_key_file);
+  if (!key_file.empty()) {
+    CHECK_EQ(1, SSL_CTX_use_PrivateKey_file(ctx, key_file.c_str(), SSL_FILETYPE_PEM));
+    CHECK_EQ(1, SSL_CTX_use_certificate_chain_file(ctx, GetFlag(FLAGS_tls_cert_file).c_str()));
+  }
+
+  // Without a CA the server certificate is not verified, it's a benchmark after all.
+  const string& ca_file = GetFlag(FLAGS_tls_ca_cert_file);
+  if (ca_file.empty()) {
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_NONE, nullptr);
+  } else {
+    CHECK_EQ(1, SSL_CTX_load_verify_locations(ctx, ca_file.c_str(), nullptr));
+    SSL_CTX_set_verify(ctx, SSL_VERIFY_PEER, nullptr);
+  }
+  SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+  return ctx;
+}
+#endif
+
+// Fetches the masters and the slots they own with CLUSTER SLOTS from the seed node.
+static Topology DiscoverCluster(ProactorBase* p, const tcp::endpoint& seed) {
+  unique_ptr<FiberSocketBase> sock(CreateSocket(p));
+  error_code ec = sock->Connect(seed);
+  CHECK(!ec) << "Could not connect to " << seed << " " << ec;
+  ec = sock->Write(io::Buffer("CLUSTER SLOTS\r\n"));
+  CHECK(!ec) << ec.message();
+
+  // The reply is parsed from the start until it's complete, so that the parsed strings point
+  // into a buffer that does not change afterwards.
+  io::IoBuf io_buf{4096};
+  RespVec slots;
+  while (true) {
+    if (io_buf.AppendLen() < 256u)
+      io_buf.EnsureCapacity(io_buf.Capacity() * 2);
+    ::io::Result<size_t> recv_sz = sock->Recv(io_buf.AppendBuffer());
+    CHECK(recv_sz) << recv_sz.error().message();
+    io_buf.CommitWrite(*recv_sz);
+
+    RedisParser parser{UINT32_MAX, false};
+    uint32_t consumed = 0;
+    slots.clear();
+    RedisParser::Result result = parser.Parse(io_buf.InputBuffer(), &consumed, &slots);
+    if (result == RedisParser::OK)
+      break;
+    CHECK_EQ(result, RedisParser::INPUT_PENDING) << "Could not parse CLUSTER SLOTS";
+  }
+  std::ignore = sock->Close();
+
+  CHECK(slots.empty() || slots[0].type != facade::RespExpr::ERROR)
+      << "CLUSTER SLOTS failed: " << slots[0].GetView();
+
+  // Each range is [start, end, [ip, port, id], replicas...].
+  Topology res;
+  res.slot_owner.resize(kNumSlots, 0);
+  for (const auto& range : slots) {
+    CHECK(range.type == facade::RespExpr::ARRAY) << range;
+    const auto& vec = range.GetVec();
+    CHECK_GE(vec.size(), 3u) << range;
+    CHECK(vec[2].type == facade::RespExpr::ARRAY && vec[2].GetVec().size() >= 2) << range;
+    const auto& master = vec[2].GetVec();
+    auto start = vec[0].GetInt(), end = vec[1].GetInt(), port = master[1].GetInt();
+    CHECK(start && end && port && *start <= *end && *end < kNumSlots) << range;
+
+    // Nodes announce themselves by address, as in the MOVED replies.
+    tcp::endpoint ep{::boost::asio::ip::make_address(master[0].GetString()), uint16_t(*port)};
+    auto it = find(res.nodes.begin(), res.nodes.end(), ep);
+    if (it == res.nodes.end())
+      it = res.nodes.insert(res.nodes.end(), ep);
+    for (int64_t slot = *start; slot <= *end; ++slot)
+      res.slot_owner[slot] = it - res.nodes.begin();
+  }
+  CHECK(!res.nodes.empty()) << "No slots are assigned in the cluster";
+  return res;
+}
+
+// Writes the percentile distribution in the format of HdrHistogram's outputPercentileDistribution,
+// so that it can be plotted with the HdrHistogram tooling. Values are in msec.
+static void WriteHdrPercentiles(const base::Histogram& hist, const string& path) {
+  ofstream out(path);
+  CHECK(out) << "Could not open " << path;
+
+  out << absl::StrFormat("%12s %14s %10s %14s\n\n", "Value", "Percentile", "TotalCount",
+                         "1/(1-Percentile)");
+  const uint64_t count = hist.count();
+  // Halves the distance to 100% with each step, like HdrHistogram does.
+  for (double pct = 0; pct < 100; pct += (100 - pct) / 4) {
+    out << absl::StrFormat("%12.3f %2.12f %10u %14.2f\n", hist.Percentile(pct) / 1000, pct / 100,
+                           uint64_t(count * pct / 100), 100 / (100 - pct));
+    if (count * (100 - pct) / 100 < 1)
+      break;
+  }
+  out << absl::StrFormat("%12.3f %2.12f %10u\n", double(hist.max()) / 1000, 1.0, count);
+  out << absl::StrFormat("#[Max = %12.3f, Total count = %12u]\n", double(hist.max()) / 1000, count);
+  LOG(INFO) << "Wrote the latency distribution to " << path;
+}
+
+static void WriteSummary(const base::Histogram& hist, absl::Duration duration,
+                         const string& path) {
+  ofstream out(path);
+  CHECK(out) << "Could not open " << path;
+
+  const double seconds = absl::ToDoubleSeconds(duration);
+  out << absl::StrFormat(
+      "{\"requests\": %u, \"duration_sec\": %.3f, \"qps\": %.1f, \"p50_usec\": %.1f, "
+      "\"p99_usec\": %.1f, \"p999_usec\": %.1f, \"max_usec\": %u}\n",
+      hist.count(), seconds, seconds > 0 ? hist.count() / seconds : 0, hist.Percentile(50),
+      hist.Percentile(99), hist.Percentile(99.9), hist.max());
+  LOG(INFO) << "Wrote the run summary to " << path;
+}
+
 int main(int argc, char* argv[]) {
   MainInitGuard guard(&argc, &argv);
 
@@ -349,12 +809,35 @@ int main(int argc, char* argv[]) {
   auto address = ::boost::asio::ip::make_address(ip_addr);
   tcp::endpoint ep{address, GetFlag(FLAGS_p)};
 
+  string protocol_str = absl::AsciiStrToUpper(GetFlag(FLAGS_protocol));
+  if (protocol_str == "MC") {
+    protocol = Protocol::MEMCACHE;
+  } else if (protocol_str != "RESP") {
+    LOG(FATAL) << "Unknown protocol: " << protocol_str;
+  }
+
+  if (GetFlag(FLAGS_tls)) {
+#ifdef DFLY_USE_SSL
+    ssl_ctx = CreateSslCntx();
+#else
+    LOG(FATAL) << "dfly_bench was built without TLS support";
+#endif
+  }
+
+  if (GetFlag(FLAGS_cluster)) {
+    CHECK(protocol == Protocol::RESP) << "The cluster mode requires the RESP protocol";
+    topology = proactor->Await([&] { return DiscoverCluster(proactor, ep); });
+    CONSOLE_INFO << "Discovered " << topology.nodes.size() << " cluster masters";
+  } else {
+    topology.nodes.push_back(ep);
+  }
+
   thread_local unique_ptr<TLocalClient> client;
 
   LOG(INFO) << "Connecting threads";
   pp->AwaitFiberOnAll([&](auto* p) {
     client = make_unique<TLocalClient>(p);
-    client->Connect(ep);
+    client->Connect();
   });
 
   const uint32_t qps = GetFlag(FLAGS_qps);
@@ -367,22 +850,63 @@ int main(int argc, char* argv[]) {
   CONSOLE_INFO << "Overall scheduled QPS: " << qps * pp->size() * GetFlag(FLAGS_c);
 
   const absl::Time start_time = absl::Now();
+  fb2::Done done;
+  fb2::Fiber report_fb;
+  if (uint32_t report_interval = GetFlag(FLAGS_report_interval); report_interval > 0) {
+    report_fb = proactor->LaunchFiber([&, report_interval] {
+      ThisFiber::SetName("report");
+      CONSOLE_INFO << "Latency per interval, all times are in usec:\n"
+                   << absl::StrFormat("%8s %10s %10s %10s %10s %10s", "time", "count", "p50",
+                                      "p99", "p99.9", "max");
+      while (!done.WaitFor(chrono::seconds(report_interval))) {
+        base::Histogram interval_hist;
+        fb2::Mutex mu;
+        pp->AwaitFiberOnAll([&](auto* p) {
+          lock_guard gu(mu);
+          interval_hist.Merge(client->hist.interval);
+          client->hist.interval.Clear();
+        });
+        CONSOLE_INFO << absl::StrFormat(
+            "%7.0fs %10u %10.0f %10.0f %10.0f %10.0f",
+            absl::ToDoubleSeconds(absl::Now() - start_time), interval_hist.count(),
+            interval_hist.Percentile(50), interval_hist.Percentile(99),
+            interval_hist.Percentile(99.9), double(interval_hist.max()));
+      }
+    });
+  }
+
   pp->AwaitFiberOnAll([&](auto* p) { client->Run(interval); });
   absl::Duration duration = absl::Now() - start_time;
+  done.Notify();
+  if (report_fb.IsJoinable())
+    report_fb.Join();
   LOG(INFO) << "Finished. Total time: " << duration;
 
   fb2::Mutex mutex;
   base::Histogram hist;
+  uint64_t num_moved = 0;
   LOG(INFO) << "Resetting all threads";
   pp->AwaitFiberOnAll([&](auto* p) {
     lock_guard gu(mutex);
-    hist.Merge(client->hist);
+    hist.Merge(client->hist.total);
+    num_moved += client->NumMoved();
     client.reset();
   });
 
   CONSOLE_INFO << "Latency summary, all times are in usec:\n" << hist.ToString();
+  if (num_moved > 0)
+    CONSOLE_INFO << "Redirected with MOVED: " << num_moved;
+  if (string hdr_file = GetFlag(FLAGS_hdr_file); !hdr_file.empty())
+    WriteHdrPercentiles(hist, hdr_file);
+  if (string summary_file = GetFlag(FLAGS_summary_file); !summary_file.empty())
+    WriteSummary(hist, duration, summary_file);
 
   pp->Stop();
 
+#ifdef DFLY_USE_SSL
+  if (ssl_ctx)
+    SSL_CTX_free(ssl_ctx);
+#endif
+
   return 0;
 }
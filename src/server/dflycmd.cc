@@ -3,10 +3,12 @@
 //
 #include "server/dflycmd.h"
 
+#include <absl/container/flat_hash_set.h>
 #include <absl/random/random.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/strip.h>
 
+#include <algorithm>
 #include <limits>
 #include <memory>
 #include <optional>
@@ -34,6 +36,17 @@ using namespace std;
 
 ABSL_DECLARE_FLAG(bool, info_replication_valkey_compatible);
 
+ABSL_FLAG(bool, replication_stream_compression, false,
+          "If true, the journal stream to replicas is sent in LZ4 compressed frames during "
+          "stable sync. Only replicas that support it are affected.");
+
+ABSL_FLAG(uint32_t, replication_shared_sync_window_ms, 0,
+          "If positive, replicas that start a full sync within this many milliseconds of each "
+          "other share a single snapshot instead of serializing the dataset once per replica.");
+ABSL_FLAG(uint32_t, replication_shared_sync_write_timeout_ms, 10000,
+          "Replicas of a shared full sync that don't accept a write of the snapshot within this "
+          "many milliseconds are disconnected, so that they don't stall the other replicas.");
+
 namespace dfly {
 
 using namespace facade;
@@ -123,8 +136,123 @@ OpStatus WaitReplicaFlowToCatchup(absl::Time end_time, shared_ptr<DflyCmd::Repli
   return OpStatus::OK;
 }
 
+// Writes the shared snapshot of a shard to the flows of all the replicas that share it.
+// A replica whose socket fails or times out is dropped and its context gets the error, the
+// others go on.
+class FanOutSink : public io::Sink {
+ public:
+  FanOutSink() : write_timeout_ms_(absl::GetFlag(FLAGS_replication_shared_sync_write_timeout_ms)) {
+  }
+
+  struct Target {
+    FlowInfo* flow;
+    Context* cntx;
+    bool active = true;
+  };
+
+  void Add(FlowInfo* flow, Context* cntx) {
+    targets_.push_back({flow, cntx});
+  }
+
+  // Stops writing to the replica, waits for a write to it that is in progress.
+  void Drop(Context* cntx) {
+    for (Target& target : targets_) {
+      if (target.cntx == cntx) {
+        target.active = false;
+        write_done_.await([&] { return writing_ != &target; });
+      }
+    }
+  }
+
+  bool empty() const {
+    return none_of(targets_.begin(), targets_.end(), [](const Target& t) { return t.active; });
+  }
+
+  const vector<Target>& targets() const {
+    return targets_;
+  }
+
+  io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final {
+    size_t res = 0;
+    for (uint32_t i = 0; i < len; ++i)
+      res += v[i].iov_len;
+
+    for (Target& target : targets_)
+      Write(&target, [&](io::Sink* sink) { return sink->Write(v, len); });
+
+    if (empty())
+      return nonstd::make_unexpected(make_error_code(errc::broken_pipe));
+    return res;
+  }
+
+  void WriteEof() {
+    for (Target& target : targets_) {
+      Write(&target,
+            [&](io::Sink* sink) { return sink->Write(io::Buffer(target.flow->eof_token)); });
+    }
+  }
+
+ private:
+  template <typename F> void Write(Target* target, F&& write) {
+    if (!target->active)
+      return;
+
+    writing_ = target;
+    auto* sock = target->flow->conn->socket();
+    uint32_t prev_timeout = sock->timeout();
+    if (write_timeout_ms_ > 0)
+      sock->set_timeout(write_timeout_ms_);
+    error_code ec = write(sock);
+    sock->set_timeout(prev_timeout);
+    writing_ = nullptr;
+    write_done_.notifyAll();
+
+    if (ec && target->active) {
+      target->active = false;
+      target->cntx->ReportError(ec);
+    }
+  }
+
+  uint32_t write_timeout_ms_;
+  vector<Target> targets_;
+  const Target* writing_ = nullptr;
+  fb2::EventCount write_done_;
+};
+
 }  // namespace
 
+// A snapshot shared by the full sync of several replicas.
+struct SharedFullSync {
+  // State of every shard, only accessed from its thread.
+  struct Shard {
+    FanOutSink sink;
+    unique_ptr<RdbSaver> saver;
+
+    // Serializes the cleanup of replicas and the transition to stable sync.
+    fb2::Mutex mu;
+    bool finished = false;  // the saver fiber has finished.
+    fb2::EventCount finished_ec;
+  };
+
+  explicit SharedFullSync(unsigned shard_count) : shards(shard_count) {
+  }
+
+  Context cntx;
+  vector<Shard> shards;
+
+  fb2::Mutex mu;  // held while stopping.
+  bool stopped = false;
+};
+
+struct DflyCmd::PendingSharedSync {
+  vector<shared_ptr<ReplicaInfo>> replicas;
+  DflyVersion version;
+
+  OpStatus status = OpStatus::OK;
+  atomic_bool started{false};
+  fb2::EventCount started_ec;
+};
+
 DflyCmd::DflyCmd(ServerFamily* server_family) : sf_(server_family) {
 }
 
@@ -278,6 +406,16 @@ void DflyCmd::Flow(CmdArgList args, ConnectionContext* cntx) {
     }
   }
 
+  // Newer replicas accept a third element that describes the stable sync stream encoding.
+  if (flow.version >= DflyVersion::VER5) {
+    flow.compress_stream = absl::GetFlag(FLAGS_replication_stream_compression);
+    rb->StartArray(3);
+    rb->SendSimpleString(sync_type);
+    rb->SendSimpleString(eof_token);
+    rb->SendSimpleString(flow.compress_stream ? "LZ4" : "NONE");
+    return;
+  }
+
   rb->StartArray(2);
   rb->SendSimpleString(sync_type);
   rb->SendSimpleString(eof_token);
@@ -297,8 +435,14 @@ void DflyCmd::Sync(CmdArgList args, ConnectionContext* cntx) {
   if (!CheckReplicaStateOrReply(*replica_ptr, SyncState::PREPARATION, rb))
     return;
 
-  // Start full sync.
-  {
+  // Partial syncs start from their own offsets, so they can not share a snapshot.
+  bool shared = absl::GetFlag(FLAGS_replication_shared_sync_window_ms) > 0 &&
+                none_of(replica_ptr->flows.begin(), replica_ptr->flows.end(),
+                        [](const FlowInfo& flow) { return flow.start_partial_sync_at; });
+  if (shared) {
+    if (JoinSharedFullSync(replica_ptr, cntx) != OpStatus::OK)
+      return cntx->SendError(kInvalidState);
+  } else {
     TransactionGuard tg{cntx->transaction};
     AggregateStatus status;
 
@@ -336,7 +480,19 @@ void DflyCmd::StartStable(CmdArgList args, ConnectionContext* cntx) {
   if (!CheckReplicaStateOrReply(*replica_ptr, SyncState::FULL_SYNC, rb))
     return;
 
-  {
+  if (auto sync = replica_ptr->shared_sync; sync) {
+    lock_guard sync_lk(sync->mu);
+    if (!sync->stopped) {
+      TransactionGuard tg{cntx->transaction};
+      shard_set->RunBlockingInParallel(
+          [this, &sync](EngineShard* shard) { StopSharedFullSyncInThread(sync.get(), shard); });
+      sync->stopped = true;
+    }
+
+    // Dropped from the shared sync before it stopped.
+    if (replica_ptr->cntx.IsCancelled())
+      return cntx->SendError(kInvalidState);
+  } else {
     TransactionGuard tg{cntx->transaction};
     AggregateStatus status;
 
@@ -532,14 +688,17 @@ void DflyCmd::StopFullSyncInThread(FlowInfo* flow, EngineShard* shard) {
   flow->saver.reset();
 }
 
+void DflyCmd::StartStreamerInThread(FlowInfo* flow, Context* cntx, EngineShard* shard) {
+  flow->streamer.reset(new JournalStreamer(sf_->journal(), cntx));
+  flow->streamer->set_compress(flow->compress_stream);
+  bool send_lsn = flow->version >= DflyVersion::VER4;
+  flow->streamer->Start(flow->conn->socket(), send_lsn);
+}
+
 OpStatus DflyCmd::StartStableSyncInThread(FlowInfo* flow, Context* cntx, EngineShard* shard) {
   // Create streamer for shard flows.
-
-  if (shard != nullptr) {
-    flow->streamer.reset(new JournalStreamer(sf_->journal(), cntx));
-    bool send_lsn = flow->version >= DflyVersion::VER4;
-    flow->streamer->Start(flow->conn->socket(), send_lsn);
-  }
+  if (shard != nullptr)
+    StartStreamerInThread(flow, cntx, shard);
 
   // Register cleanup.
   flow->cleanup = [flow]() {
@@ -567,6 +726,151 @@ void DflyCmd::FullSyncFb(FlowInfo* flow, Context* cntx) {
   }
 }
 
+OpStatus DflyCmd::JoinSharedFullSync(shared_ptr<ReplicaInfo> replica, ConnectionContext* cntx) {
+  shared_ptr<PendingSharedSync> pending;
+  bool leader = false, published = false;
+  {
+    lock_guard lk(mu_);
+    if (pending_shared_sync_ && pending_shared_sync_->version == replica->version) {
+      pending = pending_shared_sync_;
+    } else {
+      // Replicas of different versions may expect different streams, so they don't share.
+      pending = make_shared<PendingSharedSync>();
+      pending->version = replica->version;
+      leader = true;
+      if (!pending_shared_sync_) {
+        pending_shared_sync_ = pending;
+        published = true;
+      }
+    }
+    pending->replicas.push_back(replica);
+  }
+
+  if (!leader) {
+    pending->started_ec.await([&] { return pending->started.load(); });
+    return replica->cntx.IsCancelled() ? OpStatus::CANCELLED : pending->status;
+  }
+
+  if (published) {
+    ThisFiber::SleepFor(chrono::milliseconds(
+        absl::GetFlag(FLAGS_replication_shared_sync_window_ms)));
+    lock_guard lk(mu_);
+    pending_shared_sync_.reset();
+  }
+
+  // The other replicas of the group wait with their locks held, so their state can't change.
+  auto sync = make_shared<SharedFullSync>(shard_set->size());
+  vector<ReplicaInfo*> members;
+  for (const auto& member : pending->replicas) {
+    if (!member->cntx.IsCancelled()) {
+      member->shared_sync = sync;
+      members.push_back(member.get());
+    }
+  }
+
+  {
+    TransactionGuard tg{cntx->transaction};
+    AggregateStatus status;
+    shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+      status = StartSharedFullSyncInThread(sync, members, shard);
+    });
+    pending->status = *status;
+  }
+
+  if (members.size() > 1) {
+    LOG(INFO) << "Started a full sync shared by " << members.size() << " replicas";
+  }
+
+  pending->started.store(true);
+  pending->started_ec.notifyAll();
+  return replica->cntx.IsCancelled() ? OpStatus::CANCELLED : pending->status;
+}
+
+OpStatus DflyCmd::StartSharedFullSyncInThread(shared_ptr<SharedFullSync> sync,
+                                              const vector<ReplicaInfo*>& replicas,
+                                              EngineShard* shard) {
+  ShardId sid = shard->shard_id();
+  SharedFullSync::Shard& sync_shard = sync->shards[sid];
+
+  for (ReplicaInfo* replica : replicas) {
+    FlowInfo* flow = &replica->flows[sid];
+    Context* cntx = &replica->cntx;
+    sync_shard.sink.Add(flow, cntx);
+
+    flow->cleanup = [flow, cntx, sync, &sync_shard]() {
+      lock_guard lk(sync_shard.mu);
+      flow->TryShutdownSocket();
+
+      // The shared sync has already moved the flow to stable sync.
+      if (flow->streamer) {
+        flow->streamer->Cancel();
+        return;
+      }
+
+      sync_shard.sink.Drop(cntx);
+      if (sync_shard.sink.empty() && sync_shard.saver) {
+        // The last replica of the shard is gone.
+        sync_shard.saver->Cancel();
+        sync_shard.finished_ec.await([&] { return sync_shard.finished; });
+      }
+    };
+  }
+
+  SaveMode save_mode = sid == 0 ? SaveMode::SINGLE_SHARD_WITH_SUMMARY : SaveMode::SINGLE_SHARD;
+  sync_shard.saver = make_unique<RdbSaver>(&sync_shard.sink, save_mode, false);
+
+  RdbSaver* saver = sync_shard.saver.get();
+  error_code ec;
+  if (save_mode == SaveMode::SINGLE_SHARD_WITH_SUMMARY)
+    ec = saver->SaveHeader(saver->GetGlobalData(&sf_->service()));
+  else
+    ec = saver->SaveHeader({});
+
+  // A failed header cancels all the replicas, so the fiber of the shard must not start.
+  if (ec) {
+    for (ReplicaInfo* replica : replicas)
+      replica->cntx.ReportError(ec);
+    sync_shard.saver.reset();
+    return OpStatus::CANCELLED;
+  }
+
+  saver->StartSnapshotInShard(true, sync->cntx.GetCancellation(), shard);
+
+  fb2::Fiber("shared_full_sync", [sync, &sync_shard] {
+    if (auto ec = sync_shard.saver->SaveBody(&sync->cntx, nullptr); !ec)
+      sync_shard.sink.WriteEof();
+
+    sync_shard.finished = true;
+    sync_shard.finished_ec.notifyAll();
+
+    // The saver is destroyed in its thread, once the cleanups that use it are done.
+    lock_guard lk(sync_shard.mu);
+    sync_shard.saver.reset();
+  }).Detach();
+
+  return OpStatus::OK;
+}
+
+void DflyCmd::StopSharedFullSyncInThread(SharedFullSync* sync, EngineShard* shard) {
+  SharedFullSync::Shard& sync_shard = sync->shards[shard->shard_id()];
+  lock_guard lk(sync_shard.mu);
+
+  // Without replicas, the saver is cancelled by the cleanup of the last one.
+  if (sync_shard.sink.empty())
+    return;
+
+  if (sync_shard.saver) {
+    sync_shard.saver->StopSnapshotInShard(shard);
+    sync_shard.finished_ec.await([&] { return sync_shard.finished; });
+  }
+
+  // Journal changes after the snapshot stopped go to the streamers, without a gap.
+  for (const auto& target : sync_shard.sink.targets()) {
+    if (target.active)
+      StartStreamerInThread(target.flow, target.cntx, shard);
+  }
+}
+
 auto DflyCmd::CreateSyncSession(ConnectionContext* cntx)
     -> std::pair<uint32_t, std::shared_ptr<ReplicaInfo>> {
   unique_lock lk(mu_);
@@ -708,6 +1012,7 @@ void DflyCmd::GetReplicationMemoryStats(ReplicationMemoryStats* stats) const {
   lock_guard lk_main{mu_};  // prevent state changes
   auto cb = [this, &stats, &stats_mu](EngineShard* shard) {
     lock_guard lk{stats_mu};
+    absl::flat_hash_set<const SharedFullSync*> shared_syncs;
     for (const auto& [_, info] : replica_infos_) {
       lock_guard repl_lk{info->mu};
 
@@ -723,6 +1028,14 @@ void DflyCmd::GetReplicationMemoryStats(ReplicationMemoryStats* stats) const {
 
       if (flow.saver)
         stats->full_sync_buf_bytes += flow.saver->GetTotalBuffersSize();
+
+      // The saver of a shared sync is counted once for all the replicas that share it.
+      if (const auto& sync = info->shared_sync; sync && shared_syncs.insert(sync.get()).second) {
+        auto& sync_shard = sync->shards[shard->shard_id()];
+        lock_guard sync_lk{sync_shard.mu};
+        if (sync_shard.saver)
+          stats->full_sync_buf_bytes += sync_shard.saver->GetTotalBuffersSize();
+      }
     }
   };
   shard_set->RunBlockingInParallel(cb);
@@ -25,6 +25,7 @@ class EngineShardSet;
 class ServerFamily;
 class RdbSaver;
 class JournalStreamer;
+struct SharedFullSync;
 struct ReplicaRoleInfo;
 struct ReplicationMemoryStats;
 
@@ -44,6 +45,7 @@ struct FlowInfo {
   std::string eof_token;
 
   DflyVersion version = DflyVersion::VER0;
+  bool compress_stream = false;  // Whether the stable sync journal stream is framed and compressed
 
   std::optional<LSN> start_partial_sync_at;
   uint64_t last_acked_lsn = 0;
@@ -94,6 +96,12 @@ struct FlowInfo {
 //      the per-replica mutex, so that all OnClose handlers will unblock and  internal resources
 //      will be released by dragonfly. Then the ReplicaInfo is removed from the global map.
 //
+// With --replication_shared_sync_window_ms, replicas that send SYNC within the window of each
+// other share a single snapshot, whose stream is written to the flows of all of them. The first
+// STARTSTABLE of the group stops the snapshot and moves all the replicas of the group to stable
+// sync at the same point of the journal, the STARTSTABLE of the others only switches their state.
+// A replica that does not accept a write within --replication_shared_sync_write_timeout_ms is
+// dropped from the group, so that it does not stall the others.
 //
 class DflyCmd {
  public:
@@ -123,6 +131,9 @@ class DflyCmd {
     // They are always indexed by the shard index on the master.
     std::vector<FlowInfo> flows;
     util::fb2::Mutex mu;  // See top of header for locking levels.
+
+    // Set when the full sync shares its snapshot with other replicas.
+    std::shared_ptr<SharedFullSync> shared_sync;
   };
 
  public:
@@ -200,6 +211,22 @@ class DflyCmd {
   // Fiber that runs full sync for each flow.
   void FullSyncFb(FlowInfo* flow, Context* cntx);
 
+  // Starts the journal streamer of a flow.
+  void StartStreamerInThread(FlowInfo* flow, Context* cntx, EngineShard* shard);
+
+  struct PendingSharedSync;
+
+  // Waits for other replicas to send SYNC, then starts a full sync shared by all of them.
+  facade::OpStatus JoinSharedFullSync(std::shared_ptr<ReplicaInfo> replica,
+                                      ConnectionContext* cntx);
+
+  facade::OpStatus StartSharedFullSyncInThread(std::shared_ptr<SharedFullSync> sync,
+                                               const std::vector<ReplicaInfo*>& replicas,
+                                               EngineShard* shard);
+
+  // Stops the shared snapshot and starts the stable sync of all the replicas that share it.
+  void StopSharedFullSyncInThread(SharedFullSync* sync, EngineShard* shard);
+
   // Main entrypoint for stopping replication.
   void StopReplication(uint32_t sync_id);
 
@@ -226,6 +253,9 @@ class DflyCmd {
   using ReplicaInfoMap = absl::btree_map<uint32_t, std::shared_ptr<ReplicaInfo>>;
   ReplicaInfoMap replica_infos_;
 
+  // Replicas waiting for the shared full sync to start, guarded by mu_.
+  std::shared_ptr<PendingSharedSync> pending_shared_sync_;
+
   mutable util::fb2::Mutex mu_;  // Guard global operations. See header top for locking levels.
 };
 
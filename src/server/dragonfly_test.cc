@@ -17,6 +17,7 @@ extern "C" {
 #include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "core/task_queue.h"
 #include "facade/facade_test.h"
 #include "server/conn_context.h"
 #include "server/main_service.h"
@@ -26,8 +27,11 @@ ABSL_DECLARE_FLAG(float, mem_defrag_threshold);
 ABSL_DECLARE_FLAG(float, mem_defrag_waste_threshold);
 ABSL_DECLARE_FLAG(uint32_t, mem_defrag_check_sec_interval);
 ABSL_DECLARE_FLAG(std::vector<std::string>, rename_command);
+ABSL_DECLARE_FLAG(std::vector<std::string>, user_rate_limits);
 ABSL_DECLARE_FLAG(double, oom_deny_ratio);
 ABSL_DECLARE_FLAG(bool, lua_resp2_legacy_float);
+ABSL_DECLARE_FLAG(bool, tx_batch_schedule);
+ABSL_DECLARE_FLAG(bool, key_prefix_compression);
 
 namespace dfly {
 
@@ -40,6 +44,7 @@ using ::io::Result;
 using testing::AnyOf;
 using testing::ElementsAre;
 using testing::HasSubstr;
+using testing::StartsWith;
 
 namespace {
 
@@ -135,6 +140,47 @@ TEST_F(DflyRenameCommandTest, RenameCommand) {
   ASSERT_THAT(Run({"abcdefghijklmnop"}), "PONG");
 }
 
+TEST_F(DflyEngineTest, RepeatedCommands) {
+  // The connection reuses the last resolved command, which must not leak into others.
+  EXPECT_EQ(Run({"set", "a", "1"}), "OK");
+  EXPECT_EQ(Run({"SET", "b", "2"}), "OK");
+  EXPECT_EQ(Run({"sEt", "c", "3"}), "OK");
+  EXPECT_EQ(Run({"get", "c"}), "3");
+  EXPECT_THAT(Run({"setx", "a"}), ErrArg("unknown command `SETX`"));
+
+  EXPECT_EQ(Run({"xgroup", "create", "s", "g", "$", "MKSTREAM"}), "OK");
+  EXPECT_THAT(Run({"xgroup", "help"}), ArgType(RespExpr::ARRAY));
+  EXPECT_THAT(Run({"xgroup", "create", "s", "g", "$"}), ErrArg("BUSYGROUP"));
+
+  EXPECT_THAT(Run({"acl", "whoami"}), ArgType(RespExpr::STRING));
+  EXPECT_THAT(Run({"acl", "whoami", "x"}), ErrArg("for 'acl whoami' command"));
+}
+
+class DflyUserRateLimitTest : public DflyEngineTest {
+ protected:
+  DflyUserRateLimitTest() : DflyEngineTest() {
+    absl::SetFlag(&FLAGS_user_rate_limits, std::vector<std::string>({"default:100:0"}));
+  }
+
+  void TearDown() {
+    absl::SetFlag(&FLAGS_user_rate_limits, std::vector<std::string>({}));
+    DflyEngineTest::TearDown();
+  }
+};
+
+TEST_F(DflyUserRateLimitTest, Ops) {
+  auto start = absl::Now();
+  for (unsigned i = 0; i < 40; ++i)
+    Run({"set", "a", "1"});
+
+  // The first 100ms of commands run right away, the rest at 100 per second.
+  EXPECT_GE(absl::Now() - start, absl::Milliseconds(250));
+
+  auto metrics = GetMetrics();
+  ASSERT_EQ(1u, metrics.user_throttle_map.count("default"));
+  EXPECT_GT(metrics.user_throttle_map["default"].delayed, 20u);
+}
+
 TEST_F(SingleThreadDflyEngineTest, GlobalSingleThread) {
   Run({"set", "a", "1"});
   Run({"move", "a", "1"});
@@ -216,6 +262,30 @@ TEST_F(DflyEngineTest, EvalBug713) {
   fb0.Join();
 }
 
+TEST_F(DflyEngineTest, BatchSchedule) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_tx_batch_schedule, true);
+
+  // Connections on the same thread schedule on the same shard at the same time.
+  constexpr unsigned kConns = 10, kRuns = 100;
+  vector<Fiber> fbs;
+  for (unsigned i = 0; i < kConns; ++i) {
+    fbs.push_back(pp_->at(1)->LaunchFiber([this, i] {
+      string id = StrCat("conn", i);
+      for (unsigned j = 0; j < kRuns; ++j) {
+        Run(id, {"incr", kKeySid0});
+        Run(id, {"set", kKeySid1, id});
+      }
+    }));
+  }
+
+  for (auto& fb : fbs)
+    fb.Join();
+
+  EXPECT_EQ(Run({"get", kKeySid0}), StrCat(kConns * kRuns));
+  EXPECT_THAT(Run({"get", kKeySid1}), ArgType(RespExpr::STRING));
+}
+
 // Tests deadlock that happenned due to a fact that trans->Schedule was called
 // before interpreter->Lock().
 //
@@ -355,6 +425,31 @@ TEST_F(DflyEngineTest, Memcache) {
   EXPECT_THAT(resp, ElementsAre("END"));
 }
 
+TEST_F(DflyEngineTest, MemcacheMultiGet) {
+  using MP = MemcacheParser;
+
+  string line = "get";
+  vector<string> expected;
+  for (unsigned i = 0; i < 100; ++i) {
+    absl::StrAppend(&line, " key", i);
+    if (i % 3 == 0)
+      continue;  // misses are skipped in the reply.
+
+    string key = absl::StrCat("key", i), value = absl::StrCat("val", i);
+    ASSERT_THAT(RunMC(MP::SET, key, value, i), ElementsAre("STORED"));
+    expected.push_back(absl::StrCat("VALUE ", key, " ", i, " ", value.size()));
+    expected.push_back(value);
+  }
+  expected.push_back("END");
+  EXPECT_EQ(RunMCLine(line), expected);
+
+  auto resp = RunMCLine("gets key1 key3");
+  ASSERT_EQ(resp.size(), 3);
+  EXPECT_THAT(resp[0], StartsWith("VALUE key1 1 4"));
+  EXPECT_EQ(resp[1], "val1");
+  EXPECT_EQ(resp[2], "END");
+}
+
 TEST_F(DflyEngineTest, MemcacheFlags) {
   using MP = MemcacheParser;
 
@@ -364,6 +459,51 @@ TEST_F(DflyEngineTest, MemcacheFlags) {
   EXPECT_THAT(resp2, ElementsAre("VALUE key 42 3", "bar", "END"));
 }
 
+TEST_F(DflyEngineTest, MemcacheMeta) {
+  auto resp = RunMCLine("ms key 3 F5 T100", "bar");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+
+  resp = RunMCLine("mg key v f s k Oabc");
+  EXPECT_THAT(resp, ElementsAre("VA 3 f5 s3 kkey Oabc", "bar"));
+
+  resp = RunMCLine("mg key t");
+  EXPECT_THAT(resp, ElementsAre("HD t100"));
+
+  resp = RunMCLine("mg unkn v");
+  EXPECT_THAT(resp, ElementsAre("EN"));
+
+  // Quiet mode omits the response for a miss, but not for a hit.
+  resp = RunMCLine("mg unkn v q");
+  EXPECT_THAT(resp, ElementsAre());
+  resp = RunMCLine("mg key v q");
+  EXPECT_THAT(resp, ElementsAre("VA 3", "bar"));
+
+  resp = RunMCLine("mn");
+  EXPECT_THAT(resp, ElementsAre("MN"));
+
+  resp = RunMCLine("ms key 3 ME", "baz");
+  EXPECT_THAT(resp, ElementsAre("NS"));
+  resp = RunMCLine("ms key 3 MA", "baz");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+  resp = RunMCLine("mg key v");
+  EXPECT_THAT(resp, ElementsAre("VA 6", "barbaz"));
+
+  resp = RunMCLine("ms cnt 2", "10");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+  resp = RunMCLine("ma cnt D5 v");
+  EXPECT_THAT(resp, ElementsAre("VA 2", "15"));
+  resp = RunMCLine("ma cnt MD");
+  EXPECT_THAT(resp, ElementsAre("HD"));
+  resp = RunMCLine("ma unkn");
+  EXPECT_THAT(resp, ElementsAre("NF"));
+
+  resp = RunMCLine("md key q");
+  EXPECT_THAT(resp, ElementsAre());
+  resp = RunMCLine("md key");
+  EXPECT_THAT(resp, ElementsAre("NF"));
+  EXPECT_EQ(Run({"get", "cnt"}), "14");
+}
+
 TEST_F(DflyEngineTest, LimitMemory) {
   mi_option_enable(mi_option_limit_os_alloc);
   string blob(128, 'a');
@@ -462,6 +602,24 @@ TEST_F(DflyEngineTest, Bug207) {
   }
 }
 
+TEST_F(DflyEngineTest, BackgroundEviction) {
+  absl::FlagSaver fs;
+  SetTestFlag("cache_mode", "true");
+  ResetService();
+
+  // Fill about 60% of maxmemory, the heartbeat evicts only when less than 10% is free.
+  max_memory_limit = 20 << 20;
+  Run({"debug", "populate", "50000", "key", "200"});
+  ASSERT_EQ(GetMetrics().events.evicted_keys, 0u);
+
+  SetTestFlag("background_eviction_watermark", "0.5");
+  shard_set->TEST_EnableHeartBeat();
+
+  ExpectConditionWithinTimeout([this] { return GetMetrics().events.evicted_keys > 0; });
+  EXPECT_LT(CheckedInt({"dbsize"}), 50000);
+  EXPECT_EQ(Run({"set", "foo", "bar"}), "OK");
+}
+
 TEST_F(DflyEngineTest, StickyEviction) {
   shard_set->TEST_EnableHeartBeat();
   shard_set->TEST_EnableCacheMode();
@@ -517,6 +675,56 @@ TEST_F(DflyEngineTest, PSubscribe) {
   EXPECT_EQ("foo", msg.message);
   EXPECT_EQ("ab", msg.channel);
   EXPECT_EQ("a*", msg.pattern);
+  EXPECT_EQ("$2\r\nab\r\n$3\r\nfoo\r\n", msg.serialized);
+}
+
+TEST_F(DflyEngineTest, PSubscribeManyPatterns) {
+  single_response_ = false;
+  pp_->at(1)->Await([&] {
+    return Run({"psubscribe", "a*", "ab*", "abc", "a?c", "[ab]bc", "*", "b*", "abcd*", "a\\bc"});
+  });
+
+  // a*, ab*, abc, a?c, [ab]bc, * and a\bc match.
+  auto resp = pp_->at(0)->Await([&] { return Run({"publish", "abc", "foo"}); });
+  EXPECT_THAT(resp, IntArg(7));
+
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "bbc", "foo"}); });
+  EXPECT_THAT(resp, IntArg(3));
+
+  pp_->at(1)->Await([&] { return Run({"punsubscribe", "*", "abc"}); });
+  resp = pp_->at(0)->Await([&] { return Run({"publish", "abcde", "foo"}); });
+  EXPECT_THAT(resp, IntArg(3));  // a*, ab* and abcd*
+}
+
+TEST_F(DflyEngineTest, SSubscribe) {
+  single_response_ = false;
+  pp_->at(1)->Await([&] { return Run({"ssubscribe", "ch"}); });
+
+  // Shard channels do not receive regular publishes and vice versa.
+  auto resp = pp_->at(0)->Await([&] { return Run({"publish", "ch", "foo"}); });
+  EXPECT_THAT(resp, IntArg(0));
+  resp = pp_->at(0)->Await([&] { return Run({"spublish", "ch", "bar"}); });
+  EXPECT_THAT(resp, IntArg(1));
+
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+
+  ASSERT_EQ(1, SubscriberMessagesLen("IO1"));
+  const auto& msg = GetPublishedMessage("IO1", 0);
+  EXPECT_EQ("bar", msg.message);
+  EXPECT_EQ("ch", msg.channel);
+  EXPECT_TRUE(msg.sharded);
+
+  resp = pp_->at(0)->Await([&] { return Run({"pubsub", "shardchannels"}); });
+  EXPECT_EQ(resp, "ch");
+  resp = pp_->at(0)->Await([&] { return Run({"pubsub", "channels"}); });
+  EXPECT_THAT(resp, ArrLen(0));
+  resp = pp_->at(0)->Await([&] { return Run({"pubsub", "shardnumsub", "ch"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("ch", IntArg(1)));
+
+  resp = pp_->at(1)->Await([&] { return Run({"sunsubscribe"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("sunsubscribe", "ch", IntArg(0)));
+  resp = pp_->at(0)->Await([&] { return Run({"pubsub", "shardnumsub", "ch"}); });
+  EXPECT_THAT(resp.GetVec(), ElementsAre("ch", IntArg(0)));
 }
 
 TEST_F(DflyEngineTest, Unsubscribe) {
@@ -725,6 +933,46 @@ TEST_F(DflyEngineTest, Issue752) {
   ASSERT_THAT(resp.GetVec(), ElementsAre(IntArg(0), IntArg(0)));
 }
 
+TEST_F(DflyEngineTest, MemoryProfile) {
+  EXPECT_THAT(Run({"memory", "profile"}), ErrArg("requires --memory_profile_sample_rate"));
+
+  absl::FlagSaver fs;
+  SetTestFlag("memory_profile_sample_rate", "1");
+  Run({"flushall"});  // Recreates the tables with the profile.
+
+  for (unsigned i = 0; i < 100; ++i) {
+    Run({"set", StrCat("user:", i, ":name"), string(2000, 'x')});
+    Run({"hset", StrCat("session:", i), "field", string(500, 'x')});
+  }
+  Run({"set", "session:0:extra", string(500, 'x')});
+
+  auto resp = Run({"memory", "profile", "top", "3"});
+  ASSERT_THAT(resp, ArrLen(3));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre("user:", "STRING", testing::_));
+  EXPECT_THAT(resp.GetVec()[1].GetVec(), ElementsAre("session:", "HASH", testing::_));
+  EXPECT_THAT(resp.GetVec()[2].GetVec(), ElementsAre("session:", "STRING", testing::_));
+  int64_t user_bytes = *resp.GetVec()[0].GetVec()[2].GetInt();
+  EXPECT_GT(user_bytes, 100 * 2000);
+
+  resp = Run({"memory", "profile", "top", "2", "prefix-depth", "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  EXPECT_THAT(resp.GetVec()[0].GetVec()[0].GetString(), testing::StartsWith("user:"));
+  EXPECT_THAT(resp.GetVec()[0].GetVec()[0].GetString(), testing::EndsWith(":"));
+
+  // Deleted keys are not accounted anymore.
+  for (unsigned i = 0; i < 90; ++i)
+    Run({"del", StrCat("user:", i, ":name")});
+  resp = Run({"memory", "profile", "top", "3"});
+  ASSERT_THAT(resp, ArrLen(3));
+  EXPECT_THAT(resp.GetVec()[0].GetVec(), ElementsAre("session:", "HASH", testing::_));
+  EXPECT_THAT(resp.GetVec()[1].GetVec(), ElementsAre("user:", "STRING", testing::_));
+  EXPECT_LT(*resp.GetVec()[1].GetVec()[2].GetInt(), user_bytes / 5);
+
+  EXPECT_THAT(Run({"memory", "profile", "prefix-depth", "0"}), ErrArg("PREFIX-DEPTH"));
+  Run({"flushall"});
+  EXPECT_THAT(Run({"memory", "profile"}), ArrLen(0));
+}
+
 TEST_F(DflyEngineTest, Latency) {
   Run({"latency", "latest"});
 }
@@ -743,6 +991,46 @@ TEST_F(DflyEngineTest, EvalBug2664) {
   EXPECT_THAT(resp, DoubleArg(42.9));
 }
 
+class DflyKeyPrefixTest : public DflyEngineTest {
+ protected:
+  void SetUp() override {
+    absl::SetFlag(&FLAGS_key_prefix_compression, true);
+    DflyEngineTest::SetUp();
+  }
+
+  absl::FlagSaver saver_;
+};
+
+TEST_F(DflyKeyPrefixTest, Commands) {
+  constexpr string_view kPrefix = "user:session:profile:";
+  for (unsigned i = 0; i < 100; ++i)
+    Run({"set", absl::StrCat(kPrefix, i), absl::StrCat("val", i)});
+
+  EXPECT_GT(GetMetrics().key_prefix_bytes, 0u);
+  EXPECT_EQ(Run({"get", absl::StrCat(kPrefix, 42)}), "val42");
+  EXPECT_THAT(Run({"exists", absl::StrCat(kPrefix, 99), absl::StrCat(kPrefix, 100)}), IntArg(1));
+  EXPECT_THAT(Run({"keys", absl::StrCat(kPrefix, "1?")}), ArrLen(10));
+
+  // Keys that do not fit keep their plain encoding.
+  string long_key = absl::StrCat(kPrefix, string(20, 'x'));
+  Run({"set", long_key, "long"});
+  EXPECT_EQ(Run({"get", long_key}), "long");
+
+  EXPECT_EQ(Run({"rename", absl::StrCat(kPrefix, 1), "renamed:prefix:key:1"}), "OK");
+  EXPECT_EQ(Run({"get", "renamed:prefix:key:1"}), "val1");
+  EXPECT_THAT(Run({"get", absl::StrCat(kPrefix, 1)}), ArgType(RespExpr::NIL));
+
+  EXPECT_EQ(Run({"debug", "reload"}), "OK");
+  EXPECT_EQ(CheckedInt({"dbsize"}), 101);
+  EXPECT_EQ(Run({"get", absl::StrCat(kPrefix, 7)}), "val7");
+  EXPECT_EQ(Run({"get", "renamed:prefix:key:1"}), "val1");
+  EXPECT_GT(GetMetrics().key_prefix_bytes, 0u);
+
+  // The prefixes are released together with the last keys that use them.
+  Run({"flushall"});
+  ExpectConditionWithinTimeout([this] { return GetMetrics().key_prefix_bytes == 0; });
+}
+
 // TODO: to test transactions with a single shard since then all transactions become local.
 // To consider having a parameter in dragonfly engine controlling number of shards
 // unconditionally from number of cpus. TO TEST BLPOP under multi for single/multi argument case.
@@ -780,4 +1068,20 @@ static void BM_ParseDoubleAbsl(benchmark::State& state) {
 }
 BENCHMARK(BM_ParseDoubleAbsl);
 
+// Round trip latency of a hop to another thread through a shard queue.
+static void BM_TaskQueueHop(benchmark::State& state) {
+  unique_ptr<ProactorPool> pp(fb2::Pool::Epoll(2));
+  pp->Run();
+
+  TaskQueue queue(1);
+  pp->at(1)->Await([&] { queue.Start("bench_queue"); });
+  pp->at(0)->Await([&] {
+    while (state.KeepRunning())
+      benchmark::DoNotOptimize(queue.Await([] { return 42; }));
+  });
+  pp->at(1)->Await([&] { queue.Shutdown(); });
+  pp->Stop();
+}
+BENCHMARK(BM_TaskQueueHop);
+
 }  // namespace dfly
@@ -4,11 +4,15 @@
 
 #include "server/engine_shard_set.h"
 
+#include <absl/strings/ascii.h>
 #include <absl/strings/match.h>
+#include <absl/strings/str_split.h>
 
 #include <cerrno>
 
 extern "C" {
+#include "redis/quicklist.h"
+#include "redis/redis_aux.h"
 #include "redis/zmalloc.h"
 }
 #include <sys/statvfs.h>
@@ -17,9 +21,15 @@ extern "C" {
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/chunked_list.h"
+#include "core/link_slab.h"
+#include "core/sorted_map.h"
+#include "core/string_map.h"
+#include "core/string_set.h"
 #include "io/proc_reader.h"
 #include "server/blocking_controller.h"
 #include "server/cluster/cluster_defs.h"
+#include "server/hset_family.h"
 #include "server/search/doc_index.h"
 #include "server/server_state.h"
 #include "server/tiered_storage.h"
@@ -34,7 +44,8 @@ ABSL_FLAG(string, tiered_prefix, "",
           "Experimental flag. Enables tiered storage if set. "
           "The string denotes the path and prefix of the files "
           " associated with tiered storage. Stronly advised to use "
-          "high performance NVME ssd disks for this.");
+          "high performance NVME ssd disks for this. Several comma separated prefixes, "
+          "for example on different devices, distribute the shard files between them.");
 
 ABSL_FLAG(dfly::MemoryBytesFlag, tiered_max_file_size, dfly::MemoryBytesFlag{},
           "Limit on maximum file size that is used by the database for tiered storage. "
@@ -52,6 +63,27 @@ ABSL_FLAG(bool, cache_mode, false,
           "If true, the backend behaves like a cache, "
           "by evicting entries when getting close to maxmemory limit");
 
+ABSL_FLAG(double, background_eviction_watermark, 0,
+          "In cache mode, if positive, a background fiber of every shard evicts items ahead of "
+          "time to keep at least this fraction of the shard's share of maxmemory free. Its pace "
+          "follows the allocation rate, so that inserts rarely need to evict. 0 disables it.");
+
+ABSL_FLAG(string, dash_huge_pages, "",
+          "If set, the segments of the dash tables are allocated from a dedicated arena of 2MB "
+          "huge pages instead of the general heap. 'transparent' relies on transparent huge "
+          "pages, 'explicit' maps reserved huge pages and falls back to transparent ones");
+
+ABSL_FLAG(bool, key_prefix_compression, false,
+          "Stores keys that share a ':' delimited prefix and whose rest fits into 13 bytes as the "
+          "id of the prefix in a dictionary of the shard plus the inline rest, without "
+          "allocating the key. Saves memory when many keys share long prefixes.");
+
+ABSL_FLAG(uint32_t, compress_strings_min_size, 0,
+          "If positive, string values of at least this size are stored compressed with zstd "
+          "when that saves at least 1/8 of their size. The first values of each shard train a "
+          "dictionary that is used for the rest. Trades CPU on every read for memory. "
+          "0 disables compression.");
+
 ABSL_FLAG(float, mem_defrag_threshold, 0.7,
           "Minimum percentage of used memory relative to maxmemory cap before running "
           "defragmentation");
@@ -69,9 +101,21 @@ ABSL_FLAG(string, shard_round_robin_prefix, "",
           "support up to a few hundreds of prefixes. Note: prefix is looked inside hash tags when "
           "cluster mode is enabled.");
 
+ABSL_FLAG(bool, shard_by_hashtag, false,
+          "When true, keys are distributed across shards by their {hashtag} even outside of "
+          "cluster mode, so that multi key commands on keys with the same tag run on a single "
+          "shard. Unlike lock_on_hashtags, locks stay at the key level. Hashtag extraction can be "
+          "configured with locktag_* flags.");
+
 ABSL_FLAG(uint32_t, mem_defrag_check_sec_interval, 10,
           "Number of seconds between every defragmentation necessity check");
 
+ABSL_FLAG(bool, shard_cpu_stats, false,
+          "If true, accounts the thread cpu time spent in the shard callbacks per command, "
+          "reported in INFO COMMANDSTATS and DEBUG SHARDS");
+
+ABSL_DECLARE_FLAG(uint32_t, max_eviction_per_heartbeat);
+
 namespace dfly {
 
 using namespace tiering::literals;
@@ -82,10 +126,20 @@ using strings::HumanReadableNumBytes;
 
 namespace {
 
+vector<string> GetTieredPrefixes() {
+  return absl::StrSplit(GetFlag(FLAGS_tiered_prefix), ',', absl::SkipEmpty());
+}
+
 constexpr uint64_t kCursorDoneState = 0u;
 
 vector<EngineShardSet::CachedStats> cached_stats;  // initialized in EngineShardSet::Init
 
+// Set in EngineShardSet::Init, read only afterwards.
+bool shard_by_hashtag = false;
+
+// Callbacks of the calling thread waiting to be handed over to the shard queues, by shard id.
+thread_local vector<vector<function<void()>>> tl_outbound_batches;
+
 struct ShardMemUsage {
   std::size_t commited = 0;
   std::size_t used = 0;
@@ -202,6 +256,71 @@ vector<ShardId> RoundRobinSharder::round_robin_shards_;
 ShardId RoundRobinSharder::next_shard_;
 fb2::Mutex RoundRobinSharder::mutex_;
 
+unique_ptr<HugePageResource> MakeSegmentResource(PMR_NS::memory_resource* upstream) {
+  string mode = absl::AsciiStrToLower(GetFlag(FLAGS_dash_huge_pages));
+  if (mode.empty())
+    return nullptr;
+
+  unique_ptr<HugePageResource> res;
+  if (mode == "transparent") {
+    res = make_unique<HugePageResource>(upstream, HugePageResource::Mode::TRANSPARENT);
+  } else if (mode == "explicit") {
+    res = make_unique<HugePageResource>(upstream, HugePageResource::Mode::EXPLICIT);
+  } else {
+    LOG(ERROR) << "Invalid value for dash_huge_pages: " << mode
+               << ", expected 'transparent' or 'explicit'";
+    exit(1);
+  }
+
+  res->AddBlockSize(PrimeTable::kSegBytes);
+  res->AddBlockSize(ExpireTable::kSegBytes);
+  return res;
+}
+
+// Frees a part of a value of the lazyfree queue, so that freeing a large value does not block
+// the shard. Returns true once the value is empty. Listpacks and intsets are single allocations,
+// so they are freed at once by the destructor of the value.
+bool LazyFreeStep(PrimeValue* pv, uint32_t* cursor) {
+  constexpr uint32_t kBucketsPerStep = 1024;
+  constexpr uint32_t kEntriesPerStep = 1024;
+
+  switch (pv->Encoding()) {
+    case kEncodingStrMap2: {
+      DenseSet* ds = nullptr;
+      if (pv->ObjType() == OBJ_SET)
+        ds = static_cast<StringSet*>(pv->RObjPtr());
+      else if (pv->ObjType() == OBJ_HASH)
+        ds = static_cast<StringMap*>(pv->RObjPtr());
+      if (ds)
+        *cursor = ds->ClearStep(*cursor, kBucketsPerStep);
+      return *cursor == 0;
+    }
+    case OBJ_ENCODING_SKIPLIST: {
+      if (pv->ObjType() != OBJ_ZSET)
+        return true;
+      auto* sm = static_cast<detail::SortedMap*>(pv->RObjPtr());
+      if (size_t size = sm->Size(); size > 0)
+        sm->DeleteRangeByRank(0, min<size_t>(size, kEntriesPerStep) - 1);
+      return sm->Size() == 0;
+    }
+    case OBJ_ENCODING_QUICKLIST: {
+      auto* ql = static_cast<quicklist*>(pv->RObjPtr());
+      quicklistDelRange(ql, 0, kEntriesPerStep);
+      return ql->count == 0;
+    }
+    case kEncodingChunkedList: {
+      if (pv->ObjType() != OBJ_LIST)
+        return true;
+      auto* cl = static_cast<ChunkedList*>(pv->RObjPtr());
+      for (uint32_t i = 0; i < kEntriesPerStep && !cl->Empty(); ++i)
+        cl->PopFront();
+      return cl->Empty();
+    }
+    default:
+      return true;
+  }
+}
+
 }  // namespace
 
 constexpr size_t kQueueLen = 64;
@@ -211,14 +330,16 @@ EngineShardSet* shard_set = nullptr;
 uint64_t TEST_current_time_ms = 0;
 
 EngineShard::Stats& EngineShard::Stats::operator+=(const EngineShard::Stats& o) {
-  static_assert(sizeof(Stats) == 48);
+  static_assert(sizeof(Stats) == 64);
 
   defrag_attempt_total += o.defrag_attempt_total;
   defrag_realloc_total += o.defrag_realloc_total;
   defrag_task_invocation_total += o.defrag_task_invocation_total;
   poll_execution_total += o.poll_execution_total;
   tx_ooo_total += o.tx_ooo_total;
+  tx_ooo_marked_total += o.tx_ooo_marked_total;
   tx_immediate_total += o.tx_immediate_total;
+  lazyfree_freed_total += o.lazyfree_freed_total;
 
   return *this;
 }
@@ -242,7 +363,7 @@ void EngineShard::DefragTaskState::ResetScanState() {
 // 3. in case the above is OK, make sure that we have a "gap" between usage and commited memory
 // (control by mem_defrag_waste_threshold flag)
 bool EngineShard::DefragTaskState::CheckRequired() {
-  if (is_force_defrag || cursor > kCursorDoneState) {
+  if (is_force_defrag || cursor > kCursorDoneState || !containers.empty()) {
     is_force_defrag = false;
     VLOG(2) << "cursor: " << cursor << " and is_force_defrag " << is_force_defrag;
     return true;
@@ -293,6 +414,12 @@ bool EngineShard::DoDefrag() {
   constexpr size_t kMaxTraverses = 40;
   const float threshold = GetFlag(FLAGS_mem_defrag_page_utilization_threshold);
 
+  // Finish with the large containers before moving on.
+  if (!defrag_state_.containers.empty()) {
+    DefragContainerStep(threshold);
+    return true;
+  }
+
   auto& slice = db_slice();
 
   // If we moved to an invalid db, skip as long as it's not the last one
@@ -312,18 +439,32 @@ bool EngineShard::DoDefrag() {
   unsigned traverses_count = 0;
   uint64_t attempts = 0;
 
+  const auto& lock_table = slice.GetDBTable(defrag_state_.dbid)->trans_locks;
+  string tmp;
+
   do {
     cur = prime_table->Traverse(cur, [&](PrimeIterator it) {
+      // Values of locked keys may be referenced by replies that are being written,
+      // see get_zero_copy_threshold.
+      if (lock_table.Size() > 0 && lock_table.Find(LockTag(it->first.GetSlice(&tmp))).has_value())
+        return;
+
       // for each value check whether we should move it because it
       // seats on underutilized page of memory, and if so, do it.
-      bool did = it->second.DefragIfNeeded(threshold);
+      uint32_t obj_cursor = 0;
+      bool did = it->second.DefragIfNeeded(threshold, &obj_cursor);
+      HSetFamily::RecordIfCold(defrag_state_.dbid, it->first, it->second);
+      if (obj_cursor) {
+        defrag_state_.containers.push_back(
+            {DbIndex(defrag_state_.dbid), it->first.ToString(), obj_cursor});
+      }
       attempts++;
       if (did) {
         reallocations++;
       }
     });
     traverses_count++;
-  } while (traverses_count < kMaxTraverses && cur);
+  } while (traverses_count < kMaxTraverses && cur && defrag_state_.containers.empty());
 
   defrag_state_.UpdateScanState(cur.value());
 
@@ -345,6 +486,61 @@ bool EngineShard::DoDefrag() {
   return true;
 }
 
+void EngineShard::DefragContainerStep(float threshold) {
+  auto& container = defrag_state_.containers.front();
+  auto& slice = db_slice();
+
+  // The container could have been deleted or replaced since the previous step. The cursor of
+  // another container only makes its first step start in the middle.
+  if (slice.IsDbValid(container.db)) {
+    DbTable* table = slice.GetDBTable(container.db);
+    if (table->trans_locks.Size() > 0 &&
+        table->trans_locks.Find(LockTag(container.key)).has_value()) {
+      // Retry later, after the other containers.
+      defrag_state_.containers.push_back(std::move(container));
+      defrag_state_.containers.pop_front();
+      return;
+    }
+
+    if (auto it = table->prime.Find(container.key); IsValid(it)) {
+      stats_.defrag_attempt_total++;
+      stats_.defrag_realloc_total += it->second.DefragIfNeeded(threshold, &container.cursor);
+      stats_.defrag_task_invocation_total++;
+      if (container.cursor)
+        return;
+    }
+  }
+
+  defrag_state_.containers.pop_front();
+}
+
+void EngineShard::FreeLazily(PrimeValue pv) {
+  bool idle = lazyfree_queue_.empty();
+  lazyfree_queue_.push_back(std::move(pv));
+  if (!idle)
+    return;
+
+  // The previous fiber has finished, as it exits right after emptying the queue.
+  if (fiber_lazyfree_.IsJoinable())
+    fiber_lazyfree_.Join();
+  fiber_lazyfree_ = fb2::Fiber(absl::StrCat("shard_lazyfree", shard_id()), [this] {
+    RunLazyFree();
+  });
+}
+
+void EngineShard::RunLazyFree() {
+  while (true) {
+    if (LazyFreeStep(&lazyfree_queue_.front(), &lazyfree_cursor_)) {
+      lazyfree_queue_.pop_front();
+      stats_.lazyfree_freed_total++;
+    }
+
+    if (lazyfree_queue_.empty())
+      break;
+    ThisFiber::Yield();
+  }
+}
+
 // the memory defragmentation task is as follow:
 //  1. Check if memory usage is high enough
 //  2. Check if diff between commited and used memory is high enough
@@ -359,6 +555,7 @@ uint32_t EngineShard::DefragTask() {
 
   if (defrag_state_.CheckRequired()) {
     VLOG(2) << shard_id << ": need to run defrag memory cursor state: " << defrag_state_.cursor;
+    LatencyScope latency("active-defrag-cycle");
     if (DoDefrag()) {
       // we didn't finish the scan
       return util::ProactorBase::kOnIdleMaxLevel;
@@ -371,7 +568,9 @@ EngineShard::EngineShard(util::ProactorBase* pb, mi_heap_t* heap)
     : queue_(1, kQueueLen),
       txq_([](const Transaction* t) { return t->txid(); }),
       mi_resource_(heap),
-      db_slice_(pb->GetPoolIndex(), GetFlag(FLAGS_cache_mode), this) {
+      segment_resource_(MakeSegmentResource(&mi_resource_)),
+      db_slice_(pb->GetPoolIndex(), GetFlag(FLAGS_cache_mode), this),
+      cmd_cpu_stats_enabled_(GetFlag(FLAGS_shard_cpu_stats)) {
   tmp_str1 = sdsempty();
 
   db_slice_.UpdateExpireBase(absl::GetCurrentTimeNanos() / 1000000, 0);
@@ -396,6 +595,12 @@ void EngineShard::Shutdown() {
   if (fiber_periodic_.IsJoinable()) {
     fiber_periodic_.Join();
   }
+  if (fiber_evictor_.IsJoinable()) {
+    fiber_evictor_.Join();
+  }
+  if (fiber_lazyfree_.IsJoinable()) {
+    fiber_lazyfree_.Join();
+  }
 
   ProactorBase::me()->RemoveOnIdleTask(defrag_task_);
 }
@@ -409,6 +614,18 @@ void EngineShard::StartPeriodicFiber(util::ProactorBase* pb) {
     ThisFiber::SetName(absl::StrCat("shard_periodic", index));
     RunPeriodic(std::chrono::milliseconds(period_ms));
   });
+
+  StartEvictionFiber(pb->GetPoolIndex());
+}
+
+void EngineShard::StartEvictionFiber(unsigned index) {
+  if (double watermark = GetFlag(FLAGS_background_eviction_watermark);
+      watermark > 0 && GetFlag(FLAGS_cache_mode)) {
+    fiber_evictor_ = MakeFiber([this, index, watermark] {
+      ThisFiber::SetName(absl::StrCat("shard_evictor", index));
+      RunBackgroundEviction(watermark);
+    });
+  }
 }
 
 void EngineShard::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t max_file_size) {
@@ -419,12 +636,15 @@ void EngineShard::InitThreadLocal(ProactorBase* pb, bool update_db_time, size_t
   shard_ = new (ptr) EngineShard(pb, data_heap);
 
   CompactObj::InitThreadLocal(shard_->memory_resource());
+  CompactObj::EnableKeyPrefixes(GetFlag(FLAGS_key_prefix_compression));
+  CompactObj::EnableStringCompression(GetFlag(FLAGS_compress_strings_min_size));
   SmallString::InitThreadLocal(data_heap);
 
-  if (string backing_prefix = GetFlag(FLAGS_tiered_prefix); !backing_prefix.empty()) {
+  if (vector<string> prefixes = GetTieredPrefixes(); !prefixes.empty()) {
     LOG_IF(FATAL, pb->GetKind() != ProactorBase::IOURING)
         << "Only ioring based backing storage is supported. Exiting...";
 
+    const string& backing_prefix = prefixes[pb->GetPoolIndex() % prefixes.size()];
     shard_->tiered_storage_ = make_unique<TieredStorage>(&shard_->db_slice_, max_file_size);
     error_code ec = shard_->tiered_storage_->Open(backing_prefix);
     CHECK(!ec) << ec.message();
@@ -448,6 +668,7 @@ void EngineShard::DestroyThreadLocal() {
   mi_heap_t* tlh = shard_->mi_resource_.heap();
 
   shard_->Shutdown();
+  LinkSlab::DestroyThreadLocal(shard_->memory_resource());
 
   shard_->~EngineShard();
   mi_free(shard_);
@@ -474,6 +695,9 @@ void EngineShard::PollExecution(const char* context, Transaction* trans) {
   // 3. OUT_OF_ORDER -> Transactions without conflicting keys can run earlier than their position in
   // txq is reached
   uint16_t flags = Transaction::AWAKED_Q | Transaction::SUSPENDED_Q | Transaction::OUT_OF_ORDER;
+  if (trans && trans->TryMarkOutOfOrder(this))
+    stats_.tx_ooo_marked_total++;
+
   auto [trans_mask, disarmed] =
       trans ? trans->DisarmInShardWhen(sid, flags) : make_pair(uint16_t(0), false);
 
@@ -579,6 +803,27 @@ void EngineShard::RemoveContTx(Transaction* tx) {
 
 void EngineShard::Heartbeat() {
   CacheStats();
+  search_indices()->CompactStep(GetCurrentTimeMs());
+
+  if (cluster::IsClusterEnabledOrEmulated())
+    db_slice_.UpdateSlotRates(GetCurrentTimeMs());
+
+  db_slice_.RefreshHotValues(GetCurrentTimeMs());
+
+  for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+    if (db_slice_.IsDbValid(i))
+      db_slice_.PresplitStep(i);
+  }
+
+  // Return the huge page chunks once the freed segments could fill a few of them, so that a
+  // shrinking dataset does not pin its peak memory. Trim releases only chunks without live
+  // segments, hence it may find nothing on fragmented chunks.
+  constexpr size_t kTrimChunks = 4;
+  if (segment_resource_ &&
+      segment_resource_->reserved() - segment_resource_->used() >=
+          kTrimChunks * HugePageResource::kChunkSize) {
+    segment_resource_->Trim();
+  }
 
   if (IsReplica())  // Never run expiration on replica.
     return;
@@ -586,6 +831,9 @@ void EngineShard::Heartbeat() {
   constexpr double kTtlDeleteLimit = 200;
   constexpr double kRedLimitFactor = 0.1;
 
+  // Buckets of the sets and hashes with expiring members visited by a heartbeat.
+  constexpr uint32_t kFieldExpireBudget = 1024;
+
   uint32_t traversed = GetMovingSum6(TTL_TRAVERSE);
   uint32_t deleted = GetMovingSum6(TTL_DELETE);
   unsigned ttl_delete_target = 5;
@@ -610,23 +858,33 @@ void EngineShard::Heartbeat() {
 
     db_cntx.db_index = i;
     auto [pt, expt] = db_slice_.GetTables(i);
-    if (expt->size() > pt->size() / 4) {
+    if (expt->size() > pt->size() / 4 || db_slice_.GetDBTable(i)->expire_index) {
+      LatencyScope latency("expire-cycle");
       DbSlice::DeleteExpiredStats stats = db_slice_.DeleteExpiredStep(db_cntx, ttl_delete_target);
 
       counter_[TTL_TRAVERSE].IncBy(stats.traversed);
       counter_[TTL_DELETE].IncBy(stats.deleted);
     }
 
+    if (db_slice_.GetDBTable(i)->field_expire_index.size() > 0) {
+      db_slice_.DeleteExpiredFieldsStep(db_cntx, kFieldExpireBudget);
+    }
+
     // if our budget is below the limit
     if (db_slice_.memory_budget() < eviction_redline) {
-      db_slice_.FreeMemWithEvictionStep(i, eviction_redline - db_slice_.memory_budget());
+      LatencyScope latency("eviction-cycle");
+      db_slice_.FreeMemWithEvictionStep(i, eviction_redline - db_slice_.memory_budget(),
+                                        GetFlag(FLAGS_max_eviction_per_heartbeat));
     }
 
     if (tiered_storage_ && UsedMemory() > tiering_redline) {
+      LatencyScope latency("tiered-offload-cycle");
       tiered_storage_->RunOffloading(i);
     }
   }
 
+  HSetFamily::TuneEncodingStep(&db_slice_, db_cntx.time_now_ms);
+
   // Journal entries for expired entries are not writen to socket in the loop above.
   // Trigger write to socket when loop finishes.
   if (auto journal = EngineShard::tlocal()->journal(); journal) {
@@ -678,13 +936,64 @@ void EngineShard::RunPeriodic(std::chrono::milliseconds period_ms) {
   }
 }
 
+void EngineShard::RunBackgroundEviction(double watermark) {
+  constexpr auto kPeriod = 10ms;
+  constexpr size_t kMaxEvictionsPerStep = 1000;  // evictions run without preemption.
+
+  const ssize_t shard_limit = max_memory_limit / shard_set->size();
+  const ssize_t low_watermark = shard_limit * watermark;
+  size_t batch = GetFlag(FLAGS_max_eviction_per_heartbeat);
+
+  size_t used_after_eviction = UsedMemory();
+  double alloc_rate = 0;  // bytes per period, moving average.
+
+  while (!fiber_periodic_done_.WaitFor(kPeriod)) {
+    size_t used = UsedMemory();
+    size_t allocated = used > used_after_eviction ? used - used_after_eviction : 0;
+    alloc_rate = (alloc_rate * 3 + allocated) / 4;
+
+    // Free enough memory for the inserts expected until the next run as well.
+    ssize_t goal = low_watermark + ssize_t(alloc_rate) - (shard_limit - ssize_t(used));
+    if (IsReplica() || goal <= 0) {
+      used_after_eviction = used;
+      continue;
+    }
+
+    // Scale the number of evictions with the memory to free.
+    size_t per_object = std::max<size_t>(db_slice_.bytes_per_object(), 1);
+    size_t max_evictions = std::max<size_t>(batch, goal / per_object);
+    size_t evicted = 0, freed = 0;
+    while (freed < size_t(goal) && evicted < max_evictions) {
+      size_t step_evicted = 0;
+      for (unsigned i = 0; i < db_slice_.db_array_size(); ++i) {
+        if (db_slice_.IsDbValid(i)) {
+          size_t limit = std::min(kMaxEvictionsPerStep, max_evictions - evicted - step_evicted);
+          step_evicted += db_slice_.FreeMemWithEvictionStep(i, goal - freed, limit);
+        }
+      }
+      if (step_evicted == 0)
+        break;
+
+      evicted += step_evicted;
+      size_t now_used = UsedMemory();
+      freed = used > now_used ? used - now_used : 0;
+      ThisFiber::Yield();
+    }
+    used_after_eviction = UsedMemory();
+  }
+}
+
 void EngineShard::CacheStats() {
   // mi_heap_visit_blocks(tlh, false /* visit all blocks*/, visit_cb, &sum);
   mi_stats_merge();
 
   // Used memory for this shard.
   size_t used_mem = UsedMemory();
-  cached_stats[db_slice_.shard_id()].used_memory.store(used_mem, memory_order_relaxed);
+
+  // Lua interpreters of this thread allocate from their own heaps. They can not be evicted,
+  // but must count towards maxmemory.
+  size_t lua_mem = InterpreterManager::tl_stats().used_bytes;
+  cached_stats[db_slice_.shard_id()].used_memory.store(used_mem + lua_mem, memory_order_relaxed);
   ssize_t free_mem = max_memory_limit - used_mem_current.load(memory_order_relaxed);
 
   size_t entries = 0;
@@ -703,8 +1012,9 @@ void EngineShard::CacheStats() {
 }
 
 size_t EngineShard::UsedMemory() const {
-  return mi_resource_.used() + zmalloc_used_memory_tl + SmallString::UsedThreadLocal() +
-         search_indices()->GetUsedMemory();
+  size_t segments = segment_resource_ ? segment_resource_->used() : 0;
+  return mi_resource_.used() + segments + zmalloc_used_memory_tl +
+         SmallString::UsedThreadLocal() + search_indices()->GetUsedMemory();
 }
 
 BlockingController* EngineShard::EnsureBlockingController() {
@@ -719,6 +1029,7 @@ void EngineShard::TEST_EnableHeartbeat() {
   fiber_periodic_ = fb2::Fiber("shard_periodic_TEST", [this, period_ms = 1] {
     RunPeriodic(std::chrono::milliseconds(period_ms));
   });
+  StartEvictionFiber(shard_id());
 }
 
 auto EngineShard::AnalyzeTxQueue() const -> TxQueueInfo {
@@ -793,8 +1104,8 @@ auto EngineShard::AnalyzeTxQueue() const -> TxQueueInfo {
 
  */
 
-uint64_t GetFsLimit() {
-  std::filesystem::path file_path(GetFlag(FLAGS_tiered_prefix));
+uint64_t GetFsLimit(string_view prefix) {
+  std::filesystem::path file_path(prefix);
   std::string dir_name_str = file_path.parent_path().string();
 
   if (dir_name_str.empty())
@@ -810,14 +1121,21 @@ uint64_t GetFsLimit() {
 }
 
 size_t GetTieredFileLimit(size_t threads) {
-  string file_prefix = GetFlag(FLAGS_tiered_prefix);
-  if (file_prefix.empty())
+  vector<string> prefixes = GetTieredPrefixes();
+  if (prefixes.empty())
     return 0;
 
+  // Shards are distributed between prefixes in round robin, so the most loaded device
+  // determines the limit of every shard file.
   size_t max_shard_file_size = 0;
-
   size_t max_file_size = absl::GetFlag(FLAGS_tiered_max_file_size).value;
-  size_t max_file_size_limit = GetFsLimit();
+  size_t max_file_size_limit = numeric_limits<size_t>::max();
+  for (size_t i = 0; i < prefixes.size() && i < threads; i++) {
+    size_t device_shards = threads / prefixes.size() + (i < threads % prefixes.size());
+    size_t device_limit = GetFsLimit(prefixes[i]) / device_shards * threads;
+    max_file_size_limit = min(max_file_size_limit, device_limit);
+  }
+
   if (max_file_size == 0) {
     LOG(INFO) << "max_file_size has not been specified. Deciding myself....";
     max_file_size = (max_file_size_limit * 0.8);
@@ -845,6 +1163,8 @@ void EngineShardSet::Init(uint32_t sz, bool update_db_time) {
   CHECK_EQ(0u, size());
   cached_stats.resize(sz);
   shard_queue_.resize(sz);
+  numa_nodes_.resize(sz);
+  shard_by_hashtag = GetFlag(FLAGS_shard_by_hashtag);
 
   size_t max_shard_file_size = GetTieredFileLimit(sz);
   pp_->AwaitFiberOnAll([&](uint32_t index, ProactorBase* pb) {
@@ -862,6 +1182,30 @@ void EngineShardSet::InitThreadLocal(ProactorBase* pb, bool update_db_time, size
   EngineShard::InitThreadLocal(pb, update_db_time, max_file_size);
   EngineShard* es = EngineShard::tlocal();
   shard_queue_[es->shard_id()] = es->GetFiberQueue();
+  numa_nodes_[es->shard_id()] = ServerState::tlocal()->numa_node();
+}
+
+void EngineShardSet::AddBatched(ShardId sid, function<void()> f) {
+  if (tl_outbound_batches.size() < size())
+    tl_outbound_batches.resize(size());
+
+  tl_outbound_batches[sid].push_back(std::move(f));
+  if (tl_outbound_batches[sid].size() > 1)  // the fiber that started the batch dispatches it
+    return;
+
+  ThisFiber::Yield();
+
+  vector<function<void()>> batch = std::move(tl_outbound_batches[sid]);
+  tl_outbound_batches[sid].clear();
+  if (batch.size() == 1) {
+    Add(sid, std::move(batch.front()));
+    return;
+  }
+
+  Add(sid, [batch = std::move(batch)] {
+    for (const auto& cb : batch)
+      cb();
+  });
 }
 
 const vector<EngineShardSet::CachedStats>& EngineShardSet::GetCachedStats() {
@@ -877,7 +1221,7 @@ void EngineShardSet::TEST_EnableCacheMode() {
 }
 
 ShardId Shard(string_view v, ShardId shard_num) {
-  if (cluster::IsClusterShardedByTag()) {
+  if (shard_by_hashtag || cluster::IsClusterShardedByTag()) {
     v = LockTagOptions::instance().Tag(v);
   }
 
@@ -890,6 +1234,8 @@ ShardId Shard(string_view v, ShardId shard_num) {
     }
   }
 
+  // There are no hash ranges per shard to split: going from 16 to 64 shards changes the shard of
+  // three quarters of all keys, and finding them requires a scan of every table.
   return hash % shard_num;
 }
 
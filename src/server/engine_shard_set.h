@@ -12,6 +12,9 @@ extern "C" {
 #include <absl/container/flat_hash_map.h>
 #include <xxhash.h>
 
+#include <deque>
+
+#include "core/huge_page_resource.h"
 #include "core/mi_memory_resource.h"
 #include "core/task_queue.h"
 #include "core/tx_queue.h"
@@ -39,10 +42,29 @@ class EngineShard {
 
     uint64_t tx_immediate_total = 0;
     uint64_t tx_ooo_total = 0;
+    uint64_t tx_ooo_marked_total = 0;  // queued transactions that became out of order later.
+    uint64_t lazyfree_freed_total = 0;  // values freed in the background after UNLINK.
 
     Stats& operator+=(const Stats&);
   };
 
+  // Time spent by the shard thread in the callbacks of a command, with --shard_cpu_stats.
+  struct CmdCpuStats {
+    uint64_t calls = 0;
+    uint64_t cpu_ns = 0;   // thread cpu time.
+    uint64_t wall_ns = 0;  // includes the time the thread was preempted by the kernel.
+
+    CmdCpuStats& operator+=(const CmdCpuStats& o) {
+      calls += o.calls;
+      cpu_ns += o.cpu_ns;
+      wall_ns += o.wall_ns;
+      return *this;
+    }
+  };
+
+  // Keyed by the command names, that live as long as the command registry.
+  using CmdCpuMap = absl::flat_hash_map<std::string_view, CmdCpuStats>;
+
   // EngineShard() is private down below.
   ~EngineShard();
 
@@ -72,6 +94,13 @@ class EngineShard {
     return &mi_resource_;
   }
 
+  // Memory resource for the segments of the dash tables, see --dash_huge_pages.
+  PMR_NS::memory_resource* table_memory_resource() {
+    if (segment_resource_)
+      return segment_resource_.get();
+    return &mi_resource_;
+  }
+
   TaskQueue* GetFiberQueue() {
     return &queue_;
   }
@@ -110,6 +139,19 @@ class EngineShard {
     return stats_;
   }
 
+  const CmdCpuMap& cmd_cpu_stats() const {
+    return cmd_cpu_stats_;
+  }
+
+  CmdCpuMap& cmd_cpu_stats() {
+    return cmd_cpu_stats_;
+  }
+
+  // --shard_cpu_stats upon construction, read once to keep it off the callback path.
+  bool cmd_cpu_stats_enabled() const {
+    return cmd_cpu_stats_enabled_;
+  }
+
   // Returns used memory for this shard.
   size_t UsedMemory() const;
 
@@ -127,6 +169,14 @@ class EngineShard {
     return blocking_controller_.get();
   }
 
+  // Takes over a value deleted by UNLINK and frees it in a background fiber, a few buckets
+  // at a time for the sets and hashes.
+  void FreeLazily(PrimeValue pv);
+
+  size_t lazyfree_pending_objects() const {
+    return lazyfree_queue_.size();
+  }
+
   // for everyone to use for string transformations during atomic cpu sequences.
   sds tmp_str1;
 
@@ -192,6 +242,16 @@ class EngineShard {
     time_t last_check_time = 0;
     bool is_force_defrag = false;
 
+    // Large containers that are defragmented in steps by the following invocations, one step
+    // per invocation. The scan stops at the bucket that holds the first of them, so at most
+    // the containers of one bucket are queued.
+    struct Container {
+      DbIndex db;
+      std::string key;
+      uint32_t cursor;
+    };
+    std::deque<Container> containers;
+
     // check the current threshold and return true if
     // we need to do the defragmentation
     bool CheckRequired();
@@ -211,6 +271,12 @@ class EngineShard {
   void Heartbeat();
   void RunPeriodic(std::chrono::milliseconds period_ms);
 
+  // Starts RunBackgroundEviction if --background_eviction_watermark is set in cache mode.
+  void StartEvictionFiber(unsigned index);
+
+  // Keeps the free memory of the shard above the watermark fraction of its memory share.
+  void RunBackgroundEviction(double watermark);
+
   void CacheStats();
 
   // We are running a task that checks whether we need to
@@ -230,13 +296,21 @@ class EngineShard {
   // return true if we did not complete the shard scan
   bool DoDefrag();
 
+  // Runs a step on the container saved in defrag_state_ by DoDefrag.
+  void DefragContainerStep(float threshold);
+
+  void RunLazyFree();
+
   TaskQueue queue_;
 
   TxQueue txq_;
   MiMemoryResource mi_resource_;
+  std::unique_ptr<HugePageResource> segment_resource_;  // must be constructed before db_slice_.
   DbSlice db_slice_;
 
   Stats stats_;
+  CmdCpuMap cmd_cpu_stats_;
+  bool cmd_cpu_stats_enabled_ = false;
 
   // Become passive if replica: don't automatially evict expired items.
   bool is_replica_ = false;
@@ -249,7 +323,12 @@ class EngineShard {
 
   uint32_t defrag_task_ = 0;
   util::fb2::Fiber fiber_periodic_;
-  util::fb2::Done fiber_periodic_done_;
+  util::fb2::Fiber fiber_evictor_;
+  util::fb2::Done fiber_periodic_done_;  // stops both fibers.
+
+  std::deque<PrimeValue> lazyfree_queue_;
+  uint32_t lazyfree_cursor_ = 0;  // of the set at the front of lazyfree_queue_.
+  util::fb2::Fiber fiber_lazyfree_;  // runs while lazyfree_queue_ is not empty.
 
   DefragTaskState defrag_state_;
   std::unique_ptr<TieredStorage> tiered_storage_;
@@ -286,6 +365,11 @@ class EngineShardSet {
     return pp_;
   }
 
+  // The NUMA node of the thread of the shard.
+  unsigned numa_node(ShardId sid) const {
+    return numa_nodes_[sid];
+  }
+
   void Init(uint32_t size, bool update_db_time);
   void Shutdown();
 
@@ -302,6 +386,12 @@ class EngineShardSet {
     return shard_queue_[sid]->Add(std::forward<F>(f));
   }
 
+  // Same as Add, but callbacks added by the fibers of the calling thread are handed over to the
+  // shard queue together: the first one yields before dispatching, so that the ones added
+  // meanwhile join its task. Amortizes the wakeups of the shard thread when many connections run
+  // small commands. The callbacks run sequentially in a single task, so they must not preempt.
+  void AddBatched(ShardId sid, std::function<void()> f);
+
   // Runs a brief function on all shards. Waits for it to complete.
   // `func` must not preempt.
   template <typename U> void RunBriefInParallel(U&& func) const {
@@ -344,6 +434,7 @@ class EngineShardSet {
 
   util::ProactorPool* pp_;
   std::vector<TaskQueue*> shard_queue_;
+  std::vector<unsigned> numa_nodes_;
 };
 
 template <typename U, typename P>
@@ -387,6 +478,11 @@ template <typename U, typename P> void EngineShardSet::RunBlockingInParallel(U&&
   bc->Wait();
 }
 
+// Maps a key to its shard. The number of shards is fixed for the lifetime of the process:
+// transactions, blocking controllers and journals keep per shard state sized at startup, and
+// the proactor pool that hosts the shards can't grow. To scale without downtime, start a replica
+// with more threads and promote it with REPLTAKEOVER: replicas and snapshot loading map the keys
+// to their own shards.
 ShardId Shard(std::string_view v, ShardId shard_num);
 
 // absl::GetCurrentTimeNanos is twice faster than clock_gettime(CLOCK_REALTIME) on my laptop
@@ -0,0 +1,58 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/frequency_sketch.h"
+
+#include <absl/numeric/bits.h>
+#include <xxhash.h>
+
+#include <algorithm>
+
+namespace dfly {
+
+namespace {
+
+// Odd multipliers that spread a single hash over the rows.
+constexpr uint64_t kRowSeeds[] = {0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+                                  0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL};
+
+}  // namespace
+
+FrequencySketch::FrequencySketch(size_t width) {
+  width_log_ = absl::bit_width(std::max<size_t>(width, 2) - 1);
+  counters_.resize(kDepth << width_log_, 0);
+  sample_size_ = size_t(10) << width_log_;
+}
+
+size_t FrequencySketch::Index(uint64_t hash, unsigned row) const {
+  return (size_t(row) << width_log_) + ((hash * kRowSeeds[row]) >> (64 - width_log_));
+}
+
+void FrequencySketch::Touch(std::string_view key) {
+  uint64_t hash = XXH3_64bits(key.data(), key.size());
+  for (unsigned row = 0; row < kDepth; ++row) {
+    uint8_t& counter = counters_[Index(hash, row)];
+    if (counter < UINT8_MAX)
+      ++counter;
+  }
+
+  if (++touches_ >= sample_size_)
+    Decay();
+}
+
+uint8_t FrequencySketch::Estimate(std::string_view key) const {
+  uint64_t hash = XXH3_64bits(key.data(), key.size());
+  uint8_t res = UINT8_MAX;
+  for (unsigned row = 0; row < kDepth; ++row)
+    res = std::min(res, counters_[Index(hash, row)]);
+  return res;
+}
+
+void FrequencySketch::Decay() {
+  for (uint8_t& counter : counters_)
+    counter >>= 1;
+  touches_ /= 2;
+}
+
+}  // namespace dfly
@@ -0,0 +1,44 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace dfly {
+
+// FrequencySketch estimates how often keys were accessed recently, similarly to the count-min
+// sketch of TinyLFU. Every key maps to one saturating counter in each of kDepth rows and its
+// estimate is the smallest of them, so collisions can only inflate it.
+// Once the number of touches reaches a sample size of 10x the width, all the counters are
+// halved. This keeps the estimates fresh: keys that were hot long ago lose their advantage.
+class FrequencySketch {
+ public:
+  // width is rounded up to a power of 2.
+  explicit FrequencySketch(size_t width);
+
+  void Touch(std::string_view key);
+  uint8_t Estimate(std::string_view key) const;
+
+  size_t MallocUsed() const {
+    return counters_.capacity();
+  }
+
+ private:
+  static constexpr unsigned kDepth = 4;
+
+  size_t Index(uint64_t hash, unsigned row) const;
+
+  // Halves all the counters, see the class comment.
+  void Decay();
+
+  std::vector<uint8_t> counters_;  // kDepth rows of (1 << width_log_) counters.
+  unsigned width_log_;
+  size_t touches_ = 0;
+  size_t sample_size_;
+};
+
+}  // namespace dfly
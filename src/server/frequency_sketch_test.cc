@@ -0,0 +1,38 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/frequency_sketch.h"
+
+#include <absl/strings/str_cat.h>
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+TEST(FrequencySketchTest, Basic) {
+  FrequencySketch sketch(1024);
+  EXPECT_EQ(0, sketch.Estimate("key"));
+
+  for (unsigned i = 0; i < 5; ++i)
+    sketch.Touch("key");
+  sketch.Touch("other");
+
+  EXPECT_EQ(5, sketch.Estimate("key"));
+  EXPECT_EQ(1, sketch.Estimate("other"));
+}
+
+TEST(FrequencySketchTest, Decay) {
+  FrequencySketch sketch(1024);
+  for (unsigned i = 0; i < 100; ++i)
+    sketch.Touch("old");
+
+  // One hit wonders make the old key decay but stay ahead of each of them.
+  for (unsigned i = 0; i < 20000; ++i)
+    sketch.Touch(absl::StrCat("key", i));
+
+  EXPECT_LT(sketch.Estimate("old"), 100);
+  EXPECT_GT(sketch.Estimate("old"), sketch.Estimate("key19999"));
+}
+
+}  // namespace dfly
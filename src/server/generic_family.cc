@@ -5,6 +5,7 @@
 #include "server/generic_family.h"
 
 #include <boost/operators.hpp>
+#include <numeric>
 #include <optional>
 
 #include "facade/reply_builder.h"
@@ -36,6 +37,9 @@ extern "C" {
 
 ABSL_FLAG(uint32_t, dbnum, 16, "Number of databases");
 ABSL_FLAG(uint32_t, keys_output_limit, 8192, "Maximum number of keys output by keys command");
+ABSL_FLAG(uint32_t, scan_max_buckets, 1024,
+          "Maximum number of buckets SCAN and KEYS traverse in one step on a shard, before "
+          "letting it run other tasks. 0 means unlimited");
 
 namespace dfly {
 using namespace std;
@@ -194,6 +198,7 @@ std::optional<DbSlice::ItAndUpdater> RdbRestoreValue::Add(std::string_view data,
                              args.ExpirationTime());
   res->it->first.SetSticky(args.Sticky());
   if (res) {
+    db_slice.TrackFieldExpiry(index, key, res->it->second);
     return std::move(res.value());
   }
   return std::nullopt;
@@ -269,6 +274,10 @@ OpResult<RestoreArgs> RestoreArgs::TryFrom(const CmdArgList& args) {
 
 OpStatus OpPersist(const OpArgs& op_args, string_view key);
 
+// Values of at least this size that support CompactObj::CopyAcrossThreads are copied by the
+// destination shard when renamed across shards, instead of being serialized and parsed.
+constexpr size_t kRenameCopyThreshold = 1 << 16;
+
 class Renamer {
  public:
   Renamer(Transaction* t, std::string_view src_key, std::string_view dest_key, unsigned shard_count)
@@ -309,6 +318,10 @@ class Renamer {
   bool src_found_ = false;
   bool dest_found_ = false;
 
+  // Whether the value is handed over in detached_ instead of serialized_value_.value.
+  bool transfer_ = false;
+  PrimeValue detached_;
+
   SerializedValue serialized_value_;
 };
 
@@ -320,7 +333,7 @@ ErrorReply Renamer::Rename(bool destination_should_not_exist) {
     return OpStatus::KEY_NOTFOUND;
   }
 
-  if (!serialized_value_.version) {
+  if (!transfer_ && !serialized_value_.version) {
     transaction_->Conclude();
     return ErrorReply{kInvalidDumpValueErr};
   }
@@ -356,6 +369,25 @@ void Renamer::FetchData() {
 }
 
 void Renamer::FinalizeRename() {
+  if (transfer_) {
+    // The destination copies the value once the source detached it, so they run in separate hops.
+    transaction_->Execute(
+        [this](Transaction* t, EngineShard* shard) {
+          return shard->shard_id() == src_sid_ ? DelSrc(t, shard) : OpStatus::OK;
+        },
+        false);
+    transaction_->Execute(
+        [this](Transaction* t, EngineShard* shard) {
+          return shard->shard_id() == dest_sid_ ? DeserializeDest(t, shard) : OpStatus::OK;
+        },
+        true);
+
+    // The original is freed by the shard that allocated it.
+    shard_set->Await(src_sid_,
+                     [this] { EngineShard::tlocal()->FreeLazily(std::move(detached_)); });
+    return;
+  }
+
   auto cb = [this](Transaction* t, EngineShard* shard) {
     const ShardId shard_id = shard->shard_id();
 
@@ -388,6 +420,13 @@ void Renamer::SerializeSrc(Transaction* t, EngineShard* shard) {
     return;
   }
 
+  if (it->second.CanCopyAcrossThreads() && it->second.MallocUsed() >= kRenameCopyThreshold) {
+    DVLOG(1) << "Rename: key '" << src_key_ << "' successfully found, going to transfer it";
+    transfer_ = true;
+    serialized_value_ = {{}, std::nullopt, db_slice.ExpireTime(exp_it), it->first.IsSticky()};
+    return;
+  }
+
   DVLOG(1) << "Rename: key '" << src_key_ << "' successfully found, going to dump it";
 
   io::StringSink sink;
@@ -407,7 +446,11 @@ OpStatus Renamer::DelSrc(Transaction* t, EngineShard* shard) {
   DVLOG(1) << "Rename: removing the key '" << src_key_;
 
   res.post_updater.Run();
-  CHECK(shard->db_slice().Del(t->GetDbIndex(), it));
+  if (transfer_)
+    shard->db_slice().Detach(t->GetDbIndex(), it, &detached_);
+  else
+    CHECK(shard->db_slice().Del(t->GetDbIndex(), it));
+
   if (shard->journal()) {
     RecordJournal(t->GetOpArgs(shard), "DEL"sv, ArgSlice{src_key_}, 2);
   }
@@ -442,9 +485,26 @@ OpStatus Renamer::DeserializeDest(Transaction* t, EngineShard* shard) {
     return OpStatus::OK;
   }
 
-  RdbRestoreValue loader(serialized_value_.version.value());
-  auto restored_dest_it = loader.Add(serialized_value_.value, dest_key_, db_slice,
-                                     op_args.db_cntx.db_index, restore_args);
+  std::optional<DbSlice::ItAndUpdater> restored_dest_it;
+  if (transfer_) {
+    PrimeValue pv;
+    pv.CopyAcrossThreads(detached_);
+    auto res = db_slice.AddNew(op_args.db_cntx, dest_key_, std::move(pv),
+                               restore_args.ExpirationTime());
+    RETURN_ON_BAD_STATUS(res);
+    restored_dest_it.emplace(std::move(res.value()));
+
+    // Replicas still receive the serialized value.
+    if (shard->journal()) {
+      io::StringSink sink;
+      SerializerBase::DumpObject(restored_dest_it->it->second, &sink);
+      serialized_value_.value = std::move(sink).str();
+    }
+  } else {
+    RdbRestoreValue loader(serialized_value_.version.value());
+    restored_dest_it = loader.Add(serialized_value_.value, dest_key_, db_slice,
+                                  op_args.db_cntx.db_index, restore_args);
+  }
 
   if (restored_dest_it) {
     auto& dest_it = restored_dest_it->it;
@@ -568,11 +628,14 @@ bool ScanCb(const OpArgs& op_args, PrimeIterator prime_it, const ScanOpts& opts,
   return true;
 }
 
-void OpScan(const OpArgs& op_args, const ScanOpts& scan_opts, uint64_t* cursor, StringVec* vec) {
+// Traverses the shard until it finds scan_opts.limit keys or visits max_buckets buckets,
+// whichever comes first, so that sparse matches do not hold the shard thread for long.
+void OpScan(const OpArgs& op_args, const ScanOpts& scan_opts, uint64_t* cursor, StringVec* vec,
+            unsigned max_buckets = UINT_MAX) {
   auto& db_slice = op_args.shard->db_slice();
   DCHECK(db_slice.IsDbValid(op_args.db_cntx.db_index));
 
-  unsigned cnt = 0;
+  unsigned cnt = 0, buckets = 0;
 
   VLOG(1) << "PrimeTable " << db_slice.shard_id() << "/" << op_args.db_cntx.db_index << " has "
           << db_slice.DbSize(op_args.db_cntx.db_index);
@@ -583,7 +646,7 @@ void OpScan(const OpArgs& op_args, const ScanOpts& scan_opts, uint64_t* cursor,
   do {
     cur = prime_table->Traverse(
         cur, [&](PrimeIterator it) { cnt += ScanCb(op_args, it, scan_opts, &scratch, vec); });
-  } while (cur && cnt < scan_opts.limit);
+  } while (cur && cnt < scan_opts.limit && ++buckets < max_buckets);
 
   VLOG(1) << "OpScan " << db_slice.shard_id() << " cursor: " << cur.value();
   *cursor = cur.value();
@@ -607,18 +670,24 @@ uint64_t ScanGeneric(uint64_t cursor, const ScanOpts& scan_opts, StringVec* keys
 
   cursor >>= 10;
   DbContext db_cntx{cntx->conn_state.db_index, GetCurrentTimeMs()};
+  unsigned max_buckets = absl::GetFlag(FLAGS_scan_max_buckets);
+  if (max_buckets == 0)
+    max_buckets = UINT_MAX;
 
   do {
     auto cb = [&] {
       OpArgs op_args{EngineShard::tlocal(), 0, db_cntx};
-      OpScan(op_args, scan_opts, &cursor, keys);
+      OpScan(op_args, scan_opts, &cursor, keys, max_buckets);
     };
 
     // Avoid deadlocking, if called from shard queue script
-    if (EngineShard::tlocal() && EngineShard::tlocal()->shard_id() == sid)
+    if (EngineShard::tlocal() && EngineShard::tlocal()->shard_id() == sid) {
       cb();
-    else
+      // Lets the other fibers of the thread run between the steps, as they do with Await.
+      util::ThisFiber::Yield();
+    } else {
       ess->Await(sid, cb);
+    }
 
     if (cursor == 0) {
       ++sid;
@@ -642,6 +711,131 @@ uint64_t ScanGeneric(uint64_t cursor, const ScanOpts& scan_opts, StringVec* keys
   return cursor;
 }
 
+// Parallel scans traverse the prime tables of all shards over the same range of positions, so
+// that a single cursor covers all of them. Positions order the logical buckets the way
+// DashTable::Traverse visits them: by bucket id and then by segment id, padded to 32 bits.
+// Tables of different depths round the position down, which may repeat a few keys but never
+// skips any. The low bits of the cursor keep the log2 of the range traversed in a round,
+// that grows while the matches are sparse.
+constexpr unsigned kStrideBits = 6;
+constexpr unsigned kInitialStrideLog = 16;
+constexpr uint64_t kPosEnd = uint64_t(PrimeTable::kBucketNum) << 32;
+
+PrimeTable::Cursor PosToCursor(uint64_t pos) {
+  return PrimeTable::Cursor{((pos & UINT32_MAX) << 8) | (pos >> 32)};
+}
+
+uint64_t CursorToPos(PrimeTable::Cursor cur) {
+  return cur ? (uint64_t(cur.bucket_id()) << 32) | (cur.value() >> 8) : kPosEnd;
+}
+
+// Positions reached by a shard in a round of a parallel scan, with the number of keys found
+// before each of them.
+using ScanCheckpoints = vector<pair<uint64_t, size_t>>;
+
+// Traverses the prime table of the shard from pos until end or until max_buckets buckets were
+// visited. Records a checkpoint after every bucket.
+void OpParallelScan(const OpArgs& op_args, const ScanOpts& scan_opts, uint64_t pos, uint64_t end,
+                    unsigned max_buckets, StringVec* dest, ScanCheckpoints* checkpoints) {
+  auto& db_slice = op_args.shard->db_slice();
+  checkpoints->clear();
+  if (!db_slice.IsDbValid(op_args.db_cntx.db_index)) {
+    checkpoints->emplace_back(end, 0);
+    return;
+  }
+
+  PrimeTable* prime_table = db_slice.GetTables(op_args.db_cntx.db_index).first;
+  PrimeTable::Cursor cur = PosToCursor(pos);
+  string scratch;
+  unsigned buckets = 0;
+  do {
+    cur = prime_table->Traverse(
+        cur, [&](PrimeIterator it) { ScanCb(op_args, it, scan_opts, &scratch, dest); });
+    checkpoints->emplace_back(min(CursorToPos(cur), end), dest->size());
+  } while (cur && CursorToPos(cur) < end && ++buckets < max_buckets);
+}
+
+uint64_t ParallelScanGeneric(uint64_t cursor, const ScanOpts& scan_opts, StringVec* keys,
+                             ConnectionContext* cntx) {
+  uint64_t pos = cursor >> kStrideBits;
+  unsigned stride_log = cursor & ((1u << kStrideBits) - 1);
+  if (stride_log == 0 || stride_log > 32)
+    stride_log = kInitialStrideLog;
+
+  if (pos >= kPosEnd)  // protection
+    return 0;
+
+  constexpr uint64_t kMaxScanTimeMs = 100;
+  DbContext db_cntx{cntx->conn_state.db_index, GetCurrentTimeMs()};
+  unsigned max_buckets = absl::GetFlag(FLAGS_scan_max_buckets);
+  if (max_buckets == 0)
+    max_buckets = UINT_MAX;
+
+  unsigned shard_count = shard_set->size();
+  vector<StringVec> shard_keys(shard_count);
+  vector<ScanCheckpoints> shard_checkpoints(shard_count);
+  // Avoid deadlocking, if called from a script that runs in the shard queue.
+  EngineShard* local_shard = cntx->conn_state.script_info ? EngineShard::tlocal() : nullptr;
+
+  do {
+    uint64_t end = min(pos + (1ULL << stride_log), kPosEnd);
+    auto cb = [&](EngineShard* shard) {
+      OpArgs op_args{shard, 0, db_cntx};
+      ShardId sid = shard->shard_id();
+      OpParallelScan(op_args, scan_opts, pos, end, max_buckets, &shard_keys[sid],
+                     &shard_checkpoints[sid]);
+    };
+
+    // Runs in the shard queues like the transactions, so that expiring the keys does not race
+    // with them.
+    util::fb2::BlockingCounter bc(0);
+    for (ShardId sid = 0; sid < shard_count; ++sid) {
+      if (local_shard && local_shard->shard_id() == sid)
+        continue;
+      bc->Add(1);
+      shard_set->Add(sid, [&cb, bc]() mutable {
+        cb(EngineShard::tlocal());
+        bc->Dec();
+      });
+    }
+    if (local_shard)
+      cb(local_shard);
+    bc->Wait();
+
+    // The shards that stopped early because of their bucket budget limit the range of the round,
+    // the keys other shards found past it are found again in the next round.
+    uint64_t reached = end;
+    for (const ScanCheckpoints& checkpoints : shard_checkpoints)
+      reached = min(reached, checkpoints.back().first);
+
+    size_t found = 0;
+    for (ShardId sid = 0; sid < shard_count; ++sid) {
+      StringVec& vec = shard_keys[sid];
+      size_t count = 0;
+      for (const auto& [reached_pos, num_keys] : shard_checkpoints[sid]) {
+        if (reached_pos > reached)
+          break;
+        count = num_keys;
+      }
+      found += count;
+      move(vec.begin(), vec.begin() + count, back_inserter(*keys));
+      vec.clear();
+    }
+    pos = reached;
+
+    // Widen the range while the matches are sparse and narrow it when a round overshoots.
+    if (found * 2 < scan_opts.limit && stride_log < 32)
+      ++stride_log;
+    else if (found > scan_opts.limit * 2 && stride_log > 1)
+      --stride_log;
+
+    if (GetCurrentTimeMs() > db_cntx.time_now_ms + kMaxScanTimeMs)
+      break;
+  } while (pos < kPosEnd && keys->size() < scan_opts.limit);
+
+  return pos < kPosEnd ? (pos << kStrideBits) | stride_log : 0;
+}
+
 OpStatus OpExpire(const OpArgs& op_args, string_view key, const DbSlice::ExpireParams& params) {
   auto& db_slice = op_args.shard->db_slice();
   auto find_res = db_slice.FindMutable(op_args.db_cntx, key);
@@ -689,18 +883,19 @@ OpResult<long> OpFieldTtl(Transaction* t, EngineShard* shard, string_view key, s
   return res <= 0 ? res : int32_t(res - MemberTimeSeconds(db_cntx.time_now_ms));
 }
 
-OpResult<uint32_t> OpDel(const OpArgs& op_args, const ShardArgs& keys) {
+OpResult<uint32_t> OpDel(const OpArgs& op_args, const ShardArgs& keys, bool lazy) {
   DVLOG(1) << "Del: " << keys.Front();
   auto& db_slice = op_args.shard->db_slice();
 
   uint32_t res = 0;
+  db_slice.PrefetchKeys(op_args.db_cntx.db_index, keys);
 
   for (string_view key : keys) {
     auto fres = db_slice.FindMutable(op_args.db_cntx, key);
     if (!IsValid(fres.it))
       continue;
     fres.post_updater.Run();
-    res += int(db_slice.Del(op_args.db_cntx.db_index, fres.it));
+    res += int(db_slice.Del(op_args.db_cntx.db_index, fres.it, lazy));
   }
 
   return res;
@@ -738,9 +933,12 @@ void GenericFamily::Del(CmdArgList args, ConnectionContext* cntx) {
   atomic_uint32_t result{0};
   bool is_mc = cntx->protocol() == Protocol::MEMCACHE;
 
-  auto cb = [&result](const Transaction* t, EngineShard* shard) {
+  // UNLINK returns before the large values are freed.
+  bool lazy = cntx->cid->name() == "UNLINK";
+
+  auto cb = [&result, lazy](const Transaction* t, EngineShard* shard) {
     ShardArgs args = t->GetShardArgs(shard->shard_id());
-    auto res = OpDel(t->GetOpArgs(shard), args);
+    auto res = OpDel(t->GetOpArgs(shard), args, lazy);
     result.fetch_add(res.value_or(0), memory_order_relaxed);
 
     return OpStatus::OK;
@@ -759,7 +957,7 @@ void GenericFamily::Del(CmdArgList args, ConnectionContext* cntx) {
     if (del_cnt == 0) {
       mc_builder->SendNotFound();
     } else {
-      mc_builder->SendSimpleString("DELETED");
+      mc_builder->SendDeleted();
     }
   } else {
     cntx->SendLong(del_cnt);
@@ -920,10 +1118,7 @@ void GenericFamily::Keys(CmdArgList args, ConnectionContext* cntx) {
   } while (cursor != 0 && keys.size() < output_limit);
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->StartArray(keys.size());
-  for (const auto& k : keys) {
-    rb->SendBulkString(k);
-  }
+  rb->SendStringArr(keys);
 }
 
 void GenericFamily::PexpireAt(CmdArgList args, ConnectionContext* cntx) {
@@ -1113,17 +1308,248 @@ OpResultTyped<SortEntryList> OpFetchSortEntries(const OpArgs& op_args, std::stri
   return success ? res : OpStatus::WRONG_TYPE;
 }
 
+// Key pattern of SORT BY and GET: the first '*' is replaced by the element and an optional
+// "->field" suffix selects a field of the hash instead of a string value.
+struct SortPattern {
+  string_view prefix, suffix, field;
+  bool has_star = false;
+  bool is_self = false;  // GET # returns the element itself.
+
+  static SortPattern Parse(string_view pattern) {
+    SortPattern res;
+    if (pattern == "#") {
+      res.is_self = true;
+      return res;
+    }
+
+    size_t star = pattern.find('*');
+    if (star == string_view::npos) {
+      res.prefix = pattern;
+      return res;
+    }
+
+    res.has_star = true;
+    res.prefix = pattern.substr(0, star);
+    res.suffix = pattern.substr(star + 1);
+    if (size_t arrow = res.suffix.find("->");
+        arrow != string_view::npos && arrow + 2 < res.suffix.size()) {
+      res.field = res.suffix.substr(arrow + 2);
+      res.suffix = res.suffix.substr(0, arrow);
+    }
+    return res;
+  }
+};
+
+// Transaction type of the SORT pattern lookups, set by Register. MGET is registered before, it is
+// missing only if --rename_command renamed or removed it.
+const CommandId* sort_lookup_cid = nullptr;
+
+// Looks up the values that the patterns select for the elements, grouped by shard into a single
+// hop of a read-only transaction over the selected keys, so that the lookups are isolated from
+// concurrent writes. Like in Redis, patterns without '*' select nothing. In cluster mode, all the
+// selected keys must be in the slot of the sorted key, otherwise nullopt is returned.
+optional<vector<optional<string>>> LookupSortPatterns(string_view sort_key,
+                                                      const vector<SortPattern>& patterns,
+                                                      const vector<string_view>& elements,
+                                                      ConnectionContext* cntx) {
+  struct Lookup {
+    size_t key;  // index in keys
+    string_view field;
+    size_t index;
+  };
+
+  optional<cluster::SlotId> slot;
+  if (cluster::IsClusterEnabled())
+    slot = cluster::KeySlot(sort_key);
+
+  vector<optional<string>> res(patterns.size() * elements.size());
+  vector<string> keys;
+  vector<vector<Lookup>> by_shard(shard_set->size());
+  for (size_t i = 0; i < elements.size(); ++i) {
+    for (size_t j = 0; j < patterns.size(); ++j) {
+      const SortPattern& pattern = patterns[j];
+      size_t index = i * patterns.size() + j;
+      if (pattern.is_self) {
+        res[index] = string(elements[i]);
+      } else if (pattern.has_star) {
+        string key = absl::StrCat(pattern.prefix, elements[i], pattern.suffix);
+        if (slot && cluster::KeySlot(key) != *slot)
+          return nullopt;
+
+        ShardId sid = Shard(key, shard_set->size());
+        by_shard[sid].push_back({keys.size(), pattern.field, index});
+        keys.push_back(std::move(key));
+      }
+    }
+  }
+
+  if (keys.empty())
+    return res;
+
+  auto lookup_cb = [&](const OpArgs& op_args) {
+    auto& db_slice = op_args.shard->db_slice();
+    if (!db_slice.IsDbValid(op_args.db_cntx.db_index))
+      return;
+
+    for (const Lookup& lookup : by_shard[op_args.shard->shard_id()]) {
+      const string& key = keys[lookup.key];
+      if (!lookup.field.empty()) {
+        if (auto value = HSetFamily::GetField(op_args, key, lookup.field); value)
+          res[lookup.index] = std::move(*value);
+      } else if (auto it = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_STRING); it) {
+        (*it)->second.GetString(&res[lookup.index].emplace());
+      }
+    }
+  };
+
+  // A nested transaction would wait for the locks that a MULTI or script transaction holds, so
+  // those look up the keys without locking them.
+  if (cntx->transaction->IsMulti() || sort_lookup_cid == nullptr) {
+    DbContext db_cntx{cntx->conn_state.db_index, GetCurrentTimeMs()};
+    shard_set->RunBriefInParallel(
+        [&](EngineShard* shard) { lookup_cb(OpArgs{shard, 0, db_cntx}); },
+        [&](ShardId sid) { return !by_shard[sid].empty(); });
+    return res;
+  }
+
+  vector<MutableSlice> args;
+  args.reserve(keys.size());
+  for (string& key : keys)
+    args.emplace_back(key.data(), key.size());
+
+  boost::intrusive_ptr<Transaction> tx(new Transaction{sort_lookup_cid});
+  tx->InitByArgs(cntx->conn_state.db_index, absl::MakeSpan(args));
+  tx->ScheduleSingleHop([&](Transaction* t, EngineShard* shard) {
+    lookup_cb(t->GetOpArgs(shard));
+    return OpStatus::OK;
+  });
+  return res;
+}
+
+constexpr string_view kSortCrossSlotErr =
+    "-CROSSSLOT Keys selected by BY/GET patterns don't hash to the slot of the sorted key";
+
+// SORT with BY or GET patterns. Elements are fetched as strings and sorted by the values
+// BY selects, then only the elements within LIMIT are looked up for GET.
+void SortWithPatterns(string_view key, const optional<SortPattern>& by,
+                      const vector<SortPattern>& get, bool alpha, bool reversed,
+                      optional<pair<size_t, size_t>> bounds, ConnectionContext* cntx) {
+  OpResultTyped<SortEntryList> fetch_result =
+      cntx->transaction->ScheduleSingleHopT([&](Transaction* t, EngineShard* shard) {
+        return OpFetchSortEntries(t->GetOpArgs(shard), key, true);
+      });
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  if (!fetch_result.ok())
+    return rb->SendEmptyArray();
+
+  const auto& entries = std::get<vector<SortEntry<true>>>(fetch_result.value());
+  vector<string_view> elements(entries.size());
+  for (size_t i = 0; i < entries.size(); ++i)
+    elements[i] = entries[i].key;
+
+  size_t start = 0, end = elements.size();
+  if (bounds) {
+    start = std::min(bounds->first, elements.size());
+    end = std::min(bounds->first + bounds->second, elements.size());
+  }
+
+  // BY without '*' keeps the order of the container.
+  if (!by || by->has_star) {
+    vector<optional<string>> by_values;
+    if (by) {
+      auto values = LookupSortPatterns(key, {*by}, elements, cntx);
+      if (!values)
+        return cntx->SendError(kSortCrossSlotErr);
+      by_values = std::move(*values);
+    }
+
+    // Missing values sort as 0 or as the empty string.
+    auto sort_key = [&](size_t i) -> string_view {
+      if (!by)
+        return elements[i];
+      return by_values[i] ? string_view{*by_values[i]} : string_view{};
+    };
+
+    vector<uint32_t> order(elements.size());
+    iota(order.begin(), order.end(), 0);
+    auto sort_order = [&](auto cmp) {
+      auto less = [&](uint32_t lhs, uint32_t rhs) {
+        return reversed ? cmp(rhs, lhs) : cmp(lhs, rhs);
+      };
+      if (bounds)
+        std::partial_sort(order.begin(), order.begin() + end, order.end(), less);
+      else
+        std::sort(order.begin(), order.end(), less);
+    };
+
+    // Ties are broken by the elements, so that the result is deterministic.
+    if (alpha) {
+      sort_order([&](uint32_t lhs, uint32_t rhs) {
+        return pair{sort_key(lhs), elements[lhs]} < pair{sort_key(rhs), elements[rhs]};
+      });
+    } else {
+      vector<double> scores(elements.size(), 0);
+      for (size_t i = 0; i < elements.size(); ++i) {
+        string_view val = sort_key(i);
+        if (!val.empty() && !absl::SimpleAtod(val, &scores[i]))
+          return cntx->SendError("One or more scores can't be converted into double");
+      }
+      sort_order([&](uint32_t lhs, uint32_t rhs) {
+        return pair{scores[lhs], elements[lhs]} < pair{scores[rhs], elements[rhs]};
+      });
+    }
+
+    vector<string_view> sorted(end);
+    for (size_t i = 0; i < end; ++i)
+      sorted[i] = elements[order[i]];
+    elements = std::move(sorted);
+  }
+
+  vector<string_view> window(elements.begin() + start, elements.begin() + end);
+  if (get.empty()) {
+    bool is_set = (fetch_result.type() == OBJ_SET || fetch_result.type() == OBJ_ZSET);
+    rb->StartCollection(window.size(), is_set ? RedisReplyBuilder::SET : RedisReplyBuilder::ARRAY);
+    for (string_view element : window)
+      rb->SendBulkString(element);
+    return;
+  }
+
+  auto values = LookupSortPatterns(key, get, window, cntx);
+  if (!values)
+    return cntx->SendError(kSortCrossSlotErr);
+
+  rb->StartArray(values->size());
+  for (const auto& value : *values) {
+    if (value)
+      rb->SendBulkString(*value);
+    else
+      rb->SendNull();
+  }
+}
+
 void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
   std::string_view key = ArgS(args, 0);
   bool alpha = false;
   bool reversed = false;
   std::optional<std::pair<size_t, size_t>> bounds;
+  std::optional<SortPattern> by;
+  std::vector<SortPattern> get;
 
   for (size_t i = 1; i < args.size(); i++) {
     ToUpper(&args[i]);
 
     std::string_view arg = ArgS(args, i);
-    if (arg == "ALPHA") {
+    if (arg == "BY" || arg == "GET") {
+      if (i + 1 >= args.size()) {
+        return cntx->SendError(kSyntaxErr);
+      }
+      SortPattern pattern = SortPattern::Parse(ArgS(args, ++i));
+      if (arg == "BY")
+        by = pattern;
+      else
+        get.push_back(pattern);
+    } else if (arg == "ALPHA") {
       alpha = true;
     } else if (arg == "DESC") {
       reversed = true;
@@ -1141,6 +1567,13 @@ void GenericFamily::Sort(CmdArgList args, ConnectionContext* cntx) {
     }
   }
 
+  if (by || !get.empty()) {
+    // The patterns may select any key, like Redis we deny them to users with key restrictions.
+    if (!cntx->keys.all_keys)
+      return cntx->SendError("BY/GET option of SORT denied due to insufficient ACL permissions");
+    return SortWithPatterns(key, by, get, alpha, reversed, bounds, cntx);
+  }
+
   OpResultTyped<SortEntryList> fetch_result =
       cntx->transaction->ScheduleSingleHopT([&](Transaction* t, EngineShard* shard) {
         return OpFetchSortEntries(t->GetOpArgs(shard), key, alpha);
@@ -1457,7 +1890,10 @@ void GenericFamily::Scan(CmdArgList args, ConnectionContext* cntx) {
   ScanOpts scan_op = ops.value();
 
   StringVec keys;
-  cursor = ScanGeneric(cursor, scan_op, &keys, cntx);
+  if (scan_op.parallel)
+    cursor = ParallelScanGeneric(cursor, scan_op, &keys, cntx);
+  else
+    cursor = ScanGeneric(cursor, scan_op, &keys, cntx);
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(2);
@@ -1486,6 +1922,7 @@ OpResult<uint32_t> GenericFamily::OpExists(const OpArgs& op_args, const ShardArg
   DVLOG(1) << "Exists: " << keys.Front();
   auto& db_slice = op_args.shard->db_slice();
   uint32_t res = 0;
+  db_slice.PrefetchKeys(op_args.db_cntx.db_index, keys);
 
   for (string_view key : keys) {
     auto find_res = db_slice.FindReadOnly(op_args.db_cntx, key);
@@ -1547,6 +1984,7 @@ OpResult<void> GenericFamily::OpRen(const OpArgs& op_args, string_view from_key,
     to_res = std::move(*op_result);
     to_res.it->first.SetSticky(sticky);
   }
+  db_slice.TrackFieldExpiry(op_args.db_cntx.db_index, to_key, to_res.it->second);
 
   if (!is_prior_list && to_res.it->second.ObjType() == OBJ_LIST && es->blocking_controller()) {
     es->blocking_controller()->AwakeWatched(op_args.db_cntx.db_index, to_key);
@@ -1588,6 +2026,7 @@ OpStatus GenericFamily::OpMove(const OpArgs& op_args, string_view key, DbIndex t
   RETURN_ON_BAD_STATUS(op_result);
   auto& add_res = *op_result;
   add_res.it->first.SetSticky(sticky);
+  db_slice.TrackFieldExpiry(target_db, key, add_res.it->second);
 
   if (add_res.it->second.ObjType() == OBJ_LIST && op_args.shard->blocking_controller()) {
     op_args.shard->blocking_controller()->AwakeWatched(target_db, key);
@@ -1679,6 +2118,7 @@ constexpr uint32_t kRestore = KEYSPACE | WRITE | SLOW | DANGEROUS;
 
 void GenericFamily::Register(CommandRegistry* registry) {
   constexpr auto kSelectOpts = CO::LOADING | CO::FAST | CO::NOSCRIPT;
+  sort_lookup_cid = registry->Find("MGET");
   registry->StartFamily();
   *registry
       << CI{"DEL", CO::WRITE, -2, 1, -1, acl::kDel}.HFUNC(Del)
@@ -8,6 +8,8 @@ extern "C" {
 #include "redis/rdb.h"
 }
 
+#include <absl/container/flat_hash_set.h>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -75,6 +77,28 @@ TEST_F(GenericFamilyTest, Expire) {
   EXPECT_THAT(resp, ArgType(RespExpr::NIL));
 }
 
+TEST_F(GenericFamilyTest, ExpireIndex) {
+  absl::FlagSaver saver;
+  SetTestFlag("expire_index", "true");
+  Run({"flushall"});  // Recreates the tables with the index.
+
+  for (unsigned i = 0; i < 1000; ++i) {
+    Run({"set", StrCat("key", i), "val", "px", i % 2 ? "1000" : "100000"});
+  }
+  Run({"persist", "key1"});
+  Run({"pexpire", "key3", "200000"});
+  Run({"pexpire", "key2", "500"});
+
+  shard_set->TEST_EnableHeartBeat();
+  AdvanceTime(1000);
+
+  // Only the due keys are deleted, without being accessed.
+  ExpectConditionWithinTimeout([&] { return CheckedInt({"dbsize"}) == 501; });
+  EXPECT_EQ(Run({"get", "key1"}), "val");
+  EXPECT_EQ(Run({"get", "key3"}), "val");
+  EXPECT_THAT(Run({"get", "key2"}), ArgType(RespExpr::NIL));
+}
+
 TEST_F(GenericFamilyTest, ExpireOptions) {
   // NX and XX are mutually exclusive
   Run({"set", "key", "val"});
@@ -174,6 +198,42 @@ TEST_F(GenericFamilyTest, Del) {
   Run({"del", "k1"});
 }
 
+TEST_F(GenericFamilyTest, UnlinkLazyFree) {
+  vector<string> sadd = {"sadd", "set"}, hset = {"hset", "hash"}, zadd = {"zadd", "zset"},
+                 rpush = {"rpush", "list"};
+  for (unsigned i = 0; i < 10000; ++i) {
+    sadd.push_back(StrCat(i));
+    hset.insert(hset.end(), {StrCat("f", i), StrCat(i)});
+    zadd.insert(zadd.end(), {StrCat(i), StrCat("m", i)});
+    rpush.push_back(StrCat(i));
+  }
+  Run(absl::MakeSpan(sadd));
+  Run(absl::MakeSpan(hset));
+  Run(absl::MakeSpan(zadd));
+  Run(absl::MakeSpan(rpush));
+  Run({"rpush", "small", "a", "b"});
+
+  EXPECT_EQ(5, CheckedInt({"unlink", "set", "hash", "zset", "list", "small"}));
+  EXPECT_EQ(0, CheckedInt({"exists", "set", "hash", "zset", "list", "small"}));
+
+  // The small list is freed right away.
+  ExpectConditionWithinTimeout([&] {
+    auto metrics = GetMetrics();
+    return metrics.lazyfree_pending_objects == 0 && metrics.shard_stats.lazyfree_freed_total == 4;
+  });
+
+  // So is a large value that is deleted with DEL, but FLUSHALL frees it lazily.
+  Run(absl::MakeSpan(sadd));
+  EXPECT_EQ(1, CheckedInt({"del", "set"}));
+  Run(absl::MakeSpan(sadd));
+  Run({"flushall"});
+  ExpectConditionWithinTimeout([&] {
+    auto metrics = GetMetrics();
+    return metrics.lazyfree_pending_objects == 0 && metrics.shard_stats.lazyfree_freed_total == 5;
+  });
+  EXPECT_EQ(0, CheckedInt({"dbsize"}));
+}
+
 TEST_F(GenericFamilyTest, TTL) {
   EXPECT_EQ(-2, CheckedInt({"ttl", "foo"}));
   EXPECT_EQ(-2, CheckedInt({"pttl", "foo"}));
@@ -251,6 +311,38 @@ TEST_F(GenericFamilyTest, RenameNonString) {
   EXPECT_EQ(1, CheckedInt({"del", "b"}));
 }
 
+TEST_F(GenericFamilyTest, RenameLargeValues) {
+  vector<string> sadd = {"sadd", "x"}, hset = {"hset", "x"}, rpush = {"rpush", "x"};
+  for (unsigned i = 0; i < 10000; ++i) {
+    sadd.push_back(StrCat("m", i));
+    hset.insert(hset.end(), {StrCat("f", i), StrCat(i)});
+    rpush.push_back(StrCat("elem", i));
+  }
+
+  // Large values are copied by the destination shard rather than serialized.
+  Run(absl::MakeSpan(sadd));
+  Run({"expire", "x", "100"});
+  EXPECT_EQ(Run({"rename", "x", "b"}), "OK");
+  ASSERT_EQ(2, last_cmd_dbg_info_.shards_count);
+  EXPECT_EQ(0, CheckedInt({"exists", "x"}));
+  EXPECT_EQ(10000, CheckedInt({"scard", "b"}));
+  EXPECT_EQ(1, CheckedInt({"sismember", "b", "m9999"}));
+  EXPECT_GT(CheckedInt({"ttl", "b"}), 0);
+
+  Run(absl::MakeSpan(hset));
+  EXPECT_EQ(Run({"rename", "x", "b"}), "OK");
+  EXPECT_EQ(10000, CheckedInt({"hlen", "b"}));
+  EXPECT_EQ(Run({"hget", "b", "f1234"}), "1234");
+  EXPECT_EQ(-1, CheckedInt({"ttl", "b"}));
+
+  Run(absl::MakeSpan(rpush));
+  EXPECT_EQ(Run({"rename", "x", "b"}), "OK");
+  EXPECT_EQ(10000, CheckedInt({"llen", "b"}));
+  EXPECT_EQ(Run({"lindex", "b", "-1"}), "elem9999");
+
+  ExpectConditionWithinTimeout([&] { return GetMetrics().lazyfree_pending_objects == 0; });
+}
+
 TEST_F(GenericFamilyTest, RenameBinary) {
   const char kKey1[] = "\x01\x02\x03\x04";
   const char kKey2[] = "\x05\x06\x07\x08";
@@ -402,6 +494,88 @@ TEST_F(GenericFamilyTest, Scan) {
   EXPECT_THAT(vec, Each(StartsWith("zset")));
 }
 
+TEST_F(GenericFamilyTest, ScanInSteps) {
+  absl::FlagSaver saver;
+  SetTestFlag("scan_max_buckets", "1");
+
+  Run({"debug", "populate", "1000", "key", "10"});
+  Run({"set", "foo", "bar"});
+  auto resp = Run({"keys", "key:*"});
+  EXPECT_EQ(1000, resp.GetVec().size());
+  EXPECT_EQ(Run({"keys", "foo"}), "foo");
+
+  // Sparse matches return fewer keys per call, but never skip any.
+  set<string> keys;
+  string cursor = "0";
+  do {
+    resp = Run({"scan", cursor, "match", "key:1*"});
+    cursor = resp.GetVec()[0].GetString();
+    for (const auto& key : StrArray(resp.GetVec()[1]))
+      keys.insert(key);
+  } while (cursor != "0");
+  EXPECT_EQ(111u, keys.size());
+}
+
+TEST_F(GenericFamilyTest, ScanParallel) {
+  Run({"debug", "populate", "10000", "key", "10"});
+  for (unsigned i = 0; i < 10; ++i)
+    Run({"sadd", absl::StrCat("set", i), "bar"});
+
+  auto scan_all = [&](vector<string_view> opts) {
+    absl::flat_hash_set<string> keys;
+    string cursor = "0";
+    do {
+      vector<string> cmd = {"scan", cursor, "parallel"};
+      cmd.insert(cmd.end(), opts.begin(), opts.end());
+      auto resp = Run(absl::MakeSpan(cmd));
+      EXPECT_THAT(resp, ArrLen(2));
+      cursor = resp.GetVec()[0].GetString();
+      for (const auto& key : StrArray(resp.GetVec()[1]))
+        keys.insert(key);
+    } while (cursor != "0");
+    return keys;
+  };
+
+  EXPECT_EQ(10010u, scan_all({}).size());
+  EXPECT_EQ(10010u, scan_all({"count", "1000"}).size());
+  EXPECT_EQ(10u, scan_all({"type", "set"}).size());
+  EXPECT_EQ(10u, scan_all({"match", "set*"}).size());
+  EXPECT_EQ(1u, scan_all({"match", "key:123"}).size());
+
+  // Shards stop after scan_max_buckets buckets in every round and still return every key.
+  absl::FlagSaver saver;
+  SetTestFlag("scan_max_buckets", "2");
+  EXPECT_EQ(10010u, scan_all({}).size());
+  EXPECT_EQ(10u, scan_all({"match", "set*"}).size());
+}
+
+TEST_F(GenericFamilyTest, PopulateDistributions) {
+  Run({"debug", "populate", "1000", "key", "8", "RAND", "TYPE", "SET", "ELEMENTS", "1",
+       "MAXELEMENTS", "10", "MAXSIZE", "16", "EXPIRE", "0.5", "1000"});
+  EXPECT_EQ(1000, CheckedInt({"dbsize"}));
+
+  unsigned with_ttl = 0;
+  set<int64_t> lengths;
+  for (unsigned i = 0; i < 1000; ++i) {
+    string key = absl::StrCat("key:", i);
+    int64_t len = CheckedInt({"scard", key});
+    EXPECT_GE(len, 1);
+    EXPECT_LE(len, 10);
+    lengths.insert(len);
+
+    int64_t ttl = CheckedInt({"ttl", key});
+    EXPECT_LE(ttl, 1000);
+    if (ttl > 0)
+      with_ttl++;
+  }
+  EXPECT_GT(lengths.size(), 1u);
+  EXPECT_GT(with_ttl, 300u);
+  EXPECT_LT(with_ttl, 700u);
+
+  EXPECT_THAT(Run({"debug", "populate", "10", "key", "4", "EXPIRE", "2", "10"}),
+              ErrArg("fraction"));
+}
+
 TEST_F(GenericFamilyTest, Sort) {
   // Test list sort with params
   Run({"del", "list-1"});
@@ -467,6 +641,36 @@ TEST_F(GenericFamilyTest, Sort) {
   ASSERT_THAT(Run({"sort", "list-2"}), ErrArg("One or more scores can't be converted into double"));
 }
 
+TEST_F(GenericFamilyTest, SortByGet) {
+  Run({"rpush", "list", "a", "b", "c", "d"});
+  Run({"mset", "w_a", "3", "w_b", "1", "w_c", "2", "obj_a", "A", "obj_b", "B", "obj_c", "C"});
+  Run({"hset", "h_a", "name", "x"});
+  Run({"hset", "h_c", "name", "z"});
+
+  // The missing weight of d sorts as 0.
+  ASSERT_THAT(Run({"sort", "list", "by", "w_*"}).GetVec(), ElementsAre("d", "b", "c", "a"));
+  ASSERT_THAT(Run({"sort", "list", "by", "w_*", "desc", "limit", "0", "2"}).GetVec(),
+              ElementsAre("a", "c"));
+  ASSERT_THAT(Run({"sort", "list", "by", "h_*->name", "alpha", "desc"}).GetVec(),
+              ElementsAre("c", "a", "d", "b"));
+
+  // BY without '*' skips sorting.
+  ASSERT_THAT(Run({"sort", "list", "by", "nosort"}).GetVec(), ElementsAre("a", "b", "c", "d"));
+
+  auto resp = Run({"sort", "list", "by", "w_*", "get", "#", "get", "obj_*", "get", "h_*->name"});
+  ASSERT_THAT(resp, ArrLen(12));
+  const auto& vec = resp.GetVec();
+  EXPECT_EQ(vec[0], "d");
+  EXPECT_THAT(vec[1], ArgType(RespExpr::NIL));
+  EXPECT_THAT(vec[2], ArgType(RespExpr::NIL));
+  EXPECT_EQ(vec[9], "a");
+  EXPECT_EQ(vec[10], "A");
+  EXPECT_EQ(vec[11], "x");
+
+  Run({"set", "w_d", "foo"});
+  EXPECT_THAT(Run({"sort", "list", "by", "w_*"}), ErrArg("can't be converted into double"));
+}
+
 TEST_F(GenericFamilyTest, TimeNoKeys) {
   auto resp = Run({"time"});
   EXPECT_THAT(resp, ArrLen(2));
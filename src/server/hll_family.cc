@@ -93,14 +93,23 @@ OpResult<int> AddToHll(const OpArgs& op_args, string_view key, CmdArgList values
     hll_sds = sdsnewlen(hll.data(), hll.size());
   }
 
-  for (const auto& value : values) {
+  // Values are added in batches so that they are hashed together.
+  unsigned char* batch[HLL_ADD_BATCH];
+  size_t sizes[HLL_ADD_BATCH];
+  for (size_t start = 0; start < values.size(); start += HLL_ADD_BATCH) {
+    size_t count = std::min<size_t>(HLL_ADD_BATCH, values.size() - start);
+    for (size_t i = 0; i < count; ++i) {
+      batch[i] = (unsigned char*)values[start + i].data();
+      sizes[i] = values[start + i].size();
+    }
+
     int added;
     if (is_sparse) {
       // Inserting to sparse hll might extend it.
       // We can't use std::string with sds
       // `promoted` will be assigned 1 if sparse hll was promoted to dense
       int promoted = 0;
-      added = pfadd_sparse(&hll_sds, (unsigned char*)value.data(), value.size(), &promoted);
+      added = pfadd_sparse_multi(&hll_sds, batch, sizes, count, &promoted);
       if (promoted == 1) {
         is_sparse = false;
         hll = string{hll_sds, sdslen(hll_sds)};
@@ -108,7 +117,7 @@ OpResult<int> AddToHll(const OpArgs& op_args, string_view key, CmdArgList values
         DCHECK_EQ(isValidHLL(StringToHllPtr(hll)), HLL_VALID_DENSE);
       }
     } else {
-      added = pfadd_dense(StringToHllPtr(hll), (unsigned char*)value.data(), value.size());
+      added = pfadd_dense_multi(StringToHllPtr(hll), batch, sizes, count);
     }
     if (added < 0) {
       return OpStatus::INVALID_VALUE;
@@ -169,65 +178,64 @@ OpResult<int64_t> CountHllsSingle(const OpArgs& op_args, string_view key) {
   }
 }
 
-OpResult<vector<string>> ReadValues(const OpArgs& op_args, const ShardArgs& keys) {
+// Merges the HLLs of keys in the shard into raw_hll, so that only a single buffer leaves the
+// shard thread. raw_hll is left empty if none of the keys exist.
+OpStatus MergeShardHlls(const OpArgs& op_args, const ShardArgs& keys, string* raw_hll) {
   try {
-    vector<string> values;
+    string tmp;
     for (string_view key : keys) {
       auto it = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_STRING);
-      if (it.ok()) {
-        string hll;
-        it.value()->second.GetString(&hll);
-        ConvertToDenseIfNeeded(&hll);
-        if (isValidHLL(StringToHllPtr(hll)) != HLL_VALID_DENSE) {
-          return OpStatus::INVALID_VALUE;
-        } else {
-          values.push_back(std::move(hll));
-        }
-      } else if (it.status() == OpStatus::WRONG_TYPE) {
+      if (it.status() == OpStatus::WRONG_TYPE)
         return OpStatus::WRONG_TYPE;
+      if (!it.ok())
+        continue;
+
+      string_view hll = it.value()->second.GetSlice(&tmp);
+      if (isValidHLL(StringToHllPtr(hll)) == HLL_VALID_SPARSE) {
+        tmp = hll;
+        ConvertToDenseIfNeeded(&tmp);
+        hll = tmp;
       }
+
+      if (raw_hll->empty()) {
+        raw_hll->resize(getRawHllSize());
+        createRawHll(StringToHllPtr(*raw_hll));
+      }
+      if (mergeDenseIntoRawHll(StringToHllPtr(hll), StringToHllPtr(*raw_hll)) != 0)
+        return OpStatus::INVALID_VALUE;
     }
-    return values;
+    return OpStatus::OK;
   } catch (const std::bad_alloc&) {
     return OpStatus::OUT_OF_MEMORY;
   }
 }
 
-vector<HllBufferPtr> ConvertShardVector(const vector<vector<string>>& hlls) {
-  vector<HllBufferPtr> ptrs;
-  ptrs.reserve(hlls.size());
-  for (auto& shard_hlls : hlls) {
-    for (auto& hll : shard_hlls) {
-      ptrs.push_back(StringToHllPtr(hll));
-    }
+// Merges the per shard raw HLLs into a single one.
+string MergeRawHlls(const vector<string>& shard_hlls) {
+  string result(getRawHllSize(), '\0');
+  createRawHll(StringToHllPtr(result));
+  for (const auto& hll : shard_hlls) {
+    if (!hll.empty())
+      mergeRawHlls(StringToHllPtr(hll), StringToHllPtr(result));
   }
-  return ptrs;
+  return result;
 }
 
 OpResult<int64_t> PFCountMulti(CmdArgList args, ConnectionContext* cntx) {
-  vector<vector<string>> hlls;
-  hlls.resize(shard_set->size());
+  vector<string> shard_hlls(shard_set->size());
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    ShardId sid = shard->shard_id();
     ShardArgs shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
-    if (result.ok()) {
-      hlls[sid] = std::move(result.value());
-    }
-    return result.status();
+    return MergeShardHlls(t->GetOpArgs(shard), shard_args, &shard_hlls[shard->shard_id()]);
   };
 
   Transaction* trans = cntx->transaction;
-  trans->ScheduleSingleHop(std::move(cb));
+  OpStatus status = trans->ScheduleSingleHop(std::move(cb));
+  if (status != OpStatus::OK)
+    return status;
 
-  vector<HllBufferPtr> ptrs = ConvertShardVector(hlls);
-  int64_t pf_count = pfcountMulti(ptrs.data(), ptrs.size());
-  if (pf_count < 0) {
-    return OpStatus::INVALID_VALUE;
-  } else {
-    return pf_count;
-  }
+  string raw_hll = MergeRawHlls(shard_hlls);
+  return pfcountRaw(StringToHllPtr(raw_hll));
 }
 
 void PFCount(CmdArgList args, ConnectionContext* cntx) {
@@ -246,20 +254,17 @@ void PFCount(CmdArgList args, ConnectionContext* cntx) {
 }
 
 OpResult<int> PFMergeInternal(CmdArgList args, ConnectionContext* cntx) {
-  vector<vector<string>> hlls;
-  hlls.resize(shard_set->size());
+  vector<string> shard_hlls(shard_set->size());
 
   atomic_bool success = true;
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    ShardId sid = shard->shard_id();
     ShardArgs shard_args = t->GetShardArgs(shard->shard_id());
-    auto result = ReadValues(t->GetOpArgs(shard), shard_args);
-    if (result.ok()) {
-      hlls[sid] = std::move(result.value());
-    } else {
+    OpStatus status =
+        MergeShardHlls(t->GetOpArgs(shard), shard_args, &shard_hlls[shard->shard_id()]);
+    if (status != OpStatus::OK) {
       success = false;
     }
-    return result.status();
+    return status;
   };
 
   Transaction* trans = cntx->transaction;
@@ -270,12 +275,12 @@ OpResult<int> PFMergeInternal(CmdArgList args, ConnectionContext* cntx) {
     return OpStatus::INVALID_VALUE;
   }
 
-  vector<HllBufferPtr> ptrs = ConvertShardVector(hlls);
+  string raw_hll = MergeRawHlls(shard_hlls);
 
   string hll;
   hll.resize(getDenseHllSize());
   createDenseHll(StringToHllPtr(hll));
-  int result = pfmerge(ptrs.data(), ptrs.size(), StringToHllPtr(hll));
+  int result = rawToDenseHll(StringToHllPtr(raw_hll), StringToHllPtr(hll));
 
   auto set_cb = [&](Transaction* t, EngineShard* shard) {
     string_view key = ArgS(args, 0);
@@ -106,6 +106,27 @@ TEST_F(HllFamilyTest, MultipleValues_random) {
   EXPECT_LT(std::abs(CheckedInt({"pfcount", "key"}) - unique_values * 1.0) / unique_values, 0.05);
 }
 
+TEST_F(HllFamilyTest, BatchMatchesSingle) {
+  // Adding many values at once hashes them in batches, the registers must end up the same.
+  auto add_values = [&](int begin, int end) {
+    vector<string> values;
+    for (int i = begin; i < end; ++i) {
+      values.push_back(GenerateUniqueValue(i) + string(i % 37, 'x'));
+      Run({"pfadd", "single", values.back()});
+    }
+    vector<string_view> cmd = {"pfadd", "batch"};
+    cmd.insert(cmd.end(), values.begin(), values.end());
+    return CheckedInt(cmd);
+  };
+
+  // Promotes the sparse hll to dense in the middle of a batch.
+  EXPECT_EQ(add_values(0, 3000), 1);
+  EXPECT_EQ(Run({"get", "batch"}).GetString(), Run({"get", "single"}).GetString());
+
+  EXPECT_EQ(add_values(3000, 4000), 1);
+  EXPECT_EQ(Run({"get", "batch"}).GetString(), Run({"get", "single"}).GetString());
+}
+
 TEST_F(HllFamilyTest, AddInvalid) {
   EXPECT_EQ(Run({"set", "key", "..."}), "OK");
   EXPECT_THAT(Run({"pfadd", "key", "1"}), ErrArg(HllFamily::kInvalidHllErr));
@@ -156,6 +177,36 @@ TEST_F(HllFamilyTest, CountMultiple) {
   EXPECT_EQ(CheckedInt({"pfcount", "key1", "key4"}), 5);
 }
 
+TEST_F(HllFamilyTest, CountMultipleMany) {
+  vector<string> count_args = {"pfcount"};
+  for (unsigned i = 0; i < 40; ++i) {
+    string key = absl::StrCat("day", i);
+    vector<string> add_args = {"pfadd", key};
+    for (unsigned j = 0; j < 100; ++j) {
+      add_args.push_back(absl::StrCat("user", i * 50 + j));
+    }
+    Run(absl::MakeSpan(add_args));
+    count_args.push_back(key);
+  }
+
+  // Keys overlap by half, so there are 40 * 50 + 50 unique users.
+  vector<string_view> count_view(count_args.begin(), count_args.end());
+  int64_t count = CheckedInt(count_view);
+  EXPECT_LT(std::abs(count - 2050.0) / 2050, 0.05);
+
+  vector<string> merge_args = count_args;
+  merge_args[0] = "day0";
+  merge_args.insert(merge_args.begin(), "pfmerge");
+  EXPECT_EQ(Run(absl::MakeSpan(merge_args)), "OK");
+  EXPECT_EQ(count, CheckedInt({"pfcount", "day0"}));
+}
+
+TEST_F(HllFamilyTest, CountMultipleInvalid) {
+  EXPECT_EQ(CheckedInt({"pfadd", "key1", "1", "2", "3"}), 1);
+  EXPECT_EQ(Run({"set", "key2", "..."}), "OK");
+  EXPECT_THAT(Run({"pfcount", "key1", "key2"}), ErrArg(HllFamily::kInvalidHllErr));
+}
+
 TEST_F(HllFamilyTest, MergeToNew) {
   EXPECT_EQ(CheckedInt({"pfadd", "key1", "1", "2", "3"}), 1);
   EXPECT_EQ(CheckedInt({"pfadd", "key2", "4", "5"}), 1);
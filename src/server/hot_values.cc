@@ -0,0 +1,157 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/hot_values.h"
+
+#include <algorithm>
+
+#include "base/flags.h"
+#include "base/logging.h"
+#include "server/db_slice.h"
+#include "server/engine_shard_set.h"
+
+ABSL_FLAG(uint32_t, hot_values_cache_size, 0,
+          "Number of the hottest keys of every shard, as found by enable_top_keys_tracking, whose "
+          "small string values are copied to all threads for GET. 0 disables.");
+
+ABSL_FLAG(uint32_t, hot_values_max_len, 256, "Maximal length of the values copied to all threads.");
+
+namespace dfly {
+
+using namespace std;
+
+namespace {
+
+constexpr uint64_t kRefreshPeriodMs = 1000;
+
+}  // namespace
+
+thread_local vector<HotValues::DbMaps> HotValues::tl_published_;
+
+// Invalidates the copy and keeps it until its reads are reported. The caller erases it.
+void HotValues::Drop(DbIndex dbid, Map::const_iterator it) {
+  it->second->valid.store(false, memory_order_release);
+  dropped_.push_back(Dropped{dbid, it->first, it->second});
+  changed_ = true;
+}
+
+void HotValues::InvalidateSlow(DbIndex dbid, string_view key) {
+  auto it = entries_[dbid].find(key);
+  if (it == entries_[dbid].end())
+    return;
+
+  Drop(dbid, it);
+  entries_[dbid].erase(it);
+}
+
+void HotValues::InvalidateDb(DbIndex dbid) {
+  if (dbid >= entries_.size() || entries_[dbid].empty())
+    return;
+
+  for (auto it = entries_[dbid].cbegin(); it != entries_[dbid].cend(); ++it)
+    Drop(dbid, it);
+  entries_[dbid].clear();
+}
+
+void HotValues::DrainReads(absl::FunctionRef<void(DbIndex, string_view, uint64_t)> cb) {
+  for (DbIndex dbid = 0; dbid < entries_.size(); ++dbid) {
+    for (const auto& [key, entry] : entries_[dbid]) {
+      if (uint64_t reads = entry->reads.exchange(0, memory_order_relaxed); reads)
+        cb(dbid, key, reads);
+    }
+  }
+
+  for (const auto& dropped : dropped_) {
+    if (uint64_t reads = dropped.entry->reads.exchange(0, memory_order_relaxed); reads)
+      cb(dropped.dbid, dropped.key, reads);
+  }
+  dropped_.clear();
+}
+
+void HotValues::Refresh(DbSlice* db_slice, uint64_t now_ms) {
+  if (now_ms < next_refresh_ms_)
+    return;
+  next_refresh_ms_ = now_ms + kRefreshPeriodMs;
+
+  uint32_t cache_size = absl::GetFlag(FLAGS_hot_values_cache_size);
+  uint32_t max_len = absl::GetFlag(FLAGS_hot_values_max_len);
+
+  entries_.resize(db_slice->db_array_size());
+  for (DbIndex dbid = 0; dbid < db_slice->db_array_size(); ++dbid) {
+    DbTable* table = db_slice->GetDBTable(dbid);
+    Map& entries = entries_[dbid];
+    if (!table || !table->top_keys.IsEnabled() || cache_size == 0) {
+      InvalidateDb(dbid);
+      continue;
+    }
+
+    auto top_keys = table->top_keys.GetTopKeys();
+    vector<pair<uint64_t, string_view>> hottest;
+    hottest.reserve(top_keys.size());
+    for (const auto& [key, count] : top_keys)
+      hottest.emplace_back(count, key);
+
+    size_t limit = min<size_t>(cache_size, hottest.size());
+    partial_sort(hottest.begin(), hottest.begin() + limit, hottest.end(), greater<>{});
+    hottest.resize(limit);
+
+    // Copies that are no longer among the hottest are dropped, the new ones are added. The
+    // dropped ones are invalidated, because they are not tracked anymore.
+    for (auto it = entries.begin(); it != entries.end();) {
+      bool drop = none_of(hottest.begin(), hottest.end(),
+                          [&](const auto& hot) { return hot.second == it->first; });
+      if (drop) {
+        Drop(dbid, it);
+        entries.erase(it++);
+      } else {
+        ++it;
+      }
+    }
+
+    for (const auto& [count, key] : hottest) {
+      if (entries.contains(key))
+        continue;
+
+      // Values with expiry are not copied, because reads of copies do not expire them.
+      auto it = table->prime.Find(key);
+      if (!IsValid(it) || it->second.ObjType() != OBJ_STRING || it->second.HasExpire() ||
+          it->second.IsExternal() || it->second.Size() > max_len)
+        continue;
+
+      string value;
+      it->second.GetString(&value);
+      entries.emplace(key, make_shared<Entry>(std::move(value)));
+      changed_ = true;
+    }
+  }
+
+  if (changed_)
+    Publish(db_slice->shard_id());
+}
+
+void HotValues::Publish(ShardId sid) {
+  changed_ = false;
+  auto cb = [sid, entries = entries_](unsigned, util::ProactorBase*) {
+    if (tl_published_.size() <= sid)
+      tl_published_.resize(shard_set->size());
+    tl_published_[sid] = entries;
+  };
+  shard_set->pool()->DispatchBrief(std::move(cb));
+}
+
+bool HotValues::Find(ShardId sid, DbIndex dbid, string_view key, string* dest) {
+  if (sid >= tl_published_.size() || dbid >= tl_published_[sid].size())
+    return false;
+
+  const Map& entries = tl_published_[sid][dbid];
+  auto it = entries.find(key);
+  if (it == entries.end() || !it->second->valid.load(memory_order_acquire))
+    return false;
+
+  it->second->reads.fetch_add(1, memory_order_relaxed);
+  *dest = it->second->value;
+  return true;
+}
+
+}  // namespace dfly
@@ -0,0 +1,82 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+#include <absl/functional/function_ref.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "server/tx_base.h"
+
+namespace dfly {
+
+class DbSlice;
+
+// Read-only copies of the hottest small string values of a shard, as found by TopKeys, that are
+// published to every thread. GET serves them from the thread of the connection, so that reads of
+// a few very hot keys are not bound by the single thread of their shard.
+//
+// A copy is immutable. The shard invalidates it before the key is changed or deleted, so a reader
+// that finds a valid copy returns a value that was current when the read started. Invalidated
+// copies are dropped by the threads on the next refresh.
+class HotValues {
+ public:
+  // Shard thread: invalidates the copy of the key, if any. Called before the key is modified.
+  void Invalidate(DbIndex dbid, std::string_view key) {
+    if (dbid < entries_.size() && !entries_[dbid].empty())
+      InvalidateSlow(dbid, key);
+  }
+
+  // Shard thread: invalidates all the copies of the database.
+  void InvalidateDb(DbIndex dbid);
+
+  // Shard thread: selects the hottest keys of the slice and publishes copies of their values to
+  // all threads, if the selection changed. Runs at most once per refresh period.
+  void Refresh(DbSlice* db_slice, uint64_t now_ms);
+
+  // Shard thread: reports the reads served from the copies since the last call, including the
+  // reads of copies that were invalidated since, so that the shard counts them like its own.
+  void DrainReads(absl::FunctionRef<void(DbIndex, std::string_view, uint64_t)> cb);
+
+  // Any thread: copies the value of key into dest, if the thread has a valid copy of it.
+  static bool Find(ShardId sid, DbIndex dbid, std::string_view key, std::string* dest);
+
+ private:
+  struct Entry {
+    explicit Entry(std::string v) : value(std::move(v)) {
+    }
+
+    const std::string value;
+    std::atomic_bool valid{true};
+    std::atomic_uint64_t reads{0};  // served by the copies, not yet reported to the shard.
+  };
+
+  using Map = absl::flat_hash_map<std::string, std::shared_ptr<Entry>>;
+  using DbMaps = std::vector<Map>;  // indexed by DbIndex.
+
+  struct Dropped {
+    DbIndex dbid;
+    std::string key;
+    std::shared_ptr<Entry> entry;
+  };
+
+  void InvalidateSlow(DbIndex dbid, std::string_view key);
+  void Drop(DbIndex dbid, Map::const_iterator it);
+  void Publish(ShardId sid);
+
+  static thread_local std::vector<DbMaps> tl_published_;  // indexed by ShardId.
+
+  DbMaps entries_;
+  std::vector<Dropped> dropped_;  // invalidated since the last DrainReads.
+  uint64_t next_refresh_ms_ = 0;
+  bool changed_ = false;
+};
+
+}  // namespace dfly
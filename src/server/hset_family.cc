@@ -11,6 +11,7 @@ extern "C" {
 #include "redis/zmalloc.h"
 }
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/string_map.h"
 #include "server/acl/acl_commands_def.h"
@@ -19,9 +20,16 @@ extern "C" {
 #include "server/container_utils.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
+#include "server/frequency_sketch.h"
 #include "server/search/doc_index.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(uint32_t, hash_promote_lookups, 0,
+          "If positive, listpack encoded hashes are converted to hash tables once their recent "
+          "lookups, weighted by the length of the listpack, reach this count. Hash tables that "
+          "fit a listpack and are not accessed anymore are converted back when the "
+          "defragmentation visits them. 0 keeps the encoding that the size of a hash implies");
+
 using namespace std;
 
 namespace dfly {
@@ -32,7 +40,45 @@ using absl::SimpleAtoi;
 namespace {
 
 using IncrByParam = std::variant<double, int64_t>;
-using OptStr = std::optional<std::string>;
+
+// Values of the fields requested by HMGET, copied into a single buffer instead of a string per
+// field.
+class FieldValues {
+ public:
+  explicit FieldValues(size_t num_fields) : spans_(num_fields, {0, kMissing}) {
+  }
+
+  void Set(size_t index, string_view value) {
+    spans_[index] = {buf_.size(), value.size()};
+    buf_.append(value);
+  }
+
+  void Reserve(size_t bytes) {
+    buf_.reserve(bytes);
+  }
+
+  // Makes the field at index refer to the value of the field at src.
+  void CopySpan(size_t index, size_t src) {
+    spans_[index] = spans_[src];
+  }
+
+  size_t size() const {
+    return spans_.size();
+  }
+
+  optional<string_view> Get(size_t index) const {
+    auto [offset, len] = spans_[index];
+    if (len == kMissing)
+      return nullopt;
+    return string_view{buf_}.substr(offset, len);
+  }
+
+ private:
+  static constexpr size_t kMissing = SIZE_MAX;
+
+  string buf_;
+  vector<pair<size_t, size_t>> spans_;  // offset and length of every value in buf_.
+};
 enum GetAllMode : uint8_t { FIELDS = 1, VALUES = 2 };
 
 bool IsGoodForListpack(CmdArgList args, const uint8_t* lp) {
@@ -48,12 +94,79 @@ bool IsGoodForListpack(CmdArgList args, const uint8_t* lp) {
 
 using container_utils::GetStringMap;
 using container_utils::LpFind;
+using container_utils::LpFindField;
 using container_utils::LpGetView;
 
+// Tracks the lookups of the hashes of a shard for --hash_promote_lookups. The conversions are
+// deferred to the heartbeat, as the lookups and the defragmentation must not modify values.
+struct EncodingTuner {
+  // Lookups in shorter listpacks are cheap enough, longer ones count once per this many fields.
+  static constexpr size_t kScanFields = 16;
+  static constexpr size_t kMaxPending = 1024;
+
+  using PendingKeys = absl::flat_hash_set<pair<DbIndex, string>>;
+
+  FrequencySketch sketch{1 << 12};
+  PendingKeys promote, demote;
+};
+
+thread_local unique_ptr<EncodingTuner> tl_tuner;
+
+EncodingTuner* GetTuner() {
+  if (absl::GetFlag(FLAGS_hash_promote_lookups) == 0)
+    return nullptr;
+  if (!tl_tuner)
+    tl_tuner = make_unique<EncodingTuner>();
+  return tl_tuner.get();
+}
+
+void RecordLookup(const DbContext& db_cntx, string_view key, const PrimeValue& pv) {
+  // Lookups of hash tables are recorded as well, otherwise RecordIfCold would find every hash
+  // table cold and the hot ones would swing between the encodings.
+  if (pv.Encoding() == kEncodingStrMap2) {
+    if (EncodingTuner* tuner = GetTuner(); tuner)
+      tuner->sketch.Touch(key);
+    return;
+  }
+
+  if (pv.Encoding() != kEncodingListPack)
+    return;
+
+  size_t fields = lpLength((uint8_t*)pv.RObjPtr()) / 2;
+  EncodingTuner* tuner = fields >= EncodingTuner::kScanFields ? GetTuner() : nullptr;
+  if (!tuner)
+    return;
+
+  for (size_t i = EncodingTuner::kScanFields; i <= fields; i += EncodingTuner::kScanFields)
+    tuner->sketch.Touch(key);
+
+  uint32_t threshold = min<uint32_t>(absl::GetFlag(FLAGS_hash_promote_lookups), UINT8_MAX);
+  if (tuner->sketch.Estimate(key) >= threshold && tuner->promote.size() < tuner->kMaxPending)
+    tuner->promote.emplace(db_cntx.db_index, key);
+}
+
+// Returns nullptr if the hash does not fit a listpack.
+uint8_t* ConvertToListpack(StringMap* sm) {
+  uint8_t* lp = lpNew(0);
+  for (const auto& k_v : *sm) {
+    size_t field_len = sdslen(k_v.first), value_len = sdslen(k_v.second);
+    if (field_len > server.max_map_field_len || value_len > server.max_map_field_len) {
+      lpFree(lp);
+      return nullptr;
+    }
+
+    lp = lpAppend(lp, (const uint8_t*)k_v.first, field_len);
+    lp = lpAppend(lp, (const uint8_t*)k_v.second, value_len);
+    if (lpBytes(lp) >= server.max_listpack_map_bytes) {
+      lpFree(lp);
+      return nullptr;
+    }
+  }
+  return lpShrinkToFit(lp);
+}
+
 pair<uint8_t*, bool> LpDelete(uint8_t* lp, string_view field) {
-  uint8_t* fptr = lpFirst(lp);
-  DCHECK(fptr);
-  fptr = lpFind(lp, fptr, (unsigned char*)field.data(), field.size(), 1);
+  uint8_t* fptr = LpFindField(lp, field);
   if (fptr == NULL) {
     return make_pair(lp, false);
   }
@@ -70,7 +183,6 @@ pair<uint8_t*, bool> LpDelete(uint8_t* lp, string_view field) {
 pair<uint8_t*, bool> LpInsert(uint8_t* lp, string_view field, string_view val, bool skip_exists) {
   uint8_t* vptr;
 
-  uint8_t* fptr = lpFirst(lp);
   uint8_t* fsrc = field.empty() ? lp : (uint8_t*)field.data();
 
   // if we vsrc is NULL then lpReplace will delete the element, which is not what we want.
@@ -80,20 +192,17 @@ pair<uint8_t*, bool> LpInsert(uint8_t* lp, string_view field, string_view val, b
 
   bool updated = false;
 
-  if (fptr) {
-    fptr = lpFind(lp, fptr, fsrc, field.size(), 1);
-    if (fptr) {
-      if (skip_exists) {
-        return make_pair(lp, false);
-      }
-      /* Grab pointer to the value (fptr points to the field) */
-      vptr = lpNext(lp, fptr);
-      updated = true;
-
-      /* Replace value */
-      lp = lpReplace(lp, &vptr, vsrc, val.size());
-      DCHECK_EQ(0u, lpLength(lp) % 2);
+  if (uint8_t* fptr = LpFindField(lp, field); fptr) {
+    if (skip_exists) {
+      return make_pair(lp, false);
     }
+    /* Grab pointer to the value (fptr points to the field) */
+    vptr = lpNext(lp, fptr);
+    updated = true;
+
+    /* Replace value */
+    lp = lpReplace(lp, &vptr, vsrc, val.size());
+    DCHECK_EQ(0u, lpLength(lp) % 2);
   }
 
   if (!updated) {
@@ -405,7 +514,7 @@ OpResult<uint32_t> OpDel(const OpArgs& op_args, string_view key, CmdArgList valu
   return deleted;
 }
 
-OpResult<vector<OptStr>> OpHMGet(const OpArgs& op_args, std::string_view key, CmdArgList fields) {
+OpResult<FieldValues> OpHMGet(const OpArgs& op_args, std::string_view key, CmdArgList fields) {
   DCHECK(!fields.empty());
 
   auto& db_slice = op_args.shard->db_slice();
@@ -415,11 +524,13 @@ OpResult<vector<OptStr>> OpHMGet(const OpArgs& op_args, std::string_view key, Cm
     return it_res.status();
 
   const PrimeValue& pv = (*it_res)->second;
+  RecordLookup(op_args.db_cntx, key, pv);
 
-  std::vector<OptStr> result(fields.size());
+  FieldValues result(fields.size());
 
   if (pv.Encoding() == kEncodingListPack) {
     uint8_t* lp = (uint8_t*)pv.RObjPtr();
+    result.Reserve(lpBytes(lp));
 
     absl::flat_hash_map<string_view, unsigned> reverse;
     reverse.reserve(fields.size() + 1);
@@ -445,11 +556,17 @@ OpResult<vector<OptStr>> OpHMGet(const OpArgs& op_args, std::string_view key, Cm
       auto it = reverse.find(key);
       if (it != reverse.end()) {
         DCHECK_LT(it->second, result.size());
-        result[it->second].emplace(LpGetView(lp_elem, ibuf));  // populate found items.
+        result.Set(it->second, LpGetView(lp_elem, ibuf));  // populate found items.
       }
 
       lp_elem = lpNext(lp, lp_elem);  // switch to the next key
     } while (lp_elem);
+
+    // Repeated fields were mapped to their first occurrence.
+    for (size_t i = 0; i < fields.size(); ++i) {
+      if (unsigned first = reverse[ArgS(fields, i)]; first != i)
+        result.CopySpan(i, first);
+    }
   } else {
     DCHECK_EQ(kEncodingStrMap2, pv.Encoding());
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
@@ -457,7 +574,7 @@ OpResult<vector<OptStr>> OpHMGet(const OpArgs& op_args, std::string_view key, Cm
     for (size_t i = 0; i < fields.size(); ++i) {
       auto it = sm->Find(ToSV(fields[i]));
       if (it != sm->end()) {
-        result[i].emplace(it->second, sdslen(it->second));
+        result.Set(i, {it->second, sdslen(it->second)});
       }
     }
   }
@@ -489,6 +606,7 @@ OpResult<int> OpExist(const OpArgs& op_args, string_view key, string_view field)
   }
 
   const PrimeValue& pv = (*it_res)->second;
+  RecordLookup(op_args.db_cntx, key, pv);
   void* ptr = pv.RObjPtr();
   if (pv.Encoding() == kEncodingListPack) {
     uint8_t intbuf[LP_INTBUF_SIZE];
@@ -509,6 +627,7 @@ OpResult<string> OpGet(const OpArgs& op_args, string_view key, string_view field
     return it_res.status();
 
   const PrimeValue& pv = (*it_res)->second;
+  RecordLookup(op_args.db_cntx, key, pv);
   void* ptr = pv.RObjPtr();
 
   if (pv.Encoding() == kEncodingListPack) {
@@ -530,51 +649,50 @@ OpResult<string> OpGet(const OpArgs& op_args, string_view key, string_view field
   return string(it->second, sdslen(it->second));
 }
 
-OpResult<vector<string>> OpGetAll(const OpArgs& op_args, string_view key, uint8_t mask) {
+// The number of strings and the strings serialized as bulk strings.
+using SerializedStrings = pair<unsigned, RedisReplyBuilder::BulkStrChunks>;
+
+// Returns the number of strings and the strings serialized as bulk strings, so that huge hashes
+// are not copied into vectors of strings first.
+OpResult<SerializedStrings> OpGetAll(const OpArgs& op_args, string_view key, uint8_t mask) {
   auto& db_slice = op_args.shard->db_slice();
   auto it_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_HASH);
   if (!it_res) {
     if (it_res.status() == OpStatus::KEY_NOTFOUND)
-      return vector<string>{};
+      return SerializedStrings{};
     return it_res.status();
   }
 
   const PrimeValue& pv = (*it_res)->second;
-
-  vector<string> res;
-  bool keyval = (mask == (FIELDS | VALUES));
+  SerializedStrings res;
+  auto append = [&res](string_view str) {
+    RedisReplyBuilder::AppendBulkString(str, &res.second);
+    ++res.first;
+  };
 
   if (pv.Encoding() == kEncodingListPack) {
     uint8_t* lp = (uint8_t*)pv.RObjPtr();
-    res.resize(lpLength(lp) / (keyval ? 1 : 2));
-
     uint8_t* fptr = lpFirst(lp);
     uint8_t intbuf[LP_INTBUF_SIZE];
 
-    unsigned index = 0;
     while (fptr) {
-      if (mask & FIELDS) {
-        res[index++] = LpGetView(fptr, intbuf);
-      }
+      if (mask & FIELDS)
+        append(LpGetView(fptr, intbuf));
       fptr = lpNext(lp, fptr);
-      if (mask & VALUES) {
-        res[index++] = LpGetView(fptr, intbuf);
-      }
+      if (mask & VALUES)
+        append(LpGetView(fptr, intbuf));
       fptr = lpNext(lp, fptr);
     }
   } else {
     DCHECK_EQ(pv.Encoding(), kEncodingStrMap2);
     StringMap* sm = GetStringMap(pv, op_args.db_cntx);
 
-    res.reserve(sm->UpperBoundSize() * (keyval ? 2 : 1));
+    // Expired fields are skipped by the iteration, the count reflects what was serialized.
     for (const auto& k_v : *sm) {
-      if (mask & FIELDS) {
-        res.emplace_back(k_v.first, sdslen(k_v.first));
-      }
-
-      if (mask & VALUES) {
-        res.emplace_back(k_v.second, sdslen(k_v.second));
-      }
+      if (mask & FIELDS)
+        append({k_v.first, sdslen(k_v.first)});
+      if (mask & VALUES)
+        append({k_v.second, sdslen(k_v.second)});
     }
   }
 
@@ -592,6 +710,7 @@ OpResult<size_t> OpStrLen(const OpArgs& op_args, string_view key, string_view fi
   }
 
   const PrimeValue& pv = (*it_res)->second;
+  RecordLookup(op_args.db_cntx, key, pv);
   void* ptr = pv.RObjPtr();
   if (pv.Encoding() == kEncodingListPack) {
     uint8_t intbuf[LP_INTBUF_SIZE];
@@ -688,6 +807,11 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
 
       created += unsigned(added);
     }
+
+    if (op_sp.ttl != UINT32_MAX) {
+      uint32_t at_sec = MemberTimeSeconds(op_args.db_cntx.time_now_ms) + op_sp.ttl;
+      op_args.shard->db_slice().TrackFieldExpiry(op_args.db_cntx.db_index, key, at_sec);
+    }
   }
 
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, pv);
@@ -697,18 +821,17 @@ OpResult<uint32_t> OpSet(const OpArgs& op_args, string_view key, CmdArgList valu
 
 void HGetGeneric(CmdArgList args, ConnectionContext* cntx, uint8_t getall_mask) {
   string_view key = ArgS(args, 0);
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  bool is_map = (getall_mask == (VALUES | FIELDS));
+  auto type = is_map ? RedisReplyBuilder::MAP : RedisReplyBuilder::ARRAY;
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
     return OpGetAll(t->GetOpArgs(shard), key, getall_mask);
   };
 
-  OpResult<vector<string>> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
-
-  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  OpResult<SerializedStrings> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
   if (result) {
-    bool is_map = (getall_mask == (VALUES | FIELDS));
-    rb->SendStringArr(absl::Span<const string>{*result},
-                      is_map ? RedisReplyBuilder::MAP : RedisReplyBuilder::ARRAY);
+    rb->SendBulkStrArr(result->first, std::move(result->second), type);
   } else {
     cntx->SendError(result.status());
   }
@@ -800,15 +923,14 @@ void HSetFamily::HMGet(CmdArgList args, ConnectionContext* cntx) {
     return OpHMGet(t->GetOpArgs(shard), key, args);
   };
 
-  OpResult<vector<OptStr>> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  OpResult<FieldValues> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   if (result) {
     SinkReplyBuilder::ReplyAggregator agg(cntx->reply_builder());
-    auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
     rb->StartArray(result->size());
-    for (const auto& val : *result) {
-      if (val) {
+    for (size_t i = 0; i < result->size(); ++i) {
+      if (auto val = result->Get(i); val) {
         rb->SendBulkString(*val);
       } else {
         rb->SendNull();
@@ -1261,4 +1383,76 @@ int32_t HSetFamily::FieldExpireTime(const DbContext& db_context, const PrimeValu
   }
 }
 
+void HSetFamily::RecordIfCold(DbIndex db_ind, const PrimeKey& key, const PrimeValue& pv) {
+  // A listpack of max_listpack_map_bytes holds a few hundred fields at most.
+  constexpr size_t kMaxFields = 512;
+
+  if (pv.ObjType() != OBJ_HASH || pv.Encoding() != kEncodingStrMap2)
+    return;
+
+  const StringMap* sm = static_cast<const StringMap*>(pv.RObjPtr());
+  if (sm->ExpirationUsed() || sm->UpperBoundSize() == 0 || sm->UpperBoundSize() > kMaxFields)
+    return;
+
+  EncodingTuner* tuner = GetTuner();
+  if (!tuner || tuner->demote.size() >= tuner->kMaxPending)
+    return;
+
+  string tmp;
+  string_view key_view = key.GetSlice(&tmp);
+  if (tuner->sketch.Estimate(key_view) == 0)
+    tuner->demote.emplace(db_ind, key_view);
+}
+
+void HSetFamily::TuneEncodingStep(DbSlice* db_slice, uint64_t now_ms) {
+  if (!tl_tuner)
+    return;
+
+  // The pending keys are swapped out, as FindMutable can preempt and the lookups add keys.
+  auto convert = [&](EncodingTuner::PendingKeys* pending, bool promote) {
+    EncodingTuner::PendingKeys keys;
+    keys.swap(*pending);
+    for (const auto& [db_ind, key] : keys) {
+      if (!db_slice->IsDbValid(db_ind))
+        continue;
+
+      if (!db_slice->CheckLock(IntentLock::EXCLUSIVE, db_ind, key)) {
+        pending->emplace(db_ind, key);  // retried by the following steps.
+        continue;
+      }
+
+      auto res = db_slice->FindMutable(DbContext{db_ind, now_ms}, key, OBJ_HASH);
+      if (!res)
+        continue;
+
+      PrimeValue& pv = res->it->second;
+      DbTableStats* stats = db_slice->MutableStats(db_ind);
+      if (promote && pv.Encoding() == kEncodingListPack) {
+        uint8_t* lp = (uint8_t*)pv.RObjPtr();
+        stats->listpack_blob_cnt--;
+        stats->listpack_bytes -= lpBytes(lp);
+        pv.InitRobj(OBJ_HASH, kEncodingStrMap2, ConvertToStrMap(lp));
+        lpFree(lp);
+      } else if (!promote && pv.Encoding() == kEncodingStrMap2) {
+        StringMap* sm = static_cast<StringMap*>(pv.RObjPtr());
+        if (sm->ExpirationUsed())
+          continue;
+        if (uint8_t* lp = ConvertToListpack(sm); lp) {
+          stats->listpack_blob_cnt++;
+          stats->listpack_bytes += lpBytes(lp);
+          pv.InitRobj(OBJ_HASH, kEncodingListPack, lp);
+          CompactObj::DeleteMR<StringMap>(sm);
+        }
+      }
+    }
+  };
+
+  convert(&tl_tuner->promote, true);
+  convert(&tl_tuner->demote, false);
+}
+
+OpResult<string> HSetFamily::GetField(const OpArgs& op_args, string_view key, string_view field) {
+  return OpGet(op_args, key, field);
+}
+
 }  // namespace dfly
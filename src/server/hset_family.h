@@ -9,11 +9,13 @@
 #include "facade/op_status.h"
 #include "server/common.h"
 #include "server/table.h"
+#include "server/tx_base.h"
 
 namespace dfly {
 
 class ConnectionContext;
 class CommandRegistry;
+class DbSlice;
 class StringMap;
 
 using facade::OpResult;
@@ -29,6 +31,17 @@ class HSetFamily {
   static int32_t FieldExpireTime(const DbContext& db_context, const PrimeValue& pv,
                                  std::string_view field);
 
+  // Returns the value of a field of the hash at key, KEY_NOTFOUND if either is missing.
+  static OpResult<std::string> GetField(const OpArgs& op_args, std::string_view key,
+                                        std::string_view field);
+
+  // Called by the defragmentation with the values it visits, see --hash_promote_lookups.
+  // Records the hash tables that could be listpacks and were not accessed recently.
+  static void RecordIfCold(DbIndex db_ind, const PrimeKey& key, const PrimeValue& pv);
+
+  // Called by the heartbeat, converts the hashes that were recorded as hot or cold.
+  static void TuneEncodingStep(DbSlice* db_slice, uint64_t now_ms);
+
  private:
   // TODO: to move it to anonymous namespace in cc file.
 
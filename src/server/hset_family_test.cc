@@ -9,11 +9,14 @@ extern "C" {
 #include "redis/sds.h"
 }
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "server/test_utils.h"
 
+ABSL_DECLARE_FLAG(uint32_t, hash_promote_lookups);
+
 using namespace testing;
 using namespace std;
 using namespace util;
@@ -67,6 +70,45 @@ TEST_F(HSetFamilyTest, HSet) {
   EXPECT_EQ(1, CheckedInt({"hset", "small", "", "565323349817"}));
 }
 
+TEST_F(HSetFamilyTest, ListpackLookup) {
+  // Fields and values with every listpack encoding.
+  vector<pair<string, string>> entries = {{"a", "5"},
+                                           {"", "1000"},
+                                           {"17", "v"},
+                                           {"-42", ""},
+                                           {string(63, 'f'), "x"},
+                                           {string(64, 'g'), "565323349817"},
+                                           {"1000000", "-7"},
+                                           {"ab", string(64, 'v')},
+                                           {"abc", "1.5"}};
+  for (const auto& [field, value] : entries)
+    Run({"HSET", "lp", field, value});
+  EXPECT_EQ(GetMetrics().db_stats[0].listpack_blob_cnt, 1u);
+
+  for (const auto& [field, value] : entries) {
+    EXPECT_EQ(Run({"HGET", "lp", field}), value) << field;
+    EXPECT_EQ(CheckedInt({"HEXISTS", "lp", field}), 1) << field;
+  }
+  for (const string& missing : vector<string>{"b", "ab ", "18", string(63, 'g')})
+    EXPECT_EQ(CheckedInt({"HEXISTS", "lp", missing}), 0) << missing;
+
+  EXPECT_EQ(CheckedInt({"HDEL", "lp", "17", string(64, 'g')}), 2);
+  EXPECT_EQ(CheckedInt({"HSET", "lp", "ab", "w"}), 0);
+  EXPECT_EQ(Run({"HGET", "lp", "ab"}), "w");
+  EXPECT_EQ(CheckedInt({"HLEN", "lp"}), 7);
+}
+
+TEST_F(HSetFamilyTest, HMGetRepeated) {
+  Run({"HSET", "small", "a", "1", "b", "2"});
+  Run({"HSET", "large", "a", "1", "b", string(100, 'x')});
+
+  for (auto [key, b_val] : {pair{"small", string("2")}, pair{"large", string(100, 'x')}}) {
+    auto resp = Run({"HMGET", key, "a", "c", "a", "b"});
+    ASSERT_THAT(resp, ArgType(RespExpr::ARRAY)) << key;
+    EXPECT_THAT(resp.GetVec(), ElementsAre("1", ArgType(RespExpr::NIL), "1", b_val)) << key;
+  }
+}
+
 TEST_P(HestFamilyTestProtocolVersioned, Get) {
   auto resp = Run({"hello", GetParam()});
   EXPECT_THAT(resp.GetVec()[6], "proto");
@@ -315,6 +357,58 @@ TEST_F(HSetFamilyTest, HSetEx) {
   EXPECT_THAT(Run({"HGET", "k", "f"}), ArgType(RespExpr::NIL));
 }
 
+TEST_F(HSetFamilyTest, ActiveFieldExpiry) {
+  TEST_current_time_ms = kMemberExpiryBase * 1000;
+
+  for (int i = 0; i < 1000; ++i) {
+    Run({"HSETEX", "tokens", "10", absl::StrCat("t", i), "v"});
+    Run({"HSETEX", "expired", "10", absl::StrCat("t", i), "v"});
+  }
+  Run({"HSETEX", "tokens", "100", "long", "v"});
+  Run({"HSET", "tokens", "keep", "v"});
+
+  shard_set->TEST_EnableHeartBeat();
+  AdvanceTime(10'000);
+
+  // The expired fields are reclaimed without being accessed and empty hashes are deleted.
+  ExpectConditionWithinTimeout([&] { return GetMetrics().events.expired_fields == 2000; });
+  EXPECT_EQ(CheckedInt({"DBSIZE"}), 1);
+  EXPECT_EQ(CheckedInt({"HLEN", "tokens"}), 2);
+
+  AdvanceTime(90'000);
+  ExpectConditionWithinTimeout([&] { return GetMetrics().events.expired_fields == 2001; });
+  EXPECT_THAT(Run({"HKEYS", "tokens"}), "keep");
+}
+
+TEST_F(HSetFamilyTest, AdaptiveEncoding) {
+  absl::FlagSaver saver;
+  absl::SetFlag(&FLAGS_hash_promote_lookups, 8);
+
+  for (int i = 0; i < 32; ++i)
+    Run({"HSET", "hot", absl::StrCat("f", i), "v"});
+  Run({"HSET", "cold", "f", "v", "big", string(100, 'x')});
+  Run({"HDEL", "cold", "big"});
+  Run({"HSET", "warm", "f", "v", "big", string(100, 'x')});
+  Run({"HDEL", "warm", "big"});
+  EXPECT_EQ(GetMetrics().db_stats[0].listpack_blob_cnt, 1u);
+
+  for (int i = 0; i < 10; ++i)
+    EXPECT_EQ(Run({"HGET", "hot", "f31"}), "v");
+  // Lookups of hash tables are recorded too, so the warm one is not demoted.
+  EXPECT_EQ(Run({"HGET", "warm", "f"}), "v");
+
+  // The hot listpack is converted to a hash table.
+  shard_set->TEST_EnableHeartBeat();
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].listpack_blob_cnt == 0; });
+
+  // The defragmentation finds the cold hash table, which fits a listpack.
+  Run({"MEMORY", "DEFRAGMENT"});
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].listpack_blob_cnt == 1; });
+  EXPECT_THAT(Run({"HGETALL", "cold"}), RespArray(ElementsAre("f", "v")));
+  EXPECT_EQ(CheckedInt({"HLEN", "hot"}), 32);
+  EXPECT_EQ(GetMetrics().db_stats[0].listpack_blob_cnt, 1u);
+}
+
 TEST_F(HSetFamilyTest, TriggerConvertToStrMap) {
   const int kElements = 200;
   // Enough for IsGoodForListpack to become false
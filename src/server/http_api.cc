@@ -4,6 +4,10 @@
 
 #include "server/http_api.h"
 
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+
 #include "base/logging.h"
 #include "core/flatbuffers.h"
 #include "facade/conn_context.h"
@@ -141,6 +145,15 @@ struct CaptureVisitor {
     absl::StrAppend(&str, "]");
   }
 
+  void operator()(const CapturingReplyBuilder::SerializedArr& sa) {
+    absl::StrAppend(&str, "[");
+    facade::RedisReplyBuilder::ForEachBulkString(
+        sa.chunks, [this](string_view val) { absl::StrAppend(&str, JsonEscape(val), ","); });
+    if (sa.len)
+      str.pop_back();
+    absl::StrAppend(&str, "]");
+  }
+
   void operator()(unique_ptr<CapturingReplyBuilder::CollectionPayload> cp) {
     if (!cp) {
       absl::StrAppend(&str, "null");
@@ -186,6 +199,47 @@ struct CaptureVisitor {
   string str;
 };
 
+// Runs a single command and returns its captured reply.
+CapturingReplyBuilder::Payload RunCommand(vector<string> cmd_args, Service* service,
+                                          HttpContext* http_cntx) {
+  vector<facade::MutableSlice> cmd_slices(cmd_args.size());
+  for (size_t i = 0; i < cmd_args.size(); ++i) {
+    cmd_slices[i] = absl::MakeSpan(cmd_args[i]);
+  }
+
+  facade::ConnectionContext* context = (facade::ConnectionContext*)http_cntx->user_data();
+  DCHECK(context);
+
+  facade::CapturingReplyBuilder reply_builder;
+  auto* prev = context->Inject(&reply_builder);
+  service->DispatchCommand(absl::MakeSpan(cmd_slices), context);
+  context->Inject(prev);
+  return reply_builder.Take();
+}
+
+void SendTextResponse(h2::status status, string_view text, HttpContext* http_cntx) {
+  auto response = http::MakeStringResponse(status);
+  http::SetMime(http::kTextMime, &response);
+  response.body() = absl::StrCat(text, "\r\n");
+  http_cntx->Invoke(std::move(response));
+}
+
+// Decodes %XX escapes of query values, so that keys may contain any byte.
+string UrlDecode(string_view src) {
+  string res;
+  res.reserve(src.size());
+  for (size_t i = 0; i < src.size(); ++i) {
+    unsigned val = 0;
+    if (src[i] == '%' && i + 2 < src.size() && absl::SimpleHexAtoi(src.substr(i + 1, 2), &val)) {
+      res.push_back(char(val));
+      i += 2;
+    } else {
+      res.push_back(src[i] == '+' ? ' ' : src[i]);
+    }
+  }
+  return res;
+}
+
 }  // namespace
 
 void HttpAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
@@ -219,28 +273,94 @@ void HttpAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
   for (size_t i = 0; i < vec.size(); ++i) {
     cmd_args.push_back(vec[i].AsString().c_str());
   }
-  vector<facade::MutableSlice> cmd_slices(cmd_args.size());
-  for (size_t i = 0; i < cmd_args.size(); ++i) {
-    cmd_slices[i] = absl::MakeSpan(cmd_args[i]);
+
+  CapturingReplyBuilder::Payload payload = RunCommand(std::move(cmd_args), service, http_cntx);
+  auto response = http::MakeStringResponse();
+  http::SetMime(http::kJsonMime, &response);
+
+  CaptureVisitor visitor;
+  std::visit(visitor, std::move(payload));
+  visitor.str.append("}\r\n");
+  response.body() = visitor.str;
+  http_cntx->Invoke(std::move(response));
+}
+
+void HttpKeyAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
+                HttpContext* http_cntx) {
+  string key, ex;
+  for (const auto& [name, value] : args) {
+    if (name == "key")
+      key = UrlDecode(value);
+    else if (name == "ex")
+      ex = value;
   }
 
-  facade::ConnectionContext* context = (facade::ConnectionContext*)http_cntx->user_data();
-  DCHECK(context);
+  if (key.empty())
+    return SendTextResponse(h2::status::bad_request, "Missing key", http_cntx);
 
-  facade::CapturingReplyBuilder reply_builder;
-  auto* prev = context->Inject(&reply_builder);
-  // TODO: to finish this.
-  service->DispatchCommand(absl::MakeSpan(cmd_slices), context);
-  facade::CapturingReplyBuilder::Payload payload = reply_builder.Take();
+  vector<string> cmd_args;
+  switch (req.method()) {
+    case h2::verb::get:
+      cmd_args = {"GET", std::move(key)};
+      break;
+    case h2::verb::put:
+    case h2::verb::post:
+      cmd_args = {"SET", std::move(key), std::move(req.body())};
+      if (!ex.empty()) {
+        cmd_args.push_back("EX");
+        cmd_args.push_back(std::move(ex));
+      }
+      break;
+    case h2::verb::delete_:
+      cmd_args = {"DEL", std::move(key)};
+      break;
+    default:
+      return SendTextResponse(h2::status::method_not_allowed, "Unsupported method", http_cntx);
+  }
+
+  CapturingReplyBuilder::Payload payload = RunCommand(std::move(cmd_args), service, http_cntx);
+  if (auto err = CapturingReplyBuilder::GetError(payload); err)
+    return SendTextResponse(h2::status::bad_request, err->first, http_cntx);
+
+  // Values are sent as they are, without escaping them into JSON.
+  if (auto* val = get_if<CapturingReplyBuilder::BulkString>(&payload); val) {
+    auto response = http::MakeStringResponse(h2::status::ok);
+    http::SetMime("application/octet-stream", &response);
+    response.body() = std::move(*val);
+    http_cntx->Invoke(std::move(response));
+    return;
+  }
+
+  if (holds_alternative<CapturingReplyBuilder::Null>(payload) ||
+      (holds_alternative<long>(payload) && get<long>(payload) == 0)) {
+    return SendTextResponse(h2::status::not_found, "Not found", http_cntx);
+  }
+  SendTextResponse(h2::status::ok, "OK", http_cntx);
+}
+
+void HttpMGetAPI(const http::QueryArgs& args, HttpRequest&& req, Service* service,
+                 HttpContext* http_cntx) {
+  if (req.method() != h2::verb::post)
+    return SendTextResponse(h2::status::method_not_allowed, "Unsupported method", http_cntx);
+
+  vector<string> cmd_args = {"MGET"};
+  for (string_view key : absl::StrSplit(req.body(), '\n', absl::SkipEmpty()))
+    cmd_args.emplace_back(absl::StripTrailingAsciiWhitespace(key));
+
+  if (cmd_args.size() == 1)
+    return SendTextResponse(h2::status::bad_request, "Missing keys", http_cntx);
+
+  CapturingReplyBuilder::Payload payload = RunCommand(std::move(cmd_args), service, http_cntx);
+  if (auto err = CapturingReplyBuilder::GetError(payload); err)
+    return SendTextResponse(h2::status::bad_request, err->first, http_cntx);
 
-  context->Inject(prev);
   auto response = http::MakeStringResponse();
   http::SetMime(http::kJsonMime, &response);
 
   CaptureVisitor visitor;
   std::visit(visitor, std::move(payload));
   visitor.str.append("}\r\n");
-  response.body() = visitor.str;
+  response.body() = std::move(visitor.str);
   http_cntx->Invoke(std::move(response));
 }
 
@@ -23,4 +23,21 @@ using HttpRequest = util::HttpListenerBase::RequestType;
 void HttpAPI(const util::http::QueryArgs& args, HttpRequest&& req, Service* service,
              util::HttpContext* http_cntxt);
 
+/**
+ * @brief Key value endpoint that bypasses the json command encoding.
+ *
+ * The key is passed url-encoded in the `key` query argument. GET replies with the raw value or
+ * 404, PUT or POST stores the request body as the value, with an optional `ex` query argument,
+ * and DELETE removes the key.
+ */
+void HttpKeyAPI(const util::http::QueryArgs& args, HttpRequest&& req, Service* service,
+                util::HttpContext* http_cntxt);
+
+/**
+ * @brief Batch lookup endpoint. The POST body holds one key per line, the reply is the json
+ * array of their values, with null for the missing ones.
+ */
+void HttpMGetAPI(const util::http::QueryArgs& args, HttpRequest&& req, Service* service,
+                 util::HttpContext* http_cntxt);
+
 }  // namespace dfly
@@ -52,9 +52,16 @@ JournalExecutor::~JournalExecutor() {
 
 void JournalExecutor::Execute(DbIndex dbid, absl::Span<journal::ParsedEntry::CmdData> cmds) {
   SelectDb(dbid);
-  for (auto& cmd : cmds) {
-    Execute(cmd);
-  }
+
+  vector<CmdArgList> args_list;
+  args_list.reserve(cmds.size());
+  for (auto& cmd : cmds)
+    args_list.emplace_back(cmd.cmd_args.data(), cmd.cmd_args.size());
+
+  // Commands that were not dispatched because of a pause are executed one by one.
+  size_t dispatched = service_->DispatchManyCommands(absl::MakeSpan(args_list), &conn_context_);
+  for (size_t i = dispatched; i < cmds.size(); ++i)
+    Execute(cmds[i]);
 }
 
 void JournalExecutor::Execute(DbIndex dbid, journal::ParsedEntry::CmdData& cmd) {
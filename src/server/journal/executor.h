@@ -22,6 +22,7 @@ class JournalExecutor {
 
   JournalExecutor(JournalExecutor&&) = delete;
 
+  // Executes the commands in order, squashing the single shard ones into shared hops.
   void Execute(DbIndex dbid, absl::Span<journal::ParsedEntry::CmdData> cmds);
   void Execute(DbIndex dbid, journal::ParsedEntry::CmdData& cmd);
 
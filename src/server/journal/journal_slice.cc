@@ -31,6 +31,7 @@ namespace {
 string ShardName(std::string_view base, unsigned index) {
   return absl::StrCat(base, "-", absl::Dec(index, absl::kZeroPad4), ".log");
 }
+*/
 
 uint32_t NextPowerOf2(uint32_t x) {
   if (x < 2) {
@@ -40,8 +41,6 @@ uint32_t NextPowerOf2(uint32_t x) {
   return 1 << log;
 }
 
-*/
-
 }  // namespace
 
 #define CHECK_EC(x)                                                                 \
@@ -62,7 +61,7 @@ void JournalSlice::Init(unsigned index) {
     return;
 
   slice_index_ = index;
-  ring_buffer_.emplace(2);
+  ring_buffer_.emplace(NextPowerOf2(absl::GetFlag(FLAGS_shard_repl_backlog_len)));
 }
 
 #if 0
@@ -160,8 +159,6 @@ void JournalSlice::AddLogRecord(const Entry& entry, bool await) {
     item->slot = entry.slot;
   } else {
     FiberAtomicGuard fg;
-    // GetTail gives a pointer to a new tail entry in the buffer, possibly overriding the last entry
-    // if the buffer is full.
     item = &dummy;
     item->opcode = entry.opcode;
     item->lsn = lsn_++;
@@ -174,6 +171,16 @@ void JournalSlice::AddLogRecord(const Entry& entry, bool await) {
 
     item->data = io::View(ring_serialize_buf_.InputBuffer());
     ring_serialize_buf_.Clear();
+
+    // GetTail overrides the oldest entry if the buffer is full. The listeners get the local item,
+    // as the buffered one could be overwritten by newer records if they preempt. The command view
+    // is valid only during this call, so it is not buffered.
+    JournalItem* tail = ring_buffer_->GetTail(true);
+    tail->lsn = item->lsn;
+    tail->opcode = item->opcode;
+    tail->data = item->data;
+    tail->slot = item->slot;
+
     VLOG(2) << "Writing item [" << item->lsn << "]: " << entry.ToString();
   }
 
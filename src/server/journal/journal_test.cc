@@ -1,15 +1,26 @@
+#include <absl/flags/reflection.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_join.h>
+
 #include <string>
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
+#include "facade/facade_test.h"
+#include "server/journal/executor.h"
+#include "server/journal/journal_slice.h"
 #include "server/journal/serializer.h"
 #include "server/journal/types.h"
 #include "server/serializer_commons.h"
+#include "server/test_utils.h"
 
 using namespace testing;
 using namespace std;
 using namespace util;
 
+ABSL_DECLARE_FLAG(uint32_t, shard_repl_backlog_len);
+
 namespace dfly {
 namespace journal {
 template <typename T> string ConCat(const T& list) {
@@ -127,5 +138,132 @@ TEST(Journal, WriteRead) {
   }
 }
 
+// Write entries in compressed frames and read them back through JournalFrameSource.
+TEST(Journal, WriteReadFrames) {
+  StoredLists lists{};
+  auto list = [v = &lists](auto... ss) { return StoreList(v, ss...); };
+  using Payload = Entry::Payload;
+
+  io::StringSink sink;
+  JournalWriter writer{&sink};
+  for (unsigned i = 0; i < 100; i++) {
+    writer.Write(Entry{i, Op::COMMAND, 0, 1, nullopt, Payload("SET", list("key", "value"))});
+  }
+
+  // Split stream into frames of different sizes, the first one holds incompressible data
+  base::IoBuf buf;
+  string_view data = sink.str();
+  for (size_t pos = 0, len = 1; pos < data.size(); pos += len, len *= 4) {
+    len = min(len, data.size() - pos);
+    auto frame = EncodeJournalFrame(io::Buffer(data.substr(pos, len)));
+    buf.WriteAndCommit(frame.data(), frame.size());
+  }
+  EXPECT_LT(buf.InputLen(), data.size());
+
+  io::BufSource source{&buf};
+  JournalFrameSource frame_source{&source};
+  JournalReader reader{&frame_source, 0};
+  for (unsigned i = 0; i < 100; i++) {
+    auto res = reader.ReadEntry();
+    ASSERT_TRUE(res.has_value()) << i;
+    EXPECT_EQ(res->txid, i);
+    EXPECT_EQ(ExtractPayload(*res), "SET key value");
+  }
+}
+
+// The slice keeps the last shard_repl_backlog_len entries for partial syncs.
+TEST(Journal, SliceBacklog) {
+  absl::FlagSaver saver;
+  absl::SetFlag(&FLAGS_shard_repl_backlog_len, 4);
+
+  StoredLists lists{};
+  auto list = [v = &lists](auto... ss) { return StoreList(v, ss...); };
+  using Payload = Entry::Payload;
+
+  JournalSlice slice;
+  slice.Init(0);
+  for (unsigned i = 1; i <= 10; i++) {
+    Entry entry{i, Op::COMMAND, 0, 1, nullopt, Payload("SET", list("key", absl::StrCat(i)))};
+    slice.AddLogRecord(entry, false);
+  }
+  EXPECT_EQ(slice.cur_lsn(), 11u);
+
+  EXPECT_FALSE(slice.IsLSNInBuffer(6));
+  EXPECT_FALSE(slice.IsLSNInBuffer(11));
+  for (LSN lsn = 7; lsn <= 10; lsn++) {
+    ASSERT_TRUE(slice.IsLSNInBuffer(lsn));
+
+    io::BytesSource source{io::Buffer(slice.GetEntry(lsn))};
+    JournalReader reader{&source, 0};
+    auto res = reader.ReadEntry();
+    ASSERT_TRUE(res.has_value()) << lsn;
+    EXPECT_EQ(res->txid, lsn);
+    EXPECT_EQ(ExtractPayload(*res), absl::StrCat("SET key ", lsn));
+  }
+}
+
+// Replica flows batch the commands while the reader has the next entries buffered.
+TEST(Journal, ReaderBufferedInput) {
+  StoredLists lists{};
+  auto list = [v = &lists](auto... ss) { return StoreList(v, ss...); };
+  using Payload = Entry::Payload;
+
+  io::StringSink sink;
+  JournalWriter writer{&sink};
+  for (unsigned i = 0; i < 3; i++)
+    writer.Write(Entry{i, Op::COMMAND, 0, 1, nullopt, Payload("SET", list("key", "value"))});
+
+  io::BytesSource source{io::Buffer(sink.str())};
+  JournalReader reader{&source, 0};
+  EXPECT_FALSE(reader.HasBufferedInput());
+  for (unsigned i = 0; i < 3; i++) {
+    ASSERT_TRUE(reader.ReadEntry().has_value()) << i;
+    EXPECT_EQ(reader.HasBufferedInput(), i < 2) << i;
+  }
+}
+
 }  // namespace journal
+
+class JournalExecutorTest : public BaseFamilyTest {
+ protected:
+  static journal::ParsedEntry::CmdData MakeCmd(initializer_list<string_view> args) {
+    journal::ParsedEntry::CmdData cmd;
+    string joined = absl::StrJoin(args, "");
+    cmd.command_buf = make_unique<char[]>(joined.size());
+    memcpy(cmd.command_buf.get(), joined.data(), joined.size());
+
+    size_t pos = 0;
+    for (string_view arg : args) {
+      cmd.cmd_args.emplace_back(cmd.command_buf.get() + pos, arg.size());
+      pos += arg.size();
+    }
+    return cmd;
+  }
+};
+
+// A batch of replicated commands is applied in order with squashed hops.
+TEST_F(JournalExecutorTest, ExecuteBatch) {
+  vector<journal::ParsedEntry::CmdData> batch;
+  batch.push_back(MakeCmd({"SET", "a", "1"}));
+  batch.push_back(MakeCmd({"SET", "b", "2"}));
+  batch.push_back(MakeCmd({"INCR", "a"}));
+  batch.push_back(MakeCmd({"MSET", "c", "3", "d", "4"}));
+  batch.push_back(MakeCmd({"APPEND", "b", "x"}));
+
+  auto squashed_before = GetMetrics().coordinator_stats.multi_squash_executions;
+  pp_->at(0)->Await([&] {
+    JournalExecutor executor{service_.get()};
+    executor.Execute(1, absl::MakeSpan(batch));
+  });
+  EXPECT_GT(GetMetrics().coordinator_stats.multi_squash_executions, squashed_before);
+
+  EXPECT_EQ(Run({"select", "1"}), "OK");
+  EXPECT_EQ(Run({"get", "a"}), "2");
+  EXPECT_EQ(Run({"get", "b"}), "2x");
+  EXPECT_THAT(Run({"mget", "c", "d"}), RespArray(ElementsAre("3", "4")));
+
+  EXPECT_EQ(Run({"select", "0"}), "OK");
+  EXPECT_EQ(CheckedInt({"dbsize"}), 0);
+}
+
 }  // namespace dfly
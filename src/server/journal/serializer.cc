@@ -4,6 +4,9 @@
 
 #include "server/journal/serializer.h"
 
+#include <absl/base/internal/endian.h>
+#include <lz4.h>
+
 #include <system_error>
 
 #include "base/logging.h"
@@ -218,4 +221,78 @@ io::Result<journal::ParsedEntry> JournalReader::ReadEntry() {
   return entry;
 }
 
+std::vector<uint8_t> EncodeJournalFrame(io::Bytes src) {
+  DCHECK_LE(src.size(), size_t(LZ4_MAX_INPUT_SIZE));
+
+  int bound = LZ4_compressBound(src.size());
+  std::vector<uint8_t> frame(kJournalFrameHeaderSize + bound);
+
+  char* payload = reinterpret_cast<char*>(frame.data() + kJournalFrameHeaderSize);
+  int payload_len =
+      LZ4_compress_default(reinterpret_cast<const char*>(src.data()), payload, src.size(), bound);
+
+  // Store incompressible data as is
+  if (payload_len <= 0 || size_t(payload_len) >= src.size()) {
+    payload_len = src.size();
+    memcpy(payload, src.data(), src.size());
+  }
+  frame.resize(kJournalFrameHeaderSize + payload_len);
+
+  absl::little_endian::Store32(frame.data(), src.size());
+  absl::little_endian::Store32(frame.data() + 4, payload_len);
+  return frame;
+}
+
+io::Result<size_t> JournalFrameSource::ReadSome(const iovec* v, uint32_t len) {
+  if (frame_offs_ == frame_.size()) {
+    if (auto ec = ReadFrame(); ec)
+      return make_unexpected(ec);
+  }
+
+  size_t read_total = 0;
+  while (frame_offs_ < frame_.size() && len > 0) {
+    size_t read_sz = min<size_t>(frame_.size() - frame_offs_, v->iov_len);
+    memcpy(v->iov_base, frame_.data() + frame_offs_, read_sz);
+    read_total += read_sz;
+    frame_offs_ += read_sz;
+
+    ++v;
+    --len;
+  }
+  return read_total;
+}
+
+error_code JournalFrameSource::ReadFrame() {
+  uint8_t header[kJournalFrameHeaderSize];
+  size_t read_len = 0;
+  io::MutableBytes header_buf{header, sizeof(header)};
+  SET_OR_RETURN(source_->ReadAtLeast(header_buf, sizeof(header)), read_len);
+  if (read_len < sizeof(header))
+    return make_error_code(errc::io_error);
+
+  uint32_t raw_len = absl::little_endian::Load32(header);
+  uint32_t payload_len = absl::little_endian::Load32(header + 4);
+  if (payload_len > raw_len || raw_len > uint32_t(LZ4_MAX_INPUT_SIZE))
+    return make_error_code(errc::bad_message);
+
+  frame_offs_ = 0;
+  frame_.resize(raw_len);
+
+  // Read uncompressed payload directly into the frame
+  auto* dest = payload_len == raw_len ? &frame_ : &payload_;
+  dest->resize(payload_len);
+  io::MutableBytes payload_buf{dest->data(), payload_len};
+  SET_OR_RETURN(source_->ReadAtLeast(payload_buf, payload_len), read_len);
+  if (read_len < payload_len)
+    return make_error_code(errc::io_error);
+
+  if (dest == &payload_) {
+    int res = LZ4_decompress_safe(reinterpret_cast<const char*>(payload_.data()),
+                                  reinterpret_cast<char*>(frame_.data()), payload_len, raw_len);
+    if (res < 0 || uint32_t(res) != raw_len)
+      return make_error_code(errc::bad_message);
+  }
+  return {};
+}
+
 }  // namespace dfly
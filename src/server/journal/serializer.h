@@ -6,6 +6,7 @@
 
 #include <optional>
 #include <string>
+#include <vector>
 
 #include "io/io.h"
 #include "io/io_buf.h"
@@ -50,6 +51,12 @@ struct JournalReader {
   // Try reading entry from source.
   io::Result<journal::ParsedEntry> ReadEntry();
 
+  // Whether data that was read from the source is left, so the next entry is likely available
+  // without waiting for the source.
+  bool HasBufferedInput() const {
+    return buf_.InputLen() > 0;
+  }
+
  private:
   // Read from source until buffer contains at least num bytes.
   std::error_code EnsureRead(size_t num);
@@ -69,4 +76,28 @@ struct JournalReader {
   DbIndex dbid_;
 };
 
+// The journal stream can be split into frames of 4 bytes raw length and 4 bytes payload length,
+// both little endian, followed by the payload. The payload is a LZ4 compressed block unless
+// both lengths are equal.
+constexpr size_t kJournalFrameHeaderSize = 8;
+
+// Encode frame for the given data, compressing it if it's worth it.
+std::vector<uint8_t> EncodeJournalFrame(io::Bytes src);
+
+// Source that decodes the frames produced by EncodeJournalFrame from the underlying source.
+class JournalFrameSource : public io::Source {
+ public:
+  explicit JournalFrameSource(io::Source* source) : source_{source} {
+  }
+
+  io::Result<size_t> ReadSome(const iovec* v, uint32_t len) final;
+
+ private:
+  std::error_code ReadFrame();
+
+  io::Source* source_;
+  std::vector<uint8_t> frame_, payload_;
+  size_t frame_offs_ = 0;
+};
+
 }  // namespace dfly
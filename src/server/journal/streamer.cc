@@ -9,6 +9,7 @@
 #include "base/flags.h"
 #include "base/logging.h"
 #include "server/cluster/cluster_defs.h"
+#include "server/server_state.h"
 
 using namespace facade;
 
@@ -93,6 +94,15 @@ void JournalStreamer::Write(std::string_view str) {
   // We can not aggregate it since we do not know when the next update will follow.
   size_t total_pending = pending_buf_.size() + str.size();
   if (in_flight_bytes_ == 0 || total_pending > kFlushThreshold) {
+    if (compress_) {
+      AsyncWriteFrame(str);
+      return;
+    }
+
+    auto& stats = ServerState::tlocal()->stats;
+    stats.repl_stream_raw_bytes += total_pending;
+    stats.repl_stream_wire_bytes += total_pending;
+
     // because of potential SOO with strings we allocate explicitly on heap
     uint8_t* buf(new uint8_t[str.size()]);
 
@@ -138,11 +148,20 @@ void JournalStreamer::OnCompletion(std::error_code ec, size_t len) {
     cntx_->ReportError(ec);
   } else if (in_flight_bytes_ == 0 && !pending_buf_.empty() && !IsStopped()) {
     // If everything was sent but we have a pending buf, flush it.
-    io::Bytes src(pending_buf_);
-    in_flight_bytes_ += src.size();
-    dest_->AsyncWrite(src, [buf = std::move(pending_buf_), this](std::error_code ec) {
-      OnCompletion(ec, buf.size());
-    });
+    if (compress_) {
+      AsyncWriteFrame({});
+    } else {
+      io::Bytes src(pending_buf_);
+      in_flight_bytes_ += src.size();
+
+      auto& stats = ServerState::tlocal()->stats;
+      stats.repl_stream_raw_bytes += src.size();
+      stats.repl_stream_wire_bytes += src.size();
+
+      dest_->AsyncWrite(src, [buf = std::move(pending_buf_), this](std::error_code ec) {
+        OnCompletion(ec, buf.size());
+      });
+    }
   }
 
   // notify ThrottleIfNeeded or WaitForInflightToComplete that waits
@@ -153,6 +172,22 @@ void JournalStreamer::OnCompletion(std::error_code ec, size_t len) {
   waker_.notifyAll();
 }
 
+void JournalStreamer::AsyncWriteFrame(std::string_view tail) {
+  pending_buf_.insert(pending_buf_.end(), tail.begin(), tail.end());
+  std::vector<uint8_t> frame = EncodeJournalFrame(pending_buf_);
+
+  auto& stats = ServerState::tlocal()->stats;
+  stats.repl_stream_raw_bytes += pending_buf_.size();
+  stats.repl_stream_wire_bytes += frame.size();
+  pending_buf_.clear();
+
+  io::Bytes src(frame);
+  in_flight_bytes_ += src.size();
+  dest_->AsyncWrite(src, [frame = std::move(frame), this](std::error_code ec) {
+    OnCompletion(ec, frame.size());
+  });
+}
+
 void JournalStreamer::ThrottleIfNeeded() {
   if (IsStopped() || !IsStalled())
     return;
@@ -204,7 +239,14 @@ void RestoreStreamer::Start(util::FiberSocketBase* dest, bool send_lsn) {
   PrimeTable::Cursor cursor;
   uint64_t last_yield = 0;
   PrimeTable* pt = &db_array_[0]->prime;
+  auto start = chrono::steady_clock::now();
 
+  if (db_array_[0]->HasSlotIndex()) {
+    WriteIndexedSlots(start);
+    return;
+  }
+
+  buckets_total_ = pt->bucket_count();
   do {
     if (fiber_cancelled_)
       return;
@@ -216,9 +258,11 @@ void RestoreStreamer::Start(util::FiberSocketBase* dest, bool send_lsn) {
       if (WriteBucket(it)) {
         written = true;
       }
+      buckets_visited_.fetch_add(1, memory_order_relaxed);
     });
     if (written) {
       ThrottleIfNeeded();
+      LimitRate(start);
     }
 
     if (++last_yield >= 100) {
@@ -228,6 +272,44 @@ void RestoreStreamer::Start(util::FiberSocketBase* dest, bool send_lsn) {
   } while (cursor);
 }
 
+void RestoreStreamer::WriteIndexedSlots(chrono::steady_clock::time_point start) {
+  // Keys that are added later are sent by the journal, so it's enough to copy the keys of every
+  // slot when reaching it.
+  const DbTable& table = *db_array_[0];
+  size_t total = 0;
+  for (cluster::SlotId sid = 0; sid < table.slot_keys.size(); ++sid) {
+    if (my_slots_.Contains(sid))
+      total += table.slot_keys[sid].size();
+  }
+  buckets_total_ = total;
+
+  PrimeTable* pt = &db_array_[0]->prime;
+  vector<string> keys;
+  cluster::SlotId sid = 0;
+  uint64_t i = 0;
+  while (table.NextSlotKeys(my_slots_, &sid, &keys)) {
+    for (const string& key : keys) {
+      if (fiber_cancelled_)
+        return;
+
+      // Buckets that were already sent have the snapshot version and are skipped by WriteBucket.
+      if (auto it = pt->Find(key); IsValid(it)) {
+        PrimeTable::bucket_iterator bit = pt->GetBucketIterator(it);
+        db_slice_->FlushChangeToEarlierCallbacks(
+            0 /*db_id always 0 for cluster*/, DbSlice::Iterator::FromPrime(bit), snapshot_version_);
+        if (WriteBucket(bit)) {
+          ThrottleIfNeeded();
+          LimitRate(start);
+        }
+      }
+      buckets_visited_.fetch_add(1, memory_order_relaxed);
+
+      if (++i % 100 == 0)
+        ThisFiber::Yield();
+    }
+  }
+}
+
 void RestoreStreamer::SendFinalize() {
   VLOG(1) << "RestoreStreamer FIN opcode for : " << db_slice_->shard_id();
   journal::Entry entry(journal::Op::FIN, 0 /*db_id*/, 0 /*slot_id*/);
@@ -288,6 +370,8 @@ bool RestoreStreamer::WriteBucket(PrimeTable::bucket_iterator it) {
 
   if (it.GetVersion() < snapshot_version_) {
     it.SetVersion(snapshot_version_);
+    io::StringSink sink;
+    JournalWriter writer{&sink};
     string key_buffer;  // we can reuse it
     for (; !it.is_done(); ++it) {
       const auto& pv = it->second;
@@ -301,14 +385,35 @@ bool RestoreStreamer::WriteBucket(PrimeTable::bucket_iterator it) {
           expire = db_slice_->ExpireTime(eit);
         }
 
-        WriteEntry(key, it->first, pv, expire);
+        WriteEntry(key, it->first, pv, expire, &writer);
       }
     }
+
+    if (written) {
+      bytes_written_.fetch_add(sink.str().size(), memory_order_relaxed);
+      Write(sink.str());
+    }
   }
 
   return written;
 }
 
+void RestoreStreamer::LimitRate(chrono::steady_clock::time_point start) {
+  if (rate_limit_ == 0 || fiber_cancelled_)
+    return;
+
+  double allowed_sec = double(bytes_written_.load(memory_order_relaxed)) / rate_limit_;
+  auto allowed = start + chrono::duration_cast<chrono::steady_clock::duration>(
+                             chrono::duration<double>(allowed_sec));
+  if (auto now = chrono::steady_clock::now(); allowed > now)
+    ThisFiber::SleepFor(allowed - now);
+}
+
+RestoreStreamer::Progress RestoreStreamer::GetProgress() const {
+  return {bytes_written_.load(memory_order_relaxed), buckets_visited_.load(memory_order_relaxed),
+          buckets_total_.load(memory_order_relaxed)};
+}
+
 void RestoreStreamer::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req) {
   DCHECK_EQ(db_index, 0) << "Restore migration only allowed in cluster mode in db0";
 
@@ -327,7 +432,7 @@ void RestoreStreamer::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req
 }
 
 void RestoreStreamer::WriteEntry(string_view key, const PrimeValue& pk, const PrimeValue& pv,
-                                 uint64_t expire_ms) {
+                                 uint64_t expire_ms, JournalWriter* writer) {
   absl::InlinedVector<string_view, 5> args;
   args.push_back(key);
 
@@ -344,10 +449,10 @@ void RestoreStreamer::WriteEntry(string_view key, const PrimeValue& pk, const Pr
     args.push_back("STICK");
   }
 
-  WriteCommand(journal::Entry::Payload("RESTORE", ArgSlice(args)));
+  WriteCommand(journal::Entry::Payload("RESTORE", ArgSlice(args)), writer);
 }
 
-void RestoreStreamer::WriteCommand(journal::Entry::Payload cmd_payload) {
+void RestoreStreamer::WriteCommand(journal::Entry::Payload cmd_payload, JournalWriter* writer) {
   journal::Entry entry(0,                     // txid
                        journal::Op::COMMAND,  // single command
                        0,                     // db index
@@ -357,10 +462,7 @@ void RestoreStreamer::WriteCommand(journal::Entry::Payload cmd_payload) {
 
   // TODO: From WriteEntry to till Write we tripple copy the PrimeValue. It's ver in-efficient and
   // will burn CPU for large values.
-  io::StringSink sink;
-  JournalWriter writer{&sink};
-  writer.Write(entry);
-  Write(sink.str());
+  writer->Write(entry);
 }
 
 }  // namespace dfly
@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+
 #include "server/db_slice.h"
 #include "server/journal/journal.h"
 #include "server/journal/serializer.h"
@@ -25,6 +28,11 @@ class JournalStreamer {
   // Register journal listener and start writer in fiber.
   virtual void Start(util::FiberSocketBase* dest, bool send_lsn);
 
+  // Wrap written data into compressed frames, see EncodeJournalFrame. Must be set before Start.
+  void set_compress(bool compress) {
+    compress_ = compress;
+  }
+
   // Must be called on context cancellation for unblocking
   // and manual cleanup.
   virtual void Cancel();
@@ -54,6 +62,9 @@ class JournalStreamer {
  private:
   void OnCompletion(std::error_code ec, size_t len);
 
+  // Write pending_buf_ followed by tail as a single frame
+  void AsyncWriteFrame(std::string_view tail);
+
   bool IsStopped() const {
     return cntx_->IsCancelled();
   }
@@ -64,6 +75,7 @@ class JournalStreamer {
   std::vector<uint8_t> pending_buf_;
   size_t in_flight_bytes_ = 0;
   time_t last_lsn_time_ = 0;
+  bool compress_ = false;
   util::fb2::EventCount waker_;
   uint32_t journal_cb_id_{0};
 };
@@ -85,16 +97,37 @@ class RestoreStreamer : public JournalStreamer {
     return snapshot_finished_;
   }
 
+  // Limit the rate of snapshot data, 0 for no limit. Must be set before Start.
+  void set_rate_limit(uint64_t bytes_per_sec) {
+    rate_limit_ = bytes_per_sec;
+  }
+
+  struct Progress {
+    size_t bytes = 0;            // written restore data
+    size_t buckets_visited = 0;  // by the snapshot traversal
+    size_t buckets_total = 0;
+  };
+
+  // Can be called from any thread
+  Progress GetProgress() const;
+
  private:
   void OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req);
   bool ShouldWrite(const journal::JournalItem& item) const override;
   bool ShouldWrite(std::string_view key) const;
   bool ShouldWrite(cluster::SlotId slot_id) const;
 
-  // Returns whether anything was written
+  // Returns whether anything was written. All the entries of a bucket are sent as one write.
   bool WriteBucket(PrimeTable::bucket_iterator it);
-  void WriteEntry(string_view key, const PrimeValue& pk, const PrimeValue& pv, uint64_t expire_ms);
-  void WriteCommand(journal::Entry::Payload cmd_payload);
+  void WriteEntry(string_view key, const PrimeValue& pk, const PrimeValue& pv, uint64_t expire_ms,
+                  JournalWriter* writer);
+  void WriteCommand(journal::Entry::Payload cmd_payload, JournalWriter* writer);
+
+  // Snapshots my_slots_ by visiting only their keys, requires a slot index
+  void WriteIndexedSlots(std::chrono::steady_clock::time_point start);
+
+  // Sleeps until the snapshot data written since start fits into the rate limit
+  void LimitRate(std::chrono::steady_clock::time_point start);
 
   DbSlice* db_slice_;
   DbTableArray db_array_;
@@ -102,6 +135,11 @@ class RestoreStreamer : public JournalStreamer {
   cluster::SlotSet my_slots_;
   bool fiber_cancelled_ = false;
   bool snapshot_finished_ = false;
+  uint64_t rate_limit_ = 0;
+
+  std::atomic_size_t bytes_written_{0};
+  std::atomic_size_t buckets_visited_{0};
+  std::atomic_size_t buckets_total_{0};
 };
 
 }  // namespace dfly
@@ -4,6 +4,7 @@
 
 #include "server/json_family.h"
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_join.h>
@@ -13,12 +14,14 @@
 #include <jsoncons_ext/jsonpatch/jsonpatch.hpp>
 #include <jsoncons_ext/jsonpath/jsonpath.hpp>
 #include <jsoncons_ext/jsonpointer/jsonpointer.hpp>
+#include <list>
 
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/flatbuffers.h"
 #include "core/json/json_object.h"
 #include "core/json/path.h"
+#include "core/overloaded.h"
 #include "facade/cmd_arg_parser.h"
 #include "facade/op_status.h"
 #include "server/acl/acl_commands_def.h"
@@ -27,6 +30,7 @@
 #include "server/error.h"
 #include "server/journal/journal.h"
 #include "server/search/doc_index.h"
+#include "server/server_state.h"
 #include "server/string_family.h"
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
@@ -35,6 +39,8 @@ ABSL_FLAG(bool, jsonpathv2, true,
           "If true uses Dragonfly jsonpath implementation, "
           "otherwise uses legacy jsoncons implementation.");
 ABSL_FLAG(bool, experimental_flat_json, false, "If true uses flat json implementation.");
+ABSL_FLAG(uint32_t, json_path_cache_size, 512,
+          "Number of parsed json paths cached per thread, 0 disables the cache.");
 
 namespace dfly {
 
@@ -55,11 +61,13 @@ static const char DefaultJsonPath[] = "$";
 
 namespace {
 
-using JsonPathV2 = variant<json::Path, JsonExpression>;
+// jsoncons expressions are move only, so they are shared with the path cache.
+using JsonPathV2 = variant<json::Path, shared_ptr<const JsonExpression>>;
 using ExprCallback = absl::FunctionRef<void(string_view, const JsonType&)>;
 
-inline void Evaluate(const JsonExpression& expr, const JsonType& obj, ExprCallback cb) {
-  expr.evaluate(obj, cb);
+inline void Evaluate(const shared_ptr<const JsonExpression>& expr, const JsonType& obj,
+                     ExprCallback cb) {
+  expr->evaluate(obj, cb);
 }
 
 inline void Evaluate(const json::Path& expr, const JsonType& obj, ExprCallback cb) {
@@ -68,8 +76,8 @@ inline void Evaluate(const json::Path& expr, const JsonType& obj, ExprCallback c
   });
 }
 
-inline JsonType Evaluate(const JsonExpression& expr, const JsonType& obj) {
-  return expr.evaluate(obj);
+inline JsonType Evaluate(const shared_ptr<const JsonExpression>& expr, const JsonType& obj) {
+  return expr->evaluate(obj);
 }
 
 inline JsonType Evaluate(const json::Path& expr, const JsonType& obj) {
@@ -79,7 +87,27 @@ inline JsonType Evaluate(const json::Path& expr, const JsonType& obj) {
   return res;
 }
 
-facade::OpStatus SetJson(const OpArgs& op_args, string_view key, JsonType&& value) {
+bool IsFlatJson(const PrimeValue& pv) {
+  return pv.GetJsonEncoding() == kEncodingJsonFlat;
+}
+
+FlatJson GetFlatJson(const PrimeValue& pv) {
+  auto buf = pv.GetJsonFlat();
+  return flexbuffers::GetRoot(buf.data(), buf.size());
+}
+
+// Encodes value into a flexbuffer and stores it in pv.
+void SetFlatJson(const JsonType& value, PrimeValue* pv) {
+  flexbuffers::Builder fbb;
+  json::FromJsonType(value, &fbb);
+  fbb.Finish();
+  const auto& buf = fbb.GetBuffer();
+  pv->SetJson(buf.data(), buf.size());
+}
+
+// Replaces the value of key with the json value stored by set_value.
+facade::OpStatus ReplaceJson(const OpArgs& op_args, string_view key,
+                             absl::FunctionRef<void(PrimeValue*)> set_value) {
   auto& db_slice = op_args.shard->db_slice();
 
   auto op_res = db_slice.AddOrFind(op_args.db_cntx, key);
@@ -88,18 +116,101 @@ facade::OpStatus SetJson(const OpArgs& op_args, string_view key, JsonType&& valu
   auto& res = *op_res;
 
   op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, res.it->second);
+  set_value(&res.it->second);
+  op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, res.it->second);
+  return OpStatus::OK;
+}
 
-  if (absl::GetFlag(FLAGS_experimental_flat_json)) {
-    flexbuffers::Builder fbb;
-    json::FromJsonType(value, &fbb);
-    fbb.Finish();
+facade::OpStatus SetJson(const OpArgs& op_args, string_view key, JsonType&& value) {
+  return ReplaceJson(op_args, key, [&value](PrimeValue* pv) {
+    if (absl::GetFlag(FLAGS_experimental_flat_json))
+      SetFlatJson(value, pv);
+    else
+      pv->SetJson(std::move(value));
+  });
+}
+
+// Stores a flat json value built by fbb, which must be finished.
+facade::OpStatus SetJson(const OpArgs& op_args, string_view key, const flexbuffers::Builder& fbb) {
+  return ReplaceJson(op_args, key, [&fbb](PrimeValue* pv) {
     const auto& buf = fbb.GetBuffer();
-    res.it->second.SetJson(buf.data(), buf.size());
-  } else {
-    res.it->second.SetJson(std::move(value));
+    pv->SetJson(buf.data(), buf.size());
+  });
+}
+
+// Scalar to store in a flat json value in place, monostate leaves the value unchanged.
+using FlatScalar = variant<monostate, bool, int64_t, uint64_t, double>;
+
+FlatScalar ReadFlatScalar(FlatJson ref) {
+  if (ref.IsBool())
+    return ref.AsBool();
+  if (ref.IsUInt())
+    return ref.AsUInt64();
+  if (ref.IsInt())
+    return ref.AsInt64();
+  if (ref.IsFloat())
+    return ref.AsDouble();
+  return monostate{};
+}
+
+// Returns false without changing ref if value doesn't fit into the width of its current value.
+bool WriteFlatScalar(FlatJson ref, const FlatScalar& value) {
+  return visit(Overloaded{[](monostate) { return true; },
+                          [&ref](bool b) { return ref.MutateBool(b); },
+                          [&ref](int64_t i) { return ref.MutateInt(i); },
+                          [&ref](uint64_t u) { return ref.MutateUInt(u); },
+                          [&ref](double d) { return ref.MutateFloat(d); }},
+               value);
+}
+
+// Mutates scalars of a flat json value that match path without rebuilding it. new_value is called
+// for every match and returns the value to store. Returns false and leaves the json unchanged if
+// one of the new values doesn't fit into the place of the old one.
+bool MutateFlatInPlace(const json::Path& path, FlatJson json,
+                       absl::FunctionRef<FlatScalar(FlatJson)> new_value) {
+  // Functions evaluate into temporary buffers, they can't be mutated anyway
+  if (!path.empty() && path.front().type() == json::SegmentType::FUNCTION)
+    return false;
+
+  struct Update {
+    FlatJson ref;
+    FlatScalar old_value, new_value;
+  };
+
+  vector<Update> updates;
+  json::EvaluatePath(path, json, [&](optional<string_view>, FlatJson val) {
+    updates.push_back({val, ReadFlatScalar(val), new_value(val)});
+  });
+
+  for (size_t i = 0; i < updates.size(); i++) {
+    if (WriteFlatScalar(updates[i].ref, updates[i].new_value))
+      continue;
+
+    // Old values always fit back
+    for (size_t j = i; j-- > 0;)
+      WriteFlatScalar(updates[j].ref, updates[j].old_value);
+    return false;
   }
-  op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, res.it->second);
-  return OpStatus::OK;
+  return true;
+}
+
+// Mutates the flat json value of key in place with MutateFlatInPlace. Returns false if the value
+// is not flat or can't be mutated in place, then it stays unchanged.
+OpResult<bool> UpdateFlatInPlace(const OpArgs& op_args, string_view key, const json::Path& path,
+                                 absl::FunctionRef<FlatScalar(FlatJson)> new_value) {
+  auto it_res = op_args.shard->db_slice().FindMutable(op_args.db_cntx, key, OBJ_JSON);
+  if (!it_res.ok())
+    return it_res.status();
+
+  PrimeValue& pv = it_res->it->second;
+  if (!IsFlatJson(pv))
+    return false;
+
+  op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, pv);
+  bool updated = MutateFlatInPlace(path, GetFlatJson(pv), new_value);
+  it_res->post_updater.Run();
+  op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, pv);
+  return updated;
 }
 
 string JsonTypeToName(const JsonType& val) {
@@ -199,7 +310,13 @@ OpStatus UpdateEntry(const OpArgs& op_args, std::string_view key, std::string_vi
   }
 
   auto entry_it = it_res->it;
-  JsonType* json_val = entry_it->second.GetJson();
+
+  // Flat values are decoded, updated and encoded again
+  optional<JsonType> decoded;
+  if (IsFlatJson(entry_it->second))
+    decoded = json::FromFlat(GetFlatJson(entry_it->second));
+
+  JsonType* json_val = decoded ? &*decoded : entry_it->second.GetJson();
   DCHECK(json_val) << "should have a valid JSON object for key '" << key << "' the type for it is '"
                    << entry_it->second.ObjType() << "'";
   JsonType& json_entry = *json_val;
@@ -218,6 +335,9 @@ OpStatus UpdateEntry(const OpArgs& op_args, std::string_view key, std::string_vi
     verify_op(json_entry);
   }
 
+  if (decoded)
+    SetFlatJson(*decoded, &entry_it->second);
+
   it_res->post_updater.Run();
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, entry_it->second);
 
@@ -235,19 +355,36 @@ OpStatus UpdateEntry(const OpArgs& op_args, string_view key, const json::Path& p
   PrimeValue& pv = it_res->it->second;
 
   op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, pv);
-  json::MutatePath(path, std::move(cb), pv.GetJson());
+  if (IsFlatJson(pv)) {
+    flexbuffers::Builder fbb;
+    if (json::MutatePath(path, std::move(cb), GetFlatJson(pv), &fbb)) {
+      const auto& buf = fbb.GetBuffer();
+      pv.SetJson(buf.data(), buf.size());
+    }
+  } else {
+    json::MutatePath(path, std::move(cb), pv.GetJson());
+  }
   it_res->post_updater.Run();
   op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, pv);
 
   return OpStatus::OK;
 }
 
-OpResult<JsonType*> GetJson(const OpArgs& op_args, string_view key) {
+// Returns the json value of pv. Flat values are decoded into *decoded.
+JsonType* GetJson(const PrimeValue& pv, optional<JsonType>* decoded) {
+  if (IsFlatJson(pv))
+    return &decoded->emplace(json::FromFlat(GetFlatJson(pv)));
+  return pv.GetJson();
+}
+
+// Returns the json value of key for reading. Flat values are decoded into *decoded, so the result
+// is valid only as long as it is.
+OpResult<JsonType*> GetJson(const OpArgs& op_args, string_view key, optional<JsonType>* decoded) {
   auto it_res = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_JSON);
   if (!it_res.ok())
     return it_res.status();
 
-  JsonType* json_val = it_res.value()->second.GetJson();
+  JsonType* json_val = GetJson(it_res.value()->second, decoded);
   DCHECK(json_val) << "should have a valid JSON object for key " << key;
 
   return json_val;
@@ -458,7 +595,8 @@ OpResult<string> OpJsonGet(const OpArgs& op_args, string_view key,
                            const vector<pair<string_view, optional<JsonPathV2>>>& expressions,
                            bool should_format, const OptString& indent, const OptString& new_line,
                            const OptString& space) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -470,6 +608,29 @@ OpResult<string> OpJsonGet(const OpArgs& op_args, string_view key,
     return json_entry.to_string();
   }
 
+  // A single path is serialized straight from the document without copying its matches.
+  if (expressions.size() == 1 && !should_format) {
+    const optional<JsonPathV2>& expr = expressions[0].second;
+    if (!expr && json_entry.is_string())
+      return json_entry.as<string>();
+
+    string res;
+    if (!expr) {
+      json_entry.dump(res);
+      return res;
+    }
+
+    res.push_back('[');
+    auto cb = [&res](string_view, const JsonType& val) {
+      if (res.size() > 1)
+        res.push_back(',');
+      val.dump(res);
+    };
+    visit([&](auto& arg) { Evaluate(arg, json_entry, cb); }, *expr);
+    res.push_back(']');
+    return res;
+  }
+
   json_options options;
   if (should_format) {
     options.spaces_around_comma(spaces_option::no_spaces)
@@ -497,9 +658,25 @@ OpResult<string> OpJsonGet(const OpArgs& op_args, string_view key,
     return expr ? visit([&](auto& arg) { return Evaluate(arg, json_entry); }, *expr) : json_entry;
   };
 
+  // Dragonfly paths are evaluated together in a single pass over the document.
+  vector<const json::Path*> paths;
+  for (const auto& [expr_str, expr] : expressions) {
+    if (expr && holds_alternative<json::Path>(*expr))
+      paths.push_back(&get<json::Path>(*expr));
+  }
+
   JsonType out{json_object_arg};  // see https://github.com/danielaparker/jsoncons/issues/482
   if (expressions.size() == 1) {
     out = eval_wrapped(expressions[0].second);
+  } else if (paths.size() == expressions.size()) {
+    vector<JsonType> results(paths.size(), JsonType(json_array_arg));
+    json::EvaluatePaths(paths, json_entry,
+                        [&results](size_t i, optional<string_view>, const JsonType& val) {
+                          results[i].push_back(val);
+                        });
+    for (size_t i = 0; i < expressions.size(); ++i) {
+      out[expressions[i].first] = std::move(results[i]);
+    }
   } else {
     for (const auto& [expr_str, expr] : expressions) {
       out[expr_str] = eval_wrapped(expr);
@@ -507,17 +684,17 @@ OpResult<string> OpJsonGet(const OpArgs& op_args, string_view key,
   }
 
   if (should_format) {
-    json_printable jp(out, options, indenting::indent);
-    std::stringstream ss;
-    jp.dump(ss);
-    return ss.str();
+    string res;
+    out.dump(res, options, indenting::indent);
+    return res;
   }
 
   return out.as<string>();
 }
 
 OpResult<vector<string>> OpType(const OpArgs& op_args, string_view key, JsonPathV2 expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -533,7 +710,8 @@ OpResult<vector<string>> OpType(const OpArgs& op_args, string_view key, JsonPath
 }
 
 OpResult<vector<OptSizeT>> OpStrLen(const OpArgs& op_args, string_view key, JsonPathV2 expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -552,7 +730,8 @@ OpResult<vector<OptSizeT>> OpStrLen(const OpArgs& op_args, string_view key, Json
 }
 
 OpResult<vector<OptSizeT>> OpObjLen(const OpArgs& op_args, string_view key, JsonPathV2 expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -572,7 +751,8 @@ OpResult<vector<OptSizeT>> OpObjLen(const OpArgs& op_args, string_view key, Json
 }
 
 OpResult<vector<OptSizeT>> OpArrLen(const OpArgs& op_args, string_view key, JsonPathV2 expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -606,8 +786,25 @@ OpResult<vector<OptBool>> OpToggle(const OpArgs& op_args, string_view key, strin
     return false;
   };
 
+  // Booleans of flat values are always toggled in place
+  auto flat_cb = [&vec](FlatJson val) -> FlatScalar {
+    if (!val.IsBool()) {
+      vec.emplace_back(nullopt);
+      return monostate{};
+    }
+    vec.emplace_back(!val.AsBool());
+    return !val.AsBool();
+  };
+
   if (holds_alternative<json::Path>(expression)) {
     const json::Path& expr = std::get<json::Path>(expression);
+    OpResult<bool> in_place = UpdateFlatInPlace(op_args, key, expr, flat_cb);
+    if (!in_place)
+      return in_place.status();
+    if (*in_place)
+      return vec;
+
+    vec.clear();
     status = UpdateEntry(op_args, key, expr, cb);
   } else {
     status = UpdateEntry(op_args, key, path, cb);
@@ -668,9 +865,45 @@ OpResult<string> OpDoubleArithmetic(const OpArgs& op_args, string_view key, stri
     return false;
   };
 
+  // Numbers of flat values are updated in place if the result keeps their width.
+  // Follows BinOpApply: the result is a double only if the value or num is one.
+  auto flat_cb = [&](FlatJson val) -> FlatScalar {
+    if (!val.IsNumeric()) {
+      output.push_back(JsonType::null());
+      return monostate{};
+    }
+
+    double result = op_type == OP_ADD ? val.AsDouble() + num : val.AsDouble() * num;
+    if (isinf(result)) {
+      is_result_overflow = true;
+      return monostate{};
+    }
+
+    if (val.IsFloat() || has_fractional_part) {
+      output.push_back(result);
+      return result;
+    }
+    // Keep the integer kind of the stored value so its place can be reused
+    if (val.IsUInt()) {
+      output.push_back((uint64_t)result);
+      return (uint64_t)result;
+    }
+    output.push_back((int64_t)result);
+    return (int64_t)result;
+  };
+
   if (holds_alternative<json::Path>(expression)) {
     const json::Path& path = std::get<json::Path>(expression);
-    status = UpdateEntry(op_args, key, path, std::move(cb));
+    OpResult<bool> in_place = UpdateFlatInPlace(op_args, key, path, flat_cb);
+    if (!in_place) {
+      status = in_place.status();
+    } else if (*in_place) {
+      status = OpStatus::OK;
+    } else {
+      output = JsonType(json_array_arg);
+      is_result_overflow = false;
+      status = UpdateEntry(op_args, key, path, std::move(cb));
+    }
   } else {
     status = UpdateEntry(op_args, key, path, std::move(cb));
   }
@@ -684,25 +917,12 @@ OpResult<string> OpDoubleArithmetic(const OpArgs& op_args, string_view key, stri
   return output.as_string();
 }
 
-// If expression is nullopt, then the whole key should be deleted, otherwise deletes
-// items specified by the expression/path.
-OpResult<long> OpDel(const OpArgs& op_args, string_view key, string_view path,
-                     optional<JsonPathV2> expression) {
-  if (!expression || path.empty()) {
-    auto& db_slice = op_args.shard->db_slice();
-    auto it = db_slice.FindMutable(op_args.db_cntx, key).it;  // post_updater will run immediately
-    return long(db_slice.Del(op_args.db_cntx.db_index, it));
-  }
-
-  OpResult<JsonType*> result = GetJson(op_args, key);
-  if (!result) {
-    return 0;
-  }
-
-  if (holds_alternative<json::Path>(*expression)) {
-    const json::Path& path = get<json::Path>(*expression);
+// Deletes items matching expression (or path for jsoncons) from json_val, returns their number.
+long DeleteJsonItems(string_view path, const JsonPathV2& expression, JsonType* json_val) {
+  if (holds_alternative<json::Path>(expression)) {
+    const json::Path& path = get<json::Path>(expression);
     long deletions = json::MutatePath(
-        path, [](optional<string_view>, JsonType* val) { return true; }, *result);
+        path, [](optional<string_view>, JsonType* val) { return true; }, json_val);
     return deletions;
   }
 
@@ -712,7 +932,7 @@ OpResult<long> OpDel(const OpArgs& op_args, string_view key, string_view path,
     return false;
   };
 
-  JsonType& json_entry = *(result.value());
+  JsonType& json_entry = *json_val;
   error_code ec = JsonReplace(json_entry, path, std::move(cb));
   if (ec) {
     VLOG(1) << "Failed to evaluate expression on json with error: " << ec.message();
@@ -743,11 +963,38 @@ OpResult<long> OpDel(const OpArgs& op_args, string_view key, string_view path,
   return total_deletions;
 }
 
+// If expression is nullopt, then the whole key should be deleted, otherwise deletes
+// items specified by the expression/path.
+OpResult<long> OpDel(const OpArgs& op_args, string_view key, string_view path,
+                     optional<JsonPathV2> expression) {
+  if (!expression || path.empty()) {
+    auto& db_slice = op_args.shard->db_slice();
+    auto it = db_slice.FindMutable(op_args.db_cntx, key).it;  // post_updater will run immediately
+    return long(db_slice.Del(op_args.db_cntx.db_index, it));
+  }
+
+  auto it_res = op_args.shard->db_slice().FindMutable(op_args.db_cntx, key, OBJ_JSON);
+  if (!it_res.ok()) {
+    return 0;
+  }
+
+  // Flat values are decoded and encoded again after the deletions
+  PrimeValue& pv = it_res->it->second;
+  optional<JsonType> decoded;
+  JsonType* json_val = GetJson(pv, &decoded);
+
+  long deletions = DeleteJsonItems(path, *expression, json_val);
+  if (decoded && deletions > 0)
+    SetFlatJson(*decoded, &pv);
+  return deletions;
+}
+
 // Returns a vector of string vectors,
 // keys within the same object are stored in the same string vector.
 OpResult<vector<StringVec>> OpObjKeys(const OpArgs& op_args, string_view key,
                                       JsonPathV2 expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -1035,7 +1282,8 @@ OpResult<vector<OptSizeT>> OpArrAppend(const OpArgs& op_args, string_view key, s
   vector<OptSizeT> vec;
   OpStatus status;
 
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -1070,7 +1318,8 @@ OpResult<vector<OptSizeT>> OpArrAppend(const OpArgs& op_args, string_view key, s
 // JSON scalar has types of string, boolean, null, and number.
 OpResult<vector<OptLong>> OpArrIndex(const OpArgs& op_args, string_view key, JsonPathV2 expression,
                                      const JsonType& search_val, int start_index, int end_index) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -1145,34 +1394,29 @@ vector<OptString> OpJsonMGet(const JsonPathV2& expression, const Transaction* t,
       continue;
 
     dest.emplace();
-    JsonType* json_val = it_res.value()->second.GetJson();
+    optional<JsonType> decoded;
+    JsonType* json_val = GetJson(it_res.value()->second, &decoded);
     DCHECK(json_val) << "should have a valid JSON object for key " << key;
 
-    vector<JsonType> query_result;
-    auto cb = [&query_result](const string_view& path, const JsonType& val) {
-      query_result.push_back(val);
+    // Matches are serialized right away instead of being copied into a result array.
+    string str;
+    auto cb = [&str](const string_view& path, const JsonType& val) {
+      str.push_back(str.empty() ? '[' : ',');
+      error_code ec;
+      val.dump(str, {}, ec);
+      if (ec) {
+        VLOG(1) << "Failed to dump JSON value to string with the error: " << ec.message();
+      }
     };
 
     const JsonType& json_entry = *(json_val);
     visit([&](auto&& arg) { Evaluate(arg, json_entry, cb); }, expression);
 
-    if (query_result.empty()) {
+    if (str.empty()) {
       continue;
     }
 
-    JsonType arr(json_array_arg);
-    arr.reserve(query_result.size());
-    for (auto& s : query_result) {
-      arr.push_back(s);
-    }
-
-    string str;
-    error_code ec;
-    arr.dump(str, {}, ec);
-    if (ec) {
-      VLOG(1) << "Failed to dump JSON array to string with the error: " << ec.message();
-    }
-
+    str.push_back(']');
     dest = std::move(str);
   }
 
@@ -1181,7 +1425,8 @@ vector<OptString> OpJsonMGet(const JsonPathV2& expression, const Transaction* t,
 
 // Returns numeric vector that represents the number of fields of JSON value at each path.
 OpResult<vector<OptSizeT>> OpFields(const OpArgs& op_args, string_view key, JsonPathV2 expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -1197,7 +1442,8 @@ OpResult<vector<OptSizeT>> OpFields(const OpArgs& op_args, string_view key, Json
 
 // Returns json vector that represents the result of the json query.
 OpResult<vector<JsonType>> OpResp(const OpArgs& op_args, string_view key, JsonPathV2 expression) {
-  OpResult<JsonType*> result = GetJson(op_args, key);
+  optional<JsonType> decoded;
+  OpResult<JsonType*> result = GetJson(op_args, key, &decoded);
   if (!result) {
     return result.status();
   }
@@ -1212,17 +1458,33 @@ OpResult<vector<JsonType>> OpResp(const OpArgs& op_args, string_view key, JsonPa
 // Returns boolean that represents the result of the operation.
 OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
                      std::string_view json_str, bool is_nx_condition, bool is_xx_condition) {
-  std::optional<JsonType> parsed_json = JsonFromString(json_str);
-  if (!parsed_json) {
-    VLOG(1) << "got invalid JSON string '" << json_str << "' cannot be saved";
-    return OpStatus::SYNTAX_ERR;
+  bool is_root = path == "." || path == "$";
+
+  // Flat values of whole keys are built right from the text, without parsing into JsonType first.
+  // Duplicate keys still go through JsonType, that resolves them.
+  std::optional<flexbuffers::Builder> fbb;
+  if (is_root && absl::GetFlag(FLAGS_experimental_flat_json)) {
+    fbb.emplace();
+    if (json::FlatFromString(json_str, &*fbb))
+      fbb->Finish();
+    else
+      fbb.reset();
+  }
+
+  std::optional<JsonType> parsed_json;
+  if (!fbb) {
+    parsed_json = JsonFromString(json_str);
+    if (!parsed_json) {
+      VLOG(1) << "got invalid JSON string '" << json_str << "' cannot be saved";
+      return OpStatus::SYNTAX_ERR;
+    }
   }
 
   // The whole key should be replaced.
   // NOTE: unlike in Redis, we are overriding the value when the path is "$"
   // this is regardless of the current key type. In redis if the key exists
   // and its not JSON, it would return an error.
-  if (path == "." || path == "$") {
+  if (is_root) {
     if (is_nx_condition || is_xx_condition) {
       auto it_res = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_JSON);
       bool key_exists = (it_res.status() != OpStatus::KEY_NOTFOUND);
@@ -1235,7 +1497,8 @@ OpResult<bool> OpSet(const OpArgs& op_args, string_view key, string_view path,
       }
     }
 
-    OpStatus st = SetJson(op_args, key, std::move(parsed_json.value()));
+    OpStatus st = fbb ? SetJson(op_args, key, *fbb)
+                      : SetJson(op_args, key, std::move(parsed_json.value()));
     if (st != OpStatus::OK) {
       return st;
     }
@@ -1358,8 +1621,11 @@ OpStatus OpMerge(const OpArgs& op_args, string_view key, std::string_view json_s
   if (it_res.ok()) {
     op_args.shard->search_indices()->RemoveDoc(key, op_args.db_cntx, it_res->it->second);
 
-    JsonType* obj = it_res->it->second.GetJson();
+    optional<JsonType> decoded;
+    JsonType* obj = GetJson(it_res->it->second, &decoded);
     RecursiveMerge(*parsed_json, obj);
+    if (decoded)
+      SetFlatJson(*decoded, &it_res->it->second);
     it_res->post_updater.Run();
     op_args.shard->search_indices()->AddDoc(key, op_args.db_cntx, it_res->it->second);
     return OpStatus::OK;
@@ -1374,7 +1640,53 @@ OpStatus OpMerge(const OpArgs& op_args, string_view key, std::string_view json_s
   return OpSet(op_args, key, "$", json_str, false, false).status();
 }
 
-io::Result<JsonPathV2, string> ParsePathV2(string_view path) {
+// LRU cache of parsed paths keyed by their text. Commands parse their paths on the connection
+// thread, so each thread has its own cache.
+class PathCache {
+ public:
+  explicit PathCache(size_t capacity) : capacity_(capacity) {
+  }
+
+  // Returns the cached path and marks it as the most recently used one.
+  const JsonPathV2* Find(string_view text) {
+    auto it = index_.find(text);
+    if (it == index_.end())
+      return nullptr;
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return &it->second->second;
+  }
+
+  void Insert(string_view text, const JsonPathV2& path) {
+    if (capacity_ == 0)
+      return;
+
+    if (auto it = index_.find(text); it != index_.end()) {
+      it->second->second = path;
+      return;
+    }
+
+    if (entries_.size() == capacity_) {
+      index_.erase(entries_.back().first);
+      entries_.pop_back();
+    }
+    entries_.emplace_front(text, path);
+    index_.emplace(entries_.front().first, entries_.begin());
+  }
+
+ private:
+  using Entries = list<pair<string, JsonPathV2>>;
+
+  size_t capacity_;
+  Entries entries_;
+  absl::flat_hash_map<string_view, Entries::iterator> index_;  // keys point into entries_
+};
+
+PathCache* GetPathCache() {
+  thread_local PathCache cache{absl::GetFlag(FLAGS_json_path_cache_size)};
+  return &cache;
+}
+
+io::Result<JsonPathV2, string> ParseUncachedPathV2(string_view path, bool v2) {
   // We expect all valid paths to start with the root selector, otherwise prepend it
   string tmp_buf;
   if (!path.empty() && path.front() != '$') {
@@ -1382,14 +1694,38 @@ io::Result<JsonPathV2, string> ParsePathV2(string_view path) {
     path = tmp_buf;
   }
 
-  if (absl::GetFlag(FLAGS_jsonpathv2)) {
+  if (v2) {
     return json::ParsePath(path);
   }
   io::Result<JsonExpression> expr_result = ParseJsonPath(path);
   if (!expr_result) {
     return nonstd::make_unexpected(kSyntaxErr);
   }
-  return JsonPathV2(std::move(expr_result.value()));
+  return JsonPathV2(make_shared<const JsonExpression>(std::move(expr_result.value())));
+}
+
+io::Result<JsonPathV2, string> ParsePathV2(string_view path) {
+  bool v2 = absl::GetFlag(FLAGS_jsonpathv2);
+  auto& stats = ServerState::tlocal()->stats;
+  PathCache* cache = GetPathCache();
+
+  // Entries of the other implementation are left over from a flag change and are re-parsed.
+  if (const JsonPathV2* cached = cache->Find(path);
+      cached && holds_alternative<json::Path>(*cached) == v2) {
+    stats.json_path_cache_hits++;
+    return *cached;
+  }
+
+  stats.json_path_cache_misses++;
+  auto result = ParseUncachedPathV2(path, v2);
+  if (!result)
+    return result;
+
+  // Aggregation functions accumulate their results in the path, so they can't be shared.
+  const json::Path* json_path = get_if<json::Path>(&*result);
+  if (!json_path || json_path->empty() || json_path->front().type() != json::SegmentType::FUNCTION)
+    cache->Insert(path, *result);
+  return result;
 }
 
 }  // namespace
@@ -8,6 +8,7 @@
 
 #include <jsoncons/json.hpp>
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -18,6 +19,8 @@ using namespace testing;
 using namespace std;
 using namespace util;
 
+ABSL_DECLARE_FLAG(bool, experimental_flat_json);
+
 namespace dfly {
 
 class JsonFamilyTest : public BaseFamilyTest {
@@ -1133,4 +1136,63 @@ TEST_F(JsonFamilyTest, Merge) {
   EXPECT_EQ(resp, R"([{"a":"z","c":{"d":"e"}}])");
 }
 
+TEST_F(JsonFamilyTest, PathCache) {
+  auto resp = Run({"JSON.SET", "j", "$", R"({"user":{"name":"a"}})"});
+  EXPECT_EQ(resp, "OK");
+
+  auto before = GetMetrics().coordinator_stats;
+  EXPECT_EQ(Run({"JSON.GET", "j", "$.user.name"}), R"(["a"])");
+  EXPECT_EQ(Run({"JSON.GET", "j", "$.user.name"}), R"(["a"])");
+  EXPECT_EQ(Run({"JSON.GET", "j", "user.name"}), R"(["a"])");
+  auto after = GetMetrics().coordinator_stats;
+  EXPECT_EQ(after.json_path_cache_misses - before.json_path_cache_misses, 2);
+  EXPECT_EQ(after.json_path_cache_hits - before.json_path_cache_hits, 1);
+
+  // Cached paths see the current value.
+  Run({"JSON.SET", "j", "$.user.name", R"("b")"});
+  EXPECT_EQ(Run({"JSON.GET", "j", "$.user.name"}), R"(["b"])");
+}
+
+TEST_F(JsonFamilyTest, FlatEncoding) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_experimental_flat_json, true);
+
+  auto resp = Run({"JSON.SET", "j", "$", R"({"a":1,"b":[true,2.5],"c":{"d":"e"}})"});
+  EXPECT_EQ(resp, "OK");
+
+  // In place mutations
+  Run({"JSON.TOGGLE", "j", "$.b[0]"});
+  Run({"JSON.NUMINCRBY", "j", "$.a", "2"});
+  Run({"JSON.NUMMULTBY", "j", "$.b[1]", "2"});
+  resp = Run({"JSON.GET", "j", "$"});
+  EXPECT_EQ(resp, R"([{"a":3,"b":[false,5.0],"c":{"d":"e"}}])");
+
+  // Structural mutations rebuild the value
+  Run({"JSON.ARRAPPEND", "j", "$.b", "3"});
+  Run({"JSON.DEL", "j", "$.c.d"});
+  Run({"JSON.SET", "j", "$.x", R"("y")"});
+  resp = Run({"JSON.GET", "j", "$"});
+  EXPECT_EQ(resp, R"([{"a":3,"b":[false,5.0,3],"c":{},"x":"y"}])");
+
+  // Integers that outgrow their width are not mutated in place
+  Run({"JSON.NUMINCRBY", "j", "$.a", "100000"});
+  resp = Run({"JSON.GET", "j", "$.a"});
+  EXPECT_EQ(resp, "[100003]");
+
+  resp = Run({"DEBUG", "RELOAD"});
+  EXPECT_EQ(resp, "OK");
+  resp = Run({"JSON.GET", "j", "$"});
+  EXPECT_EQ(resp, R"([{"a":100003,"b":[false,5.0,3],"c":{},"x":"y"}])");
+
+  // Values with duplicate keys are resolved like non flat ones
+  resp = Run({"JSON.SET", "dup", "$", R"({"k":1,"k":1})"});
+  EXPECT_EQ(resp, "OK");
+  resp = Run({"JSON.GET", "dup", "$"});
+  EXPECT_EQ(resp, R"([{"k":1}])");
+
+  resp = Run({"JSON.SET", "bad", "$", R"({"k":)"});
+  EXPECT_THAT(resp, ArgType(RespExpr::ERROR));
+  EXPECT_EQ(Run({"EXISTS", "bad"}), IntArg(0));
+}
+
 }  // namespace dfly
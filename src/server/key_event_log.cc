@@ -0,0 +1,25 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/key_event_log.h"
+
+namespace dfly {
+
+using namespace std;
+
+uint64_t KeyEventLog::Read(uint64_t* seq, size_t limit, vector<Event>* dest) const {
+  uint64_t first_seq = next_seq_ - events_.size();
+  uint64_t lost = 0;
+  if (*seq < first_seq) {
+    lost = first_seq - *seq;
+    *seq = first_seq;
+  }
+  *seq = min(*seq, next_seq_);  // A cursor from before a restart.
+
+  for (; *seq < next_seq_ && limit > 0; ++*seq, --limit)
+    dest->push_back(events_[*seq - first_seq]);
+  return lost;
+}
+
+}  // namespace dfly
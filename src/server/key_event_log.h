@@ -0,0 +1,50 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <boost/circular_buffer.hpp>
+#include <string>
+#include <vector>
+
+#include "server/tx_base.h"
+
+namespace dfly {
+
+// Bounded log of the keyspace events of a shard, read with KEYEVENTS as an alternative to
+// publishing every event on a pub/sub channel. Events are numbered by their sequence number and
+// readers poll with the number that follows the last event they have seen. When the log is full
+// the oldest events are overwritten, so a slow reader never slows down the shard; instead it
+// learns how many events it missed.
+class KeyEventLog {
+ public:
+  struct Event {
+    DbIndex db;
+    std::string key;
+  };
+
+  explicit KeyEventLog(size_t capacity) : events_(capacity) {
+  }
+
+  void Add(DbIndex db, std::string key) {
+    events_.push_back({db, std::move(key)});
+    next_seq_++;
+  }
+
+  // Appends to dest up to limit events starting from the sequence number seq, or from the
+  // oldest event that is still in the log, and advances seq past them. Returns the number of
+  // events that were overwritten before they could be read.
+  uint64_t Read(uint64_t* seq, size_t limit, std::vector<Event>* dest) const;
+
+  // Sequence number of the next event.
+  uint64_t next_seq() const {
+    return next_seq_;
+  }
+
+ private:
+  boost::circular_buffer<Event> events_;
+  uint64_t next_seq_ = 0;
+};
+
+}  // namespace dfly
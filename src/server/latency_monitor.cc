@@ -0,0 +1,56 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/latency_monitor.h"
+
+#include <absl/time/clock.h>
+
+#include "server/server_state.h"
+#include "util/fibers/proactor_base.h"
+
+namespace dfly {
+
+using namespace std;
+using util::ProactorBase;
+
+void LatencyMonitor::AddSpike(string_view event, uint64_t latency_usec) {
+  Event& ev = events_[event];
+  uint32_t latency_ms = latency_usec / 1000;
+  int64_t now = absl::ToUnixSeconds(absl::Now());
+
+  // Like Redis, spikes of the same event within a second are merged into a single sample.
+  if (!ev.samples.empty() && ev.samples.back().unix_sec == now)
+    ev.samples.back().latency_ms = max(ev.samples.back().latency_ms, latency_ms);
+  else
+    ev.samples.push_back({now, latency_ms});
+  ev.max_ms = max(ev.max_ms, latency_ms);
+}
+
+size_t LatencyMonitor::Reset(const vector<string_view>& events) {
+  if (events.empty()) {
+    size_t res = events_.size();
+    events_.clear();
+    return res;
+  }
+
+  size_t res = 0;
+  for (string_view event : events) {
+    if (auto it = events_.find(event); it != events_.end()) {
+      events_.erase(it);
+      res++;
+    }
+  }
+  return res;
+}
+
+LatencyScope::LatencyScope(string_view event)
+    : event_(event), start_ns_(ProactorBase::GetMonotonicTimeNs()) {
+}
+
+LatencyScope::~LatencyScope() {
+  uint64_t latency_usec = (ProactorBase::GetMonotonicTimeNs() - start_ns_) / 1000;
+  ServerState::tlocal()->GetLatencyMonitor().Add(event_, latency_usec);
+}
+
+}  // namespace dfly
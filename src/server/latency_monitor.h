@@ -0,0 +1,71 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <boost/circular_buffer.hpp>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace dfly {
+
+// Per thread record of latency spikes of commands and of background work, as reported by
+// LATENCY LATEST and LATENCY HISTORY. Only events that took at least the threshold are kept,
+// so recording is a single comparison unless there is a spike.
+class LatencyMonitor {
+ public:
+  static constexpr size_t kHistoryLen = 160;  // samples per event, as in Redis.
+
+  struct Sample {
+    int64_t unix_sec;
+    uint32_t latency_ms;
+  };
+
+  struct Event {
+    Event() : samples(kHistoryLen) {
+    }
+
+    boost::circular_buffer<Sample> samples;
+    uint32_t max_ms = 0;
+  };
+
+  // 0 disables the monitor.
+  void SetThreshold(uint32_t threshold_ms) {
+    threshold_usec_ = uint64_t(threshold_ms) * 1000;
+  }
+
+  void Add(std::string_view event, uint64_t latency_usec) {
+    if (threshold_usec_ > 0 && latency_usec >= threshold_usec_)
+      AddSpike(event, latency_usec);
+  }
+
+  // Resets the events, all of them if events is empty. Returns the number of events reset.
+  size_t Reset(const std::vector<std::string_view>& events);
+
+  const absl::flat_hash_map<std::string, Event>& events() const {
+    return events_;
+  }
+
+ private:
+  void AddSpike(std::string_view event, uint64_t latency_usec);
+
+  uint64_t threshold_usec_ = 0;
+  absl::flat_hash_map<std::string, Event> events_;
+};
+
+// Records the duration of the scope as event in the latency monitor of the thread.
+class LatencyScope {
+ public:
+  explicit LatencyScope(std::string_view event);
+  ~LatencyScope();
+
+ private:
+  std::string_view event_;
+  uint64_t start_ns_;
+};
+
+}  // namespace dfly
@@ -5,14 +5,11 @@
 
 #include "server/acl/acl_commands_def.h"
 
-extern "C" {
-#include "redis/sds.h"
-}
-
 #include <absl/strings/numbers.h>
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/chunked_list.h"
 #include "server/blocking_controller.h"
 #include "server/command_registry.h"
 #include "server/conn_context.h"
@@ -59,6 +56,10 @@ ABSL_FLAG(int32_t, list_max_listpack_size, -2, "Maximum listpack size, default i
 
 ABSL_FLAG(int32_t, list_compress_depth, 0, "Compress depth of the list. Default is no compression");
 
+ABSL_FLAG(bool, list_chunked_encoding, false,
+          "If true, new lists are stored in ring buffers of fixed size chunks that are faster "
+          "for queue-like access. A list switches to quicklist on its first LINSERT, LREM or LSET");
+
 namespace dfly {
 
 using namespace std;
@@ -68,17 +69,52 @@ using time_point = Transaction::time_point;
 
 namespace {
 
+// Lists are stored either as quicklists or, with --list_chunked_encoding, as ChunkedLists.
+// ChunkedList supports only the operations at the ends and reads, so the commands that modify
+// the middle of a list convert it to quicklist with GetMutableQL.
 quicklist* GetQL(const PrimeValue& mv) {
+  DCHECK_EQ(mv.Encoding(), OBJ_ENCODING_QUICKLIST);
   return (quicklist*)mv.RObjPtr();
 }
 
+ChunkedList* GetCL(const PrimeValue& mv) {
+  return mv.Encoding() == kEncodingChunkedList ? (ChunkedList*)mv.RObjPtr() : nullptr;
+}
+
+quicklist* CreateQL() {
+  quicklist* ql = quicklistCreate();
+  quicklistSetOptions(ql, GetFlag(FLAGS_list_max_listpack_size),
+                      GetFlag(FLAGS_list_compress_depth));
+  return ql;
+}
+
+void InitList(PrimeValue* pv) {
+  if (GetFlag(FLAGS_list_chunked_encoding))
+    pv->InitRobj(OBJ_LIST, kEncodingChunkedList, CompactObj::AllocateMR<ChunkedList>());
+  else
+    pv->InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, CreateQL());
+}
+
+quicklist* GetMutableQL(PrimeValue* pv) {
+  if (const ChunkedList* cl = GetCL(*pv); cl) {
+    quicklist* ql = CreateQL();
+    cl->ToQuicklist(ql);
+    pv->InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, ql);  // frees the chunked list
+  }
+  return GetQL(*pv);
+}
+
 void* listPopSaver(unsigned char* data, size_t sz) {
   return new string((char*)data, sz);
 }
 
 enum InsertParam { INSERT_BEFORE, INSERT_AFTER };
 
-string ListPop(ListDir dir, quicklist* ql) {
+string ListPop(ListDir dir, PrimeValue& pv) {
+  if (ChunkedList* cl = GetCL(pv); cl)
+    return dir == ListDir::LEFT ? cl->PopFront() : cl->PopBack();
+
+  quicklist* ql = GetQL(pv);
   long long vlong;
   string* pop_str = nullptr;
 
@@ -98,6 +134,19 @@ string ListPop(ListDir dir, quicklist* ql) {
   return res;
 }
 
+void ListPush(ListDir dir, string_view value, PrimeValue& pv) {
+  if (ChunkedList* cl = GetCL(pv); cl) {
+    if (dir == ListDir::LEFT)
+      cl->PushFront(value);
+    else
+      cl->PushBack(value);
+    return;
+  }
+
+  int pos = (dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
+  quicklistPush(GetQL(pv), const_cast<char*>(value.data()), value.size(), pos);
+}
+
 optional<ListDir> ParseDir(string_view arg) {
   if (arg == "LEFT") {
     return ListDir::LEFT;
@@ -199,14 +248,13 @@ std::string OpBPop(Transaction* t, EngineShard* shard, std::string_view key, Lis
   CHECK(it_res) << t->DebugId() << " " << key;  // must exist and must be ok.
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
 
   absl::StrAppend(debugMessages.Next(), "OpBPop: ", key, " by ", t->DebugId());
 
-  std::string value = ListPop(dir, ql);
+  std::string value = ListPop(dir, it->second);
   it_res->post_updater.Run();
 
-  if (quicklistCount(ql) == 0) {
+  if (it->second.Size() == 0) {
     DVLOG(1) << "deleting key " << key << " " << t->DebugId();
     absl::StrAppend(debugMessages.Next(), "OpBPop Del: ", key, " by ", t->DebugId());
 
@@ -229,18 +277,13 @@ OpResult<string> OpMoveSingleShard(const OpArgs& op_args, string_view src, strin
     return src_res.status();
 
   auto src_it = src_res->it;
-  quicklist* src_ql = GetQL(src_it->second);
 
   if (src == dest) {  // simple case.
-    string val = ListPop(src_dir, src_ql);
-
-    int pos = (dest_dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
-    quicklistPush(src_ql, val.data(), val.size(), pos);
-
+    string val = ListPop(src_dir, src_it->second);
+    ListPush(dest_dir, val, src_it->second);
     return val;
   }
 
-  quicklist* dest_ql = nullptr;
   src_res->post_updater.Run();
   auto op_res = db_slice.AddOrFind(op_args.db_cntx, dest);
   RETURN_ON_BAD_STATUS(op_res);
@@ -251,26 +294,20 @@ OpResult<string> OpMoveSingleShard(const OpArgs& op_args, string_view src, strin
   src_it = src_res->it;
 
   if (dest_res.is_new) {
-    dest_ql = quicklistCreate();
-    quicklistSetOptions(dest_ql, GetFlag(FLAGS_list_max_listpack_size),
-                        GetFlag(FLAGS_list_compress_depth));
-    dest_res.it->second.InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, dest_ql);
+    InitList(&dest_res.it->second);
     DCHECK(IsValid(src_it));
   } else {
     if (dest_res.it->second.ObjType() != OBJ_LIST)
       return OpStatus::WRONG_TYPE;
-
-    dest_ql = GetQL(dest_res.it->second);
   }
 
-  string val = ListPop(src_dir, src_ql);
-  int pos = (dest_dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
-  quicklistPush(dest_ql, val.data(), val.size(), pos);
+  string val = ListPop(src_dir, src_it->second);
+  ListPush(dest_dir, val, dest_res.it->second);
 
   src_res->post_updater.Run();
   dest_res.post_updater.Run();
 
-  if (quicklistCount(src_ql) == 0) {
+  if (src_it->second.Size() == 0) {
     CHECK(db_slice.Del(op_args.db_cntx.db_index, src_it));
   }
 
@@ -288,7 +325,11 @@ OpResult<string> Peek(const OpArgs& op_args, string_view key, ListDir dir, bool
   if (!fetch)
     return OpStatus::OK;
 
-  quicklist* ql = GetQL(it_res.value()->second);
+  const PrimeValue& pv = it_res.value()->second;
+  if (const ChunkedList* cl = GetCL(pv); cl)
+    return string{dir == ListDir::LEFT ? cl->Front() : cl->Back()};
+
+  quicklist* ql = GetQL(pv);
   quicklistEntry entry = container_utils::QLEntry();
   quicklistIter* iter = (dir == ListDir::LEFT) ? quicklistGetIterator(ql, AL_START_HEAD)
                                                : quicklistGetIterator(ql, AL_START_TAIL);
@@ -317,26 +358,17 @@ OpResult<uint32_t> OpPush(const OpArgs& op_args, std::string_view key, ListDir d
     res = std::move(*op_res);
   }
 
-  quicklist* ql = nullptr;
   DVLOG(1) << "OpPush " << key << " new_key " << res.is_new;
 
   if (res.is_new) {
-    ql = quicklistCreate();
-    quicklistSetOptions(ql, GetFlag(FLAGS_list_max_listpack_size),
-                        GetFlag(FLAGS_list_compress_depth));
-    res.it->second.InitRobj(OBJ_LIST, OBJ_ENCODING_QUICKLIST, ql);
+    InitList(&res.it->second);
   } else {
     if (res.it->second.ObjType() != OBJ_LIST)
       return OpStatus::WRONG_TYPE;
-    ql = GetQL(res.it->second);
   }
 
-  // Left push is LIST_HEAD.
-  int pos = (dir == ListDir::LEFT) ? QUICKLIST_HEAD : QUICKLIST_TAIL;
-
   for (string_view v : vals) {
-    es->tmp_str1 = sdscpylen(es->tmp_str1, v.data(), v.size());
-    quicklistPush(ql, es->tmp_str1, sdslen(es->tmp_str1), pos);
+    ListPush(dir, v, res.it->second);
   }
 
   if (res.is_new) {
@@ -358,7 +390,7 @@ OpResult<uint32_t> OpPush(const OpArgs& op_args, std::string_view key, ListDir d
     RecordJournal(op_args, command, mapped, 2);
   }
 
-  return quicklistCount(ql);
+  return res.it->second.Size();
 }
 
 OpResult<StringVec> OpPop(const OpArgs& op_args, string_view key, ListDir dir, uint32_t count,
@@ -369,27 +401,26 @@ OpResult<StringVec> OpPop(const OpArgs& op_args, string_view key, ListDir dir, u
     return it_res.status();
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
 
   StringVec res;
-  if (quicklistCount(ql) < count) {
-    count = quicklistCount(ql);
+  if (it->second.Size() < count) {
+    count = it->second.Size();
   }
   res.reserve(count);
 
   if (return_results) {
     for (unsigned i = 0; i < count; ++i) {
-      res.push_back(ListPop(dir, ql));
+      res.push_back(ListPop(dir, it->second));
     }
   } else {
     for (unsigned i = 0; i < count; ++i) {
-      ListPop(dir, ql);
+      ListPop(dir, it->second);
     }
   }
 
   it_res->post_updater.Run();
 
-  if (quicklistCount(ql) == 0) {
+  if (it->second.Size() == 0) {
     absl::StrAppend(debugMessages.Next(), "OpPop Del: ", key, " by ", op_args.tx->DebugId());
     CHECK(db_slice.Del(op_args.db_cntx.db_index, it));
   }
@@ -468,15 +499,22 @@ OpResult<uint32_t> OpLen(const OpArgs& op_args, std::string_view key) {
   if (!res)
     return res.status();
 
-  quicklist* ql = GetQL(res.value()->second);
-
-  return quicklistCount(ql);
+  return res.value()->second.Size();
 }
 
 OpResult<string> OpIndex(const OpArgs& op_args, std::string_view key, long index) {
   auto res = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_LIST);
   if (!res)
     return res.status();
+
+  if (const ChunkedList* cl = GetCL(res.value()->second); cl) {
+    if (index < 0)
+      index += cl->Size();
+    if (index < 0 || size_t(index) >= cl->Size())
+      return OpStatus::KEY_NOTFOUND;
+    return string{cl->At(index)};
+  }
+
   quicklist* ql = GetQL(res.value()->second);
   quicklistEntry entry = container_utils::QLEntry();
   quicklistIter* iter = quicklistGetIteratorAtIdx(ql, AL_START_TAIL, index);
@@ -508,13 +546,33 @@ OpResult<vector<uint32_t>> OpPos(const OpArgs& op_args, std::string_view key,
     direction = AL_START_TAIL;
   }
 
-  quicklist* ql = GetQL(it_res.value()->second);
-  quicklistIter* ql_iter = quicklistGetIterator(ql, direction);
-  quicklistEntry entry;
-
   int index = 0;
   int matched = 0;
   vector<uint32_t> matches;
+
+  if (const ChunkedList* cl = GetCL(it_res.value()->second); cl) {
+    auto cb = [&](string_view value) {
+      if (max_len && index >= max_len)
+        return false;
+      if (value == element && ++matched >= rank) {
+        matches.push_back(direction == AL_START_TAIL ? cl->Size() - index - 1 : index);
+        if (count && matched - rank + 1 >= count)
+          return false;
+      }
+      index++;
+      return true;
+    };
+
+    if (direction == AL_START_TAIL)
+      cl->ReverseIterate(cb);
+    else
+      cl->Iterate(0, cl->Size(), cb);
+    return matches;
+  }
+
+  quicklist* ql = GetQL(it_res.value()->second);
+  quicklistIter* ql_iter = quicklistGetIterator(ql, direction);
+  quicklistEntry entry;
   string str;
 
   while (quicklistNext(ql_iter, &entry) && (max_len == 0 || index < max_len)) {
@@ -546,7 +604,7 @@ OpResult<int> OpInsert(const OpArgs& op_args, string_view key, string_view pivot
   if (!it_res)
     return it_res.status();
 
-  quicklist* ql = GetQL(it_res->it->second);
+  quicklist* ql = GetMutableQL(&it_res->it->second);
   quicklistEntry entry = container_utils::QLEntry();
   quicklistIter* qiter = quicklistGetIterator(ql, AL_START_HEAD);
   bool found = false;
@@ -579,7 +637,7 @@ OpResult<uint32_t> OpRem(const OpArgs& op_args, string_view key, string_view ele
     return it_res.status();
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
+  quicklist* ql = GetMutableQL(&it->second);
 
   int iter_direction = AL_START_HEAD;
   long long index = 0;
@@ -621,7 +679,7 @@ OpStatus OpSet(const OpArgs& op_args, string_view key, string_view elem, long in
     return it_res.status();
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
+  quicklist* ql = GetMutableQL(&it->second);
 
   int replaced = quicklistReplaceAtIndex(ql, index, elem.data(), elem.size());
 
@@ -638,8 +696,7 @@ OpStatus OpTrim(const OpArgs& op_args, string_view key, long start, long end) {
     return it_res.status();
 
   auto it = it_res->it;
-  quicklist* ql = GetQL(it->second);
-  long llen = quicklistCount(ql);
+  long llen = it->second.Size();
 
   /* convert negative indexes */
   if (start < 0)
@@ -664,12 +721,21 @@ OpStatus OpTrim(const OpArgs& op_args, string_view key, long start, long end) {
     rtrim = llen - end - 1;
   }
 
-  quicklistDelRange(ql, 0, ltrim);
-  quicklistDelRange(ql, -rtrim, rtrim);
+  if (ChunkedList* cl = GetCL(it->second); cl) {
+    // Capped queues trim a few elements after every push, so popping them is cheap.
+    for (long i = 0; i < ltrim; ++i)
+      cl->PopFront();
+    for (long i = 0; i < rtrim; ++i)
+      cl->PopBack();
+  } else {
+    quicklist* ql = GetQL(it->second);
+    quicklistDelRange(ql, 0, ltrim);
+    quicklistDelRange(ql, -rtrim, rtrim);
+  }
 
   it_res->post_updater.Run();
 
-  if (quicklistCount(ql) == 0) {
+  if (it->second.Size() == 0) {
     CHECK(db_slice.Del(op_args.db_cntx.db_index, it));
   }
   return OpStatus::OK;
@@ -680,8 +746,7 @@ OpResult<StringVec> OpRange(const OpArgs& op_args, std::string_view key, long st
   if (!res)
     return res.status();
 
-  quicklist* ql = GetQL(res.value()->second);
-  long llen = quicklistCount(ql);
+  long llen = res.value()->second.Size();
 
   /* convert negative indexes */
   if (start < 0)
@@ -6,6 +6,7 @@
 
 #include <absl/strings/match.h>
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -384,6 +385,69 @@ TEST_F(ListFamilyTest, LRange) {
   ASSERT_THAT(resp.GetVec(), ElementsAre("1", "2"));
 }
 
+TEST_F(ListFamilyTest, PositionalAccessManyNodes) {
+  absl::FlagSaver saver;
+  SetTestFlag("list_max_listpack_size", "4");  // thousands of nodes, which are indexed.
+
+  vector<string> cmd = {"rpush", kKey1};
+  for (unsigned i = 0; i < 10000; ++i)
+    cmd.push_back(absl::StrCat(i));
+  Run(absl::MakeSpan(cmd));
+
+  // Repeated lookups build the index, changes drop it.
+  for (unsigned round = 0; round < 3; ++round) {
+    EXPECT_EQ(Run({"lindex", kKey1, "5001"}), absl::StrCat(5001 + round));
+    EXPECT_EQ(Run({"lindex", kKey1, "-2500"}), absl::StrCat(7500 + round));
+    auto resp = Run({"lrange", kKey1, "7000", "7002"});
+    EXPECT_THAT(resp.GetVec(), ElementsAre(absl::StrCat(7000 + round), absl::StrCat(7001 + round),
+                                           absl::StrCat(7002 + round)));
+    Run({"lpop", kKey1});
+  }
+
+  ASSERT_EQ(Run({"lset", kKey1, "4000", "foo"}), "OK");
+  EXPECT_EQ(Run({"lindex", kKey1, "4000"}), "foo");
+  EXPECT_EQ(Run({"lindex", kKey1, "4001"}), "4004");
+  Run({"lpush", kKey1, "bar"});
+  EXPECT_EQ(Run({"lindex", kKey1, "4001"}), "foo");
+}
+
+TEST_F(ListFamilyTest, ChunkedEncoding) {
+  absl::FlagSaver saver;
+  SetTestFlag("list_chunked_encoding", "true");
+
+  vector<string> cmd = {"rpush", kKey1};
+  for (unsigned i = 0; i < 2000; ++i)
+    cmd.push_back(i % 100 ? absl::StrCat(i) : string(2000, 'a' + i / 100));
+  EXPECT_THAT(Run(absl::MakeSpan(cmd)), IntArg(2000));
+
+  EXPECT_THAT(Run({"llen", kKey1}), IntArg(2000));
+  EXPECT_EQ(Run({"lindex", kKey1, "1501"}), "1501");
+  EXPECT_EQ(Run({"lindex", kKey1, "-1"}), "1999");
+  EXPECT_THAT(Run({"lindex", kKey1, "2000"}), ArgType(RespExpr::NIL));
+  EXPECT_THAT(Run({"lrange", kKey1, "1099", "1101"}).GetVec(),
+              ElementsAre("1099", string(2000, 'l'), "1101"));
+  EXPECT_THAT(Run({"lpos", kKey1, "7", "RANK", "-1"}), IntArg(7));
+
+  EXPECT_EQ(Run({"rpop", kKey1}), "1999");
+  EXPECT_EQ(Run({"lpop", kKey1}), string(2000, 'a'));
+  EXPECT_EQ(Run({"lmove", kKey1, kKey2, "RIGHT", "LEFT"}), "1998");
+  EXPECT_THAT(Run({"lpush", kKey2, "x"}), IntArg(2));
+  EXPECT_THAT(Run({"brpop", kKey2, "0"}).GetVec(), ElementsAre(kKey2, "1998"));
+
+  // Capped queues trim without leaving the encoding.
+  ASSERT_EQ(Run({"ltrim", kKey1, "0", "99"}), "OK");
+  EXPECT_THAT(Run({"llen", kKey1}), IntArg(100));
+  EXPECT_EQ(Run({"lindex", kKey1, "-1"}), "100");
+
+  // The list switches to quicklist on a change in the middle and survives a reload.
+  ASSERT_EQ(Run({"lset", kKey1, "1", "foo"}), "OK");
+  EXPECT_EQ(Run({"lindex", kKey1, "1"}), "foo");
+  Run({"rpush", kKey3, "a", "b"});
+  ASSERT_EQ(Run({"debug", "reload"}), "OK");
+  EXPECT_THAT(Run({"lrange", kKey1, "0", "2"}).GetVec(), ElementsAre("1", "foo", "3"));
+  EXPECT_THAT(Run({"lrange", kKey3, "0", "-1"}).GetVec(), ElementsAre("a", "b"));
+}
+
 TEST_F(ListFamilyTest, Lset) {
   Run({"rpush", kKey1, "0", "1", "2"});
   ASSERT_EQ(Run({"lset", kKey1, "0", "bar"}), "OK");
@@ -26,17 +26,21 @@ extern "C" {
 
 #include "base/flags.h"
 #include "base/logging.h"
+#include "core/cpu_profiler.h"
 #include "facade/dragonfly_connection.h"
 #include "facade/error.h"
 #include "facade/reply_builder.h"
 #include "facade/reply_capture.h"
+#include "facade/reply_offload.h"
 #include "server/acl/acl_commands_def.h"
 #include "server/acl/acl_family.h"
 #include "server/acl/user_registry.h"
 #include "server/acl/validator.h"
 #include "server/bitops_family.h"
 #include "server/bloom_family.h"
+#include "server/cms_family.h"
 #include "server/cluster/cluster_family.h"
+#include "server/cluster/cluster_proxy.h"
 #include "server/cluster/cluster_utility.h"
 #include "server/conn_context.h"
 #include "server/error.h"
@@ -47,13 +51,18 @@ extern "C" {
 #include "server/json_family.h"
 #include "server/list_family.h"
 #include "server/multi_command_squasher.h"
+#include "server/numa.h"
 #include "server/script_mgr.h"
 #include "server/search/search_family.h"
 #include "server/server_state.h"
 #include "server/set_family.h"
+#include "server/snapshot.h"
 #include "server/stream_family.h"
 #include "server/string_family.h"
+#include "server/tdigest_family.h"
+#include "server/topk_family.h"
 #include "server/transaction.h"
+#include "server/ts_family.h"
 #include "server/version.h"
 #include "server/zset_family.h"
 #include "strings/human_readable.h"
@@ -97,6 +106,15 @@ ABSL_FLAG(double, oom_deny_ratio, 1.1,
           "commands with flag denyoom will return OOM when the ratio between maxmemory and used "
           "memory is above this value");
 
+ABSL_FLAG(bool, serve_reads_during_load, false,
+          "If true, read commands are served from the data loaded so far while a snapshot is "
+          "loaded, so keys that were not loaded yet are reported as missing. Writes are still "
+          "rejected until the load finishes.");
+
+ABSL_FLAG(bool, numa_pin_threads, false,
+          "If true, threads are pinned to the cpus node by node, so that consecutive shards share "
+          "a NUMA node, and their memory is allocated on the node of their cpu.");
+
 namespace dfly {
 
 #if defined(__linux__)
@@ -133,6 +151,9 @@ std::optional<VarzFunction> engine_varz;
 
 constexpr size_t kMaxThreadSize = 1024;
 
+// Consecutive commands on a shard of another NUMA node after which a connection is migrated.
+constexpr uint32_t kNumaMigrationCmds = 64;
+
 // Unwatch all keys for a connection and unregister from DbSlices.
 // Used by UNWATCH, DICARD and EXEC.
 void UnwatchAllKeys(ConnectionState::ExecInfo* exec_info) {
@@ -275,6 +296,7 @@ class InterpreterReplier : public RedisReplyBuilder {
   void SendNullArray() final;
 
   void SendStringArr(StrSpan arr, CollectionType type) final;
+  void SendBulkStrArr(unsigned len, BulkStrChunks chunks, CollectionType type) final;
   void SendNull() final;
 
   void SendLong(long val) final;
@@ -426,6 +448,13 @@ void InterpreterReplier::SendStringArr(StrSpan arr, CollectionType) {
   PostItem();
 }
 
+void InterpreterReplier::SendBulkStrArr(unsigned len, BulkStrChunks chunks, CollectionType) {
+  explr_->OnArrayStart(len);
+  ForEachBulkString(chunks, [this](string_view str) { explr_->OnString(str); });
+  explr_->OnArrayEnd();
+  PostItem();
+}
+
 void InterpreterReplier::SendNull() {
   explr_->OnNil();
   PostItem();
@@ -574,6 +603,65 @@ void TxTable(const http::QueryArgs& args, HttpContext* send) {
   send->Invoke(std::move(resp));
 }
 
+// Samples all the threads for the given number of seconds and replies with a CPU profile
+// in pprof format: curl host:port/profilez?seconds=10 > cpu.prof; pprof dragonfly cpu.prof
+void Profilez(const http::QueryArgs& args, HttpContext* send) {
+  static atomic_bool running = false;
+
+  uint32_t seconds = 10, hz = 100;
+  for (const auto& [name, value] : args) {
+    if (name == "seconds" && absl::SimpleAtoi(value, &seconds))
+      seconds = clamp(seconds, 1u, 300u);
+    else if (name == "hz" && absl::SimpleAtoi(value, &hz))
+      hz = clamp(hz, 1u, 1000u);
+  }
+
+  if (!shard_set || running.exchange(true)) {
+    http::StringResponse resp = http::MakeStringResponse(h2::status::conflict);
+    resp.body() = "CPU profiler is already running\n";
+    send->Invoke(std::move(resp));
+    return;
+  }
+
+  ProactorPool* pool = shard_set->pool();
+  atomic_bool started = true;
+  pool->AwaitBrief([&](unsigned, ProactorBase*) {
+    if (!CpuProfiler::Get().Start(hz))
+      started = false;
+  });
+
+  if (started)
+    ThisFiber::SleepFor(chrono::seconds(seconds));
+
+  vector<CpuProfiler::Samples> samples(pool->size());
+  atomic_uint64_t dropped = 0;
+  pool->AwaitBrief([&](unsigned index, ProactorBase*) {
+    CpuProfiler& profiler = CpuProfiler::Get();
+    profiler.Stop();
+    profiler.MergeSamples(&samples[index]);
+    dropped.fetch_add(profiler.dropped(), memory_order_relaxed);
+  });
+  running = false;
+
+  if (!started) {
+    http::StringResponse resp = http::MakeStringResponse(h2::status::internal_server_error);
+    resp.body() = "Could not start the CPU profiler\n";
+    send->Invoke(std::move(resp));
+    return;
+  }
+
+  for (size_t i = 1; i < samples.size(); ++i) {
+    for (auto& [stack, count] : samples[i])
+      samples[0][stack] += count;
+  }
+  LOG_IF(WARNING, dropped > 0) << "CPU profiler dropped " << dropped << " samples";
+
+  http::StringResponse resp = http::MakeStringResponse(h2::status::ok);
+  resp.set(h2::field::content_type, "application/octet-stream");
+  resp.body() = CpuProfiler::FormatProfile(samples[0], hz);
+  send->Invoke(std::move(resp));
+}
+
 void ClusterHtmlPage(const http::QueryArgs& args, HttpContext* send,
                      cluster::ClusterFamily* cluster_family) {
   http::StringResponse resp = http::MakeStringResponse(h2::status::ok);
@@ -854,6 +942,8 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
   config_registry.RegisterMutable("enable_heartbeat_eviction");
   config_registry.RegisterMutable("dbfilename");
   config_registry.RegisterMutable("table_growth_margin");
+  config_registry.RegisterMutable("table_presplit_fill");
+  config_registry.RegisterMutable("snapshot_cow_buffer_limit");
 
   uint32_t shard_num = GetFlag(FLAGS_num_shards);
   if (shard_num == 0 || shard_num > pp_.size()) {
@@ -863,6 +953,25 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
     shard_num = pp_.size();
   }
 
+  // Threads are bound before anything is allocated, so that the heaps of the shards are local.
+  vector<unsigned> numa_cpus;
+  if (GetFlag(FLAGS_numa_pin_threads)) {
+    const NumaTopology& numa = NumaTopology::Get();
+    numa_cpus = numa.AllowedCpusByNode();
+    LOG_IF(WARNING, numa_cpus.empty()) << "No allowed cpus found, threads are not pinned";
+  }
+  if (!numa_cpus.empty()) {
+    const NumaTopology& numa = NumaTopology::Get();
+    LOG(INFO) << "Pinning " << pp_.size() << " threads to " << numa_cpus.size() << " cpus of "
+              << numa.num_nodes() << " numa nodes";
+    numa_pinned_ = true;
+    pp_.AwaitBrief([&](uint32_t index, ProactorBase* pb) {
+      unsigned cpu = numa_cpus[index % numa_cpus.size()];
+      LOG_IF(WARNING, !BindThreadToNumaNode(cpu, numa.NodeOfCpu(cpu)))
+          << "Could not bind thread " << index << " to cpu " << cpu;
+    });
+  }
+
   // Must initialize before the shard_set because EngineShard::Init references ServerState.
   pp_.AwaitBrief([&](uint32_t index, ProactorBase* pb) {
     tl_facade_stats = new FacadeStats;
@@ -879,6 +988,7 @@ void Service::Init(util::AcceptServer* acceptor, std::vector<facade::Listener*>
 
   StringFamily::Init(&pp_);
   GenericFamily::Init(&pp_);
+  facade::ReplyOffload::Init(&pp_);
   server_family_.Init(acceptor, std::move(listeners));
 
   ChannelStore* cs = new ChannelStore{};
@@ -902,6 +1012,7 @@ void Service::Shutdown() {
   server_family_.Shutdown();
   StringFamily::Shutdown();
   GenericFamily::Shutdown();
+  facade::ReplyOffload::Shutdown(&pp_);
 
   engine_varz.reset();
 
@@ -921,16 +1032,26 @@ optional<ErrorReply> Service::CheckKeysOwnership(const CommandId* cid, CmdArgLis
     return nullopt;
   }
 
-  if (cid->first_key_pos() == 0) {
-    return nullopt;  // No key command.
+  if (cluster::MultiKeyProxy::IsSupported(cid, dfly_cntx)) {
+    // Keys of other slots are forwarded by the proxy.
+    return nullopt;
   }
 
-  OpResult<KeyIndex> key_index_res = DetermineKeys(cid, args);
-  if (!key_index_res) {
-    return ErrorReply{key_index_res.status()};
+  KeyIndex key_index;
+  if (cid->name() == "SPUBLISH" || cid->name() == "SSUBSCRIBE" || cid->name() == "SUNSUBSCRIBE") {
+    // Sharded pub/sub commands are keyless, but their channels are hashed to slots like keys.
+    size_t num_channels = cid->name() == "SPUBLISH" ? 1 : args.size();
+    key_index = KeyIndex::Range(0, num_channels);
+  } else if (cid->first_key_pos() == 0) {
+    return nullopt;  // No key command.
+  } else {
+    OpResult<KeyIndex> key_index_res = DetermineKeys(cid, args);
+    if (!key_index_res) {
+      return ErrorReply{key_index_res.status()};
+    }
+    key_index = *key_index_res;
   }
 
-  const auto& key_index = *key_index_res;
   optional<cluster::SlotId> keys_slot;
   bool cross_slot = false;
   // Iterate keys and check to which slot they belong.
@@ -1058,7 +1179,8 @@ std::optional<ErrorReply> Service::VerifyCommandState(const CommandId* cid, CmdA
   const GlobalState gstate = etl.gstate();
   switch (gstate) {
     case GlobalState::LOADING:
-      allowed_by_state = dfly_cntx.journal_emulated || (cid->opt_mask() & CO::LOADING);
+      allowed_by_state = dfly_cntx.journal_emulated || (cid->opt_mask() & CO::LOADING) ||
+                         (cid->IsReadOnly() && GetFlag(FLAGS_serve_reads_during_load));
       break;
     case GlobalState::SHUTTING_DOWN:
       allowed_by_state = false;
@@ -1142,31 +1264,48 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
   ServerState& etl = *ServerState::tlocal();
 
   ToUpper(&args[0]);
-  const auto [cid, args_no_cmd] = FindCmd(args);
+  ConnectionContext* dfly_cntx = static_cast<ConnectionContext*>(cntx);
+  const auto [cid, args_no_cmd] = FindCmdCached(args, dfly_cntx);
 
   if (cid == nullptr) {
     return cntx->SendError(ReportUnknownCmd(ArgS(args, 0)));
   }
 
-  ConnectionContext* dfly_cntx = static_cast<ConnectionContext*>(cntx);
   bool under_script = bool(dfly_cntx->conn_state.script_info);
   bool under_exec = dfly_cntx->conn_state.exec_info.IsRunning();
   bool dispatching_in_multi = under_script || under_exec;
 
+  // Sampled commands record the time of the stages they pass through, see DEBUG TRACE.
+  optional<CommandTrace> trace;
+  uint64_t trace_unix_ns = 0;
+  if (!dispatching_in_multi && cntx->conn() && etl.GetTraceLog().ShouldSample()) {
+    trace.emplace();
+    trace->Record(CommandTrace::QUEUED, cntx->dispatch_ts);
+    trace->Record(CommandTrace::DISPATCHED, ProactorBase::GetMonotonicTimeNs());
+    trace_unix_ns = absl::GetCurrentTimeNanos();
+  }
+
   if (VLOG_IS_ON(2) && cntx->conn() /* no owner in replica context */) {
     LOG(INFO) << "Got (" << cntx->conn()->GetClientId() << "): " << (under_script ? "LUA " : "")
               << args << " in dbid=" << dfly_cntx->conn_state.db_index;
   }
 
+  if (!dispatching_in_multi)
+    ThrottleUser(args, dfly_cntx);
+
   // Don't interrupt running multi commands or admin connections.
   if (!dispatching_in_multi && (!cntx->conn() || !cntx->conn()->IsPrivileged())) {
     bool is_write = cid->IsWriteOnly();
-    is_write |= cid->name() == "PUBLISH" || cid->name() == "EVAL" || cid->name() == "EVALSHA";
+    is_write |= cid->name() == "PUBLISH" || cid->name() == "SPUBLISH" || cid->name() == "EVAL" ||
+                cid->name() == "EVALSHA";
     is_write |= cid->name() == "EXEC" && dfly_cntx->conn_state.exec_info.is_write;
 
     cntx->paused = true;
     etl.AwaitPauseState(is_write);
     cntx->paused = false;
+
+    if (is_write)
+      AwaitCowBackpressure(cid, args_no_cmd, dfly_cntx);
   }
 
   if (auto err = VerifyCommandState(cid, args_no_cmd, *dfly_cntx); err) {
@@ -1200,6 +1339,14 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
     return cntx->SendSimpleString("QUEUED");
   }
 
+  if (cluster::IsClusterEnabled() && cluster::MultiKeyProxy::IsSupported(cid, *dfly_cntx)) {
+    const cluster::ClusterConfig* cluster_config = cluster_family_.cluster_config();
+    if (cluster_config == nullptr)
+      return cntx->SendError(kClusterNotConfigured);
+    if (cluster::MultiKeyProxy::Dispatch(*cluster_config, cid, args_no_cmd, dfly_cntx, this))
+      return;
+  }
+
   // Create command transaction
   intrusive_ptr<Transaction> dist_trans;
 
@@ -1234,11 +1381,33 @@ void Service::DispatchCommand(CmdArgList args, facade::ConnectionContext* cntx)
 
   dfly_cntx->cid = cid;
 
+  if (trace && dist_trans)
+    dist_trans->SetTrace(&*trace);
+
   if (!InvokeCmd(cid, args_no_cmd, dfly_cntx)) {
     dfly_cntx->SendError("Internal Error");
     dfly_cntx->reply_builder()->CloseConnection();
   }
 
+  // A connection that keeps accessing a shard of another NUMA node moves to the thread of the
+  // shard, if the threads are pinned to their nodes.
+  if (numa_pinned_ && dist_trans && !dist_trans->IsGlobal() &&
+      dist_trans->GetUniqueShardCnt() == 1 && cntx->conn()) {
+    ShardId sid = dist_trans->GetUniqueShard();
+    if (shard_set->numa_node(sid) == etl.numa_node()) {
+      dfly_cntx->numa_remote_cmds = 0;
+    } else if (++dfly_cntx->numa_remote_cmds == kNumaMigrationCmds) {
+      cntx->conn()->RequestAsyncMigration(shard_set->pool()->at(sid));
+    }
+  }
+
+  if (trace) {
+    trace->Record(CommandTrace::REPLIED, ProactorBase::GetMonotonicTimeNs());
+    if (dist_trans)
+      dist_trans->SetTrace(nullptr);
+    etl.GetTraceLog().Add(cid->name(), cntx->conn()->GetClientId(), trace_unix_ns, *trace);
+  }
+
   if (!dispatching_in_multi) {
     dfly_cntx->transaction = nullptr;
   }
@@ -1354,6 +1523,11 @@ bool Service::InvokeCmd(const CommandId* cid, CmdArgList tail_args, ConnectionCo
     cntx->conn_state.tracking_info_.IncrementSequenceNumber();
   }
 
+  if (!(cid->opt_mask() & CO::BLOCKING)) {
+    ServerState::SafeTLocal()->GetLatencyMonitor().Add(
+        (cid->opt_mask() & CO::FAST) ? "fast-command" : "command", invoke_time_usec);
+  }
+
   // TODO: we should probably discard more commands here,
   // not just the blocking ones
   const auto* conn = cntx->conn();
@@ -1434,7 +1608,13 @@ size_t Service::DispatchManyCommands(absl::Span<CmdArgList> args_list,
 
     const bool is_blocking = cid != nullptr && cid->IsBlocking();
 
-    if (!is_multi && !is_eval && !is_blocking && cid != nullptr) {
+    // Commands that might be split by slots are not checked for key ownership when squashed.
+    const bool is_proxied = cid != nullptr && cluster::IsClusterEnabled() &&
+                            cluster::MultiKeyProxy::IsSupported(cid, *dfly_cntx);
+
+    if (!is_multi && !is_eval && !is_blocking && !is_proxied && cid != nullptr) {
+      // Commands dispatched below are throttled by DispatchCommand.
+      ThrottleUser(args, dfly_cntx);
       stored_cmds.reserve(args_list.size());
       stored_cmds.emplace_back(cid, tail_args);
       continue;
@@ -1501,6 +1681,7 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
       strcpy(cmd_name, "PREPEND");
       break;
     case MemcacheParser::GET:
+    case MemcacheParser::GETS:
       strcpy(cmd_name, "MGET");
       break;
     case MemcacheParser::FLUSHALL:
@@ -1515,6 +1696,9 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
     case MemcacheParser::VERSION:
       mc_builder->SendSimpleString("VERSION 1.5.0 DF");
       return;
+    case MemcacheParser::NOOP:
+      mc_builder->SendSimpleString("MN");
+      return;
     default:
       mc_builder->SendClientError("bad command line format");
       return;
@@ -1548,16 +1732,27 @@ void Service::DispatchMC(const MemcacheParser::Command& cmd, std::string_view va
       char* key = const_cast<char*>(s.data());
       args.emplace_back(key, s.size());
     }
+    if (cmd.type == MemcacheParser::GETS) {
+      dfly_cntx->conn_state.memcache_flag = ConnectionState::FETCH_CAS_VER;
+    } else if (cmd.meta) {
+      const auto& mf = cmd.meta_flags;
+      dfly_cntx->conn_state.memcache_flag = (mf.return_cas ? ConnectionState::FETCH_CAS_VER : 0) |
+                                            (mf.return_ttl ? ConnectionState::FETCH_TTL : 0);
+    }
   } else {  // write commands.
     if (store_opt[0]) {
       args.emplace_back(store_opt, strlen(store_opt));
     }
   }
 
+  if (cmd.meta)
+    mc_builder->SetMetaCmd(&cmd);
+
   DispatchCommand(CmdArgList{args}, cntx);
 
   // Reset back.
   dfly_cntx->conn_state.memcache_flag = 0;
+  mc_builder->SetMetaCmd(nullptr);
 }
 
 ErrorReply Service::ReportUnknownCmd(string_view cmd_name) {
@@ -1653,21 +1848,19 @@ void Service::Watch(CmdArgList args, ConnectionContext* cntx) {
     return cntx->SendOk();
   }
 
-  atomic_uint32_t keys_existed = 0;
+  // Shards fill the versions of their keys by the key positions.
+  size_t first = exec_info.watched_keys.size();
+  exec_info.watched_versions.resize(first + args.size());
   auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardArgs largs = t->GetShardArgs(shard->shard_id());
-    for (auto k : largs) {
-      shard->db_slice().RegisterWatchedKey(cntx->db_index(), k, &exec_info);
+    for (auto it = largs.begin(); it != largs.end(); ++it) {
+      exec_info.watched_versions[first + it.index()] =
+          shard->db_slice().WatchKey(t->GetDbContext(), *it, &exec_info);
     }
-
-    auto res = GenericFamily::OpExists(t->GetOpArgs(shard), largs);
-    keys_existed.fetch_add(res.value_or(0), memory_order_relaxed);
     return OpStatus::OK;
   };
   cntx->transaction->ScheduleSingleHop(std::move(cb));
 
-  // Duplicate keys are stored to keep correct count.
-  exec_info.watched_existed += keys_existed.load(memory_order_relaxed);
   for (std::string_view key : ArgS(args)) {
     exec_info.watched_keys.emplace_back(cntx->db_index(), key);
   }
@@ -1696,6 +1889,8 @@ optional<CapturingReplyBuilder::Payload> Service::FlushEvalAsyncCmds(ConnectionC
     return nullopt;
 
   ++ServerState::tlocal()->stats.eval_squashed_flushes;
+  info->num_squashed++;
+  info->num_hops++;
 
   auto* eval_cid = registry_.Find("EVAL");
   DCHECK(eval_cid);
@@ -1713,9 +1908,83 @@ optional<CapturingReplyBuilder::Payload> Service::FlushEvalAsyncCmds(ConnectionC
   return CapturingReplyBuilder::GetError(reply) ? make_optional(std::move(reply)) : nullopt;
 }
 
+void Service::CallBatchFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca) {
+  auto* orig = cntx->reply_builder();
+  absl::Cleanup clean = [orig, cntx] { cntx->Inject(orig); };
+
+  // Previously queued acalls must run first. Their errors abort the script.
+  if (auto err = FlushEvalAsyncCmds(cntx, true); err) {
+    InterpreterReplier replier(ca.translator);
+    CapturingReplyBuilder::Apply(std::move(*err), &replier);
+    *ca.requested_abort = true;
+    return;
+  }
+
+  vector<CmdArgList> cmds;
+  size_t pos = 0;
+  for (unsigned len : ca.batch_lens) {
+    cmds.push_back(ca.args.subspan(pos, len));
+    ToUpper(&cmds.back()[0]);
+    pos += len;
+  }
+
+  auto& info = cntx->conn_state.script_info;
+  info->num_commands += cmds.size();
+
+  // Replies are pushed in order, one top level lua value per command.
+  if (!ca.async) {
+    info->num_hops += cmds.size();
+    for (CmdArgList cmd : cmds) {
+      InterpreterReplier replier(ca.translator);
+      cntx->Inject(&replier);
+      DispatchCommand(cmd, cntx);
+    }
+    return;
+  }
+
+  vector<StoredCmd> stored;
+  vector<optional<ErrorReply>> find_errors(cmds.size());
+  for (size_t i = 0; i < cmds.size(); ++i) {
+    if (auto* cid = registry_.Find(ArgS(cmds[i], 0)); cid != nullptr)
+      stored.emplace_back(cid, cmds[i].subspan(1));
+    else
+      find_errors[i] = ReportUnknownCmd(ArgS(cmds[i], 0));
+  }
+
+  CapturingReplyBuilder::Payload replies;
+  if (!stored.empty()) {
+    ++ServerState::tlocal()->stats.eval_squashed_flushes;
+    info->num_squashed++;
+    info->num_hops++;
+    cntx->transaction->MultiSwitchCmd(registry_.Find("EVAL"));
+
+    CapturingReplyBuilder crb;
+    cntx->Inject(&crb);
+    crb.StartArray(stored.size());
+    MultiCommandSquasher::Execute(absl::MakeSpan(stored), cntx, this, true, false);
+    replies = crb.Take();
+  }
+
+  auto* collection = get_if<unique_ptr<CapturingReplyBuilder::CollectionPayload>>(&replies);
+  DCHECK(stored.empty() || (collection && (*collection)->arr.size() == stored.size()));
+
+  size_t reply_idx = 0;
+  for (auto& find_err : find_errors) {
+    InterpreterReplier replier(ca.translator);
+    if (find_err)
+      replier.RedisReplyBuilder::SendError(std::move(*find_err));
+    else
+      CapturingReplyBuilder::Apply(std::move((*collection)->arr[reply_idx++]), &replier);
+  }
+}
+
 void Service::CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca) {
   DCHECK(cntx->transaction);
+  if (!ca.batch_lens.empty())
+    return CallBatchFromScript(cntx, ca);
+
   DVLOG(2) << "CallFromScript " << ArgS(ca.args, 0);
+  cntx->conn_state.script_info->num_commands++;
 
   InterpreterReplier replier(ca.translator);
   facade::SinkReplyBuilder* orig = cntx->Inject(&replier);
@@ -1751,6 +2020,7 @@ void Service::CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& ca)
   if (ca.async)
     return;
 
+  cntx->conn_state.script_info->num_hops++;
   DispatchCommand(ca.args, cntx);
 }
 
@@ -1807,7 +2077,15 @@ optional<ScriptMgr::ScriptParams> LoadScript(string_view sha, ScriptMgr* script_
       return std::nullopt;
 
     string err;
-    Interpreter::AddResult add_res = interpreter->AddFunction(sha, script_data->body, &err);
+    Interpreter::AddResult add_res = Interpreter::COMPILE_ERR;
+    if (script_data->bytecode) {
+      add_res = interpreter->AddCompiledFunction(sha, *script_data->bytecode, &err);
+      LOG_IF(WARNING, add_res != Interpreter::ADD_OK)
+          << "Failed to load compiled " << sha << ", err " << err;
+    }
+    if (add_res != Interpreter::ADD_OK)
+      add_res = interpreter->AddFunction(sha, script_data->body, &err);
+
     if (add_res != Interpreter::ADD_OK) {
       LOG(ERROR) << "Error adding " << sha << " to database, err " << err;
       return std::nullopt;
@@ -1898,6 +2176,40 @@ std::pair<const CommandId*, CmdArgList> Service::FindCmd(CmdArgList args) const
   return {res, args.subspan(1)};
 }
 
+void Service::ThrottleUser(CmdArgList args, ConnectionContext* cntx) {
+  // Admin connections and internal contexts are not limited.
+  if (user_rate_limiter_.empty() || !cntx->conn() || cntx->conn()->IsPrivileged())
+    return;
+
+  size_t bytes = 0;
+  for (auto arg : args)
+    bytes += arg.size();
+
+  uint64_t delay_ns = user_rate_limiter_.Acquire(cntx->authed_username, bytes,
+                                                 ProactorBase::GetMonotonicTimeNs());
+  if (delay_ns > 0) {
+    ServerState::tlocal()->RecordUserThrottle(cntx->authed_username, delay_ns / 1000);
+    ThisFiber::SleepFor(chrono::nanoseconds(delay_ns));
+  }
+}
+
+std::pair<const CommandId*, CmdArgList> Service::FindCmdCached(CmdArgList args,
+                                                               ConnectionContext* cntx) const {
+  auto& cached = cntx->last_resolved;
+  if (cached.cid && cached.name == facade::ToSV(args[0]))
+    return {cached.cid, args.subspan(1)};
+
+  auto res = FindCmd(args);
+
+  // Commands resolved by their arguments, like ACL subcommands and XGROUP HELP, are not cached.
+  if (res.first && res.second.data() == args.data() + 1 && res.first->name() != "XGROUP" &&
+      res.first->name() != "_XGROUP_HELP") {
+    cached.name = facade::ToSV(args[0]);
+    cached.cid = res.first;
+  }
+  return res;
+}
+
 static bool CanRunSingleShardMulti(optional<ShardId> sid, const ScriptMgr::ScriptParams& params,
                                    const Transaction& tx) {
   if (!sid.has_value()) {
@@ -1966,8 +2278,10 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
   interpreter->SetGlobalArray("KEYS", eval_args.keys);
   interpreter->SetGlobalArray("ARGV", eval_args.args);
 
-  absl::Cleanup clean = [interpreter, &sinfo]() {
+  absl::Cleanup clean = [interpreter, &sinfo, sha = eval_args.sha]() {
     interpreter->ResetStack();
+    ServerState::tlocal()->RecordScriptCounters(sha, sinfo->num_commands, sinfo->num_hops,
+                                                sinfo->num_squashed);
     sinfo.reset();
   };
 
@@ -1994,6 +2308,7 @@ void Service::EvalInternal(CmdArgList args, const EvalArgs& eval_args, Interpret
       cntx->transaction = tx;
       return OpStatus::OK;
     });
+    sinfo->num_hops = 1;  // all calls ran locally on the shard
 
     if (*sid != ServerState::tlocal()->thread_index()) {
       VLOG(1) << "Migrating connection " << cntx->conn() << " from "
@@ -2051,8 +2366,8 @@ void Service::Discard(CmdArgList args, ConnectionContext* cntx) {
   rb->SendOk();
 }
 
-// Return true if non of the connections watched keys expired.
-bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandRegistry& registry) {
+// Return true if none of the connection's watched keys changed, expired or were deleted.
+bool CheckWatchedKeys(ConnectionContext* cntx, const CommandRegistry& registry) {
   static char EXISTS[] = "EXISTS";
   auto& exec_info = cntx->conn_state.exec_info;
 
@@ -2062,12 +2377,16 @@ bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandRegistry& regis
     str_list[i] = MutableSlice{s.data(), s.size()};
   }
 
-  atomic_uint32_t watch_exist_count{0};
-  auto cb = [&watch_exist_count](Transaction* t, EngineShard* shard) {
+  atomic_bool changed{false};
+  auto cb = [&](Transaction* t, EngineShard* shard) {
     ShardArgs args = t->GetShardArgs(shard->shard_id());
-    auto res = GenericFamily::OpExists(t->GetOpArgs(shard), args);
-    watch_exist_count.fetch_add(res.value_or(0), memory_order_relaxed);
-
+    for (auto it = args.begin(); it != args.end(); ++it) {
+      uint64_t version = exec_info.watched_versions[it.index()];
+      if (!shard->db_slice().IsWatchedKeyUnchanged(t->GetDbContext(), *it, version)) {
+        changed.store(true, memory_order_relaxed);
+        break;
+      }
+    }
     return OpStatus::OK;
   };
 
@@ -2076,9 +2395,8 @@ bool CheckWatchedKeyExpiry(ConnectionContext* cntx, const CommandRegistry& regis
   OpStatus status = cntx->transaction->ScheduleSingleHop(std::move(cb));
   CHECK_EQ(OpStatus::OK, status);
 
-  // The comparison can still be true even if a key expired due to another one being created.
-  // So we have to check the watched_dirty flag, which is set if a key expired.
-  return watch_exist_count.load() == exec_info.watched_existed &&
+  // Keys that did not exist at WATCH dirty the flag when they are created.
+  return !changed.load(memory_order_relaxed) &&
          !exec_info.watched_dirty.load(memory_order_relaxed);
 }
 
@@ -2190,8 +2508,8 @@ void Service::Exec(CmdArgList args, ConnectionContext* cntx) {
     scheduled = true;
   }
 
-  // EXEC should not run if any of the watched keys expired.
-  if (!exec_info.watched_keys.empty() && !CheckWatchedKeyExpiry(cntx, registry_)) {
+  // EXEC should not run if any of the watched keys changed or expired.
+  if (!exec_info.watched_keys.empty() && !CheckWatchedKeys(cntx, registry_)) {
     cntx->transaction->UnlockMulti();
     return rb->SendNull();
   }
@@ -2270,6 +2588,26 @@ void Service::Unsubscribe(CmdArgList args, ConnectionContext* cntx) {
   }
 }
 
+void Service::SPublish(CmdArgList args, ConnectionContext* cntx) {
+  string_view channel = ArgS(args, 0);
+  string_view messages[] = {ArgS(args, 1)};
+
+  auto* cs = ServerState::tlocal()->channel_store();
+  cntx->SendLong(cs->SendMessages(channel, messages, true /* sharded */));
+}
+
+void Service::SSubscribe(CmdArgList args, ConnectionContext* cntx) {
+  cntx->ChangeSSubscription(true, true, args);
+}
+
+void Service::SUnsubscribe(CmdArgList args, ConnectionContext* cntx) {
+  if (args.size() == 0) {
+    cntx->SUnsubscribeAll(true);
+  } else {
+    cntx->ChangeSSubscription(false, true, args);
+  }
+}
+
 void Service::PSubscribe(CmdArgList args, ConnectionContext* cntx) {
   cntx->ChangePSubscription(true, true, args);
 }
@@ -2296,9 +2634,9 @@ void Service::Function(CmdArgList args, ConnectionContext* cntx) {
   return cntx->SendError(err, kSyntaxErrType);
 }
 
-void Service::PubsubChannels(string_view pattern, ConnectionContext* cntx) {
+void Service::PubsubChannels(string_view pattern, bool sharded, ConnectionContext* cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->SendStringArr(ServerState::tlocal()->channel_store()->ListChannels(pattern));
+  rb->SendStringArr(ServerState::tlocal()->channel_store()->ListChannels(pattern, sharded));
 }
 
 void Service::PubsubPatterns(ConnectionContext* cntx) {
@@ -2307,13 +2645,14 @@ void Service::PubsubPatterns(ConnectionContext* cntx) {
   cntx->SendLong(pattern_count);
 }
 
-void Service::PubsubNumSub(CmdArgList args, ConnectionContext* cntx) {
+void Service::PubsubNumSub(CmdArgList args, bool sharded, ConnectionContext* cntx) {
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(args.size() * 2);
 
+  auto* cs = ServerState::tlocal()->channel_store();
   for (string_view channel : ArgS(args)) {
     rb->SendBulkString(channel);
-    rb->SendLong(ServerState::tlocal()->channel_store()->FetchSubscribers(channel).size());
+    rb->SendLong(cs->FetchSubscribers(channel, sharded).size());
   }
 }
 
@@ -2344,6 +2683,10 @@ void Service::Pubsub(CmdArgList args, ConnectionContext* cntx) {
         "NUMSUB [<channel> <channel...>]",
         "\tReturns the number of subscribers for the specified channels, excluding",
         "\tpattern subscriptions.",
+        "SHARDCHANNELS [<pattern>]",
+        "\tReturn the currently active shard level channels matching a <pattern> (default: '*').",
+        "SHARDNUMSUB [<shardchannel> <shardchannel...>]",
+        "\tReturns the number of subscribers for the specified shard level channel(s).",
         "HELP",
         "\tPrints this help."};
 
@@ -2352,18 +2695,19 @@ void Service::Pubsub(CmdArgList args, ConnectionContext* cntx) {
     return;
   }
 
-  if (subcmd == "CHANNELS") {
+  if (subcmd == "CHANNELS" || subcmd == "SHARDCHANNELS") {
     string_view pattern;
     if (args.size() > 1) {
       pattern = ArgS(args, 1);
     }
 
-    PubsubChannels(pattern, cntx);
+    PubsubChannels(pattern, subcmd == "SHARDCHANNELS", cntx);
   } else if (subcmd == "NUMPAT") {
     PubsubPatterns(cntx);
-  } else if (subcmd == "NUMSUB") {
+  } else if (subcmd == "NUMSUB" || subcmd == "SHARDNUMSUB") {
+    bool sharded = subcmd == "SHARDNUMSUB";
     args.remove_prefix(1);
-    PubsubNumSub(args, cntx);
+    PubsubNumSub(args, sharded, cntx);
   } else {
     cntx->SendError(UnknownSubCmd(subcmd, "PUBSUB"));
   }
@@ -2507,6 +2851,7 @@ void Service::ConfigureHttpHandlers(util::HttpListenerBase* base, bool is_privil
   server_family_.ConfigureMetrics(base);
   base->RegisterCb("/txz", TxTable);
   base->RegisterCb("/topkeys", Topkeys);
+  base->RegisterCb("/profilez", Profilez);
   base->RegisterCb("/clusterz", [this](const http::QueryArgs& args, HttpContext* send) {
     return ClusterHtmlPage(args, send, &cluster_family_);
   });
@@ -2516,6 +2861,14 @@ void Service::ConfigureHttpHandlers(util::HttpListenerBase* base, bool is_privil
                      [this](const http::QueryArgs& args, HttpRequest&& req, HttpContext* send) {
                        HttpAPI(args, std::move(req), this, send);
                      });
+    base->RegisterCb("/v1/key",
+                     [this](const http::QueryArgs& args, HttpRequest&& req, HttpContext* send) {
+                       HttpKeyAPI(args, std::move(req), this, send);
+                     });
+    base->RegisterCb("/v1/mget",
+                     [this](const http::QueryArgs& args, HttpRequest&& req, HttpContext* send) {
+                       HttpMGetAPI(args, std::move(req), this, send);
+                     });
   }
 }
 
@@ -2528,11 +2881,15 @@ void Service::OnClose(facade::ConnectionContext* cntx) {
       server_cntx->UnsubscribeAll(false);
     }
 
-    if (conn_state.subscribe_info) {
-      DCHECK(!conn_state.subscribe_info->patterns.empty());
+    if (conn_state.subscribe_info && !conn_state.subscribe_info->patterns.empty()) {
       server_cntx->PUnsubscribeAll(false);
     }
 
+    if (conn_state.subscribe_info) {
+      DCHECK(!conn_state.subscribe_info->shard_channels.empty());
+      server_cntx->SUnsubscribeAll(false);
+    }
+
     DCHECK(!conn_state.subscribe_info);
   }
 
@@ -2543,6 +2900,7 @@ void Service::OnClose(facade::ConnectionContext* cntx) {
   server_family_.OnClose(server_cntx);
 
   conn_state.tracking_info_.SetClientTracking(false);
+  server_cntx->SetTrackingPrefixes({});
 }
 
 Service::ContextInfo Service::GetContextInfo(facade::ConnectionContext* cntx) const {
@@ -2574,6 +2932,9 @@ constexpr uint32_t kSubscribe = PUBSUB | SLOW;
 constexpr uint32_t kUnsubscribe = PUBSUB | SLOW;
 constexpr uint32_t kPSubscribe = PUBSUB | SLOW;
 constexpr uint32_t kPUnsubsribe = PUBSUB | SLOW;
+constexpr uint32_t kSPublish = PUBSUB | FAST;
+constexpr uint32_t kSSubscribe = PUBSUB | SLOW;
+constexpr uint32_t kSUnsubscribe = PUBSUB | SLOW;
 constexpr uint32_t kFunction = SLOW;
 constexpr uint32_t kMonitor = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kPubSub = SLOW;
@@ -2603,6 +2964,10 @@ void Service::Register(CommandRegistry* registry) {
       << CI{"PSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -2, 0, 0, acl::kPSubscribe}.MFUNC(PSubscribe)
       << CI{"PUNSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -1, 0, 0, acl::kPUnsubsribe}.MFUNC(
              PUnsubscribe)
+      << CI{"SPUBLISH", CO::LOADING | CO::FAST, 3, 0, 0, acl::kSPublish}.MFUNC(SPublish)
+      << CI{"SSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -2, 0, 0, acl::kSSubscribe}.MFUNC(SSubscribe)
+      << CI{"SUNSUBSCRIBE", CO::NOSCRIPT | CO::LOADING, -1, 0, 0, acl::kSUnsubscribe}.MFUNC(
+             SUnsubscribe)
       << CI{"FUNCTION", CO::NOSCRIPT, 2, 0, 0, acl::kFunction}.MFUNC(Function)
       << CI{"MONITOR", CO::ADMIN, 1, 0, 0, acl::kMonitor}.MFUNC(Monitor)
       << CI{"PUBSUB", CO::LOADING | CO::FAST, -1, 0, 0, acl::kPubSub}.MFUNC(Pubsub)
@@ -2623,6 +2988,10 @@ void Service::RegisterCommands() {
   HllFamily::Register(&registry_);
   SearchFamily::Register(&registry_);
   BloomFamily::Register(&registry_);
+  CmsFamily::Register(&registry_);
+  TopKFamily::Register(&registry_);
+  TDigestFamily::Register(&registry_);
+  TsFamily::Register(&registry_);
   server_family_.Register(&registry_);
   cluster_family_.Register(&registry_);
 
@@ -2659,6 +3028,42 @@ void Service::TestInit() {
   acl_family_.Init(nullptr, &user_registry_);
 }
 
+void AwaitCowBackpressure(const CommandId* cid, CmdArgList tail_args, ConnectionContext* cntx) {
+  if (!SliceSnapshot::IsCowOverloaded())
+    return;
+
+  // Global commands and scripts may write to any shard.
+  if ((cid->opt_mask() & CO::GLOBAL_TRANS) || CO::IsEvalKind(cid->name()))
+    return SliceSnapshot::AwaitCowBackpressure([](ShardId) { return true; });
+
+  vector<bool> touched(shard_set->size());
+  auto add_keys = [&](const CommandId* cmd_id, CmdArgList args) {
+    if (!cmd_id->IsTransactional() || !cmd_id->IsWriteOnly())
+      return;
+    auto keys = DetermineKeys(cmd_id, args);
+    if (!keys.ok())
+      return;
+    for (unsigned i = keys->start; i < keys->end; i += keys->step)
+      touched[Shard(ArgS(args, i), touched.size())] = true;
+    if (keys->bonus)
+      touched[Shard(ArgS(args, *keys->bonus), touched.size())] = true;
+  };
+
+  if (cid->name() == "EXEC") {
+    CmdArgVec arg_vec;
+    for (auto& scmd : cntx->conn_state.exec_info.body) {
+      if (CO::IsEvalKind(scmd.Cid()->name()) || (scmd.Cid()->opt_mask() & CO::GLOBAL_TRANS))
+        return SliceSnapshot::AwaitCowBackpressure([](ShardId) { return true; });
+      scmd.Fill(&arg_vec);
+      add_keys(scmd.Cid(), absl::MakeSpan(arg_vec));
+    }
+  } else {
+    add_keys(cid, tail_args);
+  }
+
+  SliceSnapshot::AwaitCowBackpressure([&](ShardId sid) { return touched[sid]; });
+}
+
 void SetMaxMemoryFlag(uint64_t value) {
   absl::SetFlag(&FLAGS_maxmemory, {value});
 }
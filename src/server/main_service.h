@@ -17,6 +17,7 @@
 #include "server/config_registry.h"
 #include "server/engine_shard_set.h"
 #include "server/server_family.h"
+#include "server/user_rate_limiter.h"
 
 namespace util {
 class AcceptServer;
@@ -75,6 +76,10 @@ class Service : public facade::ServiceInterface {
   std::pair<const CommandId*, CmdArgList> FindCmd(CmdArgList args) const;
   const CommandId* FindCmd(std::string_view) const;
 
+  // Same as FindCmd(args), but reuses the last command resolved for the connection.
+  std::pair<const CommandId*, CmdArgList> FindCmdCached(CmdArgList args,
+                                                        ConnectionContext* cntx) const;
+
   CommandRegistry* mutable_registry() {
     return &registry_;
   }
@@ -143,14 +148,17 @@ class Service : public facade::ServiceInterface {
   void Unsubscribe(CmdArgList args, ConnectionContext* cntx);
   void PSubscribe(CmdArgList args, ConnectionContext* cntx);
   void PUnsubscribe(CmdArgList args, ConnectionContext* cntx);
+  void SPublish(CmdArgList args, ConnectionContext* cntx);
+  void SSubscribe(CmdArgList args, ConnectionContext* cntx);
+  void SUnsubscribe(CmdArgList args, ConnectionContext* cntx);
   void Function(CmdArgList args, ConnectionContext* cntx);
   void Monitor(CmdArgList args, ConnectionContext* cntx);
   void Pubsub(CmdArgList args, ConnectionContext* cntx);
   void Command(CmdArgList args, ConnectionContext* cntx);
 
-  void PubsubChannels(std::string_view pattern, ConnectionContext* cntx);
+  void PubsubChannels(std::string_view pattern, bool sharded, ConnectionContext* cntx);
   void PubsubPatterns(ConnectionContext* cntx);
-  void PubsubNumSub(CmdArgList channels, ConnectionContext* cntx);
+  void PubsubNumSub(CmdArgList channels, bool sharded, ConnectionContext* cntx);
 
   struct EvalArgs {
     std::string_view sha;  // only one of them is defined.
@@ -172,9 +180,15 @@ class Service : public facade::ServiceInterface {
 
   void CallFromScript(ConnectionContext* cntx, Interpreter::CallArgs& args);
 
+  // Runs the commands of redis.pcall_batch, squashed when args.async is set.
+  void CallBatchFromScript(ConnectionContext* cntx, Interpreter::CallArgs& args);
+
   void RegisterCommands();
   void Register(CommandRegistry* registry);
 
+  // Delays the command if the user of the connection is over its rate limits.
+  void ThrottleUser(CmdArgList args, ConnectionContext* cntx);
+
   base::VarzValue::Map GetVarzStats();
 
   util::ProactorPool& pp_;
@@ -184,10 +198,15 @@ class Service : public facade::ServiceInterface {
   ServerFamily server_family_;
   cluster::ClusterFamily cluster_family_;
   CommandRegistry registry_;
+  UserRateLimiter user_rate_limiter_;
   absl::flat_hash_map<std::string, unsigned> unknown_cmds_;
 
   const CommandId* exec_cid_;  // command id of EXEC command for pipeline squashing
 
+  // Whether the threads are pinned to NUMA nodes, connections migrate to the nodes of their
+  // shards only then.
+  bool numa_pinned_ = false;
+
   mutable util::fb2::Mutex mu_;
   GlobalState global_state_ ABSL_GUARDED_BY(mu_) = GlobalState::ACTIVE;
   uint32_t loading_state_counter_ ABSL_GUARDED_BY(mu_) = 0;
@@ -196,4 +215,8 @@ class Service : public facade::ServiceInterface {
 uint64_t GetMaxMemoryFlag();
 void SetMaxMemoryFlag(uint64_t value);
 
+// Delays a write command while the buffer of a snapshot of a shard it writes to is over
+// --snapshot_cow_buffer_limit, see SliceSnapshot::AwaitCowBackpressure.
+void AwaitCowBackpressure(const CommandId* cid, CmdArgList tail_args, ConnectionContext* cntx);
+
 }  // namespace dfly
@@ -12,6 +12,11 @@
 
 #include <mimalloc.h>
 
+extern "C" {
+#include "redis/stream.h"
+#include "redis/zmalloc.h"
+}
+
 #include "base/logging.h"
 #include "core/allocation_tracker.h"
 #include "facade/cmd_arg_parser.h"
@@ -21,6 +26,7 @@
 #include "io/io_buf.h"
 #include "server/engine_shard_set.h"
 #include "server/main_service.h"
+#include "server/search/doc_index.h"
 #include "server/server_family.h"
 #include "server/server_state.h"
 #include "server/snapshot.h"
@@ -81,8 +87,60 @@ std::string MallocStatsCb(bool backing, unsigned tid) {
   return str;
 }
 
-size_t MemoryUsage(PrimeIterator it) {
-  return it->first.MallocUsed() + it->second.MallocUsed();
+// Same estimate as Redis uses for the radix trees of streams.
+size_t RaxMemoryUsage(const rax* tree) {
+  return tree->numele * sizeof(streamID) + tree->numnodes * (sizeof(raxNode) + sizeof(long) * 30);
+}
+
+// Number of stream nodes, consumer groups and consumers that MEMORY USAGE inspects by default,
+// like in Redis.
+constexpr size_t kDefaultUsageSamples = 5;
+
+// Iterates the radix tree from its start and calls cb for up to samples elements, or for all of
+// them if samples is 0. Returns the sum of cb results scaled up to all the elements.
+template <typename F> size_t SampleRax(rax* tree, size_t samples, F cb) {
+  size_t total = raxSize(tree), visited = 0, sum = 0;
+  raxIterator ri;
+  raxStart(&ri, tree);
+  raxSeek(&ri, "^", NULL, 0);
+  while ((samples == 0 || visited < samples) && raxNext(&ri)) {
+    sum += cb(ri.data);
+    visited++;
+  }
+  raxStop(&ri);
+  return visited == 0 ? 0 : sum * total / visited;
+}
+
+// Streams are not tracked by MallocUsed(), so they are walked here. This includes the pending
+// entries of the consumer groups, which can dominate the stream memory. Walking all of them takes
+// time linear in the stream size, so the listpacks, the groups and their consumers are sampled
+// and their average size is multiplied by their number.
+size_t StreamMemoryUsage(const stream* s, size_t samples) {
+  size_t res = sizeof(*s) + RaxMemoryUsage(s->rax_tree);
+  res += SampleRax(s->rax_tree, samples, [](void* lp) { return zmalloc_size(lp); });
+  if (!s->cgroups)
+    return res;
+
+  res += SampleRax(s->cgroups, samples, [samples](void* data) {
+    streamCG* cg = static_cast<streamCG*>(data);
+    size_t cg_size = sizeof(*cg) + RaxMemoryUsage(cg->pel) + raxSize(cg->pel) * sizeof(streamNACK);
+
+    // NACKs are shared with the group PEL, so only the consumer index is added.
+    cg_size += SampleRax(cg->consumers, samples, [](void* data) {
+      streamConsumer* consumer = static_cast<streamConsumer*>(data);
+      return sizeof(*consumer) + sdslen(consumer->name) + RaxMemoryUsage(consumer->pel);
+    });
+    return cg_size;
+  });
+  return res;
+}
+
+size_t MemoryUsage(PrimeIterator it, size_t samples) {
+  size_t res = it->first.MallocUsed() + it->second.MallocUsed();
+  if (it->second.ObjType() == OBJ_STREAM) {
+    res += StreamMemoryUsage(static_cast<const stream*>(it->second.RObjPtr()), samples);
+  }
+  return res;
 }
 
 }  // namespace
@@ -103,8 +161,12 @@ void MemoryCmd::Run(CmdArgList args) {
         "ARENA [BACKING] [thread-id]",
         "    Show mimalloc arena stats for a heap residing in specified thread-id. 0 by default.",
         "    If BACKING is specified, show stats for the backing heap.",
-        "USAGE <key>",
-        "    Show memory usage of a key.",
+        "USAGE <key> [SAMPLES <count>]",
+        "    Show memory usage of a key. Streams are estimated from <count> of their nodes,",
+        "    consumer groups and consumers, 5 by default. 0 inspects all of them.",
+        "PROFILE [TOP <n>] [PREFIX-DEPTH <depth>]",
+        "    Show the estimated memory of the key prefixes with the most memory in the current",
+        "    database and their types. Requires --memory_profile_sample_rate.",
         "DECOMMIT",
         "    Force decommit the memory freed by the server back to OS.",
         "TRACK",
@@ -125,6 +187,11 @@ void MemoryCmd::Run(CmdArgList args) {
         "    ADDRESS <address>",
         "        Returns whether <address> is known to be allocated internally by any of the "
         "backing heaps",
+        "    SAMPLE <bytes>",
+        "        Samples an allocation once every <bytes> allocated bytes on average and records",
+        "        its stack, 0 stops sampling and drops the samples",
+        "    DUMP",
+        "        Returns the samples as a heap profile for pprof",
     };
     auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
     return rb->SendSimpleStrArr(help_arr);
@@ -136,7 +203,22 @@ void MemoryCmd::Run(CmdArgList args) {
 
   if (sub_cmd == "USAGE" && args.size() > 1) {
     string_view key = ArgS(args, 1);
-    return Usage(key);
+    size_t samples = kDefaultUsageSamples;
+    CmdArgParser parser{args.subspan(2)};
+    if (parser.HasNext()) {
+      parser.ExpectTag("SAMPLES");
+      samples = parser.Next<size_t>();
+    }
+    if (auto err = parser.Error(); err)
+      return cntx_->SendError(err->MakeReply());
+    if (parser.HasNext())
+      return cntx_->SendError(kSyntaxErr);
+    return Usage(key, samples);
+  }
+
+  if (sub_cmd == "PROFILE") {
+    args.remove_prefix(1);
+    return Profile(args);
   }
 
   if (sub_cmd == "DECOMMIT") {
@@ -251,6 +333,9 @@ void MemoryCmd::Stats() {
   stats.push_back({"data_bytes", used_mem_current.load(memory_order_relaxed)});
   stats.push_back({"data_peak_bytes", used_mem_peak.load(memory_order_relaxed)});
 
+  // Lua interpreters, also included in data_bytes on shard threads
+  stats.push_back({"lua_bytes", server_metrics.lua_stats.used_bytes});
+
   ConnectionMemoryUsage connection_memory = GetConnectionMemoryUsage(owner_);
 
   // Connection stats, excluding replication connections
@@ -282,6 +367,20 @@ void MemoryCmd::Stats() {
   stats.push_back({"serialization", serialization_memory.load()});
   stats.push_back({"tls", tls_memory.load()});
 
+  // Search indices
+  vector<search::IndexMemoryStats> search_memory(shard_set->size());
+  shard_set->RunBriefInParallel([&](EngineShard* es) {
+    search_memory[es->shard_id()] = es->search_indices()->GetMemoryStats();
+  });
+  search::IndexMemoryStats search_total;
+  for (const auto& shard_stats : search_memory)
+    search_total += shard_stats;
+  stats.push_back({"search.used_bytes", server_metrics.search_stats.used_memory});
+  stats.push_back({"search.postings_bytes", search_total.postings_bytes});
+  stats.push_back({"search.dictionary_bytes", search_total.dictionary_bytes});
+  stats.push_back({"search.vector_bytes", search_total.vector_bytes});
+  stats.push_back({"search.sort_bytes", search_total.sort_bytes});
+
   auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
   rb->StartCollection(stats.size(), RedisReplyBuilder::MAP);
   for (const auto& [k, v] : stats) {
@@ -351,14 +450,14 @@ void MemoryCmd::ArenaStats(CmdArgList args) {
   return rb->SendVerbatimString(mi_malloc_info);
 }
 
-void MemoryCmd::Usage(std::string_view key) {
+void MemoryCmd::Usage(std::string_view key, size_t samples) {
   ShardId sid = Shard(key, shard_set->size());
-  ssize_t memory_usage = shard_set->pool()->at(sid)->AwaitBrief([key, this]() -> ssize_t {
+  ssize_t memory_usage = shard_set->pool()->at(sid)->AwaitBrief([key, samples, this]() -> ssize_t {
     auto& db_slice = EngineShard::tlocal()->db_slice();
     auto [pt, exp_t] = db_slice.GetTables(cntx_->db_index());
     PrimeIterator it = pt->Find(key);
     if (IsValid(it)) {
-      return MemoryUsage(it);
+      return MemoryUsage(it, samples);
     } else {
       return -1;
     }
@@ -370,6 +469,57 @@ void MemoryCmd::Usage(std::string_view key) {
   rb->SendLong(memory_usage);
 }
 
+void MemoryCmd::Profile(CmdArgList args) {
+  size_t top = 10;
+  unsigned depth = 1;
+  CmdArgParser parser{args};
+  while (parser.HasNext()) {
+    if (parser.Check("TOP").IgnoreCase().ExpectTail(1)) {
+      top = parser.Next<size_t>();
+    } else if (parser.Check("PREFIX-DEPTH").IgnoreCase().ExpectTail(1)) {
+      depth = parser.Next<unsigned>();
+    } else if (!parser.HasError()) {
+      return cntx_->SendError(kSyntaxErr);
+    }
+  }
+  if (auto err = parser.Error(); err)
+    return cntx_->SendError(err->MakeReply());
+  if (depth == 0 || depth > MemoryProfile::kMaxDepth)
+    return cntx_->SendError(
+        absl::StrCat("PREFIX-DEPTH must be between 1 and ", MemoryProfile::kMaxDepth));
+
+  vector<absl::flat_hash_map<MemoryProfile::Key, int64_t>> shard_aggs(shard_set->size());
+  atomic_bool enabled = false;
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    const auto& db_slice = shard->db_slice();
+    if (!db_slice.IsDbValid(cntx_->db_index()))
+      return;
+    if (const auto& profile = db_slice.GetDBTable(cntx_->db_index())->memory_profile; profile) {
+      enabled.store(true, memory_order_relaxed);
+      profile->Aggregate(depth, &shard_aggs[shard->shard_id()]);
+    }
+  });
+
+  if (!enabled.load(memory_order_relaxed))
+    return cntx_->SendError("MEMORY PROFILE requires --memory_profile_sample_rate");
+
+  absl::flat_hash_map<MemoryProfile::Key, int64_t> agg;
+  for (auto& shard_agg : shard_aggs) {
+    for (auto& [key, bytes] : shard_agg)
+      agg[key] += bytes;
+  }
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  auto entries = MemoryProfile::Top(agg, top);
+  rb->StartArray(entries.size());
+  for (const auto& [key, bytes] : entries) {
+    rb->StartArray(3);
+    rb->SendBulkString(key.first);
+    rb->SendBulkString(CompactObj::ObjTypeToString(key.second));
+    rb->SendLong(bytes);
+  }
+}
+
 void MemoryCmd::Track(CmdArgList args) {
 #ifndef DFLY_ENABLE_MEMORY_TRACKING
   return cntx_->SendError("MEMORY TRACK must be enabled at build time.");
@@ -440,6 +590,39 @@ void MemoryCmd::Track(CmdArgList args) {
     return;
   }
 
+  if (sub_cmd == "SAMPLE") {
+    size_t sample_rate = parser.Next<size_t>();
+    if (parser.HasError()) {
+      return cntx_->SendError(parser.Error()->MakeReply());
+    }
+
+    shard_set->pool()->AwaitBrief(
+        [&](unsigned index, auto*) { AllocationTracker::Get().SetSampleRate(sample_rate); });
+    return cntx_->SendOk();
+  }
+
+  if (sub_cmd == "DUMP") {
+    vector<AllocationTracker::Samples> samples(shard_set->pool()->size());
+    atomic<size_t> sample_rate{0};
+    shard_set->pool()->AwaitBrief([&](unsigned index, auto*) {
+      AllocationTracker::Get().MergeSamples(&samples[index]);
+      sample_rate.store(AllocationTracker::Get().sample_rate(), memory_order_relaxed);
+    });
+
+    if (sample_rate.load(memory_order_relaxed) == 0) {
+      return cntx_->SendError("Sampling is not enabled, see MEMORY TRACK SAMPLE");
+    }
+
+    AllocationTracker::Samples merged;
+    for (const auto& thread_samples : samples) {
+      for (const auto& [stack, stats] : thread_samples)
+        merged[stack] += stats;
+    }
+
+    auto* rb = static_cast<facade::RedisReplyBuilder*>(cntx_->reply_builder());
+    return rb->SendBulkString(AllocationTracker::FormatHeapProfile(merged, sample_rate.load()));
+  }
+
   if (sub_cmd == "ADDRESS") {
     string_view ptr_str = parser.Next();
     if (parser.HasError()) {
@@ -20,8 +20,9 @@ class MemoryCmd {
   void Stats();
   void MallocStats();
   void ArenaStats(CmdArgList args);
-  void Usage(std::string_view key);
+  void Usage(std::string_view key, size_t samples);
   void Track(CmdArgList args);
+  void Profile(CmdArgList args);
 
   ConnectionContext* cntx_;
   ServerFamily* owner_;
@@ -12,6 +12,7 @@
 #include "server/command_registry.h"
 #include "server/conn_context.h"
 #include "server/engine_shard_set.h"
+#include "server/snapshot.h"
 #include "server/transaction.h"
 
 namespace dfly {
@@ -93,14 +94,15 @@ MultiCommandSquasher::SquashResult MultiCommandSquasher::TrySquash(StoredCmd* cm
 
   // Check if all commands belong to one shard
   bool found_more = false;
+  bool conflicts = false;
   cluster::UniqueSlotChecker slot_checker;
   ShardId last_sid = kInvalidSid;
-  IterateKeys(args, *keys, [&last_sid, &found_more, &slot_checker](MutableSlice key) {
+  IterateKeys(args, *keys, [&](MutableSlice key) {
+    string_view key_sv = facade::ToSV(key);
+    conflicts |= deferred_keys_.contains(key_sv);
     if (found_more)
       return;
 
-    string_view key_sv = facade::ToSV(key);
-
     slot_checker.Add(key_sv);
 
     ShardId sid = Shard(key_sv, shard_set->size());
@@ -111,9 +113,15 @@ MultiCommandSquasher::SquashResult MultiCommandSquasher::TrySquash(StoredCmd* cm
     found_more = true;
   });
 
-  if (found_more || last_sid == kInvalidSid)
+  if (last_sid == kInvalidSid)
     return SquashResult::NOT_SQUASHED;
 
+  if (found_more)
+    return SquashResult::MULTI_SHARD;
+
+  if (conflicts)
+    return SquashResult::CONFLICT;
+
   auto& sinfo = PrepareShardInfo(last_sid, slot_checker.GetUniqueSlotId());
 
   sinfo.had_writes |= cmd->Cid()->IsWriteOnly();
@@ -129,7 +137,7 @@ MultiCommandSquasher::SquashResult MultiCommandSquasher::TrySquash(StoredCmd* cm
 }
 
 bool MultiCommandSquasher::ExecuteStandalone(StoredCmd* cmd) {
-  DCHECK(order_.empty());  // check no squashed chain is interrupted
+  DCHECK(order_.empty() || !deferred_.empty());  // check no squashed chain is interrupted
 
   cmd->Fill(&tmp_keylist_);
   auto args = absl::MakeSpan(tmp_keylist_);
@@ -141,6 +149,11 @@ bool MultiCommandSquasher::ExecuteStandalone(StoredCmd* cmd) {
     }
   }
 
+  // Pipelined writes are delayed like the ones dispatched one by one. Atomic transactions were
+  // delayed by EXEC already, as they hold their locks now.
+  if (!IsAtomic() && cmd->Cid()->IsWriteOnly())
+    AwaitCowBackpressure(cmd->Cid(), args, cntx_);
+
   auto* tx = cntx_->transaction;
   tx->MultiSwitchCmd(cmd->Cid());
   cntx_->cid = cmd->Cid();
@@ -152,6 +165,25 @@ bool MultiCommandSquasher::ExecuteStandalone(StoredCmd* cmd) {
   return true;
 }
 
+bool MultiCommandSquasher::TryDefer(StoredCmd* cmd) {
+  // Reordering is unobservable only if the keys are locked and no command after an error must be
+  // skipped. Scripts may access undeclared keys.
+  if (!IsAtomic() || error_abort_ || deferred_.size() >= kMaxDeferred ||
+      cmd->Cid()->IsMultiTransactional())
+    return false;
+
+  cmd->Fill(&tmp_keylist_);
+  auto args = absl::MakeSpan(tmp_keylist_);
+  auto keys = DetermineKeys(cmd->Cid(), args);
+  if (!keys.ok())
+    return false;
+
+  IterateKeys(args, *keys, [this](MutableSlice key) { deferred_keys_.emplace(facade::ToSV(key)); });
+  deferred_.push_back(cmd);
+  order_.push_back(kInvalidSid);
+  return true;
+}
+
 OpStatus MultiCommandSquasher::SquashedHopCb(Transaction* parent_tx, EngineShard* es) {
   auto& sinfo = sharded_[es->shard_id()];
   DCHECK(!sinfo.cmds.empty());
@@ -211,28 +243,44 @@ bool MultiCommandSquasher::ExecuteSquashed() {
     sd.replies.reserve(sd.cmds.size());
 
   Transaction* tx = cntx_->transaction;
-  ServerState::tlocal()->stats.multi_squash_executions++;
   ProactorBase* proactor = ProactorBase::me();
   uint64_t start = proactor->GetMonotonicTimeNs();
 
   // Atomic transactions (that have all keys locked) perform hops and run squashed commands via
   // stubs, non-atomic ones just run the commands in parallel.
-  if (IsAtomic()) {
-    cntx_->cid = base_cid_;
-    auto cb = [this](ShardId sid) { return !sharded_[sid].cmds.empty(); };
-    tx->PrepareSquashedMultiHop(base_cid_, cb);
-    tx->ScheduleSingleHop([this](auto* tx, auto* es) { return SquashedHopCb(tx, es); });
-  } else {
-    shard_set->RunBlockingInParallel([this, tx](auto* es) { SquashedHopCb(tx, es); },
-                                     [this](auto sid) { return !sharded_[sid].cmds.empty(); });
+  if (order_.size() > deferred_.size()) {
+    ServerState::tlocal()->stats.multi_squash_executions++;
+    if (IsAtomic()) {
+      cntx_->cid = base_cid_;
+      auto cb = [this](ShardId sid) { return !sharded_[sid].cmds.empty(); };
+      tx->PrepareSquashedMultiHop(base_cid_, cb);
+      tx->ScheduleSingleHop([this](auto* tx, auto* es) { return SquashedHopCb(tx, es); });
+    } else {
+      SliceSnapshot::AwaitCowBackpressure([this](ShardId sid) {
+        return sharded_[sid].had_writes && !sharded_[sid].cmds.empty();
+      });
+      shard_set->RunBlockingInParallel([this, tx](auto* es) { SquashedHopCb(tx, es); },
+                                       [this](auto sid) { return !sharded_[sid].cmds.empty(); });
+    }
   }
 
+  // Deferred commands don't touch the keys of the squashed commands that followed them.
+  RedisReplyBuilder* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
+  for (auto* cmd : deferred_) {
+    CapturingReplyBuilder crb{cmd->ReplyMode()};
+    crb.SetResp3(rb->IsResp3());
+    cntx_->Inject(&crb);
+    ExecuteStandalone(cmd);
+    cntx_->Inject(rb);
+    deferred_replies_.emplace_back(crb.Take());
+  }
+  reverse(deferred_replies_.begin(), deferred_replies_.end());
+
   uint64_t after_hop = proactor->GetMonotonicTimeNs();
   bool aborted = false;
 
-  RedisReplyBuilder* rb = static_cast<RedisReplyBuilder*>(cntx_->reply_builder());
   for (auto idx : order_) {
-    auto& replies = sharded_[idx].replies;
+    auto& replies = idx == kInvalidSid ? deferred_replies_ : sharded_[idx].replies;
     CHECK(!replies.empty());
 
     aborted |= error_abort_ && CapturingReplyBuilder::GetError(replies.back());
@@ -251,6 +299,9 @@ bool MultiCommandSquasher::ExecuteSquashed() {
     sinfo.cmds.clear();
 
   order_.clear();
+  deferred_.clear();
+  deferred_replies_.clear();
+  deferred_keys_.clear();
   return !aborted;
 }
 
@@ -264,6 +315,20 @@ void MultiCommandSquasher::Run() {
     if (res == SquashResult::ERROR)
       break;
 
+    if (res == SquashResult::CONFLICT) {
+      // Run the deferred commands first and start a new batch.
+      if (!ExecuteSquashed())
+        break;
+      res = TrySquash(&cmd);
+      DCHECK(res == SquashResult::SQUASHED || res == SquashResult::SQUASHED_FULL);
+    }
+
+    if (res == SquashResult::MULTI_SHARD) {
+      if (TryDefer(&cmd))
+        continue;
+      res = SquashResult::NOT_SQUASHED;
+    }
+
     if (res == SquashResult::NOT_SQUASHED || res == SquashResult::SQUASHED_FULL) {
       if (!ExecuteSquashed())
         break;
@@ -4,6 +4,8 @@
 
 #pragma once
 
+#include <absl/container/flat_hash_set.h>
+
 #include "facade/reply_capture.h"
 #include "server/conn_context.h"
 #include "server/main_service.h"
@@ -20,6 +22,12 @@ namespace dfly {
 // transactional api for commands. Non atomic multi transactions use regular shard_set dispatches
 // instead of hops for executing batches. This allows avoiding locking many keys at once. Each shard
 // contains a non-atomic multi transaction to execute squashed commands.
+//
+// In atomic mode, multi shard commands don't break the batch: they are deferred until the batch is
+// executed, and the following single shard commands on other keys keep being squashed into it.
+// Once a command touches the keys of a deferred one, the batch is executed, followed by the
+// deferred commands in their order. Commands on the same keys thus keep their relative order and
+// the replies are sent in the original order.
 class MultiCommandSquasher {
  public:
   static void Execute(absl::Span<StoredCmd> cmds, ConnectionContext* cntx, Service* service,
@@ -39,9 +47,17 @@ class MultiCommandSquasher {
     boost::intrusive_ptr<Transaction> local_tx;  // stub-mode tx for use inside shard
   };
 
-  enum class SquashResult { SQUASHED, SQUASHED_FULL, NOT_SQUASHED, ERROR };
+  enum class SquashResult {
+    SQUASHED,
+    SQUASHED_FULL,
+    NOT_SQUASHED,
+    MULTI_SHARD,  // not squashed, because its keys span multiple shards
+    CONFLICT,     // touches the keys of a deferred command
+    ERROR
+  };
 
   static constexpr int kMaxSquashing = 32;
+  static constexpr size_t kMaxDeferred = 8;
 
  private:
   MultiCommandSquasher(absl::Span<StoredCmd> cmds, ConnectionContext* cntx, Service* Service,
@@ -56,10 +72,14 @@ class MultiCommandSquasher {
   // Execute separate non-squashed cmd. Return false if aborting on error.
   bool ExecuteStandalone(StoredCmd* cmd);
 
+  // Defer a multi shard cmd until the current batch is executed. Return false if not possible.
+  bool TryDefer(StoredCmd* cmd);
+
   // Callback that runs on shards during squashed hop.
   facade::OpStatus SquashedHopCb(Transaction* parent_tx, EngineShard* es);
 
-  // Execute all currently squashed commands. Return false if aborting on error.
+  // Execute all currently squashed commands and the deferred ones after them.
+  // Return false if aborting on error.
   bool ExecuteSquashed();
 
   // Run all commands until completion.
@@ -79,7 +99,11 @@ class MultiCommandSquasher {
   bool error_abort_ = false;      // Abort upon receiving error
 
   std::vector<ShardExecInfo> sharded_;
-  std::vector<ShardId> order_;  // reply order for squashed cmds
+  std::vector<ShardId> order_;  // reply order for squashed cmds, kInvalidSid for deferred ones
+
+  std::vector<StoredCmd*> deferred_;
+  std::vector<facade::CapturingReplyBuilder::Payload> deferred_replies_;
+  absl::flat_hash_set<std::string> deferred_keys_;
 
   size_t num_squashed_ = 0;
   size_t num_shards_ = 0;
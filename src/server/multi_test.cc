@@ -21,6 +21,7 @@ ABSL_DECLARE_FLAG(bool, multi_exec_squash);
 ABSL_DECLARE_FLAG(bool, lua_auto_async);
 ABSL_DECLARE_FLAG(bool, lua_allow_undeclared_auto_correct);
 ABSL_DECLARE_FLAG(std::string, default_lua_flags);
+ABSL_DECLARE_FLAG(bool, tx_optimistic_ooo);
 
 namespace dfly {
 
@@ -287,6 +288,56 @@ TEST_F(MultiTest, MultiConsistent2) {
     fb.Join();
 }
 
+TEST_F(MultiTest, OptimisticOOO) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_tx_optimistic_ooo, true);
+
+  const int kKeyCount = 8;
+  const int kRuns = 200;
+  const int kJobs = 8;
+
+  vector<string> all_keys(kKeyCount);
+  for (size_t i = 0; i < kKeyCount; i++)
+    all_keys[i] = absl::StrCat("key", i);
+
+  // Writers overlap on some of the keys, so they conflict in some shards and not in others.
+  auto write_cb = [&](string id, size_t job) {
+    for (size_t r = 0; r < kRuns; r++) {
+      string val = absl::StrCat(job, ":", r);
+      vector<string_view> args = {"mset"};
+      for (size_t i = job % 2; i < kKeyCount; i += 1 + job % 3)
+        args.insert(args.end(), {all_keys[i], val});
+      Run(id, args);
+      Run(id, {"del", all_keys[job % kKeyCount], all_keys[(job + 3) % kKeyCount]});
+    }
+  };
+
+  vector<Fiber> fbs(kJobs);
+  for (size_t i = 0; i < kJobs; i++) {
+    fbs[i] = pp_->at(i % pp_->size())->LaunchFiber([i, write_cb]() {
+      write_cb(absl::StrCat("worker", i), i);
+    });
+  }
+
+  vector<string_view> mget = {"mget"};
+  mget.insert(mget.end(), all_keys.begin(), all_keys.end());
+  for (size_t r = 0; r < kRuns; r++) {
+    auto resp = Run("reader", mget);
+    ASSERT_THAT(resp, ArrLen(kKeyCount));
+  }
+
+  for (auto& fb : fbs)
+    fb.Join();
+
+  ASSERT_FALSE(service_->IsShardSetLocked());
+  for (const auto& key : all_keys)
+    EXPECT_FALSE(service_->IsLocked(0, key));
+
+  // With this many overlapping writers, some of them are queued behind a conflicting transaction
+  // that finishes before they are armed.
+  EXPECT_GT(GetMetrics().shard_stats.tx_ooo_marked_total, 0u);
+}
+
 TEST_F(MultiTest, MultiRename) {
   RespExpr resp = Run({"mget", kKey1, kKey4});
   ASSERT_EQ(1, GetDebugInfo().shards_count);
@@ -488,6 +539,34 @@ TEST_F(MultiTest, Watch) {
   Run({"multi"});
   ASSERT_THAT(Run({"exec"}), kExecSuccess);
 
+  // Check reads of a watched key and changes of other keys leave it clean.
+  Run({"watch", "a"});
+  Run({"get", "a"});
+  Run({"select", "1"});
+  Run({"set", "a", "2"});
+  Run({"select", "0"});
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecSuccess);
+
+  // Check SET NX on an existing watched key does not change it.
+  Run({"watch", "a"});
+  EXPECT_EQ(0, CheckedInt({"setnx", "a", "3"}));
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecSuccess);
+
+  // Check snapshots, which bump the versions of the buckets they serialize, leave it clean.
+  Run({"watch", "a"});
+  EXPECT_EQ(Run({"save"}), "OK");
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecSuccess);
+
+  // Check a watched key that was deleted and set again.
+  Run({"watch", "a"});
+  Run({"del", "a"});
+  Run({"set", "a", "1"});
+  Run({"multi"});
+  ASSERT_THAT(Run({"exec"}), kExecFail);
+
   // Check watch on non-existent key.
   Run({"del", "b"});
   EXPECT_EQ(Run({"watch", "b"}), "OK");  // didn't exist yet
@@ -587,6 +666,42 @@ TEST_F(MultiTest, MultiOOO) {
     EXPECT_EQ(0, metrics.shard_stats.tx_ooo_total);
 }
 
+TEST_F(MultiTest, EvalPCallBatch) {
+  const char* script = R"(
+    redis.acall('SET', KEYS[3], 'v')
+    return redis.pcall_batch({'INCR', KEYS[1]}, {'INCRBY', KEYS[2], 5}, {'GET', KEYS[3]},
+                             {'NOSUCHCMD'}, {'LPUSH', KEYS[3], 'e'})
+  )";
+
+  auto resp = Run({"eval", script, "3", "a", "b", "c"});
+  ASSERT_THAT(resp, ArrLen(5));
+  const auto& vec = resp.GetVec();
+  EXPECT_THAT(vec[0], IntArg(1));
+  EXPECT_THAT(vec[1], IntArg(5));
+  EXPECT_EQ(vec[2], "v");
+  EXPECT_THAT(vec[3], ErrArg("unknown command"));
+  EXPECT_THAT(vec[4], ErrArg("WRONGTYPE"));
+
+  EXPECT_EQ(Run({"get", "b"}), "5");
+}
+
+TEST_F(MultiTest, ScriptStats) {
+  const char* script = "redis.call('SET', KEYS[1], 'v'); return redis.call('GET', KEYS[1])";
+  EXPECT_EQ(Run({"eval", script, "1", "a"}), "v");
+
+  auto resp = Run({"script", "stats"});
+  ASSERT_THAT(resp, ArrLen(2));
+  const auto& entry = resp.GetVec();
+  EXPECT_EQ(entry[0].GetString().size(), 40u);
+
+  ASSERT_THAT(entry[1], ArrLen(14));
+  const auto& stats = entry[1].GetVec();
+  EXPECT_EQ(stats[0], "calls");
+  EXPECT_THAT(stats[1], IntArg(1));
+  EXPECT_EQ(stats[8], "commands");
+  EXPECT_THAT(stats[9], IntArg(2));
+}
+
 // Lua scripts lock their keys ahead and thus can run out of order.
 TEST_F(MultiTest, EvalOOO) {
   if (auto config = absl::GetFlag(FLAGS_default_lua_flags); config != "") {
@@ -889,6 +1004,35 @@ TEST_F(MultiTest, TestSquashing) {
   Run({"exec"});
 }
 
+// Multi shard commands don't break the squashed batch, unless it touches their keys.
+TEST_F(MultiTest, SquashingDefersMultiShard) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_multi_exec_squash, true);
+  absl::SetFlag(&FLAGS_multi_exec_mode, Transaction::LOCK_AHEAD);
+
+  Run({"multi"});
+  Run({"set", kKeySid0, "1"});
+  Run({"mset", kKeySid1, "2", kKeySid2, "3"});
+  Run({"set", "a", "4"});
+  Run({"get", kKeySid0});
+  Run({"append", kKeySid1, "5"});  // touches a key of the mset
+  Run({"del", kKeySid0, kKeySid2, "a"});
+  Run({"get", kKeySid1});
+  auto resp = Run({"exec"});
+
+  ASSERT_THAT(resp, ArrLen(7));
+  const auto& vec = resp.GetVec();
+  EXPECT_EQ(vec[0], "OK");
+  EXPECT_EQ(vec[1], "OK");
+  EXPECT_EQ(vec[2], "OK");
+  EXPECT_EQ(vec[3], "1");
+  EXPECT_THAT(vec[4], IntArg(2));
+  EXPECT_THAT(vec[5], IntArg(3));
+  EXPECT_EQ(vec[6], "25");
+
+  EXPECT_THAT(Run({"exists", kKeySid0, kKeySid2, "a"}), IntArg(0));
+}
+
 TEST_F(MultiTest, MultiLeavesTxQueue) {
   if (auto mode = absl::GetFlag(FLAGS_multi_exec_mode); mode == Transaction::NON_ATOMIC) {
     GTEST_SKIP() << "Skipped MultiLeavesTxQueue test because multi_exec_mode is non atomic";
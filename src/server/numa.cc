@@ -0,0 +1,134 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/numa.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_cat.h>
+#include <absl/strings/str_split.h>
+#include <absl/strings/strip.h>
+
+#include <algorithm>
+#include <thread>
+
+#ifdef __linux__
+#include <linux/mempolicy.h>
+#include <sched.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#include "base/logging.h"
+#include "io/file_util.h"
+
+namespace dfly {
+
+using namespace std;
+
+NumaTopology NumaTopology::Read() {
+  NumaTopology res;
+  for (unsigned node = 0;; ++node) {
+    string path = absl::StrCat("/sys/devices/system/node/node", node, "/cpulist");
+    auto list = io::ReadFileToString(path);
+    if (!list)
+      break;
+
+    vector<unsigned> cpus;
+    if (!ParseCpuList(absl::StripAsciiWhitespace(*list), &cpus)) {
+      LOG(WARNING) << "Could not parse the cpus of numa node " << node << ": " << *list;
+      break;
+    }
+    res.node_cpus.push_back(std::move(cpus));
+  }
+
+  if (res.node_cpus.empty()) {
+    vector<unsigned> cpus(thread::hardware_concurrency());
+    for (unsigned i = 0; i < cpus.size(); ++i)
+      cpus[i] = i;
+    res.node_cpus.push_back(std::move(cpus));
+  }
+  return res;
+}
+
+const NumaTopology& NumaTopology::Get() {
+  static const NumaTopology topology = Read();
+  return topology;
+}
+
+bool NumaTopology::ParseCpuList(string_view list, vector<unsigned>* cpus) {
+  if (list.empty())
+    return true;  // memory only nodes have no cpus.
+
+  for (string_view range : absl::StrSplit(list, ',')) {
+    pair<string_view, string_view> bounds = absl::StrSplit(range, absl::MaxSplits('-', 1));
+    unsigned first, last;
+    if (!absl::SimpleAtoi(bounds.first, &first))
+      return false;
+    last = first;
+    if (!bounds.second.empty() && !absl::SimpleAtoi(bounds.second, &last))
+      return false;
+    if (last < first)
+      return false;
+
+    for (unsigned cpu = first; cpu <= last; ++cpu)
+      cpus->push_back(cpu);
+  }
+  return true;
+}
+
+vector<unsigned> NumaTopology::AllowedCpusByNode() const {
+  vector<unsigned> res;
+#ifdef __linux__
+  cpu_set_t allowed;
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    return res;
+
+  for (const auto& cpus : node_cpus) {
+    for (unsigned cpu : cpus) {
+      if (cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed))
+        res.push_back(cpu);
+    }
+  }
+#endif
+  return res;
+}
+
+unsigned NumaTopology::NodeOfCpu(unsigned cpu) const {
+  for (unsigned node = 0; node < node_cpus.size(); ++node) {
+    if (find(node_cpus[node].begin(), node_cpus[node].end(), cpu) != node_cpus[node].end())
+      return node;
+  }
+  return 0;
+}
+
+unsigned CurrentNumaNode() {
+#ifdef __linux__
+  unsigned cpu = 0, node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) == 0)
+    return node;
+#endif
+  return 0;
+}
+
+bool BindThreadToNumaNode(unsigned cpu, unsigned node) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  if (sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+    return false;
+
+  // Preferred rather than bound, so that allocations fall back to other nodes instead of failing.
+  unsigned long mask = 1ul << node;
+  if (node >= sizeof(mask) * 8 ||
+      syscall(SYS_set_mempolicy, MPOL_PREFERRED, &mask, sizeof(mask) * 8) != 0)
+    return false;
+  return true;
+#else
+  return false;
+#endif
+}
+
+}  // namespace dfly
@@ -0,0 +1,43 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <string_view>
+#include <vector>
+
+namespace dfly {
+
+// NUMA topology of the host, read from sysfs. Hosts without NUMA support have a single node
+// with all the cpus.
+struct NumaTopology {
+  static NumaTopology Read();
+
+  // The topology read on the first call. It does not change while the process runs.
+  static const NumaTopology& Get();
+
+  // Parses a sysfs cpu list like "0-3,8-11". Returns false if it is malformed.
+  static bool ParseCpuList(std::string_view list, std::vector<unsigned>* cpus);
+
+  // The cpus this process may run on, ordered node by node, so that consecutive threads that
+  // are pinned to them share a node.
+  std::vector<unsigned> AllowedCpusByNode() const;
+
+  unsigned NodeOfCpu(unsigned cpu) const;
+
+  size_t num_nodes() const {
+    return node_cpus.size();
+  }
+
+  std::vector<std::vector<unsigned>> node_cpus;  // indexed by node
+};
+
+// Returns the node of the cpu the calling thread runs on.
+unsigned CurrentNumaNode();
+
+// Pins the calling thread to the cpu and makes the memory it allocates prefer the node,
+// so that the heap of a shard is local to its thread. Returns false on failure.
+bool BindThreadToNumaNode(unsigned cpu, unsigned node);
+
+}  // namespace dfly
@@ -0,0 +1,47 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/numa.h"
+
+#include "base/gtest.h"
+
+namespace dfly {
+
+using namespace std;
+using testing::ElementsAre;
+
+TEST(NumaTest, ParseCpuList) {
+  vector<unsigned> cpus;
+  EXPECT_TRUE(NumaTopology::ParseCpuList("0-3,8,10-11", &cpus));
+  EXPECT_THAT(cpus, ElementsAre(0, 1, 2, 3, 8, 10, 11));
+
+  cpus.clear();
+  EXPECT_TRUE(NumaTopology::ParseCpuList("", &cpus));
+  EXPECT_TRUE(cpus.empty());
+
+  EXPECT_FALSE(NumaTopology::ParseCpuList("3-1", &cpus));
+  EXPECT_FALSE(NumaTopology::ParseCpuList("a", &cpus));
+  EXPECT_FALSE(NumaTopology::ParseCpuList("1,", &cpus));
+}
+
+TEST(NumaTest, AllowedCpusByNode) {
+  NumaTopology numa;
+  numa.node_cpus = {{0, 2}, {1, 3}};
+  EXPECT_EQ(numa.NodeOfCpu(2), 0u);
+  EXPECT_EQ(numa.NodeOfCpu(3), 1u);
+
+  // The allowed cpus of the process are a subset of the topology, grouped by node.
+  vector<unsigned> cpus = numa.AllowedCpusByNode();
+  for (size_t i = 1; i < cpus.size(); ++i)
+    EXPECT_LE(numa.NodeOfCpu(cpus[i - 1]), numa.NodeOfCpu(cpus[i]));
+
+  EXPECT_GE(NumaTopology::Read().num_nodes(), 1u);
+  EXPECT_LT(CurrentNumaNode(), NumaTopology::Read().num_nodes());
+
+  // The topology is read once and cached.
+  EXPECT_EQ(&NumaTopology::Get(), &NumaTopology::Get());
+  EXPECT_EQ(NumaTopology::Get().num_nodes(), NumaTopology::Read().num_nodes());
+}
+
+}  // namespace dfly
@@ -8,17 +8,26 @@ extern "C" {
 #include "redis/rdb.h"
 }
 
-//  Custom types: Range 30-35 is used by DF RDB types.
+//  Custom types: Range 30-39 is used by DF RDB types.
 constexpr uint8_t RDB_TYPE_JSON_OLD = 20;
 constexpr uint8_t RDB_TYPE_JSON = 30;
 constexpr uint8_t RDB_TYPE_HASH_WITH_EXPIRY = 31;
 constexpr uint8_t RDB_TYPE_SET_WITH_EXPIRY = 32;
 constexpr uint8_t RDB_TYPE_SBF = 33;
+constexpr uint8_t RDB_TYPE_JSON_FLAT = 34;  // JSON encoded as flexbuffer
+constexpr uint8_t RDB_TYPE_CMS = 35;        // Count-Min sketch
+constexpr uint8_t RDB_TYPE_TS = 36;         // Time series of compressed chunks
+constexpr uint8_t RDB_TYPE_TOPK = 37;       // Top-K sketch
+constexpr uint8_t RDB_TYPE_TDIGEST = 38;    // t-digest
+
+// Option bits of RDB_TYPE_SBF.
+constexpr uint64_t RDB_SBF_BLOCKED = 1;  // filters use the blocked layout.
 
 constexpr bool rdbIsObjectTypeDF(uint8_t type) {
   return __rdbIsObjectType(type) || (type == RDB_TYPE_JSON) ||
          (type == RDB_TYPE_HASH_WITH_EXPIRY) || (type == RDB_TYPE_SET_WITH_EXPIRY) ||
-         (type == RDB_TYPE_SBF);
+         (type == RDB_TYPE_SBF) || (type == RDB_TYPE_JSON_FLAT) || (type == RDB_TYPE_CMS) ||
+         (type == RDB_TYPE_TS) || (type == RDB_TYPE_TOPK) || (type == RDB_TYPE_TDIGEST);
 }
 
 //  Opcodes: Range 200-240 is used by DF extensions.
@@ -30,10 +30,19 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/bloom.h"
+#include "core/count_min_sketch.h"
+#include "core/time_series.h"
+#include "core/flatbuffers.h"
 #include "core/json/json_object.h"
+#include "core/json/path.h"
+#include "core/packed_int_set.h"
+#include "core/packed_string_set.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
+#include "core/tdigest.h"
+#include "core/top_k.h"
+#include "server/container_utils.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/hset_family.h"
@@ -53,6 +62,7 @@ extern "C" {
 ABSL_DECLARE_FLAG(int32_t, list_max_listpack_size);
 ABSL_DECLARE_FLAG(int32_t, list_compress_depth);
 ABSL_DECLARE_FLAG(uint32_t, dbnum);
+ABSL_DECLARE_FLAG(bool, experimental_flat_json);
 
 namespace dfly {
 
@@ -386,6 +396,10 @@ class RdbLoaderBase::OpaqueObjLoader {
   void operator()(const LzfString& lzfstr);
   void operator()(const unique_ptr<LoadTrace>& ptr);
   void operator()(const RdbSBF& src);
+  void operator()(const RdbCMS& src);
+  void operator()(const RdbTimeSeries& src);
+  void operator()(const RdbTopK& src);
+  void operator()(const RdbTDigest& src);
 
   std::error_code ec() const {
     return ec_;
@@ -473,13 +487,52 @@ void RdbLoaderBase::OpaqueObjLoader::operator()(const unique_ptr<LoadTrace>& ptr
 void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbSBF& src) {
   SBF* sbf =
       CompactObj::AllocateMR<SBF>(src.grow_factor, src.fp_prob, src.max_capacity, src.prev_size,
-                                  src.current_size, CompactObj::memory_resource());
+                                  src.current_size, CompactObj::memory_resource(), src.blocked);
   for (unsigned i = 0; i < src.filters.size(); ++i) {
     sbf->AddFilter(src.filters[i].blob, src.filters[i].hash_cnt);
   }
   pv_->SetSBF(sbf);
 }
 
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbCMS& src) {
+  pv_->SetCMS(CompactObj::AllocateMR<CountMinSketch>(src.width, src.depth, src.count,
+                                                     src.counters, CompactObj::memory_resource()));
+}
+
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbTimeSeries& src) {
+  TimeSeries* ts =
+      CompactObj::AllocateMR<TimeSeries>(CompactObj::memory_resource(), src.chunk_bytes);
+  for (const auto& chunk : src.chunks) {
+    if (!ts->LoadChunk({chunk.count, chunk.bit_len, chunk.data})) {
+      LOG(ERROR) << "Invalid time series chunk";
+      CompactObj::DeleteMR<TimeSeries>(ts);
+      ec_ = RdbError(errc::rdb_file_corrupted);
+      return;
+    }
+  }
+  pv_->SetTimeSeries(ts);
+}
+
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbTopK& src) {
+  TopK* topk = CompactObj::AllocateMR<TopK>(src.k, src.width, src.depth, src.decay, src.buckets,
+                                            CompactObj::memory_resource());
+  for (const auto& [item, count] : src.items)
+    topk->LoadItem(item, count);
+  pv_->SetTopK(topk);
+}
+
+void RdbLoaderBase::OpaqueObjLoader::operator()(const RdbTDigest& src) {
+  TDigest::State state{.min = src.min,
+                       .max = src.max,
+                       .merged_nodes = src.merged_nodes,
+                       .unmerged_nodes = src.unmerged_nodes,
+                       .total_compressions = src.total_compressions,
+                       .means = src.means,
+                       .weights = src.weights};
+  pv_->SetTDigest(
+      CompactObj::AllocateMR<TDigest>(src.compression, state, CompactObj::memory_resource()));
+}
+
 void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
   size_t len = ltrace->blob_count();
 
@@ -497,6 +550,28 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
     is_intset = false;
   }
 
+  // Sets with expiry need StringSet.
+  bool is_packed_int = false;
+  if (!is_intset && rdb_type_ == RDB_TYPE_SET && len <= SetFamily::MaxPackedIntSetEntries()) {
+    is_packed_int = true;
+    Iterate(*ltrace, [&](const LoadBlob& blob) {
+      long long llval;
+      string_view member = ToSV(blob.rdb_var);
+      is_packed_int = string2ll(member.data(), member.size(), &llval);
+      return is_packed_int;
+    });
+  }
+
+  bool is_packed = false;
+  if (!is_intset && !is_packed_int && rdb_type_ == RDB_TYPE_SET &&
+      len <= SetFamily::MaxPackedSetEntries()) {
+    is_packed = true;
+    Iterate(*ltrace, [&](const LoadBlob& blob) {
+      is_packed = ToSV(blob.rdb_var).size() <= SetFamily::MaxPackedMemberLen();
+      return is_packed;
+    });
+  }
+
   sds sdsele = nullptr;
   void* inner_obj = nullptr;
 
@@ -505,6 +580,10 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
       sdsfree(sdsele);
     if (is_intset) {
       zfree(inner_obj);
+    } else if (is_packed_int) {
+      CompactObj::DeleteMR<PackedIntSet>(inner_obj);
+    } else if (is_packed) {
+      CompactObj::DeleteMR<PackedStringSet>(inner_obj);
     } else {
       CompactObj::DeleteMR<StringSet>(inner_obj);
     }
@@ -525,6 +604,33 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
       }
       return true;
     });
+  } else if (is_packed_int) {
+    PackedIntSet* set = CompactObj::AllocateMR<PackedIntSet>();
+    inner_obj = set;
+
+    Iterate(*ltrace, [&](const LoadBlob& blob) {
+      long long llval;
+      string_view member = ToSV(blob.rdb_var);
+      CHECK(string2ll(member.data(), member.size(), &llval));
+      if (!set->Add(llval)) {
+        LOG(ERROR) << "Duplicate set members detected";
+        ec_ = RdbError(errc::duplicate_key);
+        return false;
+      }
+      return true;
+    });
+  } else if (is_packed) {
+    PackedStringSet* set = CompactObj::AllocateMR<PackedStringSet>();
+    inner_obj = set;
+
+    Iterate(*ltrace, [&](const LoadBlob& blob) {
+      if (!set->Add(ToSV(blob.rdb_var))) {
+        LOG(ERROR) << "Duplicate set members detected";
+        ec_ = RdbError(errc::duplicate_key);
+        return false;
+      }
+      return true;
+    });
   } else {
     StringSet* set = CompactObj::AllocateMR<StringSet>();
     set->set_time(MemberTimeSeconds(GetCurrentTimeMs()));
@@ -574,7 +680,11 @@ void RdbLoaderBase::OpaqueObjLoader::CreateSet(const LoadTrace* ltrace) {
 
   if (ec_)
     return;
-  pv_->InitRobj(OBJ_SET, is_intset ? kEncodingIntSet : kEncodingStrMap2, inner_obj);
+  unsigned encoding = is_intset       ? kEncodingIntSet
+                      : is_packed_int ? kEncodingPackedIntSet
+                      : is_packed     ? kEncodingPackedSet
+                                      : kEncodingStrMap2;
+  pv_->InitRobj(OBJ_SET, encoding, inner_obj);
   std::move(cleanup).Cancel();
 }
 
@@ -755,31 +865,40 @@ void RdbLoaderBase::OpaqueObjLoader::CreateZSet(const LoadTrace* ltrace) {
 
   size_t maxelelen = 0, totelelen = 0;
 
+  // Collect all the members first, so that the score tree is built once in bulk.
+  vector<sds> elements;
+  vector<pair<double, string_view>> members;
+  elements.reserve(zsetlen);
+  members.reserve(zsetlen);
+  auto free_elements = absl::MakeCleanup([&] {
+    for (sds ele : elements)
+      sdsfree(ele);
+  });
+
   Iterate(*ltrace, [&](const LoadBlob& blob) {
     sds sdsele = ToSds(blob.rdb_var);
     if (!sdsele)
       return false;
 
-    double score = blob.score;
-
     /* Don't care about integer-encoded strings. */
     if (sdslen(sdsele) > maxelelen)
       maxelelen = sdslen(sdsele);
     totelelen += sdslen(sdsele);
 
-    if (!zs->Insert(score, sdsele)) {
-      LOG(ERROR) << "Duplicate zset fields detected";
-      sdsfree(sdsele);
-      ec_ = RdbError(errc::rdb_file_corrupted);
-      return false;
-    }
-
+    elements.push_back(sdsele);
+    members.emplace_back(blob.score, string_view{sdsele, sdslen(sdsele)});
     return true;
   });
 
   if (ec_)
     return;
 
+  if (zs->InsertBulk(members) != members.size()) {
+    LOG(ERROR) << "Duplicate zset fields detected";
+    ec_ = RdbError(errc::rdb_file_corrupted);
+    return;
+  }
+
   void* inner = zs;
   if (zs->Size() <= server.zset_max_listpack_entries &&
       maxelelen <= server.zset_max_listpack_value && lpSafeToAdd(NULL, totelelen)) {
@@ -924,7 +1043,9 @@ void RdbLoaderBase::OpaqueObjLoader::HandleBlob(string_view blob) {
 
     unsigned len = intsetLen(is);
 
-    if (len > SetFamily::MaxIntsetEntries()) {
+    if (len > SetFamily::MaxIntsetEntries() && len <= SetFamily::MaxPackedIntSetEntries()) {
+      pv_->InitRobj(OBJ_SET, kEncodingPackedIntSet, container_utils::IntSetToPackedIntSet(is));
+    } else if (len > SetFamily::MaxIntsetEntries()) {
       StringSet* set = SetFamily::ConvertToStrSet(is, len);
 
       if (!set) {
@@ -1040,11 +1161,30 @@ void RdbLoaderBase::OpaqueObjLoader::HandleBlob(string_view blob) {
     std::memcpy(lp, src_lp, bytes);
     pv_->InitRobj(OBJ_ZSET, OBJ_ENCODING_LISTPACK, lp);
   } else if (rdb_type_ == RDB_TYPE_JSON) {
+    // Build flat values right from the text, values with duplicate keys go through JsonType
+    if (absl::GetFlag(FLAGS_experimental_flat_json)) {
+      flexbuffers::Builder fbb;
+      if (json::FlatFromString(blob, &fbb)) {
+        fbb.Finish();
+        const auto& buf = fbb.GetBuffer();
+        pv_->SetJson(buf.data(), buf.size());
+        return;
+      }
+    }
+
     auto json = JsonFromString(blob, CompactObj::memory_resource());
     if (!json) {
       ec_ = RdbError(errc::bad_json_string);
+      return;
     }
     pv_->SetJson(std::move(*json));
+  } else if (rdb_type_ == RDB_TYPE_JSON_FLAT) {
+    auto* buf = reinterpret_cast<const uint8_t*>(blob.data());
+    if (!flexbuffers::VerifyBuffer(buf, blob.size())) {
+      ec_ = RdbError(errc::bad_json_string);
+      return;
+    }
+    pv_->SetJson(buf, blob.size());
   } else {
     LOG(FATAL) << "Unsupported rdb type " << rdb_type_;
   }
@@ -1367,6 +1507,9 @@ error_code RdbLoaderBase::ReadObj(int rdbtype, OpaqueObj* dest) {
     case RDB_TYPE_JSON:
       iores = ReadJson();
       break;
+    case RDB_TYPE_JSON_FLAT:
+      iores = ReadGeneric(rdbtype);
+      break;
     case RDB_TYPE_SET_LISTPACK:
       // We need to deal with protocol versions 9 and older because in these
       // RDB_TYPE_JSON == 20. On newer versions > 9 we bumped up RDB_TYPE_JSON to 30
@@ -1384,6 +1527,18 @@ error_code RdbLoaderBase::ReadObj(int rdbtype, OpaqueObj* dest) {
     case RDB_TYPE_SBF:
       iores = ReadSBF();
       break;
+    case RDB_TYPE_CMS:
+      iores = ReadCMS();
+      break;
+    case RDB_TYPE_TS:
+      iores = ReadTimeSeries();
+      break;
+    case RDB_TYPE_TOPK:
+      iores = ReadTopK();
+      break;
+    case RDB_TYPE_TDIGEST:
+      iores = ReadTDigest();
+      break;
     default:
       LOG(ERROR) << "Unsupported rdb type " << rdbtype;
 
@@ -1848,8 +2003,9 @@ auto RdbLoaderBase::ReadSBF() -> io::Result<OpaqueObj> {
   RdbSBF res;
   uint64_t options;
   SET_OR_UNEXPECT(LoadLen(nullptr), options);
-  if (options != 0)
+  if (options & ~RDB_SBF_BLOCKED)
     return Unexpected(errc::rdb_file_corrupted);
+  res.blocked = options & RDB_SBF_BLOCKED;
   SET_OR_UNEXPECT(FetchBinaryDouble(), res.grow_factor);
   SET_OR_UNEXPECT(FetchBinaryDouble(), res.fp_prob);
   if (res.fp_prob <= 0 || res.fp_prob > 0.5) {
@@ -1872,11 +2028,93 @@ auto RdbLoaderBase::ReadSBF() -> io::Result<OpaqueObj> {
     if (!is_power2(bit_len)) {  // must be power of two
       return Unexpected(errc::rdb_file_corrupted);
     }
+    if (res.blocked && filter_data.size() < Bloom::kBlockBytes) {
+      return Unexpected(errc::rdb_file_corrupted);
+    }
     res.filters.emplace_back(hash_cnt, std::move(filter_data));
   }
   return OpaqueObj{std::move(res), RDB_TYPE_SBF};
 }
 
+auto RdbLoaderBase::ReadCMS() -> io::Result<OpaqueObj> {
+  RdbCMS res;
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.width);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.depth);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.count);
+  SET_OR_UNEXPECT(FetchGenericString(), res.counters);
+
+  if (res.width == 0 || res.depth == 0 || res.depth > CountMinSketch::kMaxDepth ||
+      res.counters.size() != size_t(res.width) * res.depth * sizeof(uint32_t)) {
+    return Unexpected(errc::rdb_file_corrupted);
+  }
+  return OpaqueObj{std::move(res), RDB_TYPE_CMS};
+}
+
+auto RdbLoaderBase::ReadTimeSeries() -> io::Result<OpaqueObj> {
+  RdbTimeSeries res;
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.chunk_bytes);
+  if (res.chunk_bytes == 0)
+    return Unexpected(errc::rdb_file_corrupted);
+
+  size_t num_chunks;
+  SET_OR_UNEXPECT(LoadLen(nullptr), num_chunks);
+  for (size_t i = 0; i < num_chunks; ++i) {
+    auto& chunk = res.chunks.emplace_back();
+    SET_OR_UNEXPECT(LoadLen(nullptr), chunk.count);
+    SET_OR_UNEXPECT(LoadLen(nullptr), chunk.bit_len);
+    SET_OR_UNEXPECT(FetchGenericString(), chunk.data);
+  }
+  return OpaqueObj{std::move(res), RDB_TYPE_TS};
+}
+
+auto RdbLoaderBase::ReadTopK() -> io::Result<OpaqueObj> {
+  RdbTopK res;
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.k);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.width);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.depth);
+  SET_OR_UNEXPECT(FetchBinaryDouble(), res.decay);
+  SET_OR_UNEXPECT(FetchGenericString(), res.buckets);
+
+  if (res.k == 0 || res.width == 0 || res.depth == 0 || res.depth > TopK::kMaxDepth ||
+      res.buckets.size() != size_t(res.width) * res.depth * sizeof(TopK::Bucket)) {
+    return Unexpected(errc::rdb_file_corrupted);
+  }
+
+  size_t num_items;
+  SET_OR_UNEXPECT(LoadLen(nullptr), num_items);
+  if (num_items > res.k)
+    return Unexpected(errc::rdb_file_corrupted);
+
+  for (size_t i = 0; i < num_items; ++i) {
+    auto& [item, count] = res.items.emplace_back();
+    SET_OR_UNEXPECT(FetchGenericString(), item);
+    SET_OR_UNEXPECT(LoadLen(nullptr), count);
+    if (count == 0)
+      return Unexpected(errc::rdb_file_corrupted);
+  }
+  return OpaqueObj{std::move(res), RDB_TYPE_TOPK};
+}
+
+auto RdbLoaderBase::ReadTDigest() -> io::Result<OpaqueObj> {
+  RdbTDigest res;
+  SET_OR_UNEXPECT(FetchBinaryDouble(), res.compression);
+  SET_OR_UNEXPECT(FetchBinaryDouble(), res.min);
+  SET_OR_UNEXPECT(FetchBinaryDouble(), res.max);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.merged_nodes);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.unmerged_nodes);
+  SET_OR_UNEXPECT(LoadLen(nullptr), res.total_compressions);
+  SET_OR_UNEXPECT(FetchGenericString(), res.means);
+  SET_OR_UNEXPECT(FetchGenericString(), res.weights);
+
+  size_t nodes = res.merged_nodes + res.unmerged_nodes;
+  if (!(res.compression >= 1 && res.compression <= TDigest::kMaxCompression) ||
+      nodes > TDigest::Capacity(res.compression) || res.means.size() != nodes * sizeof(double) ||
+      res.weights.size() != nodes * sizeof(double)) {
+    return Unexpected(errc::rdb_file_corrupted);
+  }
+  return OpaqueObj{std::move(res), RDB_TYPE_TDIGEST};
+}
+
 template <typename T> io::Result<T> RdbLoaderBase::FetchInt() {
   auto ec = EnsureRead(sizeof(T));
   if (ec)
@@ -2364,7 +2602,17 @@ error_code RdbLoader::HandleAux() {
   } else if (auxkey == "repl-stream-db") {
     // TODO
   } else if (auxkey == "repl-id") {
-    // TODO
+    repl_id_ = std::move(auxval);
+  } else if (auxkey == "repl-lsns") {
+    for (string_view lsn : absl::StrSplit(auxval, ',')) {
+      uint64_t val;
+      if (!absl::SimpleAtoi(lsn, &val)) {
+        LOG(WARNING) << "Invalid replication LSNs in RDB: " << auxval;
+        repl_lsns_.clear();
+        break;
+      }
+      repl_lsns_.push_back(val);
+    }
   } else if (auxkey == "repl-offset") {
     // TODO
   } else if (auxkey == "lua") {
@@ -2419,6 +2667,12 @@ void RdbLoader::FlushShardAsync(ShardId sid) {
   if (out_buf.empty())
     return;
 
+  if (progress_) {
+    progress_->keys_loaded.fetch_add(out_buf.size(), std::memory_order_relaxed);
+    progress_->bytes_read.fetch_add(bytes_read_ - reported_bytes_, std::memory_order_relaxed);
+    reported_bytes_ = bytes_read_;
+  }
+
   auto cb = [indx = this->cur_db_index_, this, ib = std::move(out_buf)] {
     this->LoadItemsBuffer(indx, ib);
   };
@@ -2463,6 +2717,7 @@ void RdbLoader::LoadItemsBuffer(DbIndex db_ind, const ItemsBuf& ib) {
 
     auto& res = *op_res;
     res.it->first.SetSticky(item->is_sticky);
+    db_slice.TrackFieldExpiry(db_ind, item->key, res.it->second);
     if (!res.is_new) {
       LOG(WARNING) << "RDB has duplicated key '" << item->key << "' in DB " << db_ind;
     }
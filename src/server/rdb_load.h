@@ -3,6 +3,7 @@
 //
 #pragma once
 
+#include <atomic>
 #include <system_error>
 
 extern "C" {
@@ -27,6 +28,20 @@ class DecompressImpl;
 
 using RdbVersion = std::uint16_t;
 
+// Load progress counters that can be shared by several loaders reading the files of the same
+// snapshot. Updated by the loading fibers each time a batch is dispatched to the shards.
+struct RdbLoadProgress {
+  std::atomic_size_t bytes_total{0};
+  std::atomic_size_t bytes_read{0};
+  std::atomic_size_t keys_loaded{0};
+
+  void Reset() {
+    bytes_total.store(0, std::memory_order_relaxed);
+    bytes_read.store(0, std::memory_order_relaxed);
+    keys_loaded.store(0, std::memory_order_relaxed);
+  }
+};
+
 class RdbLoaderBase {
  protected:
   RdbLoaderBase();
@@ -44,6 +59,7 @@ class RdbLoaderBase {
     double grow_factor, fp_prob;
     size_t prev_size, current_size;
     size_t max_capacity;
+    bool blocked = false;
 
     struct Filter {
       unsigned hash_cnt;
@@ -54,8 +70,40 @@ class RdbLoaderBase {
     std::vector<Filter> filters;
   };
 
+  struct RdbCMS {
+    uint32_t width, depth;
+    uint64_t count;
+    std::string counters;
+  };
+
+  struct RdbTimeSeries {
+    uint32_t chunk_bytes;
+
+    struct Chunk {
+      uint32_t count;
+      uint64_t bit_len;
+      std::string data;
+    };
+    std::vector<Chunk> chunks;
+  };
+
+  struct RdbTopK {
+    uint32_t k, width, depth;
+    double decay;
+    std::string buckets;
+    std::vector<std::pair<std::string, uint32_t>> items;
+  };
+
+  struct RdbTDigest {
+    double compression, min, max;
+    size_t merged_nodes, unmerged_nodes;
+    uint64_t total_compressions;
+    std::string means, weights;
+  };
+
   using RdbVariant =
-      std::variant<long long, base::PODArray<char>, LzfString, std::unique_ptr<LoadTrace>, RdbSBF>;
+      std::variant<long long, base::PODArray<char>, LzfString, std::unique_ptr<LoadTrace>, RdbSBF,
+                   RdbCMS, RdbTimeSeries, RdbTopK, RdbTDigest>;
 
   struct OpaqueObj {
     RdbVariant obj;
@@ -148,6 +196,10 @@ class RdbLoaderBase {
   ::io::Result<OpaqueObj> ReadRedisJson();
   ::io::Result<OpaqueObj> ReadJson();
   ::io::Result<OpaqueObj> ReadSBF();
+  ::io::Result<OpaqueObj> ReadCMS();
+  ::io::Result<OpaqueObj> ReadTimeSeries();
+  ::io::Result<OpaqueObj> ReadTopK();
+  ::io::Result<OpaqueObj> ReadTDigest();
 
   std::error_code SkipModuleData();
   std::error_code HandleCompressedBlob(int op_type);
@@ -207,12 +259,26 @@ class RdbLoader : protected RdbLoaderBase {
     stop_early_.store(true);
   }
 
+  // Report the progress of this loader into `progress`, must outlive the loader.
+  void set_progress(RdbLoadProgress* progress) {
+    progress_ = progress;
+  }
+
   // Return the offset that was received with a RDB_OPCODE_JOURNAL_OFFSET command,
   // or 0 if no offset was received.
   std::optional<uint64_t> journal_offset() const {
     return journal_offset_;
   }
 
+  // Replication state of the replica that saved the snapshot, see RdbSaver::GlobalData.
+  const std::string& repl_id() const {
+    return repl_id_;
+  }
+
+  const std::vector<uint64_t>& repl_lsns() const {
+    return repl_lsns_;
+  }
+
   // Set callback for receiving RDB_OPCODE_FULLSYNC_END.
   // This opcode is used by a master instance to notify it finished streaming static data
   // and is ready to switch to stable state sync.
@@ -275,6 +341,9 @@ class RdbLoader : protected RdbLoaderBase {
   size_t keys_loaded_ = 0;
   double load_time_ = 0;
 
+  RdbLoadProgress* progress_ = nullptr;
+  size_t reported_bytes_ = 0;
+
   DbIndex cur_db_index_ = 0;
 
   AggregateError ec_;
@@ -283,6 +352,9 @@ class RdbLoader : protected RdbLoaderBase {
   // Callback when receiving RDB_OPCODE_FULLSYNC_END
   std::function<void()> full_sync_cut_cb;
 
+  std::string repl_id_;
+  std::vector<uint64_t> repl_lsns_;
+
   base::MPSCIntrusiveQueue<Item> item_queue_;
 };
 
@@ -7,6 +7,7 @@
 #include <absl/cleanup/cleanup.h>
 #include <absl/strings/str_cat.h>
 #include <absl/strings/str_format.h>
+#include <absl/strings/str_join.h>
 #include <lz4frame.h>
 #include <zstd.h>
 
@@ -28,10 +29,17 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "core/bloom.h"
+#include "core/chunked_list.h"
+#include "core/count_min_sketch.h"
+#include "core/time_series.h"
 #include "core/json/json_object.h"
+#include "core/packed_int_set.h"
+#include "core/packed_string_set.h"
 #include "core/sorted_map.h"
 #include "core/string_map.h"
 #include "core/string_set.h"
+#include "core/tdigest.h"
+#include "core/top_k.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
 #include "server/main_service.h"
@@ -49,6 +57,14 @@ ABSL_FLAG(dfly::CompressionMode, compression_mode, dfly::CompressionMode::MULTI_
           "set 3 for multi entry lz4 compression on df snapshot and single entry on rdb snapshot");
 ABSL_FLAG(int, compression_level, 2, "The compression level to use on zstd/lz4 compression");
 
+ABSL_FLAG(uint32_t, serialization_max_chunk_size, 0,
+          "If positive, large values are flushed in chunks of about this many bytes while they "
+          "are serialized. Applies to DFS snapshots and replication full sync");
+
+ABSL_FLAG(uint32_t, snapshot_direct_write_size, 64 * 1024,
+          "Size of the writes to snapshot files opened with O_DIRECT, rounded up to 4KB. "
+          "Larger writes need fewer calls and keep the disk busier");
+
 namespace dfly {
 
 using namespace std;
@@ -162,7 +178,7 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
     case OBJ_STRING:
       return RDB_TYPE_STRING;
     case OBJ_LIST:
-      if (compact_enc == OBJ_ENCODING_QUICKLIST)
+      if (compact_enc == OBJ_ENCODING_QUICKLIST || compact_enc == kEncodingChunkedList)
         return RDB_TYPE_LIST_QUICKLIST;
       break;
     case OBJ_SET:
@@ -173,6 +189,8 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
           return RDB_TYPE_SET_WITH_EXPIRY;
         else
           return RDB_TYPE_SET;
+      } else if (compact_enc == kEncodingPackedSet || compact_enc == kEncodingPackedIntSet) {
+        return RDB_TYPE_SET;
       }
       break;
     case OBJ_ZSET:
@@ -196,10 +214,20 @@ uint8_t RdbObjectType(const PrimeValue& pv) {
     case OBJ_MODULE:
       return RDB_TYPE_MODULE_2;
     case OBJ_JSON:
+      if (pv.GetJsonEncoding() == kEncodingJsonFlat)
+        return RDB_TYPE_JSON_FLAT;
       return RDB_TYPE_JSON;  // save with RDB_TYPE_JSON, deprecate RDB_TYPE_JSON_OLD after July
                              // 2024.
     case OBJ_SBF:
       return RDB_TYPE_SBF;
+    case OBJ_CMS:
+      return RDB_TYPE_CMS;
+    case OBJ_TS:
+      return RDB_TYPE_TS;
+    case OBJ_TOPK:
+      return RDB_TYPE_TOPK;
+    case OBJ_TDIGEST:
+      return RDB_TYPE_TDIGEST;
   }
   LOG(FATAL) << "Unknown encoding " << compact_enc << " for type " << type;
   return 0; /* avoid warning */
@@ -370,6 +398,13 @@ io::Result<uint8_t> RdbSerializer::SaveEntry(const PrimeKey& pk, const PrimeValu
     return make_unexpected(ec);
   }
 
+  // The remainder of a chunked entry must not end up inside a compressed blob,
+  // so it's flushed uncompressed as well.
+  if (chunked_entry_) {
+    FlushChunk();
+    chunked_entry_ = false;
+  }
+
   return rdb_type;
 }
 
@@ -405,14 +440,41 @@ error_code RdbSerializer::SaveObject(const PrimeValue& pv) {
     return SaveSBFObject(pv);
   }
 
+  if (obj_type == OBJ_CMS) {
+    return SaveCMSObject(pv);
+  }
+
+  if (obj_type == OBJ_TS) {
+    return SaveTimeSeriesObject(pv);
+  }
+
+  if (obj_type == OBJ_TOPK) {
+    return SaveTopKObject(pv);
+  }
+
+  if (obj_type == OBJ_TDIGEST) {
+    return SaveTDigestObject(pv);
+  }
+
   LOG(ERROR) << "Not implemented " << obj_type;
   return make_error_code(errc::function_not_supported);
 }
 
 error_code RdbSerializer::SaveListObject(const PrimeValue& pv) {
-  /* Save a list value */
+  if (pv.Encoding() == kEncodingChunkedList) {
+    // ChunkedList lists are saved as quicklists, so that the format stays compatible.
+    quicklist* ql = quicklistNew(-2, 0);
+    auto cleanup = absl::MakeCleanup([ql] { quicklistRelease(ql); });
+    static_cast<const ChunkedList*>(pv.RObjPtr())->ToQuicklist(ql);
+    return SaveQuicklist(ql);
+  }
+
   DCHECK_EQ(OBJ_ENCODING_QUICKLIST, pv.Encoding());
-  const quicklist* ql = reinterpret_cast<const quicklist*>(pv.RObjPtr());
+  return SaveQuicklist(reinterpret_cast<const quicklist*>(pv.RObjPtr()));
+}
+
+error_code RdbSerializer::SaveQuicklist(const quicklist* ql) {
+  /* Save a list value */
   quicklistNode* node = ql->head;
   DVLOG(2) << "Saving list of length " << ql->len;
 
@@ -455,6 +517,7 @@ error_code RdbSerializer::SaveListObject(const PrimeValue& pv) {
       });
       RETURN_ON_ERR(SaveListPackAsZiplist(lp));
     }
+    FlushChunkIfNeeded();
     node = node->next;
   }
   return error_code{};
@@ -474,7 +537,33 @@ error_code RdbSerializer::SaveSetObject(const PrimeValue& obj) {
           expiry = it.ExpiryTime();
         RETURN_ON_ERR(SaveLongLongAsString(expiry));
       }
+      FlushChunkIfNeeded();
     }
+  } else if (obj.Encoding() == kEncodingPackedSet) {
+    const PackedStringSet* set = (const PackedStringSet*)obj.RObjPtr();
+
+    RETURN_ON_ERR(SaveLen(set->Size()));
+
+    error_code ec;
+    set->Iterate([&](string_view member) {
+      ec = SaveString(member);
+      return !ec;
+    });
+    RETURN_ON_ERR(ec);
+    FlushChunkIfNeeded();
+  } else if (obj.Encoding() == kEncodingPackedIntSet) {
+    const PackedIntSet* set = (const PackedIntSet*)obj.RObjPtr();
+
+    RETURN_ON_ERR(SaveLen(set->Size()));
+
+    error_code ec;
+    set->Iterate([&](int64_t member) {
+      ec = SaveLongLongAsString(member);
+      if (!ec)
+        FlushChunkIfNeeded();
+      return !ec;
+    });
+    RETURN_ON_ERR(ec);
   } else {
     CHECK_EQ(obj.Encoding(), kEncodingIntSet);
     intset* is = (intset*)obj.RObjPtr();
@@ -504,6 +593,7 @@ error_code RdbSerializer::SaveHSetObject(const PrimeValue& pv) {
           expiry = it.ExpiryTime();
         RETURN_ON_ERR(SaveLongLongAsString(expiry));
       }
+      FlushChunkIfNeeded();
     }
   } else {
     CHECK_EQ(kEncodingListPack, pv.Encoding());
@@ -537,6 +627,7 @@ error_code RdbSerializer::SaveZSetObject(const PrimeValue& pv) {
       ec = SaveBinaryDouble(score);
       if (ec)
         return false;
+      FlushChunkIfNeeded();
       return true;
     });
   } else {
@@ -626,6 +717,12 @@ error_code RdbSerializer::SaveStreamObject(const PrimeValue& pv) {
 }
 
 error_code RdbSerializer::SaveJsonObject(const PrimeValue& pv) {
+  // Flat values are saved as is and loaded without parsing
+  if (pv.GetJsonEncoding() == kEncodingJsonFlat) {
+    auto buf = pv.GetJsonFlat();
+    return SaveString(buf.data(), buf.size());
+  }
+
   auto json_string = pv.GetJson()->to_string();
   return SaveString(json_string);
 }
@@ -634,7 +731,7 @@ std::error_code RdbSerializer::SaveSBFObject(const PrimeValue& pv) {
   SBF* sbf = pv.GetSBF();
 
   // options to allow format mutations in the future.
-  RETURN_ON_ERR(SaveLen(0));  // options - reserved
+  RETURN_ON_ERR(SaveLen(sbf->blocked() ? RDB_SBF_BLOCKED : 0));
   RETURN_ON_ERR(SaveBinaryDouble(sbf->grow_factor()));
   RETURN_ON_ERR(SaveBinaryDouble(sbf->fp_probability()));
   RETURN_ON_ERR(SaveLen(sbf->prev_size()));
@@ -652,6 +749,64 @@ std::error_code RdbSerializer::SaveSBFObject(const PrimeValue& pv) {
   return {};
 }
 
+std::error_code RdbSerializer::SaveCMSObject(const PrimeValue& pv) {
+  CountMinSketch* cms = pv.GetCMS();
+
+  RETURN_ON_ERR(SaveLen(cms->width()));
+  RETURN_ON_ERR(SaveLen(cms->depth()));
+  RETURN_ON_ERR(SaveLen(cms->count()));
+  return SaveString(cms->data());
+}
+
+std::error_code RdbSerializer::SaveTimeSeriesObject(const PrimeValue& pv) {
+  TimeSeries* ts = pv.GetTimeSeries();
+
+  // The chunks are saved compressed, the loader restores their stats by decoding them.
+  RETURN_ON_ERR(SaveLen(ts->chunk_bytes()));
+  RETURN_ON_ERR(SaveLen(ts->num_chunks()));
+  for (size_t i = 0; i < ts->num_chunks(); ++i) {
+    TimeSeries::ChunkBlob chunk = ts->GetChunk(i);
+    RETURN_ON_ERR(SaveLen(chunk.count));
+    RETURN_ON_ERR(SaveLen(chunk.bit_len));
+    RETURN_ON_ERR(SaveString(chunk.data));
+  }
+  return {};
+}
+
+std::error_code RdbSerializer::SaveTopKObject(const PrimeValue& pv) {
+  TopK* topk = pv.GetTopK();
+
+  RETURN_ON_ERR(SaveLen(topk->k()));
+  RETURN_ON_ERR(SaveLen(topk->width()));
+  RETURN_ON_ERR(SaveLen(topk->depth()));
+  RETURN_ON_ERR(SaveBinaryDouble(topk->decay()));
+  RETURN_ON_ERR(SaveString(topk->buckets_data()));
+
+  // The fingerprints of the items are derived from them when they are loaded.
+  auto items = topk->List();
+  RETURN_ON_ERR(SaveLen(items.size()));
+  for (const auto& [item, count] : items) {
+    RETURN_ON_ERR(SaveString(item));
+    RETURN_ON_ERR(SaveLen(count));
+  }
+  return {};
+}
+
+std::error_code RdbSerializer::SaveTDigestObject(const PrimeValue& pv) {
+  TDigest* td = pv.GetTDigest();
+
+  // The buffered values are saved as they are, the loader derives the weights from the blobs.
+  RETURN_ON_ERR(SaveBinaryDouble(td->compression()));
+  RETURN_ON_ERR(SaveBinaryDouble(td->min()));
+  RETURN_ON_ERR(SaveBinaryDouble(td->max()));
+  RETURN_ON_ERR(SaveLen(td->merged_nodes()));
+  RETURN_ON_ERR(SaveLen(td->unmerged_nodes()));
+  RETURN_ON_ERR(SaveLen(td->total_compressions()));
+  RETURN_ON_ERR(SaveString(td->means_data()));
+  RETURN_ON_ERR(SaveString(td->weights_data()));
+  return {};
+}
+
 /* Save a long long value as either an encoded string or a string. */
 error_code RdbSerializer::SaveLongLongAsString(int64_t value) {
   uint8_t buf[32];
@@ -820,6 +975,28 @@ error_code SerializerBase::FlushToSink(io::Sink* s) {
   return error_code{};
 }
 
+void SerializerBase::SetChunkCallback(size_t max_chunk_size, ChunkCb cb) {
+  max_chunk_size_ = max_chunk_size;
+  chunk_cb_ = std::move(cb);
+}
+
+void SerializerBase::FlushChunkIfNeeded() {
+  if (!chunk_cb_ || SerializedLen() < max_chunk_size_)
+    return;
+
+  FlushChunk();
+  chunked_entry_ = true;
+}
+
+void SerializerBase::FlushChunk() {
+  io::Bytes bytes = mem_buf_.InputBuffer();
+  if (bytes.empty())
+    return;
+
+  chunk_cb_(string{io::View(bytes)});
+  mem_buf_.ConsumeInput(bytes.size());
+}
+
 error_code RdbSerializer::FlushToSink(io::Sink* s) {
   RETURN_ON_ERR(SerializerBase::FlushToSink(s));
 
@@ -898,8 +1075,8 @@ io::Bytes SerializerBase::PrepareFlush() {
   if (sz == 0)
     return mem_buf_.InputBuffer();
 
-  if (compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD ||
-      compression_mode_ == CompressionMode::MULTI_ENTRY_LZ4) {
+  if (compression_enabled_ && (compression_mode_ == CompressionMode::MULTI_ENTRY_ZSTD ||
+                               compression_mode_ == CompressionMode::MULTI_ENTRY_LZ4)) {
     CompressBlob();
   }
 
@@ -928,7 +1105,7 @@ error_code SerializerBase::SaveString(string_view val) {
   /* Try LZF compression - under 20 bytes it's unable to compress even
    * aaaaaaaaaaaaaaaaaa so skip it */
   size_t len = val.size();
-  if ((compression_mode_ == CompressionMode::SINGLE_ENTRY) && (len > 20)) {
+  if (compression_enabled_ && compression_mode_ == CompressionMode::SINGLE_ENTRY && len > 20) {
     size_t comprlen, outlen = len;
     tmp_buf_.resize(outlen + 1);
 
@@ -973,7 +1150,8 @@ error_code SerializerBase::SaveLzfBlob(const io::Bytes& src, size_t uncompressed
 
 AlignedBuffer::AlignedBuffer(size_t cap, ::io::Sink* upstream)
     : capacity_(cap), upstream_(upstream) {
-  aligned_buf_ = (char*)mi_malloc_aligned(kBufLen, 4_KB);
+  DCHECK_EQ(0u, cap & kAmask);
+  aligned_buf_ = (char*)mi_malloc_aligned(cap, 4_KB);
 }
 
 AlignedBuffer::~AlignedBuffer() {
@@ -1131,7 +1309,8 @@ RdbSaver::Impl::Impl(bool align_writes, unsigned producers_len, CompressionMode
       channel_{128, producers_len},
       compression_mode_(compression_mode) {
   if (align_writes) {
-    aligned_buf_.emplace(kBufLen, sink);
+    size_t buf_len = (absl::GetFlag(FLAGS_snapshot_direct_write_size) + kAmask) & ~kAmask;
+    aligned_buf_.emplace(max<size_t>(buf_len, 4_KB), sink);
     sink_ = &aligned_buf_.value();
   }
   if (sm == SaveMode::SINGLE_SHARD || sm == SaveMode::SINGLE_SHARD_WITH_SUMMARY) {
@@ -1217,26 +1396,51 @@ error_code RdbSaver::Impl::ConsumeChannel(const Cancellation* cll) {
 
   RecordsPopper records_popper(push_to_sink_with_order_, &channel_);
 
+  // Records that are ready are written together, with a single call to the sink.
+  constexpr size_t kMaxBatchRecords = 64;
+  constexpr size_t kMaxBatchBytes = 1 << 20;
+  vector<SliceSnapshot::DbRecord> batch;
+  vector<iovec> batch_vec;
+
+  auto write_batch = [&] {
+    for (const auto& rec : batch)
+      batch_vec.push_back(iovec{const_cast<char*>(rec.value.data()), rec.value.size()});
+
+    auto before = absl::GetCurrentTimeNanos();
+    io_error = sink_->Write(batch_vec.data(), batch_vec.size());
+    auto& stats = ServerState::tlocal()->stats;
+    stats.rdb_save_usec += (absl::GetCurrentTimeNanos() - before) / 1'000;
+    stats.rdb_save_count++;
+
+    batch.clear();
+    batch_vec.clear();
+  };
+
   // we can not exit on io-error since we spawn fibers that push data.
   // TODO: we may signal them to stop processing and exit asap in case of the error.
   while ((record = records_popper.Pop())) {
     if (io_error || cll->IsCancelled())
       continue;
 
+    size_t batch_bytes = 0;
     do {
       if (cll->IsCancelled())
-        continue;
+        break;
 
       DVLOG(2) << "Pulled " << record->id;
-      auto before = absl::GetCurrentTimeNanos();
-      io_error = sink_->Write(io::Buffer(record->value));
-      auto& stats = ServerState::tlocal()->stats;
-      stats.rdb_save_usec += (absl::GetCurrentTimeNanos() - before) / 1'000;
-      stats.rdb_save_count++;
-      if (io_error) {
-        break;
+      batch_bytes += record->value.size();
+      batch.push_back(std::move(*record));
+      if (batch.size() == kMaxBatchRecords || batch_bytes >= kMaxBatchBytes) {
+        write_batch();
+        batch_bytes = 0;
+        if (io_error)
+          break;
       }
     } while ((record = records_popper.TryPop()));
+
+    if (!io_error && !batch.empty() && !cll->IsCancelled())
+      write_batch();
+    batch.clear();
   }  // while (records_popper.Pop())
 
   for (auto& ptr : shard_snapshots_) {
@@ -1253,6 +1457,10 @@ void RdbSaver::Impl::StartSnapshotting(bool stream_journal, const Cancellation*
   auto& s = GetSnapshot(shard);
   s = std::make_unique<SliceSnapshot>(&shard->db_slice(), &channel_, compression_mode_);
 
+  // Chunks split entries, so they can't be interleaved with records of other shards.
+  if (shard_snapshots_.size() == 1)
+    s->set_max_chunk_size(absl::GetFlag(FLAGS_serialization_max_chunk_size));
+
   s->Start(stream_journal, cll);
 }
 
@@ -1322,11 +1530,8 @@ RdbSaver::SnapshotStats RdbSaver::Impl::GetCurrentSnapshotProgress() const {
   }
 
   shard_set->RunBriefInParallel([&](EngineShard* es) { cb(es->shard_id()); });
-  RdbSaver::SnapshotStats init{0, 0};
-  return std::accumulate(
-      results.begin(), results.end(), init, [](auto init, auto pr) -> RdbSaver::SnapshotStats {
-        return {init.current_keys + pr.current_keys, init.total_keys + pr.total_keys};
-      });
+  return std::accumulate(results.begin(), results.end(), RdbSaver::SnapshotStats{},
+                         [](auto init, const auto& pr) { return init += pr; });
 }
 
 RdbSaver::GlobalData RdbSaver::GetGlobalData(const Service* service) {
@@ -1486,7 +1691,13 @@ error_code RdbSaver::SaveAux(const GlobalData& glob_state) {
       RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("search-index", s));
   }
 
-  // TODO: "repl-stream-db", "repl-id", "repl-offset"
+  if (save_mode_ == SaveMode::SUMMARY && !glob_state.repl_id.empty()) {
+    RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("repl-id", glob_state.repl_id));
+    string lsns = absl::StrJoin(glob_state.repl_lsns, ",");
+    RETURN_ON_ERR(impl_->SaveAuxFieldStrStr("repl-lsns", lsns));
+  }
+
+  // TODO: "repl-stream-db", "repl-offset"
   return error_code{};
 }
 
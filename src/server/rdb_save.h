@@ -9,6 +9,7 @@ extern "C" {
 #include "redis/lzfP.h"
 }
 
+#include <functional>
 #include <optional>
 
 #include "base/pod_array.h"
@@ -19,6 +20,7 @@ extern "C" {
 #include "server/journal/types.h"
 #include "server/table.h"
 
+typedef struct quicklist quicklist;
 typedef struct rax rax;
 typedef struct streamCG streamCG;
 
@@ -74,6 +76,11 @@ class RdbSaver {
   struct GlobalData {
     const StringVec lua_scripts;     // bodies of lua scripts
     const StringVec search_indices;  // ft.create commands to re-create search indices
+
+    // Set for replicas whose replication was stopped, the data matches the journal entries of
+    // the master that were applied. A replica restarted from the snapshot resumes from them.
+    std::string repl_id;
+    std::vector<uint64_t> repl_lsns;  // per master shard
   };
 
   // single_shard - true means that we run RdbSaver on a single shard and we do not use
@@ -115,6 +122,20 @@ class RdbSaver {
   struct SnapshotStats {
     size_t current_keys = 0;
     size_t total_keys = 0;
+    uint64_t busy_usec = 0;     // time the shard threads spent iterating, summed over the shards.
+    uint64_t elapsed_usec = 0;  // time since the iteration started, summed over the shards.
+    size_t cow_bytes = 0;       // serialized before the writes to buckets not yet iterated.
+    size_t cow_buffered_bytes = 0;  // waiting in the serializers to be pushed to the channels.
+
+    SnapshotStats& operator+=(const SnapshotStats& o) {
+      current_keys += o.current_keys;
+      total_keys += o.total_keys;
+      busy_usec += o.busy_usec;
+      elapsed_usec += o.elapsed_usec;
+      cow_bytes += o.cow_bytes;
+      cow_buffered_bytes += o.cow_buffered_bytes;
+      return *this;
+    }
   };
 
   SnapshotStats GetCurrentSnapshotProgress() const;
@@ -170,6 +191,18 @@ class SerializerBase {
     return SaveString(io::View(io::Bytes{buf, len}));
   }
 
+  // While serializing a large container, hands the buffered data to cb whenever it grows beyond
+  // max_chunk_size. Chunks are not compressed and may end in the middle of an entry, so the
+  // consumer must write them to a stream that is not shared with other serializers.
+  using ChunkCb = std::function<void(std::string)>;
+  void SetChunkCallback(size_t max_chunk_size, ChunkCb cb);
+
+  // Disabling the compression makes the serializer write entries and flush its buffer as is,
+  // which is faster. The stream stays readable since every compressed blob is marked.
+  void SetCompressionEnabled(bool enabled) {
+    compression_enabled_ = enabled;
+  }
+
  protected:
   // Prepare internal buffer for flush. Compress it.
   io::Bytes PrepareFlush();
@@ -180,7 +213,12 @@ class SerializerBase {
 
   std::error_code SaveLzfBlob(const ::io::Bytes& src, size_t uncompressed_len);
 
+  // Called between the elements of a container. Passes the buffer to chunk_cb_ if it's too big.
+  void FlushChunkIfNeeded();
+  void FlushChunk();
+
   CompressionMode compression_mode_;
+  bool compression_enabled_ = true;
   io::IoBuf mem_buf_;
   std::unique_ptr<CompressorImpl> compressor_impl_;
 
@@ -195,6 +233,10 @@ class SerializerBase {
   std::optional<CompressionStats> compression_stats_;
   base::PODArray<uint8_t> tmp_buf_;
   std::unique_ptr<LZF_HSLOT[]> lzf_;
+
+  size_t max_chunk_size_ = 0;
+  ChunkCb chunk_cb_;
+  bool chunked_entry_ = false;  // part of the current entry was already passed to chunk_cb_
 };
 
 class RdbSerializer : public SerializerBase {
@@ -225,12 +267,17 @@ class RdbSerializer : public SerializerBase {
  private:
   std::error_code SaveObject(const PrimeValue& pv);
   std::error_code SaveListObject(const PrimeValue& pv);
+  std::error_code SaveQuicklist(const quicklist* ql);
   std::error_code SaveSetObject(const PrimeValue& pv);
   std::error_code SaveHSetObject(const PrimeValue& pv);
   std::error_code SaveZSetObject(const PrimeValue& pv);
   std::error_code SaveStreamObject(const PrimeValue& obj);
   std::error_code SaveJsonObject(const PrimeValue& pv);
   std::error_code SaveSBFObject(const PrimeValue& pv);
+  std::error_code SaveCMSObject(const PrimeValue& pv);
+  std::error_code SaveTimeSeriesObject(const PrimeValue& pv);
+  std::error_code SaveTopKObject(const PrimeValue& pv);
+  std::error_code SaveTDigestObject(const PrimeValue& pv);
 
   std::error_code SaveLongLongAsString(int64_t value);
   std::error_code SaveBinaryDouble(double val);
@@ -11,6 +11,7 @@ extern "C" {
 }
 
 #include <absl/flags/reflection.h>
+#include <absl/time/clock.h>
 #include <mimalloc.h>
 
 #include "base/flags.h"
@@ -33,6 +34,12 @@ using absl::StrCat;
 ABSL_DECLARE_FLAG(int32, list_compress_depth);
 ABSL_DECLARE_FLAG(int32, list_max_listpack_size);
 ABSL_DECLARE_FLAG(dfly::CompressionMode, compression_mode);
+ABSL_DECLARE_FLAG(uint32_t, serialization_max_chunk_size);
+ABSL_DECLARE_FLAG(bool, snapshot_load_mmap);
+ABSL_DECLARE_FLAG(uint32_t, snapshot_direct_write_size);
+ABSL_DECLARE_FLAG(double, snapshot_cpu_share);
+ABSL_DECLARE_FLAG(uint64_t, snapshot_cow_buffer_limit);
+ABSL_DECLARE_FLAG(bool, bf_blocked_layout);
 
 namespace dfly {
 
@@ -172,6 +179,48 @@ TEST_F(RdbTest, ComressionModeSaveDragonflyAndReload) {
   }
 }
 
+TEST_F(RdbTest, SaveLoadChunkedValues) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_serialization_max_chunk_size, 1024);
+
+  for (string_view type : {"LIST", "SET", "HASH", "ZSET"}) {
+    Run({"debug", "populate", "20", type, "16", "RAND", "TYPE", type, "ELEMENTS", "1000"});
+  }
+  Run({"set", "small", "value"});
+  ASSERT_EQ(81, CheckedInt({"dbsize"}));
+
+  for (auto mode : {CompressionMode::NONE, CompressionMode::MULTI_ENTRY_LZ4}) {
+    SetFlag(&FLAGS_compression_mode, mode);
+    RespExpr resp = Run({"save", "df"});
+    ASSERT_EQ(resp, "OK");
+
+    auto save_info = service_->server_family().GetLastSaveInfo();
+    resp = Run({"debug", "load", save_info.file_name});
+    ASSERT_EQ(resp, "OK");
+    ASSERT_EQ(81, CheckedInt({"dbsize"}));
+    EXPECT_EQ(1000, CheckedInt({"llen", "LIST:0"}));
+    EXPECT_EQ(1000, CheckedInt({"scard", "SET:0"}));
+    EXPECT_EQ(1000, CheckedInt({"hlen", "HASH:0"}));
+    EXPECT_EQ(1000, CheckedInt({"zcard", "ZSET:0"}));
+    EXPECT_EQ(Run({"get", "small"}), "value");
+  }
+}
+
+TEST_F(RdbTest, SaveLoadDirectWriteSize) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_direct_write_size, 5000);  // rounded up to 8KB.
+
+  Run({"debug", "populate", "20000", "key", "100"});
+  for (string_view format : {"df", "rdb"}) {
+    ASSERT_EQ(Run({"save", format}), "OK");
+
+    auto save_info = service_->server_family().GetLastSaveInfo();
+    ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+    EXPECT_EQ(20000, CheckedInt({"dbsize"}));
+    EXPECT_EQ(100, CheckedInt({"strlen", "key:19999"}));
+  }
+}
+
 TEST_F(RdbTest, RdbLoaderOnReadCompressedDataShouldNotEnterEnsureReadFlow) {
   SetFlag(&FLAGS_compression_mode, CompressionMode::MULTI_ENTRY_ZSTD);
   for (int i = 0; i < 1000; ++i) {
@@ -257,6 +306,25 @@ TEST_F(RdbTest, ReloadTtl) {
   EXPECT_LT(990, CheckedInt({"ttl", "key"}));
 }
 
+TEST_F(RdbTest, ReloadMmap) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_load_mmap, true);
+
+  Run({"set", "string_key", "val"});
+  Run({"set", "huge_key", string((1 << 17) - 10, 'H')});
+  Run({"rpush", "list_key", "head", string(511, 'a'), "tail"});
+  Run({"debug", "populate", "10000"});
+
+  ASSERT_EQ(Run({"save", "df"}), "OK");
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+
+  EXPECT_EQ(10003, CheckedInt({"dbsize"}));
+  EXPECT_EQ(Run({"get", "string_key"}), "val");
+  EXPECT_EQ((1 << 17) - 10, CheckedInt({"strlen", "huge_key"}));
+  EXPECT_EQ(3, CheckedInt({"llen", "list_key"}));
+}
+
 TEST_F(RdbTest, ReloadExpired) {
   Run({"set", "key", "val"});
   Run({"expire", "key", "2"});
@@ -340,6 +408,87 @@ TEST_F(RdbTest, SaveFlush) {
   EXPECT_EQ(500000, k_v.second);
 }
 
+TEST_F(RdbTest, SaveThrottled) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_cpu_share, 0.2);
+  Run({"debug", "populate", "200000"});
+
+  auto save_fb = pp_->at(1)->LaunchFiber([&] {
+    RespExpr resp = Run({"save", "df"});
+    ASSERT_EQ(resp, "OK");
+  });
+
+  do {
+    usleep(10);
+  } while (!service_->server_family().TEST_IsSaving());
+
+  // Commands keep being served while the snapshot is throttled.
+  for (unsigned i = 0; i < 100; ++i)
+    EXPECT_EQ(Run({"get", "key:1"}), "value:1");
+  EXPECT_THAT(Run({"info", "persistence"}).GetString(), HasSubstr("current_snapshot_cpu_perc:"));
+  save_fb.Join();
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+  EXPECT_EQ(200000, CheckedInt({"dbsize"}));
+}
+
+TEST_F(RdbTest, SaveCowBackpressure) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_cpu_share, 0.2);
+  SetFlag(&FLAGS_snapshot_cow_buffer_limit, 1);
+  Run({"debug", "populate", "200000"});
+
+  auto save_fb = pp_->at(1)->LaunchFiber([&] {
+    RespExpr resp = Run({"save", "df"});
+    ASSERT_EQ(resp, "OK");
+  });
+
+  do {
+    usleep(10);
+  } while (!service_->server_family().TEST_IsSaving());
+
+  // Every write copies its bucket into a buffer that is over the limit, so the writers are
+  // delayed and the copies are not compressed, but the snapshot stays consistent.
+  for (unsigned i = 0; i < 1000; ++i)
+    Run({"set", StrCat("key:", i * 100), "new"});
+  EXPECT_THAT(Run({"info", "persistence"}).GetString(), HasSubstr("current_save_cow_bytes:"));
+  save_fb.Join();
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+  EXPECT_EQ(200000, CheckedInt({"dbsize"}));
+  EXPECT_EQ(Run({"get", "key:199999"}), "value:199999");
+}
+
+TEST_F(RdbTest, SaveChunksBackpressure) {
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_snapshot_cpu_share, 0.2);
+  SetFlag(&FLAGS_snapshot_cow_buffer_limit, 0);
+  SetFlag(&FLAGS_serialization_max_chunk_size, 1024);
+  Run({"debug", "populate", "2000", "HASH", "16", "RAND", "TYPE", "HASH", "ELEMENTS", "200"});
+
+  auto save_fb = pp_->at(1)->LaunchFiber([&] {
+    RespExpr resp = Run({"save", "df"});
+    ASSERT_EQ(resp, "OK");
+  });
+
+  do {
+    usleep(10);
+  } while (!service_->server_family().TEST_IsSaving());
+
+  // Every write copies its bucket as chunks that only the snapshot fiber pushes. Even without
+  // a buffer limit, the writers are delayed once too many of them are queued.
+  for (unsigned i = 0; i < 1000; ++i)
+    Run({"hset", StrCat("HASH:", i * 2), "new", "value"});
+  save_fb.Join();
+
+  auto save_info = service_->server_family().GetLastSaveInfo();
+  ASSERT_EQ(Run({"debug", "load", save_info.file_name}), "OK");
+  EXPECT_EQ(2000, CheckedInt({"dbsize"}));
+  EXPECT_EQ(200, CheckedInt({"hlen", "HASH:1999"}));
+}
+
 TEST_F(RdbTest, SaveManyDbs) {
   Run({"debug", "populate", "50000"});
   pp_->at(1)->Await([&] {
@@ -542,4 +691,181 @@ TEST_F(RdbTest, SBF) {
   EXPECT_THAT(Run({"BF.EXISTS", "k", "1"}), IntArg(1));
 }
 
+TEST_F(RdbTest, CMS) {
+  Run({"CMS.INITBYDIM", "k", "100", "4"});
+  Run({"CMS.INCRBY", "k", "a", "3", "b", "1"});
+  Run({"debug", "reload"});
+  EXPECT_EQ(Run({"type", "k"}), "CMSk-TYPE");
+  auto resp = Run({"CMS.QUERY", "k", "a", "b"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(3), IntArg(1))));
+  resp = Run({"CMS.INFO", "k"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("width", IntArg(100), "depth", IntArg(4), "count",
+                                          IntArg(4))));
+}
+
+TEST_F(RdbTest, TopK) {
+  Run({"TOPK.RESERVE", "k", "3", "50", "4", "0.8"});
+  Run({"TOPK.INCRBY", "k", "a", "5", "b", "2"});
+  Run({"debug", "reload"});
+  EXPECT_EQ(Run({"type", "k"}), "TopK-TYPE");
+  auto resp = Run({"TOPK.LIST", "k", "WITHCOUNT"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("a", IntArg(5), "b", IntArg(2))));
+  resp = Run({"TOPK.INFO", "k"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("k", IntArg(3), "width", IntArg(50), "depth", IntArg(4),
+                                          "decay", "0.8")));
+
+  // The loaded heap keeps working.
+  resp = Run({"TOPK.ADD", "k", "c"});
+  EXPECT_THAT(resp, ArgType(RespExpr::NIL));
+  resp = Run({"TOPK.QUERY", "k", "a", "c"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(1), IntArg(1))));
+}
+
+TEST_F(RdbTest, TDigest) {
+  Run({"TDIGEST.CREATE", "k", "COMPRESSION", "20"});
+  for (unsigned i = 0; i < 1000; ++i)
+    Run({"TDIGEST.ADD", "k", StrCat(i)});
+  string p10 = Run({"TDIGEST.QUANTILE", "k", "0.1"}).GetString();
+  string p90 = Run({"TDIGEST.QUANTILE", "k", "0.9"}).GetString();
+  Run({"TDIGEST.CREATE", "buffered"});
+  Run({"TDIGEST.ADD", "buffered", "1", "2", "3"});
+  Run({"TDIGEST.CREATE", "empty"});
+  Run({"debug", "reload"});
+
+  EXPECT_EQ(Run({"type", "k"}), "TDIS-TYPE");
+  EXPECT_EQ(Run({"TDIGEST.MIN", "k"}), "0");
+  EXPECT_EQ(Run({"TDIGEST.MAX", "k"}), "999");
+  EXPECT_EQ(Run({"TDIGEST.QUANTILE", "k", "0.1"}), p10);
+  EXPECT_EQ(Run({"TDIGEST.QUANTILE", "k", "0.9"}), p90);
+  auto resp = Run({"TDIGEST.INFO", "k"});
+  EXPECT_THAT(resp.GetVec()[1], IntArg(20));
+  EXPECT_THAT(resp.GetVec()[13], IntArg(1000));
+
+  resp = Run({"TDIGEST.INFO", "buffered"});
+  EXPECT_THAT(resp.GetVec()[7], IntArg(3));
+  EXPECT_EQ(Run({"TDIGEST.QUANTILE", "buffered", "0.5"}), "2");
+  EXPECT_EQ(Run({"TDIGEST.MAX", "empty"}), "nan");
+
+  // The loaded digests keep working.
+  Run({"TDIGEST.ADD", "k", "-1"});
+  EXPECT_EQ(Run({"TDIGEST.MIN", "k"}), "-1");
+  Run({"TDIGEST.ADD", "empty", "5"});
+  EXPECT_EQ(Run({"TDIGEST.MIN", "empty"}), "5");
+}
+
+TEST_F(RdbTest, TimeSeries) {
+  Run({"TS.CREATE", "k", "CHUNK_SIZE", "64"});
+  for (unsigned i = 0; i < 100; ++i)
+    Run({"TS.ADD", "k", StrCat(i * 10), StrCat(i)});
+  Run({"debug", "reload"});
+
+  EXPECT_EQ(Run({"type", "k"}), "TSDB-TYPE");
+  EXPECT_THAT(Run({"TS.RANGE", "k", "-", "+"}), ArrLen(100));
+  EXPECT_THAT(Run({"TS.GET", "k"}), RespArray(ElementsAre(IntArg(990), DoubleArg(99))));
+  EXPECT_THAT(Run({"TS.ADD", "k", "1000", "1"}), IntArg(1000));
+}
+
+TEST_F(RdbTest, BlockedSBF) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_bf_blocked_layout, true);
+
+  vector<string> items;
+  for (unsigned i = 0; i < 1000; ++i)
+    items.push_back(StrCat("item", i));
+
+  vector<string_view> cmd = {"BF.MADD", "k"};
+  cmd.insert(cmd.end(), items.begin(), items.end());
+  Run(absl::MakeSpan(cmd));
+  Run({"debug", "reload"});
+
+  // The layout is kept by the snapshot, regardless of the flag.
+  absl::SetFlag(&FLAGS_bf_blocked_layout, false);
+  cmd[0] = "BF.MEXISTS";
+  auto resp = Run(absl::MakeSpan(cmd));
+  ASSERT_THAT(resp, ArrLen(items.size()));
+  for (const auto& val : resp.GetVec())
+    EXPECT_THAT(val, IntArg(1));
+}
+
+// Measures snapshot serialization throughput per value type and compression mode, run with
+// --bench. RdbSaver runs over every shard into a counting sink, so no disk I/O is involved.
+// The fixture is set up outside of gtest, as benchmarks do not run as tests.
+class SnapshotBench : public RdbTest {
+ public:
+  static constexpr unsigned kNumKeys = 5000;
+
+  static void Init() {
+    SetUpTestSuite();
+  }
+
+  void Start(string_view type) {
+    SetUp();
+    Run({"debug", "populate", StrCat(kNumKeys), "key", "64", "RAND", "TYPE", type, "ELEMENTS",
+         "32"});
+    CHECK_EQ(kNumKeys, CheckedInt({"dbsize"}));
+  }
+
+  void Stop() {
+    TearDown();
+  }
+
+  // Returns the number of bytes serialized.
+  size_t Save() {
+    CountingSink sink;
+    atomic_size_t keys{0};
+    shard_set->RunBlockingInParallel([&](EngineShard* shard) {
+      Context cntx;
+      RdbTypeFreqMap freq_map;
+      RdbSaver saver(&sink, SaveMode::SINGLE_SHARD, false);
+      CHECK(!saver.SaveHeader({}));
+      saver.StartSnapshotInShard(false, cntx.GetCancellation(), shard);
+      CHECK(!saver.SaveBody(&cntx, &freq_map));
+      for (const auto& k_v : freq_map)
+        keys += k_v.second;
+    });
+    CHECK_EQ(kNumKeys, keys.load());
+    return sink.bytes.load();
+  }
+
+  void TestBody() final {
+  }
+
+ private:
+  class CountingSink : public io::Sink {
+   public:
+    io::Result<size_t> WriteSome(const iovec* v, uint32_t len) final {
+      size_t res = 0;
+      for (uint32_t i = 0; i < len; ++i)
+        res += v[i].iov_len;
+      bytes += res;
+      return res;
+    }
+
+    atomic_size_t bytes{0};
+  };
+};
+
+static void BM_SnapshotSerialization(benchmark::State& state) {
+  const string_view kTypes[] = {"STRING", "LIST", "SET", "HASH", "ZSET"};
+  const CompressionMode kModes[] = {CompressionMode::NONE, CompressionMode::SINGLE_ENTRY,
+                                    CompressionMode::MULTI_ENTRY_ZSTD,
+                                    CompressionMode::MULTI_ENTRY_LZ4};
+  string_view type = kTypes[state.range(0)];
+
+  absl::FlagSaver fs;
+  SetFlag(&FLAGS_compression_mode, kModes[state.range(1)]);
+  SnapshotBench::Init();
+  SnapshotBench bench;
+  bench.Start(type);
+
+  size_t bytes = 0;
+  for (auto _ : state)
+    bytes += bench.Save();
+
+  bench.Stop();
+  state.SetBytesProcessed(bytes);
+  state.SetLabel(string(type));
+}
+BENCHMARK(BM_SnapshotSerialization)->ArgsProduct({{0, 1, 2, 3, 4}, {0, 1, 2, 3}});
+
 }  // namespace dfly
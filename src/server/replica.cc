@@ -49,6 +49,9 @@ ABSL_FLAG(
 // TODO: Remove this flag on release >= 1.22
 ABSL_FLAG(bool, replica_reconnect_on_master_restart, false,
           "Deprecated - please use --break_replication_on_master_restart.");
+ABSL_FLAG(uint32_t, replica_apply_batch, 64,
+          "Maximal number of journal commands a replica flow applies in one squashed hop. "
+          "1 applies them one by one.");
 
 namespace dfly {
 
@@ -161,6 +164,20 @@ void Replica::Pause(bool pause) {
   Proactor()->Await([&] { is_paused_ = pause; });
 }
 
+void Replica::SetResumeState(ResumeState state) {
+  DCHECK_EQ(state_mask_.load(), 0u);
+  resume_repl_id_ = std::move(state.master_repl_id);
+  last_journal_LSNs_ = std::move(state.lsns);
+}
+
+optional<Replica::ResumeState> Replica::GetResumeState() const {
+  // While replicating, the LSNs are behind the data.
+  if ((state_mask_.load() & R_ENABLED) || !last_journal_LSNs_ ||
+      master_context_.master_repl_id.empty())
+    return nullopt;
+  return ResumeState{master_context_.master_repl_id, *last_journal_LSNs_};
+}
+
 std::error_code Replica::TakeOver(std::string_view timeout, bool save_flag) {
   VLOG(1) << "Taking over";
 
@@ -319,11 +336,16 @@ std::error_code Replica::HandleCapaDflyResp() {
       state_mask_.store(0);
       return make_error_code(errc::connection_aborted);
     }
-    last_journal_LSNs_.reset();
+    // LSNs restored from a snapshot are valid only for the master that sent them.
+    if (resume_repl_id_ != master_repl_id)
+      last_journal_LSNs_.reset();
   }
+  resume_repl_id_.clear();
   master_context_.master_repl_id = master_repl_id;
   master_context_.dfly_session_id = ToSV(LastResponseArgs()[1].GetBuf());
   num_df_flows_ = param_num_flows;
+  if (last_journal_LSNs_ && last_journal_LSNs_->size() != num_df_flows_)
+    last_journal_LSNs_.reset();
 
   if (LastResponseArgs().size() >= 4) {
     PC_RETURN_ON_BAD_RESPONSE(LastResponseArgs()[3].type == RespExpr::INT64);
@@ -333,6 +355,14 @@ std::error_code Replica::HandleCapaDflyResp() {
           << ", sync id: " << master_context_.dfly_session_id << ", num journals: " << num_df_flows_
           << ", version: " << unsigned(master_context_.version);
 
+  // Flows apply their commands independently only if every flow maps to a single local shard.
+  // Otherwise the part of a multi-key command that a flow received spans several local shards and
+  // is scheduled through their queues, where it waits for the commands of the other flows.
+  if (num_df_flows_ != shard_set->size()) {
+    LOG(WARNING) << "Master has " << num_df_flows_ << " shards, while this replica has "
+                 << shard_set->size() << ", multi-key commands will be applied slower";
+  }
+
   return error_code{};
 }
 
@@ -731,6 +761,13 @@ io::Result<bool> DflyShardReplica::StartSyncFlow(BlockingCounter sb, Context* cn
 
   eof_token = ToSV(LastResponseArgs()[1].GetBuf());
 
+  // Masters of version 5 and later report the encoding of the stable sync stream
+  compressed_stream_ = false;
+  if (LastResponseArgs().size() >= 3) {
+    PC_RETURN_ON_BAD_RESPONSE_T(make_unexpected, LastResponseArgs()[2].type == RespExpr::STRING);
+    compressed_stream_ = ToSV(LastResponseArgs()[2].GetBuf()) == "LZ4";
+  }
+
   leftover_buf_->ConsumeInput(read_resp->left_in_buffer);
 
   // We can not discard io_buf because it may contain data
@@ -815,8 +852,9 @@ void DflyShardReplica::StableSyncDflyReadFb(Context* cntx) {
   }
 
   io::PrefixSource ps{prefix, Sock()};
+  JournalFrameSource frame_source{&ps};
 
-  JournalReader reader{&ps, 0};
+  JournalReader reader{compressed_stream_ ? static_cast<io::Source*>(&frame_source) : &ps, 0};
   DCHECK_GE(journal_rec_executed_, 1u);
   TransactionReader tx_reader{journal_rec_executed_.load(std::memory_order_relaxed) - 1};
 
@@ -824,25 +862,46 @@ void DflyShardReplica::StableSyncDflyReadFb(Context* cntx) {
     acks_fb_ = fb2::Fiber("shard_acks", &DflyShardReplica::StableSyncDflyAcksFb, this, cntx);
   }
 
+  // Commands that don't synchronize with other flows are collected while more of the stream is
+  // already buffered and applied together, the batch is flushed before any other entry so that
+  // journal_rec_executed_ never counts commands that were not applied.
+  const size_t max_batch = absl::GetFlag(FLAGS_replica_apply_batch);
+  vector<journal::ParsedEntry::CmdData> batch;
+  DbIndex batch_dbid = 0;
+
   while (!cntx->IsCancelled()) {
     auto tx_data = tx_reader.NextTxData(&reader, cntx);
     if (!tx_data)
       break;
 
     last_io_time_ = Proactor()->GetMonotonicTimeNs();
-    if (tx_data->opcode == journal::Op::LSN) {
+
+    bool is_cmd = tx_data->opcode == journal::Op::COMMAND ||
+                  tx_data->opcode == journal::Op::MULTI_COMMAND ||
+                  tx_data->opcode == journal::Op::EXPIRED;
+    bool batchable = max_batch > 1 && is_cmd && !tx_data->IsGlobalCmd();
+    if (!batch.empty() && (!batchable || tx_data->dbid != batch_dbid))
+      ExecuteBatch(batch_dbid, &batch, cntx);
+
+    if (batchable) {
+      batch_dbid = tx_data->dbid;
+      batch.push_back(std::move(tx_data->command));
+      if (batch.size() >= max_batch || !reader.HasBufferedInput())
+        ExecuteBatch(batch_dbid, &batch, cntx);
+    } else if (tx_data->opcode == journal::Op::LSN) {
       //  Do nothing
     } else if (tx_data->opcode == journal::Op::PING) {
       force_ping_ = true;
       journal_rec_executed_.fetch_add(1, std::memory_order_relaxed);
     } else if (tx_data->opcode == journal::Op::EXEC) {
       journal_rec_executed_.fetch_add(1, std::memory_order_relaxed);
-    } else {
-      ExecuteTx(std::move(*tx_data), cntx);
+    } else if (ExecuteTx(std::move(*tx_data), cntx)) {
       journal_rec_executed_.fetch_add(1, std::memory_order_relaxed);
     }
     shard_replica_waker_.notifyAll();
   }
+
+  ExecuteBatch(batch_dbid, &batch, cntx);
 }
 
 void Replica::RedisStreamAcksFb() {
@@ -916,15 +975,33 @@ DflyShardReplica::~DflyShardReplica() {
   JoinFlow();
 }
 
-void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, Context* cntx) {
-  if (cntx->IsCancelled()) {
+void DflyShardReplica::ExecuteBatch(DbIndex dbid, vector<journal::ParsedEntry::CmdData>* batch,
+                                    Context* cntx) {
+  if (batch->empty())
     return;
+
+  // Commands dropped by the cancellation are not counted, so that a partial sync, even one
+  // resumed from a snapshot, requests them again.
+  if (!cntx->IsCancelled()) {
+    executor_->Execute(dbid, absl::MakeSpan(*batch));
+    journal_rec_executed_.fetch_add(batch->size(), std::memory_order_relaxed);
   }
+  batch->clear();
+}
 
+bool DflyShardReplica::ExecuteTx(TransactionData&& tx_data, Context* cntx) {
+  if (cntx->IsCancelled()) {
+    return false;
+  }
+
+  // Multi-shard transactions are journaled by every participating shard with only its own keys,
+  // so each flow applies its part independently and no barrier is taken for commands like MSET.
+  // Only global commands (FLUSHALL, FLUSHDB, FLUSHSLOTS) touch the keys of all flows and need to
+  // synchronize them. See the shard count check in Greet for when flows still contend.
   if (!tx_data.IsGlobalCmd()) {
     VLOG(2) << "Execute cmd without sync between shards. txid: " << tx_data.txid;
     executor_->Execute(tx_data.dbid, tx_data.command);
-    return;
+    return true;
   }
 
   bool inserted_by_me = multi_shard_exe_->InsertTxToSharedMap(tx_data.txid, tx_data.shard_cnt);
@@ -938,7 +1015,7 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, Context* cntx) {
   multi_shard_data.block->Wait();
   // Check if we woke up due to cancellation.
   if (cntx_.IsCancelled())
-    return;
+    return false;
   VLOG(2) << "Execute txid: " << tx_data.txid << " block wait finished";
 
   VLOG(2) << "Execute txid: " << tx_data.txid << " global command execution";
@@ -946,7 +1023,7 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, Context* cntx) {
   multi_shard_data.barrier.Wait();
   // Check if we woke up due to cancellation.
   if (cntx_.IsCancelled())
-    return;
+    return false;
   // Global command will be executed only from one flow fiber. This ensure corectness of data in
   // replica.
   if (inserted_by_me) {
@@ -955,9 +1032,9 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, Context* cntx) {
   // Wait until exection is done, to make sure we done execute next commands while the global is
   // executed.
   multi_shard_data.barrier.Wait();
-  // Check if we woke up due to cancellation.
+  // Check if we woke up due to cancellation, after the command was executed.
   if (cntx_.IsCancelled())
-    return;
+    return true;
 
   // Erase from map can be done only after all flow fibers executed the transaction commands.
   // The last fiber which will decrease the counter to 0 will be the one to erase the data from
@@ -967,6 +1044,7 @@ void DflyShardReplica::ExecuteTx(TransactionData&& tx_data, Context* cntx) {
   if (val == 1) {
     multi_shard_exe_->Erase(tx_data.txid);
   }
+  return true;
 }
 
 error_code Replica::ParseReplicationHeader(base::IoBuf* io_buf, PSyncResponse* dest) {
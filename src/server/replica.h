@@ -78,6 +78,20 @@ class Replica : ProtocolClient {
     return master_context_.master_repl_id;
   }
 
+  // Journal positions of a master up to which its entries were applied.
+  struct ResumeState {
+    std::string master_repl_id;
+    std::vector<LSN> lsns;  // per master shard
+  };
+
+  // Makes the first sync a partial one from state if it was taken from the same master and the
+  // master still has the LSNs. Must be called before the replication starts.
+  void SetResumeState(ResumeState state);
+
+  // Returns the state to resume from if the replication stopped after reaching stable sync.
+  // Returns nothing while the replication is running, call it after Stop.
+  std::optional<ResumeState> GetResumeState() const;
+
  private: /* Main standalone mode functions */
   // Coordinate state transitions. Spawned by start.
   void MainReplicationFb();
@@ -158,6 +172,7 @@ class Replica : ProtocolClient {
   // A vector of the last executer LSNs when a replication is interrupted.
   // Allows partial sync on reconnects.
   std::optional<std::vector<LSN>> last_journal_LSNs_;
+  std::string resume_repl_id_;  // master of last_journal_LSNs_ restored by SetResumeState
   std::shared_ptr<MultiShardExecution> multi_shard_exe_;
 
   // Guard operations where flows might be in a mixed state (transition/setup)
@@ -203,7 +218,12 @@ class DflyShardReplica : public ProtocolClient {
 
   void StableSyncDflyAcksFb(Context* cntx);
 
-  void ExecuteTx(TransactionData&& tx_data, Context* cntx);
+  // Returns false if the cancellation dropped the entry before it was applied.
+  bool ExecuteTx(TransactionData&& tx_data, Context* cntx);
+
+  // Applies a batch of commands that don't need to synchronize with other flows.
+  void ExecuteBatch(DbIndex dbid, std::vector<journal::ParsedEntry::CmdData>* batch,
+                    Context* cntx);
 
   uint32_t FlowId() const;
 
@@ -214,6 +234,7 @@ class DflyShardReplica : public ProtocolClient {
   MasterContext master_context_;
 
   std::optional<base::IoBuf> leftover_buf_;
+  bool compressed_stream_ = false;  // stable sync stream consists of compressed frames
 
   util::fb2::EventCount shard_replica_waker_;  // waker for trans_data_queue_
 
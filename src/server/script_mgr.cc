@@ -80,6 +80,9 @@ void ScriptMgr::Run(CmdArgList args, ConnectionContext* cntx) {
         "   Lists loaded scripts.",
         "LATENCY",
         "   Prints latency histograms in usec for every called function.",
+        "STATS",
+        "   Prints call counts, latency percentiles in usec, number of commands, dispatch hops",
+        "   and squashed batches for every called function.",
         "HELP"
         "   Prints this help."};
     auto rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
@@ -98,6 +101,9 @@ void ScriptMgr::Run(CmdArgList args, ConnectionContext* cntx) {
   if (subcmd == "LATENCY")
     return LatencyCmd(cntx);
 
+  if (subcmd == "STATS")
+    return StatsCmd(cntx);
+
   if (subcmd == "LOAD" && args.size() == 2)
     return LoadCmd(args, cntx);
 
@@ -185,6 +191,44 @@ void ScriptMgr::ListCmd(ConnectionContext* cntx) const {
   }
 }
 
+void ScriptMgr::StatsCmd(ConnectionContext* cntx) const {
+  absl::flat_hash_map<std::string, pair<ServerState::ScriptStats, base::Histogram>> result;
+  fb2::Mutex mu;
+
+  shard_set->pool()->AwaitFiberOnAll([&](auto* pb) {
+    auto* ss = ServerState::tlocal();
+    lock_guard lk(mu);
+    for (const auto& [sha, stats] : ss->script_stats())
+      result[sha].first += stats;
+    for (const auto& [sha, histo] : ss->call_latency_histos())
+      result[sha].second.Merge(histo);
+  });
+
+  auto rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(result.size());
+  for (const auto& [sha, k_v] : result) {
+    const auto& [stats, histo] = k_v;
+    rb->StartArray(2);
+    rb->SendBulkString(sha);
+
+    rb->StartCollection(7, RedisReplyBuilder::MAP);
+    rb->SendBulkString("calls");
+    rb->SendLong(stats.calls);
+    rb->SendBulkString("total_usec");
+    rb->SendLong(stats.total_usec);
+    rb->SendBulkString("p50_usec");
+    rb->SendLong(histo.Percentile(50));
+    rb->SendBulkString("p99_usec");
+    rb->SendLong(histo.Percentile(99));
+    rb->SendBulkString("commands");
+    rb->SendLong(stats.commands);
+    rb->SendBulkString("hops");
+    rb->SendLong(stats.hops);
+    rb->SendBulkString("squashed");
+    rb->SendLong(stats.squashed);
+  }
+}
+
 void ScriptMgr::LatencyCmd(ConnectionContext* cntx) const {
   absl::flat_hash_map<std::string, base::Histogram> result;
   fb2::Mutex mu;
@@ -257,8 +301,8 @@ io::Result<string, GenericError> ScriptMgr::Insert(string_view body, Interpreter
       body = *async_body;
   }
 
-  string result;
-  Interpreter::AddResult add_result = interpreter->AddFunction(sha, body, &result);
+  string result, bytecode;
+  Interpreter::AddResult add_result = interpreter->AddFunction(sha, body, &result, &bytecode);
   if (add_result == Interpreter::COMPILE_ERR)
     return nonstd::make_unexpected(GenericError{std::move(result)});
 
@@ -271,6 +315,10 @@ io::Result<string, GenericError> ScriptMgr::Insert(string_view body, Interpreter
       it->second.orig_body = CharBufFromSV(orig_body);
   }
 
+  // Interpreters on other threads load the compiled chunk instead of parsing the body again.
+  if (!it->second.bytecode && !bytecode.empty())
+    it->second.bytecode = make_shared<const string>(std::move(bytecode));
+
   UpdateScriptCaches(sha, it->second);
 
   return string{sha};
@@ -282,7 +330,7 @@ optional<ScriptMgr::ScriptData> ScriptMgr::Find(std::string_view sha) const {
 
   lock_guard lk{mu_};
   if (auto it = db_.find(sha); it != db_.end() && it->second.body)
-    return ScriptData{it->second, it->second.body.get(), {}};
+    return ScriptData{it->second, it->second.body.get(), {}, it->second.bytecode};
 
   return std::nullopt;
 }
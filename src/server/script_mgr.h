@@ -7,6 +7,7 @@
 #include <absl/container/flat_hash_map.h>
 
 #include <array>
+#include <memory>
 #include <optional>
 
 #include "server/conn_context.h"
@@ -33,6 +34,7 @@ class ScriptMgr {
   struct ScriptData : public ScriptParams {
     std::string body;       // script source code present in lua interpreter
     std::string orig_body;  // original code, before removing header and adding async
+    std::shared_ptr<const std::string> bytecode;  // compiled body, shared by all threads
   };
 
   struct ScriptKey : public std::array<char, 40> {
@@ -68,6 +70,7 @@ class ScriptMgr {
   void ConfigCmd(CmdArgList args, ConnectionContext* cntx);
   void ListCmd(ConnectionContext* cntx) const;
   void LatencyCmd(ConnectionContext* cntx) const;
+  void StatsCmd(ConnectionContext* cntx) const;
 
   void UpdateScriptCaches(ScriptKey sha, ScriptParams params) const;
 
@@ -75,6 +78,7 @@ class ScriptMgr {
   struct InternalScriptData : public ScriptParams {
     std::unique_ptr<char[]> body{};
     std::unique_ptr<char[]> orig_body{};
+    std::shared_ptr<const std::string> bytecode{};
   };
 
   ScriptParams default_params_;
@@ -4,6 +4,8 @@
 
 #include "server/search/aggregator.h"
 
+#include <absl/strings/str_cat.h>
+
 #include "base/logging.h"
 
 namespace dfly::aggregate {
@@ -91,6 +93,36 @@ Reducer::Func FindReducerFunc(std::string_view name) {
   return it != kReducers.end() ? it->second : Reducer::Func{};
 }
 
+std::optional<SplitReducer> FindSplitReducer(std::string_view name, std::string source_field,
+                                             std::string result_field) {
+  if (name == "COUNT" || name == "SUM") {
+    // Counts of shards are summed up like sums
+    return SplitReducer{{Reducer{std::move(source_field), result_field, FindReducerFunc(name)}},
+                        Reducer{result_field, result_field, FindReducerFunc("SUM")}};
+  }
+
+  if (name == "MIN" || name == "MAX") {
+    return SplitReducer{{Reducer{std::move(source_field), result_field, FindReducerFunc(name)}},
+                        Reducer{result_field, result_field, FindReducerFunc(name)}};
+  }
+
+  if (name == "AVG") {
+    // Shards compute sums and counts, the average is taken only from the totals
+    std::string count_field = absl::StrCat("__count_", result_field);
+    auto sum_func = FindReducerFunc("SUM");
+    auto merge_func = [sum_func, count_field](ValueIterator it) -> Value {
+      double sum = std::get<double>(sum_func(it));
+      double count = std::get<double>(sum_func(it.WithField(count_field)));
+      return sum / count;
+    };
+    return SplitReducer{{Reducer{std::move(source_field), result_field, sum_func},
+                         Reducer{"", count_field, FindReducerFunc("COUNT")}},
+                        Reducer{result_field, result_field, std::move(merge_func)}};
+  }
+
+  return std::nullopt;
+}
+
 PipelineStep MakeGroupStep(absl::Span<const std::string_view> fields,
                            std::vector<Reducer> reducers) {
   return GroupStep{std::vector<std::string>(fields.begin(), fields.end()), std::move(reducers)};
@@ -7,6 +7,7 @@
 #include <absl/container/flat_hash_map.h>
 #include <absl/types/span.h>
 
+#include <optional>
 #include <string>
 #include <variant>
 
@@ -53,6 +54,11 @@ struct ValueIterator {
     return ValueIterator{};
   }
 
+  // Iterator over another field of the remaining documents
+  ValueIterator WithField(std::string_view field) const {
+    return ValueIterator{field, values_};
+  }
+
  private:
   ValueIterator() = default;
 
@@ -69,6 +75,18 @@ struct Reducer {
 // Find reducer function by uppercase name (COUNT, MAX, etc...), empty functor if not found
 Reducer::Func FindReducerFunc(std::string_view name);
 
+// Reducer split for partial aggregation: the partial reducers compute group states from the
+// documents of a single shard and the merge reducer combines group states of all shards.
+struct SplitReducer {
+  std::vector<Reducer> partial;
+  Reducer merge;
+};
+
+// Find split reducer by uppercase name, nullopt if its result can't be merged from partial
+// states (like COUNT_DISTINCT).
+std::optional<SplitReducer> FindSplitReducer(std::string_view name, std::string source_field,
+                                             std::string result_field);
+
 // Make `GROUPBY [fields...]`  with REDUCE step
 PipelineStep MakeGroupStep(absl::Span<const std::string_view> fields,
                            std::vector<Reducer> reducers);
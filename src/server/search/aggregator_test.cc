@@ -103,4 +103,58 @@ TEST(AggregatorTest, GroupWithReduce) {
   EXPECT_EQ(result->at(1).at("distinct-null"), Value{(double)1});
 }
 
+TEST(AggregatorTest, SplitGroupWithReduce) {
+  // Two shards with the documents 0..9 split unevenly
+  std::vector<DocValues> shards[2];
+  for (size_t i = 0; i < 10; i++) {
+    shards[i < 3 ? 0 : 1].push_back(DocValues{
+        {"i", double(i)},
+        {"tag", i % 2 == 0 ? "even" : "odd"},
+    });
+  }
+
+  std::vector<Reducer> partial, merge;
+  for (auto [name, result] : {std::pair{"COUNT", "count"}, std::pair{"SUM", "sum-i"},
+                              std::pair{"MIN", "min-i"}, std::pair{"MAX", "max-i"},
+                              std::pair{"AVG", "avg-i"}}) {
+    auto split = FindSplitReducer(name, "i", result);
+    ASSERT_TRUE(split) << name;
+    partial.insert(partial.end(), split->partial.begin(), split->partial.end());
+    merge.push_back(split->merge);
+  }
+  EXPECT_FALSE(FindSplitReducer("COUNT_DISTINCT", "i", "distinct-i"));
+
+  std::string_view fields[] = {"tag"};
+  PipelineStep partial_step[] = {MakeGroupStep(fields, std::move(partial))};
+  PipelineStep merge_step[] = {MakeGroupStep(fields, std::move(merge))};
+
+  std::vector<DocValues> groups;
+  for (auto& shard : shards) {
+    auto shard_groups = Process(shard, partial_step);
+    ASSERT_TRUE(shard_groups);
+    groups.insert(groups.end(), shard_groups->begin(), shard_groups->end());
+  }
+  EXPECT_EQ(groups.size(), 4);
+
+  auto result = Process(groups, merge_step);
+  ASSERT_TRUE(result);
+  ASSERT_EQ(result->size(), 2);
+
+  if (result->at(0).at("tag") == Value("odd"))
+    std::swap(result->at(0), result->at(1));
+
+  EXPECT_EQ(result->at(0).size(), 6);  // no partial states are left
+  EXPECT_EQ(result->at(0).at("count"), Value{5.0});
+  EXPECT_EQ(result->at(0).at("sum-i"), Value{20.0});
+  EXPECT_EQ(result->at(0).at("min-i"), Value{0.0});
+  EXPECT_EQ(result->at(0).at("max-i"), Value{8.0});
+  EXPECT_EQ(result->at(0).at("avg-i"), Value{4.0});
+
+  EXPECT_EQ(result->at(1).at("count"), Value{5.0});
+  EXPECT_EQ(result->at(1).at("sum-i"), Value{25.0});
+  EXPECT_EQ(result->at(1).at("min-i"), Value{1.0});
+  EXPECT_EQ(result->at(1).at("max-i"), Value{9.0});
+  EXPECT_EQ(result->at(1).at("avg-i"), Value{5.0});
+}
+
 }  // namespace dfly::aggregate
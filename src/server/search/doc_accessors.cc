@@ -134,28 +134,34 @@ struct JsonAccessor::JsonPathContainer {
   variant<json::Path, jsoncons::jsonpath::jsonpath_expression<JsonType>> val;
 };
 
-BaseAccessor::StringList JsonAccessor::GetStrings(string_view active_field) const {
-  auto* path = GetPath(active_field);
-  if (!path)
-    return {};
+bool JsonAccessor::EvaluateField(string_view field,
+                                 absl::FunctionRef<void(const JsonType&)> cb) const {
+  if (auto it = prefetched_.find(field); it != prefetched_.end()) {
+    for (const JsonType* value : it->second)
+      cb(*value);
+    return true;
+  }
 
-  auto path_res = path->Evaluate(json_);
-  if (path_res.empty())
-    return {};
+  auto* path = GetPath(field);
+  if (!path)
+    return false;
 
-  if (path_res.size() == 1) {
-    buf_ = path_res[0].as_string();
-    return {buf_};
-  }
-  buf_.clear();
+  for (const auto& value : path->Evaluate(json_))
+    cb(value);
+  return true;
+}
 
+BaseAccessor::StringList JsonAccessor::GetStrings(string_view active_field) const {
   // First, grow buffer and compute string sizes
+  buf_.clear();
   vector<size_t> sizes;
-  for (const auto& element : path_res) {
+  bool valid = EvaluateField(active_field, [&](const JsonType& element) {
     size_t start = buf_.size();
     buf_ += element.as_string();
     sizes.push_back(buf_.size() - start);
-  }
+  });
+  if (!valid || sizes.empty())
+    return {};
 
   // Reposition start pointers to the most recent allocation of buf
   StringList out(sizes.size());
@@ -170,22 +176,53 @@ BaseAccessor::StringList JsonAccessor::GetStrings(string_view active_field) cons
 }
 
 BaseAccessor::VectorInfo JsonAccessor::GetVector(string_view active_field) const {
-  auto* path = GetPath(active_field);
-  if (!path)
-    return {};
+  // Only the first value is used
+  VectorInfo res{nullptr, 0};
+  bool found = false;
+  EvaluateField(active_field, [&](const JsonType& element) {
+    if (std::exchange(found, true))
+      return;
+
+    size_t size = element.size();
+    auto ptr = make_unique<float[]>(size);
+
+    size_t i = 0;
+    for (const auto& v : element.array_range())
+      ptr[i++] = v.as<float>();
+
+    res = {std::move(ptr), size};
+  });
 
-  auto res = path->Evaluate(json_);
-  if (res.empty())
-    return {nullptr, 0};
+  return res;
+}
+
+void JsonAccessor::PrefetchFields(const search::Schema& schema) {
+  vector<string_view> fields;
+  vector<const json::Path*> paths;
+  for (const auto& [ident, field] : schema.fields) {
+    auto* container = GetPath(ident);
+    auto* path = container ? get_if<json::Path>(&container->val) : nullptr;
+
+    // Function results are temporaries, they are evaluated on demand
+    if (!path || (!path->empty() && path->front().type() == json::SegmentType::FUNCTION))
+      continue;
 
-  size_t size = res[0].size();
-  auto ptr = make_unique<float[]>(size);
+    fields.push_back(ident);
+    paths.push_back(path);
+  }
+
+  prefetched_.clear();
+  for (string_view field : fields)
+    prefetched_[field];
 
-  size_t i = 0;
-  for (const auto& v : res[0].array_range())
-    ptr[i++] = v.as<float>();
+  // No more insertions, so the slots stay in place
+  vector<vector<const JsonType*>*> slots;
+  for (string_view field : fields)
+    slots.push_back(&prefetched_[field]);
 
-  return {std::move(ptr), size};
+  json::EvaluatePaths(paths, json_, [&slots](size_t i, auto, const JsonType& value) {
+    slots[i]->push_back(&value);
+  });
 }
 
 JsonAccessor::JsonPathContainer* JsonAccessor::GetPath(std::string_view field) const {
@@ -249,6 +286,11 @@ unique_ptr<BaseAccessor> GetAccessor(const DbContext& db_cntx, const PrimeValue&
   DCHECK(pv.ObjType() == OBJ_HASH || pv.ObjType() == OBJ_JSON);
 
   if (pv.ObjType() == OBJ_JSON) {
+    if (pv.GetJsonEncoding() == kEncodingJsonFlat) {
+      auto buf = pv.GetJsonFlat();
+      JsonType json = json::FromFlat(flexbuffers::GetRoot(buf.data(), buf.size()));
+      return make_unique<JsonAccessor>(std::move(json));
+    }
     DCHECK(pv.GetJson());
     return make_unique<JsonAccessor>(pv.GetJson());
   }
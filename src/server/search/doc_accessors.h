@@ -5,10 +5,13 @@
 #pragma once
 
 #include <absl/container/flat_hash_map.h>
+#include <absl/functional/function_ref.h>
 #include <absl/types/span.h>
 
+#include <optional>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "core/json/json_object.h"
 #include "core/search/search.h"
@@ -30,6 +33,10 @@ struct BaseAccessor : public search::DocumentAccessor {
   // Serialize selected fields
   virtual SearchDocData Serialize(const search::Schema& schema,
                                   const SearchParams::FieldReturnList& fields) const;
+
+  // Extract the values of all the schema fields ahead, if it is cheaper than one by one
+  virtual void PrefetchFields(const search::Schema& schema) {
+  }
 };
 
 // Accessor for hashes stored with listpack
@@ -68,6 +75,10 @@ struct JsonAccessor : public BaseAccessor {
   explicit JsonAccessor(const JsonType* json) : json_{*json} {
   }
 
+  // Accessor owning a decoded copy of a flat json value
+  explicit JsonAccessor(JsonType&& json) : owned_{std::move(json)}, json_{*owned_} {
+  }
+
   StringList GetStrings(std::string_view field) const override;
   VectorInfo GetVector(std::string_view field) const override;
   SearchDocData Serialize(const search::Schema& schema) const override;
@@ -76,15 +87,25 @@ struct JsonAccessor : public BaseAccessor {
   SearchDocData Serialize(const search::Schema& schema,
                           const SearchParams::FieldReturnList& fields) const override;
 
+  // Evaluates the paths of all the fields in a single traversal of the document
+  void PrefetchFields(const search::Schema& schema) override;
+
   static void RemoveFieldFromCache(std::string_view field);
 
  private:
   /// Parses `field` into a JSON path. Caches the results internally.
   JsonPathContainer* GetPath(std::string_view field) const;
 
+  // Calls cb for every value of field. Returns false if field is not a valid path.
+  bool EvaluateField(std::string_view field, absl::FunctionRef<void(const JsonType&)> cb) const;
+
+  std::optional<JsonType> owned_;
   const JsonType& json_;
   mutable std::string buf_;
 
+  // Values of prefetched fields, they point into json_
+  absl::flat_hash_map<std::string_view, std::vector<const JsonType*>> prefetched_;
+
   // Contains built json paths to avoid parsing them repeatedly
   static thread_local absl::flat_hash_map<std::string, std::unique_ptr<JsonPathContainer>>
       path_cache_;
@@ -17,17 +17,27 @@
 namespace dfly {
 
 using namespace std;
+using namespace util;
 
 namespace {
 
+// Number of keys traversed by a single step of an index build.
+constexpr size_t kBuildChunkKeys = 1024;
+
+// Traverses the table from cursor until it visited at least max_keys keys or reached the end
+// and calls f for the matching documents. Returns the cursor to continue from.
 template <typename F>
-void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
+PrimeTable::Cursor TraverseMatching(const DocIndex& index, const OpArgs& op_args,
+                                    PrimeTable::Cursor cursor, size_t max_keys,
+                                    size_t* scanned_keys, F&& f) {
   auto& db_slice = op_args.shard->db_slice();
   DCHECK(db_slice.IsDbValid(op_args.db_cntx.db_index));
   auto [prime_table, _] = db_slice.GetTables(op_args.db_cntx.db_index);
 
   string scratch;
+  size_t visited = 0;
   auto cb = [&](PrimeTable::iterator it) {
+    ++visited;
     const PrimeValue& pv = it->second;
     if (pv.ObjType() != index.GetObjCode())
       return;
@@ -40,10 +50,12 @@ void TraverseAllMatching(const DocIndex& index, const OpArgs& op_args, F&& f) {
     f(key, accessor.get());
   };
 
-  PrimeTable::Cursor cursor;
   do {
     cursor = prime_table->Traverse(cursor, cb);
-  } while (cursor);
+  } while (cursor && visited < max_keys);
+
+  *scanned_keys += visited;
+  return cursor;
 }
 
 const absl::flat_hash_map<string_view, search::SchemaField::FieldType> kSchemaTypes = {
@@ -108,8 +120,12 @@ string DocIndexInfo::BuildRestoreCommand() const {
         [](monostate) {},
         [out = &out](const search::SchemaField::VectorParams& params) {
           auto sim = params.sim == search::VectorSimilarity::L2 ? "L2" : "COSINE";
-          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", " 6 ", "DIM ", params.dim,
-                          " DISTANCE_METRIC ", sim, " INITIAL_CAP ", params.capacity);
+          bool int8 = params.quantization == search::VectorQuantization::INT8;
+          absl::StrAppend(out, " ", params.use_hnsw ? "HNSW" : "FLAT", int8 ? " 8 " : " 6 ",
+                          "DIM ", params.dim, " DISTANCE_METRIC ", sim, " INITIAL_CAP ",
+                          params.capacity);
+          if (int8)
+            absl::StrAppend(out, " QUANTIZATION INT8");
         },
         [out = &out](const search::SchemaField::TagParams& params) {
           absl::StrAppend(out, " ", "SEPARATOR", " ", string{params.separator});
@@ -159,6 +175,10 @@ string_view ShardDocIndex::DocKeyIndex::Get(DocId id) const {
   return keys_[id];
 }
 
+bool ShardDocIndex::DocKeyIndex::Contains(string_view key) const {
+  return ids_.contains(key);
+}
+
 size_t ShardDocIndex::DocKeyIndex::Size() const {
   return ids_.size();
 }
@@ -175,23 +195,83 @@ ShardDocIndex::ShardDocIndex(shared_ptr<DocIndex> index)
     : base_{std::move(index)}, indices_{{}, nullptr}, key_index_{} {
 }
 
+ShardDocIndex::~ShardDocIndex() {
+  CancelBuild();
+}
+
 void ShardDocIndex::Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr) {
+  CancelBuild();
   key_index_ = DocKeyIndex{};
   indices_ = search::FieldIndices{base_->schema, mr};
 
-  auto cb = [this](string_view key, BaseAccessor* doc) { indices_.Add(key_index_.Add(key), doc); };
-  TraverseAllMatching(*base_, op_args, cb);
+  auto state = make_shared<BuildState>();
+  state->db_index = op_args.db_cntx.db_index;
+  state->total_keys = op_args.shard->db_slice().DbSize(state->db_index);
+
+  if (!BuildStep(op_args, state.get())) {
+    VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix;
+    return;
+  }
+
+  build_state_ = state;
+  EngineShard* shard = op_args.shard;
+  fb2::Fiber("index_build", [this, shard, state = std::move(state)] {
+    ServerState& etl = *ServerState::tlocal();
+    while (true) {
+      ThisFiber::Yield();
+
+      // The index is gone or restarted its build.
+      if (state->cancelled)
+        return;
+
+      if (etl.gstate() == GlobalState::SHUTTING_DOWN ||
+          !shard->db_slice().IsDbValid(state->db_index))
+        break;
+
+      OpArgs op_args{shard, nullptr, DbContext{state->db_index, GetCurrentTimeMs()}};
+      if (!BuildStep(op_args, state.get()))
+        break;
+    }
+
+    build_state_.reset();
+    VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix;
+  }).Detach();
+}
+
+bool ShardDocIndex::BuildStep(const OpArgs& op_args, BuildState* state) {
+  auto cb = [this](string_view key, BaseAccessor* doc) {
+    // Documents written since the build started are already indexed.
+    if (!key_index_.Contains(key)) {
+      doc->PrefetchFields(base_->schema);
+      indices_.Add(key_index_.Add(key), doc);
+    }
+  };
 
-  VLOG(1) << "Indexed " << key_index_.Size() << " docs on " << base_->prefix;
+  state->cursor = TraverseMatching(*base_, op_args, state->cursor, kBuildChunkKeys,
+                                   &state->scanned_keys, cb);
+  return bool(state->cursor);
+}
+
+void ShardDocIndex::CancelBuild() {
+  if (build_state_) {
+    build_state_->cancelled = true;
+    build_state_.reset();
+  }
 }
 
 void ShardDocIndex::AddDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
   auto accessor = GetAccessor(db_cntx, pv);
+  accessor->PrefetchFields(base_->schema);
   indices_.Add(key_index_.Add(key), accessor.get());
 }
 
 void ShardDocIndex::RemoveDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
+  // The build has not reached the document yet.
+  if (IsBuilding() && !key_index_.Contains(key))
+    return;
+
   auto accessor = GetAccessor(db_cntx, pv);
+  accessor->PrefetchFields(base_->schema);
   DocId id = key_index_.Remove(key);
   indices_.Remove(id, accessor.get());
 }
@@ -201,7 +281,7 @@ bool ShardDocIndex::Matches(string_view key, unsigned obj_code) const {
 }
 
 SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& params,
-                                   search::SearchAlgorithm* search_algo) const {
+                                   search::SearchAlgorithm* search_algo, bool load_values) const {
   auto& db_slice = op_args.shard->db_slice();
   auto search_results = search_algo->Search(&indices_, params.limit_offset + params.limit_total);
 
@@ -221,9 +301,12 @@ SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& pa
       continue;
     }
 
-    auto accessor = GetAccessor(op_args.db_cntx, (*it)->second);
-    auto doc_data = params.return_fields ? accessor->Serialize(base_->schema, *params.return_fields)
-                                         : accessor->Serialize(base_->schema);
+    SearchDocData doc_data;
+    if (load_values) {
+      auto accessor = GetAccessor(op_args.db_cntx, (*it)->second);
+      doc_data = params.return_fields ? accessor->Serialize(base_->schema, *params.return_fields)
+                                      : accessor->Serialize(base_->schema);
+    }
 
     auto score = search_results.scores.empty() ? monostate{} : std::move(search_results.scores[i]);
     out.push_back(SerializedSearchDoc{string{key}, std::move(doc_data), std::move(score)});
@@ -233,6 +316,21 @@ SearchResult ShardDocIndex::Search(const OpArgs& op_args, const SearchParams& pa
                       std::move(search_results.profile)};
 }
 
+void ShardDocIndex::LoadValues(const OpArgs& op_args, const SearchParams& params,
+                               absl::Span<SerializedSearchDoc* const> docs) const {
+  auto& db_slice = op_args.shard->db_slice();
+  for (auto* doc : docs) {
+    // The transaction holds the keys since Search, so they are still present
+    auto it = db_slice.FindReadOnly(op_args.db_cntx, doc->key, base_->GetObjCode());
+    if (!it || !IsValid(*it))
+      continue;
+
+    auto accessor = GetAccessor(op_args.db_cntx, (*it)->second);
+    doc->values = params.return_fields ? accessor->Serialize(base_->schema, *params.return_fields)
+                                       : accessor->Serialize(base_->schema);
+  }
+}
+
 vector<absl::flat_hash_map<string, search::SortableValue>> ShardDocIndex::SearchForAggregator(
     const OpArgs& op_args, ArgSlice load_fields, search::SearchAlgorithm* search_algo) const {
   auto& db_slice = op_args.shard->db_slice();
@@ -266,7 +364,17 @@ vector<absl::flat_hash_map<string, search::SortableValue>> ShardDocIndex::Search
 }
 
 DocIndexInfo ShardDocIndex::GetInfo() const {
-  return {*base_, key_index_.Size()};
+  DocIndexInfo info{*base_, key_index_.Size()};
+  if (build_state_) {
+    info.indexing = true;
+    info.percent_indexed =
+        min(1.0, double(build_state_->scanned_keys) / max<size_t>(build_state_->total_keys, 1));
+  }
+  return info;
+}
+
+absl::flat_hash_map<string, search::IndexMemoryStats> ShardDocIndex::GetMemoryStats() const {
+  return indices_.GetMemoryStats();
 }
 
 ShardDocIndices::ShardDocIndices() : local_mr_{ServerState::tlocal()->data_heap()} {
@@ -329,8 +437,36 @@ void ShardDocIndices::AddDoc(string_view key, const DbContext& db_cntx, const Pr
 
 void ShardDocIndices::RemoveDoc(string_view key, const DbContext& db_cntx, const PrimeValue& pv) {
   for (auto& [_, index] : indices_) {
-    if (index->Matches(key, pv.ObjType()))
+    if (index->Matches(key, pv.ObjType())) {
       index->RemoveDoc(key, db_cntx, pv);
+      ++removed_docs_;
+    }
+  }
+}
+
+void ShardDocIndices::CompactStep(uint64_t now_ms) {
+  // Bounds the time taken by a single step when there are many terms with small posting lists
+  constexpr size_t kTermsPerStep = 100;
+  // Only removals leave sparse posting lists behind, and compacting them again and again while
+  // they are still changing just reallocates them.
+  constexpr uint64_t kCompactIntervalMs = 10'000;
+
+  bool starting = !compacting_;
+  if (starting) {
+    if (removed_docs_ == 0 || now_ms < compact_start_ms_ + kCompactIntervalMs)
+      return;
+    removed_docs_ = 0;
+    compact_start_ms_ = now_ms;
+  }
+
+  // Indices that finished the pass are not compacted again until the next one
+  compacting_ = false;
+  for (auto& [_, index] : indices_) {
+    search::FieldIndices& field_indices = index->indices_;
+    if (starting || field_indices.CompactionInProgress()) {
+      compacted_bytes_ += field_indices.Compact(kTermsPerStep);
+      compacting_ |= field_indices.CompactionInProgress();
+    }
   }
 }
 
@@ -343,7 +479,16 @@ SearchStats ShardDocIndices::GetStats() const {
   for (const auto& [_, index] : indices_)
     total_entries += index->GetInfo().num_docs;
 
-  return {GetUsedMemory(), indices_.size(), total_entries};
+  return {GetUsedMemory(), indices_.size(), total_entries, compacted_bytes_};
+}
+
+search::IndexMemoryStats ShardDocIndices::GetMemoryStats() const {
+  search::IndexMemoryStats stats;
+  for (const auto& [_, index] : indices_) {
+    for (const auto& [field, field_stats] : index->GetMemoryStats())
+      stats += field_stats;
+  }
+  return stats;
 }
 
 }  // namespace dfly
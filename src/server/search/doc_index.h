@@ -92,6 +92,10 @@ struct DocIndexInfo {
   DocIndex base_index;
   size_t num_docs = 0;
 
+  // Progress of the background build
+  bool indexing = false;
+  double percent_indexed = 1.0;
+
   // Build original ft.create command that can be used to re-create this index
   std::string BuildRestoreCommand() const;
 };
@@ -109,6 +113,7 @@ class ShardDocIndex {
     DocId Remove(std::string_view key);
 
     std::string_view Get(DocId id) const;
+    bool Contains(std::string_view key) const;
     size_t Size() const;
 
    private:
@@ -118,13 +123,30 @@ class ShardDocIndex {
     DocId last_id_ = 0;
   };
 
+  // State of a build that continues in the background. It is shared with the building fiber,
+  // which stops once the index cancels it.
+  struct BuildState {
+    DbIndex db_index = 0;
+    PrimeTable::Cursor cursor;
+    size_t scanned_keys = 0;
+    size_t total_keys = 0;  // size of the table when the build started
+    bool cancelled = false;
+  };
+
  public:
   // Index must be rebuilt at least once after intialization
   ShardDocIndex(std::shared_ptr<DocIndex> index);
+  ~ShardDocIndex();
 
-  // Perform search on all indexed documents and return results.
+  // Perform search on all indexed documents and return results. If load_values is false, only
+  // keys and scores are returned and the values of the selected documents are loaded later
+  // with LoadValues.
   SearchResult Search(const OpArgs& op_args, const SearchParams& params,
-                      search::SearchAlgorithm* search_algo) const;
+                      search::SearchAlgorithm* search_algo, bool load_values = true) const;
+
+  // Serialize the values of documents returned by Search.
+  void LoadValues(const OpArgs& op_args, const SearchParams& params,
+                  absl::Span<SerializedSearchDoc* const> docs) const;
 
   // Perform search and load requested values - note params might be interpreted differently.
   std::vector<absl::flat_hash_map<std::string, search::SortableValue>> SearchForAggregator(
@@ -138,14 +160,32 @@ class ShardDocIndex {
 
   DocIndexInfo GetInfo() const;
 
+  // Memory used by the indices of every field. Traverses all indices, so it's not part of
+  // GetInfo() that is used for stats.
+  absl::flat_hash_map<std::string, search::IndexMemoryStats> GetMemoryStats() const;
+
+  // Whether documents are still being indexed in the background.
+  bool IsBuilding() const {
+    return bool(build_state_);
+  }
+
  private:
   // Clears internal data. Traverses all matching documents and assigns ids.
+  // The first chunk of documents is indexed immediately, if there are more the traversal
+  // continues in a background fiber that yields to the shard between chunks.
+  // Searches during the build only see the documents indexed so far.
   void Rebuild(const OpArgs& op_args, PMR_NS::memory_resource* mr);
 
+  // Indexes the next chunk of documents. Returns false once all of them were traversed.
+  bool BuildStep(const OpArgs& op_args, BuildState* state);
+
+  void CancelBuild();
+
  private:
   std::shared_ptr<const DocIndex> base_;
   search::FieldIndices indices_;
   DocKeyIndex key_index_;
+  std::shared_ptr<BuildState> build_state_;  // set while building in the background
 };
 
 // Stores shard doc indices by name on a specific shard.
@@ -171,11 +211,22 @@ class ShardDocIndices {
   void AddDoc(std::string_view key, const DbContext& db_cnt, const PrimeValue& pv);
   void RemoveDoc(std::string_view key, const DbContext& db_cnt, const PrimeValue& pv);
 
+  // Compact the next part of posting lists of all indices, called periodically by the shard.
+  // A pass over all the terms starts only after documents were removed, and at most once every
+  // 10 seconds.
+  void CompactStep(uint64_t now_ms);
+
   size_t GetUsedMemory() const;
   SearchStats GetStats() const;  // combines stats for all indices
 
+  search::IndexMemoryStats GetMemoryStats() const;  // combines memory stats for all indices
+
  private:
   MiMemoryResource local_mr_;
+  size_t compacted_bytes_ = 0;
+  size_t removed_docs_ = 0;  // since the start of the last compaction pass
+  uint64_t compact_start_ms_ = 0;
+  bool compacting_ = false;
   absl::flat_hash_map<std::string, std::unique_ptr<ShardDocIndex>> indices_;
 };
 
@@ -5,6 +5,7 @@
 #include "server/search/search_family.h"
 
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/strings/ascii.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_format.h>
@@ -13,7 +14,9 @@
 #include <variant>
 #include <vector>
 
+#include "base/flags.h"
 #include "base/logging.h"
+#include "core/search/ast_expr.h"
 #include "core/search/search.h"
 #include "core/search/vector_utils.h"
 #include "facade/cmd_arg_parser.h"
@@ -29,6 +32,9 @@
 #include "server/transaction.h"
 #include "src/core/overloaded.h"
 
+ABSL_FLAG(uint32_t, search_query_cache_size, 256,
+          "Maximum number of parsed queries cached per index on every thread, 0 to disable");
+
 namespace dfly {
 
 using namespace std;
@@ -79,6 +85,13 @@ search::SchemaField::VectorParams ParseVectorParams(CmdArgParser* parser) {
       continue;
     }
 
+    if (parser->Check("QUANTIZATION").ExpectTail(1)) {
+      params.quantization =
+          parser->ToUpper().Switch("NONE", search::VectorQuantization::NONE, "INT8",
+                                   search::VectorQuantization::INT8);
+      continue;
+    }
+
     if (parser->Check("EF_RUNTIME").ExpectTail(1)) {
       parser->Next<size_t>();
       LOG(WARNING) << "EF_RUNTIME not supported";
@@ -280,6 +293,10 @@ struct AggregateParams {
 
   vector<string_view> load_fields;
   vector<aggregate::PipelineStep> steps;
+
+  // Set if the first step is a group that can be partially aggregated on shards. Then only
+  // group states are sent to the coordinator and the first step merges them.
+  optional<aggregate::PipelineStep> shard_step;
 };
 
 optional<AggregateParams> ParseAggregatorParamsOrReply(CmdArgParser parser,
@@ -303,6 +320,10 @@ optional<AggregateParams> ParseAggregatorParamsOrReply(CmdArgParser parser,
         field = parser.Next();
 
       vector<aggregate::Reducer> reducers;
+      optional<vector<aggregate::SplitReducer>> split_reducers;
+      if (params.steps.empty())
+        split_reducers.emplace();
+
       while (parser.ToUpper().Check("REDUCE").ExpectTail(2)) {
         parser.ToUpper();  // uppercase for func_name
         auto [func_name, nargs] = parser.Next<string_view, size_t>();
@@ -321,10 +342,29 @@ optional<AggregateParams> ParseAggregatorParamsOrReply(CmdArgParser parser,
         parser.ExpectTag("AS");
         string result_field = parser.Next<string>();
 
+        if (split_reducers) {
+          auto split = aggregate::FindSplitReducer(func_name, source_field, result_field);
+          if (split)
+            split_reducers->push_back(std::move(*split));
+          else
+            split_reducers.reset();
+        }
+
         reducers.push_back(aggregate::Reducer{source_field, result_field, std::move(func)});
       }
 
-      params.steps.push_back(aggregate::MakeGroupStep(fields, std::move(reducers)));
+      if (split_reducers) {
+        vector<aggregate::Reducer> partial, merge;
+        for (auto& split : *split_reducers) {
+          partial.insert(partial.end(), make_move_iterator(split.partial.begin()),
+                         make_move_iterator(split.partial.end()));
+          merge.push_back(std::move(split.merge));
+        }
+        params.shard_step = aggregate::MakeGroupStep(fields, std::move(partial));
+        params.steps.push_back(aggregate::MakeGroupStep(fields, std::move(merge)));
+      } else {
+        params.steps.push_back(aggregate::MakeGroupStep(fields, std::move(reducers)));
+      }
       continue;
     }
 
@@ -373,47 +413,39 @@ void SendSerializedDoc(const SerializedSearchDoc& doc, ConnectionContext* cntx)
   }
 }
 
-void ReplyWithResults(const SearchParams& params, absl::Span<SearchResult> results,
-                      ConnectionContext* cntx) {
-  size_t total_count = 0;
+// Documents of the reply and the number of matches reported with them.
+struct SelectedDocs {
+  size_t total = 0;
+  vector<SerializedSearchDoc*> docs;
+};
+
+SelectedDocs SelectUnsorted(const SearchParams& params, absl::Span<SearchResult> results) {
+  SelectedDocs selected;
   for (const auto& shard_docs : results)
-    total_count += shard_docs.total_hits;
+    selected.total += shard_docs.total_hits;
 
   size_t result_count =
-      min(total_count - min(total_count, params.limit_offset), params.limit_total);
-
-  facade::SinkReplyBuilder::ReplyAggregator agg{cntx->reply_builder()};
-
-  bool ids_only = params.IdsOnly();
-  size_t reply_size = ids_only ? (result_count + 1) : (result_count * 2 + 1);
-
-  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->StartArray(reply_size);
-  rb->SendLong(total_count);
+      min(selected.total - min(selected.total, params.limit_offset), params.limit_total);
 
-  size_t sent = 0;
+  // Scoring is not implemented yet, so we just cut them in the order they were retrieved
   size_t to_skip = params.limit_offset;
-  for (const auto& shard_docs : results) {
-    for (const auto& serialized_doc : shard_docs.docs) {
-      // Scoring is not implemented yet, so we just cut them in the order they were retrieved
+  for (auto& shard_docs : results) {
+    for (auto& serialized_doc : shard_docs.docs) {
       if (to_skip > 0) {
         to_skip--;
         continue;
       }
 
-      if (sent++ >= result_count)
-        return;
-
-      if (ids_only)
-        rb->SendBulkString(serialized_doc.key);
-      else
-        SendSerializedDoc(serialized_doc, cntx);
+      if (selected.docs.size() >= result_count)
+        return selected;
+      selected.docs.push_back(&serialized_doc);
     }
   }
+  return selected;
 }
 
-void ReplySorted(search::AggregationInfo agg, const SearchParams& params,
-                 absl::Span<SearchResult> results, ConnectionContext* cntx) {
+SelectedDocs SelectSorted(const search::AggregationInfo& agg, const SearchParams& params,
+                          absl::Span<SearchResult> results) {
   size_t total = 0;
   vector<SerializedSearchDoc*> docs;
   for (auto& shard_results : results) {
@@ -435,30 +467,118 @@ void ReplySorted(search::AggregationInfo agg, const SearchParams& params,
 
   size_t start_idx = min(params.limit_offset, docs.size());
   size_t result_count = min(docs.size() - start_idx, params.limit_total);
+  docs.erase(docs.begin(), docs.begin() + start_idx);
+  docs.resize(result_count);
+
+  return {min(total, agg_limit), std::move(docs)};
+}
+
+// Groups the selected documents by the shard that returned them.
+vector<vector<SerializedSearchDoc*>> SplitByShard(const SelectedDocs& selected,
+                                                  absl::Span<SearchResult> results) {
+  absl::flat_hash_set<const SerializedSearchDoc*> selected_set(selected.docs.begin(),
+                                                               selected.docs.end());
+  vector<vector<SerializedSearchDoc*>> out(results.size());
+  for (size_t sid = 0; sid < results.size(); sid++) {
+    for (auto& doc : results[sid].docs) {
+      if (selected_set.contains(&doc))
+        out[sid].push_back(&doc);
+    }
+  }
+  return out;
+}
+
+// score_alias is the field to return the score in, empty if scores are not returned.
+void ReplyWithDocs(const SelectedDocs& selected, const SearchParams& params,
+                   string_view score_alias, ConnectionContext* cntx) {
   bool ids_only = params.IdsOnly();
+  size_t result_count = selected.docs.size();
   size_t reply_size = ids_only ? (result_count + 1) : (result_count * 2 + 1);
 
-  // Clear score alias if it's excluded from return values
-  if (!params.ShouldReturnField(agg.alias))
-    agg.alias = "";
-
   facade::SinkReplyBuilder::ReplyAggregator agg_reply{cntx->reply_builder()};
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
   rb->StartArray(reply_size);
-  rb->SendLong(min(total, agg_limit));
-  for (auto* doc : absl::MakeSpan(docs).subspan(start_idx, result_count)) {
+  rb->SendLong(selected.total);
+  for (auto* doc : selected.docs) {
     if (ids_only) {
       rb->SendBulkString(doc->key);
       continue;
     }
 
-    if (!agg.alias.empty() && holds_alternative<float>(doc->score))
-      doc->values[agg.alias] = absl::StrCat(get<float>(doc->score));
+    if (!score_alias.empty() && holds_alternative<float>(doc->score))
+      doc->values[score_alias] = absl::StrCat(get<float>(doc->score));
 
     SendSerializedDoc(*doc, cntx);
   }
 }
 
+// Parsed queries, cached on the coordinator thread so that repeated query shapes skip the parser.
+// Parsing does not depend on the schema, so the entries are shared by all indices and stay valid
+// when indices are created, altered or dropped. Parameters are substituted during lexing, so their
+// values are part of the key.
+class QueryCache {
+ public:
+  struct Stats {
+    size_t hits = 0, misses = 0, entries = 0;
+  };
+
+  // Returns the parsed query or nullptr on syntax errors, which are not cached
+  shared_ptr<const search::AstNode> Get(string_view query, const search::QueryParams& params) {
+    size_t limit = absl::GetFlag(FLAGS_search_query_cache_size);
+    if (limit == 0)
+      return search::SearchAlgorithm::Parse(query, &params);
+
+    string key = MakeKey(query, params);
+    if (auto it = entries_.find(key); it != entries_.end()) {
+      stats_.hits++;
+      return it->second;
+    }
+
+    stats_.misses++;
+    auto parsed = search::SearchAlgorithm::Parse(query, &params);
+    if (parsed) {
+      if (entries_.size() >= limit)
+        entries_.clear();
+      entries_.emplace(std::move(key), parsed);
+    }
+    return parsed;
+  }
+
+  Stats GetStats() const {
+    return {stats_.hits, stats_.misses, entries_.size()};
+  }
+
+ private:
+  // Only parameters referenced with $ can change the query, sort them to have a stable key
+  static string MakeKey(string_view query, const search::QueryParams& params) {
+    string key = absl::StrCat(query.size(), ":", query);
+    if (params.Size() == 0 || query.find('$') == string_view::npos)
+      return key;
+
+    vector<pair<string_view, string_view>> sorted(params.begin(), params.end());
+    sort(sorted.begin(), sorted.end());
+    for (const auto& [name, value] : sorted)
+      absl::StrAppend(&key, name.size(), ":", name, value.size(), ":", value);
+    return key;
+  }
+
+  absl::flat_hash_map<string, shared_ptr<const search::AstNode>> entries_;
+  Stats stats_;
+};
+
+thread_local QueryCache tl_query_cache;
+
+QueryCache::Stats GetQueryCacheStats() {
+  atomic_size_t hits{0}, misses{0}, entries{0};
+  shard_set->pool()->AwaitBrief([&](unsigned, util::ProactorBase*) {
+    auto stats = tl_query_cache.GetStats();
+    hits.fetch_add(stats.hits, memory_order_relaxed);
+    misses.fetch_add(stats.misses, memory_order_relaxed);
+    entries.fetch_add(stats.entries, memory_order_relaxed);
+  });
+  return {hits.load(), misses.load(), entries.load()};
+}
+
 }  // namespace
 
 void SearchFamily::FtCreate(CmdArgList args, ConnectionContext* cntx) {
@@ -593,6 +713,7 @@ void SearchFamily::FtDropIndex(CmdArgList args, ConnectionContext* cntx) {
   DCHECK(num_deleted == 0u || num_deleted == shard_set->size());
   if (num_deleted == 0u)
     return cntx->SendError("-Unknown Index name");
+
   return cntx->SendOk();
 }
 
@@ -601,13 +722,16 @@ void SearchFamily::FtInfo(CmdArgList args, ConnectionContext* cntx) {
 
   atomic_uint num_notfound{0};
   vector<DocIndexInfo> infos(shard_set->size());
+  vector<absl::flat_hash_map<string, search::IndexMemoryStats>> memory(shard_set->size());
 
   cntx->transaction->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
     auto* index = es->search_indices()->GetIndex(idx_name);
-    if (index == nullptr)
+    if (index == nullptr) {
       num_notfound.fetch_add(1);
-    else
+    } else {
       infos[es->shard_id()] = index->GetInfo();
+      memory[es->shard_id()] = index->GetMemoryStats();
+    }
     return OpStatus::OK;
   });
 
@@ -620,14 +744,19 @@ void SearchFamily::FtInfo(CmdArgList args, ConnectionContext* cntx) {
          infos.back().base_index.schema.fields.size());
 
   size_t total_num_docs = 0;
-  for (const auto& info : infos)
+  bool indexing = false;
+  double percent_indexed = 0;
+  for (const auto& info : infos) {
     total_num_docs += info.num_docs;
+    indexing |= info.indexing;
+    percent_indexed += info.percent_indexed / infos.size();
+  }
 
   const auto& info = infos.front();
   const auto& schema = info.base_index.schema;
 
   auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
-  rb->StartCollection(4, RedisReplyBuilder::MAP);
+  rb->StartCollection(8, RedisReplyBuilder::MAP);
 
   rb->SendSimpleString("index_name");
   rb->SendSimpleString(idx_name);
@@ -662,6 +791,48 @@ void SearchFamily::FtInfo(CmdArgList args, ConnectionContext* cntx) {
 
   rb->SendSimpleString("num_docs");
   rb->SendLong(total_num_docs);
+
+  rb->SendSimpleString("indexing");
+  rb->SendLong(indexing);
+
+  rb->SendSimpleString("percent_indexed");
+  rb->SendDouble(indexing ? percent_indexed : 1.0);
+
+  // Parsed query cache of all threads, shared by all indices
+  auto cache_stats = GetQueryCacheStats();
+  size_t cache_lookups = cache_stats.hits + cache_stats.misses;
+  rb->SendSimpleString("query_cache");
+  rb->StartCollection(4, RedisReplyBuilder::MAP);
+  rb->SendSimpleString("hits");
+  rb->SendLong(cache_stats.hits);
+  rb->SendSimpleString("misses");
+  rb->SendLong(cache_stats.misses);
+  rb->SendSimpleString("entries");
+  rb->SendLong(cache_stats.entries);
+  rb->SendSimpleString("hit_rate");
+  rb->SendDouble(cache_lookups ? double(cache_stats.hits) / cache_lookups : 0.0);
+
+  // Memory used by the indices of every field, summed over all shards
+  rb->SendSimpleString("memory");
+  rb->StartCollection(schema.fields.size(), RedisReplyBuilder::MAP);
+  for (const auto& [field_ident, field_info] : schema.fields) {
+    search::IndexMemoryStats stats;
+    for (const auto& shard_memory : memory) {
+      if (auto it = shard_memory.find(field_ident); it != shard_memory.end())
+        stats += it->second;
+    }
+
+    rb->SendSimpleString(field_ident);
+    rb->StartCollection(4, RedisReplyBuilder::MAP);
+    rb->SendSimpleString("postings_bytes");
+    rb->SendLong(stats.postings_bytes);
+    rb->SendSimpleString("dictionary_bytes");
+    rb->SendLong(stats.dictionary_bytes);
+    rb->SendSimpleString("vector_bytes");
+    rb->SendLong(stats.vector_bytes);
+    rb->SendSimpleString("sort_bytes");
+    rb->SendLong(stats.sort_bytes);
+  }
 }
 
 void SearchFamily::FtList(CmdArgList args, ConnectionContext* cntx) {
@@ -688,33 +859,61 @@ void SearchFamily::FtSearch(CmdArgList args, ConnectionContext* cntx) {
 
   search::SearchAlgorithm search_algo;
   search::SortOption* sort_opt = params->sort_option.has_value() ? &*params->sort_option : nullptr;
-  if (!search_algo.Init(query_str, &params->query_params, sort_opt))
+  if (!search_algo.Init(tl_query_cache.Get(query_str, params->query_params), sort_opt))
     return cntx->SendError("Query syntax error");
 
+  // Every shard returns up to offset + limit documents, but only limit of them are replied.
+  // With multiple shards, values are serialized in a second hop only for the selected documents.
+  bool load_lazily = !params->IdsOnly() && shard_set->size() > 1;
+
   // Because our coordinator thread may not have a shard, we can't check ahead if the index exists.
   atomic<bool> index_not_found{false};
   vector<SearchResult> docs(shard_set->size());
 
-  cntx->transaction->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
-    if (auto* index = es->search_indices()->GetIndex(index_name); index)
-      docs[es->shard_id()] = index->Search(t->GetOpArgs(es), *params, &search_algo);
-    else
-      index_not_found.store(true, memory_order_relaxed);
-    return OpStatus::OK;
-  });
+  cntx->transaction->Execute(
+      [&](Transaction* t, EngineShard* es) {
+        if (auto* index = es->search_indices()->GetIndex(index_name); index)
+          docs[es->shard_id()] =
+              index->Search(t->GetOpArgs(es), *params, &search_algo, !load_lazily);
+        else
+          index_not_found.store(true, memory_order_relaxed);
+        return OpStatus::OK;
+      },
+      !load_lazily);
 
+  optional<ErrorReply> error;
   if (index_not_found.load())
-    return cntx->SendError(string{index_name} + ": no such index");
+    error = ErrorReply{string{index_name} + ": no such index"};
 
   for (const auto& res : docs) {
-    if (res.error)
-      return cntx->SendError(*res.error);
+    if (!error && res.error)
+      error = *res.error;
+  }
+
+  if (error) {
+    if (load_lazily)
+      cntx->transaction->Conclude();
+    return cntx->SendError(*error);
   }
 
-  if (auto agg = search_algo.HasAggregation(); agg)
-    ReplySorted(std::move(*agg), *params, absl::MakeSpan(docs), cntx);
-  else
-    ReplyWithResults(*params, absl::MakeSpan(docs), cntx);
+  auto agg = search_algo.HasAggregation();
+  auto selected = agg ? SelectSorted(*agg, *params, absl::MakeSpan(docs))
+                      : SelectUnsorted(*params, absl::MakeSpan(docs));
+
+  if (load_lazily) {
+    auto shard_docs = SplitByShard(selected, absl::MakeSpan(docs));
+    cntx->transaction->Execute(
+        [&](Transaction* t, EngineShard* es) {
+          if (auto* index = es->search_indices()->GetIndex(index_name); index)
+            index->LoadValues(t->GetOpArgs(es), *params, shard_docs[es->shard_id()]);
+          return OpStatus::OK;
+        },
+        true);
+  }
+
+  // Clear score alias if it's excluded from return values
+  string_view score_alias = agg && params->ShouldReturnField(agg->alias) ? agg->alias : "";
+  ReplyWithDocs(selected, *params, score_alias, cntx);
 }
 
 void SearchFamily::FtProfile(CmdArgList args, ConnectionContext* cntx) {
@@ -727,7 +926,7 @@ void SearchFamily::FtProfile(CmdArgList args, ConnectionContext* cntx) {
 
   search::SearchAlgorithm search_algo;
   search::SortOption* sort_opt = params->sort_option.has_value() ? &*params->sort_option : nullptr;
-  if (!search_algo.Init(query_str, &params->query_params, sort_opt))
+  if (!search_algo.Init(tl_query_cache.Get(query_str, params->query_params), sort_opt))
     return cntx->SendError("Query syntax error");
 
   search_algo.EnableProfiling();
@@ -804,7 +1003,7 @@ void SearchFamily::FtAggregate(CmdArgList args, ConnectionContext* cntx) {
     return;
 
   search::SearchAlgorithm search_algo;
-  if (!search_algo.Init(params->query, &params->params, nullptr))
+  if (!search_algo.Init(tl_query_cache.Get(params->query, params->params)))
     return cntx->SendError("Query syntax error");
 
   using ResultContainer =
@@ -813,8 +1012,13 @@ void SearchFamily::FtAggregate(CmdArgList args, ConnectionContext* cntx) {
   vector<ResultContainer> query_results(shard_set->size());
   cntx->transaction->ScheduleSingleHop([&](Transaction* t, EngineShard* es) {
     if (auto* index = es->search_indices()->GetIndex(params->index); index) {
-      query_results[es->shard_id()] =
-          index->SearchForAggregator(t->GetOpArgs(es), params->load_fields, &search_algo);
+      auto values = index->SearchForAggregator(t->GetOpArgs(es), params->load_fields, &search_algo);
+      if (params->shard_step) {
+        auto groups = aggregate::Process(std::move(values), {&*params->shard_step, 1});
+        DCHECK(groups.has_value());  // grouping doesn't fail
+        values = std::move(groups.value());
+      }
+      query_results[es->shard_id()] = std::move(values);
     }
     return OpStatus::OK;
   });
@@ -119,7 +119,97 @@ TEST_F(SearchFamilyTest, InfoIndex) {
   EXPECT_THAT(info,
               IsArray(_, _, _, IsArray("key_type", "HASH", "prefix", "doc-"), "attributes",
                       IsArray(IsArray("identifier", "name", "attribute", "name", "type", "TEXT")),
-                      "num_docs", IntArg(15)));
+                      "num_docs", IntArg(15), "indexing", IntArg(0), "percent_indexed", "1",
+                      "query_cache", _, "memory",
+                      IsArray("name", IsArray("postings_bytes", _, "dictionary_bytes", _,
+                                              "vector_bytes", IntArg(0), "sort_bytes", IntArg(0)))));
+
+  auto memory = info.GetVec()[15].GetVec()[1].GetVec();
+  EXPECT_GT(*memory[1].GetInt(), 0);  // postings
+  EXPECT_GT(*memory[3].GetInt(), 0);  // dictionary
+}
+
+TEST_F(SearchFamilyTest, QueryCache) {
+  EXPECT_EQ(Run({"ft.create", "cached", "PREFIX", "1", "doc-", "SCHEMA", "name", "TEXT", "num",
+                 "NUMERIC"}),
+            "OK");
+  Run({"hset", "doc-1", "name", "alpha", "num", "1"});
+  Run({"hset", "doc-2", "name", "beta", "num", "2"});
+
+  auto cache_stats = [this](string_view index = "cached") {
+    auto vec = Run({"ft.info", index}).GetVec();
+    for (size_t i = 0; i + 1 < vec.size(); i += 2) {
+      if (vec[i].GetString() == "query_cache")
+        return vec[i + 1];
+    }
+    return RespExpr{};
+  };
+
+  EXPECT_THAT(Run({"ft.search", "cached", "@num:[1 1]"}), AreDocIds("doc-1"));
+  EXPECT_THAT(Run({"ft.search", "cached", "@num:[1 1]"}), AreDocIds("doc-1"));
+  EXPECT_THAT(cache_stats(), IsArray("hits", IntArg(1), "misses", IntArg(1), "entries", IntArg(1),
+                                     "hit_rate", "0.5"));
+
+  // Parameter values are part of the cached query
+  EXPECT_THAT(Run({"ft.search", "cached", "@name:$n", "PARAMS", "2", "n", "alpha"}),
+              AreDocIds("doc-1"));
+  EXPECT_THAT(Run({"ft.search", "cached", "@name:$n", "PARAMS", "2", "n", "beta"}),
+              AreDocIds("doc-2"));
+  EXPECT_THAT(Run({"ft.search", "cached", "@name:$n", "PARAMS", "2", "n", "beta"}),
+              AreDocIds("doc-2"));
+  EXPECT_THAT(cache_stats(), IsArray("hits", IntArg(2), "misses", IntArg(3), "entries", IntArg(3),
+                                     "hit_rate", _));
+
+  // Syntax errors are not cached
+  EXPECT_THAT(Run({"ft.search", "cached", "@num:["}), ErrArg("Query syntax error"));
+  EXPECT_THAT(cache_stats(), IsArray("hits", IntArg(2), "misses", IntArg(4), "entries", IntArg(3),
+                                     "hit_rate", _));
+
+  // Parsing does not depend on the schema, so cached queries are kept when it changes
+  EXPECT_EQ(Run({"ft.alter", "cached", "schema", "add", "tag", "tag"}), "OK");
+  EXPECT_THAT(Run({"ft.search", "cached", "@num:[1 1]"}), AreDocIds("doc-1"));
+  EXPECT_THAT(cache_stats(), IsArray("hits", IntArg(3), "misses", IntArg(4), "entries", IntArg(3),
+                                     "hit_rate", _));
+
+  // Entries are shared by all indices, including the ones created after a flush
+  Run({"flushall"});
+  EXPECT_EQ(Run({"ft.create", "other", "PREFIX", "1", "doc-", "SCHEMA", "num", "NUMERIC"}), "OK");
+  EXPECT_THAT(Run({"ft.search", "other", "@num:[1 1]"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "missing", "@num:[1 1]"}), ErrArg("missing: no such index"));
+  EXPECT_THAT(cache_stats("other"), IsArray("hits", IntArg(5), "misses", IntArg(4),
+                                            "entries", IntArg(3), "hit_rate", _));
+}
+
+TEST_F(SearchFamilyTest, BackgroundIndexing) {
+  const size_t kNumDocs = 10000;
+  for (size_t i = 0; i < kNumDocs; i++)
+    Run({"hset", absl::StrCat("doc-", i), "num", absl::StrCat(i)});
+
+  EXPECT_EQ(Run({"ft.create", "i1", "PREFIX", "1", "doc-", "SCHEMA", "num", "NUMERIC"}), "OK");
+
+  // Writes during the build are reflected in the index.
+  Run({"del", "doc-1"});
+  Run({"hset", "doc-2", "num", "-1"});
+  Run({"hset", absl::StrCat("doc-", kNumDocs), "num", "-1"});
+
+  auto info_field = [this](string_view field) {
+    auto vec = Run({"ft.info", "i1"}).GetVec();
+    for (size_t i = 0; i + 1 < vec.size(); i += 2) {
+      if (vec[i].GetString() == field)
+        return vec[i + 1];
+    }
+    return RespExpr{};
+  };
+
+  while (info_field("indexing").GetInt() != 0)
+    ThisFiber::SleepFor(1ms);
+
+  EXPECT_THAT(info_field("num_docs"), IntArg(kNumDocs));
+  EXPECT_THAT(info_field("percent_indexed"), "1");
+  EXPECT_THAT(Run({"ft.search", "i1", "@num:[-1 -1]"}),
+              AreDocIds("doc-2", absl::StrCat("doc-", kNumDocs)));
+  EXPECT_THAT(Run({"ft.search", "i1", "@num:[1 1]"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "@num:[5000 5000]"}), AreDocIds("doc-5000"));
 }
 
 TEST_F(SearchFamilyTest, Stats) {
@@ -146,6 +236,23 @@ TEST_F(SearchFamilyTest, Stats) {
   EXPECT_LE(metrics.search_stats.used_memory, 3 * expected_usage);
 }
 
+TEST_F(SearchFamilyTest, CompactAfterRemovals) {
+  EXPECT_EQ(Run({"ft.create", "idx", "ON", "HASH", "SCHEMA", "tag", "TAG"}), "OK");
+  for (size_t i = 0; i < 3000; i++)
+    Run({"hset", absl::StrCat("doc-", i), "tag", "all"});
+
+  // Posting lists are not compacted while documents are only added
+  ThisFiber::SleepFor(50ms);
+  EXPECT_EQ(GetMetrics().search_stats.compacted_bytes, 0u);
+
+  for (size_t i = 0; i < 3000; i++) {
+    if (i % 10 != 0)
+      Run({"del", absl::StrCat("doc-", i)});
+  }
+  ExpectConditionWithinTimeout([&] { return GetMetrics().search_stats.compacted_bytes > 0; });
+  EXPECT_EQ(GetMetrics().search_stats.num_entries, 300u);
+}
+
 // todo: ASAN fails heres on arm
 #ifndef SANITIZERS
 TEST_F(SearchFamilyTest, Simple) {
@@ -223,6 +330,42 @@ TEST_F(SearchFamilyTest, JsonAttributesPaths) {
   EXPECT_THAT(Run({"ft.search", "i1", "yes"}), AreDocIds("k2"));
 }
 
+// All the fields of a document are extracted in one traversal before it is indexed or removed
+TEST_F(SearchFamilyTest, JsonPrefetchedFields) {
+  Run({"json.set", "k1", ".", R"({"t": "red apple", "m": {"tags": ["a", "b"], "score": 5}})"});
+  Run({"json.set", "k2", ".", R"({"t": "green apple", "m": {"tags": ["b"], "score": 7}})"});
+
+  EXPECT_EQ(Run({"ft.create", "i1", "on", "json", "schema", "$.t", "as", "t", "text",
+                 "$.m.tags[*]", "as", "tags", "tag", "$.m.score", "as", "score", "numeric",
+                 "sortable", "$.m.score", "as", "score2", "numeric"}),
+            "OK");
+
+  EXPECT_THAT(Run({"ft.search", "i1", "apple"}), AreDocIds("k1", "k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{a}"}), AreDocIds("k1"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{b}"}), AreDocIds("k1", "k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@score:[6 10]"}), AreDocIds("k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@score2:[0 5]"}), AreDocIds("k1"));
+
+  // Updates remove the values of the old document from all the indices
+  Run({"json.set", "k1", ".",
+       R"({"t": "red cherry", "m": {"tags": ["c"], "score": 9, "h": [3, 9, 4]}})"});
+  EXPECT_THAT(Run({"ft.search", "i1", "apple"}), AreDocIds("k2"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{a}"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{c}"}), AreDocIds("k1"));
+  EXPECT_THAT(Run({"ft.search", "i1", "@score:[0 6]"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "@score2:[8 10]"}), AreDocIds("k1"));
+  EXPECT_THAT(Run({"ft.search", "i1", "*", "SORTBY", "score", "DESC", "LIMIT", "0", "1"}),
+              DocIds(2, vector<string>{"k1"}));
+
+  Run({"del", "k2"});
+  EXPECT_THAT(Run({"ft.search", "i1", "@tags:{b}"}), kNoResults);
+  EXPECT_THAT(Run({"ft.search", "i1", "*"}), AreDocIds("k1"));
+
+  // Function paths are evaluated on demand
+  auto res = Run({"ft.search", "i1", "cherry", "return", "1", "max($.m.h[*])", "as", "max"});
+  EXPECT_THAT(res.GetVec()[2], RespArray(ElementsAre("max", "9")));
+}
+
 // todo: fails on arm build
 #ifndef SANITIZERS
 TEST_F(SearchFamilyTest, JsonArrayValues) {
@@ -595,6 +738,66 @@ TEST_F(SearchFamilyTest, BasicSort) {
                 AreRange(10, 10 - i, 10 - i - 3, "d2:"));
 }
 
+TEST_F(SearchFamilyTest, MultiShardLoadValues) {
+  ASSERT_GT(shard_set->size(), 1u);
+
+  Run({"ft.create", "i1", "prefix", "1", "d:", "schema", "ord", "numeric", "sortable", "name",
+       "tag"});
+  for (size_t i = 0; i < 30; i++)
+    Run({"hset", absl::StrCat("d:", i), "ord", absl::StrCat(i), "name", absl::StrCat("n", i)});
+
+  // Values are loaded in the second hop only for the selected documents, each from its own shard
+  auto resp = Run({"ft.search", "i1", "*", "SORTBY", "ord", "LIMIT", "10", "5", "RETURN", "1",
+                   "name"});
+  ASSERT_THAT(resp, ArrLen(11));
+  auto results = resp.GetVec();
+  EXPECT_THAT(results[0], IntArg(30));
+  for (size_t i = 0; i < 5; i++) {
+    EXPECT_EQ(results[1 + i * 2], absl::StrCat("d:", 10 + i));
+    EXPECT_THAT(results[2 + i * 2], IsArray("name", absl::StrCat("n", 10 + i)));
+  }
+
+  resp = Run({"ft.search", "i1", "@ord:[0 29]", "LIMIT", "3", "7", "RETURN", "1", "name"});
+  ASSERT_THAT(resp, ArrLen(15));
+  results = resp.GetVec();
+  EXPECT_THAT(results[0], IntArg(30));
+  for (size_t i = 1; i < results.size(); i += 2) {
+    string key = results[i].GetString();
+    EXPECT_THAT(results[i + 1], IsArray("name", absl::StrCat("n", key.substr(2))));
+  }
+
+  // Deleted documents leave the indices of all shards
+  for (size_t i = 0; i < 30; i += 2)
+    Run({"del", absl::StrCat("d:", i)});
+  resp = Run({"ft.search", "i1", "*", "SORTBY", "ord", "DESC", "LIMIT", "0", "3", "RETURN", "1",
+              "name"});
+  EXPECT_THAT(resp, IsArray(IntArg(15), "d:29", IsArray("name", "n29"), "d:27",
+                            IsArray("name", "n27"), "d:25", IsArray("name", "n25")));
+
+  resp = Run({"ft.search", "i1", "*", "NOCONTENT", "LIMIT", "0", "4"});
+  EXPECT_THAT(resp, ArrLen(5));
+}
+
+TEST_F(SearchFamilyTest, NumericNan) {
+  Run({"ft.create", "i1", "prefix", "1", "d:", "schema", "ord", "numeric", "sortable"});
+  Run({"hset", "d:1", "ord", "2"});
+  Run({"hset", "d:2", "ord", "nan"});
+  Run({"hset", "d:3", "ord", "-1"});
+
+  // NaN is not a number in the index and sorts like a missing value
+  EXPECT_THAT(Run({"ft.search", "i1", "@ord:[-inf +inf]"}), AreDocIds("d:1", "d:3"));
+  EXPECT_THAT(Run({"ft.search", "i1", "*", "SORTBY", "ord", "LIMIT", "0", "1"}),
+              DocIds(3, vector<string>{"d:3"}));
+  EXPECT_THAT(Run({"ft.search", "i1", "*", "SORTBY", "ord", "LIMIT", "1", "1"}),
+              DocIds(3, vector<string>{"d:2"}));
+
+  // Removing the document leaves no entries behind
+  Run({"del", "d:2"});
+  Run({"hset", "d:4", "ord", "0"});
+  EXPECT_THAT(Run({"ft.search", "i1", "*", "SORTBY", "ord", "LIMIT", "1", "1"}),
+              DocIds(3, vector<string>{"d:4"}));
+}
+
 TEST_F(SearchFamilyTest, FtProfile) {
   Run({"ft.create", "i1", "schema", "name", "text"});
 
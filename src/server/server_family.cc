@@ -5,10 +5,14 @@
 #include "server/server_family.h"
 
 #include <absl/cleanup/cleanup.h>
+#include <absl/container/btree_map.h>
+#include <absl/container/flat_hash_set.h>
 #include <absl/random/random.h>  // for master_replid_ generation.
+#include <absl/strings/escaping.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_join.h>
 #include <absl/strings/str_replace.h>
+#include <absl/strings/str_split.h>
 #include <absl/strings/strip.h>
 #include <croncpp.h>  // cron::cronexpr
 #include <sys/resource.h>
@@ -47,8 +51,10 @@ extern "C" {
 #include "server/error.h"
 #include "server/generic_family.h"
 #include "server/journal/journal.h"
+#include "server/key_event_log.h"
 #include "server/main_service.h"
 #include "server/memory_cmd.h"
+#include "server/numa.h"
 #include "server/protocol_client.h"
 #include "server/rdb_load.h"
 #include "server/rdb_save.h"
@@ -110,6 +116,13 @@ ABSL_FLAG(int32_t, slowlog_log_slower_than, 10000,
           "Add commands slower than this threshold to slow log. The value is expressed in "
           "microseconds and if it's negative - disables the slowlog.");
 ABSL_FLAG(uint32_t, slowlog_max_len, 20, "Slow log maximum length.");
+ABSL_FLAG(uint32_t, latency_monitor_threshold, 0,
+          "Records commands and background cycles that take at least this many milliseconds, "
+          "shown with LATENCY LATEST and LATENCY HISTORY. 0 disables the monitor.");
+ABSL_FLAG(uint32_t, trace_sample_rate, 0,
+          "Records the stages of every N-th command of each thread, shown with DEBUG TRACE. "
+          "0 disables the tracing.");
+ABSL_FLAG(uint32_t, trace_log_max_len, 128, "Maximum number of traced commands kept per thread.");
 
 ABSL_FLAG(string, s3_endpoint, "", "endpoint for s3 snapshots, default uses aws regional endpoint");
 ABSL_FLAG(bool, s3_use_https, true, "whether to use https for s3 endpoints");
@@ -122,12 +135,26 @@ ABSL_FLAG(bool, s3_ec2_metadata, false,
 // usage when writing snapshots to S3, at the expense of security.
 ABSL_FLAG(bool, s3_sign_payload, true,
           "whether to sign the s3 request payload when uploading snapshots");
+ABSL_FLAG(uint64_t, s3_upload_part_size, 8ULL << 20,
+          "size of the parts of s3 snapshot uploads, at least 5MB");
+ABSL_FLAG(uint32_t, s3_upload_concurrency, 4,
+          "number of parts of an s3 snapshot file that are uploaded in parallel");
+
+ABSL_FLAG(bool, snapshot_load_mmap, false,
+          "If true, local snapshot files are loaded through a memory mapping instead of reads. "
+          "Speeds up restarts when the files are still in the page cache.");
+
+ABSL_FLAG(bool, replica_warm_restart, false,
+          "If true, a replica started with --replicaof loads its local snapshot and resumes the "
+          "replication with a partial sync from the journal positions saved in it. Replicas save "
+          "these positions when their replication is stopped before the shutdown snapshot.");
 
 ABSL_FLAG(bool, info_replication_valkey_compatible, false,
           "when true - output valkey compatible values for info-replication");
 
 ABSL_DECLARE_FLAG(int32_t, port);
 ABSL_DECLARE_FLAG(bool, cache_mode);
+ABSL_DECLARE_FLAG(std::string, cache_eviction_policy);
 ABSL_DECLARE_FLAG(uint32_t, hz);
 ABSL_DECLARE_FLAG(bool, tls);
 ABSL_DECLARE_FLAG(string, tls_ca_cert_file);
@@ -463,7 +490,7 @@ void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
         "Client tracking is currently not supported for RESP2. Please use RESP3.");
 
   CmdArgParser parser{args};
-  if (!parser.HasAtLeast(1) || args.size() > 3)
+  if (!parser.HasNext())
     return cntx->SendError(kSyntaxErr);
 
   bool is_on = false;
@@ -476,26 +503,37 @@ void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
   }
 
   bool noloop = false;
+  bool bcast = false;
+  vector<string> prefixes;
 
-  if (parser.HasNext()) {
-    if (parser.Check("OPTIN").IgnoreCase()) {
+  while (parser.HasNext()) {
+    if (option == Tracking::NONE && parser.Check("OPTIN").IgnoreCase()) {
       option = Tracking::OPTIN;
-    } else if (parser.Check("OPTOUT").IgnoreCase()) {
+    } else if (option == Tracking::NONE && parser.Check("OPTOUT").IgnoreCase()) {
       option = Tracking::OPTOUT;
-    } else if (parser.Check("NOLOOP").IgnoreCase()) {
+    } else if (!noloop && parser.Check("NOLOOP").IgnoreCase()) {
       noloop = true;
+    } else if (!bcast && parser.Check("BCAST").IgnoreCase()) {
+      bcast = true;
+    } else if (parser.Check("PREFIX").IgnoreCase().ExpectTail(1)) {
+      prefixes.push_back(parser.Next<string>());
     } else {
+      parser.Error();  // PREFIX without its argument
       return cntx->SendError(kSyntaxErr);
     }
   }
 
-  if (parser.HasNext()) {
-    if (!noloop && parser.Check("NOLOOP").IgnoreCase()) {
-      noloop = true;
-    } else {
-      return cntx->SendError(kSyntaxErr);
-    }
-  }
+  if (!prefixes.empty() && !bcast)
+    return cntx->SendError("ERR PREFIX option requires BCAST mode to be enabled");
+
+  if (bcast && option != Tracking::NONE)
+    return cntx->SendError("ERR OPTIN and OPTOUT are not compatible with BCAST");
+
+  if (bcast && noloop)
+    return cntx->SendError("ERR NOLOOP is not supported in BCAST mode");
+
+  if (bcast && prefixes.empty())
+    prefixes.emplace_back();  // the empty prefix matches all keys
 
   if (is_on) {
     ++cntx->subscriptions;
@@ -504,6 +542,7 @@ void ClientTracking(CmdArgList args, ConnectionContext* cntx) {
   cntx->conn_state.tracking_info_.SetClientTracking(is_on);
   cntx->conn_state.tracking_info_.SetOption(option);
   cntx->conn_state.tracking_info_.SetNoLoop(noloop);
+  cntx->SetTrackingPrefixes(is_on ? std::move(prefixes) : vector<string>{});
   return cntx->SendOk();
 }
 
@@ -671,6 +710,21 @@ optional<ReplicaOfArgs> ReplicaOfArgs::FromCmdArgs(CmdArgList args, ConnectionCo
   return replicaof_args;
 }
 
+// A token of the per shard journal LSNs, e.g. "12,0,7".
+string JoinLsns(const vector<LSN>& lsns) {
+  return absl::StrJoin(lsns, ",");
+}
+
+bool ParseLsnToken(string_view token, vector<LSN>* lsns) {
+  for (string_view part : absl::StrSplit(token, ',')) {
+    LSN lsn;
+    if (!absl::SimpleAtoi(part, &lsn))
+      return false;
+    lsns->push_back(lsn);
+  }
+  return true;
+}
+
 }  // namespace
 
 std::optional<fb2::Fiber> Pause(std::vector<facade::Listener*> listeners, facade::Connection* conn,
@@ -766,6 +820,20 @@ void SetSlowLogMaxLen(util::ProactorPool& pool, uint32_t val) {
       [&val](auto index, auto* context) { ServerState::tlocal()->GetSlowLog().ChangeLength(val); });
 }
 
+void SetTraceOptions(util::ProactorPool& pool) {
+  uint32_t sample_rate = absl::GetFlag(FLAGS_trace_sample_rate);
+  uint32_t max_len = absl::GetFlag(FLAGS_trace_log_max_len);
+  pool.AwaitFiberOnAll([sample_rate, max_len](auto index, auto* context) {
+    ServerState::tlocal()->GetTraceLog().SetOptions(sample_rate, max_len);
+  });
+}
+
+void SetLatencyMonitorThreshold(util::ProactorPool& pool, uint32_t val) {
+  pool.AwaitFiberOnAll([val](auto index, auto* context) {
+    ServerState::tlocal()->GetLatencyMonitor().SetThreshold(val);
+  });
+}
+
 void SetSlowLogThreshold(util::ProactorPool& pool, int32_t val) {
   pool.AwaitFiberOnAll([val](auto index, auto* context) {
     ServerState::tlocal()->log_slower_than_usec = val < 0 ? UINT32_MAX : uint32_t(val);
@@ -805,6 +873,24 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
     return res.has_value();
   });
 
+  SetLatencyMonitorThreshold(service_.proactor_pool(),
+                             absl::GetFlag(FLAGS_latency_monitor_threshold));
+  config_registry.RegisterMutable("latency_monitor_threshold",
+                                  [this](const absl::CommandLineFlag& flag) {
+                                    auto res = flag.TryGet<uint32_t>();
+                                    if (res.has_value())
+                                      SetLatencyMonitorThreshold(service_.proactor_pool(), *res);
+                                    return res.has_value();
+                                  });
+
+  SetTraceOptions(service_.proactor_pool());
+  for (string_view name : {"trace_sample_rate", "trace_log_max_len"}) {
+    config_registry.RegisterMutable(name, [this](const absl::CommandLineFlag& flag) {
+      SetTraceOptions(service_.proactor_pool());
+      return true;
+    });
+  }
+
   // We only reconfigure TLS when the 'tls' config key changes. Therefore to
   // update TLS certs, first update tls_cert_file, then set 'tls true'.
   config_registry.RegisterMutable("tls", [this](const absl::CommandLineFlag& flag) {
@@ -835,7 +921,8 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
     shard_set->pool()->GetNextProactor()->Await([&] { util::aws::Init(); });
     snapshot_storage_ = std::make_shared<detail::AwsS3SnapshotStorage>(
         absl::GetFlag(FLAGS_s3_endpoint), absl::GetFlag(FLAGS_s3_use_https),
-        absl::GetFlag(FLAGS_s3_ec2_metadata), absl::GetFlag(FLAGS_s3_sign_payload));
+        absl::GetFlag(FLAGS_s3_ec2_metadata), absl::GetFlag(FLAGS_s3_sign_payload),
+        absl::GetFlag(FLAGS_s3_upload_part_size), absl::GetFlag(FLAGS_s3_upload_concurrency));
 #else
     LOG(ERROR) << "Compiled without AWS support";
 #endif
@@ -847,8 +934,14 @@ void ServerFamily::Init(util::AcceptServer* acceptor, std::vector<facade::Listen
 
   // check for '--replicaof' before loading anything
   if (ReplicaOfFlag flag = GetFlag(FLAGS_replicaof); flag.has_value()) {
-    service_.proactor_pool().GetNextProactor()->Await(
-        [this, &flag]() { this->Replicate(flag.host, flag.port); });
+    // The replication can not start while loading, so a warm restart waits for the load.
+    if (GetFlag(FLAGS_replica_warm_restart))
+      LoadFromSnapshot();
+    service_.proactor_pool().GetNextProactor()->Await([this, &flag]() {
+      if (load_result_)
+        std::exchange(load_result_, std::nullopt)->Get();
+      this->Replicate(flag.host, flag.port);
+    });
   } else {  // load from snapshot only if --replicaof is empty
     LoadFromSnapshot();
   }
@@ -902,6 +995,13 @@ void ServerFamily::Shutdown() {
 
   if (save_on_shutdown_ && !absl::GetFlag(FLAGS_dbfilename).empty()) {
     shard_set->pool()->GetNextProactor()->Await([this] {
+      // Once the replication stops the data matches the applied LSNs, which the snapshot saves
+      // for a warm restart.
+      if (GetFlag(FLAGS_replica_warm_restart)) {
+        lock_guard lk(replicaof_mu_);
+        if (replica_)
+          replica_->Stop();
+      }
       if (GenericError ec = DoSave(); ec) {
         LOG(WARNING) << "Failed to perform snapshot " << ec.Format();
       }
@@ -957,6 +1057,7 @@ std::optional<fb2::Future<GenericError>> ServerFamily::Load(const std::string& l
   }
 
   RdbLoader::PerformPreLoad(&service_);
+  load_progress_.Reset();
 
   auto& pool = service_.proactor_pool();
 
@@ -1037,26 +1138,45 @@ void ServerFamily::SnapshotScheduling() {
 }
 
 io::Result<size_t> ServerFamily::LoadRdb(const std::string& rdb_file) {
-  error_code ec;
-  io::ReadonlyFileOrError res = snapshot_storage_->OpenReadFile(rdb_file);
-  if (res) {
-    io::FileSource fs(*res);
-
+  auto load = [&](io::Source* src) -> io::Result<size_t> {
     RdbLoader loader{&service_};
-    ec = loader.Load(&fs);
-    if (!ec) {
-      VLOG(1) << "Done loading RDB from " << rdb_file << ", keys loaded: " << loader.keys_loaded();
-      VLOG(1) << "Loading finished after " << strings::HumanReadableElapsedTime(loader.load_time());
-      return loader.keys_loaded();
+    loader.set_progress(&load_progress_);
+    if (error_code ec = loader.Load(src); ec)
+      return nonstd::make_unexpected(ec);
+
+    if (!loader.repl_id().empty() && !loader.repl_lsns().empty()) {
+      lock_guard lk(replicaof_mu_);
+      loaded_resume_state_ = Replica::ResumeState{loader.repl_id(), loader.repl_lsns()};
     }
-  } else {
-    ec = res.error();
+
+    VLOG(1) << "Done loading RDB from " << rdb_file << ", keys loaded: " << loader.keys_loaded();
+    VLOG(1) << "Loading finished after " << strings::HumanReadableElapsedTime(loader.load_time());
+    return loader.keys_loaded();
+  };
+
+  if (GetFlag(FLAGS_snapshot_load_mmap) && !IsCloudPath(rdb_file)) {
+    auto res = detail::MappedFileSource::Open(rdb_file);
+    if (!res)
+      return nonstd::make_unexpected(res.error());
+
+    load_progress_.bytes_total.fetch_add((*res)->Size(), memory_order_relaxed);
+    return load(res->get());
   }
-  return nonstd::make_unexpected(ec);
+
+  io::ReadonlyFileOrError res = snapshot_storage_->OpenReadFile(rdb_file);
+  if (!res)
+    return nonstd::make_unexpected(res.error());
+
+  io::FileSource fs(*res);
+  load_progress_.bytes_total.fetch_add((*res)->Size(), memory_order_relaxed);
+  return load(&fs);
 }
 
 enum MetricType { COUNTER, GAUGE, SUMMARY, HISTOGRAM };
 
+// Bounds the cardinality of the memory profile metric.
+constexpr size_t kMetricsTopPrefixes = 20;
+
 const char* MetricTypeName(MetricType type) {
   switch (type) {
     case MetricType::COUNTER:
@@ -1142,6 +1262,10 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
                             MetricType::GAUGE, &resp->body());
   AppendMetricWithoutLabels("pipeline_commands_total", "", conn_stats.pipelined_cmd_cnt,
                             MetricType::COUNTER, &resp->body());
+  AppendMetricWithoutLabels("request_pool_hits_total", "", conn_stats.request_pool_hits,
+                            MetricType::COUNTER, &resp->body());
+  AppendMetricWithoutLabels("request_pool_misses_total", "", conn_stats.request_pool_misses,
+                            MetricType::COUNTER, &resp->body());
   AppendMetricWithoutLabels("pipeline_commands_duration_seconds", "",
                             conn_stats.pipelined_cmd_latency * 1e-6, MetricType::COUNTER,
                             &resp->body());
@@ -1186,6 +1310,10 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
   for (const auto& db_stats : m.db_stats) {
     total += db_stats;
   }
+  AppendMetricWithoutLabels("table_splits_total", "", total.table_splits, MetricType::COUNTER,
+                            &resp->body());
+  AppendMetricWithoutLabels("table_split_seconds_total", "", total.table_split_usec * 1e-6,
+                            MetricType::COUNTER, &resp->body());
 
   {
     string type_used_memory_metric;
@@ -1204,6 +1332,17 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
     if (added)
       absl::StrAppend(&resp->body(), type_used_memory_metric);
   }
+  if (!m.memory_profile.empty()) {
+    AppendMetricHeader("memory_profile_bytes",
+                       "Estimated memory of the key prefixes with the most memory",
+                       MetricType::GAUGE, &resp->body());
+    for (const auto& [key, bytes] : MemoryProfile::Top(m.memory_profile, kMetricsTopPrefixes)) {
+      string prefix = absl::CEscape(key.first);
+      AppendMetricValue("memory_profile_bytes", bytes, {"prefix", "type"},
+                        {prefix, CompactObj::ObjTypeToString(key.second)}, &resp->body());
+    }
+  }
+
   if (!m.replication_metrics.empty()) {
     ReplicationMemoryStats repl_mem;
     dfly_cmd->GetReplicationMemoryStats(&repl_mem);
@@ -1232,6 +1371,8 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
                             &resp->body());
   AppendMetricWithoutLabels("lua_blocked_total", "", m.lua_stats.blocked_cnt, MetricType::COUNTER,
                             &resp->body());
+  AppendMetricWithoutLabels("lua_gc_steps_total", "", m.lua_stats.gc_steps, MetricType::COUNTER,
+                            &resp->body());
 
   // Net metrics
   AppendMetricWithoutLabels("net_input_bytes_total", "", conn_stats.io_read_bytes,
@@ -1257,9 +1398,47 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
   // DB stats
   AppendMetricWithoutLabels("expired_keys_total", "", m.events.expired_keys, MetricType::COUNTER,
                             &resp->body());
+  AppendMetricWithoutLabels("expired_fields_total", "", m.events.expired_fields,
+                            MetricType::COUNTER, &resp->body());
   AppendMetricWithoutLabels("evicted_keys_total", "", m.events.evicted_keys, MetricType::COUNTER,
                             &resp->body());
 
+  // Per shard and per thread stats, to spot imbalanced shards and threads.
+  {
+    string shard_metrics;
+    auto append_shard = [&](string_view name, MetricType type, auto get) {
+      AppendMetricHeader(name, "", type, &shard_metrics);
+      for (size_t i = 0; i < m.thread_metrics.size(); ++i) {
+        if (m.thread_metrics[i].has_shard)
+          AppendMetricValue(name, get(m.thread_metrics[i]), {"shard"}, {absl::StrCat(i)},
+                            &shard_metrics);
+      }
+    };
+    append_shard("shard_memory_used_bytes", MetricType::GAUGE,
+                 [](const auto& tm) { return tm.used_memory; });
+    append_shard("shard_keys", MetricType::GAUGE, [](const auto& tm) { return tm.key_count; });
+    append_shard("shard_expiring_keys", MetricType::GAUGE,
+                 [](const auto& tm) { return tm.expire_count; });
+    append_shard("shard_tiered_entries", MetricType::GAUGE,
+                 [](const auto& tm) { return tm.tiered_entries; });
+    append_shard("shard_evicted_keys_total", MetricType::COUNTER,
+                 [](const auto& tm) { return tm.evicted_keys; });
+    append_shard("shard_tx_queue_length", MetricType::GAUGE,
+                 [](const auto& tm) { return tm.tx_queue_len; });
+
+    auto append_thread = [&](string_view name, MetricType type, auto get) {
+      AppendMetricHeader(name, "", type, &shard_metrics);
+      for (size_t i = 0; i < m.thread_metrics.size(); ++i)
+        AppendMetricValue(name, get(m.thread_metrics[i]), {"thread"}, {absl::StrCat(i)},
+                          &shard_metrics);
+    };
+    append_thread("thread_connected_clients", MetricType::GAUGE,
+                  [](const auto& tm) { return tm.connected_clients; });
+    append_thread("thread_commands_processed_total", MetricType::COUNTER,
+                  [](const auto& tm) { return tm.commands_processed; });
+    absl::StrAppend(&resp->body(), shard_metrics);
+  }
+
   // Command stats
   if (!m.cmd_stats_map.empty()) {
     string command_metrics;
@@ -1272,10 +1451,67 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
       AppendMetricValue("commands_total", calls, {"cmd"}, {name}, &command_metrics);
       AppendMetricValue("commands_duration_seconds", duration_seconds, {"cmd"}, {name},
                         &command_metrics);
+      if (auto it = m.cmd_cpu_map.find(name); it != m.cmd_cpu_map.end()) {
+        AppendMetricValue("commands_shard_cpu_seconds", it->second.cpu_ns * 1e-9, {"cmd"}, {name},
+                          &command_metrics);
+      }
     }
     absl::StrAppend(&resp->body(), command_metrics);
   }
 
+  if (!m.script_stats_map.empty()) {
+    string script_metrics;
+
+    AppendMetricHeader("lua_script", "Metrics for lua scripts by sha", MetricType::COUNTER,
+                       &script_metrics);
+    for (const auto& [sha, stats] : m.script_stats_map) {
+      AppendMetricValue("lua_script_calls_total", stats.calls, {"sha"}, {sha}, &script_metrics);
+      AppendMetricValue("lua_script_duration_seconds", stats.total_usec * 1e-6, {"sha"}, {sha},
+                        &script_metrics);
+      AppendMetricValue("lua_script_commands_total", stats.commands, {"sha"}, {sha},
+                        &script_metrics);
+      AppendMetricValue("lua_script_hops_total", stats.hops, {"sha"}, {sha}, &script_metrics);
+      AppendMetricValue("lua_script_squashed_total", stats.squashed, {"sha"}, {sha},
+                        &script_metrics);
+    }
+    absl::StrAppend(&resp->body(), script_metrics);
+  }
+
+  if (!m.user_throttle_map.empty()) {
+    string user_metrics;
+
+    AppendMetricHeader("user_throttled", "Commands delayed by the rate limits of their user",
+                       MetricType::COUNTER, &user_metrics);
+    for (const auto& [user, stats] : m.user_throttle_map) {
+      AppendMetricValue("user_throttled_commands_total", stats.delayed, {"user"}, {user},
+                        &user_metrics);
+      AppendMetricValue("user_throttled_delay_seconds", stats.delay_usec * 1e-6, {"user"}, {user},
+                        &user_metrics);
+    }
+    absl::StrAppend(&resp->body(), user_metrics);
+  }
+
+  if (!m.tx_latency_map.empty()) {
+    string tx_metrics;
+
+    AppendMetricHeader("tx_latency_seconds",
+                       "Transaction latency by command and phase: schedule, wait, exec",
+                       MetricType::SUMMARY, &tx_metrics);
+    for (const auto& [name, stats] : m.tx_latency_map) {
+      for (const auto& [phase, hist] : {pair{"schedule", &stats.schedule_usec},
+                                        pair{"wait", &stats.wait_usec},
+                                        pair{"exec", &stats.exec_usec}}) {
+        for (const auto& [quantile, percentile] :
+             {pair{"0.5", 50.0}, pair{"0.99", 99.0}, pair{"0.999", 99.9}}) {
+          AppendMetricValue("tx_latency_seconds", hist->Percentile(percentile) * 1e-6,
+                            {"cmd", "phase", "quantile"}, {name, phase, quantile}, &tx_metrics);
+        }
+      }
+      AppendMetricValue("tx_latency_seconds_count", stats.calls, {"cmd"}, {name}, &tx_metrics);
+    }
+    absl::StrAppend(&resp->body(), tx_metrics);
+  }
+
   if (!m.replication_metrics.empty()) {
     string replication_lag_metrics;
     AppendMetricHeader("connected_replica_lag_records", "Lag in records of a connected replica.",
@@ -1321,6 +1557,20 @@ void PrintPrometheusMetrics(const Metrics& m, DflyCmd* dfly_cmd, StringResponse*
       absl::StrAppend(&resp->body(), str);
   }
 
+  if (m.coordinator_stats.tx_multikey_cnt > 0) {
+    string str;
+    AppendMetricHeader("transaction_multikey_total",
+                       "Multi key transactions by whether they spanned a single shard",
+                       MetricType::COUNTER, &str);
+    const auto& cs = m.coordinator_stats;
+    AppendMetricValue("transaction_multikey_total", cs.tx_multikey_single_shard_cnt, {"span"},
+                      {"single"}, &str);
+    AppendMetricValue("transaction_multikey_total",
+                      cs.tx_multikey_cnt - cs.tx_multikey_single_shard_cnt, {"span"}, {"multi"},
+                      &str);
+    absl::StrAppend(&resp->body(), str);
+  }
+
   string db_key_metrics;
   string db_key_expire_metrics;
 
@@ -1364,6 +1614,13 @@ void ServerFamily::PauseReplication(bool pause) {
   }
 }
 
+optional<Replica::ResumeState> ServerFamily::GetStoppedReplicaState() const {
+  unique_lock lk(replicaof_mu_);
+  if (replica_ == nullptr)
+    return nullopt;
+  return replica_->GetResumeState();
+}
+
 std::optional<ReplicaOffsetInfo> ServerFamily::GetReplicaOffsetInfo() {
   unique_lock lk(replicaof_mu_);
 
@@ -1473,8 +1730,13 @@ GenericError ServerFamily::DoSaveCheckAndStart(bool new_version, string_view bas
                           "SAVING - can not save database"};
     }
 
-    save_controller_ = make_unique<SaveStagesController>(detail::SaveStagesInputs{
-        new_version, basename, trans, &service_, fq_threadpool_.get(), snapshot_storage_});
+    detail::SaveStagesInputs inputs{
+        new_version, basename, trans, &service_, fq_threadpool_.get(), snapshot_storage_};
+    if (optional<Replica::ResumeState> resume = GetStoppedReplicaState(); resume) {
+      inputs.repl_id_ = std::move(resume->master_repl_id);
+      inputs.repl_lsns_ = std::move(resume->lsns);
+    }
+    save_controller_ = make_unique<SaveStagesController>(std::move(inputs));
 
     auto res = save_controller_->InitResourcesAndStart();
 
@@ -1881,12 +2143,18 @@ static void MergeDbSliceStats(const DbSlice::Stats& src, Metrics* dest) {
 
   dest->events += src.events;
   dest->small_string_bytes += src.small_string_bytes;
+  dest->small_string_table_full += src.small_string_table_full;
+  dest->key_prefix_bytes += src.key_prefix_bytes;
+  dest->compressed_string_bytes += src.compressed_string_bytes;
+  dest->compressed_string_raw_bytes += src.compressed_string_raw_bytes;
+  dest->pending_rehash_buckets += src.pending_rehash_buckets;
 }
 
 void ServerFamily::ResetStat() {
   shard_set->pool()->AwaitBrief(
       [registry = service_.mutable_registry(), this](unsigned index, auto*) {
         registry->ResetCallStats(index);
+        ServerState::tlocal()->ResetTxLatencyStats();
         SinkReplyBuilder::ResetThreadLocalStats();
         auto& stats = tl_facade_stats->conn_stats;
         stats.command_cnt = 0;
@@ -1894,6 +2162,7 @@ void ServerFamily::ResetStat() {
 
         EngineShard* shard = EngineShard::tlocal();
         shard->db_slice().ResetEvents();
+        shard->cmd_cpu_stats().clear();
         tl_facade_stats->conn_stats.conn_received_cnt = 0;
         tl_facade_stats->conn_stats.pipelined_cmd_cnt = 0;
         tl_facade_stats->conn_stats.command_cnt = 0;
@@ -1920,10 +2189,35 @@ Metrics ServerFamily::GetMetrics() const {
     sum += stat.second;
   };
 
+  result.thread_metrics.resize(service_.proactor_pool().size());
+
   auto cb = [&](unsigned index, ProactorBase* pb) {
     EngineShard* shard = EngineShard::tlocal();
     ServerState* ss = ServerState::tlocal();
 
+    // The shard stats are computed before taking the lock, so that the threads are not serialized
+    // on them. The thread slot is written only by its own thread.
+    optional<DbSlice::Stats> slice_stats;
+    optional<TieredStats> tiered_stats;
+    Metrics::ThreadMetrics& thread_metrics = result.thread_metrics[index];
+    thread_metrics.connected_clients = tl_facade_stats->conn_stats.num_conns;
+    thread_metrics.commands_processed = tl_facade_stats->conn_stats.command_cnt;
+    if (shard) {
+      slice_stats = shard->db_slice().GetStats();
+      if (shard->tiered_storage())
+        tiered_stats = shard->tiered_storage()->GetStats();
+
+      thread_metrics.has_shard = true;
+      thread_metrics.used_memory = shard->UsedMemory();
+      for (const auto& db_stats : slice_stats->db_stats) {
+        thread_metrics.key_count += db_stats.key_count;
+        thread_metrics.expire_count += db_stats.expire_count;
+        thread_metrics.tiered_entries += db_stats.tiered_entries;
+      }
+      thread_metrics.evicted_keys = slice_stats->events.evicted_keys;
+      thread_metrics.tx_queue_len = shard->txq()->size();
+    }
+
     lock_guard lk(mu);
 
     result.fiber_switch_cnt += fb2::FiberSwitchEpoch();
@@ -1934,6 +2228,12 @@ Metrics ServerFamily::GetMetrics() const {
     result.worker_fiber_count += fb2::WorkerFibersCount();
 
     result.coordinator_stats.Add(ss->stats);
+    for (const auto& [sha, stats] : ss->script_stats())
+      result.script_stats_map[sha] += stats;
+    for (const auto& [cmd, stats] : ss->tx_latency_stats())
+      result.tx_latency_map[absl::AsciiStrToLower(cmd)] += stats;
+    for (const auto& [user, stats] : ss->user_throttle_stats())
+      result.user_throttle_map[user] += stats;
 
     result.uptime = time(NULL) - this->start_time_;
     result.qps += uint64_t(ss->MovingSum6());
@@ -1941,18 +2241,27 @@ Metrics ServerFamily::GetMetrics() const {
     result.serialization_bytes += SliceSnapshot::GetThreadLocalMemoryUsage();
 
     if (shard) {
-      result.heap_used_bytes += shard->UsedMemory();
-      MergeDbSliceStats(shard->db_slice().GetStats(), &result);
+      result.heap_used_bytes += thread_metrics.used_memory;
+      MergeDbSliceStats(*slice_stats, &result);
       result.shard_stats += shard->stats();
+      result.lazyfree_pending_objects += shard->lazyfree_pending_objects();
+      for (const auto& [cmd, stats] : shard->cmd_cpu_stats())
+        result.cmd_cpu_map[absl::AsciiStrToLower(cmd)] += stats;
 
-      if (shard->tiered_storage()) {
-        result.tiered_stats += shard->tiered_storage()->GetStats();
+      if (tiered_stats) {
+        result.tiered_stats += *tiered_stats;
       }
 
       if (shard->search_indices()) {
         result.search_stats += shard->search_indices()->GetStats();
       }
 
+      const DbSlice& db_slice = shard->db_slice();
+      for (DbIndex db = 0; db < db_slice.db_array_size(); ++db) {
+        if (db_slice.IsDbValid(db) && db_slice.GetDBTable(db)->memory_profile)
+          db_slice.GetDBTable(db)->memory_profile->Aggregate(1, &result.memory_profile);
+      }
+
       result.traverse_ttl_per_sec += shard->GetMovingSum6(EngineShard::TTL_TRAVERSE);
       result.delete_ttl_per_sec += shard->GetMovingSum6(EngineShard::TTL_DELETE);
       if (result.tx_queue_len < shard->txq()->size())
@@ -2041,6 +2350,7 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
 
   if (should_enter("CLIENTS")) {
     append("connected_clients", m.facade_stats.conn_stats.num_conns);
+    append("connected_tls_clients", m.facade_stats.conn_stats.num_tls_conns);
     append("max_clients", GetFlag(FLAGS_maxclients));
     append("client_read_buffer_bytes", m.facade_stats.conn_stats.read_buf_capacity);
     append("blocked_clients", m.facade_stats.conn_stats.num_blocked_clients);
@@ -2067,6 +2377,8 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("maxmemory_human", HumanReadableNumBytes(max_memory_limit));
 
     append("used_memory_lua", m.lua_stats.used_bytes);
+    append("lazyfree_pending_objects", m.lazyfree_pending_objects);
+    append("lazyfreed_objects", m.shard_stats.lazyfree_freed_total);
 
     // Blob - all these cases where the key/objects are represented by a single blob allocated on
     // heap. For example, strings or intsets. members of lists, sets, zsets etc
@@ -2082,12 +2394,21 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     }
     append("table_used_memory", total.table_mem_usage);
     append("num_buckets", total.bucket_count);
+    append("table_splits", total.table_splits);
+    append("table_split_usec", total.table_split_usec);
     append("num_entries", total.key_count);
     append("inline_keys", total.inline_keys);
     append("listpack_blobs", total.listpack_blob_cnt);
     append("listpack_bytes", total.listpack_bytes);
     append("small_string_bytes", m.small_string_bytes);
+    append("small_string_table_full", m.small_string_table_full);
+    append("key_prefix_bytes", m.key_prefix_bytes);
+    append("compressed_string_bytes", m.compressed_string_bytes);
+    append("compressed_string_raw_bytes", m.compressed_string_raw_bytes);
+    append("pending_rehash_buckets", m.pending_rehash_buckets);
     append("pipeline_cache_bytes", m.facade_stats.conn_stats.pipeline_cmd_cache_bytes);
+    append("request_pool_hits", m.facade_stats.conn_stats.request_pool_hits);
+    append("request_pool_misses", m.facade_stats.conn_stats.request_pool_misses);
     append("dispatch_queue_bytes", m.facade_stats.conn_stats.dispatch_queue_bytes);
     append("dispatch_queue_subscriber_bytes",
            m.facade_stats.conn_stats.dispatch_queue_subscriber_bytes);
@@ -2100,6 +2421,7 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
       append("cache_mode", "cache");
       // PHP Symphony needs this field to work.
       append("maxmemory_policy", "eviction");
+      append("cache_eviction_policy", GetFlag(FLAGS_cache_eviction_policy));
     } else {
       append("cache_mode", "store");
       // Compatible with redis based frameworks.
@@ -2140,6 +2462,7 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("instantaneous_output_kbps", -1);
     append("rejected_connections", -1);
     append("expired_keys", m.events.expired_keys);
+    append("expired_fields", m.events.expired_fields);
     append("evicted_keys", m.events.evicted_keys);
     append("hard_evictions", m.events.hard_evictions);
     append("garbage_checked", m.events.garbage_checked);
@@ -2151,6 +2474,11 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("delete_ttl_sec", m.delete_ttl_per_sec);
     append("keyspace_hits", m.events.hits);
     append("keyspace_misses", m.events.misses);
+    if (GetFlag(FLAGS_cache_mode)) {
+      // Measures the eviction policy, as misses of evicted keys are not told apart.
+      uint64_t lookups = m.events.hits + m.events.misses;
+      append("cache_hit_ratio", lookups ? double(m.events.hits) / lookups : 0.0);
+    }
     append("keyspace_mutations", m.events.mutations);
     append("total_reads_processed", conn_stats.io_read_cnt);
     append("total_writes_processed", reply_stats.io_write_cnt);
@@ -2165,6 +2493,7 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
 
     append("lua_interpreter_cnt", m.lua_stats.interpreter_cnt);
     append("lua_blocked", m.lua_stats.blocked_cnt);
+    append("lua_gc_steps", m.lua_stats.gc_steps);
   }
 
   if (should_enter("TIERED", true)) {
@@ -2175,12 +2504,26 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("tiered_total_fetches", m.tiered_stats.total_fetches);
     append("tiered_total_cancels", m.tiered_stats.total_cancels);
     append("tiered_total_deletes", m.tiered_stats.total_deletes);
+    append("tiered_total_defrags", m.tiered_stats.total_defrags);
     append("tiered_total_stash_overflows", m.tiered_stats.total_stash_overflows);
+    append("tiered_compressed_raw_bytes", m.tiered_stats.total_compressed_raw_bytes);
+    append("tiered_compressed_stored_bytes", m.tiered_stats.total_compressed_stored_bytes);
+    if (m.tiered_stats.total_compressed_stored_bytes > 0) {
+      append("tiered_compression_ratio",
+             double(m.tiered_stats.total_compressed_raw_bytes) /
+                 m.tiered_stats.total_compressed_stored_bytes);
+    }
     append("tiered_heap_buf_allocations", m.tiered_stats.total_heap_buf_allocs);
     append("tiered_registered_buf_allocations", m.tiered_stats.total_registered_buf_allocs);
+    append("tiered_total_disk_reads", m.tiered_stats.total_disk_reads);
+    append("tiered_total_disk_read_usec", m.tiered_stats.total_disk_read_usec);
+    append("tiered_total_disk_writes", m.tiered_stats.total_disk_writes);
+    append("tiered_total_disk_write_usec", m.tiered_stats.total_disk_write_usec);
 
     append("tiered_allocated_bytes", m.tiered_stats.allocated_bytes);
     append("tiered_capacity_bytes", m.tiered_stats.capacity_bytes);
+    append("tiered_file_free_bytes", m.tiered_stats.file_free_bytes);
+    append("tiered_file_fragmented_bytes", m.tiered_stats.file_fragmented_bytes);
 
     append("tiered_pending_read_cnt", m.tiered_stats.pending_read_cnt);
     append("tiered_pending_stash_cnt", m.tiered_stats.pending_stash_cnt);
@@ -2188,12 +2531,15 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("tiered_small_bins_cnt", m.tiered_stats.small_bins_cnt);
     append("tiered_small_bins_entries_cnt", m.tiered_stats.small_bins_entries_cnt);
     append("tiered_small_bins_filling_bytes", m.tiered_stats.small_bins_filling_bytes);
+    append("tiered_small_bins_fragmented_bytes", m.tiered_stats.small_bins_fragmented_bytes);
   }
 
   if (should_enter("PERSISTENCE", true)) {
     size_t current_snap_keys = 0;
     size_t total_snap_keys = 0;
     double perc = 0;
+    double cpu_perc = 0;
+    size_t cow_bytes = 0, cow_buffered_bytes = 0;
     bool is_saving = false;
     uint32_t curent_durration_sec = 0;
     {
@@ -2207,12 +2553,20 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
           total_snap_keys = res.total_keys;
           perc = (static_cast<double>(current_snap_keys) / total_snap_keys) * 100;
         }
+        if (res.elapsed_usec != 0)
+          cpu_perc = (static_cast<double>(res.busy_usec) / res.elapsed_usec) * 100;
+        cow_bytes = res.cow_bytes;
+        cow_buffered_bytes = res.cow_buffered_bytes;
       }
     }
 
     append("current_snapshot_perc", perc);
     append("current_save_keys_processed", current_snap_keys);
     append("current_save_keys_total", total_snap_keys);
+    append("current_snapshot_cpu_perc", cpu_perc);
+    append("current_save_cow_bytes", cow_bytes);
+    append("current_save_cow_buffered_bytes", cow_buffered_bytes);
+    append("snapshot_cow_writer_delay_usec", SliceSnapshot::GetCowWriterDelayUsec());
 
     auto save_info = GetLastSaveInfo();
     // when last success save
@@ -2222,6 +2576,15 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
 
     size_t is_loading = service_.GetGlobalState() == GlobalState::LOADING;
     append("loading", is_loading);
+    if (is_loading) {
+      size_t loaded_bytes = load_progress_.bytes_read.load(memory_order_relaxed);
+      size_t total_bytes = load_progress_.bytes_total.load(memory_order_relaxed);
+      double loaded_perc = total_bytes ? (double(loaded_bytes) / total_bytes) * 100 : 0;
+      append("loading_loaded_bytes", loaded_bytes);
+      append("loading_total_bytes", total_bytes);
+      append("loading_loaded_perc", loaded_perc);
+      append("loading_loaded_keys", load_progress_.keys_loaded.load(memory_order_relaxed));
+    }
     append("saving", is_saving);
     append("current_save_duration_sec", curent_durration_sec);
 
@@ -2240,10 +2603,13 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("tx_shard_polls", m.shard_stats.poll_execution_total);
     append("tx_shard_immediate_total", m.shard_stats.tx_immediate_total);
     append("tx_shard_ooo_total", m.shard_stats.tx_ooo_total);
+    append("tx_shard_ooo_marked_total", m.shard_stats.tx_ooo_marked_total);
     append("tx_global_total", m.coordinator_stats.tx_global_cnt);
     append("tx_normal_total", m.coordinator_stats.tx_normal_cnt);
     append("tx_inline_runs_total", m.coordinator_stats.tx_inline_runs);
     append("tx_schedule_cancel_total", m.coordinator_stats.tx_schedule_cancel_cnt);
+    append("tx_multikey_total", m.coordinator_stats.tx_multikey_cnt);
+    append("tx_multikey_single_shard_total", m.coordinator_stats.tx_multikey_single_shard_cnt);
 
     append("tx_with_freq", absl::StrJoin(m.coordinator_stats.tx_width_freq_arr, ","));
     append("tx_queue_len", m.tx_queue_len);
@@ -2255,6 +2621,8 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("multi_squash_execution_total", m.coordinator_stats.multi_squash_executions);
     append("multi_squash_execution_hop_usec", m.coordinator_stats.multi_squash_exec_hop_usec);
     append("multi_squash_execution_reply_usec", m.coordinator_stats.multi_squash_exec_reply_usec);
+    append("json_path_cache_hits", m.coordinator_stats.json_path_cache_hits);
+    append("json_path_cache_misses", m.coordinator_stats.json_path_cache_misses);
   }
 
   if (should_enter("REPLICATION")) {
@@ -2271,6 +2639,8 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
                                           ",state=", r.state, ",lag=", r.lsn_lag));
       }
       append("master_replid", master_replid_);
+      append("repl_stream_raw_bytes", m.coordinator_stats.repl_stream_raw_bytes);
+      append("repl_stream_wire_bytes", m.coordinator_stats.repl_stream_wire_bytes);
     } else {
       append("role", GetFlag(FLAGS_info_replication_valkey_compatible) ? "slave" : "replica");
 
@@ -2308,10 +2678,16 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     vector<pair<string_view, string>> commands;
     for (const auto& [name, stats] : m.cmd_stats_map) {
       const auto calls = stats.first, sum = stats.second;
-      commands.push_back(
-          {name, absl::StrJoin({absl::StrCat("calls=", calls), absl::StrCat("usec=", sum),
-                                absl::StrCat("usec_per_call=", static_cast<double>(sum) / calls)},
-                               ",")});
+      string line =
+          absl::StrJoin({absl::StrCat("calls=", calls), absl::StrCat("usec=", sum),
+                         absl::StrCat("usec_per_call=", static_cast<double>(sum) / calls)},
+                        ",");
+      if (auto it = m.cmd_cpu_map.find(name); it != m.cmd_cpu_map.end()) {
+        absl::StrAppend(&line, ",shard_calls=", it->second.calls,
+                        ",shard_cpu_usec=", it->second.cpu_ns / 1000,
+                        ",shard_wall_usec=", it->second.wall_ns / 1000);
+      }
+      commands.push_back({name, std::move(line)});
     }
 
     auto unknown_cmd = service_.UknownCmdMap();
@@ -2321,6 +2697,20 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
                   vector<pair<string_view, uint64_t>>(unknown_cmd.cbegin(), unknown_cmd.cend()));
   }
 
+  if (should_enter("LATENCYSTATS", true)) {
+    auto percentiles = [](const base::Histogram& hist) {
+      return absl::StrCat("p50=", hist.Percentile(50), ",p99=", hist.Percentile(99),
+                          ",p99.9=", hist.Percentile(99.9));
+    };
+
+    for (const auto& [name, stats] : m.tx_latency_map) {
+      append(StrCat("tx_schedule_usec_", name), percentiles(stats.schedule_usec));
+      append(StrCat("tx_wait_usec_", name), percentiles(stats.wait_usec));
+      append(StrCat("tx_exec_usec_", name), percentiles(stats.exec_usec));
+      append(StrCat("tx_hops_", name), percentiles(stats.hops));
+    }
+  }
+
   if (should_enter("MODULES")) {
     append("module",
            "name=ReJSON,ver=20000,api=1,filters=0,usedby=[search],using=[],options=[handle-io-"
@@ -2334,6 +2724,7 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("search_memory", m.search_stats.used_memory);
     append("search_num_indices", m.search_stats.num_indices);
     append("search_num_entries", m.search_stats.num_entries);
+    append("search_compacted_bytes", m.search_stats.compacted_bytes);
   }
 
   if (should_enter("ERRORSTATS", true)) {
@@ -2366,6 +2757,14 @@ void ServerFamily::Info(CmdArgList args, ConnectionContext* cntx) {
     append("used_cpu_user_children", StrCat(cu.ru_utime.tv_sec, ".", cu.ru_utime.tv_usec));
     append("used_cpu_sys_main_thread", StrCat(tu.ru_stime.tv_sec, ".", tu.ru_stime.tv_usec));
     append("used_cpu_user_main_thread", StrCat(tu.ru_utime.tv_sec, ".", tu.ru_utime.tv_usec));
+
+    absl::flat_hash_set<unsigned> shard_nodes;
+    for (ShardId sid = 0; sid < shard_set->size(); ++sid)
+      shard_nodes.insert(shard_set->numa_node(sid));
+    append("numa_nodes", NumaTopology::Get().num_nodes());
+    append("numa_shard_nodes", shard_nodes.size());
+    append("numa_local_tx_total", m.coordinator_stats.tx_numa_local_cnt);
+    append("numa_remote_tx_total", m.coordinator_stats.tx_numa_remote_cnt);
   }
 #endif
 
@@ -2548,6 +2947,12 @@ void ServerFamily::ReplicaOfInternal(CmdArgList args, ConnectionContext* cntx,
 
   replica_ = new_replica;
 
+  // The data of a replica started by --replicaof is kept, so it can resume from the state of the
+  // snapshot it loaded.
+  auto resume = std::exchange(loaded_resume_state_, std::nullopt);
+  if (resume && !cntx->transaction)
+    new_replica->SetResumeState(std::move(*resume));
+
   // TODO: disconnect pending blocked clients (pubsub, blocking commands)
   SetMasterFlagOnAllThreads(false);  // Flip flag after assiging replica
 
@@ -2603,6 +3008,69 @@ void ServerFamily::Replicate(string_view host, string_view port) {
   ReplicaOfInternal(args_list, &ctxt, ActionOnConnectionFail::kContinueReplication);
 }
 
+// KEYEVENTS cursor [COUNT count]
+// Reads the keyspace events of the log sink. The cursor holds the sequence number of the next
+// event of every shard, 0 starts from the oldest events. Replies with the next cursor, the
+// number of events that were overwritten since the cursor and up to count events of every shard
+// as [db, key] pairs.
+void ServerFamily::KeyEvents(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser{args};
+  string_view cursor = parser.Next();
+  uint32_t count = 100;
+  if (parser.Check("COUNT").IgnoreCase())
+    count = parser.Next<uint32_t>();
+
+  if (parser.HasNext())
+    return cntx->SendError(kSyntaxErr);
+  if (auto err = parser.Error(); err)
+    return cntx->SendError(err->MakeReply());
+  if (count == 0)
+    return cntx->SendError(kInvalidIntErr);
+
+  vector<uint64_t> from(shard_set->size(), 0);
+  bool initial = cursor == "0";
+  if (!initial) {
+    vector<string_view> parts = absl::StrSplit(cursor, ',');
+    if (parts.size() != from.size())
+      return cntx->SendError("invalid cursor");
+    for (size_t i = 0; i < parts.size(); ++i) {
+      if (!absl::SimpleAtoi(parts[i], &from[i]))
+        return cntx->SendError("invalid cursor");
+    }
+  }
+
+  vector<vector<KeyEventLog::Event>> events(shard_set->size());
+  atomic_uint64_t lost = 0;
+  atomic_bool enabled = true;
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    if (const KeyEventLog* log = shard->db_slice().key_event_log(); log)
+      lost.fetch_add(log->Read(&from[sid], count, &events[sid]), memory_order_relaxed);
+    else
+      enabled = false;
+  });
+
+  if (!enabled)
+    return cntx->SendError("keyspace events log is disabled, see --keyspace_events_sink");
+
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+  rb->StartArray(3);
+  rb->SendBulkString(absl::StrJoin(from, ","));
+  rb->SendLong(initial ? 0 : lost.load());
+
+  size_t total = 0;
+  for (const auto& shard_events : events)
+    total += shard_events.size();
+  rb->StartArray(total);
+  for (const auto& shard_events : events) {
+    for (const auto& event : shard_events) {
+      rb->StartArray(2);
+      rb->SendLong(event.db);
+      rb->SendBulkString(event.key);
+    }
+  }
+}
+
 // REPLTAKEOVER <seconds> [SAVE]
 // SAVE is used only by tests.
 void ServerFamily::ReplTakeOver(CmdArgList args, ConnectionContext* cntx) {
@@ -2776,6 +3244,54 @@ void ServerFamily::Role(CmdArgList args, ConnectionContext* cntx) {
   }
 }
 
+// LSNTOKEN
+// On a master, returns the current journal LSNs of the shards. A client that sends it after
+// its writes can pass the token to WAITLSN on a replica to read them back.
+// On a replica, returns the LSNs it has applied.
+void ServerFamily::LsnToken(CmdArgList args, ConnectionContext* cntx) {
+  if (auto info = GetReplicaOffsetInfo(); info)
+    return cntx->SendBulkString(JoinLsns(info->flow_offsets));
+
+  vector<LSN> lsns(shard_set->size());
+  shard_set->RunBriefInParallel([&](EngineShard* shard) {
+    auto* journal = shard->journal();
+    lsns[shard->shard_id()] = journal ? journal->GetLsn() : 0;
+  });
+  cntx->SendBulkString(JoinLsns(lsns));
+}
+
+// WAITLSN token timeout_ms
+// Blocks until the replica has applied the journal up to the LSNs of a token returned by the
+// master, or until the timeout expires, 0 means no timeout. Replies 1 if the LSNs were reached,
+// 0 otherwise. A master has applied its own writes, so it replies 1 right away.
+void ServerFamily::WaitLsn(CmdArgList args, ConnectionContext* cntx) {
+  vector<LSN> target;
+  if (!ParseLsnToken(ArgS(args, 0), &target))
+    return cntx->SendError("invalid LSN token");
+
+  uint32_t timeout_ms;
+  if (!absl::SimpleAtoi(ArgS(args, 1), &timeout_ms))
+    return cntx->SendError(kInvalidIntErr);
+
+  auto deadline = chrono::steady_clock::now() + chrono::milliseconds(timeout_ms);
+  while (true) {
+    auto info = GetReplicaOffsetInfo();
+    if (!info)
+      return cntx->SendLong(1);
+
+    // The flows are not set up before the full sync.
+    const vector<uint64_t>& applied = info->flow_offsets;
+    if (applied.size() == target.size() &&
+        equal(applied.begin(), applied.end(), target.begin(), greater_equal<uint64_t>{})) {
+      return cntx->SendLong(1);
+    }
+
+    if (timeout_ms > 0 && chrono::steady_clock::now() >= deadline)
+      return cntx->SendLong(0);
+    ThisFiber::SleepFor(1ms);
+  }
+}
+
 void ServerFamily::Script(CmdArgList args, ConnectionContext* cntx) {
   ToUpper(&args.front());
 
@@ -2796,12 +3312,83 @@ void ServerFamily::Latency(CmdArgList args, ConnectionContext* cntx) {
   ToUpper(&args[0]);
   string_view sub_cmd = ArgS(args, 0);
 
-  if (sub_cmd == "LATEST") {
-    return rb->SendEmptyArray();
+  if (sub_cmd == "RESET") {
+    vector<string_view> events;
+    for (size_t i = 1; i < args.size(); ++i)
+      events.push_back(ArgS(args, i));
+
+    // Events are counted once, no matter on how many threads they were recorded.
+    util::fb2::Mutex mu;
+    absl::flat_hash_set<string> reset;
+    service_.proactor_pool().AwaitFiberOnAll([&](auto index, auto* context) {
+      auto& monitor = ServerState::tlocal()->GetLatencyMonitor();
+      vector<string> names;
+      for (const auto& [name, _] : monitor.events()) {
+        if (events.empty() || find(events.begin(), events.end(), name) != events.end())
+          names.push_back(name);
+      }
+      monitor.Reset(events);
+      lock_guard lk(mu);
+      reset.insert(names.begin(), names.end());
+    });
+    return rb->SendLong(reset.size());
+  }
+
+  if (sub_cmd != "LATEST" && !(sub_cmd == "HISTORY" && args.size() == 2)) {
+    LOG_FIRST_N(ERROR, 10) << "Subcommand " << sub_cmd << " not supported";
+    return cntx->SendError(kSyntaxErr);
   }
 
-  LOG_FIRST_N(ERROR, 10) << "Subcommand " << sub_cmd << " not supported";
-  cntx->SendError(kSyntaxErr);
+  vector<absl::flat_hash_map<string, LatencyMonitor::Event>> events(
+      service_.proactor_pool().size());
+  service_.proactor_pool().AwaitFiberOnAll([&](auto index, auto* context) {
+    events[index] = ServerState::tlocal()->GetLatencyMonitor().events();
+  });
+
+  if (sub_cmd == "HISTORY") {
+    string_view event = ArgS(args, 1);
+    vector<LatencyMonitor::Sample> samples;
+    for (const auto& thread_events : events) {
+      if (auto it = thread_events.find(event); it != thread_events.end())
+        samples.insert(samples.end(), it->second.samples.begin(), it->second.samples.end());
+    }
+    sort(samples.begin(), samples.end(),
+         [](const auto& l, const auto& r) { return l.unix_sec < r.unix_sec; });
+    if (samples.size() > LatencyMonitor::kHistoryLen)
+      samples.erase(samples.begin(), samples.end() - LatencyMonitor::kHistoryLen);
+
+    rb->StartArray(samples.size());
+    for (const auto& sample : samples) {
+      rb->StartArray(2);
+      rb->SendLong(sample.unix_sec);
+      rb->SendLong(sample.latency_ms);
+    }
+    return;
+  }
+
+  // LATEST: event name, time and latency of the latest spike and the maximal latency.
+  absl::btree_map<string, pair<LatencyMonitor::Sample, uint32_t>> latest;
+  for (const auto& thread_events : events) {
+    for (const auto& [name, event] : thread_events) {
+      if (event.samples.empty())
+        continue;
+      auto [it, inserted] = latest.try_emplace(name, event.samples.back(), event.max_ms);
+      if (!inserted) {
+        if (event.samples.back().unix_sec >= it->second.first.unix_sec)
+          it->second.first = event.samples.back();
+        it->second.second = max(it->second.second, event.max_ms);
+      }
+    }
+  }
+
+  rb->StartArray(latest.size());
+  for (const auto& [name, value] : latest) {
+    rb->StartArray(4);
+    rb->SendBulkString(name);
+    rb->SendLong(value.first.unix_sec);
+    rb->SendLong(value.first.latency_ms);
+    rb->SendLong(value.second);
+  }
 }
 
 void ServerFamily::ShutdownCmd(CmdArgList args, ConnectionContext* cntx) {
@@ -2914,6 +3501,7 @@ constexpr uint32_t kFlushAll = KEYSPACE | WRITE | SLOW | DANGEROUS;
 constexpr uint32_t kInfo = SLOW | DANGEROUS;
 constexpr uint32_t kHello = FAST | CONNECTION;
 constexpr uint32_t kLastSave = ADMIN | FAST | DANGEROUS;
+constexpr uint32_t kKeyEvents = KEYSPACE | READ | SLOW;
 constexpr uint32_t kLatency = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kMemory = READ | SLOW;
 constexpr uint32_t kSave = ADMIN | SLOW | DANGEROUS;
@@ -2923,6 +3511,8 @@ constexpr uint32_t kReplicaOf = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kReplTakeOver = DANGEROUS;
 constexpr uint32_t kReplConf = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kRole = ADMIN | FAST | DANGEROUS;
+constexpr uint32_t kLsnToken = FAST | CONNECTION;
+constexpr uint32_t kWaitLsn = SLOW | CONNECTION;
 constexpr uint32_t kSlowLog = ADMIN | SLOW | DANGEROUS;
 constexpr uint32_t kScript = SLOW | SCRIPTING;
 constexpr uint32_t kModule = ADMIN | SLOW | DANGEROUS;
@@ -2946,6 +3536,7 @@ void ServerFamily::Register(CommandRegistry* registry) {
       << CI{"INFO", CO::LOADING, -1, 0, 0, acl::kInfo}.HFUNC(Info)
       << CI{"HELLO", CO::LOADING, -1, 0, 0, acl::kHello}.HFUNC(Hello)
       << CI{"LASTSAVE", CO::LOADING | CO::FAST, 1, 0, 0, acl::kLastSave}.HFUNC(LastSave)
+      << CI{"KEYEVENTS", CO::READONLY | CO::LOADING, -2, 0, 0, acl::kKeyEvents}.HFUNC(KeyEvents)
       << CI{"LATENCY", CO::NOSCRIPT | CO::LOADING | CO::FAST, -2, 0, 0, acl::kLatency}.HFUNC(
              Latency)
       << CI{"MEMORY", kMemOpts, -2, 0, 0, acl::kMemory}.HFUNC(Memory)
@@ -2959,6 +3550,8 @@ void ServerFamily::Register(CommandRegistry* registry) {
              ReplTakeOver)
       << CI{"REPLCONF", CO::ADMIN | CO::LOADING, -1, 0, 0, acl::kReplConf}.HFUNC(ReplConf)
       << CI{"ROLE", CO::LOADING | CO::FAST | CO::NOSCRIPT, 1, 0, 0, acl::kRole}.HFUNC(Role)
+      << CI{"LSNTOKEN", CO::LOADING | CO::FAST, 1, 0, 0, acl::kLsnToken}.HFUNC(LsnToken)
+      << CI{"WAITLSN", CO::LOADING | CO::NOSCRIPT, 3, 0, 0, acl::kWaitLsn}.HFUNC(WaitLsn)
       << CI{"SLOWLOG", CO::ADMIN | CO::FAST, -2, 0, 0, acl::kSlowLog}.HFUNC(SlowLog)
       << CI{"SCRIPT", CO::NOSCRIPT | CO::NO_KEY_TRANSACTIONAL, -2, 0, 0, acl::kScript}.HFUNC(Script)
       << CI{"DFLY", CO::ADMIN | CO::GLOBAL_TRANS | CO::HIDDEN, -2, 0, 0, acl::kDfly}.HFUNC(Dfly)
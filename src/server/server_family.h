@@ -15,6 +15,7 @@
 #include "server/detail/save_stages_controller.h"
 #include "server/dflycmd.h"
 #include "server/engine_shard_set.h"
+#include "server/rdb_load.h"
 #include "server/replica.h"
 #include "server/server_state.h"
 #include "util/fibers/fiberqueue_threadpool.h"
@@ -75,9 +76,24 @@ struct PeakStats {
 
 // Aggregated metrics over multiple sources on all shards
 struct Metrics {
+  // Stats of a single thread and of the shard it runs, if any.
+  struct ThreadMetrics {
+    bool has_shard = false;
+    size_t used_memory = 0;
+    size_t key_count = 0;
+    size_t expire_count = 0;
+    uint64_t evicted_keys = 0;
+    uint64_t tiered_entries = 0;
+    uint32_t tx_queue_len = 0;
+
+    uint32_t connected_clients = 0;
+    uint64_t commands_processed = 0;
+  };
+
   SliceEvents events;              // general keyspace stats
   std::vector<DbStats> db_stats;   // dbsize stats
   EngineShard::Stats shard_stats;  // per-shard stats
+  size_t lazyfree_pending_objects = 0;
 
   facade::FacadeStats facade_stats;  // client stats and buffer sizes
   TieredStats tiered_stats;
@@ -91,6 +107,11 @@ struct Metrics {
 
   size_t heap_used_bytes = 0;
   size_t small_string_bytes = 0;
+  size_t small_string_table_full = 0;
+  size_t key_prefix_bytes = 0;
+  size_t compressed_string_bytes = 0;
+  size_t compressed_string_raw_bytes = 0;
+  size_t pending_rehash_buckets = 0;
   uint32_t traverse_ttl_per_sec = 0;
   uint32_t delete_ttl_per_sec = 0;
   uint64_t fiber_switch_cnt = 0;
@@ -112,7 +133,16 @@ struct Metrics {
 
   // command call frequencies (count, aggregated latency in usec).
   std::map<std::string, std::pair<uint64_t, uint64_t>> cmd_stats_map;
+  std::map<std::string, ServerState::ScriptStats> script_stats_map;  // by script sha
+  std::map<std::string, ServerState::TxLatencyStats> tx_latency_map;  // by command name
+  std::map<std::string, ServerState::UserThrottleStats> user_throttle_map;  // by user name
+  std::map<std::string, EngineShard::CmdCpuStats> cmd_cpu_map;        // by command name
   std::vector<ReplicaRoleInfo> replication_metrics;
+
+  // Estimated memory by top level key prefix and type, with --memory_profile_sample_rate.
+  absl::flat_hash_map<MemoryProfile::Key, int64_t> memory_profile;
+
+  std::vector<ThreadMetrics> thread_metrics;  // by thread index
 };
 
 struct LastSaveInfo {
@@ -252,12 +282,15 @@ class ServerFamily {
   void Info(CmdArgList args, ConnectionContext* cntx);
   void Hello(CmdArgList args, ConnectionContext* cntx);
   void LastSave(CmdArgList args, ConnectionContext* cntx);
+  void KeyEvents(CmdArgList args, ConnectionContext* cntx);
   void Latency(CmdArgList args, ConnectionContext* cntx);
   void ReplicaOf(CmdArgList args, ConnectionContext* cntx);
   void AddReplicaOf(CmdArgList args, ConnectionContext* cntx);
   void ReplTakeOver(CmdArgList args, ConnectionContext* cntx);
   void ReplConf(CmdArgList args, ConnectionContext* cntx);
   void Role(CmdArgList args, ConnectionContext* cntx);
+  void LsnToken(CmdArgList args, ConnectionContext* cntx);
+  void WaitLsn(CmdArgList args, ConnectionContext* cntx);
   void Save(CmdArgList args, ConnectionContext* cntx);
   void BgSave(CmdArgList args, ConnectionContext* cntx);
   void Script(CmdArgList args, ConnectionContext* cntx);
@@ -295,6 +328,9 @@ class ServerFamily {
   GenericError WaitUntilSaveFinished(Transaction* trans, bool ignore_state = false);
   void StopAllClusterReplicas();
 
+  // Returns the resume state of the replica if its replication was stopped.
+  std::optional<Replica::ResumeState> GetStoppedReplicaState() const;
+
   util::fb2::Fiber snapshot_schedule_fb_;
   std::optional<util::fb2::Future<GenericError>> load_result_;
 
@@ -309,6 +345,8 @@ class ServerFamily {
   std::shared_ptr<Replica> replica_ ABSL_GUARDED_BY(replicaof_mu_);
   std::vector<std::unique_ptr<Replica>> cluster_replicas_
       ABSL_GUARDED_BY(replicaof_mu_);  // used to replicating multiple nodes to single dragonfly
+  // Replication state found in the loaded snapshot, used by the replica started by --replicaof.
+  std::optional<Replica::ResumeState> loaded_resume_state_ ABSL_GUARDED_BY(replicaof_mu_);
 
   std::unique_ptr<ScriptMgr> script_mgr_;
   std::unique_ptr<journal::Journal> journal_;
@@ -334,6 +372,9 @@ class ServerFamily {
 
   mutable util::fb2::Mutex peak_stats_mu_;
   mutable PeakStats peak_stats_;
+
+  // Progress of the snapshot currently being loaded, reported in INFO PERSISTENCE.
+  RdbLoadProgress load_progress_;
 };
 
 // Reusable CLIENT PAUSE implementation that blocks while polling is_pause_in_progress
@@ -4,14 +4,20 @@
 
 #include "server/server_family.h"
 
+#include <absl/flags/reflection.h>
 #include <absl/strings/match.h>
+#include <absl/strings/str_split.h>
 
 #include "absl/strings/str_cat.h"
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
 #include "server/test_utils.h"
 
+ABSL_DECLARE_FLAG(bool, tx_latency_stats);
+ABSL_DECLARE_FLAG(bool, serve_reads_during_load);
+
 using namespace testing;
 using namespace std;
 using namespace util;
@@ -60,6 +66,27 @@ TEST_F(ServerFamilyTest, SlowLogArgsCountTruncation) {
   EXPECT_THAT(commands, ElementsAreArray(expected_args));
 }
 
+TEST_F(ServerFamilyTest, LatencyMonitor) {
+  EXPECT_THAT(Run({"latency", "latest"}), ArrLen(0));
+
+  EXPECT_EQ(Run({"config", "set", "latency_monitor_threshold", "5"}), "OK");
+  Run({"eval", "local i = 0 while i < 10000000 do i = i + 1 end return i", "0"});
+
+  // Other events may show up on a slow machine.
+  auto resp = Run({"latency", "latest"});
+  ASSERT_THAT(resp, ArgType(RespExpr::ARRAY));
+  auto events = resp.GetVec();
+  auto it = find_if(events.begin(), events.end(),
+                    [](const auto& event) { return event.GetVec()[0] == "command"; });
+  ASSERT_NE(it, events.end());
+  ASSERT_THAT(it->GetVec(), ElementsAre(_, _, _, _));
+  EXPECT_GE(*it->GetVec()[3].GetInt(), 5);
+
+  EXPECT_THAT(Run({"latency", "history", "command"}), ArrLen(1));
+  EXPECT_THAT(Run({"latency", "reset", "command"}), IntArg(1));
+  EXPECT_THAT(Run({"latency", "history", "command"}), ArrLen(0));
+}
+
 TEST_F(ServerFamilyTest, SlowLogArgsLengthTruncation) {
   auto resp = Run({"config", "set", "slowlog_max_len", "3"});
   EXPECT_THAT(resp.GetString(), "OK");
@@ -127,6 +154,35 @@ TEST_F(ServerFamilyTest, SlowLogGetZero) {
   EXPECT_THAT(resp.GetVec().size(), 0);
 }
 
+TEST_F(ServerFamilyTest, DebugTrace) {
+  auto resp = Run({"config", "set", "trace_sample_rate", "1"});
+  EXPECT_THAT(resp.GetString(), "OK");
+
+  Run({"set", "foo", "bar"});
+  Run({"get", "foo"});
+
+  // Newest first: command, client id, start time, total duration and the stages.
+  resp = Run({"debug", "trace", "2"});
+  ASSERT_THAT(resp, ArrLen(2));
+  auto traces = resp.GetVec();
+  ASSERT_THAT(traces[0], ArrLen(5));
+  EXPECT_EQ(traces[0].GetVec()[0], "GET");
+  EXPECT_EQ(traces[1].GetVec()[0], "SET");
+
+  vector<string> stages;
+  auto stage_arr = traces[1].GetVec()[4].GetVec();
+  for (size_t i = 0; i < stage_arr.size(); i += 2)
+    stages.push_back(stage_arr[i].GetString());
+  EXPECT_THAT(stages, testing::IsSupersetOf({"dispatched", "exec_start", "exec_end", "replied"}));
+
+  resp = Run({"debug", "trace", "json", "1"});
+  EXPECT_THAT(resp.GetString(), HasSubstr(R"({"name":"GET")"));
+
+  Run({"config", "set", "trace_sample_rate", "0"});
+  EXPECT_EQ(Run({"debug", "trace", "reset"}), "OK");
+  EXPECT_THAT(Run({"debug", "trace"}), ArrLen(0));
+}
+
 TEST_F(ServerFamilyTest, SlowLogGetMinusOne) {
   auto resp = Run({"config", "set", "slowlog_max_len", "3"});
   EXPECT_THAT(resp.GetString(), "OK");
@@ -419,7 +475,7 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   Run({"GET", "FOO"});
   Run({"SET", "FOO", "10"});
   const auto& msg = GetInvalidationMessage("IO0", 0);
-  EXPECT_EQ(msg.key, "FOO");
+  EXPECT_THAT(msg.keys, ElementsAre("FOO"));
 
   // make sure invalidation message only gets sent once.
   Run({"GET", "FOO"});
@@ -431,7 +487,7 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   pp_->at(1)->Await([&] { return Run({"SET", "FOO", "30"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
   const auto& msg2 = GetInvalidationMessage("IO0", 1);
-  EXPECT_EQ(msg2.key, "FOO");
+  EXPECT_THAT(msg2.keys, ElementsAre("FOO"));
 
   // case 4. test multi command
   Run({"MGET", "X1", "X2", "X3", "X4", "Y1", "Y2", "Y3", "Y4", "Z1", "Z2", "Z3", "Z4"});
@@ -440,7 +496,7 @@ TEST_F(ServerFamilyTest, ClientTrackingUpdateKey) {
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 6);
   std::vector<std::string_view> keys_invalidated;
   for (unsigned int i = 2; i < 6; ++i)
-    keys_invalidated.push_back(GetInvalidationMessage("IO0", i).key);
+    keys_invalidated.push_back(GetInvalidationMessage("IO0", i).keys[0]);
   ASSERT_THAT(keys_invalidated, ElementsAre("X1", "Y3", "Z2", "Z4"));
 
   // The following doesn't work correctly as we currently can't mock listener.
@@ -455,7 +511,7 @@ TEST_F(ServerFamilyTest, ClientTrackingDeleteKey) {
   Run({"GET", "FOO"});
   pp_->at(1)->Await([&] { return Run({"DEL", "FOO"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "FOO");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("FOO"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingRenameKey) {
@@ -465,7 +521,7 @@ TEST_F(ServerFamilyTest, ClientTrackingRenameKey) {
   Run({"GET", "FOO"});
   pp_->at(1)->Await([&] { return Run({"RENAME", "FOO", "BAR"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "FOO");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("FOO"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingExpireKey) {
@@ -478,7 +534,7 @@ TEST_F(ServerFamilyTest, ClientTrackingExpireKey) {
   auto resp = Run({"GET", "C"});
   EXPECT_THAT(resp, ArgType(RespExpr::NIL));
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 1);
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "C");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("C"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingSelectDB) {
@@ -490,7 +546,41 @@ TEST_F(ServerFamilyTest, ClientTrackingSelectDB) {
   pp_->at(1)->Await([&] { return Run({"SET", "C", "1000"}); });
   pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 1);
-  EXPECT_EQ(GetInvalidationMessage("IO0", 0).key, "C");
+  EXPECT_THAT(GetInvalidationMessage("IO0", 0).keys, ElementsAre("C"));
+}
+
+TEST_F(ServerFamilyTest, ClientTrackingBcast) {
+  Run({"HELLO", "3"});
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "PREFIX", "user:"}), ErrArg("requires BCAST"));
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "BCAST", "OPTIN"}), ErrArg("not compatible"));
+  EXPECT_THAT(Run({"CLIENT", "TRACKING", "ON", "BCAST", "PREFIX"}), ErrArg("syntax error"));
+
+  // Overlapping prefixes notify the client once per key.
+  Run({"CLIENT", "TRACKING", "ON", "BCAST", "PREFIX", "user:", "PREFIX", "us", "PREFIX", "item:"});
+  pp_->at(1)->Await([&] { return Run({"MSET", "user:1", "a", "item:1", "b", "other", "c"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  ASSERT_EQ(InvalidationMessagesLen("IO0"), 2);
+  std::vector<std::string_view> keys_invalidated;
+  for (unsigned int i = 0; i < 2; ++i)
+    keys_invalidated.push_back(GetInvalidationMessage("IO0", i).keys[0]);
+  EXPECT_THAT(keys_invalidated, UnorderedElementsAre("user:1", "item:1"));
+
+  // Keys are not tracked in BCAST mode, so the notifications repeat.
+  pp_->at(1)->Await([&] { return Run({"DEL", "user:1"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_EQ(InvalidationMessagesLen("IO0"), 3);
+
+  Run({"CLIENT", "TRACKING", "OFF"});
+  pp_->at(1)->Await([&] { return Run({"SET", "user:2", "a"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_EQ(InvalidationMessagesLen("IO0"), 3);
+
+  // BCAST without prefixes matches all keys.
+  Run({"CLIENT", "TRACKING", "ON", "BCAST"});
+  pp_->at(1)->Await([&] { return Run({"SET", "other", "d"}); });
+  pp_->AwaitFiberOnAll([](ProactorBase* pb) {});
+  EXPECT_EQ(InvalidationMessagesLen("IO0"), 4);
+  EXPECT_THAT(GetInvalidationMessage("IO0", 3).keys, ElementsAre("other"));
 }
 
 TEST_F(ServerFamilyTest, ClientTrackingNonTransactionalBug) {
@@ -516,4 +606,124 @@ TEST_F(ServerFamilyTest, ClientTrackingLuaBug) {
   EXPECT_EQ(InvalidationMessagesLen("IO0"), 3);
 }
 
+TEST_F(ServerFamilyTest, TxLatencyStats) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_tx_latency_stats, true);
+
+  for (unsigned i = 0; i < 10; ++i) {
+    Run({"mset", "a", "1", "b", "2", "c", "3"});
+    Run({"rename", "a", "d"});
+    Run({"rename", "d", "a"});
+  }
+
+  auto metrics = GetMetrics();
+  ASSERT_TRUE(metrics.tx_latency_map.contains("mset"));
+  ASSERT_TRUE(metrics.tx_latency_map.contains("rename"));
+  EXPECT_EQ(10u, metrics.tx_latency_map["mset"].calls);
+  EXPECT_EQ(20u, metrics.tx_latency_map["rename"].calls);
+
+  string info = Run({"info", "latencystats"}).GetString();
+  EXPECT_THAT(info, HasSubstr("tx_wait_usec_mset:p50="));
+  EXPECT_THAT(info, HasSubstr("tx_hops_rename:p50="));
+
+  Run({"config", "resetstat"});
+  EXPECT_TRUE(GetMetrics().tx_latency_map.empty());
+}
+
+TEST_F(ServerFamilyTest, ShardCpuStats) {
+  absl::FlagSaver fs;
+  SetTestFlag("shard_cpu_stats", "true");
+  ResetService();
+
+  for (unsigned i = 0; i < 10; ++i) {
+    Run({"set", "a", "1"});
+    Run({"mset", "a", "1", "b", "2", "c", "3"});
+  }
+
+  auto metrics = GetMetrics();
+  ASSERT_TRUE(metrics.cmd_cpu_map.contains("set"));
+  ASSERT_TRUE(metrics.cmd_cpu_map.contains("mset"));
+  EXPECT_EQ(10u, metrics.cmd_cpu_map["set"].calls);
+  EXPECT_GE(metrics.cmd_cpu_map["mset"].calls, 10u);  // a callback per shard.
+
+  string info = Run({"info", "commandstats"}).GetString();
+  EXPECT_THAT(info, HasSubstr(",shard_cpu_usec="));
+
+  string shards = Run({"debug", "shards"}).GetString();
+  EXPECT_THAT(shards, HasSubstr("_cpu_mset: calls="));
+
+  Run({"config", "resetstat"});
+  EXPECT_TRUE(GetMetrics().cmd_cpu_map.empty());
+}
+
+TEST_F(ServerFamilyTest, TablePresplitFill) {
+  absl::FlagSaver fs;
+  EXPECT_THAT(Run({"config", "set", "table_presplit_fill", "1.5"}),
+              ErrArg("argument can not be set"));
+  EXPECT_THAT(Run({"config", "set", "table_presplit_fill", "-0.1"}),
+              ErrArg("argument can not be set"));
+  EXPECT_EQ(Run({"config", "set", "table_presplit_fill", "0.8"}), "OK");
+  EXPECT_THAT(Run({"config", "get", "table_presplit_fill"}),
+              RespArray(ElementsAre("table_presplit_fill", "0.8")));
+}
+
+TEST_F(ServerFamilyTest, ThreadMetrics) {
+  for (unsigned i = 0; i < 100; ++i)
+    Run({"set", absl::StrCat("key", i), "val"});
+  for (unsigned i = 0; i < 10; ++i)
+    Run({"expire", absl::StrCat("key", i), "100"});
+
+  auto metrics = GetMetrics();
+  ASSERT_EQ(metrics.thread_metrics.size(), pp_->size());
+
+  size_t shards = 0, shards_with_keys = 0, keys = 0, expiring = 0;
+  for (const auto& tm : metrics.thread_metrics) {
+    if (!tm.has_shard) {
+      EXPECT_EQ(tm.key_count, 0u);
+      continue;
+    }
+    shards++;
+    shards_with_keys += tm.key_count > 0;
+    keys += tm.key_count;
+    expiring += tm.expire_count;
+    EXPECT_GT(tm.used_memory, 0u);
+    EXPECT_EQ(tm.tx_queue_len, 0u);
+  }
+  EXPECT_EQ(shards, shard_set->size());
+  EXPECT_GT(shards_with_keys, 1u);
+  EXPECT_EQ(keys, 100u);
+  EXPECT_EQ(expiring, 10u);
+}
+
+TEST_F(ServerFamilyTest, ServeReadsDuringLoad) {
+  Run({"set", "a", "1"});
+  ASSERT_EQ(GlobalState::LOADING, service_->SwitchState(GlobalState::ACTIVE, GlobalState::LOADING));
+
+  EXPECT_THAT(Run({"get", "a"}), ErrArg("LOADING"));
+
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_serve_reads_during_load, true);
+  EXPECT_EQ(Run({"get", "a"}), "1");
+  EXPECT_THAT(Run({"get", "b"}), ArgType(RespExpr::NIL));
+  EXPECT_THAT(Run({"set", "b", "2"}), ErrArg("LOADING"));
+  EXPECT_THAT(Run({"info", "persistence"}).GetString(), HasSubstr("loading:1"));
+
+  service_->SwitchState(GlobalState::LOADING, GlobalState::ACTIVE);
+  EXPECT_EQ(Run({"set", "b", "2"}), "OK");
+}
+
+TEST_F(ServerFamilyTest, WaitLsn) {
+  Run({"set", "a", "1"});
+
+  auto resp = Run({"lsntoken"});
+  ASSERT_THAT(resp, ArgType(RespExpr::STRING));
+  vector<string> lsns = absl::StrSplit(resp.GetString(), ',');
+  EXPECT_EQ(lsns.size(), shard_set->size());
+
+  // A master has applied all of its writes.
+  EXPECT_THAT(Run({"waitlsn", resp.GetString(), "0"}), IntArg(1));
+  EXPECT_THAT(Run({"waitlsn", "1,x", "0"}), ErrArg("invalid LSN token"));
+  EXPECT_THAT(Run({"waitlsn", "1", "-1"}), ErrArg(facade::kInvalidIntErr));
+}
+
 }  // namespace dfly
@@ -16,6 +16,7 @@ extern "C" {
 #include "base/logging.h"
 #include "facade/conn_context.h"
 #include "server/journal/journal.h"
+#include "server/numa.h"
 
 ABSL_FLAG(uint32_t, interpreter_per_thread, 10, "Lua interpreters per thread");
 
@@ -27,7 +28,7 @@ ServerState::Stats::Stats(unsigned num_shards) : tx_width_freq_arr(num_shards) {
 }
 
 ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
-  static_assert(sizeof(Stats) == 16 * 8, "Stats size mismatch");
+  static_assert(sizeof(Stats) == 24 * 8, "Stats size mismatch");
 
   this->eval_io_coordination_cnt += other.eval_io_coordination_cnt;
   this->eval_shardlocal_coordination_cnt += other.eval_shardlocal_coordination_cnt;
@@ -37,6 +38,8 @@ ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
   this->tx_normal_cnt += other.tx_normal_cnt;
   this->tx_inline_runs += other.tx_inline_runs;
   this->tx_schedule_cancel_cnt += other.tx_schedule_cancel_cnt;
+  this->tx_multikey_cnt += other.tx_multikey_cnt;
+  this->tx_multikey_single_shard_cnt += other.tx_multikey_single_shard_cnt;
 
   this->multi_squash_executions += other.multi_squash_executions;
   this->multi_squash_exec_hop_usec += other.multi_squash_exec_hop_usec;
@@ -46,6 +49,12 @@ ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
   this->rdb_save_usec += other.rdb_save_usec;
   this->rdb_save_count += other.rdb_save_count;
   this->oom_error_cmd_cnt += other.oom_error_cmd_cnt;
+  this->repl_stream_raw_bytes += other.repl_stream_raw_bytes;
+  this->repl_stream_wire_bytes += other.repl_stream_wire_bytes;
+  this->json_path_cache_hits += other.json_path_cache_hits;
+  this->json_path_cache_misses += other.json_path_cache_misses;
+  this->tx_numa_local_cnt += other.tx_numa_local_cnt;
+  this->tx_numa_remote_cnt += other.tx_numa_remote_cnt;
 
   if (this->tx_width_freq_arr.size() > 0) {
     DCHECK_EQ(this->tx_width_freq_arr.size(), other.tx_width_freq_arr.size());
@@ -56,6 +65,36 @@ ServerState::Stats& ServerState::Stats::Add(const ServerState::Stats& other) {
   return *this;
 }
 
+ServerState::ScriptStats& ServerState::ScriptStats::operator+=(const ScriptStats& other) {
+  static_assert(sizeof(ScriptStats) == 5 * 8, "ScriptStats size mismatch");
+
+  this->calls += other.calls;
+  this->total_usec += other.total_usec;
+  this->commands += other.commands;
+  this->hops += other.hops;
+  this->squashed += other.squashed;
+  return *this;
+}
+
+ServerState::UserThrottleStats& ServerState::UserThrottleStats::operator+=(
+    const UserThrottleStats& other) {
+  static_assert(sizeof(UserThrottleStats) == 2 * 8, "UserThrottleStats size mismatch");
+
+  this->delayed += other.delayed;
+  this->delay_usec += other.delay_usec;
+  return *this;
+}
+
+ServerState::TxLatencyStats& ServerState::TxLatencyStats::operator+=(
+    const TxLatencyStats& other) {
+  this->calls += other.calls;
+  this->schedule_usec.Merge(other.schedule_usec);
+  this->wait_usec.Merge(other.wait_usec);
+  this->exec_usec.Merge(other.exec_usec);
+  this->hops.Merge(other.hops);
+  return *this;
+}
+
 void MonitorsRepo::Add(facade::Connection* connection) {
   VLOG(1) << "register connection "
           << " at address 0x" << std::hex << (const void*)connection << " for thread "
@@ -99,6 +138,7 @@ void ServerState::Init(uint32_t thread_index, uint32_t num_shards, acl::UserRegi
   state_ = new ServerState();
   state_->gstate_ = GlobalState::ACTIVE;
   state_->thread_index_ = thread_index;
+  state_->numa_node_ = CurrentNumaNode();
   state_->user_registry = registry;
   state_->stats = Stats(num_shards);
 }
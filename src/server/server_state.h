@@ -14,6 +14,8 @@
 #include "server/acl/user_registry.h"
 #include "server/common.h"
 #include "server/script_mgr.h"
+#include "server/command_trace.h"
+#include "server/latency_monitor.h"
 #include "server/slowlog.h"
 #include "util/sliding_counter.h"
 
@@ -109,6 +111,10 @@ class ServerState {  // public struct - to allow initialization.
     uint64_t tx_inline_runs = 0;
     uint64_t tx_schedule_cancel_cnt = 0;
 
+    // Non multi transactions with more than one key and how many of them spanned a single shard.
+    uint64_t tx_multikey_cnt = 0;
+    uint64_t tx_multikey_single_shard_cnt = 0;
+
     uint64_t eval_io_coordination_cnt = 0;
     uint64_t eval_shardlocal_coordination_cnt = 0;
     uint64_t eval_squashed_flushes = 0;
@@ -125,9 +131,51 @@ class ServerState {  // public struct - to allow initialization.
     // Number of times we rejected command dispatch due to OOM condition.
     uint64_t oom_error_cmd_cnt = 0;
 
+    // Journal bytes streamed to replicas before and after compression.
+    uint64_t repl_stream_raw_bytes = 0;
+    uint64_t repl_stream_wire_bytes = 0;
+
+    // Lookups of parsed json paths in the per thread cache.
+    uint64_t json_path_cache_hits = 0;
+    uint64_t json_path_cache_misses = 0;
+
+    // Single shard transactions coordinated on a thread of the NUMA node of the shard or not.
+    uint64_t tx_numa_local_cnt = 0;
+    uint64_t tx_numa_remote_cnt = 0;
+
     std::valarray<uint64_t> tx_width_freq_arr;
   };
 
+  // Per script counters reported by SCRIPT STATS and the metrics endpoint.
+  struct ScriptStats {
+    ScriptStats& operator+=(const ScriptStats& other);
+
+    uint64_t calls = 0;
+    uint64_t total_usec = 0;
+    uint64_t commands = 0;  // issued via redis.call and its variants
+    uint64_t hops = 0;      // dispatch rounds: synchronous calls, squashed batches, remote runs
+    uint64_t squashed = 0;  // squashed batches
+  };
+
+  // Commands of rate limited users that were delayed, see UserRateLimiter.
+  struct UserThrottleStats {
+    UserThrottleStats& operator+=(const UserThrottleStats& other);
+
+    uint64_t delayed = 0;
+    uint64_t delay_usec = 0;
+  };
+
+  // Latency breakdown of transactional commands, collected with --tx_latency_stats.
+  struct TxLatencyStats {
+    TxLatencyStats& operator+=(const TxLatencyStats& other);
+
+    uint64_t calls = 0;
+    base::Histogram schedule_usec;  // scheduling in the shard queues, including retries
+    base::Histogram wait_usec;      // armed hops waiting for their turn in the shard queues
+    base::Histogram exec_usec;      // running the hops, the slowest shard of every hop
+    base::Histogram hops;
+  };
+
   // Unsafe version.
   // Do not use after fiber migration because it can cause a data race.
   static ServerState* tlocal() {
@@ -221,6 +269,50 @@ class ServerState {  // public struct - to allow initialization.
 
   void RecordCallLatency(std::string_view sha, uint64_t latency_usec) {
     call_latency_histos_[sha].Add(latency_usec);
+
+    auto& stats = script_stats_[sha];
+    stats.calls++;
+    stats.total_usec += latency_usec;
+  }
+
+  const absl::flat_hash_map<std::string, TxLatencyStats>& tx_latency_stats() const {
+    return tx_latency_stats_;
+  }
+
+  void RecordTxLatency(std::string_view cmd, uint64_t schedule_usec, uint64_t wait_usec,
+                       uint64_t exec_usec, uint32_t hops) {
+    auto& stats = tx_latency_stats_[cmd];
+    stats.calls++;
+    stats.schedule_usec.Add(schedule_usec);
+    stats.wait_usec.Add(wait_usec);
+    stats.exec_usec.Add(exec_usec);
+    stats.hops.Add(hops);
+  }
+
+  void ResetTxLatencyStats() {
+    tx_latency_stats_.clear();
+  }
+
+  void RecordScriptCounters(std::string_view sha, uint64_t commands, uint64_t hops,
+                            uint64_t squashed) {
+    auto& stats = script_stats_[sha];
+    stats.commands += commands;
+    stats.hops += hops;
+    stats.squashed += squashed;
+  }
+
+  const absl::flat_hash_map<std::string, ScriptStats>& script_stats() const {
+    return script_stats_;
+  }
+
+  void RecordUserThrottle(std::string_view user, uint64_t delay_usec) {
+    auto& stats = user_throttle_stats_[user];
+    stats.delayed++;
+    stats.delay_usec += delay_usec;
+  }
+
+  const absl::flat_hash_map<std::string, UserThrottleStats>& user_throttle_stats() const {
+    return user_throttle_stats_;
   }
 
   void SetScriptParams(const ScriptMgr::ScriptKey& key, ScriptMgr::ScriptParams params) {
@@ -236,6 +328,11 @@ class ServerState {  // public struct - to allow initialization.
     return thread_index_;
   }
 
+  // The NUMA node the thread ran on when it was initialized.
+  unsigned numa_node() const {
+    return numa_node_;
+  }
+
   ChannelStore* channel_store() const {
     return channel_store_;
   }
@@ -270,6 +367,14 @@ class ServerState {  // public struct - to allow initialization.
     return slow_log_shard_;
   };
 
+  TraceLog& GetTraceLog() {
+    return trace_log_;
+  }
+
+  LatencyMonitor& GetLatencyMonitor() {
+    return latency_monitor_;
+  }
+
   // Tries to returns as much RSS memory as possible to the OS.
   // Decommits 3 possible heaps according to the flags.
   // For decommit_glibcmalloc the heap is global for the process, for others it's specific only
@@ -283,6 +388,8 @@ class ServerState {  // public struct - to allow initialization.
  private:
   int64_t live_transactions_ = 0;
   SlowLogShard slow_log_shard_;
+  TraceLog trace_log_;
+  LatencyMonitor latency_monitor_;
   mi_heap_t* data_heap_;
   journal::Journal* journal_ = nullptr;
 
@@ -306,7 +413,11 @@ class ServerState {  // public struct - to allow initialization.
   MonitorsRepo monitors_;
 
   absl::flat_hash_map<std::string, base::Histogram> call_latency_histos_;
+  absl::flat_hash_map<std::string, ScriptStats> script_stats_;
+  absl::flat_hash_map<std::string, TxLatencyStats> tx_latency_stats_;  // by command name
+  absl::flat_hash_map<std::string, UserThrottleStats> user_throttle_stats_;  // by user name
   uint32_t thread_index_ = 0;
+  unsigned numa_node_ = 0;
   uint64_t used_mem_cached_ = 0;  // thread local cache of used_mem_current
   uint64_t used_mem_last_update_ = 0;
 
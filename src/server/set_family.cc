@@ -13,6 +13,8 @@ extern "C" {
 #include "base/flags.h"
 #include "base/logging.h"
 #include "base/stl_util.h"
+#include "core/packed_int_set.h"
+#include "core/packed_string_set.h"
 #include "core/string_set.h"
 #include "facade/cmd_arg_parser.h"
 #include "server/acl/acl_commands_def.h"
@@ -24,6 +26,14 @@ extern "C" {
 #include "server/journal/journal.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(uint32_t, max_packed_set_entries, 4096,
+          "Maximum number of members of a string set with the packed encoding. "
+          "0 disables the encoding");
+
+ABSL_FLAG(uint32_t, max_packed_intset_entries, 1u << 20,
+          "Maximum number of members of an integer set with the packed encoding, which is used "
+          "once a set of integers outgrows the intset. 0 disables the encoding");
+
 ABSL_DECLARE_FLAG(bool, use_set2);
 
 namespace dfly {
@@ -49,10 +59,72 @@ auto EntriesRange(const NewEntries& entries) {
 
 constexpr uint32_t kMaxIntSetEntries = 256;
 
+// Longer members switch the set to StringSet.
+constexpr size_t kMaxPackedMemberLen = 64;
+static_assert(kMaxPackedMemberLen <= PackedStringSet::kMaxMemberLen);
+
 bool IsDenseEncoding(const CompactObj& co) {
   return co.Encoding() == kEncodingStrMap2;
 }
 
+bool FitsPackedSet(const NewEntries& vals) {
+  size_t size = visit([](auto& c) { return c.size(); }, vals);
+  if (size > GetFlag(FLAGS_max_packed_set_entries))
+    return false;
+
+  for (string_view v : EntriesRange(vals)) {
+    if (v.size() > kMaxPackedMemberLen)
+      return false;
+  }
+  return true;
+}
+
+void ConvertPackedSet(CompactObj* set) {
+  DCHECK_EQ(set->Encoding(), kEncodingPackedSet);
+  const PackedStringSet* ps = (const PackedStringSet*)set->RObjPtr();
+
+  // frees the packed set on a way.
+  set->InitRobj(OBJ_SET, kEncodingStrMap2, container_utils::PackedSetToStrSet(*ps));
+}
+
+void ConvertPackedIntSet(CompactObj* set, bool to_dense) {
+  DCHECK_EQ(set->Encoding(), kEncodingPackedIntSet);
+  const PackedIntSet* pis = (const PackedIntSet*)set->RObjPtr();
+
+  // frees the packed int set on a way.
+  if (!to_dense && pis->Size() < GetFlag(FLAGS_max_packed_set_entries)) {
+    set->InitRobj(OBJ_SET, kEncodingPackedSet, container_utils::PackedIntSetToPackedSet(*pis));
+  } else {
+    set->InitRobj(OBJ_SET, kEncodingStrMap2, container_utils::PackedIntSetToStrSet(*pis));
+  }
+}
+
+// Converts an intset that outgrew its encoding, with_ints is true if only integers are added.
+// Returns false on OOM.
+bool ConvertIntSet(CompactObj* set, bool with_ints) {
+  DCHECK_EQ(set->Encoding(), kEncodingIntSet);
+  intset* is = (intset*)set->RObjPtr();
+
+  if (with_ints && intsetLen(is) <= GetFlag(FLAGS_max_packed_intset_entries)) {
+    set->InitRobj(OBJ_SET, kEncodingPackedIntSet, container_utils::IntSetToPackedIntSet(is));
+    return true;
+  }
+
+  // intsets are capped far below the packed set limit, unless it is disabled.
+  if (intsetLen(is) <= GetFlag(FLAGS_max_packed_set_entries)) {
+    set->InitRobj(OBJ_SET, kEncodingPackedSet, container_utils::IntSetToPackedSet(is));
+    return true;
+  }
+
+  StringSet* ss = SetFamily::ConvertToStrSet(is, intsetLen(is));
+  if (!ss)
+    return false;
+
+  // frees 'is' on a way.
+  set->InitRobj(OBJ_SET, kEncodingStrMap2, ss);
+  return true;
+}
+
 intset* IntsetAddSafe(string_view val, intset* is, bool* success, bool* added) {
   long long llval;
   *added = false;
@@ -112,6 +184,48 @@ unsigned AddStrSet(const DbContext& db_context, const NewEntries& vals, uint32_t
   return res;
 }
 
+// Adds members to the packed set until one of them does not fit and converts the set to
+// StringSet in that case, the remaining members are left to AddStrSet.
+unsigned AddPackedSet(const NewEntries& vals, CompactObj* dest) {
+  unsigned res = 0;
+  PackedStringSet* ps = (PackedStringSet*)dest->RObjPtr();
+  uint32_t max_entries = GetFlag(FLAGS_max_packed_set_entries);
+
+  for (string_view member : EntriesRange(vals)) {
+    if (member.size() > kMaxPackedMemberLen ||
+        (ps->Size() >= max_entries && !ps->Contains(member))) {
+      ConvertPackedSet(dest);
+      break;
+    }
+    res += ps->Add(member);
+  }
+
+  return res;
+}
+
+// Adds integer members to the packed int set until a member is not an integer or does not fit
+// and converts the set in that case, the remaining members are left to the next encoding.
+unsigned AddPackedIntSet(const NewEntries& vals, CompactObj* dest) {
+  unsigned res = 0;
+  PackedIntSet* pis = (PackedIntSet*)dest->RObjPtr();
+  uint32_t max_entries = GetFlag(FLAGS_max_packed_intset_entries);
+
+  for (string_view member : EntriesRange(vals)) {
+    long long llval;
+    if (!string2ll(member.data(), member.size(), &llval)) {
+      ConvertPackedIntSet(dest, false);
+      break;
+    }
+    if (pis->Size() >= max_entries && !pis->Contains(llval)) {
+      ConvertPackedIntSet(dest, true);
+      break;
+    }
+    res += pis->Add(llval);
+  }
+
+  return res;
+}
+
 void InitStrSet(CompactObj* set) {
   set->InitRobj(OBJ_SET, kEncodingStrMap2, CompactObj::AllocateMR<StringSet>());
 }
@@ -137,6 +251,20 @@ pair<unsigned, bool> RemoveSet(const DbContext& db_context, facade::ArgRange val
     }
     isempty = (intsetLen(is) == 0);
     set->SetRObjPtr(is);
+  } else if (set->Encoding() == kEncodingPackedSet) {
+    PackedStringSet* ps = (PackedStringSet*)set->RObjPtr();
+    for (string_view val : vals) {
+      removed += ps->Erase(val);
+    }
+    isempty = ps->Empty();
+  } else if (set->Encoding() == kEncodingPackedIntSet) {
+    PackedIntSet* pis = (PackedIntSet*)set->RObjPtr();
+    long long llval;
+    for (string_view val : vals) {
+      if (string2ll(val.data(), val.size(), &llval))
+        removed += pis->Erase(llval);
+    }
+    isempty = pis->Empty();
   } else {
     return RemoveStrSet(MemberTimeSeconds(db_context.time_now_ms), vals, set);
   }
@@ -157,6 +285,8 @@ void InitSet(const NewEntries& vals, CompactObj* set) {
   if (int_set) {
     intset* is = intsetNew();
     set->InitRobj(OBJ_SET, kEncodingIntSet, is);
+  } else if (FitsPackedSet(vals)) {
+    set->InitRobj(OBJ_SET, kEncodingPackedSet, CompactObj::AllocateMR<PackedStringSet>());
   } else {
     InitStrSet(set);
   }
@@ -168,6 +298,10 @@ uint64_t ScanStrSet(const DbContext& db_context, const CompactObj& co, uint64_t
   long maxiterations = count * 10;
   DCHECK(IsDenseEncoding(co));
 
+  // A cursor of the packed encoding, the set was converted during the scan.
+  if (curs > UINT32_MAX)
+    curs = 0;
+
   if (true) {
     StringSet* set = (StringSet*)co.RObjPtr();
     set->set_time(MemberTimeSeconds(db_context.time_now_ms));
@@ -187,11 +321,54 @@ uint64_t ScanStrSet(const DbContext& db_context, const CompactObj& co, uint64_t
   return curs;
 }
 
+uint64_t ScanPackedSet(const CompactObj& co, uint64_t curs, const ScanOpts& scan_op,
+                       StringVec* res) {
+  uint32_t count = scan_op.limit;
+  long maxiterations = count * 10;
+  const PackedStringSet* ps = (const PackedStringSet*)co.RObjPtr();
+
+  do {
+    curs = ps->Scan(curs, [&](string_view str) {
+      if (scan_op.Matches(str)) {
+        res->emplace_back(str);
+      }
+    });
+  } while (curs && maxiterations-- && res->size() < count);
+
+  return curs;
+}
+
+uint64_t ScanPackedIntSet(const CompactObj& co, uint64_t curs, const ScanOpts& scan_op,
+                          StringVec* res) {
+  uint32_t count = scan_op.limit;
+  long maxiterations = count * 10;
+  const PackedIntSet* pis = (const PackedIntSet*)co.RObjPtr();
+
+  do {
+    curs = pis->Scan(curs, [&](int64_t member) {
+      string str = absl::StrCat(member);
+      if (scan_op.Matches(str)) {
+        res->push_back(std::move(str));
+      }
+    });
+  } while (curs && maxiterations-- && res->size() < count);
+
+  return curs;
+}
+
 uint32_t SetTypeLen(const DbContext& db_context, const SetType& set) {
   if (set.second == kEncodingIntSet) {
     return intsetLen((const intset*)set.first);
   }
 
+  if (set.second == kEncodingPackedSet) {
+    return ((const PackedStringSet*)set.first)->Size();
+  }
+
+  if (set.second == kEncodingPackedIntSet) {
+    return ((const PackedIntSet*)set.first)->Size();
+  }
+
   if (true) {
     StringSet* ss = (StringSet*)set.first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
@@ -203,10 +380,16 @@ bool IsInSet(const DbContext& db_context, const SetType& st, int64_t val) {
   if (st.second == kEncodingIntSet)
     return intsetFind((intset*)st.first, val);
 
+  if (st.second == kEncodingPackedIntSet)
+    return ((const PackedIntSet*)st.first)->Contains(val);
+
   char buf[32];
   char* next = absl::numbers_internal::FastIntToBuffer(val, buf);
   string_view str{buf, size_t(next - buf)};
 
+  if (st.second == kEncodingPackedSet)
+    return ((const PackedStringSet*)st.first)->Contains(str);
+
   if (true) {
     StringSet* ss = (StringSet*)st.first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
@@ -223,6 +406,15 @@ bool IsInSet(const DbContext& db_context, const SetType& st, string_view member)
     return intsetFind((intset*)st.first, llval);
   }
 
+  if (st.second == kEncodingPackedIntSet) {
+    long long llval;
+    return string2ll(member.data(), member.size(), &llval) &&
+           ((const PackedIntSet*)st.first)->Contains(llval);
+  }
+
+  if (st.second == kEncodingPackedSet)
+    return ((const PackedStringSet*)st.first)->Contains(member);
+
   if (true) {
     StringSet* ss = (StringSet*)st.first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
@@ -241,6 +433,12 @@ int32_t GetExpiry(const DbContext& db_context, const SetType& st, string_view me
     return -1;
   }
 
+  if (st.second == kEncodingPackedSet)
+    return ((const PackedStringSet*)st.first)->Contains(member) ? -1 : -3;
+
+  if (st.second == kEncodingPackedIntSet)
+    return IsInSet(db_context, st, member) ? -1 : -3;
+
   if (true) {
     StringSet* ss = (StringSet*)st.first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
@@ -264,6 +462,24 @@ void FindInSet(StringVec& memberships, const DbContext& db_context, const SetTyp
 // Removes arg from result.
 void DiffStrSet(const DbContext& db_context, const SetType& st,
                 absl::flat_hash_set<string>* result) {
+  if (st.second == kEncodingPackedSet) {
+    ((const PackedStringSet*)st.first)->Iterate([result](string_view str) {
+      result->erase(str);
+      return true;
+    });
+    return;
+  }
+
+  if (st.second == kEncodingPackedIntSet) {
+    char buf[32];
+    ((const PackedIntSet*)st.first)->Iterate([result, &buf](int64_t member) {
+      char* next = absl::numbers_internal::FastIntToBuffer(member, buf);
+      result->erase(string_view{buf, size_t(next - buf)});
+      return true;
+    });
+    return;
+  }
+
   if (true) {
     StringSet* ss = (StringSet*)st.first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
@@ -273,29 +489,41 @@ void DiffStrSet(const DbContext& db_context, const SetType& st,
   }
 }
 
-void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, StringVec* result) {
+// Stops after limit members if limit is not 0.
+void InterStrSet(const DbContext& db_context, const vector<SetType>& vec, unsigned limit,
+                 StringVec* result) {
+  auto check = [&](string_view str) {
+    size_t j = 1;
+    for (j = 1; j < vec.size(); ++j) {
+      if (vec[j].first != vec.front().first && !IsInSet(db_context, vec[j], str)) {
+        break;
+      }
+    }
+
+    if (j == vec.size()) {
+      result->push_back(std::string(str));
+    }
+    return limit == 0 || result->size() < limit;
+  };
+
+  if (vec.front().second == kEncodingPackedSet) {
+    ((const PackedStringSet*)vec.front().first)->Iterate(check);
+    return;
+  }
+
   if (true) {
     StringSet* ss = (StringSet*)vec.front().first;
     ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
     for (const sds ptr : *ss) {
-      std::string_view str{ptr, sdslen(ptr)};
-      size_t j = 1;
-      for (j = 1; j < vec.size(); ++j) {
-        if (vec[j].first != ss && !IsInSet(db_context, vec[j], str)) {
-          break;
-        }
-      }
-
-      if (j == vec.size()) {
-        result->push_back(std::string(str));
-      }
+      if (!check(std::string_view{ptr, sdslen(ptr)}))
+        break;
     }
   }
 }
 
 StringVec RandMemberStrSet(const DbContext& db_context, const CompactObj& co,
                            PicksGenerator& generator, std::size_t picks_count) {
-  CHECK(IsDenseEncoding(co));
+  DCHECK_NE(co.Encoding(), kEncodingIntSet);
 
   std::unordered_map<RandomPick, std::uint32_t> times_index_is_picked;
   for (std::size_t i = 0; i < picks_count; i++) {
@@ -305,8 +533,10 @@ StringVec RandMemberStrSet(const DbContext& db_context, const CompactObj& co,
   StringVec result;
   result.reserve(picks_count);
 
-  StringSet* ss = static_cast<StringSet*>(co.RObjPtr());
-  ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
+  if (IsDenseEncoding(co)) {
+    StringSet* ss = static_cast<StringSet*>(co.RObjPtr());
+    ss->set_time(MemberTimeSeconds(db_context.time_now_ms));
+  }
 
   std::uint32_t ss_entry_index = 0;
   container_utils::IterateSet(
@@ -407,58 +637,6 @@ ResultSetView DiffResultVec(const ResultStringVec& result_vec, ShardId src_shard
   return uniques;
 }
 
-OpResult<SvArray> InterResultVec(const ResultStringVec& result_vec, unsigned required_shard_cnt,
-                                 unsigned limit = 0) {
-  absl::flat_hash_map<std::string_view, unsigned> uniques;
-
-  for (const auto& res : result_vec) {
-    if (!res && !base::_in(res.status(), {OpStatus::SKIPPED, OpStatus::KEY_NOTFOUND}))
-      return res.status();
-  }
-
-  for (const auto& res : result_vec) {
-    if (res.status() == OpStatus::KEY_NOTFOUND)
-      return OpStatus::OK;  // empty set.
-  }
-
-  bool first = true;
-  for (const auto& res : result_vec) {
-    if (res.status() == OpStatus::SKIPPED)
-      continue;
-
-    DCHECK(res);  // we handled it above.
-
-    // I use this awkward 'first' condition instead of table[s]++ deliberately.
-    // I do not want to add keys that I know will not stay in the set.
-    if (first) {
-      for (const string& s : res.value()) {
-        uniques.emplace(s, 1);
-      }
-      first = false;
-    } else {
-      for (const string& s : res.value()) {
-        auto it = uniques.find(s);
-        if (it != uniques.end()) {
-          ++it->second;
-        }
-      }
-    }
-  }
-
-  SvArray result;
-  result.reserve(uniques.size());
-
-  for (const auto& k_v : uniques) {
-    if (k_v.second == required_shard_cnt) {
-      if (limit != 0 && result.size() >= limit)
-        return result;
-      result.push_back(k_v.first);
-    }
-  }
-
-  return result;
-}
-
 SvArray ToSvArray(const absl::flat_hash_set<std::string_view>& set) {
   SvArray result;
   result.reserve(set.size());
@@ -519,15 +697,9 @@ OpResult<uint32_t> OpAdd(const OpArgs& op_args, std::string_view key, const NewE
 
       if (!success) {
         co.SetRObjPtr(is);
-
-        StringSet* ss = SetFamily::ConvertToStrSet(is, intsetLen(is));
-        if (!ss) {
+        if (!ConvertIntSet(&co, added)) {
           return OpStatus::OUT_OF_MEMORY;
         }
-
-        // frees 'is' on a way.
-        co.InitRobj(OBJ_SET, kEncodingStrMap2, ss);
-        inner_obj = co.RObjPtr();
         break;
       }
     }
@@ -536,8 +708,17 @@ OpResult<uint32_t> OpAdd(const OpArgs& op_args, std::string_view key, const NewE
       co.SetRObjPtr(is);
   }
 
-  if (co.Encoding() != kEncodingIntSet) {
-    res = AddStrSet(op_args.db_cntx, vals, UINT32_MAX, &co);
+  // The members that were already added are skipped by the next encoding.
+  if (co.Encoding() == kEncodingPackedIntSet) {
+    res += AddPackedIntSet(vals, &co);
+  }
+
+  if (co.Encoding() == kEncodingPackedSet) {
+    res += AddPackedSet(vals, &co);
+  }
+
+  if (IsDenseEncoding(co)) {
+    res += AddStrSet(op_args.db_cntx, vals, UINT32_MAX, &co);
   }
 
   if (journal_update && op_args.shard->journal()) {
@@ -579,12 +760,19 @@ OpResult<uint32_t> OpAddEx(const OpArgs& op_args, string_view key, uint32_t ttl_
         return OpStatus::OUT_OF_MEMORY;
       }
       co.InitRobj(OBJ_SET, kEncodingStrMap2, ss);
+    } else if (co.Encoding() == kEncodingPackedSet) {
+      // Only StringSet supports member expiry.
+      ConvertPackedSet(&co);
+    } else if (co.Encoding() == kEncodingPackedIntSet) {
+      ConvertPackedIntSet(&co, true);
     }
 
     CHECK(IsDenseEncoding(co));
   }
 
   uint32_t res = AddStrSet(op_args.db_cntx, vals, ttl_sec, &co);
+  db_slice.TrackFieldExpiry(op_args.db_cntx.db_index, key,
+                            MemberTimeSeconds(op_args.db_cntx.time_now_ms) + ttl_sec);
 
   return res;
 }
@@ -789,8 +977,115 @@ OpResult<StringVec> OpDiff(const OpArgs& op_args, ShardArgs::Iterator start,
   return ToVec(std::move(uniques));
 }
 
-// Read-only OpInter op on sets.
-OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first) {
+// The number of strings and the strings serialized as bulk strings.
+using SerializedStrings = pair<unsigned, RedisReplyBuilder::BulkStrChunks>;
+
+// Returns the number of members and the members serialized as bulk strings.
+OpResult<SerializedStrings> OpSerializeMembers(const OpArgs& op_args, string_view key) {
+  auto find_res = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_SET);
+  if (!find_res) {
+    if (find_res.status() == OpStatus::KEY_NOTFOUND)
+      return SerializedStrings{};
+    return find_res.status();
+  }
+
+  const PrimeValue& pv = find_res.value()->second;
+  if (IsDenseEncoding(pv)) {
+    StringSet* ss = (StringSet*)pv.RObjPtr();
+    ss->set_time(MemberTimeSeconds(op_args.db_cntx.time_now_ms));
+  }
+
+  // Expired members are skipped during the iteration, so count the members we actually see.
+  SerializedStrings res;
+  container_utils::IterateSet(pv, [&res](container_utils::ContainerEntry ce) {
+    if (ce.value) {
+      RedisReplyBuilder::AppendBulkString({ce.value, ce.length}, &res.second);
+    } else {
+      char buf[absl::numbers_internal::kFastToBufferSize];
+      char* end = absl::numbers_internal::FastIntToBuffer(ce.longval, buf);
+      RedisReplyBuilder::AppendBulkString({buf, size_t(end - buf)}, &res.second);
+    }
+    ++res.first;
+    return true;
+  });
+  return res;
+}
+
+// Finds the sets of the shard keys, skipping the first key if remove_first is set.
+OpStatus FindShardSets(const Transaction* t, EngineShard* es, bool remove_first,
+                       vector<SetType>* sets) {
+  ShardArgs args = t->GetShardArgs(es->shard_id());
+  auto it = args.begin();
+  if (remove_first) {
+    ++it;
+  }
+  DCHECK(it != args.end());
+
+  sets->resize(args.Size() - int(remove_first));
+
+  OpStatus status = OpStatus::OK;
+  unsigned index = 0;
+  for (; it != args.end(); ++it) {
+    auto& dest = (*sets)[index++];
+    auto find_res = es->db_slice().FindReadOnly(t->GetDbContext(), *it, OBJ_SET);
+    if (!find_res) {
+      if (status == OpStatus::OK || status == OpStatus::KEY_NOTFOUND ||
+          find_res.status() != OpStatus::KEY_NOTFOUND) {
+        status = find_res.status();
+      }
+      continue;
+    }
+    const PrimeValue& pv = find_res.value()->second;
+    void* ptr = pv.RObjPtr();
+    dest = make_pair(ptr, pv.Encoding());
+  }
+  return status;
+}
+
+// Intersects the sets, starting from the smallest one. Stops after limit members if limit is
+// not 0.
+StringVec InterSets(const DbContext& db_cntx, vector<SetType>* sets, unsigned limit) {
+  auto comp = [&db_cntx](const SetType& left, const SetType& right) {
+    return SetTypeLen(db_cntx, left) < SetTypeLen(db_cntx, right);
+  };
+
+  std::sort(sets->begin(), sets->end(), comp);
+
+  StringVec result;
+  auto check_int = [&](int64_t intele) {
+    size_t j = 1;
+    for (j = 1; j < sets->size(); j++) {
+      if ((*sets)[j].first != sets->front().first && !IsInSet(db_cntx, (*sets)[j], intele))
+        break;
+    }
+
+    /* Only take action when all sets contain the member */
+    if (j == sets->size()) {
+      result.push_back(absl::StrCat(intele));
+    }
+    return limit == 0 || result.size() < limit;
+  };
+
+  int encoding = sets->front().second;
+  if (encoding == kEncodingIntSet) {
+    int ii = 0;
+    intset* is = (intset*)sets->front().first;
+    int64_t intele;
+
+    while (intsetGet(is, ii++, &intele) && check_int(intele)) {
+    }
+  } else if (encoding == kEncodingPackedIntSet) {
+    ((const PackedIntSet*)sets->front().first)->Iterate(check_int);
+  } else {
+    InterStrSet(db_cntx, *sets, limit, &result);
+  }
+
+  return result;
+}
+
+// Read-only OpInter op on sets. Stops after limit members if limit is not 0.
+OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_first,
+                            unsigned limit = 0) {
   ShardArgs args = t->GetShardArgs(es->shard_id());
   auto it = args.begin();
   if (remove_first) {
@@ -811,63 +1106,172 @@ OpResult<StringVec> OpInter(const Transaction* t, EngineShard* es, bool remove_f
     }
 
     container_utils::IterateSet(find_res.value()->second,
-                                [&result](container_utils::ContainerEntry ce) {
+                                [&result, limit](container_utils::ContainerEntry ce) {
                                   result.push_back(ce.ToString());
-                                  return true;
+                                  return limit == 0 || result.size() < limit;
                                 });
     return result;
   }
 
-  vector<SetType> sets(args.Size() - int(remove_first));
+  vector<SetType> sets;
+  if (OpStatus status = FindShardSets(t, es, remove_first, &sets); status != OpStatus::OK)
+    return status;
+
+  return InterSets(t->GetDbContext(), &sets, limit);
+}
 
-  OpStatus status = OpStatus::OK;
-  unsigned index = 0;
-  for (; it != args.end(); ++it) {
-    auto& dest = sets[index++];
-    auto find_res = es->db_slice().FindReadOnly(t->GetDbContext(), *it, OBJ_SET);
-    if (!find_res) {
-      if (status == OpStatus::OK || status == OpStatus::KEY_NOTFOUND ||
-          find_res.status() != OpStatus::KEY_NOTFOUND) {
-        status = find_res.status();
-      }
-      continue;
-    }
-    const PrimeValue& pv = find_res.value()->second;
-    void* ptr = pv.RObjPtr();
-    dest = make_pair(ptr, pv.Encoding());
-  }
+// Sets that are smaller than this are intersected already by the first hop of a multi-shard
+// intersection.
+constexpr size_t kInterInlineCard = 1024;
+
+struct ShardInterProbe {
+  size_t min_card = 0;          // of the sets of the shard.
+  optional<StringVec> members;  // the intersection of the shard, if its sets are small.
+};
 
-  if (status != OpStatus::OK)
+OpResult<ShardInterProbe> OpInterProbe(const Transaction* t, EngineShard* es,
+                                       bool remove_first) {
+  vector<SetType> sets;
+  if (OpStatus status = FindShardSets(t, es, remove_first, &sets); status != OpStatus::OK)
     return status;
 
-  auto comp = [db_contx = t->GetDbContext()](const SetType& left, const SetType& right) {
-    return SetTypeLen(db_contx, left) < SetTypeLen(db_contx, right);
-  };
+  ShardInterProbe res;
+  res.min_card = SetTypeLen(t->GetDbContext(), sets.front());
+  for (const auto& set : sets)
+    res.min_card = min<size_t>(res.min_card, SetTypeLen(t->GetDbContext(), set));
 
-  std::sort(sets.begin(), sets.end(), comp);
+  if (res.min_card <= kInterInlineCard)
+    res.members = InterSets(t->GetDbContext(), &sets, 0);
+  return res;
+}
 
-  int encoding = sets.front().second;
-  if (encoding == kEncodingIntSet) {
-    int ii = 0;
-    intset* is = (intset*)sets.front().first;
-    int64_t intele;
+// Marks the candidates that are members of all the sets of the shard.
+vector<uint8_t> OpInterFilter(const Transaction* t, EngineShard* es, bool remove_first,
+                              const StringVec& candidates) {
+  vector<uint8_t> res(candidates.size(), 0);
+  vector<SetType> sets;
+  if (FindShardSets(t, es, remove_first, &sets) != OpStatus::OK)
+    return res;
+
+  for (size_t i = 0; i < candidates.size(); ++i) {
+    res[i] = all_of(sets.begin(), sets.end(), [&](const SetType& set) {
+      return IsInSet(t->GetDbContext(), set, candidates[i]);
+    });
+  }
+  return res;
+}
 
-    while (intsetGet(is, ii++, &intele)) {
-      size_t j = 1;
-      for (j = 1; j < sets.size(); j++) {
-        if (sets[j].first != is && !IsInSet(t->GetDbContext(), sets[j], intele))
-          break;
-      }
+// Intersects the sets of a SINTER* command that spans multiple shards, so that intersecting a
+// small set with a large one copies only the members of the small set between threads.
+// The first hop finds the shard with the smallest set and intersects the shards with small sets.
+// The members of the smallest shard are then filtered by the other shards: on the coordinator
+// with the results of the first hop where they exist, otherwise by another hop.
+// The first key of dest_shard is the destination and is not intersected. Stops after limit
+// members if limit is not 0 and concludes the transaction if conclude is set.
+OpResult<StringVec> InterMultiShard(Transaction* tx, ShardId dest_shard, bool conclude,
+                                    unsigned limit) {
+  vector<OpResult<ShardInterProbe>> probes(shard_set->size(), OpStatus::SKIPPED);
+  auto probe_cb = [&](Transaction* t, EngineShard* shard) {
+    ShardId sid = shard->shard_id();
+    bool is_dest = sid == dest_shard;
+    if (is_dest && t->GetShardArgs(sid).Size() == 1)
+      return OpStatus::OK;
+    probes[sid] = OpInterProbe(t, shard, is_dest);
+    return OpStatus::OK;
+  };
+  tx->Execute(std::move(probe_cb), false);
 
-      /* Only take action when all sets contain the member */
-      if (j == sets.size()) {
-        result.push_back(absl::StrCat(intele));
-      }
+  auto finish = [&](OpResult<StringVec> res) {
+    if (conclude)
+      tx->Conclude();
+    return res;
+  };
+
+  // Errors have precedence over missing keys, which make the intersection empty.
+  optional<ShardId> smallest;
+  bool empty = false;
+  for (ShardId sid = 0; sid < probes.size(); ++sid) {
+    const auto& probe = probes[sid];
+    if (probe.status() == OpStatus::SKIPPED)
+      continue;
+    if (probe.status() == OpStatus::KEY_NOTFOUND) {
+      empty = true;
+    } else if (!probe) {
+      return finish(probe.status());
+    } else if (!smallest || probe->min_card < probes[*smallest]->min_card) {
+      smallest = sid;
     }
+  }
+  if (empty || !smallest)
+    return finish(StringVec{});
+
+  StringVec candidates;
+  if (probes[*smallest]->members) {
+    candidates = std::move(*probes[*smallest]->members);
   } else {
-    InterStrSet(t->GetDbContext(), sets, &result);
+    tx->Execute(
+        [&](Transaction* t, EngineShard* shard) {
+          if (shard->shard_id() == *smallest) {
+            if (auto res = OpInter(t, shard, *smallest == dest_shard); res)
+              candidates = std::move(*res);
+          }
+          return OpStatus::OK;
+        },
+        false);
+  }
+
+  vector<uint8_t> keep(candidates.size(), 1);
+  bool filter_hop = false;
+  for (ShardId sid = 0; sid < probes.size(); ++sid) {
+    if (sid == *smallest || !probes[sid])
+      continue;
+    if (!probes[sid]->members) {
+      filter_hop = true;
+      continue;
+    }
+    absl::flat_hash_set<string_view> members(probes[sid]->members->begin(),
+                                             probes[sid]->members->end());
+    for (size_t i = 0; i < candidates.size(); ++i)
+      keep[i] &= members.contains(candidates[i]);
+  }
+
+  if (filter_hop && !candidates.empty()) {
+    vector<vector<uint8_t>> masks(shard_set->size());
+    auto filter_cb = [&](Transaction* t, EngineShard* shard) {
+      ShardId sid = shard->shard_id();
+      if (sid != *smallest && probes[sid] && !probes[sid]->members)
+        masks[sid] = OpInterFilter(t, shard, sid == dest_shard, candidates);
+      return OpStatus::OK;
+    };
+    tx->Execute(std::move(filter_cb), conclude);
+
+    for (const auto& mask : masks) {
+      for (size_t i = 0; i < mask.size(); ++i)
+        keep[i] &= mask[i];
+    }
+  } else if (conclude) {
+    tx->Conclude();
   }
 
+  StringVec result;
+  for (size_t i = 0; i < candidates.size() && (limit == 0 || result.size() < limit); ++i) {
+    if (keep[i])
+      result.push_back(std::move(candidates[i]));
+  }
+  return result;
+}
+
+// Intersection of the keys of SINTER and SINTERCARD.
+OpResult<StringVec> InterKeys(Transaction* tx, unsigned limit) {
+  if (tx->GetUniqueShardCnt() > 1)
+    return InterMultiShard(tx, kInvalidSid, true, limit);
+
+  auto cb = [limit](Transaction* t, EngineShard* shard) {
+    return OpInter(t, shard, false, limit);
+  };
+  OpResult<StringVec> result = tx->ScheduleSingleHopT(std::move(cb));
+  if (result.status() == OpStatus::KEY_NOTFOUND)
+    return StringVec{};
   return result;
 }
 
@@ -982,6 +1386,10 @@ OpResult<StringVec> OpScan(const OpArgs& op_args, string_view key, uint64_t* cur
       }
     }
     *cursor = 0;
+  } else if (it->second.Encoding() == kEncodingPackedSet) {
+    *cursor = ScanPackedSet(it->second, *cursor, scan_op, &res);
+  } else if (it->second.Encoding() == kEncodingPackedIntSet) {
+    *cursor = ScanPackedIntSet(it->second, *cursor, scan_op, &res);
   } else {
     *cursor = ScanStrSet(op_args.db_cntx, it->second, *cursor, scan_op, &res);
   }
@@ -1238,6 +1646,24 @@ void SDiffStore(CmdArgList args, ConnectionContext* cntx) {
 }
 
 void SMembers(CmdArgList args, ConnectionContext* cntx) {
+  auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+
+  // Serialize the members right away instead of copying them into strings. Scripts need
+  // the members sorted, so they go through OpInter.
+  if (!cntx->conn_state.script_info) {
+    string_view key = ArgS(args, 0);
+    auto cb = [key](Transaction* t, EngineShard* shard) {
+      return OpSerializeMembers(t->GetOpArgs(shard), key);
+    };
+
+    OpResult<SerializedStrings> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+    if (result)
+      rb->SendBulkStrArr(result->first, std::move(result->second), RedisReplyBuilder::SET);
+    else
+      cntx->SendError(result.status());
+    return;
+  }
+
   auto cb = [](Transaction* t, EngineShard* shard) { return OpInter(t, shard, false); };
 
   OpResult<StringVec> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
@@ -1245,10 +1671,7 @@ void SMembers(CmdArgList args, ConnectionContext* cntx) {
   if (result || result.status() == OpStatus::KEY_NOTFOUND) {
     StringVec& svec = result.value();
 
-    if (cntx->conn_state.script_info) {  // sort under script
-      sort(svec.begin(), svec.end());
-    }
-    auto* rb = static_cast<RedisReplyBuilder*>(cntx->reply_builder());
+    sort(svec.begin(), svec.end());  // sort under script
     rb->SendStringArr(*result, RedisReplyBuilder::SET);
   } else {
     cntx->SendError(result.status());
@@ -1288,18 +1711,9 @@ void SRandMember(CmdArgList args, ConnectionContext* cntx) {
 }
 
 void SInter(CmdArgList args, ConnectionContext* cntx) {
-  ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
-
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    result_set[shard->shard_id()] = OpInter(t, shard, false);
-
-    return OpStatus::OK;
-  };
-
-  cntx->transaction->ScheduleSingleHop(std::move(cb));
-  OpResult<SvArray> result = InterResultVec(result_set, cntx->transaction->GetUniqueShardCnt());
+  OpResult<StringVec> result = InterKeys(cntx->transaction, 0);
   if (result) {
-    SvArray arr = std::move(*result);
+    StringVec arr = std::move(*result);
     if (cntx->conn_state.script_info) {  // sort under script
       sort(arr.begin(), arr.end());
     }
@@ -1311,35 +1725,20 @@ void SInter(CmdArgList args, ConnectionContext* cntx) {
 }
 
 void SInterStore(CmdArgList args, ConnectionContext* cntx) {
-  ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
   string_view dest_key = ArgS(args, 0);
-  ShardId dest_shard = Shard(dest_key, result_set.size());
-  atomic_uint32_t inter_shard_cnt{0};
-
-  auto inter_cb = [&](Transaction* t, EngineShard* shard) {
-    ShardArgs largs = t->GetShardArgs(shard->shard_id());
-    if (shard->shard_id() == dest_shard) {
-      CHECK_EQ(largs.Front(), dest_key);
-      if (largs.Size() == 1)
-        return OpStatus::OK;
-    }
-    inter_shard_cnt.fetch_add(1, memory_order_relaxed);
-    result_set[shard->shard_id()] = OpInter(t, shard, shard->shard_id() == dest_shard);
-    return OpStatus::OK;
-  };
-
-  cntx->transaction->Execute(std::move(inter_cb), false);
+  ShardId dest_shard = Shard(dest_key, shard_set->size());
 
-  OpResult<SvArray> result = InterResultVec(result_set, inter_shard_cnt.load(memory_order_relaxed));
+  OpResult<StringVec> result = InterMultiShard(cntx->transaction, dest_shard, false, 0);
   if (!result) {
     cntx->transaction->Conclude();
     cntx->SendError(result.status());
     return;
   }
 
+  SvArray members(result->begin(), result->end());
   auto store_cb = [&](Transaction* t, EngineShard* shard) {
     if (shard->shard_id() == dest_shard) {
-      OpAdd(t->GetOpArgs(shard), dest_key, result.value(), true, true);
+      OpAdd(t->GetOpArgs(shard), dest_key, members, true, true);
     }
 
     return OpStatus::OK;
@@ -1361,16 +1760,9 @@ void SInterCard(CmdArgList args, ConnectionContext* cntx) {
   } else if (args.size() > (num_keys + 1))
     return cntx->SendError(kSyntaxErr);
 
-  ResultStringVec result_set(shard_set->size(), OpStatus::SKIPPED);
-  auto cb = [&](Transaction* t, EngineShard* shard) {
-    result_set[shard->shard_id()] = OpInter(t, shard, false);
-    return OpStatus::OK;
-  };
-
-  cntx->transaction->ScheduleSingleHop(std::move(cb));
-  OpResult<SvArray> result =
-      InterResultVec(result_set, cntx->transaction->GetUniqueShardCnt(), limit);
-
+  OpResult<StringVec> result = InterKeys(cntx->transaction, limit);
+  if (!result)
+    return cntx->SendError(result.status());
   return cntx->SendLong(result->size());
 }
 
@@ -1582,6 +1974,18 @@ uint32_t SetFamily::MaxIntsetEntries() {
   return kMaxIntSetEntries;
 }
 
+uint32_t SetFamily::MaxPackedSetEntries() {
+  return GetFlag(FLAGS_max_packed_set_entries);
+}
+
+uint32_t SetFamily::MaxPackedIntSetEntries() {
+  return GetFlag(FLAGS_max_packed_intset_entries);
+}
+
+size_t SetFamily::MaxPackedMemberLen() {
+  return kMaxPackedMemberLen;
+}
+
 int32_t SetFamily::FieldExpireTime(const DbContext& db_context, const PrimeValue& pv,
                                    std::string_view field) {
   DCHECK_EQ(OBJ_SET, pv.ObjType());
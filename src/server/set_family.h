@@ -25,6 +25,11 @@ class SetFamily {
 
   static uint32_t MaxIntsetEntries();
 
+  // Limits of the packed encoding for sets of short strings.
+  static uint32_t MaxPackedSetEntries();
+  static uint32_t MaxPackedIntSetEntries();
+  static size_t MaxPackedMemberLen();
+
   // Returns nullptr on OOM.
   static StringSet* ConvertToStrSet(const intset* is, size_t expected_len);
 
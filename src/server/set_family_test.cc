@@ -4,6 +4,7 @@
 
 #include "server/set_family.h"
 
+#include "base/flags.h"
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -15,6 +16,9 @@ using namespace std;
 using namespace util;
 using namespace boost;
 
+ABSL_DECLARE_FLAG(uint32_t, max_packed_set_entries);
+ABSL_DECLARE_FLAG(uint32_t, max_packed_intset_entries);
+
 namespace dfly {
 
 class SetFamilyTest : public BaseFamilyTest {
@@ -47,6 +51,28 @@ TEST_F(SetFamilyTest, SAdd) {
   EXPECT_EQ(resp, "set");
 }
 
+TEST_F(SetFamilyTest, OffloadedReply) {
+  absl::FlagSaver fs;
+  SetTestFlag("reply_offload_min_len", "16");
+  ResetService();
+
+  vector<string> members;
+  for (unsigned i = 0; i < 100; ++i)
+    members.push_back(absl::StrCat(i % 2 ? "member" : "a-much-longer-set-member-", i));
+
+  vector<string> args = {"sadd", "s"};
+  args.insert(args.end(), members.begin(), members.end());
+  EXPECT_THAT(Run(absl::MakeSpan(args)), IntArg(100));
+
+  auto resp = Run({"smembers", "s"});
+  ASSERT_THAT(resp, ArrLen(100));
+  EXPECT_THAT(resp.GetVec(), UnorderedElementsAreArray(members));
+
+  // Small replies are serialized directly.
+  Run({"sadd", "small", "a", "b"});
+  EXPECT_THAT(Run({"smembers", "small"}).GetVec(), UnorderedElementsAre("a", "b"));
+}
+
 TEST_F(SetFamilyTest, IntConv) {
   auto resp = Run({"sadd", "x", "134"});
   EXPECT_THAT(resp, IntArg(1));
@@ -109,6 +135,28 @@ TEST_F(SetFamilyTest, SInter) {
   EXPECT_THAT(resp, IntArg(0));
 }
 
+TEST_F(SetFamilyTest, SInterSmallAndLarge) {
+  // Large sets are not intersected by the first hop, their shards filter the small set.
+  vector<string> sadd = {"sadd", "large"};
+  for (unsigned i = 0; i < 5000; ++i)
+    sadd.push_back(absl::StrCat("m", i));
+  Run(absl::MakeSpan(sadd));
+  sadd[1] = "large2";
+  Run(absl::MakeSpan(sadd));
+  Run({"sadd", "small", "m1", "m2", "m4999", "x"});
+
+  auto resp = Run({"sinter", "large", "small", "large2"});
+  ASSERT_THAT(resp, ArgType(RespExpr::ARRAY));
+  EXPECT_THAT(resp.GetVec(), UnorderedElementsAre("m1", "m2", "m4999"));
+  EXPECT_EQ(3, CheckedInt({"sintercard", "3", "large", "small", "large2"}));
+  EXPECT_EQ(2, CheckedInt({"sintercard", "3", "large", "small", "large2", "LIMIT", "2"}));
+  EXPECT_EQ(4999, CheckedInt({"sintercard", "2", "large", "large2", "LIMIT", "4999"}));
+
+  EXPECT_EQ(3, CheckedInt({"sinterstore", "dest", "small", "large"}));
+  EXPECT_EQ(5000, CheckedInt({"sinterstore", "dest", "large", "large2"}));
+  EXPECT_EQ(0, CheckedInt({"sinterstore", "dest", "large", "missing"}));
+}
+
 TEST_F(SetFamilyTest, SInterCard) {
   Run({"sadd", "s1", "2", "b", "1", "a"});
   Run({"sadd", "s2", "3", "c", "2", "b"});
@@ -353,4 +401,107 @@ TEST_F(SetFamilyTest, SScan) {
   EXPECT_THAT(vec.size(), 0);
 }
 
+TEST_F(SetFamilyTest, PackedEncoding) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_max_packed_set_entries, 10);
+
+  // An intset is converted to the packed encoding by the first string member.
+  EXPECT_THAT(Run({"sadd", "s", "1", "2", "a"}), IntArg(3));
+  for (unsigned i = 0; i < 7; ++i)
+    Run({"sadd", "s", absl::StrCat("m", i)});
+  EXPECT_THAT(Run({"srem", "s", "1", "x"}), IntArg(1));
+  EXPECT_THAT(Run({"sismember", "s", "2"}), IntArg(1));
+  EXPECT_THAT(Run({"sismember", "s", "1"}), IntArg(0));
+
+  // The 11th member converts the set to StringSet.
+  EXPECT_THAT(Run({"sadd", "s", "1", "m7"}), IntArg(2));
+  EXPECT_THAT(Run({"scard", "s"}), IntArg(11));
+  EXPECT_THAT(Run({"sismember", "s", "m7"}), IntArg(1));
+
+  // So do long members and member expiry.
+  string long_member(100, 'x');
+  EXPECT_THAT(Run({"sadd", "l", "a", "m1"}), IntArg(2));
+  EXPECT_THAT(Run({"sadd", "l", "b", long_member}), IntArg(2));
+  EXPECT_THAT(Run({"smembers", "l"}).GetVec(), UnorderedElementsAre("a", "b", "m1", long_member));
+
+  Run({"sadd", "p", "a", "b", "c"});
+  EXPECT_EQ(-1, CheckedInt({"fieldttl", "p", "a"}));
+  EXPECT_EQ(-3, CheckedInt({"fieldttl", "p", "d"}));
+  EXPECT_THAT(Run({"saddex", "p", "10", "d"}), IntArg(1));
+  EXPECT_EQ(10, CheckedInt({"fieldttl", "p", "d"}));
+  EXPECT_THAT(Run({"smembers", "p"}).GetVec(), UnorderedElementsAre("a", "b", "c", "d"));
+
+  Run({"sadd", "q", "a", "c", "m1", "z"});
+
+  // Scanning over a packed set honours the count.
+  vector<string> members;
+  string cursor = "0";
+  do {
+    auto resp = Run({"sscan", "q", cursor, "count", "1"});
+    auto vec = resp.GetVec();
+    cursor = vec[0].GetString();
+    for (const auto& member : StrArray(vec[1]))
+      members.push_back(member);
+  } while (cursor != "0");
+  EXPECT_THAT(members, UnorderedElementsAre("a", "c", "m1", "z"));
+
+  EXPECT_THAT(Run({"sinter", "q", "s", "l"}).GetVec(), UnorderedElementsAre("a", "m1"));
+  EXPECT_THAT(Run({"sdiff", "q", "p"}).GetVec(), UnorderedElementsAre("m1", "z"));
+  EXPECT_THAT(Run({"spop", "q", "3"}).GetVec(), SizeIs(3));
+  EXPECT_THAT(Run({"scard", "q"}), IntArg(1));
+}
+
+TEST_F(SetFamilyTest, PackedIntEncoding) {
+  absl::FlagSaver fs;
+  absl::SetFlag(&FLAGS_max_packed_intset_entries, 1000);
+
+  // More members than an intset holds.
+  vector<string> args = {"sadd", "s"};
+  for (unsigned i = 0; i < 600; ++i)
+    args.push_back(absl::StrCat(i * 2));
+  EXPECT_THAT(Run(args), IntArg(600));
+  EXPECT_THAT(Run({"sadd", "s", "-5", "0"}), IntArg(1));
+  EXPECT_THAT(Run({"scard", "s"}), IntArg(601));
+  EXPECT_THAT(Run({"sismember", "s", "598"}), IntArg(1));
+  EXPECT_THAT(Run({"sismember", "s", "599"}), IntArg(0));
+  EXPECT_THAT(Run({"sismember", "s", "a"}), IntArg(0));
+  EXPECT_THAT(Run({"srem", "s", "-5", "1", "a"}), IntArg(1));
+
+  args[1] = "t";
+  args.resize(302);
+  Run(args);
+  EXPECT_THAT(Run({"sadd", "t", "1", "3"}), IntArg(2));
+  EXPECT_THAT(Run({"sinter", "t", "s"}).GetVec(), SizeIs(300));
+  EXPECT_THAT(Run({"sdiff", "t", "s"}).GetVec(), UnorderedElementsAre("1", "3"));
+
+  // Scanning visits every member once.
+  vector<string> members;
+  string cursor = "0";
+  do {
+    auto resp = Run({"sscan", "s", cursor, "count", "100"});
+    auto vec = resp.GetVec();
+    cursor = vec[0].GetString();
+    for (const auto& member : StrArray(vec[1]))
+      members.push_back(member);
+  } while (cursor != "0");
+  sort(members.begin(), members.end());
+  EXPECT_EQ(600, members.size());
+  EXPECT_TRUE(adjacent_find(members.begin(), members.end()) == members.end());
+
+  // A string member converts the set to a string encoding.
+  EXPECT_THAT(Run({"sadd", "t", "a"}), IntArg(1));
+  EXPECT_THAT(Run({"scard", "t"}), IntArg(303));
+  EXPECT_THAT(Run({"sismember", "t", "598"}), IntArg(1));
+
+  // So does outgrowing the encoding.
+  args = {"sadd", "u"};
+  for (unsigned i = 0; i < 1000; ++i)
+    args.push_back(absl::StrCat(i * 2));
+  Run(args);
+  EXPECT_THAT(Run({"sadd", "u", "1", "3"}), IntArg(2));
+  EXPECT_THAT(Run({"scard", "u"}), IntArg(1002));
+  EXPECT_THAT(Run({"spop", "u", "2"}).GetVec(), SizeIs(2));
+  EXPECT_THAT(Run({"scard", "u"}), IntArg(1000));
+}
+
 }  // namespace dfly
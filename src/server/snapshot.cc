@@ -4,10 +4,14 @@
 
 #include "server/snapshot.h"
 
+#include <absl/cleanup/cleanup.h>
 #include <absl/functional/bind_front.h>
 #include <absl/strings/match.h>
 #include <absl/strings/str_cat.h>
 
+#include <array>
+
+#include "base/flags.h"
 #include "base/logging.h"
 #include "core/heap_size.h"
 #include "server/db_slice.h"
@@ -15,8 +19,19 @@
 #include "server/journal/journal.h"
 #include "server/rdb_extensions.h"
 #include "server/rdb_save.h"
+#include "server/server_state.h"
 #include "server/tiered_storage.h"
 
+ABSL_FLAG(double, snapshot_cpu_share, 1.0,
+          "Maximal share of a shard thread that the snapshot iteration uses while the shard also "
+          "serves commands. Lower values keep the latency of the commands flat during a snapshot "
+          "at the cost of a longer snapshot, 1 disables the throttling");
+
+ABSL_FLAG(uint64_t, snapshot_cow_buffer_limit, 64u << 20,
+          "Bytes that a shard snapshot may buffer before pushing them to its channel. Above it, "
+          "write commands are delayed briefly and above twice of it the buckets copied before "
+          "writes are serialized without compression. 0 leaves the buffer unbounded");
+
 namespace dfly {
 
 using namespace std;
@@ -25,6 +40,25 @@ using namespace chrono_literals;
 
 namespace {
 thread_local absl::flat_hash_set<SliceSnapshot*> tl_slice_snapshots;
+
+// Snapshots whose buffer is over the limit, of all the shards and of every shard.
+constexpr unsigned kMaxCowShards = 1024;
+atomic_uint32_t cow_overloaded_snapshots{0};
+array<atomic_uint32_t, kMaxCowShards> cow_overloaded_by_shard{};
+atomic_uint64_t cow_writer_delay_usec{0};
+
+// A write command waits at most kCowMaxWaits * kCowWait for the snapshots to catch up.
+constexpr auto kCowWait = 100us;
+constexpr unsigned kCowMaxWaits = 10;
+
+// Chunks are pushed by the snapshot fiber only, so past this many of them, queued by the writers
+// that serialize buckets, the writers are delayed as well.
+constexpr size_t kMaxPendingChunks = 16;
+
+// A yield that returns sooner means that no other fiber had work to do.
+constexpr uint64_t kIdleYieldNs = 20'000;
+constexpr uint64_t kMaxThrottleNs = 100'000'000;
+
 }  // namespace
 
 size_t SliceSnapshot::DbRecord::size() const {
@@ -38,6 +72,8 @@ SliceSnapshot::SliceSnapshot(DbSlice* slice, RecordChannel* dest, CompressionMod
 }
 
 SliceSnapshot::~SliceSnapshot() {
+  if (cow_overloaded_)
+    SetCowOverloaded(false);
   tl_slice_snapshots.erase(this);
 }
 
@@ -53,6 +89,38 @@ bool SliceSnapshot::IsSnaphotInProgress() {
   return tl_slice_snapshots.size() > 0;
 }
 
+bool SliceSnapshot::IsCowOverloaded() {
+  return cow_overloaded_snapshots.load(memory_order_relaxed) > 0;
+}
+
+void SliceSnapshot::AwaitCowBackpressure(absl::FunctionRef<bool(ShardId)> touches_shard) {
+  if (!IsCowOverloaded())
+    return;
+
+  auto overloaded = [&] {
+    unsigned shard_count = min<unsigned>(shard_set->size(), kMaxCowShards);
+    for (ShardId sid = 0; sid < shard_count; ++sid) {
+      if (cow_overloaded_by_shard[sid].load(memory_order_relaxed) > 0 && touches_shard(sid))
+        return true;
+    }
+    return false;
+  };
+
+  if (!overloaded())
+    return;
+
+  uint64_t start = ProactorBase::GetMonotonicTimeNs();
+  for (unsigned i = 0; i < kCowMaxWaits && overloaded(); ++i) {
+    ThisFiber::SleepFor(kCowWait);
+  }
+  uint64_t delay_usec = (ProactorBase::GetMonotonicTimeNs() - start) / 1000;
+  cow_writer_delay_usec.fetch_add(delay_usec, memory_order_relaxed);
+}
+
+uint64_t SliceSnapshot::GetCowWriterDelayUsec() {
+  return cow_writer_delay_usec.load(memory_order_relaxed);
+}
+
 void SliceSnapshot::Start(bool stream_journal, const Cancellation* cll) {
   DCHECK(!snapshot_fb_.IsJoinable());
 
@@ -67,6 +135,16 @@ void SliceSnapshot::Start(bool stream_journal, const Cancellation* cll) {
   }
 
   serializer_ = std::make_unique<RdbSerializer>(compression_mode_);
+  cow_buffer_limit_ = absl::GetFlag(FLAGS_snapshot_cow_buffer_limit);
+  if (max_chunk_size_ > 0) {
+    // We can't push to the channel during the atomic bucket serialization, so chunks are kept
+    // aside. Still, this avoids growing and copying one buffer that holds the whole value.
+    // Their number is bounded by delaying the writers, see UpdateCowPressure.
+    serializer_->SetChunkCallback(max_chunk_size_, [this](string chunk) {
+      pending_chunks_bytes_ += chunk.size();
+      pending_chunks_.push_back(std::move(chunk));
+    });
+  }
 
   VLOG(1) << "DbSaver::Start - saving entries with version less than " << snapshot_version_;
 
@@ -186,6 +264,13 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll, bool send_full_syn
     stats_.keys_total += db_slice_->DbSize(db_indx);
   }
 
+  stats_.start_ns = ProactorBase::GetMonotonicTimeNs();
+  uint64_t resumed_ns = stats_.start_ns;
+  absl::Cleanup set_end = [this, &resumed_ns] {
+    stats_.end_ns = ProactorBase::GetMonotonicTimeNs();
+    stats_.busy_ns += stats_.end_ns - resumed_ns;
+  };
+
   for (DbIndex db_indx = 0; db_indx < db_array_.size(); ++db_indx) {
     if (cll->IsCancelled())
       return;
@@ -209,7 +294,10 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll, bool send_full_syn
 
       if (stats_.loop_serialized >= last_yield + 100) {
         DVLOG(2) << "Before sleep " << ThisFiber::GetName();
-        ThisFiber::Yield();
+        uint64_t busy_ns = ProactorBase::GetMonotonicTimeNs() - resumed_ns;
+        ServerState::tlocal()->GetLatencyMonitor().Add("snapshot-cycle", busy_ns / 1000);
+        YieldAndThrottle(busy_ns);
+        resumed_ns = ProactorBase::GetMonotonicTimeNs();
         DVLOG(2) << "After sleep";
 
         last_yield = stats_.loop_serialized;
@@ -231,7 +319,29 @@ void SliceSnapshot::IterateBucketsFb(const Cancellation* cll, bool send_full_syn
 
   // serialized + side_saved must be equal to the total saved.
   VLOG(1) << "Exit SnapshotSerializer (loop_serialized/side_saved/cbcalls): "
-          << stats_.loop_serialized << "/" << stats_.side_saved << "/" << stats_.savecb_calls;
+          << stats_.loop_serialized << "/" << stats_.side_saved << "/" << stats_.savecb_calls
+          << ", cow bytes/uncompressed buckets: " << stats_.cow_bytes << "/"
+          << stats_.cow_uncompressed;
+}
+
+void SliceSnapshot::YieldAndThrottle(uint64_t busy_ns) {
+  stats_.busy_ns += busy_ns;
+
+  uint64_t yield_start = ProactorBase::GetMonotonicTimeNs();
+  ThisFiber::Yield();
+
+  double share = absl::GetFlag(FLAGS_snapshot_cpu_share);
+  uint64_t waited = ProactorBase::GetMonotonicTimeNs() - yield_start;
+  // Writers that wait for this snapshot to push its buffers are not kept waiting any longer.
+  if (share >= 1 || share <= 0 || waited < kIdleYieldNs || cow_overloaded_)
+    return;
+
+  // Pause for the rest of the cycle, of which the iteration ran for the given share.
+  uint64_t cycle = busy_ns / share;
+  if (cycle > busy_ns + waited) {
+    uint64_t pause = std::min(cycle - busy_ns - waited, kMaxThrottleNs);
+    ThisFiber::SleepFor(chrono::nanoseconds(pause));
+  }
 }
 
 bool SliceSnapshot::BucketSaveCb(PrimeIterator it) {
@@ -309,15 +419,26 @@ bool SliceSnapshot::PushSerializedToChannel(bool force) {
     delayed_entries_.pop_back();
   }
 
-  if (!force && serializer_->SerializedLen() < 4096)
-    return false;
+  // Chunks precede the data in the serializer's buffer.
+  bool pushed_chunks = !pending_chunks_.empty();
+  for (string& chunk : pending_chunks_) {
+    dest_->Push(DbRecord{.id = rec_id_++, .value = std::move(chunk)});
+  }
+  pending_chunks_.clear();
+  pending_chunks_bytes_ = 0;
+
+  if (!force && serializer_->SerializedLen() < 4096) {
+    UpdateCowPressure();
+    return pushed_chunks;
+  }
 
   io::StringFile sfile;
   serializer_->FlushToSink(&sfile);
+  UpdateCowPressure();
 
   size_t serialized = sfile.val.size();
   if (serialized == 0)
-    return 0;
+    return pushed_chunks;
 
   auto id = rec_id_++;
   DVLOG(2) << "Pushed " << id;
@@ -329,21 +450,63 @@ bool SliceSnapshot::PushSerializedToChannel(bool force) {
   return true;
 }
 
+void SliceSnapshot::SetCowOverloaded(bool overloaded) {
+  cow_overloaded_ = overloaded;
+  ShardId sid = db_slice_->shard_id();
+  if (overloaded) {
+    cow_overloaded_snapshots.fetch_add(1, memory_order_relaxed);
+    if (sid < kMaxCowShards)
+      cow_overloaded_by_shard[sid].fetch_add(1, memory_order_relaxed);
+  } else {
+    cow_overloaded_snapshots.fetch_sub(1, memory_order_relaxed);
+    if (sid < kMaxCowShards)
+      cow_overloaded_by_shard[sid].fetch_sub(1, memory_order_relaxed);
+  }
+}
+
+void SliceSnapshot::UpdateCowPressure() {
+  size_t buffered = serializer_->SerializedLen() + pending_chunks_bytes_;
+  bool overloaded = pending_chunks_.size() > kMaxPendingChunks ||
+                    (cow_buffer_limit_ && buffered > cow_buffer_limit_);
+  if (overloaded != cow_overloaded_)
+    SetCowOverloaded(overloaded);
+
+  if (cow_buffer_limit_ == 0)
+    return;
+
+  // The writers are delayed for a bounded time only, so past a hard cap we also make the
+  // serialization of the written buckets and the flush of the buffer cheaper.
+  serializer_->SetCompressionEnabled(buffered <= 2 * cow_buffer_limit_);
+}
+
 void SliceSnapshot::OnDbChange(DbIndex db_index, const DbSlice::ChangeReq& req) {
   FiberAtomicGuard fg;
   PrimeTable* table = db_slice_->GetTables(db_index).first;
+  size_t buffered = serializer_->SerializedLen() + pending_chunks_bytes_;
+  unsigned serialized = 0;
 
   if (const PrimeTable::bucket_iterator* bit = req.update()) {
     if (bit->GetVersion() < snapshot_version_) {
-      stats_.side_saved += SerializeBucket(db_index, *bit);
+      serialized += SerializeBucket(db_index, *bit);
     }
   } else {
     string_view key = get<string_view>(req.change);
-    table->CVCUponInsert(snapshot_version_, key, [this, db_index](PrimeTable::bucket_iterator it) {
-      DCHECK_LT(it.GetVersion(), snapshot_version_);
-      stats_.side_saved += SerializeBucket(db_index, it);
-    });
+    table->CVCUponInsert(snapshot_version_, key,
+                         [this, db_index, &serialized](PrimeTable::bucket_iterator it) {
+                           DCHECK_LT(it.GetVersion(), snapshot_version_);
+                           serialized += SerializeBucket(db_index, it);
+                         });
   }
+
+  if (serialized == 0)
+    return;
+
+  stats_.side_saved += serialized;
+  // Buffers only grow between the flushes.
+  stats_.cow_bytes += serializer_->SerializedLen() + pending_chunks_bytes_ - buffered;
+  if (cow_buffer_limit_ && buffered > 2 * cow_buffer_limit_)
+    ++stats_.cow_uncompressed;
+  UpdateCowPressure();
 }
 
 // For any key any journal entry must arrive at the replica strictly after its first original rdb
@@ -396,11 +559,19 @@ size_t SliceSnapshot::GetTempBuffersSize() const {
     return 0;
   }
 
-  return serializer_->GetTempBufferSize();
+  return serializer_->GetTempBufferSize() + pending_chunks_bytes_;
 }
 
 RdbSaver::SnapshotStats SliceSnapshot::GetCurrentSnapshotProgress() const {
-  return {stats_.loop_serialized + stats_.side_saved, stats_.keys_total};
+  uint64_t end_ns = stats_.end_ns ? stats_.end_ns : ProactorBase::GetMonotonicTimeNs();
+  uint64_t elapsed_ns = stats_.start_ns ? end_ns - stats_.start_ns : 0;
+  size_t cow_buffered = serializer_ ? serializer_->SerializedLen() + pending_chunks_bytes_ : 0;
+  return {stats_.loop_serialized + stats_.side_saved,
+          stats_.keys_total,
+          stats_.busy_ns / 1000,
+          elapsed_ns / 1000,
+          stats_.cow_bytes,
+          cow_buffered};
 }
 
 }  // namespace dfly
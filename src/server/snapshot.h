@@ -7,6 +7,7 @@
 #include <atomic>
 #include <bitset>
 
+#include "absl/functional/function_ref.h"
 #include "base/pod_array.h"
 #include "core/size_tracking_channel.h"
 #include "io/file.h"
@@ -47,6 +48,12 @@ struct Entry;
 // and submitting all values to an output channel.
 // In journal streaming mode, the snapshot continues submitting changes
 // over the channel until explicitly stopped.
+//
+// Bucket versions can not drive delta snapshots: they are bumped when an entry is written, but
+// deleting or expiring an entry leaves no trace in its bucket, and segment splits carry the
+// versions of the moved entries over. A delta would silently resurrect deleted keys on load,
+// since rdb has no delete opcode. Versions also restart with every process, so a
+// chain could not continue across restarts (DbSlice::version_ starts at 1).
 class SliceSnapshot {
  public:
   struct DbRecord {
@@ -64,6 +71,18 @@ class SliceSnapshot {
   static size_t GetThreadLocalMemoryUsage();
   static bool IsSnaphotInProgress();
 
+  // Whether the buffer of a snapshot of any shard grew beyond --snapshot_cow_buffer_limit,
+  // usually because the channel is full.
+  static bool IsCowOverloaded();
+
+  // Called by write commands before they run. Delays them for a short while if the buffer of a
+  // snapshot of a shard for which touches_shard returns true is overloaded, so that the copies
+  // made by OnDbChange do not inflate memory while nothing drains them.
+  static void AwaitCowBackpressure(absl::FunctionRef<bool(ShardId)> touches_shard);
+
+  // Total time that write commands were delayed by AwaitCowBackpressure.
+  static uint64_t GetCowWriterDelayUsec();
+
   // Initialize snapshot, start bucket iteration fiber, register listeners.
   // In journal streaming mode it needs to be stopped by either Stop or Cancel.
   void Start(bool stream_journal, const Cancellation* cll);
@@ -75,6 +94,12 @@ class SliceSnapshot {
   // called.
   void StartIncremental(Context* cntx, LSN start_lsn);
 
+  // Flush large values in chunks of about max_chunk_size bytes, 0 disables chunking.
+  // Must be called before Start() and only if the snapshot is the sole producer of dest.
+  void set_max_chunk_size(size_t max_chunk_size) {
+    max_chunk_size_ = max_chunk_size;
+  }
+
   // Stop snapshot. Only needs to be called for journal streaming mode.
   void Stop();
 
@@ -94,6 +119,10 @@ class SliceSnapshot {
   // Called on traversing cursor by IterateBucketsFb.
   bool BucketSaveCb(PrimeIterator it);
 
+  // Yields after IterateBucketsFb ran for busy_ns and, if the other fibers of the shard have work
+  // to do, pauses the iteration so that it uses at most --snapshot_cpu_share of the thread.
+  void YieldAndThrottle(uint64_t busy_ns);
+
   // Serialize single bucket.
   // Returns number of serialized entries, updates bucket version to snapshot version.
   unsigned SerializeBucket(DbIndex db_index, PrimeTable::bucket_iterator bucket_it);
@@ -116,6 +145,10 @@ class SliceSnapshot {
   // Return if pushed.
   bool PushSerializedToChannel(bool force);
 
+  // Updates the backpressure state and the compression of the serializer by the buffered size.
+  void UpdateCowPressure();
+  void SetCowOverloaded(bool overloaded);
+
  public:
   uint64_t snapshot_version() const {
     return snapshot_version_;
@@ -152,6 +185,15 @@ class SliceSnapshot {
   std::unique_ptr<RdbSerializer> serializer_;
   std::vector<DelayedEntry> delayed_entries_;  // collected during atomic bucket traversal
 
+  // Chunks of large values, produced during atomic bucket traversal and pushed before the
+  // serializer's buffer. Too many of them delay the writers like a full buffer does.
+  std::vector<std::string> pending_chunks_;
+  size_t pending_chunks_bytes_ = 0;
+  size_t max_chunk_size_ = 0;
+
+  size_t cow_buffer_limit_ = 0;  // --snapshot_cow_buffer_limit upon Start.
+  bool cow_overloaded_ = false;  // counted in the snapshots that delay the writers.
+
   // Used for sanity checks.
   bool serialize_bucket_running_ = false;
   util::fb2::Fiber snapshot_fb_;  // IterateEntriesFb
@@ -170,6 +212,10 @@ class SliceSnapshot {
     size_t side_saved = 0;
     size_t savecb_calls = 0;
     size_t keys_total = 0;
+    size_t cow_bytes = 0;         // serialized by OnDbChange.
+    size_t cow_uncompressed = 0;  // buckets serialized by OnDbChange without compression.
+    uint64_t busy_ns = 0;  // spent by IterateBucketsFb between its yields.
+    uint64_t start_ns = 0, end_ns = 0;
   } stats_;
 };
 
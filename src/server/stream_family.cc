@@ -578,6 +578,12 @@ streamNACK* StreamCreateNACK(streamConsumer* consumer) {
 }
 
 int StreamTrim(const AddTrimOpts& opts, stream* s) {
+  // Most XADD calls on a capped stream have nothing to trim, so they skip seeking the head
+  // of the radix tree.
+  if (opts.trim_strategy == TrimStrategy::kMaxLen && s->length <= opts.max_len) {
+    return 0;
+  }
+
   if (!opts.limit) {
     if (opts.trim_strategy == TrimStrategy::kMaxLen) {
       /* Notify xtrim event if needed. */
@@ -1593,6 +1599,16 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
   ClaimInfo result;
   result.justid = (opts.flags & kClaimJustID);
 
+  // Pending entries outside of [first_id, last_id] were trimmed, which is common for capped
+  // streams, so they are dropped without seeking the stream.
+  auto entry_exists = [stream](streamID* id) {
+    if (stream->length == 0 || streamCompareID(id, &stream->first_id) < 0 ||
+        streamCompareID(id, &stream->last_id) > 0) {
+      return false;
+    }
+    return streamEntryExists(stream, id) != 0;
+  };
+
   auto now = GetCurrentTimeMs();
   int count = opts.count;
   while (attempts-- && count && raxNext(&ri)) {
@@ -1601,7 +1617,7 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
     streamID id;
     streamDecodeID(ri.key, &id);
 
-    if (!streamEntryExists(stream, &id)) {
+    if (!entry_exists(&id)) {
       raxRemove(group->pel, ri.key, ri.key_len, nullptr);
       raxRemove(nack->consumer->pel, ri.key, ri.key_len, nullptr);
       streamFreeNACK(nack);
@@ -1616,9 +1632,9 @@ OpResult<ClaimInfo> OpAutoClaim(const OpArgs& op_args, string_view key, const Cl
         continue;
     }
 
-    op_args.shard->tmp_str1 =
-        sdscpylen(op_args.shard->tmp_str1, opts.consumer.data(), opts.consumer.size());
     if (consumer == nullptr) {
+      op_args.shard->tmp_str1 =
+          sdscpylen(op_args.shard->tmp_str1, opts.consumer.data(), opts.consumer.size());
       consumer = streamLookupConsumer(group, op_args.shard->tmp_str1, SLC_DEFAULT);
       if (consumer == nullptr) {
         consumer = streamCreateConsumer(group, op_args.shard->tmp_str1, nullptr, 0, SCC_DEFAULT);
@@ -2918,8 +2934,9 @@ void XReadBlock(ReadOpts* opts, ConnectionContext* cntx) {
     return streamCompareID(&last_id, &sitem.group->last_id) > 0;
   };
 
+  // Readers without a group do not change the stream, so all of them are woken up together.
   if (auto status = cntx->transaction->WaitOnWatch(tp, std::move(wcb), key_checker, &cntx->blocked,
-                                                   &cntx->paused);
+                                                   &cntx->paused, opts->read_group);
       status != OpStatus::OK)
     return rb->SendNullArray();
 
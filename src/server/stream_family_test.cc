@@ -367,6 +367,36 @@ TEST_F(StreamFamilyTest, XReadGroupBlock) {
   }
 }
 
+TEST_F(StreamFamilyTest, XReadBlockManyReaders) {
+  Run({"xgroup", "create", "foo", "group", "$", "MKSTREAM"});
+
+  // Readers without a group are all woken up by a single entry, even when a group reader
+  // is watching the same stream.
+  constexpr unsigned kNumReaders = 6;
+  vector<RespExpr> resps(kNumReaders);
+  vector<Fiber> fibers;
+  for (unsigned i = 0; i < kNumReaders; ++i) {
+    fibers.push_back(pp_->at(i % pp_->size())->LaunchFiber(Launch::dispatch, [&, i] {
+      string id = absl::StrCat("reader", i);
+      if (i == kNumReaders / 2) {
+        resps[i] = Run(id, {"xreadgroup", "group", "group", "alice", "block", "0", "streams",
+                            "foo", ">"});
+      } else {
+        resps[i] = Run(id, {"xread", "block", "0", "streams", "foo", "$"});
+      }
+    }));
+  }
+  ThisFiber::SleepFor(50us);
+
+  pp_->at(1)->Await([&] { return Run("xadd", {"xadd", "foo", "1-1", "k1", "v1"}); });
+  for (auto& fb : fibers)
+    fb.Join();
+
+  for (const auto& resp : resps) {
+    EXPECT_THAT(resp.GetVec(), ElementsAre("foo", ArrLen(1)));
+  }
+}
+
 TEST_F(StreamFamilyTest, XReadInvalidArgs) {
   // Invalid COUNT value.
   auto resp = Run({"xread", "count", "invalid", "streams", "s1", "s2", "0", "0"});
@@ -600,6 +630,21 @@ TEST_F(StreamFamilyTest, XTrim) {
   EXPECT_THAT(resp, IntArg(0));
 }
 
+TEST_F(StreamFamilyTest, XAddApproxMaxLen) {
+  // Approximate trimming removes whole nodes of 100 entries, so the length stays within
+  // a node of the limit.
+  for (unsigned i = 0; i < 1000; ++i) {
+    Run({"xadd", "foo", "maxlen", "~", "250", "*", "k", "v"});
+    ASSERT_LE(CheckedInt({"xlen", "foo"}), 350) << i;
+  }
+  EXPECT_GE(CheckedInt({"xlen", "foo"}), 250);
+
+  for (unsigned i = 0; i < 100; ++i) {
+    Run({"xadd", "foo", "maxlen", "250", "*", "k", "v"});
+  }
+  EXPECT_EQ(250, CheckedInt({"xlen", "foo"}));
+}
+
 TEST_F(StreamFamilyTest, XTrimInvalidArgs) {
   // Missing threshold.
   auto resp = Run({"xtrim", "foo"});
@@ -916,6 +961,50 @@ TEST_F(StreamFamilyTest, XAutoClaim) {
                                   RespArray(ElementsAre("1-2", "1-4")))));
 }
 
+TEST_F(StreamFamilyTest, XAutoClaimTrimmed) {
+  for (unsigned i = 0; i < 10; ++i) {
+    Run({"xadd", "foo", absl::StrCat("1-", i), "k", "v"});
+  }
+  int64_t usage = CheckedInt({"memory", "usage", "foo"});
+  EXPECT_GT(usage, 0);
+  Run({"xgroup", "create", "foo", "group", "0"});
+  Run({"xreadgroup", "group", "group", "alice", "streams", "foo", ">"});
+
+  // The consumer group and its PEL are counted in the stream memory.
+  EXPECT_GT(CheckedInt({"memory", "usage", "foo"}), usage);
+
+  // The pending entries of trimmed stream entries are dropped and listed separately.
+  Run({"xtrim", "foo", "maxlen", "3"});
+  auto resp = Run({"xautoclaim", "foo", "group", "bob", "0", "0-0", "justid"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(
+                        "0-0", RespArray(ElementsAre("1-7", "1-8", "1-9")),
+                        RespArray(ElementsAre("1-0", "1-1", "1-2", "1-3", "1-4", "1-5", "1-6")))));
+
+  resp = Run({"xpending", "foo", "group"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(3), "1-7", "1-9", _)));
+}
+
+TEST_F(StreamFamilyTest, MemoryUsageSamples) {
+  for (unsigned i = 0; i < 2000; ++i)
+    Run({"xadd", "foo", "*", "key", absl::StrCat("value", i)});
+  for (unsigned i = 0; i < 10; ++i) {
+    string group = absl::StrCat("group", i);
+    Run({"xgroup", "create", "foo", group, "0"});
+    Run({"xreadgroup", "group", group, "alice", "count", "100", "streams", "foo", ">"});
+  }
+
+  // The sampled estimate stays close to the size of the whole stream.
+  int64_t exact = CheckedInt({"memory", "usage", "foo", "samples", "0"});
+  int64_t sampled = CheckedInt({"memory", "usage", "foo"});
+  EXPECT_GT(sampled, exact / 2);
+  EXPECT_LT(sampled, exact * 2);
+  EXPECT_EQ(CheckedInt({"memory", "usage", "foo", "SAMPLES", "1000000"}), exact);
+
+  EXPECT_THAT(Run({"memory", "usage", "foo", "samples"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"memory", "usage", "foo", "count", "1"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"memory", "usage", "foo", "samples", "1", "2"}), ErrArg("syntax error"));
+}
+
 TEST_F(StreamFamilyTest, XInfoStream) {
   Run({"del", "mystream"});
   Run({"xgroup", "create", "mystream", "mygroup", "$", "MKSTREAM"});
@@ -4,6 +4,7 @@
 
 #include "server/string_family.h"
 
+#include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
 #include <absl/strings/match.h>
 
@@ -23,17 +24,27 @@
 #include "facade/reply_builder.h"
 #include "redis/redis_aux.h"
 #include "server/acl/acl_commands_def.h"
+#include "server/cluster/cluster_defs.h"
 #include "server/command_registry.h"
 #include "server/common.h"
 #include "server/conn_context.h"
 #include "server/engine_shard_set.h"
 #include "server/error.h"
+#include "server/hot_values.h"
 #include "server/journal/journal.h"
 #include "server/table.h"
 #include "server/tiered_storage.h"
 #include "server/transaction.h"
 #include "util/fibers/future.h"
 
+ABSL_FLAG(uint32_t, get_zero_copy_threshold, 0,
+          "If positive, GET sends string values of at least this size directly from the value "
+          "memory, keeping the key locked until the reply is written. 0 disables.");
+
+ABSL_FLAG(bool, incr_write_combining, false,
+          "If true, INCR, INCRBY, DECR and DECRBY of the same key that reach its shard together "
+          "are applied as a single update instead of as separate transactions.");
+
 namespace dfly {
 
 namespace {
@@ -45,6 +56,9 @@ using CI = CommandId;
 
 constexpr uint32_t kMaxStrLen = 1 << 28;
 
+// Strings of at least this length are modified in place by APPEND and SETRANGE.
+constexpr size_t kInPlaceStrLen = 4096;
+
 void CopyValueToBuffer(const PrimeValue& pv, char* dest) {
   DCHECK_EQ(pv.ObjType(), OBJ_STRING);
   DCHECK(!pv.IsExternal());
@@ -96,6 +110,9 @@ OpResult<uint32_t> OpSetRange(const OpArgs& op_args, string_view key, size_t sta
     if (res.it->second.ObjType() != OBJ_STRING)
       return OpStatus::WRONG_TYPE;
 
+    if (range_len >= kInPlaceStrLen && res.it->second.SetStringRange(start, value))
+      return res.it->second.Size();
+
     s = GetString(res.it->second);
     if (s.size() < range_len)
       s.resize(range_len);
@@ -139,6 +156,12 @@ OpResult<string> OpGetRange(const OpArgs& op_args, string_view key, int32_t star
 };
 
 size_t ExtendExisting(DbSlice::Iterator it, string_view key, string_view val, bool prepend) {
+  size_t cur_len = it->second.Size();
+  if (!prepend && cur_len + val.size() >= kInPlaceStrLen &&
+      it->second.SetStringRange(cur_len, val)) {
+    return it->second.Size();
+  }
+
   string tmp, new_val;
   string_view slice = it->second.GetSlice(&tmp);
 
@@ -181,15 +204,18 @@ OpResult<double> OpIncrFloat(const OpArgs& op_args, string_view key, double val)
   if (add_res.it->second.ObjType() != OBJ_STRING)
     return OpStatus::WRONG_TYPE;
 
-  if (add_res.it->second.Size() == 0)
-    return OpStatus::INVALID_FLOAT;
-
-  string tmp;
-  string_view slice = add_res.it->second.GetSlice(&tmp);
-
   double base = 0;
-  if (!ParseDouble(slice, &base)) {
-    return OpStatus::INVALID_FLOAT;
+  if (auto opt_int = add_res.it->second.TryGetInt(); opt_int) {
+    base = *opt_int;  // integer values do not need to be printed and parsed.
+  } else {
+    if (add_res.it->second.Size() == 0)
+      return OpStatus::INVALID_FLOAT;
+
+    string tmp;
+    string_view slice = add_res.it->second.GetSlice(&tmp);
+    if (!ParseDouble(slice, &base)) {
+      return OpStatus::INVALID_FLOAT;
+    }
   }
 
   base += val;
@@ -205,32 +231,12 @@ OpResult<double> OpIncrFloat(const OpArgs& op_args, string_view key, double val)
   return base;
 }
 
-// if skip_on_missing - returns KEY_NOTFOUND.
-OpResult<int64_t> OpIncrBy(const OpArgs& op_args, string_view key, int64_t incr,
-                           bool skip_on_missing) {
-  auto& db_slice = op_args.shard->db_slice();
-
-  // we avoid using AddOrFind because of skip_on_missing option for memcache.
-  auto res = db_slice.FindMutable(op_args.db_cntx, key);
-
-  if (!IsValid(res.it)) {
-    if (skip_on_missing)
-      return OpStatus::KEY_NOTFOUND;
-
-    CompactObj cobj;
-    cobj.SetInt(incr);
-
-    auto op_result = db_slice.AddNew(op_args.db_cntx, key, std::move(cobj), 0);
-    RETURN_ON_BAD_STATUS(op_result);
-
-    return incr;
-  }
-
-  if (res.it->second.ObjType() != OBJ_STRING) {
+OpResult<int64_t> IncrExisting(PrimeValue* pv, int64_t incr) {
+  if (pv->ObjType() != OBJ_STRING) {
     return OpStatus::WRONG_TYPE;
   }
 
-  auto opt_prev = res.it->second.TryGetInt();
+  auto opt_prev = pv->TryGetInt();
   if (!opt_prev) {
     return OpStatus::INVALID_VALUE;
   }
@@ -242,12 +248,135 @@ OpResult<int64_t> OpIncrBy(const OpArgs& op_args, string_view key, int64_t incr,
   }
 
   int64_t new_val = prev + incr;
-  DCHECK(!res.it->second.IsExternal());
-  res.it->second.SetInt(new_val);
+  DCHECK(!pv->IsExternal());
+  pv->SetInt(new_val);  // updates INT_TAG values in place.
 
   return new_val;
 }
 
+// if skip_on_missing - returns KEY_NOTFOUND.
+OpResult<int64_t> OpIncrBy(const OpArgs& op_args, string_view key, int64_t incr,
+                           bool skip_on_missing) {
+  auto& db_slice = op_args.shard->db_slice();
+
+  // memcache does not create missing keys, so it does not need AddOrFind.
+  if (skip_on_missing) {
+    auto res = db_slice.FindMutable(op_args.db_cntx, key);
+    if (!IsValid(res.it))
+      return OpStatus::KEY_NOTFOUND;
+    return IncrExisting(&res.it->second, incr);
+  }
+
+  auto op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  RETURN_ON_BAD_STATUS(op_res);
+  if (op_res->is_new) {
+    op_res->it->second.SetInt(incr);
+    return incr;
+  }
+
+  return IncrExisting(&op_res->it->second, incr);
+}
+
+// Coalesces the increments of the same key that reach the shard thread together, so that hot
+// counters do not pay for a transaction per command. Pending increments are applied by a fiber
+// that runs once the shard queue is drained, in the order they arrived, so every caller gets its
+// own post-increment value. Keys that are locked by transactions are left to the callers, that
+// fall back to the transactional path.
+class IncrCombiner {
+ public:
+  // nullopt tells the caller to run a transaction instead.
+  using Result = std::optional<OpResult<int64_t>>;
+
+  // Must be called from the shard thread of the key.
+  void Push(DbIndex dbid, string_view key, int64_t incr, util::fb2::Future<Result> result);
+
+ private:
+  struct Waiter {
+    int64_t incr;
+    util::fb2::Future<Result> result;
+  };
+
+  void Flush();
+  void Apply(DbIndex dbid, string_view key, vector<Waiter>* waiters);
+
+  absl::flat_hash_map<pair<DbIndex, string>, vector<Waiter>> pending_;
+};
+
+thread_local IncrCombiner tl_incr_combiner;
+
+void IncrCombiner::Push(DbIndex dbid, string_view key, int64_t incr,
+                        util::fb2::Future<Result> result) {
+  if (pending_.empty())
+    util::fb2::Fiber("incr_combiner", [this] { Flush(); }).Detach();
+
+  pending_[make_pair(dbid, string{key})].push_back(Waiter{incr, std::move(result)});
+}
+
+void IncrCombiner::Flush() {
+  auto pending = std::move(pending_);
+  pending_.clear();
+
+  for (auto& [db_key, waiters] : pending)
+    Apply(db_key.first, db_key.second, &waiters);
+}
+
+void IncrCombiner::Apply(DbIndex dbid, string_view key, vector<Waiter>* waiters) {
+  EngineShard* shard = EngineShard::tlocal();
+  DbSlice& db_slice = shard->db_slice();
+
+  LockFp fp = LockTag(key).Fingerprint();
+  KeyLockArgs lock_args{.db_index = dbid, .fps = {&fp, 1}};
+  if (!shard->shard_lock()->Check(IntentLock::EXCLUSIVE) ||
+      !db_slice.CheckLock(IntentLock::EXCLUSIVE, dbid, fp)) {
+    for (auto& waiter : *waiters)
+      waiter.result.Resolve(nullopt);
+    return;
+  }
+
+  // Hold the lock, serialization of the update by snapshots may preempt.
+  db_slice.Acquire(IntentLock::EXCLUSIVE, lock_args);
+
+  auto journal_incr = [&](int64_t delta) {
+    if (delta == 0 || !shard->journal())
+      return;
+    string delta_str = absl::StrCat(delta);
+    shard->journal()->RecordEntry(0, journal::Op::COMMAND, dbid, 1, cluster::KeySlot(key),
+                                  journal::Entry::Payload("INCRBY", ArgSlice{key, delta_str}),
+                                  false);
+  };
+
+  DbContext db_cntx{.db_index = dbid, .time_now_ms = GetCurrentTimeMs()};
+  auto op_res = db_slice.AddOrFind(db_cntx, key);
+  if (!op_res) {
+    for (auto& waiter : *waiters)
+      waiter.result.Resolve(OpResult<int64_t>{op_res.status()});
+  } else {
+    PrimeValue& pv = op_res->it->second;
+    if (op_res->is_new)
+      pv.SetInt(0);
+
+    // Replicated as a single INCRBY, unless the sum of the increments overflows.
+    int64_t delta = 0;
+    for (auto& waiter : *waiters) {
+      OpResult<int64_t> res = IncrExisting(&pv, waiter.incr);
+      if (res) {
+        int64_t next;
+        if (__builtin_add_overflow(delta, waiter.incr, &next)) {
+          journal_incr(delta);
+          next = waiter.incr;
+        }
+        delta = next;
+      }
+      waiter.result.Resolve(res);
+    }
+
+    op_res->post_updater.Run();
+    journal_incr(delta);
+  }
+
+  db_slice.Release(IntentLock::EXCLUSIVE, lock_args);
+}
+
 int64_t AbsExpiryToTtl(int64_t abs_expiry_time, bool as_milli) {
   using std::chrono::duration_cast;
   using std::chrono::milliseconds;
@@ -271,6 +400,7 @@ OpStatus OpMSet(const OpArgs& op_args, const ShardArgs& args) {
 
   OpStatus result = OpStatus::OK;
   size_t stored = 0;
+  op_args.shard->db_slice().PrefetchKeys(op_args.db_cntx.db_index, args, 2);
   for (auto it = args.begin(); it != args.end();) {
     string_view key = *(it++);
     string_view value = *(it++);
@@ -388,7 +518,7 @@ OpResult<array<int64_t, 5>> OpThrottle(const OpArgs& op_args, const string_view
   if (!limited) {
     if (IsValid(res.it)) {
       if (IsValid(res.exp_it)) {
-        res.exp_it->second = db_slice.FromAbsoluteTime(new_tat_ms);
+        db_slice.SetExpireTime(op_args.db_cntx.db_index, res.exp_it, new_tat_ms);
       } else {
         db_slice.AddExpire(op_args.db_cntx.db_index, res.it, new_tat_ms);
       }
@@ -409,7 +539,8 @@ OpResult<array<int64_t, 5>> OpThrottle(const OpArgs& op_args, const string_view
 }
 
 SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, bool fetch_mcflag,
-                                      bool fetch_mcver, const Transaction* t, EngineShard* shard) {
+                                      bool fetch_mcver, bool fetch_mcttl, const Transaction* t,
+                                      EngineShard* shard) {
   ShardArgs keys = t->GetShardArgs(shard->shard_id());
   DCHECK(!keys.Empty());
 
@@ -421,6 +552,7 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, bool f
   // First, fetch all iterators and count total size ahead
   size_t total_size = 0;
   unsigned index = 0;
+  db_slice.PrefetchKeys(t->GetDbIndex(), keys);
   for (string_view key : keys) {
     auto it_res = db_slice.FindReadOnly(t->GetDbContext(), key, OBJ_STRING);
     if (auto& dest = iters[index++]; it_res) {
@@ -433,6 +565,11 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, bool f
   response.storage_list = SinkReplyBuilder::AllocMGetStorage(total_size);
   char* next = response.storage_list->data;
 
+  // Merge reads of offloaded values that reside on adjacent pages
+  TieredStorage* tiered_storage = shard->tiered_storage();
+  if (tiered_storage)
+    tiered_storage->DeferReads();
+
   for (size_t i = 0; i < iters.size(); ++i) {
     auto it = iters[i];
     if (it.is_done())
@@ -448,7 +585,7 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, bool f
         memcpy(next, v.data(), v.size());
         wait_bc->Dec();
       };
-      shard->tiered_storage()->Read(t->GetDbIndex(), it.key(), it->second, std::move(cb));
+      tiered_storage->Read(t->GetDbIndex(), it.key(), it->second, std::move(cb));
     } else {
       CopyValueToBuffer(it->second, next);
     }
@@ -465,9 +602,19 @@ SinkReplyBuilder::MGetResponse OpMGet(util::fb2::BlockingCounter wait_bc, bool f
       if (fetch_mcver) {
         resp.mc_ver = it.GetVersion();
       }
+
+      if (fetch_mcttl && it->second.HasExpire()) {
+        auto& expire_table = db_slice.GetDBTable(t->GetDbIndex())->expire;
+        int64_t ttl_ms = db_slice.ExpireTime(expire_table.Find(it->first)) -
+                         t->GetDbContext().time_now_ms;
+        resp.mc_ttl = (max<int64_t>(ttl_ms, 0) + 999) / 1000;
+      }
     }
   }
 
+  if (tiered_storage)
+    tiered_storage->FlushReads();
+
   return response;
 }
 
@@ -501,6 +648,15 @@ OpResult<variant<size_t, util::fb2::Future<size_t>>> OpExtend(const OpArgs& op_a
   }
 }
 
+// Returns true if the value can be referenced directly by a reply while its key is locked.
+// Values that can be freed or moved by anything besides a conflicting transaction are excluded:
+// inline values move together with the table entry, expiring keys can be deleted lazily by
+// other readers, tiering may offload the value and slot flushes ignore key locks.
+bool CanPinValue(const PrimeValue& pv, size_t threshold, EngineShard* es) {
+  return !pv.IsInline() && !pv.IsExternal() && !pv.HasExpire() && pv.Size() >= threshold &&
+         es->tiered_storage() == nullptr && !cluster::IsClusterEnabled();
+}
+
 // Helper for building replies for strings
 struct GetReplies {
   GetReplies(SinkReplyBuilder* rb) : rb{static_cast<RedisReplyBuilder*>(rb)} {
@@ -556,32 +712,28 @@ OpStatus SetCmd::Set(const SetParams& params, string_view key, string_view value
   DCHECK(db_slice.IsDbValid(op_args_.db_cntx.db_index));
   VLOG(2) << "Set " << key << "(" << db_slice.shard_id() << ") ";
 
-  if (params.IsConditionalSet()) {
+  if (params.flags & SET_IF_EXISTS) {
     auto find_res = db_slice.FindMutable(op_args_.db_cntx, key);
     if (auto status = CachePrevIfNeeded(params, find_res.it); status != OpStatus::OK)
       return status;
 
-    if (params.flags & SET_IF_EXISTS) {
-      if (IsValid(find_res.it)) {
-        return SetExisting(params, find_res.it, find_res.exp_it, key, value);
-      } else {
-        return OpStatus::SKIPPED;
-      }
-    } else {
-      DCHECK(params.flags & SET_IF_NOTEXIST) << params.flags;
-      if (IsValid(find_res.it)) {
-        return OpStatus::SKIPPED;
-      }  // else AddNew() is called below
-    }
+    if (!IsValid(find_res.it))
+      return OpStatus::SKIPPED;
+    return SetExisting(params, find_res.it, find_res.exp_it, key, value);
   }
 
-  auto op_res = db_slice.AddOrFind(op_args_.db_cntx, key);
+  // NX and unconditional sets need a single lookup, that adds the key if it is missing.
+  // NX leaves existing keys untouched, so it skips their update callbacks.
+  auto op_res = (params.flags & SET_IF_NOTEXIST) ? db_slice.AddOrSkip(op_args_.db_cntx, key)
+                                                 : db_slice.AddOrFind(op_args_.db_cntx, key);
   RETURN_ON_BAD_STATUS(op_res);
 
   if (!op_res->is_new) {
     if (auto status = CachePrevIfNeeded(params, op_res->it); status != OpStatus::OK)
       return status;
 
+    if (params.flags & SET_IF_NOTEXIST)
+      return OpStatus::SKIPPED;
     return SetExisting(params, op_res->it, op_res->exp_it, key, value);
   } else {
     AddNew(params, op_res->it, op_res->exp_it, key, value);
@@ -858,15 +1010,56 @@ void StringFamily::SetNx(CmdArgList args, ConnectionContext* cntx) {
 }
 
 void StringFamily::Get(CmdArgList args, ConnectionContext* cntx) {
-  auto cb = [key = ArgS(args, 0)](Transaction* tx, EngineShard* es) -> OpResult<StringValue> {
-    auto it_res = es->db_slice().FindReadOnly(tx->GetDbContext(), key, OBJ_STRING);
-    if (!it_res.ok())
-      return it_res.status();
+  string_view key = ArgS(args, 0);
+  Transaction* tx = cntx->transaction;
+
+  // Zero copy replies rely on keeping the transaction open, which is not possible for multi
+  // transactions.
+  uint32_t zc_threshold = tx->IsMulti() ? 0 : absl::GetFlag(FLAGS_get_zero_copy_threshold);
+
+  // Hot keys are read from the copies of this thread. Connections that track keys register
+  // them in the shard, so they always go through it.
+  if (string hot; !tx->IsMulti() && !cntx->conn_state.tracking_info_.IsTrackingOn() &&
+                  HotValues::Find(tx->GetUniqueShard(), cntx->db_index(), key, &hot)) {
+    return static_cast<RedisReplyBuilder*>(cntx->reply_builder())->SendBulkString(hot);
+  }
+
+  OpResult<StringValue> result;
+  string_view pinned;
 
-    return StringValue::Read(tx->GetDbIndex(), key, (*it_res)->second, es);
+  auto cb = [&](Transaction* t, EngineShard* es) -> Transaction::RunnableResult {
+    auto it_res = es->db_slice().FindReadOnly(t->GetDbContext(), key, OBJ_STRING);
+    if (!it_res.ok()) {
+      result = it_res.status();
+      return result.status();
+    }
+
+    const PrimeValue& pv = (*it_res)->second;
+    if (zc_threshold > 0 && CanPinValue(pv, zc_threshold, es)) {
+      string scratch;
+      string_view slice = pv.GetSlice(&scratch);
+      // The slice points to the value memory, unless it had to be decoded.
+      if (scratch.empty()) {
+        pinned = slice;
+        return {OpStatus::OK, Transaction::RunnableResult::AVOID_CONCLUDING};
+      }
+      result = StringValue(std::move(scratch));
+      return OpStatus::OK;
+    }
+
+    result = StringValue::Read(t->GetDbIndex(), key, pv, es);
+    return OpStatus::OK;
   };
 
-  GetReplies{cntx->reply_builder()}.Send(cntx->transaction->ScheduleSingleHopT(cb));
+  tx->ScheduleSingleHop(cb);
+  if (!pinned.empty()) {
+    // The key stays locked by the unconcluded transaction while we write the reply.
+    static_cast<RedisReplyBuilder*>(cntx->reply_builder())->SendBulkString(pinned);
+    tx->Conclude();
+    return;
+  }
+
+  GetReplies{cntx->reply_builder()}.Send(std::move(result));
 }
 
 void StringFamily::GetDel(CmdArgList args, ConnectionContext* cntx) {
@@ -1078,12 +1271,24 @@ void StringFamily::DecrBy(CmdArgList args, ConnectionContext* cntx) {
 void StringFamily::IncrByGeneric(string_view key, int64_t val, ConnectionContext* cntx) {
   bool skip_on_missing = cntx->protocol() == Protocol::MEMCACHE;
 
+  IncrCombiner::Result combined;
+  if (!skip_on_missing && !cntx->transaction->IsMulti() &&
+      absl::GetFlag(FLAGS_incr_write_combining)) {
+    util::fb2::Future<IncrCombiner::Result> future;
+    shard_set->Add(Shard(key, shard_set->size()), [future, dbid = cntx->db_index(),
+                                                   key = string{key}, val]() mutable {
+      tl_incr_combiner.Push(dbid, key, val, std::move(future));
+    });
+    combined = future.Get();
+  }
+
   auto cb = [&](Transaction* t, EngineShard* shard) {
     OpResult<int64_t> res = OpIncrBy(t->GetOpArgs(shard), key, val, skip_on_missing);
     return res;
   };
 
-  OpResult<int64_t> result = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  OpResult<int64_t> result =
+      combined ? *combined : cntx->transaction->ScheduleSingleHopT(std::move(cb));
   auto* builder = cntx->reply_builder();
 
   DVLOG(2) << "IncrByGeneric " << key << "/" << result.value();
@@ -1148,11 +1353,14 @@ void StringFamily::MGet(CmdArgList args, ConnectionContext* cntx) {
   bool fetch_mcflag = cntx->protocol() == Protocol::MEMCACHE;
   bool fetch_mcver =
       fetch_mcflag && (dfly_cntx->conn_state.memcache_flag & ConnectionState::FETCH_CAS_VER);
+  bool fetch_mcttl =
+      fetch_mcflag && (dfly_cntx->conn_state.memcache_flag & ConnectionState::FETCH_TTL);
 
   // Count of pending tiered reads
   util::fb2::BlockingCounter tiering_bc{0};
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    mget_resp[shard->shard_id()] = OpMGet(tiering_bc, fetch_mcflag, fetch_mcver, t, shard);
+    mget_resp[shard->shard_id()] =
+        OpMGet(tiering_bc, fetch_mcflag, fetch_mcver, fetch_mcttl, t, shard);
     return OpStatus::OK;
   };
 
@@ -4,6 +4,8 @@
 
 #include "server/string_family.h"
 
+#include <absl/flags/reflection.h>
+
 #include "base/gtest.h"
 #include "base/logging.h"
 #include "facade/facade_test.h"
@@ -55,6 +57,30 @@ TEST_F(StringFamilyTest, SetGet) {
   EXPECT_EQ(3, metrics.events.mutations);
 }
 
+TEST_F(StringFamilyTest, GetZeroCopy) {
+  absl::FlagSaver fs;
+  SetTestFlag("get_zero_copy_threshold", "1000");
+
+  // Non-ascii values are stored as is and can be sent from the value memory.
+  const string big_val(5000, '\xff');
+  Run({"set", "big", big_val});
+  Run({"set", "small", "\xff\xfe"});
+  Run({"set", "ascii", string(5000, 'a')});
+
+  EXPECT_EQ(Run({"get", "big"}), big_val);
+  EXPECT_FALSE(IsLocked(0, "big"));
+  EXPECT_EQ(Run({"get", "small"}), "\xff\xfe");
+  EXPECT_EQ(Run({"get", "ascii"}), string(5000, 'a'));
+  EXPECT_THAT(Run({"get", "missing"}), ArgType(RespExpr::NIL));
+
+  Run({"lpush", "list", "a"});
+  EXPECT_THAT(Run({"get", "list"}), ErrArg("WRONGTYPE"));
+
+  Run({"multi"});
+  Run({"get", "big"});
+  EXPECT_THAT(Run({"exec"}), big_val);
+}
+
 TEST_F(StringFamilyTest, Incr) {
   ASSERT_EQ(Run({"set", "key", "0"}), "OK");
   ASSERT_THAT(Run({"incr", "key"}), IntArg(1));
@@ -76,6 +102,74 @@ TEST_F(StringFamilyTest, Incr) {
   EXPECT_EQ(0, metrics.events.hits);
 }
 
+TEST_F(StringFamilyTest, IncrWriteCombining) {
+  absl::FlagSaver fs;
+  SetTestFlag("incr_write_combining", "true");
+
+  Run({"set", "counter", "10"});
+  constexpr unsigned kNumFibers = 4, kNumIncrs = 200;
+  vector<vector<int64_t>> results(kNumFibers);
+  vector<fb2::Fiber> fibers;
+  for (unsigned i = 0; i < kNumFibers; ++i) {
+    fibers.push_back(pp_->at(i % pp_->size())->LaunchFiber([&, i] {
+      string id = StrCat("conn", i);
+      for (unsigned j = 0; j < kNumIncrs; ++j)
+        results[i].push_back(*Run(id, {"incrby", "counter", "2"}).GetInt());
+    }));
+  }
+  for (auto& fb : fibers)
+    fb.Join();
+
+  // Every caller gets its own post-increment value.
+  vector<int64_t> all;
+  for (const auto& res : results) {
+    EXPECT_TRUE(is_sorted(res.begin(), res.end()));
+    all.insert(all.end(), res.begin(), res.end());
+  }
+  sort(all.begin(), all.end());
+  EXPECT_EQ(unique(all.begin(), all.end()), all.end());
+  EXPECT_EQ(Run({"get", "counter"}), StrCat(10 + 2 * kNumFibers * kNumIncrs));
+
+  EXPECT_THAT(Run({"incr", "new"}), IntArg(1));
+  Run({"set", "big", StrCat(INT64_MAX - 1)});
+  EXPECT_THAT(Run({"incr", "big"}), IntArg(INT64_MAX));
+  EXPECT_THAT(Run({"incr", "big"}), ErrArg("overflow"));
+  Run({"lpush", "list", "a"});
+  EXPECT_THAT(Run({"incr", "list"}), ErrArg("WRONGTYPE"));
+}
+
+TEST_F(StringFamilyTest, HotValues) {
+  absl::FlagSaver fs;
+  SetTestFlag("enable_top_keys_tracking", "true");
+  SetTestFlag("hot_values_cache_size", "4");
+  ResetService();
+
+  Run({"set", "hot", "v1"});
+  for (unsigned i = 0; i < 200; ++i)
+    Run({"get", "hot"});
+
+  uint64_t refresh_ms = GetCurrentTimeMs() + 3600'000;
+  shard_set->RunBriefInParallel(
+      [&](EngineShard* es) { es->db_slice().RefreshHotValues(refresh_ms); });
+  fb2::ThisFiber::SleepFor(10ms);  // the copies are published asynchronously.
+
+  // The copy serves the read, without touching the shard. The shard counts the read later.
+  size_t hits = GetMetrics().events.hits;
+  EXPECT_EQ(Run({"get", "hot"}), "v1");
+  EXPECT_EQ(GetMetrics().events.hits, hits);
+  shard_set->RunBriefInParallel(
+      [&](EngineShard* es) { es->db_slice().RefreshHotValues(refresh_ms); });
+  EXPECT_EQ(GetMetrics().events.hits, hits + 1);
+  hits = GetMetrics().events.hits;
+
+  Run({"set", "hot", "v2"});
+  EXPECT_EQ(Run({"get", "hot"}), "v2");
+  EXPECT_GT(GetMetrics().events.hits, hits);
+
+  Run({"del", "hot"});
+  EXPECT_THAT(Run({"get", "hot"}), ArgType(RespExpr::NIL));
+}
+
 TEST_F(StringFamilyTest, Append) {
   Run({"setex", "key", "100", "val"});
   EXPECT_THAT(Run({"ttl", "key"}), IntArg(100));
@@ -84,6 +178,28 @@ TEST_F(StringFamilyTest, Append) {
   EXPECT_THAT(Run({"ttl", "key"}), IntArg(100));
 }
 
+TEST_F(StringFamilyTest, AppendLarge) {
+  string expected(5000, 'a');
+  Run({"set", "key", expected});
+  for (unsigned i = 0; i < 100; ++i) {
+    string chunk = StrCat("chunk", i);
+    expected += chunk;
+    EXPECT_THAT(Run({"append", "key", chunk}), IntArg(expected.size()));
+  }
+  EXPECT_EQ(Run({"get", "key"}), expected);
+  EXPECT_EQ(Run({"getrange", "key", "4998", "5006"}), expected.substr(4998, 9));
+
+  Run({"setrange", "key", "4999", "xyz"});
+  expected.replace(4999, 3, "xyz");
+  EXPECT_EQ(Run({"get", "key"}), expected);
+
+  size_t len = expected.size();
+  EXPECT_THAT(Run({"setrange", "key", StrCat(len + 2), "end"}), IntArg(len + 5));
+  expected += string_view("\0\0end", 5);
+  EXPECT_EQ(Run({"get", "key"}), expected);
+  EXPECT_THAT(Run({"strlen", "key"}), IntArg(len + 5));
+}
+
 TEST_F(StringFamilyTest, Expire) {
   ASSERT_EQ(Run({"set", "key", "val", "PX", "20"}), "OK");
 
@@ -219,6 +335,36 @@ TEST_F(StringFamilyTest, MSetLong) {
   EXPECT_EQ(resp, "OK");
 }
 
+TEST_F(StringFamilyTest, MGetMSetMany) {
+  // Large batches go through the prefetching lookup path.
+  vector<string> mset({"mset"}), mget({"mget"}), del({"del"});
+  for (unsigned i = 0; i < 300; ++i) {
+    mset.push_back(StrCat("key", i));
+    mset.push_back(StrCat("val", i));
+    mget.push_back(StrCat("key", i * 2));
+    del.push_back(StrCat("key", i));
+  }
+  EXPECT_EQ(Run(absl::MakeSpan(mset)), "OK");
+
+  auto resp = Run(absl::MakeSpan(mget));
+  ASSERT_THAT(resp, ArrLen(300));
+  const auto& arr = resp.GetVec();
+  for (unsigned i = 0; i < 300; ++i) {
+    if (i < 150) {
+      EXPECT_EQ(arr[i].GetString(), StrCat("val", i * 2));
+    } else {
+      EXPECT_THAT(arr[i], ArgType(RespExpr::NIL));
+    }
+  }
+
+  vector<string> exists(del);
+  exists[0] = "exists";
+  EXPECT_THAT(Run(absl::MakeSpan(exists)), IntArg(300));
+  del.push_back("missing");
+  EXPECT_THAT(Run(absl::MakeSpan(del)), IntArg(300));
+  EXPECT_THAT(Run(absl::MakeSpan(exists)), IntArg(0));
+}
+
 TEST_F(StringFamilyTest, MGetSet) {
   Run({"mset", "z", "0"});         // single key
   auto resp = Run({"mget", "z"});  // single key
@@ -505,6 +651,11 @@ TEST_F(StringFamilyTest, IncrByFloat) {
   Run({"SET", "num", "2.566"});
   resp = Run({"INCRBYFLOAT", "num", "1.0"});
   EXPECT_EQ(resp, "3.566");
+
+  Run({"SET", "int", "-7"});
+  EXPECT_EQ(Run({"INCRBYFLOAT", "int", "0.5"}), "-6.5");
+  EXPECT_EQ(Run({"INCRBYFLOAT", "int", "6.5"}), "0");
+  EXPECT_THAT(Run({"INCR", "int"}), IntArg(1));
 }
 
 TEST_F(StringFamilyTest, SetNx) {
@@ -854,6 +1005,30 @@ TEST_F(StringFamilyTest, SetWithHashtagsWithHashtagLock) {
   EXPECT_EQ(1, GetDebugInfo().shards_count);
 }
 
+TEST_F(StringFamilyTest, SetWithHashtagsShardByHashtag) {
+  absl::FlagSaver fs;
+  SetTestFlag("cluster_mode", "");
+  SetTestFlag("lock_on_hashtags", "false");
+  SetTestFlag("shard_by_hashtag", "true");
+  ResetService();
+
+  EXPECT_EQ(Run({"set", "{key}1", "val1"}), "OK");
+  EXPECT_EQ(Run({"set", "{key}2", "val2"}), "OK");
+
+  // The keys are co-located, but still locked separately.
+  auto fb = ExpectUsedKeys({"{key}1", "{key}2"});
+  EXPECT_THAT(Run({"mget", "{key}1", "{key}2"}), RespArray(ElementsAre("val1", "val2")));
+  fb.Join();
+  EXPECT_EQ(1, GetDebugInfo().shards_count);
+
+  EXPECT_EQ(Run({"mset", "{key}3", "a", "{key}4", "b", "{key}5", "c"}), "OK");
+  EXPECT_EQ(1, GetDebugInfo().shards_count);
+
+  auto metrics = GetMetrics();
+  EXPECT_EQ(2, metrics.coordinator_stats.tx_multikey_cnt);
+  EXPECT_EQ(2, metrics.coordinator_stats.tx_multikey_single_shard_cnt);
+}
+
 TEST_F(StringFamilyTest, MultiSetWithHashtagsDontLockHashtags) {
   SetTestFlag("cluster_mode", "");
   SetTestFlag("lock_on_hashtags", "false");
@@ -4,6 +4,8 @@
 
 #include "server/table.h"
 
+#include <xxhash.h>
+
 #include "base/flags.h"
 #include "base/logging.h"
 #include "server/cluster/cluster_defs.h"
@@ -11,6 +13,16 @@
 
 ABSL_FLAG(bool, enable_top_keys_tracking, false,
           "Enables / disables tracking of hot keys debugging feature");
+ABSL_FLAG(bool, cluster_slot_index, false,
+          "In cluster mode, index keys by slot so that flushing and migrating slots only visits "
+          "their keys, at the cost of a copy of every key");
+ABSL_FLAG(bool, expire_index, false,
+          "Index keys by their expiry deadline so that expired keys are deleted as soon as they "
+          "are due instead of being found by sampling, at the cost of a copy of every key "
+          "with expiry");
+ABSL_FLAG(uint32_t, memory_profile_sample_rate, 0,
+          "If positive, samples one in this many keys to estimate the memory used by every key "
+          "prefix, see MEMORY PROFILE. 0 disables the profile");
 
 using namespace std;
 namespace dfly {
@@ -49,12 +61,13 @@ DbTableStats& DbTableStats::operator+=(const DbTableStats& o) {
 }
 
 SlotStats& SlotStats::operator+=(const SlotStats& o) {
-  static_assert(sizeof(SlotStats) == 32);
+  static_assert(sizeof(SlotStats) == 40);
 
   ADD(key_count);
   ADD(total_reads);
   ADD(total_writes);
   ADD(memory_bytes);
+  ADD(ops_per_sec);
   return *this;
 }
 
@@ -80,6 +93,132 @@ void LockTable::Release(uint64_t fp, IntentLock::Mode mode) {
     locks_.erase(it);
 }
 
+void ExpireIndex::Add(string_view key, uint64_t expire_at_ms) {
+  uint64_t bucket = (expire_at_ms + kBucketMs - 1) / kBucketMs;
+  size_ += buckets_[bucket].emplace(key).second;
+}
+
+void ExpireIndex::Remove(string_view key, uint64_t expire_at_ms) {
+  auto it = buckets_.find((expire_at_ms + kBucketMs - 1) / kBucketMs);
+  if (it == buckets_.end() || it->second.erase(key) == 0)
+    return;
+
+  --size_;
+  if (it->second.empty())
+    buckets_.erase(it);
+}
+
+void ExpireIndex::PopDue(uint64_t now_ms, size_t limit, vector<string>* dest) {
+  while (limit > 0 && !buckets_.empty() && buckets_.begin()->first * kBucketMs <= now_ms) {
+    auto& keys = buckets_.begin()->second;
+    while (limit > 0 && !keys.empty()) {
+      dest->push_back(std::move(keys.extract(keys.begin()).value()));
+      --size_;
+      --limit;
+    }
+    if (keys.empty())
+      buckets_.erase(buckets_.begin());
+  }
+}
+
+void ExpireIndex::Clear() {
+  buckets_.clear();
+  size_ = 0;
+}
+
+void FieldExpireIndex::Add(string_view key, uint32_t at_sec) {
+  auto [it, inserted] = states_.try_emplace(key);
+  State& state = it->second;
+  state.pass_min = min(state.pass_min, at_sec);
+  if (inserted) {
+    state.due_sec = at_sec;
+    queue_.emplace(at_sec, key);
+  } else if (at_sec < state.due_sec) {
+    Reschedule(key, at_sec);
+  }
+}
+
+void FieldExpireIndex::Remove(string_view key) {
+  auto it = states_.find(key);
+  if (it == states_.end())
+    return;
+
+  queue_.erase({it->second.due_sec, string(key)});
+  states_.erase(it);
+}
+
+optional<string_view> FieldExpireIndex::NextDue(uint32_t now_sec) const {
+  if (queue_.empty() || queue_.begin()->first > now_sec)
+    return nullopt;
+  return queue_.begin()->second;
+}
+
+auto FieldExpireIndex::Find(string_view key) -> State* {
+  auto it = states_.find(key);
+  return it == states_.end() ? nullptr : &it->second;
+}
+
+void FieldExpireIndex::Reschedule(string_view key, uint32_t due_sec) {
+  State* state = Find(key);
+  DCHECK(state);
+  auto node = queue_.extract({state->due_sec, string(key)});
+  DCHECK(!node.empty());
+  node.value().first = due_sec;
+  queue_.insert(std::move(node));
+  state->due_sec = due_sec;
+}
+
+void FieldExpireIndex::Clear() {
+  states_.clear();
+  queue_.clear();
+}
+
+void MemoryProfile::Account(string_view key, unsigned type, int64_t delta) {
+  if (delta == 0 || XXH3_64bits(key.data(), key.size()) % sample_rate_ != 0)
+    return;
+
+  Key entry_key{string(Prefix(key, kMaxDepth)), type};
+  auto it = entries_.find(entry_key);
+  if (it == entries_.end()) {
+    if (entries_.size() >= kMaxEntries)
+      entry_key.first = kOtherPrefix;
+    it = entries_.emplace(std::move(entry_key), 0).first;
+  }
+
+  // Entries can drift below zero if the prefix of a key was accounted under kOtherPrefix before.
+  it->second += delta;
+  if (it->second <= 0)
+    entries_.erase(it);
+}
+
+void MemoryProfile::Aggregate(unsigned depth, absl::flat_hash_map<Key, int64_t>* dest) const {
+  for (const auto& [key, bytes] : entries_) {
+    string_view prefix = key.first == kOtherPrefix ? key.first : Prefix(key.first, depth);
+    (*dest)[Key{string(prefix), key.second}] += bytes * sample_rate_;
+  }
+}
+
+vector<pair<MemoryProfile::Key, int64_t>> MemoryProfile::Top(
+    const absl::flat_hash_map<Key, int64_t>& agg, size_t n) {
+  vector<pair<Key, int64_t>> res(agg.begin(), agg.end());
+  auto by_bytes = [](const auto& l, const auto& r) { return l.second > r.second; };
+  n = min(n, res.size());
+  partial_sort(res.begin(), res.begin() + n, res.end(), by_bytes);
+  res.resize(n);
+  return res;
+}
+
+string_view MemoryProfile::Prefix(string_view key, unsigned depth) {
+  size_t end = 0;
+  for (unsigned i = 0; i < depth; ++i) {
+    size_t pos = key.find(':', end);
+    if (pos == string_view::npos)
+      break;
+    end = pos + 1;
+  }
+  return key.substr(0, end);
+}
+
 DbTable::DbTable(PMR_NS::memory_resource* mr, DbIndex db_index)
     : prime(kInitSegmentLog, detail::PrimeTablePolicy{}, mr),
       expire(0, detail::ExpireTablePolicy{}, mr),
@@ -88,7 +227,13 @@ DbTable::DbTable(PMR_NS::memory_resource* mr, DbIndex db_index)
       index(db_index) {
   if (cluster::IsClusterEnabled()) {
     slots_stats.resize(cluster::kMaxSlotNum + 1);
+    if (absl::GetFlag(FLAGS_cluster_slot_index))
+      slot_keys.resize(cluster::kMaxSlotNum + 1);
   }
+  if (absl::GetFlag(FLAGS_expire_index))
+    expire_index = make_unique<ExpireIndex>();
+  if (uint32_t rate = absl::GetFlag(FLAGS_memory_profile_sample_rate); rate > 0)
+    memory_profile = make_unique<MemoryProfile>(rate);
   thread_index = ServerState::tlocal()->thread_index();
 }
 
@@ -102,6 +247,37 @@ void DbTable::Clear() {
   expire.Clear();
   mcflag.Clear();
   stats = DbTableStats{};
+  for (auto& keys : slot_keys)
+    keys.clear();
+  if (expire_index)
+    expire_index->Clear();
+  field_expire_index.Clear();
+  if (memory_profile)
+    memory_profile->Clear();
+}
+
+void DbTable::UpdateExpireIndex(string_view key, uint64_t prev_at_ms, uint64_t at_ms) {
+  if (!expire_index || prev_at_ms == at_ms)
+    return;
+
+  if (prev_at_ms)
+    expire_index->Remove(key, prev_at_ms);
+  if (at_ms)
+    expire_index->Add(key, at_ms);
+}
+
+bool DbTable::NextSlotKeys(const cluster::SlotSet& slots, cluster::SlotId* sid,
+                           vector<string>* keys) const {
+  DCHECK(HasSlotIndex());
+  keys->clear();
+  for (; *sid < slot_keys.size(); ++*sid) {
+    if (slots.Contains(*sid) && !slot_keys[*sid].empty()) {
+      keys->assign(slot_keys[*sid].begin(), slot_keys[*sid].end());
+      ++*sid;
+      return true;
+    }
+  }
+  return false;
 }
 
 PrimeIterator DbTable::Launder(PrimeIterator it, string_view key) {
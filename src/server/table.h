@@ -4,13 +4,17 @@
 
 #pragma once
 
+#include <absl/container/btree_map.h>
+#include <absl/container/btree_set.h>
 #include <absl/container/flat_hash_map.h>
+#include <absl/container/flat_hash_set.h>
 
 #include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
 
 #include "core/expire_period.h"
 #include "core/intent_lock.h"
+#include "server/cluster/slot_set.h"
 #include "server/conn_context.h"
 #include "server/detail/table.h"
 #include "server/top_keys.h"
@@ -54,6 +58,7 @@ struct SlotStats {
   uint64_t total_reads = 0;
   uint64_t total_writes = 0;
   uint64_t memory_bytes = 0;
+  uint64_t ops_per_sec = 0;  // reads and writes, averaged over the last few seconds.
   SlotStats& operator+=(const SlotStats& o);
 };
 
@@ -111,6 +116,110 @@ class LockTable {
   absl::flat_hash_map<LockFp, IntentLock, Hasher> locks_;
 };
 
+// Keys with expiry bucketed by their deadline, so that active expiry can delete the keys that are
+// due instead of sampling the expire table.
+class ExpireIndex {
+ public:
+  // Deadlines are rounded up to buckets of this width.
+  static constexpr uint64_t kBucketMs = 100;
+
+  void Add(std::string_view key, uint64_t expire_at_ms);
+
+  // Does nothing if key is not indexed with expire_at_ms.
+  void Remove(std::string_view key, uint64_t expire_at_ms);
+
+  // Moves up to limit keys that expired by now_ms to dest.
+  void PopDue(uint64_t now_ms, size_t limit, std::vector<std::string>* dest);
+
+  void Clear();
+
+  size_t size() const {
+    return size_;
+  }
+
+ private:
+  // Bucket b holds the keys expiring in ((b - 1) * kBucketMs, b * kBucketMs].
+  absl::btree_map<uint64_t, absl::flat_hash_set<std::string>> buckets_;
+  size_t size_ = 0;
+};
+
+// Sets and hashes with expiring members, scheduled by the earliest known expiry of a member, so
+// that the members can be reclaimed actively instead of only when they are encountered.
+class FieldExpireIndex {
+ public:
+  struct State {
+    uint32_t due_sec = 0;            // next visit, in member time seconds.
+    uint32_t cursor = 0;             // bucket to continue the current pass from, 0 between passes.
+    uint32_t pass_min = UINT32_MAX;  // earliest expiry of the members seen by the current pass.
+    uint32_t pass_buckets = 0;       // bucket count of the set when the current pass started.
+  };
+
+  // Schedules key for a visit at at_sec, unless it is scheduled earlier.
+  void Add(std::string_view key, uint32_t at_sec);
+  void Remove(std::string_view key);
+
+  // Returns the key with the earliest visit if it is due by now_sec.
+  std::optional<std::string_view> NextDue(uint32_t now_sec) const;
+
+  State* Find(std::string_view key);
+  void Reschedule(std::string_view key, uint32_t due_sec);
+
+  void Clear();
+
+  size_t size() const {
+    return states_.size();
+  }
+
+ private:
+  absl::flat_hash_map<std::string, State> states_;
+  absl::btree_set<std::pair<uint32_t, std::string>> queue_;  // by due_sec
+};
+
+// Estimates the memory of the keys under every prefix from a sample of the keys. Keys are
+// sampled by their hash, so a sampled key is accounted for during its whole lifetime and the
+// estimate follows deletions as well. Prefixes are the leading segments of a key delimited by ':'
+// without its last segment, up to kMaxDepth segments, i.e. "user:1:name" counts for "user:1:".
+class MemoryProfile {
+ public:
+  static constexpr unsigned kMaxDepth = 4;
+
+  // Bounds the profile of key spaces that are not structured by prefixes, accounting the
+  // remaining prefixes under kOtherPrefix.
+  static constexpr size_t kMaxEntries = 4096;
+  static constexpr std::string_view kOtherPrefix = "<other>";
+
+  using Key = std::pair<std::string, unsigned>;  // prefix and object type
+
+  // Samples one in sample_rate keys.
+  explicit MemoryProfile(uint32_t sample_rate) : sample_rate_(sample_rate) {
+  }
+
+  // Called with every change of the memory of a key, does nothing if the key is not sampled.
+  void Account(std::string_view key, unsigned type, int64_t delta);
+
+  // Adds the estimated bytes by type of the prefixes truncated to depth segments to dest.
+  void Aggregate(unsigned depth, absl::flat_hash_map<Key, int64_t>* dest) const;
+
+  void Clear() {
+    entries_.clear();
+  }
+
+  size_t size() const {
+    return entries_.size();
+  }
+
+  // Returns the n entries of an aggregate with the most bytes, in descending order.
+  static std::vector<std::pair<Key, int64_t>> Top(const absl::flat_hash_map<Key, int64_t>& agg,
+                                                  size_t n);
+
+  // Returns the prefix of key with at most depth segments.
+  static std::string_view Prefix(std::string_view key, unsigned depth);
+
+ private:
+  uint32_t sample_rate_;
+  absl::flat_hash_map<Key, int64_t> entries_;  // sampled bytes
+};
+
 // A single Db table that represents a table that can be chosen with "SELECT" command.
 struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_counter> {
   PrimeTable prime;
@@ -123,12 +232,31 @@ struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_coun
   // Stores a list of dependant connections for each watched key.
   absl::flat_hash_map<std::string, std::vector<ConnectionState::ExecInfo*>> watched_keys;
 
+  // Changes of the keys counted by a hash of the key for WATCH, see DbSlice::WatchKey. Allocated
+  // by the first WATCH on the table. Unlike bucket versions, they are not bumped by snapshots or
+  // by moves of the entries.
+  static constexpr size_t kKeyChangeSlots = 4096;
+  std::unique_ptr<uint32_t[]> key_changes;
+
   // Keyspace notifications: list of expired keys since last batch of messages was published.
   mutable std::vector<std::string> expired_keys_events_;
 
   mutable DbTableStats stats;
   std::vector<SlotStats> slots_stats;
+
+  // Keys of every slot, maintained only with --cluster_slot_index so that operations on a few
+  // slots don't have to scan the whole table.
+  std::vector<absl::flat_hash_set<std::string>> slot_keys;
   ExpireTable::Cursor expire_cursor;
+  size_t presplit_cursor = 0;  // segment id, see DbSlice::PresplitStep.
+
+  // Maintained only with --expire_index, holds a copy of every key with expiry.
+  std::unique_ptr<ExpireIndex> expire_index;
+
+  FieldExpireIndex field_expire_index;
+
+  // Maintained only with --memory_profile_sample_rate.
+  std::unique_ptr<MemoryProfile> memory_profile;
 
   TopKeys top_keys;
   DbIndex index;
@@ -138,6 +266,19 @@ struct DbTable : boost::intrusive_ref_counter<DbTable, boost::thread_unsafe_coun
   ~DbTable();
 
   void Clear();
+
+  bool HasSlotIndex() const {
+    return !slot_keys.empty();
+  }
+
+  // Copies into keys the keys of the first non-empty slot from slots that is not below *sid,
+  // and moves *sid past it. Returns false when no such slot is left. Callers that yield between
+  // the calls hold the keys of a single slot at a time. Requires HasSlotIndex().
+  bool NextSlotKeys(const cluster::SlotSet& slots, cluster::SlotId* sid,
+                    std::vector<std::string>* keys) const;
+
+  // Moves key in the expiry index from prev_at_ms to at_ms, 0 stands for no expiry.
+  void UpdateExpireIndex(std::string_view key, uint64_t prev_at_ms, uint64_t at_ms);
   PrimeIterator Launder(PrimeIterator it, std::string_view key);
 };
 
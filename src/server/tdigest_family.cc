@@ -0,0 +1,489 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/tdigest_family.h"
+
+#include <cmath>
+
+#include "core/tdigest.h"
+#include "facade/cmd_arg_parser.h"
+#include "facade/error.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/engine_shard_set.h"
+#include "server/transaction.h"
+
+namespace dfly {
+
+using namespace facade;
+using namespace std;
+
+namespace {
+
+using Values = vector<double>;
+
+// A copy of a source digest of TDIGEST.MERGE.
+using MergeSource = unique_ptr<TDigest>;
+
+void SendStatus(OpStatus status, ConnectionContext* cntx) {
+  switch (status) {
+    case OpStatus::KEY_EXISTS:
+      return cntx->SendError("T-Digest: key already exists");
+    case OpStatus::KEY_NOTFOUND:
+      return cntx->SendError("T-Digest: key does not exist");
+    default:
+      return cntx->SendError(status);
+  }
+}
+
+void SendDoubles(const Values& values, ConnectionContext* cntx) {
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(values.size());
+  for (double val : values)
+    rb->SendDouble(val);
+}
+
+// Parses the compression of a digest, a positive integer.
+bool ParseCompression(CmdArgParser* parser, double* compression) {
+  uint32_t val = parser->Next<uint32_t>();
+  if (parser->HasError() || val == 0 || val > TDigest::kMaxCompression)
+    return false;
+  *compression = val;
+  return true;
+}
+
+// Values of queries may be infinite.
+optional<Values> ParseValues(CmdArgList args) {
+  Values values(args.size());
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (!ParseDouble(ArgS(args, i), &values[i]))
+      return nullopt;
+  }
+  return values;
+}
+
+OpStatus OpCreate(const OpArgs& op_args, string_view key, double compression) {
+  auto& db_slice = op_args.shard->db_slice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+  if (!op_res->is_new)
+    return OpStatus::KEY_EXISTS;
+
+  op_res->it->second.SetTDigest(
+      CompactObj::AllocateMR<TDigest>(compression, CompactObj::memory_resource()));
+  return OpStatus::OK;
+}
+
+// Adds the values to the digest, or resets it if values is empty.
+OpStatus OpUpdate(const OpArgs& op_args, string_view key, const Values& values) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto op_res = db_slice.FindMutable(op_args.db_cntx, key, OBJ_TDIGEST);
+  if (!op_res)
+    return op_res.status();
+
+  TDigest* td = op_res->it->second.GetTDigest();
+  if (values.empty())
+    td->Reset();
+  for (double val : values)
+    td->Add(val);
+  return OpStatus::OK;
+}
+
+// Copies the source digests hosted by the shard. The first argument is the destination
+// and the sources start after {destkey, numkeys}.
+OpResult<vector<MergeSource>> OpCopySources(Transaction* t, EngineShard* shard) {
+  auto& db_slice = shard->db_slice();
+  vector<MergeSource> result;
+  ShardArgs keys = t->GetShardArgs(shard->shard_id());
+  for (auto it = keys.begin(); it != keys.end(); ++it) {
+    if (it.index() == 0)
+      continue;
+
+    auto op_res = db_slice.FindReadOnly(t->GetDbContext(), *it, OBJ_TDIGEST);
+    if (!op_res)
+      return op_res.status();
+
+    const TDigest* td = (*op_res)->second.GetTDigest();
+    result.push_back(make_unique<TDigest>(td->compression(), td->GetState(),
+                                          PMR_NS::get_default_resource()));
+  }
+  return result;
+}
+
+// Replaces the destination with the merge of the sources, and of its own values unless
+// override is set. The compression defaults to the one of the destination, if it is kept, or to
+// the largest one of the sources.
+OpStatus OpStoreMerge(const OpArgs& op_args, string_view key, const vector<MergeSource>& sources,
+                      optional<double> compression, bool override) {
+  auto& db_slice = op_args.shard->db_slice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+
+  PrimeValue& pv = op_res->it->second;
+  if (!op_res->is_new && pv.ObjType() != OBJ_TDIGEST)
+    return OpStatus::WRONG_TYPE;
+
+  const TDigest* dest = op_res->is_new || override ? nullptr : pv.GetTDigest();
+  if (!compression) {
+    compression = dest ? dest->compression() : 0;
+    for (const MergeSource& src : sources)
+      compression = std::max(*compression, src->compression());
+  }
+
+  TDigest* merged = CompactObj::AllocateMR<TDigest>(*compression, CompactObj::memory_resource());
+  if (dest)
+    merged->Merge(*dest);
+  for (const MergeSource& src : sources)
+    merged->Merge(*src);
+  pv.SetTDigest(merged);
+  return OpStatus::OK;
+}
+
+// Runs f on the digest of key. Queries merge the buffered values of the digest first, which does
+// not change its estimates, so the read-only commands run them in place.
+template <typename F, typename Result = invoke_result_t<F, TDigest*>>
+OpResult<Result> ReadDigest(string_view key, F&& f, ConnectionContext* cntx) {
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<Result> {
+    auto op_res = shard->db_slice().FindReadOnly(t->GetDbContext(), key, OBJ_TDIGEST);
+    if (!op_res)
+      return op_res.status();
+    return f((*op_res)->second.GetTDigest());
+  };
+  return cntx->transaction->ScheduleSingleHopT(std::move(cb));
+}
+
+// Sends the estimates of f for each of the values following the key.
+template <typename F> void QueryValues(CmdArgList args, F&& f, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  optional<Values> values = ParseValues(args.subspan(1));
+  if (!values)
+    return cntx->SendError("T-Digest: error parsing value");
+
+  auto res = ReadDigest(
+      key,
+      [&](TDigest* td) {
+        Values estimates(values->size());
+        for (size_t i = 0; i < values->size(); ++i)
+          estimates[i] = f(td, (*values)[i]);
+        return estimates;
+      },
+      cntx);
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  SendDoubles(*res, cntx);
+}
+
+// Sends the ranks of the values following the key, in the ascending or descending order.
+void SendRanks(CmdArgList args, bool reverse, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  optional<Values> values = ParseValues(args.subspan(1));
+  if (!values)
+    return cntx->SendError("T-Digest: error parsing value");
+
+  // Values below the minimum rank -1 and values above the maximum rank as the number of values,
+  // or the other way around in reverse. All ranks of an empty digest are -2.
+  auto res = ReadDigest(
+      key,
+      [&](TDigest* td) {
+        vector<int64_t> ranks(values->size(), -2);
+        if (td->empty())
+          return ranks;
+
+        int64_t total = td->total_weight();
+        for (size_t i = 0; i < values->size(); ++i) {
+          double val = (*values)[i];
+          if (val < td->min())
+            ranks[i] = reverse ? total : -1;
+          else if (val > td->max())
+            ranks[i] = reverse ? -1 : total;
+          else
+            ranks[i] = round((reverse ? 1 - td->Cdf(val) : td->Cdf(val)) * total - 0.5);
+        }
+        return ranks;
+      },
+      cntx);
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(res->size());
+  for (int64_t rank : *res)
+    rb->SendLong(rank);
+}
+
+// Sends the estimated values of the ranks following the key, in the ascending or descending
+// order.
+void SendByRanks(CmdArgList args, bool reverse, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  args.remove_prefix(1);
+
+  vector<uint64_t> ranks(args.size());
+  for (size_t i = 0; i < args.size(); ++i) {
+    int64_t rank;
+    if (!absl::SimpleAtoi(ArgS(args, i), &rank))
+      return cntx->SendError("T-Digest: error parsing rank");
+    if (rank < 0)
+      return cntx->SendError("T-Digest: rank needs to be non negative");
+    ranks[i] = rank;
+  }
+
+  // The ranks past the number of values are at the infinity behind the extremes.
+  auto res = ReadDigest(
+      key,
+      [&](TDigest* td) {
+        Values estimates(ranks.size(), numeric_limits<double>::quiet_NaN());
+        if (td->empty())
+          return estimates;
+
+        double total = td->total_weight();
+        for (size_t i = 0; i < ranks.size(); ++i) {
+          if (ranks[i] >= total) {
+            estimates[i] = reverse ? -HUGE_VAL : HUGE_VAL;
+          } else {
+            double pos = reverse ? total - ranks[i] - 0.5 : ranks[i] + 0.5;
+            estimates[i] = td->Quantile(pos / total);
+          }
+        }
+        return estimates;
+      },
+      cntx);
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  SendDoubles(*res, cntx);
+}
+
+}  // namespace
+
+// TDIGEST.CREATE key [COMPRESSION compression]
+void TDigestFamily::Create(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+
+  double compression = TDigest::kDefaultCompression;
+  if (parser.Check("COMPRESSION").IgnoreCase().ExpectTail(1)) {
+    if (!ParseCompression(&parser, &compression))
+      return cntx->SendError("T-Digest: error parsing compression parameter");
+  }
+  bool trailing = parser.HasNext();
+  if (parser.Error() || trailing)
+    return cntx->SendError(kSyntaxErr);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpCreate(t->GetOpArgs(shard), key, compression);
+  };
+
+  OpStatus res = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (res == OpStatus::OK)
+    return cntx->SendOk();
+  SendStatus(res, cntx);
+}
+
+void TDigestFamily::Reset(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpUpdate(t->GetOpArgs(shard), key, {});
+  };
+
+  OpStatus res = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (res == OpStatus::OK)
+    return cntx->SendOk();
+  SendStatus(res, cntx);
+}
+
+void TDigestFamily::Add(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  optional<Values> values = ParseValues(args.subspan(1));
+  if (!values || any_of(values->begin(), values->end(), [](double v) { return isinf(v); }))
+    return cntx->SendError("T-Digest: error parsing val parameter");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpUpdate(t->GetOpArgs(shard), key, *values);
+  };
+
+  OpStatus res = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (res == OpStatus::OK)
+    return cntx->SendOk();
+  SendStatus(res, cntx);
+}
+
+// TDIGEST.MERGE destination numkeys source [source ...] [COMPRESSION compression] [OVERRIDE]
+void TDigestFamily::Merge(CmdArgList args, ConnectionContext* cntx) {
+  string_view dest_key = ArgS(args, 0);
+  uint32_t num_keys = 0;
+  if (!absl::SimpleAtoi(ArgS(args, 1), &num_keys) || num_keys == 0)
+    return cntx->SendError("T-Digest: invalid numkeys");
+
+  // DetermineKeys verified that numkeys sources follow.
+  CmdArgParser parser(args.subspan(2 + num_keys));
+  optional<double> compression;
+  bool override = false;
+  while (parser.HasNext()) {
+    if (parser.Check("COMPRESSION").IgnoreCase().ExpectTail(1)) {
+      if (!ParseCompression(&parser, &compression.emplace()))
+        return cntx->SendError("T-Digest: error parsing compression parameter");
+    } else if (parser.Check("OVERRIDE").IgnoreCase()) {
+      override = true;
+    } else {
+      return cntx->SendError(kSyntaxErr);
+    }
+  }
+  if (parser.Error())
+    return cntx->SendError(kSyntaxErr);
+
+  Transaction* trans = cntx->transaction;
+  vector<OpResult<vector<MergeSource>>> copies(shard_set->size());
+  auto copy_cb = [&](Transaction* t, EngineShard* shard) {
+    copies[shard->shard_id()] = OpCopySources(t, shard);
+    return OpStatus::OK;
+  };
+  trans->Execute(std::move(copy_cb), false);
+
+  vector<MergeSource> sources;
+  for (auto& copy : copies) {
+    if (!copy) {
+      trans->Conclude();
+      return SendStatus(copy.status(), cntx);
+    }
+    move(copy->begin(), copy->end(), back_inserter(sources));
+  }
+
+  ShardId dest_shard = Shard(dest_key, shard_set->size());
+  OpStatus status = OpStatus::OK;
+  auto store_cb = [&](Transaction* t, EngineShard* shard) {
+    if (shard->shard_id() == dest_shard)
+      status = OpStoreMerge(t->GetOpArgs(shard), dest_key, sources, compression, override);
+    return OpStatus::OK;
+  };
+  trans->Execute(std::move(store_cb), true);
+
+  if (status != OpStatus::OK)
+    return SendStatus(status, cntx);
+  cntx->SendOk();
+}
+
+void TDigestFamily::Min(CmdArgList args, ConnectionContext* cntx) {
+  auto res = ReadDigest(ArgS(args, 0), [](TDigest* td) { return td->min(); }, cntx);
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  cntx->reply_builder()->SendDouble(*res);
+}
+
+void TDigestFamily::Max(CmdArgList args, ConnectionContext* cntx) {
+  auto res = ReadDigest(ArgS(args, 0), [](TDigest* td) { return td->max(); }, cntx);
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  cntx->reply_builder()->SendDouble(*res);
+}
+
+void TDigestFamily::Quantile(CmdArgList args, ConnectionContext* cntx) {
+  for (size_t i = 1; i < args.size(); ++i) {
+    double q;
+    if (!ParseDouble(ArgS(args, i), &q) || q < 0 || q > 1)
+      return cntx->SendError("T-Digest: quantile should be in [0,1]");
+  }
+  QueryValues(args, [](TDigest* td, double q) { return td->Quantile(q); }, cntx);
+}
+
+void TDigestFamily::Cdf(CmdArgList args, ConnectionContext* cntx) {
+  QueryValues(args, [](TDigest* td, double val) { return td->Cdf(val); }, cntx);
+}
+
+void TDigestFamily::Rank(CmdArgList args, ConnectionContext* cntx) {
+  SendRanks(args, false, cntx);
+}
+
+void TDigestFamily::RevRank(CmdArgList args, ConnectionContext* cntx) {
+  SendRanks(args, true, cntx);
+}
+
+void TDigestFamily::ByRank(CmdArgList args, ConnectionContext* cntx) {
+  SendByRanks(args, false, cntx);
+}
+
+void TDigestFamily::ByRevRank(CmdArgList args, ConnectionContext* cntx) {
+  SendByRanks(args, true, cntx);
+}
+
+// TDIGEST.TRIMMED_MEAN key low_cut_quantile high_cut_quantile
+void TDigestFamily::TrimmedMean(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  double low, high;
+  tie(low, high) = parser.Next<double, double>();
+  if (parser.Error())
+    return cntx->SendError("T-Digest: error parsing cut quantile");
+  if (low < 0 || low > 1 || high < 0 || high > 1) {
+    return cntx->SendError(
+        "T-Digest: low_cut_percentile and high_cut_percentile should be in [0,1]");
+  }
+  if (low >= high) {
+    return cntx->SendError(
+        "T-Digest: low_cut_percentile should be lower than high_cut_percentile");
+  }
+
+  auto res = ReadDigest(key, [&](TDigest* td) { return td->TrimmedMean(low, high); }, cntx);
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  cntx->reply_builder()->SendDouble(*res);
+}
+
+void TDigestFamily::Info(CmdArgList args, ConnectionContext* cntx) {
+  auto res = ReadDigest(
+      ArgS(args, 0),
+      [](TDigest* td) {
+        return array<uint64_t, 9>{uint64_t(td->compression()),
+                                  td->capacity(),
+                                  td->merged_nodes(),
+                                  td->unmerged_nodes(),
+                                  uint64_t(td->merged_weight()),
+                                  uint64_t(td->unmerged_weight()),
+                                  uint64_t(td->total_weight()),
+                                  td->total_compressions(),
+                                  td->MallocUsed()};
+      },
+      cntx);
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  const string_view kNames[] = {"Compression",    "Capacity",           "Merged nodes",
+                                "Unmerged nodes", "Merged weight",      "Unmerged weight",
+                                "Observations",   "Total compressions", "Memory usage"};
+  rb->StartArray(2 * res->size());
+  for (size_t i = 0; i < res->size(); ++i) {
+    rb->SendBulkString(kNames[i]);
+    rb->SendLong((*res)[i]);
+  }
+}
+
+using CI = CommandId;
+
+#define HFUNC(x) SetHandler(&TDigestFamily::x)
+
+void TDigestFamily::Register(CommandRegistry* registry) {
+  registry->StartFamily();
+
+  *registry
+      << CI{"TDIGEST.CREATE", CO::WRITE | CO::DENYOOM | CO::FAST, -2, 1, 1, acl::BLOOM}.HFUNC(
+             Create)
+      << CI{"TDIGEST.RESET", CO::WRITE | CO::FAST, 2, 1, 1, acl::BLOOM}.HFUNC(Reset)
+      << CI{"TDIGEST.ADD", CO::WRITE | CO::DENYOOM | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Add)
+      << CI{"TDIGEST.MERGE", CO::WRITE | CO::VARIADIC_KEYS | CO::DENYOOM, -4, 3, 3, acl::BLOOM}
+             .HFUNC(Merge)
+      << CI{"TDIGEST.MIN", CO::READONLY | CO::FAST, 2, 1, 1, acl::BLOOM}.HFUNC(Min)
+      << CI{"TDIGEST.MAX", CO::READONLY | CO::FAST, 2, 1, 1, acl::BLOOM}.HFUNC(Max)
+      << CI{"TDIGEST.QUANTILE", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Quantile)
+      << CI{"TDIGEST.CDF", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Cdf)
+      << CI{"TDIGEST.RANK", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Rank)
+      << CI{"TDIGEST.REVRANK", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(RevRank)
+      << CI{"TDIGEST.BYRANK", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(ByRank)
+      << CI{"TDIGEST.BYREVRANK", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(ByRevRank)
+      << CI{"TDIGEST.TRIMMED_MEAN", CO::READONLY | CO::FAST, 4, 1, 1, acl::BLOOM}.HFUNC(
+             TrimmedMean)
+      << CI{"TDIGEST.INFO", CO::READONLY | CO::FAST, 2, 1, 1, acl::BLOOM}.HFUNC(Info);
+};
+
+}  // namespace dfly
@@ -0,0 +1,36 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "server/common.h"
+
+namespace dfly {
+
+class CommandRegistry;
+class ConnectionContext;
+
+// t-digest commands, compatible with the TDIGEST commands of RedisBloom.
+class TDigestFamily {
+ public:
+  static void Register(CommandRegistry* registry);
+
+ private:
+  static void Create(CmdArgList args, ConnectionContext* cntx);
+  static void Reset(CmdArgList args, ConnectionContext* cntx);
+  static void Add(CmdArgList args, ConnectionContext* cntx);
+  static void Merge(CmdArgList args, ConnectionContext* cntx);
+  static void Min(CmdArgList args, ConnectionContext* cntx);
+  static void Max(CmdArgList args, ConnectionContext* cntx);
+  static void Quantile(CmdArgList args, ConnectionContext* cntx);
+  static void Cdf(CmdArgList args, ConnectionContext* cntx);
+  static void Rank(CmdArgList args, ConnectionContext* cntx);
+  static void RevRank(CmdArgList args, ConnectionContext* cntx);
+  static void ByRank(CmdArgList args, ConnectionContext* cntx);
+  static void ByRevRank(CmdArgList args, ConnectionContext* cntx);
+  static void TrimmedMean(CmdArgList args, ConnectionContext* cntx);
+  static void Info(CmdArgList args, ConnectionContext* cntx);
+};
+
+}  // namespace dfly
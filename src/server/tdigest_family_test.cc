@@ -0,0 +1,118 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/tdigest_family.h"
+
+#include "facade/facade_test.h"
+#include "server/test_utils.h"
+
+namespace dfly {
+
+using testing::_;
+using testing::ElementsAre;
+
+class TDigestFamilyTest : public BaseFamilyTest {
+ protected:
+};
+
+TEST_F(TDigestFamilyTest, Basic) {
+  EXPECT_EQ(Run({"tdigest.create", "t"}), "OK");
+  EXPECT_THAT(Run({"tdigest.create", "t"}), ErrArg("key already exists"));
+  EXPECT_EQ(Run({"type", "t"}), "TDIS-TYPE");
+  EXPECT_EQ(Run({"tdigest.min", "t"}), "nan");
+  EXPECT_EQ(Run({"tdigest.quantile", "t", "0.5"}), "nan");
+  EXPECT_THAT(Run({"tdigest.rank", "t", "1"}), IntArg(-2));
+
+  EXPECT_EQ(Run({"tdigest.add", "t", "1", "2", "3", "4", "5"}), "OK");
+  EXPECT_EQ(Run({"tdigest.min", "t"}), "1");
+  EXPECT_EQ(Run({"tdigest.max", "t"}), "5");
+
+  auto resp = Run({"tdigest.quantile", "t", "0", "0.5", "1"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("1", "3", "5")));
+  resp = Run({"tdigest.cdf", "t", "0", "3", "6"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("0", "0.5", "1")));
+  resp = Run({"tdigest.rank", "t", "0", "1", "3", "6"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(-1), IntArg(0), IntArg(2), IntArg(5))));
+  resp = Run({"tdigest.revrank", "t", "0", "5", "6"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(5), IntArg(0), IntArg(-1))));
+  resp = Run({"tdigest.byrank", "t", "0", "2", "5"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("1", "3", "inf")));
+  resp = Run({"tdigest.byrevrank", "t", "0", "5"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("5", "-inf")));
+  EXPECT_EQ(Run({"tdigest.trimmed_mean", "t", "0.2", "0.8"}), "3");
+
+  resp = Run({"tdigest.info", "t"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(
+                        "Compression", IntArg(100), "Capacity", IntArg(610), "Merged nodes",
+                        IntArg(5), "Unmerged nodes", IntArg(0), "Merged weight", IntArg(5),
+                        "Unmerged weight", IntArg(0), "Observations", IntArg(5),
+                        "Total compressions", IntArg(1), "Memory usage", _)));
+
+  // Reset keeps the compression.
+  Run({"tdigest.create", "t2", "COMPRESSION", "50"});
+  Run({"tdigest.add", "t2", "7"});
+  EXPECT_EQ(Run({"tdigest.reset", "t2"}), "OK");
+  EXPECT_EQ(Run({"tdigest.max", "t2"}), "nan");
+  resp = Run({"tdigest.info", "t2"});
+  EXPECT_THAT(resp.GetVec()[1], IntArg(50));
+}
+
+TEST_F(TDigestFamilyTest, Merge) {
+  Run({"tdigest.create", "a"});
+  Run({"tdigest.add", "a", "1", "2", "3"});
+  Run({"tdigest.create", "b", "COMPRESSION", "200"});
+  Run({"tdigest.add", "b", "4", "5", "6"});
+
+  // The destination is created with the largest compression of the sources.
+  EXPECT_EQ(Run({"tdigest.merge", "d", "2", "a", "b"}), "OK");
+  EXPECT_EQ(Run({"tdigest.min", "d"}), "1");
+  EXPECT_EQ(Run({"tdigest.max", "d"}), "6");
+  EXPECT_EQ(Run({"tdigest.quantile", "d", "0.5"}), "4");
+  auto resp = Run({"tdigest.info", "d"});
+  EXPECT_THAT(resp.GetVec()[1], IntArg(200));
+  EXPECT_THAT(resp.GetVec()[13], IntArg(6));
+
+  // The values of the destination are kept unless it is overridden.
+  EXPECT_EQ(Run({"tdigest.merge", "d", "1", "a"}), "OK");
+  resp = Run({"tdigest.info", "d"});
+  EXPECT_THAT(resp.GetVec()[1], IntArg(200));
+  EXPECT_THAT(resp.GetVec()[13], IntArg(9));
+
+  EXPECT_EQ(Run({"tdigest.merge", "d", "1", "a", "COMPRESSION", "10", "OVERRIDE"}), "OK");
+  resp = Run({"tdigest.info", "d"});
+  EXPECT_THAT(resp.GetVec()[1], IntArg(10));
+  EXPECT_THAT(resp.GetVec()[13], IntArg(3));
+  EXPECT_EQ(Run({"tdigest.max", "d"}), "3");
+
+  EXPECT_THAT(Run({"tdigest.merge", "d", "1", "missing"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"tdigest.merge", "d", "0", "a"}), ErrArg("at least 1 input key"));
+  EXPECT_THAT(Run({"tdigest.merge", "d", "1", "a", "foo"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"tdigest.merge", "d", "1", "a", "COMPRESSION", "0"}),
+              ErrArg("error parsing compression"));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"tdigest.merge", "str", "1", "a"}), ErrArg("WRONGTYPE"));
+  EXPECT_THAT(Run({"tdigest.merge", "d", "1", "str"}), ErrArg("WRONGTYPE"));
+}
+
+TEST_F(TDigestFamilyTest, Errors) {
+  EXPECT_THAT(Run({"tdigest.create", "t", "COMPRESSION", "0"}), ErrArg("parsing compression"));
+  EXPECT_THAT(Run({"tdigest.create", "t", "COMPRESSION", "x"}), ErrArg("parsing compression"));
+  EXPECT_THAT(Run({"tdigest.create", "t", "COMPRESSION"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"tdigest.add", "t", "1"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"tdigest.min", "t"}), ErrArg("key does not exist"));
+
+  Run({"tdigest.create", "t"});
+  EXPECT_THAT(Run({"tdigest.add", "t", "x"}), ErrArg("error parsing val"));
+  EXPECT_THAT(Run({"tdigest.add", "t", "+inf"}), ErrArg("error parsing val"));
+  EXPECT_THAT(Run({"tdigest.quantile", "t", "1.5"}), ErrArg("quantile should be in [0,1]"));
+  EXPECT_THAT(Run({"tdigest.byrank", "t", "-1"}), ErrArg("rank needs to be non negative"));
+  EXPECT_THAT(Run({"tdigest.trimmed_mean", "t", "0.8", "0.2"}), ErrArg("should be lower"));
+  EXPECT_THAT(Run({"tdigest.trimmed_mean", "t", "0", "2"}), ErrArg("should be in [0,1]"));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"tdigest.cdf", "str", "1"}), ErrArg("WRONGTYPE"));
+}
+
+}  // namespace dfly
@@ -470,6 +470,26 @@ auto BaseFamilyTest::GetMC(MP::CmdType cmd_type, std::initializer_list<std::stri
   return conn->SplitLines();
 }
 
+auto BaseFamilyTest::RunMCLine(std::string_view line, std::string_view value) -> MCResponse {
+  if (!ProactorBase::IsProactorThread()) {
+    return pp_->at(0)->Await([&] { return this->RunMCLine(line, value); });
+  }
+
+  string buf = absl::StrCat(line, "\r\n");
+  MP::Command cmd;
+  uint32_t consumed = 0;
+  CHECK_EQ(MP::OK, MemcacheParser{}.Parse(buf, &consumed, &cmd)) << line;
+  CHECK_EQ(cmd.bytes_len, value.size());
+
+  TestConnWrapper* conn = AddFindConn(Protocol::MEMCACHE, GetId());
+
+  auto* context = conn->cmd_cntx();
+
+  service_->DispatchMC(cmd, value, context);
+
+  return conn->SplitLines();
+}
+
 int64_t BaseFamilyTest::CheckedInt(ArgSlice list) {
   RespExpr resp = Run(list);
   if (resp.type == RespExpr::INT64) {
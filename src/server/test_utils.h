@@ -93,6 +93,9 @@ class BaseFamilyTest : public ::testing::Test {
   MCResponse RunMC(MemcacheParser::CmdType cmd_type, std::string_view key = std::string_view{});
   MCResponse GetMC(MemcacheParser::CmdType cmd_type, std::initializer_list<std::string_view> list);
 
+  // Parses and runs a memcache command line, like "mg key v", without the trailing CRLF.
+  MCResponse RunMCLine(std::string_view line, std::string_view value = std::string_view{});
+
   int64_t CheckedInt(std::initializer_list<std::string_view> list) {
     return CheckedInt(ArgSlice{list.begin(), list.size()});
   }
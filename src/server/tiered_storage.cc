@@ -28,9 +28,20 @@
 ABSL_FLAG(bool, tiered_storage_cache_fetched, true,
           "WIP: Load results of offloaded reads to memory");
 
+ABSL_FLAG(bool, tiered_storage_cache_hot_only, false,
+          "Load results of offloaded reads to memory only for values that were read at least twice "
+          "since the background offloading last visited them");
+
 ABSL_FLAG(unsigned, tiered_storage_write_depth, 50,
           "Maximum number of concurrent stash requests issued by background offload");
 
+ABSL_FLAG(bool, tiered_storage_compress, false,
+          "Compress offloaded values that take whole pages with zstd if that saves disk pages");
+
+ABSL_FLAG(bool, tiered_storage_demote_evicted, false,
+          "In cache mode, stash values chosen by heartbeat eviction instead of deleting them, "
+          "so that the next read loads them back from disk");
+
 namespace dfly {
 
 using namespace std;
@@ -46,6 +57,9 @@ bool OccupiesWholePages(size_t size) {
   return size >= TieredStorage::kMinOccupancySize;
 }
 
+// Deletes of compressed values must be recognized as whole page segments
+static_assert(tiering::OpManager::kMinCompressedSize >= TieredStorage::kMinOccupancySize);
+
 // Stashed bins no longer have bin ids, so this sentinel is used to differentiate from regular reads
 constexpr auto kFragmentedBin = tiering::SmallBins::kInvalidBin - 1;
 
@@ -58,6 +72,7 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
   ShardOpManager(TieredStorage* ts, DbSlice* db_slice, size_t max_size)
       : tiering::OpManager{max_size}, ts_{ts}, db_slice_{db_slice} {
     cache_fetched_ = absl::GetFlag(FLAGS_tiered_storage_cache_fetched);
+    cache_hot_only_ = absl::GetFlag(FLAGS_tiered_storage_cache_hot_only);
   }
 
   // Called before overriding value with segment
@@ -80,10 +95,19 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
     if (auto pv = Find(key); pv) {
       RecordAdded(db_slice_->MutableStats(key.first), *pv, segment);
 
+      // Values are stashed unchanged since their stash started, so a shorter segment means that
+      // the value was compressed
+      size_t size = pv->Size();
+      bool compressed = segment.length != size;
       pv->SetIoPending(false);
-      pv->SetExternal(segment.offset, segment.length);
+      pv->SetExternal(segment.offset, size, compressed ? segment.length : 0);
+      pv->SetTouched(false);
 
       stats_.total_stashes++;
+      if (compressed) {
+        stats_.compressed_raw_bytes += size;
+        stats_.compressed_stored_bytes += segment.length;
+      }
     }
   }
 
@@ -171,7 +195,11 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
     if (SliceSnapshot::IsSnaphotInProgress())
       return false;
 
-    SetInMemory(get<OpManager::KeyRef>(id), value, segment);
+    auto key = get<OpManager::KeyRef>(id);
+    if (!modified && cache_hot_only_ && !IsHot(key, segment))
+      return false;
+
+    SetInMemory(key, value, segment);
     return true;
   }
 
@@ -196,6 +224,19 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
  private:
   friend class TieredStorage;
 
+  // Returns true if the offloaded value was already read since the background offloading last
+  // visited it, otherwise marks it as touched.
+  bool IsHot(OpManager::KeyRef key, tiering::DiskSegment segment) {
+    auto* pv = Find(key);
+    if (!pv || !pv->IsExternal() || !(segment == pv->GetExternalSlice()))
+      return false;
+
+    if (pv->WasTouched())
+      return true;
+    pv->SetTouched(true);
+    return false;
+  }
+
   PrimeValue* Find(OpManager::KeyRef key) {
     // TODO: Get DbContext for transaction for correct dbid and time
     // Bypass all update and stat mechanisms
@@ -204,10 +245,12 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
   }
 
   bool cache_fetched_ = false;
+  bool cache_hot_only_ = false;
 
   struct {
     size_t total_stashes = 0, total_fetches = 0, total_cancels = 0, total_deletes = 0;
     size_t total_defrags = 0;  // included in total_fetches
+    size_t compressed_raw_bytes = 0, compressed_stored_bytes = 0;
   } stats_;
 
   TieredStorage* ts_;
@@ -216,8 +259,11 @@ class TieredStorage::ShardOpManager : public tiering::OpManager {
 
 TieredStorage::TieredStorage(DbSlice* db_slice, size_t max_size)
     : op_manager_{make_unique<ShardOpManager>(this, db_slice, max_size)},
-      bins_{make_unique<tiering::SmallBins>()} {
+      bins_{make_unique<tiering::SmallBins>()},
+      max_size_{max_size} {
   write_depth_limit_ = absl::GetFlag(FLAGS_tiered_storage_write_depth);
+  demote_evicted_ = absl::GetFlag(FLAGS_tiered_storage_demote_evicted);
+  compress_ = absl::GetFlag(FLAGS_tiered_storage_compress);
 }
 
 TieredStorage::~TieredStorage() {
@@ -239,7 +285,8 @@ util::fb2::Future<string> TieredStorage::Read(DbIndex dbid, string_view key,
     future.Resolve(*value);
     return false;
   };
-  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb));
+  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb),
+                       value.IsExternalCompressed());
   return future;
 }
 
@@ -250,7 +297,8 @@ void TieredStorage::Read(DbIndex dbid, std::string_view key, const PrimeValue& v
     readf(*value);
     return false;
   };
-  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb));
+  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb),
+                       value.IsExternalCompressed());
 }
 
 template <typename T>
@@ -263,7 +311,8 @@ util::fb2::Future<T> TieredStorage::Modify(DbIndex dbid, std::string_view key,
     future.Resolve(modf(value));
     return true;
   };
-  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb));
+  op_manager_->Enqueue(KeyRef(dbid, key), value.GetExternalSlice(), std::move(cb),
+                       value.IsExternalCompressed());
   return future;
 }
 
@@ -271,6 +320,14 @@ template util::fb2::Future<size_t> TieredStorage::Modify(DbIndex dbid, std::stri
                                                          const PrimeValue& value,
                                                          std::function<size_t(std::string*)> modf);
 
+void TieredStorage::DeferReads() {
+  op_manager_->DeferReads();
+}
+
+void TieredStorage::FlushReads() {
+  op_manager_->FlushReads();
+}
+
 void TieredStorage::Stash(DbIndex dbid, string_view key, PrimeValue* value) {
   DCHECK(!value->IsExternal() && !value->HasIoPending());
 
@@ -289,7 +346,7 @@ void TieredStorage::Stash(DbIndex dbid, string_view key, PrimeValue* value) {
   error_code ec;
   if (OccupiesWholePages(value->Size())) {  // large enough for own page
     id = KeyRef(dbid, key);
-    ec = op_manager_->Stash(id, value_sv);
+    ec = op_manager_->Stash(id, value_sv, compress_);
   } else if (auto bin = bins_->Stash(dbid, key, value_sv); bin) {
     id = bin->first;
     ec = op_manager_->Stash(bin->first, bin->second);
@@ -318,8 +375,14 @@ void TieredStorage::CancelStash(DbIndex dbid, std::string_view key, PrimeValue*
   value->SetIoPending(false);
 }
 
+// Only strings are offloaded. Strings are read back through Read/Modify, which return futures
+// that the commands await outside of their shard callbacks. Containers are accessed directly via
+// RObjPtr() from dozens of places in the families, often by multi-key callbacks that run
+// atomically and can not suspend for a disk read, so a faulted out hash or zset would need every
+// one of them to become asynchronous first.
 bool TieredStorage::ShouldStash(const PrimeValue& pv) const {
-  return !pv.IsExternal() && pv.ObjType() == OBJ_STRING && pv.Size() >= kMinValueSize;
+  return !pv.IsExternal() && !pv.IsSparseBitmap() && pv.ObjType() == OBJ_STRING &&
+         pv.Size() >= kMinValueSize;
 }
 
 TieredStats TieredStorage::GetStats() const {
@@ -331,6 +394,8 @@ TieredStats TieredStorage::GetStats() const {
     stats.total_stashes = shard_stats.total_stashes;
     stats.total_cancels = shard_stats.total_cancels;
     stats.total_defrags = shard_stats.total_defrags;
+    stats.total_compressed_raw_bytes = shard_stats.compressed_raw_bytes;
+    stats.total_compressed_stored_bytes = shard_stats.compressed_stored_bytes;
   }
 
   {  // OpManager stats
@@ -339,8 +404,15 @@ TieredStats TieredStorage::GetStats() const {
     stats.pending_stash_cnt = op_stats.pending_stash_cnt;
     stats.allocated_bytes = op_stats.disk_stats.allocated_bytes;
     stats.capacity_bytes = op_stats.disk_stats.capacity_bytes;
+    stats.file_free_bytes = op_stats.disk_stats.free_extent_bytes;
+    stats.file_fragmented_bytes =
+        op_stats.disk_stats.free_extent_bytes - op_stats.disk_stats.largest_free_extent;
     stats.total_heap_buf_allocs = op_stats.disk_stats.heap_buf_alloc_count;
     stats.total_registered_buf_allocs = op_stats.disk_stats.registered_buf_alloc_count;
+    stats.total_disk_reads = op_stats.disk_stats.read_count;
+    stats.total_disk_read_usec = op_stats.disk_stats.read_usec;
+    stats.total_disk_writes = op_stats.disk_stats.write_count;
+    stats.total_disk_write_usec = op_stats.disk_stats.write_usec;
   }
 
   {  // SmallBins stats
@@ -348,6 +420,8 @@ TieredStats TieredStorage::GetStats() const {
     stats.small_bins_cnt = bins_stats.stashed_bins_cnt;
     stats.small_bins_entries_cnt = bins_stats.stashed_entries_cnt;
     stats.small_bins_filling_bytes = bins_stats.current_bin_bytes;
+    stats.small_bins_fragmented_bytes =
+        bins_stats.stashed_bins_cnt * tiering::kPageSize - bins_stats.stashed_entries_bytes;
   }
 
   stats.total_stash_overflows = stash_overflow_cnt_;
@@ -364,7 +438,13 @@ void TieredStorage::RunOffloading(DbIndex dbid) {
     return;
 
   std::string tmp;
+  // Values accessed since the last visit are given a second chance, similar to SIEVE eviction
   auto cb = [this, dbid, &tmp, &stash_limit](PrimeIterator it) {
+    if (it->second.WasTouched()) {
+      it->second.SetTouched(false);
+      return;
+    }
+
     if (it->second.HasIoPending() || it->second.IsExternal())
       return;
 
@@ -384,4 +464,19 @@ void TieredStorage::RunOffloading(DbIndex dbid) {
   } while (offloading_cursor_ != start_cursor && stash_limit > 0 && iterations++ < 100);
 }
 
+size_t TieredStorage::DemotionBudget() const {
+  if (!demote_evicted_ || SliceSnapshot::IsSnaphotInProgress())
+    return 0;
+
+  // Stop demoting when the file is almost full, so that eviction keeps freeing memory instead of
+  // piling up values that fail to stash.
+  auto stats = op_manager_->GetStats();
+  if (stats.disk_stats.allocated_bytes + max_size_ / 16 >= max_size_)
+    return 0;
+
+  return write_depth_limit_ > stats.pending_stash_cnt
+             ? write_depth_limit_ - stats.pending_stash_cnt
+             : 0;
+}
+
 }  // namespace dfly
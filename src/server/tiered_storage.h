@@ -24,7 +24,10 @@ namespace tiering {
 class SmallBins;
 };
 
-// Manages offloaded values
+// Manages offloaded values. Only values are offloaded: the key, its expiry and an external
+// descriptor of the value (18 bytes inside the slot of the value) stay in the prime table,
+// so every offloaded entry still costs its table slot and the memory of its key. Keeping the keys
+// in memory lets lookups, expiry, eviction and SCAN work unchanged, and a miss never touches disk.
 class TieredStorage {
   class ShardOpManager;
 
@@ -55,6 +58,11 @@ class TieredStorage {
   util::fb2::Future<T> Modify(DbIndex dbid, std::string_view key, const PrimeValue& value,
                               std::function<T(std::string*)> modf);
 
+  // Defer reads issued until FlushReads() is called, so that reads of values on adjacent pages
+  // are merged into single disk reads. Used by multi-key commands. Must not yield in between.
+  void DeferReads();
+  void FlushReads();
+
   // Stash value. Sets IO_PENDING flag and unsets it on error or when finished
   void Stash(DbIndex dbid, std::string_view key, PrimeValue* value);
 
@@ -72,6 +80,10 @@ class TieredStorage {
   // Run offloading loop until i/o device is loaded or all entries were traversed
   void RunOffloading(DbIndex dbid);
 
+  // Returns how many values evicted in cache mode can be stashed instead of deleted right now.
+  // Zero when demotion is disabled, the i/o device is loaded or the file is almost full.
+  size_t DemotionBudget() const;
+
  private:
   PrimeTable::Cursor offloading_cursor_{};  // where RunOffloading left off
 
@@ -79,6 +91,9 @@ class TieredStorage {
   std::unique_ptr<tiering::SmallBins> bins_;
   unsigned write_depth_limit_ = 10;
   uint64_t stash_overflow_cnt_ = 0;
+  size_t max_size_;
+  bool demote_evicted_;
+  bool compress_;
 };
 
 }  // namespace dfly
@@ -123,6 +138,12 @@ class TieredStorage {
     return {};
   }
 
+  void DeferReads() {
+  }
+
+  void FlushReads() {
+  }
+
   void Stash(DbIndex dbid, std::string_view key, PrimeValue* value) {
   }
 
@@ -142,6 +163,10 @@ class TieredStorage {
 
   void RunOffloading(DbIndex dbid) {
   }
+
+  size_t DemotionBudget() const {
+    return 0;
+  }
 };
 
 }  // namespace dfly
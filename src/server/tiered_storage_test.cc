@@ -16,6 +16,7 @@
 #include "gtest/gtest.h"
 #include "server/engine_shard_set.h"
 #include "server/test_utils.h"
+#include "server/tiering/op_manager.h"
 #include "util/fibers/fibers.h"
 
 using namespace std;
@@ -24,9 +25,12 @@ using namespace testing;
 ABSL_DECLARE_FLAG(bool, force_epoll);
 ABSL_DECLARE_FLAG(string, tiered_prefix);
 ABSL_DECLARE_FLAG(bool, tiered_storage_cache_fetched);
+ABSL_DECLARE_FLAG(bool, tiered_storage_cache_hot_only);
 ABSL_DECLARE_FLAG(bool, backing_file_direct);
 ABSL_DECLARE_FLAG(float, tiered_offload_threshold);
 ABSL_DECLARE_FLAG(unsigned, tiered_storage_write_depth);
+ABSL_DECLARE_FLAG(bool, tiered_storage_demote_evicted);
+ABSL_DECLARE_FLAG(bool, tiered_storage_compress);
 
 namespace dfly {
 
@@ -228,4 +232,96 @@ TEST_F(TieredStorageTest, FlushAll) {
   EXPECT_GT(metrics.tiered_stats.total_fetches, 2u);
 }
 
+// In cache mode, heartbeat eviction stashes values instead of deleting their keys
+TEST_F(TieredStorageTest, DemoteEvicted) {
+  absl::FlagSaver saver;
+  absl::SetFlag(&FLAGS_tiered_offload_threshold, 1.1f);  // disable background offloading
+  absl::SetFlag(&FLAGS_tiered_storage_demote_evicted, true);
+  SetTestFlag("cache_mode", "true");
+  ResetService();
+  shard_set->TEST_EnableHeartBeat();
+
+  const int kNum = 1000;
+  max_memory_limit = kNum * 2000;
+  for (size_t i = 0; i < kNum; i++) {
+    Run({"SET", absl::StrCat("k", i), string(3000, 'A')});
+  }
+
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].tiered_entries > 0; });
+
+  // Demoted values are read back from disk, evicted keys are gone
+  size_t found = 0;
+  for (size_t i = 0; i < kNum; i++) {
+    auto resp = Run({"GET", absl::StrCat("k", i)});
+    if (resp.type == RespExpr::STRING) {
+      EXPECT_EQ(resp, string(3000, 'A'));
+      found++;
+    }
+  }
+  EXPECT_GT(found, 0u);
+  EXPECT_GT(GetMetrics().tiered_stats.total_fetches, 0u);
+}
+
+class TieredStorageHotOnlyTest : public TieredStorageTest {
+ protected:
+  void SetUp() override {
+    absl::SetFlag(&FLAGS_tiered_storage_cache_hot_only, true);
+    TieredStorageTest::SetUp();
+  }
+
+  absl::FlagSaver saver_;
+};
+
+// Offloaded values are loaded back to memory only on their second read
+TEST_F(TieredStorageHotOnlyTest, CacheOnSecondRead) {
+  Run({"SET", "k0", string(3000, 'A')});
+  ExpectConditionWithinTimeout([this] { return GetMetrics().tiered_stats.total_stashes >= 1; });
+
+  EXPECT_EQ(Run({"GET", "k0"}), string(3000, 'A'));
+  EXPECT_EQ(GetMetrics().db_stats[0].tiered_entries, 1);
+
+  EXPECT_EQ(Run({"GET", "k0"}), string(3000, 'A'));
+  EXPECT_EQ(GetMetrics().db_stats[0].tiered_entries, 0);
+  EXPECT_EQ(GetMetrics().tiered_stats.total_fetches, 1);
+}
+
+class TieredStorageCompressionTest : public TieredStorageTest {
+ protected:
+  void SetUp() override {
+    absl::SetFlag(&FLAGS_tiered_storage_compress, true);
+    TieredStorageTest::SetUp();
+  }
+
+  absl::FlagSaver saver_;
+};
+
+// Compressible values take fewer pages and are decompressed when they are read or modified
+TEST_F(TieredStorageCompressionTest, CompressedValues) {
+  const int kNum = 10;
+  const size_t kLen = 10000;
+  for (int i = 0; i < kNum; i++) {
+    Run({"SET", absl::StrCat("k", i), string(kLen, char('A' + i))});
+  }
+  ExpectConditionWithinTimeout([&] { return GetMetrics().db_stats[0].tiered_entries == kNum; });
+
+  // Every value is padded to half a page after compression
+  auto metrics = GetMetrics();
+  EXPECT_EQ(metrics.tiered_stats.total_compressed_raw_bytes, kNum * kLen);
+  EXPECT_EQ(metrics.tiered_stats.total_compressed_stored_bytes,
+            kNum * tiering::OpManager::kMinCompressedSize);
+  EXPECT_EQ(metrics.db_stats[0].tiered_used_bytes, kNum * tiering::OpManager::kMinCompressedSize);
+  EXPECT_LT(metrics.tiered_stats.allocated_bytes, kNum * 3 * tiering::kPageSize);
+
+  EXPECT_THAT(Run({"STRLEN", "k0"}), IntArg(kLen));
+  EXPECT_EQ(Run({"GET", "k0"}), string(kLen, 'A'));
+  EXPECT_THAT(Run({"APPEND", "k1", "C"}), IntArg(kLen + 1));
+  EXPECT_EQ(Run({"GET", "k1"}), string(kLen, 'B') + 'C');
+
+  Run({"DEL", "k2"});
+  metrics = GetMetrics();
+  EXPECT_EQ(metrics.db_stats[0].tiered_entries, kNum - 3);
+  EXPECT_EQ(metrics.db_stats[0].tiered_used_bytes,
+            (kNum - 3) * tiering::OpManager::kMinCompressedSize);
+}
+
 }  // namespace dfly
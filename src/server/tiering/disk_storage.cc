@@ -4,6 +4,8 @@
 
 #include "server/tiering/disk_storage.h"
 
+#include <absl/time/clock.h>
+
 #include <system_error>
 
 #include "base/flags.h"
@@ -107,7 +109,10 @@ void DiskStorage::Read(DiskSegment segment, ReadCb cb) {
   DCHECK_EQ(segment.offset % kPageSize, 0u);
 
   UringBuf buf = PrepareBuf(segment.length);
-  auto io_cb = [this, cb = std::move(cb), buf, segment](int io_res) {
+  auto io_cb = [this, cb = std::move(cb), buf, segment,
+                start = absl::GetCurrentTimeNanos()](int io_res) {
+    read_cnt_++;
+    read_usec_ += (absl::GetCurrentTimeNanos() - start) / 1000;
     if (io_res < 0)
       cb("", std::error_code{-io_res, std::system_category()});
     else
@@ -147,7 +152,10 @@ std::error_code DiskStorage::Stash(io::Bytes bytes, StashCb cb) {
   UringBuf buf = PrepareBuf(bytes.size());
   memcpy(buf.bytes.data(), bytes.data(), bytes.length());
 
-  auto io_cb = [this, cb, offset, buf, len = bytes.size()](int io_res) {
+  auto io_cb = [this, cb, offset, buf, len = bytes.size(),
+                start = absl::GetCurrentTimeNanos()](int io_res) {
+    write_cnt_++;
+    write_usec_ += (absl::GetCurrentTimeNanos() - start) / 1000;
     if (io_res < 0) {
       MarkAsFree({size_t(offset), len});
       cb({}, std::error_code{-io_res, std::system_category()});
@@ -167,7 +175,16 @@ std::error_code DiskStorage::Stash(io::Bytes bytes, StashCb cb) {
 }
 
 DiskStorage::Stats DiskStorage::GetStats() const {
-  return {alloc_.allocated_bytes(), alloc_.capacity(), heap_buf_alloc_cnt_, reg_buf_alloc_cnt_};
+  return {alloc_.allocated_bytes(),
+          alloc_.capacity(),
+          alloc_.free_extent_bytes(),
+          alloc_.largest_free_extent(),
+          heap_buf_alloc_cnt_,
+          reg_buf_alloc_cnt_,
+          read_cnt_,
+          read_usec_,
+          write_cnt_,
+          write_usec_};
 }
 
 std::error_code DiskStorage::Grow(off_t grow_size) {
@@ -20,8 +20,14 @@ class DiskStorage {
   struct Stats {
     size_t allocated_bytes = 0;
     size_t capacity_bytes = 0;
+    size_t free_extent_bytes = 0;
+    size_t largest_free_extent = 0;
     uint64_t heap_buf_alloc_count = 0;
     uint64_t registered_buf_alloc_count = 0;
+
+    // Completed i/o operations and their total latency from submission to completion
+    uint64_t read_count = 0, read_usec = 0;
+    uint64_t write_count = 0, write_usec = 0;
   };
 
   using ReadCb = std::function<void(std::string_view, std::error_code)>;
@@ -56,6 +62,9 @@ class DiskStorage {
   // how many times we allocate registered/heap buffers.
   uint64_t heap_buf_alloc_cnt_ = 0, reg_buf_alloc_cnt_ = 0;
 
+  uint64_t read_cnt_ = 0, read_usec_ = 0;
+  uint64_t write_cnt_ = 0, write_usec_ = 0;
+
   bool grow_pending_ = false;
   std::unique_ptr<util::fb2::LinuxFile> backing_file_;
 
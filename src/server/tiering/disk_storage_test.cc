@@ -88,11 +88,13 @@ TEST_F(DiskStorageTest, Basic) {
     EXPECT_EQ(segments_.size(), 100);
 
     EXPECT_EQ(GetStats().allocated_bytes, 100 * kPageSize);
+    EXPECT_EQ(GetStats().write_count, 100u);
 
     // Read all 100 values
     for (size_t i = 0; i < 100; i++)
       Read(i);
     Wait();
+    EXPECT_EQ(GetStats().read_count, 100u);
 
     // Expect them to be equal to written
     for (size_t i = 0; i < 100; i++)
@@ -367,6 +367,14 @@ int64_t ExternalAllocator::Malloc(size_t sz) {
 }
 
 void ExternalAllocator::Free(size_t offset, size_t sz) {
+  // Large blocks are carved directly from the extent tree, so they are returned to it.
+  if (detail::ClassFromSize(sz) == PageClass::LARGE_P) {
+    size_t align_sz = alignup(sz, 4_KB);
+    extent_tree_.Add(offset, align_sz);
+    allocated_bytes_ -= align_sz;
+    return;
+  }
+
   size_t idx = offset / 256_MB;
   size_t delta = offset % 256_MB;
   CHECK_LT(idx, segments_.size());
@@ -481,6 +489,7 @@ int64_t ExternalAllocator::LargeMalloc(size_t size) {
     return -int64_t(align_sz);
   }
 
+  allocated_bytes_ += align_sz;
   return op_range->first;
 }
 
@@ -505,20 +514,41 @@ void ExternalAllocator::FreePage(Page* page, SegmentDescr* owner, size_t block_s
   page->segment_inuse = 0;
   page->available = 0;
   page->next_free = nullptr;
+  --owner->page_info_.used;
+
+  // A full segment can still be linked, because FindPage unlinks full segments lazily.
+  auto& sq = sq_[owner->page_class()];
+  bool linked = owner->next != owner || sq == owner;
+
+  if (owner->used() == 0) {
+    // The segment is fully free. Its range returns to the extent tree, where it coalesces with
+    // adjacent free ranges and can be reused by any page class or by large blocks.
+    if (sq == owner)
+      sq = owner->Detach();
+    else
+      owner->Detach();
+    ReleaseSegment(owner);
+    return;
+  }
 
-  if (!owner->HasFreePages()) {
+  if (!linked) {
     // Segment was fully booked but now it has a free page.
     // Add it to the tail of segment queue.
-    DCHECK(owner->next == owner->prev);
-
-    auto& sq = sq_[owner->page_class()];
     if (sq == nullptr) {
       sq = owner;
     } else {
       sq->LinkBefore(owner);
     }
   }
-  --owner->page_info_.used;
+}
+
+void ExternalAllocator::ReleaseSegment(SegmentDescr* seg) {
+  size_t offset = seg->offset_;
+  DCHECK_EQ(segments_[offset / kSegmentAlignment], seg);
+
+  segments_[offset / kSegmentAlignment] = nullptr;
+  mi_free(seg);
+  extent_tree_.Add(offset, kSegmentSize);
 }
 
 inline auto ExternalAllocator::ToSegDescr(Page* page) -> SegmentDescr* {
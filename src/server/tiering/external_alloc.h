@@ -80,6 +80,17 @@ class ExternalAllocator {
     return allocated_bytes_;
   }
 
+  // Bytes of the storage that are not used by any segment or large block.
+  size_t free_extent_bytes() const {
+    return extent_tree_.total_len();
+  }
+
+  // Longest contiguous free range. Together with free_extent_bytes() it shows how fragmented
+  // the free space of the storage is.
+  size_t largest_free_extent() const {
+    return extent_tree_.max_len();
+  }
+
  private:
   class SegmentDescr;
   using Page = detail::Page;
@@ -91,6 +102,7 @@ class ExternalAllocator {
   int64_t LargeMalloc(size_t size);
   SegmentDescr* GetNewSegment(detail::PageClass sc);
   void FreePage(Page* page, SegmentDescr* owner, size_t block_size);
+  void ReleaseSegment(SegmentDescr* seg);
 
   static SegmentDescr* ToSegDescr(Page*);
 
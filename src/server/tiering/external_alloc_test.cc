@@ -119,6 +119,44 @@ TEST_F(ExternalAllocatorTest, Classes) {
   EXPECT_EQ(1_MB + 4_KB, ExternalAllocator::GoodSize(1_MB + 1));
 }
 
+TEST_F(ExternalAllocatorTest, LargeFree) {
+  ext_alloc_.AddStorage(0, kSegSize);
+
+  int64_t offs1 = ext_alloc_.Malloc(100_MB);
+  int64_t offs2 = ext_alloc_.Malloc(100_MB);
+  ASSERT_GE(offs1, 0);
+  ASSERT_GE(offs2, 0);
+  EXPECT_EQ(200_MB, ext_alloc_.allocated_bytes());
+  EXPECT_LT(ext_alloc_.Malloc(100_MB), 0);
+
+  // Freed large blocks are reused without growing the storage, the best fitting hole is used.
+  ext_alloc_.Free(offs1, 100_MB);
+  EXPECT_EQ(offs2 + int64_t(100_MB), ext_alloc_.Malloc(50_MB));
+  EXPECT_EQ(offs1, ext_alloc_.Malloc(80_MB));
+
+  ext_alloc_.Free(offs1, 80_MB);
+  ext_alloc_.Free(offs2 + 100_MB, 50_MB);
+  ext_alloc_.Free(offs2, 100_MB);
+  EXPECT_EQ(0u, ext_alloc_.allocated_bytes());
+  EXPECT_EQ(size_t(kSegSize), ext_alloc_.largest_free_extent());
+}
+
+TEST_F(ExternalAllocatorTest, ReleaseSegment) {
+  ext_alloc_.AddStorage(0, kSegSize);
+
+  // A segment of small pages takes all the storage.
+  int64_t offs = ext_alloc_.Malloc(kMinBlockSize);
+  ASSERT_EQ(0, offs);
+  EXPECT_EQ(0u, ext_alloc_.free_extent_bytes());
+  EXPECT_LT(ext_alloc_.Malloc(2_MB), 0);
+
+  // Once the segment is free, its range can host a large block.
+  ext_alloc_.Free(offs, kMinBlockSize);
+  EXPECT_EQ(size_t(kSegSize), ext_alloc_.free_extent_bytes());
+  EXPECT_EQ(0, ext_alloc_.Malloc(2_MB));
+  EXPECT_EQ(-kSegSize, ext_alloc_.Malloc(kMinBlockSize));  // no aligned segment is left.
+}
+
 // Fill up the allocator until it has to grow, remove 90% and make sure it has free space even with
 // extreme fragmentation
 TEST_F(ExternalAllocatorTest, EmptyFull) {
@@ -4,6 +4,9 @@
 
 #include "server/tiering/op_manager.h"
 
+#include <zstd.h>
+
+#include <algorithm>
 #include <variant>
 
 #include "base/logging.h"
@@ -28,6 +31,49 @@ OpManager::EntryId Borrowed(const OpManager::OwnedEntryId& id) {
   return std::visit([](const auto& v) -> OpManager::EntryId { return v; }, id);
 }
 
+// Upper bound for merging deferred reads of adjacent pages into a single disk read
+constexpr size_t kMaxMergedReadSize = 16 * kPageSize;
+
+// Every read decompresses the value again, so use the fastest level
+constexpr int kCompressionLevel = 1;
+
+// The compressed length is kept in 24 bits of the external pointer
+constexpr size_t kMaxCompressedSize = (1u << 24) - 1;
+
+// Returns the zero padded compressed value, or an empty string if it doesn't save disk pages
+std::string CompressValue(std::string_view value) {
+  std::string res(ZSTD_compressBound(value.size()), '\0');
+  size_t len = ZSTD_compress(res.data(), res.size(), value.data(), value.size(), kCompressionLevel);
+  if (ZSTD_isError(len))
+    return {};
+
+  res.resize(std::max(len, OpManager::kMinCompressedSize));
+  if (res.size() > kMaxCompressedSize ||
+      DiskSegment{0, res.size()}.ContainingPages().length >=
+          DiskSegment{0, value.size()}.ContainingPages().length)
+    return {};
+  return res;
+}
+
+// Decompresses the zstd frame at the start of value, it is followed by padding up to its segment
+bool DecompressValue(std::string* value) {
+  size_t frame_len = ZSTD_findFrameCompressedSize(value->data(), value->size());
+  if (ZSTD_isError(frame_len))
+    return false;
+
+  auto raw_len = ZSTD_getFrameContentSize(value->data(), frame_len);
+  if (raw_len == ZSTD_CONTENTSIZE_UNKNOWN || raw_len == ZSTD_CONTENTSIZE_ERROR)
+    return false;
+
+  std::string raw(raw_len, '\0');
+  size_t len = ZSTD_decompress(raw.data(), raw.size(), value->data(), frame_len);
+  if (ZSTD_isError(len) || len != raw_len)
+    return false;
+
+  value->swap(raw);
+  return true;
+}
+
 }  // namespace
 
 OpManager::OpManager(size_t max_size) : storage_{max_size} {
@@ -46,11 +92,37 @@ void OpManager::Close() {
   DCHECK(pending_reads_.empty());
 }
 
-void OpManager::Enqueue(EntryId id, DiskSegment segment, ReadCallback cb) {
+void OpManager::Enqueue(EntryId id, DiskSegment segment, ReadCallback cb, bool compressed) {
   // Fill pages for prepared read as it has no penalty and potentially covers more small segments
-  PrepareRead(segment.ContainingPages())
-      .ForSegment(segment, id)
-      .callbacks.emplace_back(std::move(cb));
+  EntryOps& ops = PrepareRead(segment.ContainingPages()).ForSegment(segment, id);
+  ops.compressed = compressed;
+  ops.callbacks.emplace_back(std::move(cb));
+}
+
+void OpManager::DeferReads() {
+  defer_reads_ = true;
+}
+
+void OpManager::FlushReads() {
+  defer_reads_ = false;
+  if (deferred_reads_.empty())
+    return;
+
+  std::sort(deferred_reads_.begin(), deferred_reads_.end(),
+            [](DiskSegment l, DiskSegment r) { return l.offset < r.offset; });
+
+  absl::Span<const DiskSegment> segments{deferred_reads_};
+  while (!segments.empty()) {
+    size_t end = segments[0].offset + segments[0].length;
+    size_t merged = 1;
+    while (merged < segments.size() && segments[merged].offset == end &&
+           end + segments[merged].length - segments[0].offset <= kMaxMergedReadSize) {
+      end += segments[merged++].length;
+    }
+    IssueRead(segments.subspan(0, merged));
+    segments.remove_prefix(merged);
+  }
+  deferred_reads_.clear();
 }
 
 void OpManager::Delete(EntryId id) {
@@ -73,7 +145,13 @@ void OpManager::Delete(DiskSegment segment) {
   }
 }
 
-std::error_code OpManager::Stash(EntryId id_ref, std::string_view value) {
+std::error_code OpManager::Stash(EntryId id_ref, std::string_view value, bool compress) {
+  std::string compressed;
+  if (compress)
+    compressed = CompressValue(value);
+  if (!compressed.empty())
+    value = compressed;
+
   auto id = ToOwned(id_ref);
   unsigned version = pending_stash_ver_[id] = ++pending_stash_counter_;
 
@@ -94,14 +172,35 @@ OpManager::ReadOp& OpManager::PrepareRead(DiskSegment aligned_segment) {
 
   auto [it, inserted] = pending_reads_.try_emplace(aligned_segment.offset, aligned_segment);
   if (inserted) {
-    auto io_cb = [this, aligned_segment](std::string_view value, std::error_code ec) {
-      ProcessRead(aligned_segment.offset, value);
-    };
-    storage_.Read(aligned_segment, io_cb);
+    if (defer_reads_)
+      deferred_reads_.push_back(aligned_segment);
+    else
+      IssueRead({aligned_segment});
   }
   return it->second;
 }
 
+void OpManager::IssueRead(absl::Span<const DiskSegment> segments) {
+  DCHECK(!segments.empty());
+  if (segments.size() == 1) {
+    auto io_cb = [this, offset = segments[0].offset](std::string_view value, std::error_code ec) {
+      ProcessRead(offset, value);
+    };
+    storage_.Read(segments[0], io_cb);
+    return;
+  }
+
+  DiskSegment full{segments.front().offset,
+                   segments.back().offset + segments.back().length - segments.front().offset};
+  auto io_cb = [this, full, parts = absl::InlinedVector<DiskSegment, 4>(segments.begin(),
+                                                                       segments.end())](
+                   std::string_view value, std::error_code ec) {
+    for (DiskSegment part : parts)
+      ProcessRead(part.offset, ec ? value : value.substr(part.offset - full.offset, part.length));
+  };
+  storage_.Read(full, io_cb);
+}
+
 void OpManager::ProcessStashed(EntryId id, unsigned version, DiskSegment segment,
                                std::error_code ec) {
   if (auto it = pending_stash_ver_.find(ToOwned(id));
@@ -136,6 +235,8 @@ void OpManager::ProcessRead(size_t offset, std::string_view value) {
   for (size_t i = 0; i < info->key_ops.size(); i++) {
     auto& ko = info->key_ops[i];
     key_value = value.substr(ko.segment.offset - info->segment.offset, ko.segment.length);
+    if (ko.compressed && !key_value.empty() && !DecompressValue(&key_value))
+      LOG(DFATAL) << "Failed to decompress offloaded value at " << ko.segment.offset;
 
     bool modified = false;
     for (auto& cb : ko.callbacks)
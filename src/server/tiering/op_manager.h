@@ -6,8 +6,10 @@
 
 #include <absl/container/flat_hash_map.h>
 #include <absl/container/inlined_vector.h>
+#include <absl/types/span.h>
 
 #include <variant>
+#include <vector>
 
 #include "server/tiering/common.h"
 #include "server/tiering/disk_storage.h"
@@ -38,6 +40,10 @@ class OpManager {
   // Callback for post-read completion. Returns whether the value was modified
   using ReadCallback = std::function<bool(std::string*)>;
 
+  // Compressed values are padded to at least this size, so that they are never mistaken for
+  // entries of small bins
+  static constexpr size_t kMinCompressedSize = kPageSize / 2;
+
   explicit OpManager(size_t max_size);
   virtual ~OpManager();
 
@@ -48,8 +54,16 @@ class OpManager {
 
   // Enqueue callback to be executed once value is read. Trigger read if none is pending yet for
   // this segment. Multiple entries can be obtained from a single segment, but every distinct id
-  // will have it's own independent callback loop that can safely modify the underlying value
-  void Enqueue(EntryId id, DiskSegment segment, ReadCallback cb);
+  // will have it's own independent callback loop that can safely modify the underlying value.
+  // Values stashed compressed are decompressed before the callbacks run
+  void Enqueue(EntryId id, DiskSegment segment, ReadCallback cb, bool compressed = false);
+
+  // Defer issuing reads for newly enqueued segments until FlushReads() is called. Deferred reads
+  // of adjacent pages are merged into single disk reads. Must not yield in between
+  void DeferReads();
+
+  // Issue all deferred reads
+  void FlushReads();
 
   // Delete entry with pending io
   void Delete(EntryId id);
@@ -57,8 +71,9 @@ class OpManager {
   // Delete offloaded entry
   void Delete(DiskSegment segment);
 
-  // Stash value to be offloaded
-  std::error_code Stash(EntryId id, std::string_view value);
+  // Stash value to be offloaded. With compress set, the value is stored compressed if that takes
+  // fewer pages, in which case the reported segment is shorter than the value
+  std::error_code Stash(EntryId id, std::string_view value, bool compress = false);
 
   Stats GetStats() const;
 
@@ -85,6 +100,7 @@ class OpManager {
     DiskSegment segment;
     absl::InlinedVector<ReadCallback, 1> callbacks;
     bool deleting = false;
+    bool compressed = false;
   };
 
   // Describes an ongoing read operation for a fixed segment
@@ -109,6 +125,9 @@ class OpManager {
   // Called once read finished
   void ProcessRead(size_t offset, std::string_view value);
 
+  // Issue single disk read for consecutive aligned segments of pending read ops
+  void IssueRead(absl::Span<const DiskSegment> segments);
+
   // Called once Stash finished
   void ProcessStashed(EntryId id, unsigned version, DiskSegment segment, std::error_code ec);
 
@@ -117,6 +136,9 @@ class OpManager {
 
   absl::flat_hash_map<size_t /* offset */, ReadOp> pending_reads_;
 
+  bool defer_reads_ = false;
+  std::vector<DiskSegment> deferred_reads_;  // aligned segments of deferred read ops
+
   size_t pending_stash_counter_ = 0;
   // todo: allow heterogeneous lookups with non owned id
   absl::flat_hash_map<OwnedEntryId, unsigned /* version */> pending_stash_ver_;
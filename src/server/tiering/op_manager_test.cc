@@ -140,6 +140,33 @@ TEST_F(OpManagerTest, ReadSamePageDifferentOffsets) {
   });
 }
 
+TEST_F(OpManagerTest, DeferredReads) {
+  pp_->at(0)->Await([this] {
+    Open();
+
+    for (unsigned i = 0; i < 40; i++)
+      EXPECT_FALSE(Stash(i, absl::StrCat("VALUE", i)));
+
+    while (stashed_.size() < 40)
+      util::ThisFiber::SleepFor(1ms);
+
+    // Values occupy consecutive pages, so deferred reads are merged into few disk reads
+    DeferReads();
+    std::vector<util::fb2::Future<std::string>> futures;
+    for (unsigned i = 0; i < 40; i++)
+      futures.emplace_back(Read(i, stashed_[i]));
+    futures.emplace_back(Read(7u, stashed_[7u]));
+    FlushReads();
+
+    for (unsigned i = 0; i < 40; i++)
+      EXPECT_EQ(futures[i].Get(), absl::StrCat("VALUE", i));
+    EXPECT_EQ(futures.back().Get(), "VALUE7");
+    EXPECT_EQ(GetStats().pending_read_cnt, 0u);
+
+    Close();
+  });
+}
+
 TEST_F(OpManagerTest, Modify) {
   pp_->at(0)->Await([this] {
     Open();
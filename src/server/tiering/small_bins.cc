@@ -107,6 +107,7 @@ SmallBins::KeySegmentList SmallBins::ReportStashed(BinId id, DiskSegment segment
   }
 
   stats_.stashed_entries_cnt += list.size();
+  stats_.stashed_entries_bytes += bytes;
   stashed_bins_[segment.offset] = {uint8_t(list.size()), bytes};
   return list;
 }
@@ -150,6 +151,7 @@ SmallBins::BinInfo SmallBins::Delete(DiskSegment segment) {
 
     DCHECK_LE(segment.length, bin.bytes);
     bin.bytes -= segment.length;
+    stats_.stashed_entries_bytes -= segment.length;
 
     if (--bin.entries == 0) {
       DCHECK_EQ(bin.bytes, 0u);
@@ -168,6 +170,7 @@ SmallBins::BinInfo SmallBins::Delete(DiskSegment segment) {
 SmallBins::Stats SmallBins::GetStats() const {
   return Stats{.stashed_bins_cnt = stashed_bins_.size(),
                .stashed_entries_cnt = stats_.stashed_entries_cnt,
+               .stashed_entries_bytes = stats_.stashed_entries_bytes,
                .current_bin_bytes = current_bin_bytes_};
 }
 
@@ -179,6 +182,7 @@ SmallBins::KeyHashDbList SmallBins::DeleteBin(DiskSegment segment, std::string_v
     return {};
 
   stats_.stashed_entries_cnt -= bin.mapped().entries;
+  stats_.stashed_entries_bytes -= bin.mapped().bytes;
 
   const char* data = value.data();
 
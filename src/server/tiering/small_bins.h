@@ -23,6 +23,7 @@ class SmallBins {
   struct Stats {
     size_t stashed_bins_cnt = 0;
     size_t stashed_entries_cnt = 0;
+    size_t stashed_entries_bytes = 0;  // bytes used by live entries of stashed bins
     size_t current_bin_bytes = 0;
   };
 
@@ -91,6 +92,7 @@ class SmallBins {
 
   struct {
     size_t stashed_entries_cnt = 0;
+    size_t stashed_entries_bytes = 0;
   } stats_;
 };
 
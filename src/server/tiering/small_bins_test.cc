@@ -83,12 +83,20 @@ TEST_F(SmallBinsTest, PartialStashDelete) {
     EXPECT_EQ(key, "k"s + bin->second.substr(segment.offset, segment.length).substr(1));
   }
 
+  size_t live_bytes = 0;
+  for (auto& [dbid, key, segment] : segments)
+    live_bytes += segment.length;
+  EXPECT_EQ(bins_.GetStats().stashed_entries_bytes, live_bytes);
+
   // Delete all stashed values
   while (!segments.empty()) {
     auto segment = std::get<2>(segments.back());
     segments.pop_back();
     auto bin = bins_.Delete(segment);
 
+    live_bytes -= segment.length;
+    EXPECT_EQ(bins_.GetStats().stashed_entries_bytes, live_bytes);
+
     EXPECT_EQ(bin.segment.offset, 0u);
     EXPECT_EQ(bin.segment.length, 4_KB);
 
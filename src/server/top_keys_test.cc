@@ -146,4 +146,20 @@ TEST(TopKeysTest, SavedByMultipleArrays) {
   }
 }
 
+static void BM_TouchTopKeys(benchmark::State& state) {
+  TopKeys top_keys({.min_key_count_to_record = 100});
+  vector<string> keys(1000);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    keys[i] = absl::StrCat("key:", i);
+  }
+
+  // A few hot keys among many cold ones.
+  size_t next = 0;
+  while (state.KeepRunning()) {
+    size_t i = next++;
+    top_keys.Touch(keys[i % 8 == 0 ? i % 10 : i % keys.size()]);
+  }
+}
+BENCHMARK(BM_TouchTopKeys);
+
 }  // end of namespace dfly
@@ -0,0 +1,280 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/topk_family.h"
+
+#include "core/top_k.h"
+#include "facade/cmd_arg_parser.h"
+#include "facade/error.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/engine_shard_set.h"
+#include "server/transaction.h"
+
+namespace dfly {
+
+using namespace facade;
+using namespace std;
+
+namespace {
+
+// Bounds the work of an increment, which decays the buckets of other items once per occurrence.
+constexpr uint32_t kMaxIncr = 100000;
+
+using ItemIncrs = vector<pair<string_view, uint32_t>>;
+using Expelled = vector<optional<string>>;
+using Counts = absl::InlinedVector<uint32_t, 4>;
+using ItemList = vector<pair<string, uint32_t>>;
+
+void SendStatus(OpStatus status, ConnectionContext* cntx) {
+  switch (status) {
+    case OpStatus::KEY_EXISTS:
+      return cntx->SendError("TopK: key already exists");
+    case OpStatus::KEY_NOTFOUND:
+      return cntx->SendError("TopK: key does not exist");
+    default:
+      return cntx->SendError(status);
+  }
+}
+
+OpStatus OpReserve(const OpArgs& op_args, string_view key, uint32_t k, uint32_t width,
+                   uint32_t depth, double decay) {
+  auto& db_slice = op_args.shard->db_slice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+  if (!op_res->is_new)
+    return OpStatus::KEY_EXISTS;
+
+  op_res->it->second.SetTopK(
+      CompactObj::AllocateMR<TopK>(k, width, depth, decay, CompactObj::memory_resource()));
+  return OpStatus::OK;
+}
+
+OpResult<Expelled> OpIncrBy(const OpArgs& op_args, string_view key, const ItemIncrs& incrs) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto op_res = db_slice.FindMutable(op_args.db_cntx, key, OBJ_TOPK);
+  if (!op_res)
+    return op_res.status();
+
+  TopK* topk = op_res->it->second.GetTopK();
+  Expelled result(incrs.size());
+  for (size_t i = 0; i < incrs.size(); ++i)
+    result[i] = topk->IncrBy(incrs[i].first, incrs[i].second);
+  return result;
+}
+
+// Returns whether the items are in the top-k, or their counts if counts is true.
+OpResult<Counts> OpQuery(const OpArgs& op_args, string_view key, CmdArgList items, bool counts) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto op_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_TOPK);
+  if (!op_res)
+    return op_res.status();
+
+  const TopK* topk = (*op_res)->second.GetTopK();
+  Counts result(items.size());
+  for (size_t i = 0; i < items.size(); ++i)
+    result[i] = counts ? topk->Count(ToSV(items[i])) : topk->Query(ToSV(items[i]));
+  return result;
+}
+
+OpResult<ItemList> OpList(const OpArgs& op_args, string_view key) {
+  auto& db_slice = op_args.shard->db_slice();
+  auto op_res = db_slice.FindReadOnly(op_args.db_cntx, key, OBJ_TOPK);
+  if (!op_res)
+    return op_res.status();
+
+  ItemList result;
+  for (const auto& [item, count] : (*op_res)->second.GetTopK()->List())
+    result.emplace_back(item, count);
+  return result;
+}
+
+void IncrByItems(string_view key, const ItemIncrs& incrs, ConnectionContext* cntx) {
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpIncrBy(t->GetOpArgs(shard), key, incrs);
+  };
+
+  OpResult<Expelled> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(res->size());
+  for (const auto& expelled : *res) {
+    if (expelled)
+      rb->SendBulkString(*expelled);
+    else
+      rb->SendNull();
+  }
+}
+
+void QueryItems(CmdArgList args, bool counts, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  args.remove_prefix(1);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpQuery(t->GetOpArgs(shard), key, args, counts);
+  };
+
+  OpResult<Counts> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(res->size());
+  for (uint32_t val : *res)
+    rb->SendLong(val);
+}
+
+}  // namespace
+
+// TOPK.RESERVE key topk [width depth decay]
+void TopKFamily::Reserve(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  uint32_t k = parser.Next<uint32_t>();
+
+  // The defaults of RedisBloom.
+  uint32_t width = 8, depth = 7;
+  double decay = 0.9;
+  if (parser.HasNext())
+    tie(width, depth, decay) = parser.Next<uint32_t, uint32_t, double>();
+
+  bool trailing = parser.HasNext();
+  if (parser.Error() || trailing)
+    return cntx->SendError(kSyntaxErr);
+  if (k == 0)
+    return cntx->SendError("TopK: invalid k");
+  if (width == 0)
+    return cntx->SendError("TopK: invalid width");
+  if (depth == 0 || depth > TopK::kMaxDepth)
+    return cntx->SendError("TopK: invalid depth");
+  if (decay <= 0 || decay > 1)
+    return cntx->SendError("TopK: invalid decay value. must be '<= 1' and '> 0'");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpReserve(t->GetOpArgs(shard), key, k, width, depth, decay);
+  };
+
+  OpStatus res = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (res == OpStatus::OK)
+    return cntx->SendOk();
+  SendStatus(res, cntx);
+}
+
+void TopKFamily::Add(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  args.remove_prefix(1);
+
+  ItemIncrs incrs(args.size());
+  for (size_t i = 0; i < incrs.size(); ++i)
+    incrs[i] = {ArgS(args, i), 1};
+
+  IncrByItems(key, incrs, cntx);
+}
+
+void TopKFamily::IncrBy(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  args.remove_prefix(1);
+  if (args.size() % 2 != 0)
+    return cntx->SendError(WrongNumArgsError("topk.incrby"));
+
+  ItemIncrs incrs(args.size() / 2);
+  for (size_t i = 0; i < incrs.size(); ++i) {
+    incrs[i].first = ArgS(args, 2 * i);
+    if (!absl::SimpleAtoi(ArgS(args, 2 * i + 1), &incrs[i].second) ||
+        incrs[i].second > kMaxIncr) {
+      return cntx->SendError("TopK: increment must be an integer between 0 and 100000");
+    }
+  }
+
+  IncrByItems(key, incrs, cntx);
+}
+
+void TopKFamily::Query(CmdArgList args, ConnectionContext* cntx) {
+  QueryItems(args, false, cntx);
+}
+
+void TopKFamily::Count(CmdArgList args, ConnectionContext* cntx) {
+  QueryItems(args, true, cntx);
+}
+
+// TOPK.LIST key [WITHCOUNT]
+void TopKFamily::List(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  bool with_count = static_cast<bool>(parser.Check("WITHCOUNT").IgnoreCase());
+  bool trailing = parser.HasNext();
+  if (parser.Error() || trailing)
+    return cntx->SendError(kSyntaxErr);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpList(t->GetOpArgs(shard), key);
+  };
+
+  OpResult<ItemList> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(with_count ? res->size() * 2 : res->size());
+  for (const auto& [item, count] : *res) {
+    rb->SendBulkString(item);
+    if (with_count)
+      rb->SendLong(count);
+  }
+}
+
+void TopKFamily::Info(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+
+  struct Dims {
+    uint32_t k, width, depth;
+    double decay;
+  };
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) -> OpResult<Dims> {
+    auto op_res = shard->db_slice().FindReadOnly(t->GetDbContext(), key, OBJ_TOPK);
+    if (!op_res)
+      return op_res.status();
+    const TopK* topk = (*op_res)->second.GetTopK();
+    return Dims{topk->k(), topk->width(), topk->depth(), topk->decay()};
+  };
+
+  OpResult<Dims> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(8);
+  rb->SendBulkString("k");
+  rb->SendLong(res->k);
+  rb->SendBulkString("width");
+  rb->SendLong(res->width);
+  rb->SendBulkString("depth");
+  rb->SendLong(res->depth);
+  rb->SendBulkString("decay");
+  rb->SendDouble(res->decay);
+}
+
+using CI = CommandId;
+
+#define HFUNC(x) SetHandler(&TopKFamily::x)
+
+void TopKFamily::Register(CommandRegistry* registry) {
+  registry->StartFamily();
+
+  *registry
+      << CI{"TOPK.RESERVE", CO::WRITE | CO::DENYOOM | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(
+             Reserve)
+      << CI{"TOPK.ADD", CO::WRITE | CO::DENYOOM | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Add)
+      << CI{"TOPK.INCRBY", CO::WRITE | CO::DENYOOM | CO::FAST, -4, 1, 1, acl::BLOOM}.HFUNC(IncrBy)
+      << CI{"TOPK.QUERY", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Query)
+      << CI{"TOPK.COUNT", CO::READONLY | CO::FAST, -3, 1, 1, acl::BLOOM}.HFUNC(Count)
+      << CI{"TOPK.LIST", CO::READONLY | CO::FAST, -2, 1, 1, acl::BLOOM}.HFUNC(List)
+      << CI{"TOPK.INFO", CO::READONLY | CO::FAST, 2, 1, 1, acl::BLOOM}.HFUNC(Info);
+};
+
+}  // namespace dfly
@@ -0,0 +1,29 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "server/common.h"
+
+namespace dfly {
+
+class CommandRegistry;
+class ConnectionContext;
+
+// Top-K commands, compatible with the TOPK commands of RedisBloom.
+class TopKFamily {
+ public:
+  static void Register(CommandRegistry* registry);
+
+ private:
+  static void Reserve(CmdArgList args, ConnectionContext* cntx);
+  static void Add(CmdArgList args, ConnectionContext* cntx);
+  static void IncrBy(CmdArgList args, ConnectionContext* cntx);
+  static void Query(CmdArgList args, ConnectionContext* cntx);
+  static void Count(CmdArgList args, ConnectionContext* cntx);
+  static void List(CmdArgList args, ConnectionContext* cntx);
+  static void Info(CmdArgList args, ConnectionContext* cntx);
+};
+
+}  // namespace dfly
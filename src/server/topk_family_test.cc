@@ -0,0 +1,68 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/topk_family.h"
+
+#include "facade/facade_test.h"
+#include "server/test_utils.h"
+
+namespace dfly {
+
+using testing::ElementsAre;
+
+class TopKFamilyTest : public BaseFamilyTest {
+ protected:
+};
+
+TEST_F(TopKFamilyTest, Basic) {
+  EXPECT_EQ(Run({"topk.reserve", "t", "2", "100", "4", "0.9"}), "OK");
+  EXPECT_THAT(Run({"topk.reserve", "t", "2"}), ErrArg("key already exists"));
+  EXPECT_EQ(Run({"type", "t"}), "TopK-TYPE");
+
+  auto resp = Run({"topk.add", "t", "a", "a", "b"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(ArgType(RespExpr::NIL), ArgType(RespExpr::NIL),
+                                          ArgType(RespExpr::NIL))));
+  resp = Run({"topk.incrby", "t", "a", "1", "c", "5"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(ArgType(RespExpr::NIL), "b")));
+
+  resp = Run({"topk.query", "t", "a", "b", "c"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(1), IntArg(0), IntArg(1))));
+  resp = Run({"topk.count", "t", "a", "b", "c"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(3), IntArg(1), IntArg(5))));
+
+  resp = Run({"topk.list", "t"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("c", "a")));
+  resp = Run({"topk.list", "t", "withcount"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("c", IntArg(5), "a", IntArg(3))));
+
+  resp = Run({"topk.info", "t"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("k", IntArg(2), "width", IntArg(100), "depth",
+                                          IntArg(4), "decay", "0.9")));
+
+  // The dimensions of RedisBloom are used by default.
+  EXPECT_EQ(Run({"topk.reserve", "t2", "10"}), "OK");
+  resp = Run({"topk.info", "t2"});
+  EXPECT_THAT(resp, RespArray(ElementsAre("k", IntArg(10), "width", IntArg(8), "depth",
+                                          IntArg(7), "decay", "0.9")));
+}
+
+TEST_F(TopKFamilyTest, Errors) {
+  EXPECT_THAT(Run({"topk.reserve", "t", "0"}), ErrArg("invalid k"));
+  EXPECT_THAT(Run({"topk.reserve", "t", "2", "100", "0", "0.9"}), ErrArg("invalid depth"));
+  EXPECT_THAT(Run({"topk.reserve", "t", "2", "100", "4", "1.5"}), ErrArg("invalid decay"));
+  EXPECT_THAT(Run({"topk.reserve", "t", "2", "100"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"topk.add", "t", "a"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"topk.list", "t"}), ErrArg("key does not exist"));
+
+  Run({"topk.reserve", "t", "2"});
+  EXPECT_THAT(Run({"topk.incrby", "t", "a", "x"}), ErrArg("increment must be an integer"));
+  EXPECT_THAT(Run({"topk.incrby", "t", "a", "100001"}), ErrArg("increment must be an integer"));
+  EXPECT_THAT(Run({"topk.incrby", "t", "a", "1", "b"}), ErrArg("wrong number of arguments"));
+  EXPECT_THAT(Run({"topk.list", "t", "foo"}), ErrArg("syntax error"));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"topk.query", "str", "a"}), ErrArg("WRONGTYPE"));
+}
+
+}  // namespace dfly
@@ -5,6 +5,7 @@
 #include "server/transaction.h"
 
 #include <absl/strings/match.h>
+#include <absl/time/clock.h>
 
 #include "base/logging.h"
 #include "facade/op_status.h"
@@ -20,6 +21,18 @@
 ABSL_FLAG(uint32_t, tx_queue_warning_len, 96,
           "Length threshold for warning about long transaction queue");
 
+ABSL_FLAG(bool, tx_latency_stats, false,
+          "If true, collects per command histograms of the time spent scheduling, waiting in "
+          "the transaction queues and executing, reported in INFO LATENCYSTATS");
+
+ABSL_FLAG(bool, tx_batch_schedule, false,
+          "If true, single shard transactions scheduled by the same thread at the same time are "
+          "handed over to the shard queue as a single task");
+
+ABSL_FLAG(bool, tx_optimistic_ooo, false,
+          "If true, queued transactions run out of order as soon as the transactions "
+          "they conflict with have finished, instead of waiting for the queue head");
+
 namespace dfly {
 
 using namespace std;
@@ -35,6 +48,12 @@ atomic_uint64_t op_seq{1};
 
 constexpr size_t kTransSize [[maybe_unused]] = sizeof(Transaction);
 
+uint64_t ThreadCpuNs() {
+  timespec ts;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+  return ts.tv_sec * 1'000'000'000ULL + ts.tv_nsec;
+}
+
 void AnalyzeTxQueue(const EngineShard* shard, const TxQueue* txq) {
   unsigned q_limit = absl::GetFlag(FLAGS_tx_queue_warning_len);
   if (txq->size() > q_limit) {
@@ -64,10 +83,20 @@ void AnalyzeTxQueue(const EngineShard* shard, const TxQueue* txq) {
   }
 }
 
-void RecordTxScheduleStats(const Transaction* tx) {
+void RecordTxScheduleStats(const Transaction* tx, size_t num_keys) {
   auto* ss = ServerState::tlocal();
   ++(tx->IsGlobal() ? ss->stats.tx_global_cnt : ss->stats.tx_normal_cnt);
   ++ss->stats.tx_width_freq_arr[tx->GetUniqueShardCnt() - 1];
+
+  if (!tx->IsGlobal() && !tx->IsMulti() && num_keys > 1) {
+    ++ss->stats.tx_multikey_cnt;
+    ss->stats.tx_multikey_single_shard_cnt += tx->GetUniqueShardCnt() == 1;
+  }
+
+  if (!tx->IsGlobal() && tx->GetUniqueShardCnt() == 1) {
+    bool local = shard_set->numa_node(tx->GetUniqueShard()) == ss->numa_node();
+    ++(local ? ss->stats.tx_numa_local_cnt : ss->stats.tx_numa_remote_cnt);
+  }
 }
 
 std::ostream& operator<<(std::ostream& os, Transaction::time_point tp) {
@@ -463,6 +492,7 @@ void Transaction::MultiSwitchCmd(const CommandId* cid) {
 
   cid_ = cid;
   cb_ptr_ = nullptr;
+  re_enabled_auto_journal_ = false;
 
   for (auto& sd : shard_data_) {
     sd.slice_count = sd.slice_start = 0;
@@ -553,7 +583,10 @@ bool Transaction::RunInShard(EngineShard* shard, bool txq_ooo) {
 
   /*************************************************************************/
 
+  uint64_t start_ns = latency_.enabled ? absl::GetCurrentTimeNanos() : 0;
   RunCallback(shard);
+  if (latency_.enabled)
+    sd.stats.exec_ns = min<uint64_t>(absl::GetCurrentTimeNanos() - start_ns, UINT32_MAX);
 
   /*************************************************************************/
   // at least the coordinator thread owns the reference.
@@ -628,6 +661,15 @@ void Transaction::RunCallback(EngineShard* shard) {
 
   RunnableResult result;
   shard->db_slice().LockChangeCb();
+  if (trace_)
+    trace_->RecordFirst(CommandTrace::EXEC_START, ProactorBase::GetMonotonicTimeNs());
+
+  const bool cpu_stats = shard->cmd_cpu_stats_enabled();
+  uint64_t cpu_start = 0, wall_start = 0;
+  if (cpu_stats) {
+    cpu_start = ThreadCpuNs();
+    wall_start = ProactorBase::GetMonotonicTimeNs();
+  }
   try {
     result = (*cb_ptr_)(this, shard);
 
@@ -652,6 +694,15 @@ void Transaction::RunCallback(EngineShard* shard) {
   }
 
   shard->db_slice().OnCbFinish();
+  if (trace_)
+    trace_->RecordLast(CommandTrace::EXEC_END, ProactorBase::GetMonotonicTimeNs());
+
+  if (cpu_stats) {
+    auto& stats = shard->cmd_cpu_stats()[cid_->name()];
+    stats.calls++;
+    stats.cpu_ns += ThreadCpuNs() - cpu_start;
+    stats.wall_ns += ProactorBase::GetMonotonicTimeNs() - wall_start;
+  }
 
   // Handle result flags to alter behaviour.
   if (result.flags & RunnableResult::AVOID_CONCLUDING) {
@@ -713,10 +764,21 @@ void Transaction::ScheduleInternal() {
     };
 
     run_barrier_.Start(unique_shard_cnt_);
+
+    // Unlocked single shard reads already skip the TxQueue: they run immediately in
+    // ScheduleInShard and, if the shard is owned by this thread, without any hop. Reading a
+    // remote shard directly from here is not possible: CheckLocks reads DbTable::trans_locks,
+    // which is only accessed by the owning thread, and the value itself may be moved by a
+    // concurrent segment split or bucket shift in that thread's PrimeTable. Both would require
+    // per-segment synchronization on the write path of every shard.
     if (CanRunInlined()) {
       // single shard schedule operation can't fail
       CHECK(ScheduleInShard(EngineShard::tlocal(), can_run_immediately));
       run_barrier_.Dec();
+    } else if (unique_shard_cnt_ == 1 && absl::GetFlag(FLAGS_tx_batch_schedule)) {
+      // Single shard schedules can't fail, so delaying them doesn't cause reordering.
+      shard_set->AddBatched(unique_shard_id_, cb);
+      run_barrier_.Wait();
     } else {
       IterateActiveShards([cb](const auto& sd, ShardId i) { shard_set->Add(i, cb); });
       run_barrier_.Wait();
@@ -724,8 +786,10 @@ void Transaction::ScheduleInternal() {
 
     if (schedule_fails.load(memory_order_relaxed) == 0) {
       coordinator_state_ |= COORD_SCHED;
+      if (trace_)
+        trace_->Record(CommandTrace::SCHEDULED, ProactorBase::GetMonotonicTimeNs());
 
-      RecordTxScheduleStats(this);
+      RecordTxScheduleStats(this, kv_fp_.size());
       break;
     }
 
@@ -831,15 +895,31 @@ void Transaction::Execute(RunnableType cb, bool conclude) {
   }
 
   if ((coordinator_state_ & COORD_SCHED) == 0) {
+    // Multi transactions switch commands, so they are not broken down by command.
+    latency_ = {.enabled = !multi_ && absl::GetFlag(FLAGS_tx_latency_stats)};
+    uint64_t start_ns = latency_.enabled ? absl::GetCurrentTimeNanos() : 0;
     ScheduleInternal();
+    if (latency_.enabled)
+      latency_.schedule_ns = absl::GetCurrentTimeNanos() - start_ns;
   }
 
+  uint64_t hop_start_ns = latency_.enabled ? absl::GetCurrentTimeNanos() : 0;
   DispatchHop();
   run_barrier_.Wait();
   cb_ptr_ = nullptr;
 
-  if (coordinator_state_ & COORD_CONCLUDING)
+  if (latency_.enabled)
+    RecordHopLatency(absl::GetCurrentTimeNanos() - hop_start_ns);
+
+  if (coordinator_state_ & COORD_CONCLUDING) {
     coordinator_state_ &= ~COORD_SCHED;
+    if (latency_.enabled) {
+      ServerState::tlocal()->RecordTxLatency(cid_->name(), latency_.schedule_ns / 1000,
+                                             latency_.wait_ns / 1000, latency_.exec_ns / 1000,
+                                             latency_.hops);
+      latency_.enabled = false;
+    }
+  }
 }
 
 // Runs in coordinator thread.
@@ -856,6 +936,7 @@ void Transaction::DispatchHop() {
   std::bitset<1024> poll_flags(0);
   unsigned run_cnt = 0;
   IterateActiveShards([&poll_flags, &run_cnt](auto& sd, auto i) {
+    sd.stats.exec_ns = 0;
     if ((sd.local_mask & RAN_IMMEDIATELY) == 0) {
       run_cnt++;
       poll_flags.set(i, true);
@@ -871,6 +952,8 @@ void Transaction::DispatchHop() {
 
   // Set armed flags on all active shards.
   std::atomic_thread_fence(memory_order_release);  // once fence to avoid flushing writes in loop
+  if (trace_)
+    trace_->RecordFirst(CommandTrace::ARMED, ProactorBase::GetMonotonicTimeNs());
   IterateActiveShards([&poll_flags](auto& sd, auto i) {
     if (poll_flags.test(i))
       sd.is_armed.store(true, memory_order_relaxed);
@@ -901,6 +984,18 @@ void Transaction::FinishHop() {
   run_barrier_.Dec();
 }
 
+void Transaction::RecordHopLatency(uint64_t hop_ns) {
+  // Shards run in parallel, so the hop waited for as long as its slowest shard didn't run.
+  uint64_t exec_ns = 0;
+  IterateActiveShards(
+      [&exec_ns](const auto& sd, auto i) { exec_ns = max<uint64_t>(exec_ns, sd.stats.exec_ns); });
+
+  exec_ns = min(exec_ns, hop_ns);
+  latency_.exec_ns += exec_ns;
+  latency_.wait_ns += hop_ns - exec_ns;
+  latency_.hops++;
+}
+
 void Transaction::Conclude() {
   if (!IsScheduled())
     return;
@@ -1018,6 +1113,37 @@ pair<uint16_t, bool> Transaction::DisarmInShardWhen(ShardId sid, uint16_t releva
   return {0, false};
 }
 
+bool Transaction::TryMarkOutOfOrder(EngineShard* shard) {
+  if (!absl::GetFlag(FLAGS_tx_optimistic_ooo) || IsGlobal() || IsMulti() || cid_->IsBlocking())
+    return false;
+
+  auto& sd = shard_data_[SidToId(shard->shard_id())];
+  if (!sd.is_armed.load(memory_order_acquire) || sd.pq_pos == TxQueue::kEnd)
+    return false;
+
+  const uint16_t kMask = KEYLOCK_ACQUIRED | OUT_OF_ORDER | SUSPENDED_Q | AWAKED_Q;
+  if ((sd.local_mask & kMask) != KEYLOCK_ACQUIRED)
+    return false;
+
+  // Conflicting transactions record their intents when they are scheduled, so if we hold the
+  // only intents on our keys, none of the queued transactions touches them. The ones scheduled
+  // later are ordered after us, just like for a transaction that was granted its locks when
+  // it was scheduled.
+  IntentLock::Mode mode = LockMode();
+  if (!shard->shard_lock()->Check(mode))
+    return false;
+
+  KeyLockArgs lock_args = GetLockArgs(shard->shard_id());
+  for (LockFp fp : lock_args.fps) {
+    if (!shard->db_slice().CheckHeldLock(mode, lock_args.db_index, fp))
+      return false;
+  }
+
+  sd.local_mask |= OUT_OF_ORDER;
+  DVLOG(2) << "Marked out of order " << DebugId();
+  return true;
+}
+
 bool Transaction::IsActive(ShardId sid) const {
   // If we have only one shard, we often don't store infromation about all shards, so determine it
   // solely by id
@@ -1167,7 +1293,8 @@ ShardArgs Transaction::GetShardArgs(ShardId sid) const {
 }
 
 OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_provider,
-                                  KeyReadyChecker krc, bool* block_flag, bool* pause_flag) {
+                                  KeyReadyChecker krc, bool* block_flag, bool* pause_flag,
+                                  bool consumes_key) {
   if (blocking_barrier_.IsClaimed()) {  // Might have been cancelled ahead by a dropping connection
     Conclude();
     return OpStatus::CANCELLED;
@@ -1178,7 +1305,7 @@ OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_p
   // Register keys on active shards blocking controllers and mark shard state as suspended.
   auto cb = [&](Transaction* t, EngineShard* shard) {
     auto keys = wkeys_provider(t, shard);
-    return t->WatchInShard(keys, shard, krc);
+    return t->WatchInShard(keys, shard, krc, consumes_key);
   };
   Execute(std::move(cb), true);
 
@@ -1217,14 +1344,14 @@ OpStatus Transaction::WaitOnWatch(const time_point& tp, WaitKeysProvider wkeys_p
 }
 
 OpStatus Transaction::WatchInShard(BlockingController::Keys keys, EngineShard* shard,
-                                   KeyReadyChecker krc) {
+                                   KeyReadyChecker krc, bool consumes_key) {
   auto& sd = shard_data_[SidToId(shard->shard_id())];
 
   CHECK_EQ(0, sd.local_mask & SUSPENDED_Q);
   sd.local_mask |= SUSPENDED_Q;
   sd.local_mask &= ~OUT_OF_ORDER;
 
-  shard->EnsureBlockingController()->AddWatched(keys, std::move(krc), this);
+  shard->EnsureBlockingController()->AddWatched(keys, std::move(krc), this, consumes_key);
   DVLOG(2) << "WatchInShard " << DebugId();
 
   return OpStatus::OK;
@@ -1515,8 +1642,8 @@ OpResult<KeyIndex> DetermineKeys(const CommandId* cid, CmdArgList args) {
       return OpStatus::SYNTAX_ERR;
     }
 
-    if (absl::EndsWith(name, "STORE"))
-      key_index.bonus = 0;  // Z<xxx>STORE <key> commands
+    if (absl::EndsWith(name, "STORE") || name == "CMS.MERGE" || name == "TDIGEST.MERGE")
+      key_index.bonus = 0;  // Z<xxx>STORE <key> and <type>.MERGE <key> commands
 
     unsigned num_keys_index;
     if (absl::StartsWith(name, "EVAL"))
@@ -1530,7 +1657,7 @@ OpResult<KeyIndex> DetermineKeys(const CommandId* cid, CmdArgList args) {
 
     if (num_custom_keys == 0 &&
         (absl::StartsWith(name, "ZDIFF") || absl::StartsWith(name, "ZUNION") ||
-         absl::StartsWith(name, "ZINTER"))) {
+         absl::StartsWith(name, "ZINTER") || name == "CMS.MERGE" || name == "TDIGEST.MERGE")) {
       return OpStatus::AT_LEAST_ONE_KEY;
     }
 
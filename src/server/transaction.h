@@ -19,6 +19,7 @@
 #include "core/tx_queue.h"
 #include "facade/op_status.h"
 #include "server/cluster/cluster_utility.h"
+#include "server/command_trace.h"
 #include "server/common.h"
 #include "server/journal/types.h"
 #include "server/table.h"
@@ -205,8 +206,10 @@ class Transaction {
   // or b) tp is reached. If tp is time_point::max() then waits indefinitely.
   // Expects that the transaction had been scheduled before, and uses Execute(.., true) to register.
   // Returns false if timeout occurred, true if was notified by one of the keys.
+  // consumes_key must be false only for commands that do not change the watched keys when awakened
+  // (XREAD), it allows notifying all of them at once instead of one after another.
   facade::OpStatus WaitOnWatch(const time_point& tp, WaitKeysProvider cb, KeyReadyChecker krc,
-                               bool* block_flag, bool* pause_flag);
+                               bool* block_flag, bool* pause_flag, bool consumes_key = true);
 
   // Returns true if transaction is awaked, false if it's timed-out and can be removed from the
   // blocking queue.
@@ -257,6 +260,11 @@ class Transaction {
   // If the transaction is armed, returns the local mask and a flag whether it was disarmed.
   std::pair<uint16_t, bool /* disarmed */> DisarmInShardWhen(ShardId sid, uint16_t req_flags);
 
+  // Marks an armed transaction that waits in the tx queue as OUT_OF_ORDER if no other
+  // transaction holds conflicting intents on its keys anymore, i.e. the ones it was queued behind
+  // have finished. Returns true if the transaction was marked. Runs in the shard thread.
+  bool TryMarkOutOfOrder(EngineShard* shard);
+
   // Returns if the transaction spans this shard. Safe only when the transaction is armed.
   bool IsActive(ShardId sid) const;
 
@@ -371,6 +379,12 @@ class Transaction {
     }
   }
 
+  // Records the stages of the command into trace if it's set, see CommandTrace.
+  // The trace must outlive the command.
+  void SetTrace(CommandTrace* trace) {
+    trace_ = trace;
+  }
+
   // Remove once BZPOP is stabilized
   std::string DEBUGV18_BlockInfo() {
     return "claimed=" + std::to_string(blocking_barrier_.IsClaimed()) +
@@ -421,6 +435,7 @@ class Transaction {
     // Irrational stats purely for debugging purposes.
     struct Stats {
       unsigned total_runs = 0;  // total number of runs
+      uint32_t exec_ns = 0;     // run time of the last hop, set with --tx_latency_stats
     } stats;
 
     // Prevent "false sharing" between cache lines: occupy a full cache line (64 bytes)
@@ -522,12 +537,15 @@ class Transaction {
   // Finish hop, decrement run barrier
   void FinishHop();
 
+  // Accounts a finished hop that took hop_ns in latency_. Runs in the coordinator thread.
+  void RecordHopLatency(uint64_t hop_ns);
+
   // Run actual callback on shard, store result if single shard or OOM was catched
   void RunCallback(EngineShard* shard);
 
   // Adds itself to watched queue in the shard. Must run in that shard thread.
   OpStatus WatchInShard(std::variant<ShardArgs, ArgSlice> keys, EngineShard* shard,
-                        KeyReadyChecker krc);
+                        KeyReadyChecker krc, bool consumes_key);
 
   // Expire blocking transaction, unlock keys and unregister it from the blocking controller
   void ExpireBlocking(WaitKeysProvider wcb);
@@ -648,6 +666,17 @@ class Transaction {
     ShardId coordinator_index = 0;
   } stats_;
 
+  // Latency breakdown of the current command, reported once it concludes.
+  struct LatencyStats {
+    bool enabled = false;
+    uint32_t hops = 0;
+    uint64_t schedule_ns = 0;
+    uint64_t wait_ns = 0;
+    uint64_t exec_ns = 0;
+  } latency_;
+
+  CommandTrace* trace_ = nullptr;
+
   std::function<void(Transaction* trans)> tracking_cb_;
 
  private:
@@ -0,0 +1,295 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/ts_family.h"
+
+#include <absl/strings/numbers.h>
+
+#include "core/time_series.h"
+#include "facade/cmd_arg_parser.h"
+#include "facade/error.h"
+#include "server/command_registry.h"
+#include "server/conn_context.h"
+#include "server/engine_shard_set.h"
+#include "server/transaction.h"
+
+namespace dfly {
+
+using namespace facade;
+using namespace std;
+
+namespace {
+
+constexpr uint32_t kMinChunkBytes = 48;
+constexpr uint32_t kMaxChunkBytes = 1 << 20;
+
+using Samples = vector<TimeSeries::Sample>;
+
+struct RangeParams {
+  int64_t from, to;
+  optional<TsAggregation> agg;
+  int64_t bucket_ms = 0;
+};
+
+struct InfoResult {
+  size_t total_samples, memory_usage, chunk_count;
+  int64_t first_ts, last_ts;
+  uint32_t chunk_bytes;
+};
+
+void SendStatus(OpStatus status, ConnectionContext* cntx) {
+  switch (status) {
+    case OpStatus::KEY_EXISTS:
+      return cntx->SendError("TSDB: key already exists");
+    case OpStatus::KEY_NOTFOUND:
+      return cntx->SendError("TSDB: the key does not exist");
+    case OpStatus::INVALID_VALUE:
+      return cntx->SendError("TSDB: timestamp must be newer than the last sample");
+    default:
+      return cntx->SendError(status);
+  }
+}
+
+// Parses a non negative timestamp, "-" and "+" stand for the smallest and the largest ones.
+bool ParseTimestamp(string_view str, int64_t* ts) {
+  if (str == "-") {
+    *ts = 0;
+    return true;
+  }
+  if (str == "+") {
+    *ts = INT64_MAX;
+    return true;
+  }
+  return absl::SimpleAtoi(str, ts) && *ts >= 0;
+}
+
+OpStatus OpCreate(const OpArgs& op_args, string_view key, uint32_t chunk_bytes) {
+  auto& db_slice = op_args.shard->db_slice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+  if (!op_res->is_new)
+    return OpStatus::KEY_EXISTS;
+
+  op_res->it->second.SetTimeSeries(
+      CompactObj::AllocateMR<TimeSeries>(CompactObj::memory_resource(), chunk_bytes));
+  return OpStatus::OK;
+}
+
+// Appends a sample, ts is nullopt for the current time. Returns the timestamp of the sample.
+OpResult<int64_t> OpAdd(const OpArgs& op_args, string_view key, optional<int64_t> ts,
+                        double val) {
+  auto& db_slice = op_args.shard->db_slice();
+  OpResult op_res = db_slice.AddOrFind(op_args.db_cntx, key);
+  if (!op_res)
+    return op_res.status();
+
+  PrimeValue& pv = op_res->it->second;
+  if (op_res->is_new) {
+    pv.SetTimeSeries(CompactObj::AllocateMR<TimeSeries>(CompactObj::memory_resource()));
+  } else if (pv.ObjType() != OBJ_TS) {
+    return OpStatus::WRONG_TYPE;
+  }
+
+  int64_t sample_ts = ts.value_or(op_args.db_cntx.time_now_ms);
+  if (!pv.GetTimeSeries()->Add(sample_ts, val))
+    return OpStatus::INVALID_VALUE;
+  return sample_ts;
+}
+
+OpResult<const TimeSeries*> FindSeries(const OpArgs& op_args, string_view key) {
+  auto op_res = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_TS);
+  if (!op_res)
+    return op_res.status();
+  return (*op_res)->second.GetTimeSeries();
+}
+
+OpResult<optional<TimeSeries::Sample>> OpGet(const OpArgs& op_args, string_view key) {
+  auto ts = FindSeries(op_args, key);
+  if (!ts)
+    return ts.status();
+  return (*ts)->Last();
+}
+
+OpResult<Samples> OpRange(const OpArgs& op_args, string_view key, const RangeParams& params) {
+  auto ts = FindSeries(op_args, key);
+  if (!ts)
+    return ts.status();
+
+  Samples result;
+  auto cb = [&](TimeSeries::Sample s) { result.push_back(s); };
+  if (params.agg)
+    (*ts)->Aggregate(params.from, params.to, *params.agg, params.bucket_ms, cb);
+  else
+    (*ts)->Range(params.from, params.to, cb);
+  return result;
+}
+
+OpResult<InfoResult> OpInfo(const OpArgs& op_args, string_view key) {
+  auto ts = FindSeries(op_args, key);
+  if (!ts)
+    return ts.status();
+
+  const TimeSeries* series = *ts;
+  auto last = series->Last();
+  return InfoResult{series->size(),     series->MallocUsed(), series->num_chunks(),
+                    series->first_ts(), last ? last->ts : 0,  series->chunk_bytes()};
+}
+
+void SendSample(const TimeSeries::Sample& s, RedisReplyBuilder* rb) {
+  rb->StartArray(2);
+  rb->SendLong(s.ts);
+  rb->SendDouble(s.val);
+}
+
+}  // namespace
+
+// TS.CREATE key [CHUNK_SIZE size]
+void TsFamily::Create(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  uint32_t chunk_bytes = TimeSeries::kDefaultChunkBytes;
+
+  if (parser.Check("CHUNK_SIZE").IgnoreCase().ExpectTail(1))
+    chunk_bytes = parser.Next<uint32_t>();
+
+  bool trailing = parser.HasNext();
+  if (parser.Error() || trailing)
+    return cntx->SendError(kSyntaxErr);
+  if (chunk_bytes < kMinChunkBytes || chunk_bytes > kMaxChunkBytes)
+    return cntx->SendError("TSDB: CHUNK_SIZE value must be between 48 and 1048576");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpCreate(t->GetOpArgs(shard), key, chunk_bytes);
+  };
+
+  OpStatus res = cntx->transaction->ScheduleSingleHop(std::move(cb));
+  if (res == OpStatus::OK)
+    return cntx->SendOk();
+  SendStatus(res, cntx);
+}
+
+// TS.ADD key timestamp|* value
+void TsFamily::Add(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+  string_view ts_str = ArgS(args, 1);
+
+  optional<int64_t> ts;
+  if (ts_str != "*") {
+    int64_t val;
+    if (!absl::SimpleAtoi(ts_str, &val) || val < 0)
+      return cntx->SendError("TSDB: invalid timestamp");
+    ts = val;
+  }
+
+  double val;
+  if (!absl::SimpleAtod(ArgS(args, 2), &val))
+    return cntx->SendError("TSDB: invalid value");
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpAdd(t->GetOpArgs(shard), key, ts, val);
+  };
+
+  OpResult<int64_t> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+  cntx->SendLong(*res);
+}
+
+void TsFamily::Get(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpGet(t->GetOpArgs(shard), key);
+  };
+
+  auto res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  if (!*res)
+    return rb->SendEmptyArray();
+  SendSample(**res, rb);
+}
+
+// TS.RANGE key fromTimestamp toTimestamp [AGGREGATION aggregator bucketDuration]
+void TsFamily::Range(CmdArgList args, ConnectionContext* cntx) {
+  CmdArgParser parser(args);
+  string_view key = parser.Next();
+  RangeParams params;
+  if (!ParseTimestamp(parser.Next(), &params.from) || !ParseTimestamp(parser.Next(), &params.to))
+    return cntx->SendError("TSDB: invalid timestamp");
+
+  if (parser.Check("AGGREGATION").IgnoreCase().ExpectTail(2)) {
+    params.agg = parser.ToUpper().Switch("AVG", TsAggregation::AVG, "MIN", TsAggregation::MIN,
+                                         "MAX", TsAggregation::MAX, "SUM", TsAggregation::SUM,
+                                         "COUNT", TsAggregation::COUNT);
+    params.bucket_ms = parser.Next<int64_t>();
+    if (!parser.HasError() && params.bucket_ms <= 0)
+      return cntx->SendError("TSDB: bucketDuration must be greater than zero");
+  }
+
+  bool trailing = parser.HasNext();
+  if (parser.Error() || trailing)
+    return cntx->SendError(kSyntaxErr);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpRange(t->GetOpArgs(shard), key, params);
+  };
+
+  OpResult<Samples> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(res->size());
+  for (const auto& sample : *res)
+    SendSample(sample, rb);
+}
+
+void TsFamily::Info(CmdArgList args, ConnectionContext* cntx) {
+  string_view key = ArgS(args, 0);
+
+  const auto cb = [&](Transaction* t, EngineShard* shard) {
+    return OpInfo(t->GetOpArgs(shard), key);
+  };
+
+  OpResult<InfoResult> res = cntx->transaction->ScheduleSingleHopT(std::move(cb));
+  if (!res)
+    return SendStatus(res.status(), cntx);
+
+  RedisReplyBuilder* rb = (RedisReplyBuilder*)cntx->reply_builder();
+  rb->StartArray(12);
+  rb->SendBulkString("totalSamples");
+  rb->SendLong(res->total_samples);
+  rb->SendBulkString("memoryUsage");
+  rb->SendLong(res->memory_usage);
+  rb->SendBulkString("firstTimestamp");
+  rb->SendLong(res->first_ts);
+  rb->SendBulkString("lastTimestamp");
+  rb->SendLong(res->last_ts);
+  rb->SendBulkString("chunkCount");
+  rb->SendLong(res->chunk_count);
+  rb->SendBulkString("chunkSize");
+  rb->SendLong(res->chunk_bytes);
+}
+
+using CI = CommandId;
+
+#define HFUNC(x) SetHandler(&TsFamily::x)
+
+void TsFamily::Register(CommandRegistry* registry) {
+  registry->StartFamily();
+
+  *registry
+      << CI{"TS.CREATE", CO::WRITE | CO::DENYOOM | CO::FAST, -2, 1, 1, acl::TIMESERIES}.HFUNC(
+             Create)
+      << CI{"TS.ADD", CO::WRITE | CO::DENYOOM | CO::FAST, 4, 1, 1, acl::TIMESERIES}.HFUNC(Add)
+      << CI{"TS.GET", CO::READONLY | CO::FAST, 2, 1, 1, acl::TIMESERIES}.HFUNC(Get)
+      << CI{"TS.RANGE", CO::READONLY, -4, 1, 1, acl::TIMESERIES}.HFUNC(Range)
+      << CI{"TS.INFO", CO::READONLY | CO::FAST, 2, 1, 1, acl::TIMESERIES}.HFUNC(Info);
+};
+
+}  // namespace dfly
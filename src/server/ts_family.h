@@ -0,0 +1,27 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include "server/common.h"
+
+namespace dfly {
+
+class CommandRegistry;
+class ConnectionContext;
+
+// Time series commands, a subset of the TS commands of RedisTimeSeries.
+class TsFamily {
+ public:
+  static void Register(CommandRegistry* registry);
+
+ private:
+  static void Create(CmdArgList args, ConnectionContext* cntx);
+  static void Add(CmdArgList args, ConnectionContext* cntx);
+  static void Get(CmdArgList args, ConnectionContext* cntx);
+  static void Range(CmdArgList args, ConnectionContext* cntx);
+  static void Info(CmdArgList args, ConnectionContext* cntx);
+};
+
+}  // namespace dfly
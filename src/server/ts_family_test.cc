@@ -0,0 +1,81 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/ts_family.h"
+
+#include "facade/facade_test.h"
+#include "server/test_utils.h"
+
+namespace dfly {
+
+using namespace std;
+using testing::ElementsAre;
+
+class TsFamilyTest : public BaseFamilyTest {
+ protected:
+};
+
+TEST_F(TsFamilyTest, Basic) {
+  EXPECT_EQ(Run({"ts.create", "ts1"}), "OK");
+  EXPECT_THAT(Run({"ts.create", "ts1"}), ErrArg("key already exists"));
+  EXPECT_EQ(Run({"type", "ts1"}), "TSDB-TYPE");
+  EXPECT_THAT(Run({"ts.get", "ts1"}), ArrLen(0));
+
+  EXPECT_THAT(Run({"ts.add", "ts1", "100", "1.5"}), IntArg(100));
+  EXPECT_THAT(Run({"ts.add", "ts1", "200", "2.5"}), IntArg(200));
+  EXPECT_THAT(Run({"ts.add", "ts1", "200", "3"}), ErrArg("newer than the last sample"));
+  EXPECT_THAT(Run({"ts.get", "ts1"}), RespArray(ElementsAre(IntArg(200), DoubleArg(2.5))));
+
+  // TS.ADD creates the series.
+  EXPECT_THAT(Run({"ts.add", "ts2", "5", "1"}), IntArg(5));
+  EXPECT_EQ(Run({"type", "ts2"}), "TSDB-TYPE");
+
+  auto resp = Run({"ts.info", "ts1"});
+  ASSERT_THAT(resp, ArrLen(12));
+  const auto& vec = resp.GetVec();
+  EXPECT_EQ(vec[0], "totalSamples");
+  EXPECT_THAT(vec[1], IntArg(2));
+  EXPECT_THAT(vec[5], IntArg(100));
+  EXPECT_THAT(vec[7], IntArg(200));
+  EXPECT_THAT(vec[9], IntArg(1));
+  EXPECT_THAT(vec[11], IntArg(4096));
+}
+
+TEST_F(TsFamilyTest, Range) {
+  for (unsigned i = 0; i < 100; ++i)
+    Run({"ts.add", "ts", absl::StrCat(i * 10), absl::StrCat(i)});
+
+  auto resp = Run({"ts.range", "ts", "15", "40"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(RespArray(ElementsAre(IntArg(20), DoubleArg(2))),
+                                          RespArray(ElementsAre(IntArg(30), DoubleArg(3))),
+                                          RespArray(ElementsAre(IntArg(40), DoubleArg(4))))));
+  EXPECT_THAT(Run({"ts.range", "ts", "-", "+"}), ArrLen(100));
+  EXPECT_THAT(Run({"ts.range", "ts", "2000", "+"}), ArrLen(0));
+
+  resp = Run({"ts.range", "ts", "-", "+", "AGGREGATION", "avg", "500"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(RespArray(ElementsAre(IntArg(0), DoubleArg(24.5))),
+                                          RespArray(ElementsAre(IntArg(500), DoubleArg(74.5))))));
+  resp = Run({"ts.range", "ts", "100", "+", "AGGREGATION", "count", "1000"});
+  EXPECT_THAT(resp, RespArray(ElementsAre(IntArg(0), DoubleArg(90))));
+}
+
+TEST_F(TsFamilyTest, Errors) {
+  EXPECT_THAT(Run({"ts.get", "ts"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"ts.range", "ts", "-", "+"}), ErrArg("key does not exist"));
+  EXPECT_THAT(Run({"ts.create", "ts", "CHUNK_SIZE", "10"}), ErrArg("CHUNK_SIZE"));
+  EXPECT_THAT(Run({"ts.create", "ts", "FOO"}), ErrArg("syntax error"));
+  EXPECT_THAT(Run({"ts.add", "ts", "-1", "1"}), ErrArg("invalid timestamp"));
+  EXPECT_THAT(Run({"ts.add", "ts", "1", "x"}), ErrArg("invalid value"));
+
+  Run({"ts.add", "ts", "1", "1"});
+  EXPECT_THAT(Run({"ts.range", "ts", "-", "+", "AGGREGATION", "avg", "0"}),
+              ErrArg("bucketDuration"));
+  EXPECT_THAT(Run({"ts.range", "ts", "-", "+", "AGGREGATION", "foo", "10"}),
+              ErrArg("syntax error"));
+
+  Run({"set", "str", "foo"});
+  EXPECT_THAT(Run({"ts.add", "str", "1", "1"}), ErrArg("WRONGTYPE"));
+}
+
+}  // namespace dfly
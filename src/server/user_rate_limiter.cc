@@ -0,0 +1,72 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#include "server/user_rate_limiter.h"
+
+#include <absl/strings/numbers.h>
+#include <absl/strings/str_split.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base/flags.h"
+#include "base/logging.h"
+
+ABSL_FLAG(std::vector<std::string>, user_rate_limits, {},
+          "Comma separated list of user:ops_per_sec:bytes_per_sec limits for ACL users, "
+          "0 means no limit. Commands above the limit are delayed.");
+
+namespace dfly {
+
+using namespace std;
+
+UserRateLimiter::UserRateLimiter() {
+  for (const string& limit : absl::GetFlag(FLAGS_user_rate_limits)) {
+    if (limit.empty())
+      continue;
+
+    vector<string_view> parts = absl::StrSplit(limit, ':');
+    uint64_t ops = 0, bytes = 0;
+    if (parts.size() != 3 || parts[0].empty() || !absl::SimpleAtoi(parts[1], &ops) ||
+        !absl::SimpleAtoi(parts[2], &bytes)) {
+      LOG(ERROR) << "Invalid user_rate_limits value " << limit;
+      exit(1);
+    }
+
+    auto& entry = limits_[string(parts[0])];
+    if (entry) {
+      LOG(ERROR) << "User " << parts[0] << " appears twice in user_rate_limits";
+      exit(1);
+    }
+    entry = make_unique<Limit>();
+    entry->ops.unit_ns = ops ? 1e9 / ops : 0;
+    entry->bytes.unit_ns = bytes ? 1e9 / bytes : 0;
+  }
+}
+
+uint64_t UserRateLimiter::Rate::Acquire(uint64_t cost_ns, uint64_t now_ns) {
+  uint64_t spent = spent_until_ns.load(memory_order_relaxed);
+  uint64_t next;
+  do {
+    next = max(spent, now_ns) + cost_ns;
+  } while (!spent_until_ns.compare_exchange_weak(spent, next, memory_order_relaxed));
+
+  return next > now_ns + kBurstNs ? next - now_ns - kBurstNs : 0;
+}
+
+uint64_t UserRateLimiter::Acquire(string_view user, size_t bytes, uint64_t now_ns) {
+  auto it = limits_.find(user);
+  if (it == limits_.end())
+    return 0;
+
+  Limit& limit = *it->second;
+  uint64_t delay = 0;
+  if (limit.ops.unit_ns > 0)
+    delay = limit.ops.Acquire(limit.ops.unit_ns, now_ns);
+  if (limit.bytes.unit_ns > 0)
+    delay = max(delay, limit.bytes.Acquire(limit.bytes.unit_ns * bytes, now_ns));
+  return delay;
+}
+
+}  // namespace dfly
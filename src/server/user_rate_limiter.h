@@ -0,0 +1,55 @@
+// Copyright 2024, DragonflyDB authors.  All rights reserved.
+// See LICENSE for licensing terms.
+//
+
+#pragma once
+
+#include <absl/container/flat_hash_map.h>
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <string_view>
+
+namespace dfly {
+
+// Rate limits of ACL users, set with --user_rate_limits.
+//
+// A limited user has a budget of commands and request bytes per second, shared by all its
+// connections on all threads. Every budget is tracked with the generic cell rate algorithm:
+// a single atomic holds the time at which the budget is spent, and every command moves it
+// forward by its cost. A command that moves it too far into the future waits for the
+// difference, so a noisy user is slowed down while the thread serves other connections.
+class UserRateLimiter {
+ public:
+  // How far a user can run ahead of its rate.
+  static constexpr uint64_t kBurstNs = 100'000'000;
+
+  // Parses --user_rate_limits, exits on invalid values.
+  UserRateLimiter();
+
+  bool empty() const {
+    return limits_.empty();
+  }
+
+  // Accounts a command of the user with the given request size. Returns how long the command
+  // needs to wait, in nanoseconds, 0 if it can run right away or if the user is not limited.
+  uint64_t Acquire(std::string_view user, size_t bytes, uint64_t now_ns);
+
+ private:
+  struct Rate {
+    // Accounts cost_ns and returns the delay.
+    uint64_t Acquire(uint64_t cost_ns, uint64_t now_ns);
+
+    double unit_ns = 0;  // cost of one unit, 0 if not limited.
+    std::atomic_uint64_t spent_until_ns{0};
+  };
+
+  struct Limit {
+    Rate ops, bytes;
+  };
+
+  absl::flat_hash_map<std::string, std::unique_ptr<Limit>> limits_;
+};
+
+}  // namespace dfly
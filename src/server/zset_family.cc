@@ -17,6 +17,7 @@ extern "C" {
 #include "redis/zset.h"
 }
 
+#include "base/flags.h"
 #include "base/logging.h"
 #include "base/stl_util.h"
 #include "core/sorted_map.h"
@@ -30,6 +31,11 @@ extern "C" {
 #include "server/error.h"
 #include "server/transaction.h"
 
+ABSL_FLAG(uint32_t, zset_store_effects_limit, 4096,
+          "ZUNIONSTORE and ZINTERSTORE results of up to this many members are replicated as the "
+          "resulting writes, so that replicas don't repeat the computation. Larger results are "
+          "replicated as the command. 0 always replicates the command.");
+
 namespace dfly {
 
 using namespace std;
@@ -67,9 +73,12 @@ struct GeoPoint {
   double score;
   std::string member;
   GeoPoint() : longitude(0.0), latitude(0.0), dist(0.0), score(0.0){};
-  GeoPoint(double _longitude, double _latitude, double _dist, double _score,
-           const std::string& _member)
-      : longitude(_longitude), latitude(_latitude), dist(_dist), score(_score), member(_member){};
+  GeoPoint(double _longitude, double _latitude, double _dist, double _score, std::string _member)
+      : longitude(_longitude),
+        latitude(_latitude),
+        dist(_dist),
+        score(_score),
+        member(std::move(_member)){};
 };
 using GeoArray = std::vector<GeoPoint>;
 
@@ -137,7 +146,7 @@ int ZsetDel(detail::RobjWrapper* robj_wrapper, sds ele) {
   if (robj_wrapper->encoding() == OBJ_ENCODING_LISTPACK) {
     unsigned char* eptr;
     uint8_t* lp = (uint8_t*)robj_wrapper->inner_obj();
-    if ((eptr = zzlFind(lp, ele, NULL)) != NULL) {
+    if ((eptr = container_utils::LpFindField(lp, {ele, sdslen(ele)})) != NULL) {
       lp = lpDeleteRangeWithEntry(lp, &eptr, 2);
       robj_wrapper->set_inner_obj(lp);
       return 1;
@@ -153,10 +162,11 @@ int ZsetDel(detail::RobjWrapper* robj_wrapper, sds ele) {
 // taken from t_zset.c
 std::optional<double> GetZsetScore(const detail::RobjWrapper* robj_wrapper, sds member) {
   if (robj_wrapper->encoding() == OBJ_ENCODING_LISTPACK) {
-    double score;
-    if (zzlFind((uint8_t*)robj_wrapper->inner_obj(), member, &score) == NULL)
+    uint8_t* lp = (uint8_t*)robj_wrapper->inner_obj();
+    uint8_t* eptr = container_utils::LpFindField(lp, {member, sdslen(member)});
+    if (eptr == NULL)
       return std::nullopt;
-    return score;
+    return zzlGetScore(lpNext(lp, eptr));
   }
 
   if (robj_wrapper->encoding() == OBJ_ENCODING_SKIPLIST) {
@@ -748,25 +758,6 @@ double Aggregate(double v1, double v2, AggType atype) {
   return 0;
 }
 
-// the result is in the destination.
-void UnionScoredMap(ScoredMap* dest, ScoredMap* src, AggType agg_type) {
-  ScoredMap* target = dest;
-  ScoredMap* iter = src;
-
-  if (iter->size() > target->size())
-    swap(target, iter);
-
-  for (const auto& elem : *iter) {
-    auto [it, inserted] = target->emplace(elem);
-    if (!inserted) {
-      it->second = Aggregate(it->second, elem.second, agg_type);
-    }
-  }
-
-  if (target != dest)
-    dest->swap(*src);
-}
-
 void InterScoredMap(ScoredMap* dest, ScoredMap* src, AggType agg_type) {
   ScoredMap* target = dest;
   ScoredMap* iter = src;
@@ -792,20 +783,75 @@ void InterScoredMap(ScoredMap* dest, ScoredMap* src, AggType agg_type) {
 
 using KeyIterWeightVec = vector<pair<DbSlice::ConstIterator, double>>;
 
-ScoredMap UnionShardKeysWithScore(const KeyIterWeightVec& key_iter_weight_vec, AggType agg_type) {
-  ScoredMap result;
+// The members of the object with their weighted scores, sorted by member.
+ScoredArray SortedFromObject(const CompactObj& co, double weight) {
+  ZSetFamily::RangeParams params;
+  params.with_scores = true;
+  // RANGE is a read-only operation, but requires const_cast
+  IntervalVisitor vis(Action::RANGE, params, &const_cast<CompactObj&>(co));
+  vis(ZSetFamily::IndexInterval(0, -1));
+
+  ScoredArray arr = vis.PopResult();
+  for (auto& elem : arr)
+    elem.second *= weight;
+  sort(arr.begin(), arr.end(), [](const auto& l, const auto& r) { return l.first < r.first; });
+  return arr;
+}
+
+// Merges arrays that are sorted by member with a k-way merge. Calls cb(member, score) for every
+// distinct member in member order, with its scores aggregated over all the arrays. cb may move
+// the member out of its array.
+template <typename F>
+void MergeSortedByMember(absl::Span<ScoredArray> arrays, AggType agg_type, F&& cb) {
+  using Cursor = pair<ScoredMember*, ScoredMember*>;  // next and end of an array.
+  auto cmp = [](const Cursor& l, const Cursor& r) { return l.first->first > r.first->first; };
+
+  vector<Cursor> heap;
+  for (auto& arr : arrays) {
+    if (!arr.empty())
+      heap.emplace_back(arr.data(), arr.data() + arr.size());
+  }
+  make_heap(heap.begin(), heap.end(), cmp);
+
+  // Pops the smallest member and advances its array.
+  auto pop = [&] {
+    pop_heap(heap.begin(), heap.end(), cmp);
+    ScoredMember* res = heap.back().first++;
+    if (heap.back().first == heap.back().second)
+      heap.pop_back();
+    else
+      push_heap(heap.begin(), heap.end(), cmp);
+    return res;
+  };
+
+  while (!heap.empty()) {
+    ScoredMember* member = pop();
+    double score = member->second;
+    while (!heap.empty() && heap.front().first->first == member->first)
+      score = Aggregate(score, pop()->second, agg_type);
+    cb(*member, score);
+  }
+}
+
+// Pre-aggregates the union of the keys of a shard, so that only distinct members are passed to
+// the coordinator. The result is sorted by member.
+ScoredArray UnionShardKeysWithScore(const KeyIterWeightVec& key_iter_weight_vec, AggType agg_type) {
+  vector<ScoredArray> arrays;
   for (const auto& key_iter_weight : key_iter_weight_vec) {
     if (key_iter_weight.first.is_done()) {
       continue;
     }
-
-    ScoredMap sm = FromObject(key_iter_weight.first->second, key_iter_weight.second);
-    if (result.empty()) {
-      result.swap(sm);
-    } else {
-      UnionScoredMap(&result, &sm, agg_type);
-    }
+    arrays.push_back(SortedFromObject(key_iter_weight.first->second, key_iter_weight.second));
   }
+
+  if (arrays.size() <= 1)
+    return arrays.empty() ? ScoredArray{} : std::move(arrays.front());
+
+  ScoredArray result;
+  MergeSortedByMember(absl::MakeSpan(arrays), agg_type, [&result](ScoredMember& member,
+                                                                    double score) {
+    result.emplace_back(std::move(member.first), score);
+  });
   return result;
 }
 
@@ -820,8 +866,8 @@ double GetKeyWeight(Transaction* t, ShardId shard_id, const vector<double>& weig
   return weights[windex];
 }
 
-OpResult<ScoredMap> OpUnion(EngineShard* shard, Transaction* t, string_view dest, AggType agg_type,
-                            const vector<double>& weights, bool store) {
+OpResult<ScoredArray> OpUnion(EngineShard* shard, Transaction* t, string_view dest,
+                              AggType agg_type, const vector<double>& weights, bool store) {
   ShardArgs keys = t->GetShardArgs(shard->shard_id());
   DCHECK(!keys.Empty());
 
@@ -953,6 +999,35 @@ struct AddResult {
   bool is_nan = false;
 };
 
+// Decides how a store command is journaled: computing the result on a replica costs as much as
+// on the master, while writing it costs about its size. Small results are journaled by the
+// store hop with RecordStoreEffects, large ones as the command itself.
+bool JournalStoreEffects(size_t result_size, Transaction* tx) {
+  if (result_size <= absl::GetFlag(FLAGS_zset_store_effects_limit))
+    return true;
+  tx->ReviveAutoJournal();
+  return false;
+}
+
+void RecordStoreEffects(const OpArgs& op_args, string_view dest_key, ScoredMemberSpan members) {
+  RecordJournal(op_args, "DEL"sv, ArgSlice{dest_key});
+  if (members.empty())
+    return;
+
+  vector<string> scores(members.size());
+  vector<string_view> args;
+  args.reserve(1 + members.size() * 2);
+  args.push_back(dest_key);
+
+  char buf[32];
+  for (size_t i = 0; i < members.size(); ++i) {
+    scores[i] = RedisReplyBuilder::FormatDouble(members[i].first, buf, sizeof(buf));
+    args.push_back(scores[i]);
+    args.push_back(members[i].second);
+  }
+  RecordJournal(op_args, "ZADD"sv, args);
+}
+
 size_t EstimateListpackMinBytes(ScoredMemberSpan members) {
   size_t bytes = members.size() * 2;  // at least 2 bytes per score;
   for (const auto& member : members) {
@@ -1010,6 +1085,15 @@ OpResult<AddResult> OpAdd(const OpArgs& op_args, const ZParams& zparams, string_
     }
   }
 
+  // A new sorted map without special flags can be built in bulk.
+  if (!is_list_pack && zparams.flags == 0 && !zparams.ch) {
+    detail::SortedMap* sm = (detail::SortedMap*)robj_wrapper->inner_obj();
+    if (sm->Size() == 0) {
+      aresult.num_updated = sm->InsertBulk(members);
+      return aresult;
+    }
+  }
+
   for (size_t j = 0; j < members.size(); j++) {
     const auto& m = members[j];
     tmp_str = sdscpylen(tmp_str, m.second.data(), m.second.size());
@@ -1204,12 +1288,13 @@ void ZUnionFamilyInternal(CmdArgList args, bool store, ConnectionContext* cntx)
     return SendAtLeastOneKeyError(cntx);
   }
 
-  vector<OpResult<ScoredMap>> maps(shard_set->size());
+  vector<OpResult<ScoredArray>> arrays(shard_set->size());
 
   string_view dest_key = ArgS(args, 0);
 
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    maps[shard->shard_id()] = OpUnion(shard, t, dest_key, op_args.agg_type, op_args.weights, store);
+    arrays[shard->shard_id()] =
+        OpUnion(shard, t, dest_key, op_args.agg_type, op_args.weights, store);
     return OpStatus::OK;
   };
 
@@ -1217,26 +1302,35 @@ void ZUnionFamilyInternal(CmdArgList args, bool store, ConnectionContext* cntx)
   // the last transaction hop (e.g. ZUNION)
   cntx->transaction->Execute(std::move(cb), !store);
 
-  ScoredMap result;
-  for (auto& op_res : maps) {
+  size_t total_size = 0;
+  vector<ScoredArray> shard_arrays;
+  for (auto& op_res : arrays) {
     if (!op_res)
       return cntx->SendError(op_res.status());
-    UnionScoredMap(&result, &op_res.value(), op_args.agg_type);
+    total_size += op_res->size();
+    shard_arrays.push_back(std::move(op_res.value()));
   }
 
+  // The shard results are sorted by member and are merged without copying the members.
   vector<ScoredMemberView> smvec;
-  for (const auto& elem : result) {
-    smvec.emplace_back(elem.second, elem.first);
-  }
+  smvec.reserve(total_size);
+  MergeSortedByMember(absl::MakeSpan(shard_arrays), op_args.agg_type,
+                      [&smvec](ScoredMember& member, double score) {
+                        smvec.emplace_back(score, member.first);
+                      });
 
   if (store) {
-    ShardId dest_shard = Shard(dest_key, maps.size());
+    ShardId dest_shard = Shard(dest_key, arrays.size());
+    bool journal_effects = JournalStoreEffects(smvec.size(), cntx->transaction);
     AddResult add_result;
     auto store_cb = [&](Transaction* t, EngineShard* shard) {
       if (shard->shard_id() == dest_shard) {
         ZParams zparams;
         zparams.override = true;
-        add_result = OpAdd(t->GetOpArgs(shard), zparams, dest_key, ScoredMemberSpan{smvec}).value();
+        OpArgs op_args = t->GetOpArgs(shard);
+        add_result = OpAdd(op_args, zparams, dest_key, ScoredMemberSpan{smvec}).value();
+        if (journal_effects && shard->journal())
+          RecordStoreEffects(op_args, dest_key, ScoredMemberSpan{smvec});
       }
       return OpStatus::OK;
     };
@@ -1426,24 +1520,6 @@ auto OpRange(const ZSetFamily::ZRangeSpec& range_spec, const OpArgs& op_args, st
   return iv.PopResult();
 }
 
-auto OpRanges(const std::vector<ZSetFamily::ZRangeSpec>& range_specs, const OpArgs& op_args,
-              string_view key) -> OpResult<vector<ScoredArray>> {
-  auto res_it = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
-  if (!res_it)
-    return res_it.status();
-
-  // Action::RANGE is read-only, but requires mutable pointer, thus const_cast
-  PrimeValue& pv = const_cast<PrimeValue&>(res_it.value()->second);
-  vector<ScoredArray> result_arrays;
-  for (auto& range_spec : range_specs) {
-    IntervalVisitor iv{Action::RANGE, range_spec.params, &pv};
-    std::visit(iv, range_spec.interval);
-    result_arrays.push_back(iv.PopResult());
-  }
-
-  return result_arrays;
-}
-
 OpResult<unsigned> OpRemRange(const OpArgs& op_args, string_view key,
                               const ZSetFamily::ZRangeSpec& range_spec) {
   auto& db_slice = op_args.shard->db_slice();
@@ -2091,11 +2167,15 @@ void ZSetFamily::ZInterStore(CmdArgList args, ConnectionContext* cntx) {
     smvec.emplace_back(elem.second, elem.first);
   }
 
+  bool journal_effects = JournalStoreEffects(smvec.size(), cntx->transaction);
   auto store_cb = [&](Transaction* t, EngineShard* shard) {
     if (shard->shard_id() == dest_shard) {
       ZParams zparams;
       zparams.override = true;
-      add_result = OpAdd(t->GetOpArgs(shard), zparams, dest_key, ScoredMemberSpan{smvec}).value();
+      OpArgs op_args = t->GetOpArgs(shard);
+      add_result = OpAdd(op_args, zparams, dest_key, ScoredMemberSpan{smvec}).value();
+      if (journal_effects && shard->journal())
+        RecordStoreEffects(op_args, dest_key, ScoredMemberSpan{smvec});
     }
     return OpStatus::OK;
   };
@@ -2829,6 +2909,96 @@ std::vector<ZSetFamily::ZRangeSpec> GetGeoRangeSpec(const GeoHashRadius& n) {
   return range_specs;
 }
 
+// Same as geoWithinShape(), but computes the trigonometry of the center once and rejects the
+// points that are too far north or south before computing their haversine distance.
+class GeoShapeFilter {
+ public:
+  explicit GeoShapeFilter(const GeoShape& shape)
+      : shape_(shape),
+        lon_r_(DegToRad(shape.xy[0])),
+        lat_r_(DegToRad(shape.xy[1])),
+        cos_lat_(cos(lat_r_)) {
+  }
+
+  // Returns true if the point encoded by score is within the shape, decodes it into xy and
+  // computes its distance from the center.
+  bool Matches(double score, double* xy, double* dist) const {
+    GeoHashBits hash = {.bits = (uint64_t)score, .step = GEO_STEP_MAX};
+    if (!geohashDecodeToLongLatWGS84(hash, xy))
+      return false;
+
+    // The great circle distance is never shorter than the distance along the meridian.
+    double lat_dist = kEarthRadiusMeters * fabs(DegToRad(xy[1]) - lat_r_);
+    if (shape_.type == CIRCULAR_TYPE) {
+      double radius = shape_.t.radius * shape_.conversion;
+      if (lat_dist > radius)
+        return false;
+      *dist = Distance(xy, lat_dist);
+      return *dist <= radius;
+    }
+
+    DCHECK_EQ(shape_.type, RECTANGLE_TYPE);
+    if (lat_dist > shape_.t.r.height * shape_.conversion / 2)
+      return false;
+    if (geohashGetDistance(xy[0], xy[1], shape_.xy[0], xy[1]) >
+        shape_.t.r.width * shape_.conversion / 2)
+      return false;
+    *dist = Distance(xy, lat_dist);
+    return true;
+  }
+
+ private:
+  // Earth's quadratic mean radius for WGS-84, as in geohash_helper.c.
+  static constexpr double kEarthRadiusMeters = 6372797.560856;
+
+  static double DegToRad(double deg) {
+    return deg * (M_PI / 180.0);
+  }
+
+  // geohashGetDistance() from the center.
+  double Distance(const double* xy, double lat_dist) const {
+    double v = sin((DegToRad(xy[0]) - lon_r_) / 2);
+    if (v == 0.0)
+      return lat_dist;
+    double lat_r = DegToRad(xy[1]);
+    double u = sin((lat_r - lat_r_) / 2);
+    double a = u * u + cos_lat_ * cos(lat_r) * v * v;
+    return 2.0 * kEarthRadiusMeters * asin(sqrt(a));
+  }
+
+  const GeoShape& shape_;
+  double lon_r_, lat_r_, cos_lat_;
+};
+
+// Fetches the members of the boxes and keeps the ones within the shape. With ANY it stops
+// fetching the boxes once it has found limit members.
+OpResult<GeoArray> OpGeoRanges(const vector<ZSetFamily::ZRangeSpec>& range_specs,
+                               const GeoShape& shape, unsigned long limit, const OpArgs& op_args,
+                               string_view key) {
+  auto res_it = op_args.shard->db_slice().FindReadOnly(op_args.db_cntx, key, OBJ_ZSET);
+  if (!res_it)
+    return res_it.status();
+
+  // Action::RANGE is read-only, but requires mutable pointer, thus const_cast
+  PrimeValue& pv = const_cast<PrimeValue&>(res_it.value()->second);
+  GeoShapeFilter filter(shape);
+  GeoArray ga;
+  double xy[2];
+  double distance;
+  for (auto& range_spec : range_specs) {
+    IntervalVisitor iv{Action::RANGE, range_spec.params, &pv};
+    std::visit(iv, range_spec.interval);
+    for (auto& [member, score] : iv.PopResult()) {
+      if (filter.Matches(score, xy, &distance)) {
+        ga.emplace_back(xy[0], xy[1], distance, score, std::move(member));
+        if (limit > 0 && ga.size() >= limit)
+          return ga;
+      }
+    }
+  }
+  return ga;
+}
+
 void SortIfNeeded(GeoArray* ga, Sorting sorting, uint64_t count) {
   if (sorting == Sorting::kUnsorted)
     return;
@@ -2912,33 +3082,18 @@ void GeoSearchStoreGeneric(ConnectionContext* cntx, const GeoShape& shape_ref, s
   GeoHashRadius georadius = geohashCalculateAreasByShapeWGS84(shape);
   GeoArray ga;
   auto range_specs = GetGeoRangeSpec(georadius);
-  // get all the matching members and add them to the potential result list
-  vector<OpResult<vector<ScoredArray>>> result_arrays;
+  // get the members within the shape, filtered on the shard of the key
+  unsigned long limit = geo_ops.any ? geo_ops.count : 0;
   auto cb = [&](Transaction* t, EngineShard* shard) {
-    auto res_it = OpRanges(range_specs, t->GetOpArgs(shard), key);
-    if (res_it) {
-      result_arrays.emplace_back(res_it);
+    if (shard->shard_id() == from_shard) {
+      auto res = OpGeoRanges(range_specs, *shape, limit, t->GetOpArgs(shard), key);
+      if (res)
+        ga = std::move(*res);
     }
     return OpStatus::OK;
   };
   cntx->transaction->Execute(std::move(cb), geo_ops.store == GeoStoreType::kNoStore);
 
-  // filter potential result list
-  double xy[2];
-  double distance;
-  unsigned long limit = geo_ops.any ? geo_ops.count : 0;
-  for (auto& result_array : result_arrays) {
-    for (auto& arr : *result_array) {
-      for (auto& p : arr) {
-        if (geoWithinShape(shape, p.second, xy, &distance) == 0) {
-          ga.emplace_back(xy[0], xy[1], distance, p.second, p.first);
-          if (limit > 0 && ga.size() >= limit)
-            break;
-        }
-      }
-    }
-  }
-
   // sort and trim by count
   SortIfNeeded(&ga, geo_ops.sorting, geo_ops.count);
 
@@ -3275,6 +3430,7 @@ constexpr uint32_t kGeoRadiusByMember = WRITE | GEO | SLOW;
 
 void ZSetFamily::Register(CommandRegistry* registry) {
   constexpr uint32_t kStoreMask = CO::WRITE | CO::VARIADIC_KEYS | CO::DENYOOM;
+  constexpr uint32_t kJournaledStoreMask = kStoreMask | CO::NO_AUTOJOURNAL;
   registry->StartFamily();
   // TODO: to add support for SCRIPT for BZPOPMIN, BZPOPMAX similarly to BLPOP.
   *registry
@@ -3289,7 +3445,7 @@ void ZSetFamily::Register(CommandRegistry* registry) {
       << CI{"ZCOUNT", CO::FAST | CO::READONLY, 4, 1, 1, acl::kZCount}.HFUNC(ZCount)
       << CI{"ZDIFF", CO::READONLY | CO::VARIADIC_KEYS, -3, 2, 2, acl::kZDiff}.HFUNC(ZDiff)
       << CI{"ZINCRBY", CO::FAST | CO::WRITE, 4, 1, 1, acl::kZIncrBy}.HFUNC(ZIncrBy)
-      << CI{"ZINTERSTORE", kStoreMask, -4, 3, 3, acl::kZInterStore}.HFUNC(ZInterStore)
+      << CI{"ZINTERSTORE", kJournaledStoreMask, -4, 3, 3, acl::kZInterStore}.HFUNC(ZInterStore)
       << CI{"ZINTER", kStoreMask, -3, 2, 2, acl::kZInter}.HFUNC(ZInter)
       << CI{"ZINTERCARD", CO::READONLY | CO::VARIADIC_KEYS, -3, 2, 2, acl::kZInterCard}.HFUNC(
              ZInterCard)
@@ -3314,7 +3470,7 @@ void ZSetFamily::Register(CommandRegistry* registry) {
       << CI{"ZREVRANK", CO::READONLY | CO::FAST, 3, 1, 1, acl::kZRevRank}.HFUNC(ZRevRank)
       << CI{"ZSCAN", CO::READONLY, -3, 1, 1, acl::kZScan}.HFUNC(ZScan)
       << CI{"ZUNION", CO::READONLY | CO::VARIADIC_KEYS, -3, 2, 2, acl::kZUnion}.HFUNC(ZUnion)
-      << CI{"ZUNIONSTORE", kStoreMask, -4, 3, 3, acl::kZUnionStore}.HFUNC(ZUnionStore)
+      << CI{"ZUNIONSTORE", kJournaledStoreMask, -4, 3, 3, acl::kZUnionStore}.HFUNC(ZUnionStore)
 
       // GEO functions
       << CI{"GEOADD", CO::FAST | CO::WRITE | CO::DENYOOM, -5, 1, 1, acl::kGeoAdd}.HFUNC(GeoAdd)
@@ -301,6 +301,22 @@ TEST_F(ZSetFamilyTest, LargeSet) {
   EXPECT_EQ(2, CheckedInt({"zremrangebyscore", "key", "127", "(129"}));
 }
 
+TEST_F(ZSetFamilyTest, LargeZAdd) {
+  vector<string> args = {"zadd", "key"};
+  for (int i = 0; i < 300; ++i) {
+    args.push_back(absl::StrCat(300 - i));
+    args.push_back(absl::StrCat("element:", i));
+  }
+  args.push_back("0");
+  args.push_back("element:7");
+
+  EXPECT_THAT(Run(args), IntArg(300));
+  EXPECT_EQ(300, CheckedInt({"zcard", "key"}));
+  EXPECT_EQ("0", Run({"zscore", "key", "element:7"}));
+  EXPECT_THAT(Run({"zrange", "key", "0", "1"}), RespArray(ElementsAre("element:7", "element:299")));
+  EXPECT_THAT(Run({"zrank", "key", "element:0"}), IntArg(299));
+}
+
 TEST_F(ZSetFamilyTest, ZRemRangeRank) {
   Run({"zadd", "x", "1.1", "a", "2.1", "b"});
   EXPECT_THAT(Run({"ZREMRANGEBYRANK", "y", "0", "1"}), IntArg(0));
@@ -628,6 +644,30 @@ TEST_F(ZSetFamilyTest, ZUnionStoreOpts) {
   EXPECT_THAT(resp.GetVec(), ElementsAre("c", "0", "a", "2", "b", "4"));
 }
 
+TEST_F(ZSetFamilyTest, ZUnionStoreManyKeys) {
+  // Keys spread over the shards, with overlapping members.
+  vector<string> cmd = {"zunionstore", "dest", "20"};
+  for (unsigned i = 0; i < 20; ++i) {
+    string key = absl::StrCat("z", i);
+    for (unsigned j = i; j < 100; j += 2)
+      Run({"zadd", key, "1", absl::StrCat("m", j)});
+    cmd.push_back(key);
+  }
+  cmd.insert(cmd.end(), {"aggregate", "sum"});
+
+  EXPECT_THAT(Run(absl::MakeSpan(cmd)), IntArg(100));
+  // mj is in the keys i <= j of the same parity.
+  EXPECT_EQ(Run({"zscore", "dest", "m0"}), "1");
+  EXPECT_EQ(Run({"zscore", "dest", "m7"}), "4");
+  EXPECT_EQ(Run({"zscore", "dest", "m99"}), "10");
+
+  cmd[0] = "zunion";
+  cmd.erase(cmd.begin() + 1);
+  auto resp = Run(absl::MakeSpan(cmd));
+  ASSERT_THAT(resp, ArrLen(100));
+  EXPECT_EQ(resp.GetVec()[0], "m0");
+}
+
 TEST_F(ZSetFamilyTest, ZInterStore) {
   EXPECT_EQ(2, CheckedInt({"zadd", "z1", "1", "a", "2", "b"}));
   EXPECT_EQ(2, CheckedInt({"zadd", "z2", "3", "c", "2", "b"}));
@@ -1060,6 +1100,11 @@ TEST_F(ZSetFamilyTest, GeoSearch) {
                                 RespArray(ElementsAre(DoubleArg(3.7038), DoubleArg(40.4168))))),
           RespArray(ElementsAre("Lisbon", DoubleArg(502.20769462704084),
                                 RespArray(ElementsAre(DoubleArg(9.1427), DoubleArg(38.7369))))))));
+
+  // ANY stops at COUNT matches, even if they are spread over several boxes.
+  resp = Run({"GEOSEARCH", "Europe", "FROMLONLAT", "13.4050", "52.5200", "BYRADIUS", "3000", "KM",
+              "COUNT", "3", "ANY"});
+  EXPECT_THAT(resp, ArrLen(3));
 }
 
 TEST_F(ZSetFamilyTest, GeoRadiusByMember) {
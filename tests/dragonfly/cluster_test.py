@@ -1127,11 +1127,12 @@ async def test_cluster_data_migration(df_local_factory: DflyInstanceFactory):
             "DFLYCLUSTER", "SLOT-MIGRATION-STATUS", nodes[1].id
         )
     ).startswith(f"out {nodes[1].id} FINISHED keys:7")
-    assert (
-        await nodes[1].admin_client.execute_command(
-            "DFLYCLUSTER", "SLOT-MIGRATION-STATUS", nodes[0].id
-        )
-    ).startswith(f"in {nodes[0].id} FINISHED keys:7")
+    in_status = await nodes[1].admin_client.execute_command(
+        "DFLYCLUSTER", "SLOT-MIGRATION-STATUS", nodes[0].id
+    )
+    assert in_status.startswith(f"in {nodes[0].id} FINISHED keys:7")
+    # Every migrated key arrives as one applied RESTORE entry
+    assert int(re.search(r"applied:(\d+)", in_status).group(1)) >= 7
 
     nodes[0].migrations = []
     nodes[0].slots = [(0, 2999)]
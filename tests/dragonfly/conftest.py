@@ -245,6 +245,18 @@ def pytest_addoption(parser):
         default=None,
         help="Provide a port to the existing memcached process for the test",
     )
+    parser.addoption(
+        "--perf-baseline",
+        action="store",
+        default=os.path.join(os.path.dirname(os.path.abspath(__file__)), "perf_baselines.json"),
+        help="File with the baselines the perf tests compare against",
+    )
+    parser.addoption(
+        "--perf-update",
+        action="store_true",
+        default=False,
+        help="Record the results of the perf tests as the new baselines instead of comparing",
+    )
 
 
 @pytest.fixture(scope="session")
@@ -437,6 +437,28 @@ async def test_keyspace_events(async_client: aioredis.Redis):
     assert set(ev["data"] for ev in events) == set(keys)
 
 
+@dfly_args(
+    {"notify_keyspace_events": "Ex", "keyspace_events_sink": "log", "keyspace_events_prefix": "k"}
+)
+async def test_keyspace_events_log(async_client: aioredis.Redis):
+    keys = set()
+    for i in range(10, 50):
+        keys.add(f"k{i}")
+        await async_client.set(f"k{i}", "X", px=100 + i)
+        await async_client.set(f"other{i}", "X", px=100 + i)
+
+    cursor, events = "0", set()
+    for _ in range(100):
+        cursor, lost, batch = await async_client.execute_command("KEYEVENTS", cursor, "COUNT", 8)
+        assert lost == 0
+        events.update(key for db, key in batch)
+        if len(events) >= len(keys):
+            break
+        await asyncio.sleep(0.05)
+
+    assert events == keys
+
+
 async def test_big_command(df_server, size=8 * 1024):
     reader, writer = await asyncio.open_connection("127.0.0.1", df_server.port)
 
@@ -116,6 +116,31 @@ async def test_http_api(df_server: DflyInstance):
     assert await client.ttl("foo") > 0
 
 
+@dfly_args({"proactor_threads": "1", "expose_http_api": "true"})
+async def test_http_key_api(df_server: DflyInstance):
+    client = df_server.client()
+    url = f"http://localhost:{df_server.port}/v1"
+    async with get_http_session() as session:
+        async with session.put(f"{url}/key?key=a%20b&ex=100", data=b"\x00raw\r\n") as resp:
+            assert resp.status == 200
+        async with session.get(f"{url}/key?key=a%20b") as resp:
+            assert resp.status == 200
+            assert await resp.read() == b"\x00raw\r\n"
+        async with session.get(f"{url}/key?key=missing") as resp:
+            assert resp.status == 404
+
+        async with session.post(f"{url}/mget", data="a b\nmissing\n") as resp:
+            assert resp.status == 200
+            assert (await resp.text()).strip() == '{"result":["\\u0000raw\\r\\n",null]}'
+
+        async with session.delete(f"{url}/key?key=a%20b") as resp:
+            assert resp.status == 200
+        async with session.delete(f"{url}/key?key=a%20b") as resp:
+            assert resp.status == 404
+
+    assert await client.exists("a b") == 0
+
+
 @dfly_args({"proactor_threads": "1", "expose_http_api": "true", "requirepass": "XXX"})
 async def test_password_on_http_api(df_server: DflyInstance):
     async with get_http_session("default", "badpass") as session:
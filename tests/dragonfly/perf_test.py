@@ -0,0 +1,208 @@
+"""
+End-to-end throughput checks. Every workload runs dfly_bench against a fresh Dragonfly and
+compares the throughput, latency percentiles and RSS with the baselines stored in the file
+passed with --perf-baseline. Use --perf-update to record new baselines on the reference machine.
+"""
+
+import asyncio
+import json
+import logging
+import os
+import subprocess
+from dataclasses import dataclass, field
+from pathlib import Path
+from typing import Dict, List
+
+import pytest
+from redis import asyncio as aioredis
+
+from .instance import DflyInstanceFactory
+from .utility import disconnect_clients, info_tick_timer, is_saving
+
+# Allowed regression relative to the baseline. Throughput may drop by the given fraction,
+# latencies and RSS may grow by it.
+TOLERANCES = {"qps": 0.10, "p50_usec": 0.25, "p99_usec": 0.30, "rss_bytes": 0.15}
+
+BENCH_ARGS = {
+    "proactor_threads": 2,
+    "c": 20,
+    "n": 50_000,
+    "qps": 100_000,  # per connection, so that the server is the bottleneck
+    "open_loop": "false",
+    "report_interval": 0,
+}
+
+
+@dataclass
+class Workload:
+    name: str
+    bench_args: Dict[str, object] = field(default_factory=dict)
+    # Contents of the dfly_bench --workload file, see its description in dfly_bench.
+    commands: List[str] = field(default_factory=list)
+    df_args: Dict[str, object] = field(default_factory=dict)
+    setup: List[str] = field(default_factory=list)
+    # Number of hashes doc:<i> to create with the field n = i and a tag, for FT.SEARCH.
+    docs: int = 0
+    # Started next to dfly_bench to measure the impact of background work.
+    background: str = ""
+
+
+WORKLOADS = [
+    Workload(
+        "get_set",
+        bench_args={"ratio": "1:10", "d": 64, "key_maximum": 999_999},
+        setup=["DEBUG POPULATE 1000000 key 64"],
+    ),
+    Workload(
+        "mget_pipelined",
+        bench_args={"pipeline": 10, "key_maximum": 999_999},
+        commands=["1 mget " + " ".join(["__key__"] * 8)],
+        setup=["DEBUG POPULATE 1000000 key 64"],
+    ),
+    Workload(
+        "hset",
+        bench_args={"key_prefix": "hash:", "key_maximum": 10_000},
+        commands=["1 32 hset __key__ __key__ __data__"],
+    ),
+    Workload(
+        "zadd",
+        bench_args={"key_prefix": "zset:", "key_maximum": 10_000},
+        commands=["1 zadd __key__ 1 __key__"],
+    ),
+    Workload(
+        "ft_search",
+        bench_args={"key_prefix": "", "key_maximum": 99_999, "n": 10_000},
+        commands=["1 ft.search idx @n:[__key__ +inf] LIMIT 0 10"],
+        setup=["FT.CREATE idx ON HASH PREFIX 1 doc: SCHEMA n NUMERIC SORTABLE tag TAG"],
+        docs=100_000,
+    ),
+    Workload(
+        "bgsave_get_set",
+        bench_args={"ratio": "1:10", "d": 64, "key_maximum": 999_999},
+        df_args={"dir": "{DRAGONFLY_TMP}/", "dbfilename": "perf-bgsave"},
+        setup=["DEBUG POPULATE 1000000 key 64"],
+        background="BGSAVE",
+    ),
+    Workload(
+        "tiered_get",
+        bench_args={"ratio": "0:1", "key_maximum": 199_999},
+        df_args={"tiered_prefix": "{DRAGONFLY_TMP}/perf-tiered"},
+        setup=["DEBUG POPULATE 200000 key 4096 RAND"],
+    ),
+]
+
+
+def dfly_bench_path() -> str:
+    dragonfly = os.environ.get(
+        "DRAGONFLY_PATH",
+        os.path.join(os.path.dirname(os.path.abspath(__file__)), "../../build-dbg/dragonfly"),
+    )
+    return os.environ.get("DFLY_BENCH_PATH", os.path.join(os.path.dirname(dragonfly), "dfly_bench"))
+
+
+@pytest.fixture(scope="module")
+def perf_baselines(request):
+    path = Path(request.config.getoption("--perf-baseline"))
+    baselines = json.loads(path.read_text()) if path.exists() else {}
+    yield baselines
+    if request.config.getoption("--perf-update"):
+        path.write_text(json.dumps(baselines, indent=2, sort_keys=True) + "\n")
+        logging.info(f"Wrote the perf baselines to {path}")
+
+
+async def run_setup(client: aioredis.Redis, workload: Workload):
+    for cmd in workload.setup:
+        await client.execute_command(cmd)
+
+    for start in range(0, workload.docs, 1000):
+        pipe = client.pipeline(transaction=False)
+        for i in range(start, min(start + 1000, workload.docs)):
+            pipe.hset(f"doc:{i}", mapping={"n": i, "tag": f"t{i % 100}"})
+        await pipe.execute()
+
+    if "tiered_prefix" in workload.df_args:
+        # Wait for the values to be offloaded so that the reads hit the disk.
+        async for info, breaker in info_tick_timer(client, section="TIERED", timeout=60):
+            with breaker:
+                assert info["tiered_entries"] > 150_000
+
+
+async def run_background(client: aioredis.Redis, cmd: str, bench: subprocess.Popen):
+    await asyncio.sleep(1)
+    while bench.poll() is None:
+        await client.execute_command(cmd)
+        while await is_saving(client):
+            await asyncio.sleep(0.1)
+
+
+def check_regressions(measured: Dict[str, float], baseline: Dict[str, float]) -> List[str]:
+    failures = []
+    for metric, tolerance in TOLERANCES.items():
+        if metric not in baseline:
+            continue
+        if metric == "qps":
+            limit = baseline[metric] * (1 - tolerance)
+            ok = measured[metric] >= limit
+        else:
+            limit = baseline[metric] * (1 + tolerance)
+            ok = measured[metric] <= limit
+        if not ok:
+            failures.append(
+                f"{metric}: {measured[metric]:.1f}, baseline {baseline[metric]:.1f}, "
+                f"limit {limit:.1f}"
+            )
+    return failures
+
+
+@pytest.mark.perf
+@pytest.mark.slow
+@pytest.mark.opt_only
+@pytest.mark.parametrize("workload", WORKLOADS, ids=[w.name for w in WORKLOADS])
+async def test_throughput(
+    workload: Workload, df_local_factory: DflyInstanceFactory, perf_baselines, tmp_dir, request
+):
+    bench = dfly_bench_path()
+    if not os.path.exists(bench):
+        pytest.skip(f"dfly_bench not found at {bench}, set DFLY_BENCH_PATH")
+
+    update = request.config.getoption("--perf-update")
+    baseline = perf_baselines.get(workload.name)
+    if baseline is None and not update:
+        pytest.skip(f"No baseline for {workload.name}, record it with --perf-update")
+
+    server = df_local_factory.create(proactor_threads=4, num_shards=4, **workload.df_args)
+    df_local_factory.start_all([server])
+    client = server.client()
+    await run_setup(client, workload)
+
+    summary_file = tmp_dir / f"perf-{workload.name}.json"
+    args = {**BENCH_ARGS, **workload.bench_args, "p": server.port, "summary_file": summary_file}
+    if workload.commands:
+        workload_file = tmp_dir / f"perf-{workload.name}.txt"
+        workload_file.write_text("\n".join(workload.commands) + "\n")
+        args["workload"] = workload_file
+
+    cmd = [bench] + [f"--{k}={v}" for k, v in args.items()]
+    logging.info(f"Running {' '.join(cmd)}")
+    proc = subprocess.Popen(cmd, stdout=subprocess.DEVNULL)
+    background = None
+    if workload.background:
+        background = asyncio.create_task(run_background(client, workload.background, proc))
+    while proc.poll() is None:
+        await asyncio.sleep(0.1)
+    if background:
+        await background
+    assert proc.returncode == 0, f"dfly_bench failed with {proc.returncode}"
+
+    measured = json.loads(summary_file.read_text())
+    await asyncio.sleep(1)  # Wait for another RSS heartbeat update in Dragonfly
+    measured["rss_bytes"] = (await client.info("memory"))["used_memory_peak_rss"]
+    await disconnect_clients(client)
+    logging.info(f"{workload.name}: {measured}")
+
+    if update:
+        perf_baselines[workload.name] = {metric: measured[metric] for metric in TOLERANCES}
+        return
+
+    failures = check_regressions(measured, baseline)
+    assert not failures, f"{workload.name} regressed:\n" + "\n".join(failures)
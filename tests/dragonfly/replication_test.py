@@ -2203,3 +2203,146 @@ async def test_replica_reconnect(df_local_factory, break_conn):
     assert await c_replica.execute_command("get k") == "6789"
 
     await disconnect_clients(c_master, c_replica)
+
+
+@pytest.mark.asyncio
+async def test_wait_lsn(df_local_factory):
+    master = df_local_factory.create(proactor_threads=2)
+    replica = df_local_factory.create(proactor_threads=2)
+    df_local_factory.start_all([master, replica])
+
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    for i in range(100):
+        await c_master.execute_command(f"SET k{i} {i}")
+    token = await c_master.execute_command("LSNTOKEN")
+
+    assert await c_replica.execute_command("WAITLSN", token, 0) == 1
+    assert await c_replica.execute_command("GET k99") == "99"
+
+    # The replica can not get ahead of the master.
+    ahead = ",".join(str(int(lsn) + 1000) for lsn in token.split(","))
+    assert await c_replica.execute_command("WAITLSN", ahead, 100) == 0
+
+    await disconnect_clients(c_master, c_replica)
+
+
+@pytest.mark.parametrize("effects_limit", [0, 4096])
+@pytest.mark.asyncio
+async def test_zset_store_replication(df_local_factory, effects_limit):
+    master = df_local_factory.create(proactor_threads=4, zset_store_effects_limit=effects_limit)
+    replica = df_local_factory.create(proactor_threads=4)
+    df_local_factory.start_all([master, replica])
+
+    c_master = master.client()
+    c_replica = replica.client()
+
+    await c_replica.execute_command(f"REPLICAOF localhost {master.port}")
+    await wait_available_async(c_replica)
+
+    for i in range(10):
+        await c_master.zadd(f"z{i}", {f"m{j}": i * 0.1 + j for j in range(i, i + 50)})
+
+    await c_master.execute_command("ZUNIONSTORE dest1 10 " + " ".join(f"z{i}" for i in range(10)))
+    await c_master.execute_command("ZINTERSTORE dest2 2 z0 z1 WEIGHTS 1.5 3")
+    await c_master.execute_command("ZINTERSTORE dest3 2 z0 z9")  # empty result
+    await check_all_replicas_finished([c_replica], c_master)
+
+    for key in ["dest1", "dest2", "dest3"]:
+        assert await c_replica.zrange(key, 0, -1, withscores=True) == await c_master.zrange(
+            key, 0, -1, withscores=True
+        )
+
+    await disconnect_clients(c_master, c_replica)
+
+
+@pytest.mark.asyncio
+async def test_replica_warm_restart(df_local_factory):
+    tmp_file_name = "".join(random.choices(string.ascii_letters, k=10))
+
+    master = df_local_factory.create(proactor_threads=2)
+    master.start()
+    replica = df_local_factory.create(
+        proactor_threads=2,
+        dbfilename=f"dump_{tmp_file_name}",
+        replicaof=f"localhost:{master.port}",
+        replica_warm_restart=True,
+    )
+    replica.start()
+
+    c_master = master.client()
+    c_replica = replica.client()
+    await c_master.execute_command("DEBUG POPULATE 10000")
+    await wait_available_async(c_replica)
+    await check_all_replicas_finished([c_replica], c_master)
+    await c_replica.close()
+
+    # The shutdown snapshot of the replica saves the LSNs it applied.
+    replica.stop()
+    for i in range(100):
+        await c_master.execute_command(f"SET k{i} {i}")
+
+    replica.start()
+    c_replica = replica.client()
+    await wait_available_async(c_replica)
+    await check_all_replicas_finished([c_replica], c_master)
+    assert await c_replica.execute_command("DBSIZE") == 10100
+    assert await c_replica.execute_command("GET k99") == "99"
+
+    await disconnect_clients(c_master, c_replica)
+    replica.stop()
+    assert replica.is_in_logs("Started partial sync")
+
+
+@pytest.mark.asyncio
+async def test_shared_full_sync(df_local_factory):
+    master = df_local_factory.create(proactor_threads=2, replication_shared_sync_window_ms=2000)
+    replicas = [df_local_factory.create(proactor_threads=2) for _ in range(3)]
+    df_local_factory.start_all([master, *replicas])
+
+    c_master = master.client()
+    await c_master.execute_command("DEBUG POPULATE 100000 key 100")
+    c_replicas = [replica.client() for replica in replicas]
+    await asyncio.gather(*(c.replicaof("localhost", master.port) for c in c_replicas))
+
+    # Writes during the shared full sync reach all the replicas through their streamers.
+    for i in range(100):
+        await c_master.set(f"k{i}", i)
+
+    await wait_for_replicas_state(*c_replicas)
+    await check_all_replicas_finished(c_replicas, c_master)
+    for c in c_replicas:
+        assert await c.dbsize() == 100100
+        assert await c.get("k99") == "99"
+
+    await disconnect_clients(c_master, *c_replicas)
+    assert master.is_in_logs("Started a full sync shared by 3 replicas")
+
+
+@pytest.mark.asyncio
+async def test_shared_full_sync_replica_crash(df_local_factory):
+    master = df_local_factory.create(proactor_threads=2, replication_shared_sync_window_ms=2000)
+    replicas = [df_local_factory.create(proactor_threads=2) for _ in range(2)]
+    df_local_factory.start_all([master, *replicas])
+
+    c_master = master.client()
+    await c_master.execute_command("DEBUG POPULATE 500000 key 1000")
+    c_replicas = [replica.client() for replica in replicas]
+    await asyncio.gather(*(c.replicaof("localhost", master.port) for c in c_replicas))
+
+    # Kill one replica in the middle of the full sync, the other one must finish it.
+    await asyncio.sleep(2.5)
+    await c_replicas[0].close()
+    replicas[0].stop(kill=True)
+
+    await wait_for_replicas_state(c_replicas[1])
+    await check_all_replicas_finished([c_replicas[1]], c_master)
+    assert await c_replicas[1].dbsize() == 500000
+
+    info = await c_master.info("replication")
+    assert info["connected_slaves"] == 1
+    await disconnect_clients(c_master, c_replicas[1])
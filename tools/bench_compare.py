@@ -0,0 +1,67 @@
+#!/usr/bin/env python3
+
+"""
+Compares two runs of the microbenchmarks embedded in the unit tests and fails on regressions.
+
+The benchmarks run with the --bench flag of a test binary, for example:
+
+    ./string_set_test --gtest_filter=-* --bench --benchmark_out=base.json \
+        --benchmark_out_format=json
+
+Then, after the change:
+
+    tools/bench_compare.py base.json new.json --threshold 10
+"""
+
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        data = json.load(f)
+
+    res = {}
+    for bench in data["benchmarks"]:
+        # Skip the aggregates of repeated runs, except for the median.
+        if bench.get("run_type") == "aggregate" and bench.get("aggregate_name") != "median":
+            continue
+        res[bench["name"]] = bench["cpu_time"]
+    return res
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Compare Google Benchmark JSON outputs")
+    parser.add_argument("base", help="JSON output of the baseline run")
+    parser.add_argument("new", help="JSON output of the new run")
+    parser.add_argument(
+        "--threshold", type=float, default=10, help="Allowed slowdown in percent (default: 10)"
+    )
+    args = parser.parse_args()
+
+    base = load(args.base)
+    new = load(args.new)
+
+    regressions = []
+    print(f"{'benchmark':<50} {'base':>12} {'new':>12} {'change':>8}")
+    for name, base_time in base.items():
+        if name not in new:
+            continue
+        change = (new[name] - base_time) * 100 / base_time if base_time > 0 else 0
+        print(f"{name:<50} {base_time:>12.1f} {new[name]:>12.1f} {change:>+7.1f}%")
+        if change > args.threshold:
+            regressions.append(name)
+
+    missing = sorted(set(base) - set(new))
+    if missing:
+        print("Missing in the new run: " + ", ".join(missing))
+
+    if regressions:
+        print(f"Regressed by more than {args.threshold}%: " + ", ".join(regressions))
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,112 @@
+package main
+
+import (
+	"math/bits"
+	"sort"
+	"strings"
+	"sync"
+	"sync/atomic"
+	"time"
+
+	"github.com/pterm/pterm"
+)
+
+// Every power of two range of latencies is split into this many buckets, which bounds the error
+// of the reported percentiles by 1/kSubBuckets.
+const kSubBuckets = 8
+
+// Log-linear latency histogram in microseconds, safe for concurrent use.
+type Histogram struct {
+	counts [64 * kSubBuckets]uint64
+	total  uint64
+	max    uint64
+}
+
+func bucketOf(usec uint64) int {
+	shift := bits.Len64(usec) - bits.Len64(kSubBuckets)
+	if shift < 0 {
+		shift = 0
+	}
+	return shift*kSubBuckets + int(usec>>shift)
+}
+
+// Largest latency that falls into the bucket.
+func bucketUpperBound(bucket int) uint64 {
+	if bucket < 2*kSubBuckets {
+		return uint64(bucket)
+	}
+	shift := bucket/kSubBuckets - 1
+	return (uint64(bucket-shift*kSubBuckets+1) << shift) - 1
+}
+
+func (h *Histogram) Record(latency time.Duration) {
+	usec := uint64(latency.Microseconds())
+	atomic.AddUint64(&h.counts[bucketOf(usec)], 1)
+	atomic.AddUint64(&h.total, 1)
+	for {
+		max := atomic.LoadUint64(&h.max)
+		if usec <= max || atomic.CompareAndSwapUint64(&h.max, max, usec) {
+			break
+		}
+	}
+}
+
+// Returns the latency below which the fraction q of the samples fall.
+func (h *Histogram) Quantile(q float64) time.Duration {
+	target := uint64(q * float64(atomic.LoadUint64(&h.total)))
+	var seen uint64
+	for i := range h.counts {
+		seen += atomic.LoadUint64(&h.counts[i])
+		if seen > target {
+			return time.Duration(bucketUpperBound(i)) * time.Microsecond
+		}
+	}
+	return time.Duration(atomic.LoadUint64(&h.max)) * time.Microsecond
+}
+
+// Latency histograms by command name.
+type LatencyStats struct {
+	mu       sync.Mutex
+	commands map[string]*Histogram
+}
+
+func NewLatencyStats() *LatencyStats {
+	return &LatencyStats{commands: make(map[string]*Histogram)}
+}
+
+func (s *LatencyStats) Get(cmd string) *Histogram {
+	cmd = strings.ToUpper(cmd)
+	s.mu.Lock()
+	defer s.mu.Unlock()
+	h, ok := s.commands[cmd]
+	if !ok {
+		h = &Histogram{}
+		s.commands[cmd] = h
+	}
+	return h
+}
+
+func (s *LatencyStats) Render() (string, error) {
+	s.mu.Lock()
+	defer s.mu.Unlock()
+
+	names := make([]string, 0, len(s.commands))
+	for name := range s.commands {
+		names = append(names, name)
+	}
+	sort.Strings(names)
+
+	tableData := pterm.TableData{{"command", "count", "p50", "p99", "p99.9", "max"}}
+	for _, name := range names {
+		h := s.commands[name]
+		tableData = append(tableData, []string{
+			name,
+			pterm.Sprint(atomic.LoadUint64(&h.total)),
+			h.Quantile(0.5).String(),
+			h.Quantile(0.99).String(),
+			h.Quantile(0.999).String(),
+			(time.Duration(atomic.LoadUint64(&h.max)) * time.Microsecond).String(),
+		})
+	}
+	return pterm.DefaultTable.WithHasHeader().WithBoxed().WithData(tableData).Srender()
+}
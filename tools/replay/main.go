@@ -16,6 +16,7 @@ import (
 
 var fHost = flag.String("host", "127.0.0.1:6379", "Redis host")
 var fClientBuffer = flag.Int("buffer", 100, "How many records to buffer per client")
+var fSpeed = flag.Float64("speed", 1, "Replay speed factor relative to the recording, 0 ignores the timing")
 
 type RecordHeader struct {
 	Client  uint32
@@ -53,7 +54,9 @@ type ClientWorker struct {
 // Handles a single file and distributes messages to clients
 type FileWorker struct {
 	clientGroup sync.WaitGroup
-	timeOffset  time.Duration
+	baseTime    time.Time // of the earliest record of all files
+	startTime   time.Time // when the earliest record is replayed
+	latencies   *LatencyStats
 	// stats for output, updated by clients, read by rendering goroutine
 	processed uint64
 	delayed   uint64
@@ -68,13 +71,17 @@ func (c ClientWorker) Run(worker *FileWorker) {
 			c.redis.Do(context.Background(), []interface{}{"SELECT", fmt.Sprint(msg.DbIndex)})
 		}
 
-		lag := time.Until(worker.HappensAt(time.Unix(0, int64(msg.Time))))
-		if lag < 0 {
-			atomic.AddUint64(&worker.delayed, 1)
+		if *fSpeed > 0 {
+			lag := time.Until(worker.HappensAt(time.Unix(0, int64(msg.Time))))
+			if lag < 0 {
+				atomic.AddUint64(&worker.delayed, 1)
+			}
+			time.Sleep(lag)
 		}
-		time.Sleep(lag)
 
+		start := time.Now()
 		c.redis.Do(context.Background(), msg.values...).Result()
+		worker.latencies.Get(msg.values[0].(string)).Record(time.Since(start))
 		atomic.AddUint64(&worker.processed, 1)
 		c.processed += 1
 	}
@@ -118,7 +125,8 @@ func (w *FileWorker) Run(file string, wg *sync.WaitGroup) {
 }
 
 func (w *FileWorker) HappensAt(recordTime time.Time) time.Time {
-	return recordTime.Add(w.timeOffset)
+	offset := float64(recordTime.Sub(w.baseTime)) / *fSpeed
+	return w.startTime.Add(time.Duration(offset))
 }
 
 func RenderTable(area *pterm.AreaPrinter, files []string, workers []FileWorker) {
@@ -140,14 +148,16 @@ func main() {
 	flag.Parse()
 	files := flag.Args()
 
-	timeOffset := time.Now().Add(500 * time.Millisecond).Sub(DetermineBaseTime(files))
-	fmt.Println("Offset -> ", timeOffset)
+	baseTime := DetermineBaseTime(files)
+	startTime := time.Now().Add(500 * time.Millisecond)
+	fmt.Println("Offset -> ", startTime.Sub(baseTime))
+	latencies := NewLatencyStats()
 
 	// Start a worker for every file. They take care of spawning client workers.
 	var wg sync.WaitGroup
 	workers := make([]FileWorker, len(files))
 	for i := range workers {
-		workers[i] = FileWorker{timeOffset: timeOffset}
+		workers[i] = FileWorker{baseTime: baseTime, startTime: startTime, latencies: latencies}
 		wg.Add(1)
 		go workers[i].Run(files[i], &wg)
 	}
@@ -170,4 +180,8 @@ func main() {
 	}
 
 	RenderTable(area, files, workers) // to show last stats
+	area.Stop()
+
+	content, _ := latencies.Render()
+	fmt.Println(content)
 }